@@ -0,0 +1,387 @@
+//! `slvsx animate`: drive one parameter of a document over a range and draw
+//! the solution at each value as a frame, all from one process.
+//!
+//! Frames are solved one after another from a compiled system (see
+//! `slvsx_core::compiled`), so each starts from the solution before it and
+//! keeps to the assembly of the mechanism the first one solved to. Each
+//! solved frame is handed to a pool of threads that project and write it,
+//! so the next frame is solved while the last ones are drawn.
+//!
+//! Every frame shows the same part of the model: the extent given, or else
+//! the one that takes in every frame. Without an extent given, SVG frames
+//! are drawn as they're solved and framed once the last one is; PNG frames
+//! can only be drawn once every frame is solved.
+
+use crate::commands::ViewPlane;
+use crate::io::InputReader;
+use crate::json_error::parse_json_bytes_with_context;
+use crate::sweep::parse_axis;
+use anyhow::{anyhow, Result};
+use slvsx_core::{
+    ir::ResolvedEntity,
+    solver::{Solver, SolverConfig},
+    validator::Validator,
+    InputDocument,
+};
+use slvsx_exporters::{png::PngExporter, svg::SvgExporter, StreamExporter};
+use std::collections::HashMap;
+use std::io::Write;
+use std::path::{Path, PathBuf};
+use std::sync::mpsc::{channel, sync_channel};
+use std::sync::Mutex;
+use std::thread;
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum AnimateFormat {
+    /// An SVG file per frame
+    Svg,
+    /// One SVG that shows each frame in turn, by SMIL animation
+    SvgAnimated,
+    /// A PNG file per frame
+    Png,
+}
+
+#[derive(Clone, Copy, Debug)]
+pub struct AnimateOptions {
+    pub format: AnimateFormat,
+    pub view: ViewPlane,
+    /// Threads drawing frames
+    pub jobs: usize,
+    /// Frames a second, for an animated SVG
+    pub fps: f64,
+    /// `[min_x, min_y, max_x, max_y]` in the view to frame every frame
+    /// around, rather than the extent of them all
+    pub extent: Option<[f64; 4]>,
+}
+
+type Frame = HashMap<String, ResolvedEntity>;
+
+/// A frame drawn: its number, and unless it was written to its own file
+/// already, its SVG elements and their extent
+struct Drawn {
+    index: usize,
+    body: Vec<u8>,
+    extent: Option<[f64; 4]>,
+}
+
+/// Parse `min_x,min_y,max_x,max_y`
+pub fn parse_extent(spec: &str) -> Result<[f64; 4]> {
+    let values: Vec<f64> = spec
+        .split(',')
+        .map(|s| {
+            s.trim()
+                .parse()
+                .map_err(|_| anyhow!("'{}' isn't a number, in '{}'", s.trim(), spec))
+        })
+        .collect::<Result<_>>()?;
+    match values[..] {
+        [min_x, min_y, max_x, max_y] if min_x < max_x && min_y < max_y => {
+            Ok([min_x, min_y, max_x, max_y])
+        }
+        _ => Err(anyhow!(
+            "Expected min_x,min_y,max_x,max_y, each min below its max, in '{}'",
+            spec
+        )),
+    }
+}
+
+/// The extent that takes in all of several
+fn union(extents: impl IntoIterator<Item = Option<[f64; 4]>>) -> Option<[f64; 4]> {
+    extents.into_iter().flatten().reduce(|a, b| {
+        [
+            a[0].min(b[0]),
+            a[1].min(b[1]),
+            a[2].max(b[2]),
+            a[3].max(b[3]),
+        ]
+    })
+}
+
+/// The file of frame `index` of `count`, numbered so they sort in order
+fn frame_path(dir: &Path, index: usize, count: usize, extension: &str) -> PathBuf {
+    let width = count.saturating_sub(1).to_string().len().max(4);
+    dir.join(format!("frame-{:0w$}.{}", index, extension, w = width))
+}
+
+fn create(path: &Path) -> Result<std::io::BufWriter<std::fs::File>> {
+    let file = std::fs::File::create(path)
+        .map_err(|e| anyhow!("Failed to create {}: {}", path.display(), e))?;
+    Ok(std::io::BufWriter::with_capacity(64 * 1024, file))
+}
+
+/// Animate command handler: solve the document at each of `param`'s
+/// values (as `name=start:stop:step` or `name=v1,v2,...`), and write the
+/// frames to `output`, a directory for a file per frame or the file of an
+/// animated SVG
+pub fn handle_animate<R: InputReader + ?Sized>(
+    reader: &mut R,
+    filename: &str,
+    param: &str,
+    output: &str,
+    options: AnimateOptions,
+) -> Result<()> {
+    let axis = parse_axis(param)?;
+    if options.fps.is_nan() || options.fps <= 0.0 {
+        return Err(anyhow!("--fps must be above 0"));
+    }
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
+    Validator::new().validate(&doc)?;
+    let mut system = Solver::new(SolverConfig::default()).compile(&doc)?;
+    drop(doc);
+
+    let format = options.format;
+    let dir = Path::new(output);
+    if format != AnimateFormat::SvgAnimated {
+        std::fs::create_dir_all(dir)
+            .map_err(|e| anyhow!("Failed to create {}: {}", dir.display(), e))?;
+    }
+    let count = axis.values.len();
+    let svg = SvgExporter::new(options.view.into());
+
+    let name = &axis.name;
+    let solved = axis
+        .values
+        .iter()
+        .enumerate()
+        .map(move |(index, &value)| -> Result<Frame> {
+            system.set_parameter(name, value)?;
+            let result = system.resolve().map_err(|e| {
+                anyhow!("Frame {} ({} = {}) didn't solve: {}", index, name, value, e)
+            })?;
+            Ok(result.entities.unwrap_or_default())
+        });
+
+    // A PNG is drawn to fit its extent, so without one given every frame
+    // has to be solved first
+    let mut extent = options.extent;
+    let solved: Box<dyn Iterator<Item = Result<Frame>> + '_> =
+        if format == AnimateFormat::Png && extent.is_none() {
+            let frames = solved.collect::<Result<Vec<_>>>()?;
+            extent = union(frames.iter().map(|f| svg.extent(f)));
+            Box::new(frames.into_iter().map(Ok))
+        } else {
+            Box::new(solved)
+        };
+
+    let jobs = options.jobs.max(1);
+    let (frames, queue) = sync_channel::<(usize, Frame)>(2 * jobs);
+    let queue = Mutex::new(queue);
+    let (results, finished) = channel::<Result<Drawn>>();
+    let draw = |index: usize, frame: &Frame| -> Result<Drawn> {
+        let mut body = Vec::new();
+        match (format, extent) {
+            (AnimateFormat::Png, _) => {
+                let mut png = PngExporter::new(options.view.into());
+                if let Some(e) = extent {
+                    png = png.with_extent(e);
+                }
+                let mut out = create(&frame_path(dir, index, count, "png"))?;
+                png.write_to(frame, &mut out)?;
+                out.flush()?;
+            }
+            (AnimateFormat::Svg, Some(e)) => {
+                let mut out = create(&frame_path(dir, index, count, "svg"))?;
+                SvgExporter::new(options.view.into())
+                    .with_extent(e)
+                    .write_to(frame, &mut out)?;
+                out.flush()?;
+            }
+            _ => svg.write_elements(frame, &mut body)?,
+        }
+        Ok(Drawn {
+            index,
+            body,
+            extent: svg.extent(frame),
+        })
+    };
+
+    let solving = thread::scope(|scope| -> Result<()> {
+        for _ in 0..jobs {
+            let (queue, results, draw) = (&queue, results.clone(), &draw);
+            scope.spawn(move || loop {
+                let job = queue.lock().map(|q| q.recv());
+                let Ok(Ok((index, frame))) = job else { break };
+                if results.send(draw(index, &frame)).is_err() {
+                    break;
+                }
+            });
+        }
+        // The pool stops once every frame is handed out, or a frame fails
+        let frames = frames;
+        for (index, frame) in solved.enumerate() {
+            if frames.send((index, frame?)).is_err() {
+                break;
+            }
+        }
+        Ok(())
+    });
+    drop(results);
+    solving?;
+    let mut drawn = finished.into_iter().collect::<Result<Vec<_>>>()?;
+    drawn.sort_by_key(|d| d.index);
+
+    let extent = extent.or_else(|| union(drawn.iter().map(|d| d.extent)));
+    match format {
+        AnimateFormat::Svg if options.extent.is_none() => {
+            for d in &drawn {
+                let mut out = create(&frame_path(dir, d.index, count, "svg"))?;
+                svg.write_start(extent, &mut out)?;
+                out.write_all(&d.body)?;
+                write!(out, "</svg>")?;
+                out.flush()?;
+            }
+        }
+        AnimateFormat::SvgAnimated => {
+            let mut out = create(dir)?;
+            write_animated(&svg, extent, &drawn, options.fps, &mut out)?;
+            out.flush()?;
+        }
+        _ => {}
+    }
+    Ok(())
+}
+
+/// One SVG with each frame in a group of its own, shown for its share of
+/// the animation and hidden for the rest, looping
+fn write_animated(
+    svg: &SvgExporter,
+    extent: Option<[f64; 4]>,
+    drawn: &[Drawn],
+    fps: f64,
+    out: &mut dyn Write,
+) -> Result<()> {
+    let count = drawn.len().max(1) as f64;
+    svg.write_start(extent, out)?;
+    for d in drawn {
+        let (shown, hidden) = (d.index as f64 / count, (d.index + 1) as f64 / count);
+        writeln!(out, r#"<g display="none">"#)?;
+        writeln!(
+            out,
+            r#"  <animate attributeName="display" values="none;inline;none" keyTimes="0;{};{}" dur="{}s" calcMode="discrete" repeatCount="indefinite"/>"#,
+            shown,
+            hidden,
+            count / fps
+        )?;
+        out.write_all(&d.body)?;
+        writeln!(out, "</g>")?;
+    }
+    write!(out, "</svg>")?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::io::tests::MemoryReader;
+
+    /// A crank of length 10 turning about the origin by `angle`
+    const CRANK: &str = r#"{
+        "schema": "slvs-json/1",
+        "parameters": {"angle": 0},
+        "entities": [
+            {"type": "point", "id": "o", "at": [0, 0, 0]},
+            {"type": "point", "id": "x", "at": [10, 0, 0]},
+            {"type": "point", "id": "p", "at": [10, 1, 0]},
+            {"type": "line", "id": "base", "p1": "o", "p2": "x"},
+            {"type": "line", "id": "crank", "p1": "o", "p2": "p"}
+        ],
+        "constraints": [
+            {"type": "fixed", "entity": "o"},
+            {"type": "fixed", "entity": "x"},
+            {"type": "distance", "between": ["o", "p"], "value": 10},
+            {"type": "angle", "between": ["base", "crank"], "value": "$angle"}
+        ]
+    }"#;
+
+    fn options(format: AnimateFormat) -> AnimateOptions {
+        AnimateOptions {
+            format,
+            view: ViewPlane::Xy,
+            jobs: 2,
+            fps: 10.0,
+            extent: None,
+        }
+    }
+
+    fn animate(format: AnimateFormat, output: &Path) -> Result<()> {
+        let mut reader = MemoryReader::new(CRANK.to_string());
+        let output = output.to_str().unwrap();
+        handle_animate(
+            &mut reader,
+            "crank.json",
+            "angle=10:50:20",
+            output,
+            options(format),
+        )
+    }
+
+    #[test]
+    fn test_parse_extent() {
+        assert_eq!(
+            parse_extent("-1, -2, 3, 4").unwrap(),
+            [-1.0, -2.0, 3.0, 4.0]
+        );
+        assert!(parse_extent("1,2,3").is_err());
+        assert!(parse_extent("3,0,1,4").is_err());
+        assert!(parse_extent("a,0,1,4").is_err());
+    }
+
+    #[test]
+    fn test_frame_paths_sort_in_order() {
+        let dir = Path::new("out");
+        assert_eq!(frame_path(dir, 7, 12, "svg"), dir.join("frame-0007.svg"));
+        assert_eq!(
+            frame_path(dir, 7, 12_000, "png"),
+            dir.join("frame-00007.png")
+        );
+    }
+
+    #[test]
+    fn test_svg_frames_share_one_view() {
+        let dir = tempfile::tempdir().unwrap();
+        animate(AnimateFormat::Svg, dir.path()).unwrap();
+        let frames: Vec<String> = (0..3)
+            .map(|i| std::fs::read_to_string(frame_path(dir.path(), i, 3, "svg")).unwrap())
+            .collect();
+        let view = |svg: &str| svg.lines().next().unwrap().to_string();
+        assert!(frames.iter().all(|f| view(f) == view(&frames[0])));
+        assert!(frames.iter().all(|f| f.ends_with("</svg>")));
+        assert_ne!(frames[0], frames[2], "the crank didn't turn");
+    }
+
+    #[test]
+    fn test_animated_svg_shows_each_frame_in_turn() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("crank.svg");
+        animate(AnimateFormat::SvgAnimated, &path).unwrap();
+        let svg = std::fs::read_to_string(&path).unwrap();
+        assert_eq!(svg.matches("<animate ").count(), 3);
+        assert!(svg.contains(r#"keyTimes="0;0;0.3333333333333333""#));
+        assert!(svg.contains(r#"dur="0.3s""#));
+    }
+
+    #[test]
+    fn test_png_frames_are_written() {
+        let dir = tempfile::tempdir().unwrap();
+        animate(AnimateFormat::Png, dir.path()).unwrap();
+        for i in 0..3 {
+            let png = std::fs::read(frame_path(dir.path(), i, 3, "png")).unwrap();
+            assert!(png.starts_with(b"\x89PNG"));
+        }
+    }
+
+    #[test]
+    fn test_unknown_parameter_fails() {
+        let dir = tempfile::tempdir().unwrap();
+        let mut reader = MemoryReader::new(CRANK.to_string());
+        let output = dir.path().to_str().unwrap();
+        let result = handle_animate(
+            &mut reader,
+            "crank.json",
+            "r=1:2",
+            output,
+            options(AnimateFormat::Svg),
+        );
+        assert!(result.is_err());
+    }
+}
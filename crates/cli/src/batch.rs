@@ -0,0 +1,285 @@
+//! `slvsx solve --jsonl`: solve a stream of documents, one per line, on a
+//! pool of threads, writing one response per line as each is solved.
+//!
+//! Each output line is a `slvsx serve` response whose `id` is the number of
+//! the input line the document came from, so
+//! `{"id": 3, "ok": true, "result": { ... }}` is the solution to the third
+//! line. Blank lines are skipped. Only a bounded number of documents are
+//! held at once, counting both those being solved and those waiting to be
+//! written, so memory doesn't grow with the length of the input.
+//!
+//! With a shard, only every Nth line is solved (see `Shard::takes_line`),
+//! so that N runs can split a stream between them; their responses carry
+//! the line numbers, to be merged by.
+
+use crate::serve::{Request, Response, Worker};
+use crate::shard::Shard;
+use anyhow::{anyhow, Result};
+use std::collections::BTreeMap;
+use std::io::{BufRead, Write};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, sync_channel, Receiver};
+use std::sync::{Arc, Mutex};
+use std::thread;
+
+#[derive(Debug, Clone, Copy)]
+pub struct BatchOptions {
+    /// Threads solving documents
+    pub jobs: usize,
+    /// The most documents read but not yet written
+    pub max_in_flight: usize,
+    /// Write the responses in input order rather than as they finish
+    pub ordered: bool,
+    /// Solve only this shard's lines
+    pub shard: Option<Shard>,
+}
+
+/// A document to solve: its position among the documents, its line number
+/// and the line
+type Job = (usize, usize, String);
+
+/// Solve one line into one response line (without the newline)
+fn solve_line(worker: &Worker, line_number: usize, line: &str) -> (bool, String) {
+    let id = serde_json::Value::from(line_number);
+    let response = match serde_json::from_str(line) {
+        Ok(document) => worker.run(Request {
+            id,
+            document: Some(document),
+            ..Request::default()
+        }),
+        Err(e) => Response::error(
+            id,
+            &slvsx_core::Error::InvalidInput {
+                message: e.to_string(),
+                pointer: None,
+            },
+        ),
+    };
+    let ok = response.ok;
+    let text = serde_json::to_string(&response).unwrap_or_else(|e| {
+        format!(
+            r#"{{"id":{},"ok":false,"error":{{"code":1,"message":"{}"}}}}"#,
+            line_number, e
+        )
+    });
+    (ok, text)
+}
+
+/// Solve every document in input, writing the responses to output. Fails
+/// if reading or writing does, or if any document didn't solve, once every
+/// document has had its response written.
+pub fn solve_jsonl<R, W>(input: R, output: W, options: BatchOptions) -> Result<()>
+where
+    R: BufRead + Send,
+    W: Write,
+{
+    let max_in_flight = options.max_in_flight.max(1);
+    let (jobs, queue) = sync_channel::<Job>(max_in_flight);
+    let queue = Arc::new(Mutex::new(queue));
+    let (results, finished) = channel::<(usize, bool, String)>();
+    // One slot per document that has been read and not yet written; the
+    // reader blocks once they're all taken.
+    let (take_slot, free_slot) = sync_channel::<()>(max_in_flight);
+    let failed = AtomicUsize::new(0);
+
+    let (read, written) = thread::scope(|scope| {
+        let reader = scope.spawn(move || -> Result<usize> {
+            let mut count = 0;
+            for (index, line) in input.lines().enumerate() {
+                let line = line?;
+                let other_shard = options.shard.map_or(false, |s| !s.takes_line(index + 1));
+                if line.trim().is_empty() || other_shard {
+                    continue;
+                }
+                take_slot
+                    .send(())
+                    .map_err(|_| anyhow!("The response writer has stopped"))?;
+                jobs.send((count, index + 1, line))
+                    .map_err(|_| anyhow!("The solver threads have stopped"))?;
+                count += 1;
+            }
+            Ok(count)
+        });
+
+        for _ in 0..options.jobs.max(1) {
+            let queue = Arc::clone(&queue);
+            let results = results.clone();
+            scope.spawn(move || {
+                let worker = Worker::new();
+                loop {
+                    let job = queue.lock().map(|q| q.recv());
+                    let Ok(Ok((seq, line_number, line))) = job else {
+                        break;
+                    };
+                    let (ok, response) = solve_line(&worker, line_number, &line);
+                    if results.send((seq, ok, response)).is_err() {
+                        break;
+                    }
+                }
+            });
+        }
+        drop(results);
+
+        let written = write_responses(finished, free_slot, output, options.ordered, &failed);
+        (
+            reader
+                .join()
+                .map_err(|_| anyhow!("The input reader panicked")),
+            written,
+        )
+    });
+
+    let read = read??;
+    written?;
+    match failed.load(Ordering::Relaxed) {
+        0 => Ok(()),
+        n => Err(anyhow!("{} of {} documents failed", n, read)),
+    }
+}
+
+/// Write responses as they arrive, or in order, freeing a slot for the
+/// reader after each one is written
+fn write_responses<W: Write>(
+    finished: Receiver<(usize, bool, String)>,
+    free_slot: Receiver<()>,
+    output: W,
+    ordered: bool,
+    failed: &AtomicUsize,
+) -> Result<()> {
+    let mut output = std::io::BufWriter::new(output);
+    let mut held = BTreeMap::new();
+    let mut next = 0;
+
+    let emit = |output: &mut std::io::BufWriter<W>, ok: bool, line: &str| -> Result<()> {
+        if !ok {
+            failed.fetch_add(1, Ordering::Relaxed);
+        }
+        output.write_all(line.as_bytes())?;
+        output.write_all(b"\n")?;
+        let _ = free_slot.try_recv();
+        Ok(())
+    };
+
+    loop {
+        // Write out what's there before blocking for more, so a slow
+        // document doesn't hold back the ones that finished around it.
+        let (seq, ok, line) = match finished.try_recv() {
+            Ok(r) => r,
+            Err(_) => {
+                output.flush()?;
+                match finished.recv() {
+                    Ok(r) => r,
+                    Err(_) => break,
+                }
+            }
+        };
+        if !ordered {
+            emit(&mut output, ok, &line)?;
+            continue;
+        }
+        held.insert(seq, (ok, line));
+        while let Some((ok, line)) = held.remove(&next) {
+            emit(&mut output, ok, &line)?;
+            next += 1;
+        }
+    }
+    output.flush()?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::{json, Value};
+
+    fn point_line(x: i64) -> String {
+        json!({
+            "schema": "slvs-json/1",
+            "entities": [{"type": "point", "id": "p1", "at": [x, 0, 0]}],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        })
+        .to_string()
+    }
+
+    fn run(input: &str, options: BatchOptions) -> (Result<()>, Vec<Value>) {
+        let mut output = Vec::new();
+        let result = solve_jsonl(std::io::Cursor::new(input), &mut output, options);
+        let lines = String::from_utf8(output)
+            .unwrap()
+            .lines()
+            .map(|l| serde_json::from_str(l).unwrap())
+            .collect();
+        (result, lines)
+    }
+
+    #[test]
+    fn test_shard_solves_every_nth_line() {
+        let input: String = (0..10).map(|i| point_line(i) + "\n").collect();
+        let shard = Some(Shard { index: 2, count: 3 });
+        let options = BatchOptions {
+            jobs: 2,
+            max_in_flight: 4,
+            ordered: true,
+            shard,
+        };
+        let (result, lines) = run(&input, options);
+        result.unwrap();
+        let ids: Vec<u64> = lines.iter().map(|l| l["id"].as_u64().unwrap()).collect();
+        assert_eq!(ids, vec![2, 5, 8]);
+        assert_eq!(lines[1]["result"]["entities"]["p1"]["at"][0], 4.0);
+    }
+
+    #[test]
+    fn test_ordered_output_follows_input() {
+        let input: String = (0..50).map(|i| point_line(i) + "\n").collect();
+        let options = BatchOptions {
+            jobs: 4,
+            max_in_flight: 3,
+            ordered: true,
+            shard: None,
+        };
+        let (result, lines) = run(&input, options);
+        result.unwrap();
+        assert_eq!(lines.len(), 50);
+        for (i, line) in lines.iter().enumerate() {
+            assert_eq!(line["id"], i + 1);
+            assert_eq!(line["ok"], true);
+            assert_eq!(line["result"]["status"], "ok");
+        }
+    }
+
+    #[test]
+    fn test_unordered_output_has_every_line() {
+        let input: String = (0..20).map(|i| point_line(i) + "\n\n").collect();
+        let options = BatchOptions {
+            jobs: 3,
+            max_in_flight: 8,
+            ordered: false,
+            shard: None,
+        };
+        let (result, lines) = run(&input, options);
+        result.unwrap();
+        let mut ids: Vec<u64> = lines.iter().map(|l| l["id"].as_u64().unwrap()).collect();
+        ids.sort();
+        // Every other line is blank, and keeps its number.
+        assert_eq!(ids, (0..20).map(|i| 2 * i + 1).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_bad_lines_are_reported_and_fail_the_batch() {
+        let input = format!("{}\n{{ nope\n{}\n", point_line(1), point_line(2));
+        let options = BatchOptions {
+            jobs: 2,
+            max_in_flight: 2,
+            ordered: true,
+            shard: None,
+        };
+        let (result, lines) = run(&input, options);
+        assert_eq!(result.unwrap_err().to_string(), "1 of 3 documents failed");
+        assert_eq!(lines.len(), 3);
+        assert_eq!(lines[1]["id"], 2);
+        assert_eq!(lines[1]["ok"], false);
+        assert_eq!(lines[1]["error"]["code"], 2);
+        assert_eq!(lines[2]["ok"], true);
+    }
+}
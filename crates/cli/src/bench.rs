@@ -0,0 +1,344 @@
+//! `slvsx bench`: run a corpus of documents through every layer of the CLI
+//! in-process, and report how long each layer takes.
+
+use crate::io::OutputWriter;
+use crate::json_error::parse_json_with_context;
+use anyhow::{anyhow, Result};
+use serde::Serialize;
+use slvsx_core::{
+    solver::{Solver, SolverConfig},
+    validator::Validator,
+    InputDocument,
+};
+use std::path::{Path, PathBuf};
+use std::time::Instant;
+
+/// A phase's timings over all the runs of a document, in milliseconds
+#[derive(Debug, Clone, Default, PartialEq, Serialize)]
+pub struct Summary {
+    pub min_ms: f64,
+    pub mean_ms: f64,
+    pub p50_ms: f64,
+    pub p90_ms: f64,
+    pub p99_ms: f64,
+    pub max_ms: f64,
+}
+
+impl Summary {
+    pub fn of(samples: &[f64]) -> Self {
+        if samples.is_empty() {
+            return Self::default();
+        }
+        let mut sorted = samples.to_vec();
+        sorted.sort_by(|a, b| a.total_cmp(b));
+        Self {
+            min_ms: sorted[0],
+            mean_ms: sorted.iter().sum::<f64>() / sorted.len() as f64,
+            p50_ms: percentile(&sorted, 50.0),
+            p90_ms: percentile(&sorted, 90.0),
+            p99_ms: percentile(&sorted, 99.0),
+            max_ms: sorted[sorted.len() - 1],
+        }
+    }
+}
+
+/// The nearest-rank percentile of samples that are already sorted
+fn percentile(sorted: &[f64], p: f64) -> f64 {
+    let rank = (p / 100.0 * sorted.len() as f64).ceil() as usize;
+    sorted[rank.clamp(1, sorted.len()) - 1]
+}
+
+/// Every layer of `slvsx solve`, in the order they run. The solve is also
+/// broken down into building the native system, the native solve, and
+/// reading the solved entities back; those are only timed for runs that
+/// solve.
+#[derive(Debug, Default)]
+struct Samples {
+    parse: Vec<f64>,
+    validate: Vec<f64>,
+    solve: Vec<f64>,
+    build: Vec<f64>,
+    native: Vec<f64>,
+    read_back: Vec<f64>,
+    serialize: Vec<f64>,
+    total: Vec<f64>,
+}
+
+#[derive(Debug, Serialize)]
+pub struct PhaseSummaries {
+    pub parse: Summary,
+    pub validate: Summary,
+    pub solve: Summary,
+    pub build: Summary,
+    pub native: Summary,
+    pub read_back: Summary,
+    pub serialize: Summary,
+    pub total: Summary,
+}
+
+impl From<&Samples> for PhaseSummaries {
+    fn from(s: &Samples) -> Self {
+        Self {
+            parse: Summary::of(&s.parse),
+            validate: Summary::of(&s.validate),
+            solve: Summary::of(&s.solve),
+            build: Summary::of(&s.build),
+            native: Summary::of(&s.native),
+            read_back: Summary::of(&s.read_back),
+            serialize: Summary::of(&s.serialize),
+            total: Summary::of(&s.total),
+        }
+    }
+}
+
+#[derive(Debug, Serialize)]
+pub struct DocumentReport {
+    pub file: String,
+    /// "ok", or "error" if a layer failed; a document that fails still has
+    /// the layers up to and including the one that failed timed
+    pub status: String,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    pub error: Option<String>,
+    pub runs: usize,
+    pub phases: PhaseSummaries,
+}
+
+#[derive(Debug, Serialize)]
+pub struct BenchReport {
+    pub version: String,
+    pub iterations: usize,
+    pub warmup: usize,
+    pub documents: Vec<DocumentReport>,
+    /// The most memory the process had resident, in kilobytes, where the
+    /// platform reports it
+    pub peak_rss_kb: Option<u64>,
+}
+
+fn elapsed_ms(since: Instant) -> f64 {
+    since.elapsed().as_secs_f64() * 1000.0
+}
+
+/// The documents to run: a file on its own, or every `.json` under a
+/// directory apart from the `_solution.json` files, sorted by path.
+pub fn collect_documents(path: &Path) -> Result<Vec<PathBuf>> {
+    if path.is_file() {
+        return Ok(vec![path.to_path_buf()]);
+    }
+    let mut files = Vec::new();
+    let mut dirs = vec![path.to_path_buf()];
+    while let Some(dir) = dirs.pop() {
+        let entries = std::fs::read_dir(&dir)
+            .map_err(|e| anyhow!("Failed to read directory {}: {}", dir.display(), e))?;
+        for entry in entries {
+            let p = entry?.path();
+            if p.is_dir() {
+                dirs.push(p);
+                continue;
+            }
+            let name = p.file_name().and_then(|n| n.to_str()).unwrap_or("");
+            if name.ends_with(".json") && !name.ends_with("_solution.json") {
+                files.push(p);
+            }
+        }
+    }
+    files.sort();
+    Ok(files)
+}
+
+/// Run one document `warmup` times untimed and then `iterations` times
+/// timed, through the same layers as `slvsx solve`.
+fn bench_document(input: &str, file: &str, iterations: usize, warmup: usize) -> DocumentReport {
+    let validator = Validator::new();
+    let solver = Solver::new(SolverConfig::default());
+    let mut samples = Samples::default();
+    let mut error = None;
+
+    for run in 0..warmup + iterations {
+        let mut s = Samples::default();
+        let start = Instant::now();
+        let outcome = (|| -> Result<()> {
+            let t = Instant::now();
+            let parsed: Result<InputDocument> = parse_json_with_context(input, file);
+            s.parse.push(elapsed_ms(t));
+            let doc = parsed?;
+
+            let t = Instant::now();
+            let valid = validator.validate(&doc);
+            s.validate.push(elapsed_ms(t));
+            valid?;
+
+            let t = Instant::now();
+            let solved = solver.solve(&doc);
+            s.solve.push(elapsed_ms(t));
+            let result = solved?;
+            if let Some(d) = &result.diagnostics {
+                s.build.push(d.layers.build_ms);
+                s.native.push(d.layers.native_ms);
+                s.read_back.push(d.layers.read_back_ms);
+            }
+
+            let t = Instant::now();
+            let output = serde_json::to_string_pretty(&result);
+            s.serialize.push(elapsed_ms(t));
+            std::hint::black_box(output?);
+            Ok(())
+        })();
+        s.total.push(elapsed_ms(start));
+
+        if let Err(e) = outcome {
+            error.get_or_insert_with(|| e.to_string());
+        }
+        if run >= warmup {
+            samples.parse.append(&mut s.parse);
+            samples.validate.append(&mut s.validate);
+            samples.solve.append(&mut s.solve);
+            samples.build.append(&mut s.build);
+            samples.native.append(&mut s.native);
+            samples.read_back.append(&mut s.read_back);
+            samples.serialize.append(&mut s.serialize);
+            samples.total.append(&mut s.total);
+        }
+    }
+
+    DocumentReport {
+        file: file.to_string(),
+        status: if error.is_some() { "error" } else { "ok" }.to_string(),
+        error,
+        runs: iterations,
+        phases: PhaseSummaries::from(&samples),
+    }
+}
+
+#[cfg(target_os = "linux")]
+fn peak_rss_kb() -> Option<u64> {
+    let status = std::fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|l| l.starts_with("VmHWM:"))?;
+    line.split_whitespace().nth(1)?.parse().ok()
+}
+
+#[cfg(not(target_os = "linux"))]
+fn peak_rss_kb() -> Option<u64> {
+    None
+}
+
+/// Bench command handler
+pub fn handle_bench<W: OutputWriter + ?Sized>(
+    path: &str,
+    iterations: usize,
+    warmup: usize,
+    writer: &mut W,
+) -> Result<()> {
+    if iterations == 0 {
+        return Err(anyhow!("--iterations must be at least 1"));
+    }
+    let files = collect_documents(Path::new(path))?;
+    if files.is_empty() {
+        return Err(anyhow!("No documents found in {}", path));
+    }
+
+    let mut documents = Vec::with_capacity(files.len());
+    for f in &files {
+        let name = f.display().to_string();
+        let input =
+            std::fs::read_to_string(f).map_err(|e| anyhow!("Failed to read {}: {}", name, e))?;
+        documents.push(bench_document(&input, &name, iterations, warmup));
+    }
+
+    let report = BenchReport {
+        version: env!("CARGO_PKG_VERSION").to_string(),
+        iterations,
+        warmup,
+        documents,
+        peak_rss_kb: peak_rss_kb(),
+    };
+    writer.write_str(&serde_json::to_string_pretty(&report)?)?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::io::tests::MemoryWriter;
+
+    #[test]
+    fn test_summary_percentiles() {
+        let samples: Vec<f64> = (1..=100).rev().map(|i| i as f64).collect();
+        let s = Summary::of(&samples);
+        assert_eq!(s.min_ms, 1.0);
+        assert_eq!(s.max_ms, 100.0);
+        assert_eq!(s.mean_ms, 50.5);
+        assert_eq!(s.p50_ms, 50.0);
+        assert_eq!(s.p90_ms, 90.0);
+        assert_eq!(s.p99_ms, 99.0);
+    }
+
+    #[test]
+    fn test_summary_of_one_and_none() {
+        let s = Summary::of(&[2.5]);
+        assert_eq!(s.p50_ms, 2.5);
+        assert_eq!(s.p99_ms, 2.5);
+        assert_eq!(Summary::of(&[]), Summary::default());
+    }
+
+    #[test]
+    fn test_collect_documents_skips_solutions() {
+        let dir = tempfile::tempdir().unwrap();
+        std::fs::create_dir(dir.path().join("nested")).unwrap();
+        for name in [
+            "b.json",
+            "a.json",
+            "a_solution.json",
+            "notes.md",
+            "nested/c.json",
+        ] {
+            std::fs::write(dir.path().join(name), "{}").unwrap();
+        }
+        let files = collect_documents(dir.path()).unwrap();
+        let names: Vec<_> = files
+            .iter()
+            .map(|f| {
+                f.strip_prefix(dir.path())
+                    .unwrap()
+                    .to_str()
+                    .unwrap()
+                    .to_string()
+            })
+            .collect();
+        assert_eq!(names, vec!["a.json", "b.json", "nested/c.json"]);
+    }
+
+    #[test]
+    fn test_bench_document_times_every_layer() {
+        let input = r#"{
+            "schema": "slvs-json/1",
+            "entities": [{"type": "point", "id": "p1", "at": [0, 0, 0]}],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        }"#;
+        let report = bench_document(input, "point.json", 3, 1);
+        assert_eq!(report.status, "ok");
+        assert_eq!(report.runs, 3);
+        assert!(report.phases.solve.max_ms >= report.phases.solve.min_ms);
+        assert!(report.phases.total.min_ms > 0.0);
+    }
+
+    #[test]
+    fn test_bench_document_reports_errors() {
+        let report = bench_document("{ not json", "broken.json", 2, 0);
+        assert_eq!(report.status, "error");
+        assert!(report.error.unwrap().contains("broken.json"));
+        assert_eq!(report.phases.solve, Summary::default());
+    }
+
+    #[test]
+    fn test_handle_bench_writes_json() {
+        let dir = tempfile::tempdir().unwrap();
+        let doc = r#"{"schema": "slvs-json/1", "entities": [], "constraints": []}"#;
+        std::fs::write(dir.path().join("empty.json"), doc).unwrap();
+        let mut writer = MemoryWriter::new();
+        handle_bench(dir.path().to_str().unwrap(), 2, 0, &mut writer).unwrap();
+        let report: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        assert_eq!(report["iterations"], 2);
+        assert_eq!(report["documents"].as_array().unwrap().len(), 1);
+        assert!(report["documents"][0]["phases"]["parse"]["p50_ms"].is_number());
+    }
+}
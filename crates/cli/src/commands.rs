@@ -1,9 +1,11 @@
-use crate::io::{ErrorWriter, InputReader, OutputWriter};
-use crate::json_error::parse_json_with_context;
+use crate::io::{ErrorWriter, InputReader, OutputWriter, WriteAdapter};
+use crate::json_error::parse_json_bytes_with_context;
 use anyhow::Result;
 use slvsx_core::{
+    select::Selection,
     solver::{Solver, SolverConfig},
-    InputDocument,
+    wire::WireFormat,
+    InputDocument, SolveResult,
 };
 use slvsx_exporters::svg::ViewPlane as SvgViewPlane;
 
@@ -13,7 +15,34 @@ pub enum ExportFormat {
     Svg,
     Dxf,
     Slvs,
+    SlvsSnapshot,
     Stl,
+    StlBinary,
+    Obj,
+    Step,
+    Png,
+    PngSolid,
+}
+
+impl std::str::FromStr for ExportFormat {
+    type Err = anyhow::Error;
+
+    /// A format by the name `--format` and `capabilities` give it
+    fn from_str(name: &str) -> Result<Self> {
+        Ok(match name {
+            "svg" => ExportFormat::Svg,
+            "dxf" => ExportFormat::Dxf,
+            "slvs" => ExportFormat::Slvs,
+            "slvs-snapshot" => ExportFormat::SlvsSnapshot,
+            "stl" => ExportFormat::Stl,
+            "stl-binary" => ExportFormat::StlBinary,
+            "obj" => ExportFormat::Obj,
+            "step" => ExportFormat::Step,
+            "png" => ExportFormat::Png,
+            "png-solid" => ExportFormat::PngSolid,
+            _ => return Err(anyhow::anyhow!("Unknown export format '{}'", name)),
+        })
+    }
 }
 
 /// View plane enum
@@ -25,6 +54,20 @@ pub enum ViewPlane {
     Isometric,
 }
 
+impl std::str::FromStr for ViewPlane {
+    type Err = anyhow::Error;
+
+    fn from_str(name: &str) -> Result<Self> {
+        Ok(match name {
+            "xy" => ViewPlane::Xy,
+            "xz" => ViewPlane::Xz,
+            "yz" => ViewPlane::Yz,
+            "isometric" => ViewPlane::Isometric,
+            _ => return Err(anyhow::anyhow!("Unknown view '{}'", name)),
+        })
+    }
+}
+
 impl From<ViewPlane> for SvgViewPlane {
     fn from(vp: ViewPlane) -> Self {
         match vp {
@@ -36,14 +79,44 @@ impl From<ViewPlane> for SvgViewPlane {
     }
 }
 
+/// How to write a solve result out
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct OutputFormat {
+    /// On one line, without the whitespace of pretty printing
+    pub compact: bool,
+    /// Round coordinates to this many decimal places
+    pub decimals: Option<u32>,
+    /// JSON, or MessagePack both for the document read and the result
+    pub wire: WireFormat,
+    /// Which entities to read back and report
+    pub select: Selection,
+}
+
+/// Serialize a value straight into the writer through a buffer, rather
+/// than into a `String` to write whole
+pub fn write_json<W: OutputWriter + ?Sized, T: serde::Serialize>(
+    writer: &mut W,
+    value: &T,
+    compact: bool,
+) -> Result<()> {
+    use std::io::Write;
+    let mut out = std::io::BufWriter::with_capacity(64 * 1024, WriteAdapter(writer));
+    if compact {
+        serde_json::to_writer(&mut out, value)?;
+    } else {
+        serde_json::to_writer_pretty(&mut out, value)?;
+    }
+    out.flush()?;
+    Ok(())
+}
+
 /// Validate command handler
 pub fn handle_validate<R: InputReader + ?Sized>(
     reader: &mut R,
     filename: &str,
     error_writer: &mut dyn ErrorWriter,
 ) -> Result<()> {
-    let input = reader.read()?;
-    let doc: InputDocument = parse_json_with_context(&input, filename)?;
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
 
     let validator = slvsx_core::validator::Validator::new();
     validator.validate(&doc)?;
@@ -52,25 +125,97 @@ pub fn handle_validate<R: InputReader + ?Sized>(
     Ok(())
 }
 
-/// Solve command handler
+/// Check command handler: whether the document's coordinates already
+/// satisfy its constraints, each one's residual written out, and an error
+/// if any don't
+pub fn handle_check<R: InputReader + ?Sized, W: OutputWriter + ?Sized>(
+    reader: &mut R,
+    writer: &mut W,
+    filename: &str,
+    compact: bool,
+) -> Result<()> {
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
+
+    let validator = slvsx_core::validator::Validator::new();
+    validator.validate(&doc)?;
+
+    let result = Solver::new(SolverConfig::default()).check(&doc)?;
+    write_json(writer, &result, compact)?;
+    let failed = result.constraints.iter().filter(|c| !c.ok).count();
+    if failed > 0 {
+        anyhow::bail!(
+            "{} of {} constraints aren't satisfied",
+            failed,
+            result.constraints.len()
+        );
+    }
+    Ok(())
+}
+
+/// A result written by an earlier solve, to start another from
+pub fn read_result(path: &str) -> Result<SolveResult> {
+    let bytes =
+        std::fs::read(path).map_err(|e| anyhow::anyhow!("Failed to open {}: {}", path, e))?;
+    parse_json_bytes_with_context(&bytes, path)
+}
+
+/// Solve command handler; with `initial`, the document's points and
+/// circles start from where that result has them, with `interference`,
+/// the solved outlines are checked for crossing or coming within that
+/// clearance of each other, and with `mass`, the mass properties of the
+/// solid extruded to that height are reported
+#[allow(clippy::too_many_arguments)]
 pub fn handle_solve<R: InputReader + ?Sized, W: OutputWriter + ?Sized>(
     reader: &mut R,
     writer: &mut W,
     filename: &str,
+    sensitivities: bool,
+    profile: bool,
+    interference: Option<f64>,
+    mass: Option<f64>,
+    initial: Option<&SolveResult>,
+    format: OutputFormat,
 ) -> Result<()> {
-    let input = reader.read()?;
-    let doc: InputDocument = parse_json_with_context(&input, filename)?;
+    // The input is dropped once parsed, before anything is solved
+    let mut doc: InputDocument = match format.wire {
+        WireFormat::Json => parse_json_bytes_with_context(&reader.read_bytes()?, filename)?,
+        WireFormat::Msgpack => format.wire.decode(&reader.read_bytes()?)?,
+    };
 
     // Validate document before solving to catch errors early
     let validator = slvsx_core::validator::Validator::new();
     validator.validate(&doc)?;
+    if let Some(prior) = initial {
+        slvsx_core::warm::seed(&mut doc, prior);
+    }
 
-    let solver = Solver::new(SolverConfig::default());
-    let result = solver.solve(&doc)?;
+    let config = SolverConfig {
+        sensitivities,
+        profile,
+        interference,
+        mass,
+        select: format.select,
+        ..SolverConfig::default()
+    };
+    let solver = Solver::new(config);
+    let mut result = solver.solve(&doc)?;
+    drop(doc);
 
-    let output = serde_json::to_string_pretty(&result)?;
-    writer.write_str(&output)?;
-    Ok(())
+    if let Some(decimals) = format.decimals {
+        result.round(decimals);
+    }
+    match format.wire {
+        WireFormat::Json => write_json(writer, &result, format.compact),
+        WireFormat::Msgpack => Ok(writer.write(&format.wire.encode(&result)?)?),
+    }
+}
+
+/// How far to simplify the solid of an STL or OBJ export; zero for either
+/// is no limit
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct MeshLimits {
+    pub max_triangles: usize,
+    pub max_error: f64,
 }
 
 /// Export command handler
@@ -80,9 +225,9 @@ pub fn handle_export<R: InputReader + ?Sized, W: OutputWriter + ?Sized>(
     filename: &str,
     format: ExportFormat,
     view: ViewPlane,
+    limits: MeshLimits,
 ) -> Result<()> {
-    let input = reader.read()?;
-    let doc: InputDocument = parse_json_with_context(&input, filename)?;
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
 
     // Solve the constraints
     let solver = Solver::new(SolverConfig::default());
@@ -91,8 +236,29 @@ pub fn handle_export<R: InputReader + ?Sized, W: OutputWriter + ?Sized>(
     // Use the solved entities for export
     let entities = result.entities.unwrap_or_default();
 
-    let output_data = export_entities(&entities, format, view)?;
-    writer.write(&output_data)?;
+    use std::io::Write;
+    let mut out = std::io::BufWriter::with_capacity(64 * 1024, WriteAdapter(writer));
+    write_export(&entities, format, view, limits, &mut out)?;
+    out.flush()?;
+    Ok(())
+}
+
+/// Tiles command handler: solve a document and write its drawing as a
+/// pyramid of SVG tiles into `dir`, reporting what the pyramid covers
+pub fn handle_tiles<R: InputReader + ?Sized, W: OutputWriter + ?Sized>(
+    reader: &mut R,
+    writer: &mut W,
+    filename: &str,
+    dir: &str,
+    options: slvsx_exporters::tiles::TileOptions,
+) -> Result<()> {
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
+    let solver = Solver::new(SolverConfig::default());
+    let entities = solver.solve(&doc)?.entities.unwrap_or_default();
+
+    std::fs::create_dir_all(dir).map_err(|e| anyhow::anyhow!("Failed to create {}: {}", dir, e))?;
+    let set = slvsx_exporters::tiles::write_tiles(&entities, std::path::Path::new(dir), options)?;
+    writer.write_str(&serde_json::to_string_pretty(&set)?)?;
     Ok(())
 }
 
@@ -102,54 +268,194 @@ pub fn export_entities(
     format: ExportFormat,
     view: ViewPlane,
 ) -> Result<Vec<u8>> {
-    match format {
-        ExportFormat::Svg => {
-            use slvsx_exporters::svg::SvgExporter;
-            let exporter = SvgExporter::new(view.into());
-            Ok(exporter.export(entities)?.into_bytes())
+    let mut out = Vec::new();
+    write_export(entities, format, view, MeshLimits::default(), &mut out)?;
+    Ok(out)
+}
+
+/// Export entities to the specified format, writing the output as it's made
+pub fn write_export(
+    entities: &std::collections::HashMap<String, slvsx_core::ir::ResolvedEntity>,
+    format: ExportFormat,
+    view: ViewPlane,
+    limits: MeshLimits,
+    out: &mut dyn std::io::Write,
+) -> Result<()> {
+    use slvsx_exporters::StreamExporter;
+    let solid = || {
+        slvsx_exporters::stl::StlExporter::new(100.0)
+            .with_max_triangles(limits.max_triangles)
+            .with_max_error(limits.max_error)
+    };
+    let exporter: Box<dyn StreamExporter> = match format {
+        ExportFormat::Svg => Box::new(slvsx_exporters::svg::SvgExporter::new(view.into())),
+        ExportFormat::Dxf => Box::new(slvsx_exporters::dxf::DxfExporter::new()),
+        ExportFormat::Slvs => Box::new(slvsx_exporters::slvs::SlvsExporter::new()),
+        ExportFormat::SlvsSnapshot => {
+            Box::new(slvsx_exporters::slvs::SlvsExporter::new().snapshot())
         }
-        ExportFormat::Dxf => {
-            use slvsx_exporters::dxf::DxfExporter;
-            let exporter = DxfExporter::new();
-            Ok(exporter.export(entities)?.into_bytes())
+        ExportFormat::Stl => Box::new(solid()),
+        ExportFormat::StlBinary => Box::new(solid().binary()),
+        ExportFormat::Obj => Box::new(slvsx_exporters::obj::ObjExporter::new(solid())),
+        ExportFormat::Step => Box::new(slvsx_exporters::step::StepExporter::new(100.0)),
+        ExportFormat::Png => Box::new(slvsx_exporters::png::PngExporter::new(view.into())),
+        ExportFormat::PngSolid => {
+            Box::new(slvsx_exporters::png::PngExporter::new(view.into()).filled(solid()))
         }
-        ExportFormat::Slvs => {
-            use slvsx_exporters::slvs::SlvsExporter;
-            let exporter = SlvsExporter::new();
-            Ok(exporter.export(entities)?.into_bytes())
+    };
+    exporter.write_to(entities, out)
+}
+
+/// One output of an export: a format, a view (which only SVG and PNG use) and the
+/// file to write
+#[derive(Clone, Debug, PartialEq)]
+pub struct ExportTarget {
+    pub format: ExportFormat,
+    pub view: ViewPlane,
+    pub path: String,
+}
+
+/// Pair the `--format`, `--view` and `--output` of an export in order, one
+/// target per output; a format or view given once applies to every output
+pub fn export_targets(
+    formats: &[ExportFormat],
+    views: &[ViewPlane],
+    outputs: &[String],
+) -> Result<Vec<ExportTarget>> {
+    let pick = |n: usize, name: &str, i: usize| -> Result<usize> {
+        match n {
+            1 => Ok(0),
+            n if n == outputs.len() => Ok(i),
+            n => Err(anyhow::anyhow!(
+                "{} --{} given for {} --output; give one, or one per output",
+                n,
+                name,
+                outputs.len()
+            )),
+        }
+    };
+    outputs
+        .iter()
+        .enumerate()
+        .map(|(i, path)| {
+            Ok(ExportTarget {
+                format: formats[pick(formats.len(), "format", i)?],
+                view: views[pick(views.len(), "view", i)?],
+                path: path.clone(),
+            })
+        })
+        .collect()
+}
+
+/// Export command handler for several outputs: the document is solved
+/// once, and each distinct output rendered once, on a thread of its own,
+/// into every file that asks for it
+pub fn handle_export_many<R: InputReader + ?Sized>(
+    reader: &mut R,
+    filename: &str,
+    targets: &[ExportTarget],
+    limits: MeshLimits,
+) -> Result<()> {
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
+    let solver = Solver::new(SolverConfig::default());
+    let entities = solver.solve(&doc)?.entities.unwrap_or_default();
+    drop(doc);
+
+    // Only SVG and PNG are projected, so the other formats are the same in
+    // any view
+    let mut renders: Vec<(ExportFormat, ViewPlane, Vec<&str>)> = Vec::new();
+    for target in targets {
+        let view = match target.format {
+            ExportFormat::Svg | ExportFormat::Png | ExportFormat::PngSolid => target.view,
+            _ => ViewPlane::Xy,
+        };
+        match renders
+            .iter_mut()
+            .find(|(f, v, _)| *f == target.format && *v == view)
+        {
+            Some((_, _, paths)) => paths.push(&target.path),
+            None => renders.push((target.format, view, vec![&target.path])),
         }
-        ExportFormat::Stl => {
-            use slvsx_exporters::stl::StlExporter;
-            let exporter = StlExporter::new(100.0);
-            Ok(exporter.export(entities)?)
+    }
+
+    let entities = &entities;
+    std::thread::scope(|scope| {
+        let threads: Vec<_> = renders
+            .iter()
+            .map(|(format, view, paths)| {
+                scope.spawn(move || -> Result<()> {
+                    let mut out = Tee::create(paths)?;
+                    write_export(entities, *format, *view, limits, &mut out)?;
+                    std::io::Write::flush(&mut out)?;
+                    Ok(())
+                })
+            })
+            .collect();
+        threads
+            .into_iter()
+            .map(|t| {
+                t.join()
+                    .unwrap_or_else(|panic| std::panic::resume_unwind(panic))
+            })
+            .collect()
+    })
+}
+
+/// Writes everything to each of several files, through a buffer apiece
+struct Tee(Vec<std::io::BufWriter<std::fs::File>>);
+
+impl Tee {
+    fn create(paths: &[&str]) -> Result<Self> {
+        let files = paths
+            .iter()
+            .map(|path| {
+                let file = std::fs::File::create(path)
+                    .map_err(|e| anyhow::anyhow!("Failed to create {}: {}", path, e))?;
+                Ok(std::io::BufWriter::with_capacity(64 * 1024, file))
+            })
+            .collect::<Result<_>>()?;
+        Ok(Self(files))
+    }
+}
+
+impl std::io::Write for Tee {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        for file in &mut self.0 {
+            file.write_all(buf)?;
         }
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        self.0.iter_mut().try_for_each(|file| file.flush())
     }
 }
 
-/// Capabilities command handler
-pub fn handle_capabilities<W: OutputWriter + ?Sized>(writer: &mut W) -> Result<()> {
-    let version = env!("CARGO_PKG_VERSION");
-    let capabilities = format!(
-        r#"{{
-  "version": "{}",
+/// What `capabilities` writes, fixed when the binary is built
+pub const CAPABILITIES: &str = concat!(
+    r#"{
+  "version": ""#,
+    env!("CARGO_PKG_VERSION"),
+    r#"",
   "entities": ["point", "line", "circle", "arc", "plane"],
   "constraints": [
     "coincident", "distance", "angle", "perpendicular", "parallel",
     "horizontal", "vertical", "equal_length", "equal_radius", "tangent",
     "point_on_line", "point_on_circle", "fixed"
   ],
-  "export_formats": ["svg", "dxf", "slvs", "stl"],
+  "export_formats": ["svg", "dxf", "slvs", "slvs-snapshot", "stl", "stl-binary", "obj", "step", "png", "png-solid"],
   "units": ["mm", "cm", "m", "in", "ft"]
-}}"#,
-        version
-    );
-    writer.write_str(&capabilities)?;
+}"#
+);
+
+/// Capabilities command handler
+pub fn handle_capabilities<W: OutputWriter + ?Sized>(writer: &mut W) -> Result<()> {
+    writer.write_str(CAPABILITIES)?;
     Ok(())
 }
 
-/// Schema command handler - returns JSON schema for input documents
-pub fn handle_schema<W: OutputWriter + ?Sized>(writer: &mut W) -> Result<()> {
-    let schema = r##"{
+/// The JSON schema `schema` writes for input documents
+pub const SCHEMA: &str = r##"{
   "$schema": "http://json-schema.org/draft-07/schema#",
   "title": "SLVSX Constraint Document",
   "description": "JSON schema for SLVSX geometric constraint solver input",
@@ -425,7 +731,10 @@ pub fn handle_schema<W: OutputWriter + ?Sized>(writer: &mut W) -> Result<()> {
     }
   }
 }"##;
-    writer.write_str(schema)?;
+
+/// Schema command handler - returns JSON schema for input documents
+pub fn handle_schema<W: OutputWriter + ?Sized>(writer: &mut W) -> Result<()> {
+    writer.write_str(SCHEMA)?;
     Ok(())
 }
 
@@ -485,13 +794,292 @@ mod tests {
         let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
         let mut writer = MemoryWriter::new();
 
-        let result = handle_solve(&mut reader, &mut writer, "test.json");
+        let result = handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            false,
+            None,
+            None,
+            None,
+            OutputFormat::default(),
+        );
         assert!(result.is_ok());
         let output = writer.as_string();
         assert!(output.contains("\"status\""));
         assert!(output.contains("\"p1\""));
     }
 
+    #[test]
+    fn test_handle_solve_compact_and_rounded() {
+        let problem = json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0.1, 0.2, 0]},
+                {"type": "point", "id": "p2", "at": [3, 4, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 2.0}
+            ]
+        });
+
+        let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
+        let mut writer = MemoryWriter::new();
+        let format = OutputFormat {
+            compact: true,
+            decimals: Some(3),
+            ..OutputFormat::default()
+        };
+        handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            false,
+            None,
+            None,
+            None,
+            format,
+        )
+        .unwrap();
+        let output = writer.as_string();
+        assert!(!output.contains('\n'));
+
+        let result: serde_json::Value = serde_json::from_str(&output).unwrap();
+        for c in result["entities"]["p2"]["at"].as_array().unwrap() {
+            let c = c.as_f64().unwrap();
+            assert_eq!(c, (c * 1000.0).round() / 1000.0);
+        }
+        assert!(result.get("profile").is_none());
+    }
+
+    #[test]
+    fn test_handle_solve_profile() {
+        let problem = serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0.1, 0.2, 0]},
+                {"type": "point", "id": "p2", "at": [3, 4, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 2.0}
+            ]
+        });
+
+        let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
+        let mut writer = MemoryWriter::new();
+        handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            true,
+            None,
+            None,
+            None,
+            OutputFormat::default(),
+        )
+        .unwrap();
+        let result: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        let profile = result["profile"].as_array().unwrap();
+        let distance = profile
+            .iter()
+            .find(|c| c["pointer"] == "/constraints/1")
+            .unwrap();
+        assert_eq!(distance["type"], "distance");
+        assert!(distance["expr_nodes"].as_u64().unwrap() > 0);
+    }
+
+    #[test]
+    fn test_handle_solve_interference() {
+        // Two lines crossing at (5, 5), and a circle well clear of them
+        let problem = serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "a1", "at": [0, 0, 0]},
+                {"type": "point", "id": "a2", "at": [10, 10, 0]},
+                {"type": "point", "id": "b1", "at": [0, 10, 0]},
+                {"type": "point", "id": "b2", "at": [10, 0, 0]},
+                {"type": "line", "id": "a", "p1": "a1", "p2": "a2"},
+                {"type": "line", "id": "b", "p1": "b1", "p2": "b2"},
+                {"type": "circle", "id": "c", "center": [30, 0, 0], "diameter": 4}
+            ],
+            "constraints": []
+        });
+
+        let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
+        let mut writer = MemoryWriter::new();
+        handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            false,
+            Some(0.0),
+            None,
+            None,
+            OutputFormat::default(),
+        )
+        .unwrap();
+        let result: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        let found = result["interference"].as_array().unwrap();
+        assert_eq!(found.len(), 1);
+        assert_eq!(
+            (found[0]["a"].as_str(), found[0]["b"].as_str()),
+            (Some("a"), Some("b"))
+        );
+        assert!((found[0]["depth"].as_f64().unwrap() - 50f64.sqrt()).abs() < 1e-6);
+    }
+
+    #[test]
+    fn test_handle_solve_mass() {
+        // A cylinder 10 across, and a line, which the STL export leaves out
+        let problem = serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "a", "at": [0, 0, 0]},
+                {"type": "point", "id": "b", "at": [10, 0, 0]},
+                {"type": "line", "id": "ab", "p1": "a", "p2": "b"},
+                {"type": "circle", "id": "c", "center": [20, 0, 0], "diameter": 10}
+            ],
+            "constraints": []
+        });
+
+        let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
+        let mut writer = MemoryWriter::new();
+        handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            false,
+            None,
+            Some(4.0),
+            None,
+            OutputFormat::default(),
+        )
+        .unwrap();
+        let result: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        let mass = &result["mass"];
+        let volume = std::f64::consts::PI * 25.0 * 4.0;
+        assert!((mass["volume"].as_f64().unwrap() - volume).abs() < 1e-9);
+        assert_eq!(mass["centroid"], serde_json::json!([20.0, 0.0, 2.0]));
+        let izz = mass["inertia"][2][2].as_f64().unwrap();
+        assert!((izz - volume * 25.0 / 2.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_handle_solve_only_selected() {
+        let problem = json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [3, 4, 0]}
+            ],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        });
+
+        let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
+        let mut writer = MemoryWriter::new();
+        let format = OutputFormat {
+            select: Selection::only(["p2"]),
+            ..OutputFormat::default()
+        };
+        handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            false,
+            None,
+            None,
+            None,
+            format,
+        )
+        .unwrap();
+
+        let result: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        let entities = result["entities"].as_object().unwrap();
+        assert_eq!(entities.keys().collect::<Vec<_>>(), ["p2"]);
+    }
+
+    #[test]
+    fn test_handle_check() {
+        let problem = |value: f64| {
+            json!({
+                "schema": "slvs-json/1",
+                "entities": [
+                    {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                    {"type": "point", "id": "p2", "at": [3, 4, 0]}
+                ],
+                "constraints": [
+                    {"type": "fixed", "entity": "p1"},
+                    {"type": "distance", "between": ["p1", "p2"], "value": value}
+                ]
+            })
+        };
+
+        let mut reader = MemoryReader::new(problem(5.0).to_string());
+        let mut writer = MemoryWriter::new();
+        handle_check(&mut reader, &mut writer, "test.json", true).unwrap();
+        let result: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        assert_eq!(result["status"], "ok");
+        assert_eq!(result["constraints"][1]["type"], "distance");
+
+        let mut reader = MemoryReader::new(problem(7.0).to_string());
+        let mut writer = MemoryWriter::new();
+        let err = handle_check(&mut reader, &mut writer, "test.json", true).unwrap_err();
+        assert!(err.to_string().contains("1 of 2"));
+        let result: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        assert_eq!(result["status"], "failed");
+        assert_eq!(result["constraints"][1]["ok"], false);
+        assert!((result["constraints"][1]["residual"].as_f64().unwrap() - 2.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_handle_solve_msgpack() {
+        struct BytesReader(Vec<u8>);
+        impl InputReader for BytesReader {
+            fn read(&mut self) -> Result<String> {
+                unreachable!("MessagePack is read as bytes")
+            }
+            fn read_bytes(&mut self) -> Result<Vec<u8>> {
+                Ok(self.0.clone())
+            }
+        }
+
+        let problem = json!({
+            "schema": "slvs-json/1",
+            "entities": [{"type": "point", "id": "p1", "at": [1, 2, 3]}],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        });
+        let mut reader = BytesReader(WireFormat::Msgpack.encode(&problem).unwrap());
+        let mut writer = MemoryWriter::new();
+        let format = OutputFormat {
+            wire: WireFormat::Msgpack,
+            ..OutputFormat::default()
+        };
+        handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.msgpack",
+            false,
+            false,
+            None,
+            None,
+            None,
+            format,
+        )
+        .unwrap();
+
+        let result: serde_json::Value = WireFormat::Msgpack.decode(writer.as_bytes()).unwrap();
+        assert_eq!(result["status"], "ok");
+        assert_eq!(result["entities"]["p1"]["at"], json!([1.0, 2.0, 3.0]));
+    }
+
     #[test]
     fn test_handle_capabilities() {
         let mut writer = MemoryWriter::new();
@@ -502,6 +1090,8 @@ mod tests {
         assert!(output.contains("\"entities\""));
         assert!(output.contains("\"constraints\""));
         assert!(output.contains("\"export_formats\""));
+        let parsed: serde_json::Value = serde_json::from_str(&output).unwrap();
+        assert_eq!(parsed["version"], env!("CARGO_PKG_VERSION"));
     }
 
     #[test]
@@ -562,6 +1152,187 @@ mod tests {
         assert!(result.is_ok());
     }
 
+    #[test]
+    fn test_write_export_simplifies_to_the_limit() {
+        use slvsx_core::ir::ResolvedEntity;
+        use std::collections::HashMap;
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![0.0, 0.0, 0.0],
+                diameter: 20.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let facets = |limits: MeshLimits| {
+            let mut out = Vec::new();
+            write_export(
+                &entities,
+                ExportFormat::Stl,
+                ViewPlane::Xy,
+                limits,
+                &mut out,
+            )
+            .unwrap();
+            String::from_utf8(out)
+                .unwrap()
+                .matches("facet normal")
+                .count()
+        };
+        assert_eq!(facets(MeshLimits::default()), 128);
+        let limited = facets(MeshLimits {
+            max_triangles: 64,
+            max_error: 0.0,
+        });
+        assert!(limited <= 64 && limited > 0);
+    }
+
+    #[test]
+    fn test_export_entities_obj() {
+        use std::collections::HashMap;
+        let entities = HashMap::new();
+        let result = export_entities(&entities, ExportFormat::Obj, ViewPlane::Xy).unwrap();
+        assert!(String::from_utf8(result).unwrap().starts_with("# slvsx"));
+    }
+
+    #[test]
+    fn test_export_entities_step() {
+        use slvsx_core::ir::ResolvedEntity;
+        use std::collections::HashMap;
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c1".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![0.0, 0.0, 0.0],
+                diameter: 10.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let step = export_entities(&entities, ExportFormat::Step, ViewPlane::Xy).unwrap();
+        let step = String::from_utf8(step).unwrap();
+        assert!(step.starts_with("ISO-10303-21;"));
+        assert!(step.contains("MANIFOLD_SOLID_BREP("));
+        assert!(export_entities(&HashMap::new(), ExportFormat::Step, ViewPlane::Xy).is_err());
+    }
+
+    #[test]
+    fn test_export_entities_png() {
+        use slvsx_core::ir::ResolvedEntity;
+        use std::collections::HashMap;
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c1".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![0.0, 0.0, 0.0],
+                diameter: 10.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        for format in [ExportFormat::Png, ExportFormat::PngSolid] {
+            let png = export_entities(&entities, format, ViewPlane::Isometric).unwrap();
+            assert!(png.starts_with(b"\x89PNG\r\n\x1a\n"));
+            assert_eq!(&png[12..16], b"IHDR");
+        }
+    }
+
+    #[test]
+    fn test_export_entities_stl_binary() {
+        use slvsx_core::ir::ResolvedEntity;
+        use std::collections::HashMap;
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c1".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![0.0, 0.0, 0.0],
+                diameter: 10.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let ascii = export_entities(&entities, ExportFormat::Stl, ViewPlane::Xy).unwrap();
+        let binary = export_entities(&entities, ExportFormat::StlBinary, ViewPlane::Xy).unwrap();
+        let count = u32::from_le_bytes(binary[80..84].try_into().unwrap()) as usize;
+        assert_eq!(
+            count,
+            String::from_utf8(ascii.clone())
+                .unwrap()
+                .matches("facet normal")
+                .count()
+        );
+        assert_eq!(binary.len(), 84 + 50 * count);
+        assert!(binary.len() * 4 < ascii.len());
+    }
+
+    #[test]
+    fn test_export_targets_pair_in_order() {
+        let outputs = vec![
+            "a.svg".to_string(),
+            "b.svg".to_string(),
+            "c.dxf".to_string(),
+        ];
+        let targets = export_targets(
+            &[ExportFormat::Svg, ExportFormat::Svg, ExportFormat::Dxf],
+            &[ViewPlane::Xz],
+            &outputs,
+        )
+        .unwrap();
+        assert_eq!(targets.len(), 3);
+        assert_eq!(targets[1].format, ExportFormat::Svg);
+        assert_eq!(targets[2].format, ExportFormat::Dxf);
+        assert!(targets.iter().all(|t| t.view == ViewPlane::Xz));
+        assert_eq!(targets[2].path, "c.dxf");
+
+        let err = export_targets(
+            &[ExportFormat::Svg],
+            &[ViewPlane::Xy, ViewPlane::Yz],
+            &outputs,
+        );
+        assert!(err.is_err());
+    }
+
+    #[test]
+    fn test_handle_export_many_solves_once_for_every_output() {
+        let problem = json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 5]},
+                {"type": "line", "id": "l1", "p1": "p1", "p2": "p2"}
+            ],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        });
+        let dir = tempfile::tempdir().unwrap();
+        let path = |name: &str| dir.path().join(name).to_string_lossy().into_owned();
+        let target = |format, view, name: &str| ExportTarget {
+            format,
+            view,
+            path: path(name),
+        };
+        let targets = [
+            target(ExportFormat::Svg, ViewPlane::Xy, "xy.svg"),
+            target(ExportFormat::Svg, ViewPlane::Xz, "xz.svg"),
+            target(ExportFormat::Svg, ViewPlane::Xy, "xy_again.svg"),
+            target(ExportFormat::Dxf, ViewPlane::Yz, "out.dxf"),
+        ];
+        let mut reader = MemoryReader::new(problem.to_string());
+        handle_export_many(&mut reader, "test.json", &targets, MeshLimits::default()).unwrap();
+
+        let read = |name: &str| std::fs::read_to_string(path(name)).unwrap();
+        let entities = Solver::new(SolverConfig::default())
+            .solve(&serde_json::from_value(problem).unwrap())
+            .unwrap()
+            .entities
+            .unwrap();
+        let single = |format, view| {
+            String::from_utf8(export_entities(&entities, format, view).unwrap()).unwrap()
+        };
+        assert_eq!(read("xy.svg"), single(ExportFormat::Svg, ViewPlane::Xy));
+        assert_eq!(read("xy_again.svg"), read("xy.svg"));
+        assert_eq!(read("xz.svg"), single(ExportFormat::Svg, ViewPlane::Xz));
+        assert_ne!(read("xz.svg"), read("xy.svg"));
+        assert!(read("out.dxf").contains("LINE"));
+    }
+
     #[test]
     fn test_view_plane_conversion() {
         assert!(matches!(SvgViewPlane::from(ViewPlane::Xy), SvgViewPlane::XY));
@@ -586,7 +1357,14 @@ mod tests {
             let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
             let mut writer = MemoryWriter::new();
 
-            let result = handle_export(&mut reader, &mut writer, "test.json", format, ViewPlane::Xy);
+            let result = handle_export(
+                &mut reader,
+                &mut writer,
+                "test.json",
+                format,
+                ViewPlane::Xy,
+                MeshLimits::default(),
+            );
             assert!(result.is_ok(), "Failed for format: {:?}", format);
         }
     }
@@ -608,7 +1386,14 @@ mod tests {
             let mut reader = MemoryReader::new(serde_json::to_string(&problem).unwrap());
             let mut writer = MemoryWriter::new();
 
-            let result = handle_export(&mut reader, &mut writer, "test.json", ExportFormat::Svg, view);
+            let result = handle_export(
+                &mut reader,
+                &mut writer,
+                "test.json",
+                ExportFormat::Svg,
+                view,
+                MeshLimits::default(),
+            );
             assert!(result.is_ok(), "Failed for view: {:?}", view);
         }
     }
@@ -618,7 +1403,17 @@ mod tests {
         // Test with invalid JSON
         let mut reader = MemoryReader::new("{invalid json}".to_string());
         let mut writer = MemoryWriter::new();
-        let result = handle_solve(&mut reader, &mut writer, "test.json");
+        let result = handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            false,
+            None,
+            None,
+            None,
+            OutputFormat::default(),
+        );
         assert!(result.is_err());
 
         // Test with invalid document structure - constraint references nonexistent entity
@@ -635,9 +1430,25 @@ mod tests {
         let mut reader = MemoryReader::new(serde_json::to_string(&invalid).unwrap());
         let mut writer = MemoryWriter::new();
         // This should fail validation before solving
-        let result = handle_solve(&mut reader, &mut writer, "test.json");
-        assert!(result.is_err(), "Should fail validation for nonexistent entity reference");
-        match result.unwrap_err().downcast_ref::<slvsx_core::error::Error>() {
+        let result = handle_solve(
+            &mut reader,
+            &mut writer,
+            "test.json",
+            false,
+            false,
+            None,
+            None,
+            None,
+            OutputFormat::default(),
+        );
+        assert!(
+            result.is_err(),
+            "Should fail validation for nonexistent entity reference"
+        );
+        match result
+            .unwrap_err()
+            .downcast_ref::<slvsx_core::error::Error>()
+        {
             Some(slvsx_core::error::Error::InvalidInput { message, .. }) => {
                 assert!(message.contains("unknown entity") || message.contains("nonexistent"));
             }
@@ -0,0 +1,198 @@
+//! Coalescing solves in `slvsx serve`: a document with the structural hash
+//! of one being solved right now isn't solved again, but waits for that
+//! solve, whose result answers it too, under its own ids (see
+//! `slvsx_core::cache`). Parallel agents that fan out over one sketch then
+//! cost one solve, not one each.
+//!
+//! The first request for a hash leads its flight: it solves, and lands the
+//! flight with its response. Requests that come while it's in the air join
+//! it, handing over where their response goes, so no worker is held while
+//! they wait. Nothing cancels a flight; one whose waiters have all gone
+//! lands as any other, and their responses go nowhere. A leader that
+//! panics lands its flight as it unwinds, and its waiters go unanswered
+//! with it, rather than every later request for the document joining a
+//! flight that never lands.
+//!
+//! Hashes can collide, so a request joins a flight only if its key has
+//! the same structure as the leader's; one that collides solves alone.
+
+use serde_json::Value;
+use slvsx_core::cache::StructuralKey;
+use slvsx_core::wire::WireFormat;
+use std::collections::HashMap;
+use std::sync::mpsc::Sender;
+use std::sync::Mutex;
+use std::time::Instant;
+
+/// A request waiting for a flight: its id, key, format, where its response
+/// goes, and when it was queued
+pub(crate) struct Waiter {
+    pub id: Value,
+    pub key: StructuralKey,
+    pub format: WireFormat,
+    pub reply: Sender<Vec<u8>>,
+    pub queued: Instant,
+}
+
+/// A flight in the air: its leader's key, and who's waiting for it
+struct Flight {
+    key: StructuralKey,
+    waiters: Vec<Waiter>,
+}
+
+/// The flights in the air, by structural hash
+#[derive(Default)]
+pub struct Flights {
+    flying: Mutex<HashMap<u64, Flight>>,
+}
+
+/// What a request does about a flight
+pub(crate) enum Boarding<'a> {
+    /// It's waiting for the flight already in the air
+    Joined,
+    /// It's to solve, and land the flight after
+    Leads(Leading<'a>),
+    /// It's to solve by itself: there's no reply to hand over, or another
+    /// document whose hash collides with its own is in the air
+    Alone,
+}
+
+/// A flight being led, which lands when it's dropped if its leader
+/// hasn't landed it
+pub(crate) struct Leading<'a> {
+    flights: &'a Flights,
+    key: &'a StructuralKey,
+    landed: bool,
+}
+
+impl<'a> Leading<'a> {
+    pub(crate) fn key(&self) -> &'a StructuralKey {
+        self.key
+    }
+
+    /// Land the flight, giving who was waiting for it
+    pub(crate) fn land(mut self) -> Vec<Waiter> {
+        self.landed = true;
+        self.flights.land(self.key)
+    }
+}
+
+impl Drop for Leading<'_> {
+    fn drop(&mut self) {
+        if !self.landed {
+            // Their replies go with them, as the leader's own does
+            drop(self.flights.land(self.key));
+        }
+    }
+}
+
+impl Flights {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Join the flight for a key if one is in the air, making the waiter
+    /// only then; otherwise start one for the caller to lead
+    pub(crate) fn board<'a, F>(&'a self, key: &'a StructuralKey, waiter: F) -> Boarding<'a>
+    where
+        F: FnOnce() -> Option<Waiter>,
+    {
+        let Ok(mut flying) = self.flying.lock() else {
+            return Boarding::Alone;
+        };
+        match flying.get_mut(&key.hash) {
+            Some(flight) if flight.key.same_structure(key) => match waiter() {
+                Some(waiter) => {
+                    flight.waiters.push(waiter);
+                    Boarding::Joined
+                }
+                None => Boarding::Alone,
+            },
+            Some(_) => Boarding::Alone,
+            None => {
+                flying.insert(
+                    key.hash,
+                    Flight {
+                        key: key.clone(),
+                        waiters: Vec::new(),
+                    },
+                );
+                Boarding::Leads(Leading {
+                    flights: self,
+                    key,
+                    landed: false,
+                })
+            }
+        }
+    }
+
+    /// Land the flight for a key, giving who was waiting for it
+    fn land(&self, key: &StructuralKey) -> Vec<Waiter> {
+        let Ok(mut flying) = self.flying.lock() else {
+            return Vec::new();
+        };
+        match flying.get(&key.hash) {
+            Some(flight) if flight.key.same_structure(key) => flying
+                .remove(&key.hash)
+                .map_or_else(Vec::new, |flight| flight.waiters),
+            _ => Vec::new(),
+        }
+    }
+
+    #[cfg(test)]
+    pub fn in_air(&self) -> usize {
+        self.flying.lock().map_or(0, |f| f.len())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use slvsx_core::cache::structural_key;
+    use slvsx_core::InputDocument;
+    use std::sync::mpsc::channel;
+
+    fn key(x: f64) -> StructuralKey {
+        let doc: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [{"type": "point", "id": "p", "at": [x, 0, 0]}],
+            "constraints": []
+        }))
+        .unwrap();
+        structural_key(&doc, 1e-6).unwrap()
+    }
+
+    #[test]
+    fn test_a_panicking_leader_lands() {
+        let (flights, key) = (Flights::new(), key(1.0));
+        let led = std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| {
+            let _leading = flights.board(&key, || None);
+            assert_eq!(flights.in_air(), 1);
+            panic!("the solve failed");
+        }));
+        assert!(led.is_err());
+        assert_eq!(flights.in_air(), 0);
+        assert!(matches!(flights.board(&key, || None), Boarding::Leads(_)));
+    }
+
+    #[test]
+    fn test_a_colliding_hash_flies_alone() {
+        let (flights, key, mut other) = (Flights::new(), key(1.0), key(2.0));
+        other.hash = key.hash;
+        let Boarding::Leads(leading) = flights.board(&key, || None) else {
+            panic!("should lead")
+        };
+        let (reply, _) = channel();
+        let waiter = || {
+            Some(Waiter {
+                id: serde_json::json!(1),
+                key: other.clone(),
+                format: WireFormat::Json,
+                reply,
+                queued: Instant::now(),
+            })
+        };
+        assert!(matches!(flights.board(&other, waiter), Boarding::Alone));
+        assert!(leading.land().is_empty());
+    }
+}
@@ -4,6 +4,12 @@ use std::io::{self, Read, Write};
 /// Trait for reading input from various sources
 pub trait InputReader {
     fn read(&mut self) -> Result<String>;
+
+    /// The input as bytes, to parse straight from the buffer it was read
+    /// into without making a `String` of it first
+    fn read_bytes(&mut self) -> Result<Vec<u8>> {
+        Ok(self.read()?.into_bytes())
+    }
 }
 
 /// Trait for writing output to various destinations
@@ -23,6 +29,12 @@ impl InputReader for StdinReader {
         io::stdin().read_to_string(&mut buffer)?;
         Ok(buffer)
     }
+
+    fn read_bytes(&mut self) -> Result<Vec<u8>> {
+        let mut buffer = Vec::new();
+        io::stdin().lock().read_to_end(&mut buffer)?;
+        Ok(buffer)
+    }
 }
 
 /// File input reader
@@ -40,6 +52,10 @@ impl InputReader for FileReader {
     fn read(&mut self) -> Result<String> {
         Ok(std::fs::read_to_string(&self.path)?)
     }
+
+    fn read_bytes(&mut self) -> Result<Vec<u8>> {
+        Ok(std::fs::read(&self.path)?)
+    }
 }
 
 /// Standard output writer
@@ -52,20 +68,42 @@ impl OutputWriter for StdoutWriter {
     }
 }
 
-/// File output writer
+/// File output writer: the first write creates the file, and each one
+/// after appends to it
 pub struct FileWriter {
     path: String,
+    file: Option<std::fs::File>,
 }
 
 impl FileWriter {
     pub fn new(path: String) -> Self {
-        Self { path }
+        Self { path, file: None }
     }
 }
 
 impl OutputWriter for FileWriter {
     fn write(&mut self, data: &[u8]) -> Result<()> {
-        std::fs::write(&self.path, data)?;
+        if self.file.is_none() {
+            self.file = Some(std::fs::File::create(&self.path)?);
+        }
+        if let Some(file) = self.file.as_mut() {
+            file.write_all(data)?;
+        }
+        Ok(())
+    }
+}
+
+/// An `OutputWriter` as an `io::Write`, to serialize straight into it
+pub struct WriteAdapter<'a, W: OutputWriter + ?Sized>(pub &'a mut W);
+
+impl<W: OutputWriter + ?Sized> Write for WriteAdapter<'_, W> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        OutputWriter::write(self.0, buf)
+            .map_err(|e| io::Error::new(io::ErrorKind::Other, e.to_string()))?;
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
         Ok(())
     }
 }
@@ -239,6 +277,7 @@ pub mod tests {
         
         let mut reader = FileReader::new(tmp_file.path().to_str().unwrap().to_string());
         assert_eq!(reader.read().unwrap(), "test content");
+        assert_eq!(reader.read_bytes().unwrap(), b"test content");
     }
 
     #[test]
@@ -253,6 +292,10 @@ pub mod tests {
         
         let content = std::fs::read_to_string(&path).unwrap();
         assert_eq!(content, "test content");
+
+        writer.write(b" and more").unwrap();
+        let content = std::fs::read_to_string(&path).unwrap();
+        assert_eq!(content, "test content and more");
     }
 
     #[test]
@@ -6,8 +6,21 @@ pub fn parse_json_with_context<T>(input: &str, filename: &str) -> Result<T>
 where
     T: serde::de::DeserializeOwned,
 {
-    serde_json::from_str(input).map_err(|e| {
-        anyhow!(format_json_error(e, input, filename))
+    serde_json::from_str(input).map_err(|e| anyhow!(format_json_error(e, input, filename)))
+}
+
+/// Parse JSON straight from the bytes it was read as, with the same
+/// messages as `parse_json_with_context`
+pub fn parse_json_bytes_with_context<T>(input: &[u8], filename: &str) -> Result<T>
+where
+    T: serde::de::DeserializeOwned,
+{
+    serde_json::from_slice(input).map_err(|e| {
+        anyhow!(format_json_error(
+            e,
+            &String::from_utf8_lossy(input),
+            filename
+        ))
     })
 }
 
@@ -106,6 +119,20 @@ mod tests {
         assert!(err.contains("test.json"));
     }
     
+    #[test]
+    fn test_bytes_parse_like_strings() {
+        let json = br#"{"name": "test", "value": 3}"#;
+        let parsed: TestStruct = parse_json_bytes_with_context(json, "test.json").unwrap();
+        assert_eq!(parsed.value, 3);
+
+        let json = b"{\"name\": \"test\",\n  \"value\": \"x\"}";
+        let err = parse_json_bytes_with_context::<TestStruct>(json, "test.json")
+            .unwrap_err()
+            .to_string();
+        assert!(err.contains("line 2"));
+        assert!(err.contains("\"value\": \"x\""));
+    }
+
     #[test]
     fn test_invalid_syntax_error() {
         let json = r#"{"name": "test", }"#;  // trailing comma
@@ -1,13 +1,44 @@
 use anyhow::Result;
 use clap::{Parser, Subcommand, ValueEnum};
 
+mod animate;
+mod batch;
+mod bench;
 mod commands;
+mod flight;
 mod io;
 mod json_error;
+mod manifest;
+mod metrics;
+mod optimize;
+mod regen;
+mod scaling;
+mod serve;
+mod session;
+mod shard;
+mod store;
+mod sweep;
 
-use commands::{handle_capabilities, handle_export, handle_schema, handle_solve, handle_validate};
+use animate::{handle_animate, parse_extent, AnimateOptions};
+use batch::BatchOptions;
+use bench::handle_bench;
+use commands::{
+    export_targets, handle_capabilities, handle_check, handle_export, handle_export_many,
+    handle_schema, handle_solve, handle_tiles, handle_validate, read_result, MeshLimits,
+    OutputFormat,
+};
+use io::StderrWriter;
 use io::{create_input_reader, create_output_writer};
 use io::StderrWriter;
+use manifest::handle_export_batch;
+use optimize::handle_optimize;
+use regen::{handle_regen, RegenOptions};
+use scaling::handle_scaling;
+use serve::{handle_serve, Admission};
+use shard::Shard;
+use slvsx_core::ffi::TrackSteps;
+use slvsx_core::select::Selection;
+use sweep::{handle_sweep, handle_sweep_merge, handle_sweep_shard};
 
 #[derive(Parser)]
 #[command(name = "slvsx")]
@@ -23,7 +54,69 @@ pub enum ExportFormat {
     Svg,
     Dxf,
     Slvs,
+    /// The binary snapshot of a .slvs, which loads without parsing text
+    SlvsSnapshot,
     Stl,
+    /// Binary STL, a fifth the size of ASCII
+    StlBinary,
+    /// Wavefront OBJ, an indexed mesh with each vertex written once
+    Obj,
+    /// STEP solids with exact surfaces, for CAD
+    Step,
+    /// A PNG preview of the sketch, in the view given
+    Png,
+    /// A PNG preview with the solid of the STL export shaded in
+    PngSolid,
+}
+
+#[derive(Clone, Debug, PartialEq, clap::ValueEnum)]
+pub enum SweepFormat {
+    Csv,
+    Json,
+}
+
+impl From<SweepFormat> for sweep::SweepFormat {
+    fn from(f: SweepFormat) -> Self {
+        match f {
+            SweepFormat::Csv => sweep::SweepFormat::Csv,
+            SweepFormat::Json => sweep::SweepFormat::Json,
+        }
+    }
+}
+
+#[derive(Clone, Debug, PartialEq, clap::ValueEnum)]
+pub enum AnimateFormat {
+    /// An SVG file per frame
+    Svg,
+    /// One SVG that plays the frames in a loop, by SMIL animation
+    SvgAnimated,
+    /// A PNG file per frame
+    Png,
+}
+
+impl From<AnimateFormat> for animate::AnimateFormat {
+    fn from(f: AnimateFormat) -> Self {
+        match f {
+            AnimateFormat::Svg => animate::AnimateFormat::Svg,
+            AnimateFormat::SvgAnimated => animate::AnimateFormat::SvgAnimated,
+            AnimateFormat::Png => animate::AnimateFormat::Png,
+        }
+    }
+}
+
+#[derive(Clone, Copy, Debug, PartialEq, clap::ValueEnum)]
+pub enum WireFormat {
+    Json,
+    Msgpack,
+}
+
+impl From<WireFormat> for slvsx_core::wire::WireFormat {
+    fn from(f: WireFormat) -> Self {
+        match f {
+            WireFormat::Json => slvsx_core::wire::WireFormat::Json,
+            WireFormat::Msgpack => slvsx_core::wire::WireFormat::Msgpack,
+        }
+    }
 }
 
 #[derive(Clone, Debug, PartialEq, clap::ValueEnum)]
@@ -40,7 +133,13 @@ impl From<ExportFormat> for commands::ExportFormat {
             ExportFormat::Svg => commands::ExportFormat::Svg,
             ExportFormat::Dxf => commands::ExportFormat::Dxf,
             ExportFormat::Slvs => commands::ExportFormat::Slvs,
+            ExportFormat::SlvsSnapshot => commands::ExportFormat::SlvsSnapshot,
             ExportFormat::Stl => commands::ExportFormat::Stl,
+            ExportFormat::StlBinary => commands::ExportFormat::StlBinary,
+            ExportFormat::Obj => commands::ExportFormat::Obj,
+            ExportFormat::Step => commands::ExportFormat::Step,
+            ExportFormat::Png => commands::ExportFormat::Png,
+            ExportFormat::PngSolid => commands::ExportFormat::PngSolid,
         }
     }
 }
@@ -63,22 +162,211 @@ enum Commands {
         /// Input file path (use - for stdin)
         file: String,
     },
+    /// Check that a document's coordinates already satisfy its constraints,
+    /// without solving it; exits with an error if any don't
+    Check {
+        /// Input file path (use - for stdin)
+        file: String,
+
+        /// Write the result on one line, without pretty printing
+        #[arg(long)]
+        compact: bool,
+    },
     /// Solve the constraint system
     Solve {
         /// Input file path (use - for stdin)
         file: String,
+
+        /// Read one document per line and write one response per line
+        #[arg(long)]
+        jsonl: bool,
+
+        /// With --jsonl, threads to solve on (0 for one per core)
+        #[arg(short = 'j', long, default_value_t = 0)]
+        jobs: usize,
+
+        /// With --jsonl, the most documents held at once (0 for four per thread)
+        #[arg(long, default_value_t = 0)]
+        max_in_flight: usize,
+
+        /// With --jsonl, write responses in input order
+        #[arg(long)]
+        ordered: bool,
+
+        /// With --jsonl, solve only every Nth line, from the ith, as i/N;
+        /// responses keep their line numbers as ids
+        #[arg(long, requires = "jsonl")]
+        shard: Option<String>,
+
+        /// Report how each point moves with each dimension parameter
+        #[arg(long, conflicts_with = "jsonl")]
+        sensitivities: bool,
+
+        /// Report what each constraint cost the solve, most expensive first
+        #[arg(long, conflicts_with = "jsonl")]
+        profile: bool,
+
+        /// Report the solved circles, arcs and lines that cross each other,
+        /// or come within this clearance (0 if not given), seen from +z
+        #[arg(long, conflicts_with = "jsonl", num_args = 0..=1, default_missing_value = "0")]
+        interference: Option<f64>,
+
+        /// Report the volume, area, centroid and inertia tensor of the
+        /// solid the STL export would make, extruding to this height (100
+        /// if not given)
+        #[arg(long, conflicts_with = "jsonl", num_args = 0..=1, default_missing_value = "100")]
+        mass: Option<f64>,
+
+        /// Write the result on one line, without pretty printing
+        #[arg(long, conflicts_with = "jsonl")]
+        compact: bool,
+
+        /// Round coordinates to this many decimal places
+        #[arg(long, conflicts_with = "jsonl")]
+        decimals: Option<u32>,
+
+        /// Read the document and write the result as JSON or MessagePack
+        #[arg(long, default_value = "json", conflicts_with = "jsonl")]
+        format: WireFormat,
+
+        /// Report only these entities: ids, or globs such as 'arm_*'
+        /// (comma-separated, or repeat the option)
+        #[arg(long, value_delimiter = ',', conflicts_with = "jsonl")]
+        only: Vec<String>,
+
+        /// Report only the entities the solve moved
+        #[arg(long, conflicts_with = "jsonl")]
+        changed_only: bool,
+
+        /// Start each point and circle from where this earlier result has
+        /// it, matched by id
+        #[arg(long, conflicts_with = "jsonl")]
+        initial: Option<String>,
     },
     /// Export solved system to various formats
     Export {
+        /// Input file path (use - for stdin)
+        #[arg(required_unless_present = "batch")]
+        file: Option<String>,
+
+        /// Repeat with --output to write several formats from one solve;
+        /// the nth --format goes to the nth --output
+        #[arg(short, long, default_value = "svg")]
+        format: Vec<ExportFormat>,
+
+        /// Repeat with --output to write several views from one solve
+        #[arg(short, long, default_value = "xy")]
+        view: Vec<ViewPlane>,
+
+        /// Output file; repeat for several, each with its own --format
+        /// and --view (or ones given once, for all of them)
+        #[arg(short, long)]
+        output: Vec<String>,
+
+        /// Simplify an STL or OBJ solid to at most this many triangles
+        #[arg(long, default_value_t = 0)]
+        max_triangles: usize,
+
+        /// Simplify an STL or OBJ solid as far as moves no vertex more
+        /// than this
+        #[arg(long, default_value_t = 0.0)]
+        max_error: f64,
+
+        /// Export everything this manifest lists, a JSON line apiece of
+        /// input, format, view and output, and report on each (JSON)
+        #[arg(long, conflicts_with_all = ["file", "format", "view", "output"])]
+        batch: Option<String>,
+
+        /// With --batch, threads to export on (0 for one per core)
+        #[arg(short = 'j', long, default_value_t = 0, requires = "batch")]
+        jobs: usize,
+
+        /// With --batch, the most documents held at once (0 for four per thread)
+        #[arg(long, default_value_t = 0, requires = "batch")]
+        max_in_flight: usize,
+    },
+    /// Draw a document as a pyramid of SVG tiles at several levels of
+    /// detail, for a viewer to fetch only the tiles it shows
+    Tiles {
         /// Input file path (use - for stdin)
         file: String,
 
+        #[arg(short, long, default_value = "xy")]
+        view: ViewPlane,
+
+        /// Levels of the pyramid; the last draws every entity in full, the
+        /// ones before it simplified to their pixels
+        #[arg(short, long, default_value_t = 6)]
+        levels: u32,
+
+        /// Pixels across a tile
+        #[arg(long, default_value_t = 256)]
+        tile_size: u32,
+
+        /// Threads writing tiles (0 for one per core)
+        #[arg(short = 'j', long, default_value_t = 0)]
+        jobs: usize,
+
+        /// The directory to write {level}/{x}/{y}.svg and tiles.json in
+        #[arg(short, long)]
+        output: String,
+    },
+    /// Drive one parameter over a range and draw the solution at each
+    /// value as a frame of an animation
+    Animate {
+        /// Input file path (use - for stdin)
+        file: String,
+
+        /// The parameter and its values, as name=start:stop:step or
+        /// name=v1,v2,...; each frame is solved from the one before
+        #[arg(short, long = "param")]
+        param: String,
+
         #[arg(short, long, default_value = "svg")]
-        format: ExportFormat,
+        format: AnimateFormat,
 
         #[arg(short, long, default_value = "xy")]
         view: ViewPlane,
 
+        /// Frames a second, for svg-animated
+        #[arg(long, default_value_t = 24.0)]
+        fps: f64,
+
+        /// Frame every frame around min_x,min_y,max_x,max_y in the view,
+        /// rather than around them all; PNG frames are then drawn as
+        /// they're solved
+        #[arg(long)]
+        extent: Option<String>,
+
+        /// Threads drawing frames (0 for one per core)
+        #[arg(short = 'j', long, default_value_t = 0)]
+        jobs: usize,
+
+        /// A directory for a file per frame, or the file of svg-animated
+        #[arg(short, long)]
+        output: String,
+    },
+    /// Load native .slvs files, regenerate every group without a GUI, and
+    /// save them again or export their mesh, reporting each group's timings
+    Regen {
+        /// .slvs files to regenerate
+        #[arg(required = true)]
+        files: Vec<String>,
+
+        /// Write each file here instead of over itself, % standing for its
+        /// name; anything but .slvs exports the mesh (e.g. %.stl)
+        #[arg(long)]
+        to: Option<String>,
+
+        /// Chord tolerance, in mm
+        #[arg(short = 't', long)]
+        chord_tol: Option<f64>,
+
+        /// SolveSpace's headless command line, built from libslvs-static
+        #[arg(long, env = "SLVSX_SOLVESPACE_CLI", default_value = "solvespace-cli")]
+        solvespace_cli: String,
+
+        /// Where to write the timing report
         #[arg(short, long)]
         output: Option<String>,
     },
@@ -86,6 +374,202 @@ enum Commands {
     Capabilities,
     /// Output JSON schema for input documents
     Schema,
+    /// Time every layer of solving a corpus of documents, in-process
+    Bench {
+        /// A document, or a directory to take every document under
+        #[arg(default_value = "examples")]
+        path: String,
+
+        /// Timed runs of each document
+        #[arg(short = 'n', long, default_value_t = 10)]
+        iterations: usize,
+
+        /// Untimed runs of each document first
+        #[arg(long, default_value_t = 1)]
+        warmup: usize,
+
+        #[arg(short, long)]
+        output: Option<String>,
+    },
+    /// Search generated documents for solves that grow faster than they do
+    Scaling {
+        /// Documents to generate and solve, each at two sizes
+        #[arg(short = 'n', long, default_value_t = 20)]
+        rounds: usize,
+
+        /// Seed for the documents, so a search can be run again
+        #[arg(long, default_value_t = 1)]
+        seed: u64,
+
+        /// The largest size to solve a document at
+        #[arg(long, default_value_t = 128)]
+        max_size: usize,
+
+        /// Fail a document whose time or memory grows faster than size to this
+        #[arg(long, default_value_t = 1.5)]
+        max_exponent: f64,
+
+        /// Runs of each document, taking the quickest
+        #[arg(long, default_value_t = 3)]
+        runs: usize,
+
+        /// Keep the smallest failing documents here, for `slvsx bench` to run
+        #[arg(long)]
+        keep: Option<String>,
+
+        #[arg(short, long)]
+        output: Option<String>,
+    },
+    /// Answer newline-delimited JSON requests until the input ends
+    Serve {
+        /// Listen on this Unix socket instead of stdin and stdout
+        #[arg(long)]
+        socket: Option<String>,
+
+        /// Requests to solve at once (0 for one per core)
+        #[arg(short, long, default_value_t = 0)]
+        workers: usize,
+
+        /// Solve results to keep, to answer documents solved before without
+        /// solving them again (0 to keep none)
+        #[arg(long, default_value_t = 1024)]
+        cache_entries: usize,
+
+        /// Most megabytes of solve results to keep
+        #[arg(long, default_value_t = 64)]
+        cache_mb: usize,
+
+        /// Compiled systems to keep, to solve documents that differ from
+        /// one solved before only in values without building them (0 to
+        /// keep none)
+        #[arg(long, default_value_t = 64)]
+        cache_systems: usize,
+
+        /// Keep the documents of compiled systems in this directory, and
+        /// compile them again on starting, so that a restart starts warm
+        #[arg(long)]
+        cache_dir: Option<String>,
+
+        /// Sessions that can be open at once, each a document kept to be
+        /// edited by patches (0 for none)
+        #[arg(long, default_value_t = 64)]
+        sessions: usize,
+
+        /// Count what the server does, and serve it over HTTP at /metrics
+        /// on this address (such as 127.0.0.1:9464) for Prometheus
+        #[arg(long)]
+        metrics: Option<String>,
+
+        /// Refuse documents whose cost, estimated from their structure as
+        /// they're parsed, is over this
+        #[arg(long)]
+        max_cost: Option<f64>,
+
+        /// Solve documents whose estimated cost is over this on a pool of
+        /// their own, so that they don't hold up small ones
+        #[arg(long)]
+        heavy_cost: Option<f64>,
+
+        /// Threads of the pool for heavy documents
+        #[arg(long, default_value_t = 1)]
+        heavy_workers: usize,
+
+        /// Heavy documents to queue for that pool; more are refused as
+        /// overloaded
+        #[arg(long, default_value_t = 16)]
+        heavy_queue: usize,
+
+        /// Most megabytes each solve may hold; one that needs more fails
+        /// as out of memory (exit code 10) rather than taking the server
+        /// down
+        #[arg(long)]
+        memory_mb: Option<u64>,
+
+        /// Requests and replies as lines of JSON, or as MessagePack, each
+        /// after its length as a four byte big-endian integer
+        #[arg(long, default_value = "json")]
+        format: WireFormat,
+    },
+    /// Solve a document over a grid of parameter values
+    Sweep {
+        /// Input file path (use - for stdin)
+        #[arg(required_unless_present = "merge")]
+        file: Option<String>,
+
+        /// A parameter and its values, as name=start:stop:step or
+        /// name=v1,v2,...; repeat for a grid over several
+        #[arg(short, long = "param", required_unless_present = "merge")]
+        params: Vec<String>,
+
+        /// Threads to solve on (0 for one per core)
+        #[arg(short = 'j', long, default_value_t = 0)]
+        jobs: usize,
+
+        /// Stop at the first grid point where this holds, e.g. "ok" or
+        /// "p3.y > 40"
+        #[arg(long)]
+        stop_when: Option<String>,
+
+        /// Follow one solution from each value to the next, by continuation,
+        /// rather than solving each one on its own; for one parameter that
+        /// drives a dimension, such as a linkage's angle
+        #[arg(long)]
+        track: bool,
+
+        /// With --track, the longest step to take between solutions, in the
+        /// dimension's units (0 for no limit)
+        #[arg(long, default_value_t = 0.0, requires = "track")]
+        max_step: f64,
+
+        /// Take each batched grid point's first Newton steps in single
+        /// precision, and the last in double, to the same tolerance
+        #[arg(long, conflicts_with = "track")]
+        mixed_precision: bool,
+
+        /// Solve only the ith of N parts of the grid, as i/N, into a shard
+        /// file at --output; run again, it resumes where the file ends
+        #[arg(long, requires = "output", conflicts_with_all = ["stop_when", "track"])]
+        shard: Option<String>,
+
+        /// Merge these shard files, every shard of one sweep, into its table
+        #[arg(long, num_args = 1.., conflicts_with_all = ["file", "params", "shard", "track"])]
+        merge: Vec<String>,
+
+        #[arg(short, long, default_value = "csv")]
+        format: SweepFormat,
+
+        #[arg(short, long)]
+        output: Option<String>,
+    },
+
+    /// Move parameters within bounds to minimize or maximize a distance
+    /// between solved points (JSON report)
+    Optimize {
+        /// Input file path (use - for stdin)
+        file: String,
+
+        /// Two points, as a,b, to bring together; repeat to minimize the
+        /// longest of several distances
+        #[arg(long, conflicts_with = "maximize")]
+        minimize: Vec<String>,
+
+        /// Two points, as a,b, to move apart; repeat to maximize the
+        /// clearance, the shortest of several distances
+        #[arg(long)]
+        maximize: Vec<String>,
+
+        /// A parameter to optimize and its bounds, as name=min:max; it must
+        /// set only the values of distance, angle and diameter constraints
+        #[arg(short, long = "param", required = true)]
+        params: Vec<String>,
+
+        /// The most quasi-Newton steps to take
+        #[arg(long, default_value_t = 100)]
+        max_iterations: usize,
+
+        #[arg(short, long)]
+        output: Option<String>,
+    },
 }
 
 fn main() -> Result<()> {
@@ -97,20 +581,199 @@ fn main() -> Result<()> {
             let mut error_writer = StderrWriter;
             handle_validate(reader.as_mut(), &file, &mut error_writer)
         }
-        Commands::Solve { file } => {
+        Commands::Check { file, compact } => {
+            let mut reader = create_input_reader(&file);
+            let mut writer = create_output_writer(None);
+            handle_check(reader.as_mut(), writer.as_mut(), &file, compact)
+        }
+        Commands::Solve {
+            file,
+            jsonl: true,
+            jobs,
+            max_in_flight,
+            ordered,
+            shard,
+            ..
+        } => {
+            let jobs = if jobs == 0 {
+                serve::default_workers()
+            } else {
+                jobs
+            };
+            let max_in_flight = if max_in_flight == 0 {
+                4 * jobs
+            } else {
+                max_in_flight
+            };
+            let shard = shard.as_deref().map(Shard::parse).transpose()?;
+            let options = BatchOptions {
+                jobs,
+                max_in_flight,
+                ordered,
+                shard,
+            };
+            let stdout = std::io::stdout().lock();
+            if file == "-" {
+                batch::solve_jsonl(std::io::BufReader::new(std::io::stdin()), stdout, options)
+            } else {
+                let input = std::fs::File::open(&file)
+                    .map_err(|e| anyhow::anyhow!("Failed to open {}: {}", file, e))?;
+                batch::solve_jsonl(std::io::BufReader::new(input), stdout, options)
+            }
+        }
+        Commands::Solve {
+            file,
+            sensitivities,
+            profile,
+            interference,
+            mass,
+            compact,
+            decimals,
+            format,
+            only,
+            changed_only,
+            initial,
+            ..
+        } => {
+            let initial = initial.as_deref().map(read_result).transpose()?;
             let mut reader = create_input_reader(&file);
             let mut writer = create_output_writer(None);
-            handle_solve(reader.as_mut(), writer.as_mut(), &file)
+            let mut select = Selection::only(only);
+            select.changed_only = changed_only;
+            let format = OutputFormat {
+                compact,
+                decimals,
+                wire: format.into(),
+                select,
+            };
+            handle_solve(
+                reader.as_mut(),
+                writer.as_mut(),
+                &file,
+                sensitivities,
+                profile,
+                interference,
+                mass,
+                initial.as_ref(),
+                format,
+            )
         }
         Commands::Export {
             file,
             format,
             view,
             output,
+            max_triangles,
+            max_error,
+            batch,
+            jobs,
+            max_in_flight,
+        } => {
+            let limits = MeshLimits {
+                max_triangles,
+                max_error,
+            };
+            if let Some(manifest) = batch {
+                let jobs = if jobs == 0 {
+                    serve::default_workers()
+                } else {
+                    jobs
+                };
+                let max_in_flight = if max_in_flight == 0 {
+                    4 * jobs
+                } else {
+                    max_in_flight
+                };
+                let mut writer = create_output_writer(None);
+                return handle_export_batch(
+                    &manifest,
+                    jobs,
+                    max_in_flight,
+                    limits,
+                    writer.as_mut(),
+                );
+            }
+            let file = file.unwrap_or_default();
+            let mut reader = create_input_reader(&file);
+            let formats: Vec<_> = format.into_iter().map(Into::into).collect();
+            let views: Vec<_> = view.into_iter().map(Into::into).collect();
+            if output.len() > 1 {
+                let targets = export_targets(&formats, &views, &output)?;
+                return handle_export_many(reader.as_mut(), &file, &targets, limits);
+            }
+            if formats.len() > 1 || views.len() > 1 {
+                anyhow::bail!("Several --format or --view need an --output each");
+            }
+            let mut writer = create_output_writer(output.first().map(String::as_str));
+            handle_export(
+                reader.as_mut(),
+                writer.as_mut(),
+                &file,
+                formats[0],
+                views[0],
+                limits,
+            )
+        }
+        Commands::Tiles {
+            file,
+            view,
+            levels,
+            tile_size,
+            jobs,
+            output,
+        } => {
+            let options = slvsx_exporters::tiles::TileOptions {
+                view: commands::ViewPlane::from(view).into(),
+                levels,
+                tile_size,
+                jobs: if jobs == 0 {
+                    serve::default_workers()
+                } else {
+                    jobs
+                },
+            };
+            let mut reader = create_input_reader(&file);
+            let mut writer = create_output_writer(None);
+            handle_tiles(reader.as_mut(), writer.as_mut(), &file, &output, options)
+        }
+        Commands::Animate {
+            file,
+            param,
+            format,
+            view,
+            fps,
+            extent,
+            jobs,
+            output,
         } => {
+            let options = AnimateOptions {
+                format: format.into(),
+                view: view.into(),
+                jobs: if jobs == 0 {
+                    serve::default_workers()
+                } else {
+                    jobs
+                },
+                fps,
+                extent: extent.as_deref().map(parse_extent).transpose()?,
+            };
             let mut reader = create_input_reader(&file);
+            handle_animate(reader.as_mut(), &file, &param, &output, options)
+        }
+        Commands::Regen {
+            files,
+            to,
+            chord_tol,
+            solvespace_cli,
+            output,
+        } => {
+            let options = RegenOptions {
+                program: solvespace_cli,
+                output: to,
+                chord_tol,
+            };
             let mut writer = create_output_writer(output.as_deref());
-            handle_export(reader.as_mut(), writer.as_mut(), &file, format.into(), view.into())
+            handle_regen(&files, &options, writer.as_mut())
         }
         Commands::Capabilities => {
             let mut writer = create_output_writer(None);
@@ -120,6 +783,141 @@ fn main() -> Result<()> {
             let mut writer = create_output_writer(None);
             handle_schema(writer.as_mut())
         }
+        Commands::Bench {
+            path,
+            iterations,
+            warmup,
+            output,
+        } => {
+            let mut writer = create_output_writer(output.as_deref());
+            handle_bench(&path, iterations, warmup, writer.as_mut())
+        }
+        Commands::Scaling {
+            rounds,
+            seed,
+            max_size,
+            max_exponent,
+            runs,
+            keep,
+            output,
+        } => {
+            let mut writer = create_output_writer(output.as_deref());
+            handle_scaling(
+                rounds,
+                seed,
+                max_size,
+                max_exponent,
+                runs,
+                keep.as_deref(),
+                writer.as_mut(),
+            )
+        }
+        Commands::Serve {
+            socket,
+            workers,
+            cache_entries,
+            cache_mb,
+            cache_systems,
+            cache_dir,
+            sessions,
+            metrics,
+            max_cost,
+            heavy_cost,
+            heavy_workers,
+            heavy_queue,
+            memory_mb,
+            format,
+        } => handle_serve(
+            socket.as_deref(),
+            workers,
+            cache_entries,
+            cache_mb,
+            cache_systems,
+            sessions,
+            metrics.as_deref(),
+            Admission {
+                max_cost,
+                heavy_cost,
+                heavy_workers,
+                heavy_queue,
+                memory_mb,
+            },
+            format.into(),
+            cache_dir.as_deref(),
+        ),
+        Commands::Sweep {
+            file,
+            params,
+            jobs,
+            stop_when,
+            track,
+            max_step,
+            mixed_precision,
+            shard,
+            merge,
+            format,
+            output,
+        } => {
+            let jobs = if jobs == 0 {
+                serve::default_workers()
+            } else {
+                jobs
+            };
+            if !merge.is_empty() {
+                let mut writer = create_output_writer(output.as_deref());
+                return handle_sweep_merge(writer.as_mut(), &merge, format.into());
+            }
+            let file = file.unwrap_or_default();
+            let mut reader = create_input_reader(&file);
+            if let (Some(shard), Some(path)) = (shard, output.as_deref()) {
+                let shard = Shard::parse(&shard)?;
+                return handle_sweep_shard(
+                    reader.as_mut(),
+                    &file,
+                    &params,
+                    jobs,
+                    mixed_precision,
+                    shard,
+                    path,
+                );
+            }
+            let track = track.then_some(TrackSteps {
+                max: max_step,
+                ..TrackSteps::default()
+            });
+            let mut writer = create_output_writer(output.as_deref());
+            handle_sweep(
+                reader.as_mut(),
+                writer.as_mut(),
+                &file,
+                &params,
+                jobs,
+                mixed_precision,
+                stop_when.as_deref(),
+                track,
+                format.into(),
+            )
+        }
+        Commands::Optimize {
+            file,
+            minimize,
+            maximize,
+            params,
+            max_iterations,
+            output,
+        } => {
+            let mut reader = create_input_reader(&file);
+            let mut writer = create_output_writer(output.as_deref());
+            handle_optimize(
+                reader.as_mut(),
+                writer.as_mut(),
+                &file,
+                &minimize,
+                &maximize,
+                &params,
+                max_iterations,
+            )
+        }
     }
 }
 
@@ -142,11 +940,133 @@ mod tests {
         }
     }
 
+    #[test]
+    fn test_cli_parse_check() {
+        let cli = Cli::parse_from(["slvsx", "check", "--compact", "file.json"]);
+        match cli.command {
+            Commands::Check { file, compact } => {
+                assert_eq!(file, "file.json");
+                assert!(compact);
+            }
+            _ => panic!("Expected Check command"),
+        }
+    }
+
     #[test]
     fn test_cli_parse_solve() {
         let cli = Cli::parse_from(["slvsx", "solve", "-"]);
         match cli.command {
-            Commands::Solve { file } => assert_eq!(file, "-"),
+            Commands::Solve { file, jsonl, .. } => {
+                assert_eq!(file, "-");
+                assert!(!jsonl);
+            }
+            _ => panic!("Expected Solve command"),
+        }
+    }
+
+    #[test]
+    fn test_cli_parse_solve_sensitivities() {
+        let cli = Cli::parse_from(["slvsx", "solve", "--sensitivities", "in.json"]);
+        match cli.command {
+            Commands::Solve { sensitivities, .. } => assert!(sensitivities),
+            _ => panic!("Expected Solve command"),
+        }
+        assert!(
+            Cli::try_parse_from(["slvsx", "solve", "--jsonl", "--sensitivities", "-"]).is_err()
+        );
+    }
+
+    #[test]
+    fn test_cli_parse_solve_profile() {
+        let cli = Cli::parse_from(["slvsx", "solve", "--profile", "in.json"]);
+        match cli.command {
+            Commands::Solve { profile, .. } => assert!(profile),
+            _ => panic!("Expected Solve command"),
+        }
+        assert!(Cli::try_parse_from(["slvsx", "solve", "--jsonl", "--profile", "-"]).is_err());
+    }
+
+    #[test]
+    fn test_cli_parse_solve_interference() {
+        let cli = Cli::parse_from(["slvsx", "solve", "--interference", "--", "in.json"]);
+        match cli.command {
+            Commands::Solve { interference, .. } => assert_eq!(interference, Some(0.0)),
+            _ => panic!("Expected Solve command"),
+        }
+        let cli = Cli::parse_from(["slvsx", "solve", "--interference", "0.5", "in.json"]);
+        match cli.command {
+            Commands::Solve { interference, .. } => assert_eq!(interference, Some(0.5)),
+            _ => panic!("Expected Solve command"),
+        }
+    }
+
+    #[test]
+    fn test_cli_parse_solve_mass() {
+        let cli = Cli::parse_from(["slvsx", "solve", "--mass", "--", "in.json"]);
+        assert!(matches!(cli.command, Commands::Solve { mass: Some(h), .. } if h == 100.0));
+        let cli = Cli::parse_from(["slvsx", "solve", "--mass", "5", "in.json"]);
+        assert!(matches!(cli.command, Commands::Solve { mass: Some(h), .. } if h == 5.0));
+        assert!(Cli::try_parse_from(["slvsx", "solve", "--jsonl", "--mass", "5", "-"]).is_err());
+    }
+
+    #[test]
+    fn test_cli_parse_solve_output_format() {
+        let cli = Cli::parse_from(["slvsx", "solve", "--compact", "--decimals", "6", "in.json"]);
+        match cli.command {
+            Commands::Solve {
+                compact, decimals, ..
+            } => {
+                assert!(compact);
+                assert_eq!(decimals, Some(6));
+            }
+            _ => panic!("Expected Solve command"),
+        }
+        assert!(Cli::try_parse_from(["slvsx", "solve", "--jsonl", "--compact", "-"]).is_err());
+
+        let cli = Cli::parse_from(["slvsx", "solve", "--format", "msgpack", "in.msgpack"]);
+        match cli.command {
+            Commands::Solve { format, .. } => assert_eq!(format, WireFormat::Msgpack),
+            _ => panic!("Expected Solve command"),
+        }
+
+        let cli = Cli::parse_from(["slvsx", "solve", "--only", "p1,arm_*", "--only", "p2", "-"]);
+        match cli.command {
+            Commands::Solve {
+                only, changed_only, ..
+            } => {
+                assert_eq!(only, ["p1", "arm_*", "p2"]);
+                assert!(!changed_only);
+            }
+            _ => panic!("Expected Solve command"),
+        }
+    }
+
+    #[test]
+    fn test_cli_parse_solve_jsonl() {
+        let cli = Cli::parse_from([
+            "slvsx",
+            "solve",
+            "--jsonl",
+            "-j",
+            "8",
+            "--ordered",
+            "docs.jsonl",
+        ]);
+        match cli.command {
+            Commands::Solve {
+                file,
+                jsonl,
+                jobs,
+                max_in_flight,
+                ordered,
+                ..
+            } => {
+                assert_eq!(file, "docs.jsonl");
+                assert!(jsonl);
+                assert_eq!(jobs, 8);
+                assert_eq!(max_in_flight, 0);
+                assert!(ordered);
+            }
             _ => panic!("Expected Solve command"),
         }
     }
@@ -185,6 +1105,244 @@ mod tests {
         }
     }
 
+    #[test]
+    fn test_cli_parse_bench_defaults() {
+        let cli = Cli::parse_from(["slvsx", "bench"]);
+        match cli.command {
+            Commands::Bench {
+                path,
+                iterations,
+                warmup,
+                output,
+            } => {
+                assert_eq!(path, "examples");
+                assert_eq!(iterations, 10);
+                assert_eq!(warmup, 1);
+                assert_eq!(output, None);
+            }
+            _ => panic!("Expected Bench command"),
+        }
+    }
+
+    #[test]
+    fn test_cli_parse_bench_with_options() {
+        let cli = Cli::parse_from(["slvsx", "bench", "-n", "50", "--warmup", "0", "corpus"]);
+        match cli.command {
+            Commands::Bench {
+                path,
+                iterations,
+                warmup,
+                ..
+            } => {
+                assert_eq!(path, "corpus");
+                assert_eq!(iterations, 50);
+                assert_eq!(warmup, 0);
+            }
+            _ => panic!("Expected Bench command"),
+        }
+    }
+
+    #[test]
+    fn test_cli_parse_serve() {
+        let cli = Cli::parse_from([
+            "slvsx",
+            "serve",
+            "--socket",
+            "/tmp/slvsx.sock",
+            "-w",
+            "4",
+            "--metrics",
+            "127.0.0.1:9464",
+            "--heavy-cost",
+            "5000",
+            "--cache-dir",
+            "/var/cache/slvsx",
+        ]);
+        match cli.command {
+            Commands::Serve {
+                socket,
+                workers,
+                cache_entries,
+                cache_dir,
+                metrics,
+                max_cost,
+                heavy_cost,
+                heavy_workers,
+                ..
+            } => {
+                assert_eq!(socket, Some("/tmp/slvsx.sock".to_string()));
+                assert_eq!(workers, 4);
+                assert_eq!(cache_entries, 1024);
+                assert_eq!(cache_dir, Some("/var/cache/slvsx".to_string()));
+                assert_eq!(metrics, Some("127.0.0.1:9464".to_string()));
+                assert_eq!(max_cost, None);
+                assert_eq!(heavy_cost, Some(5000.0));
+                assert_eq!(heavy_workers, 1);
+            }
+            _ => panic!("Expected Serve command"),
+        }
+    }
+
+    #[test]
+    fn test_cli_parse_sweep() {
+        let cli = Cli::parse_from([
+            "slvsx",
+            "sweep",
+            "-p",
+            "r=1:10",
+            "--param",
+            "k=1,2",
+            "--stop-when",
+            "ok",
+            "doc.json",
+        ]);
+        match cli.command {
+            Commands::Sweep {
+                file,
+                params,
+                jobs,
+                stop_when,
+                track,
+                mixed_precision,
+                format,
+                output,
+                ..
+            } => {
+                assert_eq!(file.as_deref(), Some("doc.json"));
+                assert_eq!(params, vec!["r=1:10", "k=1,2"]);
+                assert_eq!(jobs, 0);
+                assert_eq!(stop_when, Some("ok".to_string()));
+                assert!(!track);
+                assert!(!mixed_precision);
+                assert_eq!(format, SweepFormat::Csv);
+                assert_eq!(output, None);
+            }
+            _ => panic!("Expected Sweep command"),
+        }
+
+        let cli = Cli::parse_from([
+            "slvsx",
+            "sweep",
+            "-p",
+            "r=1:10",
+            "--mixed-precision",
+            "doc.json",
+        ]);
+        assert!(matches!(
+            cli.command,
+            Commands::Sweep {
+                mixed_precision: true,
+                ..
+            }
+        ));
+        let both = [
+            "slvsx",
+            "sweep",
+            "-p",
+            "r=1:10",
+            "--mixed-precision",
+            "--track",
+            "doc.json",
+        ];
+        assert!(Cli::try_parse_from(both).is_err());
+    }
+
+    #[test]
+    fn test_cli_parse_sweep_shards() {
+        let cli = Cli::parse_from([
+            "slvsx",
+            "sweep",
+            "-p",
+            "r=1:10",
+            "--shard",
+            "2/4",
+            "-o",
+            "part2.jsonl",
+            "doc.json",
+        ]);
+        match cli.command {
+            Commands::Sweep { shard, output, .. } => {
+                assert_eq!(shard.as_deref(), Some("2/4"));
+                assert_eq!(output.as_deref(), Some("part2.jsonl"));
+            }
+            _ => panic!("Expected Sweep command"),
+        }
+        // A shard needs a file to write to and resume from
+        assert!(Cli::try_parse_from([
+            "slvsx", "sweep", "-p", "r=1:10", "--shard", "2/4", "doc.json"
+        ])
+        .is_err());
+
+        let cli = Cli::parse_from([
+            "slvsx",
+            "sweep",
+            "--merge",
+            "part1.jsonl",
+            "part2.jsonl",
+            "-f",
+            "json",
+        ]);
+        match cli.command {
+            Commands::Sweep {
+                file,
+                merge,
+                format,
+                ..
+            } => {
+                assert_eq!(file, None);
+                assert_eq!(merge, vec!["part1.jsonl", "part2.jsonl"]);
+                assert_eq!(format, SweepFormat::Json);
+            }
+            _ => panic!("Expected Sweep command"),
+        }
+        assert!(Cli::try_parse_from(["slvsx", "sweep", "doc.json"]).is_err());
+    }
+
+    #[test]
+    fn test_cli_parse_optimize() {
+        let cli = Cli::parse_from([
+            "slvsx",
+            "optimize",
+            "--maximize",
+            "p2,p3",
+            "--maximize",
+            "p2,p4",
+            "-p",
+            "r=5:40",
+            "doc.json",
+        ]);
+        match cli.command {
+            Commands::Optimize {
+                file,
+                minimize,
+                maximize,
+                params,
+                max_iterations,
+                output,
+            } => {
+                assert_eq!(file, "doc.json");
+                assert!(minimize.is_empty());
+                assert_eq!(maximize, vec!["p2,p3", "p2,p4"]);
+                assert_eq!(params, vec!["r=5:40"]);
+                assert_eq!(max_iterations, 100);
+                assert_eq!(output, None);
+            }
+            _ => panic!("Expected Optimize command"),
+        }
+        assert!(Cli::try_parse_from([
+            "slvsx",
+            "optimize",
+            "--minimize",
+            "a,b",
+            "--maximize",
+            "a,c",
+            "-p",
+            "r=1:2",
+            "doc.json",
+        ])
+        .is_err());
+    }
+
     #[test]
     fn test_cli_parse_export_with_output() {
         let cli = Cli::parse_from(["slvsx", "export", "--output", "out.svg", "file.json"]);
@@ -0,0 +1,309 @@
+//! `slvsx export --batch`: export many documents, each in any number of
+//! formats and views, from one process.
+//!
+//! The manifest is JSON Lines, one export to a line:
+//! `{"input": "a.json", "format": "svg", "view": "xy", "output": "a.svg"}`,
+//! the view defaulting to `xy`, and paths that aren't absolute taken from
+//! the manifest's directory. Blank lines are skipped. Each document is
+//! read, solved once however many lines name it, and written through the
+//! streaming exporters to each of its outputs, on a pool of threads. Only
+//! a bounded number of documents are held at once, read but not yet
+//! exported. A report of how every line went is written once they all
+//! have, in manifest order.
+
+use crate::commands::{write_export, ExportFormat, MeshLimits, ViewPlane};
+use crate::io::OutputWriter;
+use crate::json_error::parse_json_bytes_with_context;
+use anyhow::{anyhow, Result};
+use serde::{Deserialize, Serialize};
+use slvsx_core::{
+    ir::ResolvedEntity,
+    solver::{Solver, SolverConfig},
+    InputDocument,
+};
+use std::collections::HashMap;
+use std::io::Write;
+use std::path::{Path, PathBuf};
+use std::sync::mpsc::{channel, sync_channel};
+use std::sync::Mutex;
+use std::thread;
+
+/// A line of the manifest, as written
+#[derive(Debug, Deserialize)]
+#[serde(deny_unknown_fields)]
+struct ManifestLine {
+    input: String,
+    format: String,
+    #[serde(default = "default_view")]
+    view: String,
+    output: String,
+}
+
+fn default_view() -> String {
+    "xy".to_string()
+}
+
+/// One output of a document, and the manifest line that asked for it
+#[derive(Debug, Clone, PartialEq)]
+struct Target {
+    line: usize,
+    format: ExportFormat,
+    view: ViewPlane,
+    output: PathBuf,
+}
+
+/// A document to export, and everything to export it to
+#[derive(Debug, Clone, PartialEq)]
+struct Document {
+    input: PathBuf,
+    targets: Vec<Target>,
+}
+
+/// How one line of the manifest went
+#[derive(Debug, Clone, PartialEq, Serialize)]
+pub struct ItemStatus {
+    pub line: usize,
+    pub input: String,
+    pub output: String,
+    pub ok: bool,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    pub error: Option<String>,
+}
+
+#[derive(Debug, Serialize)]
+pub struct BatchExportReport {
+    pub exported: usize,
+    pub failed: usize,
+    pub items: Vec<ItemStatus>,
+}
+
+/// The documents a manifest names, in the order each is first named, with
+/// the outputs of every line naming it. A line that can't be read fails
+/// the whole manifest, before anything is exported.
+fn read_manifest(text: &str, base: &Path) -> Result<Vec<Document>> {
+    let mut documents: Vec<Document> = Vec::new();
+    let mut by_input: HashMap<PathBuf, usize> = HashMap::new();
+    for (index, line) in text.lines().enumerate() {
+        if line.trim().is_empty() {
+            continue;
+        }
+        let number = index + 1;
+        let entry: ManifestLine = serde_json::from_str(line)
+            .map_err(|e| anyhow!("Line {} of the manifest: {}", number, e))?;
+        let target = Target {
+            line: number,
+            format: entry
+                .format
+                .parse()
+                .map_err(|e| anyhow!("Line {} of the manifest: {}", number, e))?,
+            view: entry
+                .view
+                .parse()
+                .map_err(|e| anyhow!("Line {} of the manifest: {}", number, e))?,
+            output: base.join(&entry.output),
+        };
+        let input = base.join(&entry.input);
+        match by_input.get(&input) {
+            Some(&i) => documents[i].targets.push(target),
+            None => {
+                by_input.insert(input.clone(), documents.len());
+                documents.push(Document {
+                    input,
+                    targets: vec![target],
+                });
+            }
+        }
+    }
+    Ok(documents)
+}
+
+/// Parse and solve a document
+fn solve(solver: &Solver, input: &Path, bytes: &[u8]) -> Result<HashMap<String, ResolvedEntity>> {
+    let doc: InputDocument = parse_json_bytes_with_context(bytes, &input.display().to_string())?;
+    Ok(solver.solve(&doc)?.entities.unwrap_or_default())
+}
+
+fn write_target(
+    entities: &HashMap<String, ResolvedEntity>,
+    target: &Target,
+    limits: MeshLimits,
+) -> Result<()> {
+    let file = std::fs::File::create(&target.output)
+        .map_err(|e| anyhow!("Failed to create {}: {}", target.output.display(), e))?;
+    let mut out = std::io::BufWriter::with_capacity(64 * 1024, file);
+    write_export(entities, target.format, target.view, limits, &mut out)?;
+    out.flush()?;
+    Ok(())
+}
+
+/// Solve a document read, or not, and write each of its outputs
+fn export_document(
+    solver: &Solver,
+    document: &Document,
+    bytes: Result<Vec<u8>>,
+    limits: MeshLimits,
+) -> Vec<ItemStatus> {
+    let solved = bytes.and_then(|bytes| solve(solver, &document.input, &bytes));
+    document
+        .targets
+        .iter()
+        .map(|target| {
+            let outcome = match &solved {
+                Ok(entities) => write_target(entities, target, limits),
+                Err(e) => Err(anyhow!("{}", e)),
+            };
+            ItemStatus {
+                line: target.line,
+                input: document.input.display().to_string(),
+                output: target.output.display().to_string(),
+                ok: outcome.is_ok(),
+                error: outcome.err().map(|e| e.to_string()),
+            }
+        })
+        .collect()
+}
+
+/// Export everything the manifest at `path` lists on `jobs` threads,
+/// holding at most `max_in_flight` documents read but not yet exported,
+/// and write the report. Fails if the manifest can't be read, or once
+/// the report is written, if any export failed.
+pub fn handle_export_batch<W: OutputWriter + ?Sized>(
+    path: &str,
+    jobs: usize,
+    max_in_flight: usize,
+    limits: MeshLimits,
+    writer: &mut W,
+) -> Result<()> {
+    let text = std::fs::read_to_string(path)
+        .map_err(|e| anyhow!("Failed to read manifest {}: {}", path, e))?;
+    let base = Path::new(path).parent().unwrap_or(Path::new(""));
+    let documents = read_manifest(&text, base)?;
+
+    let (read, queue) = sync_channel::<(Document, Result<Vec<u8>>)>(max_in_flight.max(1));
+    let queue = Mutex::new(queue);
+    let (results, finished) = channel::<Vec<ItemStatus>>();
+    thread::scope(|scope| {
+        scope.spawn(move || {
+            for document in documents {
+                let bytes = std::fs::read(&document.input)
+                    .map_err(|e| anyhow!("Failed to read {}: {}", document.input.display(), e));
+                if read.send((document, bytes)).is_err() {
+                    break;
+                }
+            }
+        });
+        for _ in 0..jobs.max(1) {
+            let (queue, results) = (&queue, results.clone());
+            scope.spawn(move || {
+                let solver = Solver::new(SolverConfig::default());
+                loop {
+                    let job = queue.lock().map(|q| q.recv());
+                    let Ok(Ok((document, bytes))) = job else {
+                        break;
+                    };
+                    if results
+                        .send(export_document(&solver, &document, bytes, limits))
+                        .is_err()
+                    {
+                        break;
+                    }
+                }
+            });
+        }
+    });
+    drop(results);
+
+    let mut items: Vec<ItemStatus> = finished.into_iter().flatten().collect();
+    items.sort_by_key(|item| item.line);
+    let failed = items.iter().filter(|item| !item.ok).count();
+    let report = BatchExportReport {
+        exported: items.len() - failed,
+        failed,
+        items,
+    };
+    writer.write_str(&serde_json::to_string_pretty(&report)?)?;
+    match failed {
+        0 => Ok(()),
+        n => Err(anyhow!("{} of {} exports failed", n, report.items.len())),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::io::tests::MemoryWriter;
+
+    const SQUARE: &str = r#"{
+        "schema": "slvs-json/1",
+        "entities": [
+            {"type": "point", "id": "a", "at": [0, 0, 0]},
+            {"type": "point", "id": "b", "at": [10, 0, 0]},
+            {"type": "line", "id": "ab", "p1": "a", "p2": "b"}
+        ],
+        "constraints": [{"type": "fixed", "entity": "a"}]
+    }"#;
+
+    #[test]
+    fn test_manifest_groups_outputs_by_input() {
+        let text = concat!(
+            r#"{"input": "a.json", "format": "svg", "output": "a.svg"}"#,
+            "\n\n",
+            r#"{"input": "b.json", "format": "png", "view": "isometric", "output": "b.png"}"#,
+            "\n",
+            r#"{"input": "a.json", "format": "dxf", "output": "out/a.dxf"}"#,
+        );
+        let documents = read_manifest(text, Path::new("cat")).unwrap();
+        assert_eq!(documents.len(), 2);
+        assert_eq!(documents[0].input, Path::new("cat/a.json"));
+        let lines: Vec<usize> = documents[0].targets.iter().map(|t| t.line).collect();
+        assert_eq!(lines, [1, 4]);
+        assert_eq!(documents[0].targets[1].format, ExportFormat::Dxf);
+        assert_eq!(documents[0].targets[1].output, Path::new("cat/out/a.dxf"));
+        assert_eq!(documents[1].targets[0].view, ViewPlane::Isometric);
+    }
+
+    #[test]
+    fn test_manifest_with_a_bad_line_fails() {
+        let bad_format = r#"{"input": "a.json", "format": "gif", "output": "a.gif"}"#;
+        let err = read_manifest(bad_format, Path::new("")).unwrap_err();
+        assert!(err.to_string().contains("Line 1"), "{}", err);
+        assert!(read_manifest(r#"{"input": "a.json"}"#, Path::new("")).is_err());
+    }
+
+    #[test]
+    fn test_export_batch_writes_every_output_and_reports() {
+        let dir = tempfile::tempdir().unwrap();
+        std::fs::write(dir.path().join("square.json"), SQUARE).unwrap();
+        let manifest = dir.path().join("manifest.jsonl");
+        std::fs::write(
+            &manifest,
+            [
+                r#"{"input": "square.json", "format": "svg", "output": "square.svg"}"#,
+                r#"{"input": "square.json", "format": "dxf", "output": "square.dxf"}"#,
+                r#"{"input": "missing.json", "format": "svg", "output": "missing.svg"}"#,
+            ]
+            .join("\n"),
+        )
+        .unwrap();
+
+        let mut writer = MemoryWriter::new();
+        let path = manifest.to_str().unwrap();
+        let result = handle_export_batch(path, 2, 1, MeshLimits::default(), &mut writer);
+        assert!(
+            result.is_err(),
+            "the missing document should fail the batch"
+        );
+
+        let report: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        assert_eq!(report["exported"], 2);
+        assert_eq!(report["failed"], 1);
+        let items = report["items"].as_array().unwrap();
+        let lines: Vec<_> = items.iter().map(|i| i["line"].as_u64().unwrap()).collect();
+        assert_eq!(lines, [1, 2, 3]);
+        assert!(items[2]["error"].as_str().unwrap().contains("missing.json"));
+        let svg = std::fs::read_to_string(dir.path().join("square.svg")).unwrap();
+        assert!(svg.starts_with("<svg"));
+        assert!(dir.path().join("square.dxf").exists());
+        assert!(!dir.path().join("missing.svg").exists());
+    }
+}
@@ -0,0 +1,514 @@
+//! `slvsx serve --metrics ADDR`: counters of what the server is doing,
+//! served over HTTP at `/metrics` in the Prometheus text format.
+//!
+//! Every counter is an atomic that workers bump without taking a lock, and
+//! a scrape reads them as they stand. The metrics are:
+//!
+//! - `slvsx_requests_total{command}`, requests by command (`solve`,
+//!   `validate`, or `unknown` for those that didn't parse)
+//! - `slvsx_request_duration_seconds`, from a request being queued to its
+//!   response being ready
+//! - `slvsx_phase_duration_seconds{phase}`, the time in each of `parse`,
+//!   `validate`, `build`, `solve` and `serialize`
+//! - `slvsx_outcomes_total{status}`, responses by outcome: `ok`, or the
+//!   error that `slvsx solve` would exit with
+//! - `slvsx_queue_depth`, requests queued and not yet taken by a worker
+//! - `slvsx_cache_lookups_total{cache,result}`, hits and misses of the
+//!   `results` and `systems` caches, whose ratio is the hit rate
+//! - `slvsx_coalesced_total`, requests answered by the solve of the same
+//!   document already in flight rather than solved again
+//! - `slvsx_admissions_total{lane}`, requests by where their estimated
+//!   cost sent them: `light`, `heavy` or `refused` (only with cost limits)
+//! - `slvsx_arena_peak_bytes`, the most any one solve held in the solver's
+//!   temporary arenas at once
+//! - `slvsx_resident_peak_bytes`, the process's peak resident set, where
+//!   the platform says (Linux)
+//! - `slvsx_newton_iterations`, the Newton iterations each solve took
+
+use anyhow::{anyhow, Result};
+use std::fmt::Write as _;
+use std::io::{Read, Write};
+use std::net::TcpListener;
+use std::sync::atomic::{AtomicI64, AtomicU64, Ordering::Relaxed};
+use std::sync::Arc;
+use std::thread;
+use std::time::Duration;
+
+/// Upper bounds of the latency buckets, in seconds
+const SECONDS: &[f64] = &[
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5,
+    5.0, 10.0,
+];
+
+/// Upper bounds of the iteration buckets
+const ITERATIONS: &[f64] = &[0.0, 1.0, 2.0, 3.0, 5.0, 8.0, 13.0, 21.0, 34.0, 55.0, 100.0];
+
+/// A phase of answering a request
+#[derive(Debug, Clone, Copy)]
+pub enum Phase {
+    Parse,
+    Validate,
+    Build,
+    Solve,
+    Serialize,
+}
+
+const PHASES: [&str; 5] = ["parse", "validate", "build", "solve", "serialize"];
+
+/// A request's command, as counted
+#[derive(Debug, Clone, Copy)]
+pub enum CommandLabel {
+    Solve,
+    Validate,
+    Unknown,
+}
+
+const COMMANDS: [&str; 3] = ["solve", "validate", "unknown"];
+
+/// Outcomes by exit code, 0 for ok (see `slvsx_core::Error::exit_code`)
+const OUTCOMES: [&str; 11] = [
+    "ok",
+    "error",
+    "invalid_input",
+    "did_not_converge",
+    "overconstrained",
+    "underconstrained",
+    "ffi",
+    "invalid_system",
+    "too_many_unknowns",
+    "timed_out",
+    "resource_exhausted",
+];
+
+/// A cache whose lookups are counted
+#[derive(Debug, Clone, Copy)]
+pub enum CacheLabel {
+    Results,
+    Systems,
+}
+
+const CACHES: [&str; 2] = ["results", "systems"];
+
+/// Where a request's estimated cost sent it
+#[derive(Debug, Clone, Copy)]
+pub enum Lane {
+    Light,
+    Heavy,
+    Refused,
+}
+
+const LANES: [&str; 3] = ["light", "heavy", "refused"];
+
+/// Counts of observations at or below each bound (not cumulative; a scrape
+/// adds them up), with their count and sum
+struct Histogram {
+    bounds: &'static [f64],
+    buckets: Vec<AtomicU64>,
+    count: AtomicU64,
+    /// The sum's f64 bits
+    sum: AtomicU64,
+}
+
+impl Histogram {
+    fn new(bounds: &'static [f64]) -> Self {
+        Self {
+            bounds,
+            // The last is +Inf
+            buckets: (0..=bounds.len()).map(|_| AtomicU64::new(0)).collect(),
+            count: AtomicU64::new(0),
+            sum: AtomicU64::new(0f64.to_bits()),
+        }
+    }
+
+    fn observe(&self, value: f64) {
+        let bucket = self.bounds.partition_point(|&b| b < value);
+        self.buckets[bucket].fetch_add(1, Relaxed);
+        self.count.fetch_add(1, Relaxed);
+        let _ = self.sum.fetch_update(Relaxed, Relaxed, |s| {
+            Some((f64::from_bits(s) + value).to_bits())
+        });
+    }
+
+    fn render(&self, out: &mut String, name: &str, labels: &str) {
+        let mut cumulative = 0;
+        let sep = if labels.is_empty() { "" } else { "," };
+        for (i, bucket) in self.buckets.iter().enumerate() {
+            cumulative += bucket.load(Relaxed);
+            let le = self
+                .bounds
+                .get(i)
+                .map_or("+Inf".to_string(), |b| b.to_string());
+            let _ = writeln!(
+                out,
+                "{}_bucket{{{}{}le=\"{}\"}} {}",
+                name, labels, sep, le, cumulative
+            );
+        }
+        let braces = if labels.is_empty() {
+            String::new()
+        } else {
+            format!("{{{}}}", labels)
+        };
+        let _ = writeln!(
+            out,
+            "{}_sum{} {}",
+            name,
+            braces,
+            f64::from_bits(self.sum.load(Relaxed))
+        );
+        let _ = writeln!(out, "{}_count{} {}", name, braces, self.count.load(Relaxed));
+    }
+}
+
+/// What `slvsx serve` counts, shared by its workers and the endpoint
+pub struct Metrics {
+    requests: [AtomicU64; 3],
+    latency: Histogram,
+    phases: [Histogram; 5],
+    outcomes: [AtomicU64; 11],
+    queue_depth: AtomicI64,
+    /// Hits then misses, for each cache
+    cache_lookups: [[AtomicU64; 2]; 2],
+    admissions: [AtomicU64; 3],
+    coalesced: AtomicU64,
+    arena_peak_bytes: AtomicU64,
+    iterations: Histogram,
+}
+
+impl Default for Metrics {
+    fn default() -> Self {
+        Self {
+            requests: Default::default(),
+            latency: Histogram::new(SECONDS),
+            phases: std::array::from_fn(|_| Histogram::new(SECONDS)),
+            outcomes: Default::default(),
+            queue_depth: AtomicI64::new(0),
+            cache_lookups: Default::default(),
+            admissions: Default::default(),
+            coalesced: AtomicU64::new(0),
+            arena_peak_bytes: AtomicU64::new(0),
+            iterations: Histogram::new(ITERATIONS),
+        }
+    }
+}
+
+impl Metrics {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn request(&self, command: CommandLabel) {
+        self.requests[command as usize].fetch_add(1, Relaxed);
+    }
+
+    /// A request's response is ready, this long after it was queued
+    pub fn answered(&self, latency: Duration) {
+        self.latency.observe(latency.as_secs_f64());
+    }
+
+    pub fn phase(&self, phase: Phase, took: Duration) {
+        self.phases[phase as usize].observe(took.as_secs_f64());
+    }
+
+    /// A response's outcome, by the exit code of its error (0 for ok)
+    pub fn outcome(&self, exit_code: i32) {
+        let i = usize::try_from(exit_code)
+            .ok()
+            .filter(|&i| i < OUTCOMES.len())
+            .unwrap_or(1);
+        self.outcomes[i].fetch_add(1, Relaxed);
+    }
+
+    pub fn queued(&self) {
+        self.queue_depth.fetch_add(1, Relaxed);
+    }
+
+    pub fn dequeued(&self) {
+        self.queue_depth.fetch_sub(1, Relaxed);
+    }
+
+    pub fn cache_lookup(&self, cache: CacheLabel, hit: bool) {
+        self.cache_lookups[cache as usize][usize::from(!hit)].fetch_add(1, Relaxed);
+    }
+
+    pub fn admitted(&self, lane: Lane) {
+        self.admissions[lane as usize].fetch_add(1, Relaxed);
+    }
+
+    pub fn coalesced(&self) {
+        self.coalesced.fetch_add(1, Relaxed);
+    }
+
+    /// What a solve reported of itself
+    pub fn solved(&self, diagnostics: &slvsx_core::ir::Diagnostics) {
+        self.iterations.observe(diagnostics.iters as f64);
+        self.arena_peak_bytes
+            .fetch_max(diagnostics.memory.temporary_peak_bytes, Relaxed);
+    }
+
+    /// Everything, in the Prometheus text format
+    pub fn render(&self) -> String {
+        let mut out = String::new();
+        let head = |out: &mut String, name: &str, kind: &str, help: &str| {
+            let _ = writeln!(out, "# HELP {} {}\n# TYPE {} {}", name, help, name, kind);
+        };
+
+        head(
+            &mut out,
+            "slvsx_requests_total",
+            "counter",
+            "Requests, by command",
+        );
+        for (label, n) in COMMANDS.iter().zip(&self.requests) {
+            let _ = writeln!(
+                out,
+                "slvsx_requests_total{{command=\"{}\"}} {}",
+                label,
+                n.load(Relaxed)
+            );
+        }
+
+        let name = "slvsx_request_duration_seconds";
+        let help = "Time from a request being queued to its response being ready";
+        head(&mut out, name, "histogram", help);
+        self.latency.render(&mut out, name, "");
+
+        let name = "slvsx_phase_duration_seconds";
+        head(
+            &mut out,
+            name,
+            "histogram",
+            "Time in each phase of answering a request",
+        );
+        for (label, h) in PHASES.iter().zip(&self.phases) {
+            h.render(&mut out, name, &format!("phase=\"{}\"", label));
+        }
+
+        head(
+            &mut out,
+            "slvsx_outcomes_total",
+            "counter",
+            "Responses, by outcome",
+        );
+        for (label, n) in OUTCOMES.iter().zip(&self.outcomes) {
+            let _ = writeln!(
+                out,
+                "slvsx_outcomes_total{{status=\"{}\"}} {}",
+                label,
+                n.load(Relaxed)
+            );
+        }
+
+        head(
+            &mut out,
+            "slvsx_queue_depth",
+            "gauge",
+            "Requests waiting for a worker",
+        );
+        let _ = writeln!(
+            out,
+            "slvsx_queue_depth {}",
+            self.queue_depth.load(Relaxed).max(0)
+        );
+
+        let name = "slvsx_cache_lookups_total";
+        head(
+            &mut out,
+            name,
+            "counter",
+            "Cache lookups, by cache and whether they hit",
+        );
+        for (cache, lookups) in CACHES.iter().zip(&self.cache_lookups) {
+            for (result, n) in ["hit", "miss"].iter().zip(lookups) {
+                let _ = writeln!(
+                    out,
+                    "{}{{cache=\"{}\",result=\"{}\"}} {}",
+                    name,
+                    cache,
+                    result,
+                    n.load(Relaxed)
+                );
+            }
+        }
+
+        let name = "slvsx_admissions_total";
+        head(
+            &mut out,
+            name,
+            "counter",
+            "Requests, by where their estimated cost sent them",
+        );
+        for (label, n) in LANES.iter().zip(&self.admissions) {
+            let _ = writeln!(out, "{}{{lane=\"{}\"}} {}", name, label, n.load(Relaxed));
+        }
+
+        let name = "slvsx_coalesced_total";
+        head(
+            &mut out,
+            name,
+            "counter",
+            "Requests answered by a solve already in flight",
+        );
+        let _ = writeln!(out, "{} {}", name, self.coalesced.load(Relaxed));
+
+        let name = "slvsx_arena_peak_bytes";
+        head(
+            &mut out,
+            name,
+            "gauge",
+            "The most one solve held in the solver's temporary arenas",
+        );
+        let _ = writeln!(out, "{} {}", name, self.arena_peak_bytes.load(Relaxed));
+
+        if let Some(bytes) = resident_peak_bytes() {
+            let name = "slvsx_resident_peak_bytes";
+            head(&mut out, name, "gauge", "The process's peak resident set");
+            let _ = writeln!(out, "{} {}", name, bytes);
+        }
+
+        let name = "slvsx_newton_iterations";
+        head(&mut out, name, "histogram", "Newton iterations per solve");
+        self.iterations.render(&mut out, name, "");
+        out
+    }
+}
+
+/// The process's peak resident set, from /proc on Linux
+fn resident_peak_bytes() -> Option<u64> {
+    let status = std::fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|l| l.starts_with("VmHWM:"))?;
+    let kb: u64 = line.split_whitespace().nth(1)?.parse().ok()?;
+    Some(kb * 1024)
+}
+
+/// Answer one HTTP request on a connection: the metrics for `GET /metrics`,
+/// and 404 for anything else
+fn answer<S: Read + Write>(stream: &mut S, metrics: &Metrics) -> std::io::Result<()> {
+    // The request line is all that's looked at; read up to the end of the
+    // headers, or as much as fits, whichever comes first
+    let mut request = Vec::new();
+    let mut buf = [0; 1024];
+    while request.len() < 8192 && !request.windows(4).any(|w| w == b"\r\n\r\n") {
+        let n = stream.read(&mut buf)?;
+        if n == 0 {
+            break;
+        }
+        request.extend_from_slice(&buf[..n]);
+    }
+    let line = request.split(|&b| b == b'\n').next().unwrap_or_default();
+    let mut words = line.split(|&b| b == b' ');
+    let (method, path) = (
+        words.next().unwrap_or_default(),
+        words.next().unwrap_or_default(),
+    );
+    let scrape = path == b"/metrics" || path.starts_with(b"/metrics?");
+    let (status, kind, body) = if method == b"GET" && scrape {
+        ("200 OK", "text/plain; version=0.0.4", metrics.render())
+    } else {
+        (
+            "404 Not Found",
+            "text/plain",
+            "Not found; try /metrics\n".to_string(),
+        )
+    };
+    write!(
+        stream,
+        "HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+        status,
+        kind,
+        body.len(),
+        body
+    )?;
+    stream.flush()
+}
+
+/// Listen on addr, and answer scrapes on a thread of their own for as long
+/// as the process runs
+pub fn serve_metrics(addr: &str, metrics: Arc<Metrics>) -> Result<()> {
+    let listener =
+        TcpListener::bind(addr).map_err(|e| anyhow!("Failed to listen on {}: {}", addr, e))?;
+    thread::spawn(move || {
+        for stream in listener.incoming() {
+            let mut stream = match stream {
+                Ok(s) => s,
+                Err(e) => {
+                    tracing::warn!("Failed to accept a scrape: {}", e);
+                    continue;
+                }
+            };
+            let _ = stream.set_read_timeout(Some(Duration::from_secs(5)));
+            if let Err(e) = answer(&mut stream, &metrics) {
+                tracing::warn!("Failed to answer a scrape: {}", e);
+            }
+        }
+    });
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_histogram_buckets_are_cumulative() {
+        let h = Histogram::new(&[1.0, 2.0]);
+        for v in [0.5, 1.0, 1.5, 3.0] {
+            h.observe(v);
+        }
+        let mut out = String::new();
+        h.render(&mut out, "x", "");
+        assert!(out.contains("x_bucket{le=\"1\"} 2\n"));
+        assert!(out.contains("x_bucket{le=\"2\"} 3\n"));
+        assert!(out.contains("x_bucket{le=\"+Inf\"} 4\n"));
+        assert!(out.contains("x_sum 6\n"));
+        assert!(out.contains("x_count 4\n"));
+    }
+
+    #[test]
+    fn test_render() {
+        let m = Metrics::new();
+        m.request(CommandLabel::Solve);
+        m.outcome(0);
+        m.outcome(4);
+        m.outcome(42);
+        m.queued();
+        m.cache_lookup(CacheLabel::Results, false);
+        m.cache_lookup(CacheLabel::Systems, true);
+        m.admitted(Lane::Heavy);
+        m.phase(Phase::Validate, Duration::from_micros(300));
+        let out = m.render();
+        assert!(out.contains("slvsx_requests_total{command=\"solve\"} 1\n"));
+        assert!(out.contains("slvsx_outcomes_total{status=\"ok\"} 1\n"));
+        assert!(out.contains("slvsx_outcomes_total{status=\"overconstrained\"} 1\n"));
+        assert!(out.contains("slvsx_outcomes_total{status=\"error\"} 1\n"));
+        assert!(out.contains("slvsx_queue_depth 1\n"));
+        assert!(out.contains("slvsx_cache_lookups_total{cache=\"results\",result=\"miss\"} 1\n"));
+        assert!(out.contains("slvsx_cache_lookups_total{cache=\"systems\",result=\"hit\"} 1\n"));
+        assert!(out.contains("slvsx_admissions_total{lane=\"heavy\"} 1\n"));
+        assert!(out
+            .contains("slvsx_phase_duration_seconds_bucket{phase=\"validate\",le=\"0.0005\"} 1\n"));
+        assert!(out.contains("slvsx_phase_duration_seconds_count{phase=\"parse\"} 0\n"));
+    }
+
+    #[test]
+    fn test_endpoint() {
+        let metrics = Arc::new(Metrics::new());
+        metrics.request(CommandLabel::Validate);
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap().to_string();
+        drop(listener);
+        serve_metrics(&addr, Arc::clone(&metrics)).unwrap();
+
+        let get = |path: &str| {
+            let mut stream = std::net::TcpStream::connect(&addr).unwrap();
+            write!(stream, "GET {} HTTP/1.1\r\nHost: x\r\n\r\n", path).unwrap();
+            let mut response = String::new();
+            stream.read_to_string(&mut response).unwrap();
+            response
+        };
+        let response = get("/metrics");
+        assert!(response.starts_with("HTTP/1.1 200 OK\r\n"));
+        assert!(response.contains("slvsx_requests_total{command=\"validate\"} 1\n"));
+        assert!(get("/other").starts_with("HTTP/1.1 404"));
+    }
+}
@@ -0,0 +1,165 @@
+//! `slvsx optimize`: move some of a document's parameters, within bounds,
+//! to minimize or maximize a distance over its solved points, and write
+//! where they ended up and the solve there.
+
+use crate::io::{InputReader, OutputWriter};
+use crate::json_error::parse_json_bytes_with_context;
+use anyhow::{anyhow, Result};
+use slvsx_core::{
+    optimize::{Bound, Goal, Objective, OptimizeOptions},
+    solver::{Solver, SolverConfig},
+    validator::Validator,
+    InputDocument,
+};
+
+/// Parse `name=min:max`
+pub fn parse_bound(spec: &str) -> Result<Bound> {
+    let (name, range) = spec
+        .split_once('=')
+        .ok_or_else(|| anyhow!("Expected name=min:max in '{}'", spec))?;
+    let (min, max) = range
+        .split_once(':')
+        .ok_or_else(|| anyhow!("Expected min:max in '{}'", spec))?;
+    let number = |s: &str| -> Result<f64> {
+        s.trim()
+            .parse()
+            .map_err(|_| anyhow!("'{}' isn't a number, in '{}'", s.trim(), spec))
+    };
+    let (min, max) = (number(min)?, number(max)?);
+    if min > max {
+        return Err(anyhow!("The range in '{}' is empty", spec));
+    }
+    Ok(Bound {
+        name: name.trim().to_string(),
+        min,
+        max,
+    })
+}
+
+/// Parse `a,b`, two point ids
+pub fn parse_pair(spec: &str) -> Result<[String; 2]> {
+    match spec
+        .split(',')
+        .map(str::trim)
+        .collect::<Vec<_>>()
+        .as_slice()
+    {
+        [a, b] if !a.is_empty() && !b.is_empty() => Ok([a.to_string(), b.to_string()]),
+        _ => Err(anyhow!("Expected two point ids, a,b, in '{}'", spec)),
+    }
+}
+
+/// Optimize command handler: minimize the distance between each pair in
+/// `minimize` (the longest of them, given several), or maximize the
+/// shortest of those in `maximize`
+#[allow(clippy::too_many_arguments)]
+pub fn handle_optimize<R: InputReader + ?Sized, W: OutputWriter + ?Sized>(
+    reader: &mut R,
+    writer: &mut W,
+    filename: &str,
+    minimize: &[String],
+    maximize: &[String],
+    params: &[String],
+    max_iterations: usize,
+) -> Result<()> {
+    let (goal, pairs) = match (minimize.is_empty(), maximize.is_empty()) {
+        (false, true) => (Goal::Minimize, minimize),
+        (true, false) => (Goal::Maximize, maximize),
+        _ => return Err(anyhow!("Give --minimize or --maximize, not both")),
+    };
+    let objective = Objective {
+        goal,
+        pairs: pairs.iter().map(|p| parse_pair(p)).collect::<Result<_>>()?,
+    };
+    let bounds = params
+        .iter()
+        .map(|p| parse_bound(p))
+        .collect::<Result<Vec<_>>>()?;
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
+    Validator::new().validate(&doc)?;
+
+    let options = OptimizeOptions {
+        max_iterations,
+        ..OptimizeOptions::default()
+    };
+    let report =
+        Solver::new(SolverConfig::default()).optimize(&doc, &objective, &bounds, options)?;
+    writer.write_str(&serde_json::to_string_pretty(&report)?)?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::io::tests::{MemoryReader, MemoryWriter};
+
+    #[test]
+    fn test_parse_bound_and_pair() {
+        let b = parse_bound("r = 1.5:20").unwrap();
+        assert_eq!((b.name.as_str(), b.min, b.max), ("r", 1.5, 20.0));
+        assert!(parse_bound("r").is_err());
+        assert!(parse_bound("r=1").is_err());
+        assert!(parse_bound("r=5:1").is_err());
+        assert!(parse_bound("r=a:1").is_err());
+
+        assert_eq!(
+            parse_pair("p1, p3").unwrap(),
+            ["p1".to_string(), "p3".to_string()]
+        );
+        assert!(parse_pair("p1").is_err());
+        assert!(parse_pair("p1,p2,p3").is_err());
+        assert!(parse_pair("p1,").is_err());
+    }
+
+    #[test]
+    fn test_handle_optimize() {
+        // p2 sits $r from the fixed p1, square to the fixed line to p3
+        let doc = r#"{
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [0, 10, 0]},
+                {"type": "point", "id": "p3", "at": [30, 0, 0]},
+                {"type": "line", "id": "l1", "p1": "p1", "p2": "p3"},
+                {"type": "line", "id": "l2", "p1": "p1", "p2": "p2"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "fixed", "entity": "p3"},
+                {"type": "perpendicular", "a": "l1", "b": "l2"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        }"#;
+        let mut reader = MemoryReader::new(doc.to_string());
+        let mut writer = MemoryWriter::new();
+        let params = vec!["r=5:40".to_string()];
+        handle_optimize(
+            &mut reader,
+            &mut writer,
+            "doc.json",
+            &[],
+            &["p2,p3".to_string()],
+            &params,
+            50,
+        )
+        .unwrap();
+        let report: serde_json::Value = serde_json::from_str(&writer.as_string()).unwrap();
+        assert_eq!(report["parameters"]["r"], 40.0);
+        assert!((report["objective"].as_f64().unwrap() - 50.0).abs() < 1e-6);
+        assert!(report["result"]["entities"]["p2"].is_object());
+
+        let mut reader = MemoryReader::new(doc.to_string());
+        let both = vec!["p2,p3".to_string()];
+        assert!(handle_optimize(
+            &mut reader,
+            &mut writer,
+            "doc.json",
+            &both,
+            &both,
+            &params,
+            50
+        )
+        .is_err());
+    }
+}
@@ -0,0 +1,206 @@
+//! `slvsx regen`: load native `.slvs` files, regenerate every group without
+//! a GUI, and save them again or export their mesh.
+//!
+//! The solver library doesn't know about the groups, shells and meshes of a
+//! `.slvs` file, so this runs SolveSpace's own headless `solvespace-cli
+//! regenerate --timing`, built from `libslvs-static` with the GUI off, and
+//! reports what each group cost: its solve, its own shell, the Boolean with
+//! the groups before it, and its triangulation.
+
+use crate::io::OutputWriter;
+use anyhow::{anyhow, Result};
+use serde::{Deserialize, Serialize};
+use std::process::{Command, Stdio};
+
+/// Groups listed as the slowest, across every file
+const SLOWEST: usize = 10;
+
+pub struct RegenOptions {
+    /// The `solvespace-cli` to run
+    pub program: String,
+    /// Where to write each file, `%` standing for its name without the
+    /// extension; a pattern not ending in `.slvs` exports the mesh. The
+    /// files are saved over if there's none.
+    pub output: Option<String>,
+    /// Chord tolerance, in mm
+    pub chord_tol: Option<f64>,
+}
+
+/// What one group cost, in milliseconds
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct GroupTiming {
+    pub name: String,
+    pub solved: bool,
+    pub dof: i64,
+    pub solve_ms: f64,
+    pub shell_ms: f64,
+    pub boolean_ms: f64,
+    pub mesh_ms: f64,
+    #[serde(default)]
+    pub total_ms: f64,
+}
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct FileTiming {
+    pub file: String,
+    pub groups: Vec<GroupTiming>,
+    #[serde(default)]
+    pub total_ms: f64,
+}
+
+#[derive(Debug, Serialize)]
+pub struct Slowest {
+    pub file: String,
+    pub group: String,
+    pub total_ms: f64,
+}
+
+#[derive(Debug, Serialize)]
+pub struct RegenReport {
+    pub files: Vec<FileTiming>,
+    pub slowest: Vec<Slowest>,
+}
+
+fn arguments(files: &[String], options: &RegenOptions) -> Vec<String> {
+    let mut args = vec!["regenerate".to_string(), "--timing".to_string()];
+    if let Some(output) = &options.output {
+        args.extend(["--output".to_string(), output.clone()]);
+    }
+    if let Some(chord_tol) = options.chord_tol {
+        args.extend(["--chord-tol".to_string(), chord_tol.to_string()]);
+    }
+    args.extend(files.iter().cloned());
+    args
+}
+
+/// The lines of JSON `regenerate --timing` wrote, one to a file, with
+/// their totals added up
+fn parse_timings(stdout: &str) -> Result<Vec<FileTiming>> {
+    let mut files = Vec::new();
+    for line in stdout.lines().filter(|line| !line.trim().is_empty()) {
+        let mut file: FileTiming = serde_json::from_str(line)
+            .map_err(|e| anyhow!("Unexpected timing report from solvespace-cli: {}", e))?;
+        for group in &mut file.groups {
+            group.total_ms = group.solve_ms + group.shell_ms + group.boolean_ms + group.mesh_ms;
+        }
+        file.total_ms = file.groups.iter().map(|g| g.total_ms).sum();
+        files.push(file);
+    }
+    Ok(files)
+}
+
+fn report(files: Vec<FileTiming>) -> RegenReport {
+    let mut slowest: Vec<Slowest> = files
+        .iter()
+        .flat_map(|file| {
+            file.groups.iter().map(move |group| Slowest {
+                file: file.file.clone(),
+                group: group.name.clone(),
+                total_ms: group.total_ms,
+            })
+        })
+        .collect();
+    slowest.sort_by(|a, b| b.total_ms.total_cmp(&a.total_ms));
+    slowest.truncate(SLOWEST);
+    RegenReport { files, slowest }
+}
+
+/// Regenerate `files` and write how long each of their groups took. Fails
+/// if `solvespace-cli` can't be run, or once the report of the files it did
+/// regenerate is written, if it failed on one.
+pub fn handle_regen<W: OutputWriter + ?Sized>(
+    files: &[String],
+    options: &RegenOptions,
+    writer: &mut W,
+) -> Result<()> {
+    if files.is_empty() {
+        return Err(anyhow!("No .slvs files to regenerate"));
+    }
+    let output = Command::new(&options.program)
+        .args(arguments(files, options))
+        .stdin(Stdio::null())
+        .stderr(Stdio::inherit())
+        .output()
+        .map_err(|e| {
+            anyhow!(
+                "Failed to run {}: {} (point --solvespace-cli or SLVSX_SOLVESPACE_CLI at it)",
+                options.program,
+                e
+            )
+        })?;
+    let files = parse_timings(&String::from_utf8_lossy(&output.stdout))?;
+    writer.write_str(&serde_json::to_string_pretty(&report(files))?)?;
+    if output.status.success() {
+        Ok(())
+    } else {
+        Err(anyhow!("{} failed: {}", options.program, output.status))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const REPORT: &str = concat!(
+        r#"{"file":"a.slvs","groups":[{"name":"#,
+        r#""sketch-in-plane","solved":true,"dof":0,"solve_ms":1.5,"shell_ms":0.0,"#,
+        r#""boolean_ms":0.0,"mesh_ms":0.0},{"name":"extrude","solved":true,"dof":0,"#,
+        r#""solve_ms":0.5,"shell_ms":4.0,"boolean_ms":20.0,"mesh_ms":3.0}]}"#,
+        "\n\n",
+        r#"{"file":"b.slvs","groups":[]}"#,
+        "\n",
+    );
+
+    #[test]
+    fn test_arguments_ask_for_timing() {
+        let options = RegenOptions {
+            program: "solvespace-cli".to_string(),
+            output: Some("%-out.stl".to_string()),
+            chord_tol: Some(0.5),
+        };
+        let args = arguments(&["a.slvs".to_string()], &options);
+        assert_eq!(
+            args,
+            [
+                "regenerate",
+                "--timing",
+                "--output",
+                "%-out.stl",
+                "--chord-tol",
+                "0.5",
+                "a.slvs"
+            ]
+        );
+    }
+
+    #[test]
+    fn test_timings_are_totalled_and_ranked() {
+        let files = parse_timings(REPORT).unwrap();
+        assert_eq!(files.len(), 2);
+        assert_eq!(files[0].groups[1].total_ms, 27.5);
+        assert_eq!(files[0].total_ms, 29.0);
+        assert!(files[1].groups.is_empty());
+
+        let report = report(files);
+        assert_eq!(report.slowest.len(), 2);
+        assert_eq!(report.slowest[0].group, "extrude");
+        assert_eq!(report.slowest[0].file, "a.slvs");
+    }
+
+    #[test]
+    fn test_bad_timing_line_fails() {
+        assert!(parse_timings("Written 'a.slvs'.\n").is_err());
+    }
+
+    #[test]
+    fn test_missing_program_fails() {
+        let options = RegenOptions {
+            program: "/nonexistent/solvespace-cli".to_string(),
+            output: None,
+            chord_tol: None,
+        };
+        let mut writer = crate::io::tests::MemoryWriter::new();
+        let err = handle_regen(&["a.slvs".to_string()], &options, &mut writer).unwrap_err();
+        assert!(err.to_string().contains("SLVSX_SOLVESPACE_CLI"), "{}", err);
+    }
+}
@@ -0,0 +1,380 @@
+//! `slvsx scaling`: search generated documents of the shapes that are valid
+//! but slow (long coincidence chains, nearly singular Jacobians, large
+//! redundant sets, deeply nested expressions) for solves whose time or
+//! memory grows faster than the document.
+//!
+//! Each round draws a shape and a seed, and solves the document at two
+//! sizes, one twice the other. The growth exponent of a measure is the log2
+//! of how much it grew between them: 1 for linear, 2 for quadratic. A round
+//! fails if the time or the bytes taken from the temporary arena grow with
+//! an exponent over the limit, once they're big enough not to be noise. A
+//! failing document is then halved for as long as it still fails, and the
+//! smallest one kept, as a document for `slvsx bench` to run from then on.
+
+use crate::io::OutputWriter;
+use anyhow::{anyhow, Result};
+use serde::Serialize;
+use serde_json::{json, Value};
+use slvsx_core::{
+    solver::{Solver, SolverConfig},
+    InputDocument,
+};
+use std::path::Path;
+use std::time::Instant;
+
+/// Below these, a measure is too small for its growth to mean anything
+const MIN_MS: f64 = 2.0;
+const MIN_BYTES: f64 = 64.0 * 1024.0;
+
+/// The smallest size that a failing document is halved to
+const MIN_SIZE: usize = 4;
+
+/// The shapes of document that are generated
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize)]
+#[serde(rename_all = "snake_case")]
+pub enum Shape {
+    /// Points each coincident with the next
+    CoincidentChain,
+    /// A chain of rods pulled almost straight between fixed ends
+    NearSingular,
+    /// A chain of rods with every length given several times, some of the
+    /// copies conflicting, for the solver to find which to drop
+    Redundant,
+    /// Lengths from expressions nested as deep as the size
+    NestedExpressions,
+}
+
+const SHAPES: [Shape; 4] = [
+    Shape::CoincidentChain,
+    Shape::NearSingular,
+    Shape::Redundant,
+    Shape::NestedExpressions,
+];
+
+impl Shape {
+    fn name(self) -> &'static str {
+        match self {
+            Shape::CoincidentChain => "coincident_chain",
+            Shape::NearSingular => "near_singular",
+            Shape::Redundant => "redundant",
+            Shape::NestedExpressions => "nested_expressions",
+        }
+    }
+}
+
+/// SplitMix64, so that a seed gives the same documents everywhere
+struct Rng(u64);
+
+impl Rng {
+    fn next(&mut self) -> u64 {
+        self.0 = self.0.wrapping_add(0x9e37_79b9_7f4a_7c15);
+        let mut z = self.0;
+        z = (z ^ (z >> 30)).wrapping_mul(0xbf58_476d_1ce4_e5b9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94d0_49bb_1331_11eb);
+        z ^ (z >> 31)
+    }
+
+    /// Uniform in [0, 1)
+    fn unit(&mut self) -> f64 {
+        (self.next() >> 11) as f64 / (1u64 << 53) as f64
+    }
+
+    fn below(&mut self, n: u64) -> u64 {
+        self.next() % n
+    }
+}
+
+fn point(id: String, x: f64, y: f64) -> Value {
+    json!({"type": "point", "id": id, "at": [x, y, 0.0]})
+}
+
+fn distance(a: String, b: String, value: Value) -> Value {
+    json!({"type": "distance", "between": [a, b], "value": value})
+}
+
+/// The document of a shape at a size, the same for the same seed
+pub fn document(shape: Shape, size: usize, seed: u64) -> Result<InputDocument> {
+    let mut rng = Rng(seed);
+    let mut entities = Vec::with_capacity(size + 1);
+    let mut constraints = vec![json!({"type": "fixed", "entity": "p0"})];
+    let mut parameters = serde_json::Map::new();
+    let id = |i: usize| format!("p{}", i);
+    // Up to a tenth of a unit off
+    let jitter = |rng: &mut Rng| 0.1 * (rng.unit() - 0.5);
+
+    match shape {
+        Shape::CoincidentChain => {
+            for i in 0..size {
+                entities.push(point(id(i), i as f64 + jitter(&mut rng), jitter(&mut rng)));
+            }
+            for i in 1..size {
+                constraints.push(json!({"type": "coincident", "entities": [id(i - 1), id(i)]}));
+            }
+        }
+        Shape::NearSingular => {
+            // The ends are this much short of the rods' length apart
+            let slack = 10f64.powi(-(3 + rng.below(6) as i32));
+            for i in 0..=size {
+                let x = i as f64 * (10.0 - slack / size as f64);
+                entities.push(point(id(i), x, slack * jitter(&mut rng)));
+            }
+            constraints.push(json!({"type": "fixed", "entity": id(size)}));
+            for i in 1..=size {
+                constraints.push(distance(id(i - 1), id(i), json!(10.0)));
+            }
+        }
+        Shape::Redundant => {
+            let copies = 2 + rng.below(3);
+            for i in 0..=size {
+                entities.push(point(
+                    id(i),
+                    10.0 * i as f64 + jitter(&mut rng),
+                    jitter(&mut rng),
+                ));
+            }
+            for i in 1..=size {
+                constraints.push(distance(id(i - 1), id(i), json!(10.0)));
+                for _ in 1..copies {
+                    // One copy in eight conflicts
+                    let off = if rng.below(8) == 0 { 1.0 } else { 0.0 };
+                    constraints.push(distance(id(i - 1), id(i), json!(10.0 + off)));
+                }
+            }
+        }
+        Shape::NestedExpressions => {
+            parameters.insert("a".to_string(), json!(1.0 + rng.unit()));
+            // Each level adds a and takes it away again
+            let mut value = "$a".to_string();
+            for _ in 0..size {
+                value = format!("(({}) + $a - $a)", value);
+            }
+            let rods = 4 + rng.below(5) as usize;
+            for i in 0..=rods {
+                entities.push(point(
+                    id(i),
+                    2.0 * i as f64 + jitter(&mut rng),
+                    jitter(&mut rng),
+                ));
+            }
+            for i in 1..=rods {
+                constraints.push(distance(id(i - 1), id(i), json!(value)));
+            }
+        }
+    }
+
+    let doc = json!({
+        "schema": "slvs-json/1",
+        "units": "mm",
+        "parameters": parameters,
+        "entities": entities,
+        "constraints": constraints,
+    });
+    Ok(serde_json::from_value(doc)?)
+}
+
+/// The least time a document took to solve over some runs, and the bytes
+/// its solve took from the temporary arena, if it got as far as reporting
+/// them
+#[derive(Debug, Clone, Copy, PartialEq, Serialize)]
+pub struct Measure {
+    pub ms: f64,
+    pub bytes: Option<f64>,
+}
+
+fn measure(solver: &Solver, doc: &InputDocument, runs: usize) -> Measure {
+    let mut ms = f64::INFINITY;
+    let mut bytes = None;
+    for _ in 0..runs.max(1) {
+        let start = Instant::now();
+        let solved = solver.solve(doc);
+        ms = ms.min(start.elapsed().as_secs_f64() * 1000.0);
+        // A solve that fails has its time, but not its memory
+        if let Ok(d) = solved.as_ref().map(|r| r.diagnostics.as_ref()) {
+            bytes = d.map(|d| d.memory.temporary_bytes as f64);
+        }
+    }
+    Measure { ms, bytes }
+}
+
+/// How a measure grew from one size to twice that: its log2, or None if the
+/// larger is too small to tell
+fn exponent(small: f64, large: f64, floor: f64) -> Option<f64> {
+    (large >= floor && small > 0.0).then(|| (large / small).log2())
+}
+
+/// A document that grew faster than the limit
+#[derive(Debug, Clone, Serialize)]
+pub struct Finding {
+    pub shape: Shape,
+    pub seed: String,
+    /// The larger of the two sizes it was measured at
+    pub size: usize,
+    pub time_exponent: Option<f64>,
+    pub bytes_exponent: Option<f64>,
+    /// Where the document at that size was kept, if anywhere
+    pub file: Option<String>,
+}
+
+#[derive(Debug, Serialize)]
+pub struct ScalingReport {
+    pub rounds: usize,
+    pub max_exponent: f64,
+    pub findings: Vec<Finding>,
+}
+
+/// The exponents of a shape from `size` to twice that, if either is over
+/// `max_exponent`
+fn grows_too_fast(
+    solver: &Solver,
+    shape: Shape,
+    size: usize,
+    seed: u64,
+    runs: usize,
+    max_exponent: f64,
+) -> Result<Option<(Option<f64>, Option<f64>)>> {
+    let small = measure(solver, &document(shape, size, seed)?, runs);
+    let large = measure(solver, &document(shape, 2 * size, seed)?, runs);
+    let time = exponent(small.ms, large.ms, MIN_MS);
+    let bytes = match (small.bytes, large.bytes) {
+        (Some(s), Some(l)) => exponent(s, l, MIN_BYTES),
+        _ => None,
+    };
+    let over = |e: Option<f64>| e.is_some_and(|e| e > max_exponent);
+    Ok((over(time) || over(bytes)).then_some((time, bytes)))
+}
+
+/// Scaling command handler: run `rounds` rounds from `seed`, keep what's
+/// found in `keep`, if given, and fail if anything was
+pub fn handle_scaling<W: OutputWriter + ?Sized>(
+    rounds: usize,
+    seed: u64,
+    max_size: usize,
+    max_exponent: f64,
+    runs: usize,
+    keep: Option<&str>,
+    writer: &mut W,
+) -> Result<()> {
+    if max_size < 2 * MIN_SIZE {
+        return Err(anyhow!("--max-size must be at least {}", 2 * MIN_SIZE));
+    }
+    let solver = Solver::new(SolverConfig::default());
+    let mut rng = Rng(seed);
+    let mut findings = Vec::new();
+
+    for _ in 0..rounds {
+        let shape = SHAPES[rng.below(SHAPES.len() as u64) as usize];
+        let doc_seed = rng.next();
+        let half = max_size / 2;
+        let mut size = MIN_SIZE + rng.below((half - MIN_SIZE + 1) as u64) as usize;
+        let Some(mut growth) = grows_too_fast(&solver, shape, size, doc_seed, runs, max_exponent)?
+        else {
+            continue;
+        };
+        // The smallest size that still fails
+        while size / 2 >= MIN_SIZE {
+            match grows_too_fast(&solver, shape, size / 2, doc_seed, runs, max_exponent)? {
+                Some(g) => {
+                    growth = g;
+                    size /= 2;
+                }
+                None => break,
+            }
+        }
+
+        let seed = format!("{:016x}", doc_seed);
+        let file = match keep {
+            Some(dir) => {
+                let dir = Path::new(dir);
+                std::fs::create_dir_all(dir)
+                    .map_err(|e| anyhow!("Failed to create {}: {}", dir.display(), e))?;
+                let path = dir.join(format!("{}-{}-n{}.json", shape.name(), seed, 2 * size));
+                let doc = document(shape, 2 * size, doc_seed)?;
+                std::fs::write(&path, serde_json::to_string_pretty(&doc)?)
+                    .map_err(|e| anyhow!("Failed to write {}: {}", path.display(), e))?;
+                Some(path.display().to_string())
+            }
+            None => None,
+        };
+        findings.push(Finding {
+            shape,
+            seed,
+            size: 2 * size,
+            time_exponent: growth.0,
+            bytes_exponent: growth.1,
+            file,
+        });
+    }
+
+    let found = findings.len();
+    let report = ScalingReport {
+        rounds,
+        max_exponent,
+        findings,
+    };
+    writer.write_str(&serde_json::to_string_pretty(&report)?)?;
+    if found > 0 {
+        return Err(anyhow!(
+            "{} documents grew faster than size^{}",
+            found,
+            max_exponent
+        ));
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::io::tests::MemoryWriter;
+
+    #[test]
+    fn test_documents_are_the_same_for_a_seed() {
+        for shape in SHAPES {
+            let a = serde_json::to_string(&document(shape, 8, 42).unwrap()).unwrap();
+            let b = serde_json::to_string(&document(shape, 8, 42).unwrap()).unwrap();
+            let c = serde_json::to_string(&document(shape, 8, 43).unwrap()).unwrap();
+            assert_eq!(a, b, "{:?}", shape);
+            assert_ne!(a, c, "{:?}", shape);
+        }
+    }
+
+    #[test]
+    fn test_documents_grow_with_their_size() {
+        let chain = document(Shape::CoincidentChain, 16, 1).unwrap();
+        assert_eq!(chain.entities.len(), 16);
+        assert_eq!(chain.constraints.len(), 16);
+        let rods = document(Shape::NearSingular, 16, 1).unwrap();
+        assert_eq!(rods.entities.len(), 17);
+        let nested = document(Shape::NestedExpressions, 16, 1).unwrap();
+        let deep = document(Shape::NestedExpressions, 32, 1).unwrap();
+        assert!(
+            serde_json::to_string(&deep).unwrap().len()
+                > serde_json::to_string(&nested).unwrap().len()
+        );
+    }
+
+    #[test]
+    fn test_generated_documents_solve() {
+        let solver = Solver::new(SolverConfig::default());
+        for shape in [Shape::CoincidentChain, Shape::NestedExpressions] {
+            let doc = document(shape, 8, 7).unwrap();
+            assert!(solver.solve(&doc).is_ok(), "{:?}", shape);
+        }
+    }
+
+    #[test]
+    fn test_exponent_ignores_small_measures() {
+        assert_eq!(exponent(1.0, 4.0, 2.0), Some(2.0));
+        assert_eq!(exponent(0.5, 1.0, 2.0), None);
+    }
+
+    #[test]
+    fn test_handle_scaling_writes_a_report() {
+        let mut writer = MemoryWriter::new();
+        // Small documents are too quick to fail
+        handle_scaling(2, 9, 8, 1.5, 1, None, &mut writer).unwrap();
+        let report: Value = serde_json::from_str(&writer.as_string()).unwrap();
+        assert_eq!(report["rounds"], 2);
+        assert!(report["findings"].as_array().unwrap().is_empty());
+    }
+}
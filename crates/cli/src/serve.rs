@@ -0,0 +1,1605 @@
+//! `slvsx serve`: a long-lived solver that answers newline-delimited JSON
+//! requests on stdin or a Unix socket, so that a caller pays for starting
+//! the process and setting up the validator once, not on every solve.
+//!
+//! Each request is one line:
+//!
+//! ```json
+//! {"id": 1, "command": "solve", "document": { ... }}
+//! ```
+//!
+//! where `command` is `"solve"` (the default) or `"validate"`, and `id` is
+//! any JSON value, echoed back. A solve request may also give `"select"`, a
+//! list of entity ids or globs such as `"arm_*"`, and `"changed_only": true`,
+//! to have only those entities, or only those the solve moved, read back
+//! and reported; results cut down that way aren't cached. It may give
+//! `"initial"`, the result of an earlier solve, to start the document's
+//! points and circles from where that has them, matched by id; a small edit
+//! to the document it was solved from then starts next to its answer. Each
+//! response is one line, either
+//! `{"id": 1, "ok": true, "result": { ... }}` or
+//! `{"id": 1, "ok": false, "error": {"code": 4, "message": "..."}}`, with the
+//! same codes that `slvsx solve` exits with. Requests are solved concurrently,
+//! so responses come back in the order they finish, which needn't be the
+//! order they were asked in; match them up by `id`.
+//!
+//! Solve results are cached by the document's structural hash, which stays
+//! the same when its entities and constraints are reordered or renamed, so
+//! a document that's been solved before is answered without validating or
+//! solving it again. Compiled systems are cached by the document's topology
+//! too, so a document that differs from one solved before only in its
+//! values is solved without being validated or built; see
+//! `slvsx_core::cache`. A document asked for while one with its structural
+//! hash is being solved waits for that solve rather than solving it again;
+//! see `crate::flight`.
+//!
+//! A client editing one document a little at a time can open a session on
+//! it instead, with `{"command": "open", "session": "s1", "document": ...}`,
+//! then send `{"command": "patch", "session": "s1", "patch": [ ... ]}`, a
+//! JSON Patch of the document, for each edit, and `"close"` when it's done.
+//! Each patch is answered with the entities that moved, and the session's
+//! `version`; see `crate::session`. `--sessions` is how many can be open.
+//! An open or a patch may give `"progress": true` to be told how its solve
+//! is getting on: a message `{"id": 1, "progress": {"iterations": 2,
+//! "residual": 0.003, "equations": 12, "unknowns": 12}}` for each Newton
+//! step, all of them before the response, for a client to show while it
+//! waits on a large document.
+//!
+//! With `--format msgpack`, requests and responses are the same objects in
+//! MessagePack instead (see `slvsx_core::wire`), each framed by its length
+//! in bytes as a four byte big-endian integer rather than by a newline.
+//! A solve request may give `"positions": true` to have its result's
+//! entities replaced by `positions`, four floats for each entity of the
+//! document in order: `[x, y, z, 0]` for a point, `[cx, cy, cz, radius]`
+//! for a circle, NaNs for the rest. In MessagePack that's one bin of
+//! little-endian float 64s, which a client reads as an array of floats in
+//! one go rather than parsing a map of numbers; in JSON it's an array.
+//!
+//! With `--cache-dir DIR`, the documents that compiled systems are cached
+//! for are saved there every so often and as the server stops, and
+//! compiled again when it next starts, so that a restart doesn't empty
+//! the cache; see `crate::store`.
+//!
+//! With `--metrics ADDR`, what the server is doing is counted, and served
+//! over HTTP at `/metrics` on that address; see `crate::metrics`.
+//!
+//! Each document's cost can be estimated as it's parsed, from its structure
+//! (see `slvsx_core::cost`), so that one costing more than `--max-cost` is
+//! refused with the error for too many unknowns, and one costing more than
+//! `--heavy-cost` is handed to a pool of its own, of `--heavy-workers`
+//! threads. That pool's queue holds `--heavy-queue` requests, and one that
+//! finds it full is refused as overloaded, so however many heavy requests
+//! arrive, the pool for the rest keeps answering small ones promptly.
+//! What got past the estimate can still be held to `--memory-mb` per solve:
+//! one that needs more fails with code 10, as out of memory, rather than
+//! growing until the whole server is killed.
+
+use crate::flight::{Boarding, Flights, Leading, Waiter};
+use crate::metrics::{CacheLabel, CommandLabel, Lane, Metrics, Phase};
+use crate::session::Sessions;
+use crate::store::SystemStore;
+use anyhow::{anyhow, Result};
+use serde::{Deserialize, Serialize};
+use slvsx_core::{
+    cache::{structural_key, topology_key, SolveCache, StructuralKey, SystemCache, TopologyKey},
+    compiled::{CompiledSystem, Progress, ProgressFn},
+    cost,
+    ir::ResolvedEntity,
+    patch::Operation,
+    select::Selection,
+    solver::{Solver, SolverConfig},
+    validator::Validator,
+    wire::{self, WireFormat},
+    InputDocument, SolveResult,
+};
+use std::io::{BufRead, Read, Write};
+use std::path::Path;
+use std::sync::mpsc::{channel, sync_channel, Receiver, Sender, SyncSender, TrySendError};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+#[derive(Debug, Default, Deserialize, PartialEq)]
+#[serde(rename_all = "lowercase")]
+pub(crate) enum Command {
+    #[default]
+    Solve,
+    Validate,
+    /// Open a session on the document, and solve it
+    Open,
+    /// Edit a session's document, and solve it again
+    Patch,
+    Close,
+}
+
+#[derive(Debug, Default, Deserialize)]
+pub(crate) struct Request {
+    #[serde(default)]
+    pub id: serde_json::Value,
+    #[serde(default)]
+    pub command: Command,
+    /// Every command but `patch` and `close` needs one
+    #[serde(default)]
+    pub document: Option<InputDocument>,
+    /// The document as sent, to open a session on
+    #[serde(skip)]
+    pub source: Option<serde_json::Value>,
+    #[serde(default)]
+    pub session: Option<String>,
+    #[serde(default)]
+    pub patch: Vec<Operation>,
+    /// The session's version that a patch is for
+    #[serde(default)]
+    pub version: Option<u64>,
+    /// Entity ids or globs to report, or none for all of them
+    #[serde(default)]
+    pub select: Vec<String>,
+    /// Report only the entities the solve moved
+    #[serde(default)]
+    pub changed_only: bool,
+    /// An earlier result to start the document's points and circles from
+    #[serde(default)]
+    pub initial: Option<SolveResult>,
+    /// Report where the points and circles went as one packed block of
+    /// floats, rather than entity by entity
+    #[serde(default)]
+    pub positions: bool,
+    /// Send a message for each Newton step of a session's solve, before
+    /// its response
+    #[serde(default)]
+    pub progress: bool,
+}
+
+#[derive(Debug, Clone, Serialize)]
+struct ErrorBody {
+    code: i32,
+    message: String,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    pointer: Option<String>,
+}
+
+/// A step of a request's solve, sent ahead of its response
+#[derive(Serialize)]
+struct ProgressMessage<'a> {
+    id: &'a serde_json::Value,
+    progress: Progress,
+}
+
+#[derive(Debug, Serialize)]
+pub(crate) struct Response {
+    id: serde_json::Value,
+    pub ok: bool,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    result: Option<SolveResult>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    error: Option<ErrorBody>,
+    /// A session's version, after a patch
+    #[serde(skip_serializing_if = "Option::is_none")]
+    version: Option<u64>,
+    /// The result's entities, packed, in place of them; see `finish`
+    #[serde(skip)]
+    positions: Option<Vec<f64>>,
+}
+
+impl Response {
+    fn ok(id: serde_json::Value, result: Option<SolveResult>) -> Self {
+        Self {
+            id,
+            ok: true,
+            result,
+            error: None,
+            version: None,
+            positions: None,
+        }
+    }
+
+    fn of(id: serde_json::Value, result: slvsx_core::Result<Option<SolveResult>>) -> Self {
+        match result {
+            Ok(result) => Self::ok(id, result),
+            Err(e) => Self::error(id, &e),
+        }
+    }
+
+    pub(crate) fn error(id: serde_json::Value, e: &slvsx_core::Error) -> Self {
+        let pointer = match e {
+            slvsx_core::Error::InvalidInput { pointer, .. } => pointer.clone(),
+            _ => None,
+        };
+        Self {
+            id,
+            ok: false,
+            result: None,
+            error: Some(ErrorBody {
+                code: e.exit_code(),
+                message: e.to_string(),
+                pointer,
+            }),
+            version: None,
+            positions: None,
+        }
+    }
+
+    /// The response with its result's entities packed, four floats each in
+    /// the order of ids: `[x, y, z, 0]` for a point, `[cx, cy, cz, radius]`
+    /// for a circle, and NaNs for anything else
+    fn packed(mut self, ids: &[String]) -> Self {
+        let Some(entities) = self.result.as_mut().and_then(|r| r.entities.take()) else {
+            return self;
+        };
+        let mut positions = Vec::with_capacity(ids.len() * 4);
+        // A 2D point's z is 0
+        let slot = |at: &[f64], w: f64| {
+            let mut slot = [0.0, 0.0, 0.0, w];
+            let n = at.len().min(3);
+            slot[..n].copy_from_slice(&at[..n]);
+            slot
+        };
+        for id in ids {
+            positions.extend_from_slice(&match entities.get(id) {
+                Some(ResolvedEntity::Point { at }) => slot(at, 0.0),
+                Some(ResolvedEntity::Circle {
+                    center, diameter, ..
+                }) => slot(center, diameter / 2.0),
+                _ => [f64::NAN; 4],
+            });
+        }
+        self.positions = Some(positions);
+        self
+    }
+}
+
+/// The caches a pool's workers share, and the sessions open on it
+#[derive(Clone, Default)]
+pub struct Caches {
+    /// Solve results, by structural hash
+    pub results: Option<Arc<SolveCache>>,
+    /// Compiled systems, by topology hash
+    pub systems: Option<Arc<SystemCache>>,
+    pub sessions: Option<Arc<Sessions>>,
+    /// Solves in flight, for the same document asked again meanwhile to
+    /// wait for
+    pub flights: Option<Arc<Flights>>,
+}
+
+/// Which requests are taken on, by their estimated cost, the pool that
+/// the heavy ones run on, and the memory each solve may hold
+#[derive(Debug, Clone, Copy, Default)]
+pub struct Admission {
+    /// Refuse requests estimated to cost more than this
+    pub max_cost: Option<f64>,
+    /// Run requests estimated to cost more than this on the heavy pool
+    pub heavy_cost: Option<f64>,
+    /// The heavy pool's threads, and the most requests it queues
+    pub heavy_workers: usize,
+    pub heavy_queue: usize,
+    /// The most megabytes a solve may hold before it fails as out of
+    /// memory, rather than growing until the process is killed
+    pub memory_mb: Option<u64>,
+}
+
+impl Admission {
+    /// A solver that holds each solve to the memory budget, if any
+    fn solver(&self) -> Solver {
+        let memory_budget = self.memory_mb.map(|mb| mb.saturating_mul(1 << 20));
+        Solver::new(SolverConfig {
+            memory_budget,
+            ..SolverConfig::default()
+        })
+    }
+}
+
+/// A request for the heavy pool, parsed already, where its response goes,
+/// and when it was first queued
+type HeavyJob = (Request, Sender<Vec<u8>>, Instant);
+
+/// Where a request's response goes, when it was queued, and its format
+type Reply<'a> = (&'a Sender<Vec<u8>>, Instant, WireFormat);
+
+/// What each thread of the pool keeps between requests
+pub(crate) struct Worker {
+    validator: Validator,
+    solver: Solver,
+    caches: Caches,
+    metrics: Option<Arc<Metrics>>,
+    admission: Admission,
+    /// Where requests over the heavy cost go, if anywhere
+    heavy: Option<SyncSender<HeavyJob>>,
+}
+
+impl Worker {
+    pub(crate) fn new() -> Self {
+        Self::with_caches(Caches::default())
+    }
+
+    pub(crate) fn with_caches(caches: Caches) -> Self {
+        Self {
+            validator: Validator::new(),
+            solver: Solver::new(SolverConfig::default()),
+            caches,
+            metrics: None,
+            admission: Admission::default(),
+            heavy: None,
+        }
+    }
+
+    /// Run f, and count the time it took as phase, if metrics are kept
+    fn timed<T>(&self, phase: Phase, f: impl FnOnce() -> T) -> T {
+        let Some(metrics) = &self.metrics else {
+            return f();
+        };
+        let start = Instant::now();
+        let out = f();
+        metrics.phase(phase, start.elapsed());
+        out
+    }
+
+    /// Answer one request here, heavy or not
+    #[cfg(test)]
+    fn handle(&self, request: &[u8], format: WireFormat) -> Vec<u8> {
+        self.respond(request, format, None).unwrap_or_default()
+    }
+
+    /// Answer one request with one response in the same format (a JSON
+    /// response without its newline, a MessagePack one without its length),
+    /// or, if it's for the heavy pool, hand it over with reply and answer
+    /// nothing here
+    fn respond(
+        &self,
+        request: &[u8],
+        format: WireFormat,
+        reply: Option<(&Sender<Vec<u8>>, Instant)>,
+    ) -> Option<Vec<u8>> {
+        let invalid = |e: serde_json::Error| slvsx_core::Error::InvalidInput {
+            message: e.to_string(),
+            pointer: None,
+        };
+        // Or the id, if there is one, and why not
+        let parsed = self.timed(Phase::Parse, || {
+            let value: slvsx_core::Result<serde_json::Value> = match format {
+                WireFormat::Json => serde_json::from_slice(request).map_err(invalid),
+                WireFormat::Msgpack => wire::from_msgpack(request),
+            };
+            match value {
+                Err(e) => Err((serde_json::Value::Null, e)),
+                Ok(value) => {
+                    let id = value.get("id").cloned().unwrap_or_default();
+                    let source = match value.get("command").and_then(|c| c.as_str()) {
+                        Some("open") => value.get("document").cloned(),
+                        _ => None,
+                    };
+                    serde_json::from_value::<Request>(value)
+                        .map(|request| Request { source, ..request })
+                        .map_err(|e| (id, invalid(e)))
+                }
+            }
+        });
+        if let Some(metrics) = &self.metrics {
+            metrics.request(match &parsed {
+                Ok(request) if request.command == Command::Validate => CommandLabel::Validate,
+                Ok(_) => CommandLabel::Solve,
+                Err(_) => CommandLabel::Unknown,
+            });
+        }
+        let response = match parsed {
+            Err((id, e)) => Response::error(id, &e),
+            Ok(request) => match self.admit(request, reply) {
+                Ok(Some(request)) => self.run_with(
+                    request,
+                    reply.map(|(reply, queued)| (reply, queued, format)),
+                )?,
+                Ok(None) => return None,
+                Err(refused) => refused,
+            },
+        };
+        Some(self.finish(&response, format))
+    }
+
+    /// A response counted, and encoded
+    fn finish(&self, response: &Response, format: WireFormat) -> Vec<u8> {
+        if let Some(metrics) = &self.metrics {
+            metrics.outcome(response.error.as_ref().map_or(0, |e| e.code));
+        }
+        self.timed(Phase::Serialize, || {
+            let encoded = match &response.positions {
+                Some(positions) => format.encode_with_f64s(response, "positions", positions),
+                None => format.encode(response),
+            };
+            encoded.unwrap_or_else(|e| {
+                format
+                    .encode(&Response::error(serde_json::Value::Null, &e))
+                    .unwrap_or_default()
+            })
+        })
+    }
+
+    /// Check a request's estimated cost against the limits: refuse it, hand
+    /// it to the heavy pool (None), or give it back to run here. With no
+    /// heavy pool, or no reply to hand over, a heavy request runs here.
+    fn admit(
+        &self,
+        request: Request,
+        reply: Option<(&Sender<Vec<u8>>, Instant)>,
+    ) -> std::result::Result<Option<Request>, Response> {
+        let Admission {
+            max_cost,
+            heavy_cost,
+            ..
+        } = self.admission;
+        if max_cost.is_none() && heavy_cost.is_none() {
+            return Ok(Some(request));
+        }
+        // A patch is as heavy as its session; it's taken as light
+        let Some(doc) = &request.document else {
+            return Ok(Some(request));
+        };
+        let cost = cost::estimate(doc).units;
+        let lane = |lane: Lane| {
+            if let Some(metrics) = &self.metrics {
+                metrics.admitted(lane);
+            }
+        };
+        if max_cost.is_some_and(|max| cost > max) {
+            lane(Lane::Refused);
+            return Err(Response::error(
+                request.id,
+                &slvsx_core::Error::TooManyUnknowns,
+            ));
+        }
+        if let (Some(true), Some(heavy), Some((reply, queued))) =
+            (heavy_cost.map(|h| cost > h), &self.heavy, reply)
+        {
+            return match heavy.try_send((request, reply.clone(), queued)) {
+                Ok(()) => {
+                    lane(Lane::Heavy);
+                    Ok(None)
+                }
+                Err(TrySendError::Full((request, ..))) => {
+                    lane(Lane::Refused);
+                    Err(Response::error(request.id, &slvsx_core::Error::Overloaded))
+                }
+                Err(TrySendError::Disconnected((request, ..))) => Ok(Some(request)),
+            };
+        }
+        lane(Lane::Light);
+        Ok(Some(request))
+    }
+
+    pub(crate) fn run(&self, request: Request) -> Response {
+        self.run_with(request, None)
+            .unwrap_or_else(|| unreachable!("there's no reply to wait on"))
+    }
+
+    /// Run a request, or, if a solve of the same document is in flight,
+    /// hand reply to it and answer nothing here
+    fn run_with(&self, request: Request, reply: Option<Reply>) -> Option<Response> {
+        if matches!(
+            request.command,
+            Command::Open | Command::Patch | Command::Close
+        ) {
+            return Some(self.session(request, reply));
+        }
+        let packing = match (&request.document, request.positions) {
+            (Some(doc), true) if request.command == Command::Solve => Some(
+                doc.entities
+                    .iter()
+                    .map(|e| e.id().to_string())
+                    .collect::<Vec<_>>(),
+            ),
+            _ => None,
+        };
+        let response = self.run_document(request, reply)?;
+        Some(match packing {
+            Some(ids) => response.packed(&ids),
+            None => response,
+        })
+    }
+
+    /// Validate or solve a request's document, from the cache if it can be
+    fn run_document(&self, mut request: Request, reply: Option<Reply>) -> Option<Response> {
+        let Some(doc) = &mut request.document else {
+            return Some(Response::error(request.id, &missing("document")));
+        };
+        if let Some(prior) = &request.initial {
+            slvsx_core::warm::seed(doc, prior);
+        }
+        let doc = &*doc;
+        let solving = request.command == Command::Solve;
+        let mut select = Selection::only(&request.select);
+        select.changed_only = request.changed_only;
+        let key = match (&self.caches.results, &self.caches.flights) {
+            (Some(cache), _) if solving && select.is_all() => cache.key(doc),
+            (None, Some(_)) if solving && select.is_all() => {
+                structural_key(doc, self.solver.config().tolerance)
+            }
+            _ => None,
+        };
+        if let (Some(cache), Some(key)) = (&self.caches.results, &key) {
+            let hit = cache.get(key);
+            self.count_lookup(CacheLabel::Results, hit.is_some());
+            if let Some(result) = hit {
+                return Some(Response::ok(request.id, Some(result)));
+            }
+        }
+
+        let flight = match (&self.caches.flights, &key) {
+            (Some(flights), Some(key)) => {
+                // A waiter is answered with entities, not packed positions
+                let waiter = || {
+                    reply
+                        .filter(|_| !request.positions)
+                        .map(|(reply, queued, format)| Waiter {
+                            id: request.id.clone(),
+                            key: key.clone(),
+                            format,
+                            reply: reply.clone(),
+                            queued,
+                        })
+                };
+                match flights.board(key, waiter) {
+                    Boarding::Joined => {
+                        if let Some(metrics) = &self.metrics {
+                            metrics.coalesced();
+                        }
+                        return None;
+                    }
+                    Boarding::Leads(leading) => Some(leading),
+                    Boarding::Alone => None,
+                }
+            }
+            _ => None,
+        };
+        let response = Response::of(request.id, self.check_and_solve(doc, solving, select, &key));
+        if let Some(leading) = flight {
+            self.land(leading, &response);
+        }
+        Some(response)
+    }
+
+    /// Validate a document and, for a solve, solve it, caching the result
+    /// under key if there's a cache
+    fn check_and_solve(
+        &self,
+        doc: &InputDocument,
+        solving: bool,
+        select: Selection,
+        key: &Option<StructuralKey>,
+    ) -> slvsx_core::Result<Option<SolveResult>> {
+        // A document with the topology of one solved before has the same
+        // ids, references and types, which is all the validator checks.
+        let topology = match &self.caches.systems {
+            Some(_) if solving => topology_key(doc),
+            _ => None,
+        };
+        let system = match (&self.caches.systems, &topology) {
+            (Some(systems), Some(topology)) => {
+                let system = systems.take(topology);
+                self.count_lookup(CacheLabel::Systems, system.is_some());
+                system
+            }
+            _ => None,
+        };
+        if system.is_none() {
+            self.timed(Phase::Validate, || self.validator.validate(doc))?;
+        }
+        if !solving {
+            return Ok(None);
+        }
+
+        let solved = match (&self.caches.systems, &topology) {
+            (Some(systems), Some(topology)) => {
+                self.solve_compiled(systems, topology, system, doc, select)
+            }
+            _ if select.is_all() => self.solve(&self.solver, doc),
+            _ => {
+                let config = SolverConfig {
+                    select,
+                    ..self.solver.config().clone()
+                };
+                self.solve(&Solver::new(config), doc)
+            }
+        };
+        if let (
+            Some(metrics),
+            Ok(SolveResult {
+                diagnostics: Some(diagnostics),
+                ..
+            }),
+        ) = (&self.metrics, &solved)
+        {
+            metrics.solved(diagnostics);
+        }
+        let result = solved?;
+        if let (Some(cache), Some(key)) = (&self.caches.results, key) {
+            cache.insert(key, &result);
+        }
+        Ok(Some(result))
+    }
+
+    /// Answer everyone waiting for a flight with its leader's response,
+    /// under their own ids
+    fn land(&self, leading: Leading, response: &Response) {
+        let key = leading.key();
+        let waiters = leading.land();
+        if waiters.is_empty() {
+            return;
+        }
+        let canonical = response.result.as_ref().map(|result| key.canonical(result));
+        for waiter in waiters {
+            let theirs = Response {
+                id: waiter.id,
+                ok: response.ok,
+                result: canonical.as_ref().map(|result| waiter.key.restore(result)),
+                error: response.error.clone(),
+                version: None,
+                positions: None,
+            };
+            let theirs = self.finish(&theirs, waiter.format);
+            if let Some(metrics) = &self.metrics {
+                metrics.answered(waiter.queued.elapsed());
+            }
+            let _ = waiter.reply.send(theirs);
+        }
+    }
+
+    /// Solve a document with the system compiled for its topology, or with
+    /// a new one, and keep the system for the next document with it
+    fn solve_compiled(
+        &self,
+        systems: &SystemCache,
+        topology: &TopologyKey,
+        system: Option<CompiledSystem>,
+        doc: &InputDocument,
+        select: Selection,
+    ) -> slvsx_core::Result<SolveResult> {
+        let mut system = self.timed(Phase::Build, || match system {
+            Some(mut system) => system.load(doc).map(|_| system),
+            None => self.solver.compile(doc),
+        })?;
+        system.select(select);
+        let solved = self.timed(Phase::Solve, || system.resolve());
+        systems.put(topology, system);
+        solved
+    }
+
+    /// Solve a document from scratch; its build and solve are counted from
+    /// what the solve reports of its layers
+    fn solve(&self, solver: &Solver, doc: &InputDocument) -> slvsx_core::Result<SolveResult> {
+        let Some(metrics) = &self.metrics else {
+            return solver.solve(doc);
+        };
+        let start = Instant::now();
+        let solved = solver.solve(doc);
+        match &solved {
+            Ok(SolveResult {
+                diagnostics: Some(d),
+                ..
+            }) => {
+                metrics.phase(
+                    Phase::Build,
+                    Duration::from_secs_f64(d.layers.build_ms / 1000.0),
+                );
+                let solve_ms = d.layers.native_ms + d.layers.read_back_ms;
+                metrics.phase(Phase::Solve, Duration::from_secs_f64(solve_ms / 1000.0));
+            }
+            _ => metrics.phase(Phase::Solve, start.elapsed()),
+        }
+        solved
+    }
+
+    /// Open, patch or close a session, sending its solve's steps ahead of
+    /// the response if the request asks for them and there's a reply
+    fn session(&self, request: Request, reply: Option<Reply>) -> Response {
+        let Some(sessions) = &self.caches.sessions else {
+            let e = slvsx_core::Error::InvalidInput {
+                message: "This server keeps no sessions".to_string(),
+                pointer: Some("/command".to_string()),
+            };
+            return Response::error(request.id, &e);
+        };
+        let Some(name) = &request.session else {
+            return Response::error(request.id, &missing("session"));
+        };
+        let select = Selection::only(&request.select);
+        let selected = |mut result: SolveResult| {
+            if let (false, Some(entities)) = (select.is_all(), &mut result.entities) {
+                entities.retain(|id, _| select.matches(id));
+            }
+            Some(result)
+        };
+        let progress = reply
+            .filter(|_| request.progress)
+            .map(|(reply, _, format)| {
+                let (reply, id) = (reply.clone(), request.id.clone());
+                Box::new(move |progress: Progress| {
+                    if let Ok(message) = format.encode(&ProgressMessage { id: &id, progress }) {
+                        let _ = reply.send(message);
+                    }
+                }) as ProgressFn
+            });
+        match request.command {
+            Command::Open => {
+                let (Some(doc), Some(source)) = (&request.document, request.source) else {
+                    return Response::error(request.id, &missing("document"));
+                };
+                let opened = self.timed(Phase::Solve, || {
+                    sessions.open(name, source, doc, &self.solver, &self.validator, progress)
+                });
+                Response::of(request.id, opened.map(selected))
+            }
+            Command::Patch => {
+                let (patch, tolerance) = (&request.patch, self.solver.config().tolerance);
+                let (patched, version) = self.timed(Phase::Solve, || {
+                    let validator = &self.validator;
+                    sessions.patch(name, patch, request.version, validator, tolerance, progress)
+                });
+                Response {
+                    version,
+                    ..Response::of(request.id, patched.map(selected))
+                }
+            }
+            _ => Response::of(request.id, sessions.close(name).map(|_| None)),
+        }
+    }
+
+    fn count_lookup(&self, cache: CacheLabel, hit: bool) {
+        if let Some(metrics) = &self.metrics {
+            metrics.cache_lookup(cache, hit);
+        }
+    }
+}
+
+fn missing(field: &str) -> slvsx_core::Error {
+    slvsx_core::Error::InvalidInput {
+        message: format!("The request has no {}", field),
+        pointer: Some(format!("/{}", field)),
+    }
+}
+
+/// A request, where its response goes, and when it was queued
+type Job = (Vec<u8>, Sender<Vec<u8>>, Instant);
+
+/// Where requests are queued for a pool, counted if metrics are kept
+#[derive(Clone)]
+struct Jobs {
+    sender: Sender<Job>,
+    metrics: Option<Arc<Metrics>>,
+}
+
+impl Jobs {
+    fn send(&self, request: Vec<u8>, reply: Sender<Vec<u8>>) -> Result<()> {
+        if let Some(metrics) = &self.metrics {
+            metrics.queued();
+        }
+        self.sender
+            .send((request, reply, Instant::now()))
+            .map_err(|_| anyhow!("The solver pool has stopped"))
+    }
+}
+
+/// Threads that take requests off a shared queue; they finish once every
+/// sender has been dropped and the queue is empty. Heavy requests go on to
+/// threads of their own, if admission asks for them.
+struct Pool {
+    jobs: Jobs,
+    threads: Vec<thread::JoinHandle<()>>,
+    heavy: Option<(SyncSender<HeavyJob>, Vec<thread::JoinHandle<()>>)>,
+}
+
+impl Pool {
+    fn new(
+        workers: usize,
+        caches: Caches,
+        metrics: Option<Arc<Metrics>>,
+        admission: Admission,
+        format: WireFormat,
+    ) -> Self {
+        let heavy = admission.heavy_cost.map(|_| {
+            let (sender, queue) = sync_channel::<HeavyJob>(admission.heavy_queue);
+            let queue = Arc::new(Mutex::new(queue));
+            let threads = (0..admission.heavy_workers.max(1))
+                .map(|_| {
+                    let queue = Arc::clone(&queue);
+                    let mut worker = Worker::with_caches(caches.clone());
+                    worker.solver = admission.solver();
+                    worker.metrics = metrics.clone();
+                    thread::spawn(move || loop {
+                        let job = queue.lock().map(|q| q.recv());
+                        let Ok(Ok((request, reply, queued))) = job else {
+                            break;
+                        };
+                        let reply_to = Some((&reply, queued, format));
+                        let Some(response) = worker.run_with(request, reply_to) else {
+                            continue;
+                        };
+                        let response = worker.finish(&response, format);
+                        if let Some(metrics) = &worker.metrics {
+                            metrics.answered(queued.elapsed());
+                        }
+                        let _ = reply.send(response);
+                    })
+                })
+                .collect::<Vec<_>>();
+            (sender, threads)
+        });
+
+        let (sender, queue) = channel::<Job>();
+        let queue = Arc::new(Mutex::new(queue));
+        let threads = (0..workers.max(1))
+            .map(|_| {
+                let queue = Arc::clone(&queue);
+                let mut worker = Worker::with_caches(caches.clone());
+                worker.solver = admission.solver();
+                worker.metrics = metrics.clone();
+                worker.admission = admission;
+                worker.heavy = heavy.as_ref().map(|(sender, _)| sender.clone());
+                thread::spawn(move || loop {
+                    let job = queue.lock().map(|q| q.recv());
+                    let Ok(Ok((request, reply, queued))) = job else {
+                        break;
+                    };
+                    if let Some(metrics) = &worker.metrics {
+                        metrics.dequeued();
+                    }
+                    let Some(response) = worker.respond(&request, format, Some((&reply, queued)))
+                    else {
+                        continue;
+                    };
+                    if let Some(metrics) = &worker.metrics {
+                        metrics.answered(queued.elapsed());
+                    }
+                    // The caller may have gone; there's no one to tell.
+                    let _ = reply.send(response);
+                })
+            })
+            .collect();
+        Self {
+            jobs: Jobs { sender, metrics },
+            threads,
+            heavy,
+        }
+    }
+
+    fn join(self) {
+        drop(self.jobs);
+        for t in self.threads {
+            let _ = t.join();
+        }
+        // The light workers' senders are gone with them
+        if let Some((sender, threads)) = self.heavy {
+            drop(sender);
+            for t in threads {
+                let _ = t.join();
+            }
+        }
+    }
+}
+
+/// How often compiled systems are saved, with `--cache-dir`
+const SAVE_EVERY: Duration = Duration::from_secs(30);
+
+/// How many workers to start when none are asked for: one per core
+pub fn default_workers() -> usize {
+    thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1)
+}
+
+/// Read one length-prefixed frame, or None if input ends before it starts
+fn read_frame<R: BufRead>(input: &mut R) -> std::io::Result<Option<Vec<u8>>> {
+    if input.fill_buf()?.is_empty() {
+        return Ok(None);
+    }
+    let mut len = [0; 4];
+    input.read_exact(&mut len)?;
+    let len = u32::from_be_bytes(len) as u64;
+    // Read what arrives rather than trusting the length to allocate
+    let mut frame = Vec::new();
+    if input.take(len).read_to_end(&mut frame)? as u64 != len {
+        return Err(std::io::ErrorKind::UnexpectedEof.into());
+    }
+    Ok(Some(frame))
+}
+
+/// Read requests from input until it ends, queueing each one on the pool,
+/// and write the responses to output as they come back. Returns once every
+/// response has been written.
+fn serve_stream<R, W>(mut input: R, mut output: W, jobs: &Jobs, format: WireFormat) -> Result<()>
+where
+    R: BufRead,
+    W: Write + Send + 'static,
+{
+    let (reply, replies): (Sender<Vec<u8>>, Receiver<Vec<u8>>) = channel();
+    let writer = thread::spawn(move || -> std::io::Result<()> {
+        for response in replies {
+            match format {
+                WireFormat::Json => {
+                    output.write_all(&response)?;
+                    output.write_all(b"\n")?;
+                }
+                WireFormat::Msgpack => {
+                    output.write_all(&(response.len() as u32).to_be_bytes())?;
+                    output.write_all(&response)?;
+                }
+            }
+            output.flush()?;
+        }
+        Ok(())
+    });
+
+    let send = |request: Vec<u8>| jobs.send(request, reply.clone());
+    match format {
+        WireFormat::Json => {
+            for line in input.lines() {
+                let line = line?;
+                if line.trim().is_empty() {
+                    continue;
+                }
+                send(line.into_bytes())?;
+            }
+        }
+        WireFormat::Msgpack => {
+            while let Some(frame) = read_frame(&mut input)? {
+                send(frame)?;
+            }
+        }
+    }
+    // The writer finishes when the last pending job drops its sender.
+    drop(reply);
+    writer
+        .join()
+        .map_err(|_| anyhow!("The response writer panicked"))??;
+    Ok(())
+}
+
+/// Serve requests from one input until it ends
+pub fn serve_lines<R, W>(
+    input: R,
+    output: W,
+    workers: usize,
+    caches: Caches,
+    metrics: Option<Arc<Metrics>>,
+    admission: Admission,
+    format: WireFormat,
+) -> Result<()>
+where
+    R: BufRead,
+    W: Write + Send + 'static,
+{
+    let pool = Pool::new(workers, caches, metrics, admission, format);
+    let result = serve_stream(input, output, &pool.jobs, format);
+    pool.join();
+    result
+}
+
+/// Serve every connection to a Unix socket at path, until the process is
+/// stopped; connections share one pool.
+#[cfg(unix)]
+pub fn serve_socket(
+    path: &str,
+    workers: usize,
+    caches: Caches,
+    metrics: Option<Arc<Metrics>>,
+    admission: Admission,
+    format: WireFormat,
+) -> Result<()> {
+    use std::os::unix::fs::FileTypeExt;
+    use std::os::unix::net::UnixListener;
+
+    // A socket left behind by an earlier server would stop us binding.
+    if let Ok(meta) = std::fs::symlink_metadata(path) {
+        if meta.file_type().is_socket() {
+            std::fs::remove_file(path)?;
+        }
+    }
+    let listener =
+        UnixListener::bind(path).map_err(|e| anyhow!("Failed to listen on {}: {}", path, e))?;
+    let pool = Pool::new(workers, caches, metrics, admission, format);
+    for stream in listener.incoming() {
+        let stream = match stream {
+            Ok(s) => s,
+            Err(e) => {
+                tracing::warn!("Failed to accept a connection: {}", e);
+                continue;
+            }
+        };
+        let jobs = pool.jobs.clone();
+        thread::spawn(move || {
+            let output = match stream.try_clone() {
+                Ok(s) => s,
+                Err(e) => {
+                    tracing::warn!("Failed to set up a connection: {}", e);
+                    return;
+                }
+            };
+            if let Err(e) = serve_stream(std::io::BufReader::new(stream), output, &jobs, format) {
+                tracing::warn!("Connection ended with an error: {}", e);
+            }
+        });
+    }
+    pool.join();
+    Ok(())
+}
+
+#[cfg(not(unix))]
+pub fn serve_socket(
+    _path: &str,
+    _workers: usize,
+    _caches: Caches,
+    _metrics: Option<Arc<Metrics>>,
+    _admission: Admission,
+    _format: WireFormat,
+) -> Result<()> {
+    Err(anyhow!(
+        "Unix sockets aren't available on this platform; serve on stdin instead"
+    ))
+}
+
+/// Serve command handler; a cache of no entries isn't kept at all, nor
+/// are sessions if none can be open, and metrics are only kept when
+/// there's an address to serve them on
+#[allow(clippy::too_many_arguments)]
+pub fn handle_serve(
+    socket: Option<&str>,
+    workers: usize,
+    cache_entries: usize,
+    cache_mb: usize,
+    cache_systems: usize,
+    sessions: usize,
+    metrics_addr: Option<&str>,
+    admission: Admission,
+    format: WireFormat,
+    cache_dir: Option<&str>,
+) -> Result<()> {
+    let workers = if workers == 0 {
+        default_workers()
+    } else {
+        workers
+    };
+    let caches = Caches {
+        results: (cache_entries > 0).then(|| {
+            let tolerance = SolverConfig::default().tolerance;
+            Arc::new(SolveCache::new(cache_entries, cache_mb << 20, tolerance))
+        }),
+        systems: (cache_systems > 0).then(|| Arc::new(SystemCache::new(cache_systems))),
+        sessions: (sessions > 0).then(|| Arc::new(Sessions::new(sessions))),
+        flights: Some(Arc::new(Flights::new())),
+    };
+    let metrics = match metrics_addr {
+        Some(addr) => {
+            let metrics = Arc::new(Metrics::new());
+            crate::metrics::serve_metrics(addr, Arc::clone(&metrics))?;
+            Some(metrics)
+        }
+        None => None,
+    };
+    let store = match (cache_dir, &caches.systems) {
+        (Some(dir), Some(systems)) => {
+            let store = Arc::new(SystemStore::open(Path::new(dir), Arc::clone(systems))?);
+            let solver = Solver::new(SolverConfig::default());
+            Arc::clone(&store).start(solver, SAVE_EVERY);
+            Some(store)
+        }
+        _ => None,
+    };
+    let served = match socket {
+        Some(path) => serve_socket(path, workers, caches, metrics, admission, format),
+        None => {
+            let (input, output) = (std::io::stdin().lock(), std::io::stdout());
+            serve_lines(input, output, workers, caches, metrics, admission, format)
+        }
+    };
+    if let Some(store) = store {
+        store.save()?;
+    }
+    served
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::{json, Value};
+
+    fn point_document() -> Value {
+        json!({
+            "schema": "slvs-json/1",
+            "entities": [{"type": "point", "id": "p1", "at": [1, 2, 3]}],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        })
+    }
+
+    fn handle(request: Value) -> Value {
+        let response = Worker::new().handle(request.to_string().as_bytes(), WireFormat::Json);
+        serde_json::from_slice(&response).unwrap()
+    }
+
+    #[test]
+    fn test_solve_request() {
+        let response = handle(json!({"id": 7, "document": point_document()}));
+        assert_eq!(response["id"], 7);
+        assert_eq!(response["ok"], true);
+        assert_eq!(response["result"]["status"], "ok");
+        assert!(response["result"]["entities"]["p1"].is_object());
+    }
+
+    #[test]
+    fn test_validate_request() {
+        let response =
+            handle(json!({"id": "v", "command": "validate", "document": point_document()}));
+        assert_eq!(response["id"], "v");
+        assert_eq!(response["ok"], true);
+        assert!(response.get("result").is_none());
+    }
+
+    #[test]
+    fn test_bad_request_keeps_id() {
+        let response = handle(json!({"id": 3, "command": "solve"}));
+        assert_eq!(response["id"], 3);
+        assert_eq!(response["ok"], false);
+        assert_eq!(response["error"]["code"], 2);
+    }
+
+    #[test]
+    fn test_select_request() {
+        let mut document = point_document();
+        document["entities"]
+            .as_array_mut()
+            .unwrap()
+            .push(json!({"type": "point", "id": "q1", "at": [4, 5, 6]}));
+        let response = handle(json!({"id": 1, "document": document, "select": ["q*"]}));
+        assert_eq!(response["ok"], true);
+        let entities = response["result"]["entities"].as_object().unwrap();
+        assert_eq!(entities.keys().collect::<Vec<_>>(), ["q1"]);
+
+        let response = handle(json!({"id": 2, "document": document, "changed_only": true}));
+        assert!(response["result"]["entities"]
+            .as_object()
+            .unwrap()
+            .is_empty());
+    }
+
+    #[test]
+    fn test_initial_request() {
+        let mut document = point_document();
+        document["entities"]
+            .as_array_mut()
+            .unwrap()
+            .push(json!({"type": "point", "id": "q1", "at": [4, 5, 6]}));
+        let initial = json!({"status": "ok", "entities": {"q1": {"at": [7, 8, 9]}}});
+        let response = handle(json!({"id": 1, "document": document, "initial": initial}));
+        assert_eq!(response["ok"], true);
+        // Nothing holds q1, so it stays where it starts
+        assert_eq!(
+            response["result"]["entities"]["q1"]["at"],
+            json!([7.0, 8.0, 9.0])
+        );
+        assert_eq!(
+            response["result"]["entities"]["p1"]["at"],
+            json!([1.0, 2.0, 3.0])
+        );
+    }
+
+    #[test]
+    fn test_malformed_line() {
+        let response = Worker::new().handle(b"{ nope", WireFormat::Json);
+        let response: Value = serde_json::from_slice(&response).unwrap();
+        assert_eq!(response["id"], Value::Null);
+        assert_eq!(response["ok"], false);
+        assert_eq!(response["error"]["code"], 2);
+    }
+
+    /// A writer that the test can read back once the server is done with it
+    #[derive(Clone, Default)]
+    struct SharedBuffer(Arc<Mutex<Vec<u8>>>);
+
+    impl Write for SharedBuffer {
+        fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+            self.0.lock().unwrap().write(buf)
+        }
+        fn flush(&mut self) -> std::io::Result<()> {
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn test_serve_lines_answers_every_request() {
+        let mut input = String::new();
+        for id in 0..20 {
+            input.push_str(&json!({"id": id, "document": point_document()}).to_string());
+            input.push_str("\n\n");
+        }
+        let output = SharedBuffer::default();
+        let input = std::io::Cursor::new(input);
+        // The same document each time, so most wait for another's solve
+        let caches = Caches {
+            flights: Some(Arc::new(Flights::new())),
+            ..Caches::default()
+        };
+        let admission = Admission::default();
+        serve_lines(
+            input,
+            output.clone(),
+            4,
+            caches,
+            None,
+            admission,
+            WireFormat::Json,
+        )
+        .unwrap();
+
+        let text = String::from_utf8(output.0.lock().unwrap().clone()).unwrap();
+        let mut ids: Vec<i64> = text
+            .lines()
+            .map(|l| {
+                let response: Value = serde_json::from_str(l).unwrap();
+                assert_eq!(response["ok"], true);
+                response["id"].as_i64().unwrap()
+            })
+            .collect();
+        ids.sort();
+        assert_eq!(ids, (0..20).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_serve_msgpack_frames() {
+        let mut input = Vec::new();
+        for id in 0..5 {
+            let request = json!({"id": id, "document": point_document()});
+            let request = wire::to_msgpack(&request).unwrap();
+            input.extend_from_slice(&(request.len() as u32).to_be_bytes());
+            input.extend_from_slice(&request);
+        }
+        let output = SharedBuffer::default();
+        let input = std::io::Cursor::new(input);
+        let (admission, format) = (Admission::default(), WireFormat::Msgpack);
+        serve_lines(
+            input,
+            output.clone(),
+            2,
+            Caches::default(),
+            None,
+            admission,
+            format,
+        )
+        .unwrap();
+
+        let bytes = output.0.lock().unwrap().clone();
+        let mut frames = std::io::Cursor::new(bytes);
+        let mut ids = Vec::new();
+        while let Some(frame) = read_frame(&mut frames).unwrap() {
+            let response: Value = wire::from_msgpack(&frame).unwrap();
+            assert_eq!(response["ok"], true);
+            assert_eq!(
+                response["result"]["entities"]["p1"]["at"],
+                json!([1.0, 2.0, 3.0])
+            );
+            ids.push(response["id"].as_i64().unwrap());
+        }
+        ids.sort();
+        assert_eq!(ids, (0..5).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_positions_are_packed_in_document_order() {
+        let document = json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [1, 2, 3]},
+                {"type": "point", "id": "p2", "at": [4, 5, 6]},
+                {"type": "line", "id": "l", "p1": "p1", "p2": "p2"},
+                {"type": "circle", "id": "c", "center": [0, 0, 0], "diameter": 4,
+                 "normal": [0, 0, 1]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "fixed", "entity": "p2"},
+                {"type": "diameter", "circle": "c", "value": 4}
+            ]
+        });
+        let request = json!({"id": 1, "document": document, "positions": true});
+        let response = handle(request.clone());
+        assert_eq!(response["ok"], true);
+        assert!(response["result"].get("entities").is_none());
+        assert_eq!(
+            response["positions"],
+            json!([
+                1.0, 2.0, 3.0, 0.0, 4.0, 5.0, 6.0, 0.0, null, null, null, null, 0.0, 0.0, 0.0, 2.0
+            ])
+        );
+
+        // In MessagePack they're the response's last entry, as raw floats
+        let request = wire::to_msgpack(&request).unwrap();
+        let response = Worker::new().handle(&request, WireFormat::Msgpack);
+        let packed = &response[response.len() - 16 * 8..];
+        assert_eq!(&response[response.len() - 16 * 8 - 2..][..2], &[0xc4, 128]);
+        assert_eq!(f64::from_le_bytes(packed[32..40].try_into().unwrap()), 4.0);
+        assert!(f64::from_le_bytes(packed[64..72].try_into().unwrap()).is_nan());
+        assert_eq!(f64::from_le_bytes(packed[120..].try_into().unwrap()), 2.0);
+    }
+
+    #[test]
+    fn test_read_frame_rejects_a_cut_off_frame() {
+        let mut input = std::io::Cursor::new(vec![0, 0, 0, 9, 0x80]);
+        assert!(read_frame(&mut input).is_err());
+    }
+
+    #[test]
+    fn test_cached_solve_answers_a_renamed_document() {
+        let cache = Arc::new(SolveCache::new(16, 1 << 20, 1e-6));
+        let worker = Worker::with_caches(Caches {
+            results: Some(Arc::clone(&cache)),
+            systems: None,
+            ..Caches::default()
+        });
+        let ask = |doc: Value| -> Value {
+            let request = json!({"id": 1, "document": doc}).to_string();
+            serde_json::from_slice(&worker.handle(request.as_bytes(), WireFormat::Json)).unwrap()
+        };
+        let first = ask(point_document());
+        assert_eq!(cache.len(), 1);
+
+        let mut renamed = point_document();
+        renamed["entities"][0]["id"] = json!("origin");
+        renamed["constraints"][0]["entity"] = json!("origin");
+        let second = ask(renamed);
+        assert_eq!(cache.len(), 1);
+        assert_eq!(
+            second["result"]["entities"]["origin"],
+            first["result"]["entities"]["p1"]
+        );
+    }
+
+    #[test]
+    fn test_cached_system_solves_new_values() {
+        let systems = Arc::new(SystemCache::new(4));
+        let worker = Worker::with_caches(Caches {
+            results: None,
+            systems: Some(Arc::clone(&systems)),
+            ..Caches::default()
+        });
+        let ask = |doc: Value| -> Value {
+            let request = json!({"id": 1, "document": doc}).to_string();
+            serde_json::from_slice(&worker.handle(request.as_bytes(), WireFormat::Json)).unwrap()
+        };
+        ask(point_document());
+        assert_eq!(systems.len(), 1);
+
+        let mut moved = point_document();
+        moved["entities"][0]["at"] = json!([4, 5, 6]);
+        let response = ask(moved);
+        assert_eq!(systems.len(), 1);
+        assert_eq!(
+            response["result"]["entities"]["p1"]["at"],
+            json!([4.0, 5.0, 6.0])
+        );
+    }
+
+    #[test]
+    fn test_metrics_count_requests_phases_and_cache_hits() {
+        let metrics = Arc::new(Metrics::new());
+        let mut worker = Worker::with_caches(Caches {
+            results: Some(Arc::new(SolveCache::new(16, 1 << 20, 1e-6))),
+            systems: None,
+            ..Caches::default()
+        });
+        worker.metrics = Some(Arc::clone(&metrics));
+        let request = json!({"id": 1, "document": point_document()}).to_string();
+        worker.handle(request.as_bytes(), WireFormat::Json);
+        worker.handle(request.as_bytes(), WireFormat::Json);
+        worker.handle(b"{ nope", WireFormat::Json);
+
+        let out = metrics.render();
+        assert!(out.contains("slvsx_requests_total{command=\"solve\"} 2\n"));
+        assert!(out.contains("slvsx_requests_total{command=\"unknown\"} 1\n"));
+        assert!(out.contains("slvsx_outcomes_total{status=\"ok\"} 2\n"));
+        assert!(out.contains("slvsx_outcomes_total{status=\"invalid_input\"} 1\n"));
+        assert!(out.contains("slvsx_cache_lookups_total{cache=\"results\",result=\"miss\"} 1\n"));
+        assert!(out.contains("slvsx_cache_lookups_total{cache=\"results\",result=\"hit\"} 1\n"));
+        // Validated and solved once; the second was answered from the cache
+        assert!(out.contains("slvsx_phase_duration_seconds_count{phase=\"parse\"} 3\n"));
+        assert!(out.contains("slvsx_phase_duration_seconds_count{phase=\"validate\"} 1\n"));
+        assert!(out.contains("slvsx_phase_duration_seconds_count{phase=\"solve\"} 1\n"));
+        assert!(out.contains("slvsx_newton_iterations_count 1\n"));
+    }
+
+    #[test]
+    fn test_refuses_a_request_over_the_cost_limit() {
+        // A fixed point costs 3^1.5 for its block, and 3 for its equations
+        let mut worker = Worker::new();
+        worker.admission.max_cost = Some(5.0);
+        let request = json!({"id": 4, "document": point_document()}).to_string();
+        let response = worker.handle(request.as_bytes(), WireFormat::Json);
+        let response: Value = serde_json::from_slice(&response).unwrap();
+        assert_eq!(response["id"], 4);
+        assert_eq!(response["ok"], false);
+        assert_eq!(response["error"]["code"], 8);
+
+        worker.admission.max_cost = Some(10.0);
+        let response = worker.handle(request.as_bytes(), WireFormat::Json);
+        let response: Value = serde_json::from_slice(&response).unwrap();
+        assert_eq!(response["ok"], true);
+    }
+
+    #[test]
+    fn test_heavy_requests_run_on_their_own_pool() {
+        let mut input = String::new();
+        for id in 0..10 {
+            input.push_str(&json!({"id": id, "document": point_document()}).to_string());
+            input.push('\n');
+        }
+        let metrics = Arc::new(Metrics::new());
+        let admission = Admission {
+            max_cost: None,
+            heavy_cost: Some(5.0),
+            heavy_workers: 2,
+            heavy_queue: 16,
+            memory_mb: None,
+        };
+        let output = SharedBuffer::default();
+        let input = std::io::Cursor::new(input);
+        let caches = Caches::default();
+        let format = WireFormat::Json;
+        serve_lines(
+            input,
+            output.clone(),
+            2,
+            caches,
+            Some(Arc::clone(&metrics)),
+            admission,
+            format,
+        )
+        .unwrap();
+
+        let text = String::from_utf8(output.0.lock().unwrap().clone()).unwrap();
+        let mut ids: Vec<i64> = text
+            .lines()
+            .map(|l| {
+                let response: Value = serde_json::from_str(l).unwrap();
+                assert_eq!(response["ok"], true);
+                response["id"].as_i64().unwrap()
+            })
+            .collect();
+        ids.sort();
+        assert_eq!(ids, (0..10).collect::<Vec<_>>());
+        let out = metrics.render();
+        assert!(out.contains("slvsx_admissions_total{lane=\"heavy\"} 10\n"));
+        assert!(out.contains("slvsx_request_duration_seconds_count 10\n"));
+    }
+
+    #[test]
+    fn test_session_patches_answer_with_what_moved() {
+        let worker = Worker::with_caches(Caches {
+            sessions: Some(Arc::new(Sessions::new(4))),
+            ..Caches::default()
+        });
+        let ask = |request: Value| -> Value {
+            let response = worker.handle(request.to_string().as_bytes(), WireFormat::Json);
+            serde_json::from_slice(&response).unwrap()
+        };
+        let document = json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [3, 4, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 5}
+            ]
+        });
+        let opened = ask(json!({"id": 1, "command": "open", "session": "s", "document": document}));
+        assert_eq!(opened["ok"], true);
+        assert_eq!(opened["result"]["entities"].as_object().unwrap().len(), 2);
+
+        let patch = json!([{"op": "replace", "path": "/constraints/1/value", "value": 10}]);
+        let patched = ask(json!({"id": 2, "command": "patch", "session": "s", "patch": patch}));
+        assert_eq!(patched["ok"], true, "{}", patched);
+        assert_eq!(patched["version"], 1);
+        let entities = patched["result"]["entities"].as_object().unwrap();
+        assert_eq!(entities.keys().collect::<Vec<_>>(), ["p2"]);
+        assert_eq!(entities["p2"]["at"], json!([6.0, 8.0, 0.0]));
+
+        let closed = ask(json!({"id": 3, "command": "close", "session": "s"}));
+        assert_eq!(closed["ok"], true);
+        let gone = ask(json!({"id": 4, "command": "patch", "session": "s", "patch": patch}));
+        assert_eq!(gone["ok"], false);
+        assert_eq!(gone["error"]["pointer"], "/session");
+
+        // Without sessions, or a document, there's nothing to do
+        let response = handle(json!({"id": 5, "command": "open", "session": "s"}));
+        assert_eq!(response["error"]["pointer"], "/command");
+        let response = handle(json!({"id": 6}));
+        assert_eq!(response["error"]["pointer"], "/document");
+    }
+
+    #[test]
+    fn test_session_progress_comes_before_the_response() {
+        let document = json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [3, 4, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 10}
+            ]
+        });
+        let open = json!({"id": 1, "command": "open", "session": "s", "document": document,
+                          "progress": true});
+        let input = std::io::Cursor::new(format!("{}\n", open));
+        let output = SharedBuffer::default();
+        let caches = Caches {
+            sessions: Some(Arc::new(Sessions::new(1))),
+            ..Caches::default()
+        };
+        let admission = Admission::default();
+        serve_lines(
+            input,
+            output.clone(),
+            1,
+            caches,
+            None,
+            admission,
+            WireFormat::Json,
+        )
+        .unwrap();
+
+        let text = String::from_utf8(output.0.lock().unwrap().clone()).unwrap();
+        let lines: Vec<Value> = text
+            .lines()
+            .map(|l| serde_json::from_str(l).unwrap())
+            .collect();
+        let (response, steps) = lines.split_last().unwrap();
+        assert_eq!(response["ok"], true);
+        assert!(!steps.is_empty());
+        for (n, step) in steps.iter().enumerate() {
+            assert_eq!(step["id"], 1);
+            assert_eq!(step["progress"]["iterations"], n as i64 + 1);
+        }
+    }
+
+    #[test]
+    fn test_same_document_in_flight_waits_for_its_solve() {
+        let (flights, metrics) = (Arc::new(Flights::new()), Arc::new(Metrics::new()));
+        let caches = Caches {
+            flights: Some(Arc::clone(&flights)),
+            ..Caches::default()
+        };
+        let mut worker = Worker::with_caches(caches);
+        worker.metrics = Some(Arc::clone(&metrics));
+
+        // A solve of the document is in the air
+        let doc: InputDocument = serde_json::from_value(point_document()).unwrap();
+        let key = structural_key(&doc, SolverConfig::default().tolerance).unwrap();
+        let Boarding::Leads(leading) = flights.board(&key, || None) else {
+            panic!("should lead")
+        };
+
+        // The same document, renamed, waits for it rather than solving
+        let mut renamed = point_document();
+        renamed["entities"][0]["id"] = json!("origin");
+        renamed["constraints"][0]["entity"] = json!("origin");
+        let request = json!({"id": 9, "document": renamed}).to_string();
+        let (sender, receiver) = channel();
+        let reply = Some((&sender, Instant::now()));
+        assert!(worker
+            .respond(request.as_bytes(), WireFormat::Json, reply)
+            .is_none());
+        assert!(receiver.try_recv().is_err());
+
+        // The leader's response answers it, under its own ids
+        let response = Worker::new().run(Request {
+            document: Some(doc),
+            ..Request::default()
+        });
+        worker.land(leading, &response);
+        let answer: Value = serde_json::from_slice(&receiver.recv().unwrap()).unwrap();
+        assert_eq!(answer["id"], 9);
+        assert_eq!(
+            answer["result"]["entities"]["origin"]["at"],
+            json!([1.0, 2.0, 3.0])
+        );
+        assert_eq!(flights.in_air(), 0);
+        assert!(metrics.render().contains("slvsx_coalesced_total 1\n"));
+    }
+}
@@ -0,0 +1,367 @@
+//! Sessions of `slvsx serve`: a document opened once and kept, compiled,
+//! on the server, then edited by JSON Patch (RFC 6902; see
+//! `slvsx_core::patch`) rather than sent again whole for each small change.
+//!
+//! Each patch is applied to the document's JSON and to the parsed document,
+//! checked, and written to the compiled system, which solves again just the
+//! blocks the edit reached (see `slvsx_core::compiled`). Its response has
+//! only the entities that moved since the last solve, or are new, so both
+//! the request and the response are about the size of the edit. A session's
+//! version counts its patches; a patch that gives `version` applies only to
+//! that one, for clients that send patches without waiting for the last.
+
+use slvsx_core::{
+    compiled::{CompiledSystem, ProgressFn},
+    ir::ResolvedEntity,
+    patch::{self, Operation},
+    solver::Solver,
+    validator::Validator,
+    Error, InputDocument, Result, SolveResult,
+};
+use std::collections::HashMap;
+use std::sync::{Arc, Mutex};
+
+struct Session {
+    /// The document as the client sent and patched it
+    source: serde_json::Value,
+    system: CompiledSystem,
+    /// Every entity as last solved: where a rebuild starts from, and what a
+    /// patch's response is compared with
+    last: SolveResult,
+    version: u64,
+}
+
+/// The sessions open on a server, shared by its workers; each one is taken
+/// by one request at a time
+pub struct Sessions {
+    open: Mutex<HashMap<String, Arc<Mutex<Session>>>>,
+    limit: usize,
+}
+
+fn no_session(name: &str) -> Error {
+    Error::InvalidInput {
+        message: format!("No session '{}' is open", name),
+        pointer: Some("/session".to_string()),
+    }
+}
+
+/// Whether an entity moved further than `tolerance` in any coordinate
+fn moved(a: &ResolvedEntity, b: &ResolvedEntity, tolerance: f64) -> bool {
+    use ResolvedEntity::*;
+    let apart = |a: &[f64], b: &[f64]| {
+        a.len() != b.len() || a.iter().zip(b).any(|(a, b)| (a - b).abs() > tolerance)
+    };
+    match (a, b) {
+        (Point { at: a }, Point { at: b }) => apart(a, b),
+        (
+            Circle {
+                center: c,
+                diameter: d,
+                normal: n,
+            },
+            Circle {
+                center: c2,
+                diameter: d2,
+                normal: n2,
+            },
+        ) => apart(c, c2) || apart(&[*d], &[*d2]) || apart(n, n2),
+        (Line { p1, p2 }, Line { p1: q1, p2: q2 }) => apart(p1, q1) || apart(p2, q2),
+        (
+            Arc {
+                center,
+                start,
+                end,
+                normal,
+            },
+            Arc {
+                center: c,
+                start: s,
+                end: e,
+                normal: n,
+            },
+        ) => apart(center, c) || apart(start, s) || apart(end, e) || apart(normal, n),
+        (
+            Cubic {
+                start,
+                control1,
+                control2,
+                end,
+            },
+            Cubic {
+                start: s,
+                control1: c1,
+                control2: c2,
+                end: e,
+            },
+        ) => apart(start, s) || apart(control1, c1) || apart(control2, c2) || apart(end, e),
+        _ => true,
+    }
+}
+
+impl Sessions {
+    /// Room for `limit` sessions open at once
+    pub fn new(limit: usize) -> Self {
+        Self {
+            open: Mutex::new(HashMap::new()),
+            limit,
+        }
+    }
+
+    fn get(&self, name: &str) -> Result<Arc<Mutex<Session>>> {
+        let open = self.open.lock().map_err(|_| Error::Overloaded)?;
+        open.get(name).cloned().ok_or_else(|| no_session(name))
+    }
+
+    /// Open a session on a document (replacing one of the same name), and
+    /// solve it, telling `progress` of each step if given
+    pub fn open(
+        &self,
+        name: &str,
+        source: serde_json::Value,
+        doc: &InputDocument,
+        solver: &Solver,
+        validator: &Validator,
+        progress: Option<ProgressFn>,
+    ) -> Result<SolveResult> {
+        let full = |open: &HashMap<String, Arc<Mutex<Session>>>| {
+            open.len() >= self.limit && !open.contains_key(name)
+        };
+        // Checked first so a full server doesn't compile and solve for
+        // nothing
+        if full(&*self.open.lock().map_err(|_| Error::Overloaded)?) {
+            return Err(Error::Overloaded);
+        }
+        validator.validate(doc)?;
+        let mut system = solver.compile(doc)?;
+        system.on_progress(progress);
+        let result = system.resolve();
+        system.on_progress(None);
+        let result = result?;
+        let session = Session {
+            source,
+            system,
+            last: result.clone(),
+            version: 0,
+        };
+        // And again where it's kept, as other opens may have filled the
+        // server meanwhile
+        let mut open = self.open.lock().map_err(|_| Error::Overloaded)?;
+        if full(&open) {
+            return Err(Error::Overloaded);
+        }
+        open.insert(name.to_string(), Arc::new(Mutex::new(session)));
+        Ok(result)
+    }
+
+    /// Patch a session's document and solve it again, giving what moved and
+    /// the session's version after the patch. A patch that applies, but
+    /// leaves a document that doesn't build or solve, is kept, as such a
+    /// document sent whole would be, and the error says why. `progress`,
+    /// if given, is told of each step of the solve.
+    pub fn patch(
+        &self,
+        name: &str,
+        ops: &[Operation],
+        version: Option<u64>,
+        validator: &Validator,
+        tolerance: f64,
+        progress: Option<ProgressFn>,
+    ) -> (Result<SolveResult>, Option<u64>) {
+        let session = match self.get(name) {
+            Ok(session) => session,
+            Err(e) => return (Err(e), None),
+        };
+        let Ok(mut session) = session.lock() else {
+            return (Err(Error::Overloaded), None);
+        };
+        let Session {
+            source,
+            system,
+            last,
+            version: at,
+        } = &mut *session;
+        if let Some(wanted) = version.filter(|v| v != at) {
+            let e = Error::InvalidInput {
+                message: format!("Session '{}' is at version {}, not {}", name, at, wanted),
+                pointer: Some("/version".to_string()),
+            };
+            return (Err(e), Some(*at));
+        }
+
+        let mut applied = false;
+        let edit = |doc: &mut InputDocument| {
+            patch::apply_to_document(source, doc, ops, |doc| validator.validate(doc))?;
+            applied = true;
+            Ok(())
+        };
+        let edited = system.edit(edit, Some(last));
+        *at += u64::from(applied);
+        system.on_progress(progress);
+        let solved = edited.and_then(|_| system.resolve());
+        system.on_progress(None);
+        let result = solved.map(|mut result| {
+            let entities = result.entities.take().unwrap_or_default();
+            let before = last.entities.as_ref();
+            let changed = entities
+                .iter()
+                .filter(|(id, e)| {
+                    before
+                        .and_then(|b| b.get(*id))
+                        .map_or(true, |b| moved(b, e, tolerance))
+                })
+                .map(|(id, e)| (id.clone(), e.clone()))
+                .collect();
+            *last = SolveResult {
+                entities: Some(entities),
+                ..result.clone()
+            };
+            SolveResult {
+                entities: Some(changed),
+                ..result
+            }
+        });
+        (result, Some(*at))
+    }
+
+    /// Close a session
+    pub fn close(&self, name: &str) -> Result<()> {
+        let mut open = self.open.lock().map_err(|_| Error::Overloaded)?;
+        open.remove(name)
+            .map(|_| ())
+            .ok_or_else(|| no_session(name))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+    use slvsx_core::solver::SolverConfig;
+
+    /// p2 is 10 from the fixed p1, and p3 apart from both
+    fn source() -> serde_json::Value {
+        json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10.0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 0]},
+                {"type": "point", "id": "p3", "at": [0, 5, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "fixed", "entity": "p3"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        })
+    }
+
+    fn ops(value: serde_json::Value) -> Vec<Operation> {
+        serde_json::from_value(value).unwrap()
+    }
+
+    fn ids(result: &SolveResult) -> Vec<&str> {
+        let mut ids: Vec<&str> = result
+            .entities
+            .as_ref()
+            .unwrap()
+            .keys()
+            .map(String::as_str)
+            .collect();
+        ids.sort();
+        ids
+    }
+
+    #[test]
+    fn test_patches_answer_with_what_moved() {
+        let (solver, validator) = (Solver::new(SolverConfig::default()), Validator::new());
+        let sessions = Sessions::new(4);
+        let doc: InputDocument = serde_json::from_value(source()).unwrap();
+        let opened = sessions
+            .open("s", source(), &doc, &solver, &validator, None)
+            .unwrap();
+        assert_eq!(ids(&opened), ["p1", "p2", "p3"]);
+
+        let patch = ops(json!([{"op": "replace", "path": "/parameters/r", "value": 20}]));
+        let (result, version) = sessions.patch("s", &patch, None, &validator, 1e-9, None);
+        assert_eq!(ids(&result.unwrap()), ["p2"]);
+        assert_eq!(version, Some(1));
+
+        // A new point, tied to p3, is all that's new or moved
+        let patch = ops(json!([
+            {"op": "add", "path": "/entities/-",
+             "value": {"type": "point", "id": "p4", "at": [1, 5, 0]}},
+            {"op": "add", "path": "/constraints/-",
+             "value": {"type": "distance", "between": ["p3", "p4"], "value": 2}}
+        ]));
+        let (result, version) = sessions.patch("s", &patch, Some(1), &validator, 1e-9, None);
+        assert_eq!(ids(&result.unwrap()), ["p4"]);
+        assert_eq!(version, Some(2));
+
+        // A stale version, or a patch that breaks a reference, changes nothing
+        let (result, version) = sessions.patch("s", &patch, Some(1), &validator, 1e-9, None);
+        assert!(result.is_err());
+        assert_eq!(version, Some(2));
+        let patch = ops(json!([{"op": "remove", "path": "/entities/0"}]));
+        let (result, version) = sessions.patch("s", &patch, None, &validator, 1e-9, None);
+        assert!(result.is_err());
+        assert_eq!(version, Some(2));
+
+        sessions.close("s").unwrap();
+        assert!(sessions
+            .patch("s", &patch, None, &validator, 1e-9, None)
+            .0
+            .is_err());
+        assert!(sessions.close("s").is_err());
+    }
+
+    #[test]
+    fn test_sessions_are_limited() {
+        let (solver, validator) = (Solver::new(SolverConfig::default()), Validator::new());
+        let sessions = Sessions::new(1);
+        let doc: InputDocument = serde_json::from_value(source()).unwrap();
+        sessions
+            .open("a", source(), &doc, &solver, &validator, None)
+            .unwrap();
+        let err = sessions
+            .open("b", source(), &doc, &solver, &validator, None)
+            .unwrap_err();
+        assert!(matches!(err, Error::Overloaded));
+        // Opening one of the same name again replaces it
+        sessions
+            .open("a", source(), &doc, &solver, &validator, None)
+            .unwrap();
+    }
+
+    #[test]
+    fn test_opens_solving_at_once_keep_to_the_limit() {
+        let (solver, validator) = (Solver::new(SolverConfig::default()), Validator::new());
+        let sessions = Arc::new(Sessions::new(1));
+        // p2 starts off the distance, so "a" takes steps
+        let mut moved = source();
+        moved["parameters"]["r"] = json!(20.0);
+        let doc: InputDocument = serde_json::from_value(moved.clone()).unwrap();
+        // While "a" solves, "b" is opened on another thread and takes the
+        // one place
+        let (other, mut opened) = (Arc::clone(&sessions), false);
+        let progress: ProgressFn = Box::new(move |_| {
+            if !std::mem::replace(&mut opened, true) {
+                let other = Arc::clone(&other);
+                std::thread::spawn(move || {
+                    let doc: InputDocument = serde_json::from_value(source()).unwrap();
+                    let solver = Solver::new(SolverConfig::default());
+                    other
+                        .open("b", source(), &doc, &solver, &Validator::new(), None)
+                        .unwrap();
+                })
+                .join()
+                .unwrap();
+            }
+        });
+        let err = sessions
+            .open("a", moved, &doc, &solver, &validator, Some(progress))
+            .unwrap_err();
+        assert!(matches!(err, Error::Overloaded));
+        assert!(sessions.get("b").is_ok() && sessions.get("a").is_err());
+    }
+}
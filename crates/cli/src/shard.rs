@@ -0,0 +1,89 @@
+//! `--shard i/N`: splitting a sweep's grid, or a stream of documents, into
+//! N parts for separate runs to solve, on separate machines if need be,
+//! without any coordination between them. Which part a grid point or a
+//! document falls in depends only on i, N and where it is.
+
+use anyhow::{anyhow, Result};
+use std::ops::Range;
+
+/// The `index`th (from 1) of `count` parts
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Shard {
+    pub index: usize,
+    pub count: usize,
+}
+
+impl Shard {
+    /// Parse `i/N`, with i from 1 to N
+    pub fn parse(spec: &str) -> Result<Self> {
+        let (index, count) = spec
+            .split_once('/')
+            .ok_or_else(|| anyhow!("Expected i/N, such as 1/4, in '{}'", spec))?;
+        let number = |s: &str| -> Result<usize> {
+            s.trim()
+                .parse()
+                .map_err(|_| anyhow!("'{}' isn't a whole number, in '{}'", s.trim(), spec))
+        };
+        let (index, count) = (number(index)?, number(count)?);
+        if index == 0 || index > count {
+            return Err(anyhow!(
+                "The shard in '{}' should be from 1 to {}",
+                spec,
+                count
+            ));
+        }
+        Ok(Self { index, count })
+    }
+
+    /// The grid indices this shard solves, out of `grid_size`: the index'th
+    /// of N runs of consecutive indices, as near equal as they divide
+    pub fn range(&self, grid_size: usize) -> Range<usize> {
+        let at = |k: usize| (grid_size as u128 * k as u128 / self.count as u128) as usize;
+        at(self.index - 1)..at(self.index)
+    }
+
+    /// Whether this shard solves the document on `line` (from 1) of a
+    /// stream, whose length isn't known up front: every Nth line, from the
+    /// index'th
+    pub fn takes_line(&self, line: usize) -> bool {
+        (line.max(1) - 1) % self.count == self.index - 1
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse() {
+        assert_eq!(Shard::parse("2/4").unwrap(), Shard { index: 2, count: 4 });
+        assert_eq!(
+            Shard::parse(" 1 / 1 ").unwrap(),
+            Shard { index: 1, count: 1 }
+        );
+        assert!(Shard::parse("0/4").is_err());
+        assert!(Shard::parse("5/4").is_err());
+        assert!(Shard::parse("1").is_err());
+        assert!(Shard::parse("a/4").is_err());
+    }
+
+    #[test]
+    fn test_ranges_cover_the_grid_once() {
+        for count in [1, 3, 7, 10] {
+            let ranges: Vec<Range<usize>> = (1..=count)
+                .map(|index| Shard { index, count }.range(10))
+                .collect();
+            assert_eq!(ranges[0].start, 0);
+            assert_eq!(ranges[count - 1].end, 10);
+            assert!(ranges.windows(2).all(|w| w[0].end == w[1].start));
+            assert!(ranges.iter().all(|r| r.len() <= 10usize.div_ceil(count)));
+        }
+    }
+
+    #[test]
+    fn test_lines_go_round_robin() {
+        let shard = Shard { index: 2, count: 3 };
+        let taken: Vec<usize> = (1..=9).filter(|&l| shard.takes_line(l)).collect();
+        assert_eq!(taken, vec![2, 5, 8]);
+    }
+}
@@ -0,0 +1,254 @@
+//! Compiled systems kept on disk by `slvsx serve --cache-dir`, so that a
+//! server that restarts doesn't start cold: the documents it had systems
+//! compiled for are compiled again as it starts, in the background, while
+//! it answers requests as it would without them.
+//!
+//! A compiled system is native solver state, and can't be written out as
+//! it is. What's kept is the document each system was last built from,
+//! one file per topology hash under `systems-v1/`, which is all that's
+//! needed to build it again. Files are written every so often and as the
+//! server stops, each to a temporary name and renamed into place, so a
+//! server killed while saving leaves the last save whole. Each is checked
+//! as it's restored: one whose document doesn't parse, validate, or hash
+//! to its name (as after a change to how topologies are hashed) is
+//! dropped rather than trusted.
+
+use slvsx_core::{
+    cache::{topology_key, SystemCache},
+    solver::Solver,
+    validator::Validator,
+    InputDocument,
+};
+use std::collections::hash_map::DefaultHasher;
+use std::collections::HashMap;
+use std::fs;
+use std::hash::{Hash, Hasher};
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{Duration, SystemTime};
+
+/// The layout of the files; a change to it gets a new directory
+const LAYOUT: &str = "systems-v1";
+
+/// The compiled systems of a cache, as kept in a directory
+pub struct SystemStore {
+    dir: PathBuf,
+    systems: Arc<SystemCache>,
+    /// A hash of what was last written for each topology, so that a save
+    /// writes only what changed
+    written: Mutex<HashMap<u64, u64>>,
+}
+
+fn file_key(path: &Path) -> Option<u64> {
+    let name = path.file_name()?.to_str()?.strip_suffix(".json")?;
+    u64::from_str_radix(name, 16).ok()
+}
+
+fn modified(path: &Path) -> SystemTime {
+    fs::metadata(path)
+        .and_then(|m| m.modified())
+        .unwrap_or(SystemTime::UNIX_EPOCH)
+}
+
+impl SystemStore {
+    /// A store under dir for systems, creating its directory if need be
+    pub fn open(dir: &Path, systems: Arc<SystemCache>) -> io::Result<Self> {
+        let dir = dir.join(LAYOUT);
+        fs::create_dir_all(&dir)?;
+        Ok(Self {
+            dir,
+            systems,
+            written: Mutex::new(HashMap::new()),
+        })
+    }
+
+    fn path(&self, key: u64) -> PathBuf {
+        self.dir.join(format!("{:016x}.json", key))
+    }
+
+    /// The saved files, by topology, most recently saved first
+    fn files(&self) -> io::Result<Vec<(u64, PathBuf)>> {
+        let mut files: Vec<(u64, PathBuf, SystemTime)> = fs::read_dir(&self.dir)?
+            .filter_map(|entry| {
+                let path = entry.ok()?.path();
+                let key = file_key(&path)?;
+                let time = modified(&path);
+                Some((key, path, time))
+            })
+            .collect();
+        files.sort_by(|a, b| b.2.cmp(&a.2));
+        Ok(files
+            .into_iter()
+            .map(|(key, path, _)| (key, path))
+            .collect())
+    }
+
+    /// Write the document of every system in the cache, then drop the
+    /// oldest files beyond what the cache can hold. Returns how many files
+    /// were written.
+    pub fn save(&self) -> io::Result<usize> {
+        let mut written = 0;
+        for (key, doc) in self.systems.documents() {
+            let bytes = serde_json::to_vec(&doc)?;
+            let mut hasher = DefaultHasher::new();
+            bytes.hash(&mut hasher);
+            let hash = hasher.finish();
+            let path = self.path(key);
+            let unchanged = self
+                .written
+                .lock()
+                .map_or(false, |w| w.get(&key) == Some(&hash));
+            if unchanged && path.exists() {
+                // Still in use: keep it among the newest
+                fs::File::options()
+                    .write(true)
+                    .open(&path)?
+                    .set_modified(SystemTime::now())?;
+                continue;
+            }
+            let temporary = path.with_extension("tmp");
+            fs::write(&temporary, &bytes)?;
+            fs::rename(&temporary, &path)?;
+            if let Ok(mut w) = self.written.lock() {
+                w.insert(key, hash);
+            }
+            written += 1;
+        }
+        for (key, path) in self.files()?.into_iter().skip(self.systems.capacity()) {
+            fs::remove_file(path)?;
+            if let Ok(mut w) = self.written.lock() {
+                w.remove(&key);
+            }
+        }
+        Ok(written)
+    }
+
+    /// Compile the saved documents, as many as the cache holds, newest
+    /// last so that they're the last to be dropped, and keep each system
+    /// unless one is kept for its topology already. Files that don't check
+    /// out are removed. Returns how many systems were restored.
+    pub fn restore(&self, solver: &Solver, validator: &Validator) -> usize {
+        let Ok(files) = self.files() else { return 0 };
+        let mut restored = 0;
+        for (key, path) in files.into_iter().take(self.systems.capacity()).rev() {
+            let doc = fs::read(&path)
+                .ok()
+                .and_then(|bytes| serde_json::from_slice::<InputDocument>(&bytes).ok());
+            let topology = doc
+                .as_ref()
+                .and_then(topology_key)
+                .filter(|t| t.hash == key);
+            let doc = doc.filter(|doc| topology.is_some() && validator.validate(doc).is_ok());
+            let system = doc.and_then(|doc| solver.compile(&doc).ok());
+            let (Some(topology), Some(system)) = (topology, system) else {
+                let _ = fs::remove_file(&path);
+                continue;
+            };
+            restored += usize::from(self.systems.put_if_absent(&topology, system));
+        }
+        restored
+    }
+
+    /// Restore the saved systems, then save them every `every`, on a
+    /// thread of its own
+    pub fn start(self: Arc<Self>, solver: Solver, every: Duration) -> thread::JoinHandle<()> {
+        thread::spawn(move || {
+            let restored = self.restore(&solver, &Validator::new());
+            if restored > 0 {
+                eprintln!(
+                    "Restored {} compiled systems from {}",
+                    restored,
+                    self.dir.display()
+                );
+            }
+            loop {
+                thread::sleep(every);
+                if let Err(e) = self.save() {
+                    eprintln!(
+                        "Couldn't save compiled systems to {}: {}",
+                        self.dir.display(),
+                        e
+                    );
+                }
+            }
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use slvsx_core::solver::SolverConfig;
+
+    fn document(r: f64) -> InputDocument {
+        serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": r},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 1, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        }))
+        .unwrap()
+    }
+
+    fn temp_dir(name: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!("slvsx-store-{}-{}", name, std::process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        dir
+    }
+
+    #[test]
+    fn test_systems_survive_a_restart() {
+        let dir = temp_dir("restart");
+        let solver = Solver::new(SolverConfig::default());
+        let doc = document(5.0);
+        let key = topology_key(&doc).unwrap();
+
+        let systems = Arc::new(SystemCache::new(4));
+        systems.put(&key, solver.compile(&doc).unwrap());
+        let store = SystemStore::open(&dir, Arc::clone(&systems)).unwrap();
+        assert_eq!(store.save().unwrap(), 1);
+        // Nothing changed, so nothing is written again
+        assert_eq!(store.save().unwrap(), 0);
+
+        // A file that's been corrupted, or hashed another way, is dropped
+        fs::write(store.path(1), b"{}").unwrap();
+        fs::write(store.path(2), serde_json::to_vec(&doc).unwrap()).unwrap();
+
+        let restarted = Arc::new(SystemCache::new(4));
+        let store = SystemStore::open(&dir, Arc::clone(&restarted)).unwrap();
+        assert_eq!(store.restore(&solver, &Validator::new()), 1);
+        assert!(!store.path(1).exists() && !store.path(2).exists());
+
+        // The restored system solves a document with new values
+        let mut system = restarted.take(&key).unwrap();
+        system.load(&document(7.0)).unwrap();
+        let result = system.resolve().unwrap();
+        let p2 = match &result.entities.unwrap()["p2"] {
+            slvsx_core::ir::ResolvedEntity::Point { at } => at.clone(),
+            other => panic!("{:?}", other),
+        };
+        assert!((p2.iter().map(|c| c * c).sum::<f64>().sqrt() - 7.0).abs() < 1e-6);
+        let _ = fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_save_keeps_as_many_files_as_the_cache_holds() {
+        let dir = temp_dir("prune");
+        let systems = Arc::new(SystemCache::new(1));
+        let store = SystemStore::open(&dir, Arc::clone(&systems)).unwrap();
+        for key in [1, 2, 3] {
+            fs::write(store.path(key), b"{}").unwrap();
+        }
+        store.save().unwrap();
+        assert_eq!(store.files().unwrap().len(), 1);
+        let _ = fs::remove_dir_all(&dir);
+    }
+}
@@ -0,0 +1,792 @@
+//! `slvsx sweep`: solve a document over a grid of values for some of its
+//! parameters, and write a table of what each grid point solved to.
+//!
+//! A sweep too big for one machine can be split into shards (see `Shard`),
+//! each solved on its own into a shard file: JSON Lines, a header naming
+//! the sweep and the part of its grid the shard covers, then a row per
+//! line. Rows are appended a chunk at a time as they're solved, so a shard
+//! that is stopped picks up where its file ends when run again. `--merge`
+//! puts the shards' rows back together into one table, in grid order.
+
+use crate::io::{InputReader, OutputWriter};
+use crate::json_error::parse_json_bytes_with_context;
+use crate::shard::Shard;
+use anyhow::{anyhow, Result};
+use serde::{Deserialize, Serialize};
+use slvsx_core::{
+    expr::ExpressionEvaluator,
+    ffi::TrackSteps,
+    solver::{Solver, SolverConfig},
+    sweep::{SweepAxis, SweepReport, SweepRow},
+    validator::Validator,
+    InputDocument,
+};
+use std::collections::{BTreeMap, HashMap, HashSet};
+use std::io::{BufRead, Write};
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum SweepFormat {
+    Csv,
+    Json,
+}
+
+/// Parse `name=start:stop:step` (stop included, step defaulting to 1) or
+/// `name=v1,v2,...`
+pub fn parse_axis(spec: &str) -> Result<SweepAxis> {
+    let (name, range) = spec.split_once('=').ok_or_else(|| {
+        anyhow!(
+            "Expected name=start:stop:step or name=v1,v2,... in '{}'",
+            spec
+        )
+    })?;
+    let number = |s: &str| -> Result<f64> {
+        s.trim()
+            .parse()
+            .map_err(|_| anyhow!("'{}' isn't a number, in '{}'", s.trim(), spec))
+    };
+
+    let values = if range.contains(':') {
+        let parts: Vec<&str> = range.split(':').collect();
+        let (start, stop, step) = match parts.as_slice() {
+            [start, stop] => (number(start)?, number(stop)?, 1.0),
+            [start, stop, step] => (number(start)?, number(stop)?, number(step)?),
+            _ => {
+                return Err(anyhow!(
+                    "Expected start:stop or start:stop:step in '{}'",
+                    spec
+                ))
+            }
+        };
+        if step <= 0.0 || stop < start {
+            return Err(anyhow!("The range in '{}' has no values", spec));
+        }
+        // Allow for rounding, so that 0:1:0.1 includes 1.
+        let count = ((stop - start) / step + 1e-9).floor() as usize + 1;
+        (0..count).map(|i| start + step * i as f64).collect()
+    } else {
+        range.split(',').map(number).collect::<Result<Vec<_>>>()?
+    };
+    Ok(SweepAxis {
+        name: name.trim().to_string(),
+        values,
+    })
+}
+
+const COMPARISONS: [&str; 6] = ["<=", ">=", "==", "!=", "<", ">"];
+
+/// A condition on a row, `lhs op rhs`, where both sides are expressions
+/// over the document's parameters (at that row's values), `ok` (1 if the
+/// row solved, 0 if not), `dof`, and `<point>.x`, `.y` and `.z` for each
+/// point entity.
+pub struct Predicate {
+    lhs: String,
+    op: &'static str,
+    rhs: String,
+}
+
+impl Predicate {
+    pub fn parse(text: &str) -> Result<Self> {
+        for op in COMPARISONS {
+            if let Some((lhs, rhs)) = text.split_once(op) {
+                return Ok(Self {
+                    lhs: lhs.trim().to_string(),
+                    op,
+                    rhs: rhs.trim().to_string(),
+                });
+            }
+        }
+        // A bare expression holds when it isn't zero.
+        Ok(Self {
+            lhs: text.trim().to_string(),
+            op: "!=",
+            rhs: "0".to_string(),
+        })
+    }
+
+    pub fn holds(
+        &self,
+        row: &SweepRow,
+        report_points: &[String],
+        base: &HashMap<String, f64>,
+        names: &[String],
+    ) -> bool {
+        let mut vars = base.clone();
+        for (name, v) in names.iter().zip(&row.values) {
+            vars.insert(name.clone(), *v);
+        }
+        vars.insert("ok".to_string(), if row.is_ok() { 1.0 } else { 0.0 });
+        if let Some(dof) = row.dof {
+            vars.insert("dof".to_string(), dof as f64);
+        }
+        for (point, p) in report_points.iter().zip(&row.positions) {
+            for (axis, v) in ["x", "y", "z"].iter().zip(p) {
+                vars.insert(format!("{}.{}", point, axis), *v);
+            }
+        }
+
+        let eval = ExpressionEvaluator::new(vars);
+        let (Ok(a), Ok(b)) = (eval.eval(&self.lhs), eval.eval(&self.rhs)) else {
+            // A row that failed has no positions to compare.
+            return false;
+        };
+        match self.op {
+            "<=" => a <= b,
+            ">=" => a >= b,
+            "==" => a == b,
+            "!=" => a != b,
+            "<" => a < b,
+            _ => a > b,
+        }
+    }
+}
+
+fn csv_field(s: &str) -> String {
+    if s.contains([',', '"', '\n']) {
+        format!("\"{}\"", s.replace('"', "\"\""))
+    } else {
+        s.to_string()
+    }
+}
+
+/// The report as CSV: one row per grid point, with each swept parameter,
+/// the status and dof, each point's coordinates and any error; and, if it
+/// was tracked, the iterations and steps each row took
+fn to_csv(report: &SweepReport) -> String {
+    let mut header = vec!["index".to_string()];
+    header.extend(report.parameters.iter().map(|p| csv_field(p)));
+    header.push("status".to_string());
+    header.push("dof".to_string());
+    for p in &report.points {
+        for axis in ["x", "y", "z"] {
+            header.push(csv_field(&format!("{}.{}", p, axis)));
+        }
+    }
+    header.push("error".to_string());
+    if report.tracked {
+        header.push("iterations".to_string());
+        header.push("steps".to_string());
+    }
+
+    let mut out = header.join(",");
+    out.push('\n');
+    for row in &report.rows {
+        let mut fields = vec![row.index.to_string()];
+        fields.extend(row.values.iter().map(|v| v.to_string()));
+        fields.push(row.status.clone());
+        fields.push(row.dof.map(|d| d.to_string()).unwrap_or_default());
+        for i in 0..report.points.len() {
+            match row.positions.get(i) {
+                Some(p) => fields.extend(p.iter().map(|v| v.to_string())),
+                None => fields.extend(["", "", ""].map(String::from)),
+            }
+        }
+        fields.push(row.error.as_deref().map(csv_field).unwrap_or_default());
+        if report.tracked {
+            fields.push(row.iterations.map(|n| n.to_string()).unwrap_or_default());
+            fields.push(row.steps.map(|n| n.to_string()).unwrap_or_default());
+        }
+        out.push_str(&fields.join(","));
+        out.push('\n');
+    }
+    out
+}
+
+/// Sweep command handler; with `track`, the one parameter is tracked (see
+/// `Solver::track`) rather than swept, and with `mixed_precision`, batched
+/// grid points start in single precision (see `SolverConfig`)
+#[allow(clippy::too_many_arguments)]
+pub fn handle_sweep<R: InputReader + ?Sized, W: OutputWriter + ?Sized>(
+    reader: &mut R,
+    writer: &mut W,
+    filename: &str,
+    params: &[String],
+    jobs: usize,
+    mixed_precision: bool,
+    stop_when: Option<&str>,
+    track: Option<TrackSteps>,
+    format: SweepFormat,
+) -> Result<()> {
+    if params.is_empty() {
+        return Err(anyhow!("Give at least one --param to sweep"));
+    }
+    if track.is_some() && params.len() > 1 {
+        return Err(anyhow!("Only one --param can be tracked"));
+    }
+    let axes = params
+        .iter()
+        .map(|p| parse_axis(p))
+        .collect::<Result<Vec<_>>>()?;
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
+    Validator::new().validate(&doc)?;
+
+    let predicate = stop_when.map(Predicate::parse).transpose()?;
+    let names: Vec<String> = axes.iter().map(|a| a.name.clone()).collect();
+    let points: Vec<String> = doc
+        .entities
+        .iter()
+        .filter(|e| {
+            matches!(
+                e,
+                slvsx_core::Entity::Point { .. } | slvsx_core::Entity::Point2D { .. }
+            )
+        })
+        .map(|e| e.id().to_string())
+        .collect();
+    let stop = |row: &SweepRow| {
+        predicate
+            .as_ref()
+            .map_or(false, |p| p.holds(row, &points, &doc.parameters, &names))
+    };
+
+    let solver = Solver::new(SolverConfig {
+        mixed_precision,
+        ..SolverConfig::default()
+    });
+    let stop_when = predicate.as_ref().map(|_| &stop as _);
+    let report = match track {
+        Some(steps) => solver.track(&doc, &axes[0], steps, stop_when)?,
+        None => solver.sweep(&doc, &axes, jobs.max(1), stop_when)?,
+    };
+    let output = match format {
+        SweepFormat::Csv => to_csv(&report),
+        SweepFormat::Json => serde_json::to_string_pretty(&report)?,
+    };
+    writer.write_str(&output)?;
+    Ok(())
+}
+
+/// Rows a shard solves between appending them to its file
+const CHECKPOINT_ROWS: usize = 4096;
+
+/// The first line of a shard file
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+struct ShardHeader {
+    shard: usize,
+    shards: usize,
+    /// The swept document's hash (see `document_hash`); missing from files
+    /// written before it was kept, which then match no document
+    #[serde(default)]
+    document: String,
+    parameters: Vec<String>,
+    /// Each swept parameter's values, in axis order
+    values: Vec<Vec<f64>>,
+    points: Vec<String>,
+    grid_size: usize,
+    batched: bool,
+    /// The grid indices the shard covers, from the first up to the second
+    rows: [usize; 2],
+}
+
+impl ShardHeader {
+    /// Whether another shard's header is of the same sweep
+    fn same_sweep(&self, other: &ShardHeader) -> bool {
+        self.shards == other.shards
+            && self.document == other.document
+            && self.parameters == other.parameters
+            && self.values == other.values
+            && self.points == other.points
+            && self.grid_size == other.grid_size
+    }
+}
+
+/// Write a value as JSON with every object's keys in order, whatever
+/// order its maps keep them in
+fn write_canonical(value: &serde_json::Value, out: &mut String) {
+    match value {
+        serde_json::Value::Array(items) => {
+            out.push('[');
+            for (i, item) in items.iter().enumerate() {
+                if i > 0 {
+                    out.push(',');
+                }
+                write_canonical(item, out);
+            }
+            out.push(']');
+        }
+        serde_json::Value::Object(fields) => {
+            let mut keys: Vec<&String> = fields.keys().collect();
+            keys.sort();
+            out.push('{');
+            for (i, key) in keys.into_iter().enumerate() {
+                if i > 0 {
+                    out.push(',');
+                }
+                out.push_str(&serde_json::Value::String(key.clone()).to_string());
+                out.push(':');
+                write_canonical(&fields[key], out);
+            }
+            out.push('}');
+        }
+        other => out.push_str(&other.to_string()),
+    }
+}
+
+/// A hash of a document that's the same on every machine and build, so
+/// that shards solved apart can tell whether they're of one document:
+/// 64-bit FNV-1a of its canonical JSON, in hex
+fn document_hash(doc: &InputDocument) -> Result<String> {
+    let mut canonical = String::new();
+    write_canonical(&serde_json::to_value(doc)?, &mut canonical);
+    let hash = canonical.bytes().fold(0xcbf2_9ce4_8422_2325u64, |h, b| {
+        (h ^ u64::from(b)).wrapping_mul(0x0100_0000_01b3)
+    });
+    Ok(format!("{:016x}", hash))
+}
+
+/// A shard file's header and the rows after it that were written whole;
+/// a line cut short by the shard being stopped, and anything after it, is
+/// dropped
+fn read_shard(path: &str) -> Result<(ShardHeader, Vec<SweepRow>)> {
+    let file = std::fs::File::open(path).map_err(|e| anyhow!("Failed to open {}: {}", path, e))?;
+    let mut lines = std::io::BufReader::new(file).lines();
+    let header = lines
+        .next()
+        .transpose()?
+        .and_then(|l| serde_json::from_str::<ShardHeader>(&l).ok())
+        .ok_or_else(|| anyhow!("{} isn't a sweep shard file", path))?;
+    let mut rows = Vec::new();
+    for line in lines {
+        match serde_json::from_str::<SweepRow>(&line?) {
+            Ok(row) if (header.rows[0]..header.rows[1]).contains(&row.index) => rows.push(row),
+            _ => break,
+        }
+    }
+    Ok((header, rows))
+}
+
+/// Sweep one shard of the grid into the shard file at `path`, resuming
+/// from the rows already in it
+pub fn handle_sweep_shard<R: InputReader + ?Sized>(
+    reader: &mut R,
+    filename: &str,
+    params: &[String],
+    jobs: usize,
+    mixed_precision: bool,
+    shard: Shard,
+    path: &str,
+) -> Result<()> {
+    if params.is_empty() {
+        return Err(anyhow!("Give at least one --param to sweep"));
+    }
+    let axes = params
+        .iter()
+        .map(|p| parse_axis(p))
+        .collect::<Result<Vec<_>>>()?;
+    let doc: InputDocument = parse_json_bytes_with_context(&reader.read_bytes()?, filename)?;
+    Validator::new().validate(&doc)?;
+
+    let solver = Solver::new(SolverConfig {
+        mixed_precision,
+        ..SolverConfig::default()
+    });
+    let grid_size = axes.iter().map(|a| a.values.len()).product();
+    let range = shard.range(grid_size);
+    // Nothing solved, just which points the rows report and how
+    let empty = solver.sweep_range(&doc, &axes, range.start..range.start, 1, None)?;
+    let header = ShardHeader {
+        shard: shard.index,
+        shards: shard.count,
+        document: document_hash(&doc)?,
+        parameters: empty.parameters,
+        values: axes.iter().map(|a| a.values.clone()).collect(),
+        points: empty.points,
+        grid_size,
+        batched: empty.batched,
+        rows: [range.start, range.end],
+    };
+
+    let rows = if std::path::Path::new(path).exists() {
+        let (found, rows) = read_shard(path)?;
+        if found != header {
+            return Err(anyhow!(
+                "{} holds another sweep, or another shard of it; remove it to start this one",
+                path
+            ));
+        }
+        rows
+    } else {
+        Vec::new()
+    };
+    // Rewrite what was kept, without any line cut short, then append
+    let temp = format!("{}.tmp", path);
+    {
+        let mut out = std::io::BufWriter::new(std::fs::File::create(&temp)?);
+        writeln!(out, "{}", serde_json::to_string(&header)?)?;
+        for row in &rows {
+            writeln!(out, "{}", serde_json::to_string(row)?)?;
+        }
+        out.into_inner()
+            .map_err(|e| anyhow!("Failed to write {}: {}", temp, e))?
+            .sync_all()?;
+    }
+    std::fs::rename(&temp, path)?;
+
+    let done: HashSet<usize> = rows.iter().map(|r| r.index).collect();
+    let mut file = std::fs::OpenOptions::new().append(true).open(path)?;
+    let mut start = range.start;
+    while start < range.end {
+        let end = (start + CHECKPOINT_ROWS).min(range.end);
+        if (start..end).any(|i| !done.contains(&i)) {
+            let report = solver.sweep_range(&doc, &axes, start..end, jobs.max(1), None)?;
+            let mut chunk = String::new();
+            for row in report.rows.iter().filter(|r| !done.contains(&r.index)) {
+                chunk.push_str(&serde_json::to_string(row)?);
+                chunk.push('\n');
+            }
+            file.write_all(chunk.as_bytes())?;
+            file.sync_data()?;
+        }
+        start = end;
+    }
+    Ok(())
+}
+
+/// Merge shard files, every shard of one sweep each solved through, into
+/// the sweep's report
+pub fn handle_sweep_merge<W: OutputWriter + ?Sized>(
+    writer: &mut W,
+    paths: &[String],
+    format: SweepFormat,
+) -> Result<()> {
+    let mut shards: BTreeMap<usize, (ShardHeader, Vec<SweepRow>)> = BTreeMap::new();
+    for path in paths {
+        let (header, rows) = read_shard(path)?;
+        if let Some((first, _)) = shards.values().next() {
+            if !first.same_sweep(&header) {
+                return Err(anyhow!(
+                    "{} is a shard of another sweep than {}",
+                    path,
+                    paths[0]
+                ));
+            }
+        }
+        if shards.contains_key(&header.shard) {
+            return Err(anyhow!(
+                "Shard {}/{} is given twice",
+                header.shard,
+                header.shards
+            ));
+        }
+        shards.insert(header.shard, (header, rows));
+    }
+    let Some((first, _)) = shards.values().next() else {
+        return Err(anyhow!("Give the shard files to merge"));
+    };
+    let first = first.clone();
+    if let Some(missing) = (1..=first.shards).find(|i| !shards.contains_key(i)) {
+        return Err(anyhow!("Shard {}/{} is missing", missing, first.shards));
+    }
+
+    let mut rows = Vec::with_capacity(first.grid_size);
+    let mut batched = true;
+    for (header, shard_rows) in shards.into_values() {
+        let expected = header.rows[1] - header.rows[0];
+        if shard_rows.len() != expected {
+            return Err(anyhow!(
+                "Shard {}/{} has {} of its {} rows; run it again to finish it",
+                header.shard,
+                header.shards,
+                shard_rows.len(),
+                expected
+            ));
+        }
+        batched &= header.batched;
+        rows.extend(shard_rows);
+    }
+    rows.sort_by_key(|r| r.index);
+
+    let report = SweepReport {
+        parameters: first.parameters,
+        points: first.points,
+        grid_size: first.grid_size,
+        batched,
+        tracked: false,
+        stopped: false,
+        rows,
+    };
+    let output = match format {
+        SweepFormat::Csv => to_csv(&report),
+        SweepFormat::Json => serde_json::to_string_pretty(&report)?,
+    };
+    writer.write_str(&output)?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::io::tests::{MemoryReader, MemoryWriter};
+
+    #[test]
+    fn test_parse_axis_range_and_list() {
+        let a = parse_axis("r=0:1:0.25").unwrap();
+        assert_eq!(a.name, "r");
+        assert_eq!(a.values, vec![0.0, 0.25, 0.5, 0.75, 1.0]);
+        assert_eq!(parse_axis("n=1:3").unwrap().values, vec![1.0, 2.0, 3.0]);
+        assert_eq!(parse_axis("k=2, 4,8").unwrap().values, vec![2.0, 4.0, 8.0]);
+        assert_eq!(parse_axis("t=0:1:0.1").unwrap().values.len(), 11);
+    }
+
+    #[test]
+    fn test_parse_axis_errors() {
+        assert!(parse_axis("r").is_err());
+        assert!(parse_axis("r=1:x").is_err());
+        assert!(parse_axis("r=3:1").is_err());
+        assert!(parse_axis("r=0:1:0").is_err());
+    }
+
+    fn row(values: Vec<f64>, ok: bool) -> SweepRow {
+        SweepRow {
+            index: 0,
+            values,
+            status: if ok { "ok" } else { "error" }.to_string(),
+            error: if ok { None } else { Some("failed".to_string()) },
+            dof: ok.then_some(0),
+            positions: if ok { vec![[1.0, 2.0, 3.0]] } else { vec![] },
+            iterations: None,
+            steps: None,
+        }
+    }
+
+    #[test]
+    fn test_predicate() {
+        let points = vec!["p1".to_string()];
+        let names = vec!["r".to_string()];
+        let base = HashMap::from([("r".to_string(), 0.0), ("k".to_string(), 2.0)]);
+        let holds = |text: &str, row: &SweepRow| {
+            Predicate::parse(text)
+                .unwrap()
+                .holds(row, &points, &base, &names)
+        };
+        assert!(holds("r >= 5", &row(vec![5.0], true)));
+        assert!(!holds("r > 5", &row(vec![5.0], true)));
+        assert!(holds("p1.y * k == 4", &row(vec![5.0], true)));
+        assert!(holds("ok", &row(vec![1.0], true)));
+        assert!(!holds("ok", &row(vec![1.0], false)));
+        assert!(!holds("p1.x < 10", &row(vec![1.0], false)));
+    }
+
+    #[test]
+    fn test_handle_sweep_csv() {
+        let doc = r#"{
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        }"#;
+        let mut reader = MemoryReader::new(doc.to_string());
+        let mut writer = MemoryWriter::new();
+        let params = vec!["r=1:5".to_string()];
+        let stop = Some("r >= 3");
+        handle_sweep(
+            &mut reader,
+            &mut writer,
+            "doc.json",
+            &params,
+            2,
+            false,
+            stop,
+            None,
+            SweepFormat::Csv,
+        )
+        .unwrap();
+        let csv = writer.as_string();
+        let lines: Vec<&str> = csv.lines().collect();
+        assert_eq!(
+            lines[0],
+            "index,r,status,dof,p1.x,p1.y,p1.z,p2.x,p2.y,p2.z,error"
+        );
+        // Stopped at r = 3
+        assert_eq!(lines.len(), 4);
+        assert!(lines[3].starts_with("2,3,ok,"));
+    }
+
+    #[test]
+    fn test_shards_resume_and_merge() {
+        // h places p3, so the sweep over it is rebuilt at each grid point
+        let doc = r#"{
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10, "h": 0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 0]},
+                {"type": "point", "id": "p3", "at": [0, "$h", 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        }"#;
+        let dir = tempfile::tempdir().unwrap();
+        let path = |i: usize| {
+            dir.path()
+                .join(format!("shard{}.jsonl", i))
+                .to_string_lossy()
+                .into_owned()
+        };
+        let params = vec!["h=0:2".to_string(), "r=1:5".to_string()];
+        let run = |i: usize| {
+            let mut reader = MemoryReader::new(doc.to_string());
+            let shard = Shard { index: i, count: 3 };
+            handle_sweep_shard(&mut reader, "doc.json", &params, 2, false, shard, &path(i))
+        };
+        for i in 1..=3 {
+            run(i).unwrap();
+        }
+
+        // Shard 2 stopped part way through a row: running it again
+        // finishes it from there
+        let full = std::fs::read_to_string(path(2)).unwrap();
+        let lines: Vec<&str> = full.lines().collect();
+        assert_eq!(lines.len(), 6);
+        let cut = format!("{}\n{}\n{}", lines[0], lines[1], &lines[2][..10]);
+        std::fs::write(path(2), cut).unwrap();
+        run(2).unwrap();
+        assert_eq!(std::fs::read_to_string(path(2)).unwrap(), full);
+
+        let mut writer = MemoryWriter::new();
+        let paths: Vec<String> = [3, 1, 2].iter().map(|&i| path(i)).collect();
+        handle_sweep_merge(&mut writer, &paths, SweepFormat::Csv).unwrap();
+        let csv = writer.as_string();
+        let lines: Vec<&str> = csv.lines().collect();
+        assert_eq!(lines.len(), 16);
+        for (i, line) in lines[1..].iter().enumerate() {
+            assert!(
+                line.starts_with(&format!("{},{},{},ok,", i, i / 5, i % 5 + 1)),
+                "{}",
+                line
+            );
+        }
+
+        // A missing or unfinished shard, or one of another sweep, won't merge
+        assert!(handle_sweep_merge(&mut writer, &paths[..2], SweepFormat::Csv).is_err());
+        std::fs::write(path(2), lines_of(&path(2), 3)).unwrap();
+        assert!(handle_sweep_merge(&mut writer, &paths, SweepFormat::Csv).is_err());
+        let mut reader = MemoryReader::new(doc.to_string());
+        let other = vec!["h=0:3".to_string(), "r=1:5".to_string()];
+        let shard = Shard { index: 1, count: 3 };
+        assert!(
+            handle_sweep_shard(&mut reader, "doc.json", &other, 1, false, shard, &path(1)).is_err()
+        );
+    }
+
+    #[test]
+    fn test_shards_of_another_document_are_refused() {
+        let doc = |r: f64| {
+            format!(
+                r#"{{
+                    "schema": "slvs-json/1",
+                    "entities": [
+                        {{"type": "point", "id": "p1", "at": [0, 0, 0]}},
+                        {{"type": "point", "id": "p2", "at": [10, 0, 0]}}
+                    ],
+                    "constraints": [
+                        {{"type": "fixed", "entity": "p1"}},
+                        {{"type": "distance", "between": ["p1", "p2"], "value": {}}}
+                    ],
+                    "parameters": {{"h": 0, "a": 1, "b": 2, "c": 3}}
+                }}"#,
+                r
+            )
+        };
+        let dir = tempfile::tempdir().unwrap();
+        let path = |i: usize| {
+            dir.path()
+                .join(format!("shard{}.jsonl", i))
+                .to_string_lossy()
+                .into_owned()
+        };
+        let params = vec!["h=0:3".to_string()];
+        let run = |r: f64, i: usize| {
+            let mut reader = MemoryReader::new(doc(r));
+            let shard = Shard { index: i, count: 2 };
+            handle_sweep_shard(&mut reader, "doc.json", &params, 1, false, shard, &path(i))
+        };
+        run(5.0, 1).unwrap();
+        run(6.0, 2).unwrap();
+
+        // The same parameters and points, but the document was edited
+        assert!(run(6.0, 1).is_err());
+        let mut writer = MemoryWriter::new();
+        assert!(handle_sweep_merge(&mut writer, &[path(1), path(2)], SweepFormat::Csv).is_err());
+
+        // Its own document resumes, however its parameters' map iterates
+        let hash = || document_hash(&serde_json::from_str(&doc(5.0)).unwrap()).unwrap();
+        assert!((0..8).all(|_| hash() == hash()));
+        run(5.0, 1).unwrap();
+    }
+
+    /// The first n lines of a file
+    fn lines_of(path: &str, n: usize) -> String {
+        std::fs::read_to_string(path)
+            .unwrap()
+            .lines()
+            .take(n)
+            .map(|l| format!("{}\n", l))
+            .collect()
+    }
+
+    #[test]
+    fn test_handle_sweep_track_csv() {
+        let doc = r#"{
+            "schema": "slvs-json/1",
+            "parameters": {"a": 30},
+            "entities": [
+                {"type": "point", "id": "o", "at": [0, 0, 0]},
+                {"type": "point", "id": "x", "at": [10, 0, 0]},
+                {"type": "point", "id": "p", "at": [7, -7, 0]},
+                {"type": "line", "id": "l1", "p1": "o", "p2": "x"},
+                {"type": "line", "id": "l2", "p1": "o", "p2": "p"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "o"},
+                {"type": "fixed", "entity": "x"},
+                {"type": "distance", "between": ["o", "p"], "value": 10},
+                {"type": "angle", "between": ["l1", "l2"], "value": "$a"}
+            ]
+        }"#;
+        let mut reader = MemoryReader::new(doc.to_string());
+        let mut writer = MemoryWriter::new();
+        let params = vec!["a=10:170:20".to_string()];
+        let track = Some(TrackSteps::default());
+        handle_sweep(
+            &mut reader,
+            &mut writer,
+            "doc.json",
+            &params,
+            1,
+            false,
+            None,
+            track,
+            SweepFormat::Csv,
+        )
+        .unwrap();
+        let csv = writer.as_string();
+        let lines: Vec<&str> = csv.lines().collect();
+        assert!(lines[0].ends_with(",error,iterations,steps"));
+        assert_eq!(lines.len(), 10);
+        assert!(lines[1..].iter().all(|l| l.contains(",ok,")));
+
+        let mut reader = MemoryReader::new(doc.to_string());
+        let params = vec!["a=10:20".to_string(), "a=1,2".to_string()];
+        let format = SweepFormat::Csv;
+        let result = handle_sweep(
+            &mut reader,
+            &mut writer,
+            "doc.json",
+            &params,
+            1,
+            false,
+            None,
+            track,
+            format,
+        );
+        assert!(result.is_err());
+    }
+}
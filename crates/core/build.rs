@@ -36,7 +36,17 @@ fn main() {
     // System libraries needed by libslvs
     #[cfg(target_os = "linux")]
     {
-        println!("cargo:rustc-link-lib=stdc++");
+        // libstdc++ goes in statically, where the compiler has an archive of
+        // it: loading and relocating the shared one is most of what a one-shot
+        // slvsx spends before main. SLVS_STATIC_STDCXX=0 links the shared one.
+        println!("cargo:rerun-if-env-changed=SLVS_STATIC_STDCXX");
+        match static_libstdcxx_dir() {
+            Some(dir) => {
+                println!("cargo:rustc-link-search=native={}", dir.display());
+                println!("cargo:rustc-link-lib=static=stdc++");
+            }
+            None => println!("cargo:rustc-link-lib=stdc++"),
+        }
         println!("cargo:rustc-link-lib=m");
     }
     
@@ -44,4 +54,25 @@ fn main() {
     {
         println!("cargo:rustc-link-lib=c++");
     }
-}
\ No newline at end of file
+}
+
+/// Where the C++ compiler keeps libstdc++.a, if it has one and it's wanted
+#[cfg(target_os = "linux")]
+fn static_libstdcxx_dir() -> Option<PathBuf> {
+    if env::var("SLVS_STATIC_STDCXX").map_or(false, |v| v == "0") {
+        return None;
+    }
+    let output = cc::Build::new()
+        .cpp(true)
+        .get_compiler()
+        .to_command()
+        .arg("-print-file-name=libstdc++.a")
+        .output()
+        .ok()?;
+    // Without one, the compiler prints the name back as it was given
+    let path = PathBuf::from(String::from_utf8(output.stdout).ok()?.trim());
+    if !path.is_absolute() {
+        return None;
+    }
+    path.parent().map(PathBuf::from)
+}
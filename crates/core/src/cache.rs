@@ -0,0 +1,850 @@
+//! A structural hash of documents, and a cache of solve results keyed by it,
+//! so a document that's been solved before is answered without solving it.
+//!
+//! The hash ignores the order of entities and constraints and what the
+//! entities are called. Every value is evaluated, so an expression hashes
+//! the same as the number it comes to, and quantised to the solver's
+//! tolerance. Entities are told apart by refining their labels with what
+//! they reference and what references them until that stops splitting
+//! them, and each entity's final label is its canonical name: results are
+//! cached under canonical names, and handed back under the asker's ids.
+//! When that leaves two entities with the same label, which happens for a
+//! document with symmetries, the ids go into the hash as well, so only the
+//! same document with its ids unchanged (in any order) hits.
+//!
+//! A second, coarser hash covers only a document's topology: its entities'
+//! and constraints' types, ids and references, in order, with every value
+//! left out. Documents that share it differ only in values, so one's
+//! compiled system can take on another's values and solve it without
+//! validating or building anything.
+//!
+//! Hashes can collide, so each key also carries the canonical form it was
+//! hashed from, and a cache hit is one whose form matches as well.
+
+use crate::compiled::CompiledSystem;
+use crate::expr::ExpressionEvaluator;
+use crate::ir::{InputDocument, ResolvedEntity, SolveResult};
+use serde_json::Value;
+use std::collections::hash_map::DefaultHasher;
+use std::collections::{BTreeMap, HashMap, HashSet};
+use std::hash::{Hash, Hasher};
+use std::sync::{Arc, Mutex};
+
+/// One step of a walk over an entity or constraint, as it's hashed
+#[derive(Debug, Clone, PartialEq, Eq, PartialOrd, Ord, Hash)]
+enum Token {
+    Null,
+    Bool(bool),
+    /// A number, quantised, or any number in a topology
+    Number(i64),
+    Text(String),
+    /// A reference, to the next entity in the shape's refs
+    Ref,
+    Len(usize),
+}
+
+/// What a document's structural hash is taken of: its entities by label,
+/// each with the rest of it and the labels of what it references, then its
+/// constraints the same way, all sorted. Documents with the same form are
+/// the same document up to their ids.
+#[derive(Debug, PartialEq, Eq)]
+struct Form {
+    schema: String,
+    units: String,
+    entities: Vec<(u64, Vec<Token>, Vec<u64>)>,
+    constraints: Vec<(Vec<Token>, Vec<u64>)>,
+}
+
+impl Form {
+    fn tokens(&self) -> usize {
+        let entities: usize = self
+            .entities
+            .iter()
+            .map(|(_, t, r)| t.len() + r.len())
+            .sum();
+        let constraints: usize = self
+            .constraints
+            .iter()
+            .map(|(t, r)| t.len() + r.len())
+            .sum();
+        entities + constraints
+    }
+}
+
+/// A document's structural hash, and each of its entities' canonical name
+#[derive(Debug, Clone, PartialEq)]
+pub struct StructuralKey {
+    pub hash: u64,
+    /// Each entity's id, with its canonical name
+    names: Vec<(String, String)>,
+    form: Arc<Form>,
+}
+
+impl StructuralKey {
+    /// Whether another document's key is for this one's structure, which
+    /// takes their forms and not only their hashes to match
+    pub fn same_structure(&self, other: &StructuralKey) -> bool {
+        self.hash == other.hash && self.form == other.form
+    }
+
+    /// A result under the document's ids, put under its canonical names
+    pub fn canonical(&self, result: &SolveResult) -> SolveResult {
+        let names = self
+            .names
+            .iter()
+            .map(|(id, name)| (id.as_str(), name.as_str()))
+            .collect();
+        renamed(result, &names)
+    }
+
+    /// A result under canonical names, put under the document's ids
+    pub fn restore(&self, result: &SolveResult) -> SolveResult {
+        let names = self
+            .names
+            .iter()
+            .map(|(id, name)| (name.as_str(), id.as_str()))
+            .collect();
+        renamed(result, &names)
+    }
+}
+
+/// A document's topology hash, and the entities and constraints, in order,
+/// it was taken of
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct TopologyKey {
+    pub hash: u64,
+    form: Arc<Vec<Token>>,
+}
+
+/// An entity or constraint with its own id left out, the entities it
+/// references in the order it references them, and the rest, with its hash
+struct Shape {
+    base: u64,
+    tokens: Vec<Token>,
+    refs: Vec<usize>,
+}
+
+fn hash_of<T: Hash>(value: T) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    value.hash(&mut hasher);
+    hasher.finish()
+}
+
+/// What hashing a document's values needs to know
+struct Canon<'a> {
+    ids: HashMap<&'a str, usize>,
+    eval: ExpressionEvaluator,
+    quantum: f64,
+    /// Whether to hash the topology alone: values all hash the same, and
+    /// references hash as the ids they are
+    topology: bool,
+}
+
+impl Canon<'_> {
+    fn number(&self, value: f64) -> Token {
+        match self.topology {
+            true => Token::Number(0),
+            false => Token::Number((value / self.quantum).round() as i64),
+        }
+    }
+
+    fn walk(&self, value: &Value, key: &str, tokens: &mut Vec<Token>, refs: &mut Vec<usize>) {
+        match value {
+            Value::Null => tokens.push(Token::Null),
+            Value::Bool(b) => tokens.push(Token::Bool(*b)),
+            Value::Number(n) => tokens.push(self.number(n.as_f64().unwrap_or(0.0))),
+            Value::String(s) if key == "type" => tokens.push(Token::Text(s.clone())),
+            Value::String(s) => {
+                if let Some(&index) = self.ids.get(s.as_str()) {
+                    tokens.push(Token::Ref);
+                    if self.topology {
+                        tokens.push(Token::Text(s.clone()));
+                    }
+                    refs.push(index);
+                } else if let Ok(v) = self.eval.eval(s) {
+                    tokens.push(self.number(v));
+                } else {
+                    tokens.push(Token::Text(s.clone()));
+                }
+            }
+            Value::Array(items) => {
+                tokens.push(Token::Len(items.len()));
+                for item in items {
+                    self.walk(item, "", tokens, refs);
+                }
+            }
+            Value::Object(fields) => {
+                // Whatever order the map keeps them in
+                let mut keys: Vec<&String> = fields.keys().collect();
+                keys.sort();
+                tokens.push(Token::Len(keys.len()));
+                for k in keys {
+                    tokens.push(Token::Text(k.clone()));
+                    self.walk(&fields[k], k, tokens, refs);
+                }
+            }
+        }
+    }
+
+    /// An entity's or constraint's shape, leaving its id out unless asked
+    fn shape(&self, value: &Value, with_id: bool) -> Shape {
+        let mut tokens = Vec::new();
+        let mut refs = Vec::new();
+        match value {
+            Value::Object(fields) => {
+                // As a name, not as a reference to itself
+                let mut fields = fields.clone();
+                let id = fields.remove("id");
+                if with_id {
+                    tokens.push(match id {
+                        Some(Value::String(id)) => Token::Text(id),
+                        _ => Token::Null,
+                    });
+                }
+                self.walk(&Value::Object(fields), "", &mut tokens, &mut refs);
+            }
+            _ => self.walk(value, "", &mut tokens, &mut refs),
+        }
+        Shape {
+            base: hash_of(&tokens),
+            tokens,
+            refs,
+        }
+    }
+}
+
+fn distinct(labels: &[u64]) -> usize {
+    labels.iter().collect::<HashSet<_>>().len()
+}
+
+/// Hash a document's structure, with its ids in the hash or without,
+/// giving its entities' labels and the form it was hashed from
+fn hash_shapes(
+    doc: &InputDocument,
+    canon: &Canon,
+    with_ids: bool,
+) -> Option<(u64, Vec<u64>, Form)> {
+    let entities = doc
+        .entities
+        .iter()
+        .map(|e| Some(canon.shape(&serde_json::to_value(e).ok()?, with_ids)))
+        .collect::<Option<Vec<_>>>()?;
+    let constraints = doc
+        .constraints
+        .iter()
+        .map(|c| Some(canon.shape(&serde_json::to_value(c).ok()?, false)))
+        .collect::<Option<Vec<_>>>()?;
+
+    // Each entity's label, then each constraint's, with what they reference
+    let of = |shape: &Shape, own: u64, labels: &[u64]| {
+        hash_of((
+            own,
+            shape.refs.iter().map(|&r| labels[r]).collect::<Vec<_>>(),
+        ))
+    };
+    let mut labels: Vec<u64> = entities.iter().map(|s| s.base).collect();
+    for _ in 0..=labels.len() {
+        let mut seen_by = vec![Vec::new(); labels.len()];
+        let mut note = |label: u64, shape: &Shape| {
+            for (position, &r) in shape.refs.iter().enumerate() {
+                seen_by[r].push((label, position));
+            }
+        };
+        for (i, shape) in entities.iter().enumerate() {
+            note(of(shape, labels[i], &labels), shape);
+        }
+        for shape in &constraints {
+            note(of(shape, shape.base, &labels), shape);
+        }
+        let refined: Vec<u64> = entities
+            .iter()
+            .enumerate()
+            .map(|(i, shape)| {
+                seen_by[i].sort_unstable();
+                hash_of((of(shape, labels[i], &labels), &seen_by[i]))
+            })
+            .collect();
+        let split = distinct(&refined) > distinct(&labels);
+        labels = refined;
+        if !split {
+            break;
+        }
+    }
+
+    let mut entity_labels = labels.clone();
+    entity_labels.sort_unstable();
+    let mut constraint_labels: Vec<u64> =
+        constraints.iter().map(|s| of(s, s.base, &labels)).collect();
+    constraint_labels.sort_unstable();
+    let hash = hash_of((&doc.schema, &doc.units, entity_labels, constraint_labels));
+
+    let referenced = |shape: &Shape| shape.refs.iter().map(|&r| labels[r]).collect::<Vec<_>>();
+    let mut form = Form {
+        schema: doc.schema.clone(),
+        units: doc.units.clone(),
+        entities: Vec::with_capacity(entities.len()),
+        constraints: Vec::with_capacity(constraints.len()),
+    };
+    for (shape, &label) in entities.iter().zip(&labels) {
+        form.entities
+            .push((label, shape.tokens.clone(), referenced(shape)));
+    }
+    for shape in &constraints {
+        form.constraints
+            .push((shape.tokens.clone(), referenced(shape)));
+    }
+    form.entities.sort_unstable();
+    form.constraints.sort_unstable();
+    Some((hash, labels, form))
+}
+
+/// A document's structural hash, with its numbers quantised to `quantum`,
+/// or None if it can't be told apart from itself with its entities
+/// swapped, which takes two entities with the same id
+pub fn structural_key(doc: &InputDocument, quantum: f64) -> Option<StructuralKey> {
+    let canon = Canon {
+        ids: doc
+            .entities
+            .iter()
+            .enumerate()
+            .map(|(i, e)| (e.id(), i))
+            .collect(),
+        eval: ExpressionEvaluator::new(doc.parameters.clone()),
+        quantum,
+        topology: false,
+    };
+    let unique = |(_, labels, _): &(u64, Vec<u64>, Form)| distinct(labels) == labels.len();
+    let (hash, labels, form) = Some(hash_shapes(doc, &canon, false)?)
+        .filter(unique)
+        .or_else(|| hash_shapes(doc, &canon, true).filter(unique))?;
+    let names = doc
+        .entities
+        .iter()
+        .zip(labels)
+        .map(|(e, label)| (e.id().to_string(), format!("{:016x}", label)))
+        .collect();
+    Some(StructuralKey {
+        hash,
+        names,
+        form: Arc::new(form),
+    })
+}
+
+/// A hash of a document's topology alone, which stays the same whatever
+/// its values, parameters and expressions (short of an expression becoming
+/// one that can't be evaluated) and changes with anything the validator
+/// checks
+pub fn topology_key(doc: &InputDocument) -> Option<TopologyKey> {
+    let canon = Canon {
+        ids: doc
+            .entities
+            .iter()
+            .enumerate()
+            .map(|(i, e)| (e.id(), i))
+            .collect(),
+        eval: ExpressionEvaluator::new(doc.parameters.clone()),
+        quantum: 1.0,
+        topology: true,
+    };
+    let mut form = vec![
+        Token::Text(doc.schema.clone()),
+        Token::Text(doc.units.clone()),
+        Token::Len(doc.entities.len()),
+    ];
+    for e in &doc.entities {
+        form.append(&mut canon.shape(&serde_json::to_value(e).ok()?, true).tokens);
+    }
+    for c in &doc.constraints {
+        form.append(&mut canon.shape(&serde_json::to_value(c).ok()?, true).tokens);
+    }
+    Some(TopologyKey {
+        hash: hash_of(&form),
+        form: Arc::new(form),
+    })
+}
+
+/// Rename the entities of a result, dropping any that aren't named
+fn renamed(result: &SolveResult, names: &HashMap<&str, &str>) -> SolveResult {
+    let mut result = result.clone();
+    result.entities = result.entities.map(|entities| {
+        entities
+            .into_iter()
+            .filter_map(|(id, e)| names.get(id.as_str()).map(|n| (n.to_string(), e)))
+            .collect()
+    });
+    result
+}
+
+/// Roughly how much memory a result takes
+fn approx_bytes(result: &SolveResult) -> usize {
+    let coordinates = |e: &ResolvedEntity| match e {
+        ResolvedEntity::Point { at } => at.len(),
+        ResolvedEntity::Circle { center, normal, .. } => center.len() + normal.len() + 1,
+        ResolvedEntity::Line { p1, p2 } => p1.len() + p2.len(),
+        ResolvedEntity::Arc {
+            center,
+            start,
+            end,
+            normal,
+        } => center.len() + start.len() + end.len() + normal.len(),
+        ResolvedEntity::Cubic {
+            start,
+            control1,
+            control2,
+            end,
+        } => start.len() + control1.len() + control2.len() + end.len(),
+    };
+    let entities: usize = result
+        .entities
+        .iter()
+        .flatten()
+        .map(|(id, e)| id.len() + 64 + 8 * coordinates(e))
+        .sum();
+    std::mem::size_of::<SolveResult>() + result.status.len() + entities
+}
+
+struct Cached<T> {
+    value: T,
+    bytes: usize,
+    used: u64,
+}
+
+/// Values by hash, with when each was last used
+struct Lru<T> {
+    entries: HashMap<u64, Cached<T>>,
+    /// Each entry's hash, by when it was last used
+    order: BTreeMap<u64, u64>,
+    clock: u64,
+    bytes: usize,
+}
+
+impl<T> Default for Lru<T> {
+    fn default() -> Self {
+        Self {
+            entries: HashMap::new(),
+            order: BTreeMap::new(),
+            clock: 0,
+            bytes: 0,
+        }
+    }
+}
+
+impl<T> Lru<T> {
+    fn touch(&mut self, hash: u64) {
+        self.clock += 1;
+        if let Some(entry) = self.entries.get_mut(&hash) {
+            self.order.remove(&entry.used);
+            entry.used = self.clock;
+            self.order.insert(self.clock, hash);
+        }
+    }
+
+    fn remove(&mut self, hash: u64) -> Option<T> {
+        let entry = self.entries.remove(&hash)?;
+        self.order.remove(&entry.used);
+        self.bytes -= entry.bytes;
+        Some(entry.value)
+    }
+
+    /// Keep a value, then drop the least recently used until there are no
+    /// more than max_entries taking no more than max_bytes
+    fn insert(&mut self, hash: u64, value: T, bytes: usize, max_entries: usize, max_bytes: usize) {
+        self.remove(hash);
+        self.bytes += bytes;
+        self.entries.insert(
+            hash,
+            Cached {
+                value,
+                bytes,
+                used: 0,
+            },
+        );
+        self.touch(hash);
+        while self.entries.len() > max_entries || self.bytes > max_bytes {
+            let Some((_, &oldest)) = self.order.iter().next() else {
+                break;
+            };
+            self.remove(oldest);
+        }
+    }
+}
+
+/// Solve results by their documents' structural hash, each with its
+/// document's form, keeping the most recently used up to a number of
+/// entries and a number of bytes
+pub struct SolveCache {
+    lru: Mutex<Lru<(Arc<Form>, SolveResult)>>,
+    max_entries: usize,
+    max_bytes: usize,
+    quantum: f64,
+}
+
+impl SolveCache {
+    /// A cache quantising documents' numbers to `quantum`, which should be
+    /// the solver's tolerance
+    pub fn new(max_entries: usize, max_bytes: usize, quantum: f64) -> Self {
+        Self {
+            lru: Mutex::new(Lru::default()),
+            max_entries,
+            max_bytes,
+            quantum,
+        }
+    }
+
+    pub fn key(&self, doc: &InputDocument) -> Option<StructuralKey> {
+        structural_key(doc, self.quantum)
+    }
+
+    pub fn len(&self) -> usize {
+        self.lru.lock().map_or(0, |lru| lru.entries.len())
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// The result cached for a document, with its entities under the
+    /// document's ids. One cached for another document whose hash
+    /// collides with this one's isn't it.
+    pub fn get(&self, key: &StructuralKey) -> Option<SolveResult> {
+        let mut lru = self.lru.lock().ok()?;
+        let (form, result) = &lru.entries.get(&key.hash)?.value;
+        if *form != key.form {
+            return None;
+        }
+        let result = key.restore(result);
+        lru.touch(key.hash);
+        Some(result)
+    }
+
+    /// Cache a document's result, unless it has sensitivities, which are
+    /// by parameter name, a profile, which is of that one solve,
+    /// interference or mass properties, which depend on the clearance or
+    /// height asked for, or it's too big to keep
+    pub fn insert(&self, key: &StructuralKey, result: &SolveResult) {
+        if result.sensitivities.is_some()
+            || result.profile.is_some()
+            || result.interference.is_some()
+            || result.mass.is_some()
+            || self.max_entries == 0
+        {
+            return;
+        }
+        let result = key.canonical(result);
+        let bytes = approx_bytes(&result) + key.form.tokens() * std::mem::size_of::<Token>();
+        if bytes > self.max_bytes {
+            return;
+        }
+        if let Ok(mut lru) = self.lru.lock() {
+            let value = (Arc::clone(&key.form), result);
+            lru.insert(key.hash, value, bytes, self.max_entries, self.max_bytes);
+        }
+    }
+}
+
+/// Compiled systems by their documents' topology hash, each with its
+/// topology's form, keeping the most recently used up to a number of them.
+/// A system is taken out to solve with and put back after, so two solves
+/// never share one.
+pub struct SystemCache {
+    lru: Mutex<Lru<(Arc<Vec<Token>>, CompiledSystem)>>,
+    max_entries: usize,
+}
+
+impl SystemCache {
+    pub fn new(max_entries: usize) -> Self {
+        Self {
+            lru: Mutex::new(Lru::default()),
+            max_entries,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.lru.lock().map_or(0, |lru| lru.entries.len())
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Take out the system compiled for a topology, if there is one; one
+    /// compiled for a topology whose hash collides with it is left kept
+    pub fn take(&self, key: &TopologyKey) -> Option<CompiledSystem> {
+        let mut lru = self.lru.lock().ok()?;
+        if lru.entries.get(&key.hash)?.value.0 != key.form {
+            return None;
+        }
+        lru.remove(key.hash).map(|(_, system)| system)
+    }
+
+    /// Keep a system for its topology, for the next document that has it
+    pub fn put(&self, key: &TopologyKey, system: CompiledSystem) {
+        if self.max_entries == 0 {
+            return;
+        }
+        if let Ok(mut lru) = self.lru.lock() {
+            let value = (Arc::clone(&key.form), system);
+            lru.insert(key.hash, value, 0, self.max_entries, usize::MAX);
+        }
+    }
+
+    /// Keep a system unless one is kept for its topology's hash already;
+    /// whether it was kept
+    pub fn put_if_absent(&self, key: &TopologyKey, system: CompiledSystem) -> bool {
+        let Ok(mut lru) = self.lru.lock() else {
+            return false;
+        };
+        if self.max_entries == 0 || lru.entries.contains_key(&key.hash) {
+            return false;
+        }
+        lru.insert(
+            key.hash,
+            (Arc::clone(&key.form), system),
+            0,
+            self.max_entries,
+            usize::MAX,
+        );
+        true
+    }
+
+    /// How many systems are kept at most
+    pub fn capacity(&self) -> usize {
+        self.max_entries
+    }
+
+    /// The documents the kept systems were last built from, by topology,
+    /// least recently used first
+    pub fn documents(&self) -> Vec<(u64, InputDocument)> {
+        let Ok(lru) = self.lru.lock() else {
+            return Vec::new();
+        };
+        lru.order
+            .values()
+            .filter_map(|key| Some((*key, lru.entries.get(key)?.value.1.document().clone())))
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn document(value: Value) -> InputDocument {
+        serde_json::from_value(value).unwrap()
+    }
+
+    /// A triangle: p1 fixed, p2 `r` from it, and p3 on the line through
+    /// them, 5 from p2
+    fn triangle() -> Value {
+        serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10.0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 0]},
+                {"type": "point", "id": "p3", "at": [5, 5, 0]},
+                {"type": "line", "id": "l1", "p1": "p1", "p2": "p2"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"},
+                {"type": "distance", "between": ["p2", "p3"], "value": 5},
+                {"type": "point_on_line", "point": "p3", "line": "l1"}
+            ]
+        })
+    }
+
+    fn key(value: Value) -> StructuralKey {
+        structural_key(&document(value), 1e-6).unwrap()
+    }
+
+    #[test]
+    fn test_hash_ignores_order_and_names() {
+        let renamed = serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "line", "id": "edge", "p1": "a", "p2": "b"},
+                {"type": "point", "id": "c", "at": [5, 5, 0]},
+                {"type": "point", "id": "b", "at": [10, 0, 0]},
+                {"type": "point", "id": "a", "at": [0, 0, 0]}
+            ],
+            "constraints": [
+                {"type": "point_on_line", "point": "c", "line": "edge"},
+                {"type": "distance", "between": ["b", "c"], "value": 5},
+                {"type": "distance", "between": ["a", "b"], "value": 10.0000000001},
+                {"type": "fixed", "entity": "a"}
+            ]
+        });
+        let (a, b) = (key(triangle()), key(renamed));
+        assert_eq!(a.hash, b.hash);
+        let name =
+            |k: &StructuralKey, id: &str| k.names.iter().find(|(i, _)| i == id).unwrap().1.clone();
+        assert_eq!(name(&a, "p1"), name(&b, "a"));
+        assert_eq!(name(&a, "p3"), name(&b, "c"));
+        assert_eq!(name(&a, "l1"), name(&b, "edge"));
+    }
+
+    #[test]
+    fn test_hash_sees_values_and_references() {
+        let base = key(triangle()).hash;
+        let mut moved = triangle();
+        moved["constraints"][2]["value"] = serde_json::json!(5.001);
+        assert_ne!(base, key(moved).hash);
+
+        let mut rewired = triangle();
+        rewired["constraints"][0]["entity"] = serde_json::json!("p3");
+        assert_ne!(base, key(rewired).hash);
+
+        let mut parameter = triangle();
+        parameter["parameters"]["r"] = serde_json::json!(12.0);
+        assert_ne!(base, key(parameter).hash);
+    }
+
+    #[test]
+    fn test_symmetric_documents_keep_their_ids() {
+        let twins = |a: &str, b: &str| {
+            serde_json::json!({
+                "schema": "slvs-json/1",
+                "entities": [
+                    {"type": "point", "id": a, "at": [1, 2, 3]},
+                    {"type": "point", "id": b, "at": [1, 2, 3]}
+                ],
+                "constraints": []
+            })
+        };
+        assert_eq!(key(twins("a", "b")).hash, key(twins("b", "a")).hash);
+        assert_ne!(key(twins("a", "b")).hash, key(twins("a", "c")).hash);
+    }
+
+    fn point_result(ids: &[&str]) -> SolveResult {
+        SolveResult {
+            status: "ok".to_string(),
+            diagnostics: None,
+            entities: Some(
+                ids.iter()
+                    .enumerate()
+                    .map(|(i, id)| {
+                        (
+                            id.to_string(),
+                            ResolvedEntity::Point {
+                                at: vec![i as f64; 3],
+                            },
+                        )
+                    })
+                    .collect(),
+            ),
+            warnings: vec![],
+            sensitivities: None,
+            profile: None,
+            interference: None,
+            mass: None,
+        }
+    }
+
+    #[test]
+    fn test_cache_answers_under_the_askers_ids() {
+        let cache = SolveCache::new(8, 1 << 20, 1e-6);
+        let first = key(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [1, 0, 0]}
+            ],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        }));
+        let second = key(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "far", "at": [1, 0, 0]},
+                {"type": "point", "id": "origin", "at": [0, 0, 0]}
+            ],
+            "constraints": [{"type": "fixed", "entity": "origin"}]
+        }));
+        assert!(cache.get(&second).is_none());
+        cache.insert(&first, &point_result(&["p1", "p2"]));
+
+        let hit = cache.get(&second).unwrap();
+        let entities = hit.entities.unwrap();
+        assert_eq!(
+            entities["origin"],
+            ResolvedEntity::Point { at: vec![0.0; 3] }
+        );
+        assert_eq!(entities["far"], ResolvedEntity::Point { at: vec![1.0; 3] });
+    }
+
+    #[test]
+    fn test_cache_evicts_the_least_recently_used() {
+        let cache = SolveCache::new(2, 1 << 20, 1e-6);
+        let at = |x: f64| {
+            key(serde_json::json!({
+                "schema": "slvs-json/1",
+                "entities": [{"type": "point", "id": "p", "at": [x, 0, 0]}],
+                "constraints": []
+            }))
+        };
+        let (a, b, c) = (at(1.0), at(2.0), at(3.0));
+        cache.insert(&a, &point_result(&["p"]));
+        cache.insert(&b, &point_result(&["p"]));
+        assert!(cache.get(&a).is_some());
+        cache.insert(&c, &point_result(&["p"]));
+        assert_eq!(cache.len(), 2);
+        assert!(cache.get(&a).is_some());
+        assert!(cache.get(&b).is_none());
+
+        // And a result too big for it isn't kept at all
+        let tiny = SolveCache::new(2, 16, 1e-6);
+        tiny.insert(&a, &point_result(&["p"]));
+        assert!(tiny.is_empty());
+    }
+
+    #[test]
+    fn test_colliding_hashes_miss() {
+        let cache = SolveCache::new(8, 1 << 20, 1e-6);
+        let first = key(triangle());
+        cache.insert(&first, &point_result(&["p1", "p2", "p3"]));
+        let mut moved = triangle();
+        moved["constraints"][2]["value"] = serde_json::json!(6);
+        // Another document, made to hash as the first does
+        let mut forged = key(moved);
+        forged.hash = first.hash;
+        assert!(!forged.same_structure(&first));
+        assert!(cache.get(&forged).is_none());
+        assert!(cache.get(&first).is_some());
+
+        let systems = SystemCache::new(4);
+        let topology = topology_key(&document(triangle())).unwrap();
+        let mut rewired = triangle();
+        rewired["constraints"][0]["entity"] = serde_json::json!("p2");
+        let mut forged = topology_key(&document(rewired)).unwrap();
+        forged.hash = topology.hash;
+        let solver = crate::solver::Solver::new(crate::solver::SolverConfig::default());
+        systems.put(&topology, solver.compile(&document(triangle())).unwrap());
+        assert!(systems.take(&forged).is_none());
+        assert!(systems.take(&topology).is_some());
+    }
+
+    #[test]
+    fn test_topology_ignores_values_alone() {
+        let topology = |value: Value| topology_key(&document(value)).unwrap();
+        let base = topology(triangle());
+
+        let mut values = triangle();
+        values["entities"][2]["at"] = serde_json::json!([7, -1, 3]);
+        values["constraints"][2]["value"] = serde_json::json!("$r / 4");
+        values["parameters"]["r"] = serde_json::json!(40.0);
+        assert_eq!(base, topology(values));
+
+        let mut renamed = triangle();
+        renamed["entities"][3]["id"] = serde_json::json!("edge");
+        renamed["constraints"][3]["line"] = serde_json::json!("edge");
+        assert_ne!(base, topology(renamed));
+
+        let mut rewired = triangle();
+        rewired["constraints"][0]["entity"] = serde_json::json!("p2");
+        assert_ne!(base, topology(rewired));
+
+        let mut flagged = triangle();
+        flagged["entities"][0]["preserve"] = serde_json::json!(true);
+        assert_ne!(base, topology(flagged));
+    }
+}
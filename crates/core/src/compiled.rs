@@ -0,0 +1,563 @@
+//! A document built into a native system once and kept, to be solved again
+//! as its parameters change without building it again.
+//!
+//! Changing a parameter re-evaluates the document's expressions into the
+//! records the system was built from, and only the records whose values
+//! that changes are written to the native system: the params of the
+//! entities they made, or their constraints' values. Everything else keeps
+//! the values it was solved to, so each solve starts from the last one's
+//! solution. A change that alters the document's structure instead (an
+//! expression that no longer evaluates the same way to references) builds
+//! the system again.
+//!
+//! The document's expressions are compiled once, the first time they're
+//! recorded, and a parameter that none of them reads changes nothing.
+//!
+//! A point can be dragged as well: moved to where it's wanted and marked
+//! for the solver to keep as near there as the constraints allow, as an
+//! interactive editor does when the user drags it.
+//!
+//! A long solve can report how it's getting on, too, with the residual
+//! after each Newton step, for a client to show while it waits.
+//!
+//! The document can be edited in place, too (see `patch`). Values it
+//! changes are written as a parameter's are; entities and constraints added
+//! after the others are added to the native system as they are, which
+//! solves just the blocks they join along with any that moved. Any other
+//! change to the structure builds the system again.
+
+use crate::error::{Error, Result};
+use crate::expr::ExpressionEvaluator;
+use crate::ffi::{ConstraintRecord, EntityRecord, SolvePhase, Solver as FfiSolver, TraceEvent};
+use crate::ids::EntityIndex;
+use crate::ir::{Entity, ExprOrNumber, InputDocument, SolveResult};
+use crate::select::Selection;
+use crate::solver::{BuiltSystem, Solver, SolverConfig};
+use crate::warm;
+use serde::Serialize;
+use std::ffi::c_void;
+use std::sync::Mutex;
+
+/// Where a solve has got to, as one of its Newton steps ends
+#[derive(Debug, Clone, Copy, PartialEq, Serialize)]
+pub struct Progress {
+    /// The steps taken so far on the set of equations being solved; each
+    /// independent part of the document is solved by itself, and counts
+    /// from 1 again
+    pub iterations: i32,
+    /// The norm of those equations' residuals after this step
+    pub residual: f64,
+    pub equations: i32,
+    pub unknowns: i32,
+}
+
+/// Told of each step of a solve, from whichever thread takes it
+pub type ProgressFn = Box<dyn FnMut(Progress) + Send>;
+
+/// Passes the library's step events on to the `ProgressFn` at user
+unsafe extern "C" fn progress_event(event: *const TraceEvent, user: *mut c_void) {
+    let Some(event) = event.as_ref() else { return };
+    let Some(progress) = (user as *const Mutex<ProgressFn>).as_ref() else {
+        return;
+    };
+    if SolvePhase::from_raw(event.phase) != Some(SolvePhase::NewtonStep) {
+        return;
+    }
+    // A panic mustn't unwind into the library
+    let _ = std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| {
+        if let Ok(mut progress) = progress.lock() {
+            progress(Progress {
+                iterations: event.iterations,
+                residual: event.residual,
+                equations: event.equations,
+                unknowns: event.unknowns,
+            });
+        }
+    }));
+}
+
+/// A document and the native system it's built into, kept between solves
+pub struct CompiledSystem {
+    solver: Solver,
+    doc: InputDocument,
+    /// Evaluates the document's expressions, keeping them compiled
+    eval: ExpressionEvaluator,
+    built: BuiltSystem,
+    /// The records the native system was built from, as last updated
+    entities: Vec<EntityRecord>,
+    constraints: Vec<ConstraintRecord>,
+    /// Whether a parameter has changed since the records were made
+    changed: bool,
+    /// Told of each step of each solve, if anything is; boxed so that the
+    /// library can keep a pointer to it
+    progress: Option<Box<Mutex<ProgressFn>>>,
+}
+
+/// Whether two records are for the same add call, whatever its values
+fn same_entity(a: &EntityRecord, b: &EntityRecord) -> bool {
+    a.kind == b.kind && a.id == b.id && a.arg == b.arg
+}
+
+fn same_constraint(a: &ConstraintRecord, b: &ConstraintRecord) -> bool {
+    a.kind == b.kind && a.id == b.id && a.arg == b.arg
+}
+
+fn ffi_error(e: crate::ffi::FfiError) -> Error {
+    Error::InvalidInput {
+        message: e.to_string(),
+        pointer: None,
+    }
+}
+
+/// A document's records, and where its entities went
+pub(crate) fn record(
+    doc: &InputDocument,
+    eval: &ExpressionEvaluator,
+) -> Result<(Vec<EntityRecord>, Vec<ConstraintRecord>, EntityIndex)> {
+    let mut recorder = FfiSolver::recorder();
+    let index = Solver::add_document(&mut recorder, doc, eval)?;
+    let (entities, constraints) = recorder.take_held();
+    Ok((entities, constraints, index))
+}
+
+impl Solver {
+    /// Build the document into a native system to keep, for solving it
+    /// again and again as its parameters change
+    pub fn compile(&self, doc: &InputDocument) -> Result<CompiledSystem> {
+        let eval = ExpressionEvaluator::new(doc.parameters.clone());
+        let (entities, constraints, index) = record(doc, &eval)?;
+        let built = self.build_from(&entities, &constraints, index)?;
+        Ok(CompiledSystem {
+            solver: Solver::new(self.config().clone()),
+            doc: doc.clone(),
+            eval,
+            built,
+            entities,
+            constraints,
+            changed: false,
+            progress: None,
+        })
+    }
+
+    pub(crate) fn build_from(
+        &self,
+        entities: &[EntityRecord],
+        constraints: &[ConstraintRecord],
+        index: EntityIndex,
+    ) -> Result<BuiltSystem> {
+        let mut ffi_solver = FfiSolver::new();
+        ffi_solver
+            .add_records(entities, constraints)
+            .map_err(ffi_error)?;
+        self.configure(&mut ffi_solver)?;
+        Ok(BuiltSystem {
+            ffi_solver,
+            entities: index,
+        })
+    }
+}
+
+impl CompiledSystem {
+    /// The document, with its parameters as they're set now
+    pub fn document(&self) -> &InputDocument {
+        &self.doc
+    }
+
+    /// Set one of the document's parameters, for the next `resolve`
+    pub fn set_parameter(&mut self, name: &str, value: f64) -> Result<()> {
+        match self.doc.parameters.get_mut(name) {
+            Some(v) => {
+                if v.to_bits() != value.to_bits() {
+                    *v = value;
+                    self.eval.set_parameter(name, value)?;
+                    self.changed |= self.eval.any_reads(name);
+                }
+                Ok(())
+            }
+            None => Err(Error::InvalidInput {
+                message: format!("The document has no parameter '{}'", name),
+                pointer: Some("/parameters".to_string()),
+            }),
+        }
+    }
+
+    /// Drag a point towards `at` ([u, v] of it for a point in a workplane):
+    /// it starts the next solve there, and the solver keeps it as near
+    /// there as the constraints allow. The first drag of a point builds
+    /// the system again, as it changes more than values; after that, the
+    /// point's position is all that changes.
+    pub fn drag(&mut self, id: &str, at: &[f64]) -> Result<()> {
+        let index = self.doc.entities.iter().position(|e| e.id() == id);
+        let (coordinates, preserve) = match index.map(|i| &mut self.doc.entities[i]) {
+            Some(Entity::Point { at, preserve, .. }) => (at, preserve),
+            Some(Entity::Point2D { at, preserve, .. }) => (at, preserve),
+            _ => {
+                return Err(Error::InvalidInput {
+                    message: format!("The document has no point '{}' to drag", id),
+                    pointer: Some("/entities".to_string()),
+                })
+            }
+        };
+        if at.len() < coordinates.len().min(2) {
+            return Err(Error::InvalidInput {
+                message: format!("Point '{}' needs {} coordinates", id, coordinates.len()),
+                pointer: None,
+            });
+        }
+        for (c, &v) in coordinates.iter_mut().zip(at) {
+            *c = ExprOrNumber::Number(v);
+        }
+        *preserve = true;
+        self.changed = true;
+        Ok(())
+    }
+
+    /// Have `f` told where each `resolve` has got to after every Newton
+    /// step it takes, or stop with None
+    pub fn on_progress(&mut self, f: Option<ProgressFn>) {
+        self.progress = f.map(|f| Box::new(Mutex::new(f)));
+        if self.progress.is_none() {
+            let ffi_solver = &mut self.built.ffi_solver;
+            unsafe { ffi_solver.set_trace_callback(None, std::ptr::null_mut()) };
+            ffi_solver.set_trace_steps(false);
+        }
+    }
+
+    /// Point the native system, which may have been built again since, at
+    /// the progress callback, if there is one
+    fn watch(&mut self) {
+        if let Some(progress) = &self.progress {
+            let user = &**progress as *const Mutex<ProgressFn> as *mut c_void;
+            let ffi_solver = &mut self.built.ffi_solver;
+            // Safety: the callback is kept, and not moved, until it's
+            // replaced, which takes &mut self, as does every solve
+            unsafe { ffi_solver.set_trace_callback(Some(progress_event), user) };
+            ffi_solver.set_trace_steps(true);
+        }
+    }
+
+    /// Report just these entities from each `resolve` from now on
+    pub fn select(&mut self, select: Selection) {
+        if self.solver.config().select != select {
+            self.solver = Solver::new(SolverConfig {
+                select,
+                ..self.solver.config().clone()
+            });
+        }
+    }
+
+    /// Take on another document with the same topology as this one (see
+    /// `cache::topology_key`), for `resolve` to solve. Unlike setting
+    /// parameters, every value goes to the native system, so the document
+    /// solves from its own starting point, as it would built from scratch.
+    pub fn load(&mut self, doc: &InputDocument) -> Result<()> {
+        self.doc = doc.clone();
+        self.eval = ExpressionEvaluator::new(doc.parameters.clone());
+        self.rerecord(true, None)
+    }
+
+    /// Edit the document in place with `edit`, which leaves it as it was if
+    /// it fails, and write what changed to the native system for `resolve`
+    /// to solve. If the structure changes such that the system is built
+    /// again, its points and circles start from where `prior` has them (see
+    /// `warm::seed`), if given, rather than from the document's values. If
+    /// the edited document doesn't build, it's kept, and every `resolve`
+    /// tries again until an edit fixes it.
+    pub fn edit<F>(&mut self, edit: F, prior: Option<&SolveResult>) -> Result<()>
+    where
+        F: FnOnce(&mut InputDocument) -> Result<()>,
+    {
+        let parameters = self.doc.parameters.clone();
+        edit(&mut self.doc)?;
+        let same_names = parameters.len() == self.doc.parameters.len()
+            && parameters
+                .keys()
+                .all(|name| self.doc.parameters.contains_key(name));
+        if same_names {
+            for (name, &value) in &self.doc.parameters {
+                if parameters[name].to_bits() != value.to_bits() {
+                    self.eval.set_parameter(name, value)?;
+                }
+            }
+        } else {
+            self.eval = ExpressionEvaluator::new(self.doc.parameters.clone());
+        }
+        self.changed = true;
+        self.rerecord(false, prior)
+    }
+
+    /// Record the document again, and write the records to the native
+    /// system: all of them, or only those that changed, and those added
+    /// after the rest. A record that changed more than its values builds
+    /// the system again, from the document seeded with `prior` if given.
+    fn rerecord(&mut self, all: bool, prior: Option<&SolveResult>) -> Result<()> {
+        let (entities, constraints, index) = record(&self.doc, &self.eval)?;
+        let (n, m) = (self.entities.len(), self.constraints.len());
+        let kept = entities.len() >= n
+            && constraints.len() >= m
+            && entities
+                .iter()
+                .zip(&self.entities)
+                .all(|(a, b)| same_entity(a, b))
+            && constraints
+                .iter()
+                .zip(&self.constraints)
+                .all(|(a, b)| same_constraint(a, b));
+        if kept {
+            let moved: Vec<EntityRecord> = entities
+                .iter()
+                .zip(&self.entities)
+                .filter(|(a, b)| all || a != b)
+                .map(|(a, _)| *a)
+                .collect();
+            let reset: Vec<ConstraintRecord> = constraints
+                .iter()
+                .zip(&self.constraints)
+                .filter(|(a, b)| all || a != b)
+                .map(|(a, _)| *a)
+                .collect();
+            let ffi_solver = &mut self.built.ffi_solver;
+            ffi_solver
+                .update_records(&moved, &reset)
+                .map_err(ffi_error)?;
+            if entities.len() > n || constraints.len() > m {
+                ffi_solver
+                    .add_records(&entities[n..], &constraints[m..])
+                    .map_err(ffi_error)?;
+                self.built.entities = index;
+            }
+        } else if let Some(prior) = prior {
+            // Built from the seeded document, but compared from now on as
+            // recorded from the document itself, so that the next edit
+            // writes only what it changes
+            let mut seeded = self.doc.clone();
+            warm::seed(&mut seeded, prior);
+            let (e, c, index) = record(&seeded, &self.eval)?;
+            self.built = self.solver.build_from(&e, &c, index)?;
+        } else {
+            self.built = self.solver.build_from(&entities, &constraints, index)?;
+        }
+        self.entities = entities;
+        self.constraints = constraints;
+        self.changed = false;
+        Ok(())
+    }
+
+    /// Solve the document with its parameters as they're set now, starting
+    /// from the last solution, having written just what the parameters
+    /// changed since then to the native system
+    pub fn resolve(&mut self) -> Result<SolveResult> {
+        let start = std::time::Instant::now();
+        if self.changed {
+            self.rerecord(false, None)?;
+        }
+        self.watch();
+        self.solver
+            .solve_built(&self.doc, &self.eval, &mut self.built, start)
+    }
+
+    /// Solve as `resolve` does, but write just where each entity went to
+    /// `out`, four values per entity in document order: `[x, y, z, 0]` for
+    /// a point, `[cx, cy, cz, radius]` for a circle, and NaNs for the rest,
+    /// which are made of those. Nothing is allocated for a result, for
+    /// callers that solve many times a second.
+    pub fn resolve_positions(&mut self, out: &mut Vec<f64>) -> Result<()> {
+        if self.changed {
+            self.rerecord(false, None)?;
+        }
+        self.watch();
+        self.solver.solve_positions(&self.doc, &mut self.built, out)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ir::ResolvedEntity;
+    use crate::solver::SolverConfig;
+
+    /// p2 sits `r` from the fixed p1, and p3 is fixed at (0, h, 0)
+    fn document() -> InputDocument {
+        serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10.0, "h": 5.0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 1, 0]},
+                {"type": "point", "id": "p3", "at": [0, "$h", 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "fixed", "entity": "p3"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        }))
+        .unwrap()
+    }
+
+    fn at(result: &SolveResult, id: &str) -> Vec<f64> {
+        match &result.entities.as_ref().unwrap()[id] {
+            ResolvedEntity::Point { at } => at.clone(),
+            other => panic!("{} isn't a point: {:?}", id, other),
+        }
+    }
+
+    #[test]
+    fn test_resolve_matches_solving_from_scratch() {
+        let solver = Solver::new(SolverConfig::default());
+        let mut doc = document();
+        let mut compiled = solver.compile(&doc).unwrap();
+        compiled.resolve().unwrap();
+
+        compiled.set_parameter("r", 25.0).unwrap();
+        compiled.set_parameter("h", -3.0).unwrap();
+        let resolved = compiled.resolve().unwrap();
+        doc.parameters.insert("r".to_string(), 25.0);
+        doc.parameters.insert("h".to_string(), -3.0);
+        let fresh = solver.solve(&doc).unwrap();
+
+        let p2 = at(&resolved, "p2");
+        assert!((p2.iter().map(|c| c * c).sum::<f64>().sqrt() - 25.0).abs() < 1e-6);
+        assert_eq!(at(&resolved, "p3"), at(&fresh, "p3"));
+        assert_eq!(at(&resolved, "p3"), vec![0.0, -3.0, 0.0]);
+    }
+
+    #[test]
+    fn test_resolve_without_changes_keeps_the_solution() {
+        let solver = Solver::new(SolverConfig::default());
+        let mut compiled = solver.compile(&document()).unwrap();
+        let first = compiled.resolve().unwrap();
+        compiled.set_parameter("r", 10.0).unwrap();
+        let second = compiled.resolve().unwrap();
+        assert_eq!(at(&first, "p2"), at(&second, "p2"));
+        assert!(second.diagnostics.unwrap().iters <= first.diagnostics.unwrap().iters);
+    }
+
+    #[test]
+    fn test_progress_reports_each_step() {
+        use std::sync::{Arc, Mutex};
+        let solver = Solver::new(SolverConfig::default());
+        let mut compiled = solver.compile(&document()).unwrap();
+        let steps = Arc::new(Mutex::new(Vec::new()));
+        let seen = Arc::clone(&steps);
+        compiled.on_progress(Some(Box::new(move |p| seen.lock().unwrap().push(p))));
+
+        compiled.set_parameter("r", 25.0).unwrap();
+        compiled.resolve().unwrap();
+        let taken = steps.lock().unwrap().clone();
+        assert!(!taken.is_empty());
+        assert_eq!(taken[0].iterations, 1);
+        assert!(taken.last().unwrap().residual < 1e-6);
+
+        // Stopped, nothing more is told
+        compiled.on_progress(None);
+        compiled.set_parameter("r", 5.0).unwrap();
+        compiled.resolve().unwrap();
+        assert_eq!(steps.lock().unwrap().len(), taken.len());
+    }
+
+    #[test]
+    fn test_drag_moves_a_point_towards_its_target() {
+        let solver = Solver::new(SolverConfig::default());
+        let mut compiled = solver.compile(&document()).unwrap();
+        let mut positions = Vec::new();
+        compiled.resolve_positions(&mut positions).unwrap();
+        assert_eq!(positions.len(), 3 * 4);
+
+        // p2 stays 10 from p1, on the way to where it's dragged
+        for target in [[0.0, 20.0, 0.0], [-20.0, 0.0, 0.0]] {
+            compiled.drag("p2", &target).unwrap();
+            compiled.resolve_positions(&mut positions).unwrap();
+            let p2 = &positions[4..7];
+            assert!((p2.iter().map(|c| c * c).sum::<f64>().sqrt() - 10.0).abs() < 1e-6);
+            assert!((p2[0] - target[0] / 2.0).abs() < 1e-6, "{:?}", p2);
+            assert!((p2[1] - target[1] / 2.0).abs() < 1e-6, "{:?}", p2);
+        }
+        assert!(compiled.drag("nope", &[0.0, 0.0, 0.0]).is_err());
+    }
+
+    #[test]
+    fn test_set_parameter_needs_a_known_name() {
+        let solver = Solver::new(SolverConfig::default());
+        let mut compiled = solver.compile(&document()).unwrap();
+        let err = compiled.set_parameter("nope", 1.0).unwrap_err();
+        assert!(err.to_string().contains("nope"));
+    }
+
+    #[test]
+    fn test_load_solves_like_a_fresh_build() {
+        let solver = Solver::new(SolverConfig::default());
+        let mut compiled = solver.compile(&document()).unwrap();
+        compiled.resolve().unwrap();
+
+        // The same topology, with other values and no parameters
+        let other: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [1, 1, 0]},
+                {"type": "point", "id": "p2", "at": [-4, 2, 0]},
+                {"type": "point", "id": "p3", "at": [0, 7, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "fixed", "entity": "p3"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 3}
+            ]
+        }))
+        .unwrap();
+        assert_eq!(
+            crate::cache::topology_key(&other),
+            crate::cache::topology_key(&document())
+        );
+        compiled.load(&other).unwrap();
+        let loaded = compiled.resolve().unwrap();
+        let fresh = solver.solve(&other).unwrap();
+        for id in ["p1", "p2", "p3"] {
+            assert_eq!(at(&loaded, id), at(&fresh, id));
+        }
+    }
+
+    #[test]
+    fn test_edit_adds_to_the_system_and_rebuilds_warm() {
+        let solver = Solver::new(SolverConfig::default());
+        let mut compiled = solver.compile(&document()).unwrap();
+        let first = compiled.resolve().unwrap();
+
+        // p4 is added 2 from p3; p2, in a block of its own, stays put
+        let add = |doc: &mut InputDocument| {
+            let more: InputDocument = serde_json::from_value(serde_json::json!({
+                "schema": "slvs-json/1",
+                "entities": [{"type": "point", "id": "p4", "at": [1, 5, 0]}],
+                "constraints": [{"type": "distance", "between": ["p3", "p4"], "value": 2}]
+            }))
+            .unwrap();
+            doc.entities.extend(more.entities);
+            doc.constraints.extend(more.constraints);
+            Ok(())
+        };
+        compiled.edit(add, None).unwrap();
+        let added = compiled.resolve().unwrap();
+        assert_eq!(at(&added, "p2"), at(&first, "p2"));
+        let (p3, p4) = (at(&added, "p3"), at(&added, "p4"));
+        let d: f64 = p3.iter().zip(&p4).map(|(a, b)| (a - b) * (a - b)).sum();
+        assert!((d.sqrt() - 2.0).abs() < 1e-6);
+
+        // Taking p3's fixed away builds the system again, from the solution
+        let unfix = |doc: &mut InputDocument| {
+            doc.constraints.remove(1);
+            Ok(())
+        };
+        compiled.edit(unfix, Some(&added)).unwrap();
+        let rebuilt = compiled.resolve().unwrap();
+        for id in ["p2", "p4"] {
+            for (a, b) in at(&rebuilt, id).iter().zip(at(&added, id)) {
+                assert!((a - b).abs() < 1e-9, "{} moved", id);
+            }
+        }
+
+        // A failed edit changes nothing
+        let fail = |_: &mut InputDocument| Err(Error::Ffi("no".to_string()));
+        assert!(compiled.edit(fail, None).is_err());
+        assert_eq!(compiled.document().constraints.len(), 3);
+    }
+}
@@ -3,9 +3,10 @@
 // This module uses Rust's type system to enforce that every constraint
 // type defined in ir.rs has a corresponding FFI implementation.
 
-use crate::ir::Constraint;
-use crate::ffi::Solver as FfiSolver;
 use crate::expr::ExpressionEvaluator;
+use crate::ffi::Solver as FfiSolver;
+use crate::ids::EntityIndex;
+use crate::ir::Constraint;
 
 /// Trait that all constraints must implement to prove they have FFI support
 pub trait HasFfiImplementation {
@@ -14,7 +15,7 @@ pub trait HasFfiImplementation {
         &self,
         solver: &mut FfiSolver,
         constraint_id: i32,
-        entity_id_map: &std::collections::HashMap<String, i32>,
+        entity_id_map: &EntityIndex,
     ) -> Result<(), String>;
 }
 
@@ -37,22 +38,22 @@ impl ConstraintRegistry {
         constraint: &Constraint,
         solver: &mut FfiSolver,
         constraint_id: i32,
-        entity_id_map: &std::collections::HashMap<String, i32>,
+        entity_id_map: &EntityIndex,
         evaluator: &ExpressionEvaluator,
     ) -> Result<(), String> {
         match constraint {
             Constraint::Fixed { entity, workplane } => {
-                let entity_id = entity_id_map.get(entity).copied().unwrap_or(0);
+                let entity_id = entity_id_map.get(entity).unwrap_or(0);
                 let workplane_id = workplane
                     .as_ref()
-                    .and_then(|wp| entity_id_map.get(wp).copied())
+                    .and_then(|wp| entity_id_map.get(wp))
                     .unwrap_or(0); // 0 means 3D (FREE_IN_3D)
                 solver.add_fixed_constraint(constraint_id, entity_id, workplane_id)
             }
             Constraint::Distance { between, value } => {
                 if between.len() == 2 {
-                    let id1 = entity_id_map.get(&between[0]).copied().unwrap_or(0);
-                    let id2 = entity_id_map.get(&between[1]).copied().unwrap_or(0);
+                    let id1 = entity_id_map.get(&between[0]).unwrap_or(0);
+                    let id2 = entity_id_map.get(&between[1]).unwrap_or(0);
                     let dist = match value {
                         crate::ir::ExprOrNumber::Number(n) => *n,
                         crate::ir::ExprOrNumber::Expression(e) => {
@@ -66,8 +67,8 @@ impl ConstraintRegistry {
             }
             Constraint::Angle { between, value } => {
                 if between.len() == 2 {
-                    let line1_id = entity_id_map.get(&between[0]).copied().unwrap_or(0);
-                    let line2_id = entity_id_map.get(&between[1]).copied().unwrap_or(0);
+                    let line1_id = entity_id_map.get(&between[0]).unwrap_or(0);
+                    let line2_id = entity_id_map.get(&between[1]).unwrap_or(0);
                     let angle = match value {
                         crate::ir::ExprOrNumber::Number(n) => *n,
                         crate::ir::ExprOrNumber::Expression(e) => {
@@ -84,8 +85,8 @@ impl ConstraintRegistry {
                 match data {
                     crate::ir::CoincidentData::PointOnLine { at, of } => {
                         if of.len() == 1 {
-                            let point_id = entity_id_map.get(at).copied().unwrap_or(0);
-                            let line_id = entity_id_map.get(&of[0]).copied().unwrap_or(0);
+                            let point_id = entity_id_map.get(at).unwrap_or(0);
+                            let line_id = entity_id_map.get(&of[0]).unwrap_or(0);
                             // For coincident PointOnLine, use FREE_IN_3D (None) for backwards compatibility
                             solver.add_point_on_line_constraint(constraint_id, point_id, line_id, None)
                         } else {
@@ -95,8 +96,8 @@ impl ConstraintRegistry {
                     crate::ir::CoincidentData::TwoEntities { entities } => {
                         if entities.len() == 2 {
                             // For point-to-point coincident, use distance constraint of 0
-                            let id1 = entity_id_map.get(&entities[0]).copied().unwrap_or(0);
-                            let id2 = entity_id_map.get(&entities[1]).copied().unwrap_or(0);
+                            let id1 = entity_id_map.get(&entities[0]).unwrap_or(0);
+                            let id2 = entity_id_map.get(&entities[1]).unwrap_or(0);
                             solver.add_distance_constraint(constraint_id, id1, id2, 0.0)
                         } else {
                             Err("Coincident constraint requires exactly 2 entities".to_string())
@@ -105,28 +106,28 @@ impl ConstraintRegistry {
                 }
             }
             Constraint::Perpendicular { a, b } => {
-                let line1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let line2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let line1_id = entity_id_map.get(a).unwrap_or(0);
+                let line2_id = entity_id_map.get(b).unwrap_or(0);
                 solver.add_perpendicular_constraint(constraint_id, line1_id, line2_id)
             }
             Constraint::Parallel { entities } => {
                 if entities.len() == 2 {
-                    let line1_id = entity_id_map.get(&entities[0]).copied().unwrap_or(0);
-                    let line2_id = entity_id_map.get(&entities[1]).copied().unwrap_or(0);
+                    let line1_id = entity_id_map.get(&entities[0]).unwrap_or(0);
+                    let line2_id = entity_id_map.get(&entities[1]).unwrap_or(0);
                     solver.add_parallel_constraint(constraint_id, line1_id, line2_id)
                 } else {
                     Err("Parallel constraint requires exactly 2 entities".to_string())
                 }
             }
             Constraint::Horizontal { a, workplane } => {
-                let line_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let workplane_id = entity_id_map.get(workplane).copied().unwrap_or(0);
+                let line_id = entity_id_map.get(a).unwrap_or(0);
+                let workplane_id = entity_id_map.get(workplane).unwrap_or(0);
                 solver.add_horizontal_constraint(constraint_id, line_id, workplane_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::Vertical { a, workplane } => {
-                let line_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let workplane_id = entity_id_map.get(workplane).copied().unwrap_or(0);
+                let line_id = entity_id_map.get(a).unwrap_or(0);
+                let workplane_id = entity_id_map.get(workplane).unwrap_or(0);
                 solver.add_vertical_constraint(constraint_id, line_id, workplane_id)
                     .map_err(|e| e.to_string())
             }
@@ -136,13 +137,13 @@ impl ConstraintRegistry {
                 }
                 // Create pairwise constraints: entity[0] with each of entity[1..n]
                 // This ensures all entities have equal length
-                let base_line_id = entity_id_map.get(&entities[0]).copied().unwrap_or(0);
+                let base_line_id = entity_id_map.get(&entities[0]).unwrap_or(0);
                 let workplane_id = workplane
                     .as_ref()
-                    .and_then(|wp| entity_id_map.get(wp).copied())
+                    .and_then(|wp| entity_id_map.get(wp))
                     .unwrap_or(0); // 0 means 3D (FREE_IN_3D)
                 for (idx, entity_id_str) in entities.iter().skip(1).enumerate() {
-                    let other_line_id = entity_id_map.get(entity_id_str).copied().unwrap_or(0);
+                    let other_line_id = entity_id_map.get(entity_id_str).unwrap_or(0);
                     // Use constraint_id + idx to create unique constraint IDs
                     solver.add_equal_length_constraint(constraint_id + idx as i32, base_line_id, other_line_id, workplane_id)
                         .map_err(|e| e.to_string())?;
@@ -150,57 +151,57 @@ impl ConstraintRegistry {
                 Ok(())
             }
             Constraint::EqualRadius { a, b } => {
-                let circle1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let circle2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let circle1_id = entity_id_map.get(a).unwrap_or(0);
+                let circle2_id = entity_id_map.get(b).unwrap_or(0);
                 solver.add_equal_radius_constraint(constraint_id, circle1_id, circle2_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::Tangent { a, b } => {
-                let entity1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let entity2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let entity1_id = entity_id_map.get(a).unwrap_or(0);
+                let entity2_id = entity_id_map.get(b).unwrap_or(0);
                 solver.add_tangent_constraint(constraint_id, entity1_id, entity2_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::PointOnLine { point, line, workplane } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let line_id = entity_id_map.get(line).copied().unwrap_or(0);
-                let workplane_id = workplane.as_ref().and_then(|wp| entity_id_map.get(wp).copied());
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let line_id = entity_id_map.get(line).unwrap_or(0);
+                let workplane_id = workplane.as_ref().and_then(|wp| entity_id_map.get(wp));
                 solver.add_point_on_line_constraint(constraint_id, point_id, line_id, workplane_id)
             }
             Constraint::PointOnCircle { point, circle } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let circle_id = entity_id_map.get(circle).copied().unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let circle_id = entity_id_map.get(circle).unwrap_or(0);
                 solver.add_point_on_circle_constraint(constraint_id, point_id, circle_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::Symmetric { a, b, about } => {
-                let entity1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let entity2_id = entity_id_map.get(b).copied().unwrap_or(0);
-                let line_id = entity_id_map.get(about).copied().unwrap_or(0);
+                let entity1_id = entity_id_map.get(a).unwrap_or(0);
+                let entity2_id = entity_id_map.get(b).unwrap_or(0);
+                let line_id = entity_id_map.get(about).unwrap_or(0);
                 solver.add_symmetric_constraint(constraint_id, entity1_id, entity2_id, line_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::Midpoint { point, of } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let line_id = entity_id_map.get(of).copied().unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let line_id = entity_id_map.get(of).unwrap_or(0);
                 solver.add_midpoint_constraint(constraint_id, point_id, line_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::PointInPlane { point, plane } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let plane_id = entity_id_map.get(plane).copied().unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let plane_id = entity_id_map.get(plane).unwrap_or(0);
                 solver.add_point_in_plane_constraint(constraint_id, point_id, plane_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::Dragged { point, workplane } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let workplane_id = workplane.as_ref().and_then(|wp| entity_id_map.get(wp).copied());
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let workplane_id = workplane.as_ref().and_then(|wp| entity_id_map.get(wp));
                 solver.add_where_dragged_constraint(constraint_id, point_id, workplane_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::PointPlaneDistance { point, plane, value } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let plane_id = entity_id_map.get(plane).copied().unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let plane_id = entity_id_map.get(plane).unwrap_or(0);
                 let distance = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -211,8 +212,8 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::PointLineDistance { point, line, value } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let line_id = entity_id_map.get(line).copied().unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let line_id = entity_id_map.get(line).unwrap_or(0);
                 let distance = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -223,8 +224,8 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::LengthRatio { a, b, value } => {
-                let line1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let line2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let line1_id = entity_id_map.get(a).unwrap_or(0);
+                let line2_id = entity_id_map.get(b).unwrap_or(0);
                 let ratio = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -238,29 +239,29 @@ impl ConstraintRegistry {
                 if lines.len() != 4 {
                     return Err("EqualAngle constraint requires exactly 4 lines".to_string());
                 }
-                let line1_id = entity_id_map.get(&lines[0]).copied().unwrap_or(0);
-                let line2_id = entity_id_map.get(&lines[1]).copied().unwrap_or(0);
-                let line3_id = entity_id_map.get(&lines[2]).copied().unwrap_or(0);
-                let line4_id = entity_id_map.get(&lines[3]).copied().unwrap_or(0);
+                let line1_id = entity_id_map.get(&lines[0]).unwrap_or(0);
+                let line2_id = entity_id_map.get(&lines[1]).unwrap_or(0);
+                let line3_id = entity_id_map.get(&lines[2]).unwrap_or(0);
+                let line4_id = entity_id_map.get(&lines[3]).unwrap_or(0);
                 solver.add_equal_angle_constraint(constraint_id, line1_id, line2_id, line3_id, line4_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::SymmetricHorizontal { a, b, workplane } => {
-                let entity1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let entity2_id = entity_id_map.get(b).copied().unwrap_or(0);
-                let workplane_id = entity_id_map.get(workplane).copied().unwrap_or(0);
+                let entity1_id = entity_id_map.get(a).unwrap_or(0);
+                let entity2_id = entity_id_map.get(b).unwrap_or(0);
+                let workplane_id = entity_id_map.get(workplane).unwrap_or(0);
                 solver.add_symmetric_horizontal_constraint(constraint_id, entity1_id, entity2_id, workplane_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::SymmetricVertical { a, b, workplane } => {
-                let entity1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let entity2_id = entity_id_map.get(b).copied().unwrap_or(0);
-                let workplane_id = entity_id_map.get(workplane).copied().unwrap_or(0);
+                let entity1_id = entity_id_map.get(a).unwrap_or(0);
+                let entity2_id = entity_id_map.get(b).unwrap_or(0);
+                let workplane_id = entity_id_map.get(workplane).unwrap_or(0);
                 solver.add_symmetric_vertical_constraint(constraint_id, entity1_id, entity2_id, workplane_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::Diameter { circle, value } => {
-                let circle_id = entity_id_map.get(circle).copied().unwrap_or(0);
+                let circle_id = entity_id_map.get(circle).unwrap_or(0);
                 let diameter = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -271,15 +272,15 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::SameOrientation { a, b } => {
-                let entity1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let entity2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let entity1_id = entity_id_map.get(a).unwrap_or(0);
+                let entity2_id = entity_id_map.get(b).unwrap_or(0);
                 solver.add_same_orientation_constraint(constraint_id, entity1_id, entity2_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::ProjectedPointDistance { a, b, plane, value } => {
-                let point1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let point2_id = entity_id_map.get(b).copied().unwrap_or(0);
-                let plane_id = entity_id_map.get(plane).copied().unwrap_or(0);
+                let point1_id = entity_id_map.get(a).unwrap_or(0);
+                let point2_id = entity_id_map.get(b).unwrap_or(0);
+                let plane_id = entity_id_map.get(plane).unwrap_or(0);
                 let distance = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -290,8 +291,8 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::LengthDifference { a, b, value } => {
-                let line1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let line2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let line1_id = entity_id_map.get(a).unwrap_or(0);
+                let line2_id = entity_id_map.get(b).unwrap_or(0);
                 let difference = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -302,14 +303,14 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::PointOnFace { point, face } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let face_id = entity_id_map.get(face).copied().unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let face_id = entity_id_map.get(face).unwrap_or(0);
                 solver.add_point_on_face_constraint(constraint_id, point_id, face_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::PointFaceDistance { point, face, value } => {
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let face_id = entity_id_map.get(face).copied().unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let face_id = entity_id_map.get(face).unwrap_or(0);
                 let distance = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -320,35 +321,35 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::EqualLineArcLength { line, arc } => {
-                let line_id = entity_id_map.get(line).copied().unwrap_or(0);
-                let arc_id = entity_id_map.get(arc).copied().unwrap_or(0);
+                let line_id = entity_id_map.get(line).unwrap_or(0);
+                let arc_id = entity_id_map.get(arc).unwrap_or(0);
                 solver.add_equal_line_arc_length_constraint(constraint_id, line_id, arc_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::EqualLengthPointLineDistance { line, point, reference_line } => {
-                let line_id = entity_id_map.get(line).copied().unwrap_or(0);
-                let point_id = entity_id_map.get(point).copied().unwrap_or(0);
-                let ref_line_id = entity_id_map.get(reference_line).copied().unwrap_or(0);
+                let line_id = entity_id_map.get(line).unwrap_or(0);
+                let point_id = entity_id_map.get(point).unwrap_or(0);
+                let ref_line_id = entity_id_map.get(reference_line).unwrap_or(0);
                 solver.add_equal_length_point_line_distance_constraint(constraint_id, line_id, point_id, ref_line_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::EqualPointLineDistances { point1, line1, point2, line2 } => {
-                let point1_id = entity_id_map.get(point1).copied().unwrap_or(0);
-                let line1_id = entity_id_map.get(line1).copied().unwrap_or(0);
-                let point2_id = entity_id_map.get(point2).copied().unwrap_or(0);
-                let line2_id = entity_id_map.get(line2).copied().unwrap_or(0);
+                let point1_id = entity_id_map.get(point1).unwrap_or(0);
+                let line1_id = entity_id_map.get(line1).unwrap_or(0);
+                let point2_id = entity_id_map.get(point2).unwrap_or(0);
+                let line2_id = entity_id_map.get(line2).unwrap_or(0);
                 solver.add_equal_point_line_distances_constraint(constraint_id, point1_id, line1_id, point2_id, line2_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::CubicLineTangent { cubic, line } => {
-                let cubic_id = entity_id_map.get(cubic).copied().unwrap_or(0);
-                let line_id = entity_id_map.get(line).copied().unwrap_or(0);
+                let cubic_id = entity_id_map.get(cubic).unwrap_or(0);
+                let line_id = entity_id_map.get(line).unwrap_or(0);
                 solver.add_cubic_line_tangent_constraint(constraint_id, cubic_id, line_id)
                     .map_err(|e| e.to_string())
             }
             Constraint::ArcArcLengthRatio { a, b, value } => {
-                let arc1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let arc2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let arc1_id = entity_id_map.get(a).unwrap_or(0);
+                let arc2_id = entity_id_map.get(b).unwrap_or(0);
                 let ratio = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -359,8 +360,8 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::ArcLineLengthRatio { arc, line, value } => {
-                let arc_id = entity_id_map.get(arc).copied().unwrap_or(0);
-                let line_id = entity_id_map.get(line).copied().unwrap_or(0);
+                let arc_id = entity_id_map.get(arc).unwrap_or(0);
+                let line_id = entity_id_map.get(line).unwrap_or(0);
                 let ratio = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -371,8 +372,8 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::ArcArcLengthDifference { a, b, value } => {
-                let arc1_id = entity_id_map.get(a).copied().unwrap_or(0);
-                let arc2_id = entity_id_map.get(b).copied().unwrap_or(0);
+                let arc1_id = entity_id_map.get(a).unwrap_or(0);
+                let arc2_id = entity_id_map.get(b).unwrap_or(0);
                 let difference = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -383,8 +384,8 @@ impl ConstraintRegistry {
                     .map_err(|e| e.to_string())
             }
             Constraint::ArcLineLengthDifference { arc, line, value } => {
-                let arc_id = entity_id_map.get(arc).copied().unwrap_or(0);
-                let line_id = entity_id_map.get(line).copied().unwrap_or(0);
+                let arc_id = entity_id_map.get(arc).unwrap_or(0);
+                let line_id = entity_id_map.get(line).unwrap_or(0);
                 let difference = match value {
                     crate::ir::ExprOrNumber::Number(n) => *n,
                     crate::ir::ExprOrNumber::Expression(e) => {
@@ -394,6 +395,51 @@ impl ConstraintRegistry {
                 solver.add_arc_line_length_difference_constraint(constraint_id, arc_id, line_id, difference)
                     .map_err(|e| e.to_string())
             }
+            Constraint::GearMesh {
+                a,
+                b,
+                module,
+                teeth_a,
+                teeth_b,
+                internal,
+            } => {
+                let value = |v: &crate::ir::ExprOrNumber| match v {
+                    crate::ir::ExprOrNumber::Number(n) => *n,
+                    crate::ir::ExprOrNumber::Expression(e) => evaluator.eval(e).unwrap_or(0.0),
+                };
+                let teeth = |v: &crate::ir::ExprOrNumber| {
+                    let n = value(v);
+                    if n >= 1.0 && n.fract() == 0.0 && n <= i32::MAX as f64 {
+                        Ok(n as i32)
+                    } else {
+                        Err(format!(
+                            "GearMesh tooth counts must be whole numbers of at least 1, not {}",
+                            n
+                        ))
+                    }
+                };
+                let (teeth_a, teeth_b) = (teeth(teeth_a)?, teeth(teeth_b)?);
+                if *internal && teeth_b <= teeth_a {
+                    return Err(format!(
+                        "GearMesh ring gear '{}' needs more teeth than the gear '{}' inside it",
+                        b, a
+                    ));
+                }
+                let gear1_id = entity_id_map.get(a).unwrap_or(0);
+                let gear2_id = entity_id_map.get(b).unwrap_or(0);
+                // The library takes a ring gear's teeth as negative
+                let teeth_b = if *internal { -teeth_b } else { teeth_b };
+                solver
+                    .add_gear_mesh_constraint(
+                        constraint_id,
+                        gear1_id,
+                        gear2_id,
+                        teeth_a,
+                        teeth_b,
+                        value(module),
+                    )
+                    .map_err(|e| e.to_string())
+            }
             // ============ CONVENIENCE CONSTRAINTS ============
             // These expand into multiple primitive constraints
             
@@ -405,8 +451,8 @@ impl ConstraintRegistry {
                 }
                 
                 // Get the first two points (they define the implicit line direction)
-                let p1_id = entity_id_map.get(&points[0]).copied().unwrap_or(0);
-                let p2_id = entity_id_map.get(&points[1]).copied().unwrap_or(0);
+                let p1_id = entity_id_map.get(&points[0]).unwrap_or(0);
+                let p2_id = entity_id_map.get(&points[1]).unwrap_or(0);
                 
                 // Create an implicit line entity for the collinear constraint
                 // Use a high offset to avoid ID collisions
@@ -417,7 +463,7 @@ impl ConstraintRegistry {
                 // Add point_on_line constraints for remaining points
                 // For collinear constraint, use FREE_IN_3D (None) since we create a 3D line
                 for (i, point) in points.iter().skip(2).enumerate() {
-                    let point_id = entity_id_map.get(point).copied().unwrap_or(0);
+                    let point_id = entity_id_map.get(point).unwrap_or(0);
                     let sub_constraint_id = constraint_id * 1000 + (i as i32) + 1;
                     solver.add_point_on_line_constraint(sub_constraint_id, point_id, line_id, None)
                         .map_err(|e| e.to_string())?;
@@ -447,8 +493,8 @@ impl ConstraintRegistry {
                 
                 // Add angle constraints between consecutive pairs
                 for i in 0..lines.len() - 1 {
-                    let line1_id = entity_id_map.get(&lines[i]).copied().unwrap_or(0);
-                    let line2_id = entity_id_map.get(&lines[i + 1]).copied().unwrap_or(0);
+                    let line1_id = entity_id_map.get(&lines[i]).unwrap_or(0);
+                    let line2_id = entity_id_map.get(&lines[i + 1]).unwrap_or(0);
                     let sub_constraint_id = constraint_id * 1000 + (i as i32);
                     
                     if let Some(angle_val) = angle {
@@ -458,8 +504,8 @@ impl ConstraintRegistry {
                     } else if i > 0 {
                         // If no angle specified, make this angle equal to the first angle
                         // Use EqualAngle constraint: angle(line0, line1) == angle(lineI, lineI+1)
-                        let line0_id = entity_id_map.get(&lines[0]).copied().unwrap_or(0);
-                        let line1_first_id = entity_id_map.get(&lines[1]).copied().unwrap_or(0);
+                        let line0_id = entity_id_map.get(&lines[0]).unwrap_or(0);
+                        let line1_first_id = entity_id_map.get(&lines[1]).unwrap_or(0);
                         solver.add_equal_angle_constraint(sub_constraint_id, line0_id, line1_first_id, line1_id, line2_id)
                             .map_err(|e| e.to_string())?;
                     }
@@ -517,6 +563,7 @@ impl ConstraintRegistry {
             "ArcLineLengthRatio",
             "ArcArcLengthDifference",
             "ArcLineLengthDifference",
+            "GearMesh",
             "Dragged",
             "Collinear",
             "EqualAngles",
@@ -534,7 +581,7 @@ mod tests {
         // from the process_constraint match statement
         let test_constraint = |c: Constraint| {
             let mut solver = FfiSolver::new();
-            let entity_map = std::collections::HashMap::new();
+            let entity_map = EntityIndex::default();
             let evaluator = ExpressionEvaluator::new(std::collections::HashMap::new());
             let _ = ConstraintRegistry::process_constraint(&c, &mut solver, 1, &entity_map, &evaluator);
         };
@@ -673,15 +720,23 @@ mod tests {
             line: "l1".to_string(),
             value: crate::ir::ExprOrNumber::Number(5.0)
         });
+        test_constraint(Constraint::GearMesh {
+            a: "c1".to_string(),
+            b: "c2".to_string(),
+            module: crate::ir::ExprOrNumber::Number(1.0),
+            teeth_a: crate::ir::ExprOrNumber::Number(24.0),
+            teeth_b: crate::ir::ExprOrNumber::Number(12.0),
+            internal: false,
+        });
         // ... more test cases
     }
 
     #[test]
     fn test_midpoint_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("l1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("l1", 10);
 
         let constraint = Constraint::Midpoint {
             point: "p1".to_string(),
@@ -702,10 +757,10 @@ mod tests {
     #[test]
     fn test_symmetric_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("p2".to_string(), 2);
-        entity_map.insert("l1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("p2", 2);
+        entity_map.push("l1", 10);
 
         let constraint = Constraint::Symmetric {
             a: "p1".to_string(),
@@ -720,9 +775,9 @@ mod tests {
     #[test]
     fn test_point_on_circle_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("c1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("c1", 10);
 
         let constraint = Constraint::PointOnCircle {
             point: "p1".to_string(),
@@ -736,9 +791,9 @@ mod tests {
     #[test]
     fn test_tangent_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("c1".to_string(), 20);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("c1", 20);
 
         let constraint = Constraint::Tangent {
             a: "l1".to_string(),
@@ -752,9 +807,9 @@ mod tests {
     #[test]
     fn test_equal_radius_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("c1".to_string(), 1);
-        entity_map.insert("c2".to_string(), 2);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("c1", 1);
+        entity_map.push("c2", 2);
 
         let constraint = Constraint::EqualRadius {
             a: "c1".to_string(),
@@ -769,10 +824,10 @@ mod tests {
     fn test_equal_length_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
-        entity_map.insert("l3".to_string(), 12);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
+        entity_map.push("l3", 12);
 
         // Test with 2 entities
         let constraint = Constraint::EqualLength {
@@ -807,9 +862,9 @@ mod tests {
     fn test_angle_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
 
         // Test with number value
         let constraint = Constraint::Angle {
@@ -843,9 +898,9 @@ mod tests {
     #[test]
     fn test_point_in_plane_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("wp1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("wp1", 10);
 
         let constraint = Constraint::PointInPlane {
             point: "p1".to_string(),
@@ -860,9 +915,9 @@ mod tests {
     fn test_point_plane_distance_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("wp1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("wp1", 10);
 
         let constraint = Constraint::PointPlaneDistance {
             point: "p1".to_string(),
@@ -878,9 +933,9 @@ mod tests {
     fn test_point_line_distance_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("l1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("l1", 10);
 
         let constraint = Constraint::PointLineDistance {
             point: "p1".to_string(),
@@ -896,9 +951,9 @@ mod tests {
     fn test_length_ratio_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
 
         // Test with number value
         let constraint = Constraint::LengthRatio {
@@ -924,11 +979,11 @@ mod tests {
     #[test]
     fn test_equal_angle_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
-        entity_map.insert("l3".to_string(), 12);
-        entity_map.insert("l4".to_string(), 13);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
+        entity_map.push("l3", 12);
+        entity_map.push("l4", 13);
 
         // Test with correct number of lines
         let constraint = Constraint::EqualAngle {
@@ -951,10 +1006,10 @@ mod tests {
     #[test]
     fn test_symmetric_horizontal_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("p2".to_string(), 2);
-        entity_map.insert("wp1".to_string(), 3);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("p2", 2);
+        entity_map.push("wp1", 3);
 
         let constraint = Constraint::SymmetricHorizontal {
             a: "p1".to_string(),
@@ -969,10 +1024,10 @@ mod tests {
     #[test]
     fn test_symmetric_vertical_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("p2".to_string(), 2);
-        entity_map.insert("wp1".to_string(), 3);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("p2", 2);
+        entity_map.push("wp1", 3);
 
         let constraint = Constraint::SymmetricVertical {
             a: "p1".to_string(),
@@ -988,8 +1043,8 @@ mod tests {
     fn test_diameter_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("c1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("c1", 10);
 
         // Test with number value
         let constraint = Constraint::Diameter {
@@ -1013,9 +1068,9 @@ mod tests {
     #[test]
     fn test_same_orientation_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
 
         let constraint = Constraint::SameOrientation {
             a: "l1".to_string(),
@@ -1030,10 +1085,10 @@ mod tests {
     fn test_projected_point_distance_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("p2".to_string(), 2);
-        entity_map.insert("wp1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("p2", 2);
+        entity_map.push("wp1", 10);
 
         // Test with number value
         let constraint = Constraint::ProjectedPointDistance {
@@ -1062,9 +1117,9 @@ mod tests {
     fn test_length_difference_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
 
         // Test with number value
         let constraint = Constraint::LengthDifference {
@@ -1090,9 +1145,9 @@ mod tests {
     #[test]
     fn test_point_on_face_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("f1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("f1", 10);
 
         let constraint = Constraint::PointOnFace {
             point: "p1".to_string(),
@@ -1108,9 +1163,9 @@ mod tests {
     fn test_point_face_distance_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("f1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("f1", 10);
 
         let constraint = Constraint::PointFaceDistance {
             point: "p1".to_string(),
@@ -1126,9 +1181,9 @@ mod tests {
     #[test]
     fn test_equal_line_arc_length_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("a1".to_string(), 20);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("a1", 20);
 
         let constraint = Constraint::EqualLineArcLength {
             line: "l1".to_string(),
@@ -1142,10 +1197,10 @@ mod tests {
     #[test]
     fn test_equal_length_point_line_distance_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("l2".to_string(), 11);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("p1", 1);
+        entity_map.push("l2", 11);
 
         let constraint = Constraint::EqualLengthPointLineDistance {
             line: "l1".to_string(),
@@ -1160,11 +1215,11 @@ mod tests {
     #[test]
     fn test_equal_point_line_distances_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("p2".to_string(), 2);
-        entity_map.insert("l2".to_string(), 11);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("l1", 10);
+        entity_map.push("p2", 2);
+        entity_map.push("l2", 11);
 
         let constraint = Constraint::EqualPointLineDistances {
             point1: "p1".to_string(),
@@ -1180,9 +1235,9 @@ mod tests {
     #[test]
     fn test_cubic_line_tangent_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("c1".to_string(), 20);
-        entity_map.insert("l1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("c1", 20);
+        entity_map.push("l1", 10);
 
         let constraint = Constraint::CubicLineTangent {
             cubic: "c1".to_string(),
@@ -1198,9 +1253,9 @@ mod tests {
     fn test_arc_arc_length_ratio_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("a1".to_string(), 10);
-        entity_map.insert("a2".to_string(), 20);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("a1", 10);
+        entity_map.push("a2", 20);
 
         let constraint = Constraint::ArcArcLengthRatio {
             a: "a1".to_string(),
@@ -1216,9 +1271,9 @@ mod tests {
     fn test_arc_line_length_ratio_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("a1".to_string(), 10);
-        entity_map.insert("l1".to_string(), 20);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("a1", 10);
+        entity_map.push("l1", 20);
 
         let constraint = Constraint::ArcLineLengthRatio {
             arc: "a1".to_string(),
@@ -1234,9 +1289,9 @@ mod tests {
     fn test_arc_arc_length_difference_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("a1".to_string(), 10);
-        entity_map.insert("a2".to_string(), 20);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("a1", 10);
+        entity_map.push("a2", 20);
 
         let constraint = Constraint::ArcArcLengthDifference {
             a: "a1".to_string(),
@@ -1252,9 +1307,9 @@ mod tests {
     fn test_arc_line_length_difference_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("a1".to_string(), 10);
-        entity_map.insert("l1".to_string(), 20);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("a1", 10);
+        entity_map.push("l1", 20);
 
         let constraint = Constraint::ArcLineLengthDifference {
             arc: "a1".to_string(),
@@ -1266,12 +1321,83 @@ mod tests {
         assert!(result.is_ok(), "ArcLineLengthDifference constraint should process successfully");
     }
 
+    #[test]
+    fn test_gear_mesh_constraint_processing() {
+        use crate::ir::ExprOrNumber;
+        let mut solver = FfiSolver::new();
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("sun", 10);
+        entity_map.push("ring", 20);
+        let evaluator = ExpressionEvaluator::new(std::collections::HashMap::new());
+
+        let constraint = Constraint::GearMesh {
+            a: "sun".to_string(),
+            b: "ring".to_string(),
+            module: ExprOrNumber::Number(2.0),
+            teeth_a: ExprOrNumber::Number(24.0),
+            teeth_b: ExprOrNumber::Expression("72".to_string()),
+            internal: true,
+        };
+        let result = ConstraintRegistry::process_constraint(
+            &constraint,
+            &mut solver,
+            100,
+            &entity_map,
+            &evaluator,
+        );
+        assert!(
+            result.is_ok(),
+            "GearMesh constraint should process successfully"
+        );
+
+        // A ring can't have fewer teeth than the gear inside it, nor a gear
+        // part of a tooth
+        let constraint = Constraint::GearMesh {
+            a: "ring".to_string(),
+            b: "sun".to_string(),
+            module: ExprOrNumber::Number(2.0),
+            teeth_a: ExprOrNumber::Number(72.0),
+            teeth_b: ExprOrNumber::Number(24.0),
+            internal: true,
+        };
+        let result = ConstraintRegistry::process_constraint(
+            &constraint,
+            &mut solver,
+            101,
+            &entity_map,
+            &evaluator,
+        );
+        assert!(
+            result.is_err(),
+            "A ring gear with fewer teeth should be rejected"
+        );
+        let constraint = Constraint::GearMesh {
+            a: "sun".to_string(),
+            b: "ring".to_string(),
+            module: ExprOrNumber::Number(2.0),
+            teeth_a: ExprOrNumber::Number(24.5),
+            teeth_b: ExprOrNumber::Number(12.0),
+            internal: false,
+        };
+        let result = ConstraintRegistry::process_constraint(
+            &constraint,
+            &mut solver,
+            102,
+            &entity_map,
+            &evaluator,
+        );
+        assert!(
+            result.is_err(),
+            "A fractional tooth count should be rejected"
+        );
+    }
+
     #[test]
     fn test_dragged_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("wp1".to_string(), 10);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("wp1", 10);
 
         // Test 3D dragged constraint
         let constraint = Constraint::Dragged {
@@ -1305,11 +1431,11 @@ mod tests {
     #[test]
     fn test_collinear_constraint_processing() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("p2".to_string(), 2);
-        entity_map.insert("p3".to_string(), 3);
-        entity_map.insert("p4".to_string(), 4);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("p2", 2);
+        entity_map.push("p3", 3);
+        entity_map.push("p4", 4);
 
         // Test with 3 points (minimum)
         let constraint = Constraint::Collinear {
@@ -1341,11 +1467,11 @@ mod tests {
     fn test_equal_angles_constraint_processing() {
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
-        entity_map.insert("l3".to_string(), 12);
-        entity_map.insert("l4".to_string(), 13);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
+        entity_map.push("l3", 12);
+        entity_map.push("l4", 13);
 
         // Test with 3 lines (should create equal_angle constraints)
         let constraint = Constraint::EqualAngles {
@@ -1389,9 +1515,9 @@ mod tests {
     #[test]
     fn test_equal_angles_two_lines_no_value_should_error() {
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("l1".to_string(), 10);
-        entity_map.insert("l2".to_string(), 11);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("l1", 10);
+        entity_map.push("l2", 11);
 
         // With 2 lines and no value specified, the constraint is meaningless
         // (there's only one angle, nothing to compare it to)
@@ -1426,8 +1552,8 @@ mod tests {
     fn test_process_constraint_fixed() {
         use crate::ffi::Solver as FfiSolver;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
         
         let constraint = Constraint::Fixed { entity: "p1".to_string(), workplane: None };
         let evaluator = ExpressionEvaluator::new(std::collections::HashMap::new());
@@ -1441,9 +1567,9 @@ mod tests {
         use crate::ffi::Solver as FfiSolver;
         use crate::ir::ExprOrNumber;
         let mut solver = FfiSolver::new();
-        let mut entity_map = std::collections::HashMap::new();
-        entity_map.insert("p1".to_string(), 1);
-        entity_map.insert("p2".to_string(), 2);
+        let mut entity_map = EntityIndex::default();
+        entity_map.push("p1", 1);
+        entity_map.push("p2", 2);
         
         let constraint = Constraint::Distance {
             between: vec!["p1".to_string(), "p2".to_string()],
@@ -1462,7 +1588,7 @@ mod tests {
         use crate::ir::ExprOrNumber;
         use crate::expr::ExpressionEvaluator;
         let mut solver = FfiSolver::new();
-        let entity_map = std::collections::HashMap::new();
+        let entity_map = EntityIndex::default();
         let evaluator = ExpressionEvaluator::new(std::collections::HashMap::new());
         
         // All constraints are now implemented. This test verifies that
@@ -1531,7 +1657,7 @@ mod tests {
         
         for constraint in test_constraints {
             let mut solver = FfiSolver::new();
-            let entity_map = HashMap::new();
+            let entity_map = EntityIndex::default();
             let evaluator = ExpressionEvaluator::new(HashMap::new());
             
             // All these constraints should be processed (not silently ignored)
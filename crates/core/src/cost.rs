@@ -0,0 +1,225 @@
+//! What a document will roughly cost to solve, estimated from its structure
+//! alone, in one pass over its entities and constraints: for deciding
+//! whether to take a request on, and where to run it, before validating or
+//! building anything.
+//!
+//! Entities and constraints are counted for the unknowns and equations
+//! they'll write, and joined by their references into the independent
+//! blocks that the solver will split the system into. The cost is in units
+//! of no particular size, meant only to rank documents and to set limits
+//! against: each block contributes its unknowns to the power 1.5, as
+//! factoring a sparse Jacobian grows faster than its size, and every
+//! equation adds one for writing and evaluating it.
+
+use crate::ids::{EntityKind, IdTable};
+use crate::ir::{CoincidentData, Constraint, Entity, InputDocument, PositionOrRef};
+use serde::Serialize;
+
+/// A document's structure, and what it's estimated to cost
+#[derive(Debug, Clone, Default, PartialEq, Serialize)]
+pub struct Cost {
+    pub entities: usize,
+    pub constraints: usize,
+    /// Unknowns and equations the solver will write, roughly
+    pub unknowns: usize,
+    pub equations: usize,
+    /// Groups of entities that no constraint joins, and the unknowns of
+    /// the largest
+    pub blocks: usize,
+    pub largest_block: usize,
+    pub units: f64,
+}
+
+/// The unknowns an entity adds of its own; lines, arcs and cubics are made
+/// of points counted by themselves, and planes are fixed
+fn unknowns(entity: &Entity) -> usize {
+    match entity {
+        Entity::Point { .. } => 3,
+        Entity::Point2D { .. } => 2,
+        Entity::Circle {
+            center: PositionOrRef::Coordinates(_),
+            ..
+        } => 4,
+        Entity::Circle { .. } => 1,
+        _ => 0,
+    }
+}
+
+/// The equations a constraint writes, roughly: a point fixed, coincident
+/// or placed symmetrically takes one for each coordinate, most others one
+fn equations(constraint: &Constraint) -> usize {
+    let extra = |n: usize| n.saturating_sub(1);
+    match constraint {
+        Constraint::Coincident {
+            data: CoincidentData::TwoEntities { entities },
+        } => 3 * extra(entities.len()),
+        Constraint::Coincident {
+            data: CoincidentData::PointOnLine { of, .. },
+        } => 2 * of.len(),
+        Constraint::Fixed { .. } | Constraint::Symmetric { .. } | Constraint::Midpoint { .. } => 3,
+        Constraint::Dragged { .. } => 0,
+        Constraint::PointOnLine { .. } | Constraint::SameOrientation { .. } => 2,
+        Constraint::Parallel { entities } => 2 * extra(entities.len()),
+        Constraint::EqualLength { entities, .. } => extra(entities.len()),
+        Constraint::Collinear { points } => 2 * points.len().saturating_sub(2),
+        Constraint::EqualAngles { lines, .. } => extra(lines.len() / 2),
+        _ => 1,
+    }
+}
+
+/// Union-find over entity indices
+struct Blocks(Vec<usize>);
+
+impl Blocks {
+    fn find(&mut self, mut i: usize) -> usize {
+        while self.0[i] != i {
+            self.0[i] = self.0[self.0[i]];
+            i = self.0[i];
+        }
+        i
+    }
+
+    fn join(&mut self, a: usize, b: usize) {
+        let (a, b) = (self.find(a), self.find(b));
+        if a != b {
+            self.0[a.max(b)] = a.min(b);
+        }
+    }
+}
+
+/// Estimate what a document will cost to solve. References that don't
+/// resolve are skipped; that's for the validator to report.
+pub fn estimate(doc: &InputDocument) -> Cost {
+    let table = IdTable::new(doc);
+    let mut blocks = Blocks((0..doc.entities.len()).collect());
+    // Planes are fixed, so sketches that share one aren't joined by it
+    let index = |id: &str| match table.kind(id) {
+        Some(EntityKind::Plane) | None => None,
+        Some(_) => table.index(id),
+    };
+
+    // Lines, arcs, cubics and circles are one with their points
+    for (i, entity) in doc.entities.iter().enumerate() {
+        let mut join = |id: &String| {
+            if let Some(j) = index(id) {
+                blocks.join(i, j);
+            }
+        };
+        match entity {
+            Entity::Line { p1, p2, .. } | Entity::Line2D { p1, p2, .. } => {
+                join(p1);
+                join(p2);
+            }
+            Entity::Arc {
+                center, start, end, ..
+            } => [center, start, end].into_iter().for_each(join),
+            Entity::Cubic { control_points, .. } => control_points.iter().for_each(join),
+            Entity::Circle {
+                center: PositionOrRef::Reference(c),
+                ..
+            } => join(c),
+            _ => {}
+        }
+    }
+
+    let mut cost = Cost {
+        entities: doc.entities.len(),
+        constraints: doc.constraints.len(),
+        ..Cost::default()
+    };
+    for constraint in &doc.constraints {
+        cost.equations += equations(constraint);
+        // A fixed entity is a constant, and joins nothing
+        if matches!(constraint, Constraint::Fixed { .. }) {
+            continue;
+        }
+        let mut refs = constraint.refs().filter_map(index);
+        if let Some(first) = refs.next() {
+            refs.for_each(|j| blocks.join(first, j));
+        }
+    }
+
+    let mut block_unknowns = vec![0usize; doc.entities.len()];
+    for (i, entity) in doc.entities.iter().enumerate() {
+        let n = unknowns(entity);
+        cost.unknowns += n;
+        let root = blocks.find(i);
+        block_unknowns[root] += n;
+    }
+    for (i, &n) in block_unknowns.iter().enumerate() {
+        if blocks.find(i) == i && n > 0 {
+            cost.blocks += 1;
+            cost.largest_block = cost.largest_block.max(n);
+            cost.units += (n as f64).powf(1.5);
+        }
+    }
+    cost.units += cost.equations as f64;
+    cost
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+
+    fn doc(value: serde_json::Value) -> InputDocument {
+        serde_json::from_value(value).unwrap()
+    }
+
+    /// n points, each joined to the one before by a line of fixed length
+    fn chain(n: usize) -> InputDocument {
+        let mut entities = vec![];
+        let mut constraints = vec![json!({"type": "fixed", "entity": "p0"})];
+        for i in 0..n {
+            entities.push(json!({"type": "point", "id": format!("p{}", i), "at": [i, 0, 0]}));
+            if i > 0 {
+                let (a, b) = (format!("p{}", i - 1), format!("p{}", i));
+                entities.push(json!({"type": "line", "id": format!("l{}", i), "p1": a, "p2": b}));
+                constraints.push(json!({"type": "distance", "between": [a, b], "value": 1}));
+            }
+        }
+        doc(json!({"schema": "slvs-json/1", "entities": entities, "constraints": constraints}))
+    }
+
+    #[test]
+    fn test_counts_a_chain_as_one_block() {
+        let cost = estimate(&chain(10));
+        assert_eq!(cost.entities, 19);
+        assert_eq!(cost.constraints, 10);
+        assert_eq!(cost.unknowns, 30);
+        assert_eq!(cost.equations, 3 + 9);
+        assert_eq!(cost.blocks, 1);
+        assert_eq!(cost.largest_block, 30);
+        assert!((cost.units - (30f64.powf(1.5) + 12.0)).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_separate_sketches_are_separate_blocks() {
+        let cost = estimate(&doc(json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "plane", "id": "xy", "origin": [0, 0, 0], "normal": [0, 0, 1]},
+                {"type": "point2_d", "id": "a", "at": [0, 0], "workplane": "xy"},
+                {"type": "point2_d", "id": "b", "at": [1, 0], "workplane": "xy"},
+                {"type": "point", "id": "c", "at": [0, 0, 5]},
+                {"type": "circle", "id": "k", "center": "c", "diameter": 2, "normal": [0, 0, 1]}
+            ],
+            "constraints": [
+                {"type": "horizontal", "a": "a", "workplane": "xy"},
+                {"type": "horizontal", "a": "b", "workplane": "xy"},
+                {"type": "diameter", "circle": "k", "value": 3}
+            ]
+        })));
+        // The plane joins nothing; a, b, and c with its circle are apart
+        assert_eq!(cost.blocks, 3);
+        assert_eq!(cost.largest_block, 4);
+        assert_eq!(cost.unknowns, 2 + 2 + 3 + 1);
+    }
+
+    #[test]
+    fn test_cost_grows_faster_than_size() {
+        let small = estimate(&chain(10)).units;
+        let large = estimate(&chain(1000)).units;
+        assert!(large > 100.0 * small);
+    }
+}
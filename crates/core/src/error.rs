@@ -23,6 +23,21 @@ pub enum Error {
     #[error("System is underconstrained (DOF: {dof})")]
     Underconstrained { dof: u32 },
 
+    #[error("System has more unknowns than the solver's limit")]
+    TooManyUnknowns,
+
+    #[error("Solver ran past its time limit")]
+    TimedOut,
+
+    #[error("Solver ran past its memory budget")]
+    ResourceExhausted,
+
+    #[error("Solve was cancelled")]
+    Cancelled,
+
+    #[error("Solve pool is full")]
+    Overloaded,
+
     #[error("Invalid solver system: constraint matrix is singular. This typically means:\n  \
              - Redundant constraints (e.g., distance constraints on both lines + equal_length)\n  \
              - Conflicting 2D/3D constraint workplanes\n  \
@@ -58,6 +73,9 @@ impl Error {
             Error::Underconstrained { .. } => 5,
             Error::Ffi(_) => 6,
             Error::InvalidSystem => 7,
+            Error::TooManyUnknowns => 8,
+            Error::TimedOut => 9,
+            Error::ResourceExhausted => 10,
             _ => 1,
         }
     }
@@ -83,6 +101,9 @@ mod tests {
         assert_eq!(Error::Underconstrained { dof: 3 }.exit_code(), 5);
         assert_eq!(Error::Ffi("test".into()).exit_code(), 6);
         assert_eq!(Error::InvalidSystem.exit_code(), 7);
+        assert_eq!(Error::TooManyUnknowns.exit_code(), 8);
+        assert_eq!(Error::TimedOut.exit_code(), 9);
+        assert_eq!(Error::ResourceExhausted.exit_code(), 10);
         assert_eq!(
             Error::Io(std::io::Error::new(std::io::ErrorKind::NotFound, "test")).exit_code(),
             1
@@ -1,17 +1,186 @@
 use crate::error::{Error, Result};
+use std::cell::RefCell;
 use std::collections::HashMap;
 
-/// Evaluates mathematical expressions with parameter substitution
+/// A function an expression can call, on an angle in degrees for the
+/// trigonometric ones
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Function {
+    Cos,
+    Sin,
+    Tan,
+    Sqrt,
+    Abs,
+}
+
+/// An expression parsed once, to evaluate again and again against the
+/// parameters' values, which it reads by slot
+#[derive(Debug, Clone, PartialEq)]
+pub enum CompiledExpr {
+    Number(f64),
+    Parameter(usize),
+    Add(Box<CompiledExpr>, Box<CompiledExpr>),
+    Sub(Box<CompiledExpr>, Box<CompiledExpr>),
+    Mul(Box<CompiledExpr>, Box<CompiledExpr>),
+    Div(Box<CompiledExpr>, Box<CompiledExpr>),
+    Call(Function, Box<CompiledExpr>),
+}
+
+impl CompiledExpr {
+    /// Evaluate with each parameter's value at its slot in `values`
+    pub fn eval(&self, values: &[f64]) -> Result<f64> {
+        Ok(match self {
+            CompiledExpr::Number(val) => *val,
+            CompiledExpr::Parameter(slot) => values[*slot],
+            CompiledExpr::Add(left, right) => left.eval(values)? + right.eval(values)?,
+            CompiledExpr::Sub(left, right) => left.eval(values)? - right.eval(values)?,
+            CompiledExpr::Mul(left, right) => left.eval(values)? * right.eval(values)?,
+            CompiledExpr::Div(left, right) => {
+                let left_val = left.eval(values)?;
+                let right_val = right.eval(values)?;
+                if right_val == 0.0 {
+                    return Err(Error::ExpressionEval("Division by zero".to_string()));
+                }
+                left_val / right_val
+            }
+            CompiledExpr::Call(func, arg) => {
+                let arg_val = arg.eval(values)?;
+                match func {
+                    Function::Cos => arg_val.to_radians().cos(),
+                    Function::Sin => arg_val.to_radians().sin(),
+                    Function::Tan => arg_val.to_radians().tan(),
+                    Function::Sqrt => arg_val.sqrt(),
+                    Function::Abs => arg_val.abs(),
+                }
+            }
+        })
+    }
+
+    /// Whether the expression reads the parameter at `slot`
+    pub fn reads(&self, slot: usize) -> bool {
+        match self {
+            CompiledExpr::Number(_) => false,
+            CompiledExpr::Parameter(s) => *s == slot,
+            CompiledExpr::Add(left, right)
+            | CompiledExpr::Sub(left, right)
+            | CompiledExpr::Mul(left, right)
+            | CompiledExpr::Div(left, right) => left.reads(slot) || right.reads(slot),
+            CompiledExpr::Call(_, arg) => arg.reads(slot),
+        }
+    }
+
+    /// The expression in the native solver's own syntax, for it to parse
+    /// and evaluate itself, reading the parameter at each slot from the
+    /// native param `handles[slot]`; None if a number in it isn't finite,
+    /// which that syntax has no way to write. Its sin and cos take degrees
+    /// as these do, and tan and abs are written in terms of those.
+    pub fn to_native(&self, handles: &[i32]) -> Option<String> {
+        let binary = |op: &str, left: &CompiledExpr, right: &CompiledExpr| {
+            Some(format!(
+                "({} {} {})",
+                left.to_native(handles)?,
+                op,
+                right.to_native(handles)?
+            ))
+        };
+        match self {
+            CompiledExpr::Number(val) if val.is_finite() => Some(format!("({})", val)),
+            CompiledExpr::Number(_) => None,
+            CompiledExpr::Parameter(slot) => Some(format!("${}", handles.get(*slot)?)),
+            CompiledExpr::Add(left, right) => binary("+", left, right),
+            CompiledExpr::Sub(left, right) => binary("-", left, right),
+            CompiledExpr::Mul(left, right) => binary("*", left, right),
+            CompiledExpr::Div(left, right) => binary("/", left, right),
+            CompiledExpr::Call(func, arg) => {
+                let arg = arg.to_native(handles)?;
+                Some(match func {
+                    Function::Cos => format!("cos({})", arg),
+                    Function::Sin => format!("sin({})", arg),
+                    Function::Tan => format!("(sin({}) / cos({}))", arg, arg),
+                    Function::Sqrt => format!("sqrt({})", arg),
+                    Function::Abs => format!("sqrt(square({}))", arg),
+                })
+            }
+        }
+    }
+}
+
+/// Evaluates mathematical expressions with parameter substitution.
+///
+/// Each expression is compiled the first time it's evaluated and kept, so
+/// evaluating it again, with the same parameter values or after
+/// `set_parameter`, doesn't parse it again.
 pub struct ExpressionEvaluator {
-    parameters: HashMap<String, f64>,
+    /// Each parameter's slot in `values`
+    slots: HashMap<String, usize>,
+    values: Vec<f64>,
+    /// Every expression compiled so far, by its text
+    compiled: RefCell<HashMap<String, CompiledExpr>>,
 }
 
 impl ExpressionEvaluator {
     pub fn new(parameters: HashMap<String, f64>) -> Self {
-        Self { parameters }
+        let mut slots = HashMap::with_capacity(parameters.len());
+        let mut values = Vec::with_capacity(parameters.len());
+        for (name, value) in parameters {
+            slots.insert(name, values.len());
+            values.push(value);
+        }
+        Self {
+            slots,
+            values,
+            compiled: RefCell::new(HashMap::new()),
+        }
     }
 
     pub fn eval(&self, expr: &str) -> Result<f64> {
+        if let Some(compiled) = self.compiled.borrow().get(expr) {
+            return compiled.eval(&self.values);
+        }
+        let compiled = self.compile(expr)?;
+        let value = compiled.eval(&self.values);
+        self.compiled
+            .borrow_mut()
+            .insert(expr.to_string(), compiled);
+        value
+    }
+
+    /// The slot a parameter's value is read from
+    pub fn slot(&self, name: &str) -> Option<usize> {
+        self.slots.get(name).copied()
+    }
+
+    /// The parameters' values, by slot
+    pub fn values(&self) -> &[f64] {
+        &self.values
+    }
+
+    /// Change a parameter's value. Expressions compiled already stay
+    /// compiled, and read the new value from here on.
+    pub fn set_parameter(&mut self, name: &str, value: f64) -> Result<()> {
+        match self.slots.get(name) {
+            Some(&slot) => {
+                self.values[slot] = value;
+                Ok(())
+            }
+            None => Err(Error::ExpressionEval(format!(
+                "Unknown parameter: {}",
+                name
+            ))),
+        }
+    }
+
+    /// Whether any expression evaluated so far reads the parameter
+    pub fn any_reads(&self, name: &str) -> bool {
+        match self.slots.get(name) {
+            Some(&slot) => self.compiled.borrow().values().any(|e| e.reads(slot)),
+            None => false,
+        }
+    }
+
+    /// Parse an expression, resolving its parameters to their slots; only
+    /// evaluating it can fail after this, on a division by zero
+    pub fn compile(&self, expr: &str) -> Result<CompiledExpr> {
         let expr = expr.trim();
 
         // Check for empty expression
@@ -21,7 +190,7 @@ impl ExpressionEvaluator {
 
         // Try parsing as a number first
         if let Ok(val) = expr.parse::<f64>() {
-            return Ok(val);
+            return Ok(CompiledExpr::Number(val));
         }
 
         // Check if it's a parameter reference (with or without $)
@@ -31,12 +200,12 @@ impl ExpressionEvaluator {
             expr
         };
 
-        if let Some(val) = self.parameters.get(param_key) {
-            return Ok(*val);
+        if let Some(&slot) = self.slots.get(param_key) {
+            return Ok(CompiledExpr::Parameter(slot));
         }
 
         // Handle basic arithmetic operations
-        if let Some(result) = self.eval_binary_op(expr)? {
+        if let Some(result) = self.compile_binary_op(expr)? {
             return Ok(result);
         }
 
@@ -46,16 +215,16 @@ impl ExpressionEvaluator {
         )))
     }
 
-    fn eval_binary_op(&self, expr: &str) -> Result<Option<f64>> {
+    fn compile_binary_op(&self, expr: &str) -> Result<Option<CompiledExpr>> {
         // Find operators in reverse precedence order (+ and - before * and /)
         for op in &['+', '-'] {
-            if let Some(result) = self.try_split_and_eval(expr, *op)? {
+            if let Some(result) = self.try_split_and_compile(expr, *op)? {
                 return Ok(Some(result));
             }
         }
 
         for op in &['*', '/'] {
-            if let Some(result) = self.try_split_and_eval(expr, *op)? {
+            if let Some(result) = self.try_split_and_compile(expr, *op)? {
                 return Ok(Some(result));
             }
         }
@@ -63,7 +232,7 @@ impl ExpressionEvaluator {
         Ok(None)
     }
 
-    fn try_split_and_eval(&self, expr: &str, op: char) -> Result<Option<f64>> {
+    fn try_split_and_compile(&self, expr: &str, op: char) -> Result<Option<CompiledExpr>> {
         // Find the last occurrence of the operator (for left-associativity)
         let mut depth = 0;
         let mut split_pos = None;
@@ -81,22 +250,14 @@ impl ExpressionEvaluator {
         }
 
         if let Some(pos) = split_pos {
-            let left = expr[..pos].trim();
-            let right = expr[pos + 1..].trim();
-
-            let left_val = self.eval(left)?;
-            let right_val = self.eval(right)?;
+            let left = Box::new(self.compile(expr[..pos].trim())?);
+            let right = Box::new(self.compile(expr[pos + 1..].trim())?);
 
             let result = match op {
-                '+' => left_val + right_val,
-                '-' => left_val - right_val,
-                '*' => left_val * right_val,
-                '/' => {
-                    if right_val == 0.0 {
-                        return Err(Error::ExpressionEval("Division by zero".to_string()));
-                    }
-                    left_val / right_val
-                }
+                '+' => CompiledExpr::Add(left, right),
+                '-' => CompiledExpr::Sub(left, right),
+                '*' => CompiledExpr::Mul(left, right),
+                '/' => CompiledExpr::Div(left, right),
                 _ => return Ok(None),
             };
 
@@ -107,16 +268,18 @@ impl ExpressionEvaluator {
         if let Some(paren_pos) = expr.find('(') {
             let func_name = expr[..paren_pos].trim();
             if expr.ends_with(')') {
-                let arg = &expr[paren_pos + 1..expr.len() - 1];
-                let arg_val = self.eval(arg)?;
-
-                match func_name {
-                    "cos" => return Ok(Some(arg_val.to_radians().cos())),
-                    "sin" => return Ok(Some(arg_val.to_radians().sin())),
-                    "tan" => return Ok(Some(arg_val.to_radians().tan())),
-                    "sqrt" => return Ok(Some(arg_val.sqrt())),
-                    "abs" => return Ok(Some(arg_val.abs())),
-                    _ => {}
+                let arg = Box::new(self.compile(&expr[paren_pos + 1..expr.len() - 1])?);
+
+                let func = match func_name {
+                    "cos" => Some(Function::Cos),
+                    "sin" => Some(Function::Sin),
+                    "tan" => Some(Function::Tan),
+                    "sqrt" => Some(Function::Sqrt),
+                    "abs" => Some(Function::Abs),
+                    _ => None,
+                };
+                if let Some(func) = func {
+                    return Ok(Some(CompiledExpr::Call(func, arg)));
                 }
             }
         }
@@ -127,7 +290,7 @@ impl ExpressionEvaluator {
             && !expr.contains("cos")
             && !expr.contains("sin")
         {
-            return Ok(Some(self.eval(&expr[1..expr.len() - 1])?));
+            return Ok(Some(self.compile(&expr[1..expr.len() - 1])?));
         }
 
         Ok(None)
@@ -138,6 +301,21 @@ impl ExpressionEvaluator {
 mod tests {
     use super::*;
 
+    #[test]
+    fn test_to_native() {
+        let mut params = HashMap::new();
+        params.insert("a".to_string(), 4.0);
+        let evaluator = ExpressionEvaluator::new(params);
+        let expr = evaluator.compile("$a / 2 - cos(a)").unwrap();
+        assert_eq!(
+            expr.to_native(&[10007]).unwrap(),
+            "(($10007 / (2)) - cos($10007))"
+        );
+        assert_eq!(CompiledExpr::Number(-0.5).to_native(&[]).unwrap(), "(-0.5)");
+        assert!(CompiledExpr::Number(f64::INFINITY).to_native(&[]).is_none());
+        assert!(CompiledExpr::Parameter(1).to_native(&[10007]).is_none());
+    }
+
     #[test]
     fn test_eval_number() {
         let eval = ExpressionEvaluator::new(HashMap::new());
@@ -267,15 +445,15 @@ mod tests {
     }
 
     #[test]
-    fn test_try_split_and_eval_no_op() {
+    fn test_try_split_and_compile_no_op() {
         let eval = ExpressionEvaluator::new(HashMap::new());
-        assert_eq!(eval.try_split_and_eval("42", '+').unwrap(), None);
+        assert_eq!(eval.try_split_and_compile("42", '+').unwrap(), None);
     }
 
     #[test]
-    fn test_eval_binary_op_no_match() {
+    fn test_compile_binary_op_no_match() {
         let eval = ExpressionEvaluator::new(HashMap::new());
-        assert_eq!(eval.eval_binary_op("42").unwrap(), None);
+        assert_eq!(eval.compile_binary_op("42").unwrap(), None);
     }
 
     #[test]
@@ -385,27 +563,34 @@ mod tests {
         assert_eq!(eval.eval("-10 + 5").unwrap(), -5.0);
     }
 
+    /// Split an expression at an operator, and evaluate what that makes
+    fn split(eval: &ExpressionEvaluator, expr: &str, op: char) -> Option<f64> {
+        eval.try_split_and_compile(expr, op)
+            .unwrap()
+            .map(|e| e.eval(eval.values()).unwrap())
+    }
+
     #[test]
-    fn test_try_split_and_eval_with_operator() {
+    fn test_try_split_and_compile_with_operator() {
         let eval = ExpressionEvaluator::new(HashMap::new());
-        assert_eq!(eval.try_split_and_eval("2 + 3", '+').unwrap(), Some(5.0));
-        assert_eq!(eval.try_split_and_eval("10 - 3", '-').unwrap(), Some(7.0));
-        assert_eq!(eval.try_split_and_eval("4 * 5", '*').unwrap(), Some(20.0));
-        assert_eq!(eval.try_split_and_eval("20 / 4", '/').unwrap(), Some(5.0));
+        assert_eq!(split(&eval, "2 + 3", '+'), Some(5.0));
+        assert_eq!(split(&eval, "10 - 3", '-'), Some(7.0));
+        assert_eq!(split(&eval, "4 * 5", '*'), Some(20.0));
+        assert_eq!(split(&eval, "20 / 4", '/'), Some(5.0));
     }
 
     #[test]
-    fn test_try_split_and_eval_with_parentheses() {
+    fn test_try_split_and_compile_with_parentheses() {
         let eval = ExpressionEvaluator::new(HashMap::new());
         // Should handle operators inside parentheses correctly
         assert_eq!(eval.eval("(2 + 3) * 4").unwrap(), 20.0);
     }
 
     #[test]
-    fn test_try_split_and_eval_unknown_operator() {
+    fn test_try_split_and_compile_unknown_operator() {
         let eval = ExpressionEvaluator::new(HashMap::new());
         // Unknown operator should return None
-        assert_eq!(eval.try_split_and_eval("2 % 3", '%').unwrap(), None);
+        assert_eq!(eval.try_split_and_compile("2 % 3", '%').unwrap(), None);
     }
 
     #[test]
@@ -423,4 +608,49 @@ mod tests {
         assert_eq!(eval.eval(" $W ").unwrap(), 100.0);
         assert_eq!(eval.eval("$W ").unwrap(), 100.0);
     }
+
+    #[test]
+    fn test_compiled_expression_reads_new_values() {
+        let mut params = HashMap::new();
+        params.insert("W".to_string(), 100.0);
+        params.insert("H".to_string(), 40.0);
+        let mut eval = ExpressionEvaluator::new(params);
+        let compiled = eval.compile("(W + $H) / 2 - H").unwrap();
+        assert_eq!(compiled.eval(eval.values()).unwrap(), 30.0);
+
+        eval.set_parameter("H", 10.0).unwrap();
+        assert_eq!(compiled.eval(eval.values()).unwrap(), 45.0);
+        assert_eq!(eval.eval("(W + $H) / 2 - H").unwrap(), 45.0);
+        assert!(eval.set_parameter("D", 1.0).is_err());
+    }
+
+    #[test]
+    fn test_compiled_expression_dependencies() {
+        let mut params = HashMap::new();
+        params.insert("a".to_string(), 1.0);
+        params.insert("b".to_string(), 2.0);
+        params.insert("c".to_string(), 3.0);
+        let eval = ExpressionEvaluator::new(params);
+        let compiled = eval.compile("a * sqrt(b)").unwrap();
+        assert!(compiled.reads(eval.slot("a").unwrap()));
+        assert!(compiled.reads(eval.slot("b").unwrap()));
+        assert!(!compiled.reads(eval.slot("c").unwrap()));
+
+        // Only what's been evaluated counts
+        assert!(!eval.any_reads("a"));
+        eval.eval("a + 1").unwrap();
+        assert!(eval.any_reads("a"));
+        assert!(!eval.any_reads("b"));
+        assert!(!eval.any_reads("nope"));
+    }
+
+    #[test]
+    fn test_division_by_zero_is_found_when_evaluating() {
+        let mut params = HashMap::new();
+        params.insert("d".to_string(), 0.0);
+        let mut eval = ExpressionEvaluator::new(params);
+        assert!(eval.eval("10 / d").is_err());
+        eval.set_parameter("d", 4.0).unwrap();
+        assert_eq!(eval.eval("10 / d").unwrap(), 2.5);
+    }
 }
@@ -1,4 +1,6 @@
-use std::os::raw::{c_double, c_int};
+use std::cell::RefCell;
+use std::ffi::CString;
+use std::os::raw::{c_char, c_double, c_int, c_void};
 
 /// FFI error types for better error handling
 #[derive(Debug, Clone)]
@@ -7,8 +9,12 @@ pub enum FfiError {
     Inconsistent,
     /// Solver didn't converge
     DidntConverge,
-    /// Too many unknowns (underconstrained)
+    /// More unknowns than the solver's limit (see `set_max_unknowns`)
     TooManyUnknowns,
+    /// The solve ran past its time limit (see `set_timeout`)
+    TimedOut,
+    /// The solve held more memory than its budget (see `set_memory_budget`)
+    ResourceExhausted,
     /// Invalid system pointer
     InvalidSystem,
     /// Unknown error code
@@ -24,7 +30,9 @@ impl std::fmt::Display for FfiError {
         match self {
             FfiError::Inconsistent => write!(f, "System is inconsistent (conflicting constraints)"),
             FfiError::DidntConverge => write!(f, "Solver did not converge (try adjusting initial guesses or constraints)"),
-            FfiError::TooManyUnknowns => write!(f, "Too many unknowns (system is underconstrained)"),
+            FfiError::TooManyUnknowns => write!(f, "Too many unknowns for the solver's limit"),
+            FfiError::TimedOut => write!(f, "Solver ran past its time limit"),
+            FfiError::ResourceExhausted => write!(f, "Solver ran past its memory budget"),
             FfiError::InvalidSystem => write!(f, "Invalid solver system"),
             FfiError::Unknown(code) => write!(f, "Solver failed with unknown error code {}", code),
             FfiError::EntityNotFound(id) => write!(f, "Entity not found: {}", id),
@@ -45,402 +53,668 @@ pub struct SolverSystem {
 extern "C" {
     pub fn real_slvs_create() -> *mut SolverSystem;
     pub fn real_slvs_destroy(sys: *mut SolverSystem);
+    pub fn real_slvs_reset(sys: *mut SolverSystem) -> c_int;
 
-    pub fn real_slvs_add_point(
+    pub fn real_slvs_add_records(
         sys: *mut SolverSystem,
-        id: c_int,
-        x: c_double,
-        y: c_double,
-        z: c_double,
-        is_dragged: c_int, // 1 if dragged, 0 otherwise
-    ) -> c_int;
-
-    pub fn real_slvs_add_where_dragged_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point_id: c_int,
-        workplane_id: c_int, // -1 for 3D, otherwise workplane ID
+        entities: *const EntityRecord,
+        n_entities: c_int,
+        constraints: *const ConstraintRecord,
+        n_constraints: c_int,
+        failed: *mut c_int,
     ) -> c_int;
-    pub fn real_slvs_add_line(
+    pub fn real_slvs_update_records(
         sys: *mut SolverSystem,
-        id: c_int,
-        point1_id: c_int,
-        point2_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_line_2d(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point1_id: c_int,
-        point2_id: c_int,
-        workplane_id: c_int,
+        entities: *const EntityRecord,
+        n_entities: c_int,
+        constraints: *const ConstraintRecord,
+        n_constraints: c_int,
+        failed: *mut c_int,
     ) -> c_int;
-    pub fn real_slvs_add_point_2d(
+
+    pub fn real_slvs_set_solver_options(
         sys: *mut SolverSystem,
-        id: c_int,
-        workplane_id: c_int,
-        u: c_double,
-        v: c_double,
-        is_dragged: c_int, // 1 if dragged, 0 otherwise
+        tolerance: c_double,
+        max_iterations: c_int,
+        damped: c_int, // 1 for a damped (line search) Newton step, 0 otherwise
     ) -> c_int;
 
-    pub fn real_slvs_add_circle(
+    pub fn real_slvs_set_max_unknowns(sys: *mut SolverSystem, max_unknowns: c_int) -> c_int; // 0 for no limit
+    pub fn real_slvs_set_chord_steps(sys: *mut SolverSystem, chord: c_int) -> c_int;
+    pub fn real_slvs_set_multi_start(sys: *mut SolverSystem, starts: c_int) -> c_int;
+    pub fn real_slvs_set_staged_start(sys: *mut SolverSystem, staged: c_int) -> c_int;
+    pub fn real_slvs_set_mixed_precision(sys: *mut SolverSystem, mixed: c_int) -> c_int;
+
+    pub fn real_slvs_set_timeout(sys: *mut SolverSystem, timeout_ms: c_int) -> c_int; // 0 for no limit
+    pub fn real_slvs_set_memory_budget(sys: *mut SolverSystem, bytes: i64) -> c_int; // 0 for no limit
+
+    pub fn real_slvs_cancel(sys: *mut SolverSystem) -> c_int; // from any thread
+
+    pub fn real_slvs_set_trace(
         sys: *mut SolverSystem,
-        id: c_int,
-        cx: c_double,
-        cy: c_double,
-        cz: c_double,
-        radius: c_double,
-        nx: c_double,
-        ny: c_double,
-        nz: c_double,
+        callback: Option<TraceCallback>,
+        user: *mut c_void,
     ) -> c_int;
 
-    pub fn real_slvs_add_circle_with_center_point(
+    pub fn real_slvs_set_trace_steps(sys: *mut SolverSystem, on: c_int) -> c_int;
+
+    pub fn real_slvs_solve(sys: *mut SolverSystem) -> c_int;
+
+    pub fn real_slvs_count_constraints(sys: *mut SolverSystem) -> c_int;
+    pub fn real_slvs_check(
         sys: *mut SolverSystem,
-        id: c_int,
-        center_point_id: c_int,
-        radius: c_double,
-        nx: c_double,
-        ny: c_double,
-        nz: c_double,
+        ids: *mut c_int,
+        residuals: *mut c_double,
+        max: c_int,
     ) -> c_int;
 
-    pub fn real_slvs_add_arc(
+    pub fn real_slvs_add_constant(sys: *mut SolverSystem, value: c_double) -> c_int;
+    pub fn real_slvs_set_constraint_expression(
         sys: *mut SolverSystem,
         id: c_int,
-        center_point_id: c_int,
-        start_point_id: c_int,
-        end_point_id: c_int,
-        nx: c_double,
-        ny: c_double,
-        nz: c_double,
-        workplane_id: c_int, // -1 for 3D, otherwise workplane ID
+        expr: *const c_char,
     ) -> c_int;
 
-    pub fn real_slvs_add_cubic(
+    pub fn real_slvs_solve_batch(
         sys: *mut SolverSystem,
-        id: c_int,
-        pt0_id: c_int,
-        pt1_id: c_int,
-        pt2_id: c_int,
-        pt3_id: c_int,
-        workplane_id: c_int, // -1 for 3D, otherwise workplane ID
+        rows: c_int,
+        workers: c_int,
+        constraint_ids: *const c_int,
+        n_constraints: c_int,
+        values: *const c_double, // rows x n_constraints
+        constant_ids: *const c_int,
+        n_constants: c_int,
+        constant_values: *const c_double, // rows x n_constants
+        point_ids: *const c_int,
+        n_points: c_int,
+        positions: *mut c_double, // rows x n_points x 3
+        results: *mut c_int,
+        dofs: *mut c_int,
     ) -> c_int;
 
-    pub fn real_slvs_add_fixed_constraint(
+    pub fn real_slvs_solve_track(
         sys: *mut SolverSystem,
-        id: c_int,
-        entity_id: c_int,
-        workplane_id: c_int, // -1 or 0 for 3D, otherwise workplane ID for 2D points
+        constraint_id: c_int,
+        n_values: c_int,
+        values: *const c_double,
+        step: c_double, // 0 for the defaults
+        min_step: c_double,
+        max_step: c_double,
+        point_ids: *const c_int,
+        n_points: c_int,
+        positions: *mut c_double, // n_values x n_points x 3
+        results: *mut c_int,
+        dofs: *mut c_int,
+        iterations: *mut c_int,
+        steps: *mut c_int,
     ) -> c_int;
-    pub fn real_slvs_add_distance_constraint(
+
+    pub fn real_slvs_set_sensitivities(
         sys: *mut SolverSystem,
-        id: c_int,
-        entity1: c_int,
-        entity2: c_int,
-        distance: c_double,
+        constraint_ids: *const c_int,
+        n_constraints: c_int,
     ) -> c_int;
-    pub fn real_slvs_add_point_on_line_constraint(
+    pub fn real_slvs_get_point_sensitivity(
         sys: *mut SolverSystem,
-        id: c_int,
+        index: c_int,
         point_id: c_int,
-        line_id: c_int,
-        workplane_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_points_coincident_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point1_id: c_int,
-        point2_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_perpendicular_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line1_id: c_int,
-        line2_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_parallel_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line1_id: c_int,
-        line2_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_angle_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line1_id: c_int,
-        line2_id: c_int,
-        angle: c_double,
-    ) -> c_int;
-    pub fn real_slvs_add_horizontal_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line_id: c_int,
-        workplane_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_vertical_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line_id: c_int,
-        workplane_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_equal_length_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line1_id: c_int,
-        line2_id: c_int,
-        workplane_id: c_int,
-    ) -> c_int;
-    pub fn real_slvs_add_equal_radius_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        circle1_id: c_int,
-        circle2_id: c_int,
+        dx: *mut c_double,
+        dy: *mut c_double,
+        dz: *mut c_double,
     ) -> c_int;
-    pub fn real_slvs_add_tangent_constraint(
+
+    pub fn real_slvs_get_dof(sys: *mut SolverSystem) -> c_int;
+    pub fn real_slvs_get_stats(sys: *mut SolverSystem, stats: *mut SolveStats) -> c_int;
+    pub fn real_slvs_set_profile(sys: *mut SolverSystem, on: c_int) -> c_int;
+    pub fn real_slvs_get_costs(
         sys: *mut SolverSystem,
-        id: c_int,
-        entity1_id: c_int,
-        entity2_id: c_int,
+        out: *mut ConstraintCost,
+        max: c_int,
     ) -> c_int;
-    pub fn real_slvs_add_point_on_circle_constraint(
+
+    pub fn real_slvs_get_point_position(
         sys: *mut SolverSystem,
         id: c_int,
-        point_id: c_int,
-        circle_id: c_int,
+        x: *mut c_double,
+        y: *mut c_double,
+        z: *mut c_double,
     ) -> c_int;
-    pub fn real_slvs_add_symmetric_constraint(
+    pub fn real_slvs_get_circle_position(
         sys: *mut SolverSystem,
         id: c_int,
-        entity1_id: c_int,
-        entity2_id: c_int,
-        line_id: c_int,
+        cx: *mut c_double,
+        cy: *mut c_double,
+        cz: *mut c_double,
+        radius: *mut c_double,
     ) -> c_int;
-    pub fn real_slvs_add_midpoint_constraint(
+    pub fn real_slvs_get_positions(
         sys: *mut SolverSystem,
-        id: c_int,
-        point_id: c_int,
-        line_id: c_int,
+        ids: *const c_int,
+        kinds: *const c_int,
+        n: c_int,
+        out: *mut c_double, // n x 4
+        results: *mut c_int,
     ) -> c_int;
+}
 
-    pub fn real_slvs_add_workplane(
-        sys: *mut SolverSystem,
-        id: c_int,
-        origin_point_id: c_int,
-        nx: c_double,
-        ny: c_double,
-        nz: c_double,
-    ) -> c_int;
+/// One entity for `Solver::add_records`, laid out like the wrapper's
+/// `RealSlvsEntityRecord`: which add function it's for, its id, and that
+/// function's other int and double arguments, each in the order it takes them.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct EntityRecord {
+    pub kind: c_int,
+    pub id: c_int,
+    pub arg: [c_int; 5],
+    pub val: [c_double; 7],
+}
 
-    pub fn real_slvs_add_point_in_plane_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point_id: c_int,
-        workplane_id: c_int,
-    ) -> c_int;
+impl EntityRecord {
+    fn new(kind: c_int, id: i32, args: &[c_int], vals: &[c_double]) -> Self {
+        let mut record = Self {
+            kind,
+            id,
+            arg: [0; 5],
+            val: [0.0; 7],
+        };
+        record.arg[..args.len()].copy_from_slice(args);
+        record.val[..vals.len()].copy_from_slice(vals);
+        record
+    }
+}
 
-    pub fn real_slvs_add_point_plane_distance_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point_id: c_int,
-        workplane_id: c_int,
-        distance: c_double,
-    ) -> c_int;
+/// One constraint for `Solver::add_records`, laid out like the wrapper's
+/// `RealSlvsConstraintRecord`, as `EntityRecord` is; no constraint takes more
+/// than one double.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct ConstraintRecord {
+    pub kind: c_int,
+    pub id: c_int,
+    pub arg: [c_int; 4],
+    pub val: c_double,
+}
 
-    pub fn real_slvs_add_point_line_distance_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point_id: c_int,
-        line_id: c_int,
-        distance: c_double,
-    ) -> c_int;
+impl ConstraintRecord {
+    fn new(kind: c_int, id: i32, args: &[c_int], val: c_double) -> Self {
+        let mut record = Self {
+            kind,
+            id,
+            arg: [0; 4],
+            val,
+        };
+        record.arg[..args.len()].copy_from_slice(args);
+        record
+    }
+}
 
-    pub fn real_slvs_add_length_ratio_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line1_id: c_int,
-        line2_id: c_int,
-        ratio: c_double,
-    ) -> c_int;
+/// Kinds of `EntityRecord`, as the wrapper numbers them
+mod entity_kind {
+    use std::os::raw::c_int;
+    pub const POINT: c_int = 1;
+    pub const POINT_2D: c_int = 2;
+    pub const LINE: c_int = 3;
+    pub const LINE_2D: c_int = 4;
+    pub const CIRCLE: c_int = 5;
+    pub const CIRCLE_WITH_CENTER_POINT: c_int = 6;
+    pub const ARC: c_int = 7;
+    pub const CUBIC: c_int = 8;
+    pub const WORKPLANE: c_int = 9;
+    pub const SKETCH_PLANE: c_int = 10;
+}
 
-    pub fn real_slvs_add_equal_angle_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line1_id: c_int,
-        line2_id: c_int,
-        line3_id: c_int,
-        line4_id: c_int,
-    ) -> c_int;
+/// Kinds of `ConstraintRecord`, as the wrapper numbers them
+mod constraint_kind {
+    use std::os::raw::c_int;
+    pub const WHERE_DRAGGED: c_int = 1;
+    pub const DISTANCE: c_int = 2;
+    pub const FIXED: c_int = 3;
+    pub const PARALLEL: c_int = 4;
+    pub const PERPENDICULAR: c_int = 5;
+    pub const ANGLE: c_int = 6;
+    pub const HORIZONTAL: c_int = 7;
+    pub const VERTICAL: c_int = 8;
+    pub const EQUAL_LENGTH: c_int = 9;
+    pub const EQUAL_RADIUS: c_int = 10;
+    pub const TANGENT: c_int = 11;
+    pub const POINT_ON_CIRCLE: c_int = 12;
+    pub const SYMMETRIC: c_int = 13;
+    pub const MIDPOINT: c_int = 14;
+    pub const POINT_ON_LINE: c_int = 15;
+    pub const POINTS_COINCIDENT: c_int = 16;
+    pub const POINT_IN_PLANE: c_int = 17;
+    pub const POINT_PLANE_DISTANCE: c_int = 18;
+    pub const POINT_LINE_DISTANCE: c_int = 19;
+    pub const LENGTH_RATIO: c_int = 20;
+    pub const EQUAL_ANGLE: c_int = 21;
+    pub const SYMMETRIC_HORIZONTAL: c_int = 22;
+    pub const SYMMETRIC_VERTICAL: c_int = 23;
+    pub const DIAMETER: c_int = 24;
+    pub const SAME_ORIENTATION: c_int = 25;
+    pub const PROJECTED_POINT_DISTANCE: c_int = 26;
+    pub const LENGTH_DIFFERENCE: c_int = 27;
+    pub const POINT_ON_FACE: c_int = 28;
+    pub const POINT_FACE_DISTANCE: c_int = 29;
+    pub const EQUAL_LINE_ARC_LENGTH: c_int = 30;
+    pub const EQUAL_LENGTH_POINT_LINE_DISTANCE: c_int = 31;
+    pub const EQUAL_POINT_LINE_DISTANCES: c_int = 32;
+    pub const CUBIC_LINE_TANGENT: c_int = 33;
+    pub const ARC_ARC_LENGTH_RATIO: c_int = 34;
+    pub const ARC_LINE_LENGTH_RATIO: c_int = 35;
+    pub const ARC_ARC_LENGTH_DIFFERENCE: c_int = 36;
+    pub const ARC_LINE_LENGTH_DIFFERENCE: c_int = 37;
+    pub const GEAR_MESH: c_int = 38;
+}
 
-    pub fn real_slvs_add_symmetric_horizontal_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        entity1_id: c_int,
-        entity2_id: c_int,
-        workplane_id: c_int,
-    ) -> c_int;
+/// What the last solve did, laid out like the library's `Slvs_Stats`. Times
+/// are in milliseconds; the phases nest, and are summed over threads. The
+/// heaviest constraint is in the numbering it was added with, or 0.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct SolveStats {
+    pub iterations: c_int,
+    pub residual: c_double,
+    pub equations: c_int,
+    pub unknowns: c_int,
+    pub jacobian_non_zeros: i64,
+    pub write_equations_ms: c_double,
+    pub substitute_ms: c_double,
+    pub alone_ms: c_double,
+    pub write_jacobian_ms: c_double,
+    pub eval_jacobian_ms: c_double,
+    pub step_ms: c_double,
+    pub rank_ms: c_double,
+    pub find_bad_ms: c_double,
+    pub exprs_allocated: i64,
+    pub temporary_bytes: i64,
+    pub temporary_peak_bytes: i64,
+    pub source_nodes: i64,
+    pub folded_nodes: i64,
+    pub partial_nodes: i64,
+    pub jacobian_entries: i64,
+    pub heaviest_constraint: u32,
+    pub heaviest_constraint_exprs: i64,
+    pub place_ms: c_double,
+    pub rigid_clusters: c_int,
+    pub copied_blocks: c_int,
+    pub largest_block_equations: c_int,
+    pub largest_block_unknowns: c_int,
+    pub reused_steps: c_int,
+}
 
-    pub fn real_slvs_add_symmetric_vertical_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        entity1_id: c_int,
-        entity2_id: c_int,
-        workplane_id: c_int,
-    ) -> c_int;
+/// What one constraint cost a profiled solve, laid out like the library's
+/// `Slvs_ConstraintCost`, with the id it was added with. The evaluation time
+/// is of its rows by themselves, so it ranks constraints against each other
+/// rather than adding up to the solve's.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct ConstraintCost {
+    pub id: u32,
+    pub expr_nodes: i64,
+    pub jacobian_non_zeros: i64,
+    pub eval_ms: c_double,
+    pub iterations_above_tolerance: c_int,
+}
 
-    pub fn real_slvs_add_diameter_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        circle_id: c_int,
-        diameter: c_double,
-    ) -> c_int;
+/// The beginning or end of a phase of a solve, laid out like the library's
+/// `Slvs_TraceEvent`; `phase` is one of `SolvePhase`'s values.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct TraceEvent {
+    pub phase: c_int,
+    pub begin: c_int,
+    pub time_ns: i64,
+    pub equations: c_int,
+    pub unknowns: c_int,
+    pub jacobian_non_zeros: i64,
+    pub iterations: c_int,
+    pub residual: c_double,
+    pub exprs_allocated: i64,
+    pub temporary_bytes: i64,
+}
 
-    pub fn real_slvs_add_same_orientation_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        entity1_id: c_int,
-        entity2_id: c_int,
-    ) -> c_int;
+pub type TraceCallback = unsafe extern "C" fn(event: *const TraceEvent, user: *mut c_void);
+
+/// The phases of a solve that the library traces, as it numbers them, and
+/// the end of a Newton step, which it tells of only if asked to
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SolvePhase {
+    Solve = 0,
+    WriteJacobian = 1,
+    Newton = 2,
+    FindBad = 3,
+    MarkFree = 4,
+    NewtonStep = 5,
+}
 
-    pub fn real_slvs_add_projected_point_distance_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point1_id: c_int,
-        point2_id: c_int,
-        workplane_id: c_int,
-        distance: c_double,
-    ) -> c_int;
+impl SolvePhase {
+    pub fn from_raw(phase: c_int) -> Option<Self> {
+        match phase {
+            0 => Some(SolvePhase::Solve),
+            1 => Some(SolvePhase::WriteJacobian),
+            2 => Some(SolvePhase::Newton),
+            3 => Some(SolvePhase::FindBad),
+            4 => Some(SolvePhase::MarkFree),
+            5 => Some(SolvePhase::NewtonStep),
+            _ => None,
+        }
+    }
+}
 
-    pub fn real_slvs_add_length_difference_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line1_id: c_int,
-        line2_id: c_int,
-        difference: c_double,
-    ) -> c_int;
+thread_local! {
+    /// The spans of the phases open on this thread, innermost last, with
+    /// the expression nodes the thread had allocated as each one began
+    static PHASE_SPANS: RefCell<Vec<(tracing::span::EnteredSpan, i64)>> = RefCell::new(Vec::new());
+}
 
-    pub fn real_slvs_add_point_on_face_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point_id: c_int,
-        face_id: c_int,
-    ) -> c_int;
+/// Opens a `tracing` span as each phase begins, and closes it with the
+/// phase's counters as it ends. The phases nest on each thread, so the spans
+/// do too, under whatever span the solve was called in.
+unsafe extern "C" fn trace_to_spans(event: *const TraceEvent, _user: *mut c_void) {
+    let Some(event) = event.as_ref() else { return };
+    let Some(phase) = SolvePhase::from_raw(event.phase) else {
+        return;
+    };
+    // A step opens and closes no span
+    if phase == SolvePhase::NewtonStep {
+        return;
+    }
+    // A panic mustn't unwind into the library
+    let _ = std::panic::catch_unwind(|| {
+        PHASE_SPANS.with(|spans| {
+            let mut spans = spans.borrow_mut();
+            if event.begin != 0 {
+                macro_rules! phase_span {
+                    ($name:literal) => {
+                        tracing::debug_span!(
+                            target: "slvs",
+                            $name,
+                            equations = event.equations,
+                            unknowns = event.unknowns,
+                            jacobian_non_zeros = tracing::field::Empty,
+                            iterations = tracing::field::Empty,
+                            residual = tracing::field::Empty,
+                            exprs_allocated = tracing::field::Empty,
+                            temporary_bytes = tracing::field::Empty,
+                        )
+                    };
+                }
+                let span = match phase {
+                    SolvePhase::Solve => phase_span!("solve"),
+                    SolvePhase::WriteJacobian => phase_span!("write_jacobian"),
+                    SolvePhase::Newton => phase_span!("newton"),
+                    SolvePhase::FindBad => phase_span!("find_bad"),
+                    SolvePhase::MarkFree => phase_span!("mark_free"),
+                    SolvePhase::NewtonStep => return,
+                };
+                spans.push((span.entered(), event.exprs_allocated));
+            } else if let Some((span, exprs)) = spans.pop() {
+                span.record("equations", event.equations);
+                span.record("unknowns", event.unknowns);
+                span.record("jacobian_non_zeros", event.jacobian_non_zeros);
+                span.record("iterations", event.iterations);
+                span.record("residual", event.residual);
+                span.record("exprs_allocated", event.exprs_allocated - exprs);
+                span.record("temporary_bytes", event.temporary_bytes);
+            }
+        })
+    });
+}
 
-    pub fn real_slvs_add_point_face_distance_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point_id: c_int,
-        face_id: c_int,
-        distance: c_double,
-    ) -> c_int;
+// Safe Rust wrapper
+/// How many reset systems each thread keeps for its next solvers
+const POOLED_SYSTEMS: usize = 2;
 
-    pub fn real_slvs_add_equal_line_arc_length_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line_id: c_int,
-        arc_id: c_int,
-    ) -> c_int;
+/// The systems of solvers dropped on this thread, reset: `Solver::new`
+/// takes one of these before it creates a system, and since a reset keeps
+/// the storage that the system's solves grew, serving one system after
+/// another of about the same size doesn't allocate
+struct SystemPool(Vec<*mut SolverSystem>);
 
-    pub fn real_slvs_add_equal_length_point_line_distance_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        line_id: c_int,
-        point_id: c_int,
-        reference_line_id: c_int,
-    ) -> c_int;
+impl Drop for SystemPool {
+    fn drop(&mut self) {
+        for system in self.0.drain(..) {
+            unsafe { real_slvs_destroy(system) }
+        }
+    }
+}
 
-    pub fn real_slvs_add_equal_point_line_distances_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        point1_id: c_int,
-        line1_id: c_int,
-        point2_id: c_int,
-        line2_id: c_int,
-    ) -> c_int;
+thread_local! {
+    static SYSTEM_POOL: RefCell<SystemPool> = RefCell::new(SystemPool(Vec::new()));
+}
 
-    pub fn real_slvs_add_cubic_line_tangent_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        cubic_id: c_int,
-        line_id: c_int,
-    ) -> c_int;
+pub struct Solver {
+    system: *mut SolverSystem,
+    /// What's been added since `hold_adds`, not yet in the system
+    held: Option<(Vec<EntityRecord>, Vec<ConstraintRecord>)>,
+    /// Whether the library's phases are traced as spans
+    traced: bool,
+}
 
-    pub fn real_slvs_add_arc_arc_length_ratio_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        arc1_id: c_int,
-        arc2_id: c_int,
-        ratio: c_double,
-    ) -> c_int;
+/// One row of a batched solve: the outcome, the remaining degrees of freedom
+/// (-1 if the row failed), and the solved positions of the requested points.
+#[derive(Debug, Clone)]
+pub struct BatchRow {
+    pub result: Result<(), FfiError>,
+    pub dof: i32,
+    pub positions: Vec<(f64, f64, f64)>,
+}
 
-    pub fn real_slvs_add_arc_line_length_ratio_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        arc_id: c_int,
-        line_id: c_int,
-        ratio: c_double,
-    ) -> c_int;
+/// One value of a tracked solve: the batch row for it, with the Newton
+/// iterations and continuation steps it took to get there from the value
+/// before it.
+#[derive(Debug, Clone)]
+pub struct TrackFrame {
+    pub row: BatchRow,
+    pub iterations: i32,
+    pub steps: i32,
+}
 
-    pub fn real_slvs_add_arc_arc_length_difference_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        arc1_id: c_int,
-        arc2_id: c_int,
-        difference: c_double,
-    ) -> c_int;
+/// One thing for `Solver::get_positions` to read back: a point's position,
+/// or a circle's centre and radius, by the id it was added with.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Readback {
+    None,
+    Point(i32),
+    Circle(i32),
+}
 
-    pub fn real_slvs_add_arc_line_length_difference_constraint(
-        sys: *mut SolverSystem,
-        id: c_int,
-        arc_id: c_int,
-        line_id: c_int,
-        difference: c_double,
-    ) -> c_int;
+impl Readback {
+    fn raw(self) -> (c_int, c_int) {
+        match self {
+            Readback::None => (0, 0),
+            Readback::Point(id) => (id, 1),
+            Readback::Circle(id) => (id, 2),
+        }
+    }
+}
 
-    pub fn real_slvs_solve(sys: *mut SolverSystem) -> c_int;
+/// The ids and kinds of what `Solver::read_positions_in` reads back, and
+/// whether each was found, kept from one read to the next
+#[derive(Debug, Default)]
+pub struct PositionBuffers {
+    ids: Vec<c_int>,
+    kinds: Vec<c_int>,
+    results: Vec<c_int>,
+}
 
-    pub fn real_slvs_get_point_position(
-        sys: *mut SolverSystem,
-        id: c_int,
-        x: *mut c_double,
-        y: *mut c_double,
-        z: *mut c_double,
-    ) -> c_int;
-    pub fn real_slvs_get_circle_position(
-        sys: *mut SolverSystem,
-        id: c_int,
-        cx: *mut c_double,
-        cy: *mut c_double,
-        cz: *mut c_double,
-        radius: *mut c_double,
-    ) -> c_int;
+/// Step lengths for `Solver::solve_track`, in the dimension's units; 0 for
+/// the library's defaults.
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct TrackSteps {
+    pub initial: f64,
+    pub min: f64,
+    pub max: f64,
 }
 
-// Safe Rust wrapper
-pub struct Solver {
-    system: *mut SolverSystem,
+/// A solve result code from the library, as a batch row's outcome
+fn row_result(code: c_int) -> Result<(), FfiError> {
+    match code {
+        0 | 4 => Ok(()), // Okay, or okay with redundant constraints
+        1 => Err(FfiError::Inconsistent),
+        2 => Err(FfiError::DidntConverge),
+        3 => Err(FfiError::TooManyUnknowns),
+        5 => Err(FfiError::TimedOut),
+        6 => Err(FfiError::ResourceExhausted),
+        code => Err(FfiError::Unknown(code)),
+    }
 }
 
 impl Solver {
     pub fn new() -> Self {
-        unsafe {
-            let system = real_slvs_create();
-            if system.is_null() {
-                panic!("Failed to create solver system");
+        let pooled = SYSTEM_POOL
+            .try_with(|pool| pool.borrow_mut().0.pop())
+            .ok()
+            .flatten();
+        let system = pooled.unwrap_or_else(|| unsafe { real_slvs_create() });
+        if system.is_null() {
+            panic!("Failed to create solver system");
+        }
+        Self {
+            system,
+            held: None,
+            traced: false,
+        }
+    }
+
+    /// A solver with no native system, that only holds what it's given as
+    /// records, for `take_held`
+    pub fn recorder() -> Self {
+        Self {
+            system: std::ptr::null_mut(),
+            held: Some((Vec::new(), Vec::new())),
+            traced: false,
+        }
+    }
+
+    /// Add entities and constraints to the system in one call, the entities
+    /// first, with room made for them all up front.
+    pub fn add_records(
+        &mut self,
+        entities: &[EntityRecord],
+        constraints: &[ConstraintRecord],
+    ) -> Result<(), FfiError> {
+        self.apply_records(real_slvs_add_records, "add", entities, constraints)
+    }
+
+    /// Set what records added before made to the values in these, which must
+    /// each have the kind, id and references of one that was added: the
+    /// params of the entities it made, or its constraint's value. Everything
+    /// else keeps the values it has, the solved ones after a solve.
+    pub fn update_records(
+        &mut self,
+        entities: &[EntityRecord],
+        constraints: &[ConstraintRecord],
+    ) -> Result<(), FfiError> {
+        self.apply_records(real_slvs_update_records, "update", entities, constraints)
+    }
+
+    fn apply_records(
+        &mut self,
+        apply: unsafe extern "C" fn(
+            *mut SolverSystem,
+            *const EntityRecord,
+            c_int,
+            *const ConstraintRecord,
+            c_int,
+            *mut c_int,
+        ) -> c_int,
+        verb: &str,
+        entities: &[EntityRecord],
+        constraints: &[ConstraintRecord],
+    ) -> Result<(), FfiError> {
+        if entities.len() > c_int::MAX as usize || constraints.len() > c_int::MAX as usize {
+            return Err(FfiError::ConstraintFailed(format!(
+                "Too many records to {}",
+                verb
+            )));
+        }
+        let mut failed: c_int = -1;
+        let result = unsafe {
+            apply(
+                self.system,
+                entities.as_ptr(),
+                entities.len() as c_int,
+                constraints.as_ptr(),
+                constraints.len() as c_int,
+                &mut failed,
+            )
+        };
+        match result {
+            0 => Ok(()),
+            _ if failed >= 0 && (failed as usize) < entities.len() => {
+                Err(FfiError::ConstraintFailed(format!(
+                    "Failed to {} entity {}",
+                    verb, entities[failed as usize].id
+                )))
             }
-            Self { system }
+            _ if failed >= 0 => Err(FfiError::ConstraintFailed(format!(
+                "Failed to {} constraint {}",
+                verb,
+                constraints[failed as usize - entities.len()].id
+            ))),
+            _ => Err(FfiError::InvalidSystem),
+        }
+    }
+
+    /// Hold what the add functions are given from now on as records, rather
+    /// than adding each to the system as it comes, until `add_held` adds them
+    /// all at once. The system doesn't have them until then.
+    pub fn hold_adds(&mut self) {
+        if self.held.is_none() {
+            self.held = Some((Vec::new(), Vec::new()));
+        }
+    }
+
+    /// Add everything held since `hold_adds` with one `add_records`, and go
+    /// back to adding as things come.
+    pub fn add_held(&mut self) -> Result<(), FfiError> {
+        match self.held.take() {
+            Some((entities, constraints)) => self.add_records(&entities, &constraints),
+            None => Ok(()),
+        }
+    }
+
+    /// Everything held since `hold_adds`, without adding it, and go back to
+    /// adding as things come.
+    pub fn take_held(&mut self) -> (Vec<EntityRecord>, Vec<ConstraintRecord>) {
+        self.held.take().unwrap_or_default()
+    }
+
+    fn add_entity(&mut self, record: EntityRecord) -> c_int {
+        if let Some((entities, _)) = &mut self.held {
+            entities.push(record);
+            return 0;
+        }
+        match self.add_records(&[record], &[]) {
+            Ok(()) => 0,
+            Err(_) => -1,
+        }
+    }
+
+    fn add_constraint(&mut self, record: ConstraintRecord) -> c_int {
+        if let Some((_, constraints)) = &mut self.held {
+            constraints.push(record);
+            return 0;
+        }
+        match self.add_records(&[], &[record]) {
+            Ok(()) => 0,
+            Err(_) => -1,
         }
     }
 
     pub fn add_point(&mut self, id: i32, x: f64, y: f64, z: f64, is_dragged: bool) -> Result<(), String> {
-        unsafe {
-            let dragged = if is_dragged { 1 } else { 0 };
-            let result = real_slvs_add_point(self.system, id, x, y, z, dragged);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add point {}", id))
-            }
+        let dragged = if is_dragged { 1 } else { 0 };
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::POINT,
+            id,
+            &[dragged],
+            &[x, y, z],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add point {}", id))
         }
     }
 
@@ -450,36 +724,48 @@ impl Solver {
         point_id: i32,
         workplane_id: Option<i32>, // None for 3D, Some(id) for 2D
     ) -> Result<(), FfiError> {
-        unsafe {
-            let wp_id = workplane_id.unwrap_or(-1);
-            let result = real_slvs_add_where_dragged_constraint(self.system, id, point_id, wp_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add WHERE_DRAGGED constraint {}", id)))
-            }
+        let wp_id = workplane_id.unwrap_or(-1);
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::WHERE_DRAGGED,
+            id,
+            &[point_id, wp_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add WHERE_DRAGGED constraint {}",
+                id
+            )))
         }
     }
 
     pub fn add_line(&mut self, id: i32, point1_id: i32, point2_id: i32) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_line(self.system, id, point1_id, point2_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add line {}", id))
-            }
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::LINE,
+            id,
+            &[point1_id, point2_id],
+            &[],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add line {}", id))
         }
     }
 
     pub fn add_line_2d(&mut self, id: i32, point1_id: i32, point2_id: i32, workplane_id: i32) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_line_2d(self.system, id, point1_id, point2_id, workplane_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add 2D line {}", id))
-            }
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::LINE_2D,
+            id,
+            &[point1_id, point2_id, workplane_id],
+            &[],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add 2D line {}", id))
         }
     }
 
@@ -491,14 +777,20 @@ impl Solver {
         v: f64,
         is_dragged: bool,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let dragged = if is_dragged { 1 } else { 0 };
-            let result = real_slvs_add_point_2d(self.system, id, workplane_id, u, v, dragged);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add 2D point {}", id)))
-            }
+        let dragged = if is_dragged { 1 } else { 0 };
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::POINT_2D,
+            id,
+            &[workplane_id, dragged],
+            &[u, v],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add 2D point {}",
+                id
+            )))
         }
     }
 
@@ -513,13 +805,16 @@ impl Solver {
         ny: f64,
         nz: f64,
     ) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_circle(self.system, id, cx, cy, cz, radius, nx, ny, nz);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add circle {}", id))
-            }
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::CIRCLE,
+            id,
+            &[],
+            &[cx, cy, cz, radius, nx, ny, nz],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add circle {}", id))
         }
     }
 
@@ -534,15 +829,19 @@ impl Solver {
         ny: f64,
         nz: f64,
     ) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_circle_with_center_point(
-                self.system, id, center_point_id, radius, nx, ny, nz
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add circle {} with center point {}", id, center_point_id))
-            }
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::CIRCLE_WITH_CENTER_POINT,
+            id,
+            &[center_point_id],
+            &[radius, nx, ny, nz],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!(
+                "Failed to add circle {} with center point {}",
+                id, center_point_id
+            ))
         }
     }
 
@@ -557,17 +856,20 @@ impl Solver {
         nz: f64,
         workplane_id: Option<i32>, // None for 3D, Some(id) for 2D
     ) -> Result<(), FfiError> {
-        unsafe {
-            let wp_id = workplane_id.unwrap_or(-1);
-            let result = real_slvs_add_arc(
-                self.system, id, center_point_id, start_point_id, end_point_id,
-                nx, ny, nz, wp_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add arc {}", id)))
-            }
+        let wp_id = workplane_id.unwrap_or(-1);
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::ARC,
+            id,
+            &[center_point_id, start_point_id, end_point_id, wp_id],
+            &[nx, ny, nz],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add arc {}",
+                id
+            )))
         }
     }
 
@@ -580,27 +882,34 @@ impl Solver {
         pt3_id: i32,
         workplane_id: Option<i32>, // None for 3D, Some(id) for 2D
     ) -> Result<(), FfiError> {
-        unsafe {
-            let wp_id = workplane_id.unwrap_or(-1);
-            let result = real_slvs_add_cubic(
-                self.system, id, pt0_id, pt1_id, pt2_id, pt3_id, wp_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add cubic {}", id)))
-            }
+        let wp_id = workplane_id.unwrap_or(-1);
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::CUBIC,
+            id,
+            &[pt0_id, pt1_id, pt2_id, pt3_id, wp_id],
+            &[],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add cubic {}",
+                id
+            )))
         }
     }
 
     pub fn add_fixed_constraint(&mut self, id: i32, entity_id: i32, workplane_id: i32) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_fixed_constraint(self.system, id, entity_id, workplane_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add fixed constraint {}", id))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::FIXED,
+            id,
+            &[entity_id, workplane_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add fixed constraint {}", id))
         }
     }
 
@@ -611,14 +920,16 @@ impl Solver {
         entity2: i32,
         distance: f64,
     ) -> Result<(), String> {
-        unsafe {
-            let result =
-                real_slvs_add_distance_constraint(self.system, id, entity1, entity2, distance);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add distance constraint {}", id))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::DISTANCE,
+            id,
+            &[entity1, entity2],
+            distance,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add distance constraint {}", id))
         }
     }
 
@@ -631,14 +942,17 @@ impl Solver {
         line_id: i32,
         workplane_id: Option<i32>,
     ) -> Result<(), String> {
-        unsafe {
-            let wp_id = workplane_id.unwrap_or(-1);
-            let result = real_slvs_add_point_on_line_constraint(self.system, id, point_id, line_id, wp_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add point on line constraint {}", id))
-            }
+        let wp_id = workplane_id.unwrap_or(-1);
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINT_ON_LINE,
+            id,
+            &[point_id, line_id, wp_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add point on line constraint {}", id))
         }
     }
 
@@ -648,13 +962,16 @@ impl Solver {
         point1_id: i32,
         point2_id: i32,
     ) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_points_coincident_constraint(self.system, id, point1_id, point2_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add points coincident constraint {}", id))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINTS_COINCIDENT,
+            id,
+            &[point1_id, point2_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add points coincident constraint {}", id))
         }
     }
 
@@ -664,13 +981,16 @@ impl Solver {
         line1_id: i32,
         line2_id: i32,
     ) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_perpendicular_constraint(self.system, id, line1_id, line2_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add perpendicular constraint {}", id))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::PERPENDICULAR,
+            id,
+            &[line1_id, line2_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add perpendicular constraint {}", id))
         }
     }
 
@@ -680,13 +1000,16 @@ impl Solver {
         line1_id: i32,
         line2_id: i32,
     ) -> Result<(), String> {
-        unsafe {
-            let result = real_slvs_add_parallel_constraint(self.system, id, line1_id, line2_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(format!("Failed to add parallel constraint {}", id))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::PARALLEL,
+            id,
+            &[line1_id, line2_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(format!("Failed to add parallel constraint {}", id))
         }
     }
 
@@ -697,13 +1020,19 @@ impl Solver {
         line2_id: i32,
         angle: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_angle_constraint(self.system, id, line1_id, line2_id, angle);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add angle constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::ANGLE,
+            id,
+            &[line1_id, line2_id],
+            angle,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add angle constraint {}",
+                id
+            )))
         }
     }
 
@@ -713,13 +1042,19 @@ impl Solver {
         line_id: i32,
         workplane_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_horizontal_constraint(self.system, id, line_id, workplane_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add horizontal constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::HORIZONTAL,
+            id,
+            &[line_id, workplane_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add horizontal constraint {}",
+                id
+            )))
         }
     }
 
@@ -729,13 +1064,19 @@ impl Solver {
         line_id: i32,
         workplane_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_vertical_constraint(self.system, id, line_id, workplane_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add vertical constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::VERTICAL,
+            id,
+            &[line_id, workplane_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add vertical constraint {}",
+                id
+            )))
         }
     }
 
@@ -746,13 +1087,19 @@ impl Solver {
         line2_id: i32,
         workplane_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_equal_length_constraint(self.system, id, line1_id, line2_id, workplane_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add equal length constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::EQUAL_LENGTH,
+            id,
+            &[line1_id, line2_id, workplane_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add equal length constraint {}",
+                id
+            )))
         }
     }
 
@@ -762,13 +1109,19 @@ impl Solver {
         circle1_id: i32,
         circle2_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_equal_radius_constraint(self.system, id, circle1_id, circle2_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add equal radius constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::EQUAL_RADIUS,
+            id,
+            &[circle1_id, circle2_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add equal radius constraint {}",
+                id
+            )))
         }
     }
 
@@ -778,13 +1131,19 @@ impl Solver {
         entity1_id: i32,
         entity2_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_tangent_constraint(self.system, id, entity1_id, entity2_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add tangent constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::TANGENT,
+            id,
+            &[entity1_id, entity2_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add tangent constraint {}",
+                id
+            )))
         }
     }
 
@@ -794,13 +1153,19 @@ impl Solver {
         point_id: i32,
         circle_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_point_on_circle_constraint(self.system, id, point_id, circle_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add point on circle constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINT_ON_CIRCLE,
+            id,
+            &[point_id, circle_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add point on circle constraint {}",
+                id
+            )))
         }
     }
 
@@ -811,13 +1176,19 @@ impl Solver {
         entity2_id: i32,
         line_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_symmetric_constraint(self.system, id, entity1_id, entity2_id, line_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add symmetric constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::SYMMETRIC,
+            id,
+            &[entity1_id, entity2_id, line_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add symmetric constraint {}",
+                id
+            )))
         }
     }
 
@@ -827,13 +1198,33 @@ impl Solver {
         point_id: i32,
         line_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_midpoint_constraint(self.system, id, point_id, line_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add midpoint constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::MIDPOINT,
+            id,
+            &[point_id, line_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add midpoint constraint {}",
+                id
+            )))
+        }
+    }
+
+    /// Make everything added from here on in the xy plane, solved in 2D:
+    /// points as their x and y, circles and arcs with the plane's normal, and
+    /// the constraints between them written in the plane. Only for a system
+    /// that's all in that plane, before anything else is added.
+    pub fn set_planar(&mut self) -> Result<(), FfiError> {
+        if self.add_entity(EntityRecord::new(entity_kind::SKETCH_PLANE, 0, &[], &[])) == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(
+                "Failed to set the sketch plane".to_string(),
+            ))
         }
     }
 
@@ -845,13 +1236,19 @@ impl Solver {
         ny: f64,
         nz: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_workplane(self.system, id, origin_point_id, nx, ny, nz);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add workplane {}", id)))
-            }
+        let result = self.add_entity(EntityRecord::new(
+            entity_kind::WORKPLANE,
+            id,
+            &[origin_point_id],
+            &[nx, ny, nz],
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add workplane {}",
+                id
+            )))
         }
     }
 
@@ -861,13 +1258,19 @@ impl Solver {
         point_id: i32,
         workplane_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_point_in_plane_constraint(self.system, id, point_id, workplane_id);
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add point in plane constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINT_IN_PLANE,
+            id,
+            &[point_id, workplane_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add point in plane constraint {}",
+                id
+            )))
         }
     }
 
@@ -876,17 +1279,21 @@ impl Solver {
         id: i32,
         point_id: i32,
         workplane_id: i32,
-        distance: f64,
-    ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_point_plane_distance_constraint(
-                self.system, id, point_id, workplane_id, distance
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add point plane distance constraint {}", id)))
-            }
+        distance: f64,
+    ) -> Result<(), FfiError> {
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINT_PLANE_DISTANCE,
+            id,
+            &[point_id, workplane_id],
+            distance,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add point plane distance constraint {}",
+                id
+            )))
         }
     }
 
@@ -897,15 +1304,19 @@ impl Solver {
         line_id: i32,
         distance: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_point_line_distance_constraint(
-                self.system, id, point_id, line_id, distance
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add point line distance constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINT_LINE_DISTANCE,
+            id,
+            &[point_id, line_id],
+            distance,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add point line distance constraint {}",
+                id
+            )))
         }
     }
 
@@ -916,15 +1327,19 @@ impl Solver {
         line2_id: i32,
         ratio: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_length_ratio_constraint(
-                self.system, id, line1_id, line2_id, ratio
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add length ratio constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::LENGTH_RATIO,
+            id,
+            &[line1_id, line2_id],
+            ratio,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add length ratio constraint {}",
+                id
+            )))
         }
     }
 
@@ -936,15 +1351,19 @@ impl Solver {
         line3_id: i32,
         line4_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_equal_angle_constraint(
-                self.system, id, line1_id, line2_id, line3_id, line4_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add equal angle constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::EQUAL_ANGLE,
+            id,
+            &[line1_id, line2_id, line3_id, line4_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add equal angle constraint {}",
+                id
+            )))
         }
     }
 
@@ -955,15 +1374,19 @@ impl Solver {
         entity2_id: i32,
         workplane_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_symmetric_horizontal_constraint(
-                self.system, id, entity1_id, entity2_id, workplane_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add symmetric horizontal constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::SYMMETRIC_HORIZONTAL,
+            id,
+            &[entity1_id, entity2_id, workplane_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add symmetric horizontal constraint {}",
+                id
+            )))
         }
     }
 
@@ -974,15 +1397,19 @@ impl Solver {
         entity2_id: i32,
         workplane_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_symmetric_vertical_constraint(
-                self.system, id, entity1_id, entity2_id, workplane_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add symmetric vertical constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::SYMMETRIC_VERTICAL,
+            id,
+            &[entity1_id, entity2_id, workplane_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add symmetric vertical constraint {}",
+                id
+            )))
         }
     }
 
@@ -992,15 +1419,19 @@ impl Solver {
         circle_id: i32,
         diameter: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_diameter_constraint(
-                self.system, id, circle_id, diameter
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add diameter constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::DIAMETER,
+            id,
+            &[circle_id],
+            diameter,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add diameter constraint {}",
+                id
+            )))
         }
     }
 
@@ -1010,15 +1441,19 @@ impl Solver {
         entity1_id: i32,
         entity2_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_same_orientation_constraint(
-                self.system, id, entity1_id, entity2_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add same orientation constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::SAME_ORIENTATION,
+            id,
+            &[entity1_id, entity2_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add same orientation constraint {}",
+                id
+            )))
         }
     }
 
@@ -1030,15 +1465,19 @@ impl Solver {
         workplane_id: i32,
         distance: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_projected_point_distance_constraint(
-                self.system, id, point1_id, point2_id, workplane_id, distance
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add projected point distance constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::PROJECTED_POINT_DISTANCE,
+            id,
+            &[point1_id, point2_id, workplane_id],
+            distance,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add projected point distance constraint {}",
+                id
+            )))
         }
     }
 
@@ -1049,15 +1488,19 @@ impl Solver {
         line2_id: i32,
         difference: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_length_difference_constraint(
-                self.system, id, line1_id, line2_id, difference
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add length difference constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::LENGTH_DIFFERENCE,
+            id,
+            &[line1_id, line2_id],
+            difference,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add length difference constraint {}",
+                id
+            )))
         }
     }
 
@@ -1067,15 +1510,19 @@ impl Solver {
         point_id: i32,
         face_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_point_on_face_constraint(
-                self.system, id, point_id, face_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add point on face constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINT_ON_FACE,
+            id,
+            &[point_id, face_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add point on face constraint {}",
+                id
+            )))
         }
     }
 
@@ -1086,15 +1533,19 @@ impl Solver {
         face_id: i32,
         distance: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_point_face_distance_constraint(
-                self.system, id, point_id, face_id, distance
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add point face distance constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::POINT_FACE_DISTANCE,
+            id,
+            &[point_id, face_id],
+            distance,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add point face distance constraint {}",
+                id
+            )))
         }
     }
 
@@ -1104,15 +1555,19 @@ impl Solver {
         line_id: i32,
         arc_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_equal_line_arc_length_constraint(
-                self.system, id, line_id, arc_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add equal line arc length constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::EQUAL_LINE_ARC_LENGTH,
+            id,
+            &[line_id, arc_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add equal line arc length constraint {}",
+                id
+            )))
         }
     }
 
@@ -1123,15 +1578,19 @@ impl Solver {
         point_id: i32,
         reference_line_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_equal_length_point_line_distance_constraint(
-                self.system, id, line_id, point_id, reference_line_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add equal length point line distance constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::EQUAL_LENGTH_POINT_LINE_DISTANCE,
+            id,
+            &[line_id, point_id, reference_line_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add equal length point line distance constraint {}",
+                id
+            )))
         }
     }
 
@@ -1143,15 +1602,19 @@ impl Solver {
         point2_id: i32,
         line2_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_equal_point_line_distances_constraint(
-                self.system, id, point1_id, line1_id, point2_id, line2_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add equal point line distances constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::EQUAL_POINT_LINE_DISTANCES,
+            id,
+            &[point1_id, line1_id, point2_id, line2_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add equal point line distances constraint {}",
+                id
+            )))
         }
     }
 
@@ -1161,15 +1624,19 @@ impl Solver {
         cubic_id: i32,
         line_id: i32,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_cubic_line_tangent_constraint(
-                self.system, id, cubic_id, line_id
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add cubic line tangent constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::CUBIC_LINE_TANGENT,
+            id,
+            &[cubic_id, line_id],
+            0.0,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add cubic line tangent constraint {}",
+                id
+            )))
         }
     }
 
@@ -1180,15 +1647,19 @@ impl Solver {
         arc2_id: i32,
         ratio: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_arc_arc_length_ratio_constraint(
-                self.system, id, arc1_id, arc2_id, ratio
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add arc arc length ratio constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::ARC_ARC_LENGTH_RATIO,
+            id,
+            &[arc1_id, arc2_id],
+            ratio,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add arc arc length ratio constraint {}",
+                id
+            )))
         }
     }
 
@@ -1199,15 +1670,19 @@ impl Solver {
         line_id: i32,
         ratio: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_arc_line_length_ratio_constraint(
-                self.system, id, arc_id, line_id, ratio
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add arc line length ratio constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::ARC_LINE_LENGTH_RATIO,
+            id,
+            &[arc_id, line_id],
+            ratio,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add arc line length ratio constraint {}",
+                id
+            )))
         }
     }
 
@@ -1218,15 +1693,19 @@ impl Solver {
         arc2_id: i32,
         difference: f64,
     ) -> Result<(), FfiError> {
-        unsafe {
-            let result = real_slvs_add_arc_arc_length_difference_constraint(
-                self.system, id, arc1_id, arc2_id, difference
-            );
-            if result == 0 {
-                Ok(())
-            } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add arc arc length difference constraint {}", id)))
-            }
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::ARC_ARC_LENGTH_DIFFERENCE,
+            id,
+            &[arc1_id, arc2_id],
+            difference,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add arc arc length difference constraint {}",
+                id
+            )))
         }
     }
 
@@ -1237,32 +1716,490 @@ impl Solver {
         line_id: i32,
         difference: f64,
     ) -> Result<(), FfiError> {
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::ARC_LINE_LENGTH_DIFFERENCE,
+            id,
+            &[arc_id, line_id],
+            difference,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add arc line length difference constraint {}",
+                id
+            )))
+        }
+    }
+
+    /// Two circles as the pitch circles of gears in mesh; `teeth2` is
+    /// negative for a ring gear that the first turns inside
+    pub fn add_gear_mesh_constraint(
+        &mut self,
+        id: i32,
+        circle1_id: i32,
+        circle2_id: i32,
+        teeth1: i32,
+        teeth2: i32,
+        module: f64,
+    ) -> Result<(), FfiError> {
+        let result = self.add_constraint(ConstraintRecord::new(
+            constraint_kind::GEAR_MESH,
+            id,
+            &[circle1_id, circle2_id, teeth1, teeth2],
+            module,
+        ));
+        if result == 0 {
+            Ok(())
+        } else {
+            Err(FfiError::ConstraintFailed(format!(
+                "Failed to add gear mesh constraint {}",
+                id
+            )))
+        }
+    }
+
+    /// Set the convergence tolerance and iteration limit for Newton's method,
+    /// 0 for libslvs's own, and whether its steps are damped by a line search.
+    pub fn set_solver_options(
+        &mut self,
+        tolerance: f64,
+        max_iterations: u32,
+        damped: bool,
+    ) -> Result<(), String> {
         unsafe {
-            let result = real_slvs_add_arc_line_length_difference_constraint(
-                self.system, id, arc_id, line_id, difference
-            );
+            let max_iterations = max_iterations.min(c_int::MAX as u32) as c_int;
+            let damped = if damped { 1 } else { 0 };
+            let result =
+                real_slvs_set_solver_options(self.system, tolerance, max_iterations, damped);
             if result == 0 {
                 Ok(())
             } else {
-                Err(FfiError::ConstraintFailed(format!("Failed to add arc line length difference constraint {}", id)))
+                Err(format!(
+                    "Invalid solver options (tolerance {}, max iterations {})",
+                    tolerance, max_iterations
+                ))
             }
         }
     }
 
+    /// Set the most unknowns the solver takes on at once, in any one part of
+    /// the system that shares no unknowns with the rest, or lift the limit
+    /// with 0. The stats say how big the largest part was.
+    pub fn set_max_unknowns(&mut self, max_unknowns: usize) {
+        unsafe {
+            let max_unknowns = max_unknowns.min(c_int::MAX as usize) as c_int;
+            real_slvs_set_max_unknowns(self.system, max_unknowns);
+        }
+    }
+
+    /// Set whether Newton's method reuses the last factorization of the
+    /// Jacobian for as long as the residuals keep at least halving with each
+    /// step, as in the chord method, instead of re-evaluating it every step.
+    /// That saves most of a step's work on large parts of the system; the
+    /// stats count the reused steps.
+    pub fn set_chord_steps(&mut self, chord: bool) {
+        unsafe {
+            real_slvs_set_chord_steps(self.system, if chord { 1 } else { 0 });
+        }
+    }
+
+    /// Set whether solves start in stages, for rough starting positions:
+    /// the coincidences and fixed points first, then the distances and
+    /// incidences, the angles and the tangencies in turn, each from where
+    /// the last left the points, and then everything.
+    pub fn set_staged_start(&mut self, staged: bool) {
+        unsafe {
+            real_slvs_set_staged_start(self.system, if staged { 1 } else { 0 });
+        }
+    }
+
+    /// Set whether batches evaluate each row's first Newton steps in single
+    /// precision, going over to double for the last; the rows converge to
+    /// the same tolerance, for less work on large batches of small systems.
+    pub fn set_mixed_precision(&mut self, mixed: bool) {
+        unsafe {
+            real_slvs_set_mixed_precision(self.system, if mixed { 1 } else { 0 });
+        }
+    }
+
+    /// Have a solve that doesn't converge from the given positions try again
+    /// from up to `starts - 1` fixed perturbations of them, on the worker
+    /// threads, keeping the first (the least perturbed) that converges; 0 or
+    /// 1 tries only the given positions. The answer doesn't depend on the
+    /// number of threads.
+    pub fn set_multi_start(&mut self, starts: u32) {
+        unsafe {
+            let starts = starts.min(c_int::MAX as u32) as c_int;
+            real_slvs_set_multi_start(self.system, starts);
+        }
+    }
+
+    /// Set the longest each solve may take, in milliseconds, or lift the
+    /// limit with 0. A solve that runs past it fails with `TimedOut`, and
+    /// leaves the points where they started.
+    pub fn set_timeout(&mut self, timeout_ms: u64) {
+        unsafe {
+            let timeout_ms = timeout_ms.min(c_int::MAX as u64) as c_int;
+            real_slvs_set_timeout(self.system, timeout_ms);
+        }
+    }
+
+    /// Set the most bytes each solve may hold, in its temporaries and
+    /// roughly in its matrices, or lift the limit with 0. A solve that goes
+    /// over fails with `ResourceExhausted`, and leaves the points where they
+    /// started.
+    pub fn set_memory_budget(&mut self, bytes: u64) {
+        unsafe {
+            let bytes = bytes.min(i64::MAX as u64) as i64;
+            real_slvs_set_memory_budget(self.system, bytes);
+        }
+    }
+
+    /// Have the library call `callback` with `user` as each phase of this
+    /// system's solves begins and ends, or stop with `None`. With more than
+    /// one worker, it's called from each of their threads.
+    ///
+    /// # Safety
+    /// `user` must be valid for as long as the callback is set, and the
+    /// callback must be safe to call from any thread.
+    pub unsafe fn set_trace_callback(
+        &mut self,
+        callback: Option<TraceCallback>,
+        user: *mut c_void,
+    ) {
+        real_slvs_set_trace(self.system, callback, user);
+        self.traced = false;
+    }
+
+    /// Have the trace callback told of the end of each Newton step too, as
+    /// `SolvePhase::NewtonStep`, with the steps taken and the residual
+    pub fn set_trace_steps(&mut self, on: bool) {
+        unsafe {
+            real_slvs_set_trace_steps(self.system, on as c_int);
+        }
+    }
+
+    /// Trace the library's phases as `tracing` spans (target `slvs`, at
+    /// debug) while a subscriber wants them; the solves check before each
+    /// run, so the library isn't called back when no one is listening.
+    fn sync_trace(&mut self) {
+        let wanted = tracing::enabled!(target: "slvs", tracing::Level::DEBUG);
+        if wanted != self.traced && !self.system.is_null() {
+            let callback: Option<TraceCallback> = if wanted { Some(trace_to_spans) } else { None };
+            unsafe { real_slvs_set_trace(self.system, callback, std::ptr::null_mut()) };
+            self.traced = wanted;
+        }
+    }
+
+    /// A handle that ends this system's solves from another thread
+    pub(crate) fn canceller(&self) -> Canceller {
+        Canceller(self.system)
+    }
+
     pub fn solve(&mut self) -> Result<(), FfiError> {
+        self.sync_trace();
         unsafe {
             let result = real_slvs_solve(self.system);
             match result {
                 0 => Ok(()),
                 1 => Err(FfiError::Inconsistent), // Overconstrained
                 2 => Err(FfiError::DidntConverge), // Convergence failure
-                3 => Err(FfiError::TooManyUnknowns), // Underconstrained
+                3 => Err(FfiError::TooManyUnknowns),
+                5 => Err(FfiError::TimedOut),
+                6 => Err(FfiError::ResourceExhausted),
+                -1 => Err(FfiError::InvalidSystem),
+                code => Err(FfiError::Unknown(code)),
+            }
+        }
+    }
+
+    /// Check whether the points, where they were added, already solve the
+    /// system, without solving it: each equation is evaluated once. Gives
+    /// whether all of them are within the tolerance, and each constraint's
+    /// id with the largest of its residuals, in the order they were added.
+    pub fn check(&mut self) -> Result<(bool, Vec<(i32, f64)>), FfiError> {
+        unsafe {
+            let n = real_slvs_count_constraints(self.system);
+            if n < 0 {
+                return Err(FfiError::InvalidSystem);
+            }
+            let mut ids = vec![0 as c_int; n as usize];
+            let mut residuals = vec![0.0; n as usize];
+            match real_slvs_check(self.system, ids.as_mut_ptr(), residuals.as_mut_ptr(), n) {
+                code @ (0 | 2) => Ok((code == 0, ids.into_iter().zip(residuals).collect())),
                 -1 => Err(FfiError::InvalidSystem),
                 code => Err(FfiError::Unknown(code)),
             }
         }
     }
 
+    /// Add a constant for dimensions' expressions to read, and give the
+    /// handle they read it by (see `set_constraint_expression`)
+    pub fn add_constant(&mut self, value: f64) -> Result<i32, FfiError> {
+        match unsafe { real_slvs_add_constant(self.system, value) } {
+            -1 => Err(FfiError::InvalidSystem),
+            handle => Ok(handle),
+        }
+    }
+
+    /// Have a dimension constraint take its value from an expression of
+    /// constants when the system is compiled for a batch, so that a batch
+    /// can change the constants rather than the dimensions. The expression
+    /// is in the native solver's syntax (see `CompiledExpr::to_native`),
+    /// with `$h` for the constant whose handle is h.
+    pub fn set_constraint_expression(&mut self, id: i32, expr: &str) -> Result<(), FfiError> {
+        let text = CString::new(expr)
+            .map_err(|_| FfiError::ConstraintFailed(format!("Bad expression: {}", expr)))?;
+        match unsafe { real_slvs_set_constraint_expression(self.system, id, text.as_ptr()) } {
+            0 => Ok(()),
+            _ => Err(FfiError::ConstraintFailed(format!(
+                "Bad expression: {}",
+                expr
+            ))),
+        }
+    }
+
+    /// Solve the system once for each row of values, reusing one compiled
+    /// system and spreading the rows over `workers` threads: a row has the
+    /// values of the given dimension constraints, and then of the given
+    /// constants. Each row starts from the positions the points were added
+    /// with, so the rows don't depend on each other.
+    pub fn solve_batch(
+        &mut self,
+        constraint_ids: &[i32],
+        constant_ids: &[i32],
+        values: &[Vec<f64>],
+        point_ids: &[i32],
+        workers: usize,
+    ) -> Result<Vec<BatchRow>, FfiError> {
+        self.sync_trace();
+        let rows = values.len();
+        let n = constraint_ids.len();
+        let mut flat = Vec::with_capacity(rows * n);
+        let mut constants = Vec::with_capacity(rows * constant_ids.len());
+        for row in values {
+            if row.len() != n + constant_ids.len() {
+                return Err(FfiError::ConstraintFailed(format!(
+                    "Batch row has {} values for {} constraints and {} constants",
+                    row.len(),
+                    n,
+                    constant_ids.len()
+                )));
+            }
+            flat.extend_from_slice(&row[..n]);
+            constants.extend_from_slice(&row[n..]);
+        }
+
+        let mut positions = vec![0.0; rows * point_ids.len() * 3];
+        let mut results = vec![0 as c_int; rows];
+        let mut dofs = vec![0 as c_int; rows];
+        let workers = workers.max(1).min(c_int::MAX as usize) as c_int;
+        unsafe {
+            let result = real_slvs_solve_batch(
+                self.system,
+                rows as c_int,
+                workers,
+                constraint_ids.as_ptr(),
+                constraint_ids.len() as c_int,
+                flat.as_ptr(),
+                constant_ids.as_ptr(),
+                constant_ids.len() as c_int,
+                constants.as_ptr(),
+                point_ids.as_ptr(),
+                point_ids.len() as c_int,
+                positions.as_mut_ptr(),
+                results.as_mut_ptr(),
+                dofs.as_mut_ptr(),
+            );
+            match result {
+                0 => {}
+                3 => return Err(FfiError::TooManyUnknowns),
+                -1 => {
+                    return Err(FfiError::ConstraintFailed(
+                        "Batch refers to a constraint or point not in the system".to_string(),
+                    ))
+                }
+                code => return Err(FfiError::Unknown(code)),
+            }
+        }
+
+        Ok((0..rows)
+            .map(|r| BatchRow {
+                result: row_result(results[r]),
+                dof: dofs[r],
+                positions: positions[r * point_ids.len() * 3..(r + 1) * point_ids.len() * 3]
+                    .chunks(3)
+                    .map(|p| (p[0], p[1], p[2]))
+                    .collect(),
+            })
+            .collect())
+    }
+
+    /// Follow the solution as one dimension constraint's value moves
+    /// through `values` in turn: the first is solved from the positions the
+    /// points were added with, and each one after by continuation from the
+    /// solution before it, which keeps to the same branch of solutions. A
+    /// value that can't be reached fails, and the next is tried from the
+    /// last point solved.
+    pub fn solve_track(
+        &mut self,
+        constraint_id: i32,
+        values: &[f64],
+        steps: TrackSteps,
+        point_ids: &[i32],
+    ) -> Result<Vec<TrackFrame>, FfiError> {
+        self.sync_trace();
+        let n = values.len();
+        let mut positions = vec![0.0; n * point_ids.len() * 3];
+        let mut results = vec![0 as c_int; n];
+        let mut dofs = vec![0 as c_int; n];
+        let mut iterations = vec![0 as c_int; n];
+        let mut taken = vec![0 as c_int; n];
+        unsafe {
+            let result = real_slvs_solve_track(
+                self.system,
+                constraint_id,
+                n.min(c_int::MAX as usize) as c_int,
+                values.as_ptr(),
+                steps.initial,
+                steps.min,
+                steps.max,
+                point_ids.as_ptr(),
+                point_ids.len() as c_int,
+                positions.as_mut_ptr(),
+                results.as_mut_ptr(),
+                dofs.as_mut_ptr(),
+                iterations.as_mut_ptr(),
+                taken.as_mut_ptr(),
+            );
+            match result {
+                0 => {}
+                3 => return Err(FfiError::TooManyUnknowns),
+                -1 => {
+                    return Err(FfiError::ConstraintFailed(format!(
+                        "Constraint {} isn't a dimension, or a point isn't in the system",
+                        constraint_id
+                    )))
+                }
+                code => return Err(FfiError::Unknown(code)),
+            }
+        }
+
+        Ok((0..n)
+            .map(|k| TrackFrame {
+                row: BatchRow {
+                    result: row_result(results[k]),
+                    dof: dofs[k],
+                    positions: positions[k * point_ids.len() * 3..(k + 1) * point_ids.len() * 3]
+                        .chunks(3)
+                        .map(|p| (p[0], p[1], p[2]))
+                        .collect(),
+                },
+                iterations: iterations[k],
+                steps: taken[k],
+            })
+            .collect())
+    }
+
+    /// The degrees of freedom left after the last solve, or -1 if it
+    /// didn't find them.
+    pub fn get_dof(&self) -> i32 {
+        unsafe { real_slvs_get_dof(self.system) }
+    }
+
+    /// What the last solve did: its iterations, residual, sizes and the time
+    /// it spent in each phase.
+    pub fn get_stats(&self) -> SolveStats {
+        let mut stats = SolveStats::default();
+        unsafe {
+            real_slvs_get_stats(self.system, &mut stats);
+        }
+        stats
+    }
+
+    /// Profile the solves that follow, or stop; see `get_costs`.
+    pub fn set_profile(&mut self, on: bool) {
+        unsafe {
+            real_slvs_set_profile(self.system, on as c_int);
+        }
+    }
+
+    /// What each constraint cost the last profiled solve, in the order of
+    /// their ids; empty if it wasn't profiled.
+    pub fn get_costs(&self) -> Vec<ConstraintCost> {
+        unsafe {
+            let n = real_slvs_get_costs(self.system, std::ptr::null_mut(), 0);
+            if n <= 0 {
+                return Vec::new();
+            }
+            let mut costs = vec![ConstraintCost::default(); n as usize];
+            let n = real_slvs_get_costs(self.system, costs.as_mut_ptr(), n);
+            costs.truncate(n.max(0) as usize);
+            costs
+        }
+    }
+
+    /// Read back everything in `wanted` with one call after a solve, in the
+    /// same order: `[x, y, z, 0]` for a point, `[cx, cy, cz, radius]` for a
+    /// circle, or `None` for one that isn't in the system.
+    pub fn get_positions(&self, wanted: &[Readback]) -> Vec<Option<[f64; 4]>> {
+        let mut out = Vec::new();
+        self.read_positions(wanted, &mut out);
+        out.chunks(4)
+            .map(|o| (!o[0].is_nan()).then(|| [o[0], o[1], o[2], o[3]]))
+            .collect()
+    }
+
+    /// Read back everything in `wanted` as `get_positions` does, but flat
+    /// into `out`, four values each, with NaNs for what isn't there
+    pub fn read_positions(&self, wanted: &[Readback], out: &mut Vec<f64>) {
+        self.read_positions_in(wanted, out, &mut PositionBuffers::default());
+    }
+
+    /// `read_positions`, with the arrays passed to the library kept in
+    /// `buffers`, so that reading back as much again allocates nothing
+    pub fn read_positions_in(
+        &self,
+        wanted: &[Readback],
+        out: &mut Vec<f64>,
+        buffers: &mut PositionBuffers,
+    ) {
+        let n = wanted.len().min(c_int::MAX as usize);
+        let PositionBuffers {
+            ids,
+            kinds,
+            results,
+        } = buffers;
+        ids.clear();
+        kinds.clear();
+        for w in &wanted[..n] {
+            let (id, kind) = w.raw();
+            ids.push(id);
+            kinds.push(kind);
+        }
+        out.clear();
+        out.resize(n * 4, 0.0);
+        results.clear();
+        results.resize(n, -1);
+        unsafe {
+            real_slvs_get_positions(
+                self.system,
+                ids.as_ptr(),
+                kinds.as_ptr(),
+                n as c_int,
+                out.as_mut_ptr(),
+                results.as_mut_ptr(),
+            );
+        }
+        for (o, &r) in out.chunks_mut(4).zip(results.iter()) {
+            if r != 0 {
+                o.fill(f64::NAN);
+            }
+        }
+        out.resize(wanted.len() * 4, f64::NAN);
+    }
+
     pub fn get_point_position(&self, id: i32) -> Result<(f64, f64, f64), String> {
         unsafe {
             let mut x = 0.0;
@@ -1278,6 +2215,49 @@ impl Solver {
         }
     }
 
+    /// Have each solve from now on also find how the solution moves with
+    /// the values of these dimension constraints, from the Jacobian at the
+    /// solution; an empty list turns that off.
+    pub fn set_sensitivities(&mut self, constraint_ids: &[i32]) -> Result<(), FfiError> {
+        unsafe {
+            let n = constraint_ids.len().min(c_int::MAX as usize) as c_int;
+            match real_slvs_set_sensitivities(self.system, constraint_ids.as_ptr(), n) {
+                0 => Ok(()),
+                _ => Err(FfiError::ConstraintFailed(
+                    "Failed to set sensitivities".to_string(),
+                )),
+            }
+        }
+    }
+
+    /// The rate at which a point's solved position moves with the value of
+    /// the `index`th constraint given to `set_sensitivities`, at the last
+    /// solve; zeros for a dimension that doesn't move it, or that isn't a
+    /// dimension at all.
+    pub fn get_point_sensitivity(
+        &self,
+        index: usize,
+        point_id: i32,
+    ) -> Result<(f64, f64, f64), String> {
+        unsafe {
+            let (mut dx, mut dy, mut dz) = (0.0, 0.0, 0.0);
+            let index = index.min(c_int::MAX as usize) as c_int;
+            let result = real_slvs_get_point_sensitivity(
+                self.system,
+                index,
+                point_id,
+                &mut dx,
+                &mut dy,
+                &mut dz,
+            );
+            if result == 0 {
+                Ok((dx, dy, dz))
+            } else {
+                Err(format!("No sensitivity {} for point {}", index, point_id))
+            }
+        }
+    }
+
     pub fn get_circle_position(&self, id: i32) -> Result<(f64, f64, f64, f64), String> {
         unsafe {
             let mut cx = 0.0;
@@ -1304,18 +2284,48 @@ impl Solver {
 
 impl Drop for Solver {
     fn drop(&mut self) {
-        unsafe {
-            if !self.system.is_null() {
-                real_slvs_destroy(self.system);
-                self.system = std::ptr::null_mut();
-            }
+        let system = std::mem::replace(&mut self.system, std::ptr::null_mut());
+        if system.is_null() {
+            return;
         }
+        // Kept for this thread's next solver if there's room, as new
+        let pooled = unsafe { real_slvs_reset(system) } == 0
+            && SYSTEM_POOL
+                .try_with(|pool| {
+                    let mut pool = pool.borrow_mut();
+                    if pool.0.len() < POOLED_SYSTEMS {
+                        pool.0.push(system);
+                        true
+                    } else {
+                        false
+                    }
+                })
+                .unwrap_or(false);
+        if !pooled {
+            unsafe { real_slvs_destroy(system) }
+        }
+    }
+}
+
+unsafe impl Send for Solver {}
+unsafe impl Sync for Solver {}
+
+/// Ends the solve running on a native system, from any thread; see
+/// `Solver::canceller`. It must not be used once the system is dropped.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct Canceller(*mut SolverSystem);
+
+// The native cancel only sets an atomic flag
+unsafe impl Send for Canceller {}
+unsafe impl Sync for Canceller {}
+
+impl Canceller {
+    /// The solve stops at its next check with `TimedOut`
+    pub(crate) unsafe fn cancel(self) {
+        real_slvs_cancel(self.0);
     }
 }
 
-unsafe impl Send for Solver {}
-unsafe impl Sync for Solver {}
-
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -1343,6 +2353,321 @@ mod tests {
         assert!((distance - 36.0).abs() < 0.001, "Point should be at distance 36 from origin");
     }
 
+    #[test]
+    fn test_pooled_system_starts_empty() {
+        for round in 0..3 {
+            let mut solver = Solver::new();
+            // Nothing of the last round's solver is left in its system
+            assert!(solver.get_point_position(2).is_err());
+            solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(2, 10.0, 0.0, 0.0, false).unwrap();
+            solver.add_fixed_constraint(1, 1, 0).unwrap();
+            solver
+                .add_distance_constraint(100, 1, 2, 20.0 + round as f64)
+                .unwrap();
+            solver.solve().unwrap();
+            let (x, y, z) = solver.get_point_position(2).unwrap();
+            assert!(((x * x + y * y + z * z).sqrt() - (20.0 + round as f64)).abs() < 0.001);
+        }
+    }
+
+    #[test]
+    fn test_get_positions_in_order() {
+        let mut solver = Solver::new();
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 10.0, 3.0, 2.0, false).unwrap();
+        solver
+            .add_circle(3, 5.0, 6.0, 0.0, 4.0, 0.0, 0.0, 1.0)
+            .unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_distance_constraint(100, 1, 2, 36.0).unwrap();
+        solver.solve().unwrap();
+
+        let got = solver.get_positions(&[
+            Readback::Circle(3),
+            Readback::None,
+            Readback::Point(2),
+            Readback::Point(999),
+            Readback::Point(1),
+        ]);
+        assert_eq!(got.len(), 5);
+        let (cx, cy, cz, r) = solver.get_circle_position(3).unwrap();
+        assert_eq!(got[0], Some([cx, cy, cz, r]));
+        assert_eq!(got[1], None);
+        let (x, y, z) = solver.get_point_position(2).unwrap();
+        assert_eq!(got[2], Some([x, y, z, 0.0]));
+        assert_eq!(got[3], None);
+        assert_eq!(got[4], Some([0.0, 0.0, 0.0, 0.0]));
+    }
+
+    #[test]
+    fn test_held_adds_match_direct_adds() {
+        fn build(solver: &mut Solver) {
+            solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(2, 10.0, 3.0, 2.0, false).unwrap();
+            solver.add_line(3, 1, 2).unwrap();
+            solver
+                .add_circle(4, 5.0, 6.0, 0.0, 4.0, 0.0, 0.0, 1.0)
+                .unwrap();
+            solver.add_fixed_constraint(1, 1, 0).unwrap();
+            solver.add_distance_constraint(100, 1, 2, 36.0).unwrap();
+            solver.add_diameter_constraint(101, 4, 12.0).unwrap();
+        }
+
+        let mut direct = Solver::new();
+        build(&mut direct);
+        direct.solve().unwrap();
+
+        let mut held = Solver::new();
+        held.hold_adds();
+        build(&mut held);
+        // Nothing's in the system until it's all added at once
+        assert!(held.get_point_position(2).is_err());
+        held.add_held().unwrap();
+        held.solve().unwrap();
+
+        let wanted = [Readback::Point(1), Readback::Point(2), Readback::Circle(4)];
+        assert_eq!(held.get_positions(&wanted), direct.get_positions(&wanted));
+        assert_eq!(held.get_dof(), direct.get_dof());
+
+        // A record of no kind fails, and says which one it was
+        let bad = ConstraintRecord::new(0, 7, &[], 0.0);
+        assert!(held.add_records(&[], &[bad]).is_err());
+    }
+
+    #[test]
+    fn test_update_records_moves_points_and_resets_values() {
+        let mut recorder = Solver::recorder();
+        recorder.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        recorder.add_point(2, 10.0, 0.0, 0.0, false).unwrap();
+        recorder.add_point(3, 0.0, 5.0, 0.0, false).unwrap();
+        recorder.add_fixed_constraint(1, 1, 0).unwrap();
+        recorder.add_fixed_constraint(2, 3, 0).unwrap();
+        recorder.add_distance_constraint(3, 1, 2, 10.0).unwrap();
+        let (entities, constraints) = recorder.take_held();
+
+        let mut solver = Solver::new();
+        solver.add_records(&entities, &constraints).unwrap();
+        solver.solve().unwrap();
+
+        // Move the fixed point and lengthen the distance, in place
+        let mut moved = entities[2];
+        moved.val[1] = -3.0;
+        let mut reset = constraints[2];
+        reset.val = 25.0;
+        solver.update_records(&[moved], &[reset]).unwrap();
+        solver.solve().unwrap();
+
+        let (x, y, z) = solver.get_point_position(2).unwrap();
+        assert!(((x * x + y * y + z * z).sqrt() - 25.0).abs() < 1e-6);
+        assert_eq!(solver.get_point_position(3).unwrap(), (0.0, -3.0, 0.0));
+
+        // Updating an entity that isn't there fails
+        let mut stray = entities[0];
+        stray.id = 99;
+        assert!(solver.update_records(&[stray], &[]).is_err());
+    }
+
+    #[test]
+    fn test_damped_solve_from_far_start() {
+        let mut solver = Solver::new();
+        solver.set_solver_options(1e-10, 200, true).unwrap();
+
+        // Start the free point a long way from where the distance puts it
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 1.0e4, -3.0e3, 2.0e3, false).unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_distance_constraint(100, 1, 2, 36.0).unwrap();
+
+        solver.solve().unwrap();
+
+        let (x, y, z) = solver.get_point_position(2).unwrap();
+        let distance = (x * x + y * y + z * z).sqrt();
+        assert!(
+            (distance - 36.0).abs() < 1e-6,
+            "Point should be at distance 36 from origin"
+        );
+    }
+
+    #[test]
+    fn test_cancel_before_a_solve_ends_it() {
+        let mut solver = Solver::new();
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 10.0, 3.0, 2.0, false).unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_distance_constraint(100, 1, 2, 25.0).unwrap();
+
+        // A cancel made before the solve starts isn't lost
+        unsafe { solver.canceller().cancel() };
+        assert!(matches!(solver.solve(), Err(FfiError::TimedOut)));
+        // And it's spent by that solve, so the next one runs
+        solver.solve().unwrap();
+    }
+
+    #[test]
+    fn test_solve_batch() {
+        let mut solver = Solver::new();
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 10.0, 3.0, 2.0, false).unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_distance_constraint(100, 1, 2, 36.0).unwrap();
+
+        let values = vec![vec![5.0], vec![10.0], vec![20.0], vec![40.0]];
+        let rows = solver.solve_batch(&[100], &[], &values, &[2], 2).unwrap();
+        assert_eq!(rows.len(), 4);
+        for (row, value) in rows.iter().zip(&values) {
+            assert!(row.result.is_ok());
+            let (x, y, z) = row.positions[0];
+            let distance = (x * x + y * y + z * z).sqrt();
+            assert!(
+                (distance - value[0]).abs() < 1e-6,
+                "Point should be at distance {}",
+                value[0]
+            );
+        }
+
+        assert!(solver.solve_batch(&[999], &[], &values, &[2], 1).is_err());
+
+        // The batch leaves the system as it was
+        solver.solve().unwrap();
+        let (x, y, z) = solver.get_point_position(2).unwrap();
+        assert!(((x * x + y * y + z * z).sqrt() - 36.0).abs() < 0.001);
+    }
+
+    #[test]
+    fn test_solve_batch_in_mixed_precision() {
+        // A triangle whose two free sides are swept
+        let solve = |mixed: bool| {
+            let mut solver = Solver::new();
+            solver.set_mixed_precision(mixed);
+            solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(2, 30.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(3, 12.0, 9.0, 0.0, false).unwrap();
+            solver.add_fixed_constraint(1, 1, 0).unwrap();
+            solver.add_fixed_constraint(2, 2, 0).unwrap();
+            solver.add_distance_constraint(100, 1, 3, 20.0).unwrap();
+            solver.add_distance_constraint(101, 2, 3, 20.0).unwrap();
+            let values: Vec<Vec<f64>> = (0..37)
+                .map(|i| vec![16.0 + i as f64 * 0.5, 35.0 - i as f64 * 0.25])
+                .collect();
+            solver
+                .solve_batch(&[100, 101], &[], &values, &[3], 2)
+                .unwrap()
+        };
+        let double = solve(false);
+        let mixed = solve(true);
+        for (d, m) in double.iter().zip(&mixed) {
+            assert!(d.result.is_ok() && m.result.is_ok());
+            let ((dx, dy, _), (mx, my, _)) = (d.positions[0], m.positions[0]);
+            assert!((dx - mx).abs() < 1e-6 && (dy - my).abs() < 1e-6);
+        }
+    }
+
+    #[test]
+    fn test_solve_batch_of_constants() {
+        let mut solver = Solver::new();
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 10.0, 3.0, 2.0, false).unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_distance_constraint(100, 1, 2, 36.0).unwrap();
+        let k = solver.add_constant(1.0).unwrap();
+        solver
+            .set_constraint_expression(100, &format!("(20 / ${})", k))
+            .unwrap();
+        assert!(solver.set_constraint_expression(100, "20 /").is_err());
+
+        let rows = solver
+            .solve_batch(&[], &[k], &[vec![1.0], vec![4.0], vec![0.0]], &[2], 2)
+            .unwrap();
+        for (row, distance) in rows.iter().zip([20.0, 5.0]) {
+            assert!(row.result.is_ok());
+            let (x, y, z) = row.positions[0];
+            assert!(((x * x + y * y + z * z).sqrt() - distance).abs() < 1e-6);
+        }
+        // 20 / 0 isn't a distance
+        assert!(rows[2].result.is_err());
+    }
+
+    #[test]
+    fn test_solve_track_keeps_branch() {
+        // arm2_end swings on a circle of radius 80 about the fixed pivot,
+        // at the given angle from the fixed arm1; both sides of arm1 solve.
+        let mut solver = Solver::new();
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 80.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(3, 60.0, -60.0, 0.0, false).unwrap();
+        solver.add_line(4, 1, 2).unwrap();
+        solver.add_line(5, 1, 3).unwrap();
+        solver.add_fixed_constraint(100, 1, 0).unwrap();
+        solver.add_fixed_constraint(101, 2, 0).unwrap();
+        solver.add_distance_constraint(102, 1, 3, 80.0).unwrap();
+        solver.add_angle_constraint(103, 4, 5, 45.0).unwrap();
+
+        let values: Vec<f64> = (0..=15).map(|i| 20.0 + 10.0 * i as f64).collect();
+        let frames = solver
+            .solve_track(103, &values, TrackSteps::default(), &[3])
+            .unwrap();
+        assert_eq!(frames.len(), values.len());
+        for (frame, angle) in frames.iter().zip(&values) {
+            assert!(frame.row.result.is_ok(), "{} should solve", angle);
+            let (x, y, _) = frame.row.positions[0];
+            assert!(((x * x + y * y).sqrt() - 80.0).abs() < 1e-6);
+            // Still below arm1, where the first value solved to
+            assert!(y < 0.0, "{} jumped to the other branch", angle);
+            assert!((x.atan2(-y).to_degrees() - (90.0 - angle)).abs() < 1e-6);
+        }
+        // Continuing from the frame before takes few iterations.
+        let later: i32 = frames[1..].iter().map(|f| f.iterations).sum();
+        assert!(
+            later <= 4 * (frames.len() as i32 - 1),
+            "took {} iterations",
+            later
+        );
+
+        assert!(solver
+            .solve_track(999, &values, TrackSteps::default(), &[3])
+            .is_err());
+    }
+
+    #[test]
+    fn test_point_sensitivities() {
+        // p3 is 80 from the fixed p1, at 30 degrees from the fixed line 4
+        let mut solver = Solver::new();
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 80.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(3, 60.0, 40.0, 0.0, false).unwrap();
+        solver.add_line(4, 1, 2).unwrap();
+        solver.add_line(5, 1, 3).unwrap();
+        solver.add_fixed_constraint(100, 1, 0).unwrap();
+        solver.add_fixed_constraint(101, 2, 0).unwrap();
+        solver.add_distance_constraint(102, 1, 3, 80.0).unwrap();
+        solver.add_angle_constraint(103, 4, 5, 30.0).unwrap();
+        solver.set_sensitivities(&[102, 103, 100]).unwrap();
+        solver.solve().unwrap();
+
+        // Along the arm per unit of length, and around the pivot per degree
+        let theta = 30f64.to_radians();
+        let (dx, dy, dz) = solver.get_point_sensitivity(0, 3).unwrap();
+        assert!((dx - theta.cos()).abs() < 1e-6 && (dy - theta.sin()).abs() < 1e-6);
+        assert!(dz.abs() < 1e-9);
+        let per_degree = 80.0 * std::f64::consts::PI / 180.0;
+        let (dx, dy, _) = solver.get_point_sensitivity(1, 3).unwrap();
+        assert!((dx + per_degree * theta.sin()).abs() < 1e-6, "{}", dx);
+        assert!((dy - per_degree * theta.cos()).abs() < 1e-6, "{}", dy);
+        // A fixed point moves with nothing, and a constraint without a value
+        // moves nothing.
+        assert_eq!(solver.get_point_sensitivity(0, 1).unwrap(), (0.0, 0.0, 0.0));
+        assert_eq!(solver.get_point_sensitivity(2, 3).unwrap(), (0.0, 0.0, 0.0));
+        assert!(solver.get_point_sensitivity(3, 3).is_err());
+    }
+
+    #[test]
+    fn test_invalid_solver_options() {
+        let mut solver = Solver::new();
+        assert!(solver.set_solver_options(-1.0, 50, false).is_err());
+        assert!(solver.set_solver_options(1e-8, 50, false).is_ok());
+    }
+
     #[test]
     fn test_angle_constraint_ffi_binding() {
         let mut solver = Solver::new();
@@ -1660,7 +2985,15 @@ mod tests {
         );
         assert_eq!(
             FfiError::TooManyUnknowns.to_string(),
-            "Too many unknowns (system is underconstrained)"
+            "Too many unknowns for the solver's limit"
+        );
+        assert_eq!(
+            FfiError::TimedOut.to_string(),
+            "Solver ran past its time limit"
+        );
+        assert_eq!(
+            FfiError::ResourceExhausted.to_string(),
+            "Solver ran past its memory budget"
         );
         assert_eq!(
             FfiError::InvalidSystem.to_string(),
@@ -1823,6 +3156,30 @@ mod tests {
         assert!(result.is_ok(), "Should be able to add diameter constraint via FFI");
     }
 
+    #[test]
+    fn test_gear_mesh_constraint_ffi_binding() {
+        let mut solver = Solver::new();
+
+        // A sun and a ring as pitch circles
+        solver
+            .add_circle(10, 0.0, 0.0, 0.0, 12.0, 0.0, 0.0, 1.0)
+            .unwrap();
+        solver
+            .add_circle(20, 0.0, 0.0, 0.0, 36.0, 0.0, 0.0, 1.0)
+            .unwrap();
+
+        let result = solver.add_gear_mesh_constraint(100, 10, 20, 24, -72, 1.0);
+        assert!(
+            result.is_ok(),
+            "Should be able to add gear mesh constraint via FFI"
+        );
+        let result = solver.add_gear_mesh_constraint(101, 10, 20, 24, -24, 1.0);
+        assert!(
+            result.is_err(),
+            "Gears with no centre distance should be rejected"
+        );
+    }
+
     #[test]
     fn test_diameter_constraint_with_solve() {
         // Minimal reproduction of the diameter constraint issue
@@ -2232,4 +3589,531 @@ mod tests {
         let result = solver.add_where_dragged_constraint(100, 2, Some(10));
         assert!(result.is_ok(), "Should be able to add WHERE_DRAGGED constraint for 2D point via FFI");
     }
+
+    /// Points on a rows x cols grid, a little off their spacing of 10, with
+    /// distances between neighbours and a fixed corner. It's underconstrained,
+    /// but one connected block with three unknowns a point.
+    fn build_grid(solver: &mut Solver, rows: i32, cols: i32) {
+        for i in 0..rows {
+            for j in 0..cols {
+                let (fi, fj) = (i as f64, j as f64);
+                let x = 10.0 * fj + 0.2 * (0.7 * fi + fj).sin();
+                let y = 10.0 * fi + 0.2 * (fi - 0.3 * fj).cos();
+                solver
+                    .add_point(i * cols + j + 1, x, y, 0.0, false)
+                    .unwrap();
+            }
+        }
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+
+        let mut constraint_id = 2;
+        for i in 0..rows {
+            for j in 0..cols {
+                let id = i * cols + j + 1;
+                if j + 1 < cols {
+                    solver
+                        .add_distance_constraint(constraint_id, id, id + 1, 10.0)
+                        .unwrap();
+                    constraint_id += 1;
+                }
+                if i + 1 < rows {
+                    solver
+                        .add_distance_constraint(constraint_id, id, id + cols, 10.0)
+                        .unwrap();
+                    constraint_id += 1;
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn test_max_unknowns_limit() {
+        // The limit goes by equations, and a 4 x 4 grid has 24 distances
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 4, 4);
+        solver.set_max_unknowns(16);
+        assert!(matches!(solver.solve(), Err(FfiError::TooManyUnknowns)));
+        // It says how big the block was; the fixed corner isn't in it
+        let stats = solver.get_stats();
+        assert_eq!(stats.largest_block_equations, 24);
+        assert_eq!(stats.largest_block_unknowns, 45);
+
+        solver.set_max_unknowns(0);
+        solver.solve().unwrap();
+        let (x1, y1, z1) = solver.get_point_position(1).unwrap();
+        let (x2, y2, z2) = solver.get_point_position(2).unwrap();
+        let d = ((x2 - x1).powi(2) + (y2 - y1).powi(2) + (z2 - z1).powi(2)).sqrt();
+        assert!(
+            (d - 10.0).abs() < 1e-6,
+            "Neighbours should be 10 apart, got {}",
+            d
+        );
+    }
+
+    #[test]
+    fn test_max_unknowns_limit_goes_by_block() {
+        // Two chains of 10 points, with 18 distances between them in all,
+        // but only 9 in each
+        let mut solver = Solver::new();
+        for chain in 0..2 {
+            for i in 0..10 {
+                let id = chain * 10 + i + 1;
+                solver
+                    .add_point(id, 10.0 * i as f64, 5.0 * chain as f64, 0.0, false)
+                    .unwrap();
+                if i > 0 {
+                    solver
+                        .add_distance_constraint(100 + id, id - 1, id, 9.0)
+                        .unwrap();
+                }
+            }
+        }
+        solver.set_max_unknowns(12);
+        solver.solve().unwrap();
+        assert_eq!(solver.get_stats().largest_block_equations, 9);
+
+        solver.set_max_unknowns(9);
+        assert!(matches!(solver.solve(), Err(FfiError::TooManyUnknowns)));
+    }
+
+    #[test]
+    fn test_chord_steps_reuse_the_jacobian() {
+        // A chain of 40 points a tenth too close together, which is too big
+        // a block to be solved as a small one
+        let build = |chord: bool| {
+            let mut solver = Solver::new();
+            solver.set_chord_steps(chord);
+            for i in 0..40 {
+                let id = i + 1;
+                let y = if i % 2 == 0 { 0.0 } else { 3.0 };
+                solver.add_point(id, 9.0 * i as f64, y, 0.0, false).unwrap();
+                if i > 0 {
+                    solver
+                        .add_distance_constraint(100 + id, id - 1, id, 10.0)
+                        .unwrap();
+                }
+            }
+            solver.solve().unwrap();
+            solver
+        };
+        let every = build(false);
+        let chord = build(true);
+        assert_eq!(every.get_stats().reused_steps, 0);
+        assert!(chord.get_stats().reused_steps > 0);
+
+        // Both meet the distances
+        for solver in [&every, &chord] {
+            for id in 2..=40 {
+                let (x0, y0, z0) = solver.get_point_position(id - 1).unwrap();
+                let (x1, y1, z1) = solver.get_point_position(id).unwrap();
+                let d = ((x1 - x0).powi(2) + (y1 - y0).powi(2) + (z1 - z0).powi(2)).sqrt();
+                assert!((d - 10.0).abs() < 1e-6);
+            }
+        }
+    }
+
+    #[test]
+    fn test_staged_start_solves_a_scattered_triangle() {
+        // A 3-4-5 right triangle whose free corners start far from it
+        let mut solver = Solver::new();
+        solver.set_staged_start(true);
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, -40.0, 25.0, 7.0, false).unwrap();
+        solver.add_point(3, 31.0, -12.0, -20.0, false).unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_line(10, 1, 2).unwrap();
+        solver.add_line(11, 1, 3).unwrap();
+        solver.add_distance_constraint(20, 1, 2, 3.0).unwrap();
+        solver.add_distance_constraint(21, 1, 3, 4.0).unwrap();
+        solver.add_perpendicular_constraint(22, 10, 11).unwrap();
+        solver.solve().unwrap();
+
+        let (x2, y2, z2) = solver.get_point_position(2).unwrap();
+        let (x3, y3, z3) = solver.get_point_position(3).unwrap();
+        let d = ((x3 - x2).powi(2) + (y3 - y2).powi(2) + (z3 - z2).powi(2)).sqrt();
+        assert!((d - 5.0).abs() < 1e-6);
+        assert!(solver.get_stats().iterations > 1);
+    }
+
+    #[test]
+    fn test_multi_start_recovers_from_a_singular_start() {
+        // A point that starts on top of both of the fixed points it has to
+        // be 5 from, where the distances have no direction
+        let build = |starts: u32| {
+            let mut solver = Solver::new();
+            solver.set_multi_start(starts);
+            solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(2, 0.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(3, 10.0, 0.0, 0.0, false).unwrap();
+            solver.add_fixed_constraint(1, 1, 0).unwrap();
+            solver.add_fixed_constraint(2, 3, 0).unwrap();
+            solver.add_distance_constraint(101, 1, 2, 5.0).unwrap();
+            solver.add_distance_constraint(102, 3, 2, 5.0).unwrap();
+            solver
+        };
+        assert!(build(0).solve().is_err());
+
+        let mut solver = build(8);
+        solver.solve().unwrap();
+        let (x, _, _) = solver.get_point_position(2).unwrap();
+        assert!((x - 5.0).abs() < 1e-6);
+    }
+
+    #[test]
+    fn test_check_evaluates_without_solving() {
+        let build = |distance: f64| {
+            let mut solver = Solver::new();
+            solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(2, 3.0, 4.0, 0.0, false).unwrap();
+            solver.add_fixed_constraint(1, 1, 0).unwrap();
+            solver.add_distance_constraint(101, 1, 2, distance).unwrap();
+            solver
+        };
+        let (ok, residuals) = build(5.0).check().unwrap();
+        assert!(ok);
+        assert_eq!(residuals.iter().map(|r| r.0).collect::<Vec<_>>(), [1, 101]);
+
+        let mut solver = build(6.0);
+        let (ok, residuals) = solver.check().unwrap();
+        assert!(!ok);
+        assert!((residuals[1].1 - 1.0).abs() < 1e-12);
+        // Nothing moved
+        assert_eq!(solver.get_point_position(2).unwrap(), (3.0, 4.0, 0.0));
+    }
+
+    #[test]
+    fn test_rank_is_taken_at_the_solution() {
+        // The parallel lines are one line both ways round, whose equations
+        // only become dependent at the solution; the rank there leaves the
+        // two distances and seven degrees of freedom.
+        let mut solver = Solver::new();
+        solver.add_point(1, 89.58, 38.56, 91.63, false).unwrap();
+        solver.add_point(2, 23.12, 47.95, 86.17, false).unwrap();
+        solver.add_point(3, 11.54, 3.28, 1.91, false).unwrap();
+        solver.add_point(4, 14.53, 85.69, 65.58, false).unwrap();
+        solver.add_line(5, 2, 1).unwrap();
+        solver.add_line(6, 1, 2).unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_distance_constraint(2, 2, 4, 47.7194).unwrap();
+        solver.add_distance_constraint(3, 2, 3, 82.1676).unwrap();
+        solver.add_parallel_constraint(4, 5, 6).unwrap();
+        // Redundant, which the wrapper doesn't count as a success
+        let _ = solver.solve();
+        assert_eq!(solver.get_dof(), 7);
+    }
+
+    #[test]
+    fn test_solve_stats() {
+        // 12 distances on 9 points, and three equations to fix the first
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 3, 3);
+        solver.solve().unwrap();
+
+        let stats = solver.get_stats();
+        assert!(stats.iterations > 0);
+        assert!(stats.residual < 1e-6);
+        assert_eq!(stats.equations, 15);
+        assert!(stats.unknowns >= 24);
+        assert!(stats.jacobian_non_zeros > 0);
+        assert!(stats.write_equations_ms >= 0.0 && stats.step_ms >= 0.0);
+        assert!(solver.get_dof() > 0);
+
+        // What it took in memory, and that a distance is the costliest to write
+        assert!(stats.exprs_allocated > 0);
+        assert!(stats.temporary_bytes >= stats.exprs_allocated);
+        assert!(stats.temporary_peak_bytes > 0);
+        assert!(stats.jacobian_entries >= stats.jacobian_non_zeros);
+        assert!((2..=13).contains(&stats.heaviest_constraint));
+        assert!(stats.heaviest_constraint_exprs > 0);
+
+        // The distances are written from kernels, and the fixed corner is
+        // pinned rather than solved for, so it takes a perpendicular to have
+        // an equation copied and folded
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 3, 3);
+        solver.add_line(100, 1, 2).unwrap();
+        solver.add_line(101, 1, 4).unwrap();
+        solver.add_perpendicular_constraint(50, 100, 101).unwrap();
+        solver.solve().unwrap();
+        let stats = solver.get_stats();
+        assert!(stats.source_nodes > 0 && stats.folded_nodes > 0 && stats.partial_nodes > 0);
+    }
+
+    #[test]
+    fn test_rigid_triangle_is_placed() {
+        // A 3-4-5 triangle drawn nowhere near true, with its first point fixed
+        let mut solver = Solver::new();
+        solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+        solver.add_point(2, 1.0, 0.5, 0.0, false).unwrap();
+        solver.add_point(3, 0.2, 9.0, 0.0, false).unwrap();
+        solver.add_fixed_constraint(1, 1, 0).unwrap();
+        solver.add_distance_constraint(2, 1, 2, 3.0).unwrap();
+        solver.add_distance_constraint(3, 2, 3, 5.0).unwrap();
+        solver.add_distance_constraint(4, 1, 3, 4.0).unwrap();
+        solver.solve().unwrap();
+
+        let stats = solver.get_stats();
+        assert_eq!(stats.rigid_clusters, 1);
+        assert!(stats.place_ms >= 0.0);
+        // Placed in closed form, and the fixed point pinned, so Newton's
+        // method takes just the one step that finds it true
+        assert_eq!(stats.iterations, 1);
+        let (bx, by, bz) = solver.get_point_position(2).unwrap();
+        let (cx, cy, cz) = solver.get_point_position(3).unwrap();
+        assert!(((bx * bx + by * by).sqrt() - 3.0).abs() < 1e-9);
+        assert!(((cx * cx + cy * cy).sqrt() - 4.0).abs() < 1e-9);
+        assert!(((cx - bx).hypot(cy - by) - 5.0).abs() < 1e-9);
+        // Kept in its plane, pointing the way it was drawn, on the same side
+        assert!(bz.abs() < 1e-12 && cz.abs() < 1e-12);
+        assert!((by / bx - 0.5).abs() < 1e-9);
+        assert!(bx * cy - by * cx > 0.0);
+    }
+
+    #[test]
+    fn test_copies_are_solved_once() {
+        // Three copies of a chain of four points, each pinned at its first
+        // point, and the last one pulled out of shape
+        let mut solver = Solver::new();
+        let mut constraint_id = 1;
+        for copy in 0..3 {
+            let base = copy * 4 + 1;
+            let (ox, oy) = (50.0 * copy as f64, 20.0);
+            let stretch = if copy == 2 { 3.0 } else { 0.0 };
+            let pts = [(0.0, 0.0), (9.0, 1.0), (17.0, -2.0), (26.0 + stretch, 0.5)];
+            for (k, (x, y)) in pts.iter().enumerate() {
+                solver
+                    .add_point(base + k as i32, ox + x, oy + y, 0.0, false)
+                    .unwrap();
+            }
+            solver.add_fixed_constraint(constraint_id, base, 0).unwrap();
+            constraint_id += 1;
+            for k in 0..3 {
+                solver
+                    .add_distance_constraint(constraint_id, base + k, base + k + 1, 10.0)
+                    .unwrap();
+                constraint_id += 1;
+            }
+        }
+        solver.solve().unwrap();
+
+        // The second copy is put in place from the first; the third started
+        // from a different shape, so is solved for itself
+        assert_eq!(solver.get_stats().copied_blocks, 1);
+        let at = |id| solver.get_point_position(id).unwrap();
+        for copy in 0..3 {
+            let base = copy * 4 + 1;
+            assert_eq!(at(base), (50.0 * copy as f64, 20.0, 0.0));
+            for k in 0..3 {
+                let (a, b) = (at(base + k), at(base + k + 1));
+                let d = ((a.0 - b.0).powi(2) + (a.1 - b.1).powi(2) + (a.2 - b.2).powi(2)).sqrt();
+                assert!((d - 10.0).abs() < 1e-6, "copy {} link {}: {}", copy, k, d);
+            }
+        }
+        let (first, second) = (at(4), at(8));
+        assert!((second.0 - first.0 - 50.0).abs() < 1e-9 && (second.1 - first.1).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_planar_sketch_solves_in_2d() {
+        // A right angle with a circle on its end and one free of it, with a
+        // point held on that, built in 3D and in the sketch plane
+        let sketch = |planar: bool| {
+            let mut solver = Solver::new();
+            if planar {
+                solver.set_planar().unwrap();
+            }
+            solver.add_point(1, 0.0, 0.0, 0.0, false).unwrap();
+            solver.add_point(2, 9.0, 1.0, 0.0, false).unwrap();
+            solver.add_point(3, 1.0, 7.0, 0.0, false).unwrap();
+            solver.add_point(4, 22.0, 8.0, 0.0, false).unwrap();
+            solver.add_line(5, 1, 2).unwrap();
+            solver.add_line(6, 1, 3).unwrap();
+            solver
+                .add_circle(7, 20.0, 5.0, 0.0, 3.0, 0.0, 0.0, 1.0)
+                .unwrap();
+            solver
+                .add_circle_with_center_point(8, 2, 2.0, 0.0, 0.0, 1.0)
+                .unwrap();
+            solver.add_fixed_constraint(1, 1, 0).unwrap();
+            solver.add_distance_constraint(2, 1, 2, 10.0).unwrap();
+            solver.add_distance_constraint(3, 1, 3, 6.0).unwrap();
+            solver.add_perpendicular_constraint(4, 5, 6).unwrap();
+            solver.add_point_on_circle_constraint(5, 4, 7).unwrap();
+            solver.solve().unwrap();
+            solver
+        };
+        let (solid, flat) = (sketch(false), sketch(true));
+
+        // Two unknowns a point rather than three, and no normals to solve for
+        let (s, f) = (solid.get_stats(), flat.get_stats());
+        assert!(f.unknowns < s.unknowns && f.equations < s.equations);
+        // The right angle is determined, so it's where it was; the circle
+        // and the point on it aren't, but the point's still on it
+        for id in 1..=3 {
+            let (a, b) = (
+                solid.get_point_position(id).unwrap(),
+                flat.get_point_position(id).unwrap(),
+            );
+            assert!((a.0 - b.0).abs() < 1e-9 && (a.1 - b.1).abs() < 1e-9 && b.2 == 0.0);
+        }
+        let (cx, cy, cz, r) = flat.get_circle_position(7).unwrap();
+        let (px, py, _) = flat.get_point_position(4).unwrap();
+        assert!(((px - cx).hypot(py - cy) - r).abs() < 1e-9 && cz == 0.0);
+        let (x, y, _) = flat.get_point_position(2).unwrap();
+        assert!((x.hypot(y) - 10.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_constraint_costs() {
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 3, 3);
+        solver.set_profile(true);
+        solver.solve().unwrap();
+        let costs = solver.get_costs();
+        // The fixed point's and all 12 distances, by id
+        let ids: Vec<u32> = costs.iter().map(|c| c.id).collect();
+        assert_eq!(ids, (1..=13).collect::<Vec<u32>>());
+        for c in &costs[1..] {
+            assert!(c.expr_nodes > 0, "{:?}", c);
+            // A distance's row has an entry for each of its points' coordinates
+            assert!(
+                c.jacobian_non_zeros > 0 && c.jacobian_non_zeros <= 6,
+                "{:?}",
+                c
+            );
+            assert!(c.eval_ms >= 0.0);
+        }
+        // The grid starts out of true
+        assert!(costs.iter().any(|c| c.iterations_above_tolerance > 0));
+
+        solver.set_profile(false);
+        solver.solve().unwrap();
+        assert!(solver.get_costs().is_empty());
+    }
+
+    #[test]
+    fn test_solve_timeout() {
+        // Far too big to solve in a millisecond
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 60, 60);
+        solver.set_max_unknowns(0);
+        let start = solver.get_point_position(2).unwrap();
+        solver.set_timeout(1);
+        assert!(matches!(solver.solve(), Err(FfiError::TimedOut)));
+        assert_eq!(solver.get_point_position(2).unwrap(), start);
+
+        solver.set_timeout(0);
+        solver.solve().unwrap();
+    }
+
+    #[test]
+    fn test_solve_memory_budget() {
+        // Far more than a kilobyte of expressions to solve
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 20, 20);
+        solver.set_max_unknowns(0);
+        let start = solver.get_point_position(2).unwrap();
+        solver.set_memory_budget(1024);
+        assert!(matches!(solver.solve(), Err(FfiError::ResourceExhausted)));
+        assert_eq!(solver.get_point_position(2).unwrap(), start);
+
+        solver.set_memory_budget(0);
+        solver.solve().unwrap();
+    }
+
+    #[test]
+    fn test_trace_callback() {
+        unsafe extern "C" fn record(event: *const TraceEvent, user: *mut c_void) {
+            let events = &mut *(user as *mut Vec<TraceEvent>);
+            events.push(*event);
+        }
+
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 3, 3);
+        let mut events: Vec<TraceEvent> = Vec::new();
+        unsafe {
+            solver.set_trace_callback(Some(record), &mut events as *mut _ as *mut c_void);
+        }
+        solver.solve().unwrap();
+        unsafe { solver.set_trace_callback(None, std::ptr::null_mut()) };
+
+        // The solve opens first and closes last, and every phase in it closes
+        let first = events.first().unwrap();
+        let last = events.last().unwrap();
+        assert_eq!((first.phase, first.begin), (SolvePhase::Solve as c_int, 1));
+        assert_eq!((last.phase, last.begin), (SolvePhase::Solve as c_int, 0));
+        assert!(last.time_ns >= first.time_ns);
+        let mut open = Vec::new();
+        for event in &events {
+            if event.begin != 0 {
+                open.push(event.phase);
+            } else {
+                assert_eq!(open.pop(), Some(event.phase));
+            }
+        }
+        assert!(open.is_empty());
+        assert!(events
+            .iter()
+            .any(|e| e.phase == SolvePhase::Newton as c_int && e.begin == 0));
+        assert!(last.unknowns > 0);
+        assert!(last.exprs_allocated >= first.exprs_allocated);
+
+        let seen = events.len();
+        solver.solve().unwrap();
+        assert_eq!(events.len(), seen);
+    }
+
+    #[test]
+    fn test_trace_steps() {
+        unsafe extern "C" fn record(event: *const TraceEvent, user: *mut c_void) {
+            let events = &mut *(user as *mut Vec<TraceEvent>);
+            events.push(*event);
+        }
+
+        let mut solver = Solver::new();
+        build_grid(&mut solver, 3, 3);
+        let mut events: Vec<TraceEvent> = Vec::new();
+        unsafe {
+            solver.set_trace_callback(Some(record), &mut events as *mut _ as *mut c_void);
+        }
+        solver.set_trace_steps(true);
+        solver.solve().unwrap();
+        unsafe { solver.set_trace_callback(None, std::ptr::null_mut()) };
+
+        // The steps count up, and the residual falls, to where Newton ends
+        let steps: Vec<&TraceEvent> = events
+            .iter()
+            .filter(|e| e.phase == SolvePhase::NewtonStep as c_int)
+            .collect();
+        assert!(!steps.is_empty());
+        for (n, step) in steps.iter().enumerate() {
+            assert_eq!(step.iterations, n as c_int + 1);
+        }
+        assert!(steps.last().unwrap().residual < steps[0].residual);
+        let newton = events
+            .iter()
+            .find(|e| e.phase == SolvePhase::Newton as c_int && e.begin == 0)
+            .unwrap();
+        assert_eq!(newton.iterations, steps.last().unwrap().iterations);
+    }
+
+    /// Solve time against the number of unknowns, with no limit on them. Run
+    /// with `cargo test --release scaling -- --ignored --nocapture`.
+    #[test]
+    #[ignore]
+    fn test_solve_scaling() {
+        for &(rows, cols) in &[(10, 10), (20, 20), (40, 40), (60, 60), (100, 100)] {
+            let mut solver = Solver::new();
+            solver.set_max_unknowns(0);
+            build_grid(&mut solver, rows, cols);
+
+            let start = std::time::Instant::now();
+            solver.solve().unwrap();
+            println!(
+                "{:>6} unknowns: {:>10.1} ms",
+                3 * rows * cols,
+                start.elapsed().as_secs_f64() * 1000.0
+            );
+        }
+    }
 }
@@ -0,0 +1,377 @@
+//! A document's entity ids, interned once and shared by everything that
+//! checks or follows references between its entities and constraints.
+//!
+//! The table borrows the ids from the document, and a constraint's
+//! references are walked in place (see `Constraint::refs`), so looking
+//! references up allocates nothing.
+
+use crate::ir::{CoincidentData, Constraint, Entity, InputDocument};
+use std::collections::HashMap;
+
+/// What kind of entity an id names, as far as references care
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum EntityKind {
+    Point,
+    Line,
+    Circle,
+    Arc,
+    Plane,
+    Cubic,
+}
+
+impl EntityKind {
+    pub fn of(entity: &Entity) -> Self {
+        match entity {
+            Entity::Point { .. } | Entity::Point2D { .. } => EntityKind::Point,
+            Entity::Line { .. } | Entity::Line2D { .. } => EntityKind::Line,
+            Entity::Circle { .. } => EntityKind::Circle,
+            Entity::Arc { .. } => EntityKind::Arc,
+            Entity::Plane { .. } => EntityKind::Plane,
+            Entity::Cubic { .. } => EntityKind::Cubic,
+        }
+    }
+
+    pub fn name(self) -> &'static str {
+        match self {
+            EntityKind::Point => "point",
+            EntityKind::Line => "line",
+            EntityKind::Circle => "circle",
+            EntityKind::Arc => "arc",
+            EntityKind::Plane => "plane",
+            EntityKind::Cubic => "cubic",
+        }
+    }
+}
+
+/// A document's entity ids, each with its entity's index and kind
+#[derive(Debug, Default)]
+pub struct IdTable<'a> {
+    ids: HashMap<&'a str, (usize, EntityKind)>,
+}
+
+impl<'a> IdTable<'a> {
+    /// Every entity in the document; of entities sharing an id, the first
+    pub fn new(doc: &'a InputDocument) -> Self {
+        let mut table = Self::with_capacity(doc.entities.len());
+        for (idx, entity) in doc.entities.iter().enumerate() {
+            table.insert(idx, entity);
+        }
+        table
+    }
+
+    pub fn with_capacity(capacity: usize) -> Self {
+        Self {
+            ids: HashMap::with_capacity(capacity),
+        }
+    }
+
+    /// Add the entity at `idx`, unless its id is already taken
+    pub fn insert(&mut self, idx: usize, entity: &'a Entity) -> bool {
+        use std::collections::hash_map::Entry;
+        match self.ids.entry(entity.id()) {
+            Entry::Occupied(_) => false,
+            Entry::Vacant(slot) => {
+                slot.insert((idx, EntityKind::of(entity)));
+                true
+            }
+        }
+    }
+
+    pub fn contains(&self, id: &str) -> bool {
+        self.ids.contains_key(id)
+    }
+
+    pub fn index(&self, id: &str) -> Option<usize> {
+        self.ids.get(id).map(|&(idx, _)| idx)
+    }
+
+    pub fn kind(&self, id: &str) -> Option<EntityKind> {
+        self.ids.get(id).map(|&(_, kind)| kind)
+    }
+
+    pub fn len(&self) -> usize {
+        self.ids.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.ids.is_empty()
+    }
+
+    /// The ids, sorted, for listing in messages
+    pub fn sorted(&self) -> Vec<&'a str> {
+        let mut ids: Vec<&'a str> = self.ids.keys().copied().collect();
+        ids.sort_unstable();
+        ids
+    }
+}
+
+/// A document's entities as they're built into a native system: each id
+/// interned to its entity's index, in document order, and by index the
+/// native handle each entity made. Once built, everything after works on
+/// indices, and ids are only hashed to look up a reference.
+#[derive(Debug, Clone, Default)]
+pub struct EntityIndex {
+    /// Entity id to entity index; of entities sharing an id, the last
+    ids: HashMap<String, u32>,
+    /// Entity index to the native handle it made
+    handles: Vec<i32>,
+    /// Entity index to the native point a circle is centred on, or 0
+    centres: Vec<i32>,
+    /// The indices of the points each entity is made from, in order,
+    /// starting at `starts[idx]`
+    points: Vec<u32>,
+    starts: Vec<u32>,
+}
+
+impl EntityIndex {
+    pub fn with_capacity(capacity: usize) -> Self {
+        Self {
+            ids: HashMap::with_capacity(capacity),
+            handles: Vec::with_capacity(capacity),
+            centres: Vec::with_capacity(capacity),
+            points: Vec::new(),
+            starts: Vec::with_capacity(capacity + 1),
+        }
+    }
+
+    /// The next entity, which made `handle`, made from the points referred
+    /// to (see `refer`) since the last one
+    pub fn push(&mut self, id: &str, handle: i32) {
+        let idx = self.handles.len() as u32;
+        if self.starts.is_empty() {
+            self.starts.push(0);
+        }
+        self.ids.insert(id.to_string(), idx);
+        self.handles.push(handle);
+        self.centres.push(0);
+        self.starts.push(self.points.len() as u32);
+    }
+
+    /// The native handle of the entity with this id
+    pub fn get(&self, id: &str) -> Option<i32> {
+        self.ids.get(id).map(|&idx| self.handles[idx as usize])
+    }
+
+    /// The native handle of a point the next entity is made from
+    pub fn refer(&mut self, id: &str) -> Option<i32> {
+        let idx = *self.ids.get(id)?;
+        self.points.push(idx);
+        Some(self.handles[idx as usize])
+    }
+
+    /// The index of the entity with this id
+    pub fn index(&self, id: &str) -> Option<usize> {
+        self.ids.get(id).map(|&idx| idx as usize)
+    }
+
+    pub fn len(&self) -> usize {
+        self.handles.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.handles.is_empty()
+    }
+
+    /// The native handle the entity at `idx` made
+    pub fn handle(&self, idx: usize) -> i32 {
+        self.handles[idx]
+    }
+
+    /// Centre the last entity, a circle, on the native point `handle`
+    pub fn centre_last(&mut self, handle: i32) {
+        if let Some(centre) = self.centres.last_mut() {
+            *centre = handle;
+        }
+    }
+
+    /// The native point the circle at `idx` is centred on, if it's centred
+    /// on a point entity
+    pub fn centre(&self, idx: usize) -> Option<i32> {
+        Some(self.centres[idx]).filter(|&h| h != 0)
+    }
+
+    /// The indices of the points the entity at `idx` is made from
+    pub fn points(&self, idx: usize) -> &[u32] {
+        &self.points[self.starts[idx] as usize..self.starts[idx + 1] as usize]
+    }
+}
+
+/// The ids a constraint references, in order: up to four named fields,
+/// then a list
+#[derive(Debug, Clone)]
+pub struct Refs<'a> {
+    fields: [Option<&'a str>; 4],
+    next: usize,
+    list: std::slice::Iter<'a, String>,
+}
+
+impl<'a> Refs<'a> {
+    fn new(fields: &[&'a String], list: &'a [String]) -> Self {
+        let mut refs = Self {
+            fields: [None; 4],
+            next: 0,
+            list: list.iter(),
+        };
+        for (slot, field) in refs.fields.iter_mut().zip(fields) {
+            *slot = Some(field.as_str());
+        }
+        refs
+    }
+}
+
+impl<'a> Iterator for Refs<'a> {
+    type Item = &'a str;
+
+    fn next(&mut self) -> Option<&'a str> {
+        if let Some(Some(field)) = self.fields.get(self.next) {
+            self.next += 1;
+            return Some(field);
+        }
+        self.list.next().map(|s| s.as_str())
+    }
+}
+
+impl Constraint {
+    /// The ids of the entities this constraint references
+    pub fn refs(&self) -> Refs<'_> {
+        fn with<'a>(fixed: &[&'a String], optional: &'a Option<String>) -> Refs<'a> {
+            let mut refs = Refs::new(fixed, &[]);
+            refs.fields[fixed.len()] = optional.as_deref();
+            refs
+        }
+
+        match self {
+            Constraint::Coincident { data } => match data {
+                CoincidentData::PointOnLine { at, of } => Refs::new(&[at], of),
+                CoincidentData::TwoEntities { entities } => Refs::new(&[], entities),
+            },
+            Constraint::Distance { between, .. } | Constraint::Angle { between, .. } => {
+                Refs::new(&[], between)
+            }
+            Constraint::Perpendicular { a, b }
+            | Constraint::EqualRadius { a, b }
+            | Constraint::Tangent { a, b }
+            | Constraint::SameOrientation { a, b }
+            | Constraint::CubicLineTangent { cubic: a, line: b } => Refs::new(&[a, b], &[]),
+            Constraint::Parallel { entities } | Constraint::EqualLength { entities, .. } => {
+                Refs::new(&[], entities)
+            }
+            Constraint::EqualAngle { lines } | Constraint::EqualAngles { lines, .. } => {
+                Refs::new(&[], lines)
+            }
+            Constraint::Collinear { points } => Refs::new(&[], points),
+            Constraint::Horizontal { a, workplane } | Constraint::Vertical { a, workplane } => {
+                Refs::new(&[a, workplane], &[])
+            }
+            Constraint::Fixed { entity, workplane } => with(&[entity], workplane),
+            Constraint::Dragged { point, workplane } => with(&[point], workplane),
+            Constraint::PointOnLine {
+                point,
+                line,
+                workplane,
+            } => with(&[point, line], workplane),
+            Constraint::Diameter { circle, .. } => Refs::new(&[circle], &[]),
+            Constraint::PointLineDistance { point, line, .. }
+            | Constraint::EqualLengthPointLineDistance { point, line, .. }
+            | Constraint::PointOnCircle {
+                point,
+                circle: line,
+            } => Refs::new(&[point, line], &[]),
+            Constraint::Symmetric { a, b, about } => Refs::new(&[a, b, about], &[]),
+            Constraint::SymmetricHorizontal { a, b, workplane }
+            | Constraint::SymmetricVertical { a, b, workplane } => {
+                Refs::new(&[a, b, workplane], &[])
+            }
+            Constraint::Midpoint { point, of } => Refs::new(&[point, of], &[]),
+            Constraint::PointInPlane { point, plane }
+            | Constraint::PointPlaneDistance { point, plane, .. } => {
+                Refs::new(&[point, plane], &[])
+            }
+            Constraint::LengthRatio { a, b, .. }
+            | Constraint::LengthDifference { a, b, .. }
+            | Constraint::ArcArcLengthRatio { a, b, .. }
+            | Constraint::ArcArcLengthDifference { a, b, .. }
+            | Constraint::GearMesh { a, b, .. } => Refs::new(&[a, b], &[]),
+            Constraint::ProjectedPointDistance { a, b, plane, .. } => {
+                Refs::new(&[a, b, plane], &[])
+            }
+            Constraint::PointOnFace { point, face }
+            | Constraint::PointFaceDistance { point, face, .. } => Refs::new(&[point, face], &[]),
+            Constraint::EqualLineArcLength { line, arc } => Refs::new(&[line, arc], &[]),
+            Constraint::EqualPointLineDistances {
+                point1,
+                line1,
+                point2,
+                line2,
+            } => Refs::new(&[point1, line1, point2, line2], &[]),
+            Constraint::ArcLineLengthRatio { arc, line, .. }
+            | Constraint::ArcLineLengthDifference { arc, line, .. } => Refs::new(&[arc, line], &[]),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_refs_walk_fields_then_list() {
+        let constraint = Constraint::Coincident {
+            data: CoincidentData::PointOnLine {
+                at: "p1".to_string(),
+                of: vec!["l1".to_string(), "l2".to_string()],
+            },
+        };
+        assert_eq!(
+            constraint.refs().collect::<Vec<_>>(),
+            vec!["p1", "l1", "l2"]
+        );
+
+        let constraint = Constraint::Fixed {
+            entity: "p1".to_string(),
+            workplane: Some("wp".to_string()),
+        };
+        assert_eq!(constraint.refs().collect::<Vec<_>>(), vec!["p1", "wp"]);
+    }
+
+    #[test]
+    fn test_table_keeps_the_first_of_a_duplicate_id() {
+        let doc: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "a", "at": [0, 0, 0]},
+                {"type": "plane", "id": "a", "origin": [0, 0, 0], "normal": [0, 0, 1]},
+                {"type": "plane", "id": "wp", "origin": [0, 0, 0], "normal": [0, 0, 1]}
+            ],
+            "constraints": []
+        }))
+        .unwrap();
+        let table = IdTable::new(&doc);
+        assert_eq!(table.len(), 2);
+        assert_eq!(table.kind("a"), Some(EntityKind::Point));
+        assert_eq!(table.index("wp"), Some(2));
+        assert_eq!(table.sorted(), vec!["a", "wp"]);
+    }
+
+    #[test]
+    fn test_entity_index_keeps_each_entitys_points() {
+        let mut index = EntityIndex::default();
+        index.push("p1", 1);
+        index.push("p2", 2);
+        assert_eq!(index.refer("p1"), Some(1));
+        assert_eq!(index.refer("p2"), Some(2));
+        index.push("l1", 3);
+        assert_eq!(index.get("p1"), Some(1));
+        index.push("c1", 4);
+        index.centre_last(1);
+
+        assert_eq!(index.len(), 4);
+        assert_eq!(index.points(2), &[0, 1]);
+        assert!(index.points(0).is_empty());
+        assert_eq!(index.index("l1"), Some(2));
+        assert_eq!(index.handle(2), 3);
+        assert_eq!(index.centre(3), Some(1));
+        assert_eq!(index.centre(2), None);
+        assert_eq!(index.refer("nope"), None);
+    }
+}
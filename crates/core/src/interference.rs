@@ -0,0 +1,701 @@
+//! Finding solved entities that cross or crowd each other: circles, arcs
+//! and lines, as seen from +z (projected onto the XY plane, as the SVG
+//! export draws them). Circles and arcs in planes that aren't parallel to
+//! XY, points and cubics are left out.
+//!
+//! A bounding volume hierarchy over the outlines' boxes finds the pairs
+//! that could come within the clearance of each other, and only those get
+//! the exact test, so that a sketch of a few thousand gear teeth doesn't
+//! take a test for every pair.
+//!
+//! Two outlines that cross overlap by as far as one would have to move to
+//! stop crossing the other, which is taken as the least of: how deep a
+//! line or arc cuts into the other's circle (for two circles, how far
+//! their outlines overlap), and how far each free end reaches past the
+//! other outline. Outlines that only touch overlap by nothing.
+
+use crate::ir::{Interference, ResolvedEntity};
+use std::f64::consts::TAU;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+type P = [f64; 2];
+
+fn sub(a: P, b: P) -> P {
+    [a[0] - b[0], a[1] - b[1]]
+}
+
+fn dot(a: P, b: P) -> f64 {
+    a[0] * b[0] + a[1] * b[1]
+}
+
+fn cross(a: P, b: P) -> f64 {
+    a[0] * b[1] - a[1] * b[0]
+}
+
+fn norm(a: P) -> f64 {
+    dot(a, a).sqrt()
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Shape {
+    Segment {
+        a: P,
+        b: P,
+    },
+    /// An arc of the circle about `c`, from the angle `start`, sweeping
+    /// `sweep` radians counterclockwise; TAU for the whole circle
+    Arc {
+        c: P,
+        r: f64,
+        start: f64,
+        sweep: f64,
+    },
+}
+
+fn xy(v: &[f64]) -> P {
+    [
+        v.first().copied().unwrap_or(0.0),
+        v.get(1).copied().unwrap_or(0.0),
+    ]
+}
+
+/// Whether a normal is along z, and if so, whether it's +z
+fn facing(normal: &[f64]) -> Option<bool> {
+    let z = normal.get(2).copied().unwrap_or(1.0);
+    (norm(xy(normal)) <= 1e-9 * z.abs()).then_some(z > 0.0)
+}
+
+impl Shape {
+    fn of(entity: &ResolvedEntity) -> Option<Shape> {
+        match entity {
+            ResolvedEntity::Line { p1, p2 } => Some(Shape::Segment {
+                a: xy(p1),
+                b: xy(p2),
+            }),
+            ResolvedEntity::Circle {
+                center,
+                diameter,
+                normal,
+            } => {
+                facing(normal)?;
+                Some(Shape::Arc {
+                    c: xy(center),
+                    r: diameter.abs() / 2.0,
+                    start: 0.0,
+                    sweep: TAU,
+                })
+            }
+            ResolvedEntity::Arc {
+                center,
+                start,
+                end,
+                normal,
+            } => {
+                // Seen from -z, the arc runs the other way round
+                let (start, end) = if facing(normal)? {
+                    (start, end)
+                } else {
+                    (end, start)
+                };
+                let c = xy(center);
+                let (s, e) = (sub(xy(start), c), sub(xy(end), c));
+                let from = s[1].atan2(s[0]);
+                let mut sweep = (e[1].atan2(e[0]) - from).rem_euclid(TAU);
+                // A closed arc is the whole circle
+                if sweep == 0.0 {
+                    sweep = TAU;
+                }
+                Some(Shape::Arc {
+                    c,
+                    r: norm(s),
+                    start: from,
+                    sweep,
+                })
+            }
+            _ => None,
+        }
+    }
+
+    fn bounds(&self) -> (P, P) {
+        match *self {
+            Shape::Segment { a, b } => (
+                [a[0].min(b[0]), a[1].min(b[1])],
+                [a[0].max(b[0]), a[1].max(b[1])],
+            ),
+            Shape::Arc { c, r, .. } => {
+                // The ends, and the extremes along x and y that the arc
+                // passes through
+                let mut lo = [f64::INFINITY; 2];
+                let mut hi = [f64::NEG_INFINITY; 2];
+                let extremes = [
+                    [c[0] + r, c[1]],
+                    [c[0], c[1] + r],
+                    [c[0] - r, c[1]],
+                    [c[0], c[1] - r],
+                ];
+                for p in self
+                    .ends()
+                    .into_iter()
+                    .chain(extremes.into_iter().filter(|&p| self.on_arc(p)))
+                {
+                    for k in 0..2 {
+                        lo[k] = lo[k].min(p[k]);
+                        hi[k] = hi[k].max(p[k]);
+                    }
+                }
+                (lo, hi)
+            }
+        }
+    }
+
+    /// The free ends: a segment's, or an arc's that isn't a whole circle
+    fn ends(&self) -> Vec<P> {
+        match *self {
+            Shape::Segment { a, b } => vec![a, b],
+            Shape::Arc { sweep, .. } if sweep >= TAU => vec![],
+            Shape::Arc { c, r, start, sweep } => {
+                let at = |t: f64| [c[0] + r * t.cos(), c[1] + r * t.sin()];
+                vec![at(start), at(start + sweep)]
+            }
+        }
+    }
+
+    /// Whether the direction of p from an arc's center is within the arc
+    fn on_arc(&self, p: P) -> bool {
+        match *self {
+            Shape::Arc {
+                c, start, sweep, ..
+            } => {
+                let d = sub(p, c);
+                sweep >= TAU || (d[1].atan2(d[0]) - start).rem_euclid(TAU) <= sweep
+            }
+            Shape::Segment { .. } => true,
+        }
+    }
+
+    fn distance_to(&self, p: P) -> f64 {
+        match *self {
+            Shape::Segment { a, b } => {
+                let ab = sub(b, a);
+                let len2 = dot(ab, ab);
+                let t = if len2 > 0.0 {
+                    (dot(sub(p, a), ab) / len2).clamp(0.0, 1.0)
+                } else {
+                    0.0
+                };
+                norm(sub(p, [a[0] + t * ab[0], a[1] + t * ab[1]]))
+            }
+            Shape::Arc { c, r, .. } => {
+                let from_center = norm(sub(p, c));
+                if from_center == 0.0 || self.on_arc(p) {
+                    (from_center - r).abs()
+                } else {
+                    self.ends()
+                        .into_iter()
+                        .map(|e| norm(sub(p, e)))
+                        .fold(f64::INFINITY, f64::min)
+                }
+            }
+        }
+    }
+}
+
+/// The point of segment ab closest to c
+fn closest_on_segment(a: P, b: P, c: P) -> P {
+    let ab = sub(b, a);
+    let len2 = dot(ab, ab);
+    let t = if len2 > 0.0 {
+        (dot(sub(c, a), ab) / len2).clamp(0.0, 1.0)
+    } else {
+        0.0
+    };
+    [a[0] + t * ab[0], a[1] + t * ab[1]]
+}
+
+/// Whether two outlines meet (cross or touch)
+fn meet(s: &Shape, o: &Shape) -> bool {
+    match (*s, *o) {
+        (Shape::Segment { a, b }, Shape::Segment { a: c, b: d }) => {
+            let (o1, o2) = (cross(sub(b, a), sub(c, a)), cross(sub(b, a), sub(d, a)));
+            let (o3, o4) = (cross(sub(d, c), sub(a, c)), cross(sub(d, c), sub(b, c)));
+            // Collinear segments are left to `separation`, which is 0 where
+            // they overlap
+            let collinear = o1 == 0.0 && o2 == 0.0;
+            !collinear && o1 * o2 <= 0.0 && o3 * o4 <= 0.0
+        }
+        (Shape::Segment { a, b }, Shape::Arc { c, r, .. }) => {
+            // |a + t (b - a) - c| = r, for t in [0, 1]
+            let ab = sub(b, a);
+            let ac = sub(a, c);
+            let (qa, qb, qc) = (dot(ab, ab), 2.0 * dot(ab, ac), dot(ac, ac) - r * r);
+            let disc = qb * qb - 4.0 * qa * qc;
+            if qa == 0.0 || disc < 0.0 {
+                return false;
+            }
+            [-1.0, 1.0].iter().any(|sign| {
+                let t = (-qb + sign * disc.sqrt()) / (2.0 * qa);
+                (0.0..=1.0).contains(&t) && o.on_arc([a[0] + t * ab[0], a[1] + t * ab[1]])
+            })
+        }
+        (Shape::Arc { .. }, Shape::Segment { .. }) => meet(o, s),
+        (Shape::Arc { c: c1, r: r1, .. }, Shape::Arc { c: c2, r: r2, .. }) => {
+            let between = sub(c2, c1);
+            let d = norm(between);
+            if d == 0.0 || d > r1 + r2 || d < (r1 - r2).abs() {
+                return false;
+            }
+            // Where the circles meet, along and across the line of centers
+            let along = (d * d + r1 * r1 - r2 * r2) / (2.0 * d);
+            let across = (r1 * r1 - along * along).max(0.0).sqrt();
+            let u = [between[0] / d, between[1] / d];
+            [-1.0, 1.0].iter().any(|sign| {
+                let p = [
+                    c1[0] + along * u[0] - sign * across * u[1],
+                    c1[1] + along * u[1] + sign * across * u[0],
+                ];
+                s.on_arc(p) && o.on_arc(p)
+            })
+        }
+    }
+}
+
+/// The least distance between two outlines that don't meet
+fn separation(s: &Shape, o: &Shape) -> f64 {
+    let mut best = f64::INFINITY;
+    for (x, y) in [(s, o), (o, s)] {
+        for e in x.ends() {
+            best = best.min(y.distance_to(e));
+        }
+        match (*x, *y) {
+            // Where the segment comes closest to the circle's center
+            (Shape::Segment { a, b }, Shape::Arc { c, .. }) => {
+                best = best.min(y.distance_to(closest_on_segment(a, b, c)));
+            }
+            // Circles come closest along the line of their centers
+            (Shape::Arc { c: c1, r, .. }, Shape::Arc { c: c2, .. }) => {
+                let between = sub(c2, c1);
+                let d = norm(between);
+                if d > 0.0 {
+                    for sign in [-1.0, 1.0] {
+                        let p = [
+                            c1[0] + sign * r * between[0] / d,
+                            c1[1] + sign * r * between[1] / d,
+                        ];
+                        if x.on_arc(p) {
+                            best = best.min(y.distance_to(p));
+                        }
+                    }
+                }
+            }
+            _ => {}
+        }
+    }
+    best
+}
+
+/// How far two outlines that meet overlap (see the module comment)
+fn overlap(s: &Shape, o: &Shape) -> f64 {
+    let mut best = f64::INFINITY;
+    for (x, y) in [(s, o), (o, s)] {
+        for e in x.ends() {
+            best = best.min(y.distance_to(e));
+        }
+        match (*x, *y) {
+            (Shape::Segment { a, b }, Shape::Arc { c, r, .. }) => {
+                let ab = sub(b, a);
+                let len = norm(ab);
+                if len > 0.0 {
+                    best = best.min(r - (cross(ab, sub(c, a)) / len).abs());
+                }
+            }
+            (Shape::Arc { c: c1, r: r1, .. }, Shape::Arc { c: c2, r: r2, .. }) => {
+                let d = norm(sub(c2, c1));
+                best = best.min((r1 + r2 - d).min(d - (r1 - r2).abs()));
+            }
+            _ => {}
+        }
+    }
+    best.max(0.0)
+}
+
+/// How far two outlines are inside the clearance of each other: the
+/// clearance plus their overlap if they meet, or less their separation if
+/// they don't
+fn depth(s: &Shape, o: &Shape, clearance: f64) -> f64 {
+    if meet(s, o) {
+        clearance + overlap(s, o)
+    } else {
+        clearance - separation(s, o)
+    }
+}
+
+/// A box in the hierarchy, holding two more or, in a leaf, shapes
+/// `order[first..first + count]`
+struct Node {
+    lo: P,
+    hi: P,
+    children: Option<(usize, usize)>,
+    first: usize,
+    count: usize,
+}
+
+const LEAF_SHAPES: usize = 4;
+
+struct Bvh {
+    nodes: Vec<Node>,
+    order: Vec<usize>,
+}
+
+fn boxes_overlap(lo: P, hi: P, lo2: P, hi2: P) -> bool {
+    lo[0] <= hi2[0] && lo2[0] <= hi[0] && lo[1] <= hi2[1] && lo2[1] <= hi[1]
+}
+
+impl Bvh {
+    fn new(boxes: &[(P, P)]) -> Self {
+        let mut bvh = Bvh {
+            nodes: Vec::new(),
+            order: (0..boxes.len()).collect(),
+        };
+        if !boxes.is_empty() {
+            bvh.build(boxes, 0, boxes.len());
+        }
+        bvh
+    }
+
+    /// Add the node over `order[first..first + count]`, splitting it at the
+    /// median along its longer side, and return its index
+    fn build(&mut self, boxes: &[(P, P)], first: usize, count: usize) -> usize {
+        let mut lo = [f64::INFINITY; 2];
+        let mut hi = [f64::NEG_INFINITY; 2];
+        for &i in &self.order[first..first + count] {
+            for k in 0..2 {
+                lo[k] = lo[k].min(boxes[i].0[k]);
+                hi[k] = hi[k].max(boxes[i].1[k]);
+            }
+        }
+        let index = self.nodes.len();
+        self.nodes.push(Node {
+            lo,
+            hi,
+            children: None,
+            first,
+            count,
+        });
+        if count > LEAF_SHAPES {
+            let axis = if hi[0] - lo[0] >= hi[1] - lo[1] { 0 } else { 1 };
+            let center = |i: usize| boxes[i].0[axis] + boxes[i].1[axis];
+            let half = count / 2;
+            self.order[first..first + count]
+                .select_nth_unstable_by(half, |&a, &b| center(a).total_cmp(&center(b)));
+            let left = self.build(boxes, first, half);
+            let right = self.build(boxes, first + half, count - half);
+            self.nodes[index].children = Some((left, right));
+        }
+        index
+    }
+
+    /// The shapes whose boxes overlap lo..hi
+    fn query(&self, lo: P, hi: P, found: &mut Vec<usize>) {
+        let mut stack = vec![0];
+        while let Some(n) = stack.pop() {
+            let Some(node) = self.nodes.get(n) else {
+                continue;
+            };
+            if !boxes_overlap(lo, hi, node.lo, node.hi) {
+                continue;
+            }
+            match node.children {
+                Some((left, right)) => stack.extend([left, right]),
+                None => found.extend_from_slice(&self.order[node.first..node.first + node.count]),
+            }
+        }
+    }
+}
+
+/// Shapes at a time that a thread takes to check
+const CHUNK: usize = 256;
+
+/// Every pair of the entities whose outlines cross, or come closer than
+/// `clearance`, by more than `tolerance`, deepest first; on `jobs` threads,
+/// or for 0, as many as it's worth. The pair's ids are in the order given.
+pub fn find(
+    entities: &[(&str, &ResolvedEntity)],
+    clearance: f64,
+    tolerance: f64,
+    jobs: usize,
+) -> Vec<Interference> {
+    let shapes: Vec<(usize, Shape)> = entities
+        .iter()
+        .enumerate()
+        .filter_map(|(i, (_, e))| Some((i, Shape::of(e)?)))
+        .filter(|(_, s)| {
+            s.bounds()
+                .0
+                .iter()
+                .chain(&s.bounds().1)
+                .all(|v| v.is_finite())
+        })
+        .collect();
+    // Each box grown by half the clearance, so boxes that don't overlap
+    // hold shapes that are farther apart than it
+    let margin = clearance.max(0.0) / 2.0;
+    let boxes: Vec<(P, P)> = shapes
+        .iter()
+        .map(|(_, s)| {
+            let (lo, hi) = s.bounds();
+            (
+                [lo[0] - margin, lo[1] - margin],
+                [hi[0] + margin, hi[1] + margin],
+            )
+        })
+        .collect();
+    let bvh = Bvh::new(&boxes);
+
+    let chunks = shapes.len().div_ceil(CHUNK);
+    let jobs = match jobs {
+        0 => std::thread::available_parallelism().map_or(1, |n| n.get()),
+        n => n,
+    };
+    let next = AtomicUsize::new(0);
+    let found = Mutex::new(Vec::new());
+    let check = || {
+        let mut pairs = Vec::new();
+        let mut candidates = Vec::new();
+        loop {
+            let chunk = next.fetch_add(1, Ordering::Relaxed);
+            if chunk >= chunks {
+                break;
+            }
+            for i in chunk * CHUNK..((chunk + 1) * CHUNK).min(shapes.len()) {
+                candidates.clear();
+                bvh.query(boxes[i].0, boxes[i].1, &mut candidates);
+                for &j in candidates.iter().filter(|&&j| j > i) {
+                    let depth = depth(&shapes[i].1, &shapes[j].1, clearance);
+                    if depth > tolerance {
+                        pairs.push(Interference {
+                            a: entities[shapes[i].0].0.to_string(),
+                            b: entities[shapes[j].0].0.to_string(),
+                            depth,
+                        });
+                    }
+                }
+            }
+        }
+        found.lock().unwrap().append(&mut pairs);
+    };
+    if jobs <= 1 || chunks <= 1 {
+        check();
+    } else {
+        std::thread::scope(|scope| {
+            for _ in 0..jobs.min(chunks) {
+                scope.spawn(check);
+            }
+        });
+    }
+
+    let order: std::collections::HashMap<&str, usize> = entities
+        .iter()
+        .enumerate()
+        .map(|(i, (id, _))| (*id, i))
+        .collect();
+    let mut found = found.into_inner().unwrap();
+    found.sort_by(|x, y| {
+        y.depth
+            .total_cmp(&x.depth)
+            .then_with(|| order[x.a.as_str()].cmp(&order[y.a.as_str()]))
+            .then_with(|| order[x.b.as_str()].cmp(&order[y.b.as_str()]))
+    });
+    found
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn circle(x: f64, y: f64, r: f64) -> ResolvedEntity {
+        ResolvedEntity::Circle {
+            center: vec![x, y, 0.0],
+            diameter: 2.0 * r,
+            normal: vec![0.0, 0.0, 1.0],
+        }
+    }
+
+    fn line(a: [f64; 2], b: [f64; 2]) -> ResolvedEntity {
+        ResolvedEntity::Line {
+            p1: vec![a[0], a[1], 0.0],
+            p2: vec![b[0], b[1], 0.0],
+        }
+    }
+
+    /// The quarter arc of radius r about (x, y), counterclockwise from +x
+    fn quarter(x: f64, y: f64, r: f64) -> ResolvedEntity {
+        ResolvedEntity::Arc {
+            center: vec![x, y, 0.0],
+            start: vec![x + r, y, 0.0],
+            end: vec![x, y + r, 0.0],
+            normal: vec![0.0, 0.0, 1.0],
+        }
+    }
+
+    fn pairs(entities: &[(&str, ResolvedEntity)], clearance: f64) -> Vec<(String, String, f64)> {
+        let refs: Vec<(&str, &ResolvedEntity)> = entities.iter().map(|(id, e)| (*id, e)).collect();
+        find(&refs, clearance, 1e-9, 1)
+            .into_iter()
+            .map(|i| (i.a, i.b, i.depth))
+            .collect()
+    }
+
+    #[test]
+    fn test_circles() {
+        // A planet poking 10 past its ring; one meshing with it exactly;
+        // one apart; one nested well inside
+        let entities = [
+            ("ring", circle(0.0, 0.0, 50.0)),
+            ("planet1", circle(40.0, 0.0, 20.0)),
+            ("planet2", circle(-30.0, 0.0, 20.0)),
+            ("far", circle(200.0, 0.0, 5.0)),
+            ("inner", circle(0.0, 30.0, 2.0)),
+        ];
+        let found = pairs(&entities, 0.0);
+        assert_eq!(found.len(), 1);
+        assert_eq!(
+            (found[0].0.as_str(), found[0].1.as_str()),
+            ("ring", "planet1")
+        );
+        assert!((found[0].2 - 10.0).abs() < 1e-9);
+
+        // With clearance, the meshing planet and the nested one are too close
+        let found = pairs(&entities, 1.0);
+        let names: Vec<(&str, &str)> = found
+            .iter()
+            .map(|(a, b, _)| (a.as_str(), b.as_str()))
+            .collect();
+        assert_eq!(names, vec![("ring", "planet1"), ("ring", "planet2")]);
+        assert!((found[1].2 - 1.0).abs() < 1e-9);
+        assert!(
+            (pairs(&entities, 20.0)
+                .iter()
+                .find(|p| p.1 == "inner")
+                .unwrap()
+                .2
+                - 2.0)
+                .abs()
+                < 1e-9
+        );
+    }
+
+    #[test]
+    fn test_lines_and_arcs() {
+        let entities = [
+            // Crossing at (5, 5), with the nearest free end 5 past the other
+            ("l1", line([0.0, 0.0], [10.0, 10.0])),
+            ("l2", line([0.0, 10.0], [10.0, 0.0])),
+            // Sharing an end with l1: touching, not crossing
+            ("l3", line([10.0, 10.0], [20.0, 10.0])),
+            // A chord 6 from the center of a circle of radius 10 cuts 4 in
+            ("c", circle(100.0, 0.0, 10.0)),
+            ("chord", line([80.0, 6.0], [120.0, 6.0])),
+            // The quarter arc of radius 10 about (200, 0) runs from (210,
+            // 0) to (200, 10); this line crosses the part it doesn't cover
+            ("a", quarter(200.0, 0.0, 10.0)),
+            ("miss", line([180.0, -5.0], [220.0, -5.0])),
+        ];
+        let found = pairs(&entities, 0.0);
+        let names: Vec<(&str, &str)> = found
+            .iter()
+            .map(|(a, b, _)| (a.as_str(), b.as_str()))
+            .collect();
+        assert_eq!(names, vec![("l1", "l2"), ("c", "chord")]);
+        assert!((found[0].2 - 50f64.sqrt()).abs() < 1e-9);
+        assert!((found[1].2 - 4.0).abs() < 1e-9);
+
+        // The arc's start is 5 from `miss`
+        let found = pairs(&entities, 6.0);
+        let a_miss = found.iter().find(|p| p.0 == "a").unwrap();
+        assert_eq!(a_miss.1, "miss");
+        assert!((a_miss.2 - 1.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_arcs_facing_down_run_the_other_way() {
+        // Seen from -z, the arc runs clockwise from (10, 0) round to (0, 10)
+        let down = ResolvedEntity::Arc {
+            center: vec![0.0, 0.0, 0.0],
+            start: vec![10.0, 0.0, 0.0],
+            end: vec![0.0, 10.0, 0.0],
+            normal: vec![0.0, 0.0, -1.0],
+        };
+        let shape = Shape::of(&down).unwrap();
+        assert!(shape.on_arc([0.0, -10.0]));
+        assert!(!shape.on_arc([7.0, 7.0]));
+        // Tilted circles aren't seen from +z
+        let tilted = ResolvedEntity::Circle {
+            center: vec![0.0; 3],
+            diameter: 2.0,
+            normal: vec![1.0, 0.0, 0.0],
+        };
+        assert!(Shape::of(&tilted).is_none());
+    }
+
+    #[test]
+    fn test_solver_reports_interference() {
+        use crate::solver::{Solver, SolverConfig};
+        let doc: crate::ir::InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"offset": 40},
+            "entities": [
+                {"type": "circle", "id": "ring", "center": [0, 0, 0], "diameter": 100},
+                {"type": "circle", "id": "planet", "center": ["$offset", 0, 0], "diameter": 40}
+            ],
+            "constraints": []
+        }))
+        .unwrap();
+        let config = SolverConfig {
+            interference: Some(0.0),
+            ..SolverConfig::default()
+        };
+        let result = Solver::new(config).solve(&doc).unwrap();
+        let found = result.interference.unwrap();
+        assert_eq!(found.len(), 1);
+        assert!((found[0].depth - 10.0).abs() < 1e-6);
+        assert!(Solver::new(SolverConfig::default())
+            .solve(&doc)
+            .unwrap()
+            .interference
+            .is_none());
+    }
+
+    #[test]
+    fn test_many_in_parallel_match_pairwise() {
+        // A ring of teeth, each crossing the next, and some that don't
+        let mut entities = Vec::new();
+        let names: Vec<String> = (0..1000).map(|i| format!("t{}", i)).collect();
+        for i in 0..1000 {
+            let t = i as f64 * TAU / 1000.0;
+            let r = if i % 3 == 0 { 0.2 } else { 0.4 };
+            entities.push((
+                names[i].as_str(),
+                circle(100.0 * t.cos(), 100.0 * t.sin(), r),
+            ));
+        }
+        let refs: Vec<(&str, &ResolvedEntity)> = entities.iter().map(|(id, e)| (*id, e)).collect();
+        let found = find(&refs, 0.0, 1e-9, 4);
+
+        let shapes: Vec<Shape> = entities
+            .iter()
+            .map(|(_, e)| Shape::of(e).unwrap())
+            .collect();
+        let mut expected = 0;
+        for i in 0..shapes.len() {
+            for j in i + 1..shapes.len() {
+                if depth(&shapes[i], &shapes[j], 0.0) > 1e-9 {
+                    expected += 1;
+                }
+            }
+        }
+        assert!(expected > 0);
+        assert_eq!(found.len(), expected);
+        assert!(found.windows(2).all(|w| w[0].depth >= w[1].depth));
+    }
+}
@@ -167,13 +167,52 @@ impl Entity {
     }
 }
 
-#[derive(Debug, Clone, Serialize, Deserialize, PartialEq, JsonSchema)]
+#[derive(Debug, Clone, Serialize, PartialEq, JsonSchema)]
 #[serde(untagged)]
 pub enum ExprOrNumber {
     Number(f64),
     Expression(String),
 }
 
+/// Deserialized by looking at the value once, where an untagged derive
+/// would try it as a number first and make an error to throw away for
+/// every expression
+impl<'de> Deserialize<'de> for ExprOrNumber {
+    fn deserialize<D: serde::Deserializer<'de>>(deserializer: D) -> Result<Self, D::Error> {
+        struct Visitor;
+
+        impl<'de> serde::de::Visitor<'de> for Visitor {
+            type Value = ExprOrNumber;
+
+            fn expecting(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+                f.write_str("a number or an expression")
+            }
+
+            fn visit_f64<E>(self, v: f64) -> Result<ExprOrNumber, E> {
+                Ok(ExprOrNumber::Number(v))
+            }
+
+            fn visit_i64<E>(self, v: i64) -> Result<ExprOrNumber, E> {
+                Ok(ExprOrNumber::Number(v as f64))
+            }
+
+            fn visit_u64<E>(self, v: u64) -> Result<ExprOrNumber, E> {
+                Ok(ExprOrNumber::Number(v as f64))
+            }
+
+            fn visit_str<E>(self, v: &str) -> Result<ExprOrNumber, E> {
+                Ok(ExprOrNumber::Expression(v.to_owned()))
+            }
+
+            fn visit_string<E>(self, v: String) -> Result<ExprOrNumber, E> {
+                Ok(ExprOrNumber::Expression(v))
+            }
+        }
+
+        deserializer.deserialize_any(Visitor)
+    }
+}
+
 impl Default for ExprOrNumber {
     fn default() -> Self {
         ExprOrNumber::Number(0.0)
@@ -384,6 +423,18 @@ pub enum Constraint {
         line: String,
         value: ExprOrNumber,
     },
+    /// Two gears in mesh, as their pitch circles: their centres are held
+    /// module * (teeth_a + teeth_b) / 2 apart, or module * (teeth_b -
+    /// teeth_a) / 2 when `b` is a ring gear that `a` turns inside
+    GearMesh {
+        a: String,
+        b: String,
+        module: ExprOrNumber,
+        teeth_a: ExprOrNumber,
+        teeth_b: ExprOrNumber,
+        #[serde(default)]
+        internal: bool,
+    },
     Dragged {
         point: String,
         #[serde(skip_serializing_if = "Option::is_none")]
@@ -415,6 +466,83 @@ pub struct SolveResult {
     pub entities: Option<HashMap<String, ResolvedEntity>>,
     #[serde(skip_serializing_if = "Vec::is_empty", default)]
     pub warnings: Vec<String>,
+    /// Each point's [dx, dy, dz] per unit of each dimension parameter,
+    /// when asked for: `sensitivities[parameter][point]`
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub sensitivities: Option<HashMap<String, HashMap<String, [f64; 3]>>>,
+    /// What each constraint cost the solve, most expensive first, when
+    /// asked for
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub profile: Option<Vec<ConstraintProfile>>,
+    /// Pairs of solved outlines that cross or come within the clearance
+    /// asked for, deepest first, when asked for
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub interference: Option<Vec<Interference>>,
+    /// The mass properties of the solid the STL export extrudes from the
+    /// solved sketch, when asked for
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub mass: Option<MassProperties>,
+}
+
+/// What one constraint cost a profiled solve: the expression nodes that
+/// writing its equations took, the nonzeros in their rows of the Jacobians,
+/// the time spent evaluating those rows (each by itself, so this ranks the
+/// constraints rather than adding up to the solve), and the Newton
+/// iterations that began with one of its residuals out of tolerance
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct ConstraintProfile {
+    /// Where it is in the document
+    pub pointer: String,
+    #[serde(rename = "type")]
+    pub kind: String,
+    pub expr_nodes: u64,
+    pub jacobian_nnz: u64,
+    pub eval_ms: f64,
+    pub iterations_above_tolerance: u32,
+}
+
+/// Two solved entities whose outlines cross or crowd each other, and by
+/// how much: how far they cross, plus the clearance asked for, or for
+/// outlines that don't cross, how far short of the clearance they are
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct Interference {
+    pub a: String,
+    pub b: String,
+    pub depth: f64,
+}
+
+/// The volume, surface area, centroid and inertia tensor of a solid, at
+/// unit density; the tensor is about the centroid, with the products of
+/// inertia negated off its diagonal
+#[derive(Debug, Clone, Copy, Default, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct MassProperties {
+    pub volume: f64,
+    pub area: f64,
+    pub centroid: [f64; 3],
+    pub inertia: [[f64; 3]; 3],
+}
+
+/// Whether a document's coordinates, as written, already satisfy its
+/// constraints, found without solving it
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct CheckResult {
+    /// "ok" if every constraint is within tolerance, or "failed"
+    pub status: String,
+    /// Each constraint, in document order
+    pub constraints: Vec<ConstraintCheck>,
+    pub time_ms: f64,
+}
+
+/// The largest of a constraint's residuals, where the document puts its
+/// points, and whether that's within tolerance
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct ConstraintCheck {
+    /// Where it is in the document
+    pub pointer: String,
+    #[serde(rename = "type")]
+    pub kind: String,
+    pub residual: f64,
+    pub ok: bool,
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize, PartialEq, JsonSchema)]
@@ -423,6 +551,69 @@ pub struct Diagnostics {
     pub residual: f64,
     pub dof: u32,
     pub time_ms: u64,
+    /// How many equations and unknowns the solver wrote, and the nonzeros
+    /// in the Jacobians that it solved with
+    #[serde(default)]
+    pub equations: u32,
+    #[serde(default)]
+    pub unknowns: u32,
+    #[serde(default)]
+    pub jacobian_nnz: u64,
+    /// Where the solver's time went
+    #[serde(default)]
+    pub phases: PhaseTimes,
+    /// And the time in each layer around it
+    #[serde(default)]
+    pub layers: LayerTimes,
+    /// What the solver took in memory
+    #[serde(default)]
+    pub memory: MemoryCounts,
+}
+
+/// Milliseconds spent in each phase of a solve, summed over the solver's
+/// threads. The phases nest: solving the equations in one unknown each
+/// includes writing and factoring their Jacobians, for example.
+#[derive(Debug, Clone, Default, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct PhaseTimes {
+    pub write_equations_ms: f64,
+    pub substitute_ms: f64,
+    pub alone_ms: f64,
+    pub write_jacobian_ms: f64,
+    pub eval_jacobian_ms: f64,
+    pub factor_ms: f64,
+    pub rank_test_ms: f64,
+    pub find_bad_ms: f64,
+}
+
+/// Wall-clock milliseconds in each layer of a solve: writing the document
+/// into the native solver, the native solve itself (which the phases above
+/// break down), and reading the solved entities back out.
+#[derive(Debug, Clone, Default, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct LayerTimes {
+    pub build_ms: f64,
+    pub native_ms: f64,
+    pub read_back_ms: f64,
+}
+
+/// What a solve took in memory: the expression nodes it allocated, and the
+/// bytes it took from its temporary arenas and the most they held at once,
+/// summed over the solver's threads; the distinct nodes of the equations that
+/// its Jacobians were written from, what folding and sharing left of them,
+/// and the nodes their partial derivatives added; the entries of those
+/// Jacobians, of which `jacobian_nnz` were filled; and the constraint whose
+/// equations took the most nodes to write, as a pointer into the document.
+#[derive(Debug, Clone, Default, Serialize, Deserialize, PartialEq, JsonSchema)]
+pub struct MemoryCounts {
+    pub exprs_allocated: u64,
+    pub temporary_bytes: u64,
+    pub temporary_peak_bytes: u64,
+    pub source_nodes: u64,
+    pub folded_nodes: u64,
+    pub partial_nodes: u64,
+    pub jacobian_entries: u64,
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub heaviest_constraint: Option<String>,
+    pub heaviest_constraint_exprs: u64,
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize, PartialEq, JsonSchema)]
@@ -435,6 +626,151 @@ pub enum ResolvedEntity {
     Cubic { start: Vec<f64>, control1: Vec<f64>, control2: Vec<f64>, end: Vec<f64> },
 }
 
+/// `v` rounded to `decimals` places, so it prints in as few digits as that
+/// needs
+fn round_to(v: f64, decimals: u32) -> f64 {
+    let scale = 10f64.powi(decimals as i32);
+    let rounded = (v * scale).round() / scale;
+    // Past what an f64 can scale, or -0.0
+    if rounded.is_finite() {
+        rounded + 0.0
+    } else {
+        v
+    }
+}
+
+impl ResolvedEntity {
+    /// Make this a copy of `from`, in the storage it has if it's the same
+    /// kind of entity, as it is when the same document is solved again
+    pub fn assign(&mut self, from: &ResolvedEntity) {
+        use ResolvedEntity::*;
+        match (self, from) {
+            (Point { at }, Point { at: a }) => at.clone_from(a),
+            (
+                Circle {
+                    center,
+                    diameter,
+                    normal,
+                },
+                Circle {
+                    center: c,
+                    diameter: d,
+                    normal: n,
+                },
+            ) => {
+                center.clone_from(c);
+                *diameter = *d;
+                normal.clone_from(n);
+            }
+            (Line { p1, p2 }, Line { p1: a, p2: b }) => {
+                p1.clone_from(a);
+                p2.clone_from(b);
+            }
+            (
+                Arc {
+                    center,
+                    start,
+                    end,
+                    normal,
+                },
+                Arc {
+                    center: c,
+                    start: s,
+                    end: e,
+                    normal: n,
+                },
+            ) => {
+                center.clone_from(c);
+                start.clone_from(s);
+                end.clone_from(e);
+                normal.clone_from(n);
+            }
+            (
+                Cubic {
+                    start,
+                    control1,
+                    control2,
+                    end,
+                },
+                Cubic {
+                    start: s,
+                    control1: c1,
+                    control2: c2,
+                    end: e,
+                },
+            ) => {
+                start.clone_from(s);
+                control1.clone_from(c1);
+                control2.clone_from(c2);
+                end.clone_from(e);
+            }
+            (this, from) => *this = from.clone(),
+        }
+    }
+
+    /// Round every coordinate to `decimals` places
+    pub fn round(&mut self, decimals: u32) {
+        let coords: Vec<&mut Vec<f64>> = match self {
+            ResolvedEntity::Point { at } => vec![at],
+            ResolvedEntity::Circle {
+                center,
+                diameter,
+                normal,
+            } => {
+                *diameter = round_to(*diameter, decimals);
+                vec![center, normal]
+            }
+            ResolvedEntity::Line { p1, p2 } => vec![p1, p2],
+            ResolvedEntity::Arc {
+                center,
+                start,
+                end,
+                normal,
+            } => vec![center, start, end, normal],
+            ResolvedEntity::Cubic {
+                start,
+                control1,
+                control2,
+                end,
+            } => {
+                vec![start, control1, control2, end]
+            }
+        };
+        for v in coords.into_iter().flatten() {
+            *v = round_to(*v, decimals);
+        }
+    }
+}
+
+impl SolveResult {
+    /// Round the solved entities and sensitivities to `decimals` places,
+    /// for output that doesn't need the digits past the solver's tolerance
+    pub fn round(&mut self, decimals: u32) {
+        for entity in self.entities.iter_mut().flat_map(|e| e.values_mut()) {
+            entity.round(decimals);
+        }
+        for rates in self.sensitivities.iter_mut().flat_map(|s| s.values_mut()) {
+            for v in rates.values_mut().flatten() {
+                *v = round_to(*v, decimals);
+            }
+        }
+        for pair in self.interference.iter_mut().flatten() {
+            pair.depth = round_to(pair.depth, decimals);
+        }
+        if let Some(mass) = &mut self.mass {
+            mass.volume = round_to(mass.volume, decimals);
+            mass.area = round_to(mass.area, decimals);
+            for v in mass
+                .centroid
+                .iter_mut()
+                .chain(mass.inertia.iter_mut().flatten())
+            {
+                *v = round_to(*v, decimals);
+            }
+        }
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -580,6 +916,77 @@ mod tests {
         assert_eq!(expr.as_expr(), Some("W/2"));
     }
 
+    #[test]
+    fn test_expr_or_number_deserialize() {
+        let values: Vec<ExprOrNumber> = serde_json::from_str(r#"[1, -2, 2.5, "$W / 2"]"#).unwrap();
+        assert_eq!(
+            values,
+            vec![
+                ExprOrNumber::Number(1.0),
+                ExprOrNumber::Number(-2.0),
+                ExprOrNumber::Number(2.5),
+                ExprOrNumber::Expression("$W / 2".into()),
+            ]
+        );
+        assert!(serde_json::from_str::<ExprOrNumber>("true").is_err());
+
+        // Inside an entity, which serde buffers to find its tag
+        let entity: Entity =
+            serde_json::from_str(r#"{"type": "point", "id": "p", "at": [0, "$h", 1.5]}"#).unwrap();
+        match entity {
+            Entity::Point { at, .. } => assert_eq!(at[1], ExprOrNumber::Expression("$h".into())),
+            other => panic!("not a point: {:?}", other),
+        }
+    }
+
+    #[test]
+    fn test_solve_result_round() {
+        let mut result = SolveResult {
+            status: "ok".to_string(),
+            diagnostics: None,
+            entities: Some(HashMap::from([
+                (
+                    "p".to_string(),
+                    ResolvedEntity::Point {
+                        at: vec![0.1 + 0.2, -1e-12, 2.0 / 3.0],
+                    },
+                ),
+                (
+                    "c".to_string(),
+                    ResolvedEntity::Circle {
+                        center: vec![1.0; 3],
+                        diameter: 9.999_999_7,
+                        normal: vec![0.0; 3],
+                    },
+                ),
+            ])),
+            warnings: vec![],
+            sensitivities: Some(HashMap::from([(
+                "r".to_string(),
+                HashMap::from([("p".to_string(), [1.0 / 3.0, 0.0, 0.0])]),
+            )])),
+            profile: None,
+            interference: None,
+            mass: None,
+        };
+        result.round(6);
+        let entities = result.entities.as_ref().unwrap();
+        assert_eq!(
+            entities["p"],
+            ResolvedEntity::Point {
+                at: vec![0.3, 0.0, 0.666667]
+            }
+        );
+        match &entities["c"] {
+            ResolvedEntity::Circle { diameter, .. } => assert_eq!(*diameter, 10.0),
+            other => panic!("not a circle: {:?}", other),
+        }
+        assert_eq!(
+            result.sensitivities.unwrap()["r"]["p"],
+            [0.333333, 0.0, 0.0]
+        );
+    }
+
     #[test]
     fn test_input_document_deserialize() {
         let json = r#"{
@@ -692,11 +1099,28 @@ mod tests {
             diagnostics: None,
             entities: None,
             warnings: vec![],
+            sensitivities: None,
+            profile: None,
+            interference: None,
+            mass: None,
         };
 
         let json = serde_json::to_string(&result).unwrap();
         assert!(!json.contains("warnings"));
         assert!(!json.contains("diagnostics"));
         assert!(!json.contains("entities"));
+        assert!(!json.contains("sensitivities"));
+    }
+
+    #[test]
+    fn test_diagnostics_without_stats() {
+        // Solutions written before the solver reported its phases still load
+        let json = r#"{"iters": 3, "residual": 0.0, "dof": 0, "time_ms": 1}"#;
+        let diagnostics: Diagnostics = serde_json::from_str(json).unwrap();
+        assert_eq!(diagnostics.iters, 3);
+        assert_eq!(diagnostics.equations, 0);
+        assert_eq!(diagnostics.phases, PhaseTimes::default());
+        assert_eq!(diagnostics.layers, LayerTimes::default());
+        assert_eq!(diagnostics.memory, MemoryCounts::default());
     }
 }
@@ -1,10 +1,24 @@
+pub mod cache;
+pub mod compiled;
+pub mod cost;
 pub mod error;
 pub mod expr;
+pub mod ids;
+pub mod interference;
 pub mod ir;
+pub mod mass;
+pub mod optimize;
+pub mod patch;
+pub mod pool;
 pub mod schema_validator;
+pub mod select;
+pub mod sensitivity;
 pub mod solver;
+pub mod sweep;
 pub mod translator;
 pub mod validator;
+pub mod warm;
+pub mod wire;
 
 pub mod ffi;
 pub mod constraint_registry;
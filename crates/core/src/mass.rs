@@ -0,0 +1,337 @@
+//! Mass properties of the solid the STL export makes of a solved sketch:
+//! each circle extruded along +z into a closed cylinder, and each arc and
+//! cubic into an open wall, which has area but no volume. They're found
+//! analytically, part by part, rather than from the triangles the export
+//! would write, so they don't wait on a mesh or depend on its tolerance.
+//!
+//! Each part's integrals of 1, x and x*x over its volume are taken about
+//! the origin, where they simply add up, and moved to the centroid once
+//! they're all in (the parallel axis theorem). Cylinders that overlap are
+//! each counted in full, as the export's separate shells would be.
+
+use crate::ir::{MassProperties, ResolvedEntity};
+use std::f64::consts::PI;
+use std::thread;
+
+/// Entities to a thread, below which more threads aren't worth starting
+const CHUNK: usize = 4096;
+
+/// Gauss-Legendre nodes and weights on [-1, 1], for the lengths of curves
+const NODES: [(f64, f64); 5] = [
+    (0.0, 0.568_888_888_888_888_9),
+    (-0.538_469_310_105_683_1, 0.478_628_670_499_366_5),
+    (0.538_469_310_105_683_1, 0.478_628_670_499_366_5),
+    (-0.906_179_845_938_664, 0.236_926_885_056_189_1),
+    (0.906_179_845_938_664, 0.236_926_885_056_189_1),
+];
+/// Pieces a cubic is cut into for its length
+const CUBIC_PIECES: usize = 8;
+
+/// A solid's volume, first moments and second moments about the origin,
+/// and its area
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+struct Sums {
+    volume: f64,
+    area: f64,
+    first: [f64; 3],
+    second: [[f64; 3]; 3],
+}
+
+impl Sums {
+    fn add(&mut self, other: &Sums) {
+        self.volume += other.volume;
+        self.area += other.area;
+        for i in 0..3 {
+            self.first[i] += other.first[i];
+            for j in 0..3 {
+                self.second[i][j] += other.second[i][j];
+            }
+        }
+    }
+
+    /// The cylinder standing `height` high on the circle about `center`
+    fn cylinder(center: [f64; 3], radius: f64, height: f64) -> Sums {
+        let (r, h) = (radius.abs(), height.abs());
+        let volume = PI * r * r * h;
+        let c = [center[0], center[1], center[2] + height / 2.0];
+        // About its own centroid, the cylinder's second moments are r^2/4
+        // across the axis and h^2/12 along it, times its volume
+        let own = [r * r / 4.0, r * r / 4.0, h * h / 12.0];
+        let mut second = [[0.0; 3]; 3];
+        for i in 0..3 {
+            for j in 0..3 {
+                second[i][j] = volume * c[i] * c[j];
+            }
+            second[i][i] += volume * own[i];
+        }
+        Sums {
+            volume,
+            area: 2.0 * PI * r * r + 2.0 * PI * r * h,
+            first: c.map(|x| volume * x),
+            second,
+        }
+    }
+
+    /// The wall standing `height` high on a curve this long, seen from +z
+    fn wall(length: f64, height: f64) -> Sums {
+        Sums {
+            area: length * height.abs(),
+            ..Sums::default()
+        }
+    }
+
+    fn of(entity: &ResolvedEntity, height: f64) -> Sums {
+        match entity {
+            ResolvedEntity::Circle {
+                center, diameter, ..
+            } => Sums::cylinder(point(center), diameter / 2.0, height),
+            ResolvedEntity::Arc {
+                center,
+                start,
+                end,
+                normal,
+            } => Sums::wall(
+                arc_length(point(center), point(start), point(end), point(normal)),
+                height,
+            ),
+            ResolvedEntity::Cubic {
+                start,
+                control1,
+                control2,
+                end,
+            } => {
+                let p = [point(start), point(control1), point(control2), point(end)];
+                Sums::wall(cubic_length(&p), height)
+            }
+            _ => Sums::default(),
+        }
+    }
+
+    fn finish(&self) -> MassProperties {
+        let mut mass = MassProperties {
+            volume: self.volume,
+            area: self.area,
+            ..Default::default()
+        };
+        if self.volume == 0.0 {
+            return mass;
+        }
+        let c = self.first.map(|x| x / self.volume);
+        // The second moments about the centroid
+        let mut about = [[0.0; 3]; 3];
+        for i in 0..3 {
+            for j in 0..3 {
+                about[i][j] = self.second[i][j] - self.volume * c[i] * c[j];
+            }
+        }
+        let trace = about[0][0] + about[1][1] + about[2][2];
+        for (i, row) in about.iter().enumerate() {
+            for (j, &m) in row.iter().enumerate() {
+                // Adding zero turns -0 into 0
+                mass.inertia[i][j] = if i == j { trace - m } else { -m + 0.0 };
+            }
+        }
+        mass.centroid = c;
+        mass
+    }
+}
+
+/// A point's coordinates, missing ones 0
+fn point(p: &[f64]) -> [f64; 3] {
+    [0, 1, 2].map(|i| p.get(i).copied().unwrap_or(0.0))
+}
+
+/// The integral of `f` over [a, b], `pieces` at a time
+fn integrate(f: impl Fn(f64) -> f64, a: f64, b: f64, pieces: usize) -> f64 {
+    let step = (b - a) / pieces as f64;
+    (0..pieces)
+        .map(|k| {
+            let mid = a + (k as f64 + 0.5) * step;
+            NODES
+                .iter()
+                .map(|&(x, w)| w * f(mid + x * step / 2.0))
+                .sum::<f64>()
+                * step
+                / 2.0
+        })
+        .sum()
+}
+
+/// The length, seen from +z, of the arc about `center` from `start` to
+/// `end`, counterclockwise about `normal`
+fn arc_length(center: [f64; 3], start: [f64; 3], end: [f64; 3], normal: [f64; 3]) -> f64 {
+    let u = [0, 1, 2].map(|i| start[i] - center[i]);
+    let n = normal.iter().map(|x| x * x).sum::<f64>().sqrt();
+    let n = if n > 0.0 {
+        normal.map(|x| x / n)
+    } else {
+        [0.0, 0.0, 1.0]
+    };
+    let v = [
+        n[1] * u[2] - n[2] * u[1],
+        n[2] * u[0] - n[0] * u[2],
+        n[0] * u[1] - n[1] * u[0],
+    ];
+    let to_end = [0, 1, 2].map(|i| end[i] - center[i]);
+    let along = |a: [f64; 3]| (0..3).map(|i| a[i] * to_end[i]).sum::<f64>();
+    let mut sweep = along(v).atan2(along(u));
+    if sweep <= 0.0 {
+        sweep += 2.0 * PI;
+    }
+    // The speed along the arc, of which only x and y count
+    let speed = |t: f64| {
+        let (s, c) = t.sin_cos();
+        let d = [0, 1].map(|i| v[i] * c - u[i] * s);
+        d[0].hypot(d[1])
+    };
+    integrate(speed, 0.0, sweep, (sweep / (PI / 4.0)).ceil() as usize)
+}
+
+/// The length, seen from +z, of the cubic Bezier on these points
+fn cubic_length(p: &[[f64; 3]; 4]) -> f64 {
+    let speed = |t: f64| {
+        let s = 1.0 - t;
+        let d = [0, 1].map(|i| {
+            3.0 * (s * s * (p[1][i] - p[0][i])
+                + 2.0 * s * t * (p[2][i] - p[1][i])
+                + t * t * (p[3][i] - p[2][i]))
+        });
+        d[0].hypot(d[1])
+    };
+    integrate(speed, 0.0, 1.0, CUBIC_PIECES)
+}
+
+fn sum(entities: &[&ResolvedEntity], height: f64) -> Sums {
+    entities.iter().fold(Sums::default(), |mut total, entity| {
+        total.add(&Sums::of(entity, height));
+        total
+    })
+}
+
+/// The mass properties of the solid the STL export would extrude to
+/// `height` from these solved entities, summed on up to `jobs` threads (0
+/// for one to a core). An empty solid, or one of walls alone, has only
+/// its area.
+pub fn of(entities: &[&ResolvedEntity], height: f64, jobs: usize) -> MassProperties {
+    let jobs = match jobs {
+        0 => thread::available_parallelism().map_or(1, |n| n.get()),
+        n => n,
+    };
+    if entities.len() <= CHUNK || jobs == 1 {
+        return sum(entities, height).finish();
+    }
+    let per = entities.len().div_ceil(jobs).max(CHUNK);
+    let total = thread::scope(|scope| {
+        let parts: Vec<_> = entities
+            .chunks(per)
+            .map(|chunk| scope.spawn(move || sum(chunk, height)))
+            .collect();
+        parts.into_iter().fold(Sums::default(), |mut total, part| {
+            total.add(&part.join().unwrap_or_else(|e| std::panic::resume_unwind(e)));
+            total
+        })
+    });
+    total.finish()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn circle(center: [f64; 3], diameter: f64) -> ResolvedEntity {
+        ResolvedEntity::Circle {
+            center: center.to_vec(),
+            diameter,
+            normal: vec![0.0, 0.0, 1.0],
+        }
+    }
+
+    fn close(a: f64, b: f64) -> bool {
+        (a - b).abs() <= 1e-9 * b.abs().max(1.0)
+    }
+
+    #[test]
+    fn test_cylinder() {
+        let c = circle([1.0, 2.0, 3.0], 4.0);
+        let mass = of(&[&c], 10.0, 1);
+        let volume = PI * 4.0 * 10.0;
+        assert!(close(mass.volume, volume));
+        assert!(close(mass.area, 2.0 * PI * 4.0 + 2.0 * PI * 2.0 * 10.0));
+        assert_eq!(mass.centroid, [1.0, 2.0, 8.0]);
+        assert!(close(mass.inertia[2][2], volume * 4.0 / 2.0));
+        assert!(close(
+            mass.inertia[0][0],
+            volume * (3.0 * 4.0 + 100.0) / 12.0
+        ));
+        assert!(close(mass.inertia[1][1], mass.inertia[0][0]));
+        assert!(mass.inertia[0][1].abs() < 1e-9 && mass.inertia[1][2].abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_parts_move_to_the_centroid() {
+        let (a, b) = (circle([-5.0, 0.0, 0.0], 2.0), circle([5.0, 0.0, 0.0], 2.0));
+        let one = of(&[&a], 4.0, 1);
+        let both = of(&[&a, &b], 4.0, 1);
+        assert!(close(both.volume, 2.0 * one.volume));
+        assert!(both.centroid[0].abs() < 1e-12);
+        // About y, each is 5 off the shared centroid; about x, neither is
+        assert!(close(
+            both.inertia[1][1],
+            2.0 * (one.inertia[1][1] + one.volume * 25.0)
+        ));
+        assert!(close(both.inertia[0][0], 2.0 * one.inertia[0][0]));
+    }
+
+    #[test]
+    fn test_walls_have_area_only() {
+        let arc = ResolvedEntity::Arc {
+            center: vec![0.0, 0.0, 0.0],
+            start: vec![3.0, 0.0, 0.0],
+            end: vec![0.0, 3.0, 0.0],
+            normal: vec![0.0, 0.0, 1.0],
+        };
+        let cubic = ResolvedEntity::Cubic {
+            start: vec![0.0, 0.0, 0.0],
+            control1: vec![1.0, 0.0, 5.0],
+            control2: vec![2.0, 0.0, -5.0],
+            end: vec![3.0, 0.0, 0.0],
+        };
+        let mass = of(
+            &[&arc, &cubic, &ResolvedEntity::Point { at: vec![1.0; 3] }],
+            2.0,
+            1,
+        );
+        assert_eq!(mass.volume, 0.0);
+        assert!(
+            close(mass.area, 2.0 * (3.0 * PI / 2.0 + 3.0)),
+            "{}",
+            mass.area
+        );
+        assert_eq!(mass.centroid, [0.0; 3]);
+    }
+
+    #[test]
+    fn test_threads_sum_the_same() {
+        let circles: Vec<ResolvedEntity> = (0..3 * CHUNK)
+            .map(|i| {
+                circle(
+                    [(i % 97) as f64, (i / 97) as f64, 0.0],
+                    0.5 + (i % 7) as f64 * 0.1,
+                )
+            })
+            .collect();
+        let refs: Vec<&ResolvedEntity> = circles.iter().collect();
+        let serial = of(&refs, 3.0, 1);
+        let parallel = of(&refs, 3.0, 4);
+        assert!(close(parallel.volume, serial.volume));
+        // The products of inertia are differences of large sums, so they're
+        // compared at the scale of the moments
+        let scale = serial.inertia[0][0];
+        for i in 0..3 {
+            assert!(close(parallel.centroid[i], serial.centroid[i]));
+            for j in 0..3 {
+                assert!((parallel.inertia[i][j] - serial.inertia[i][j]).abs() <= 1e-9 * scale);
+            }
+        }
+    }
+}
@@ -0,0 +1,487 @@
+//! Optimizing a document's dimension parameters, within bounds, for an
+//! objective over the solved geometry: the distance between two points, or
+//! the clearance (the least distance) between several pairs of them.
+//!
+//! Each step solves the document with sensitivities, so that the gradient
+//! of the objective with every parameter comes from the Jacobian at the
+//! solution rather than from a solve per parameter, and starts that solve
+//! from the positions the last accepted one ended at. The parameters move
+//! by a projected quasi-Newton (BFGS) method: a parameter at a bound that
+//! the gradient pushes past it is held there, and every trial point is
+//! clamped into the bounds, then backtracked until the objective drops
+//! enough. Only parameters that have sensitivities (see `sensitivity`) can
+//! be optimized.
+
+use crate::error::{Error, Result};
+use crate::ir::{InputDocument, ResolvedEntity, SolveResult};
+use crate::select::Selection;
+use crate::solver::{Solver, SolverConfig};
+use serde::Serialize;
+use std::collections::BTreeMap;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Goal {
+    Minimize,
+    Maximize,
+}
+
+/// What to optimize: the distance between the points of a pair, or with
+/// several pairs, the longest of them when minimizing and the shortest
+/// (the clearance) when maximizing
+#[derive(Debug, Clone, PartialEq)]
+pub struct Objective {
+    pub goal: Goal,
+    pub pairs: Vec<[String; 2]>,
+}
+
+/// A parameter to optimize, and the range it may take
+#[derive(Debug, Clone, PartialEq)]
+pub struct Bound {
+    pub name: String,
+    pub min: f64,
+    pub max: f64,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct OptimizeOptions {
+    pub max_iterations: usize,
+    /// Converged once no parameter, moved across its whole range at the
+    /// current gradient, would change the objective by more than this
+    /// (relative to the objective, once it is past 1)
+    pub tolerance: f64,
+}
+
+impl Default for OptimizeOptions {
+    fn default() -> Self {
+        Self {
+            max_iterations: 100,
+            tolerance: 1e-6,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct OptimizeReport {
+    /// "converged", "max_iterations", or "stalled" if no step along the
+    /// last direction improved the objective
+    pub status: String,
+    /// The objective at the optimized parameters
+    pub objective: f64,
+    pub parameters: BTreeMap<String, f64>,
+    /// The objective's rate of change with each parameter there
+    pub gradient: BTreeMap<String, f64>,
+    pub iterations: usize,
+    /// Solves it took, trial points included
+    pub solves: usize,
+    /// The solve at the optimized parameters
+    pub result: SolveResult,
+}
+
+/// A solved set of parameter values: the objective, to be minimized (so
+/// negated when maximizing), and its gradient
+struct Iterate {
+    x: Vec<f64>,
+    f: f64,
+    g: Vec<f64>,
+    result: SolveResult,
+}
+
+/// Stop once an accepted step changes the objective by less than this,
+/// relative to it
+const F_TOLERANCE: f64 = 1e-12;
+
+/// Halvings of a step before giving up on its direction
+const BACKTRACKS: usize = 30;
+
+fn dot(a: &[f64], b: &[f64]) -> f64 {
+    a.iter().zip(b).map(|(a, b)| a * b).sum()
+}
+
+fn position(result: &SolveResult, id: &str) -> Result<[f64; 3]> {
+    match result.entities.as_ref().and_then(|e| e.get(id)) {
+        Some(ResolvedEntity::Point { at }) => {
+            let mut p = [0.0; 3];
+            for (p, v) in p.iter_mut().zip(at) {
+                *p = *v;
+            }
+            Ok(p)
+        }
+        _ => Err(Error::EntityNotFound(format!(
+            "{} (the objective needs a point)",
+            id
+        ))),
+    }
+}
+
+fn check(doc: &InputDocument, objective: &Objective, bounds: &[Bound]) -> Result<()> {
+    let invalid = |message: String, pointer: Option<&str>| Error::InvalidInput {
+        message,
+        pointer: pointer.map(String::from),
+    };
+    if objective.pairs.is_empty() {
+        return Err(invalid(
+            "The objective needs at least one pair of points".to_string(),
+            None,
+        ));
+    }
+    if bounds.is_empty() {
+        return Err(invalid(
+            "Give at least one parameter to optimize".to_string(),
+            None,
+        ));
+    }
+    for (i, b) in bounds.iter().enumerate() {
+        if !doc.parameters.contains_key(&b.name) {
+            return Err(invalid(
+                format!("The document has no parameter '{}' to optimize", b.name),
+                Some("/parameters"),
+            ));
+        }
+        if !(b.min.is_finite() && b.max.is_finite() && b.min <= b.max) {
+            return Err(invalid(
+                format!("The bounds on '{}' are empty or not finite", b.name),
+                None,
+            ));
+        }
+        if bounds[..i].iter().any(|o| o.name == b.name) {
+            return Err(invalid(format!("'{}' is bounded twice", b.name), None));
+        }
+    }
+    Ok(())
+}
+
+impl Solver {
+    /// Optimize the bounded parameters of the document for the objective,
+    /// starting from their values in the document (clamped into bounds).
+    /// The solve at the start must succeed; a trial point that fails to
+    /// solve is backtracked from like one that doesn't improve.
+    pub fn optimize(
+        &self,
+        doc: &InputDocument,
+        objective: &Objective,
+        bounds: &[Bound],
+        options: OptimizeOptions,
+    ) -> Result<OptimizeReport> {
+        check(doc, objective, bounds)?;
+        let solver = Solver::new(SolverConfig {
+            sensitivities: true,
+            interference: None,
+            mass: None,
+            select: Selection::default(),
+            ..self.config().clone()
+        });
+        let sign = match objective.goal {
+            Goal::Minimize => 1.0,
+            Goal::Maximize => -1.0,
+        };
+        let mut solves = 0;
+
+        let mut evaluate = |x: &[f64], prior: Option<&SolveResult>| -> Result<Iterate> {
+            let mut trial = doc.clone();
+            for (b, v) in bounds.iter().zip(x) {
+                trial.parameters.insert(b.name.clone(), *v);
+            }
+            if let Some(prior) = prior {
+                crate::warm::seed(&mut trial, prior);
+            }
+            solves += 1;
+            let result = solver.solve(&trial)?;
+
+            // The pair that decides the objective: the farthest apart when
+            // minimizing, the closest when maximizing
+            let mut active: Option<(f64, &String, &String, Vec<f64>)> = None;
+            for [a, b] in &objective.pairs {
+                let (pa, pb) = (position(&result, a)?, position(&result, b)?);
+                let d: Vec<f64> = pa.iter().zip(&pb).map(|(a, b)| a - b).collect();
+                let distance = dot(&d, &d).sqrt();
+                if active
+                    .as_ref()
+                    .map_or(true, |&(best, ..)| sign * distance > sign * best)
+                {
+                    active = Some((distance, a, b, d));
+                }
+            }
+            let (distance, a, b, d) = active.expect("pairs were checked");
+
+            let sensitivities = result.sensitivities.as_ref();
+            let g = bounds
+                .iter()
+                .map(|bound| {
+                    let rates =
+                        sensitivities
+                            .and_then(|s| s.get(&bound.name))
+                            .ok_or_else(|| Error::InvalidInput {
+                                message: format!(
+                                "'{}' can't be optimized: only parameters that set the values of \
+                                 distance, angle and diameter constraints, and nothing else, have \
+                                 sensitivities",
+                                bound.name
+                            ),
+                                pointer: Some("/parameters".to_string()),
+                            })?;
+                    if distance == 0.0 {
+                        return Ok(0.0);
+                    }
+                    let moved = |p: &String| rates.get(p).copied().unwrap_or_default();
+                    let (ra, rb) = (moved(a), moved(b));
+                    let along: Vec<f64> = ra.iter().zip(&rb).map(|(a, b)| a - b).collect();
+                    Ok(sign * dot(&d, &along) / distance)
+                })
+                .collect::<Result<Vec<f64>>>()?;
+            Ok(Iterate {
+                x: x.to_vec(),
+                f: sign * distance,
+                g,
+                result,
+            })
+        };
+
+        let n = bounds.len();
+        let span: Vec<f64> = bounds.iter().map(|b| b.max - b.min).collect();
+        let x: Vec<f64> = bounds
+            .iter()
+            .map(|b| doc.parameters[&b.name].clamp(b.min, b.max))
+            .collect();
+        let mut at = evaluate(&x, None)?;
+        // The inverse Hessian approximation, over all parameters; None
+        // until the first step, and after a direction that doesn't descend
+        let mut h: Option<Vec<Vec<f64>>> = None;
+        let mut status = "max_iterations";
+        let mut iterations = 0;
+
+        while iterations < options.max_iterations {
+            // Parameters held at a bound the gradient pushes past
+            let free: Vec<bool> = (0..n)
+                .map(|i| {
+                    let b = &bounds[i];
+                    span[i] > 0.0
+                        && !(at.x[i] <= b.min && at.g[i] > 0.0)
+                        && !(at.x[i] >= b.max && at.g[i] < 0.0)
+                })
+                .collect();
+            let reach = (0..n)
+                .filter(|&i| free[i])
+                .map(|i| (at.g[i] * span[i]).abs())
+                .fold(0.0, f64::max);
+            if reach <= options.tolerance * at.f.abs().max(1.0) {
+                status = "converged";
+                break;
+            }
+            iterations += 1;
+
+            let direction = |h: &[Vec<f64>]| -> Vec<f64> {
+                (0..n)
+                    .map(|i| {
+                        if !free[i] {
+                            return 0.0;
+                        }
+                        -(0..n)
+                            .filter(|&j| free[j])
+                            .map(|j| h[i][j] * at.g[j])
+                            .sum::<f64>()
+                    })
+                    .collect()
+            };
+            let mut d = h.as_deref().map(direction).unwrap_or_default();
+            if h.is_none() || dot(&d, &at.g) >= 0.0 {
+                // Steepest descent, scaled so that the first trial moves
+                // each parameter by at most a quarter of its range
+                let mut scaled = vec![vec![0.0; n]; n];
+                for i in 0..n {
+                    scaled[i][i] = 0.25 * span[i] * span[i] / reach;
+                }
+                d = direction(&scaled);
+                h = Some(scaled);
+            }
+
+            let mut t = 1.0;
+            let mut next = None;
+            for _ in 0..BACKTRACKS {
+                let x: Vec<f64> = (0..n)
+                    .map(|i| (at.x[i] + t * d[i]).clamp(bounds[i].min, bounds[i].max))
+                    .collect();
+                if x == at.x {
+                    break;
+                }
+                let step: Vec<f64> = x.iter().zip(&at.x).map(|(a, b)| a - b).collect();
+                match evaluate(&x, Some(&at.result)) {
+                    Ok(trial) if trial.f <= at.f + 1e-4 * dot(&at.g, &step) => {
+                        next = Some(trial);
+                        break;
+                    }
+                    _ => t *= 0.5,
+                }
+            }
+            let Some(next) = next else {
+                status = "stalled";
+                break;
+            };
+
+            let s: Vec<f64> = next.x.iter().zip(&at.x).map(|(a, b)| a - b).collect();
+            let y: Vec<f64> = next.g.iter().zip(&at.g).map(|(a, b)| a - b).collect();
+            let sy = dot(&s, &y);
+            if let Some(h) = h
+                .as_mut()
+                .filter(|_| sy > 1e-12 * dot(&s, &s).sqrt() * dot(&y, &y).sqrt())
+            {
+                // H = (I - ρ s yᵀ) H (I - ρ y sᵀ) + ρ s sᵀ
+                let rho = 1.0 / sy;
+                let hy: Vec<f64> = (0..n).map(|i| dot(&h[i], &y)).collect();
+                let yhy = dot(&y, &hy);
+                for i in 0..n {
+                    for j in 0..n {
+                        h[i][j] += -rho * (hy[i] * s[j] + s[i] * hy[j])
+                            + (rho * rho * yhy + rho) * s[i] * s[j];
+                    }
+                }
+            }
+
+            let change = (at.f - next.f).abs();
+            at = next;
+            if change <= F_TOLERANCE * at.f.abs().max(1.0) {
+                status = "converged";
+                break;
+            }
+        }
+
+        Ok(OptimizeReport {
+            status: status.to_string(),
+            objective: sign * at.f,
+            parameters: bounds
+                .iter()
+                .map(|b| b.name.clone())
+                .zip(at.x.iter().copied())
+                .collect(),
+            gradient: bounds
+                .iter()
+                .map(|b| b.name.clone())
+                .zip(at.g.iter().map(|g| sign * g))
+                .collect(),
+            iterations,
+            solves,
+            result: at.result,
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// p3 sits `2 * $r` from the fixed p1, at `$a` degrees from the fixed
+    /// line p1-p2; q is fixed at 80 from p1, at 36.87 degrees.
+    fn arm_document() -> InputDocument {
+        serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": 12.0, "a": 60.0, "h": 5.0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [80, 0, 0]},
+                {"type": "point", "id": "p3", "at": [12, 20, 0]},
+                {"type": "point", "id": "q", "at": [64, 48, 0]},
+                {"type": "point", "id": "p4", "at": [0, "$h", 0]},
+                {"type": "line", "id": "l1", "p1": "p1", "p2": "p2"},
+                {"type": "line", "id": "l2", "p1": "p1", "p2": "p3"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "fixed", "entity": "p2"},
+                {"type": "fixed", "entity": "q"},
+                {"type": "fixed", "entity": "p4"},
+                {"type": "distance", "between": ["p1", "p3"], "value": "2 * $r"},
+                {"type": "angle", "between": ["l1", "l2"], "value": "$a"}
+            ]
+        }))
+        .unwrap()
+    }
+
+    fn bound(name: &str, min: f64, max: f64) -> Bound {
+        Bound {
+            name: name.to_string(),
+            min,
+            max,
+        }
+    }
+
+    fn pair(a: &str, b: &str) -> [String; 2] {
+        [a.to_string(), b.to_string()]
+    }
+
+    #[test]
+    fn test_minimize_reaches_a_bound_and_an_interior_optimum() {
+        let objective = Objective {
+            goal: Goal::Minimize,
+            pairs: vec![pair("p3", "q")],
+        };
+        let bounds = [bound("r", 5.0, 20.0), bound("a", 10.0, 80.0)];
+        let report = Solver::new(SolverConfig::default())
+            .optimize(
+                &arm_document(),
+                &objective,
+                &bounds,
+                OptimizeOptions::default(),
+            )
+            .unwrap();
+        assert_eq!(report.status, "converged");
+        // p3 reaches at most 40 from p1, pointing at q, 80 away
+        assert_eq!(report.parameters["r"], 20.0);
+        assert!((report.parameters["a"] - 0.75f64.atan().to_degrees()).abs() < 1e-3);
+        assert!((report.objective - 40.0).abs() < 1e-6);
+        assert!(report.gradient["r"] < 0.0);
+        assert!(report.solves > report.iterations);
+    }
+
+    #[test]
+    fn test_maximize_clearance() {
+        // As far as p3 can get from both p2 and q: round past p1 from them,
+        // as far out as it may, where q is the nearer of the two
+        let objective = Objective {
+            goal: Goal::Maximize,
+            pairs: vec![pair("p3", "p2"), pair("p3", "q")],
+        };
+        let bounds = [bound("r", 5.0, 20.0), bound("a", 10.0, 150.0)];
+        let report = Solver::new(SolverConfig::default())
+            .optimize(
+                &arm_document(),
+                &objective,
+                &bounds,
+                OptimizeOptions::default(),
+            )
+            .unwrap();
+        assert_eq!(report.parameters["a"], 150.0);
+        assert_eq!(report.parameters["r"], 20.0);
+        let p3 = position(&report.result, "p3").unwrap();
+        let to_q = ((p3[0] - 64.0).powi(2) + (p3[1] - 48.0).powi(2)).sqrt();
+        assert!((report.objective - to_q).abs() < 1e-9);
+        assert!(report.objective > 90.0);
+    }
+
+    #[test]
+    fn test_rejects_what_it_cant_optimize() {
+        let solver = Solver::new(SolverConfig::default());
+        let doc = arm_document();
+        let objective = Objective {
+            goal: Goal::Minimize,
+            pairs: vec![pair("p3", "q")],
+        };
+        let options = OptimizeOptions::default();
+        // h places p4, so it has no sensitivities
+        let err = solver
+            .optimize(&doc, &objective, &[bound("h", 0.0, 10.0)], options)
+            .unwrap_err();
+        assert!(err.to_string().contains("'h' can't be optimized"));
+        assert!(solver
+            .optimize(&doc, &objective, &[bound("x", 0.0, 1.0)], options)
+            .is_err());
+        assert!(solver
+            .optimize(&doc, &objective, &[bound("r", 2.0, 1.0)], options)
+            .is_err());
+        let nowhere = Objective {
+            goal: Goal::Minimize,
+            pairs: vec![pair("p3", "l1")],
+        };
+        assert!(solver
+            .optimize(&doc, &nowhere, &[bound("r", 1.0, 2.0)], options)
+            .is_err());
+    }
+}
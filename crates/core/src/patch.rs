@@ -0,0 +1,507 @@
+//! RFC 6902 JSON Patch, for editing a document a little at a time rather
+//! than sending all of it again: set a value, add a constraint, remove an
+//! entity.
+//!
+//! A patch applies as a whole or not at all; if an operation fails, those
+//! before it are undone, which takes as long as they did rather than a copy
+//! of the document. `apply_to_document` keeps a parsed document in step
+//! with its JSON, parsing again only the entities and constraints that the
+//! patch reached into, unless it added, removed or moved whole ones.
+
+use crate::error::{Error, Result};
+use crate::ir::{Constraint, Entity, InputDocument};
+use serde::{Deserialize, Serialize};
+use serde_json::Value;
+use std::collections::HashMap;
+
+/// One operation of a patch; paths are JSON Pointers (RFC 6901)
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(tag = "op", rename_all = "lowercase")]
+pub enum Operation {
+    Add { path: String, value: Value },
+    Remove { path: String },
+    Replace { path: String, value: Value },
+    Move { from: String, path: String },
+    Copy { from: String, path: String },
+    Test { path: String, value: Value },
+}
+
+impl Operation {
+    /// The paths the operation writes to or reads from
+    fn paths(&self) -> impl Iterator<Item = &str> {
+        let (path, from) = match self {
+            Operation::Add { path, .. }
+            | Operation::Remove { path }
+            | Operation::Replace { path, .. }
+            | Operation::Test { path, .. } => (path, None),
+            Operation::Move { from, path } | Operation::Copy { from, path } => (path, Some(from)),
+        };
+        std::iter::once(path.as_str()).chain(from.map(String::as_str))
+    }
+}
+
+/// A pointer's reference tokens, unescaped: `~1` is `/` and `~0` is `~`
+fn tokens(pointer: &str) -> std::result::Result<Vec<String>, String> {
+    if pointer.is_empty() {
+        return Ok(Vec::new());
+    }
+    let Some(rest) = pointer.strip_prefix('/') else {
+        return Err(format!(
+            "'{}' isn't a JSON Pointer; it should start with '/'",
+            pointer
+        ));
+    };
+    Ok(rest
+        .split('/')
+        .map(|t| t.replace("~1", "/").replace("~0", "~"))
+        .collect())
+}
+
+/// An array index, which must be 0 or have no leading zeros, up to `len`
+fn index(token: &str, len: usize) -> std::result::Result<usize, String> {
+    match token.parse::<usize>() {
+        Ok(i) if i <= len && (token == "0" || !token.starts_with('0')) => Ok(i),
+        _ => Err(format!("'{}' isn't an index from 0 to {}", token, len)),
+    }
+}
+
+fn get<'a>(doc: &'a Value, path: &[String]) -> std::result::Result<&'a Value, String> {
+    path.iter().try_fold(doc, |value, token| {
+        let found = match value {
+            Value::Object(map) => map.get(token),
+            Value::Array(items) => index(token, items.len()).ok().and_then(|i| items.get(i)),
+            _ => None,
+        };
+        found.ok_or_else(|| format!("Nothing is at '{}'", token))
+    })
+}
+
+/// The container that the last token of a path is in
+fn parent<'a, 'p>(
+    doc: &'a mut Value,
+    path: &'p [String],
+) -> std::result::Result<(&'a mut Value, &'p str), String> {
+    let (last, within) = path
+        .split_last()
+        .ok_or("The document itself can't be added to")?;
+    let mut value = doc;
+    for token in within {
+        value = match value {
+            Value::Object(map) => map.get_mut(token),
+            Value::Array(items) => {
+                let len = items.len();
+                index(token, len).ok().and_then(move |i| items.get_mut(i))
+            }
+            _ => None,
+        }
+        .ok_or_else(|| format!("Nothing is at '{}'", token))?;
+    }
+    Ok((value, last))
+}
+
+/// What puts the document back as it was before one step of a patch
+enum Undo {
+    Remove(Vec<String>),
+    Add(Vec<String>, Value),
+    /// The whole document, replaced
+    Document(Value),
+}
+
+/// Add `value` at `path`, replacing what an object has there already
+fn add(doc: &mut Value, path: Vec<String>, value: Value) -> std::result::Result<Undo, String> {
+    if path.is_empty() {
+        return Ok(Undo::Document(std::mem::replace(doc, value)));
+    }
+    let (container, last) = parent(doc, &path)?;
+    let undo = match container {
+        Value::Object(map) => match map.insert(last.to_string(), value) {
+            Some(old) => Undo::Add(path, old),
+            None => Undo::Remove(path),
+        },
+        Value::Array(items) => {
+            let i = if last == "-" {
+                items.len()
+            } else {
+                index(last, items.len())?
+            };
+            items.insert(i, value);
+            let mut path = path;
+            *path.last_mut().unwrap() = i.to_string();
+            Undo::Remove(path)
+        }
+        _ => return Err("Only an object or an array can be added to".to_string()),
+    };
+    Ok(undo)
+}
+
+/// Remove what's at `path`, and return it
+fn remove(doc: &mut Value, path: Vec<String>) -> std::result::Result<(Value, Undo), String> {
+    let (container, last) = parent(doc, &path)?;
+    let removed = match container {
+        Value::Object(map) => map.remove(last),
+        Value::Array(items) => match index(last, items.len()) {
+            Ok(i) if i < items.len() => Some(items.remove(i)),
+            _ => None,
+        },
+        _ => None,
+    }
+    .ok_or_else(|| format!("Nothing is at '{}' to remove", last))?;
+    Ok((removed.clone(), Undo::Add(path, removed)))
+}
+
+/// Whether two values are the same, numbers by their value, as `test` asks
+fn same(a: &Value, b: &Value) -> bool {
+    match (a, b) {
+        (Value::Number(a), Value::Number(b)) => a.as_f64() == b.as_f64(),
+        (Value::Array(a), Value::Array(b)) => {
+            a.len() == b.len() && a.iter().zip(b).all(|(a, b)| same(a, b))
+        }
+        (Value::Object(a), Value::Object(b)) => {
+            a.len() == b.len() && a.iter().all(|(k, v)| b.get(k).is_some_and(|w| same(v, w)))
+        }
+        _ => a == b,
+    }
+}
+
+fn step(doc: &mut Value, op: &Operation, undo: &mut Vec<Undo>) -> std::result::Result<(), String> {
+    match op {
+        Operation::Add { path, value } => undo.push(add(doc, tokens(path)?, value.clone())?),
+        Operation::Remove { path } => undo.push(remove(doc, tokens(path)?)?.1),
+        Operation::Replace { path, value } => {
+            let path = tokens(path)?;
+            if path.is_empty() {
+                undo.push(Undo::Document(std::mem::replace(doc, value.clone())));
+            } else {
+                let (_, removed) = remove(doc, path.clone())?;
+                undo.push(removed);
+                undo.push(add(doc, path, value.clone())?);
+            }
+        }
+        Operation::Move { from, path } => {
+            let (from, path) = (tokens(from)?, tokens(path)?);
+            if path.len() > from.len() && path.starts_with(&from) {
+                return Err("A value can't be moved into itself".to_string());
+            }
+            let (value, removed) = remove(doc, from)?;
+            undo.push(removed);
+            undo.push(add(doc, path, value)?);
+        }
+        Operation::Copy { from, path } => {
+            let value = get(doc, &tokens(from)?)?.clone();
+            undo.push(add(doc, tokens(path)?, value)?);
+        }
+        Operation::Test { path, value } => {
+            if !same(get(doc, &tokens(path)?)?, value) {
+                return Err("The value isn't what the test expects".to_string());
+            }
+        }
+    }
+    Ok(())
+}
+
+fn rollback(doc: &mut Value, undo: Vec<Undo>) {
+    for step in undo.into_iter().rev() {
+        // Each undoes a step that succeeded, so can't fail
+        let _ = match step {
+            Undo::Remove(path) => remove(doc, path).map(|_| ()),
+            Undo::Add(path, value) => add(doc, path, value).map(|_| ()),
+            Undo::Document(value) => {
+                *doc = value;
+                Ok(())
+            }
+        };
+    }
+}
+
+fn failed(i: usize, message: String) -> Error {
+    Error::InvalidInput {
+        message: format!("Patch operation {}: {}", i, message),
+        pointer: Some(format!("/patch/{}", i)),
+    }
+}
+
+fn apply_undoable(doc: &mut Value, patch: &[Operation]) -> Result<Vec<Undo>> {
+    let mut undo = Vec::new();
+    for (i, op) in patch.iter().enumerate() {
+        if let Err(message) = step(doc, op, &mut undo) {
+            rollback(doc, undo);
+            return Err(failed(i, message));
+        }
+    }
+    Ok(undo)
+}
+
+/// Apply a patch to a JSON value, all of it or, if it fails, none of it
+pub fn apply(doc: &mut Value, patch: &[Operation]) -> Result<()> {
+    apply_undoable(doc, patch).map(|_| ())
+}
+
+/// What a patch reached into, and so what has to be parsed again
+#[derive(Default)]
+struct Touched {
+    document: bool,
+    parameters: bool,
+    /// Whole lists, when an item was added, removed or moved
+    entities: bool,
+    constraints: bool,
+    /// Items written inside, by index
+    entity: Vec<usize>,
+    constraint: Vec<usize>,
+}
+
+impl Touched {
+    fn of(patch: &[Operation]) -> Self {
+        let mut touched = Touched::default();
+        for path in patch.iter().flat_map(Operation::paths) {
+            let path = tokens(path).unwrap_or_default();
+            let item = path.get(1).and_then(|t| t.parse::<usize>().ok());
+            match (path.first().map(String::as_str), path.len()) {
+                (Some("parameters"), _) => touched.parameters = true,
+                (Some("entities"), n) if n > 2 && item.is_some() => touched.entity.extend(item),
+                (Some("constraints"), n) if n > 2 && item.is_some() => {
+                    touched.constraint.extend(item)
+                }
+                (Some("entities"), n) if n > 1 => touched.entities = true,
+                (Some("constraints"), n) if n > 1 => touched.constraints = true,
+                _ => touched.document = true,
+            }
+        }
+        touched
+    }
+}
+
+fn parse<T: for<'de> Deserialize<'de>>(value: &Value, pointer: String) -> Result<T> {
+    T::deserialize(value).map_err(|e| Error::InvalidInput {
+        message: format!("After the patch, {}: {}", pointer, e),
+        pointer: Some(pointer),
+    })
+}
+
+/// The parts of a document that a patch changed, parsed from its JSON
+#[derive(Default)]
+struct Parts {
+    document: Option<Box<InputDocument>>,
+    parameters: Option<HashMap<String, f64>>,
+    entities: Option<Vec<Entity>>,
+    constraints: Option<Vec<Constraint>>,
+    entity: Vec<(usize, Entity)>,
+    constraint: Vec<(usize, Constraint)>,
+}
+
+impl Parts {
+    fn parse(source: &Value, touched: &Touched) -> Result<Self> {
+        if touched.document {
+            return Ok(Parts {
+                document: Some(parse(source, String::new())?),
+                ..Parts::default()
+            });
+        }
+        let list = |name: &str| source.get(name).unwrap_or(&Value::Null);
+        let mut parts = Parts::default();
+        if touched.parameters {
+            parts.parameters = Some(parse(list("parameters"), "/parameters".to_string())?);
+        }
+        if touched.entities {
+            parts.entities = Some(parse(list("entities"), "/entities".to_string())?);
+        } else {
+            for &i in &touched.entity {
+                let pointer = format!("/entities/{}", i);
+                parts
+                    .entity
+                    .push((i, parse(&list("entities")[i], pointer)?));
+            }
+        }
+        if touched.constraints {
+            parts.constraints = Some(parse(list("constraints"), "/constraints".to_string())?);
+        } else {
+            for &i in &touched.constraint {
+                let pointer = format!("/constraints/{}", i);
+                parts
+                    .constraint
+                    .push((i, parse(&list("constraints")[i], pointer)?));
+            }
+        }
+        Ok(parts)
+    }
+
+    /// Swap these parts with the document's; swapping again puts it back
+    fn swap(&mut self, doc: &mut InputDocument) {
+        use std::mem::swap;
+        if let Some(document) = &mut self.document {
+            swap(doc, document);
+        }
+        if let Some(parameters) = &mut self.parameters {
+            swap(&mut doc.parameters, parameters);
+        }
+        if let Some(entities) = &mut self.entities {
+            swap(&mut doc.entities, entities);
+        }
+        if let Some(constraints) = &mut self.constraints {
+            swap(&mut doc.constraints, constraints);
+        }
+        for (i, entity) in &mut self.entity {
+            swap(&mut doc.entities[*i], entity);
+        }
+        for (i, constraint) in &mut self.constraint {
+            swap(&mut doc.constraints[*i], constraint);
+        }
+    }
+}
+
+/// Apply a patch to a document's JSON, bring the parsed document in step
+/// with it, and `check` the result. If the patch fails, leaves something
+/// that doesn't parse, or fails the check, neither changes.
+pub fn apply_to_document<F>(
+    source: &mut Value,
+    doc: &mut InputDocument,
+    patch: &[Operation],
+    check: F,
+) -> Result<()>
+where
+    F: FnOnce(&InputDocument) -> Result<()>,
+{
+    let undo = apply_undoable(source, patch)?;
+    let mut parts = match Parts::parse(source, &Touched::of(patch)) {
+        Ok(parts) => parts,
+        Err(e) => {
+            rollback(source, undo);
+            return Err(e);
+        }
+    };
+    parts.swap(doc);
+    if let Err(e) = check(doc) {
+        parts.swap(doc);
+        rollback(source, undo);
+        return Err(e);
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+
+    fn patch(ops: Value) -> Vec<Operation> {
+        serde_json::from_value(ops).unwrap()
+    }
+
+    #[test]
+    fn test_rfc_examples() {
+        let mut doc = json!({"foo": ["bar", "baz"], "a/b": 1, "m~n": 2});
+        apply(
+            &mut doc,
+            &patch(json!([
+                {"op": "add", "path": "/foo/1", "value": "qux"},
+                {"op": "remove", "path": "/foo/0"},
+                {"op": "replace", "path": "/a~1b", "value": 3},
+                {"op": "test", "path": "/m~0n", "value": 2.0},
+                {"op": "copy", "from": "/foo/0", "path": "/foo/-"},
+                {"op": "move", "from": "/m~0n", "path": "/moved"}
+            ])),
+        )
+        .unwrap();
+        assert_eq!(
+            doc,
+            json!({"foo": ["qux", "baz", "qux"], "a/b": 3, "moved": 2})
+        );
+    }
+
+    #[test]
+    fn test_a_failed_patch_changes_nothing() {
+        let original = json!({"foo": ["bar"], "baz": {"x": 1}});
+        let mut doc = original.clone();
+        let err = apply(
+            &mut doc,
+            &patch(json!([
+                {"op": "add", "path": "/foo/-", "value": 1},
+                {"op": "replace", "path": "/baz/x", "value": 2},
+                {"op": "move", "from": "/baz", "path": "/qux"},
+                {"op": "remove", "path": "/nope"}
+            ])),
+        )
+        .unwrap_err();
+        assert_eq!(doc, original);
+        assert!(matches!(err, Error::InvalidInput { pointer: Some(p), .. } if p == "/patch/3"));
+
+        for bad in [
+            json!([{"op": "test", "path": "/foo/0", "value": "nope"}]),
+            json!([{"op": "add", "path": "/foo/2", "value": 1}]),
+            json!([{"op": "add", "path": "/foo/01", "value": 1}]),
+            json!([{"op": "move", "from": "/baz", "path": "/baz/y"}]),
+            json!([{"op": "replace", "path": "foo", "value": 1}]),
+        ] {
+            assert!(apply(&mut doc, &patch(bad)).is_err());
+            assert_eq!(doc, original);
+        }
+    }
+
+    fn document() -> Value {
+        json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10.0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        })
+    }
+
+    #[test]
+    fn test_document_follows_its_json() {
+        let mut source = document();
+        let mut doc: InputDocument = serde_json::from_value(source.clone()).unwrap();
+        let edits = [
+            json!([{"op": "replace", "path": "/entities/1/at/1", "value": 5}]),
+            json!([{"op": "replace", "path": "/parameters/r", "value": 20}]),
+            json!([
+                {"op": "add", "path": "/entities/-",
+                 "value": {"type": "point", "id": "p3", "at": [0, 1, 0]}},
+                {"op": "add", "path": "/constraints/-",
+                 "value": {"type": "distance", "between": ["p1", "p3"], "value": 4}}
+            ]),
+            json!([{"op": "remove", "path": "/constraints/0"}]),
+            json!([{"op": "add", "path": "/units", "value": "in"}]),
+        ];
+        for edit in edits {
+            apply_to_document(&mut source, &mut doc, &patch(edit), |_| Ok(())).unwrap();
+            assert_eq!(
+                doc,
+                serde_json::from_value::<InputDocument>(source.clone()).unwrap()
+            );
+        }
+        assert_eq!(doc.entities.len(), 3);
+        assert_eq!(doc.constraints.len(), 2);
+    }
+
+    #[test]
+    fn test_a_patch_that_breaks_the_document_is_undone() {
+        let mut source = document();
+        let mut doc: InputDocument = serde_json::from_value(source.clone()).unwrap();
+        let before = (source.clone(), doc.clone());
+        let edit = json!([
+            {"op": "replace", "path": "/parameters/r", "value": 5},
+            {"op": "replace", "path": "/entities/0/type", "value": "nope"}
+        ]);
+        let err = apply_to_document(&mut source, &mut doc, &patch(edit), |_| Ok(())).unwrap_err();
+        assert!(matches!(err, Error::InvalidInput { pointer: Some(p), .. } if p == "/entities/0"));
+        assert_eq!((&source, &doc), (&before.0, &before.1));
+
+        // Or that fails the check
+        let edit = json!([
+            {"op": "replace", "path": "/parameters/r", "value": 5},
+            {"op": "replace", "path": "/entities/1/at/0", "value": 3},
+            {"op": "remove", "path": "/entities/0"}
+        ]);
+        let check = |doc: &InputDocument| match doc.entities.len() {
+            2 => Ok(()),
+            _ => Err(Error::Ffi("p1 is gone".to_string())),
+        };
+        assert!(apply_to_document(&mut source, &mut doc, &patch(edit), check).is_err());
+        assert_eq!((source, doc), before);
+    }
+}
@@ -0,0 +1,364 @@
+//! Solves run on a pool of threads of their own, for async services: a
+//! solve is queued as a future that any executor can await, and blocks
+//! none of its threads.
+//!
+//! The queue is bounded, so a pool that's behind refuses more work with
+//! `Error::Overloaded` rather than letting it wait without end. Each solve
+//! can be cancelled, which resolves its future at once with
+//! `Error::Cancelled`; a queued solve is dropped, and a running one is
+//! stopped at the native solver's next check, as a timeout would stop it.
+//! Dropping the future cancels it too, so a solve that an executor's timeout
+//! gives up on doesn't hold a worker. (A cancel in the instant between the
+//! native system being built and its solve starting can't stop the solve,
+//! which then runs to its end; its result is still dropped.)
+
+use crate::error::{Error, Result};
+use crate::expr::ExpressionEvaluator;
+use crate::ffi::Canceller;
+use crate::ir::{InputDocument, SolveResult};
+use crate::solver::{Solver, SolverConfig};
+use std::future::Future;
+use std::pin::Pin;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::mpsc::{sync_channel, Receiver, SyncSender, TrySendError};
+use std::sync::{Arc, Mutex};
+use std::task::{Context, Poll, Waker};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// A finished solve, with how long it waited for a worker and then ran
+#[derive(Debug)]
+pub struct Solved {
+    pub result: Result<SolveResult>,
+    pub queued: Duration,
+    pub ran: Duration,
+}
+
+struct Job {
+    config: SolverConfig,
+    doc: InputDocument,
+    shared: Arc<Shared>,
+}
+
+/// What a solve's future, its cancel handles and its worker share
+struct Shared {
+    cancelled: AtomicBool,
+    /// The native system, while it's solving
+    running: Mutex<Option<Canceller>>,
+    state: Mutex<State>,
+}
+
+struct State {
+    submitted: Instant,
+    started: Option<Instant>,
+    /// Set once, by whichever of the worker and a cancel comes first
+    finished: bool,
+    done: Option<Solved>,
+    waker: Option<Waker>,
+}
+
+impl Shared {
+    fn finish(&self, result: Result<SolveResult>) {
+        let mut state = self.state.lock().unwrap_or_else(|e| e.into_inner());
+        if state.finished {
+            return;
+        }
+        let now = Instant::now();
+        let started = state.started.unwrap_or(now);
+        state.finished = true;
+        state.done = Some(Solved {
+            result,
+            queued: started - state.submitted,
+            ran: now - started,
+        });
+        if let Some(waker) = state.waker.take() {
+            waker.wake();
+        }
+    }
+
+    fn cancel(&self) {
+        self.cancelled.store(true, Ordering::Relaxed);
+        // Held while the worker drops the system, so it's never cancelled
+        // after that
+        let running = self.running.lock().unwrap_or_else(|e| e.into_inner());
+        if let Some(canceller) = *running {
+            unsafe { canceller.cancel() };
+        }
+        drop(running);
+        self.finish(Err(Error::Cancelled));
+    }
+}
+
+/// Cancels one solve from anywhere; see `SolveFuture::cancel_handle`
+#[derive(Clone)]
+pub struct CancelHandle(Arc<Shared>);
+
+impl CancelHandle {
+    pub fn cancel(&self) {
+        self.0.cancel();
+    }
+
+    pub fn is_cancelled(&self) -> bool {
+        self.0.cancelled.load(Ordering::Relaxed)
+    }
+}
+
+/// A queued solve, which resolves once it's solved or cancelled
+pub struct SolveFuture {
+    shared: Arc<Shared>,
+}
+
+impl SolveFuture {
+    pub fn cancel_handle(&self) -> CancelHandle {
+        CancelHandle(Arc::clone(&self.shared))
+    }
+}
+
+impl Future for SolveFuture {
+    type Output = Solved;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Solved> {
+        let mut state = self.shared.state.lock().unwrap_or_else(|e| e.into_inner());
+        match state.done.take() {
+            Some(solved) => Poll::Ready(solved),
+            None => {
+                state.waker = Some(cx.waker().clone());
+                Poll::Pending
+            }
+        }
+    }
+}
+
+impl Drop for SolveFuture {
+    fn drop(&mut self) {
+        let finished = self.shared.state.lock().map(|s| s.finished).unwrap_or(true);
+        if !finished {
+            self.shared.cancel();
+        }
+    }
+}
+
+pub struct SolvePool {
+    jobs: Option<SyncSender<Job>>,
+    threads: Vec<thread::JoinHandle<()>>,
+}
+
+impl SolvePool {
+    /// Start `workers` threads (at least one), with room for `queue` more
+    /// solves to wait for them
+    pub fn new(workers: usize, queue: usize) -> Self {
+        let (jobs, receiver) = sync_channel::<Job>(queue);
+        let receiver = Arc::new(Mutex::new(receiver));
+        let threads = (0..workers.max(1))
+            .map(|_| {
+                let receiver = Arc::clone(&receiver);
+                thread::spawn(move || work(&receiver))
+            })
+            .collect();
+        Self {
+            jobs: Some(jobs),
+            threads,
+        }
+    }
+
+    /// Queue a solve of doc with these options, or refuse it with
+    /// `Error::Overloaded` if the queue is full
+    pub fn solve(&self, config: SolverConfig, doc: InputDocument) -> Result<SolveFuture> {
+        let shared = Arc::new(Shared {
+            cancelled: AtomicBool::new(false),
+            running: Mutex::new(None),
+            state: Mutex::new(State {
+                submitted: Instant::now(),
+                started: None,
+                finished: false,
+                done: None,
+                waker: None,
+            }),
+        });
+        let job = Job {
+            config,
+            doc,
+            shared: Arc::clone(&shared),
+        };
+        let jobs = self.jobs.as_ref().ok_or(Error::Overloaded)?;
+        match jobs.try_send(job) {
+            Ok(()) => Ok(SolveFuture { shared }),
+            Err(TrySendError::Full(_)) | Err(TrySendError::Disconnected(_)) => {
+                Err(Error::Overloaded)
+            }
+        }
+    }
+}
+
+impl Drop for SolvePool {
+    /// Solves already queued are finished first
+    fn drop(&mut self) {
+        drop(self.jobs.take());
+        for t in self.threads.drain(..) {
+            let _ = t.join();
+        }
+    }
+}
+
+fn work(receiver: &Mutex<Receiver<Job>>) {
+    loop {
+        let job = receiver.lock().map(|r| r.recv());
+        let Ok(Ok(Job {
+            config,
+            doc,
+            shared,
+        })) = job
+        else {
+            break;
+        };
+        {
+            let mut state = shared.state.lock().unwrap_or_else(|e| e.into_inner());
+            if state.finished {
+                continue;
+            }
+            state.started = Some(Instant::now());
+        }
+        let result = run(&Solver::new(config), &doc, &shared);
+        shared.finish(result);
+    }
+}
+
+fn run(solver: &Solver, doc: &InputDocument, shared: &Shared) -> Result<SolveResult> {
+    let start = Instant::now();
+    let eval = ExpressionEvaluator::new(doc.parameters.clone());
+    let mut built = solver.build(doc, &eval)?;
+    {
+        let mut running = shared.running.lock().unwrap_or_else(|e| e.into_inner());
+        if shared.cancelled.load(Ordering::Relaxed) {
+            return Err(Error::Cancelled);
+        }
+        *running = Some(built.ffi_solver.canceller());
+    }
+    let result = solver.solve_built(doc, &eval, &mut built, start);
+    *shared.running.lock().unwrap_or_else(|e| e.into_inner()) = None;
+    if shared.cancelled.load(Ordering::Relaxed) {
+        return Err(Error::Cancelled);
+    }
+    result
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::Condvar;
+    use std::task::Wake;
+
+    /// Wakes a thread parked in `block_on`
+    struct Signal(Mutex<bool>, Condvar);
+
+    impl Wake for Signal {
+        fn wake(self: Arc<Self>) {
+            *self.0.lock().unwrap() = true;
+            self.1.notify_one();
+        }
+    }
+
+    fn block_on<F: Future>(future: F) -> F::Output {
+        let mut future = std::pin::pin!(future);
+        let signal = Arc::new(Signal(Mutex::new(false), Condvar::new()));
+        let waker = Waker::from(Arc::clone(&signal));
+        let mut cx = Context::from_waker(&waker);
+        loop {
+            if let Poll::Ready(output) = future.as_mut().poll(&mut cx) {
+                return output;
+            }
+            let mut woken = signal.0.lock().unwrap();
+            while !*woken {
+                woken = signal.1.wait(woken).unwrap();
+            }
+            *woken = false;
+        }
+    }
+
+    fn doc(distance: f64) -> InputDocument {
+        serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 1, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": distance}
+            ]
+        }))
+        .unwrap()
+    }
+
+    /// A chain of points, each a distance from the last, that takes a while
+    fn slow_doc() -> InputDocument {
+        let n = 3000;
+        let mut entities = vec![];
+        let mut constraints = vec![serde_json::json!({"type": "fixed", "entity": "p0"})];
+        for i in 0..n {
+            entities.push(serde_json::json!({"type": "point", "id": format!("p{}", i),
+                                             "at": [i as f64 * 3.0, (i % 7) as f64, 0]}));
+            if i > 0 {
+                constraints.push(serde_json::json!({"type": "distance",
+                    "between": [format!("p{}", i - 1), format!("p{}", i)], "value": 1.0}));
+            }
+        }
+        serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1", "entities": entities, "constraints": constraints
+        }))
+        .unwrap()
+    }
+
+    #[test]
+    fn test_pool_solves_and_times() {
+        let pool = SolvePool::new(2, 4);
+        let futures: Vec<_> = (1..=3)
+            .map(|d| pool.solve(SolverConfig::default(), doc(d as f64)).unwrap())
+            .collect();
+        for future in futures {
+            let solved = block_on(future);
+            assert!(solved.result.is_ok());
+            assert!(solved.ran > Duration::ZERO);
+        }
+    }
+
+    #[test]
+    fn test_pool_refuses_work_past_its_queue() {
+        let pool = SolvePool::new(1, 1);
+        let running = pool.solve(SolverConfig::default(), slow_doc()).unwrap();
+        // Until the worker takes the first, the queue's one place may be
+        // taken by it, so try a few
+        let refused = (0..3)
+            .map(|_| pool.solve(SolverConfig::default(), doc(5.0)))
+            .filter(|r| matches!(r, Err(Error::Overloaded)))
+            .count();
+        assert!(refused >= 1);
+        running.cancel_handle().cancel();
+    }
+
+    #[test]
+    fn test_cancel_ends_a_running_solve() {
+        let pool = SolvePool::new(1, 1);
+        let future = pool.solve(SolverConfig::default(), slow_doc()).unwrap();
+        let cancel = future.cancel_handle();
+        thread::sleep(Duration::from_millis(20));
+        cancel.cancel();
+        assert!(cancel.is_cancelled());
+        assert!(matches!(block_on(future).result, Err(Error::Cancelled)));
+
+        // The worker is free again
+        let solved = block_on(pool.solve(SolverConfig::default(), doc(5.0)).unwrap());
+        assert!(solved.result.is_ok());
+    }
+
+    #[test]
+    fn test_dropping_a_queued_solve_cancels_it() {
+        let pool = SolvePool::new(1, 2);
+        let first = pool.solve(SolverConfig::default(), doc(5.0)).unwrap();
+        let second = pool.solve(SolverConfig::default(), doc(6.0)).unwrap();
+        let cancel = second.cancel_handle();
+        drop(second);
+        assert!(cancel.is_cancelled());
+        assert!(block_on(first).result.is_ok());
+    }
+}
@@ -0,0 +1,171 @@
+//! Which solved entities a result reports, for callers that want only a few
+//! positions out of a large document.
+//!
+//! Entities that aren't selected aren't read back from the native system at
+//! all, except as the points a selected line, arc or cubic is made of.
+
+use std::collections::HashSet;
+
+/// The entities to report: those whose ids match any of the patterns (or
+/// every entity, with none), and of those, with `changed_only`, just the
+/// ones the solve moved by more than the solver's tolerance
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct Selection {
+    /// Ids to report as they are
+    ids: HashSet<String>,
+    /// Patterns with `*` (any run of characters) or `?` (any one)
+    globs: Vec<String>,
+    pub changed_only: bool,
+}
+
+impl Selection {
+    /// Report the entities matching any of the patterns, each an id or a
+    /// glob with `*` and `?`; no patterns report every entity
+    pub fn only<I, S>(patterns: I) -> Self
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        let mut selection = Self::default();
+        for pattern in patterns {
+            let pattern = pattern.into();
+            if pattern.contains(['*', '?']) {
+                selection.globs.push(pattern);
+            } else {
+                selection.ids.insert(pattern);
+            }
+        }
+        selection
+    }
+
+    /// Whether the selection lets every entity through
+    pub fn is_all(&self) -> bool {
+        self.ids.is_empty() && self.globs.is_empty() && !self.changed_only
+    }
+
+    /// Whether the entity with this id is one to report, if it changed
+    /// when only changes are
+    pub fn matches(&self, id: &str) -> bool {
+        (self.ids.is_empty() && self.globs.is_empty())
+            || self.ids.contains(id)
+            || self
+                .globs
+                .iter()
+                .any(|g| glob_match(g.as_bytes(), id.as_bytes()))
+    }
+}
+
+/// Whether text matches pattern, where `*` matches any run of bytes and `?`
+/// any one byte; on a mismatch after a `*`, the `*` takes one more byte
+fn glob_match(pattern: &[u8], text: &[u8]) -> bool {
+    let (mut p, mut t) = (0, 0);
+    let mut star: Option<(usize, usize)> = None;
+    while t < text.len() {
+        match pattern.get(p) {
+            Some(b'*') => {
+                star = Some((p, t));
+                p += 1;
+            }
+            Some(&c) if c == b'?' || c == text[t] => {
+                p += 1;
+                t += 1;
+            }
+            _ => match star {
+                Some((sp, st)) => {
+                    p = sp + 1;
+                    t = st + 1;
+                    star = Some((sp, st + 1));
+                }
+                None => return false,
+            },
+        }
+    }
+    pattern[p..].iter().all(|&c| c == b'*')
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_glob_match() {
+        assert!(glob_match(b"gear*", b"gear_12"));
+        assert!(glob_match(b"gear*", b"gear"));
+        assert!(glob_match(b"*_c?", b"wheel_cx"));
+        assert!(glob_match(b"a*b*c", b"aXbYbZc"));
+        assert!(!glob_match(b"a*b*c", b"aXbYbZ"));
+        assert!(!glob_match(b"p?", b"p"));
+        assert!(!glob_match(b"gear", b"gears"));
+    }
+
+    #[test]
+    fn test_selection_matches() {
+        let all = Selection::default();
+        assert!(all.is_all());
+        assert!(all.matches("anything"));
+
+        let some = Selection::only(["p1", "arm_*"]);
+        assert!(!some.is_all());
+        assert!(some.matches("p1"));
+        assert!(some.matches("arm_left"));
+        assert!(!some.matches("p2"));
+
+        let changed = Selection {
+            changed_only: true,
+            ..Selection::default()
+        };
+        assert!(!changed.is_all());
+        assert!(changed.matches("p2"));
+    }
+
+    #[test]
+    fn test_solve_reports_only_the_selection() {
+        use crate::solver::{Solver, SolverConfig};
+        // p2 is pulled in to 5 from the fixed p1; nothing moves p3
+        let doc: crate::InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 1, 0]},
+                {"type": "point", "id": "p3", "at": [0, 5, 0]},
+                {"type": "line", "id": "l_moved", "p1": "p1", "p2": "p2"},
+                {"type": "line", "id": "l_still", "p1": "p1", "p2": "p3"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 5}
+            ]
+        }))
+        .unwrap();
+        let ids = |select: Selection| {
+            let solver = Solver::new(SolverConfig {
+                select,
+                ..SolverConfig::default()
+            });
+            let mut ids: Vec<String> = solver
+                .solve(&doc)
+                .unwrap()
+                .entities
+                .unwrap()
+                .into_keys()
+                .collect();
+            ids.sort();
+            ids
+        };
+
+        assert_eq!(
+            ids(Selection::only(["p2", "l_*"])),
+            ["l_moved", "l_still", "p2"]
+        );
+        let changed = Selection {
+            changed_only: true,
+            ..Selection::default()
+        };
+        assert_eq!(ids(changed), ["l_moved", "p2"]);
+        let changed_lines = Selection {
+            changed_only: true,
+            ..Selection::only(["l_*"])
+        };
+        assert_eq!(ids(changed_lines), ["l_moved"]);
+    }
+}
@@ -0,0 +1,216 @@
+//! How the solved points move with a document's parameters, for tolerance
+//! stack-ups and gradient-based optimization, without a solve per parameter.
+//!
+//! The native solver differentiates the solution by the value of each
+//! dimension, from the Jacobian at the solution; a parameter's sensitivity
+//! is the sum of those over the dimensions it sets, each scaled by how fast
+//! the dimension's value expression moves with the parameter. Only
+//! parameters that set the values of distance, angle and diameter
+//! constraints, and nothing else, have sensitivities: one that places an
+//! entity or sets any other kind of constraint changes the equations
+//! themselves, not just a dimension.
+
+use crate::expr::ExpressionEvaluator;
+use crate::ffi::Solver as FfiSolver;
+use crate::ids::EntityIndex;
+use crate::ir::{ExprOrNumber, InputDocument};
+use crate::select::Selection;
+use crate::sweep::{batchable_value, batched_constraints, point_ids, SweepAxis};
+use std::collections::HashMap;
+
+/// Each point's rate of change with each parameter, as [dx, dy, dz] per
+/// unit of the parameter: `sensitivities[parameter][point]`
+pub type Sensitivities = HashMap<String, HashMap<String, [f64; 3]>>;
+
+/// The dimensions to ask the native solver for, and how each parameter
+/// moves them
+pub(crate) struct Plan {
+    /// Native constraint ids, in the order the solver reports them
+    pub constraint_ids: Vec<i32>,
+    /// Each parameter, with the index in constraint_ids and the rate of
+    /// change with the parameter of each dimension it sets
+    parameters: Vec<(String, Vec<(usize, f64)>)>,
+}
+
+/// The rate of change of expr with the parameter name, by a central
+/// difference, which is exact for the linear expressions dimensions mostly
+/// have
+fn rate(parameters: &HashMap<String, f64>, name: &str, expr: &str) -> Option<f64> {
+    let at = parameters.get(name).copied()?;
+    let h = 1e-6 * at.abs().max(1.0);
+    let value = |v: f64| {
+        let mut p = parameters.clone();
+        p.insert(name.to_string(), v);
+        ExpressionEvaluator::new(p).eval(expr).ok()
+    };
+    Some((value(at + h)? - value(at - h)?) / (2.0 * h))
+}
+
+pub(crate) fn plan(doc: &InputDocument) -> Plan {
+    let mut plan = Plan {
+        constraint_ids: Vec::new(),
+        parameters: Vec::new(),
+    };
+    let mut names: Vec<&String> = doc.parameters.keys().collect();
+    names.sort();
+    for name in names {
+        let axis = SweepAxis {
+            name: name.clone(),
+            values: vec![doc.parameters[name]],
+        };
+        let Some(constraints) = batched_constraints(doc, std::slice::from_ref(&axis)) else {
+            continue;
+        };
+        let mut dimensions = Vec::new();
+        for i in constraints {
+            let Some(ExprOrNumber::Expression(expr)) = batchable_value(&doc.constraints[i]) else {
+                continue;
+            };
+            let Some(rate) = rate(&doc.parameters, name, expr) else {
+                continue;
+            };
+            // The solver numbers constraints in document order.
+            let id = crate::solver::FIRST_CONSTRAINT_ID + i as i32;
+            let slot = match plan.constraint_ids.iter().position(|&c| c == id) {
+                Some(slot) => slot,
+                None => {
+                    plan.constraint_ids.push(id);
+                    plan.constraint_ids.len() - 1
+                }
+            };
+            dimensions.push((slot, rate));
+        }
+        if !dimensions.is_empty() {
+            plan.parameters.push((name.clone(), dimensions));
+        }
+    }
+    plan
+}
+
+/// The sensitivities of every selected point to every planned parameter,
+/// after a solve that was asked for the planned dimensions
+pub(crate) fn read(
+    plan: &Plan,
+    ffi_solver: &FfiSolver,
+    doc: &InputDocument,
+    entity_id_map: &EntityIndex,
+    select: &Selection,
+) -> Sensitivities {
+    let mut points = point_ids(doc);
+    points.retain(|p| select.matches(p));
+    // Each point's rate of change with each dimension
+    let by_dimension: Vec<Vec<[f64; 3]>> = points
+        .iter()
+        .map(|p| {
+            let id = entity_id_map.get(p).unwrap_or(0);
+            (0..plan.constraint_ids.len())
+                .map(|slot| {
+                    let (dx, dy, dz) = ffi_solver
+                        .get_point_sensitivity(slot, id)
+                        .unwrap_or_default();
+                    [dx, dy, dz]
+                })
+                .collect()
+        })
+        .collect();
+
+    plan.parameters
+        .iter()
+        .map(|(name, dimensions)| {
+            let moves = points
+                .iter()
+                .zip(&by_dimension)
+                .map(|(point, rates)| {
+                    let mut d = [0.0; 3];
+                    for &(slot, rate) in dimensions {
+                        for (d, r) in d.iter_mut().zip(rates[slot]) {
+                            *d += rate * r;
+                        }
+                    }
+                    (point.clone(), d)
+                })
+                .collect();
+            (name.clone(), moves)
+        })
+        .collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::solver::{Solver, SolverConfig};
+
+    /// p3 sits `2 * $r` from the fixed p1, at `$a` degrees from the fixed
+    /// line p1-p2; `$h` places p4, so it has no sensitivities.
+    fn arm_document() -> InputDocument {
+        serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": 40.0, "a": 30.0, "h": 5.0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [80, 0, 0]},
+                {"type": "point", "id": "p3", "at": [60, 40, 0]},
+                {"type": "point", "id": "p4", "at": [0, "$h", 0]},
+                {"type": "line", "id": "l1", "p1": "p1", "p2": "p2"},
+                {"type": "line", "id": "l2", "p1": "p1", "p2": "p3"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "fixed", "entity": "p2"},
+                {"type": "distance", "between": ["p1", "p3"], "value": "2 * $r"},
+                {"type": "angle", "between": ["l1", "l2"], "value": "$a"}
+            ]
+        }))
+        .unwrap()
+    }
+
+    #[test]
+    fn test_plan_covers_dimension_parameters_only() {
+        let plan = plan(&arm_document());
+        assert_eq!(plan.constraint_ids, vec![103, 102]);
+        let names: Vec<&str> = plan.parameters.iter().map(|(n, _)| n.as_str()).collect();
+        assert_eq!(names, vec!["a", "r"]);
+        assert!((plan.parameters[1].1[0].1 - 2.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_sensitivities_match_the_geometry() {
+        let doc = arm_document();
+        let config = SolverConfig {
+            sensitivities: true,
+            ..SolverConfig::default()
+        };
+        let result = Solver::new(config).solve(&doc).unwrap();
+        let s = result.sensitivities.unwrap();
+        assert!(!s.contains_key("h"));
+
+        let theta = 30f64.to_radians();
+        let [dx, dy, _] = s["r"]["p3"];
+        assert!((dx - 2.0 * theta.cos()).abs() < 1e-6 && (dy - 2.0 * theta.sin()).abs() < 1e-6);
+        let per_degree = 80.0 * std::f64::consts::PI / 180.0;
+        let [dx, dy, _] = s["a"]["p3"];
+        assert!((dx + per_degree * theta.sin()).abs() < 1e-6);
+        assert!((dy - per_degree * theta.cos()).abs() < 1e-6);
+        assert_eq!(s["a"]["p1"], [0.0; 3]);
+
+        // Against re-solving with the parameter moved a little
+        let mut moved = doc.clone();
+        moved.parameters.insert("a".to_string(), 30.001);
+        let before = &result.entities.as_ref().unwrap()["p3"];
+        let after = &Solver::new(SolverConfig::default())
+            .solve(&moved)
+            .unwrap()
+            .entities
+            .unwrap()["p3"];
+        if let (
+            crate::ir::ResolvedEntity::Point { at: b },
+            crate::ir::ResolvedEntity::Point { at: a },
+        ) = (before, after)
+        {
+            assert!(((a[0] - b[0]) / 0.001 - s["a"]["p3"][0]).abs() < 1e-3);
+            assert!(((a[1] - b[1]) / 0.001 - s["a"]["p3"][1]).abs() < 1e-3);
+        } else {
+            panic!("p3 should be a point");
+        }
+    }
+}
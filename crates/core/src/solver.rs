@@ -1,12 +1,61 @@
 use crate::error::Result;
-use crate::ir::{Diagnostics, InputDocument, SolveResult};
+use crate::expr::ExpressionEvaluator;
+use crate::ffi::{ConstraintRecord, EntityRecord, PositionBuffers, Readback, Solver as FfiSolver};
+use crate::ids::EntityIndex;
+use crate::ir::{
+    CheckResult, Constraint, ConstraintCheck, ConstraintProfile, Diagnostics, InputDocument,
+    LayerTimes, MemoryCounts, PhaseTimes, ResolvedEntity, SolveResult,
+};
+use crate::select::Selection;
 use std::collections::HashMap;
 
+/// The native id of a document's first constraint; the rest follow it in
+/// document order
+pub(crate) const FIRST_CONSTRAINT_ID: i32 = 100;
+
+/// How the native solver takes each Newton step
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum StepMode {
+    /// The full step, as libslvs has always taken it
+    #[default]
+    Newton,
+    /// The step cut back until the residuals shrink, for starts far from a
+    /// solution
+    Damped,
+}
+
 #[derive(Debug, Clone)]
 pub struct SolverConfig {
+    /// How far a solved constraint may be from exact, for the checks made
+    /// on the result
     pub tolerance: f64,
     pub max_iterations: u32,
+    /// How the native solver steps
+    pub step_mode: StepMode,
+    /// The residual at which the native solver stops, or None for its own
+    /// (LENGTH_EPS/100)
+    pub converge_tolerance: Option<f64>,
+    /// The longest a solve may take, or None for no limit
     pub timeout_ms: Option<u64>,
+    /// The most bytes a solve may hold, or None for no limit
+    pub memory_budget: Option<u64>,
+    /// The most unknowns the solver takes on at once, or 0 for no limit
+    pub max_unknowns: usize,
+    /// Whether to report how the points move with each dimension parameter
+    pub sensitivities: bool,
+    /// Whether to report what each constraint cost the solve
+    pub profile: bool,
+    /// The clearance to check the solved outlines for interference with,
+    /// or None not to
+    pub interference: Option<f64>,
+    /// The height to extrude the solved sketch to, as the STL export does,
+    /// for its mass properties, or None not to report them
+    pub mass: Option<f64>,
+    /// Whether batched sweeps take each grid point's first Newton steps in
+    /// single precision, going over to double for the last
+    pub mixed_precision: bool,
+    /// Which solved entities to read back and report
+    pub select: Selection,
 }
 
 impl Default for SolverConfig {
@@ -14,21 +63,312 @@ impl Default for SolverConfig {
         Self {
             tolerance: 1e-6,
             max_iterations: 1000,
+            step_mode: StepMode::Newton,
+            converge_tolerance: None,
             timeout_ms: None,
+            memory_budget: None,
+            max_unknowns: 0,
+            sensitivities: false,
+            profile: false,
+            interference: None,
+            mass: None,
+            mixed_precision: false,
+            select: Selection::default(),
         }
     }
 }
 
 pub struct Solver {
-    #[allow(dead_code)]
     config: SolverConfig,
 }
 
+/// A document added to a native system, and where its entities went
+pub(crate) struct BuiltSystem {
+    pub ffi_solver: FfiSolver,
+    /// The entities' interned ids, and what each made in the native system
+    pub entities: EntityIndex,
+}
+
+fn elapsed_ms(since: std::time::Instant) -> f64 {
+    since.elapsed().as_secs_f64() * 1000.0
+}
+
+/// What to read back from libslvs for each entity, in entity order: every
+/// point and circle that `read` lets through; lines, arcs and cubics take
+/// their points from there
+fn readbacks(
+    doc: &InputDocument,
+    entities: &EntityIndex,
+    read: impl Fn(usize) -> bool,
+) -> Vec<Readback> {
+    let mut wanted = Vec::with_capacity(doc.entities.len());
+    readbacks_into(doc, entities, read, &mut wanted);
+    wanted
+}
+
+/// `readbacks`, into `out`
+fn readbacks_into(
+    doc: &InputDocument,
+    entities: &EntityIndex,
+    read: impl Fn(usize) -> bool,
+    out: &mut Vec<Readback>,
+) {
+    out.clear();
+    out.extend(
+        doc.entities
+            .iter()
+            .enumerate()
+            .map(|(i, entity)| match entity {
+                _ if !read(i) => Readback::None,
+                crate::ir::Entity::Point { .. } | crate::ir::Entity::Point2D { .. } => {
+                    Readback::Point(entities.handle(i))
+                }
+                crate::ir::Entity::Circle { .. } => match entities.centre(i) {
+                    Some(point_id) => Readback::Point(point_id),
+                    None => Readback::Circle(entities.handle(i)),
+                },
+                _ => Readback::None,
+            }),
+    );
+}
+
+/// A result with nothing in it yet
+fn empty_result() -> SolveResult {
+    SolveResult {
+        status: String::new(),
+        diagnostics: None,
+        entities: None,
+        warnings: vec![],
+        sensitivities: None,
+        profile: None,
+        interference: None,
+        mass: None,
+    }
+}
+
+/// What reading a solve back works in, kept between solves by a
+/// `SolveWorkspace`
+#[derive(Default)]
+struct ReadBuffers {
+    /// Whether each entity is selected, and whether it's read back
+    keep: Vec<bool>,
+    read: Vec<bool>,
+    wanted: Vec<Readback>,
+    /// Where what's read back was before the solve, if that's asked for,
+    /// and after, as `FfiSolver::read_positions` lays them out
+    before: Vec<f64>,
+    solved: Vec<f64>,
+    positions: PositionBuffers,
+    /// Each entity as it last resolved, where `got` says this solve
+    /// resolved it, and whether it's reported
+    resolved: Vec<Option<ResolvedEntity>>,
+    got: Vec<bool>,
+    report: Vec<bool>,
+}
+
+/// Set the coordinates `to` to `at`, in the storage they have
+fn set_coords(to: &mut Vec<f64>, at: [f64; 3]) {
+    to.clear();
+    to.extend_from_slice(&at);
+}
+
+fn put_point(slot: &mut Option<ResolvedEntity>, at: [f64; 3]) {
+    match slot {
+        Some(ResolvedEntity::Point { at: to }) => set_coords(to, at),
+        _ => *slot = Some(ResolvedEntity::Point { at: at.to_vec() }),
+    }
+}
+
+fn put_line(slot: &mut Option<ResolvedEntity>, p1: [f64; 3], p2: [f64; 3]) {
+    match slot {
+        Some(ResolvedEntity::Line { p1: a, p2: b }) => {
+            set_coords(a, p1);
+            set_coords(b, p2);
+        }
+        _ => {
+            *slot = Some(ResolvedEntity::Line {
+                p1: p1.to_vec(),
+                p2: p2.to_vec(),
+            })
+        }
+    }
+}
+
+fn put_circle(
+    slot: &mut Option<ResolvedEntity>,
+    center: [f64; 3],
+    diameter: f64,
+    normal: [f64; 3],
+) {
+    match slot {
+        Some(ResolvedEntity::Circle {
+            center: c,
+            diameter: d,
+            normal: n,
+        }) => {
+            set_coords(c, center);
+            *d = diameter;
+            set_coords(n, normal);
+        }
+        _ => {
+            *slot = Some(ResolvedEntity::Circle {
+                center: center.to_vec(),
+                diameter,
+                normal: normal.to_vec(),
+            })
+        }
+    }
+}
+
+/// An arc's centre, start, end and normal
+fn put_arc(slot: &mut Option<ResolvedEntity>, [center, start, end, normal]: [[f64; 3]; 4]) {
+    match slot {
+        Some(ResolvedEntity::Arc {
+            center: c,
+            start: s,
+            end: e,
+            normal: n,
+        }) => {
+            set_coords(c, center);
+            set_coords(s, start);
+            set_coords(e, end);
+            set_coords(n, normal);
+        }
+        _ => {
+            *slot = Some(ResolvedEntity::Arc {
+                center: center.to_vec(),
+                start: start.to_vec(),
+                end: end.to_vec(),
+                normal: normal.to_vec(),
+            })
+        }
+    }
+}
+
+/// A cubic's start, control points and end
+fn put_cubic(slot: &mut Option<ResolvedEntity>, [start, control1, control2, end]: [[f64; 3]; 4]) {
+    match slot {
+        Some(ResolvedEntity::Cubic {
+            start: s,
+            control1: c1,
+            control2: c2,
+            end: e,
+        }) => {
+            set_coords(s, start);
+            set_coords(c1, control1);
+            set_coords(c2, control2);
+            set_coords(e, end);
+        }
+        _ => {
+            *slot = Some(ResolvedEntity::Cubic {
+                start: start.to_vec(),
+                control1: control1.to_vec(),
+                control2: control2.to_vec(),
+                end: end.to_vec(),
+            })
+        }
+    }
+}
+
+/// A document built into a native system and the result of solving it,
+/// kept by the caller between `Solver::solve_in` calls, so that solving
+/// the same document again builds nothing and allocates nothing for its
+/// result
+pub struct SolveWorkspace {
+    /// The document last solved here, and what it was built into
+    doc: Option<InputDocument>,
+    eval: Option<ExpressionEvaluator>,
+    built: Option<BuiltSystem>,
+    /// The records it was built from, to set it back to the document's
+    /// values before solving it again
+    entities: Vec<EntityRecord>,
+    constraints: Vec<ConstraintRecord>,
+    buffers: ReadBuffers,
+    result: SolveResult,
+}
+
+impl SolveWorkspace {
+    pub fn new() -> Self {
+        Self {
+            doc: None,
+            eval: None,
+            built: None,
+            entities: Vec::new(),
+            constraints: Vec::new(),
+            buffers: ReadBuffers::default(),
+            result: empty_result(),
+        }
+    }
+}
+
+impl Default for SolveWorkspace {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Whether the whole document is a sketch in the xy plane: its points and
+/// circles at z = 0, its circles and arcs facing +z, and nothing that needs
+/// a plane of its own or the third dimension. Such a document is solved in
+/// 2D, each point with two unknowns rather than three and no normal to
+/// solve for, which gives the same positions.
+fn is_planar(doc: &InputDocument, eval: &ExpressionEvaluator) -> Result<bool> {
+    use crate::ir::{Constraint, Entity, ExprOrNumber, PositionOrRef};
+
+    let value = |v: Option<&ExprOrNumber>, or: f64| -> Result<f64> {
+        match v {
+            Some(ExprOrNumber::Number(n)) => Ok(*n),
+            Some(ExprOrNumber::Expression(e)) => eval.eval(e),
+            None => Ok(or),
+        }
+    };
+    let faces_up = |normal: &[ExprOrNumber]| -> Result<bool> {
+        Ok(value(normal.get(0), 0.0)? == 0.0
+            && value(normal.get(1), 0.0)? == 0.0
+            && value(normal.get(2), 1.0)? > 0.0)
+    };
+
+    for entity in &doc.entities {
+        let planar = match entity {
+            Entity::Point { at, .. } => value(at.get(2), 0.0)? == 0.0,
+            Entity::Line { .. } => true,
+            Entity::Circle { center, normal, .. } => {
+                let centred = match center {
+                    PositionOrRef::Coordinates(coords) => value(coords.get(2), 0.0)? == 0.0,
+                    PositionOrRef::Reference(_) => true,
+                };
+                centred && faces_up(normal)?
+            }
+            Entity::Arc {
+                normal, workplane, ..
+            } => workplane.is_none() && faces_up(normal)?,
+            Entity::Cubic { workplane, .. } => workplane.is_none(),
+            Entity::Point2D { .. } | Entity::Line2D { .. } | Entity::Plane { .. } => false,
+        };
+        if !planar {
+            return Ok(false);
+        }
+    }
+    Ok(!doc.constraints.iter().any(|c| {
+        matches!(
+            c,
+            Constraint::Symmetric { .. }
+                | Constraint::SameOrientation { .. }
+                | Constraint::PointOnFace { .. }
+                | Constraint::PointFaceDistance { .. }
+        )
+    }))
+}
+
 impl Solver {
     pub fn new(config: SolverConfig) -> Self {
         Self { config }
     }
 
+    pub fn config(&self) -> &SolverConfig {
+        &self.config
+    }
+
     /// Map FFI errors to high-level Error types
     /// This is public for testing purposes
     ///
@@ -43,10 +383,9 @@ impl Solver {
                     iterations: max_iterations,
                 }
             }
-            crate::ffi::FfiError::TooManyUnknowns => {
-                // Try to get DOF from solver if possible, otherwise default to 0
-                crate::error::Error::Underconstrained { dof: 0 }
-            }
+            crate::ffi::FfiError::TooManyUnknowns => crate::error::Error::TooManyUnknowns,
+            crate::ffi::FfiError::TimedOut => crate::error::Error::TimedOut,
+            crate::ffi::FfiError::ResourceExhausted => crate::error::Error::ResourceExhausted,
             crate::ffi::FfiError::InvalidSystem => crate::error::Error::InvalidSystem,
             crate::ffi::FfiError::Unknown(code) => {
                 crate::error::Error::Ffi(format!("Unknown solver error (code: {})", code))
@@ -55,18 +394,70 @@ impl Solver {
         }
     }
 
-    pub fn solve(&self, doc: &InputDocument) -> Result<SolveResult> {
-        use crate::expr::ExpressionEvaluator;
-        use crate::ffi::Solver as FfiSolver;
-
+    /// Add a document's entities and constraints to a new native system,
+    /// set up with this solver's options but not solved yet
+    pub(crate) fn build(
+        &self,
+        doc: &InputDocument,
+        eval: &ExpressionEvaluator,
+    ) -> Result<BuiltSystem> {
         let mut ffi_solver = FfiSolver::new();
-        let eval = ExpressionEvaluator::new(doc.parameters.clone());
+        // Gather everything as records, to add it to the native system in
+        // one call once it's all there
+        ffi_solver.hold_adds();
+        let entities = Self::add_document(&mut ffi_solver, doc, eval)?;
+        ffi_solver
+            .add_held()
+            .map_err(|e| crate::error::Error::InvalidInput {
+                message: e.to_string(),
+                pointer: None,
+            })?;
+        self.configure(&mut ffi_solver)?;
+
+        Ok(BuiltSystem {
+            ffi_solver,
+            entities,
+        })
+    }
+
+    /// Give a native system this solver's options
+    pub(crate) fn configure(&self, ffi_solver: &mut FfiSolver) -> Result<()> {
+        ffi_solver
+            .set_solver_options(
+                self.config.converge_tolerance.unwrap_or(0.0),
+                self.config.max_iterations,
+                self.config.step_mode == StepMode::Damped,
+            )
+            .map_err(|e| crate::error::Error::InvalidInput {
+                message: e,
+                pointer: None,
+            })?;
+        ffi_solver.set_max_unknowns(self.config.max_unknowns);
+        ffi_solver.set_mixed_precision(self.config.mixed_precision);
+        ffi_solver.set_timeout(self.config.timeout_ms.unwrap_or(0));
+        ffi_solver.set_memory_budget(self.config.memory_budget.unwrap_or(0));
+        Ok(())
+    }
+
+    /// Add a document's entities and constraints to a solver, numbering the
+    /// entities from 1 and the constraints from 100 in document order.
+    /// Returns the entities' ids interned to their indices, with the native
+    /// handle each one made and the point each circle centred on a point
+    /// entity is centred on.
+    pub(crate) fn add_document(
+        ffi_solver: &mut FfiSolver,
+        doc: &InputDocument,
+        eval: &ExpressionEvaluator,
+    ) -> Result<EntityIndex> {
+        if is_planar(doc, eval)? {
+            ffi_solver
+                .set_planar()
+                .map_err(|e| crate::error::Error::Ffi(e.to_string()))?;
+        }
 
         // Add entities to solver
-        let mut entity_id_map = HashMap::new();
+        let mut entities = EntityIndex::with_capacity(doc.entities.len());
         let mut next_id = 1;
-        // Track circles that reference point entities (circle_id -> point_entity_id)
-        let mut circle_point_refs: HashMap<String, i32> = HashMap::new();
 
         for (entity_idx, entity) in doc.entities.iter().enumerate() {
             match entity {
@@ -95,7 +486,7 @@ impl Solver {
                             message: format!("Failed to add point '{}': {}", id, e),
                             pointer: Some(format!("/entities/{}", entity_idx)),
                         })?;
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
                     next_id += 1;
                 }
                 crate::ir::Entity::Point2D { id, at, workplane, preserve, .. } => {
@@ -110,56 +501,56 @@ impl Solver {
                     };
 
                     // Look up workplane entity ID
-                    let workplane_id = entity_id_map
+                    let workplane_id = entities
                         .get(workplane)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(workplane.clone()))?;
 
                     ffi_solver
-                        .add_point_2d(next_id, *workplane_id, u, v, *preserve)
+                        .add_point_2d(next_id, workplane_id, u, v, *preserve)
                         .map_err(|e| crate::error::Error::InvalidInput {
                             message: format!("Failed to add 2D point '{}': {}", id, e),
                             pointer: Some(format!("/entities/{}", entity_idx)),
                         })?;
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
                     next_id += 1;
                 }
                 crate::ir::Entity::Line { id, p1, p2, .. } => {
                     // Look up the point entity IDs
-                    let point1_id = entity_id_map
-                        .get(p1)
+                    let point1_id = entities
+                        .refer(p1)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(p1.clone()))?;
-                    let point2_id = entity_id_map
-                        .get(p2)
+                    let point2_id = entities
+                        .refer(p2)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(p2.clone()))?;
 
                     ffi_solver
-                        .add_line(next_id, *point1_id, *point2_id)
+                        .add_line(next_id, point1_id, point2_id)
                         .map_err(|e| crate::error::Error::InvalidInput {
                             message: format!("Failed to add line '{}': {}", id, e),
                             pointer: Some(format!("/entities/{}", entity_idx)),
                         })?;
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
                     next_id += 1;
                 }
                 crate::ir::Entity::Line2D { id, p1, p2, workplane, .. } => {
                     // Look up the point entity IDs (must be Point2D)
-                    let point1_id = entity_id_map
-                        .get(p1)
+                    let point1_id = entities
+                        .refer(p1)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(p1.clone()))?;
-                    let point2_id = entity_id_map
-                        .get(p2)
+                    let point2_id = entities
+                        .refer(p2)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(p2.clone()))?;
-                    let workplane_id = entity_id_map
+                    let workplane_id = entities
                         .get(workplane)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(workplane.clone()))?;
 
                     ffi_solver
-                        .add_line_2d(next_id, *point1_id, *point2_id, *workplane_id)
+                        .add_line_2d(next_id, point1_id, point2_id, workplane_id)
                         .map_err(|e| crate::error::Error::InvalidInput {
                             message: format!("Failed to add 2D line '{}': {}", id, e),
                             pointer: Some(format!("/entities/{}", entity_idx)),
                         })?;
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
                     next_id += 1;
                 }
                 crate::ir::Entity::Circle {
@@ -200,6 +591,7 @@ impl Solver {
                     let nz_norm = if norm_len > 0.0 { nz / norm_len } else { 1.0 };
 
                     // Handle center - either coordinates or point reference
+                    let mut centre = None;
                     match center {
                         crate::ir::PositionOrRef::Coordinates(coords) => {
                             // Evaluate center coordinates
@@ -225,7 +617,7 @@ impl Solver {
                         }
                         crate::ir::PositionOrRef::Reference(point_id) => {
                             // Look up the referenced point's entity ID
-                            let point_entity_id = *entity_id_map.get(point_id).ok_or_else(|| {
+                            let point_entity_id = entities.get(point_id).ok_or_else(|| {
                                 crate::error::Error::EntityNotFound(format!(
                                     "Circle '{}' references unknown point '{}'",
                                     id, point_id
@@ -236,10 +628,13 @@ impl Solver {
                                 .add_circle_with_center_point(next_id, point_entity_id, radius, nx_norm, ny_norm, nz_norm)
                                 .map_err(|e| crate::error::Error::Ffi(e))?;
                             // Track this reference for output
-                            circle_point_refs.insert(id.clone(), point_entity_id);
+                            centre = Some(point_entity_id);
                         }
                     }
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
+                    if let Some(point_entity_id) = centre {
+                        entities.centre_last(point_entity_id);
+                    }
                     next_id += 1;
                 }
                 crate::ir::Entity::Arc {
@@ -252,14 +647,14 @@ impl Solver {
                     ..
                 } => {
                     // Look up point entity IDs
-                    let center_id = entity_id_map
-                        .get(center)
+                    let center_id = entities
+                        .refer(center)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(center.clone()))?;
-                    let start_id = entity_id_map
-                        .get(start)
+                    let start_id = entities
+                        .refer(start)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(start.clone()))?;
-                    let end_id = entity_id_map
-                        .get(end)
+                    let end_id = entities
+                        .refer(end)
                         .ok_or_else(|| crate::error::Error::EntityNotFound(end.clone()))?;
 
                     // Evaluate normal vector
@@ -287,15 +682,24 @@ impl Solver {
                     let nz_norm = if norm_len > 0.0 { nz / norm_len } else { 1.0 };
 
                     // Get workplane ID if specified
-                    let workplane_id = workplane.as_ref().and_then(|wp| entity_id_map.get(wp).copied());
+                    let workplane_id = workplane.as_ref().and_then(|wp| entities.get(wp));
 
-                        ffi_solver
-                        .add_arc(next_id, *center_id, *start_id, *end_id, nx_norm, ny_norm, nz_norm, workplane_id)
+                    ffi_solver
+                        .add_arc(
+                            next_id,
+                            center_id,
+                            start_id,
+                            end_id,
+                            nx_norm,
+                            ny_norm,
+                            nz_norm,
+                            workplane_id,
+                        )
                         .map_err(|e| crate::error::Error::InvalidInput {
                             message: format!("Failed to add arc '{}': {}", id, e),
                             pointer: Some(format!("/entities/{}", entity_idx)),
                         })?;
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
                     next_id += 1;
                 }
                 crate::ir::Entity::Cubic {
@@ -312,29 +716,29 @@ impl Solver {
                     }
 
                     // Look up point entity IDs
-                    let pt0_id = entity_id_map
-                        .get(&control_points[0])
-                        .ok_or_else(|| crate::error::Error::EntityNotFound(control_points[0].clone()))?;
-                    let pt1_id = entity_id_map
-                        .get(&control_points[1])
-                        .ok_or_else(|| crate::error::Error::EntityNotFound(control_points[1].clone()))?;
-                    let pt2_id = entity_id_map
-                        .get(&control_points[2])
-                        .ok_or_else(|| crate::error::Error::EntityNotFound(control_points[2].clone()))?;
-                    let pt3_id = entity_id_map
-                        .get(&control_points[3])
-                        .ok_or_else(|| crate::error::Error::EntityNotFound(control_points[3].clone()))?;
+                    let pt0_id = entities.refer(&control_points[0]).ok_or_else(|| {
+                        crate::error::Error::EntityNotFound(control_points[0].clone())
+                    })?;
+                    let pt1_id = entities.refer(&control_points[1]).ok_or_else(|| {
+                        crate::error::Error::EntityNotFound(control_points[1].clone())
+                    })?;
+                    let pt2_id = entities.refer(&control_points[2]).ok_or_else(|| {
+                        crate::error::Error::EntityNotFound(control_points[2].clone())
+                    })?;
+                    let pt3_id = entities.refer(&control_points[3]).ok_or_else(|| {
+                        crate::error::Error::EntityNotFound(control_points[3].clone())
+                    })?;
 
                     // Get workplane ID if specified
-                    let workplane_id = workplane.as_ref().and_then(|wp| entity_id_map.get(wp).copied());
+                    let workplane_id = workplane.as_ref().and_then(|wp| entities.get(wp));
 
                     ffi_solver
-                        .add_cubic(next_id, *pt0_id, *pt1_id, *pt2_id, *pt3_id, workplane_id)
+                        .add_cubic(next_id, pt0_id, pt1_id, pt2_id, pt3_id, workplane_id)
                         .map_err(|e| crate::error::Error::InvalidInput {
                             message: format!("Failed to add cubic curve '{}': {}", id, e),
                             pointer: Some(format!("/entities/{}", entity_idx)),
                         })?;
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
                     next_id += 1;
                 }
                 crate::ir::Entity::Plane { id, origin, normal } => {
@@ -397,7 +801,7 @@ impl Solver {
                             message: format!("Failed to add plane '{}': {}", id, e),
                             pointer: Some(format!("/entities/{}", entity_idx)),
                         })?;
-                    entity_id_map.insert(id.clone(), next_id);
+                    entities.push(id, next_id);
                     next_id += 1;
                 }
                 _ => {} // Handle other entity types as needed
@@ -406,16 +810,16 @@ impl Solver {
 
         // Add constraints from JSON - use ConstraintRegistry to ensure all constraints are handled
         use crate::constraint_registry::ConstraintRegistry;
-        let mut constraint_id = 100;
+        let mut constraint_id = FIRST_CONSTRAINT_ID;
 
         // Process all constraints from JSON
         for (constraint_idx, constraint) in doc.constraints.iter().enumerate() {
             ConstraintRegistry::process_constraint(
                 constraint,
-                &mut ffi_solver,
+                ffi_solver,
                 constraint_id,
-                &entity_id_map,
-                &eval,
+                &entities,
+                eval,
             )
             .map_err(|e| crate::error::Error::InvalidInput {
                 message: format!("Failed to process constraint: {}", e),
@@ -424,57 +828,221 @@ impl Solver {
             constraint_id += 1;
         }
 
-        // Actually solve the constraints!
+        Ok(entities)
+    }
+
+    pub fn solve(&self, doc: &InputDocument) -> Result<SolveResult> {
+        let start = std::time::Instant::now();
+        let eval = ExpressionEvaluator::new(doc.parameters.clone());
+        let mut built = self.build(doc, &eval)?;
+        self.solve_built(doc, &eval, &mut built, start)
+    }
+
+    /// Check whether the document's points, where it puts them, already
+    /// satisfy its constraints, by evaluating each constraint's equations
+    /// once rather than solving: for results from a cache, or geometry made
+    /// elsewhere, that only need verifying.
+    pub fn check(&self, doc: &InputDocument) -> Result<CheckResult> {
+        let start = std::time::Instant::now();
+        let eval = ExpressionEvaluator::new(doc.parameters.clone());
+        let mut built = self.build(doc, &eval)?;
+        let (_, residuals) = built
+            .ffi_solver
+            .check()
+            .map_err(|e| Self::map_ffi_error(e, self.config.max_iterations))?;
+
+        // The largest residual of the native constraints each one became
+        let mut worst = vec![0.0f64; doc.constraints.len()];
+        for (id, residual) in residuals {
+            let Some(i) = constraint_index(id, doc.constraints.len()) else {
+                continue;
+            };
+            if !(residual <= worst[i]) {
+                worst[i] = residual;
+            }
+        }
+        let constraints: Vec<ConstraintCheck> = doc
+            .constraints
+            .iter()
+            .zip(worst)
+            .enumerate()
+            .map(|(i, (constraint, residual))| ConstraintCheck {
+                pointer: format!("/constraints/{}", i),
+                kind: kind_of(constraint),
+                residual,
+                ok: residual <= self.config.tolerance,
+            })
+            .collect();
+        let ok = constraints.iter().all(|c| c.ok);
+        Ok(CheckResult {
+            status: if ok { "ok" } else { "failed" }.to_string(),
+            constraints,
+            time_ms: elapsed_ms(start),
+        })
+    }
+
+    /// Solve a built system, and write just where its points and circles
+    /// went to `out`, as `FfiSolver::read_positions` lays them out, one
+    /// slot per entity in document order
+    pub(crate) fn solve_positions(
+        &self,
+        doc: &InputDocument,
+        built: &mut BuiltSystem,
+        out: &mut Vec<f64>,
+    ) -> Result<()> {
+        let wanted = readbacks(doc, &built.entities, |_| true);
+        built
+            .ffi_solver
+            .solve()
+            .map_err(|e| Self::map_ffi_error(e, self.config.max_iterations))?;
+        built.ffi_solver.read_positions(&wanted, out);
+        Ok(())
+    }
+
+    /// Solve a document's built system, and read back what it solved to;
+    /// `start` is when building it began
+    pub(crate) fn solve_built(
+        &self,
+        doc: &InputDocument,
+        eval: &ExpressionEvaluator,
+        built: &mut BuiltSystem,
+        start: std::time::Instant,
+    ) -> Result<SolveResult> {
+        let mut result = empty_result();
+        let mut buffers = ReadBuffers::default();
+        self.solve_built_into(doc, eval, built, start, &mut buffers, &mut result)?;
+        Ok(result)
+    }
+
+    /// Solve as `solve_built` does, reading back into `buffers` and
+    /// `result` as an earlier solve left them: the entities it reported
+    /// again keep their storage, so that solving the same document again
+    /// allocates nothing for its result
+    fn solve_built_into(
+        &self,
+        doc: &InputDocument,
+        eval: &ExpressionEvaluator,
+        built: &mut BuiltSystem,
+        start: std::time::Instant,
+        buffers: &mut ReadBuffers,
+        result: &mut SolveResult,
+    ) -> Result<()> {
+        use std::fmt::Write as _;
+
+        let BuiltSystem {
+            ffi_solver,
+            entities,
+        } = built;
         let max_iterations = self.config.max_iterations;
+        let plan = if self.config.sensitivities {
+            let plan = crate::sensitivity::plan(doc);
+            ffi_solver
+                .set_sensitivities(&plan.constraint_ids)
+                .map_err(|e| Self::map_ffi_error(e, max_iterations))?;
+            Some(plan)
+        } else {
+            None
+        };
+        ffi_solver.set_profile(self.config.profile);
+
+        // The selected entities, and the points they're made of, which are
+        // all that's read back
+        let select = &self.config.select;
+        let n = doc.entities.len();
+        let ReadBuffers {
+            keep,
+            read,
+            wanted,
+            before,
+            solved,
+            positions,
+            resolved,
+            got,
+            report,
+        } = buffers;
+        keep.clear();
+        keep.extend(doc.entities.iter().map(|e| select.matches(e.id())));
+        read.clear();
+        read.extend_from_slice(keep);
+        for i in (0..n).filter(|&i| keep[i]) {
+            for &j in entities.points(i) {
+                read[j as usize] = true;
+            }
+        }
+
+        readbacks_into(doc, entities, |i| read[i], wanted);
+        // Where they start from, to tell which the solve moves
+        let changed_only = select.changed_only;
+        if changed_only {
+            ffi_solver.read_positions_in(wanted, before, positions);
+        }
+
+        let build_ms = elapsed_ms(start);
+        let native_start = std::time::Instant::now();
         ffi_solver
             .solve()
             .map_err(|e| Self::map_ffi_error(e, max_iterations))?;
+        let native_ms = elapsed_ms(native_start);
+        let read_back_start = std::time::Instant::now();
 
-        // Get solved positions from libslvs
-        let mut resolved_entities = HashMap::new();
+        ffi_solver.read_positions_in(wanted, solved, positions);
+        let before: &[f64] = before;
+        let solved: &[f64] = solved;
+        // Where the entity at an index was read back at, four values
+        let slot_at = |v: &[f64], j: usize| {
+            let o = &v[4 * j..4 * j + 4];
+            (!o[0].is_nan()).then(|| [o[0], o[1], o[2], o[3]])
+        };
+        // Where the point entity at an index solved to
+        let point_at = |j: u32| {
+            let j = j as usize;
+            match doc.entities[j] {
+                crate::ir::Entity::Point { .. } | crate::ir::Entity::Point2D { .. } => {
+                    slot_at(solved, j)
+                }
+                _ => None,
+            }
+            .map(|p| [p[0], p[1], p[2]])
+        };
 
-        // Retrieve solved positions for all entities
-        for entity in &doc.entities {
+        // Resolved entities by index, made into the output map at the end;
+        // `got` says which of them this solve resolved
+        resolved.resize_with(n, || None);
+        got.clear();
+        got.resize(n, false);
+        for (i, entity) in doc.entities.iter().enumerate() {
+            if !keep[i] {
+                continue;
+            }
+            let slot = &mut resolved[i];
             match entity {
-                crate::ir::Entity::Point { id, .. } | crate::ir::Entity::Point2D { id, .. } => {
-                    let entity_id = entity_id_map.get(id).copied().unwrap_or(0);
-                    if let Ok((x, y, z)) = ffi_solver.get_point_position(entity_id) {
-                        resolved_entities.insert(
-                            id.clone(),
-                            crate::ir::ResolvedEntity::Point { at: vec![x, y, z] },
-                        );
+                crate::ir::Entity::Point { .. } | crate::ir::Entity::Point2D { .. } => {
+                    if let Some([x, y, z, _]) = slot_at(solved, i) {
+                        put_point(slot, [x, y, z]);
+                        got[i] = true;
                     }
                 }
-                crate::ir::Entity::Line { id, p1, p2, .. }
-                | crate::ir::Entity::Line2D { id, p1, p2, .. } => {
+                crate::ir::Entity::Line { .. } | crate::ir::Entity::Line2D { .. } => {
                     // Lines are defined by their endpoints, get the actual coordinates
-                    let p1_id = entity_id_map
-                        .get(p1)
-                        .ok_or_else(|| crate::error::Error::EntityNotFound(p1.clone()))?;
-                    let p2_id = entity_id_map
-                        .get(p2)
-                        .ok_or_else(|| crate::error::Error::EntityNotFound(p2.clone()))?;
+                    let &[p1, p2] = entities.points(i) else {
+                        continue;
+                    };
 
-                    if let (Ok((x1, y1, z1)), Ok((x2, y2, z2))) = (
-                        ffi_solver.get_point_position(*p1_id),
-                        ffi_solver.get_point_position(*p2_id),
-                    ) {
-                        resolved_entities.insert(
-                            id.clone(),
-                            crate::ir::ResolvedEntity::Line {
-                                p1: vec![x1, y1, z1],
-                                p2: vec![x2, y2, z2],
-                            },
-                        );
+                    if let (Some(p1), Some(p2)) = (point_at(p1), point_at(p2)) {
+                        put_line(slot, p1, p2);
+                        got[i] = true;
                     }
                 }
-                crate::ir::Entity::Circle { id, normal, diameter, .. } => {
-                    let entity_id = entity_id_map.get(id).copied().unwrap_or(0);
-                    
+                crate::ir::Entity::Circle {
+                    normal, diameter, ..
+                } => {
                     // Get center position - different for circles referencing points vs coordinates
-                    let (final_cx, final_cy, final_cz, final_radius) = if let Some(point_id) = circle_point_refs.get(id) {
+                    let (final_cx, final_cy, final_cz, final_radius) = if entities
+                        .centre(i)
+                        .is_some()
+                    {
                         // Circle references a point - get the point's solved position
-                        let (cx, cy, cz) = ffi_solver.get_point_position(*point_id).unwrap_or((0.0, 0.0, 0.0));
+                        let [cx, cy, cz, _] = slot_at(solved, i).unwrap_or([0.0; 4]);
                         // Radius comes from the IR since we can't easily get it from FFI for this case
                         let diam = match diameter {
                             crate::ir::ExprOrNumber::Number(n) => *n,
@@ -482,8 +1050,8 @@ impl Solver {
                         };
                         (cx, cy, cz, diam / 2.0)
                     } else {
-                        // Circle has fixed coordinates - use get_circle_position
-                        if let Ok((cx, cy, cz, radius)) = ffi_solver.get_circle_position(entity_id) {
+                        // Circle has fixed coordinates - read back with its radius
+                        if let Some([cx, cy, cz, radius]) = slot_at(solved, i) {
                             (cx, cy, cz, radius)
                         } else {
                             continue; // Skip if we can't get the position
@@ -506,83 +1074,270 @@ impl Solver {
                         Some(crate::ir::ExprOrNumber::Expression(e)) => eval.eval(e).unwrap_or(1.0),
                         None => 1.0,
                     };
-                    
-                    resolved_entities.insert(
-                        id.clone(),
-                        crate::ir::ResolvedEntity::Circle {
-                            center: vec![final_cx, final_cy, final_cz],
-                            diameter: final_radius * 2.0,
-                            normal: vec![nx, ny, nz],
-                        },
+
+                    put_circle(
+                        slot,
+                        [final_cx, final_cy, final_cz],
+                        final_radius * 2.0,
+                        [nx, ny, nz],
                     );
+                    got[i] = true;
                 }
-                crate::ir::Entity::Arc { id, center, start, end, normal, .. } => {
+                crate::ir::Entity::Arc { normal, .. } => {
                     // Get positions of center, start, and end points
-                    let center_id = entity_id_map.get(center).copied().unwrap_or(0);
-                    let start_id = entity_id_map.get(start).copied().unwrap_or(0);
-                    let end_id = entity_id_map.get(end).copied().unwrap_or(0);
-                    
-                    if let (Ok((cx, cy, cz)), Ok((sx, sy, sz)), Ok((ex, ey, ez))) = (
-                        ffi_solver.get_point_position(center_id),
-                        ffi_solver.get_point_position(start_id),
-                        ffi_solver.get_point_position(end_id),
-                    ) {
+                    let &[center, start, end] = entities.points(i) else {
+                        continue;
+                    };
+
+                    if let (Some(center), Some(start), Some(end)) =
+                        (point_at(center), point_at(start), point_at(end))
+                    {
                         // Extract normal vector from Vec<ExprOrNumber>
                         let nx = normal.get(0).and_then(|e| e.as_f64()).unwrap_or(0.0);
                         let ny = normal.get(1).and_then(|e| e.as_f64()).unwrap_or(0.0);
                         let nz = normal.get(2).and_then(|e| e.as_f64()).unwrap_or(1.0);
                         
-                        resolved_entities.insert(
-                            id.clone(),
-                            crate::ir::ResolvedEntity::Arc {
-                                center: vec![cx, cy, cz],
-                                start: vec![sx, sy, sz],
-                                end: vec![ex, ey, ez],
-                                normal: vec![nx, ny, nz],
-                            },
-                        );
+                        put_arc(slot, [center, start, end, [nx, ny, nz]]);
+                        got[i] = true;
                     }
                 }
-                crate::ir::Entity::Cubic { id, control_points, .. } => {
-                    // Get positions of all control points
-                    let mut points = Vec::new();
-                    for point_id_str in control_points {
-                        let point_id = entity_id_map.get(point_id_str).copied().unwrap_or(0);
-                        if let Ok((x, y, z)) = ffi_solver.get_point_position(point_id) {
-                            points.push(vec![x, y, z]);
-                        }
-                    }
-                    
-                    // Cubic requires exactly 4 control points
-                    if points.len() == 4 {
-                        resolved_entities.insert(
-                            id.clone(),
-                            crate::ir::ResolvedEntity::Cubic {
-                                start: points[0].clone(),
-                                control1: points[1].clone(),
-                                control2: points[2].clone(),
-                                end: points[3].clone(),
-                            },
-                        );
+                crate::ir::Entity::Cubic { .. } => {
+                    // Cubic requires exactly 4 control points, all solved
+                    let &[p0, p1, p2, p3] = entities.points(i) else {
+                        continue;
+                    };
+
+                    if let (Some(p0), Some(p1), Some(p2), Some(p3)) =
+                        (point_at(p0), point_at(p1), point_at(p2), point_at(p3))
+                    {
+                        put_cubic(slot, [p0, p1, p2, p3]);
+                        got[i] = true;
                     }
                 }
                 _ => {} // Handle other entity types as needed
             }
         }
+        let resolved = &*resolved;
 
-        // Return the solved entities - this is now completely generic!
-        return Ok(SolveResult {
-            status: "ok".to_string(),
-            diagnostics: Some(Diagnostics {
-                iters: 1,
-                residual: 0.0,
-                dof: 0,
-                time_ms: 1,
-            }),
-            entities: Some(resolved_entities),
-            warnings: vec![],
+        // Whether the solve moved the entity at an index, or any of its points
+        let moved = |i: usize| {
+            if !changed_only {
+                return true;
+            }
+            std::iter::once(i)
+                .chain(entities.points(i).iter().map(|&j| j as usize))
+                .any(|j| match (slot_at(before, j), slot_at(solved, j)) {
+                    (Some(a), Some(b)) => a
+                        .iter()
+                        .zip(b)
+                        .any(|(a, b)| (a - b).abs() > self.config.tolerance),
+                    _ => false,
+                })
+        };
+
+        let sensitivities =
+            plan.map(|plan| crate::sensitivity::read(&plan, &ffi_solver, doc, entities, select));
+        let profile = self.config.profile.then(|| profile_of(&ffi_solver, doc));
+        let solved = || -> Vec<(&str, &crate::ir::ResolvedEntity)> {
+            doc.entities
+                .iter()
+                .zip(resolved)
+                .enumerate()
+                .filter(|&(i, _)| got[i])
+                .filter_map(|(_, (entity, resolved))| Some((entity.id(), resolved.as_ref()?)))
+                .collect()
+        };
+        let interference = self.config.interference.map(|clearance| {
+            crate::interference::find(&solved(), clearance, self.config.tolerance, 0)
         });
+        let mass = self.config.mass.map(|height| {
+            let solved: Vec<_> = solved().into_iter().map(|(_, entity)| entity).collect();
+            crate::mass::of(&solved, height, 0)
+        });
+
+        // Into the map the last solve left, dropping what this one doesn't
+        // report and updating the rest where they are
+        report.clear();
+        report.extend((0..n).map(|i| got[i] && moved(i)));
+        let resolved_entities = result.entities.get_or_insert_with(HashMap::new);
+        resolved_entities.retain(|id, _| entities.index(id).map_or(false, |i| i < n && report[i]));
+        for (i, entity) in doc.entities.iter().enumerate() {
+            let Some(from) = resolved[i].as_ref().filter(|_| report[i]) else {
+                continue;
+            };
+            match resolved_entities.get_mut(entity.id()) {
+                Some(to) => to.assign(from),
+                None => {
+                    resolved_entities.insert(entity.id().to_string(), from.clone());
+                }
+            }
+        }
+        let read_back_ms = elapsed_ms(read_back_start);
+        let stats = ffi_solver.get_stats();
+
+        // The constraints were numbered from FIRST_CONSTRAINT_ID in document
+        // order; the pointer to the heaviest is written where the last one was
+        let mut heaviest_constraint = result
+            .diagnostics
+            .take()
+            .and_then(|d| d.memory.heaviest_constraint);
+        match (stats.heaviest_constraint as usize)
+            .checked_sub(FIRST_CONSTRAINT_ID as usize)
+            .filter(|&i| i < doc.constraints.len())
+        {
+            Some(i) => {
+                let pointer = heaviest_constraint.get_or_insert_with(String::new);
+                pointer.clear();
+                let _ = write!(pointer, "/constraints/{}", i);
+            }
+            None => heaviest_constraint = None,
+        }
+        let diagnostics = Diagnostics {
+            iters: stats.iterations.max(0) as u32,
+            residual: stats.residual,
+            dof: ffi_solver.get_dof().max(0) as u32,
+            time_ms: start.elapsed().as_millis() as u64,
+            equations: stats.equations.max(0) as u32,
+            unknowns: stats.unknowns.max(0) as u32,
+            jacobian_nnz: stats.jacobian_non_zeros.max(0) as u64,
+            phases: PhaseTimes {
+                write_equations_ms: stats.write_equations_ms,
+                substitute_ms: stats.substitute_ms,
+                alone_ms: stats.alone_ms,
+                write_jacobian_ms: stats.write_jacobian_ms,
+                eval_jacobian_ms: stats.eval_jacobian_ms,
+                factor_ms: stats.step_ms,
+                rank_test_ms: stats.rank_ms,
+                find_bad_ms: stats.find_bad_ms,
+            },
+            layers: LayerTimes {
+                build_ms,
+                native_ms,
+                read_back_ms,
+            },
+            memory: MemoryCounts {
+                exprs_allocated: stats.exprs_allocated.max(0) as u64,
+                temporary_bytes: stats.temporary_bytes.max(0) as u64,
+                temporary_peak_bytes: stats.temporary_peak_bytes.max(0) as u64,
+                source_nodes: stats.source_nodes.max(0) as u64,
+                folded_nodes: stats.folded_nodes.max(0) as u64,
+                partial_nodes: stats.partial_nodes.max(0) as u64,
+                jacobian_entries: stats.jacobian_entries.max(0) as u64,
+                heaviest_constraint,
+                heaviest_constraint_exprs: stats.heaviest_constraint_exprs.max(0) as u64,
+            },
+        };
+
+        if result.status != "ok" {
+            result.status.clear();
+            result.status.push_str("ok");
+        }
+        result.diagnostics = Some(diagnostics);
+        result.warnings.clear();
+        result.sensitivities = sensitivities;
+        result.profile = profile;
+        result.interference = interference;
+        result.mass = mass;
+        Ok(())
     }
+
+    /// Solve the document as `solve` does, in `workspace`: if it last
+    /// solved the same document, its system isn't built again but set back
+    /// to the document's values, and the result it holds is updated in
+    /// place, so that such a solve allocates nothing on this side
+    pub fn solve_in<'w>(
+        &self,
+        doc: &InputDocument,
+        workspace: &'w mut SolveWorkspace,
+    ) -> Result<&'w SolveResult> {
+        let start = std::time::Instant::now();
+        let SolveWorkspace {
+            doc: kept,
+            eval,
+            built,
+            entities,
+            constraints,
+            buffers,
+            result,
+        } = workspace;
+        match (kept.as_ref(), eval.as_ref(), built.as_mut()) {
+            (Some(kept), Some(_), Some(built)) if kept == doc => {
+                built
+                    .ffi_solver
+                    .update_records(entities, constraints)
+                    .map_err(|e| crate::error::Error::InvalidInput {
+                        message: e.to_string(),
+                        pointer: None,
+                    })?;
+                self.configure(&mut built.ffi_solver)?;
+            }
+            _ => {
+                // Nothing is kept if this doesn't build
+                *kept = None;
+                let fresh = ExpressionEvaluator::new(doc.parameters.clone());
+                let (e, c, index) = crate::compiled::record(doc, &fresh)?;
+                *built = Some(self.build_from(&e, &c, index)?);
+                *entities = e;
+                *constraints = c;
+                *eval = Some(fresh);
+                *kept = Some(doc.clone());
+            }
+        }
+        let (Some(eval), Some(built)) = (eval.as_ref(), built.as_mut()) else {
+            unreachable!("a workspace's document is built")
+        };
+        self.solve_built_into(doc, eval, built, start, buffers, result)?;
+        Ok(result)
+    }
+}
+
+/// The document constraint that a native constraint id was added for: the
+/// ids follow document order from FIRST_CONSTRAINT_ID, and those of the
+/// parts of one added in several parts are its id times 1000 and up
+fn constraint_index(id: i32, constraints: usize) -> Option<usize> {
+    let id = if id >= 1000 * FIRST_CONSTRAINT_ID {
+        id / 1000
+    } else {
+        id
+    };
+    let i = (id as usize).checked_sub(FIRST_CONSTRAINT_ID as usize)?;
+    (i < constraints).then_some(i)
+}
+
+/// A constraint's type, as the document names it
+fn kind_of(constraint: &Constraint) -> String {
+    serde_json::to_value(constraint)
+        .ok()
+        .and_then(|v| v.get("type").and_then(|t| t.as_str()).map(str::to_string))
+        .unwrap_or_default()
+}
+
+/// What each of the document's constraints cost the last solve, most
+/// expensive to evaluate first
+fn profile_of(ffi_solver: &FfiSolver, doc: &InputDocument) -> Vec<ConstraintProfile> {
+    let mut profile: Vec<ConstraintProfile> = ffi_solver
+        .get_costs()
+        .into_iter()
+        .filter_map(|cost| {
+            let i = (cost.id as usize).checked_sub(FIRST_CONSTRAINT_ID as usize)?;
+            let constraint = doc.constraints.get(i)?;
+            Some(ConstraintProfile {
+                pointer: format!("/constraints/{}", i),
+                kind: kind_of(constraint),
+                expr_nodes: cost.expr_nodes.max(0) as u64,
+                jacobian_nnz: cost.jacobian_non_zeros.max(0) as u64,
+                eval_ms: cost.eval_ms,
+                iterations_above_tolerance: cost.iterations_above_tolerance.max(0) as u32,
+            })
+        })
+        .collect();
+    profile.sort_by(|a, b| {
+        b.eval_ms
+            .total_cmp(&a.eval_ms)
+            .then(b.expr_nodes.cmp(&a.expr_nodes))
+            .then(a.pointer.cmp(&b.pointer))
+    });
+    profile
 }
 
 #[cfg(test)]
@@ -594,7 +1349,10 @@ mod tests {
         let config = SolverConfig::default();
         assert_eq!(config.tolerance, 1e-6);
         assert_eq!(config.max_iterations, 1000);
+        assert_eq!(config.step_mode, StepMode::Newton);
+        assert_eq!(config.converge_tolerance, None);
         assert_eq!(config.timeout_ms, None);
+        assert_eq!(config.max_unknowns, 0);
     }
 
     #[test]
@@ -602,13 +1360,149 @@ mod tests {
         let config = SolverConfig {
             tolerance: 1e-8,
             max_iterations: 500,
+            step_mode: StepMode::Damped,
+            converge_tolerance: Some(1e-10),
             timeout_ms: Some(5000),
+            memory_budget: Some(64 << 20),
+            max_unknowns: 4096,
+            sensitivities: true,
+            profile: false,
+            interference: None,
+            mass: None,
+            mixed_precision: false,
+            select: Selection::default(),
         };
         assert_eq!(config.tolerance, 1e-8);
         assert_eq!(config.max_iterations, 500);
         assert_eq!(config.timeout_ms, Some(5000));
     }
 
+    #[test]
+    fn test_step_modes_agree() {
+        let doc: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 1, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 25}
+            ]
+        }))
+        .unwrap();
+        let at = |result: &SolveResult| match result.entities.as_ref().unwrap().get("p2") {
+            Some(ResolvedEntity::Point { at }) => at.clone(),
+            other => panic!("p2 should be a point, not {:?}", other),
+        };
+        let newton = Solver::new(SolverConfig::default()).solve(&doc).unwrap();
+        let config = SolverConfig {
+            step_mode: StepMode::Damped,
+            ..SolverConfig::default()
+        };
+        let damped = Solver::new(config).solve(&doc).unwrap();
+        let (a, b) = (at(&newton), at(&damped));
+        assert!((a[0].hypot(a[1]) - 25.0).abs() < 1e-8);
+        assert!(
+            a.iter().zip(&b).all(|(x, y)| (x - y).abs() < 1e-8),
+            "{:?} vs {:?}",
+            a,
+            b
+        );
+    }
+
+    #[test]
+    fn test_diagnostics_report_memory() {
+        let doc: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 1, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 25}
+            ]
+        }))
+        .unwrap();
+        let result = Solver::new(SolverConfig::default()).solve(&doc).unwrap();
+        let memory = result.diagnostics.unwrap().memory;
+        assert!(memory.exprs_allocated > 0 && memory.temporary_peak_bytes > 0);
+        assert!(memory.folded_nodes > 0 && memory.jacobian_entries > 0);
+        // A distance takes more writing than fixing a point does
+        assert_eq!(
+            memory.heaviest_constraint.as_deref(),
+            Some("/constraints/1")
+        );
+        assert!(memory.heaviest_constraint_exprs > 0);
+    }
+
+    #[test]
+    fn test_profile_ranks_the_constraints() {
+        let doc: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 1, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": 25}
+            ]
+        }))
+        .unwrap();
+        let plain = Solver::new(SolverConfig::default()).solve(&doc).unwrap();
+        assert!(plain.profile.is_none());
+
+        let config = SolverConfig {
+            profile: true,
+            ..SolverConfig::default()
+        };
+        let profile = Solver::new(config).solve(&doc).unwrap().profile.unwrap();
+        let distance = profile
+            .iter()
+            .find(|c| c.pointer == "/constraints/1")
+            .unwrap();
+        assert_eq!(distance.kind, "distance");
+        assert!(distance.expr_nodes > 0 && distance.jacobian_nnz > 0);
+        assert!(distance.iterations_above_tolerance > 0);
+        assert!(profile.windows(2).all(|w| w[0].eval_ms >= w[1].eval_ms));
+    }
+
+    #[test]
+    fn test_check_reports_each_constraint() {
+        let doc = |p3: [f64; 3]| -> InputDocument {
+            serde_json::from_value(serde_json::json!({
+                "schema": "slvs-json/1",
+                "entities": [
+                    {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                    {"type": "point", "id": "p2", "at": [3, 4, 0]},
+                    {"type": "point", "id": "p3", "at": p3}
+                ],
+                "constraints": [
+                    {"type": "fixed", "entity": "p1"},
+                    {"type": "distance", "between": ["p1", "p2"], "value": 5},
+                    {"type": "collinear", "points": ["p1", "p2", "p3"]}
+                ]
+            }))
+            .unwrap()
+        };
+        let solver = Solver::new(SolverConfig::default());
+        let checked = solver.check(&doc([6.0, 8.0, 0.0])).unwrap();
+        assert_eq!(checked.status, "ok");
+        assert_eq!(checked.constraints.len(), 3);
+        assert_eq!(checked.constraints[2].kind, "collinear");
+        assert!(checked
+            .constraints
+            .iter()
+            .all(|c| c.ok && c.residual < 1e-9));
+
+        let checked = solver.check(&doc([6.0, 9.0, 0.0])).unwrap();
+        assert_eq!(checked.status, "failed");
+        assert!(checked.constraints[0].ok && checked.constraints[1].ok);
+        assert!(!checked.constraints[2].ok && checked.constraints[2].residual > 0.1);
+    }
+
     #[test]
     fn test_solver_new() {
         let config = SolverConfig::default();
@@ -646,7 +1540,13 @@ mod tests {
         assert!(matches!(error, crate::error::Error::Overconstrained));
 
         let error = Solver::map_ffi_error(crate::ffi::FfiError::TooManyUnknowns, 1000);
-        assert!(matches!(error, crate::error::Error::Underconstrained { dof: 0 }));
+        assert!(matches!(error, crate::error::Error::TooManyUnknowns));
+
+        let error = Solver::map_ffi_error(crate::ffi::FfiError::TimedOut, 1000);
+        assert!(matches!(error, crate::error::Error::TimedOut));
+
+        let error = Solver::map_ffi_error(crate::ffi::FfiError::ResourceExhausted, 1000);
+        assert!(matches!(error, crate::error::Error::ResourceExhausted));
 
         let error = Solver::map_ffi_error(crate::ffi::FfiError::InvalidSystem, 1000);
         assert!(matches!(error, crate::error::Error::InvalidSystem));
@@ -707,11 +1607,11 @@ mod property_tests {
                 "Inconsistent should always map to Overconstrained"
             );
 
-            // TooManyUnknowns always produces Underconstrained with dof 0
+            // TooManyUnknowns always produces TooManyUnknowns
             let error = Solver::map_ffi_error(crate::ffi::FfiError::TooManyUnknowns, max_iterations);
             prop_assert!(
-                matches!(error, crate::error::Error::Underconstrained { dof: 0 }),
-                "TooManyUnknowns should always map to Underconstrained with dof 0"
+                matches!(error, crate::error::Error::TooManyUnknowns),
+                "TooManyUnknowns should always map to TooManyUnknowns"
             );
 
             // InvalidSystem always produces InvalidSystem error
@@ -729,7 +1629,17 @@ mod property_tests {
             let config = SolverConfig {
                 tolerance: 1e-6,
                 max_iterations,
+                step_mode: StepMode::Newton,
+                converge_tolerance: None,
                 timeout_ms: None,
+                memory_budget: None,
+                max_unknowns: 0,
+                sensitivities: false,
+                profile: false,
+                interference: None,
+                mass: None,
+                mixed_precision: false,
+                select: Selection::default(),
             };
 
             // Simulate what happens when solve() encounters a convergence error
@@ -0,0 +1,858 @@
+//! Solving one document over a grid of parameter values.
+//!
+//! When the swept parameters only set the values of distance, angle and
+//! diameter constraints, the document is built into a native system once
+//! and every grid point is solved from it in batches. The parameters go to
+//! the native system as constants, and those values as its own expressions
+//! of them, so that each grid point only changes the swept constants and
+//! the native solver evaluates the rest. Otherwise each grid point is
+//! rebuilt and solved on its own, starting from the positions solved at the
+//! grid point before it.
+//!
+//! A sweep along one parameter that sets one dimension can be tracked
+//! instead: each value is solved by continuation from the solution at the
+//! value before it, which takes fewer Newton iterations than solving each
+//! one from the start, and keeps to the branch of solutions (the assembly
+//! of a linkage, say) that the first value solved to.
+
+use crate::error::{Error, Result};
+use crate::expr::{CompiledExpr, ExpressionEvaluator};
+use crate::ffi::{Solver as FfiSolver, TrackSteps};
+use crate::ir::{Constraint, Entity, ExprOrNumber, InputDocument, ResolvedEntity};
+use crate::solver::Solver;
+use serde::{Deserialize, Serialize};
+use std::ops::Range;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+/// A parameter, and the values to solve the document for
+#[derive(Debug, Clone, PartialEq)]
+pub struct SweepAxis {
+    pub name: String,
+    pub values: Vec<f64>,
+}
+
+/// The outcome at one grid point
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct SweepRow {
+    /// The grid point's position in the sweep, last axis changing fastest
+    pub index: usize,
+    /// The value of each swept parameter, in axis order
+    pub values: Vec<f64>,
+    /// "ok", or "error" if the solve failed
+    pub status: String,
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub error: Option<String>,
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub dof: Option<u32>,
+    /// The solved position of each point in `SweepReport::points`, or
+    /// nothing if the solve failed
+    pub positions: Vec<[f64; 3]>,
+    /// In a tracked sweep, the Newton iterations and continuation steps it
+    /// took to get here from the row before
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub iterations: Option<u32>,
+    #[serde(skip_serializing_if = "Option::is_none", default)]
+    pub steps: Option<u32>,
+}
+
+impl SweepRow {
+    pub fn is_ok(&self) -> bool {
+        self.error.is_none()
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct SweepReport {
+    pub parameters: Vec<String>,
+    /// The point entities whose positions each row reports
+    pub points: Vec<String>,
+    /// How many grid points there are
+    pub grid_size: usize,
+    /// Whether the grid was solved in batches from one built system
+    pub batched: bool,
+    /// Whether each row was continued from the one before
+    pub tracked: bool,
+    /// Whether the sweep stopped early because a row met the stop condition
+    pub stopped: bool,
+    /// The rows that were solved, in grid order
+    pub rows: Vec<SweepRow>,
+}
+
+/// Whether a sweep should stop after solving a row
+pub type StopWhen<'a> = &'a (dyn Fn(&SweepRow) -> bool + Sync);
+
+/// The value of every swept parameter at grid point `index`
+fn grid_point(axes: &[SweepAxis], mut index: usize) -> Vec<f64> {
+    let mut values = vec![0.0; axes.len()];
+    for (k, axis) in axes.iter().enumerate().rev() {
+        values[k] = axis.values[index % axis.values.len()];
+        index /= axis.values.len();
+    }
+    values
+}
+
+/// Whether an expression names a parameter, with or without a `$`
+fn mentions(expr: &str, name: &str) -> bool {
+    expr.split(|c: char| !(c.is_alphanumeric() || c == '_' || c == '$' || c == '.'))
+        .any(|token| token.trim_start_matches('$') == name)
+}
+
+/// Every string in a JSON value, which covers every expression
+fn strings<'a>(value: &'a serde_json::Value, out: &mut Vec<&'a str>) {
+    match value {
+        serde_json::Value::String(s) => out.push(s),
+        serde_json::Value::Array(a) => a.iter().for_each(|v| strings(v, out)),
+        serde_json::Value::Object(o) => o.values().for_each(|v| strings(v, out)),
+        _ => {}
+    }
+}
+
+/// The value expression of a constraint whose value goes to the native
+/// system unchanged, so a batch can set it directly
+pub(crate) fn batchable_value(constraint: &Constraint) -> Option<&ExprOrNumber> {
+    match constraint {
+        Constraint::Distance { value, .. }
+        | Constraint::Angle { value, .. }
+        | Constraint::Diameter { value, .. } => Some(value),
+        _ => None,
+    }
+}
+
+/// The constraints a batch has to set for each grid point, by index, or
+/// None if the swept parameters reach anything else in the document and
+/// every grid point has to be rebuilt. This errs towards rebuilding: a
+/// swept parameter with the same name as an entity counts as reaching it.
+pub(crate) fn batched_constraints(doc: &InputDocument, axes: &[SweepAxis]) -> Option<Vec<usize>> {
+    let swept = |s: &str| axes.iter().any(|a| mentions(s, &a.name));
+
+    let mut batched = Vec::new();
+    let mut rest = vec![serde_json::to_value(&doc.entities).ok()?];
+    for (i, constraint) in doc.constraints.iter().enumerate() {
+        match batchable_value(constraint) {
+            Some(ExprOrNumber::Expression(e)) if swept(e) => batched.push(i),
+            Some(_) => {}
+            None => rest.push(serde_json::to_value(constraint).ok()?),
+        }
+    }
+    let mut found = Vec::new();
+    rest.iter().for_each(|v| strings(v, &mut found));
+    if found.into_iter().any(swept) {
+        None
+    } else {
+        Some(batched)
+    }
+}
+
+/// Give the native system a constant for each of the document's
+/// parameters, and each batched constraint's value as an expression of
+/// those for it to evaluate, so that a batch need only set the swept
+/// constants. Gives the constants' handles, by slot; or None, with no
+/// expression set, if a value can't be written in the native syntax.
+fn native_dimensions(
+    ffi_solver: &mut FfiSolver,
+    doc: &InputDocument,
+    eval: &ExpressionEvaluator,
+    constraints: &[usize],
+) -> Result<Option<Vec<i32>>> {
+    let to_error = |e: crate::ffi::FfiError| Error::InvalidInput {
+        message: e.to_string(),
+        pointer: None,
+    };
+    let handles = eval
+        .values()
+        .iter()
+        .map(|&v| ffi_solver.add_constant(v).map_err(to_error))
+        .collect::<Result<Vec<i32>>>()?;
+
+    let mut texts = Vec::with_capacity(constraints.len());
+    for &i in constraints {
+        let text = match batchable_value(&doc.constraints[i]) {
+            Some(ExprOrNumber::Expression(e)) => eval.compile(e)?.to_native(&handles),
+            Some(ExprOrNumber::Number(n)) => CompiledExpr::Number(*n).to_native(&handles),
+            None => unreachable!("only batchable constraints are batched"),
+        };
+        match text {
+            Some(text) => texts.push((i, text)),
+            None => return Ok(None),
+        }
+    }
+    for (i, text) in texts {
+        // The solver numbers constraints from 100 in document order.
+        ffi_solver
+            .set_constraint_expression(100 + i as i32, &text)
+            .map_err(to_error)?;
+    }
+    Ok(Some(handles))
+}
+
+/// Point entities, whose positions the rows report, in document order
+pub(crate) fn point_ids(doc: &InputDocument) -> Vec<String> {
+    doc.entities
+        .iter()
+        .filter(|e| matches!(e, Entity::Point { .. } | Entity::Point2D { .. }))
+        .map(|e| e.id().to_string())
+        .collect()
+}
+
+fn error_row(index: usize, values: Vec<f64>, e: &Error) -> SweepRow {
+    SweepRow {
+        index,
+        values,
+        status: "error".to_string(),
+        error: Some(e.to_string()),
+        dof: None,
+        positions: Vec::new(),
+        iterations: None,
+        steps: None,
+    }
+}
+
+/// Every swept parameter has to be in the document, with values to take
+fn check_axes(doc: &InputDocument, axes: &[SweepAxis]) -> Result<()> {
+    for axis in axes {
+        if !doc.parameters.contains_key(&axis.name) {
+            return Err(Error::InvalidInput {
+                message: format!("The document has no parameter '{}' to sweep", axis.name),
+                pointer: Some("/parameters".to_string()),
+            });
+        }
+        if axis.values.is_empty() {
+            return Err(Error::InvalidInput {
+                message: format!("No values to sweep '{}' over", axis.name),
+                pointer: None,
+            });
+        }
+    }
+    Ok(())
+}
+
+/// Rows solved in a batch at a time; a stop condition is only checked
+/// between batches.
+const BATCH_ROWS: usize = 256;
+
+impl Solver {
+    /// Solve the document at every point of the grid the axes span, on
+    /// `jobs` threads, stopping once a row meets `stop_when`. The document
+    /// must name every swept parameter in `parameters`.
+    pub fn sweep(
+        &self,
+        doc: &InputDocument,
+        axes: &[SweepAxis],
+        jobs: usize,
+        stop_when: Option<StopWhen>,
+    ) -> Result<SweepReport> {
+        let grid_size = axes.iter().map(|a| a.values.len()).product();
+        self.sweep_range(doc, axes, 0..grid_size, jobs, stop_when)
+    }
+
+    /// Solve the document at the grid points with indices in `range` (as
+    /// `SweepRow::index` numbers them), as `sweep` does the whole grid; so
+    /// that a grid can be split up and solved a part at a time, or a part
+    /// on each of several machines
+    pub fn sweep_range(
+        &self,
+        doc: &InputDocument,
+        axes: &[SweepAxis],
+        range: Range<usize>,
+        jobs: usize,
+        stop_when: Option<StopWhen>,
+    ) -> Result<SweepReport> {
+        check_axes(doc, axes)?;
+
+        let grid_size = axes.iter().map(|a| a.values.len()).product();
+        let range = range.start.min(grid_size)..range.end.min(grid_size);
+        let points = point_ids(doc);
+        let batched = batched_constraints(doc, axes);
+        let (mut rows, stopped) = match &batched {
+            Some(_) if range.is_empty() => (Vec::new(), false),
+            Some(constraints) => {
+                self.sweep_batched(doc, axes, constraints, &points, range, jobs, stop_when)?
+            }
+            None => self.sweep_rebuilt(doc, axes, &points, range, jobs, stop_when),
+        };
+        rows.sort_by_key(|r| r.index);
+
+        Ok(SweepReport {
+            parameters: axes.iter().map(|a| a.name.clone()).collect(),
+            points,
+            grid_size,
+            batched: batched.is_some(),
+            tracked: false,
+            stopped,
+            rows,
+        })
+    }
+
+    /// Solve the document at each of the axis's values in turn, tracking
+    /// one solution by continuation from the first value. The parameter
+    /// must set the value of one distance, angle or diameter constraint and
+    /// nothing else. The stop condition is checked once every value has
+    /// been tracked.
+    pub fn track(
+        &self,
+        doc: &InputDocument,
+        axis: &SweepAxis,
+        steps: TrackSteps,
+        stop_when: Option<StopWhen>,
+    ) -> Result<SweepReport> {
+        let axes = std::slice::from_ref(axis);
+        check_axes(doc, axes)?;
+        let constraint = match batched_constraints(doc, axes).as_deref() {
+            Some(&[i]) => i,
+            _ => {
+                return Err(Error::InvalidInput {
+                    message: format!(
+                        "Tracking needs '{}' to set the value of one distance, angle or diameter \
+                         constraint, and nothing else",
+                        axis.name
+                    ),
+                    pointer: Some("/parameters".to_string()),
+                })
+            }
+        };
+        let Some(ExprOrNumber::Expression(expr)) = batchable_value(&doc.constraints[constraint])
+        else {
+            unreachable!("only constraints with expressions are batched");
+        };
+
+        let points = point_ids(doc);
+        let mut eval = ExpressionEvaluator::new(doc.parameters.clone());
+        let mut built = self.build(doc, &eval)?;
+
+        // The dimension's value at each of the parameter's, from the
+        // expression building the system compiled
+        let dimension = axis
+            .values
+            .iter()
+            .map(|v| {
+                eval.set_parameter(&axis.name, *v)?;
+                eval.eval(expr)
+            })
+            .collect::<Result<Vec<f64>>>()?;
+
+        let point_ids: Vec<i32> = points
+            .iter()
+            .map(|p| built.entities.get(p).unwrap_or(0))
+            .collect();
+        let max_iterations = self.config().max_iterations;
+        let frames = built
+            .ffi_solver
+            .solve_track(100 + constraint as i32, &dimension, steps, &point_ids)
+            .map_err(|e| Self::map_ffi_error(e, max_iterations))?;
+
+        let mut rows = Vec::with_capacity(frames.len());
+        let mut stopped = false;
+        for (index, (frame, &v)) in frames.into_iter().zip(&axis.values).enumerate() {
+            let row = match frame.row.result {
+                Ok(()) => SweepRow {
+                    index,
+                    values: vec![v],
+                    status: "ok".to_string(),
+                    error: None,
+                    dof: Some(frame.row.dof.max(0) as u32),
+                    positions: frame
+                        .row
+                        .positions
+                        .iter()
+                        .map(|&(x, y, z)| [x, y, z])
+                        .collect(),
+                    iterations: Some(frame.iterations.max(0) as u32),
+                    steps: Some(frame.steps.max(0) as u32),
+                },
+                Err(e) => SweepRow {
+                    iterations: Some(frame.iterations.max(0) as u32),
+                    steps: Some(frame.steps.max(0) as u32),
+                    ..error_row(index, vec![v], &Self::map_ffi_error(e, max_iterations))
+                },
+            };
+            stopped = stop_when.map_or(false, |f| f(&row));
+            rows.push(row);
+            if stopped {
+                break;
+            }
+        }
+
+        Ok(SweepReport {
+            parameters: vec![axis.name.clone()],
+            points,
+            grid_size: axis.values.len(),
+            batched: false,
+            tracked: true,
+            stopped,
+            rows,
+        })
+    }
+
+    fn sweep_batched(
+        &self,
+        doc: &InputDocument,
+        axes: &[SweepAxis],
+        constraints: &[usize],
+        points: &[String],
+        range: Range<usize>,
+        jobs: usize,
+        stop_when: Option<StopWhen>,
+    ) -> Result<(Vec<SweepRow>, bool)> {
+        let mut eval = ExpressionEvaluator::new(doc.parameters.clone());
+        let mut built = self.build(doc, &eval)?;
+        // The solver numbers constraints from 100 in document order.
+        let constraint_ids: Vec<i32> = constraints.iter().map(|&i| 100 + i as i32).collect();
+        let point_ids: Vec<i32> = points
+            .iter()
+            .map(|p| built.entities.get(p).unwrap_or(0))
+            .collect();
+        let max_iterations = self.config().max_iterations;
+        // With the batched values as the native system's own expressions, a
+        // row is just the swept constants' values
+        let (constraint_ids, constant_ids) =
+            match native_dimensions(&mut built.ffi_solver, doc, &eval, constraints)? {
+                Some(handles) => {
+                    let swept = axes
+                        .iter()
+                        .map(|a| handles[eval.slot(&a.name).expect("swept parameters are checked")])
+                        .collect();
+                    (Vec::new(), swept)
+                }
+                None => (constraint_ids, Vec::new()),
+            };
+        let native = !constant_ids.is_empty();
+
+        let mut rows = Vec::with_capacity(range.len());
+        let mut start = range.start;
+        while start < range.end {
+            let end = (start + BATCH_ROWS).min(range.end);
+            // Each grid point's values, or why they couldn't be had
+            let mut solvable = Vec::new();
+            let mut values = Vec::new();
+            for index in start..end {
+                let point = grid_point(axes, index);
+                if native {
+                    solvable.push((index, point.clone()));
+                    values.push(point);
+                    continue;
+                }
+                // The batched values' expressions were compiled building the
+                // system, so each grid point only evaluates them again
+                for (axis, v) in axes.iter().zip(&point) {
+                    eval.set_parameter(&axis.name, *v)?;
+                }
+                let row: Result<Vec<f64>> = constraints
+                    .iter()
+                    .map(|&i| match batchable_value(&doc.constraints[i]) {
+                        Some(ExprOrNumber::Expression(e)) => eval.eval(e),
+                        Some(ExprOrNumber::Number(n)) => Ok(*n),
+                        None => unreachable!("only batchable constraints are batched"),
+                    })
+                    .collect();
+                match row {
+                    Ok(row) => {
+                        solvable.push((index, point));
+                        values.push(row);
+                    }
+                    Err(e) => rows.push(error_row(index, point, &e)),
+                }
+            }
+
+            let solved = built
+                .ffi_solver
+                .solve_batch(&constraint_ids, &constant_ids, &values, &point_ids, jobs)
+                .map_err(|e| Self::map_ffi_error(e, max_iterations))?;
+            for ((index, point), row) in solvable.into_iter().zip(solved) {
+                rows.push(match row.result {
+                    Ok(()) => SweepRow {
+                        index,
+                        values: point,
+                        status: "ok".to_string(),
+                        error: None,
+                        dof: Some(row.dof.max(0) as u32),
+                        positions: row.positions.iter().map(|&(x, y, z)| [x, y, z]).collect(),
+                        iterations: None,
+                        steps: None,
+                    },
+                    Err(e) => error_row(index, point, &Self::map_ffi_error(e, max_iterations)),
+                });
+            }
+
+            if let Some(stop) = stop_when {
+                if let Some(first) = rows[rows.len().saturating_sub(end - start)..]
+                    .iter()
+                    .filter(|r| stop(r))
+                    .map(|r| r.index)
+                    .min()
+                {
+                    rows.retain(|r| r.index <= first);
+                    return Ok((rows, true));
+                }
+            }
+            start = end;
+        }
+        Ok((rows, false))
+    }
+
+    fn sweep_rebuilt(
+        &self,
+        doc: &InputDocument,
+        axes: &[SweepAxis],
+        points: &[String],
+        range: Range<usize>,
+        jobs: usize,
+        stop_when: Option<StopWhen>,
+    ) -> (Vec<SweepRow>, bool) {
+        // Threads take a line of the grid along the last axis at a time, so
+        // that each grid point can start from the one next to it; the
+        // lines at the ends of the range may be cut short.
+        let line_len = axes.last().map_or(1, |a| a.values.len()).max(1);
+        let first_line = range.start / line_len;
+        let end_line = range.end.div_ceil(line_len);
+        let lines = end_line.saturating_sub(first_line);
+        let next_line = AtomicUsize::new(first_line);
+        // The first row found to meet the stop condition. Rows before it are
+        // all still solved, so that stopping gives the same rows however the
+        // lines were shared out.
+        let stop_at = AtomicUsize::new(usize::MAX);
+        let rows = Mutex::new(Vec::new());
+
+        std::thread::scope(|scope| {
+            for _ in 0..jobs.clamp(1, lines.max(1)) {
+                scope.spawn(|| {
+                    let mut line_rows = Vec::with_capacity(line_len);
+                    loop {
+                        let line = next_line.fetch_add(1, Ordering::Relaxed);
+                        if line >= end_line || line * line_len > stop_at.load(Ordering::Relaxed) {
+                            break;
+                        }
+                        let mut start = doc.clone();
+                        let from = (line * line_len).max(range.start);
+                        for index in from..((line + 1) * line_len).min(range.end) {
+                            if index > stop_at.load(Ordering::Relaxed) {
+                                break;
+                            }
+                            let row = self.solve_grid_point(&mut start, axes, points, index);
+                            if stop_when.map_or(false, |f| f(&row)) {
+                                stop_at.fetch_min(index, Ordering::Relaxed);
+                            }
+                            line_rows.push(row);
+                        }
+                        rows.lock().unwrap().append(&mut line_rows);
+                    }
+                });
+            }
+        });
+
+        let mut rows = rows.into_inner().unwrap();
+        let stop_at = stop_at.into_inner();
+        rows.retain(|r| r.index <= stop_at);
+        (rows, stop_at != usize::MAX)
+    }
+
+    /// Solve `doc` at one grid point and, if it solves, move its points to
+    /// where they were solved, as the start for the next grid point.
+    /// Points that are preserved, or placed by expressions, stay put.
+    fn solve_grid_point(
+        &self,
+        doc: &mut InputDocument,
+        axes: &[SweepAxis],
+        points: &[String],
+        index: usize,
+    ) -> SweepRow {
+        let values = grid_point(axes, index);
+        for (axis, v) in axes.iter().zip(&values) {
+            doc.parameters.insert(axis.name.clone(), *v);
+        }
+        let result = match self.solve(doc) {
+            Ok(result) => result,
+            Err(e) => return error_row(index, values, &e),
+        };
+        let entities = result.entities.unwrap_or_default();
+        let position = |id: &str| match entities.get(id) {
+            Some(ResolvedEntity::Point { at }) if at.len() >= 3 => [at[0], at[1], at[2]],
+            _ => [0.0; 3],
+        };
+
+        for entity in &mut doc.entities {
+            if let Entity::Point {
+                id,
+                at,
+                preserve: false,
+                ..
+            }
+            | Entity::Point2D {
+                id,
+                at,
+                preserve: false,
+                ..
+            } = entity
+            {
+                if at.iter().all(|c| c.as_f64().is_some()) {
+                    let solved = position(id);
+                    for (c, v) in at.iter_mut().zip(solved) {
+                        *c = ExprOrNumber::Number(v);
+                    }
+                }
+            }
+        }
+
+        SweepRow {
+            index,
+            values,
+            status: "ok".to_string(),
+            error: None,
+            dof: result.diagnostics.map(|d| d.dof),
+            positions: points.iter().map(|p| position(p)).collect(),
+            iterations: None,
+            steps: None,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::solver::SolverConfig;
+
+    /// p2 sits `r` from the fixed p1, along the line p1-p2 held horizontal
+    fn radius_document(extra: serde_json::Value) -> InputDocument {
+        let mut doc = serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"r": 10.0, "h": 0.0},
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 0]}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "p1"},
+                {"type": "distance", "between": ["p1", "p2"], "value": "$r"}
+            ]
+        });
+        if let Some(e) = extra.as_array() {
+            doc["entities"]
+                .as_array_mut()
+                .unwrap()
+                .extend(e.iter().cloned());
+        }
+        serde_json::from_value(doc).unwrap()
+    }
+
+    fn axis(name: &str, values: &[f64]) -> SweepAxis {
+        SweepAxis {
+            name: name.to_string(),
+            values: values.to_vec(),
+        }
+    }
+
+    fn distance(row: &SweepRow) -> f64 {
+        let [x1, y1, z1] = row.positions[0];
+        let [x2, y2, z2] = row.positions[1];
+        ((x2 - x1).powi(2) + (y2 - y1).powi(2) + (z2 - z1).powi(2)).sqrt()
+    }
+
+    #[test]
+    fn test_grid_point_order() {
+        let axes = [axis("a", &[1.0, 2.0]), axis("b", &[10.0, 20.0, 30.0])];
+        assert_eq!(grid_point(&axes, 0), vec![1.0, 10.0]);
+        assert_eq!(grid_point(&axes, 2), vec![1.0, 30.0]);
+        assert_eq!(grid_point(&axes, 4), vec![2.0, 20.0]);
+    }
+
+    #[test]
+    fn test_mentions() {
+        assert!(mentions("$r * 2", "r"));
+        assert!(mentions("sqrt(r)", "r"));
+        assert!(!mentions("$radius", "r"));
+        assert!(!mentions("p1", "p"));
+    }
+
+    #[test]
+    fn test_sweep_of_dimension_values_is_batched() {
+        let doc = radius_document(serde_json::json!([]));
+        let solver = Solver::new(SolverConfig::default());
+        let report = solver
+            .sweep(&doc, &[axis("r", &[5.0, 10.0, 20.0])], 2, None)
+            .unwrap();
+        assert!(report.batched);
+        assert!(!report.stopped);
+        assert_eq!(report.points, vec!["p1", "p2"]);
+        assert_eq!(report.rows.len(), 3);
+        for (row, r) in report.rows.iter().zip([5.0, 10.0, 20.0]) {
+            assert!(row.is_ok(), "{:?}", row.error);
+            assert!((distance(row) - r).abs() < 1e-6);
+        }
+    }
+
+    #[test]
+    fn test_batched_sweep_in_mixed_precision() {
+        let doc = radius_document(serde_json::json!([]));
+        let solver = Solver::new(SolverConfig {
+            mixed_precision: true,
+            ..SolverConfig::default()
+        });
+        let values: Vec<f64> = (1..=20).map(|i| i as f64 * 2.5).collect();
+        let report = solver.sweep(&doc, &[axis("r", &values)], 2, None).unwrap();
+        assert!(report.batched);
+        for (row, r) in report.rows.iter().zip(&values) {
+            assert!(row.is_ok(), "{:?}", row.error);
+            assert!((distance(row) - r).abs() < 1e-6);
+        }
+    }
+
+    #[test]
+    fn test_batched_values_are_evaluated_natively() {
+        let mut doc = radius_document(serde_json::json!([]));
+        doc.constraints[1] = serde_json::from_value(serde_json::json!(
+            {"type": "distance", "between": ["p1", "p2"], "value": "100 / $r * tan(45)"}
+        ))
+        .unwrap();
+        let solver = Solver::new(SolverConfig::default());
+        let report = solver
+            .sweep(&doc, &[axis("r", &[10.0, 0.0, 20.0])], 2, None)
+            .unwrap();
+        assert!(report.batched);
+        assert!((distance(&report.rows[0]) - 10.0).abs() < 1e-6);
+        assert!(!report.rows[1].is_ok(), "100 / 0 isn't a distance");
+        assert!((distance(&report.rows[2]) - 5.0).abs() < 1e-6);
+    }
+
+    #[test]
+    fn test_sweep_reaching_entities_is_rebuilt() {
+        let doc = radius_document(serde_json::json!([
+            {"type": "point", "id": "p3", "at": [0, "$h", 0]}
+        ]));
+        let solver = Solver::new(SolverConfig::default());
+        let axes = [axis("h", &[1.0, 2.0]), axis("r", &[5.0, 10.0])];
+        let report = solver.sweep(&doc, &axes, 2, None).unwrap();
+        assert!(!report.batched);
+        assert_eq!(report.grid_size, 4);
+        assert_eq!(
+            report.rows.iter().map(|r| r.index).collect::<Vec<_>>(),
+            vec![0, 1, 2, 3]
+        );
+        for row in &report.rows {
+            assert!(row.is_ok(), "{:?}", row.error);
+            assert!((distance(row) - row.values[1]).abs() < 1e-6);
+            assert_eq!(row.positions[2][1], row.values[0]);
+        }
+
+        // A range cutting lines of the grid short solves just those rows,
+        // as the whole sweep did
+        let part = solver.sweep_range(&doc, &axes, 1..3, 2, None).unwrap();
+        assert_eq!(part.grid_size, 4);
+        assert_eq!(part.rows, report.rows[1..3]);
+    }
+
+    #[test]
+    fn test_batched_sweep_range() {
+        let doc = radius_document(serde_json::json!([]));
+        let solver = Solver::new(SolverConfig::default());
+        let values: Vec<f64> = (1..=600).map(|v| v as f64).collect();
+        let axes = [axis("r", &values)];
+        let report = solver.sweep_range(&doc, &axes, 250..520, 2, None).unwrap();
+        assert!(report.batched);
+        assert_eq!(report.rows.len(), 270);
+        assert_eq!(report.rows[0].index, 250);
+        assert!(report
+            .rows
+            .iter()
+            .all(|r| (distance(r) - r.values[0]).abs() < 1e-6));
+        assert!(solver
+            .sweep_range(&doc, &axes, 700..800, 2, None)
+            .unwrap()
+            .rows
+            .is_empty());
+    }
+
+    #[test]
+    fn test_sweep_stops_at_the_first_matching_row() {
+        let doc = radius_document(serde_json::json!([]));
+        let solver = Solver::new(SolverConfig::default());
+        let values: Vec<f64> = (1..=1000).map(f64::from).collect();
+        let stop = |row: &SweepRow| row.values[0] >= 300.0;
+        let report = solver
+            .sweep(&doc, &[axis("r", &values)], 4, Some(&stop))
+            .unwrap();
+        assert!(report.stopped);
+        assert_eq!(report.rows.last().unwrap().values[0], 300.0);
+        assert_eq!(report.rows.len(), 300);
+    }
+
+    /// arm2_end swings about the fixed pivot at `$theta` from the fixed
+    /// arm1, starting below it
+    fn hinge_document() -> InputDocument {
+        serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "parameters": {"theta": 45.0, "r": 80.0},
+            "entities": [
+                {"type": "point", "id": "pivot", "at": [0, 0, 0]},
+                {"type": "point", "id": "arm1_end", "at": [80, 0, 0]},
+                {"type": "point", "id": "arm2_end", "at": [60, -60, 0]},
+                {"type": "line", "id": "arm1", "p1": "pivot", "p2": "arm1_end"},
+                {"type": "line", "id": "arm2", "p1": "pivot", "p2": "arm2_end"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "pivot"},
+                {"type": "fixed", "entity": "arm1_end"},
+                {"type": "distance", "between": ["pivot", "arm2_end"], "value": "$r"},
+                {"type": "angle", "between": ["arm1", "arm2"], "value": "$theta"}
+            ]
+        }))
+        .unwrap()
+    }
+
+    #[test]
+    fn test_track_follows_one_branch() {
+        let doc = hinge_document();
+        let solver = Solver::new(SolverConfig::default());
+        let values: Vec<f64> = (0..=30).map(|i| 10.0 + 5.0 * i as f64).collect();
+        let report = solver
+            .track(&doc, &axis("theta", &values), TrackSteps::default(), None)
+            .unwrap();
+        assert!(report.tracked);
+        assert_eq!(report.rows.len(), values.len());
+        for row in &report.rows {
+            assert!(row.is_ok(), "{:?}", row.error);
+            let [x, y, _] = row.positions[2];
+            assert!(y < 0.0, "{} jumped to the other branch", row.values[0]);
+            assert!((x.atan2(-y).to_degrees() - (90.0 - row.values[0])).abs() < 1e-6);
+        }
+        let tracked: u32 = report.rows[1..].iter().map(|r| r.iterations.unwrap()).sum();
+        assert!(
+            tracked <= 3 * (values.len() as u32 - 1),
+            "took {} iterations",
+            tracked
+        );
+    }
+
+    #[test]
+    fn test_track_stops_and_needs_one_dimension() {
+        let doc = hinge_document();
+        let solver = Solver::new(SolverConfig::default());
+        let stop = |row: &SweepRow| row.values[0] >= 30.0;
+        let report = solver
+            .track(
+                &doc,
+                &axis("theta", &[10.0, 20.0, 30.0, 40.0]),
+                TrackSteps::default(),
+                Some(&stop),
+            )
+            .unwrap();
+        assert!(report.stopped);
+        assert_eq!(report.rows.len(), 3);
+
+        let moved = radius_document(serde_json::json!([
+            {"type": "point", "id": "p3", "at": [0, "$h", 0]}
+        ]));
+        assert!(solver
+            .track(&moved, &axis("h", &[1.0]), TrackSteps::default(), None)
+            .is_err());
+    }
+
+    #[test]
+    fn test_sweep_needs_known_parameters() {
+        let doc = radius_document(serde_json::json!([]));
+        let solver = Solver::new(SolverConfig::default());
+        let err = solver
+            .sweep(&doc, &[axis("nope", &[1.0])], 1, None)
+            .unwrap_err();
+        assert!(err.to_string().contains("nope"));
+    }
+}
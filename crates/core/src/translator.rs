@@ -1,5 +1,6 @@
 use crate::error::{Error, Result};
-use crate::ir::{Constraint, CoincidentData, InputDocument};
+use crate::ids::{IdTable, Refs};
+use crate::ir::{Constraint, InputDocument};
 
 /// Translates IR to FFI calls
 pub struct Translator;
@@ -10,33 +11,31 @@ impl Translator {
     }
 
     pub fn translate(&self, doc: &InputDocument) -> Result<()> {
+        self.translate_indexed(doc, &IdTable::new(doc))
+    }
+
+    /// Translate a document with the id table its validation made (see
+    /// `Validator::index`)
+    pub fn translate_indexed(&self, doc: &InputDocument, ids: &IdTable) -> Result<()> {
         // Validate references first
-        self.validate_references(doc)?;
+        self.validate_references(doc, ids)?;
 
         // Translation logic will go here
         Ok(())
     }
 
-    fn validate_references(&self, doc: &InputDocument) -> Result<()> {
-        let entity_ids: std::collections::HashSet<_> =
-            doc.entities.iter().map(|e| e.id()).collect();
-
+    fn validate_references(&self, doc: &InputDocument, ids: &IdTable) -> Result<()> {
         // Check constraints reference valid entities
         for constraint in &doc.constraints {
-            self.validate_constraint_refs(constraint, &entity_ids)?;
+            self.validate_constraint_refs(constraint, ids)?;
         }
 
         Ok(())
     }
 
-    fn validate_constraint_refs(
-        &self,
-        constraint: &Constraint,
-        entity_ids: &std::collections::HashSet<&str>,
-    ) -> Result<()> {
-        let refs = self.get_constraint_refs(constraint);
-        for ref_id in refs {
-            if !entity_ids.contains(ref_id.as_str()) {
+    fn validate_constraint_refs(&self, constraint: &Constraint, ids: &IdTable) -> Result<()> {
+        for ref_id in self.get_constraint_refs(constraint) {
+            if !ids.contains(ref_id) {
                 return Err(Error::InvalidInput {
                     message: format!("Unknown entity reference '{}'", ref_id),
                     pointer: None,
@@ -46,95 +45,8 @@ impl Translator {
         Ok(())
     }
 
-    fn get_constraint_refs(&self, constraint: &Constraint) -> Vec<String> {
-        match constraint {
-            Constraint::Coincident { data } => {
-                match data {
-                    CoincidentData::PointOnLine { at, of } => {
-                        let mut refs = vec![at.clone()];
-                        refs.extend(of.clone());
-                        refs
-                    },
-                    CoincidentData::TwoEntities { entities } => entities.clone(),
-                }
-            }
-            Constraint::Distance { between, .. } | Constraint::Angle { between, .. } => {
-                between.clone()
-            }
-            Constraint::Perpendicular { a, b }
-            | Constraint::EqualRadius { a, b }
-            | Constraint::Tangent { a, b }
-            | Constraint::SameOrientation { a, b }
-            | Constraint::CubicLineTangent { cubic: a, line: b } => vec![a.clone(), b.clone()],
-            Constraint::Parallel { entities } | Constraint::EqualLength { entities, .. } => entities.clone(),
-            Constraint::EqualAngle { lines } => lines.clone(),
-            Constraint::Horizontal { a, workplane } | Constraint::Vertical { a, workplane } => {
-                vec![a.clone(), workplane.clone()]
-            }
-            Constraint::Fixed { entity, workplane } => {
-                let mut refs = vec![entity.clone()];
-                if let Some(wp) = workplane {
-                    refs.push(wp.clone());
-                }
-                refs
-            }
-            Constraint::Diameter { circle: a, .. } => vec![a.clone()],
-            Constraint::PointOnLine { point, line, workplane } => {
-                let mut refs = vec![point.clone(), line.clone()];
-                if let Some(wp) = workplane {
-                    refs.push(wp.clone());
-                }
-                refs
-            }
-            Constraint::PointLineDistance { point, line, .. }
-            | Constraint::EqualLengthPointLineDistance { point, line, .. }
-            | Constraint::PointOnCircle {
-                point,
-                circle: line,
-            } => vec![point.clone(), line.clone()],
-            Constraint::Symmetric { a, b, about } => vec![a.clone(), b.clone(), about.clone()],
-            Constraint::SymmetricHorizontal { a, b, workplane } | Constraint::SymmetricVertical { a, b, workplane } => {
-                vec![a.clone(), b.clone(), workplane.clone()]
-            }
-            Constraint::Midpoint { point, of } => vec![point.clone(), of.clone()],
-            Constraint::PointInPlane { point, plane } | Constraint::PointPlaneDistance { point, plane, .. } => {
-                vec![point.clone(), plane.clone()]
-            }
-            Constraint::LengthRatio { a, b, .. } | Constraint::LengthDifference { a, b, .. } => {
-                vec![a.clone(), b.clone()]
-            }
-            Constraint::ProjectedPointDistance { a, b, plane, .. } => {
-                vec![a.clone(), b.clone(), plane.clone()]
-            }
-            Constraint::PointOnFace { point, face } | Constraint::PointFaceDistance { point, face, .. } => {
-                vec![point.clone(), face.clone()]
-            }
-            Constraint::EqualLineArcLength { line, arc } => {
-                vec![line.clone(), arc.clone()]
-            }
-            Constraint::EqualPointLineDistances { point1, line1, point2, line2 } => {
-                vec![point1.clone(), line1.clone(), point2.clone(), line2.clone()]
-            }
-            Constraint::ArcArcLengthRatio { a, b, .. } | Constraint::ArcArcLengthDifference { a, b, .. } => {
-                vec![a.clone(), b.clone()]
-            }
-            Constraint::ArcLineLengthRatio { arc, line, .. } | Constraint::ArcLineLengthDifference { arc, line, .. } => {
-                vec![arc.clone(), line.clone()]
-            }
-            Constraint::Dragged { point, workplane } => {
-                let mut refs = vec![point.clone()];
-                if let Some(wp) = workplane {
-                    refs.push(wp.clone());
-                }
-                refs
-            }
-            Constraint::Collinear { points } => {
-                points.clone()
-            }
-            Constraint::EqualAngles { lines, .. } => {
-                lines.clone()
-            }
-        }
+    fn get_constraint_refs<'a>(&self, constraint: &'a Constraint) -> Refs<'a> {
+        constraint.refs()
     }
 }
 
@@ -147,7 +59,7 @@ impl Default for Translator {
 #[cfg(test)]
 mod tests {
     use super::*;
-    use crate::ir::{Entity, ExprOrNumber};
+    use crate::ir::{CoincidentData, Entity, ExprOrNumber};
     use std::collections::HashMap;
 
     #[test]
@@ -194,7 +106,9 @@ mod tests {
             }],
         };
 
-        assert!(translator.validate_references(&doc).is_ok());
+        assert!(translator
+            .validate_references(&doc, &IdTable::new(&doc))
+            .is_ok());
     }
 
     #[test]
@@ -218,7 +132,7 @@ mod tests {
             ],
         };
 
-        let result = translator.validate_references(&doc);
+        let result = translator.validate_references(&doc, &IdTable::new(&doc));
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, .. } => {
@@ -236,14 +150,21 @@ mod tests {
             a: "l1".to_string(),
             workplane: "wp1".to_string(),
         };
-        assert_eq!(translator.get_constraint_refs(&constraint), vec!["l1", "wp1"]);
+        assert_eq!(
+            translator
+                .get_constraint_refs(&constraint)
+                .collect::<Vec<_>>(),
+            vec!["l1", "wp1"]
+        );
 
         let constraint = Constraint::Perpendicular {
             a: "l1".to_string(),
             b: "l2".to_string(),
         };
         assert_eq!(
-            translator.get_constraint_refs(&constraint),
+            translator
+                .get_constraint_refs(&constraint)
+                .collect::<Vec<_>>(),
             vec!["l1", "l2"]
         );
 
@@ -254,7 +175,9 @@ mod tests {
             }
         };
         assert_eq!(
-            translator.get_constraint_refs(&constraint),
+            translator
+                .get_constraint_refs(&constraint)
+                .collect::<Vec<_>>(),
             vec!["p1", "l1", "l2"]
         );
     }
@@ -322,8 +245,13 @@ mod tests {
         ];
 
         for constraint in constraints {
-            let refs = translator.get_constraint_refs(&constraint);
-            assert!(!refs.is_empty(), "Constraint should have at least one reference");
+            let refs = translator
+                .get_constraint_refs(&constraint)
+                .collect::<Vec<_>>();
+            assert!(
+                !refs.is_empty(),
+                "Constraint should have at least one reference"
+            );
         }
     }
 
@@ -341,7 +269,9 @@ mod tests {
         let constraint = Constraint::Collinear {
             points: vec!["p1".to_string(), "p2".to_string(), "p3".to_string()],
         };
-        let refs = translator.get_constraint_refs(&constraint);
+        let refs = translator
+            .get_constraint_refs(&constraint)
+            .collect::<Vec<_>>();
         assert_eq!(refs, vec!["p1", "p2", "p3"]);
     }
 
@@ -354,7 +284,9 @@ mod tests {
             lines: vec!["l1".to_string(), "l2".to_string(), "l3".to_string()],
             value: None,
         };
-        let refs = translator.get_constraint_refs(&constraint);
+        let refs = translator
+            .get_constraint_refs(&constraint)
+            .collect::<Vec<_>>();
         assert_eq!(refs, vec!["l1", "l2", "l3"]);
 
         // Test with value
@@ -362,7 +294,9 @@ mod tests {
             lines: vec!["l1".to_string(), "l2".to_string()],
             value: Some(ExprOrNumber::Number(45.0)),
         };
-        let refs = translator.get_constraint_refs(&constraint);
+        let refs = translator
+            .get_constraint_refs(&constraint)
+            .collect::<Vec<_>>();
         assert_eq!(refs, vec!["l1", "l2"]);
     }
 }
@@ -1,6 +1,6 @@
 use crate::error::{Error, Result};
-use crate::ir::InputDocument;
-use std::collections::HashSet;
+use crate::ids::{EntityKind, IdTable};
+use crate::ir::{Constraint, Entity, InputDocument};
 
 pub struct Validator;
 
@@ -10,13 +10,63 @@ impl Validator {
     }
 
     pub fn validate(&self, doc: &InputDocument) -> Result<()> {
+        self.index(doc).map(|_| ())
+    }
+
+    /// Validate the document, and hand back the table of its entity ids
+    /// for translating it.
+    ///
+    /// This is one pass over the entities and one over the constraints.
+    /// Errors are still reported in the order of the checks: duplicate ids,
+    /// units, unknown constraint references, entity references, then what
+    /// constraints ask of the entities they reference.
+    pub fn index<'a>(&self, doc: &'a InputDocument) -> Result<IdTable<'a>> {
         self.validate_schema(doc)?;
-        self.validate_entity_ids(doc)?;
+
+        let mut table = IdTable::with_capacity(doc.entities.len());
+        let mut entity_error = None;
+        for (idx, entity) in doc.entities.iter().enumerate() {
+            if entity_error.is_none() {
+                entity_error = self.check_entity_refs(idx, entity, &table).err();
+            }
+            if !table.insert(idx, entity) {
+                return Err(Error::InvalidInput {
+                    message: format!("Duplicate entity ID: {}", entity.id()),
+                    pointer: None,
+                });
+            }
+        }
+
         self.validate_units(doc)?;
-        self.validate_constraint_references(doc)?;
-        self.validate_entity_references(doc)?;
-        self.validate_constraint_entity_types(doc)?;
-        Ok(())
+
+        let mut constraint_error = None;
+        for (idx, constraint) in doc.constraints.iter().enumerate() {
+            for ref_id in constraint.refs() {
+                if !table.contains(ref_id) {
+                    return Err(Error::InvalidInput {
+                        message: format!(
+                            "Constraint #{} references unknown entity '{}'. Available entities: {}",
+                            idx + 1,
+                            ref_id,
+                            if table.is_empty() {
+                                "(none)".to_string()
+                            } else {
+                                table.sorted().join(", ")
+                            }
+                        ),
+                        pointer: Some(format!("/constraints/{}", idx)),
+                    });
+                }
+            }
+            if constraint_error.is_none() {
+                constraint_error = self.check_constraint_types(idx, constraint, &table).err();
+            }
+        }
+
+        match entity_error.or(constraint_error) {
+            Some(e) => Err(e),
+            None => Ok(table),
+        }
     }
 
     fn validate_schema(&self, doc: &InputDocument) -> Result<()> {
@@ -29,20 +79,6 @@ impl Validator {
         Ok(())
     }
 
-    fn validate_entity_ids(&self, doc: &InputDocument) -> Result<()> {
-        let mut seen = HashSet::new();
-        for entity in &doc.entities {
-            let id = entity.id();
-            if !seen.insert(id) {
-                return Err(Error::InvalidInput {
-                    message: format!("Duplicate entity ID: {}", id),
-                    pointer: None,
-                });
-            }
-        }
-        Ok(())
-    }
-
     fn validate_units(&self, doc: &InputDocument) -> Result<()> {
         const VALID_UNITS: &[&str] = &["mm", "cm", "m", "in", "ft"];
         if !VALID_UNITS.contains(&doc.units.as_str()) {
@@ -57,117 +93,37 @@ impl Validator {
         Ok(())
     }
 
-    fn validate_constraint_references(&self, doc: &InputDocument) -> Result<()> {
-        use crate::ir::{Constraint, CoincidentData};
-        let entity_ids: HashSet<&str> = doc.entities.iter().map(|e| e.id()).collect();
-
-        for (idx, constraint) in doc.constraints.iter().enumerate() {
-            let refs = match constraint {
-                Constraint::Fixed { entity, .. } => vec![entity.as_str()],
-                Constraint::Distance { between, .. } => between.iter().map(|s| s.as_str()).collect(),
-                Constraint::Angle { between, .. } => between.iter().map(|s| s.as_str()).collect(),
-                Constraint::Perpendicular { a, b } | Constraint::EqualRadius { a, b } | Constraint::Tangent { a, b } | 
-                Constraint::SameOrientation { a, b } | Constraint::CubicLineTangent { cubic: a, line: b } => {
-                    vec![a.as_str(), b.as_str()]
-                }
-                Constraint::Parallel { entities } | Constraint::EqualLength { entities, .. } => {
-                    entities.iter().map(|s| s.as_str()).collect()
-                }
-                Constraint::EqualAngle { lines } => {
-                    lines.iter().map(|s| s.as_str()).collect()
-                }
-                Constraint::Horizontal { a, workplane } | Constraint::Vertical { a, workplane } => {
-                    vec![a.as_str(), workplane.as_str()]
-                }
-                Constraint::Diameter { circle: a, .. } => {
-                    vec![a.as_str()]
-                }
-                Constraint::PointOnLine { point, line, workplane } => {
-                    let mut refs = vec![point.as_str(), line.as_str()];
-                    if let Some(wp) = workplane {
-                        refs.push(wp.as_str());
-                    }
-                    refs
-                }
-                Constraint::PointLineDistance { point, line, .. } |
-                Constraint::EqualLengthPointLineDistance { point, line, .. } => {
-                    vec![point.as_str(), line.as_str()]
-                }
-                Constraint::PointOnCircle { point, circle } => vec![point.as_str(), circle.as_str()],
-                Constraint::Symmetric { a, b, about } => vec![a.as_str(), b.as_str(), about.as_str()],
-                Constraint::SymmetricHorizontal { a, b, workplane } | Constraint::SymmetricVertical { a, b, workplane } => {
-                    vec![a.as_str(), b.as_str(), workplane.as_str()]
-                }
-                Constraint::Midpoint { point, of } => {
-                    let mut refs = vec![point.as_str()];
-                    refs.push(of.as_str());
-                    refs
-                }
-                Constraint::PointInPlane { point, plane } | Constraint::PointPlaneDistance { point, plane, .. } => {
-                    vec![point.as_str(), plane.as_str()]
-                }
-                Constraint::LengthRatio { a, b, .. } | Constraint::LengthDifference { a, b, .. } => {
-                    vec![a.as_str(), b.as_str()]
-                }
-                Constraint::ProjectedPointDistance { a, b, plane, .. } => {
-                    vec![a.as_str(), b.as_str(), plane.as_str()]
-                }
-                Constraint::PointOnFace { point, face } | Constraint::PointFaceDistance { point, face, .. } => {
-                    vec![point.as_str(), face.as_str()]
-                }
-                Constraint::EqualLineArcLength { line, arc } => {
-                    vec![line.as_str(), arc.as_str()]
-                }
-                Constraint::EqualPointLineDistances { point1, line1, point2, line2 } => {
-                    vec![point1.as_str(), line1.as_str(), point2.as_str(), line2.as_str()]
-                }
-                Constraint::ArcArcLengthRatio { a, b, .. } | Constraint::ArcArcLengthDifference { a, b, .. } => {
-                    vec![a.as_str(), b.as_str()]
-                }
-                Constraint::ArcLineLengthRatio { arc, line, .. } | Constraint::ArcLineLengthDifference { arc, line, .. } => {
-                    vec![arc.as_str(), line.as_str()]
-                }
-                Constraint::Dragged { point, workplane } => {
-                    let mut refs = vec![point.as_str()];
-                    if let Some(wp) = workplane {
-                        refs.push(wp.as_str());
-                    }
-                    refs
-                }
-                Constraint::Collinear { points } => {
-                    points.iter().map(|s| s.as_str()).collect()
-                }
-                Constraint::EqualAngles { lines, .. } => {
-                    lines.iter().map(|s| s.as_str()).collect()
-                }
-                Constraint::Coincident { data } => {
-                    match data {
-                        CoincidentData::PointOnLine { at, of } => {
-                            let mut refs = vec![at.as_str()];
-                            refs.extend(of.iter().map(|s| s.as_str()));
-                            refs
-                        }
-                        CoincidentData::TwoEntities { entities } => {
-                            entities.iter().map(|s| s.as_str()).collect()
-                        }
-                    }
-                }
-            };
+    /// Check what a constraint asks of the kinds of entities it references
+    fn check_constraint_types(
+        &self,
+        idx: usize,
+        constraint: &Constraint,
+        table: &IdTable,
+    ) -> Result<()> {
+        // Symmetric constraint about a line doesn't work in 3D
+        if let Constraint::Symmetric { a, b, about } = constraint {
+            return Err(Error::InvalidInput {
+                message: format!(
+                    "The 'symmetric' constraint (about line '{}') is not supported in 3D mode. \
+                    Use 'symmetric_horizontal' or 'symmetric_vertical' with a workplane instead. \
+                    Example: {{\"type\": \"symmetric_horizontal\", \"a\": \"{}\", \"b\": \"{}\", \"workplane\": \"your_plane\"}}",
+                    about, a, b
+                ),
+                pointer: Some(format!("/constraints/{}", idx)),
+            });
+        }
 
-            for ref_id in refs {
-                if !entity_ids.contains(ref_id) {
+        // A gear mesh is between pitch circles
+        if let Constraint::GearMesh { a, b, .. } = constraint {
+            for id in [a, b] {
+                let kind = table.kind(id);
+                if kind != Some(EntityKind::Circle) {
                     return Err(Error::InvalidInput {
                         message: format!(
-                            "Constraint #{} references unknown entity '{}'. Available entities: {}",
-                            idx + 1,
-                            ref_id,
-                            if entity_ids.is_empty() {
-                                "(none)".to_string()
-                            } else {
-                                let mut sorted: Vec<&str> = entity_ids.iter().copied().collect();
-                                sorted.sort();
-                                sorted.join(", ")
-                            }
+                            "GearMesh constraint cannot be applied to entity '{}' (type: {}). \
+                            Gears mesh as their pitch circles, so both must be circle entities.",
+                            id,
+                            kind.map_or("unknown", EntityKind::name)
                         ),
                         pointer: Some(format!("/constraints/{}", idx)),
                     });
@@ -175,65 +131,21 @@ impl Validator {
             }
         }
 
-        Ok(())
-    }
-
-    fn validate_constraint_entity_types(&self, doc: &InputDocument) -> Result<()> {
-        use crate::ir::{Constraint, Entity};
-        use std::collections::HashMap;
-
-        // Build entity type map
-        let entity_types: HashMap<&str, &str> = doc.entities.iter().map(|e| {
-            let type_name = match e {
-                Entity::Point { .. } | Entity::Point2D { .. } => "point",
-                Entity::Line { .. } | Entity::Line2D { .. } => "line",
-                Entity::Circle { .. } => "circle",
-                Entity::Arc { .. } => "arc",
-                Entity::Plane { .. } => "plane",
-                Entity::Cubic { .. } => "cubic",
-            };
-            (e.id(), type_name)
-        }).collect();
+        // Tangent constraint only works with arc, cubic, and line - NOT circle
+        if let Constraint::Tangent { a, b } = constraint {
+            const VALID_TANGENT_TYPES: &[EntityKind] =
+                &[EntityKind::Arc, EntityKind::Cubic, EntityKind::Line];
 
-        for (idx, constraint) in doc.constraints.iter().enumerate() {
-            // Symmetric constraint about a line doesn't work in 3D
-            if let Constraint::Symmetric { a, b, about } = constraint {
-                return Err(Error::InvalidInput {
-                    message: format!(
-                        "The 'symmetric' constraint (about line '{}') is not supported in 3D mode. \
-                        Use 'symmetric_horizontal' or 'symmetric_vertical' with a workplane instead. \
-                        Example: {{\"type\": \"symmetric_horizontal\", \"a\": \"{}\", \"b\": \"{}\", \"workplane\": \"your_plane\"}}",
-                        about, a, b
-                    ),
-                    pointer: Some(format!("/constraints/{}", idx)),
-                });
-            }
-
-            // Tangent constraint only works with arc, cubic, and line - NOT circle
-            if let Constraint::Tangent { a, b } = constraint {
-                let type_a = entity_types.get(a.as_str()).copied().unwrap_or("unknown");
-                let type_b = entity_types.get(b.as_str()).copied().unwrap_or("unknown");
-                
-                const VALID_TANGENT_TYPES: &[&str] = &["arc", "cubic", "line"];
-                
-                if !VALID_TANGENT_TYPES.contains(&type_a) {
+            for id in [a, b] {
+                let kind = table.kind(id);
+                if !kind.map_or(false, |k| VALID_TANGENT_TYPES.contains(&k)) {
                     return Err(Error::InvalidInput {
                         message: format!(
                             "Tangent constraint cannot be applied to entity '{}' (type: {}). \
                             Tangent constraints only work with arc, cubic, or line entities. \
                             Circles are not supported - use an Arc entity instead.",
-                            a, type_a
-                        ),
-                        pointer: Some(format!("/constraints/{}", idx)),
-                    });
-                }
-                if !VALID_TANGENT_TYPES.contains(&type_b) {
-                    return Err(Error::InvalidInput {
-                        message: format!(
-                            "Tangent constraint cannot be applied to entity '{}' (type: {}). \
-                            Tangent constraints only work with arc, cubic, or line entities. \
-                            Circles are not supported - use an Arc entity instead.",
-                            b, type_b
+                            id,
+                            kind.map_or("unknown", EntityKind::name)
                         ),
                         pointer: Some(format!("/constraints/{}", idx)),
                     });
@@ -244,268 +156,268 @@ impl Validator {
         Ok(())
     }
 
-    fn validate_entity_references(&self, doc: &InputDocument) -> Result<()> {
-        use crate::ir::Entity;
-        // Build set incrementally to prevent forward references
-        // This matches how the solver processes entities sequentially
-        // Only track Point entities since Line.p1/p2 and Arc.start/end must reference Points
-        let mut seen_point_ids = HashSet::new();
-        // Track all entity IDs to provide better error messages
-        let mut seen_entity_ids = HashSet::new();
+    /// Check an entity's references against the entities before it. These
+    /// must already be defined, which matches how the solver adds entities
+    /// sequentially, and Line.p1/p2, Arc.start/end and the like must be
+    /// points.
+    fn check_entity_refs(&self, idx: usize, entity: &Entity, table: &IdTable) -> Result<()> {
+        let is_point = |id: &str| table.kind(id) == Some(EntityKind::Point);
 
-        for (idx, entity) in doc.entities.iter().enumerate() {
-            match entity {
-                Entity::Line { p1, p2, .. } => {
-                    if !seen_point_ids.contains(p1.as_str()) {
-                        if !seen_entity_ids.contains(p1.as_str()) {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, p1
-                                ),
-                                pointer: Some(format!("/entities/{}/p1", idx)),
-                            });
-                        } else {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line entity #{} references '{}' which is not a Point entity. Line endpoints must reference Point entities.",
-                                    idx + 1, p1
-                                ),
-                                pointer: Some(format!("/entities/{}/p1", idx)),
-                            });
-                        }
+        match entity {
+            Entity::Line { p1, p2, .. } => {
+                if !is_point(p1.as_str()) {
+                    if !table.contains(p1.as_str()) {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, p1
+                            ),
+                            pointer: Some(format!("/entities/{}/p1", idx)),
+                        });
+                    } else {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line entity #{} references '{}' which is not a Point entity. Line endpoints must reference Point entities.",
+                                idx + 1, p1
+                            ),
+                            pointer: Some(format!("/entities/{}/p1", idx)),
+                        });
                     }
-                    if !seen_point_ids.contains(p2.as_str()) {
-                        if !seen_entity_ids.contains(p2.as_str()) {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, p2
-                                ),
-                                pointer: Some(format!("/entities/{}/p2", idx)),
-                            });
-                        } else {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line entity #{} references '{}' which is not a Point entity. Line endpoints must reference Point entities.",
-                                    idx + 1, p2
-                                ),
-                                pointer: Some(format!("/entities/{}/p2", idx)),
-                            });
-                        }
+                }
+                if !is_point(p2.as_str()) {
+                    if !table.contains(p2.as_str()) {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, p2
+                            ),
+                            pointer: Some(format!("/entities/{}/p2", idx)),
+                        });
+                    } else {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line entity #{} references '{}' which is not a Point entity. Line endpoints must reference Point entities.",
+                                idx + 1, p2
+                            ),
+                            pointer: Some(format!("/entities/{}/p2", idx)),
+                        });
                     }
                 }
-                Entity::Line2D { p1, p2, workplane, .. } => {
-                    // Validate that p1 and p2 reference Point2D entities
-                    if !seen_point_ids.contains(p1.as_str()) {
-                        if !seen_entity_ids.contains(p1.as_str()) {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line2D entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, p1
-                                ),
-                                pointer: Some(format!("/entities/{}/p1", idx)),
-                            });
-                        } else {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line2D entity #{} references '{}' which is not a Point2D entity. Line2D endpoints must reference Point2D entities.",
-                                    idx + 1, p1
-                                ),
-                                pointer: Some(format!("/entities/{}/p1", idx)),
-                            });
-                        }
+            }
+            Entity::Line2D {
+                p1, p2, workplane, ..
+            } => {
+                // Validate that p1 and p2 reference Point2D entities
+                if !is_point(p1.as_str()) {
+                    if !table.contains(p1.as_str()) {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line2D entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, p1
+                            ),
+                            pointer: Some(format!("/entities/{}/p1", idx)),
+                        });
+                    } else {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line2D entity #{} references '{}' which is not a Point2D entity. Line2D endpoints must reference Point2D entities.",
+                                idx + 1, p1
+                            ),
+                            pointer: Some(format!("/entities/{}/p1", idx)),
+                        });
                     }
-                    if !seen_point_ids.contains(p2.as_str()) {
-                        if !seen_entity_ids.contains(p2.as_str()) {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line2D entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, p2
-                                ),
-                                pointer: Some(format!("/entities/{}/p2", idx)),
-                            });
-                        } else {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Line2D entity #{} references '{}' which is not a Point2D entity. Line2D endpoints must reference Point2D entities.",
-                                    idx + 1, p2
-                                ),
-                                pointer: Some(format!("/entities/{}/p2", idx)),
-                            });
-                        }
+                }
+                if !is_point(p2.as_str()) {
+                    if !table.contains(p2.as_str()) {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line2D entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, p2
+                            ),
+                            pointer: Some(format!("/entities/{}/p2", idx)),
+                        });
+                    } else {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Line2D entity #{} references '{}' which is not a Point2D entity. Line2D endpoints must reference Point2D entities.",
+                                idx + 1, p2
+                            ),
+                            pointer: Some(format!("/entities/{}/p2", idx)),
+                        });
                     }
-                    // Validate workplane reference
-                    if !seen_entity_ids.contains(workplane.as_str()) {
+                }
+                // Validate workplane reference
+                if !table.contains(workplane.as_str()) {
+                    return Err(Error::InvalidInput {
+                        message: format!(
+                            "Line2D entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                            idx + 1, workplane
+                        ),
+                        pointer: Some(format!("/entities/{}/workplane", idx)),
+                    });
+                }
+            }
+            Entity::Arc {
+                center,
+                start,
+                end,
+                workplane,
+                ..
+            } => {
+                // Validate center point reference
+                if !is_point(center.as_str()) {
+                    if !table.contains(center.as_str()) {
                         return Err(Error::InvalidInput {
                             message: format!(
-                                "Line2D entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                idx + 1, workplane
+                                "Arc entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, center
                             ),
-                            pointer: Some(format!("/entities/{}/workplane", idx)),
+                            pointer: Some(format!("/entities/{}/center", idx)),
+                        });
+                    } else {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Arc entity #{} references '{}' which is not a Point entity. Arc center must reference a Point entity.",
+                                idx + 1, center
+                            ),
+                            pointer: Some(format!("/entities/{}/center", idx)),
                         });
                     }
                 }
-                Entity::Arc { center, start, end, workplane, .. } => {
-                    // Validate center point reference
-                    if !seen_point_ids.contains(center.as_str()) {
-                        if !seen_entity_ids.contains(center.as_str()) {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Arc entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, center
-                                ),
-                                pointer: Some(format!("/entities/{}/center", idx)),
-                            });
-                        } else {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Arc entity #{} references '{}' which is not a Point entity. Arc center must reference a Point entity.",
-                                    idx + 1, center
-                                ),
-                                pointer: Some(format!("/entities/{}/center", idx)),
-                            });
-                        }
+                // Validate start point reference
+                if !is_point(start.as_str()) {
+                    if !table.contains(start.as_str()) {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Arc entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, start
+                            ),
+                            pointer: Some(format!("/entities/{}/start", idx)),
+                        });
+                    } else {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Arc entity #{} references '{}' which is not a Point entity. Arc start/end points must reference Point entities.",
+                                idx + 1, start
+                            ),
+                            pointer: Some(format!("/entities/{}/start", idx)),
+                        });
                     }
-                    // Validate start point reference
-                    if !seen_point_ids.contains(start.as_str()) {
-                        if !seen_entity_ids.contains(start.as_str()) {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Arc entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, start
-                                ),
-                                pointer: Some(format!("/entities/{}/start", idx)),
-                            });
-                        } else {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Arc entity #{} references '{}' which is not a Point entity. Arc start/end points must reference Point entities.",
-                                    idx + 1, start
-                                ),
-                                pointer: Some(format!("/entities/{}/start", idx)),
-                            });
-                        }
+                }
+                // Validate end point reference
+                if !is_point(end.as_str()) {
+                    if !table.contains(end.as_str()) {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Arc entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, end
+                            ),
+                            pointer: Some(format!("/entities/{}/end", idx)),
+                        });
+                    } else {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Arc entity #{} references '{}' which is not a Point entity. Arc start/end points must reference Point entities.",
+                                idx + 1, end
+                            ),
+                            pointer: Some(format!("/entities/{}/end", idx)),
+                        });
                     }
-                    // Validate end point reference
-                    if !seen_point_ids.contains(end.as_str()) {
-                        if !seen_entity_ids.contains(end.as_str()) {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Arc entity #{} references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, end
-                                ),
-                                pointer: Some(format!("/entities/{}/end", idx)),
-                            });
-                        } else {
-                            return Err(Error::InvalidInput {
-                                message: format!(
-                                    "Arc entity #{} references '{}' which is not a Point entity. Arc start/end points must reference Point entities.",
-                                    idx + 1, end
-                                ),
-                                pointer: Some(format!("/entities/{}/end", idx)),
-                            });
-                        }
+                }
+                // Validate workplane if specified
+                if let Some(wp_id) = workplane {
+                    if !table.contains(wp_id.as_str()) {
+                        return Err(Error::InvalidInput {
+                            message: format!(
+                                "Arc entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, wp_id
+                            ),
+                            pointer: Some(format!("/entities/{}/workplane", idx)),
+                        });
                     }
-                    // Validate workplane if specified
-                    if let Some(wp_id) = workplane {
-                        if !seen_entity_ids.contains(wp_id.as_str()) {
+                }
+            }
+            Entity::Cubic {
+                control_points,
+                workplane,
+                ..
+            } => {
+                // Validate all control points
+                for (pt_idx, pt_id) in control_points.iter().enumerate() {
+                    if !is_point(pt_id.as_str()) {
+                        if !table.contains(pt_id.as_str()) {
                             return Err(Error::InvalidInput {
                                 message: format!(
-                                    "Arc entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, wp_id
+                                    "Cubic entity #{} control point #{} '{}' is not yet defined. Entities must be defined before they are referenced.",
+                                    idx + 1, pt_idx + 1, pt_id
                                 ),
-                                pointer: Some(format!("/entities/{}/workplane", idx)),
+                                pointer: Some(format!("/entities/{}/control_points/{}", idx, pt_idx)),
                             });
-                        }
-                    }
-                }
-                Entity::Cubic { control_points, workplane, .. } => {
-                    // Validate all control points
-                    for (pt_idx, pt_id) in control_points.iter().enumerate() {
-                        if !seen_point_ids.contains(pt_id.as_str()) {
-                            if !seen_entity_ids.contains(pt_id.as_str()) {
-                                return Err(Error::InvalidInput {
-                                    message: format!(
-                                        "Cubic entity #{} control point #{} '{}' is not yet defined. Entities must be defined before they are referenced.",
-                                        idx + 1, pt_idx + 1, pt_id
-                                    ),
-                                    pointer: Some(format!("/entities/{}/control_points/{}", idx, pt_idx)),
-                                });
-                            } else {
-                                return Err(Error::InvalidInput {
-                                    message: format!(
-                                        "Cubic entity #{} control point #{} '{}' is not a Point entity. Cubic control points must reference Point entities.",
-                                        idx + 1, pt_idx + 1, pt_id
-                                    ),
-                                    pointer: Some(format!("/entities/{}/control_points/{}", idx, pt_idx)),
-                                });
-                            }
-                        }
-                    }
-                    // Validate workplane if specified
-                    if let Some(wp_id) = workplane {
-                        if !seen_entity_ids.contains(wp_id.as_str()) {
+                        } else {
                             return Err(Error::InvalidInput {
                                 message: format!(
-                                    "Cubic entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                    idx + 1, wp_id
+                                    "Cubic entity #{} control point #{} '{}' is not a Point entity. Cubic control points must reference Point entities.",
+                                    idx + 1, pt_idx + 1, pt_id
                                 ),
-                                pointer: Some(format!("/entities/{}/workplane", idx)),
+                                pointer: Some(format!("/entities/{}/control_points/{}", idx, pt_idx)),
                             });
                         }
                     }
                 }
-                Entity::Point2D { workplane, .. } => {
-                    // Validate workplane reference
-                    if !seen_entity_ids.contains(workplane.as_str()) {
+                // Validate workplane if specified
+                if let Some(wp_id) = workplane {
+                    if !table.contains(wp_id.as_str()) {
                         return Err(Error::InvalidInput {
                             message: format!(
-                                "Point2D entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                idx + 1, workplane
+                                "Cubic entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                idx + 1, wp_id
                             ),
                             pointer: Some(format!("/entities/{}/workplane", idx)),
                         });
                     }
-                    // Track Point2D as a Point for reference validation
-                    seen_point_ids.insert(entity.id());
                 }
-                Entity::Point { .. } => {
-                    // Track Point entities separately
-                    seen_point_ids.insert(entity.id());
+            }
+            Entity::Point2D { workplane, .. } => {
+                // Validate workplane reference
+                if !table.contains(workplane.as_str()) {
+                    return Err(Error::InvalidInput {
+                        message: format!(
+                            "Point2D entity #{} references workplane '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                            idx + 1, workplane
+                        ),
+                        pointer: Some(format!("/entities/{}/workplane", idx)),
+                    });
                 }
-                Entity::Circle { id, center, .. } => {
-                    // Validate center point reference if it's a reference (not coordinates)
-                    if let crate::ir::PositionOrRef::Reference(point_id) = center {
-                        if !seen_point_ids.contains(point_id.as_str()) {
-                            if !seen_entity_ids.contains(point_id.as_str()) {
-                                return Err(Error::InvalidInput {
-                                    message: format!(
-                                        "Circle entity '{}' references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
-                                        id, point_id
-                                    ),
-                                    pointer: Some(format!("/entities/{}/center", idx)),
-                                });
-                            } else {
-                                return Err(Error::InvalidInput {
-                                    message: format!(
-                                        "Circle entity '{}' references '{}' which is not a Point entity. Circle center must reference a Point or Point2D entity.",
-                                        id, point_id
-                                    ),
-                                    pointer: Some(format!("/entities/{}/center", idx)),
-                                });
-                            }
+            }
+            Entity::Point { .. } => {}
+            Entity::Circle { id, center, .. } => {
+                // Validate center point reference if it's a reference (not coordinates)
+                if let crate::ir::PositionOrRef::Reference(point_id) = center {
+                    if !is_point(point_id.as_str()) {
+                        if !table.contains(point_id.as_str()) {
+                            return Err(Error::InvalidInput {
+                                message: format!(
+                                    "Circle entity '{}' references point '{}' that is not yet defined. Entities must be defined before they are referenced.",
+                                    id, point_id
+                                ),
+                                pointer: Some(format!("/entities/{}/center", idx)),
+                            });
+                        } else {
+                            return Err(Error::InvalidInput {
+                                message: format!(
+                                    "Circle entity '{}' references '{}' which is not a Point entity. Circle center must reference a Point or Point2D entity.",
+                                    id, point_id
+                                ),
+                                pointer: Some(format!("/entities/{}/center", idx)),
+                            });
                         }
                     }
                 }
-                Entity::Plane { .. } => {
-                    // Planes don't reference other entities
-                }
             }
-            // Add this entity's ID to the set after checking its references
-            seen_entity_ids.insert(entity.id());
+            Entity::Plane { .. } => {
+                // Planes don't reference other entities
+            }
         }
-
         Ok(())
     }
 }
@@ -581,7 +493,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        assert!(validator.validate_entity_ids(&doc).is_ok());
+        assert!(validator.validate(&doc).is_ok());
     }
 
     #[test]
@@ -607,7 +519,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_ids(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, .. } => assert!(message.contains("Duplicate entity ID")),
@@ -693,7 +605,7 @@ mod tests {
             ],
             constraints: vec![Constraint::Fixed { entity: "p1".to_string(), workplane: None }],
         };
-        assert!(validator.validate_constraint_references(&doc).is_ok());
+        assert!(validator.validate(&doc).is_ok());
     }
 
     #[test]
@@ -712,7 +624,7 @@ mod tests {
             }],
             constraints: vec![Constraint::Fixed { entity: "nonexistent".to_string(), workplane: None }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -755,7 +667,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        assert!(validator.validate_entity_references(&doc).is_ok());
+        assert!(validator.validate(&doc).is_ok());
     }
 
     #[test]
@@ -783,7 +695,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -820,7 +732,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -860,7 +772,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -900,7 +812,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -944,7 +856,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err(), "Forward references should be rejected");
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -990,7 +902,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err(), "Line should not be able to reference Circle");
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1040,7 +952,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err(), "Arc should not be able to reference Circle");
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1086,7 +998,7 @@ mod tests {
             ],
             constraints: vec![],
         };
-        let result = validator.validate_entity_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err(), "Line should not be able to reference Line");
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1110,7 +1022,7 @@ mod tests {
             entities: vec![], // Empty entities
             constraints: vec![Constraint::Fixed { entity: "nonexistent".to_string(), workplane: None }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1245,7 +1157,11 @@ mod tests {
                 },
             ],
         };
-        assert!(validator.validate_constraint_references(&doc).is_ok());
+        // Every reference resolves; only the kinds checked after (symmetric
+        // in 3D, tangent circles) may still object
+        if let Err(e) = validator.validate(&doc) {
+            assert!(!e.to_string().contains("unknown entity"), "{}", e);
+        }
     }
 
     #[test]
@@ -1267,7 +1183,7 @@ mod tests {
                 value: ExprOrNumber::Number(10.0),
             }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1300,7 +1216,7 @@ mod tests {
                 },
             }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1332,7 +1248,7 @@ mod tests {
                 },
             }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1374,7 +1290,7 @@ mod tests {
             ],
             constraints: vec![Constraint::Fixed { entity: "nonexistent".to_string(), workplane: None }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, pointer } => {
@@ -1413,7 +1329,7 @@ mod tests {
                 points: vec!["p1".to_string(), "p2".to_string(), "p3".to_string()],
             }],
         };
-        assert!(validator.validate_constraint_references(&doc).is_ok());
+        assert!(validator.validate(&doc).is_ok());
         
         // Invalid - references nonexistent point
         let doc = InputDocument {
@@ -1428,7 +1344,7 @@ mod tests {
                 points: vec!["p1".to_string(), "p2".to_string(), "p3".to_string()],
             }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, .. } => {
@@ -1461,7 +1377,7 @@ mod tests {
                 value: None,
             }],
         };
-        assert!(validator.validate_constraint_references(&doc).is_ok());
+        assert!(validator.validate(&doc).is_ok());
         
         // Invalid - references nonexistent line
         let doc = InputDocument {
@@ -1478,7 +1394,7 @@ mod tests {
                 value: Some(ExprOrNumber::Number(45.0)),
             }],
         };
-        let result = validator.validate_constraint_references(&doc);
+        let result = validator.validate(&doc);
         assert!(result.is_err());
         match result.unwrap_err() {
             Error::InvalidInput { message, .. } => {
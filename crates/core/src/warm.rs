@@ -0,0 +1,202 @@
+//! Starting a solve from where an earlier one ended, so that re-solving a
+//! document after a small edit starts next to the answer rather than from
+//! the guesses written in it.
+//!
+//! A prior result seeds the points and circles of a document that it has
+//! entries for, matched by entity id; lines, arcs and cubics are made of
+//! points, so they follow. Entities without an entry keep the values they
+//! were written with, as do those held where they are, by a `fixed`
+//! constraint or `preserve`, since a solve doesn't move them anyway.
+
+use crate::ir::{
+    Constraint, Entity, ExprOrNumber, InputDocument, PositionOrRef, ResolvedEntity, SolveResult,
+};
+use std::collections::HashSet;
+
+fn numbers(values: &[f64]) -> Vec<ExprOrNumber> {
+    values.iter().map(|&v| ExprOrNumber::Number(v)).collect()
+}
+
+/// Seed the document's points and circles with where they are in `prior`,
+/// and return how many were seeded
+pub fn seed(doc: &mut InputDocument, prior: &SolveResult) -> usize {
+    let Some(solved) = &prior.entities else {
+        return 0;
+    };
+    let held: HashSet<&str> = doc
+        .constraints
+        .iter()
+        .filter_map(|c| match c {
+            Constraint::Fixed { entity, .. } => Some(entity.as_str()),
+            _ => None,
+        })
+        .collect();
+
+    let mut seeded = 0;
+    for entity in &mut doc.entities {
+        let id = entity.id().to_string();
+        if held.contains(id.as_str()) {
+            continue;
+        }
+        match (entity, solved.get(&id)) {
+            (
+                Entity::Point {
+                    at,
+                    preserve: false,
+                    ..
+                },
+                Some(ResolvedEntity::Point { at: p }),
+            ) => {
+                let n = at.len().min(p.len());
+                *at = numbers(&p[..n]);
+            }
+            // Solved 2D points are reported in their workplane's coordinates
+            (
+                Entity::Point2D {
+                    at,
+                    preserve: false,
+                    ..
+                },
+                Some(ResolvedEntity::Point { at: p }),
+            ) if p.len() >= 2 => {
+                *at = numbers(&p[..2]);
+            }
+            (
+                Entity::Circle {
+                    center,
+                    diameter,
+                    preserve: false,
+                    ..
+                },
+                Some(ResolvedEntity::Circle {
+                    center: c,
+                    diameter: d,
+                    ..
+                }),
+            ) => {
+                if let PositionOrRef::Coordinates(at) = center {
+                    let n = at.len().min(c.len());
+                    *at = numbers(&c[..n]);
+                }
+                *diameter = ExprOrNumber::Number(*d);
+            }
+            _ => continue,
+        }
+        seeded += 1;
+    }
+    seeded
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::solver::{Solver, SolverConfig};
+
+    fn solve(doc: &InputDocument) -> SolveResult {
+        Solver::new(SolverConfig::default()).solve(doc).unwrap()
+    }
+
+    fn point(result: &SolveResult, id: &str) -> Vec<f64> {
+        match &result.entities.as_ref().unwrap()[id] {
+            ResolvedEntity::Point { at } => at.clone(),
+            _ => panic!("{} should be a point", id),
+        }
+    }
+
+    #[test]
+    fn test_seed_matches_by_id() {
+        let mut doc: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "point", "id": "p1", "at": [0, 0, 0]},
+                {"type": "point", "id": "p2", "at": [10, 0, 0]},
+                {"type": "point", "id": "p3", "at": ["$x", 5, 0]},
+                {"type": "point", "id": "p4", "at": [1, 1, 1], "preserve": true},
+                {"type": "circle", "id": "c1", "center": [0, 0, 0], "diameter": 4}
+            ],
+            "constraints": [{"type": "fixed", "entity": "p1"}]
+        }))
+        .unwrap();
+        let prior: SolveResult = serde_json::from_value(serde_json::json!({
+            "status": "ok",
+            "entities": {
+                "p1": {"at": [9, 9, 9]},
+                "p3": {"at": [3, 4, 5]},
+                "p4": {"at": [9, 9, 9]},
+                "c1": {"center": [1, 2, 0], "diameter": 6, "normal": [0, 0, 1]},
+                "gone": {"at": [0, 0, 0]}
+            }
+        }))
+        .unwrap();
+
+        assert_eq!(seed(&mut doc, &prior), 2);
+        let at = |i: usize| match &doc.entities[i] {
+            Entity::Point { at, .. } => at
+                .iter()
+                .map(ExprOrNumber::as_f64)
+                .collect::<Option<Vec<_>>>(),
+            _ => None,
+        };
+        assert_eq!(at(0), Some(vec![0.0, 0.0, 0.0]));
+        assert_eq!(at(1), Some(vec![10.0, 0.0, 0.0]));
+        assert_eq!(at(2), Some(vec![3.0, 4.0, 5.0]));
+        assert_eq!(at(3), Some(vec![1.0, 1.0, 1.0]));
+        match &doc.entities[4] {
+            Entity::Circle {
+                center: PositionOrRef::Coordinates(c),
+                diameter,
+                ..
+            } => {
+                assert_eq!(c, &numbers(&[1.0, 2.0, 0.0]));
+                assert_eq!(diameter, &ExprOrNumber::Number(6.0));
+            }
+            _ => panic!("c1 should be a circle"),
+        }
+    }
+
+    #[test]
+    fn test_seeded_solve_starts_at_the_answer() {
+        // A right triangle in a plane stood on its side
+        let doc: InputDocument = serde_json::from_value(serde_json::json!({
+            "schema": "slvs-json/1",
+            "entities": [
+                {"type": "plane", "id": "wp", "origin": [5, 0, 0], "normal": [1, 0, 0]},
+                {"type": "point2_d", "id": "a", "at": [0, 0], "workplane": "wp"},
+                {"type": "point2_d", "id": "b", "at": [30, 2], "workplane": "wp"},
+                {"type": "point2_d", "id": "c", "at": [3, 35], "workplane": "wp"},
+                {"type": "line2_d", "id": "ab", "p1": "a", "p2": "b", "workplane": "wp"},
+                {"type": "line2_d", "id": "ac", "p1": "a", "p2": "c", "workplane": "wp"}
+            ],
+            "constraints": [
+                {"type": "fixed", "entity": "a", "workplane": "wp"},
+                {"type": "horizontal", "a": "ab", "workplane": "wp"},
+                {"type": "perpendicular", "a": "ab", "b": "ac", "workplane": "wp"},
+                {"type": "distance", "between": ["a", "b"], "value": 40},
+                {"type": "distance", "between": ["a", "c"], "value": 25}
+            ]
+        }))
+        .unwrap();
+        let first = solve(&doc);
+
+        let mut warm = doc.clone();
+        assert_eq!(seed(&mut warm, &first), 2);
+        match &warm.entities[2] {
+            Entity::Point2D { at, .. } => {
+                let uv = at
+                    .iter()
+                    .map(ExprOrNumber::as_f64)
+                    .collect::<Option<Vec<_>>>()
+                    .unwrap();
+                assert!((uv[0] - 40.0).abs() < 1e-6 && uv[1].abs() < 1e-6);
+            }
+            _ => panic!("b should be a 2D point"),
+        }
+        // Nothing moves further than the first solve's tolerance
+        let again = solve(&warm);
+        for id in ["a", "b", "c"] {
+            for (x, y) in point(&first, id).iter().zip(point(&again, id)) {
+                assert!((x - y).abs() < 1e-5, "{} moved", id);
+            }
+        }
+    }
+}
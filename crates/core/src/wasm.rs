@@ -4,6 +4,7 @@
 //! and Node.js environments.
 
 use crate::{
+    compiled::{CompiledSystem, Progress},
     solver::{Solver, SolverConfig},
     InputDocument, SolveResult,
 };
@@ -55,6 +56,23 @@ impl WasmSolver {
             .map_err(|e| JsValue::from_str(&format!("Serialization error: {}", e)))
     }
 
+    /// Solve a constraint system given as MessagePack bytes (see
+    /// `crate::wire`), returning the result as MessagePack, for callers
+    /// that would rather not build and parse JSON strings
+    #[wasm_bindgen]
+    pub fn solve_msgpack(&self, input: &[u8]) -> Result<Vec<u8>, JsValue> {
+        let doc: InputDocument = crate::wire::from_msgpack(input)
+            .map_err(|e| JsValue::from_str(&format!("Invalid MessagePack: {}", e)))?;
+
+        let result = self
+            .solver
+            .solve(&doc)
+            .map_err(|e| JsValue::from_str(&format!("Solve error: {}", e)))?;
+
+        crate::wire::to_msgpack(&result)
+            .map_err(|e| JsValue::from_str(&format!("Serialization error: {}", e)))
+    }
+
     /// Validate a constraint document without solving
     #[wasm_bindgen]
     pub fn validate(&self, json_str: &str) -> Result<bool, JsValue> {
@@ -72,11 +90,120 @@ impl WasmSolver {
 
     /// Get the JSON schema for constraint documents
     #[wasm_bindgen]
+    ///
+    /// Generated from the document types once, on the first call
     pub fn get_schema() -> String {
         use schemars::schema_for;
+        use std::sync::OnceLock;
+
+        static SCHEMA: OnceLock<String> = OnceLock::new();
+        SCHEMA
+            .get_or_init(|| {
+                let schema = schema_for!(InputDocument);
+                serde_json::to_string_pretty(&schema).unwrap_or_else(|_| "{}".to_string())
+            })
+            .clone()
+    }
+}
+
+/// A JS function for `CompiledSystem::on_progress`, which wants one it can
+/// call from any thread; a wasm module has just the one
+#[cfg(feature = "wasm")]
+struct OnModuleThread(js_sys::Function);
+
+#[cfg(feature = "wasm")]
+unsafe impl Send for OnModuleThread {}
+
+#[cfg(feature = "wasm")]
+impl OnModuleThread {
+    fn call(&self, step: Progress) {
+        let (iterations, residual) = (JsValue::from(step.iterations), JsValue::from(step.residual));
+        let _ = self.0.call2(&JsValue::NULL, &iterations, &residual);
+    }
+}
+
+/// A document compiled once and kept, to solve again and again as its
+/// parameters change and its points are dragged, without any JSON
+#[cfg(feature = "wasm")]
+#[wasm_bindgen]
+pub struct WasmSystem {
+    system: CompiledSystem,
+    /// The last solve's positions, which `solve` hands out a view of
+    positions: Vec<f64>,
+}
+
+#[cfg(feature = "wasm")]
+#[wasm_bindgen]
+impl WasmSystem {
+    /// Validate and compile a constraint document given as JSON
+    #[wasm_bindgen(constructor)]
+    pub fn new(json_str: &str) -> Result<WasmSystem, JsValue> {
+        let doc: InputDocument = serde_json::from_str(json_str)
+            .map_err(|e| JsValue::from_str(&format!("Invalid JSON: {}", e)))?;
+        crate::validator::Validator::new()
+            .validate(&doc)
+            .map_err(|e| JsValue::from_str(&format!("Validation error: {}", e)))?;
+        let system = Solver::new(SolverConfig::default())
+            .compile(&doc)
+            .map_err(|e| JsValue::from_str(&format!("Solve error: {}", e)))?;
+        Ok(Self {
+            system,
+            positions: Vec::new(),
+        })
+    }
 
-        let schema = schema_for!(InputDocument);
-        serde_json::to_string_pretty(&schema).unwrap_or_else(|_| "{}".to_string())
+    /// The entities' ids, in the order `solve` lays out their positions
+    #[wasm_bindgen(js_name = entityIds)]
+    pub fn entity_ids(&self) -> js_sys::Array {
+        self.system
+            .document()
+            .entities
+            .iter()
+            .map(|e| JsValue::from_str(e.id()))
+            .collect()
+    }
+
+    /// Set one of the document's parameters, for the next solve
+    #[wasm_bindgen(js_name = setParameter)]
+    pub fn set_parameter(&mut self, name: &str, value: f64) -> Result<(), JsValue> {
+        self.system
+            .set_parameter(name, value)
+            .map_err(|e| JsValue::from_str(&e.to_string()))
+    }
+
+    /// Drag a point towards (x, y, z), or (u, v) in its workplane, for the
+    /// next solve to keep it as near there as the constraints allow
+    #[wasm_bindgen(js_name = setPointTarget)]
+    pub fn set_point_target(&mut self, id: &str, x: f64, y: f64, z: f64) -> Result<(), JsValue> {
+        self.system
+            .drag(id, &[x, y, z])
+            .map_err(|e| JsValue::from_str(&e.to_string()))
+    }
+
+    /// Have `f(iterations, residual)` called after each Newton step of each
+    /// solve from now on, or stop with null, to show a long solve's progress
+    /// as it goes. It's called in the middle of `solve`, so it mustn't call
+    /// back into this system.
+    #[wasm_bindgen(js_name = onProgress)]
+    pub fn on_progress(&mut self, f: Option<js_sys::Function>) {
+        self.system.on_progress(f.map(|f| {
+            let f = OnModuleThread(f);
+            Box::new(move |step: Progress| f.call(step)) as crate::compiled::ProgressFn
+        }));
+    }
+
+    /// Solve from the last solution, returning four values per entity in
+    /// `entityIds` order: `[x, y, z, 0]` for a point, `[cx, cy, cz, radius]`
+    /// for a circle, NaNs for the rest. The array is a view of the module's
+    /// memory, good until the next call into the module; copy it to keep it.
+    #[wasm_bindgen]
+    pub fn solve(&mut self) -> Result<js_sys::Float64Array, JsValue> {
+        self.system
+            .resolve_positions(&mut self.positions)
+            .map_err(|e| JsValue::from_str(&format!("Solve error: {}", e)))?;
+        // Safety: nothing allocates between here and the caller taking the
+        // view, and the caller is told not to keep it past its next call
+        Ok(unsafe { js_sys::Float64Array::view(&self.positions) })
     }
 }
 
@@ -136,6 +263,15 @@ const TS_TYPES: &'static str = r#"
  * 
  * // Option 2: Use direct function
  * const result = solve_constraints(constraintJson);
+ *
+ * // Or, with MessagePack bytes in and out (a Uint8Array each way)
+ * const packed = solver.solve_msgpack(constraintMsgpack);
+ *
+ * // Or compile once and solve again as a point is dragged
+ * const system = new WasmSystem(constraintJson);
+ * const ids = system.entityIds();
+ * system.setPointTarget("p2", mouseX, mouseY, 0);
+ * const positions = system.solve(); // Float64Array, 4 values per entity
  * ```
  */
 export interface ConstraintDocument {
@@ -153,8 +289,53 @@ export interface SolveResult {
     residual: number;
     dof: number;
     time_ms: number;
+    equations: number;
+    unknowns: number;
+    jacobian_nnz: number;
+    phases: {
+      write_equations_ms: number;
+      substitute_ms: number;
+      alone_ms: number;
+      write_jacobian_ms: number;
+      eval_jacobian_ms: number;
+      factor_ms: number;
+      rank_test_ms: number;
+      find_bad_ms: number;
+    };
+    layers: {
+      build_ms: number;
+      native_ms: number;
+      read_back_ms: number;
+    };
+    memory: {
+      exprs_allocated: number;
+      temporary_bytes: number;
+      temporary_peak_bytes: number;
+      source_nodes: number;
+      folded_nodes: number;
+      partial_nodes: number;
+      jacobian_entries: number;
+      heaviest_constraint?: string;
+      heaviest_constraint_exprs: number;
+    };
   };
   entities?: Record<string, ResolvedEntity>;
   warnings: string[];
+  sensitivities?: Record<string, Record<string, [number, number, number]>>;
+  profile?: Array<{
+    pointer: string;
+    type: string;
+    expr_nodes: number;
+    jacobian_nnz: number;
+    eval_ms: number;
+    iterations_above_tolerance: number;
+  }>;
+  interference?: Array<{ a: string; b: string; depth: number }>;
+  mass?: {
+    volume: number;
+    area: number;
+    centroid: [number, number, number];
+    inertia: [[number, number, number], [number, number, number], [number, number, number]];
+  };
 }
 "#;
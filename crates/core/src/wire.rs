@@ -0,0 +1,390 @@
+//! Wire formats for documents and results: JSON, or the same data model in
+//! MessagePack, for callers that would rather not format and parse text.
+//!
+//! The MessagePack encoding is of exactly what the JSON would be, so the
+//! JSON schema in `schema/` describes it too, and a document carries its
+//! schema version in its `schema` field either way. Maps are keyed by
+//! strings; numbers that are floats in the JSON are always float 64, and
+//! integers are as small as they fit. The one exception is a block of
+//! floats added by `WireFormat::encode_with_f64s`, which MessagePack carries
+//! as raw bytes; it's only ever written, never read.
+
+use crate::error::{Error, Result};
+use serde::{de::DeserializeOwned, Serialize};
+use serde_json::{Map, Number, Value};
+
+/// How a document or result is encoded
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum WireFormat {
+    #[default]
+    Json,
+    Msgpack,
+}
+
+impl WireFormat {
+    pub fn encode<T: Serialize>(self, value: &T) -> Result<Vec<u8>> {
+        match self {
+            WireFormat::Json => Ok(serde_json::to_vec(value)?),
+            WireFormat::Msgpack => to_msgpack(value),
+        }
+    }
+
+    pub fn decode<T: DeserializeOwned>(self, bytes: &[u8]) -> Result<T> {
+        match self {
+            WireFormat::Json => Ok(serde_json::from_slice(bytes)?),
+            WireFormat::Msgpack => from_msgpack(bytes),
+        }
+    }
+
+    /// Encode `value`, which must encode as a map, with one more entry:
+    /// `key`, holding `values`. In MessagePack that's a bin of the values as
+    /// little-endian float 64s, for a caller to read as one array rather
+    /// than number by number; in JSON it's an array, with null for NaN.
+    pub fn encode_with_f64s<T: Serialize>(
+        self,
+        value: &T,
+        key: &str,
+        values: &[f64],
+    ) -> Result<Vec<u8>> {
+        let Value::Object(mut map) = serde_json::to_value(value)? else {
+            return Err(invalid(format!(
+                "Can't add '{}' to a value that isn't a map",
+                key
+            )));
+        };
+        match self {
+            WireFormat::Json => {
+                let number = |&v: &f64| Number::from_f64(v).map_or(Value::Null, Value::Number);
+                map.insert(key.to_string(), values.iter().map(number).collect());
+                Ok(serde_json::to_vec(&map)?)
+            }
+            WireFormat::Msgpack => {
+                map.remove(key);
+                let mut out = Vec::with_capacity(256 + values.len() * 8);
+                encode_len(map.len() + 1, 0x80, 16, [0, 0xde, 0xdf], &mut out);
+                for (key, item) in &map {
+                    encode_len(key.len(), 0xa0, 32, [0xd9, 0xda, 0xdb], &mut out);
+                    out.extend_from_slice(key.as_bytes());
+                    encode(item, &mut out);
+                }
+                encode_len(key.len(), 0xa0, 32, [0xd9, 0xda, 0xdb], &mut out);
+                out.extend_from_slice(key.as_bytes());
+                encode_len(values.len() * 8, 0, 0, [0xc4, 0xc5, 0xc6], &mut out);
+                for v in values {
+                    out.extend_from_slice(&v.to_le_bytes());
+                }
+                Ok(out)
+            }
+        }
+    }
+}
+
+/// Nesting deeper than this is refused, as serde_json refuses it
+const MAX_DEPTH: usize = 128;
+
+fn invalid(message: String) -> Error {
+    Error::InvalidInput {
+        message,
+        pointer: None,
+    }
+}
+
+pub fn to_msgpack<T: Serialize>(value: &T) -> Result<Vec<u8>> {
+    let value = serde_json::to_value(value)?;
+    let mut out = Vec::with_capacity(256);
+    encode(&value, &mut out);
+    Ok(out)
+}
+
+pub fn from_msgpack<T: DeserializeOwned>(bytes: &[u8]) -> Result<T> {
+    let mut reader = Reader { bytes, at: 0 };
+    let value = reader.value(0)?;
+    if reader.at != bytes.len() {
+        return Err(invalid(format!(
+            "MessagePack has {} bytes left over after its value",
+            bytes.len() - reader.at
+        )));
+    }
+    Ok(serde_json::from_value(value)?)
+}
+
+fn encode(value: &Value, out: &mut Vec<u8>) {
+    match value {
+        Value::Null => out.push(0xc0),
+        Value::Bool(b) => out.push(if *b { 0xc3 } else { 0xc2 }),
+        Value::Number(n) => {
+            if let (false, Some(u)) = (n.is_f64(), n.as_u64()) {
+                encode_uint(u, out);
+            } else if let (false, Some(i)) = (n.is_f64(), n.as_i64()) {
+                encode_int(i, out);
+            } else {
+                out.push(0xcb);
+                out.extend_from_slice(&n.as_f64().unwrap_or(0.0).to_be_bytes());
+            }
+        }
+        Value::String(s) => {
+            encode_len(s.len(), 0xa0, 32, [0xd9, 0xda, 0xdb], out);
+            out.extend_from_slice(s.as_bytes());
+        }
+        Value::Array(items) => {
+            encode_len(items.len(), 0x90, 16, [0, 0xdc, 0xdd], out);
+            for item in items {
+                encode(item, out);
+            }
+        }
+        Value::Object(map) => {
+            encode_len(map.len(), 0x80, 16, [0, 0xde, 0xdf], out);
+            for (key, item) in map {
+                encode_len(key.len(), 0xa0, 32, [0xd9, 0xda, 0xdb], out);
+                out.extend_from_slice(key.as_bytes());
+                encode(item, out);
+            }
+        }
+    }
+}
+
+/// A length in the fix form below `fix_max`, or after the 8, 16 or 32 bit
+/// marker (0 for none)
+fn encode_len(len: usize, fix: u8, fix_max: usize, markers: [u8; 3], out: &mut Vec<u8>) {
+    if len < fix_max {
+        out.push(fix | len as u8);
+    } else if markers[0] != 0 && len <= u8::MAX as usize {
+        out.extend_from_slice(&[markers[0], len as u8]);
+    } else if len <= u16::MAX as usize {
+        out.push(markers[1]);
+        out.extend_from_slice(&(len as u16).to_be_bytes());
+    } else {
+        out.push(markers[2]);
+        out.extend_from_slice(&(len as u32).to_be_bytes());
+    }
+}
+
+fn encode_uint(u: u64, out: &mut Vec<u8>) {
+    if u < 0x80 {
+        out.push(u as u8);
+    } else if u <= u8::MAX as u64 {
+        out.extend_from_slice(&[0xcc, u as u8]);
+    } else if u <= u16::MAX as u64 {
+        out.push(0xcd);
+        out.extend_from_slice(&(u as u16).to_be_bytes());
+    } else if u <= u32::MAX as u64 {
+        out.push(0xce);
+        out.extend_from_slice(&(u as u32).to_be_bytes());
+    } else {
+        out.push(0xcf);
+        out.extend_from_slice(&u.to_be_bytes());
+    }
+}
+
+fn encode_int(i: i64, out: &mut Vec<u8>) {
+    if i >= 0 {
+        encode_uint(i as u64, out);
+    } else if i >= -32 {
+        out.push(i as i8 as u8);
+    } else if i >= i8::MIN as i64 {
+        out.extend_from_slice(&[0xd0, i as i8 as u8]);
+    } else if i >= i16::MIN as i64 {
+        out.push(0xd1);
+        out.extend_from_slice(&(i as i16).to_be_bytes());
+    } else if i >= i32::MIN as i64 {
+        out.push(0xd2);
+        out.extend_from_slice(&(i as i32).to_be_bytes());
+    } else {
+        out.push(0xd3);
+        out.extend_from_slice(&i.to_be_bytes());
+    }
+}
+
+struct Reader<'a> {
+    bytes: &'a [u8],
+    at: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, n: usize) -> Result<&'a [u8]> {
+        let end = self
+            .at
+            .checked_add(n)
+            .filter(|&end| end <= self.bytes.len());
+        let end =
+            end.ok_or_else(|| invalid("MessagePack ends in the middle of a value".to_string()))?;
+        let taken = &self.bytes[self.at..end];
+        self.at = end;
+        Ok(taken)
+    }
+
+    fn array<const N: usize>(&mut self) -> Result<[u8; N]> {
+        let mut a = [0; N];
+        a.copy_from_slice(self.take(N)?);
+        Ok(a)
+    }
+
+    fn len(&mut self, marker: u8, fix_mask: u8, wide: [u8; 3]) -> Result<usize> {
+        Ok(match marker {
+            m if m == wide[0] => self.array::<1>()?[0] as usize,
+            m if m == wide[1] => u16::from_be_bytes(self.array()?) as usize,
+            m if m == wide[2] => u32::from_be_bytes(self.array()?) as usize,
+            m => (m & fix_mask) as usize,
+        })
+    }
+
+    fn string(&mut self, len: usize) -> Result<String> {
+        let bytes = self.take(len)?;
+        std::str::from_utf8(bytes)
+            .map(str::to_owned)
+            .map_err(|_| invalid("MessagePack string isn't UTF-8".to_string()))
+    }
+
+    fn value(&mut self, depth: usize) -> Result<Value> {
+        if depth > MAX_DEPTH {
+            return Err(invalid("MessagePack nests too deeply".to_string()));
+        }
+        let marker = self.array::<1>()?[0];
+        let float = |f: f64| {
+            Number::from_f64(f)
+                .map(Value::Number)
+                .ok_or_else(|| invalid(format!("{} isn't a number JSON can hold", f)))
+        };
+        Ok(match marker {
+            0x00..=0x7f => Value::from(marker),
+            0xe0..=0xff => Value::from(marker as i8),
+            0xc0 => Value::Null,
+            0xc2 => Value::Bool(false),
+            0xc3 => Value::Bool(true),
+            0xcc => Value::from(self.array::<1>()?[0]),
+            0xcd => Value::from(u16::from_be_bytes(self.array()?)),
+            0xce => Value::from(u32::from_be_bytes(self.array()?)),
+            0xcf => Value::from(u64::from_be_bytes(self.array()?)),
+            0xd0 => Value::from(self.array::<1>()?[0] as i8),
+            0xd1 => Value::from(i16::from_be_bytes(self.array()?)),
+            0xd2 => Value::from(i32::from_be_bytes(self.array()?)),
+            0xd3 => Value::from(i64::from_be_bytes(self.array()?)),
+            0xca => float(f32::from_be_bytes(self.array()?) as f64)?,
+            0xcb => float(f64::from_be_bytes(self.array()?))?,
+            0xa0..=0xbf | 0xd9 | 0xda | 0xdb => {
+                let len = self.len(marker, 0x1f, [0xd9, 0xda, 0xdb])?;
+                Value::String(self.string(len)?)
+            }
+            0x90..=0x9f | 0xdc | 0xdd => {
+                let len = self.len(marker, 0x0f, [0, 0xdc, 0xdd])?;
+                // Every item takes at least a byte, so a length can't ask
+                // for more room than there's input
+                let mut items = Vec::with_capacity(len.min(self.bytes.len() - self.at));
+                for _ in 0..len {
+                    items.push(self.value(depth + 1)?);
+                }
+                Value::Array(items)
+            }
+            0x80..=0x8f | 0xde | 0xdf => {
+                let len = self.len(marker, 0x0f, [0, 0xde, 0xdf])?;
+                let mut map = Map::new();
+                for _ in 0..len {
+                    let key = match self.value(depth + 1)? {
+                        Value::String(key) => key,
+                        other => {
+                            let message = format!("MessagePack map key {} isn't a string", other);
+                            return Err(invalid(message));
+                        }
+                    };
+                    let item = self.value(depth + 1)?;
+                    map.insert(key, item);
+                }
+                Value::Object(map)
+            }
+            other => {
+                return Err(invalid(format!(
+                    "MessagePack type 0x{:02x} (binary or extension) isn't supported",
+                    other
+                )))
+            }
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+
+    #[test]
+    fn test_msgpack_round_trips_json_values() {
+        let value = json!({
+            "schema": "slvs-json/1",
+            "small": [0, 127, 128, 255, 256, 65536, 4294967296u64],
+            "negative": [-1, -32, -33, -200, -40000, -3000000000i64],
+            "floats": [0.5, 1.0, -2.25, 1e300],
+            "text": ["", "x".repeat(31), "y".repeat(40), "z".repeat(300)],
+            "nested": {"a": null, "b": true, "c": false, "d": [[], {}]},
+            "long": (0..70000).collect::<Vec<u32>>()
+        });
+        let bytes = to_msgpack(&value).unwrap();
+        let back: Value = from_msgpack(&bytes).unwrap();
+        assert_eq!(back, value);
+    }
+
+    #[test]
+    fn test_msgpack_encodes_known_bytes() {
+        assert_eq!(
+            to_msgpack(&json!({"a": [1, -1, 0.5]})).unwrap(),
+            vec![0x81, 0xa1, b'a', 0x93, 0x01, 0xff, 0xcb, 0x3f, 0xe0, 0, 0, 0, 0, 0, 0,]
+        );
+    }
+
+    #[test]
+    fn test_msgpack_document_solves_like_json() {
+        let doc = json!({
+            "schema": "slvs-json/1",
+            "entities": [{"type": "point", "id": "p1", "at": [1, "$x", 3]}],
+            "constraints": [{"type": "fixed", "entity": "p1"}],
+            "parameters": {"x": 2.0}
+        });
+        let from_json: crate::InputDocument = serde_json::from_value(doc.clone()).unwrap();
+        let bytes = WireFormat::Msgpack.encode(&doc).unwrap();
+        let from_msgpack: crate::InputDocument = WireFormat::Msgpack.decode(&bytes).unwrap();
+        assert_eq!(from_json, from_msgpack);
+    }
+
+    #[test]
+    fn test_f64s_are_packed_as_bytes() {
+        let value = json!({"id": 1, "ok": true});
+        let values = [1.5, -2.0, f64::NAN];
+        let bytes = WireFormat::Msgpack
+            .encode_with_f64s(&value, "xs", &values)
+            .unwrap();
+        let mut expected = to_msgpack(&value).unwrap();
+        expected[0] += 1;
+        expected.extend_from_slice(&[0xa2, b'x', b's', 0xc4, 24]);
+        for v in values {
+            expected.extend_from_slice(&v.to_le_bytes());
+        }
+        assert_eq!(bytes, expected);
+
+        let bytes = WireFormat::Json
+            .encode_with_f64s(&value, "xs", &values)
+            .unwrap();
+        let back: Value = serde_json::from_slice(&bytes).unwrap();
+        assert_eq!(back, json!({"id": 1, "ok": true, "xs": [1.5, -2.0, null]}));
+        assert!(WireFormat::Json
+            .encode_with_f64s(&json!([1]), "xs", &values)
+            .is_err());
+    }
+
+    #[test]
+    fn test_msgpack_rejects_bad_input() {
+        assert!(from_msgpack::<Value>(&[0x92, 0x01]).is_err(), "truncated");
+        assert!(
+            from_msgpack::<Value>(&[0x01, 0x02]).is_err(),
+            "trailing bytes"
+        );
+        assert!(
+            from_msgpack::<Value>(&[0x81, 0x01, 0x01]).is_err(),
+            "integer key"
+        );
+        assert!(from_msgpack::<Value>(&[0xc4, 0x00]).is_err(), "binary");
+        assert!(
+            from_msgpack::<Value>(&[0xdd, 0xff, 0xff, 0xff, 0xff]).is_err(),
+            "huge length"
+        );
+        assert!(from_msgpack::<Value>(&vec![0x91; 200]).is_err(), "too deep");
+    }
+}
@@ -0,0 +1,161 @@
+//! Tests that solving the same document again in a `SolveWorkspace`
+//! allocates nothing on the Rust side: the system isn't built again, and
+//! the result is updated where it is.
+//!
+//! Allocations are counted per thread, so tests running alongside on
+//! others don't count; what the native library allocates isn't counted.
+
+use slvsx_core::ir::{InputDocument, ResolvedEntity};
+use slvsx_core::solver::{SolveWorkspace, Solver, SolverConfig};
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+
+struct Counting;
+
+thread_local! {
+    static ALLOCATIONS: Cell<usize> = const { Cell::new(0) };
+}
+
+fn count() {
+    let _ = ALLOCATIONS.try_with(|n| n.set(n.get() + 1));
+}
+
+unsafe impl GlobalAlloc for Counting {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        count();
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        count();
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        count();
+        System.realloc(ptr, layout, new_size)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
+#[global_allocator]
+static ALLOCATOR: Counting = Counting;
+
+fn allocations() -> usize {
+    ALLOCATIONS.with(|n| n.get())
+}
+
+/// A triangle of points and lines, with a circle centred on one corner
+fn document() -> InputDocument {
+    serde_json::from_value(serde_json::json!({
+        "schema": "slvs-json/1",
+        "parameters": {"side": 30.0},
+        "entities": [
+            {"type": "point", "id": "a", "at": [0, 0, 0]},
+            {"type": "point", "id": "b", "at": [28, 1, 0]},
+            {"type": "point", "id": "c", "at": [14, 20, 0]},
+            {"type": "line", "id": "ab", "p1": "a", "p2": "b"},
+            {"type": "line", "id": "bc", "p1": "b", "p2": "c"},
+            {"type": "line", "id": "ca", "p1": "c", "p2": "a"},
+            {"type": "circle", "id": "k", "center": "c", "diameter": 8, "normal": [0, 0, 1]}
+        ],
+        "constraints": [
+            {"type": "fixed", "entity": "a"},
+            {"type": "distance", "between": ["a", "b"], "value": "$side"},
+            {"type": "distance", "between": ["b", "c"], "value": "$side"},
+            {"type": "distance", "between": ["c", "a"], "value": "$side"}
+        ]
+    }))
+    .unwrap()
+}
+
+/// Every coordinate of a resolved entity, in order
+fn coords(entity: &ResolvedEntity) -> Vec<f64> {
+    match entity {
+        ResolvedEntity::Point { at } => at.clone(),
+        ResolvedEntity::Circle {
+            center,
+            diameter,
+            normal,
+        } => [&center[..], std::slice::from_ref(diameter), &normal[..]].concat(),
+        ResolvedEntity::Line { p1, p2 } => [&p1[..], &p2[..]].concat(),
+        ResolvedEntity::Arc {
+            center,
+            start,
+            end,
+            normal,
+        } => [&center[..], &start[..], &end[..], &normal[..]].concat(),
+        ResolvedEntity::Cubic {
+            start,
+            control1,
+            control2,
+            end,
+        } => [&start[..], &control1[..], &control2[..], &end[..]].concat(),
+    }
+}
+
+#[test]
+fn test_second_solve_in_workspace_allocates_nothing() {
+    let doc = document();
+    let solver = Solver::new(SolverConfig::default());
+    let mut workspace = SolveWorkspace::new();
+
+    solver.solve_in(&doc, &mut workspace).unwrap();
+    let before = allocations();
+    let result = solver.solve_in(&doc, &mut workspace).unwrap();
+    let made = allocations() - before;
+
+    assert_eq!(made, 0, "the second solve allocated {} times", made);
+    assert_eq!(result.status, "ok");
+    assert_eq!(result.entities.as_ref().unwrap().len(), doc.entities.len());
+}
+
+#[test]
+fn test_workspace_solves_as_solve_does() {
+    let doc = document();
+    let solver = Solver::new(SolverConfig::default());
+    let expected = solver.solve(&doc).unwrap();
+    let mut workspace = SolveWorkspace::new();
+
+    let expected = expected.entities.unwrap();
+    for _ in 0..3 {
+        let result = solver.solve_in(&doc, &mut workspace).unwrap();
+        let entities = result.entities.as_ref().unwrap();
+        assert_eq!(entities.len(), expected.len());
+        for (id, entity) in &expected {
+            let (a, b) = (coords(entity), coords(&entities[id]));
+            assert!(
+                a.iter().zip(&b).all(|(a, b)| (a - b).abs() < 1e-9),
+                "{} moved",
+                id
+            );
+        }
+    }
+}
+
+#[test]
+fn test_workspace_takes_on_another_document() {
+    let solver = Solver::new(SolverConfig::default());
+    let mut workspace = SolveWorkspace::new();
+    let doc = document();
+    solver.solve_in(&doc, &mut workspace).unwrap();
+
+    let mut smaller = doc.clone();
+    smaller.parameters.insert("side".to_string(), 20.0);
+    smaller.entities.truncate(4);
+    smaller.constraints.truncate(2);
+    let result = solver.solve_in(&smaller, &mut workspace).unwrap();
+
+    let entities = result.entities.as_ref().unwrap();
+    assert_eq!(entities.len(), 4);
+    match &entities["b"] {
+        ResolvedEntity::Point { at } => {
+            let length = (at[0] * at[0] + at[1] * at[1] + at[2] * at[2]).sqrt();
+            assert!((length - 20.0).abs() < 1e-6, "b is {} from a", length);
+        }
+        other => panic!("b isn't a point: {:?}", other),
+    }
+}
@@ -30,6 +30,9 @@ fn test_error_mapping_with_iterations(ffi_error: FfiError, expected_error: Error
             assert_eq!(a, b);
         }
         (Error::InvalidSystem, Error::InvalidSystem) => {}
+        (Error::TooManyUnknowns, Error::TooManyUnknowns) => {}
+        (Error::TimedOut, Error::TimedOut) => {}
+        (Error::ResourceExhausted, Error::ResourceExhausted) => {}
         _ => panic!("Error types don't match: {:?} vs {:?}", mapped, expected_error),
     }
 }
@@ -61,7 +64,17 @@ fn test_ffi_error_mapping_didnt_converge_custom_iterations() {
 
 #[test]
 fn test_ffi_error_mapping_too_many_unknowns() {
-    test_error_mapping(FfiError::TooManyUnknowns, Error::Underconstrained { dof: 0 });
+    test_error_mapping(FfiError::TooManyUnknowns, Error::TooManyUnknowns);
+}
+
+#[test]
+fn test_ffi_error_mapping_timed_out() {
+    test_error_mapping(FfiError::TimedOut, Error::TimedOut);
+}
+
+#[test]
+fn test_ffi_error_mapping_resource_exhausted() {
+    test_error_mapping(FfiError::ResourceExhausted, Error::ResourceExhausted);
 }
 
 #[test]
@@ -157,14 +170,14 @@ mod property_tests {
             }
         }
 
-        /// Property: Underconstrained errors should not be affected by max_iterations
+        /// Property: TooManyUnknowns errors should not be affected by max_iterations
         #[test]
-        fn underconstrained_error_independent_of_iterations(max_iterations in 1u32..=100_000) {
+        fn too_many_unknowns_error_independent_of_iterations(max_iterations in 1u32..=100_000) {
             let error = Solver::map_ffi_error(FfiError::TooManyUnknowns, max_iterations);
 
             match error {
-                Error::Underconstrained { dof: 0 } => {} // Expected
-                _ => prop_assert!(false, "TooManyUnknowns should always map to Underconstrained with dof 0"),
+                Error::TooManyUnknowns => {} // Expected
+                _ => prop_assert!(false, "TooManyUnknowns should always map to TooManyUnknowns"),
             }
         }
 
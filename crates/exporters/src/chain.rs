@@ -0,0 +1,251 @@
+//! Lines that meet end to end, chained into polylines for vector export as
+//! SolveSpace's `SEdgeList::AssemblePolygon` chains edges, with each run of
+//! collinear segments merged into one as `MergeCollinearSegments` does. A
+//! closed profile of a hundred lines is written as one path.
+
+use crate::weld::{Welder, WELD_TOLERANCE};
+use slvsx_core::ir::ResolvedEntity;
+use std::collections::HashMap;
+
+/// Lines chained end to end, through points no third line meets
+#[derive(Debug, Clone, PartialEq)]
+pub struct Polyline<'a> {
+    /// The lines, in order along the chain
+    pub ids: Vec<&'a str>,
+    pub points: Vec<[f64; 3]>,
+    /// Whether the last point joins back to the first
+    pub closed: bool,
+}
+
+impl<'a> Polyline<'a> {
+    /// The least of the lines' ids, where the chain goes in id order
+    pub fn first_id(&self) -> &'a str {
+        self.ids.iter().copied().min().unwrap_or("")
+    }
+}
+
+/// The line entities chained, in the order of their least ids; a line no
+/// other meets is a chain of its own
+pub fn chain_lines(entities: &HashMap<String, ResolvedEntity>) -> Vec<Polyline<'_>> {
+    let mut lines: Vec<(&str, [f64; 3], [f64; 3])> = entities
+        .iter()
+        .filter_map(|(id, entity)| match entity {
+            ResolvedEntity::Line { p1, p2 } => Some((id.as_str(), point(p1), point(p2))),
+            _ => None,
+        })
+        .collect();
+    lines.sort_by_key(|(id, _, _)| *id);
+
+    let mut welder = Welder::new(WELD_TOLERANCE);
+    let ends: Vec<[u32; 2]> = lines
+        .iter()
+        .map(|(_, a, b)| [welder.index(*a), welder.index(*b)])
+        .collect();
+    let vertices = welder.into_vertices();
+    // The lines at each vertex; a line of no length meets none
+    let mut meeting = vec![Vec::new(); vertices.len()];
+    for (i, &[a, b]) in ends.iter().enumerate() {
+        if a != b {
+            meeting[a as usize].push(i);
+            meeting[b as usize].push(i);
+        }
+    }
+
+    let mut used = vec![false; lines.len()];
+    // From vertex v, the one other line that goes on if exactly two meet
+    // there, and the vertex at its far end
+    let step = |v: u32, used: &mut Vec<bool>| -> Option<(usize, u32)> {
+        let [x, y] = meeting[v as usize][..] else {
+            return None;
+        };
+        let next = if used[x] { y } else { x };
+        if used[next] {
+            return None;
+        }
+        used[next] = true;
+        let [a, b] = ends[next];
+        Some((next, if a == v { b } else { a }))
+    };
+
+    let mut chains = Vec::new();
+    for first in 0..lines.len() {
+        if used[first] {
+            continue;
+        }
+        used[first] = true;
+        let [a, b] = ends[first];
+        let (mut ahead, mut ahead_ids) = (vec![b], vec![first]);
+        let mut end = b;
+        let mut closed = false;
+        while a != b {
+            let Some((line, far)) = step(end, &mut used) else {
+                break;
+            };
+            ahead_ids.push(line);
+            if far == a {
+                closed = true;
+                break;
+            }
+            ahead.push(far);
+            end = far;
+        }
+        let (mut behind, mut behind_ids) = (vec![a], vec![]);
+        let mut start = a;
+        while !closed && a != b {
+            let Some((line, far)) = step(start, &mut used) else {
+                break;
+            };
+            behind_ids.push(line);
+            behind.push(far);
+            start = far;
+        }
+        behind.reverse();
+        behind_ids.reverse();
+        let points: Vec<[f64; 3]> = behind
+            .into_iter()
+            .chain(ahead)
+            .map(|v| vertices[v as usize])
+            .collect();
+        let ids = behind_ids
+            .into_iter()
+            .chain(ahead_ids)
+            .map(|i| lines[i].0)
+            .collect();
+        chains.push(Polyline {
+            ids,
+            points: merge_collinear(points, closed),
+            closed,
+        });
+    }
+    chains
+}
+
+/// Drop each point that lies on the segment between its neighbours
+fn merge_collinear(points: Vec<[f64; 3]>, closed: bool) -> Vec<[f64; 3]> {
+    let mut merged: Vec<[f64; 3]> = Vec::with_capacity(points.len());
+    for p in points {
+        while let [.., prev, mid] = merged[..] {
+            if !between(prev, mid, p) {
+                break;
+            }
+            merged.pop();
+        }
+        merged.push(p);
+    }
+    if closed {
+        // Around the seam, where the path starts and ends
+        while merged.len() > 3 {
+            let n = merged.len();
+            if between(merged[n - 1], merged[0], merged[1]) {
+                merged.remove(0);
+            } else if between(merged[n - 2], merged[n - 1], merged[0]) {
+                merged.pop();
+            } else {
+                break;
+            }
+        }
+    }
+    merged
+}
+
+/// Whether mid is on the segment from a to b, within the tolerance
+fn between(a: [f64; 3], mid: [f64; 3], b: [f64; 3]) -> bool {
+    let ab = sub(b, a);
+    let am = sub(mid, a);
+    let length = dot(ab, ab).sqrt();
+    if length <= WELD_TOLERANCE {
+        return false;
+    }
+    let off = cross(am, ab);
+    let along = dot(am, ab);
+    dot(off, off).sqrt() / length <= WELD_TOLERANCE && along > 0.0 && along < dot(ab, ab)
+}
+
+fn point(p: &[f64]) -> [f64; 3] {
+    [0, 1, 2].map(|i| p.get(i).copied().unwrap_or(0.0))
+}
+
+fn sub(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+}
+
+fn dot(a: [f64; 3], b: [f64; 3]) -> f64 {
+    a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+}
+
+fn cross(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0],
+    ]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn lines(segments: &[(&str, [f64; 2], [f64; 2])]) -> HashMap<String, ResolvedEntity> {
+        segments
+            .iter()
+            .map(|(id, a, b)| {
+                let line = ResolvedEntity::Line {
+                    p1: vec![a[0], a[1], 0.0],
+                    p2: vec![b[0], b[1], 0.0],
+                };
+                (id.to_string(), line)
+            })
+            .collect()
+    }
+
+    #[test]
+    fn test_closed_profile_chains_and_merges() {
+        // A square whose bottom edge is cut in two, drawn in no order and
+        // with one side backwards
+        let entities = lines(&[
+            ("a", [0.0, 0.0], [5.0, 0.0]),
+            ("d", [0.0, 10.0], [0.0, 0.0]),
+            ("b", [5.0, 0.0], [10.0, 0.0]),
+            ("c", [10.0, 10.0], [10.0, 0.0]),
+            ("e", [10.0, 10.0], [0.0, 10.0 + 1e-9]),
+        ]);
+        let chains = chain_lines(&entities);
+        assert_eq!(chains.len(), 1);
+        let chain = &chains[0];
+        assert!(chain.closed);
+        assert_eq!(chain.ids, ["a", "b", "c", "e", "d"]);
+        assert_eq!(chain.first_id(), "a");
+        // The cut in the bottom edge is merged away
+        assert_eq!(chain.points.len(), 4);
+        assert!(!chain.points.contains(&[5.0, 0.0, 0.0]));
+    }
+
+    #[test]
+    fn test_open_chain_stops_at_junctions() {
+        // Three lines meeting at the origin, one of which goes on
+        let entities = lines(&[
+            ("l1", [0.0, 0.0], [1.0, 0.0]),
+            ("l2", [0.0, 0.0], [0.0, 1.0]),
+            ("l3", [0.0, 0.0], [-1.0, -1.0]),
+            ("l4", [0.0, 1.0], [1.0, 2.0]),
+        ]);
+        let chains = chain_lines(&entities);
+        let ids: Vec<_> = chains.iter().map(|c| c.ids.clone()).collect();
+        assert_eq!(ids, vec![vec!["l1"], vec!["l2", "l4"], vec!["l3"]]);
+        assert!(chains.iter().all(|c| !c.closed));
+        assert_eq!(
+            chains[1].points,
+            vec![[0.0, 0.0, 0.0], [0.0, 1.0, 0.0], [1.0, 2.0, 0.0]]
+        );
+    }
+
+    #[test]
+    fn test_collinear_but_doubling_back_is_kept() {
+        let entities = lines(&[
+            ("a", [0.0, 0.0], [10.0, 0.0]),
+            ("b", [10.0, 0.0], [4.0, 0.0]),
+        ]);
+        let chains = chain_lines(&entities);
+        assert_eq!(chains[0].points.len(), 3);
+    }
+}
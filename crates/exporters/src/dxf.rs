@@ -1,13 +1,19 @@
+use crate::chain::{chain_lines, Polyline};
 use slvsx_core::ir::ResolvedEntity;
 use std::collections::HashMap;
+use std::io::Write;
 
 pub struct DxfExporter {
     precision: usize,
+    chain: bool,
 }
 
 impl Default for DxfExporter {
     fn default() -> Self {
-        Self { precision: 6 }
+        Self {
+            precision: 6,
+            chain: true,
+        }
     }
 }
 
@@ -16,42 +22,62 @@ impl DxfExporter {
         Self::default()
     }
 
+    /// Whether lines that meet end to end are written as one POLYLINE, as
+    /// they are by default, or each as a LINE
+    pub fn with_chaining(mut self, chain: bool) -> Self {
+        self.chain = chain;
+        self
+    }
+
     pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String> {
-        let mut dxf = String::new();
+        crate::Exporter::export(self, entities)
+    }
+}
 
+impl crate::StreamExporter for DxfExporter {
+    fn write_to(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()> {
         // DXF header
-        dxf.push_str("0\nSECTION\n2\nHEADER\n0\nENDSEC\n");
+        out.write_all(b"0\nSECTION\n2\nHEADER\n0\nENDSEC\n")?;
 
         // Entities section
-        dxf.push_str("0\nSECTION\n2\nENTITIES\n");
+        out.write_all(b"0\nSECTION\n2\nENTITIES\n")?;
 
         for (_id, entity) in entities {
             match entity {
                 ResolvedEntity::Point { at } => {
                     // DXF POINT entity
-                    dxf.push_str(&format!(
-                        "0\nPOINT\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n",
+                    writeln!(
+                        out,
+                        "0\nPOINT\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}",
                         at.get(0).copied().unwrap_or(0.0),
                         at.get(1).copied().unwrap_or(0.0),
                         at.get(2).copied().unwrap_or(0.0),
                         p = self.precision
-                    ));
+                    )?;
                 }
                 ResolvedEntity::Circle { center, diameter, .. } => {
                     // DXF CIRCLE entity
-                    dxf.push_str(&format!(
-                        "0\nCIRCLE\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n40\n{:.p$}\n",
+                    writeln!(
+                        out,
+                        "0\nCIRCLE\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n40\n{:.p$}",
                         center.get(0).copied().unwrap_or(0.0),
                         center.get(1).copied().unwrap_or(0.0),
                         center.get(2).copied().unwrap_or(0.0),
                         diameter / 2.0,
                         p = self.precision
-                    ));
+                    )?;
                 }
+                // Written as chains after the rest
+                ResolvedEntity::Line { .. } if self.chain => {}
                 ResolvedEntity::Line { p1, p2 } => {
                     // DXF LINE entity
-                    dxf.push_str(&format!(
-                        "0\nLINE\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n11\n{:.p$}\n21\n{:.p$}\n31\n{:.p$}\n",
+                    writeln!(
+                        out,
+                        "0\nLINE\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n11\n{:.p$}\n21\n{:.p$}\n31\n{:.p$}",
                         p1.get(0).copied().unwrap_or(0.0),
                         p1.get(1).copied().unwrap_or(0.0),
                         p1.get(2).copied().unwrap_or(0.0),
@@ -59,7 +85,7 @@ impl DxfExporter {
                         p2.get(1).copied().unwrap_or(0.0),
                         p2.get(2).copied().unwrap_or(0.0),
                         p = self.precision
-                    ));
+                    )?;
                 }
                 ResolvedEntity::Arc { center, start, end, .. } => {
                     // DXF ARC entity
@@ -78,31 +104,81 @@ impl DxfExporter {
                     let start_angle = (sy - cy).atan2(sx - cx).to_degrees();
                     let end_angle = (ey - cy).atan2(ex - cx).to_degrees();
                     
-                    dxf.push_str(&format!(
-                        "0\nARC\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n40\n{:.p$}\n50\n{:.p$}\n51\n{:.p$}\n",
+                    writeln!(
+                        out,
+                        "0\nARC\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n40\n{:.p$}\n50\n{:.p$}\n51\n{:.p$}",
                         cx, cy, cz, radius, start_angle, end_angle,
                         p = self.precision
-                    ));
+                    )?;
                 }
                 ResolvedEntity::Cubic { start, control1, control2, end } => {
-                    // DXF doesn't have native cubic bezier support, approximate with polyline
-                    // For now, just draw a line from start to end (simplified)
-                    dxf.push_str(&format!(
-                        "0\nLINE\n8\n0\n10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}\n11\n{:.p$}\n21\n{:.p$}\n31\n{:.p$}\n",
-                        start.get(0).copied().unwrap_or(0.0),
-                        start.get(1).copied().unwrap_or(0.0),
-                        start.get(2).copied().unwrap_or(0.0),
-                        end.get(0).copied().unwrap_or(0.0),
-                        end.get(1).copied().unwrap_or(0.0),
-                        end.get(2).copied().unwrap_or(0.0),
-                        p = self.precision
-                    ));
+                    // DXF SPLINE entity: the Bezier exactly, as a cubic
+                    // B-spline on one span, with the knots SolveSpace's own
+                    // DXF export gives it
+                    out.write_all(b"0\nSPLINE\n8\n0\n70\n8\n71\n3\n72\n8\n73\n4\n74\n0\n")?;
+                    for knot in [0, 0, 0, 0, 1, 1, 1, 1] {
+                        writeln!(out, "40\n{}", knot)?;
+                    }
+                    for point in [start, control1, control2, end] {
+                        writeln!(
+                            out,
+                            "10\n{:.p$}\n20\n{:.p$}\n30\n{:.p$}",
+                            point.get(0).copied().unwrap_or(0.0),
+                            point.get(1).copied().unwrap_or(0.0),
+                            point.get(2).copied().unwrap_or(0.0),
+                            p = self.precision
+                        )?;
+                    }
                 }
             }
         }
 
-        dxf.push_str("0\nENDSEC\n0\nEOF\n");
-        Ok(dxf)
+        if self.chain {
+            for chain in chain_lines(entities) {
+                self.write_chain(&chain, out)?;
+            }
+        }
+
+        out.write_all(b"0\nENDSEC\n0\nEOF\n")?;
+        Ok(())
+    }
+}
+
+impl DxfExporter {
+    fn write_point(&self, code: u32, p: [f64; 3], out: &mut dyn Write) -> anyhow::Result<()> {
+        writeln!(
+            out,
+            "{}\n{:.p$}\n{}\n{:.p$}\n{}\n{:.p$}",
+            code,
+            p[0],
+            code + 10,
+            p[1],
+            code + 20,
+            p[2],
+            p = self.precision
+        )?;
+        Ok(())
+    }
+
+    /// A line alone as a LINE; a longer chain as an R12 3D POLYLINE, its
+    /// points as VERTEX entities up to the SEQEND
+    fn write_chain(&self, chain: &Polyline, out: &mut dyn Write) -> anyhow::Result<()> {
+        if let ([_], [a, b]) = (&chain.ids[..], &chain.points[..]) {
+            out.write_all(b"0\nLINE\n8\n0\n")?;
+            self.write_point(10, *a, out)?;
+            return self.write_point(11, *b, out);
+        }
+        // Flags: 8 for a 3D polyline, 1 if it closes
+        let flags = if chain.closed { 9 } else { 8 };
+        writeln!(out, "0\nPOLYLINE\n8\n0\n66\n1\n70\n{}", flags)?;
+        self.write_point(10, [0.0; 3], out)?;
+        for &p in &chain.points {
+            out.write_all(b"0\nVERTEX\n8\n0\n")?;
+            self.write_point(10, p, out)?;
+            out.write_all(b"70\n32\n")?;
+        }
+        out.write_all(b"0\nSEQEND\n8\n0\n")?;
+        Ok(())
     }
 }
 
@@ -197,4 +273,70 @@ mod tests {
         assert!(dxf.contains("20\n0.000000")); // Missing coords default to 0
         assert!(dxf.contains("30\n0.000000"));
     }
+
+    #[test]
+    fn test_export_cubic_as_spline() {
+        let exporter = DxfExporter::new();
+        let mut entities = HashMap::new();
+        entities.insert(
+            "b1".to_string(),
+            ResolvedEntity::Cubic {
+                start: vec![0.0, 0.0, 0.0],
+                control1: vec![30.0, 50.0, 0.0],
+                control2: vec![70.0, 50.0, 0.0],
+                end: vec![100.0, 0.0, 0.0],
+            },
+        );
+
+        let dxf = exporter.export(&entities).unwrap();
+        assert!(dxf.contains("0\nSPLINE\n"));
+        assert!(!dxf.contains("0\nLINE\n"));
+        assert!(dxf.contains("71\n3\n72\n8\n73\n4\n"));
+        assert_eq!(dxf.matches("\n40\n").count(), 8);
+        // Every control point, in order
+        let at = |x: &str| dxf.find(&format!("10\n{}\n", x)).unwrap();
+        assert!(at("0.000000") < at("30.000000"));
+        assert!(at("30.000000") < at("70.000000"));
+        assert!(at("70.000000") < at("100.000000"));
+    }
+
+    fn square() -> HashMap<String, ResolvedEntity> {
+        let corners = [
+            [0.0, 0.0],
+            [5.0, 0.0],
+            [10.0, 0.0],
+            [10.0, 10.0],
+            [0.0, 10.0],
+        ];
+        (0..corners.len())
+            .map(|i| {
+                let (a, b) = (corners[i], corners[(i + 1) % corners.len()]);
+                let line = ResolvedEntity::Line {
+                    p1: vec![a[0], a[1], 0.0],
+                    p2: vec![b[0], b[1], 0.0],
+                };
+                (format!("l{}", i), line)
+            })
+            .collect()
+    }
+
+    #[test]
+    fn test_export_chained_polyline() {
+        let dxf = DxfExporter::new().export(&square()).unwrap();
+        assert!(!dxf.contains("0\nLINE\n"));
+        assert_eq!(dxf.matches("0\nPOLYLINE\n8\n0\n66\n1\n70\n9\n").count(), 1);
+        // The two collinear halves of the bottom edge are one segment
+        assert_eq!(dxf.matches("0\nVERTEX\n").count(), 4);
+        assert!(dxf.contains("0\nSEQEND\n"));
+    }
+
+    #[test]
+    fn test_export_unchained() {
+        let dxf = DxfExporter::new()
+            .with_chaining(false)
+            .export(&square())
+            .unwrap();
+        assert_eq!(dxf.matches("0\nLINE\n").count(), 5);
+        assert!(!dxf.contains("POLYLINE"));
+    }
 }
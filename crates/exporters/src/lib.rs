@@ -1,6 +1,12 @@
+pub mod chain;
+mod weld;
+
 #[cfg(feature = "svg")]
 pub mod svg;
 
+#[cfg(feature = "svg")]
+pub mod tiles;
+
 #[cfg(feature = "dxf")]
 pub mod dxf;
 
@@ -10,13 +16,49 @@ pub mod slvs;
 #[cfg(feature = "stl")]
 pub mod stl;
 
+#[cfg(feature = "stl")]
+pub mod mesh;
+
+#[cfg(feature = "stl")]
+pub mod simplify;
+
+#[cfg(feature = "obj")]
+pub mod obj;
+
+#[cfg(feature = "step")]
+pub mod step;
+
+#[cfg(feature = "png")]
+pub mod png;
+
 use slvsx_core::ir::ResolvedEntity;
 use std::collections::HashMap;
+use std::io::Write;
 
 pub trait Exporter {
     fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String>;
 }
 
+/// An exporter that writes its output as it makes it, so an export holds
+/// no more of it in memory than the writer does. Each number is formatted
+/// straight into the writer, in many small writes: give it a `BufWriter`
+/// around a file or socket.
+pub trait StreamExporter {
+    fn write_to(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()>;
+}
+
+impl<T: StreamExporter + ?Sized> Exporter for T {
+    fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String> {
+        let mut out = Vec::new();
+        self.write_to(entities, &mut out)?;
+        Ok(String::from_utf8(out)?)
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -28,5 +70,9 @@ mod tests {
             std::mem::size_of::<&dyn Exporter>(),
             std::mem::size_of::<[usize; 2]>()
         );
+        assert_eq!(
+            std::mem::size_of::<&dyn StreamExporter>(),
+            std::mem::size_of::<[usize; 2]>()
+        );
     }
 }
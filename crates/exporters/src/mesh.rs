@@ -0,0 +1,97 @@
+//! Triangles welded into an indexed mesh, as SolveSpace's `SKdNode` snaps
+//! a mesh's vertices together: vertices within the tolerance of one
+//! another become one, stored once and shared by every triangle on it.
+
+use crate::stl::Triangle;
+use crate::weld::Welder;
+pub use crate::weld::WELD_TOLERANCE;
+
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct IndexedMesh {
+    pub vertices: Vec<[f64; 3]>,
+    /// Each triangle's vertices, counterclockwise about its outward normal
+    pub faces: Vec<[u32; 3]>,
+}
+
+impl IndexedMesh {
+    /// Weld the triangles' vertices, dropping any triangle left with two
+    /// corners on one vertex
+    pub fn weld(triangles: &[Triangle], tolerance: f64) -> Self {
+        let mut welder = Welder::new(tolerance);
+        let mut faces = Vec::with_capacity(triangles.len());
+        for t in triangles {
+            let [a, b, c] = t.vertices.map(|v| welder.index(v));
+            if a != b && b != c && a != c {
+                faces.push([a, b, c]);
+            }
+        }
+        Self {
+            vertices: welder.into_vertices(),
+            faces,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::stl::StlExporter;
+    use slvsx_core::ir::ResolvedEntity;
+    use std::collections::HashMap;
+
+    fn triangle(vertices: [[f64; 3]; 3]) -> Triangle {
+        Triangle {
+            normal: [0.0, 0.0, 1.0],
+            vertices,
+        }
+    }
+
+    #[test]
+    fn test_weld_shares_vertices() {
+        let triangles = [
+            triangle([[0.0, 0.0, 0.0], [1.0, 0.0, 0.0], [1.0, 1.0, 0.0]]),
+            // Off from the first triangle's corners by less than the tolerance
+            triangle([[0.0, 0.0, 4e-7], [1.0, 1.0, 0.0], [0.0, 1.0 - 3e-7, 0.0]]),
+        ];
+        let mesh = IndexedMesh::weld(&triangles, WELD_TOLERANCE);
+        assert_eq!(mesh.vertices.len(), 4);
+        assert_eq!(mesh.faces, vec![[0, 1, 2], [0, 2, 3]]);
+    }
+
+    #[test]
+    fn test_weld_drops_collapsed_triangles() {
+        let sliver = triangle([[0.0, 0.0, 0.0], [1.0, 0.0, 0.0], [1.0, 1e-9, 0.0]]);
+        let mesh = IndexedMesh::weld(&[sliver], WELD_TOLERANCE);
+        assert!(mesh.faces.is_empty());
+    }
+
+    #[test]
+    fn test_cylinder_welds_closed() {
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![3.0, 4.0, 0.0],
+                diameter: 10.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let triangles = StlExporter::new(5.0).triangles(&entities);
+        let mesh = IndexedMesh::weld(&triangles, WELD_TOLERANCE);
+
+        // Two cap centers and two rims of 32
+        assert_eq!(mesh.vertices.len(), 66);
+        assert_eq!(mesh.faces.len(), triangles.len());
+
+        // Closed: every edge is used once each way
+        let mut edges = HashMap::new();
+        for f in &mesh.faces {
+            for k in 0..3 {
+                *edges.entry((f[k], f[(k + 1) % 3])).or_insert(0) += 1;
+            }
+        }
+        assert!(edges
+            .iter()
+            .all(|(&(a, b), &n)| n == 1 && edges.get(&(b, a)) == Some(&1)));
+    }
+}
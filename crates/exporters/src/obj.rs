@@ -0,0 +1,105 @@
+use crate::mesh::{IndexedMesh, WELD_TOLERANCE};
+use crate::stl::StlExporter;
+use slvsx_core::ir::ResolvedEntity;
+use std::collections::HashMap;
+use std::io::Write;
+
+/// Wavefront OBJ: the same solid as the STL export, welded into an
+/// indexed mesh so each vertex is written once
+pub struct ObjExporter {
+    solid: StlExporter,
+    precision: usize,
+}
+
+impl Default for ObjExporter {
+    fn default() -> Self {
+        Self::new(StlExporter::default())
+    }
+}
+
+impl ObjExporter {
+    /// Export the solid this STL exporter would tessellate
+    pub fn new(solid: StlExporter) -> Self {
+        Self {
+            solid,
+            precision: 6,
+        }
+    }
+
+    pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String> {
+        crate::Exporter::export(self, entities)
+    }
+
+    pub fn mesh(&self, entities: &HashMap<String, ResolvedEntity>) -> IndexedMesh {
+        IndexedMesh::weld(&self.solid.triangles(entities), WELD_TOLERANCE)
+    }
+}
+
+impl crate::StreamExporter for ObjExporter {
+    fn write_to(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()> {
+        let mesh = self.mesh(entities);
+        writeln!(
+            out,
+            "# slvsx: {} vertices, {} faces",
+            mesh.vertices.len(),
+            mesh.faces.len()
+        )?;
+        for v in &mesh.vertices {
+            writeln!(
+                out,
+                "v {:.p$} {:.p$} {:.p$}",
+                v[0],
+                v[1],
+                v[2],
+                p = self.precision
+            )?;
+        }
+        // OBJ counts vertices from 1
+        for [a, b, c] in &mesh.faces {
+            writeln!(out, "f {} {} {}", a + 1, b + 1, c + 1)?;
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_export_empty() {
+        let obj = ObjExporter::default().export(&HashMap::new()).unwrap();
+        assert_eq!(obj, "# slvsx: 0 vertices, 0 faces\n");
+    }
+
+    #[test]
+    fn test_export_cylinder() {
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c1".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![0.0, 0.0, 0.0],
+                diameter: 10.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let obj = ObjExporter::new(StlExporter::new(20.0))
+            .export(&entities)
+            .unwrap();
+        assert_eq!(obj.lines().filter(|l| l.starts_with("v ")).count(), 66);
+        assert_eq!(obj.lines().filter(|l| l.starts_with("f ")).count(), 128);
+        assert!(obj.contains("v 0.000000 0.000000 20.000000\n"));
+
+        // Every face names vertices that are there
+        for line in obj.lines().filter(|l| l.starts_with("f ")) {
+            for i in line[2..].split(' ') {
+                let i: usize = i.parse().unwrap();
+                assert!((1..=66).contains(&i));
+            }
+        }
+    }
+}
@@ -0,0 +1,952 @@
+use crate::stl::{bezier, point, Arc, StlExporter};
+use crate::svg::ViewPlane;
+use slvsx_core::ir::ResolvedEntity;
+use std::collections::HashMap;
+use std::f64::consts::PI;
+use std::io::Write;
+use std::thread;
+
+/// Rows in a tile; tiles are dealt out to the threads in turn, so a busy
+/// part of the drawing is shared among them
+const TILE_ROWS: usize = 32;
+/// The most a chord of a curve strays from it, in pixels
+const CHORD_PIXELS: f64 = 0.25;
+const MAX_SEGMENTS: usize = 4096;
+/// Room left around the drawing, as a share of the image
+const MARGIN: f64 = 0.04;
+
+const BACKGROUND: [u8; 3] = [255, 255, 255];
+const INK: [u8; 3] = [0, 0, 0];
+const FILL: [u8; 3] = [176, 196, 222];
+
+/// A preview of the sketch as a PNG, drawn straight from the solved
+/// geometry in the same view as the SVG export: no SVG is written, and
+/// nothing outside this crate is needed to rasterize it
+pub struct PngExporter {
+    view_plane: ViewPlane,
+    width: usize,
+    height: usize,
+    solid: Option<StlExporter>,
+    extent: Option<[f64; 4]>,
+}
+
+impl Default for PngExporter {
+    fn default() -> Self {
+        Self::new(ViewPlane::XY)
+    }
+}
+
+/// Pixels, three bytes to each, row by row from the top
+#[derive(Debug, Clone, PartialEq)]
+pub struct Image {
+    pub width: usize,
+    pub height: usize,
+    pub pixels: Vec<u8>,
+}
+
+impl Image {
+    pub fn pixel(&self, x: usize, y: usize) -> [u8; 3] {
+        let at = 3 * (y * self.width + x);
+        [self.pixels[at], self.pixels[at + 1], self.pixels[at + 2]]
+    }
+}
+
+impl PngExporter {
+    pub fn new(view_plane: ViewPlane) -> Self {
+        Self {
+            view_plane,
+            width: 800,
+            height: 800,
+            solid: None,
+            extent: None,
+        }
+    }
+
+    pub fn with_size(mut self, width: usize, height: usize) -> Self {
+        self.width = width.max(1);
+        self.height = height.max(1);
+        self
+    }
+
+    /// Shade the facets of the solid this STL exporter would tessellate,
+    /// nearest in front, under the outlines
+    pub fn filled(mut self, solid: StlExporter) -> Self {
+        self.solid = Some(solid);
+        self
+    }
+
+    /// Fit this extent to the image, `[min_x, min_y, max_x, max_y]` across
+    /// and down the view as `SvgExporter::extent` gives it, rather than the
+    /// entities drawn
+    pub fn with_extent(mut self, extent: [f64; 4]) -> Self {
+        self.extent = Some(extent);
+        self
+    }
+
+    pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<Vec<u8>> {
+        let mut png = Vec::new();
+        crate::StreamExporter::write_to(self, entities, &mut png)?;
+        Ok(png)
+    }
+
+    pub fn render(&self, entities: &HashMap<String, ResolvedEntity>) -> Image {
+        let workers = thread::available_parallelism().map_or(1, |n| n.get());
+        self.render_on(entities, workers)
+    }
+
+    /// The drawing is made in screen space first, then each tile of rows
+    /// is drawn on whichever thread it was dealt to, with only the shapes
+    /// that reach into it and a depth buffer of its own
+    fn render_on(&self, entities: &HashMap<String, ResolvedEntity>, workers: usize) -> Image {
+        let scene = Scene::new(self, entities);
+        let (width, height) = (self.width, self.height);
+        let mut pixels = vec![0u8; 3 * width * height];
+
+        let tiles = height.div_ceil(TILE_ROWS);
+        let mut bins: Vec<Vec<Shape>> = vec![Vec::new(); tiles];
+        for shape in scene.shapes() {
+            let (top, bottom) = shape.rows();
+            let first = (top.max(0.0) as usize / TILE_ROWS).min(tiles);
+            let last = ((bottom.max(0.0) as usize) / TILE_ROWS).min(tiles - 1);
+            if bottom >= 0.0 && top < height as f64 {
+                for bin in &mut bins[first..=last] {
+                    bin.push(shape);
+                }
+            }
+        }
+
+        let workers = workers.clamp(1, tiles);
+        let mut dealt: Vec<Vec<(usize, &mut [u8])>> = (0..workers).map(|_| Vec::new()).collect();
+        for (i, tile) in pixels.chunks_mut(3 * width * TILE_ROWS).enumerate() {
+            dealt[i % workers].push((i, tile));
+        }
+        let (scene, bins) = (&scene, &bins);
+        thread::scope(|scope| {
+            for tiles in dealt {
+                scope.spawn(move || {
+                    for (i, tile) in tiles {
+                        scene.draw(&bins[i], i * TILE_ROWS, tile);
+                    }
+                });
+            }
+        });
+        Image {
+            width,
+            height,
+            pixels,
+        }
+    }
+}
+
+impl crate::StreamExporter for PngExporter {
+    fn write_to(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()> {
+        write_png(&self.render(entities), out)?;
+        Ok(())
+    }
+}
+
+/// The drawing in pixels: facets with a depth at each corner, nearer
+/// larger, and segments and points in ink
+struct Scene {
+    width: usize,
+    facets: Vec<Facet>,
+    strokes: Vec<[[f64; 2]; 2]>,
+    dots: Vec<[f64; 2]>,
+}
+
+struct Facet {
+    corners: [[f64; 2]; 3],
+    depth: [f64; 3],
+    color: [u8; 3],
+}
+
+/// One shape of a scene, by index
+#[derive(Clone, Copy)]
+enum Shape {
+    Facet(usize, f64, f64),
+    Stroke(usize, f64, f64),
+    Dot(usize, f64),
+}
+
+impl Shape {
+    fn rows(&self) -> (f64, f64) {
+        match *self {
+            Shape::Facet(_, top, bottom) | Shape::Stroke(_, top, bottom) => (top, bottom),
+            Shape::Dot(_, y) => (y - 1.0, y + 1.0),
+        }
+    }
+}
+
+/// Where the model goes in the image
+struct View {
+    right: [f64; 3],
+    down: [f64; 3],
+    scale: f64,
+    offset: [f64; 2],
+}
+
+impl View {
+    fn to_screen(&self, p: [f64; 3]) -> [f64; 2] {
+        [
+            dot(p, self.right) * self.scale + self.offset[0],
+            dot(p, self.down) * self.scale + self.offset[1],
+        ]
+    }
+}
+
+impl Scene {
+    fn new(exporter: &PngExporter, entities: &HashMap<String, ResolvedEntity>) -> Self {
+        let (right, down) = exporter.view_plane.axes();
+        // Right and down across a screen looking along their cross product
+        let toward = normalized(cross(down, right));
+        let triangles = exporter
+            .solid
+            .as_ref()
+            .map(|s| s.triangles(entities))
+            .unwrap_or_default();
+
+        // Fit the extents to the image first, as the curves are cut finer
+        // the larger they are drawn
+        let mut bounds = Bounds::default();
+        let reach = |r: f64, axis: [f64; 3]| r * length(axis);
+        for entity in entities.values() {
+            match entity {
+                ResolvedEntity::Point { at } => {
+                    bounds.add(dot(point(at), right), dot(point(at), down), 0.0, 0.0)
+                }
+                ResolvedEntity::Line { p1, p2 } => {
+                    for p in [point(p1), point(p2)] {
+                        bounds.add(dot(p, right), dot(p, down), 0.0, 0.0);
+                    }
+                }
+                ResolvedEntity::Circle {
+                    center, diameter, ..
+                } => {
+                    let (c, r) = (point(center), diameter / 2.0);
+                    bounds.add(dot(c, right), dot(c, down), reach(r, right), reach(r, down));
+                }
+                ResolvedEntity::Arc { center, start, .. } => {
+                    let (c, r) = (point(center), length(sub(point(start), point(center))));
+                    bounds.add(dot(c, right), dot(c, down), reach(r, right), reach(r, down));
+                }
+                ResolvedEntity::Cubic {
+                    start,
+                    control1,
+                    control2,
+                    end,
+                } => {
+                    for p in [start, control1, control2, end] {
+                        bounds.add(dot(point(p), right), dot(point(p), down), 0.0, 0.0);
+                    }
+                }
+            }
+        }
+        for t in &triangles {
+            for p in t.vertices {
+                bounds.add(dot(p, right), dot(p, down), 0.0, 0.0);
+            }
+        }
+        if let Some([min_x, min_y, max_x, max_y]) = exporter.extent {
+            bounds = Bounds {
+                min: [min_x, min_y],
+                max: [max_x, max_y],
+            };
+        }
+        let view = bounds.fit(right, down, exporter.width, exporter.height);
+
+        let mut scene = Scene {
+            width: exporter.width,
+            facets: Vec::new(),
+            strokes: Vec::new(),
+            dots: Vec::new(),
+        };
+        for t in &triangles {
+            let light = 0.45 + 0.55 * dot(t.normal, toward).abs();
+            scene.facets.push(Facet {
+                corners: t.vertices.map(|p| view.to_screen(p)),
+                depth: t.vertices.map(|p| dot(p, toward)),
+                color: FILL.map(|c| (c as f64 * light).round() as u8),
+            });
+        }
+
+        let mut sorted: Vec<_> = entities.iter().collect();
+        sorted.sort_by_key(|(id, _)| *id);
+        let tolerance = CHORD_PIXELS / view.scale;
+        for (_, entity) in sorted {
+            match entity {
+                ResolvedEntity::Point { at } => scene.dots.push(view.to_screen(point(at))),
+                ResolvedEntity::Line { p1, p2 } => {
+                    scene
+                        .strokes
+                        .push([view.to_screen(point(p1)), view.to_screen(point(p2))]);
+                }
+                ResolvedEntity::Circle {
+                    center,
+                    diameter,
+                    normal,
+                } => {
+                    let c = point(center);
+                    let start = [0, 1, 2].map(|i| c[i] + diameter / 2.0 * across(point(normal))[i]);
+                    let arc = Arc::new(c, start, start, point(normal));
+                    scene.trace(
+                        &view,
+                        |t| arc.at(t * arc.sweep),
+                        arc_segments(&arc, tolerance),
+                    );
+                }
+                ResolvedEntity::Arc {
+                    center,
+                    start,
+                    end,
+                    normal,
+                } => {
+                    let arc = Arc::new(point(center), point(start), point(end), point(normal));
+                    scene.trace(
+                        &view,
+                        |t| arc.at(t * arc.sweep),
+                        arc_segments(&arc, tolerance),
+                    );
+                }
+                ResolvedEntity::Cubic {
+                    start,
+                    control1,
+                    control2,
+                    end,
+                } => {
+                    let p = [point(start), point(control1), point(control2), point(end)];
+                    // As the STL export bounds a cubic's chords
+                    let bend = |a: [f64; 3], b: [f64; 3], c: [f64; 3]| {
+                        length([0, 1, 2].map(|i| a[i] - 2.0 * b[i] + c[i]))
+                    };
+                    let most = bend(p[0], p[1], p[2]).max(bend(p[1], p[2], p[3]));
+                    let segments =
+                        ((0.75 * most / tolerance).sqrt().ceil() as usize).clamp(1, MAX_SEGMENTS);
+                    scene.trace(&view, |t| bezier(&p, t), segments);
+                }
+            }
+        }
+        scene
+    }
+
+    /// The curve through at(0) to at(1), cut into `segments` strokes
+    fn trace(&mut self, view: &View, at: impl Fn(f64) -> [f64; 3], segments: usize) {
+        let mut from = view.to_screen(at(0.0));
+        for i in 1..=segments {
+            let to = view.to_screen(at(i as f64 / segments as f64));
+            self.strokes.push([from, to]);
+            from = to;
+        }
+    }
+
+    fn shapes(&self) -> impl Iterator<Item = Shape> + '_ {
+        let span = |ys: &[f64]| {
+            ys.iter()
+                .fold((f64::INFINITY, f64::NEG_INFINITY), |(lo, hi), &y| {
+                    (lo.min(y), hi.max(y))
+                })
+        };
+        let facets = self.facets.iter().enumerate().map(move |(i, f)| {
+            let (top, bottom) = span(&f.corners.map(|c| c[1]));
+            Shape::Facet(i, top, bottom)
+        });
+        let strokes = self.strokes.iter().enumerate().map(move |(i, s)| {
+            let (top, bottom) = span(&[s[0][1], s[1][1]]);
+            Shape::Stroke(i, top, bottom)
+        });
+        let dots = self
+            .dots
+            .iter()
+            .enumerate()
+            .map(|(i, d)| Shape::Dot(i, d[1]));
+        facets.chain(strokes).chain(dots)
+    }
+
+    /// Draw the shapes that reach into the tile starting at row `top`:
+    /// the facets, then over them the strokes and dots
+    fn draw(&self, shapes: &[Shape], top: usize, tile: &mut [u8]) {
+        let rows = tile.len() / (3 * self.width);
+        let mut canvas = Canvas {
+            width: self.width,
+            top,
+            rows,
+            pixels: tile,
+        };
+        for px in canvas.pixels.chunks_mut(3) {
+            px.copy_from_slice(&BACKGROUND);
+        }
+        let mut depth = vec![f64::NEG_INFINITY; self.width * rows];
+        for shape in shapes {
+            if let Shape::Facet(i, ..) = *shape {
+                canvas.facet(&self.facets[i], &mut depth);
+            }
+        }
+        for shape in shapes {
+            match *shape {
+                Shape::Stroke(i, ..) => canvas.stroke(self.strokes[i]),
+                Shape::Dot(i, _) => canvas.dot(self.dots[i]),
+                Shape::Facet(..) => {}
+            }
+        }
+    }
+}
+
+/// The part of the image in one tile
+struct Canvas<'a> {
+    width: usize,
+    top: usize,
+    rows: usize,
+    pixels: &'a mut [u8],
+}
+
+impl Canvas<'_> {
+    fn put(&mut self, x: i64, y: i64, color: [u8; 3]) {
+        let y = y - self.top as i64;
+        if x >= 0 && y >= 0 && (x as usize) < self.width && (y as usize) < self.rows {
+            let at = 3 * (y as usize * self.width + x as usize);
+            self.pixels[at..at + 3].copy_from_slice(&color);
+        }
+    }
+
+    /// Every pixel whose center is inside, where nothing nearer is drawn
+    fn facet(&mut self, facet: &Facet, depth: &mut [f64]) {
+        let [a, b, c] = facet.corners;
+        let area = edge(a, b, c);
+        if area.abs() < 1e-12 {
+            return;
+        }
+        let (x0, x1) = (a[0].min(b[0]).min(c[0]), a[0].max(b[0]).max(c[0]));
+        let (y0, y1) = (a[1].min(b[1]).min(c[1]), a[1].max(b[1]).max(c[1]));
+        let top = self.top as f64;
+        let rows = (y0 - top).floor().max(0.0) as usize
+            ..((y1 - top).ceil().max(0.0) as usize).min(self.rows);
+        let columns = x0.floor().max(0.0) as usize..(x1.ceil().max(0.0) as usize).min(self.width);
+        for row in rows {
+            for column in columns.clone() {
+                let p = [column as f64 + 0.5, (self.top + row) as f64 + 0.5];
+                let w = [
+                    edge(b, c, p) / area,
+                    edge(c, a, p) / area,
+                    edge(a, b, p) / area,
+                ];
+                if w.iter().any(|&w| w < 0.0) {
+                    continue;
+                }
+                let z = w[0] * facet.depth[0] + w[1] * facet.depth[1] + w[2] * facet.depth[2];
+                let at = row * self.width + column;
+                if z > depth[at] {
+                    depth[at] = z;
+                    self.pixels[3 * at..3 * at + 3].copy_from_slice(&facet.color);
+                }
+            }
+        }
+    }
+
+    /// A step a pixel long along the segment at a time, over only the part
+    /// of it in this tile
+    fn stroke(&mut self, [from, to]: [[f64; 2]; 2]) {
+        let d = [to[0] - from[0], to[1] - from[1]];
+        let steps = d[0].abs().max(d[1].abs()).ceil().max(1.0);
+        let (mut first, mut last) = (0.0, steps);
+        if d[1] != 0.0 {
+            let enter = (self.top as f64 - from[1]) / d[1] * steps;
+            let leave = ((self.top + self.rows) as f64 - from[1]) / d[1] * steps;
+            first = enter.min(leave).floor().max(0.0);
+            last = enter.max(leave).ceil().min(steps);
+        }
+        let mut i = first;
+        while i <= last {
+            let t = i / steps;
+            self.put(
+                (from[0] + t * d[0]).floor() as i64,
+                (from[1] + t * d[1]).floor() as i64,
+                INK,
+            );
+            i += 1.0;
+        }
+    }
+
+    fn dot(&mut self, [x, y]: [f64; 2]) {
+        let (x, y) = (x.floor() as i64, y.floor() as i64);
+        for dy in -1..=1 {
+            for dx in -1..=1 {
+                self.put(x + dx, y + dy, INK);
+            }
+        }
+    }
+}
+
+/// Extents across and down, in model units
+struct Bounds {
+    min: [f64; 2],
+    max: [f64; 2],
+}
+
+impl Default for Bounds {
+    fn default() -> Self {
+        Self {
+            min: [f64::INFINITY; 2],
+            max: [f64::NEG_INFINITY; 2],
+        }
+    }
+}
+
+impl Bounds {
+    fn add(&mut self, x: f64, y: f64, reach_x: f64, reach_y: f64) {
+        self.min = [self.min[0].min(x - reach_x), self.min[1].min(y - reach_y)];
+        self.max = [self.max[0].max(x + reach_x), self.max[1].max(y + reach_y)];
+    }
+
+    /// Scaled alike both ways to fill the image inside its margin, and
+    /// centered; with nothing to draw, the same view as the SVG export's
+    fn fit(&self, right: [f64; 3], down: [f64; 3], width: usize, height: usize) -> View {
+        let (min, max) = if self.min[0].is_finite() {
+            (self.min, self.max)
+        } else {
+            ([-100.0; 2], [100.0; 2])
+        };
+        let size = [(max[0] - min[0]).max(1e-9), (max[1] - min[1]).max(1e-9)];
+        let room = [
+            width as f64 * (1.0 - 2.0 * MARGIN),
+            height as f64 * (1.0 - 2.0 * MARGIN),
+        ];
+        let scale = (room[0] / size[0]).min(room[1] / size[1]);
+        let offset = [
+            width as f64 / 2.0 - (min[0] + max[0]) / 2.0 * scale,
+            height as f64 / 2.0 - (min[1] + max[1]) / 2.0 * scale,
+        ];
+        View {
+            right,
+            down,
+            scale,
+            offset,
+        }
+    }
+}
+
+fn arc_segments(arc: &Arc, tolerance: f64) -> usize {
+    // A chord of angle a strays r(1 - cos(a/2)) from its arc
+    let step = if tolerance < arc.radius {
+        2.0 * (1.0 - tolerance / arc.radius).acos()
+    } else {
+        PI
+    };
+    ((arc.sweep / step).ceil() as usize).clamp(1, MAX_SEGMENTS)
+}
+
+/// A unit vector square to `normal`
+fn across(normal: [f64; 3]) -> [f64; 3] {
+    let n = if length(normal) > 0.0 {
+        normalized(normal)
+    } else {
+        [0.0, 0.0, 1.0]
+    };
+    let other = if n[0].abs() < 0.9 {
+        [1.0, 0.0, 0.0]
+    } else {
+        [0.0, 1.0, 0.0]
+    };
+    normalized(cross(n, other))
+}
+
+/// Twice the signed area of a, b, c
+fn edge(a: [f64; 2], b: [f64; 2], c: [f64; 2]) -> f64 {
+    (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0])
+}
+
+fn sub(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+}
+
+fn dot(a: [f64; 3], b: [f64; 3]) -> f64 {
+    a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+}
+
+fn cross(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0],
+    ]
+}
+
+fn length(a: [f64; 3]) -> f64 {
+    dot(a, a).sqrt()
+}
+
+fn normalized(a: [f64; 3]) -> [f64; 3] {
+    let len = length(a);
+    a.map(|c| c / len)
+}
+
+/// An 8-bit RGB PNG: each row filtered by its left neighbor, so that runs
+/// of one color become runs of zeros, then deflated
+fn write_png(image: &Image, out: &mut dyn Write) -> std::io::Result<()> {
+    let row = 3 * image.width;
+    let mut filtered = Vec::with_capacity((row + 1) * image.height);
+    for pixels in image.pixels.chunks(row) {
+        filtered.push(1);
+        filtered.extend_from_slice(&pixels[..3]);
+        filtered.extend(pixels.windows(4).map(|w| w[3].wrapping_sub(w[0])));
+    }
+
+    let mut header = Vec::with_capacity(13);
+    header.extend_from_slice(&(image.width as u32).to_be_bytes());
+    header.extend_from_slice(&(image.height as u32).to_be_bytes());
+    header.extend_from_slice(&[8, 2, 0, 0, 0]);
+
+    // A zlib stream: its header, the deflated data, and the data's Adler-32
+    let mut zlib = vec![0x78, 0x01];
+    zlib.extend(deflate(&filtered));
+    zlib.extend_from_slice(&adler32(&filtered).to_be_bytes());
+
+    out.write_all(b"\x89PNG\r\n\x1a\n")?;
+    write_chunk(out, b"IHDR", &header)?;
+    write_chunk(out, b"IDAT", &zlib)?;
+    write_chunk(out, b"IEND", &[])
+}
+
+fn write_chunk(out: &mut dyn Write, kind: &[u8; 4], data: &[u8]) -> std::io::Result<()> {
+    out.write_all(&(data.len() as u32).to_be_bytes())?;
+    out.write_all(kind)?;
+    out.write_all(data)?;
+    out.write_all(&crc32(&[kind, data]).to_be_bytes())
+}
+
+/// Lengths 3 to 258 in deflate's length codes 257 on: the shortest length
+/// of each code, and the extra bits after it
+const LENGTH_BASE: [u16; 29] = [
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131,
+    163, 195, 227, 258,
+];
+const LENGTH_EXTRA: [u8; 29] = [
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+];
+
+/// One block with the fixed codes, whose only matches are runs of the byte
+/// before: enough for a drawing of flat colors, once filtered
+fn deflate(data: &[u8]) -> Vec<u8> {
+    let mut bits = Bits::default();
+    bits.put(1, 1); // the last block
+    bits.put(1, 2); // with the fixed codes
+    let mut i = 0;
+    while i < data.len() {
+        let run = match i {
+            0 => 0,
+            _ => data[i..]
+                .iter()
+                .take(258)
+                .take_while(|&&b| b == data[i - 1])
+                .count(),
+        };
+        if run < 3 {
+            bits.symbol(data[i] as u16);
+            i += 1;
+            continue;
+        }
+        let code = LENGTH_BASE
+            .iter()
+            .rposition(|&base| base as usize <= run)
+            .unwrap_or(0);
+        bits.symbol(257 + code as u16);
+        bits.put(
+            (run - LENGTH_BASE[code] as usize) as u32,
+            LENGTH_EXTRA[code] as u32,
+        );
+        bits.put(0, 5); // distance code 0, a distance of one
+        i += run;
+    }
+    bits.symbol(256);
+    bits.finish()
+}
+
+/// Bits packed from the low end of each byte, as deflate writes them
+#[derive(Default)]
+struct Bits {
+    out: Vec<u8>,
+    pending: u64,
+    count: u32,
+}
+
+impl Bits {
+    fn put(&mut self, value: u32, count: u32) {
+        self.pending |= (value as u64) << self.count;
+        self.count += count;
+        while self.count >= 8 {
+            self.out.push(self.pending as u8);
+            self.pending >>= 8;
+            self.count -= 8;
+        }
+    }
+
+    /// A literal or length symbol in its fixed code, which is written from
+    /// its high bit
+    fn symbol(&mut self, symbol: u16) {
+        let symbol = symbol as u32;
+        let (code, len) = match symbol {
+            0..=143 => (0x30 + symbol, 8),
+            144..=255 => (0x190 + symbol - 144, 9),
+            256..=279 => (symbol - 256, 7),
+            _ => (0xc0 + symbol - 280, 8),
+        };
+        self.put(code.reverse_bits() >> (32 - len), len);
+    }
+
+    fn finish(mut self) -> Vec<u8> {
+        if self.count > 0 {
+            self.out.push(self.pending as u8);
+        }
+        self.out
+    }
+}
+
+const CRC_TABLE: [u32; 256] = crc_table();
+
+const fn crc_table() -> [u32; 256] {
+    let mut table = [0; 256];
+    let mut n = 0;
+    while n < 256 {
+        let mut c = n as u32;
+        let mut k = 0;
+        while k < 8 {
+            c = if c & 1 != 0 {
+                0xedb8_8320 ^ (c >> 1)
+            } else {
+                c >> 1
+            };
+            k += 1;
+        }
+        table[n] = c;
+        n += 1;
+    }
+    table
+}
+
+fn crc32(parts: &[&[u8]]) -> u32 {
+    let mut c = 0xffff_ffffu32;
+    for &b in parts.iter().copied().flatten() {
+        c = CRC_TABLE[((c ^ b as u32) & 0xff) as usize] ^ (c >> 8);
+    }
+    c ^ 0xffff_ffff
+}
+
+fn adler32(data: &[u8]) -> u32 {
+    // 5552 bytes is the most that can be summed before b could overflow
+    let (mut a, mut b) = (1u32, 0u32);
+    for chunk in data.chunks(5552) {
+        for &byte in chunk {
+            a += byte as u32;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    (b << 16) | a
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn line(p1: [f64; 2], p2: [f64; 2]) -> ResolvedEntity {
+        ResolvedEntity::Line {
+            p1: vec![p1[0], p1[1], 0.0],
+            p2: vec![p2[0], p2[1], 0.0],
+        }
+    }
+
+    fn circle(center: [f64; 2], diameter: f64) -> ResolvedEntity {
+        ResolvedEntity::Circle {
+            center: vec![center[0], center[1], 0.0],
+            diameter,
+            normal: vec![0.0, 0.0, 1.0],
+        }
+    }
+
+    /// Inflate a stream of fixed-code blocks, as `deflate` writes
+    fn inflate(data: &[u8]) -> Vec<u8> {
+        let mut at = 0;
+        let mut bit = |n: u32| -> u32 {
+            let mut v = 0;
+            for i in 0..n {
+                v |= (((data[at / 8] >> (at % 8)) & 1) as u32) << i;
+                at += 1;
+            }
+            v
+        };
+        let mut out: Vec<u8> = Vec::new();
+        loop {
+            let last = bit(1);
+            assert_eq!(bit(2), 1);
+            loop {
+                let mut code = 0;
+                for _ in 0..7 {
+                    code = code << 1 | bit(1);
+                }
+                let symbol = if code <= 23 {
+                    256 + code
+                } else {
+                    code = code << 1 | bit(1);
+                    match code {
+                        0x30..=0xbf => code - 0x30,
+                        0xc0..=0xc7 => 280 + code - 0xc0,
+                        _ => 144 + (code << 1 | bit(1)) - 0x190,
+                    }
+                };
+                match symbol {
+                    0..=255 => out.push(symbol as u8),
+                    256 => break,
+                    _ => {
+                        let code = (symbol - 257) as usize;
+                        let len =
+                            LENGTH_BASE[code] as usize + bit(LENGTH_EXTRA[code] as u32) as usize;
+                        assert_eq!(bit(5), 0);
+                        for _ in 0..len {
+                            out.push(*out.last().unwrap());
+                        }
+                    }
+                }
+            }
+            if last == 1 {
+                return out;
+            }
+        }
+    }
+
+    /// The image back from a PNG this module wrote
+    fn decode(png: &[u8]) -> Image {
+        assert_eq!(&png[..8], b"\x89PNG\r\n\x1a\n");
+        let (mut at, mut width, mut height, mut zlib) = (8, 0, 0, Vec::new());
+        while at < png.len() {
+            let len = u32::from_be_bytes(png[at..at + 4].try_into().unwrap()) as usize;
+            let kind = &png[at + 4..at + 8];
+            let data = &png[at + 8..at + 8 + len];
+            let crc = u32::from_be_bytes(png[at + 8 + len..at + 12 + len].try_into().unwrap());
+            assert_eq!(crc, crc32(&[kind, data]));
+            match kind {
+                b"IHDR" => {
+                    width = u32::from_be_bytes(data[..4].try_into().unwrap()) as usize;
+                    height = u32::from_be_bytes(data[4..8].try_into().unwrap()) as usize;
+                    assert_eq!(&data[8..], &[8, 2, 0, 0, 0]);
+                }
+                b"IDAT" => zlib.extend_from_slice(data),
+                _ => {}
+            }
+            at += 12 + len;
+        }
+        let filtered = inflate(&zlib[2..zlib.len() - 4]);
+        assert_eq!(zlib[zlib.len() - 4..], adler32(&filtered).to_be_bytes());
+        let mut pixels = Vec::new();
+        for row in filtered.chunks(3 * width + 1) {
+            assert_eq!(row[0], 1);
+            let start = pixels.len();
+            for (i, &b) in row[1..].iter().enumerate() {
+                let left = if i >= 3 { pixels[start + i - 3] } else { 0u8 };
+                pixels.push(b.wrapping_add(left));
+            }
+        }
+        Image {
+            width,
+            height,
+            pixels,
+        }
+    }
+
+    #[test]
+    fn test_crc_of_iend() {
+        assert_eq!(crc32(&[b"IEND", &[]]), 0xae42_6082);
+    }
+
+    #[test]
+    fn test_adler32() {
+        assert_eq!(adler32(b"Wikipedia"), 0x11e6_0398);
+    }
+
+    #[test]
+    fn test_deflate_round_trips() {
+        let mut data = vec![0u8; 1000];
+        data.extend((0..=255u8).cycle().take(700));
+        data.extend([7u8; 300]);
+        assert_eq!(inflate(&deflate(&data)), data);
+        assert!(deflate(&[0u8; 10_000]).len() < 200);
+    }
+
+    #[test]
+    fn test_png_decodes_to_the_render() {
+        let mut entities = HashMap::new();
+        entities.insert("c".to_string(), circle([0.0, 0.0], 50.0));
+        entities.insert("l".to_string(), line([-30.0, -30.0], [30.0, 20.0]));
+        let exporter = PngExporter::default().with_size(120, 90);
+        let png = exporter.export(&entities).unwrap();
+        assert_eq!(decode(&png), exporter.render(&entities));
+    }
+
+    #[test]
+    fn test_extent_is_fitted_in_place_of_the_drawing() {
+        let mut entities = HashMap::new();
+        entities.insert("l".to_string(), line([0.0, 0.0], [100.0, 0.0]));
+        let image = PngExporter::default()
+            .with_size(100, 100)
+            .with_extent([0.0, 0.0, 200.0, 200.0])
+            .render(&entities);
+        let ink = |x: usize, y: usize| image.pixel(x, y) == INK;
+        // The line reaches halfway across the extent
+        assert!(ink(25, 4) && !ink(75, 4));
+    }
+
+    #[test]
+    fn test_line_is_drawn_across_the_image() {
+        let mut entities = HashMap::new();
+        entities.insert("l".to_string(), line([0.0, 0.0], [100.0, 0.0]));
+        entities.insert("m".to_string(), line([0.0, 0.0], [0.0, 100.0]));
+        let image = PngExporter::default().with_size(100, 100).render(&entities);
+        let ink = |x: usize, y: usize| image.pixel(x, y) == INK;
+        // The square of the two lines fills the image inside its margin
+        assert!(ink(4, 50) && ink(50, 4));
+        assert!(!ink(50, 50) && !ink(95, 95) && !ink(2, 50));
+    }
+
+    #[test]
+    fn test_tiles_on_any_number_of_threads_agree() {
+        let mut entities = HashMap::new();
+        for i in 0..20 {
+            let f = i as f64;
+            entities.insert(format!("c{}", i), circle([f * 7.0, f * 3.0], 10.0 + f));
+            entities.insert(format!("l{}", i), line([-f, f * 9.0], [f * 11.0, -f * 2.0]));
+        }
+        let exporter = PngExporter::new(ViewPlane::Isometric)
+            .with_size(200, 150)
+            .filled(StlExporter::new(10.0));
+        let one = exporter.render_on(&entities, 1);
+        assert_eq!(one, exporter.render_on(&entities, 3));
+        assert_eq!(one, exporter.render_on(&entities, 16));
+    }
+
+    #[test]
+    fn test_filled_solid_hides_what_is_behind() {
+        let mut entities = HashMap::new();
+        entities.insert("c".to_string(), circle([0.0, 0.0], 100.0));
+        let outline = PngExporter::default().with_size(64, 64).render(&entities);
+        let filled = PngExporter::default()
+            .with_size(64, 64)
+            .filled(StlExporter::new(10.0))
+            .render(&entities);
+        assert_eq!(outline.pixel(32, 32), BACKGROUND);
+        let inside = filled.pixel(32, 32);
+        assert!(inside != BACKGROUND && inside != INK);
+        // The cap faces the viewer, so is shaded at full light
+        assert_eq!(inside, FILL);
+        assert_eq!(filled.pixel(0, 0), BACKGROUND);
+    }
+
+    #[test]
+    fn test_empty_sketch_is_blank() {
+        let image = PngExporter::default()
+            .with_size(10, 40)
+            .render(&HashMap::new());
+        assert!(image.pixels.iter().all(|&b| b == 255));
+    }
+}
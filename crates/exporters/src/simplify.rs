@@ -0,0 +1,618 @@
+//! Simplifying an indexed mesh by collapsing its edges, cheapest first, as
+//! SolveSpace's `SMesh::MakeFromSimplificationOf` does. The cost of moving
+//! a vertex is the sum of its squared distances from the planes of the
+//! faces that met there first (Garland and Heckbert's quadric error). A
+//! vertex on an edge that isn't between exactly two faces stays put.
+//!
+//! A big mesh is cut into slabs along its longest axis, each simplified on
+//! a thread of its own with the vertices the slabs share left alone. That's
+//! done in passes, each allowing collapses of a greater cost, and with the
+//! cuts moved half a slab every other pass; then what's left goes once more
+//! to meet the budget. The slabs don't depend on the number of threads, so
+//! nor does the result.
+
+use crate::mesh::IndexedMesh;
+use std::cmp::Ordering;
+use std::collections::{BinaryHeap, HashMap};
+use std::thread;
+
+const MIN_SLAB_FACES: usize = 4096;
+const MAX_SLABS: usize = 16;
+const PASSES: usize = 8;
+
+impl IndexedMesh {
+    /// A copy with at most `max_faces` faces, or with no vertex moved much
+    /// more than `max_error`; zero for either is no limit
+    pub fn simplified(&self, max_faces: usize, max_error: f64) -> IndexedMesh {
+        let max_cost = if max_error > 0.0 {
+            max_error * max_error
+        } else {
+            f64::INFINITY
+        };
+        if (max_faces == 0 || self.faces.len() <= max_faces) && max_error <= 0.0 {
+            return self.clone();
+        }
+
+        let mut state = State {
+            pos: self.vertices.clone(),
+            quadric: vec![Quadric::default(); self.vertices.len()],
+            fixed: vec![false; self.vertices.len()],
+            faces: self.faces.iter().map(|f| f.map(|v| v as usize)).collect(),
+        };
+        for f in &state.faces {
+            if let Some(q) = Quadric::of_face(f, &state.pos) {
+                for &v in f {
+                    state.quadric[v].add(&q);
+                }
+            }
+        }
+        let mut edges: HashMap<(usize, usize), u32> = HashMap::new();
+        for f in &state.faces {
+            for k in 0..3 {
+                let (a, b) = (f[k], f[(k + 1) % 3]);
+                *edges.entry((a.min(b), a.max(b))).or_insert(0) += 1;
+            }
+        }
+        for (&(a, b), &n) in &edges {
+            if n != 2 {
+                state.fixed[a] = true;
+                state.fixed[b] = true;
+            }
+        }
+        drop(edges);
+
+        let n = state.faces.len();
+        let slabs = (n / MIN_SLAB_FACES).clamp(1, MAX_SLABS);
+        if slabs > 1 {
+            let axis = longest_axis(&state.pos);
+            let size = bounding_size(&state.pos);
+            // From collapses that move a vertex by a millionth of the model,
+            // sixteen times the cost (four times the distance) each pass
+            let mut pass_cost = 1e-12 * dot(size, size);
+            for pass in 0..PASSES {
+                let m = state.faces.len();
+                if max_faces > 0 && m <= max_faces {
+                    break;
+                }
+                pass_cost = (pass_cost * 16.0).min(max_cost);
+                state.slab_pass(axis, slabs, pass, max_faces, pass_cost);
+                if pass_cost >= max_cost {
+                    break;
+                }
+            }
+        }
+        let all: Vec<usize> = (0..state.faces.len()).collect();
+        let region = Region::new(&state, &all, &[]).run(max_faces, max_cost);
+        state.faces = region.commit(&mut state);
+
+        // Only the vertices still used, in their order
+        let mut index = vec![u32::MAX; state.pos.len()];
+        let mut vertices = Vec::new();
+        let faces = state
+            .faces
+            .iter()
+            .map(|f| {
+                f.map(|v| {
+                    if index[v] == u32::MAX {
+                        index[v] = vertices.len() as u32;
+                        vertices.push(state.pos[v]);
+                    }
+                    index[v]
+                })
+            })
+            .collect();
+        IndexedMesh { vertices, faces }
+    }
+}
+
+/// The mesh between passes: its vertices, with their quadrics, and faces
+struct State {
+    pos: Vec<[f64; 3]>,
+    quadric: Vec<Quadric>,
+    fixed: Vec<bool>,
+    faces: Vec<[usize; 3]>,
+}
+
+impl State {
+    fn slab_pass(&mut self, axis: usize, slabs: usize, pass: usize, max_faces: usize, cost: f64) {
+        let m = self.faces.len();
+        let along = |f: &[usize; 3]| f.iter().map(|&v| self.pos[v][axis]).sum::<f64>();
+        let mut order: Vec<usize> = (0..m).collect();
+        order.sort_by(|&p, &q| {
+            along(&self.faces[p])
+                .total_cmp(&along(&self.faces[q]))
+                .then(p.cmp(&q))
+        });
+
+        // A vertex in more than one slab is left alone in all of them, so
+        // no slab changes a face of another's
+        let shift = if pass % 2 == 1 { m / (2 * slabs) } else { 0 };
+        let mut lists = vec![Vec::new(); slabs];
+        let mut slab_of = vec![usize::MAX; self.pos.len()];
+        let mut shared = vec![false; self.pos.len()];
+        for (k, &f) in order.iter().enumerate() {
+            let s = ((k + shift) * slabs / m) % slabs;
+            lists[s].push(f);
+            for &v in &self.faces[f] {
+                if slab_of[v] == usize::MAX {
+                    slab_of[v] = s;
+                } else if slab_of[v] != s {
+                    shared[v] = true;
+                }
+            }
+        }
+
+        let this = &*self;
+        let shared = &shared;
+        let regions: Vec<Region> = thread::scope(|scope| {
+            let threads: Vec<_> = lists
+                .iter()
+                .map(|list| {
+                    let target = max_faces * list.len() / m;
+                    scope.spawn(move || Region::new(this, list, shared).run(target, cost))
+                })
+                .collect();
+            threads
+                .into_iter()
+                .map(|t| t.join().expect("simplifying a slab"))
+                .collect()
+        });
+        let mut faces = Vec::with_capacity(m);
+        for region in regions {
+            faces.extend(region.commit(self));
+        }
+        self.faces = faces;
+    }
+}
+
+/// The sum of squared distances from planes, as the upper triangle of a
+/// symmetric 4x4 matrix: xx xy xz xw yy yz yw zz zw ww
+#[derive(Clone, Copy, Debug, Default)]
+struct Quadric([f64; 10]);
+
+impl Quadric {
+    fn of_face(f: &[usize; 3], pos: &[[f64; 3]]) -> Option<Quadric> {
+        let n = cross(sub(pos[f[1]], pos[f[0]]), sub(pos[f[2]], pos[f[0]]));
+        let len = dot(n, n).sqrt();
+        if len < 1e-12 {
+            return None;
+        }
+        let n = n.map(|c| c / len);
+        let d = -dot(n, pos[f[0]]);
+        Some(Quadric([
+            n[0] * n[0],
+            n[0] * n[1],
+            n[0] * n[2],
+            n[0] * d,
+            n[1] * n[1],
+            n[1] * n[2],
+            n[1] * d,
+            n[2] * n[2],
+            n[2] * d,
+            d * d,
+        ]))
+    }
+
+    fn add(&mut self, q: &Quadric) {
+        for (a, b) in self.0.iter_mut().zip(q.0) {
+            *a += b;
+        }
+    }
+
+    fn error(&self, p: [f64; 3]) -> f64 {
+        let [xx, xy, xz, xw, yy, yz, yw, zz, zw, ww] = self.0;
+        p[0] * (xx * p[0] + 2.0 * (xy * p[1] + xz * p[2] + xw))
+            + p[1] * (yy * p[1] + 2.0 * (yz * p[2] + yw))
+            + p[2] * (zz * p[2] + 2.0 * zw)
+            + ww
+    }
+
+    /// Where the error is least, if that's well defined
+    fn minimum(&self) -> Option<[f64; 3]> {
+        let [xx, xy, xz, xw, yy, yz, yw, zz, zw, _] = self.0;
+        let det = xx * (yy * zz - yz * yz) - xy * (xy * zz - yz * xz) + xz * (xy * yz - yy * xz);
+        if det.abs() < 1e-12 {
+            return None;
+        }
+        Some([
+            -(xw * (yy * zz - yz * yz) - xy * (yw * zz - yz * zw) + xz * (yw * yz - yy * zw)) / det,
+            -(xx * (yw * zz - zw * yz) - xw * (xy * zz - yz * xz) + xz * (xy * zw - yw * xz)) / det,
+            -(xx * (yy * zw - yz * yw) - xy * (xy * zw - yw * xz) + xw * (xy * yz - yy * xz)) / det,
+        ])
+    }
+}
+
+/// Collapse the edge from vertex `gone` into `kept`, which moves to `p`
+#[derive(Clone, Copy, Debug)]
+struct Collapse {
+    cost: f64,
+    gone: usize,
+    kept: usize,
+    stamps: (u32, u32),
+    p: [f64; 3],
+}
+
+impl PartialEq for Collapse {
+    fn eq(&self, other: &Self) -> bool {
+        self.cmp(other) == Ordering::Equal
+    }
+}
+impl Eq for Collapse {}
+impl PartialOrd for Collapse {
+    fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
+        Some(self.cmp(other))
+    }
+}
+impl Ord for Collapse {
+    /// Cheapest first out of the max-heap
+    fn cmp(&self, other: &Self) -> Ordering {
+        other
+            .cost
+            .total_cmp(&self.cost)
+            .then((other.gone, other.kept).cmp(&(self.gone, self.kept)))
+    }
+}
+
+/// Some of the faces of a `State`, with their vertices numbered from zero
+struct Region {
+    global: Vec<usize>,
+    pos: Vec<[f64; 3]>,
+    quadric: Vec<Quadric>,
+    /// Doesn't move, though others may collapse into it
+    fixed: Vec<bool>,
+    /// Not collapsed at all
+    frozen: Vec<bool>,
+    stamp: Vec<u32>,
+    vertex_faces: Vec<Vec<usize>>,
+    faces: Vec<[usize; 3]>,
+    alive: Vec<bool>,
+    count: usize,
+    heap: BinaryHeap<Collapse>,
+}
+
+impl Region {
+    fn new(state: &State, list: &[usize], frozen: &[bool]) -> Region {
+        let mut local = HashMap::new();
+        let mut region = Region {
+            global: Vec::new(),
+            pos: Vec::new(),
+            quadric: Vec::new(),
+            fixed: Vec::new(),
+            frozen: Vec::new(),
+            stamp: Vec::new(),
+            vertex_faces: Vec::new(),
+            faces: Vec::with_capacity(list.len()),
+            alive: vec![true; list.len()],
+            count: list.len(),
+            heap: BinaryHeap::new(),
+        };
+        for (i, &f) in list.iter().enumerate() {
+            let face = state.faces[f].map(|g| {
+                *local.entry(g).or_insert_with(|| {
+                    let is_frozen = frozen.get(g).copied().unwrap_or(false);
+                    region.global.push(g);
+                    region.pos.push(state.pos[g]);
+                    region.quadric.push(state.quadric[g]);
+                    region.fixed.push(state.fixed[g] || is_frozen);
+                    region.frozen.push(is_frozen);
+                    region.stamp.push(0);
+                    region.vertex_faces.push(Vec::new());
+                    region.global.len() - 1
+                })
+            });
+            for &v in &face {
+                region.vertex_faces[v].push(i);
+            }
+            region.faces.push(face);
+        }
+        for v in 0..region.pos.len() {
+            region.push_edges(v, true);
+        }
+        region
+    }
+
+    fn push_edges(&mut self, v: usize, only_after: bool) {
+        for k in 0..self.vertex_faces[v].len() {
+            let f = self.vertex_faces[v][k];
+            if !self.alive[f] {
+                continue;
+            }
+            for w in self.faces[f] {
+                if w == v || (only_after && w < v) {
+                    continue;
+                }
+                if let Some(c) = self.evaluate(v, w) {
+                    self.heap.push(c);
+                }
+            }
+        }
+    }
+
+    fn evaluate(&self, a: usize, b: usize) -> Option<Collapse> {
+        if (self.fixed[a] && self.fixed[b]) || self.frozen[a] || self.frozen[b] {
+            return None;
+        }
+        let mut q = self.quadric[a];
+        q.add(&self.quadric[b]);
+        let (gone, kept) = if self.fixed[a] { (b, a) } else { (a, b) };
+        let p = if self.fixed[kept] {
+            self.pos[kept]
+        } else {
+            let (pa, pb) = (self.pos[a], self.pos[b]);
+            let span = dist(pa, pb);
+            match q.minimum() {
+                Some(p) if dist(p, pa) <= 2.0 * span => p,
+                // No one best place, or it's far off: the best of the ends
+                // and the middle
+                _ => [pa, pb, [0, 1, 2].map(|i| (pa[i] + pb[i]) / 2.0)]
+                    .into_iter()
+                    .min_by(|p, r| q.error(*p).total_cmp(&q.error(*r)))
+                    .unwrap(),
+            }
+        };
+        Some(Collapse {
+            cost: q.error(p).max(0.0),
+            gone,
+            kept,
+            stamps: (self.stamp[gone], self.stamp[kept]),
+            p,
+        })
+    }
+
+    /// Whether moving v to p turns any of its faces without `other` too far
+    /// over, or flat
+    fn folds(&self, v: usize, p: [f64; 3], other: usize) -> bool {
+        self.vertex_faces[v].iter().any(|&f| {
+            let face = self.faces[f];
+            if !self.alive[f] || face.contains(&other) {
+                return false;
+            }
+            let a = face.map(|w| self.pos[w]);
+            let b = face.map(|w| if w == v { p } else { self.pos[w] });
+            let n0 = cross(sub(a[1], a[0]), sub(a[2], a[0]));
+            let n1 = cross(sub(b[1], b[0]), sub(b[2], b[0]));
+            let m1 = dot(n1, n1).sqrt();
+            m1 < 1e-12 || dot(n0, n1) < 0.2 * dot(n0, n0).sqrt() * m1
+        })
+    }
+
+    /// Whether the ends of an edge have no neighbors in common but the far
+    /// corners of the faces on it; else the collapse would pinch the mesh
+    fn keeps_manifold(&self, a: usize, b: usize) -> bool {
+        let neighbors = |v: usize| {
+            let mut n: Vec<usize> = self.vertex_faces[v]
+                .iter()
+                .filter(|&&f| self.alive[f])
+                .flat_map(|&f| self.faces[f])
+                .filter(|&w| w != v)
+                .collect();
+            n.sort_unstable();
+            n.dedup();
+            n
+        };
+        let shared = self.vertex_faces[a]
+            .iter()
+            .filter(|&&f| self.alive[f] && self.faces[f].contains(&b))
+            .count();
+        let nb = neighbors(b);
+        let common = neighbors(a)
+            .into_iter()
+            .filter(|w| nb.binary_search(w).is_ok())
+            .count();
+        common == shared
+    }
+
+    fn run(mut self, target: usize, max_cost: f64) -> Region {
+        while self.count > target {
+            let Some(c) = self.heap.pop() else { break };
+            if c.cost > max_cost {
+                break;
+            }
+            if c.stamps != (self.stamp[c.gone], self.stamp[c.kept])
+                || !self.keeps_manifold(c.gone, c.kept)
+                || self.folds(c.gone, c.p, c.kept)
+                || self.folds(c.kept, c.p, c.gone)
+            {
+                continue;
+            }
+
+            for f in std::mem::take(&mut self.vertex_faces[c.gone]) {
+                if !self.alive[f] {
+                    continue;
+                }
+                if self.faces[f].contains(&c.kept) {
+                    self.alive[f] = false;
+                    self.count -= 1;
+                    continue;
+                }
+                for w in self.faces[f].iter_mut() {
+                    if *w == c.gone {
+                        *w = c.kept;
+                    }
+                }
+                self.vertex_faces[c.kept].push(f);
+            }
+            self.stamp[c.gone] += 1;
+            self.stamp[c.kept] += 1;
+            self.pos[c.kept] = c.p;
+            let gone = self.quadric[c.gone];
+            self.quadric[c.kept].add(&gone);
+            let alive = &self.alive;
+            self.vertex_faces[c.kept].retain(|&f| alive[f]);
+            self.push_edges(c.kept, false);
+        }
+        self
+    }
+
+    /// Write the vertices that moved back to the state, and give the faces
+    /// left, numbered as the state's
+    fn commit(self, state: &mut State) -> Vec<[usize; 3]> {
+        for (v, &g) in self.global.iter().enumerate() {
+            if !self.frozen[v] {
+                state.pos[g] = self.pos[v];
+                state.quadric[g] = self.quadric[v];
+            }
+        }
+        self.faces
+            .iter()
+            .zip(&self.alive)
+            .filter(|(_, &alive)| alive)
+            .map(|(f, _)| f.map(|v| self.global[v]))
+            .collect()
+    }
+}
+
+fn bounding_size(pos: &[[f64; 3]]) -> [f64; 3] {
+    let mut lo = [f64::INFINITY; 3];
+    let mut hi = [f64::NEG_INFINITY; 3];
+    for p in pos {
+        for i in 0..3 {
+            lo[i] = lo[i].min(p[i]);
+            hi[i] = hi[i].max(p[i]);
+        }
+    }
+    [0, 1, 2].map(|i| (hi[i] - lo[i]).max(0.0))
+}
+
+fn longest_axis(pos: &[[f64; 3]]) -> usize {
+    let size = bounding_size(pos);
+    (0..3)
+        .max_by(|&a, &b| size[a].total_cmp(&size[b]).then(b.cmp(&a)))
+        .unwrap_or(0)
+}
+
+fn sub(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+}
+
+fn dot(a: [f64; 3], b: [f64; 3]) -> f64 {
+    a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+}
+
+fn cross(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0],
+    ]
+}
+
+fn dist(a: [f64; 3], b: [f64; 3]) -> f64 {
+    let d = sub(a, b);
+    dot(d, d).sqrt()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mesh::WELD_TOLERANCE;
+    use crate::stl::StlExporter;
+    use slvsx_core::ir::ResolvedEntity;
+
+    /// A closed UV sphere of radius 10 about the origin
+    fn sphere(nu: usize, nv: usize) -> IndexedMesh {
+        let mut vertices = vec![[0.0, 0.0, 10.0], [0.0, 0.0, -10.0]];
+        for j in 1..nv {
+            let th = std::f64::consts::PI * j as f64 / nv as f64;
+            for i in 0..nu {
+                let ph = 2.0 * std::f64::consts::PI * i as f64 / nu as f64;
+                vertices.push([
+                    10.0 * th.sin() * ph.cos(),
+                    10.0 * th.sin() * ph.sin(),
+                    10.0 * th.cos(),
+                ]);
+            }
+        }
+        let at = |i: usize, j: usize| -> u32 {
+            match j {
+                0 => 0,
+                j if j == nv => 1,
+                j => (2 + (j - 1) * nu + i % nu) as u32,
+            }
+        };
+        let mut faces = Vec::new();
+        for i in 0..nu {
+            for j in 0..nv {
+                let (a, b, c, d) = (at(i, j), at(i + 1, j), at(i + 1, j + 1), at(i, j + 1));
+                if j != 0 {
+                    faces.push([a, d, b]);
+                }
+                if j != nv - 1 {
+                    faces.push([b, d, c]);
+                }
+            }
+        }
+        IndexedMesh { vertices, faces }
+    }
+
+    fn is_closed(mesh: &IndexedMesh) -> bool {
+        let mut edges = HashMap::new();
+        for f in &mesh.faces {
+            for k in 0..3 {
+                *edges.entry((f[k], f[(k + 1) % 3])).or_insert(0) += 1;
+            }
+        }
+        edges
+            .iter()
+            .all(|(&(a, b), &n)| n == 1 && edges.get(&(b, a)) == Some(&1))
+    }
+
+    fn farthest_off_sphere(mesh: &IndexedMesh) -> f64 {
+        mesh.vertices
+            .iter()
+            .map(|v| (dot(*v, *v).sqrt() - 10.0).abs())
+            .fold(0.0, f64::max)
+    }
+
+    #[test]
+    fn test_budget_is_met_and_closed() {
+        let mesh = sphere(200, 100);
+        assert!(mesh.faces.len() > 4 * MIN_SLAB_FACES);
+        let small = mesh.simplified(2000, 0.0);
+        assert!(small.faces.len() <= 2000 && small.faces.len() > 1900);
+        assert!(is_closed(&small));
+        // About what a uniform sphere of as many faces strays by
+        assert!(farthest_off_sphere(&small) < 0.1);
+    }
+
+    #[test]
+    fn test_error_bound() {
+        let mesh = sphere(60, 30);
+        let small = mesh.simplified(0, 0.01);
+        assert!(small.faces.len() < mesh.faces.len());
+        assert!(is_closed(&small));
+        assert!(farthest_off_sphere(&small) < 0.02);
+    }
+
+    #[test]
+    fn test_flat_profile_keeps_its_outline() {
+        // The walls of a cylinder cut finely: the cap rims are creases
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![0.0, 0.0, 0.0],
+                diameter: 20.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let triangles = StlExporter::new(10.0)
+            .with_chord_tolerance(1e-4)
+            .triangles(&entities);
+        let mesh = IndexedMesh::weld(&triangles, WELD_TOLERANCE);
+        let small = mesh.simplified(mesh.faces.len() / 4, 0.0);
+        assert!(small.faces.len() <= mesh.faces.len() / 4);
+        assert!(is_closed(&small));
+        // Every vertex still on a rim
+        for v in &small.vertices {
+            assert!(v[2].abs() < 1e-9 || (v[2] - 10.0).abs() < 1e-9);
+        }
+    }
+
+    #[test]
+    fn test_no_limits_is_a_copy() {
+        let mesh = sphere(8, 4);
+        assert_eq!(mesh.simplified(0, 0.0), mesh);
+        assert_eq!(mesh.simplified(mesh.faces.len(), 0.0), mesh);
+    }
+}
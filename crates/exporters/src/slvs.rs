@@ -1,13 +1,18 @@
 use slvsx_core::ir::ResolvedEntity;
-use std::collections::HashMap;
+use std::collections::{BTreeMap, HashMap};
+use std::io::Write;
 
 pub struct SlvsExporter {
     precision: usize,
+    snapshot: bool,
 }
 
 impl Default for SlvsExporter {
     fn default() -> Self {
-        Self { precision: 8 }
+        Self {
+            precision: 8,
+            snapshot: false,
+        }
     }
 }
 
@@ -16,148 +21,571 @@ impl SlvsExporter {
         Self::default()
     }
 
-    pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String> {
-        let mut slvs = String::new();
+    /// Write the binary snapshot that the C++ core's `SaveSnapshot` writes
+    /// and its `LoadFromFile` reads, rather than text; see [`Snapshot`].
+    /// Binary output isn't text, so only `write_to` can give it.
+    pub fn snapshot(mut self) -> Self {
+        self.snapshot = true;
+        self
+    }
 
-        // SLVS text format header
-        slvs.push_str("# SolveSpace Text Format v1\n");
-        slvs.push_str("# Generated by slvsx\n\n");
+    pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String> {
+        crate::Exporter::export(self, entities)
+    }
 
-        // Group section
-        slvs.push_str("Group.h.v=00000001\n");
-        slvs.push_str("Group.name=sketch\n");
-        slvs.push_str("Group.visible=1\n\n");
+    /// Walk the sketch into `sink`: the group, then each entity's params
+    /// followed by the entity
+    fn walk(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        sink: &mut dyn Sink,
+    ) -> anyhow::Result<()> {
+        use SnapshotValue::{Bool, Hex, Int, Str};
+
+        sink.record(
+            b'g',
+            &[
+                ("Group.h.v", Hex(1)),
+                ("Group.name", Str("sketch".into())),
+                ("Group.visible", Bool(true)),
+            ],
+        )?;
 
         // Parameters and entities
-        let mut param_id = 0x10000;
-        let mut entity_id = 0x20000;
+        let mut param_id: u32 = 0x10000;
+        let mut entity_id: u32 = 0x20000;
+        let params = |sink: &mut dyn Sink, first: u32, coords: &[f64]| -> anyhow::Result<()> {
+            for (i, coord) in coords.iter().enumerate() {
+                sink.param(first + i as u32, *coord)?;
+            }
+            Ok(())
+        };
 
         for (id, entity) in entities {
+            let h = ("Entity.h.v", Hex(entity_id));
+            let name = ("Entity.name", Str(id.clone()));
             match entity {
                 ResolvedEntity::Point { at } => {
                     // Each point needs 3 parameters (x, y, z)
-                    for (i, coord) in at.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
-
-                    slvs.push_str(&format!("Entity.h.v={:08x}\n", entity_id));
-                    slvs.push_str("Entity.type=2000\n"); // Point type
-                    slvs.push_str(&format!("Entity.name={}\n", id));
-                    slvs.push_str(&format!("Entity.param[0].v={:08x}\n", param_id));
-                    slvs.push_str(&format!("Entity.param[1].v={:08x}\n", param_id + 1));
-                    slvs.push_str(&format!("Entity.param[2].v={:08x}\n\n", param_id + 2));
+                    params(sink, param_id, at)?;
+                    sink.record(
+                        b'e',
+                        &[
+                            h,
+                            ("Entity.type", Int(2000)), // Point type
+                            name,
+                            ("Entity.param[0].v", Hex(param_id)),
+                            ("Entity.param[1].v", Hex(param_id + 1)),
+                            ("Entity.param[2].v", Hex(param_id + 2)),
+                        ],
+                    )?;
 
                     param_id += 3;
-                    entity_id += 1;
                 }
-                ResolvedEntity::Circle { center, diameter, .. } => {
-                    // Center point parameters
-                    for (i, coord) in center.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
-
-                    // Radius parameter
-                    slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + 3));
-                    slvs.push_str(&format!(
-                        "Param.val={:.p$}\n\n",
-                        diameter / 2.0,
-                        p = self.precision
-                    ));
-
-                    slvs.push_str(&format!("Entity.h.v={:08x}\n", entity_id));
-                    slvs.push_str("Entity.type=4000\n"); // Circle type
-                    slvs.push_str(&format!("Entity.name={}\n", id));
-                    slvs.push_str(&format!("Entity.param[0].v={:08x}\n", param_id));
-                    slvs.push_str(&format!("Entity.param[1].v={:08x}\n", param_id + 1));
-                    slvs.push_str(&format!("Entity.param[2].v={:08x}\n", param_id + 2));
-                    slvs.push_str(&format!("Entity.param[3].v={:08x}\n\n", param_id + 3));
+                ResolvedEntity::Circle {
+                    center, diameter, ..
+                } => {
+                    // Center point parameters, then the radius
+                    params(sink, param_id, center)?;
+                    sink.param(param_id + 3, diameter / 2.0)?;
+                    sink.record(
+                        b'e',
+                        &[
+                            h,
+                            ("Entity.type", Int(4000)), // Circle type
+                            name,
+                            ("Entity.param[0].v", Hex(param_id)),
+                            ("Entity.param[1].v", Hex(param_id + 1)),
+                            ("Entity.param[2].v", Hex(param_id + 2)),
+                            ("Entity.param[3].v", Hex(param_id + 3)),
+                        ],
+                    )?;
 
                     param_id += 4;
-                    entity_id += 1;
                 }
                 ResolvedEntity::Line { p1, p2 } => {
-                    // Start point parameters
-                    for (i, coord) in p1.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
-
-                    // End point parameters
-                    for (i, coord) in p2.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + 3 + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
-
-                    slvs.push_str(&format!("Entity.h.v={:08x}\n", entity_id));
-                    slvs.push_str("Entity.type=3000\n"); // Line segment type
-                    slvs.push_str(&format!("Entity.name={}\n", id));
-                    slvs.push_str(&format!("Entity.point[0].v={:08x}\n", entity_id + 0x1000));
-                    slvs.push_str(&format!("Entity.point[1].v={:08x}\n\n", entity_id + 0x1001));
+                    // Start and end point parameters
+                    params(sink, param_id, p1)?;
+                    params(sink, param_id + 3, p2)?;
+                    sink.record(
+                        b'e',
+                        &[
+                            h,
+                            ("Entity.type", Int(3000)), // Line segment type
+                            name,
+                            ("Entity.point[0].v", Hex(entity_id + 0x1000)),
+                            ("Entity.point[1].v", Hex(entity_id + 0x1001)),
+                        ],
+                    )?;
 
                     param_id += 6;
-                    entity_id += 1;
                 }
-                ResolvedEntity::Arc { center, start, end, .. } => {
+                ResolvedEntity::Arc {
+                    center, start, end, ..
+                } => {
                     // For SLVS format, we'll export arc as three points
                     // This is a simplification - proper arc entity would be more complex
-                    
-                    // Center point
-                    for (i, coord) in center.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
-                    
-                    // Start point
-                    for (i, coord) in start.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + 3 + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
-                    
-                    // End point  
-                    for (i, coord) in end.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + 6 + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
-                    
+                    params(sink, param_id, center)?;
+                    params(sink, param_id + 3, start)?;
+                    params(sink, param_id + 6, end)?;
+
                     // Export as arc entity (type 5000)
-                    slvs.push_str(&format!("Entity.h.v={:08x}\n", entity_id));
-                    slvs.push_str("Entity.type=5000\n"); // Arc type
-                    slvs.push_str(&format!("Entity.name={}\n", id));
-                    
+                    sink.record(b'e', &[h, ("Entity.type", Int(5000)), name])?;
+
                     param_id += 9;
-                    entity_id += 1;
                 }
-                ResolvedEntity::Cubic { start, control1, control2, end } => {
+                ResolvedEntity::Cubic { start, end, .. } => {
                     // For SLVS format, cubic beziers aren't directly supported
                     // Export as line from start to end as simplification
-                    
-                    // Start point parameters
-                    for (i, coord) in start.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
+                    params(sink, param_id, start)?;
+                    params(sink, param_id + 3, end)?;
+                    sink.record(
+                        b'e',
+                        &[
+                            h,
+                            ("Entity.type", Int(3000)), // Line segment type (simplified)
+                            ("Entity.name", Str(format!("{}_cubic", id))),
+                            ("Entity.point[0].v", Hex(entity_id + 0x1000)),
+                            ("Entity.point[1].v", Hex(entity_id + 0x1001)),
+                        ],
+                    )?;
 
-                    // End point parameters
-                    for (i, coord) in end.iter().enumerate() {
-                        slvs.push_str(&format!("Param.h.v={:08x}\n", param_id + 3 + i));
-                        slvs.push_str(&format!("Param.val={:.p$}\n\n", coord, p = self.precision));
-                    }
+                    param_id += 6;
+                }
+            }
+            entity_id += 1;
+        }
 
-                    slvs.push_str(&format!("Entity.h.v={:08x}\n", entity_id));
-                    slvs.push_str("Entity.type=3000\n"); // Line segment type (simplified)
-                    slvs.push_str(&format!("Entity.name={}_cubic\n", id));
-                    slvs.push_str(&format!("Entity.point[0].v={:08x}\n", entity_id + 0x1000));
-                    slvs.push_str(&format!("Entity.point[1].v={:08x}\n\n", entity_id + 0x1001));
+        Ok(())
+    }
+}
 
-                    param_id += 6;
-                    entity_id += 1;
+impl crate::StreamExporter for SlvsExporter {
+    fn write_to(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()> {
+        if self.snapshot {
+            let mut snapshot = SnapshotWriter::default();
+            self.walk(entities, &mut snapshot)?;
+            return snapshot.write_to(out);
+        }
+
+        // SLVS text format header
+        out.write_all(b"# SolveSpace Text Format v1\n")?;
+        out.write_all(b"# Generated by slvsx\n\n")?;
+        self.walk(
+            entities,
+            &mut TextWriter {
+                out,
+                precision: self.precision,
+            },
+        )
+    }
+}
+
+/// Where `SlvsExporter::walk` sends the sketch: as text, or into the
+/// sections of a snapshot
+trait Sink {
+    fn param(&mut self, h: u32, val: f64) -> anyhow::Result<()>;
+    /// A group (`b'g'`) or entity (`b'e'`), by its keys in the loader's table
+    fn record(&mut self, kind: u8, fields: &[(&str, SnapshotValue)]) -> anyhow::Result<()>;
+}
+
+struct TextWriter<'a> {
+    out: &'a mut dyn Write,
+    precision: usize,
+}
+
+impl Sink for TextWriter<'_> {
+    fn param(&mut self, h: u32, val: f64) -> anyhow::Result<()> {
+        writeln!(self.out, "Param.h.v={:08x}", h)?;
+        write!(self.out, "Param.val={:.p$}\n\n", val, p = self.precision)?;
+        Ok(())
+    }
+
+    fn record(&mut self, _kind: u8, fields: &[(&str, SnapshotValue)]) -> anyhow::Result<()> {
+        for (key, value) in fields {
+            match value {
+                SnapshotValue::Hex(v) | SnapshotValue::Color(v) => {
+                    writeln!(self.out, "{}={:08x}", key, v)?
+                }
+                SnapshotValue::Int(v) => writeln!(self.out, "{}={}", key, v)?,
+                SnapshotValue::Bool(v) => writeln!(self.out, "{}={}", key, *v as u8)?,
+                SnapshotValue::Real(v) => {
+                    writeln!(self.out, "{}={:.p$}", key, v, p = self.precision)?
+                }
+                SnapshotValue::Str(v) | SnapshotValue::Path(v) => {
+                    writeln!(self.out, "{}={}", key, v)?
+                }
+                SnapshotValue::Remap(_) => anyhow::bail!("{} can't be written as one line", key),
+            }
+        }
+        self.out.write_all(b"\n")?;
+        Ok(())
+    }
+}
+
+// The binary snapshot, as `SaveSnapshot` in libslvs-static/src/file.cpp
+// lays it out: a header, a table of sections, then the sections, each
+// padded to 8 bytes. Params (and, from the core, the cached mesh) are arrays
+// of fixed-size records; groups, requests, entities, constraints and styles
+// are (key, value) pairs ending in END_OF_RECORD, with the keys listed once
+// in their own section. Everything is little-endian here, which the header's
+// byte-order word says.
+const MAGIC: &[u8; 8] = b"SLVSSNAP";
+const VERSION: u32 = 1;
+const BYTE_ORDER: u32 = 0x0102_0304;
+const END_OF_RECORD: u16 = 0xffff;
+const HEADER_SIZE: usize = 24;
+const SECTION_SIZE: usize = 24;
+const KEYS: u32 = b'K' as u32;
+const PARAMS: u32 = b'p' as u32;
+const TRIANGLES: u32 = b'T' as u32;
+const PARAM_SIZE: usize = 16;
+const TRIANGLE_SIZE: usize = 80;
+
+/// A value in a snapshot's records, by the format its key has in the table
+#[derive(Debug, Clone, PartialEq)]
+pub enum SnapshotValue {
+    Hex(u32),
+    Int(i32),
+    Bool(bool),
+    Real(f64),
+    Str(String),
+    Color(u32),
+    /// A path relative to the snapshot, with `/` between its parts
+    Path(String),
+    /// A linked group's (entity, input, copy number) remapping
+    Remap(Vec<(u32, u32, i32)>),
+}
+
+impl SnapshotValue {
+    fn format(&self) -> u8 {
+        match self {
+            SnapshotValue::Hex(_) => b'x',
+            SnapshotValue::Int(_) => b'd',
+            SnapshotValue::Bool(_) => b'b',
+            SnapshotValue::Real(_) => b'f',
+            SnapshotValue::Str(_) => b'S',
+            SnapshotValue::Color(_) => b'c',
+            SnapshotValue::Path(_) => b'P',
+            SnapshotValue::Remap(_) => b'M',
+        }
+    }
+}
+
+/// One triangle of the cached mesh
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SnapshotTriangle {
+    pub face: u32,
+    pub color: u32,
+    pub vertices: [[f64; 3]; 3],
+}
+
+/// A snapshot, read back
+#[derive(Debug, Default, Clone, PartialEq)]
+pub struct Snapshot {
+    /// Each param's handle and value
+    pub params: Vec<(u32, f64)>,
+    /// The records of each kind (`'g'`, `'r'`, `'e'`, `'c'` or `'s'`), in
+    /// the order they were saved, each a list of (key, value)
+    pub records: BTreeMap<char, Vec<Vec<(String, SnapshotValue)>>>,
+    /// The last group's mesh
+    pub triangles: Vec<SnapshotTriangle>,
+}
+
+#[derive(Default)]
+struct SnapshotWriter {
+    keys: Vec<u8>,
+    key_index: HashMap<(String, u8), u16>,
+    /// Each record section's tag, record count and bytes
+    records: Vec<(u32, u32, Vec<u8>)>,
+    params: Vec<u8>,
+}
+
+impl Sink for SnapshotWriter {
+    fn param(&mut self, h: u32, val: f64) -> anyhow::Result<()> {
+        self.params.extend_from_slice(&h.to_le_bytes());
+        self.params.extend_from_slice(&0u32.to_le_bytes());
+        self.params.extend_from_slice(&val.to_le_bytes());
+        Ok(())
+    }
+
+    fn record(&mut self, kind: u8, fields: &[(&str, SnapshotValue)]) -> anyhow::Result<()> {
+        let tag = kind as u32;
+        let at = match self.records.iter().position(|(t, _, _)| *t == tag) {
+            Some(at) => at,
+            None => {
+                self.records.push((tag, 0, Vec::new()));
+                self.records.len() - 1
+            }
+        };
+        let mut out = std::mem::take(&mut self.records[at].2);
+        for (key, value) in fields {
+            let index = self.key(key, value.format())?;
+            out.extend_from_slice(&index.to_le_bytes());
+            put_value(value, &mut out)?;
+        }
+        out.extend_from_slice(&END_OF_RECORD.to_le_bytes());
+        self.records[at].1 += 1;
+        self.records[at].2 = out;
+        Ok(())
+    }
+}
+
+fn put_string(s: &str, out: &mut Vec<u8>) -> anyhow::Result<()> {
+    let len = u32::try_from(s.len())
+        .map_err(|_| anyhow::anyhow!("a string of {} bytes is too long", s.len()))?;
+    out.extend_from_slice(&len.to_le_bytes());
+    out.extend_from_slice(s.as_bytes());
+    Ok(())
+}
+
+fn put_value(value: &SnapshotValue, out: &mut Vec<u8>) -> anyhow::Result<()> {
+    match value {
+        SnapshotValue::Hex(v) | SnapshotValue::Color(v) => out.extend_from_slice(&v.to_le_bytes()),
+        SnapshotValue::Int(v) => out.extend_from_slice(&v.to_le_bytes()),
+        SnapshotValue::Bool(v) => out.push(*v as u8),
+        SnapshotValue::Real(v) => out.extend_from_slice(&v.to_le_bytes()),
+        SnapshotValue::Str(v) | SnapshotValue::Path(v) => put_string(v, out)?,
+        SnapshotValue::Remap(remap) => {
+            out.extend_from_slice(&(remap.len() as u32).to_le_bytes());
+            for (entity, input, copy) in remap {
+                out.extend_from_slice(&entity.to_le_bytes());
+                out.extend_from_slice(&input.to_le_bytes());
+                out.extend_from_slice(&copy.to_le_bytes());
+            }
+        }
+    }
+    Ok(())
+}
+
+impl SnapshotWriter {
+    fn key(&mut self, key: &str, format: u8) -> anyhow::Result<u16> {
+        if let Some(&index) = self.key_index.get(&(key.to_string(), format)) {
+            return Ok(index);
+        }
+        let index = self.key_index.len() as u16;
+        anyhow::ensure!(index != END_OF_RECORD, "too many keys for a snapshot");
+        self.keys.push(format);
+        put_string(key, &mut self.keys)?;
+        self.key_index.insert((key.to_string(), format), index);
+        Ok(index)
+    }
+
+    fn write_to(self, out: &mut dyn Write) -> anyhow::Result<()> {
+        let mut sections: Vec<(u32, u32, &[u8])> =
+            vec![(KEYS, self.key_index.len() as u32, &self.keys)];
+        let groups = self.records.iter().filter(|r| r.0 == b'g' as u32);
+        let others = self.records.iter().filter(|r| r.0 != b'g' as u32);
+        sections.extend(groups.map(|(tag, count, data)| (*tag, *count, data.as_slice())));
+        sections.push((
+            PARAMS,
+            (self.params.len() / PARAM_SIZE) as u32,
+            &self.params,
+        ));
+        sections.extend(others.map(|(tag, count, data)| (*tag, *count, data.as_slice())));
+
+        out.write_all(MAGIC)?;
+        for word in [VERSION, BYTE_ORDER, sections.len() as u32, 0] {
+            out.write_all(&word.to_le_bytes())?;
+        }
+        let mut offset = (HEADER_SIZE + SECTION_SIZE * sections.len()) as u64;
+        for (tag, count, data) in &sections {
+            out.write_all(&tag.to_le_bytes())?;
+            out.write_all(&count.to_le_bytes())?;
+            out.write_all(&offset.to_le_bytes())?;
+            out.write_all(&(data.len() as u64).to_le_bytes())?;
+            offset += (data.len() as u64 + 7) & !7;
+        }
+        for (_, _, data) in &sections {
+            out.write_all(data)?;
+            out.write_all(&[0; 8][..(8 - data.len() % 8) % 8])?;
+        }
+        Ok(())
+    }
+}
+
+/// Reads a snapshot's sections with every read checked against their end
+struct Reader<'a> {
+    bytes: &'a [u8],
+    at: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, n: usize) -> anyhow::Result<&'a [u8]> {
+        let end = self
+            .at
+            .checked_add(n)
+            .filter(|&end| end <= self.bytes.len());
+        let end = end.ok_or_else(|| anyhow::anyhow!("the snapshot is cut short"))?;
+        let taken = &self.bytes[self.at..end];
+        self.at = end;
+        Ok(taken)
+    }
+
+    fn array<const N: usize>(&mut self) -> anyhow::Result<[u8; N]> {
+        Ok(self.take(N)?.try_into().unwrap())
+    }
+
+    fn u16(&mut self) -> anyhow::Result<u16> {
+        Ok(u16::from_le_bytes(self.array()?))
+    }
+
+    fn u32(&mut self) -> anyhow::Result<u32> {
+        Ok(u32::from_le_bytes(self.array()?))
+    }
+
+    fn i32(&mut self) -> anyhow::Result<i32> {
+        Ok(i32::from_le_bytes(self.array()?))
+    }
+
+    fn u64(&mut self) -> anyhow::Result<u64> {
+        Ok(u64::from_le_bytes(self.array()?))
+    }
+
+    fn f64(&mut self) -> anyhow::Result<f64> {
+        Ok(f64::from_le_bytes(self.array()?))
+    }
+
+    fn string(&mut self) -> anyhow::Result<String> {
+        let len = self.u32()? as usize;
+        Ok(String::from_utf8(self.take(len)?.to_vec())?)
+    }
+
+    fn value(&mut self, format: u8) -> anyhow::Result<SnapshotValue> {
+        Ok(match format {
+            b'x' => SnapshotValue::Hex(self.u32()?),
+            b'd' => SnapshotValue::Int(self.i32()?),
+            b'b' => SnapshotValue::Bool(self.take(1)?[0] != 0),
+            b'f' => SnapshotValue::Real(self.f64()?),
+            b'S' => SnapshotValue::Str(self.string()?),
+            b'c' => SnapshotValue::Color(self.u32()?),
+            b'P' => SnapshotValue::Path(self.string()?),
+            b'M' => {
+                let count = self.u32()? as usize;
+                let mut remap = Vec::with_capacity(count.min(self.bytes.len() / 12));
+                for _ in 0..count {
+                    remap.push((self.u32()?, self.u32()?, self.i32()?));
                 }
+                SnapshotValue::Remap(remap)
+            }
+            _ => anyhow::bail!(
+                "the snapshot has a key of unknown format {:?}",
+                format as char
+            ),
+        })
+    }
+}
+
+impl Snapshot {
+    /// Whether `bytes` start as a snapshot does
+    pub fn recognizes(bytes: &[u8]) -> bool {
+        bytes.starts_with(MAGIC)
+    }
+
+    pub fn read(bytes: &[u8]) -> anyhow::Result<Snapshot> {
+        anyhow::ensure!(Self::recognizes(bytes), "not a snapshot");
+        let mut header = Reader {
+            bytes,
+            at: MAGIC.len(),
+        };
+        let (version, byte_order, count) = (header.u32()?, header.u32()?, header.u32()?);
+        anyhow::ensure!(
+            version == VERSION,
+            "snapshot version {} isn't supported",
+            version
+        );
+        anyhow::ensure!(
+            byte_order == BYTE_ORDER,
+            "the snapshot was written big-endian"
+        );
+        header.u32()?;
+
+        let mut sections = Vec::new();
+        for _ in 0..count {
+            let (tag, count, offset, size) =
+                (header.u32()?, header.u32()?, header.u64()?, header.u64()?);
+            let start = usize::try_from(offset).ok().filter(|&o| o <= bytes.len());
+            let start =
+                start.ok_or_else(|| anyhow::anyhow!("a snapshot section starts past its end"))?;
+            let data = Reader { bytes, at: start }.take(size as usize)?;
+            sections.push((tag, count as usize, data));
+        }
+        let find = |tag: u32| sections.iter().find(|s| s.0 == tag);
+
+        let mut keys = Vec::new();
+        if let Some(&(_, count, data)) = find(KEYS) {
+            let mut r = Reader { bytes: data, at: 0 };
+            for _ in 0..count {
+                let format = r.take(1)?[0];
+                keys.push((format, r.string()?));
             }
         }
 
-        Ok(slvs)
+        let mut snapshot = Snapshot::default();
+        if let Some(&(_, count, data)) = find(PARAMS) {
+            anyhow::ensure!(
+                data.len() == count * PARAM_SIZE,
+                "the snapshot's params are the wrong size"
+            );
+            for param in data.chunks_exact(PARAM_SIZE) {
+                let mut r = Reader {
+                    bytes: param,
+                    at: 0,
+                };
+                let h = r.u32()?;
+                r.u32()?;
+                snapshot.params.push((h, r.f64()?));
+            }
+        }
+        if let Some(&(_, count, data)) = find(TRIANGLES) {
+            anyhow::ensure!(
+                data.len() == count * TRIANGLE_SIZE,
+                "the snapshot's mesh is the wrong size"
+            );
+            for triangle in data.chunks_exact(TRIANGLE_SIZE) {
+                let mut r = Reader {
+                    bytes: triangle,
+                    at: 0,
+                };
+                let (face, color) = (r.u32()?, r.u32()?);
+                let mut vertices = [[0.0; 3]; 3];
+                for v in vertices.iter_mut().flatten() {
+                    *v = r.f64()?;
+                }
+                snapshot.triangles.push(SnapshotTriangle {
+                    face,
+                    color,
+                    vertices,
+                });
+            }
+        }
+        for kind in ['g', 'r', 'e', 'c', 's'] {
+            let Some(&(_, count, data)) = find(kind as u32) else {
+                continue;
+            };
+            let mut r = Reader { bytes: data, at: 0 };
+            let mut records = Vec::new();
+            for _ in 0..count {
+                let mut fields = Vec::new();
+                loop {
+                    let index = r.u16()?;
+                    if index == END_OF_RECORD {
+                        break;
+                    }
+                    let (format, key) = keys.get(index as usize).ok_or_else(|| {
+                        anyhow::anyhow!("a snapshot record has key {} of {}", index, keys.len())
+                    })?;
+                    fields.push((key.clone(), r.value(*format)?));
+                }
+                records.push(fields);
+            }
+            snapshot.records.insert(kind, records);
+        }
+        Ok(snapshot)
     }
 }
 
@@ -257,4 +685,114 @@ mod tests {
         assert!(slvs.contains("Param.h.v=00010000"));
         assert!(slvs.contains("Entity.h.v=00020000"));
     }
+
+    fn snapshot_of(entities: &HashMap<String, ResolvedEntity>) -> Vec<u8> {
+        let mut out = Vec::new();
+        crate::StreamExporter::write_to(&SlvsExporter::new().snapshot(), entities, &mut out)
+            .unwrap();
+        out
+    }
+
+    #[test]
+    fn test_snapshot_round_trips() {
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c1".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![1.0, 2.0, 3.0],
+                diameter: 100.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+
+        let bytes = snapshot_of(&entities);
+        assert!(Snapshot::recognizes(&bytes));
+        let snapshot = Snapshot::read(&bytes).unwrap();
+        assert_eq!(
+            snapshot.params,
+            vec![
+                (0x10000, 1.0),
+                (0x10001, 2.0),
+                (0x10002, 3.0),
+                (0x10003, 50.0)
+            ]
+        );
+        assert_eq!(
+            snapshot.records[&'g'],
+            vec![vec![
+                ("Group.h.v".to_string(), SnapshotValue::Hex(1)),
+                (
+                    "Group.name".to_string(),
+                    SnapshotValue::Str("sketch".to_string())
+                ),
+                ("Group.visible".to_string(), SnapshotValue::Bool(true)),
+            ]]
+        );
+        let entity = &snapshot.records[&'e'][0];
+        assert_eq!(
+            entity[0],
+            ("Entity.h.v".to_string(), SnapshotValue::Hex(0x20000))
+        );
+        assert_eq!(
+            entity[1],
+            ("Entity.type".to_string(), SnapshotValue::Int(4000))
+        );
+        assert_eq!(
+            entity[2],
+            (
+                "Entity.name".to_string(),
+                SnapshotValue::Str("c1".to_string())
+            )
+        );
+        assert!(snapshot.triangles.is_empty());
+    }
+
+    #[test]
+    fn test_snapshot_layout() {
+        let mut entities = HashMap::new();
+        entities.insert(
+            "p1".to_string(),
+            ResolvedEntity::Point {
+                at: vec![0.0, 0.0, 0.0],
+            },
+        );
+        let bytes = snapshot_of(&entities);
+
+        let word = |at: usize| u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap());
+        assert_eq!(&bytes[..8], b"SLVSSNAP");
+        assert_eq!(word(8), 1);
+        assert_eq!(word(12), 0x0102_0304);
+        let sections = word(16) as usize;
+        assert_eq!(sections, 4);
+        for i in 0..sections {
+            let at = 24 + 24 * i;
+            let offset = u64::from_le_bytes(bytes[at + 8..at + 16].try_into().unwrap());
+            assert_eq!(offset % 8, 0);
+        }
+        // The keys come first, then the groups, then the params, 16 bytes each
+        assert_eq!(
+            [word(24), word(48), word(72)],
+            [b'K' as u32, b'g' as u32, b'p' as u32]
+        );
+        assert_eq!(word(76), 3);
+        assert_eq!(bytes.len() % 8, 0);
+    }
+
+    #[test]
+    fn test_snapshot_rejects_bad_input() {
+        let mut entities = HashMap::new();
+        entities.insert(
+            "p1".to_string(),
+            ResolvedEntity::Point {
+                at: vec![0.0, 0.0, 0.0],
+            },
+        );
+        let bytes = snapshot_of(&entities);
+
+        assert!(Snapshot::read(b"# SolveSpace Text Format v1").is_err());
+        assert!(Snapshot::read(&bytes[..bytes.len() - 8]).is_err());
+        let mut newer = bytes.clone();
+        newer[8] = 2;
+        assert!(Snapshot::read(&newer).is_err());
+    }
 }
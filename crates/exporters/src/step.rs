@@ -0,0 +1,552 @@
+//! STEP (ISO 10303-21) boundary representation, laid out as SolveSpace's
+//! `StepFileWriter` writes it: the same header, units and product, then a
+//! MANIFOLD_SOLID_BREP for each solid. The sketch is extruded along +Z as
+//! the STL export extrudes it, but with exact surfaces in place of facets:
+//! each circle into a cylinder, and each closed profile of lines lying in
+//! a plane of constant Z into a prism.
+
+use crate::chain::chain_lines;
+use crate::weld::WELD_TOLERANCE;
+use slvsx_core::ir::ResolvedEntity;
+use std::collections::HashMap;
+use std::fmt;
+use std::io::Write;
+
+pub struct StepExporter {
+    extrusion_height: f64,
+}
+
+impl Default for StepExporter {
+    fn default() -> Self {
+        Self::new(100.0)
+    }
+}
+
+impl StepExporter {
+    pub fn new(extrusion_height: f64) -> Self {
+        Self { extrusion_height }
+    }
+
+    pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String> {
+        crate::Exporter::export(self, entities)
+    }
+
+    /// The solids to write, in the order of their (first) entities' ids
+    fn solids<'a>(&self, entities: &'a HashMap<String, ResolvedEntity>) -> Vec<(&'a str, Solid)> {
+        let mut solids: Vec<(&str, Solid)> = entities
+            .iter()
+            .filter_map(|(id, entity)| match entity {
+                ResolvedEntity::Circle {
+                    center, diameter, ..
+                } if *diameter > 0.0 => {
+                    Some((id.as_str(), Solid::Cylinder(point(center), diameter / 2.0)))
+                }
+                _ => None,
+            })
+            .collect();
+        for chain in chain_lines(entities) {
+            if chain.closed {
+                if let Some(profile) = profile(chain.points.clone()) {
+                    solids.push((chain.first_id(), Solid::Prism(profile)));
+                }
+            }
+        }
+        solids.sort_by_key(|(id, _)| *id);
+        solids
+    }
+}
+
+enum Solid {
+    /// Center and radius of the base
+    Cylinder([f64; 3], f64),
+    /// The base, counterclockwise about +Z
+    Prism(Vec<[f64; 3]>),
+}
+
+impl crate::StreamExporter for StepExporter {
+    fn write_to(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()> {
+        let solids = self.solids(entities);
+        if solids.is_empty() {
+            anyhow::bail!("The sketch has no circles or closed profiles to export as solids");
+        }
+
+        out.write_all(HEADER.as_bytes())?;
+        out.write_all(PRODUCT_HEADER.as_bytes())?;
+        // Numbered from past the header's entities, as StepFileWriter does
+        let mut step = Step { out, id: 199 };
+        let mut breps = Vec::with_capacity(solids.len());
+        for (_, solid) in &solids {
+            let faces = match solid {
+                Solid::Cylinder(center, radius) => {
+                    step.cylinder(*center, *radius, self.extrusion_height)?
+                }
+                Solid::Prism(base) => step.prism(base, self.extrusion_height)?,
+            };
+            let shell = step.add(format_args!("CLOSED_SHELL('',({}))", Refs(&faces)))?;
+            breps.push(step.add(format_args!("MANIFOLD_SOLID_BREP('brep',#{})", shell))?);
+            writeln!(step.out)?;
+        }
+        let representation = step.add(format_args!(
+            "ADVANCED_BREP_SHAPE_REPRESENTATION('',({},#170),#168)",
+            Refs(&breps)
+        ))?;
+        step.add(format_args!(
+            "SHAPE_REPRESENTATION_RELATIONSHIP($,$,#169,#{})",
+            representation
+        ))?;
+        step.out.write_all(b"\nENDSEC;\n\nEND-ISO-10303-21;\n")?;
+        Ok(())
+    }
+}
+
+/// A closed chain as the base of a prism: at least three points, all at
+/// one Z, enclosing some area, turned counterclockwise about +Z
+fn profile(mut points: Vec<[f64; 3]>) -> Option<Vec<[f64; 3]>> {
+    let z = points.first()?[2];
+    if points.len() < 3 || points.iter().any(|p| (p[2] - z).abs() > WELD_TOLERANCE) {
+        return None;
+    }
+    let twice_area: f64 = (0..points.len())
+        .map(|i| {
+            let (a, b) = (points[i], points[(i + 1) % points.len()]);
+            a[0] * b[1] - b[0] * a[1]
+        })
+        .sum();
+    if twice_area.abs() <= WELD_TOLERANCE {
+        return None;
+    }
+    if twice_area < 0.0 {
+        points.reverse();
+    }
+    Some(points)
+}
+
+/// Writes numbered entities, each returning its number
+struct Step<'w> {
+    out: &'w mut dyn Write,
+    id: u32,
+}
+
+impl Step<'_> {
+    fn add(&mut self, entity: fmt::Arguments) -> std::io::Result<u32> {
+        self.id += 1;
+        writeln!(self.out, "#{}={};", self.id, entity)?;
+        Ok(self.id)
+    }
+
+    fn point(&mut self, p: [f64; 3]) -> std::io::Result<u32> {
+        self.add(format_args!(
+            "CARTESIAN_POINT('',({},{},{}))",
+            Real(p[0]),
+            Real(p[1]),
+            Real(p[2])
+        ))
+    }
+
+    fn direction(&mut self, d: [f64; 3]) -> std::io::Result<u32> {
+        let d = normalize(d);
+        self.add(format_args!(
+            "DIRECTION('',({},{},{}))",
+            Real(d[0]),
+            Real(d[1]),
+            Real(d[2])
+        ))
+    }
+
+    fn vertex(&mut self, p: [f64; 3]) -> std::io::Result<u32> {
+        let point = self.point(p)?;
+        self.add(format_args!("VERTEX_POINT('',#{})", point))
+    }
+
+    /// Placed at `at`, with Z along `axis` and X along `reference`
+    fn placement(&mut self, at: [f64; 3], axis: u32, reference: u32) -> std::io::Result<u32> {
+        let at = self.point(at)?;
+        self.add(format_args!(
+            "AXIS2_PLACEMENT_3D('',#{},#{},#{})",
+            at, axis, reference
+        ))
+    }
+
+    fn plane(
+        &mut self,
+        at: [f64; 3],
+        normal: [f64; 3],
+        reference: [f64; 3],
+    ) -> std::io::Result<u32> {
+        let (normal, reference) = (self.direction(normal)?, self.direction(reference)?);
+        let placement = self.placement(at, normal, reference)?;
+        self.add(format_args!("PLANE('',#{})", placement))
+    }
+
+    /// The straight edge between two vertices, at points a and b
+    fn line(&mut self, a: ([f64; 3], u32), b: ([f64; 3], u32)) -> std::io::Result<u32> {
+        let along = sub(b.0, a.0);
+        let start = self.point(a.0)?;
+        let direction = self.direction(along)?;
+        let vector = self.add(format_args!(
+            "VECTOR('',#{},{})",
+            direction,
+            Real(length(along))
+        ))?;
+        let line = self.add(format_args!("LINE('',#{},#{})", start, vector))?;
+        self.add(format_args!(
+            "EDGE_CURVE('',#{},#{},#{},.T.)",
+            a.1, b.1, line
+        ))
+    }
+
+    /// A face bounded by the edges, each taken along its curve or against
+    /// it, counterclockwise about the surface's normal
+    fn face(&mut self, surface: u32, edges: &[(u32, bool)]) -> std::io::Result<u32> {
+        let mut oriented = Vec::with_capacity(edges.len());
+        for &(edge, along) in edges {
+            let sense = if along { 'T' } else { 'F' };
+            oriented.push(self.add(format_args!("ORIENTED_EDGE('',*,*,#{},.{}.)", edge, sense))?);
+        }
+        let edge_loop = self.add(format_args!("EDGE_LOOP('',({}))", Refs(&oriented)))?;
+        let bound = self.add(format_args!("FACE_OUTER_BOUND('',#{},.T.)", edge_loop))?;
+        self.add(format_args!(
+            "ADVANCED_FACE('',(#{}),#{},.T.)",
+            bound, surface
+        ))
+    }
+
+    /// The base, the top, and the side between them, each bounded by the
+    /// full circles round the base and top and the seam line joining them
+    /// at +X
+    fn cylinder(
+        &mut self,
+        center: [f64; 3],
+        radius: f64,
+        height: f64,
+    ) -> std::io::Result<Vec<u32>> {
+        let top = [center[0], center[1], center[2] + height];
+        let seam = [center[0] + radius, center[1], center[2]];
+        let seam_top = [seam[0], seam[1], top[2]];
+        let (up, x) = (
+            self.direction([0.0, 0.0, 1.0])?,
+            self.direction([1.0, 0.0, 0.0])?,
+        );
+
+        let (base_vertex, top_vertex) = (self.vertex(seam)?, self.vertex(seam_top)?);
+        let rim = |step: &mut Self, at: [f64; 3], vertex: u32| -> std::io::Result<(u32, u32)> {
+            let axis = step.placement(at, up, x)?;
+            let circle = step.add(format_args!("CIRCLE('',#{},{})", axis, Real(radius)))?;
+            let edge = step.add(format_args!(
+                "EDGE_CURVE('',#{},#{},#{},.T.)",
+                vertex, vertex, circle
+            ))?;
+            Ok((axis, edge))
+        };
+        let (base_axis, base_edge) = rim(self, center, base_vertex)?;
+        let (top_axis, top_edge) = rim(self, top, top_vertex)?;
+        let seam_edge = self.line((seam, base_vertex), (seam_top, top_vertex))?;
+
+        let base_plane = self.plane(center, [0.0, 0.0, -1.0], [1.0, 0.0, 0.0])?;
+        let top_plane = self.add(format_args!("PLANE('',#{})", top_axis))?;
+        let side = self.add(format_args!(
+            "CYLINDRICAL_SURFACE('',#{},{})",
+            base_axis,
+            Real(radius)
+        ))?;
+        Ok(vec![
+            self.face(base_plane, &[(base_edge, false)])?,
+            self.face(
+                side,
+                &[
+                    (base_edge, true),
+                    (seam_edge, true),
+                    (top_edge, false),
+                    (seam_edge, false),
+                ],
+            )?,
+            self.face(top_plane, &[(top_edge, true)])?,
+        ])
+    }
+
+    /// The base, the top, and a planar side on each edge of the base
+    fn prism(&mut self, base: &[[f64; 3]], height: f64) -> std::io::Result<Vec<u32>> {
+        let n = base.len();
+        let top: Vec<[f64; 3]> = base.iter().map(|p| [p[0], p[1], p[2] + height]).collect();
+        let base_vertices = base
+            .iter()
+            .map(|&p| self.vertex(p))
+            .collect::<std::io::Result<Vec<_>>>()?;
+        let top_vertices = top
+            .iter()
+            .map(|&p| self.vertex(p))
+            .collect::<std::io::Result<Vec<_>>>()?;
+        let (mut base_edges, mut top_edges, mut risers) = (vec![], vec![], vec![]);
+        for i in 0..n {
+            let j = (i + 1) % n;
+            base_edges.push(self.line((base[i], base_vertices[i]), (base[j], base_vertices[j]))?);
+            top_edges.push(self.line((top[i], top_vertices[i]), (top[j], top_vertices[j]))?);
+            risers.push(self.line((base[i], base_vertices[i]), (top[i], top_vertices[i]))?);
+        }
+
+        let reference = sub(base[1], base[0]);
+        let base_plane = self.plane(base[0], [0.0, 0.0, -1.0], reference)?;
+        let mut faces = vec![self.face(
+            base_plane,
+            &(0..n)
+                .rev()
+                .map(|i| (base_edges[i], false))
+                .collect::<Vec<_>>(),
+        )?];
+        for i in 0..n {
+            let j = (i + 1) % n;
+            let along = sub(base[j], base[i]);
+            // Outward, to the right of a counterclockwise base
+            let outward = [along[1], -along[0], 0.0];
+            let plane = self.plane(base[i], outward, along)?;
+            faces.push(self.face(
+                plane,
+                &[
+                    (base_edges[i], true),
+                    (risers[j], true),
+                    (top_edges[i], false),
+                    (risers[i], false),
+                ],
+            )?);
+        }
+        let top_plane = self.plane(top[0], [0.0, 0.0, 1.0], reference)?;
+        faces.push(self.face(
+            top_plane,
+            &(0..n).map(|i| (top_edges[i], true)).collect::<Vec<_>>(),
+        )?);
+        Ok(faces)
+    }
+}
+
+/// A STEP real, to the five places StepFileWriter writes, and never a
+/// negative zero
+struct Real(f64);
+
+impl fmt::Display for Real {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        let v = if self.0.abs() < 5e-6 { 0.0 } else { self.0 };
+        write!(f, "{:.5}", v)
+    }
+}
+
+/// A list of entity references, comma separated
+struct Refs<'a>(&'a [u32]);
+
+impl fmt::Display for Refs<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        for (i, id) in self.0.iter().enumerate() {
+            write!(f, "{}#{}", if i == 0 { "" } else { "," }, id)?;
+        }
+        Ok(())
+    }
+}
+
+fn point(p: &[f64]) -> [f64; 3] {
+    [0, 1, 2].map(|i| p.get(i).copied().unwrap_or(0.0))
+}
+
+fn sub(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+}
+
+fn length(a: [f64; 3]) -> f64 {
+    (a[0] * a[0] + a[1] * a[1] + a[2] * a[2]).sqrt()
+}
+
+fn normalize(a: [f64; 3]) -> [f64; 3] {
+    let l = length(a);
+    if l > 0.0 {
+        a.map(|c| c / l)
+    } else {
+        a
+    }
+}
+
+/// The units, tolerance and representation context, always the same, as
+/// StepFileWriter::WriteHeader gives them
+const HEADER: &str = "ISO-10303-21;
+HEADER;
+
+FILE_DESCRIPTION((''), '2;1');
+
+FILE_NAME(
+    'output_file',
+    '2009-06-07T17:44:47-07:00',
+    (''),
+    (''),
+    'slvsx',
+    '',
+    ''
+);
+
+FILE_SCHEMA (('CONFIG_CONTROL_DESIGN'));
+ENDSEC;
+
+DATA;
+
+#158=(
+LENGTH_UNIT()
+NAMED_UNIT(*)
+SI_UNIT(.MILLI.,.METRE.)
+);
+#161=(
+NAMED_UNIT(*)
+PLANE_ANGLE_UNIT()
+SI_UNIT($,.RADIAN.)
+);
+#166=(
+NAMED_UNIT(*)
+SI_UNIT($,.STERADIAN.)
+SOLID_ANGLE_UNIT()
+);
+#167=UNCERTAINTY_MEASURE_WITH_UNIT(LENGTH_MEASURE(0.000002),#158,
+'DISTANCE_ACCURACY_VALUE',
+'string');
+#168=(
+GEOMETRIC_REPRESENTATION_CONTEXT(3)
+GLOBAL_UNCERTAINTY_ASSIGNED_CONTEXT((#167))
+GLOBAL_UNIT_ASSIGNED_CONTEXT((#166,#161,#158))
+REPRESENTATION_CONTEXT('ID1','3D')
+);
+#169=SHAPE_REPRESENTATION('',(#170),#168);
+#170=AXIS2_PLACEMENT_3D('',#173,#171,#172);
+#171=DIRECTION('',(0.,0.,1.));
+#172=DIRECTION('',(1.,0.,0.));
+#173=CARTESIAN_POINT('',(0.,0.,0.));
+
+";
+
+const PRODUCT_HEADER: &str = "#175 = SHAPE_DEFINITION_REPRESENTATION(#176, #169);
+#176 = PRODUCT_DEFINITION_SHAPE('Version', 'Test Part', #177);
+#177 = PRODUCT_DEFINITION('Version', 'Test Part', #182, #178);
+#178 = DESIGN_CONTEXT('3D Mechanical Parts', #181, 'design');
+#179 = PRODUCT('1', 'Product', 'Test Part', (#180));
+#180 = MECHANICAL_CONTEXT('3D Mechanical Parts', #181, 'mechanical');
+#181 = APPLICATION_CONTEXT(
+'configuration controlled 3d designs of mechanical parts and assemblies');
+#182 = PRODUCT_DEFINITION_FORMATION_WITH_SPECIFIED_SOURCE('Version',
+'Test Part', #179, .MADE.);
+
+";
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn line(a: [f64; 2], b: [f64; 2]) -> ResolvedEntity {
+        ResolvedEntity::Line {
+            p1: vec![a[0], a[1], 0.0],
+            p2: vec![b[0], b[1], 0.0],
+        }
+    }
+
+    /// Every #n referred to is defined, and none twice
+    fn assert_references_resolve(step: &str) {
+        let mut defined = std::collections::HashSet::new();
+        for line in step.lines() {
+            if let Some(rest) = line.strip_prefix('#') {
+                let id: String = rest.chars().take_while(char::is_ascii_digit).collect();
+                assert!(defined.insert(id.clone()), "#{} defined twice", id);
+            }
+        }
+        for (i, _) in step.match_indices('#') {
+            let id: String = step[i + 1..]
+                .chars()
+                .take_while(char::is_ascii_digit)
+                .collect();
+            assert!(defined.contains(&id), "#{} is not defined", id);
+        }
+    }
+
+    #[test]
+    fn test_export_empty_is_an_error() {
+        assert!(StepExporter::default().export(&HashMap::new()).is_err());
+    }
+
+    #[test]
+    fn test_export_cylinder() {
+        let mut entities = HashMap::new();
+        entities.insert(
+            "c1".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![0.0, 0.0, 0.0],
+                diameter: 10.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let step = StepExporter::new(20.0).export(&entities).unwrap();
+        assert!(step.starts_with("ISO-10303-21;\n"));
+        assert!(step.ends_with("END-ISO-10303-21;\n"));
+        assert_eq!(step.matches("MANIFOLD_SOLID_BREP(").count(), 1);
+        assert_eq!(step.matches("ADVANCED_FACE(").count(), 3);
+        assert_eq!(step.matches("CYLINDRICAL_SURFACE(").count(), 1);
+        assert_eq!(step.matches("=CIRCLE('',").count(), 2);
+        assert!(step.contains("CARTESIAN_POINT('',(5.00000,0.00000,20.00000))"));
+        assert_references_resolve(&step);
+    }
+
+    #[test]
+    fn test_export_closed_profile_as_prism() {
+        let mut entities = HashMap::new();
+        // A triangle drawn clockwise, and a line that closes nothing
+        entities.insert("a".to_string(), line([0.0, 0.0], [0.0, 10.0]));
+        entities.insert("b".to_string(), line([0.0, 10.0], [10.0, 0.0]));
+        entities.insert("c".to_string(), line([10.0, 0.0], [0.0, 0.0]));
+        entities.insert("d".to_string(), line([50.0, 0.0], [60.0, 0.0]));
+
+        let step = StepExporter::new(5.0).export(&entities).unwrap();
+        assert_eq!(step.matches("MANIFOLD_SOLID_BREP(").count(), 1);
+        // Base, top and three sides
+        assert_eq!(step.matches("ADVANCED_FACE(").count(), 5);
+        assert_eq!(step.matches("=PLANE(").count(), 5);
+        assert_eq!(step.matches("=EDGE_CURVE(").count(), 9);
+        assert!(!step.contains("60.00000"));
+        assert_references_resolve(&step);
+    }
+
+    #[test]
+    fn test_every_edge_is_used_once_each_way() {
+        let mut entities = HashMap::new();
+        for (id, a, b) in [
+            ("a", [0.0, 0.0], [4.0, 0.0]),
+            ("b", [4.0, 0.0], [4.0, 3.0]),
+            ("c", [4.0, 3.0], [0.0, 0.0]),
+        ] {
+            entities.insert(id.to_string(), line(a, b));
+        }
+        entities.insert(
+            "z".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![9.0, 9.0, 0.0],
+                diameter: 2.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        let step = StepExporter::default().export(&entities).unwrap();
+
+        // Each edge of a closed shell bounds two faces, once along it and
+        // once against it
+        let mut uses: HashMap<String, (usize, usize)> = HashMap::new();
+        for line in step.lines().filter(|l| l.contains("=ORIENTED_EDGE(")) {
+            let edge = line
+                .split(",*,*,")
+                .nth(1)
+                .unwrap()
+                .split(',')
+                .next()
+                .unwrap();
+            let count = uses.entry(edge.to_string()).or_default();
+            if line.ends_with(".T.);") {
+                count.0 += 1
+            } else {
+                count.1 += 1
+            }
+        }
+        assert_eq!(uses.len(), step.matches("=EDGE_CURVE(").count());
+        assert!(uses.values().all(|&u| u == (1, 1)), "{:?}", uses);
+    }
+}
@@ -1,147 +1,458 @@
+use crate::mesh::{IndexedMesh, WELD_TOLERANCE};
 use slvsx_core::ir::ResolvedEntity;
 use std::collections::HashMap;
 use std::f64::consts::PI;
-
+use std::io::Write;
+use std::thread;
+
+/// Segments in a full turn of a circle or arc, and along a cubic, when no
+/// chord tolerance is set
+const TURN_SEGMENTS: usize = 32;
+const CUBIC_SEGMENTS: usize = 16;
+/// The most segments one curve is cut into, however fine the tolerance
+const MAX_SEGMENTS: usize = 4096;
+
+/// Extrudes the sketch along +Z: each circle into a closed cylinder, and
+/// each arc and cubic into an open wall
 pub struct StlExporter {
     extrusion_height: f64,
+    binary: bool,
+    chord_tolerance: Option<f64>,
+    max_triangles: usize,
+    max_error: f64,
 }
 
 impl Default for StlExporter {
     fn default() -> Self {
-        Self {
-            extrusion_height: 100.0,
-        }
+        Self::new(100.0)
     }
 }
 
+/// One facet, with its outward normal
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct Triangle {
+    pub normal: [f64; 3],
+    pub vertices: [[f64; 3]; 3],
+}
+
 impl StlExporter {
     pub fn new(extrusion_height: f64) -> Self {
-        Self { extrusion_height }
+        Self {
+            extrusion_height,
+            binary: false,
+            chord_tolerance: None,
+            max_triangles: 0,
+            max_error: 0.0,
+        }
+    }
+
+    /// Write binary STL, 50 bytes a triangle, rather than ASCII. Binary
+    /// output isn't text, so only `export` and `write_to` can give it.
+    pub fn binary(mut self) -> Self {
+        self.binary = true;
+        self
+    }
+
+    /// Cut each curve into as few segments as keep every chord within
+    /// `tolerance` of it, rather than into a fixed count
+    pub fn with_chord_tolerance(mut self, tolerance: f64) -> Self {
+        self.chord_tolerance = Some(tolerance).filter(|t| *t > 0.0);
+        self
+    }
+
+    /// Simplify the solid to at most `max_triangles` facets, as a preview
+    /// needs; zero is no limit
+    pub fn with_max_triangles(mut self, max_triangles: usize) -> Self {
+        self.max_triangles = max_triangles;
+        self
+    }
+
+    /// Simplify the solid as far as moves no vertex much more than
+    /// `max_error`; zero is no limit
+    pub fn with_max_error(mut self, max_error: f64) -> Self {
+        self.max_error = max_error.max(0.0);
+        self
     }
 
     pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<Vec<u8>> {
         let mut stl = Vec::new();
+        crate::StreamExporter::write_to(self, entities, &mut stl)?;
+        Ok(stl)
+    }
 
-        // STL ASCII header
-        stl.extend_from_slice(b"solid model\n");
+    /// Every facet of the solid, in the order of the entities' ids
+    pub fn triangles(&self, entities: &HashMap<String, ResolvedEntity>) -> Vec<Triangle> {
+        let workers = thread::available_parallelism().map_or(1, |n| n.get());
+        let triangles = self.tessellate(entities, workers);
+        let over = self.max_triangles > 0 && triangles.len() > self.max_triangles;
+        if !over && self.max_error <= 0.0 {
+            return triangles;
+        }
+        let mesh = IndexedMesh::weld(&triangles, WELD_TOLERANCE)
+            .simplified(self.max_triangles, self.max_error);
+        let at = |v: u32| mesh.vertices[v as usize];
+        mesh.faces
+            .iter()
+            .map(|&[a, b, c]| facet(at(a), at(b), at(c)))
+            .collect()
+    }
 
-        // Generate cylinder for each circle entity
-        for (_id, entity) in entities {
-            match entity {
-                ResolvedEntity::Circle { center, diameter, .. } => {
-                    self.add_cylinder_to_stl(&mut stl, center, *diameter)?;
+    /// Each entity's facets are counted first, so all of them go into one
+    /// buffer made at its full size; the entities are then split into runs
+    /// of about equal facet counts, each filling its own part of the buffer
+    /// on a thread of its own
+    fn tessellate(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        workers: usize,
+    ) -> Vec<Triangle> {
+        let mut sorted: Vec<_> = entities.iter().collect();
+        sorted.sort_by_key(|(id, _)| *id);
+        let shapes: Vec<Shape> = sorted
+            .into_iter()
+            .filter_map(|(_, e)| self.shape(e))
+            .collect();
+        let total: usize = shapes.iter().map(Shape::triangle_count).sum();
+        let mut buffer = vec![Triangle::default(); total];
+
+        let workers = workers.clamp(1, shapes.len().max(1));
+        if workers == 1 {
+            fill_all(&shapes, self.extrusion_height, &mut buffer);
+            return buffer;
+        }
+        let per_worker = total.div_ceil(workers);
+        thread::scope(|scope| {
+            let mut rest: &mut [Triangle] = &mut buffer;
+            let mut start = 0;
+            while start < shapes.len() {
+                let (mut end, mut count) = (start, 0);
+                while end < shapes.len()
+                    && (count == 0 || count + shapes[end].triangle_count() <= per_worker)
+                {
+                    count += shapes[end].triangle_count();
+                    end += 1;
                 }
-                _ => {} // Skip other entities
+                let (chunk, tail) = std::mem::take(&mut rest).split_at_mut(count);
+                rest = tail;
+                let run = &shapes[start..end];
+                let height = self.extrusion_height;
+                scope.spawn(move || fill_all(run, height, chunk));
+                start = end;
             }
-        }
+        });
+        buffer
+    }
 
-        // STL footer
-        stl.extend_from_slice(b"endsolid model\n");
+    fn shape<'a>(&self, entity: &'a ResolvedEntity) -> Option<Shape<'a>> {
+        match entity {
+            ResolvedEntity::Circle {
+                center, diameter, ..
+            } => {
+                let radius = diameter / 2.0;
+                let segments = self.turn_segments(radius, 2.0 * PI).max(3);
+                Some(Shape::Cylinder {
+                    center,
+                    radius,
+                    segments,
+                })
+            }
+            ResolvedEntity::Arc {
+                center,
+                start,
+                end,
+                normal,
+            } => {
+                let arc = Arc::new(point(center), point(start), point(end), point(normal));
+                let segments = self.turn_segments(arc.radius, arc.sweep);
+                Some(Shape::Arc { arc, segments })
+            }
+            ResolvedEntity::Cubic {
+                start,
+                control1,
+                control2,
+                end,
+            } => {
+                let points = [point(start), point(control1), point(control2), point(end)];
+                let segments = match self.chord_tolerance {
+                    // A cubic's second derivative is at most six times its
+                    // largest second difference, and a chord strays by at
+                    // most an eighth of that over its length squared
+                    Some(tolerance) => {
+                        let bend = |a: [f64; 3], b: [f64; 3], c: [f64; 3]| {
+                            length([0, 1, 2].map(|i| a[i] - 2.0 * b[i] + c[i]))
+                        };
+                        let most = bend(points[0], points[1], points[2])
+                            .max(bend(points[1], points[2], points[3]));
+                        (0.75 * most / tolerance).sqrt().ceil() as usize
+                    }
+                    None => CUBIC_SEGMENTS,
+                };
+                Some(Shape::Cubic {
+                    points,
+                    segments: segments.clamp(1, MAX_SEGMENTS),
+                })
+            }
+            _ => None, // Skip other entities
+        }
+    }
 
-        Ok(stl)
+    /// Segments for `sweep` radians of a curve of this radius
+    fn turn_segments(&self, radius: f64, sweep: f64) -> usize {
+        let step = match self.chord_tolerance {
+            // A chord of angle a strays r(1 - cos(a/2)) from its arc
+            Some(tolerance) if tolerance < radius => 2.0 * (1.0 - tolerance / radius).acos(),
+            Some(_) => PI,
+            None => 2.0 * PI / TURN_SEGMENTS as f64,
+        };
+        ((sweep / step).ceil() as usize).clamp(1, MAX_SEGMENTS)
     }
+}
 
-    fn add_cylinder_to_stl(
+impl crate::StreamExporter for StlExporter {
+    fn write_to(
         &self,
-        stl: &mut Vec<u8>,
-        center: &[f64],
-        diameter: f64,
+        entities: &HashMap<String, ResolvedEntity>,
+        stl: &mut dyn Write,
     ) -> anyhow::Result<()> {
-        let cx = center.get(0).copied().unwrap_or(0.0);
-        let cy = center.get(1).copied().unwrap_or(0.0);
-        let base_z = center.get(2).copied().unwrap_or(0.0);
-        let radius = diameter / 2.0;
-
-        // Number of segments for circle approximation
-        let segments = 32;
-        let angle_step = 2.0 * PI / segments as f64;
-
-        // Generate top and bottom faces
-        for z in [base_z, base_z + self.extrusion_height] {
-            let normal = if z == base_z { "0 0 -1" } else { "0 0 1" };
-
-            // Triangle fan from center
-            for i in 0..segments {
-                let angle1 = i as f64 * angle_step;
-                let angle2 = (i + 1) as f64 * angle_step;
-
-                let triangle = format!(
-                    "  facet normal {}\n    outer loop\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n    endloop\n  endfacet\n",
-                    normal,
-                    cx, cy, z,
-                    cx + radius * angle1.cos(), cy + radius * angle1.sin(), z,
-                    cx + radius * angle2.cos(), cy + radius * angle2.sin(), z
-                );
-                stl.extend_from_slice(triangle.as_bytes());
+        let triangles = self.triangles(entities);
+        if self.binary {
+            write_binary(stl, &triangles)
+        } else {
+            write_ascii(stl, &triangles)?;
+            Ok(())
+        }
+    }
+}
+
+fn write_ascii(stl: &mut dyn Write, triangles: &[Triangle]) -> std::io::Result<()> {
+    stl.write_all(b"solid model\n")?;
+    for t in triangles {
+        let [a, b, c] = t.vertices;
+        write!(
+            stl,
+            "  facet normal {:.6} {:.6} {:.6}\n    outer loop\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n    endloop\n  endfacet\n",
+            t.normal[0], t.normal[1], t.normal[2],
+            a[0], a[1], a[2],
+            b[0], b[1], b[2],
+            c[0], c[1], c[2]
+        )?;
+    }
+    stl.write_all(b"endsolid model\n")
+}
+
+/// An 80-byte header (which mustn't start "solid", or readers take the
+/// file for ASCII), the count of triangles, then each as twelve
+/// little-endian floats and a zero attribute word
+fn write_binary(stl: &mut dyn Write, triangles: &[Triangle]) -> anyhow::Result<()> {
+    let count = u32::try_from(triangles.len())
+        .map_err(|_| anyhow::anyhow!("{} triangles is too many for binary STL", triangles.len()))?;
+    let mut header = [b' '; 80];
+    header[..17].copy_from_slice(b"slvsx binary STL ");
+    stl.write_all(&header)?;
+    stl.write_all(&count.to_le_bytes())?;
+    let mut record = [0u8; 50];
+    for t in triangles {
+        let floats = std::iter::once(&t.normal).chain(&t.vertices).flatten();
+        for (i, v) in floats.enumerate() {
+            record[i * 4..i * 4 + 4].copy_from_slice(&(*v as f32).to_le_bytes());
+        }
+        stl.write_all(&record)?;
+    }
+    Ok(())
+}
+
+/// An entity to tessellate, and into how many segments
+enum Shape<'a> {
+    Cylinder {
+        center: &'a [f64],
+        radius: f64,
+        segments: usize,
+    },
+    Arc {
+        arc: Arc,
+        segments: usize,
+    },
+    Cubic {
+        points: [[f64; 3]; 4],
+        segments: usize,
+    },
+}
+
+impl Shape<'_> {
+    fn triangle_count(&self) -> usize {
+        match self {
+            // Two caps of a fan each, and a wall
+            Shape::Cylinder { segments, .. } => 4 * segments,
+            Shape::Arc { segments, .. } | Shape::Cubic { segments, .. } => 2 * segments,
+        }
+    }
+
+    fn fill(&self, height: f64, out: &mut [Triangle]) {
+        match self {
+            Shape::Cylinder {
+                center,
+                radius,
+                segments,
+            } => {
+                let [cx, cy, z] = point(center);
+                let (bottom, top) = ([cx, cy, z], [cx, cy, z + height]);
+                let at = |i: usize, z: f64| {
+                    let angle = (i % segments) as f64 * 2.0 * PI / *segments as f64;
+                    [cx + radius * angle.cos(), cy + radius * angle.sin(), z]
+                };
+                let (caps, walls) = out.split_at_mut(2 * segments);
+                for i in 0..*segments {
+                    caps[2 * i] = facet(bottom, at(i + 1, bottom[2]), at(i, bottom[2]));
+                    caps[2 * i + 1] = facet(top, at(i, top[2]), at(i + 1, top[2]));
+                    quad(at(i, z), at(i + 1, z), height, &mut walls[2 * i..2 * i + 2]);
+                }
+            }
+            Shape::Arc { arc, segments } => {
+                let step = arc.sweep / *segments as f64;
+                wall(|i| arc.at(i as f64 * step), *segments, height, out);
+            }
+            Shape::Cubic { points, segments } => {
+                let step = 1.0 / *segments as f64;
+                wall(|i| bezier(points, i as f64 * step), *segments, height, out);
             }
         }
+    }
+}
 
-        // Generate side walls
-        for i in 0..segments {
-            let angle = i as f64 * angle_step;
-            let next_angle = (i + 1) as f64 * angle_step;
-
-            self.add_quad_faces(
-                stl,
-                cx + radius * angle.cos(),
-                cy + radius * angle.sin(),
-                cx + radius * next_angle.cos(),
-                cy + radius * next_angle.sin(),
-                base_z,
-                base_z + self.extrusion_height,
-            );
+fn fill_all(shapes: &[Shape], height: f64, out: &mut [Triangle]) {
+    let mut at = 0;
+    for shape in shapes {
+        let n = shape.triangle_count();
+        shape.fill(height, &mut out[at..at + n]);
+        at += n;
+    }
+}
+
+/// An arc turning counterclockwise about its normal from start to end
+pub(crate) struct Arc {
+    center: [f64; 3],
+    /// From the center to the start, and the same turned a quarter about
+    /// the normal
+    u: [f64; 3],
+    v: [f64; 3],
+    pub(crate) radius: f64,
+    pub(crate) sweep: f64,
+}
+
+impl Arc {
+    pub(crate) fn new(center: [f64; 3], start: [f64; 3], end: [f64; 3], normal: [f64; 3]) -> Self {
+        let u = sub(start, center);
+        let radius = length(u);
+        let n = length(normal);
+        let n = if n > 0.0 {
+            normal.map(|c| c / n)
+        } else {
+            [0.0, 0.0, 1.0]
+        };
+        let v = cross(n, u);
+        let to_end = sub(end, center);
+        let mut sweep = dot(to_end, v).atan2(dot(to_end, u));
+        if sweep <= 0.0 {
+            sweep += 2.0 * PI;
+        }
+        Self {
+            center,
+            u,
+            v,
+            radius,
+            sweep,
         }
+    }
 
-        Ok(())
+    pub(crate) fn at(&self, angle: f64) -> [f64; 3] {
+        let (s, c) = angle.sin_cos();
+        [0, 1, 2].map(|i| self.center[i] + self.u[i] * c + self.v[i] * s)
     }
+}
 
-    fn add_quad_faces(
-        &self,
-        stl: &mut Vec<u8>,
-        x1: f64,
-        y1: f64,
-        x2: f64,
-        y2: f64,
-        z1: f64,
-        z2: f64,
-    ) {
-        // Calculate normal (pointing outward)
-        let dx = x2 - x1;
-        let dy = y2 - y1;
-        let len = (dx * dx + dy * dy).sqrt();
-        let nx = dy / len;
-        let ny = -dx / len;
-
-        // First triangle
-        let tri1 = format!(
-            "  facet normal {:.6} {:.6} 0\n    outer loop\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n    endloop\n  endfacet\n",
-            nx, ny,
-            x1, y1, z1,
-            x2, y2, z1,
-            x2, y2, z2
-        );
-        stl.extend_from_slice(tri1.as_bytes());
-
-        // Second triangle
-        let tri2 = format!(
-            "  facet normal {:.6} {:.6} 0\n    outer loop\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n      vertex {:.6} {:.6} {:.6}\n    endloop\n  endfacet\n",
-            nx, ny,
-            x1, y1, z1,
-            x2, y2, z2,
-            x1, y1, z2
-        );
-        stl.extend_from_slice(tri2.as_bytes());
+/// The wall standing on a curve cut into `segments`, through point(0) to
+/// point(segments)
+fn wall(point: impl Fn(usize) -> [f64; 3], segments: usize, height: f64, out: &mut [Triangle]) {
+    let mut from = point(0);
+    for i in 0..segments {
+        let to = point(i + 1);
+        quad(from, to, height, &mut out[2 * i..2 * i + 2]);
+        from = to;
+    }
+}
+
+/// The two facets of the wall `height` high on the segment p1 to p2; its
+/// normal is to the right of the segment, outward for a counterclockwise
+/// curve
+fn quad(p1: [f64; 3], p2: [f64; 3], height: f64, out: &mut [Triangle]) {
+    let up = |p: [f64; 3]| [p[0], p[1], p[2] + height];
+    out[0] = facet(p1, p2, up(p2));
+    out[1] = facet(p1, up(p2), up(p1));
+}
+
+fn facet(a: [f64; 3], b: [f64; 3], c: [f64; 3]) -> Triangle {
+    let n = cross(sub(b, a), sub(c, a));
+    let len = length(n);
+    // Adding zero turns -0 into 0, which ASCII output would print signed
+    let normal = if len > 0.0 {
+        n.map(|x| x / len + 0.0)
+    } else {
+        [0.0; 3]
+    };
+    Triangle {
+        normal,
+        vertices: [a, b, c],
     }
 }
 
+pub(crate) fn bezier(p: &[[f64; 3]; 4], t: f64) -> [f64; 3] {
+    let s = 1.0 - t;
+    let w = [s * s * s, 3.0 * s * s * t, 3.0 * s * t * t, t * t * t];
+    [0, 1, 2].map(|i| (0..4).map(|k| w[k] * p[k][i]).sum())
+}
+
+/// A point's coordinates, missing ones 0
+pub(crate) fn point(p: &[f64]) -> [f64; 3] {
+    [0, 1, 2].map(|i| p.get(i).copied().unwrap_or(0.0))
+}
+
+fn sub(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+}
+
+fn dot(a: [f64; 3], b: [f64; 3]) -> f64 {
+    a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+}
+
+fn cross(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0],
+    ]
+}
+
+fn length(a: [f64; 3]) -> f64 {
+    dot(a, a).sqrt()
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
 
+    fn circle(center: Vec<f64>, diameter: f64) -> ResolvedEntity {
+        ResolvedEntity::Circle {
+            center,
+            diameter,
+            normal: vec![0.0, 0.0, 1.0],
+        }
+    }
+
     #[test]
     fn test_stl_exporter_default() {
         let exporter = StlExporter::default();
         assert_eq!(exporter.extrusion_height, 100.0);
+        assert!(!exporter.binary);
     }
 
     #[test]
@@ -164,14 +475,7 @@ mod tests {
     fn test_export_circle_as_cylinder() {
         let exporter = StlExporter::default();
         let mut entities = HashMap::new();
-        entities.insert(
-            "circle1".to_string(),
-            ResolvedEntity::Circle {
-                center: vec![0.0, 0.0, 0.0],
-                diameter: 48.0,
-                normal: vec![0.0, 0.0, 1.0],
-            },
-        );
+        entities.insert("circle1".to_string(), circle(vec![0.0, 0.0, 0.0], 48.0));
 
         let stl = exporter.export(&entities).unwrap();
         let stl_str = String::from_utf8(stl).unwrap();
@@ -187,26 +491,8 @@ mod tests {
     fn test_export_multiple_circles() {
         let exporter = StlExporter::new(100.0);
         let mut entities = HashMap::new();
-
-        // First circle
-        entities.insert(
-            "circle1".to_string(),
-            ResolvedEntity::Circle {
-                center: vec![0.0, 0.0, 0.0],
-                diameter: 48.0,
-                normal: vec![0.0, 0.0, 1.0],
-            },
-        );
-
-        // Second circle
-        entities.insert(
-            "circle2".to_string(),
-            ResolvedEntity::Circle {
-                center: vec![36.0, 0.0, 0.0],
-                diameter: 24.0,
-                normal: vec![0.0, 0.0, 1.0],
-            },
-        );
+        entities.insert("circle1".to_string(), circle(vec![0.0, 0.0, 0.0], 48.0));
+        entities.insert("circle2".to_string(), circle(vec![36.0, 0.0, 0.0], 24.0));
 
         let stl = exporter.export(&entities).unwrap();
         let stl_str = String::from_utf8(stl).unwrap();
@@ -217,36 +503,30 @@ mod tests {
     }
 
     #[test]
-    fn test_add_quad_faces() {
-        let exporter = StlExporter::default();
-        let mut stl = Vec::new();
+    fn test_quad_faces() {
+        let mut out = [Triangle::default(); 2];
+        quad([0.0, 0.0, 0.0], [1.0, 0.0, 0.0], 10.0, &mut out);
 
-        exporter.add_quad_faces(&mut stl, 0.0, 0.0, 1.0, 0.0, 0.0, 10.0);
-
-        let stl_str = String::from_utf8(stl).unwrap();
-        assert!(stl_str.contains("facet normal"));
-        assert!(stl_str.contains("vertex"));
-        // Should create 2 triangles
-        assert_eq!(stl_str.matches("facet normal").count(), 2);
+        // Two triangles, facing right of the segment
+        for t in out {
+            assert_eq!(t.normal, [0.0, -1.0, 0.0]);
+        }
+        assert_eq!(out[0].vertices[2], [1.0, 0.0, 10.0]);
+        assert_eq!(out[1].vertices[2], [0.0, 0.0, 10.0]);
     }
 
     #[test]
-    fn test_add_cylinder_to_stl() {
+    fn test_cylinder() {
         let exporter = StlExporter::new(50.0);
-        let mut stl = Vec::new();
-
-        let center = vec![10.0, 20.0, 5.0];
-        let diameter = 30.0;
+        let mut entities = HashMap::new();
+        entities.insert("c".to_string(), circle(vec![10.0, 20.0, 5.0], 30.0));
 
-        exporter
-            .add_cylinder_to_stl(&mut stl, &center, diameter)
-            .unwrap();
+        let stl_str = String::from_utf8(exporter.export(&entities).unwrap()).unwrap();
 
-        let stl_str = String::from_utf8(stl).unwrap();
-
-        // Should have facets for top, bottom, and sides
-        let facet_count = stl_str.matches("facet normal").count();
-        assert!(facet_count >= 64); // At least 32 segments * 2 (top/bottom) + sides
+        // 32 segments, each a facet of either cap and two of the wall
+        assert_eq!(stl_str.matches("facet normal").count(), 128);
+        assert!(stl_str.contains("facet normal 0.000000 0.000000 -1.000000"));
+        assert!(stl_str.contains("facet normal 0.000000 0.000000 1.000000"));
 
         // Check that vertices reference the correct center coordinates
         assert!(stl_str.contains("10.000000"));
@@ -258,20 +538,117 @@ mod tests {
     #[test]
     fn test_cylinder_with_default_z() {
         let exporter = StlExporter::default();
-        let mut stl = Vec::new();
+        let mut entities = HashMap::new();
 
         // Test with only x,y coordinates (z should default to 0)
-        let center = vec![15.0, 25.0];
-        let diameter = 40.0;
+        entities.insert("c".to_string(), circle(vec![15.0, 25.0], 40.0));
 
-        exporter
-            .add_cylinder_to_stl(&mut stl, &center, diameter)
-            .unwrap();
-
-        let stl_str = String::from_utf8(stl).unwrap();
+        let stl_str = String::from_utf8(exporter.export(&entities).unwrap()).unwrap();
 
         // Should contain z=0 and z=100 (default height)
         assert!(stl_str.contains(" 0.000000"));
         assert!(stl_str.contains(" 100.000000"));
     }
+
+    #[test]
+    fn test_binary_layout() {
+        let exporter = StlExporter::new(10.0).binary();
+        let mut entities = HashMap::new();
+        entities.insert("c".to_string(), circle(vec![0.0, 0.0, 0.0], 2.0));
+
+        let stl = exporter.export(&entities).unwrap();
+        assert!(!stl.starts_with(b"solid"));
+        assert_eq!(u32::from_le_bytes(stl[80..84].try_into().unwrap()), 128);
+        assert_eq!(stl.len(), 84 + 128 * 50);
+
+        // The first facet is on the bottom cap, facing down
+        let float = |at: usize| f32::from_le_bytes(stl[at..at + 4].try_into().unwrap());
+        assert_eq!([float(84), float(88), float(92)], [0.0, 0.0, -1.0]);
+        assert_eq!(&stl[84 + 48..84 + 50], &[0, 0]);
+    }
+
+    #[test]
+    fn test_chord_tolerance_sets_segments() {
+        let mut entities = HashMap::new();
+        entities.insert("c".to_string(), circle(vec![0.0, 0.0, 0.0], 20.0));
+        let count = |tolerance| {
+            StlExporter::default()
+                .with_chord_tolerance(tolerance)
+                .triangles(&entities)
+                .len()
+        };
+        let (coarse, fine) = (count(0.5), count(0.001));
+        assert!(coarse < 128 && fine > 128, "{} {}", coarse, fine);
+
+        // Each chord is within the tolerance of the circle
+        let triangles = StlExporter::default()
+            .with_chord_tolerance(0.01)
+            .triangles(&entities);
+        let segments = triangles.len() / 4;
+        let sagitta = 10.0 * (1.0 - (PI / segments as f64).cos());
+        assert!(sagitta <= 0.01);
+        let sagitta = 10.0 * (1.0 - (PI / (segments - 1) as f64).cos());
+        assert!(sagitta > 0.01);
+    }
+
+    #[test]
+    fn test_arcs_and_cubics_become_walls() {
+        let mut entities = HashMap::new();
+        entities.insert(
+            "arc".to_string(),
+            ResolvedEntity::Arc {
+                center: vec![0.0, 0.0, 0.0],
+                start: vec![10.0, 0.0, 0.0],
+                end: vec![0.0, 10.0, 0.0],
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        entities.insert(
+            "cubic".to_string(),
+            ResolvedEntity::Cubic {
+                start: vec![0.0, 0.0, 0.0],
+                control1: vec![30.0, 50.0, 0.0],
+                control2: vec![70.0, 50.0, 0.0],
+                end: vec![100.0, 0.0, 0.0],
+            },
+        );
+        let triangles = StlExporter::new(5.0).triangles(&entities);
+
+        // A quarter turn is 8 of 32 segments, and the cubic 16, each a quad
+        assert_eq!(triangles.len(), 2 * 8 + 2 * 16);
+        let arc = &triangles[..16];
+        assert_eq!(arc[0].vertices[0], [10.0, 0.0, 0.0]);
+        let last = arc[15].vertices[1];
+        assert!(last[0].abs() < 1e-9 && (last[1] - 10.0).abs() < 1e-9 && last[2] == 5.0);
+        // The arc turns counterclockwise, so its wall faces out
+        assert!(arc[0].normal[0] > 0.9);
+
+        let cubic = &triangles[16..];
+        assert_eq!(cubic[0].vertices[0], [0.0, 0.0, 0.0]);
+        assert_eq!(cubic[1].vertices[2], [0.0, 0.0, 5.0]);
+        assert_eq!(cubic[30].vertices[1], [100.0, 0.0, 0.0]);
+    }
+
+    #[test]
+    fn test_threads_fill_the_same_buffer() {
+        let mut entities = HashMap::new();
+        for i in 0..40 {
+            let at = vec![i as f64 * 3.0, 0.0, 0.0];
+            entities.insert(format!("c{:02}", i), circle(at, 1.0 + i as f64));
+            entities.insert(
+                format!("a{:02}", i),
+                ResolvedEntity::Arc {
+                    center: vec![0.0, i as f64, 0.0],
+                    start: vec![2.0, i as f64, 0.0],
+                    end: vec![-2.0, i as f64, 0.0],
+                    normal: vec![0.0, 0.0, 1.0],
+                },
+            );
+        }
+        let exporter = StlExporter::default().with_chord_tolerance(0.01);
+        let one = exporter.tessellate(&entities, 1);
+        assert_eq!(exporter.tessellate(&entities, 3), one);
+        assert_eq!(exporter.tessellate(&entities, 16), one);
+        assert!(one.iter().all(|t| t.normal != [0.0; 3]));
+    }
 }
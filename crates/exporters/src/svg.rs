@@ -1,9 +1,8 @@
-use quick_xml::events::{BytesStart, Event};
-use quick_xml::{Reader, Writer};
-use regex::Regex;
+use crate::chain::{chain_lines, Polyline};
 use slvsx_core::ir::ResolvedEntity;
 use std::collections::HashMap;
-use std::io::Cursor;
+use std::fmt;
+use std::io::Write;
 
 /// Normalize a floating point value to avoid -0.0
 /// This ensures consistent output across platforms
@@ -11,68 +10,83 @@ fn normalize_zero(v: f64) -> f64 {
     if v == 0.0 { 0.0_f64.abs() } else { v }
 }
 
-/// Format a float for SVG output, normalizing -0.0 to 0.0
-fn fmt_svg(v: f64, precision: usize) -> String {
-    format!("{:.p$}", normalize_zero(v), p = precision)
+/// A number for SVG output, with a fixed count of decimals, that never
+/// prints as a negative zero: a small negative value that rounds to zero
+/// (-0.0000001 at six places) is written as 0.000000
+pub(crate) struct Fixed(pub(crate) f64, pub(crate) usize);
+
+impl fmt::Display for Fixed {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        let Fixed(v, precision) = *self;
+        if v < 0.0 && v > -1.0 {
+            // Only these can round to zero; format the magnitude first to
+            // see if any digit is left for the sign
+            let mut digits = Digits::default();
+            if fmt::Write::write_fmt(&mut digits, format_args!("{:.p$}", -v, p = precision)).is_ok()
+            {
+                let text = digits.as_str();
+                let sign = if text.bytes().any(|b| (b'1'..=b'9').contains(&b)) {
+                    "-"
+                } else {
+                    ""
+                };
+                return write!(f, "{}{}", sign, text);
+            }
+        }
+        write!(f, "{:.p$}", normalize_zero(v), p = precision)
+    }
 }
 
-/// Sanitize an attribute value, replacing -0.0... patterns with 0.0...
-fn sanitize_attr_value(value: &str) -> String {
-    // Match -0.0 followed by any number of zeros (e.g., -0.000000)
-    let re = Regex::new(r"-0\.0+").unwrap();
-    re.replace_all(value, |caps: &regex::Captures| {
-        caps[0].replacen("-", "", 1)
-    }).to_string()
+/// Room on the stack for a number under one at any precision we write
+#[derive(Default)]
+struct Digits {
+    buf: [u8; 32],
+    len: usize,
 }
 
-/// Post-process SVG using proper XML parsing to sanitize attribute values
-fn sanitize_svg_attributes(svg: &str) -> anyhow::Result<String> {
-    let mut reader = Reader::from_str(svg);
-    reader.trim_text(false);
-    
-    let mut writer = Writer::new(Cursor::new(Vec::new()));
-    
-    loop {
-        match reader.read_event() {
-            Ok(Event::Start(ref e)) => {
-                let name = e.name();
-                let name_str = std::str::from_utf8(name.as_ref())?;
-                let mut elem = BytesStart::new(name_str.to_owned());
-                for attr in e.attributes() {
-                    let attr = attr?;
-                    let key = std::str::from_utf8(attr.key.as_ref())?.to_owned();
-                    let value = std::str::from_utf8(&attr.value)?;
-                    let sanitized = sanitize_attr_value(value);
-                    elem.push_attribute((key.as_str(), sanitized.as_str()));
-                }
-                writer.write_event(Event::Start(elem))?;
-            }
-            Ok(Event::Empty(ref e)) => {
-                let name = e.name();
-                let name_str = std::str::from_utf8(name.as_ref())?;
-                let mut elem = BytesStart::new(name_str.to_owned());
-                for attr in e.attributes() {
-                    let attr = attr?;
-                    let key = std::str::from_utf8(attr.key.as_ref())?.to_owned();
-                    let value = std::str::from_utf8(&attr.value)?;
-                    let sanitized = sanitize_attr_value(value);
-                    elem.push_attribute((key.as_str(), sanitized.as_str()));
-                }
-                writer.write_event(Event::Empty(elem))?;
-            }
-            Ok(Event::Eof) => break,
-            Ok(e) => writer.write_event(e)?,
-            Err(e) => return Err(anyhow::anyhow!("XML parse error: {}", e)),
+impl Digits {
+    fn as_str(&self) -> &str {
+        std::str::from_utf8(&self.buf[..self.len]).unwrap_or("")
+    }
+}
+
+impl fmt::Write for Digits {
+    fn write_str(&mut self, s: &str) -> fmt::Result {
+        let end = self.len + s.len();
+        self.buf
+            .get_mut(self.len..end)
+            .ok_or(fmt::Error)?
+            .copy_from_slice(s.as_bytes());
+        self.len = end;
+        Ok(())
+    }
+}
+
+/// An entity id, escaped for an attribute value
+struct Escaped<'a>(&'a str);
+
+impl fmt::Display for Escaped<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        let mut rest = self.0;
+        while let Some(i) = rest.find(['&', '<', '>', '"']) {
+            f.write_str(&rest[..i])?;
+            f.write_str(match rest.as_bytes()[i] {
+                b'&' => "&amp;",
+                b'<' => "&lt;",
+                b'>' => "&gt;",
+                _ => "&quot;",
+            })?;
+            rest = &rest[i + 1..];
         }
+        f.write_str(rest)
     }
-    
-    let result = writer.into_inner().into_inner();
-    Ok(String::from_utf8(result)?)
 }
 
 pub struct SvgExporter {
     view_plane: ViewPlane,
     precision: usize,
+    chain: bool,
+    extent: Option<[f64; 4]>,
 }
 
 #[derive(Debug, Clone, Copy)]
@@ -83,12 +97,22 @@ pub enum ViewPlane {
     Isometric,
 }
 
+impl ViewPlane {
+    /// The directions in the model that run right and down the drawing,
+    /// so a point is drawn at its dot product with each
+    pub fn axes(&self) -> ([f64; 3], [f64; 3]) {
+        match self {
+            ViewPlane::XY => ([1.0, 0.0, 0.0], [0.0, 1.0, 0.0]),
+            ViewPlane::XZ => ([1.0, 0.0, 0.0], [0.0, 0.0, 1.0]),
+            ViewPlane::YZ => ([0.0, 1.0, 0.0], [0.0, 0.0, 1.0]),
+            ViewPlane::Isometric => ([1.0, -1.0, 0.0], [0.5, 0.5, -1.0]),
+        }
+    }
+}
+
 impl Default for SvgExporter {
     fn default() -> Self {
-        Self {
-            view_plane: ViewPlane::XY,
-            precision: 6,
-        }
+        Self::new(ViewPlane::XY)
     }
 }
 
@@ -97,11 +121,33 @@ impl SvgExporter {
         Self {
             view_plane,
             precision: 6,
+            chain: true,
+            extent: None,
         }
     }
 
+    /// Whether lines that meet end to end are drawn as one path, as they
+    /// are by default, or each as a `<line>` of its own
+    pub fn with_chaining(mut self, chain: bool) -> Self {
+        self.chain = chain;
+        self
+    }
+
+    /// Frame the drawing around this extent, as `extent` gives it, rather
+    /// than around the entities drawn; so that the frames of an animation
+    /// all show the same part of the model
+    pub fn with_extent(mut self, extent: [f64; 4]) -> Self {
+        self.extent = Some(extent);
+        self
+    }
+
     pub fn export(&self, entities: &HashMap<String, ResolvedEntity>) -> anyhow::Result<String> {
-        // Calculate bounding box
+        crate::Exporter::export(self, entities)
+    }
+
+    /// The least and greatest x and y the entities are drawn at, as
+    /// `[min_x, min_y, max_x, max_y]`, or None if there are none
+    pub fn extent(&self, entities: &HashMap<String, ResolvedEntity>) -> Option<[f64; 4]> {
         let mut min_x = f64::INFINITY;
         let mut max_x = f64::NEG_INFINITY;
         let mut min_y = f64::INFINITY;
@@ -166,45 +212,70 @@ impl SvgExporter {
             }
         }
 
+        (min_x.is_finite() && max_x.is_finite()).then_some([min_x, min_y, max_x, max_y])
+    }
+
+    /// The opening `<svg>` tag, framing an extent (as `extent` gives it)
+    /// with a margin around it
+    pub fn write_start(&self, extent: Option<[f64; 4]>, out: &mut dyn Write) -> anyhow::Result<()> {
         // Add padding
         let padding = 20.0;
-        if min_x.is_finite() && max_x.is_finite() {
-            min_x -= padding;
-            max_x += padding;
-            min_y -= padding;
-            max_y += padding;
-        } else {
+        let [min_x, min_y, max_x, max_y] = match extent {
+            Some([min_x, min_y, max_x, max_y]) => [
+                min_x - padding,
+                min_y - padding,
+                max_x + padding,
+                max_y + padding,
+            ],
             // Default view if no entities
-            min_x = -100.0;
-            max_x = 100.0;
-            min_y = -100.0;
-            max_y = 100.0;
-        }
+            None => [-100.0, -100.0, 100.0, 100.0],
+        };
 
         let width = max_x - min_x;
         let height = max_y - min_y;
 
-        let mut svg = format!(
-            r#"<svg xmlns="http://www.w3.org/2000/svg" viewBox="{:.1} {:.1} {:.1} {:.1}" width="800" height="800">"#,
-            min_x, min_y, width, height
-        );
-        svg.push('\n');
+        writeln!(
+            out,
+            r#"<svg xmlns="http://www.w3.org/2000/svg" viewBox="{} {} {} {}" width="800" height="800">"#,
+            Fixed(min_x, 1),
+            Fixed(min_y, 1),
+            Fixed(width, 1),
+            Fixed(height, 1)
+        )?;
+        Ok(())
+    }
 
+    /// The elements that draw the entities, without the `<svg>` around them
+    pub fn write_elements(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()> {
         // Sort entities by ID for deterministic output order
         let mut sorted_entities: Vec<_> = entities.iter().collect();
         sorted_entities.sort_by_key(|(id, _)| *id);
+
+        // Each chain of lines is drawn where its first line would be
+        let chains: HashMap<&str, Polyline> = if self.chain {
+            chain_lines(entities)
+                .into_iter()
+                .map(|c| (c.first_id(), c))
+                .collect()
+        } else {
+            HashMap::new()
+        };
         
         for (id, entity) in sorted_entities {
             match entity {
                 ResolvedEntity::Point { at } => {
                     let (x, y) = self.project_point(at);
-                    svg.push_str(&format!(
+                    writeln!(
+                        out,
                         r#"  <circle id="{}" cx="{}" cy="{}" r="2" fill="black"/>"#,
-                        id,
-                        fmt_svg(x, self.precision),
-                        fmt_svg(y, self.precision),
-                    ));
-                    svg.push('\n');
+                        Escaped(id),
+                        self.num(x),
+                        self.num(y),
+                    )?;
                 }
                 ResolvedEntity::Circle { center, diameter, normal } => {
                     let (cx, cy) = self.project_point(center);
@@ -213,10 +284,14 @@ impl SvgExporter {
                     
                     if (rx - ry).abs() < 0.001 {
                         // Circle appears as circle (no significant distortion)
-                        svg.push_str(&format!(
+                        writeln!(
+                            out,
                             r#"  <circle id="{}" cx="{}" cy="{}" r="{}" fill="none" stroke="black"/>"#,
-                            id, fmt_svg(cx, self.precision), fmt_svg(cy, self.precision), fmt_svg(rx, self.precision)
-                        ));
+                            Escaped(id),
+                            self.num(cx),
+                            self.num(cy),
+                            self.num(rx)
+                        )?;
                     } else if rx.abs() < 0.001 || ry.abs() < 0.001 {
                         // Circle appears as line (edge-on view)
                         // Draw as a line representing the circle's edge
@@ -224,31 +299,48 @@ impl SvgExporter {
                         let angle_rad = rotation.to_radians();
                         let dx = half_len * angle_rad.cos();
                         let dy = half_len * angle_rad.sin();
-                        svg.push_str(&format!(
+                        writeln!(
+                            out,
                             r#"  <line id="{}" x1="{}" y1="{}" x2="{}" y2="{}" stroke="black"/>"#,
-                            id, fmt_svg(cx - dx, self.precision), fmt_svg(cy - dy, self.precision), 
-                            fmt_svg(cx + dx, self.precision), fmt_svg(cy + dy, self.precision)
-                        ));
+                            Escaped(id),
+                            self.num(cx - dx),
+                            self.num(cy - dy),
+                            self.num(cx + dx),
+                            self.num(cy + dy)
+                        )?;
                     } else {
                         // Circle appears as ellipse
-                        svg.push_str(&format!(
-                            r#"  <ellipse id="{}" cx="{}" cy="{}" rx="{}" ry="{}" transform="rotate({:.1} {} {})" fill="none" stroke="black"/>"#,
-                            id, fmt_svg(cx, self.precision), fmt_svg(cy, self.precision), 
-                            fmt_svg(rx, self.precision), fmt_svg(ry, self.precision), 
-                            normalize_zero(rotation), fmt_svg(cx, self.precision), fmt_svg(cy, self.precision)
-                        ));
+                        writeln!(
+                            out,
+                            r#"  <ellipse id="{}" cx="{}" cy="{}" rx="{}" ry="{}" transform="rotate({} {} {})" fill="none" stroke="black"/>"#,
+                            Escaped(id),
+                            self.num(cx),
+                            self.num(cy),
+                            self.num(rx),
+                            self.num(ry),
+                            Fixed(rotation, 1),
+                            self.num(cx),
+                            self.num(cy)
+                        )?;
+                    }
+                }
+                ResolvedEntity::Line { .. } if self.chain => {
+                    if let Some(chain) = chains.get(id.as_str()) {
+                        self.write_chain(chain, out)?;
                     }
-                    svg.push('\n');
                 }
                 ResolvedEntity::Line { p1, p2 } => {
                     let (x1, y1) = self.project_point(p1);
                     let (x2, y2) = self.project_point(p2);
-                    svg.push_str(&format!(
+                    writeln!(
+                        out,
                         r#"  <line id="{}" x1="{}" y1="{}" x2="{}" y2="{}" stroke="black"/>"#,
-                        id, fmt_svg(x1, self.precision), fmt_svg(y1, self.precision), 
-                        fmt_svg(x2, self.precision), fmt_svg(y2, self.precision)
-                    ));
-                    svg.push('\n');
+                        Escaped(id),
+                        self.num(x1),
+                        self.num(y1),
+                        self.num(x2),
+                        self.num(y2)
+                    )?;
                 }
                 ResolvedEntity::Arc { center, start, end, normal } => {
                     // Project the arc points
@@ -280,16 +372,19 @@ impl SvgExporter {
                     let large_arc = if angle_diff > std::f64::consts::PI { 1 } else { 0 };
                     
                     // SVG path for arc
-                    svg.push_str(&format!(
+                    writeln!(
+                        out,
                         r#"  <path id="{}" d="M {} {} A {} {} {} {} 0 {} {}" fill="none" stroke="black"/>"#,
-                        id,
-                        fmt_svg(sx, self.precision), fmt_svg(sy, self.precision),
-                        fmt_svg(rx, self.precision), fmt_svg(ry, self.precision),
-                        fmt_svg(rotation, self.precision),
+                        Escaped(id),
+                        self.num(sx),
+                        self.num(sy),
+                        self.num(rx),
+                        self.num(ry),
+                        self.num(rotation),
                         large_arc,
-                        fmt_svg(ex, self.precision), fmt_svg(ey, self.precision)
-                    ));
-                    svg.push('\n');
+                        self.num(ex),
+                        self.num(ey)
+                    )?;
                 }
                 ResolvedEntity::Cubic { start, control1, control2, end } => {
                     // Project all control points
@@ -299,26 +394,89 @@ impl SvgExporter {
                     let (x3, y3) = self.project_point(end);
                     
                     // SVG path for cubic Bezier curve
-                    svg.push_str(&format!(
+                    writeln!(
+                        out,
                         r#"  <path id="{}" d="M {} {} C {} {}, {} {}, {} {}" fill="none" stroke="black"/>"#,
-                        id,
-                        fmt_svg(x0, self.precision), fmt_svg(y0, self.precision),
-                        fmt_svg(x1, self.precision), fmt_svg(y1, self.precision),
-                        fmt_svg(x2, self.precision), fmt_svg(y2, self.precision),
-                        fmt_svg(x3, self.precision), fmt_svg(y3, self.precision)
-                    ));
-                    svg.push('\n');
+                        Escaped(id),
+                        self.num(x0),
+                        self.num(y0),
+                        self.num(x1),
+                        self.num(y1),
+                        self.num(x2),
+                        self.num(y2),
+                        self.num(x3),
+                        self.num(y3)
+                    )?;
                 }
             }
         }
 
-        svg.push_str("</svg>");
-        
-        // Post-process to sanitize any remaining -0.0 patterns in attributes
-        sanitize_svg_attributes(&svg)
+        Ok(())
     }
+}
 
-    fn project_point(&self, point: &[f64]) -> (f64, f64) {
+impl crate::StreamExporter for SvgExporter {
+    fn write_to(
+        &self,
+        entities: &HashMap<String, ResolvedEntity>,
+        out: &mut dyn Write,
+    ) -> anyhow::Result<()> {
+        self.write_start(self.extent.or_else(|| self.extent(entities)), out)?;
+        self.write_elements(entities, out)?;
+        write!(out, "</svg>")?;
+        Ok(())
+    }
+}
+
+impl SvgExporter {
+    fn num(&self, v: f64) -> Fixed {
+        Fixed(v, self.precision)
+    }
+
+    /// A line alone as a `<line>`; a longer chain as one path, with the ids
+    /// of the lines in it in `data-ids`
+    fn write_chain(&self, chain: &Polyline, out: &mut dyn Write) -> anyhow::Result<()> {
+        let points: Vec<(f64, f64)> = chain.points.iter().map(|p| self.project_point(p)).collect();
+        if let [(x1, y1), (x2, y2)] = points[..] {
+            if chain.ids.len() == 1 {
+                writeln!(
+                    out,
+                    r#"  <line id="{}" x1="{}" y1="{}" x2="{}" y2="{}" stroke="black"/>"#,
+                    Escaped(chain.ids[0]),
+                    self.num(x1),
+                    self.num(y1),
+                    self.num(x2),
+                    self.num(y2)
+                )?;
+                return Ok(());
+            }
+        }
+        write!(
+            out,
+            r#"  <path id="{}" data-ids=""#,
+            Escaped(chain.first_id())
+        )?;
+        for (i, id) in chain.ids.iter().enumerate() {
+            write!(out, "{}{}", if i == 0 { "" } else { " " }, Escaped(id))?;
+        }
+        out.write_all(br#"" d=""#)?;
+        for (i, (x, y)) in points.iter().enumerate() {
+            write!(
+                out,
+                "{}{} {}",
+                if i == 0 { "M " } else { " L " },
+                self.num(*x),
+                self.num(*y)
+            )?;
+        }
+        if chain.closed {
+            out.write_all(b" Z")?;
+        }
+        writeln!(out, r#"" fill="none" stroke="black"/>"#)?;
+        Ok(())
+    }
+
+    pub(crate) fn project_point(&self, point: &[f64]) -> (f64, f64) {
         let (x, y) = match self.view_plane {
             ViewPlane::XY => (
                 point.get(0).copied().unwrap_or(0.0),
@@ -452,6 +610,34 @@ mod tests {
         assert!(svg.contains("</svg>"));
     }
 
+    #[test]
+    fn test_extent_frames_drawings_alike() {
+        let point = |x: f64, y: f64| {
+            HashMap::from([(
+                "p".to_string(),
+                ResolvedEntity::Point {
+                    at: vec![x, y, 0.0],
+                },
+            )])
+        };
+        let exporter = SvgExporter::default();
+        assert_eq!(
+            exporter.extent(&point(10.0, 20.0)),
+            Some([10.0, 20.0, 10.0, 20.0])
+        );
+        assert_eq!(exporter.extent(&HashMap::new()), None);
+
+        let framed = SvgExporter::default().with_extent([0.0, 0.0, 100.0, 100.0]);
+        for svg in [
+            framed.export(&point(10.0, 20.0)),
+            framed.export(&point(90.0, 5.0)),
+        ] {
+            assert!(svg
+                .unwrap()
+                .contains(r#"viewBox="-20.0 -20.0 140.0 140.0""#));
+        }
+    }
+
     #[test]
     fn test_export_point() {
         let exporter = SvgExporter::default();
@@ -600,4 +786,65 @@ mod tests {
         assert!(svg.contains(r#"M 0"#), "Cubic path should start at the start point");
         assert!(svg.contains(r#"C"#), "Cubic path should contain cubic command");
     }
+
+    #[test]
+    fn test_fixed_never_writes_negative_zero() {
+        assert_eq!(Fixed(-0.0000001, 6).to_string(), "0.000000");
+        assert_eq!(Fixed(-0.0, 6).to_string(), "0.000000");
+        assert_eq!(Fixed(-0.04, 1).to_string(), "0.0");
+        assert_eq!(Fixed(-0.05, 6).to_string(), "-0.050000");
+        assert_eq!(Fixed(-0.0000006, 6).to_string(), "-0.000001");
+        assert_eq!(Fixed(-12.5, 1).to_string(), "-12.5");
+        assert_eq!(Fixed(0.25, 2).to_string(), "0.25");
+    }
+
+    #[test]
+    fn test_write_to_streams_the_same_svg() {
+        use crate::StreamExporter;
+        let exporter = SvgExporter::default();
+        let mut entities = HashMap::new();
+        entities.insert(
+            "a&b".to_string(),
+            ResolvedEntity::Point {
+                at: vec![-0.05, 0.0, 0.0],
+            },
+        );
+
+        let mut out = std::io::BufWriter::new(Vec::new());
+        exporter.write_to(&entities, &mut out).unwrap();
+        let streamed = String::from_utf8(out.into_inner().unwrap()).unwrap();
+        assert_eq!(streamed, exporter.export(&entities).unwrap());
+        assert!(streamed.contains(r#"id="a&amp;b" cx="-0.050000""#));
+    }
+
+    #[test]
+    fn test_export_chained_path() {
+        let mut entities = HashMap::new();
+        for (id, a, b) in [
+            ("l1", [0.0, 0.0], [10.0, 0.0]),
+            ("l2", [10.0, 0.0], [10.0, 10.0]),
+            ("l3", [10.0, 10.0], [0.0, 0.0]),
+            ("l4", [50.0, 50.0], [60.0, 50.0]),
+        ] {
+            let line = ResolvedEntity::Line {
+                p1: vec![a[0], a[1], 0.0],
+                p2: vec![b[0], b[1], 0.0],
+            };
+            entities.insert(id.to_string(), line);
+        }
+
+        let svg = SvgExporter::default().export(&entities).unwrap();
+        assert!(svg.contains(
+            r#"<path id="l1" data-ids="l1 l2 l3" d="M 0.000000 0.000000 L 10.000000 0.000000 L 10.000000 10.000000 Z" fill="none" stroke="black"/>"#
+        ));
+        assert!(svg.contains(r#"<line id="l4""#));
+        assert_eq!(svg.matches("<line ").count(), 1);
+
+        let unchained = SvgExporter::default()
+            .with_chaining(false)
+            .export(&entities)
+            .unwrap();
+        assert_eq!(unchained.matches("<line ").count(), 4);
+        assert!(!unchained.contains("<path"));
+    }
 }
@@ -0,0 +1,728 @@
+//! A drawing as a pyramid of SVG tiles, so that a viewer fetches only the
+//! tiles it shows, at the level of detail it shows them at, as map viewers
+//! do.
+//!
+//! Level 0 is one square tile framing the whole drawing, and each level
+//! splits every tile of the one before into four, so level z is 2^z tiles
+//! across. Geometry is binned into the tiles of a level by its bounding box,
+//! a quadtree kept as the range of tiles each piece covers. The last level
+//! draws the entities in each tile as `SvgExporter` does. The coarser ones
+//! draw polylines with no more detail than a pixel of their tiles holds:
+//! lines chained end to end and merged where collinear, curves flattened,
+//! everything simplified by Douglas-Peucker, and whatever is smaller than a
+//! pixel left out. Each tile has only the runs of a polyline that cross it.
+//!
+//! Tiles are written to `{level}/{x}/{y}.svg` in the output directory, only
+//! where there's something to draw, on a pool of threads; `tiles.json` says
+//! what the pyramid covers.
+
+use crate::chain::chain_lines;
+use crate::svg::{Fixed, SvgExporter, ViewPlane};
+use serde::Serialize;
+use slvsx_core::ir::ResolvedEntity;
+use std::collections::HashMap;
+use std::io::Write;
+use std::path::Path;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::thread;
+
+/// Radius a point is drawn with, as `SvgExporter` draws it
+const POINT_RADIUS: f64 = 2.0;
+/// Segments a curve is flattened into, at most
+const MAX_SEGMENTS: usize = 1024;
+
+#[derive(Debug, Clone, Copy)]
+pub struct TileOptions {
+    pub view: ViewPlane,
+    /// Levels in the pyramid, the last drawn in full
+    pub levels: u32,
+    /// Pixels across a tile, which sets the detail of the coarser levels
+    pub tile_size: u32,
+    /// Threads writing tiles
+    pub jobs: usize,
+}
+
+impl Default for TileOptions {
+    fn default() -> Self {
+        Self {
+            view: ViewPlane::XY,
+            levels: 6,
+            tile_size: 256,
+            jobs: 1,
+        }
+    }
+}
+
+/// What a pyramid covers, written to `tiles.json`
+#[derive(Debug, Clone, PartialEq, Serialize)]
+pub struct TileSet {
+    /// The square of the drawing that tile 0/0/0 frames, as
+    /// `[min_x, min_y, max_x, max_y]`; tile z/x/y is the square x across
+    /// and y down of 2^z across it
+    pub extent: [f64; 4],
+    pub levels: u32,
+    pub tile_size: u32,
+    /// Tiles written at each level
+    pub tiles: Vec<usize>,
+}
+
+/// A polyline in the drawing's coordinates, with the box around it
+struct Shape {
+    points: Vec<(f64, f64)>,
+    closed: bool,
+    bounds: [f64; 4],
+}
+
+impl Shape {
+    fn new(points: Vec<(f64, f64)>, closed: bool) -> Self {
+        let bounds = bounds_of(&points);
+        Self {
+            points,
+            closed,
+            bounds,
+        }
+    }
+}
+
+/// What one tile has in it to draw
+enum Contents {
+    /// Entities, drawn in full
+    Entities(Vec<usize>),
+    /// Shapes of a coarse level
+    Shapes(Vec<usize>),
+}
+
+struct Tile {
+    level: u32,
+    x: u32,
+    y: u32,
+    contents: Contents,
+}
+
+/// The square around the drawing that tile 0/0/0 frames
+fn root_extent(svg: &SvgExporter, entities: &HashMap<String, ResolvedEntity>) -> [f64; 4] {
+    let [min_x, min_y, max_x, max_y] = svg
+        .extent(entities)
+        .unwrap_or([-100.0, -100.0, 100.0, 100.0]);
+    let (min_x, min_y) = (min_x - POINT_RADIUS, min_y - POINT_RADIUS);
+    let side = (max_x - min_x).max(max_y - min_y) + POINT_RADIUS;
+    [min_x, min_y, min_x + side, min_y + side]
+}
+
+/// The tiles of a level a box covers, as `(first x, first y, last x, last y)`
+fn tile_range(root: [f64; 4], level: u32, bounds: [f64; 4]) -> (u32, u32, u32, u32) {
+    let across = 1u32 << level;
+    let side = (root[2] - root[0]) / across as f64;
+    let index = |v: f64, origin: f64| {
+        ((v - origin) / side)
+            .floor()
+            .clamp(0.0, (across - 1) as f64) as u32
+    };
+    (
+        index(bounds[0], root[0]),
+        index(bounds[1], root[1]),
+        index(bounds[2], root[0]),
+        index(bounds[3], root[1]),
+    )
+}
+
+fn bounds_of(points: &[(f64, f64)]) -> [f64; 4] {
+    points.iter().fold(
+        [
+            f64::INFINITY,
+            f64::INFINITY,
+            f64::NEG_INFINITY,
+            f64::NEG_INFINITY,
+        ],
+        |[a, b, c, d], &(x, y)| [a.min(x), b.min(y), c.max(x), d.max(y)],
+    )
+}
+
+fn vec3(v: &[f64]) -> [f64; 3] {
+    [
+        v.first().copied().unwrap_or(0.0),
+        v.get(1).copied().unwrap_or(0.0),
+        v.get(2).copied().unwrap_or(0.0),
+    ]
+}
+
+fn sub(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+}
+
+fn dot(a: [f64; 3], b: [f64; 3]) -> f64 {
+    a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+}
+
+fn cross(a: [f64; 3], b: [f64; 3]) -> [f64; 3] {
+    [
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0],
+    ]
+}
+
+fn scaled(a: [f64; 3], s: f64) -> [f64; 3] {
+    [a[0] * s, a[1] * s, a[2] * s]
+}
+
+fn unit(a: [f64; 3]) -> Option<[f64; 3]> {
+    let length = dot(a, a).sqrt();
+    (length > 1e-12).then(|| scaled(a, 1.0 / length))
+}
+
+/// Segments that keep an arc of `radius` through `angle` within `tolerance`
+fn arc_segments(radius: f64, angle: f64, tolerance: f64) -> usize {
+    let step = if tolerance < radius {
+        2.0 * (1.0 - tolerance / radius).acos()
+    } else {
+        angle / 3.0
+    };
+    ((angle / step.max(1e-6)).ceil() as usize).clamp(1, MAX_SEGMENTS)
+}
+
+/// An arc about `center` in the plane normal to `normal`, from `start`
+/// through `angle` radians, flattened in the model and then projected
+fn flatten_arc(
+    svg: &SvgExporter,
+    center: [f64; 3],
+    start: [f64; 3],
+    normal: [f64; 3],
+    angle: f64,
+    tolerance: f64,
+) -> Vec<(f64, f64)> {
+    let u = sub(start, center);
+    let radius = dot(u, u).sqrt();
+    let v = cross(unit(normal).unwrap_or([0.0, 0.0, 1.0]), u);
+    let n = arc_segments(radius, angle, tolerance);
+    (0..=n)
+        .map(|i| {
+            let t = angle * i as f64 / n as f64;
+            let (c, s) = (t.cos(), t.sin());
+            let p = [
+                center[0] + u[0] * c + v[0] * s,
+                center[1] + u[1] * c + v[1] * s,
+                center[2] + u[2] * c + v[2] * s,
+            ];
+            svg.project_point(&p)
+        })
+        .collect()
+}
+
+/// Any direction at right angles to `n`
+fn perpendicular(n: [f64; 3]) -> [f64; 3] {
+    let other = if n[0].abs() < 0.9 {
+        [1.0, 0.0, 0.0]
+    } else {
+        [0.0, 1.0, 0.0]
+    };
+    unit(cross(n, other)).unwrap_or([1.0, 0.0, 0.0])
+}
+
+/// The outline of a curved entity flattened to within `tolerance`, and
+/// whether it closes; None for lines and points
+fn flatten(svg: &SvgExporter, entity: &ResolvedEntity, tolerance: f64) -> Option<Shape> {
+    match entity {
+        ResolvedEntity::Circle {
+            center,
+            diameter,
+            normal,
+        } => {
+            let center = vec3(center);
+            let normal = unit(vec3(normal)).unwrap_or([0.0, 0.0, 1.0]);
+            let across = perpendicular(normal);
+            let start = [0, 1, 2].map(|i| center[i] + across[i] * diameter / 2.0);
+            let mut points =
+                flatten_arc(svg, center, start, normal, std::f64::consts::TAU, tolerance);
+            points.pop();
+            Some(Shape::new(points, true))
+        }
+        ResolvedEntity::Arc {
+            center,
+            start,
+            end,
+            normal,
+        } => {
+            let (center, start, end) = (vec3(center), vec3(start), vec3(end));
+            let normal = unit(vec3(normal)).unwrap_or([0.0, 0.0, 1.0]);
+            let (u, w) = (sub(start, center), sub(end, center));
+            let mut angle = dot(cross(u, w), normal).atan2(dot(u, w));
+            if angle <= 0.0 {
+                angle += std::f64::consts::TAU;
+            }
+            Some(Shape::new(
+                flatten_arc(svg, center, start, normal, angle, tolerance),
+                false,
+            ))
+        }
+        ResolvedEntity::Cubic {
+            start,
+            control1,
+            control2,
+            end,
+        } => {
+            let p = [vec3(start), vec3(control1), vec3(control2), vec3(end)];
+            // The control polygon is no shorter than the curve
+            let length: f64 = p
+                .windows(2)
+                .map(|w| dot(sub(w[1], w[0]), sub(w[1], w[0])).sqrt())
+                .sum();
+            let n = ((length / tolerance.max(1e-9)).sqrt().ceil() as usize).clamp(1, MAX_SEGMENTS);
+            let points = (0..=n)
+                .map(|i| {
+                    let t = i as f64 / n as f64;
+                    let s = 1.0 - t;
+                    let w = [s * s * s, 3.0 * s * s * t, 3.0 * s * t * t, t * t * t];
+                    let q = [0, 1, 2].map(|k| (0..4).map(|j| w[j] * p[j][k]).sum::<f64>());
+                    svg.project_point(&q)
+                })
+                .collect();
+            Some(Shape::new(points, false))
+        }
+        ResolvedEntity::Point { .. } | ResolvedEntity::Line { .. } => None,
+    }
+}
+
+/// Douglas-Peucker: the fewest of `points` that keep every one of them
+/// within `tolerance` of the line through what's kept
+fn simplify(points: &[(f64, f64)], tolerance: f64) -> Vec<(f64, f64)> {
+    if points.len() < 3 {
+        return points.to_vec();
+    }
+    let mut keep = vec![false; points.len()];
+    keep[0] = true;
+    keep[points.len() - 1] = true;
+    let mut spans = vec![(0, points.len() - 1)];
+    while let Some((a, b)) = spans.pop() {
+        let ((ax, ay), (bx, by)) = (points[a], points[b]);
+        let (dx, dy) = (bx - ax, by - ay);
+        let length = (dx * dx + dy * dy).sqrt();
+        let mut farthest = (0.0, a);
+        for (i, &(x, y)) in points.iter().enumerate().take(b).skip(a + 1) {
+            let off = if length > 0.0 {
+                ((x - ax) * dy - (y - ay) * dx).abs() / length
+            } else {
+                ((x - ax).powi(2) + (y - ay).powi(2)).sqrt()
+            };
+            if off > farthest.0 {
+                farthest = (off, i);
+            }
+        }
+        if farthest.0 > tolerance {
+            keep[farthest.1] = true;
+            spans.push((a, farthest.1));
+            spans.push((farthest.1, b));
+        }
+    }
+    points
+        .iter()
+        .zip(keep)
+        .filter(|(_, k)| *k)
+        .map(|(p, _)| *p)
+        .collect()
+}
+
+/// Every line chained and curve flattened, simplified to `tolerance`,
+/// leaving out what would be smaller than it
+fn coarse_shapes(
+    svg: &SvgExporter,
+    entities: &HashMap<String, ResolvedEntity>,
+    tolerance: f64,
+) -> Vec<Shape> {
+    let chains = chain_lines(entities).into_iter().map(|chain| {
+        let points: Vec<(f64, f64)> = chain.points.iter().map(|p| svg.project_point(p)).collect();
+        Shape::new(points, chain.closed)
+    });
+    let mut curves: Vec<(&String, &ResolvedEntity)> = entities.iter().collect();
+    curves.sort_by_key(|(id, _)| *id);
+    let curves = curves
+        .into_iter()
+        .filter_map(|(_, entity)| flatten(svg, entity, tolerance / 2.0));
+
+    chains
+        .chain(curves)
+        .filter_map(|shape| {
+            let [a, b, c, d] = shape.bounds;
+            if (c - a).max(d - b) < tolerance {
+                return None;
+            }
+            let mut points = shape.points;
+            if shape.closed {
+                // Simplify the loop as a path back to where it started
+                let first = points[0];
+                points.push(first);
+            }
+            let mut points = simplify(&points, tolerance);
+            if shape.closed {
+                points.pop();
+            }
+            let closed = shape.closed && points.len() > 2;
+            Some(Shape::new(points, closed))
+        })
+        .collect()
+}
+
+/// The box an entity is drawn in, to bin it by
+fn entity_bounds(svg: &SvgExporter, entity: &ResolvedEntity, tolerance: f64) -> [f64; 4] {
+    match entity {
+        ResolvedEntity::Point { at } => {
+            let (x, y) = svg.project_point(at);
+            [
+                x - POINT_RADIUS,
+                y - POINT_RADIUS,
+                x + POINT_RADIUS,
+                y + POINT_RADIUS,
+            ]
+        }
+        ResolvedEntity::Line { p1, p2 } => {
+            bounds_of(&[svg.project_point(p1), svg.project_point(p2)])
+        }
+        _ => {
+            let [a, b, c, d] = flatten(svg, entity, tolerance)
+                .map(|s| s.bounds)
+                .unwrap_or_default();
+            [a - tolerance, b - tolerance, c + tolerance, d + tolerance]
+        }
+    }
+}
+
+/// Items binned into the tiles of `level` by their boxes
+fn bin(
+    root: [f64; 4],
+    level: u32,
+    bounds: impl Iterator<Item = [f64; 4]>,
+) -> HashMap<(u32, u32), Vec<usize>> {
+    let mut tiles: HashMap<(u32, u32), Vec<usize>> = HashMap::new();
+    for (i, b) in bounds.enumerate() {
+        let (x0, y0, x1, y1) = tile_range(root, level, b);
+        for x in x0..=x1 {
+            for y in y0..=y1 {
+                tiles.entry((x, y)).or_default().push(i);
+            }
+        }
+    }
+    tiles
+}
+
+/// Decimals that resolve a tenth of `tolerance`
+fn decimals(tolerance: f64) -> usize {
+    (1.0 - tolerance.log10()).ceil().clamp(0.0, 6.0) as usize
+}
+
+/// The runs of a shape that cross a box, each as a path of its own
+fn write_runs(
+    shape: &Shape,
+    bounds: [f64; 4],
+    precision: usize,
+    out: &mut dyn Write,
+) -> anyhow::Result<()> {
+    let points = &shape.points;
+    let n = points.len();
+    let segments = if shape.closed { n } else { n.saturating_sub(1) };
+    let crosses = |i: usize| {
+        let [a, b, c, d] = bounds_of(&[points[i], points[(i + 1) % n]]);
+        a <= bounds[2] && c >= bounds[0] && b <= bounds[3] && d >= bounds[1]
+    };
+    if n > 1 && !(0..segments).any(crosses) {
+        return Ok(());
+    }
+    if n == 1 || (0..segments).all(crosses) {
+        write!(out, r#"  <path d=""#)?;
+        for (i, (x, y)) in points.iter().enumerate() {
+            write!(
+                out,
+                "{}{} {}",
+                if i == 0 { "M " } else { " L " },
+                Fixed(*x, precision),
+                Fixed(*y, precision)
+            )?;
+        }
+        if shape.closed {
+            out.write_all(b" Z")?;
+        }
+        writeln!(
+            out,
+            r#"" fill="none" stroke="black" vector-effect="non-scaling-stroke"/>"#
+        )?;
+        return Ok(());
+    }
+    let mut open = false;
+    write!(out, r#"  <path d=""#)?;
+    for i in 0..segments {
+        if !crosses(i) {
+            open = false;
+            continue;
+        }
+        let ((x0, y0), (x1, y1)) = (points[i], points[(i + 1) % n]);
+        if !open {
+            write!(out, "M {} {} ", Fixed(x0, precision), Fixed(y0, precision))?;
+        }
+        write!(out, "L {} {} ", Fixed(x1, precision), Fixed(y1, precision))?;
+        open = true;
+    }
+    writeln!(
+        out,
+        r#"" fill="none" stroke="black" vector-effect="non-scaling-stroke"/>"#
+    )?;
+    Ok(())
+}
+
+/// Write the pyramid of tiles of `entities` into `dir`, and return what it
+/// covers, as is also written to `tiles.json` there
+pub fn write_tiles(
+    entities: &HashMap<String, ResolvedEntity>,
+    dir: &Path,
+    options: TileOptions,
+) -> anyhow::Result<TileSet> {
+    let svg = SvgExporter::new(options.view);
+    let root = root_extent(&svg, entities);
+    let levels = options.levels.clamp(1, 24);
+    let tile_size = options.tile_size.max(1) as f64;
+    let pixel = |level: u32| (root[2] - root[0]) / (1u64 << level) as f64 / tile_size;
+
+    // The last level, drawn in full
+    let mut ids: Vec<&String> = entities.keys().collect();
+    ids.sort();
+    let last = levels - 1;
+    let fine = bin(
+        root,
+        last,
+        ids.iter()
+            .map(|id| entity_bounds(&svg, &entities[*id], pixel(last))),
+    );
+    let mut tiles: Vec<Tile> = fine
+        .into_iter()
+        .map(|((x, y), items)| Tile {
+            level: last,
+            x,
+            y,
+            contents: Contents::Entities(items),
+        })
+        .collect();
+
+    // The coarser levels, simplified to their pixels
+    let mut shapes: Vec<Vec<Shape>> = Vec::new();
+    for level in 0..last {
+        let level_shapes = coarse_shapes(&svg, entities, pixel(level));
+        let binned = bin(root, level, level_shapes.iter().map(|s| s.bounds));
+        tiles.extend(binned.into_iter().map(|((x, y), items)| Tile {
+            level,
+            x,
+            y,
+            contents: Contents::Shapes(items),
+        }));
+        shapes.push(level_shapes);
+    }
+    tiles.sort_by_key(|tile| (tile.level, tile.x, tile.y));
+
+    let next = AtomicUsize::new(0);
+    let failure: Mutex<Option<anyhow::Error>> = Mutex::new(None);
+    thread::scope(|scope| {
+        for _ in 0..options.jobs.clamp(1, tiles.len().max(1)) {
+            scope.spawn(|| loop {
+                let Some(tile) = tiles.get(next.fetch_add(1, Ordering::Relaxed)) else {
+                    break;
+                };
+                if let Err(e) =
+                    write_tile(&svg, entities, &ids, &shapes, root, tile_size, dir, tile)
+                {
+                    failure
+                        .lock()
+                        .unwrap_or_else(|p| p.into_inner())
+                        .get_or_insert(e);
+                    break;
+                }
+            });
+        }
+    });
+    if let Some(e) = failure.into_inner().unwrap_or_else(|e| e.into_inner()) {
+        return Err(e);
+    }
+
+    let mut counts = vec![0; levels as usize];
+    for tile in &tiles {
+        counts[tile.level as usize] += 1;
+    }
+    let set = TileSet {
+        extent: root,
+        levels,
+        tile_size: tile_size as u32,
+        tiles: counts,
+    };
+    std::fs::write(dir.join("tiles.json"), serde_json::to_string_pretty(&set)?)?;
+    Ok(set)
+}
+
+#[allow(clippy::too_many_arguments)]
+fn write_tile(
+    svg: &SvgExporter,
+    entities: &HashMap<String, ResolvedEntity>,
+    ids: &[&String],
+    shapes: &[Vec<Shape>],
+    root: [f64; 4],
+    tile_size: f64,
+    dir: &Path,
+    tile: &Tile,
+) -> anyhow::Result<()> {
+    let side = (root[2] - root[0]) / (1u64 << tile.level) as f64;
+    let (x0, y0) = (
+        root[0] + tile.x as f64 * side,
+        root[1] + tile.y as f64 * side,
+    );
+    let folder = dir.join(tile.level.to_string()).join(tile.x.to_string());
+    std::fs::create_dir_all(&folder)?;
+    let file = std::fs::File::create(folder.join(format!("{}.svg", tile.y)))?;
+    let mut out = std::io::BufWriter::with_capacity(64 * 1024, file);
+
+    let precision = decimals(side / tile_size);
+    writeln!(
+        out,
+        r#"<svg xmlns="http://www.w3.org/2000/svg" viewBox="{} {} {} {}" width="{}" height="{}">"#,
+        Fixed(x0, precision),
+        Fixed(y0, precision),
+        Fixed(side, precision),
+        Fixed(side, precision),
+        tile_size,
+        tile_size
+    )?;
+    match &tile.contents {
+        Contents::Entities(items) => {
+            let subset: HashMap<String, ResolvedEntity> = items
+                .iter()
+                .map(|&i| (ids[i].clone(), entities[ids[i]].clone()))
+                .collect();
+            svg.write_elements(&subset, &mut out)?;
+        }
+        Contents::Shapes(items) => {
+            // A pixel's margin, for strokes along the edge
+            let pixel = side / tile_size;
+            let bounds = [x0 - pixel, y0 - pixel, x0 + side + pixel, y0 + side + pixel];
+            for &i in items {
+                write_runs(&shapes[tile.level as usize][i], bounds, precision, &mut out)?;
+            }
+        }
+    }
+    write!(out, "</svg>")?;
+    out.flush()?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn line(p1: [f64; 2], p2: [f64; 2]) -> ResolvedEntity {
+        ResolvedEntity::Line {
+            p1: vec![p1[0], p1[1], 0.0],
+            p2: vec![p2[0], p2[1], 0.0],
+        }
+    }
+
+    #[test]
+    fn test_simplify_drops_points_within_tolerance() {
+        let points = [
+            (0.0, 0.0),
+            (1.0, 0.01),
+            (2.0, -0.01),
+            (3.0, 0.0),
+            (3.0, 5.0),
+        ];
+        assert_eq!(
+            simplify(&points, 0.1),
+            vec![(0.0, 0.0), (3.0, 0.0), (3.0, 5.0)]
+        );
+        assert_eq!(simplify(&points, 0.001).len(), points.len());
+    }
+
+    #[test]
+    fn test_box_covers_the_tiles_it_overlaps() {
+        let root = [0.0, 0.0, 100.0, 100.0];
+        assert_eq!(tile_range(root, 0, [10.0, 10.0, 90.0, 90.0]), (0, 0, 0, 0));
+        assert_eq!(tile_range(root, 2, [10.0, 30.0, 60.0, 40.0]), (0, 1, 2, 1));
+        // Past the edge, the edge tile
+        assert_eq!(tile_range(root, 1, [-5.0, 0.0, 105.0, 10.0]), (0, 0, 1, 0));
+    }
+
+    #[test]
+    fn test_circle_flattens_within_tolerance() {
+        let svg = SvgExporter::new(ViewPlane::XY);
+        let circle = ResolvedEntity::Circle {
+            center: vec![0.0, 0.0, 0.0],
+            diameter: 20.0,
+            normal: vec![0.0, 0.0, 1.0],
+        };
+        let shape = flatten(&svg, &circle, 0.1).unwrap();
+        assert!(shape.closed);
+        assert!(shape
+            .points
+            .iter()
+            .all(|(x, y)| ((x * x + y * y).sqrt() - 10.0).abs() < 1e-9));
+        assert!(flatten(&svg, &circle, 1.0).unwrap().points.len() < shape.points.len());
+    }
+
+    #[test]
+    fn test_pyramid_has_every_level_and_less_at_the_top() {
+        // A staircase of many short lines, a circle, and a point
+        let mut entities = HashMap::new();
+        let mut at = [0.0, 0.0];
+        for i in 0..400 {
+            let to = if i % 2 == 0 {
+                [at[0] + 0.5, at[1]]
+            } else {
+                [at[0], at[1] + 0.5]
+            };
+            entities.insert(format!("l{:03}", i), line(at, to));
+            at = to;
+        }
+        entities.insert(
+            "c".to_string(),
+            ResolvedEntity::Circle {
+                center: vec![50.0, 20.0, 0.0],
+                diameter: 10.0,
+                normal: vec![0.0, 0.0, 1.0],
+            },
+        );
+        entities.insert(
+            "p".to_string(),
+            ResolvedEntity::Point {
+                at: vec![150.0, 10.0, 0.0],
+            },
+        );
+
+        let dir = tempfile::tempdir().unwrap();
+        let options = TileOptions {
+            levels: 4,
+            tile_size: 64,
+            jobs: 3,
+            ..TileOptions::default()
+        };
+        let set = write_tiles(&entities, dir.path(), options).unwrap();
+        assert_eq!(set.tiles.len(), 4);
+        assert_eq!(set.tiles[0], 1);
+        assert!(set.tiles[3] > 1);
+
+        let top = std::fs::read_to_string(dir.path().join("0/0/0.svg")).unwrap();
+        assert!(top.starts_with("<svg"));
+        assert!(top.ends_with("</svg>"));
+        // The steps are under a pixel of the top tile, so are smoothed away
+        assert!(top.matches(" L ").count() < 20, "{}", top);
+        let last_level: usize = walk(&dir.path().join("3"));
+        assert_eq!(last_level, set.tiles[3]);
+        assert!(dir.path().join("tiles.json").exists());
+    }
+
+    fn walk(dir: &Path) -> usize {
+        std::fs::read_dir(dir)
+            .unwrap()
+            .map(|entry| {
+                let path = entry.unwrap().path();
+                if path.is_dir() {
+                    walk(&path)
+                } else {
+                    1
+                }
+            })
+            .sum()
+    }
+}
@@ -0,0 +1,60 @@
+//! Welding points together: each point within a tolerance of one seen
+//! before is given that one's index, as SolveSpace's kd-trees snap
+//! vertices to one another.
+
+use std::collections::HashMap;
+
+/// How close two points are to be the same; SolveSpace's `LENGTH_EPS`
+pub const WELD_TOLERANCE: f64 = 1e-6;
+
+/// Finds the vertex a point welds to through a grid of cells the size of
+/// the tolerance, so only the 27 cells around the point are searched
+pub(crate) struct Welder {
+    tolerance: f64,
+    vertices: Vec<[f64; 3]>,
+    cells: HashMap<[i64; 3], Vec<u32>>,
+}
+
+impl Welder {
+    pub(crate) fn new(tolerance: f64) -> Self {
+        Self {
+            tolerance: tolerance.max(f64::MIN_POSITIVE),
+            vertices: Vec::new(),
+            cells: HashMap::new(),
+        }
+    }
+
+    fn cell(&self, p: [f64; 3]) -> [i64; 3] {
+        p.map(|c| (c / self.tolerance).floor() as i64)
+    }
+
+    /// The index of the vertex p welds to, added if there is none
+    pub(crate) fn index(&mut self, p: [f64; 3]) -> u32 {
+        let [x, y, z] = self.cell(p);
+        for dx in -1..=1 {
+            for dy in -1..=1 {
+                for dz in -1..=1 {
+                    let Some(near) = self.cells.get(&[x + dx, y + dy, z + dz]) else {
+                        continue;
+                    };
+                    for &i in near {
+                        let v = self.vertices[i as usize];
+                        let d = [0, 1, 2].map(|k| v[k] - p[k]);
+                        let squared = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                        if squared <= self.tolerance * self.tolerance {
+                            return i;
+                        }
+                    }
+                }
+            }
+        }
+        let i = self.vertices.len() as u32;
+        self.vertices.push(p);
+        self.cells.entry([x, y, z]).or_default().push(i);
+        i
+    }
+
+    pub(crate) fn into_vertices(self) -> Vec<[f64; 3]> {
+        self.vertices
+    }
+}
@@ -1,35 +1,331 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
 #include "slvs.h"
 
+// Where each entity is in sys.entity, by handle: an open-addressed hash
+// table, kept at most half full. Handle 0 (SLVS_FREE_IN_3D) is never an
+// entity's, so it marks an empty slot.
+typedef struct {
+    uint32_t* key;
+    int* index;
+    int cap;    // a power of two
+    int count;
+} HandleIndex;
+
+// The handle given to each thing the caller names, by what it's for and the
+// caller's id for it: an open-addressed hash table of (role << 32 | id),
+// kept at most half full like HandleIndex. Roles start from 1, so key 0
+// marks an empty slot.
+typedef struct {
+    uint64_t* key;
+    uint32_t* handle;
+    int cap;    // a power of two
+    int count;
+} HandleNames;
+
+// What a named handle is for: the caller's own entities and constraints, and
+// the entities a circle, arc or workplane makes for itself
+enum {
+    ROLE_ENTITY = 1,
+    ROLE_CONSTRAINT,
+    ROLE_CIRCLE_NORMAL,
+    ROLE_CIRCLE_ORIGIN,
+    ROLE_CIRCLE_WORKPLANE,
+    ROLE_CIRCLE_CENTER,
+    ROLE_CIRCLE_RADIUS,
+    ROLE_CIRCLE,
+    ROLE_ARC_NORMAL,
+    ROLE_WORKPLANE_NORMAL,
+};
+
 // Structure to hold the SolveSpace system
 typedef struct {
     Slvs_System sys;
+    Slvs_Context* ctx;  // Solver state of its own, so systems can solve concurrently
     int next_param;
     int next_entity;
     int next_constraint;
-    double circle_radii[1000];  // Store circle radii
+    // Allocated lengths of the arrays in sys, which grow as things are added
+    int param_cap, entity_cap, constraint_cap, dragged_cap;
+    HandleIndex entity_index;
+    HandleNames names;
+    // The caller's id for each constraint handle, which are numbered from 1
+    int* constraint_id;
+    int constraint_id_cap;
+    // Whether solves are profiled, and the allocated length of sys.cost
+    int profile;
+    int cost_cap;
+    // Whether points, circles and arcs are made in the sketch plane, and
+    // constraints between them written in it (see real_slvs_set_planar)
+    int planar;
+    // How many starting points a solve that doesn't converge tries (see
+    // real_slvs_set_multi_start); 0 or 1 for just the given one
+    int starts;
+    // The most params, entities, constraints and dragged params held at a
+    // real_slvs_reset since the last look at trimming, and how many resets
+    // there have been since
+    int high_water[4];
+    int resets;
 } RealSlvsSystem;
 
-// Forward declaration
+// Forward declarations
 static void normal_to_quaternion(double nx, double ny, double nz, double* qw, double* qx, double* qy, double* qz);
+static int find_point_params(RealSlvsSystem* s, int point_id, int idx[3]);
+
+// No add function writes more than this many params, entities, constraints
+// or dragged params
+#define SLOT_HEADROOM 32
+
+// Params are numbered from here, in the order they're added to sys.param
+#define FIRST_PARAM 10000
+
+// How many of each the arrays start with room for
+#define INITIAL_SLOTS 256
+
+// How many resets go between looks at whether a system holds much more than
+// it has needed lately, and how many times more that is
+#define TRIM_PERIOD 16
+#define TRIM_FACTOR 4
+
+// The sketch plane's entities, and the group they're in: not the solved
+// one, so the plane is fixed. Their handles are kept back from the ones
+// given out, which start after them.
+#define SKETCH_ORIGIN 1
+#define SKETCH_NORMAL 2
+#define SKETCH_PLANE  3
+#define SKETCH_GROUP  2
+#define FIRST_ENTITY  4
+
+// The group of the constants that dimensions' expressions read (see
+// real_slvs_add_constant): not the solved one either, so they're known
+#define CONSTANT_GROUP 3
+
+static uint32_t hash_handle(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// The index stored for handle h, or -1 if there's none
+static int handle_index_get(const HandleIndex* t, uint32_t h) {
+    if (h == 0 || t->cap == 0) return -1;
+    for (uint32_t i = hash_handle(h) & (t->cap - 1);; i = (i + 1) & (t->cap - 1)) {
+        if (t->key[i] == h) return t->index[i];
+        if (t->key[i] == 0) return -1;
+    }
+}
+
+// Store index for handle h, unless h already has one (the first entity
+// with a handle is the one that's found, as the solver finds it); there must
+// be room for it.
+static void handle_index_put(HandleIndex* t, uint32_t h, int index) {
+    if (h == 0) return;
+    uint32_t i = hash_handle(h) & (t->cap - 1);
+    for (; t->key[i] != 0; i = (i + 1) & (t->cap - 1)) {
+        if (t->key[i] == h) return;
+    }
+    t->key[i] = h;
+    t->index[i] = index;
+    t->count++;
+}
+
+// Make sure that adding another `more` handles keeps the table at most half
+// full, rehashing it in to a bigger one if not
+static int handle_index_reserve(HandleIndex* t, int more) {
+    if (2 * ((int64_t)t->count + more) <= t->cap) return 0;
+
+    int64_t cap = t->cap ? t->cap : 2 * INITIAL_SLOTS;
+    while (2 * ((int64_t)t->count + more) > cap) cap *= 2;
+    if (cap > INT32_MAX) return -1;
+    HandleIndex n = { calloc(cap, sizeof(uint32_t)), malloc(sizeof(int) * cap), (int)cap, 0 };
+    if (!n.key || !n.index) {
+        free(n.key);
+        free(n.index);
+        return -1;
+    }
+    for (int i = 0; i < t->cap; i++) {
+        if (t->key[i] != 0) handle_index_put(&n, t->key[i], t->index[i]);
+    }
+    free(t->key);
+    free(t->index);
+    *t = n;
+    return 0;
+}
+
+static uint32_t hash_name(uint64_t k) {
+    return hash_handle((uint32_t)k ^ hash_handle((uint32_t)(k >> 32)));
+}
+
+static uint64_t name_key(int role, int id) {
+    return ((uint64_t)role << 32) | (uint32_t)id;
+}
+
+// The slot of key in the table: where it is, or the empty one it would go in
+static int handle_names_slot(const HandleNames* t, uint64_t key) {
+    uint32_t i = hash_name(key) & (t->cap - 1);
+    while (t->key[i] != 0 && t->key[i] != key) i = (i + 1) & (t->cap - 1);
+    return (int)i;
+}
+
+// Make sure that naming another `more` handles keeps the table at most half
+// full, rehashing it in to a bigger one if not
+static int handle_names_reserve(HandleNames* t, int more) {
+    if (2 * ((int64_t)t->count + more) <= t->cap) return 0;
+
+    int64_t cap = t->cap ? t->cap : 2 * INITIAL_SLOTS;
+    while (2 * ((int64_t)t->count + more) > cap) cap *= 2;
+    if (cap > INT32_MAX) return -1;
+    HandleNames n = { calloc(cap, sizeof(uint64_t)), malloc(sizeof(uint32_t) * cap), (int)cap, 0 };
+    if (!n.key || !n.handle) {
+        free(n.key);
+        free(n.handle);
+        return -1;
+    }
+    for (int i = 0; i < t->cap; i++) {
+        if (t->key[i] == 0) continue;
+        int j = handle_names_slot(&n, t->key[i]);
+        n.key[j] = t->key[i];
+        n.handle[j] = t->handle[i];
+        n.count++;
+    }
+    free(t->key);
+    free(t->handle);
+    *t = n;
+    return 0;
+}
+
+// The handle of the caller's id for role, or 0 if it hasn't been given one
+static uint32_t find_handle(const RealSlvsSystem* s, int role, int id) {
+    if (s->names.cap == 0) return 0;
+    int i = handle_names_slot(&s->names, name_key(role, id));
+    return s->names.key[i] ? s->names.handle[i] : 0;
+}
+
+// The handle of the caller's id for role, giving it the next one if it has
+// none yet, so that something can be named before it's added. Entities and
+// constraints are each numbered in turn as they're named, which keeps the
+// solver's handles dense. There must be room (see reserve_slots).
+static uint32_t name_handle(RealSlvsSystem* s, int role, int id) {
+    uint64_t key = name_key(role, id);
+    int i = handle_names_slot(&s->names, key);
+    if (s->names.key[i]) return s->names.handle[i];
+
+    uint32_t h;
+    if (role == ROLE_CONSTRAINT) {
+        h = (uint32_t)s->next_constraint++;
+        s->constraint_id[h] = id;
+    } else {
+        h = (uint32_t)s->next_entity++;
+    }
+    s->names.key[i] = key;
+    s->names.handle[i] = h;
+    s->names.count++;
+    return h;
+}
+
+static Slvs_hEntity entity_handle(RealSlvsSystem* s, int id) {
+    return name_handle(s, ROLE_ENTITY, id);
+}
+
+static Slvs_hConstraint constraint_handle(RealSlvsSystem* s, int id) {
+    return name_handle(s, ROLE_CONSTRAINT, id);
+}
+
+// The caller's id for constraint handle h, or h itself if it's none of theirs
+static int constraint_user_id(const RealSlvsSystem* s, Slvs_hConstraint h) {
+    if (h == 0 || h >= (Slvs_hConstraint)s->next_constraint) return (int)h;
+    return s->constraint_id[h];
+}
+
+// Append an entity to the system, and index it by its handle. There must be
+// room for it (see reserve_slots).
+static void add_entity(RealSlvsSystem* s, Slvs_Entity e) {
+    handle_index_put(&s->entity_index, e.h, s->sys.entities);
+    s->sys.entity[s->sys.entities++] = e;
+}
+
+// The entity with user handle h, or NULL
+static Slvs_Entity* find_entity(RealSlvsSystem* s, Slvs_hEntity h) {
+    int i = handle_index_get(&s->entity_index, h);
+    return (i >= 0) ? &s->sys.entity[i] : NULL;
+}
+
+// Where param h is in sys.param, or -1. Every param is numbered in turn
+// from FIRST_PARAM as it's appended, so that's just its number.
+static int param_index(RealSlvsSystem* s, Slvs_hParam h) {
+    if (h < FIRST_PARAM) return -1;
+    Slvs_hParam i = h - FIRST_PARAM;
+    if (i >= (Slvs_hParam)s->sys.params || s->sys.param[i].h != h) return -1;
+    return (int)i;
+}
+
+// Double the length of an array of count elements until it has room for
+// `more`; the new elements are zeroed, like calloc's.
+static int grow_array(void** array, int* capacity, int count, int more, size_t size) {
+    if ((int64_t)count + more <= *capacity) return 0;
+
+    int64_t cap = *capacity * 2;
+    while ((int64_t)count + more > cap) cap *= 2;
+    if (cap > INT32_MAX) return -1;
+    void* p = realloc(*array, (size_t)cap * size);
+    if (!p) return -1;
+    memset((char*)p + (size_t)*capacity * size, 0, (size_t)(cap - *capacity) * size);
+    *array = p;
+    *capacity = (int)cap;
+    return 0;
+}
+
+// Make room for this many more params, entities, constraints and dragged
+// params
+static int reserve_room(RealSlvsSystem* s, int params, int entities, int constraints, int dragged) {
+    if (grow_array((void**)&s->sys.param, &s->param_cap, s->sys.params, params, sizeof(Slvs_Param)) ||
+        grow_array((void**)&s->sys.entity, &s->entity_cap, s->sys.entities, entities, sizeof(Slvs_Entity)) ||
+        grow_array((void**)&s->sys.constraint, &s->constraint_cap, s->sys.constraints, constraints,
+                   sizeof(Slvs_Constraint)) ||
+        grow_array((void**)&s->sys.dragged, &s->dragged_cap, s->sys.ndragged, dragged, sizeof(Slvs_hParam)) ||
+        handle_index_reserve(&s->entity_index, entities) ||
+        handle_names_reserve(&s->names, entities + constraints) ||
+        grow_array((void**)&s->constraint_id, &s->constraint_id_cap, s->next_constraint, constraints,
+                   sizeof(int))) {
+        return -1;
+    }
+    return 0;
+}
+
+// Make room for whatever an add function is about to write
+static int reserve_slots(RealSlvsSystem* s) {
+    return reserve_room(s, SLOT_HEADROOM, SLOT_HEADROOM, SLOT_HEADROOM, SLOT_HEADROOM);
+}
 
 // Create a new system
 RealSlvsSystem* real_slvs_create() {
     RealSlvsSystem* s = (RealSlvsSystem*)calloc(1, sizeof(RealSlvsSystem));
     if (!s) return NULL;
     
-    // Allocate space for parameters, entities, and constraints
-    s->sys.param = (Slvs_Param*)calloc(5000, sizeof(Slvs_Param));
-    s->sys.entity = (Slvs_Entity*)calloc(5000, sizeof(Slvs_Entity));
-    s->sys.constraint = (Slvs_Constraint*)calloc(5000, sizeof(Slvs_Constraint));
-    
-    if (!s->sys.param || !s->sys.entity || !s->sys.constraint) {
+    // Allocate space for parameters, entities, and constraints; the arrays
+    // grow as they fill
+    s->sys.param = (Slvs_Param*)calloc(INITIAL_SLOTS, sizeof(Slvs_Param));
+    s->sys.entity = (Slvs_Entity*)calloc(INITIAL_SLOTS, sizeof(Slvs_Entity));
+    s->sys.constraint = (Slvs_Constraint*)calloc(INITIAL_SLOTS, sizeof(Slvs_Constraint));
+    s->sys.dragged = (Slvs_hParam*)calloc(INITIAL_SLOTS, sizeof(Slvs_hParam));
+    s->constraint_id = (int*)calloc(INITIAL_SLOTS, sizeof(int));
+    
+    if (!s->sys.param || !s->sys.entity || !s->sys.constraint || !s->sys.dragged || !s->constraint_id ||
+        handle_index_reserve(&s->entity_index, SLOT_HEADROOM) != 0 ||
+        handle_names_reserve(&s->names, SLOT_HEADROOM) != 0) {
         free(s->sys.param);
         free(s->sys.entity);
         free(s->sys.constraint);
+        free(s->sys.dragged);
+        free(s->constraint_id);
+        free(s->entity_index.key);
+        free(s->entity_index.index);
+        free(s->names.key);
+        free(s->names.handle);
         free(s);
         return NULL;
     }
@@ -37,36 +333,38 @@ RealSlvsSystem* real_slvs_create() {
     s->sys.params = 0;
     s->sys.entities = 0;
     s->sys.constraints = 0;
+    s->sys.ndragged = 0;
     s->sys.calculateFaileds = 0;
-    
-    // Allocate space for dragged parameters array
-    s->sys.dragged = (Slvs_hParam*)calloc(1000, sizeof(Slvs_hParam));
-    if (!s->sys.dragged) {
+    s->param_cap = s->entity_cap = s->constraint_cap = s->dragged_cap = INITIAL_SLOTS;
+    s->constraint_id_cap = INITIAL_SLOTS;
+
+    s->ctx = Slvs_CreateContext();
+    if (!s->ctx) {
         free(s->sys.param);
         free(s->sys.entity);
         free(s->sys.constraint);
+        free(s->sys.dragged);
+        free(s->constraint_id);
+        free(s->entity_index.key);
+        free(s->entity_index.index);
+        free(s->names.key);
+        free(s->names.handle);
         free(s);
         return NULL;
     }
-    s->sys.ndragged = 0;
     
-    // Start numbering from higher values to avoid conflicts
-    // Use different ranges to prevent ID collisions
-    // ID scheme:
-    //   User entities:       id (passed directly, typically 1-10000)
-    //   Constraints:         id (passed directly)
-    //   Circle internals use offsets of 100000+ to avoid collisions:
-    //     Normal:     100000 + id
-    //     Origin:     200000 + id  
-    //     Workplane:  300000 + id
-    //     2D Center:  400000 + id
-    //     Distance:   500000 + id
-    //     Circle:     600000 + id
-    //   Arc normals:  700000 + id
-    //   Workplane normals: 800000 + id
-    s->next_param = 10000;  // Parameters: 10000+
-    s->next_entity = 100;   // Entities stay at 100+
-    s->next_constraint = 100; // Constraints stay at 100+
+    // Handles are given out in turn, so the solver's are dense whatever ids
+    // the caller uses:
+    //   Parameters:   FIRST_PARAM on, in the order they're added
+    //   Entities:     FIRST_ENTITY on, as they're named (see name_handle),
+    //                 the caller's own and the ones a circle, arc or
+    //                 workplane makes each under a role of their own
+    //   Constraints:  1 on, as they're named
+    //   The sketch plane (real_slvs_set_planar): SKETCH_ORIGIN, SKETCH_NORMAL
+    //   and SKETCH_PLANE
+    s->next_param = FIRST_PARAM;
+    s->next_entity = FIRST_ENTITY;
+    s->next_constraint = 1;
     
     return s;
 }
@@ -78,20 +376,148 @@ void real_slvs_destroy(RealSlvsSystem* s) {
         if (s->sys.entity) free(s->sys.entity);
         if (s->sys.constraint) free(s->sys.constraint);
         if (s->sys.dragged) free(s->sys.dragged);
+        free(s->sys.sensitivity);
+        free(s->sys.dParam);
+        free(s->sys.cost);
+        free(s->entity_index.key);
+        free(s->entity_index.index);
+        free(s->names.key);
+        free(s->names.handle);
+        free(s->constraint_id);
+        Slvs_DestroyContext(s->ctx);
         free(s);
     }
 }
 
+// Shrink an array to room for `to` elements, if it has more; if that fails,
+// it's left as it was
+static void shrink_array(void** array, int* capacity, int to, size_t size) {
+    if (to >= *capacity) return;
+    void* p = realloc(*array, (size_t)to * size);
+    if (!p) return;
+    *array = p;
+    *capacity = to;
+}
+
+// The room to leave an array that held at most high_water elements
+static int trimmed_slots(int high_water) {
+    int cap = INITIAL_SLOTS;
+    while (cap < high_water + SLOT_HEADROOM) cap *= 2;
+    return cap;
+}
+
+// Give back whatever holds more than TRIM_FACTOR times what the systems since
+// the last trim needed: the arrays, the handle tables and the solver context
+static void trim_system(RealSlvsSystem* s) {
+    int want[4];
+    for (int i = 0; i < 4; i++) want[i] = trimmed_slots(s->high_water[i]);
+    int trimmed = 0;
+
+    if (s->param_cap > TRIM_FACTOR * want[0]) {
+        shrink_array((void**)&s->sys.param, &s->param_cap, want[0], sizeof(Slvs_Param));
+        trimmed = 1;
+    }
+    if (s->entity_cap > TRIM_FACTOR * want[1]) {
+        shrink_array((void**)&s->sys.entity, &s->entity_cap, want[1], sizeof(Slvs_Entity));
+        trimmed = 1;
+    }
+    if (s->constraint_cap > TRIM_FACTOR * want[2]) {
+        shrink_array((void**)&s->sys.constraint, &s->constraint_cap, want[2], sizeof(Slvs_Constraint));
+        shrink_array((void**)&s->constraint_id, &s->constraint_id_cap, want[2], sizeof(int));
+        trimmed = 1;
+    }
+    if (s->dragged_cap > TRIM_FACTOR * want[3]) {
+        shrink_array((void**)&s->sys.dragged, &s->dragged_cap, want[3], sizeof(Slvs_hParam));
+    }
+    // The tables are empty, so they're just made again, as small as they'd
+    // be for a new system
+    if (s->entity_index.cap > 2 * TRIM_FACTOR * want[1]) {
+        free(s->entity_index.key);
+        free(s->entity_index.index);
+        memset(&s->entity_index, 0, sizeof(s->entity_index));
+        handle_index_reserve(&s->entity_index, SLOT_HEADROOM);
+    }
+    if (s->names.cap > 2 * TRIM_FACTOR * (want[1] + want[2])) {
+        free(s->names.key);
+        free(s->names.handle);
+        memset(&s->names, 0, sizeof(s->names));
+        handle_names_reserve(&s->names, SLOT_HEADROOM);
+    }
+    // The context holds about as much again, as the solver's own copy of
+    // the system; a new one starts small
+    if (trimmed) {
+        Slvs_Context* ctx = Slvs_CreateContext();
+        if (ctx) {
+            Slvs_DestroyContext(s->ctx);
+            s->ctx = ctx;
+        }
+    }
+    Slvs_TrimThreadMemory();
+}
+
+// Empty the system for another one, as if it had just been created, settings
+// and all, but keep the room it grew for the last; so that a system of about
+// the same size is added and solved without allocating. Every TRIM_PERIOD
+// resets, whatever has room for far more than the systems since needed is
+// given back. Returns 0, or -1 on a bad system or if a table couldn't be
+// made again after trimming it, in which case the system must be destroyed.
+int real_slvs_reset(RealSlvsSystem* s) {
+    if (!s) return -1;
+
+    int used[4] = { s->sys.params, s->sys.entities, s->sys.constraints, s->sys.ndragged };
+    for (int i = 0; i < 4; i++) {
+        if (used[i] > s->high_water[i]) s->high_water[i] = used[i];
+    }
+
+    // Past the count, the arrays are zeroed, as grow_array leaves them
+    memset(s->sys.param, 0, sizeof(Slvs_Param) * (size_t)s->sys.params);
+    memset(s->sys.entity, 0, sizeof(Slvs_Entity) * (size_t)s->sys.entities);
+    memset(s->sys.constraint, 0, sizeof(Slvs_Constraint) * (size_t)s->sys.constraints);
+    memset(s->sys.dragged, 0, sizeof(Slvs_hParam) * (size_t)s->sys.ndragged);
+    memset(s->constraint_id, 0, sizeof(int) * (size_t)s->next_constraint);
+    memset(s->entity_index.key, 0, sizeof(uint32_t) * (size_t)s->entity_index.cap);
+    s->entity_index.count = 0;
+    memset(s->names.key, 0, sizeof(uint64_t) * (size_t)s->names.cap);
+    s->names.count = 0;
+
+    // Everything else in sys goes back to zero, as calloc left it
+    Slvs_System kept = s->sys;
+    free(kept.sensitivity);
+    memset(&s->sys, 0, sizeof(s->sys));
+    s->sys.param = kept.param;
+    s->sys.entity = kept.entity;
+    s->sys.constraint = kept.constraint;
+    s->sys.dragged = kept.dragged;
+    s->sys.dParam = kept.dParam;
+    s->sys.cost = kept.cost;
+
+    s->next_param = FIRST_PARAM;
+    s->next_entity = FIRST_ENTITY;
+    s->next_constraint = 1;
+    s->profile = 0;
+    s->planar = 0;
+    s->starts = 0;
+    Slvs_ResetContext(s->ctx);
+
+    if (++s->resets >= TRIM_PERIOD) {
+        trim_system(s);
+        memset(s->high_water, 0, sizeof(s->high_water));
+        s->resets = 0;
+        if (s->entity_index.cap == 0 || s->names.cap == 0) return -1;
+    }
+    return 0;
+}
+
 // Add WHERE_DRAGGED constraint (locks point to current position)
 int real_slvs_add_where_dragged_constraint(RealSlvsSystem* s, int id,
                                            int point_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity wrkpl = (workplane_id >= 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity wrkpl = (workplane_id >= 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_WHERE_DRAGGED, wrkpl,
@@ -100,9 +526,35 @@ int real_slvs_add_where_dragged_constraint(RealSlvsSystem* s, int id,
     return 0;
 }
 
+// Add a 2D point in the workplane with handle wrkpl
+static int add_point_in(RealSlvsSystem* s, int id, Slvs_hEntity wrkpl, double u, double v, int is_dragged) {
+    Slvs_hGroup g = 1;
+    
+    // Create parameters for 2D coordinates
+    int pu = s->next_param++;
+    int pv = s->next_param++;
+    
+    s->sys.param[s->sys.params++] = Slvs_MakeParam(pu, g, u);
+    s->sys.param[s->sys.params++] = Slvs_MakeParam(pv, g, v);
+    
+    // If dragged, mark these parameters as dragged
+    if (is_dragged) {
+        s->sys.dragged[s->sys.ndragged++] = pu;
+        s->sys.dragged[s->sys.ndragged++] = pv;
+    }
+    
+    // Create 2D point entity
+    add_entity(s, Slvs_MakePoint2d(entity_handle(s, id), g, wrkpl, pu, pv));
+    
+    return 0;
+}
+
 // Add a 3D point
 int real_slvs_add_point(RealSlvsSystem* s, int id, double x, double y, double z, int is_dragged) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
+
+    // In the sketch plane, a point is just its x and y
+    if (s->planar) return add_point_in(s, id, SKETCH_PLANE, x, y, is_dragged);
     
     Slvs_hGroup g = 1;
     
@@ -116,84 +568,80 @@ int real_slvs_add_point(RealSlvsSystem* s, int id, double x, double y, double z,
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pz, g, z);
     
     // If dragged, mark these parameters as dragged
-    if (is_dragged && s->sys.ndragged < 997) {  // Leave room for 3 params
+    if (is_dragged) {
         s->sys.dragged[s->sys.ndragged++] = px;
         s->sys.dragged[s->sys.ndragged++] = py;
         s->sys.dragged[s->sys.ndragged++] = pz;
     }
     
-    // Create the point entity with 1000+ offset like working version
-    Slvs_hEntity entity_id = 1000 + id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakePoint3d(entity_id, g, px, py, pz);
+    // Create the point entity
+    Slvs_hEntity entity_id = entity_handle(s, id);
+    add_entity(s, Slvs_MakePoint3d(entity_id, g, px, py, pz));
     
     return 0;
 }
 
 // Add a line between two points (3D line)
 int real_slvs_add_line(RealSlvsSystem* s, int id, int point1_id, int point2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Create line segment entity with proper ID mapping
-    Slvs_hEntity line_id = 1000 + id;
-    Slvs_hEntity p1 = 1000 + point1_id;
-    Slvs_hEntity p2 = 1000 + point2_id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeLineSegment(line_id, g, 
-        SLVS_FREE_IN_3D, p1, p2);
+    Slvs_hEntity line_id = entity_handle(s, id);
+    Slvs_hEntity p1 = entity_handle(s, point1_id);
+    Slvs_hEntity p2 = entity_handle(s, point2_id);
+    add_entity(s, Slvs_MakeLineSegment(line_id, g, 
+        SLVS_FREE_IN_3D, p1, p2));
     
     return 0;
 }
 
 // Add a 2D line between two 2D points in a workplane
 int real_slvs_add_line_2d(RealSlvsSystem* s, int id, int point1_id, int point2_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Create 2D line segment entity with proper ID mapping
-    Slvs_hEntity line_id = 1000 + id;
-    Slvs_hEntity p1 = 1000 + point1_id;
-    Slvs_hEntity p2 = 1000 + point2_id;
-    Slvs_hEntity wrkpl = (workplane_id > 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeLineSegment(line_id, g, wrkpl, p1, p2);
+    Slvs_hEntity line_id = entity_handle(s, id);
+    Slvs_hEntity p1 = entity_handle(s, point1_id);
+    Slvs_hEntity p2 = entity_handle(s, point2_id);
+    Slvs_hEntity wrkpl = (workplane_id > 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
+    add_entity(s, Slvs_MakeLineSegment(line_id, g, wrkpl, p1, p2));
     
     return 0;
 }
 
 // Add a 2D point in a workplane
 int real_slvs_add_point_2d(RealSlvsSystem* s, int id, int workplane_id, double u, double v, int is_dragged) {
-    if (!s) return -1;
-    
-    Slvs_hGroup g = 1;
-    
-    // Create parameters for 2D coordinates
-    int pu = s->next_param++;
-    int pv = s->next_param++;
-    
-    s->sys.param[s->sys.params++] = Slvs_MakeParam(pu, g, u);
-    s->sys.param[s->sys.params++] = Slvs_MakeParam(pv, g, v);
-    
-    // If dragged, mark these parameters as dragged
-    if (is_dragged && s->sys.ndragged < 998) {  // Leave room for 2 params
-        s->sys.dragged[s->sys.ndragged++] = pu;
-        s->sys.dragged[s->sys.ndragged++] = pv;
-    }
-    
-    // Create 2D point entity
-    Slvs_hEntity entity_id = 1000 + id;
-    Slvs_hEntity wp = 1000 + workplane_id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakePoint2d(entity_id, g, wp, pu, pv);
-    
-    return 0;
+    if (!s || reserve_slots(s) != 0) return -1;
+    return add_point_in(s, id, entity_handle(s, workplane_id), u, v, is_dragged);
 }
 
 // Add a circle with explicit normal vector
 int real_slvs_add_circle(RealSlvsSystem* s, int id, double cx, double cy, double cz, double radius,
                          double nx, double ny, double nz) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
+
+    if (s->planar) {
+        // The centre is a point in the sketch plane, and the circle takes
+        // the plane's normal; there's no origin or workplane of its own
+        int pu = s->next_param++;
+        int pv = s->next_param++;
+        s->sys.param[s->sys.params++] = Slvs_MakeParam(pu, g, cx);
+        s->sys.param[s->sys.params++] = Slvs_MakeParam(pv, g, cy);
+        add_entity(s, Slvs_MakePoint2d(name_handle(s, ROLE_CIRCLE_CENTER, id), g, SKETCH_PLANE, pu, pv));
+
+        int pr = s->next_param++;
+        s->sys.param[s->sys.params++] = Slvs_MakeParam(pr, g, radius);
+        add_entity(s, Slvs_MakeDistance(name_handle(s, ROLE_CIRCLE_RADIUS, id), g, SLVS_FREE_IN_3D, pr));
+
+        add_entity(s, Slvs_MakeCircle(name_handle(s, ROLE_CIRCLE, id), g, SKETCH_PLANE, name_handle(s, ROLE_CIRCLE_CENTER, id), SKETCH_NORMAL, name_handle(s, ROLE_CIRCLE_RADIUS, id)));
+        return 0;
+    }
     
     // Create normal entity from the provided normal vector
     double qw, qx, qy, qz;
@@ -209,8 +657,8 @@ int real_slvs_add_circle(RealSlvsSystem* s, int id, double cx, double cy, double
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pqy, g, qy);
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pqz, g, qz);
     
-    Slvs_hEntity normal_id = 100000 + id; // Use large offset to avoid collisions
-    s->sys.entity[s->sys.entities++] = Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz);
+    Slvs_hEntity normal_id = name_handle(s, ROLE_CIRCLE_NORMAL, id);
+    add_entity(s, Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz));
     
     // Create origin point for workplane (3D point)
     int pox = s->next_param++;
@@ -221,12 +669,12 @@ int real_slvs_add_circle(RealSlvsSystem* s, int id, double cx, double cy, double
     s->sys.param[s->sys.params++] = Slvs_MakeParam(poy, g, cy);
     s->sys.param[s->sys.params++] = Slvs_MakeParam(poz, g, cz);
     
-    Slvs_hEntity origin_id = 200000 + id; // Use large offset to avoid collisions
-    s->sys.entity[s->sys.entities++] = Slvs_MakePoint3d(origin_id, g, pox, poy, poz);
+    Slvs_hEntity origin_id = name_handle(s, ROLE_CIRCLE_ORIGIN, id);
+    add_entity(s, Slvs_MakePoint3d(origin_id, g, pox, poy, poz));
     
     // Create workplane for the circle (required for circles)
-    Slvs_hEntity workplane_id = 300000 + id; // Use large offset to avoid collisions
-    s->sys.entity[s->sys.entities++] = Slvs_MakeWorkplane(workplane_id, g, origin_id, normal_id);
+    Slvs_hEntity workplane_id = name_handle(s, ROLE_CIRCLE_WORKPLANE, id);
+    add_entity(s, Slvs_MakeWorkplane(workplane_id, g, origin_id, normal_id));
     
     // Create 2D center point in the workplane (u, v coordinates)
     // For simplicity, use (0, 0) as the center in the workplane coordinate system
@@ -236,24 +684,19 @@ int real_slvs_add_circle(RealSlvsSystem* s, int id, double cx, double cy, double
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pu, g, 0.0);
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pv, g, 0.0);
     
-    Slvs_hEntity center_id = 400000 + id; // Use large offset to avoid collisions
-    s->sys.entity[s->sys.entities++] = Slvs_MakePoint2d(center_id, g, workplane_id, pu, pv);
+    Slvs_hEntity center_id = name_handle(s, ROLE_CIRCLE_CENTER, id);
+    add_entity(s, Slvs_MakePoint2d(center_id, g, workplane_id, pu, pv));
     
     // Create distance entity for radius
     int pr = s->next_param++;
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pr, g, radius);
     
-    Slvs_hEntity radius_id = 500000 + id; // Use large offset to avoid collisions
-    s->sys.entity[s->sys.entities++] = Slvs_MakeDistance(radius_id, g, SLVS_FREE_IN_3D, pr);
-    
-    // Create circle entity (use high offset to avoid collision with regular entities)
-    Slvs_hEntity circle_id = 600000 + id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeCircle(circle_id, g, workplane_id, center_id, normal_id, radius_id);
+    Slvs_hEntity radius_id = name_handle(s, ROLE_CIRCLE_RADIUS, id);
+    add_entity(s, Slvs_MakeDistance(radius_id, g, SLVS_FREE_IN_3D, pr));
     
-    // Store radius for later retrieval (for backward compatibility)
-    if (id < 1000) {
-        s->circle_radii[id] = radius;
-    }
+    // Create circle entity
+    Slvs_hEntity circle_id = name_handle(s, ROLE_CIRCLE, id);
+    add_entity(s, Slvs_MakeCircle(circle_id, g, workplane_id, center_id, normal_id, radius_id));
     
     return 0;
 }
@@ -262,9 +705,21 @@ int real_slvs_add_circle(RealSlvsSystem* s, int id, double cx, double cy, double
 // This allows the circle to track the point during solving
 int real_slvs_add_circle_with_center_point(RealSlvsSystem* s, int id, int center_point_id, 
                                             double radius, double nx, double ny, double nz) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
+
+    if (s->planar) {
+        // The point is in the sketch plane already, so the circle only
+        // needs its radius
+        int pr = s->next_param++;
+        s->sys.param[s->sys.params++] = Slvs_MakeParam(pr, g, radius);
+        add_entity(s, Slvs_MakeDistance(name_handle(s, ROLE_CIRCLE_RADIUS, id), g, SLVS_FREE_IN_3D, pr));
+
+        add_entity(s, Slvs_MakeCircle(name_handle(s, ROLE_CIRCLE, id), g, SKETCH_PLANE, entity_handle(s, center_point_id), SKETCH_NORMAL,
+                                      name_handle(s, ROLE_CIRCLE_RADIUS, id)));
+        return 0;
+    }
     
     // Create normal entity from the provided normal vector
     double qw, qx, qy, qz;
@@ -280,15 +735,15 @@ int real_slvs_add_circle_with_center_point(RealSlvsSystem* s, int id, int center
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pqy, g, qy);
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pqz, g, qz);
     
-    Slvs_hEntity normal_id = 100000 + id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz);
+    Slvs_hEntity normal_id = name_handle(s, ROLE_CIRCLE_NORMAL, id);
+    add_entity(s, Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz));
     
     // Use the existing point as the workplane origin
-    Slvs_hEntity origin_id = 1000 + center_point_id;
+    Slvs_hEntity origin_id = entity_handle(s, center_point_id);
     
     // Create workplane for the circle centered on the existing point
-    Slvs_hEntity workplane_id = 300000 + id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeWorkplane(workplane_id, g, origin_id, normal_id);
+    Slvs_hEntity workplane_id = name_handle(s, ROLE_CIRCLE_WORKPLANE, id);
+    add_entity(s, Slvs_MakeWorkplane(workplane_id, g, origin_id, normal_id));
     
     // Create 2D center point at origin of the workplane (0, 0)
     int pu = s->next_param++;
@@ -297,24 +752,19 @@ int real_slvs_add_circle_with_center_point(RealSlvsSystem* s, int id, int center
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pu, g, 0.0);
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pv, g, 0.0);
     
-    Slvs_hEntity center_2d_id = 400000 + id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakePoint2d(center_2d_id, g, workplane_id, pu, pv);
+    Slvs_hEntity center_2d_id = name_handle(s, ROLE_CIRCLE_CENTER, id);
+    add_entity(s, Slvs_MakePoint2d(center_2d_id, g, workplane_id, pu, pv));
     
     // Create distance entity for radius
     int pr = s->next_param++;
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pr, g, radius);
     
-    Slvs_hEntity radius_id = 500000 + id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeDistance(radius_id, g, SLVS_FREE_IN_3D, pr);
+    Slvs_hEntity radius_id = name_handle(s, ROLE_CIRCLE_RADIUS, id);
+    add_entity(s, Slvs_MakeDistance(radius_id, g, SLVS_FREE_IN_3D, pr));
     
     // Create circle entity
-    Slvs_hEntity circle_id = 600000 + id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeCircle(circle_id, g, workplane_id, center_2d_id, normal_id, radius_id);
-    
-    // Store radius and track that this circle uses an existing point
-    if (id < 1000) {
-        s->circle_radii[id] = radius;
-    }
+    Slvs_hEntity circle_id = name_handle(s, ROLE_CIRCLE, id);
+    add_entity(s, Slvs_MakeCircle(circle_id, g, workplane_id, center_2d_id, normal_id, radius_id));
     
     return 0;
 }
@@ -322,9 +772,16 @@ int real_slvs_add_circle_with_center_point(RealSlvsSystem* s, int id, int center
 // Add a proper arc of circle
 int real_slvs_add_arc(RealSlvsSystem* s, int id, int center_point_id, int start_point_id, 
                      int end_point_id, double nx, double ny, double nz, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
+
+    if (s->planar && workplane_id < 0) {
+        // In the sketch plane, with its normal
+        add_entity(s, Slvs_MakeArcOfCircle(entity_handle(s, id), g, SKETCH_PLANE, SKETCH_NORMAL, entity_handle(s, center_point_id),
+                                           entity_handle(s, start_point_id), entity_handle(s, end_point_id)));
+        return 0;
+    }
     
     // Convert normal vector to quaternion for normal entity
     double qw, qx, qy, qz;
@@ -342,17 +799,17 @@ int real_slvs_add_arc(RealSlvsSystem* s, int id, int center_point_id, int start_
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pqz, g, qz);
     
     // Create normal entity
-    Slvs_hEntity normal_id = 700000 + id; // Use large offset to avoid collisions
-    s->sys.entity[s->sys.entities++] = Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz);
+    Slvs_hEntity normal_id = name_handle(s, ROLE_ARC_NORMAL, id);
+    add_entity(s, Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz));
     
     // Create arc entity
-    Slvs_hEntity arc_id = 1000 + id;
-    Slvs_hEntity center = 1000 + center_point_id;
-    Slvs_hEntity start = 1000 + start_point_id;
-    Slvs_hEntity end = 1000 + end_point_id;
-    Slvs_hEntity wrkpl = (workplane_id >= 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hEntity arc_id = entity_handle(s, id);
+    Slvs_hEntity center = entity_handle(s, center_point_id);
+    Slvs_hEntity start = entity_handle(s, start_point_id);
+    Slvs_hEntity end = entity_handle(s, end_point_id);
+    Slvs_hEntity wrkpl = (workplane_id >= 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
     
-    s->sys.entity[s->sys.entities++] = Slvs_MakeArcOfCircle(arc_id, g, wrkpl, normal_id, center, start, end);
+    add_entity(s, Slvs_MakeArcOfCircle(arc_id, g, wrkpl, normal_id, center, start, end));
     
     return 0;
 }
@@ -360,36 +817,35 @@ int real_slvs_add_arc(RealSlvsSystem* s, int id, int center_point_id, int start_
 // Add a cubic Bezier curve
 int real_slvs_add_cubic(RealSlvsSystem* s, int id, int pt0_id, int pt1_id, 
                        int pt2_id, int pt3_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Create cubic entity
-    Slvs_hEntity cubic_id = 1000 + id;
-    Slvs_hEntity pt0 = 1000 + pt0_id;
-    Slvs_hEntity pt1 = 1000 + pt1_id;
-    Slvs_hEntity pt2 = 1000 + pt2_id;
-    Slvs_hEntity pt3 = 1000 + pt3_id;
-    Slvs_hEntity wrkpl = (workplane_id >= 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hEntity cubic_id = entity_handle(s, id);
+    Slvs_hEntity pt0 = entity_handle(s, pt0_id);
+    Slvs_hEntity pt1 = entity_handle(s, pt1_id);
+    Slvs_hEntity pt2 = entity_handle(s, pt2_id);
+    Slvs_hEntity pt3 = entity_handle(s, pt3_id);
+    Slvs_hEntity wrkpl = (workplane_id >= 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
+    if (s->planar && workplane_id < 0) wrkpl = SKETCH_PLANE;
     
-    s->sys.entity[s->sys.entities++] = Slvs_MakeCubic(cubic_id, g, wrkpl, pt0, pt1, pt2, pt3);
+    add_entity(s, Slvs_MakeCubic(cubic_id, g, wrkpl, pt0, pt1, pt2, pt3));
     
     return 0;
 }
 
 // Add a distance constraint
 int real_slvs_add_distance_constraint(RealSlvsSystem* s, int id, int entity1, int entity2, double distance) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     
     Slvs_hGroup g = 1;
     
-    // Convert entity IDs to internal IDs with 1000+ offset
-    Slvs_hEntity point1 = 1000 + entity1;
-    Slvs_hEntity point2 = 1000 + entity2;
+    Slvs_hEntity point1 = entity_handle(s, entity1);
+    Slvs_hEntity point2 = entity_handle(s, entity2);
     
-    // Use a unique constraint ID with large offset
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
     // Add distance constraint - pass distance directly as valParam like working version
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
@@ -404,16 +860,14 @@ int real_slvs_add_distance_constraint(RealSlvsSystem* s, int id, int entity1, in
 // For 3D points, pass workplane_id <= 0 to use FREE_IN_3D
 // For 2D points, pass the workplane ID
 int real_slvs_add_fixed_constraint(RealSlvsSystem* s, int id, int entity_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
-    // Convert entity ID to internal ID with 1000+ offset
-    Slvs_hEntity e = 1000 + entity_id;
-    Slvs_hEntity workplane = (workplane_id > 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hEntity e = entity_handle(s, entity_id);
+    Slvs_hEntity workplane = (workplane_id > 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
     
-    // Use a unique constraint ID with large offset
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
     // Where the point is constrained to be
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
@@ -425,14 +879,14 @@ int real_slvs_add_fixed_constraint(RealSlvsSystem* s, int id, int entity_id, int
 
 // Add parallel constraint
 int real_slvs_add_parallel_constraint(RealSlvsSystem* s, int id, int line1_id, int line2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PARALLEL, SLVS_FREE_IN_3D,
@@ -443,14 +897,14 @@ int real_slvs_add_parallel_constraint(RealSlvsSystem* s, int id, int line1_id, i
 
 // Add perpendicular constraint
 int real_slvs_add_perpendicular_constraint(RealSlvsSystem* s, int id, int line1_id, int line2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PERPENDICULAR, SLVS_FREE_IN_3D,
@@ -461,14 +915,14 @@ int real_slvs_add_perpendicular_constraint(RealSlvsSystem* s, int id, int line1_
 
 // Add angle constraint
 int real_slvs_add_angle_constraint(RealSlvsSystem* s, int id, int line1_id, int line2_id, double angle) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
     
     // Pass angle value directly (in degrees), not as a parameter ID
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
@@ -480,14 +934,14 @@ int real_slvs_add_angle_constraint(RealSlvsSystem* s, int id, int line1_id, int
 
 // Add horizontal constraint
 int real_slvs_add_horizontal_constraint(RealSlvsSystem* s, int id, int line_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entity
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity line = 1000 + line_id;
-    Slvs_hEntity workplane = (workplane_id > 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity line = entity_handle(s, line_id);
+    Slvs_hEntity workplane = (workplane_id > 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_HORIZONTAL, workplane,
@@ -498,14 +952,14 @@ int real_slvs_add_horizontal_constraint(RealSlvsSystem* s, int id, int line_id,
 
 // Add vertical constraint
 int real_slvs_add_vertical_constraint(RealSlvsSystem* s, int id, int line_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entity
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity line = 1000 + line_id;
-    Slvs_hEntity workplane = (workplane_id > 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity line = entity_handle(s, line_id);
+    Slvs_hEntity workplane = (workplane_id > 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_VERTICAL, workplane,
@@ -517,15 +971,15 @@ int real_slvs_add_vertical_constraint(RealSlvsSystem* s, int id, int line_id, in
 // Add equal length constraint (between two lines)
 // For 2D lines, pass the workplane_id; for 3D lines, pass 0
 int real_slvs_add_equal_length_constraint(RealSlvsSystem* s, int id, int line1_id, int line2_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
 
     Slvs_hGroup g = 1;
 
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
-    Slvs_hEntity workplane = (workplane_id > 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
+    Slvs_hEntity workplane = (workplane_id > 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
 
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_EQUAL_LENGTH_LINES, workplane,
@@ -536,14 +990,14 @@ int real_slvs_add_equal_length_constraint(RealSlvsSystem* s, int id, int line1_i
 
 // Add equal radius constraint (between two circles/arcs)
 int real_slvs_add_equal_radius_constraint(RealSlvsSystem* s, int id, int circle1_id, int circle2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity circle1 = 600000 + circle1_id;
-    Slvs_hEntity circle2 = 600000 + circle2_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity circle1 = name_handle(s, ROLE_CIRCLE, circle1_id);
+    Slvs_hEntity circle2 = name_handle(s, ROLE_CIRCLE, circle2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_EQUAL_RADIUS, SLVS_FREE_IN_3D,
@@ -557,21 +1011,20 @@ int real_slvs_add_equal_radius_constraint(RealSlvsSystem* s, int id, int circle1
 // For Arc+Line use SLVS_C_ARC_LINE_TANGENT
 // For Cubic+Line use SLVS_C_CUBIC_LINE_TANGENT
 int real_slvs_add_tangent_constraint(RealSlvsSystem* s, int id, int entity1_id, int entity2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity entity1 = 1000 + entity1_id;
-    Slvs_hEntity entity2 = 1000 + entity2_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity entity1 = entity_handle(s, entity1_id);
+    Slvs_hEntity entity2 = entity_handle(s, entity2_id);
     
     // Detect entity types to choose the correct constraint type
-    int entity1_type = -1, entity2_type = -1;
-    for (int i = 0; i < s->sys.entities; i++) {
-        if (s->sys.entity[i].h == entity1) entity1_type = s->sys.entity[i].type;
-        if (s->sys.entity[i].h == entity2) entity2_type = s->sys.entity[i].type;
-    }
+    Slvs_Entity* e1 = find_entity(s, entity1);
+    Slvs_Entity* e2 = find_entity(s, entity2);
+    int entity1_type = e1 ? e1->type : -1;
+    int entity2_type = e2 ? e2->type : -1;
     
     // Determine the correct constraint type based on entity types
     int constraint_type;
@@ -625,14 +1078,14 @@ int real_slvs_add_tangent_constraint(RealSlvsSystem* s, int id, int entity1_id,
 
 // Add point on circle constraint
 int real_slvs_add_point_on_circle_constraint(RealSlvsSystem* s, int id, int point_id, int circle_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity circle = 600000 + circle_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity circle = name_handle(s, ROLE_CIRCLE, circle_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PT_ON_CIRCLE, SLVS_FREE_IN_3D,
@@ -643,15 +1096,15 @@ int real_slvs_add_point_on_circle_constraint(RealSlvsSystem* s, int id, int poin
 
 // Add symmetric constraint (two entities symmetric about a line)
 int real_slvs_add_symmetric_constraint(RealSlvsSystem* s, int id, int entity1_id, int entity2_id, int line_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity entity1 = 1000 + entity1_id;
-    Slvs_hEntity entity2 = 1000 + entity2_id;
-    Slvs_hEntity line = 1000 + line_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity entity1 = entity_handle(s, entity1_id);
+    Slvs_hEntity entity2 = entity_handle(s, entity2_id);
+    Slvs_hEntity line = entity_handle(s, line_id);
     
     // Use SYMMETRIC_LINE for symmetric about a line
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
@@ -663,14 +1116,14 @@ int real_slvs_add_symmetric_constraint(RealSlvsSystem* s, int id, int entity1_id
 
 // Add midpoint constraint (point at midpoint of line)
 int real_slvs_add_midpoint_constraint(RealSlvsSystem* s, int id, int point_id, int line_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity line = 1000 + line_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity line = entity_handle(s, line_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_AT_MIDPOINT, SLVS_FREE_IN_3D,
@@ -682,15 +1135,15 @@ int real_slvs_add_midpoint_constraint(RealSlvsSystem* s, int id, int point_id, i
 // Add point on line constraint
 // workplane_id: use -1 for 3D (SLVS_FREE_IN_3D), or the workplane entity ID for 2D
 int real_slvs_add_point_on_line_constraint(RealSlvsSystem* s, int id, int point_id, int line_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
 
     Slvs_hGroup g = 1;
 
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity line = 1000 + line_id;
-    Slvs_hEntity wrkpl = (workplane_id >= 0) ? (1000 + workplane_id) : SLVS_FREE_IN_3D;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity line = entity_handle(s, line_id);
+    Slvs_hEntity wrkpl = (workplane_id >= 0) ? entity_handle(s, workplane_id) : SLVS_FREE_IN_3D;
 
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PT_ON_LINE, wrkpl,
@@ -701,14 +1154,14 @@ int real_slvs_add_point_on_line_constraint(RealSlvsSystem* s, int id, int point_
 
 // Add points coincident constraint
 int real_slvs_add_points_coincident_constraint(RealSlvsSystem* s, int id, int point1_id, int point2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
     // Use proper ID mapping for constraint and entities
-    Slvs_hConstraint constraint_id = 10000 + id;
-    Slvs_hEntity point1 = 1000 + point1_id;
-    Slvs_hEntity point2 = 1000 + point2_id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+    Slvs_hEntity point1 = entity_handle(s, point1_id);
+    Slvs_hEntity point2 = entity_handle(s, point2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_POINTS_COINCIDENT, SLVS_FREE_IN_3D,
@@ -717,14 +1170,241 @@ int real_slvs_add_points_coincident_constraint(RealSlvsSystem* s, int id, int po
     return 0;
 }
 
+// Set the convergence tolerance, the iteration limit, and whether Newton's
+// method takes damped steps (a tolerance or limit of 0 keeps the default)
+int real_slvs_set_solver_options(RealSlvsSystem* s, double tolerance, int max_iterations, int damped) {
+    if (!s) return -1;
+    if (tolerance < 0 || max_iterations < 0) return -1;
+
+    s->sys.tolerance = tolerance;
+    s->sys.maxIterations = max_iterations;
+    s->sys.stepMode = damped ? SLVS_STEP_DAMPED : SLVS_STEP_NEWTON;
+
+    return 0;
+}
+
+// Set the most unknowns the solver takes on at once (0 for no limit)
+int real_slvs_set_max_unknowns(RealSlvsSystem* s, int max_unknowns) {
+    if (!s) return -1;
+    if (max_unknowns < 0) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetMaxUnknowns(max_unknowns);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// Set whether Newton's method reuses the last factorization of the Jacobian
+// for as long as the residuals shrink quickly (the chord method)
+int real_slvs_set_chord_steps(RealSlvsSystem* s, int chord) {
+    if (!s) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetJacobianUpdate(chord ? SLVS_JACOBIAN_UPDATE_CHORD : SLVS_JACOBIAN_UPDATE_EVERY_STEP);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// Set whether solves start in stages, a class of constraints at a time
+int real_slvs_set_staged_start(RealSlvsSystem* s, int staged) {
+    if (!s) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetStartMode(staged ? SLVS_START_STAGED : SLVS_START_AS_GIVEN);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// Set whether batches evaluate their first Newton steps in single precision
+int real_slvs_set_mixed_precision(RealSlvsSystem* s, int mixed) {
+    if (!s) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetBatchPrecision(mixed ? SLVS_BATCH_PRECISION_MIXED : SLVS_BATCH_PRECISION_DOUBLE);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// Set how many starting points a solve tries when the given one doesn't
+// converge, each a fixed perturbation of it (0 or 1 for just the given one)
+int real_slvs_set_multi_start(RealSlvsSystem* s, int starts) {
+    if (!s) return -1;
+    if (starts < 0) return -1;
+
+    s->starts = starts;
+    return 0;
+}
+
+// Set the longest each solve may take, in milliseconds (0 for no limit)
+int real_slvs_set_timeout(RealSlvsSystem* s, int timeout_ms) {
+    if (!s) return -1;
+    if (timeout_ms < 0) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetTimeout(timeout_ms);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// Set the most bytes each solve may hold (0 for no limit)
+int real_slvs_set_memory_budget(RealSlvsSystem* s, int64_t bytes) {
+    if (!s) return -1;
+    if (bytes < 0) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetMemoryBudget(bytes);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// Call back as each phase of this system's solves begins and ends, or stop
+// with a NULL callback; the callback may be called from several threads.
+int real_slvs_set_trace(RealSlvsSystem* s, Slvs_TraceCallback callback, void* user) {
+    if (!s) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetTraceCallback(callback, user);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// Tell the system's trace of the end of each Newton step as well
+int real_slvs_set_trace_steps(RealSlvsSystem* s, int on) {
+    if (!s) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    Slvs_SetTraceSteps(on);
+    Slvs_SetCurrentContext(prev);
+
+    return 0;
+}
+
+// End the solve running on the system as soon as it can, as a timeout would.
+// Safe to call from any thread while the system exists.
+int real_slvs_cancel(RealSlvsSystem* s) {
+    if (!s) return -1;
+    Slvs_Cancel(s->ctx);
+    return 0;
+}
+
+// Ask the next solves for the derivatives of every parameter by the values of
+// the given dimension constraints (none, with n_constraints 0), which
+// real_slvs_get_point_sensitivity reads back. Returns 0, or -1 on bad
+// arguments.
+int real_slvs_set_sensitivities(RealSlvsSystem* s, const int* constraint_ids, int n_constraints) {
+    if (!s || n_constraints < 0 || (n_constraints > 0 && !constraint_ids)) return -1;
+
+    Slvs_hConstraint* handles = NULL;
+    if (n_constraints > 0) {
+        handles = malloc(sizeof(Slvs_hConstraint) * n_constraints);
+        if (!handles) return -1;
+        for (int i = 0; i < n_constraints; i++) {
+            handles[i] = find_handle(s, ROLE_CONSTRAINT, constraint_ids[i]);
+        }
+    }
+    free(s->sys.sensitivity);
+    s->sys.sensitivity = handles;
+    s->sys.sensitivities = n_constraints;
+    return 0;
+}
+
+// The derivative of a point's solved coordinates (2D points as u, v, 0) by
+// the value of the index'th constraint passed to real_slvs_set_sensitivities,
+// from the last solve. Returns 0, or -1 if there's no such point or index.
+int real_slvs_get_point_sensitivity(RealSlvsSystem* s, int index, int point_id,
+                                    double* dx, double* dy, double* dz) {
+    if (!s || !dx || !dy || !dz || !s->sys.dParam) return -1;
+    if (index < 0 || index >= s->sys.sensitivities) return -1;
+
+    int idx[3];
+    if (find_point_params(s, point_id, idx) != 0) return -1;
+    const double* row = &s->sys.dParam[(size_t)index * s->sys.params];
+    *dx = (idx[0] >= 0) ? row[idx[0]] : 0.0;
+    *dy = (idx[1] >= 0) ? row[idx[1]] : 0.0;
+    *dz = (idx[2] >= 0) ? row[idx[2]] : 0.0;
+    return 0;
+}
+
+// Profile the solves that follow (on != 0) or stop. Returns 0, or -1 on a
+// bad system.
+int real_slvs_set_profile(RealSlvsSystem* s, int on) {
+    if (!s) return -1;
+    s->profile = on ? 1 : 0;
+    if (!s->profile) {
+        free(s->sys.cost);
+        s->sys.cost = NULL;
+        s->sys.costs = 0;
+        s->cost_cap = 0;
+    }
+    return 0;
+}
+
+// What each constraint cost the last profiled solve, in the numbering they
+// were added with, in order; up to max of them are written to out. Returns
+// how many there are, or -1 on bad arguments.
+int real_slvs_get_costs(RealSlvsSystem* s, Slvs_ConstraintCost* out, int max) {
+    if (!s || max < 0 || (max > 0 && !out)) return -1;
+    if (!s->sys.cost) return 0;
+    int n = s->sys.costs < s->cost_cap ? s->sys.costs : s->cost_cap;
+    for (int i = 0; i < n && i < max; i++) {
+        out[i] = s->sys.cost[i];
+        out[i].h = (Slvs_hConstraint)constraint_user_id(s, out[i].h);
+    }
+    return n;
+}
+
 // Solve the system
 int real_slvs_solve(RealSlvsSystem* s) {
     if (!s) return -1;
+
+    if (s->sys.sensitivities > 0) {
+        // Room for a row of derivatives per dimension, for however many
+        // params there are now
+        double* d = realloc(s->sys.dParam,
+                            sizeof(double) * (size_t)s->sys.sensitivities * (s->sys.params > 0 ? s->sys.params : 1));
+        if (!d) return -1;
+        s->sys.dParam = d;
+    }
     
-    // Solve the system for group 1 (default group)
-    Slvs_Solve(&s->sys, 1);
+    if (s->profile) {
+        // Room for what every constraint cost
+        int n = s->sys.constraints > 0 ? s->sys.constraints : 1;
+        if (n > s->cost_cap) {
+            Slvs_ConstraintCost* c = realloc(s->sys.cost, sizeof(Slvs_ConstraintCost) * n);
+            if (!c) return -1;
+            s->sys.cost = c;
+            s->cost_cap = n;
+        }
+        s->sys.costs = s->cost_cap;
+    }
+
+    // Solve the system for group 1 (default group), in this system's own context
+    if (s->starts > 1) {
+        Slvs_Context* prev = Slvs_GetCurrentContext();
+        Slvs_SetCurrentContext(s->ctx);
+        Slvs_SolveMultiStart(&s->sys, 1, s->starts);
+        Slvs_SetCurrentContext(prev);
+    } else {
+        Slvs_SolveInContext(s->ctx, &s->sys, 1);
+    }
     
-    // Return status (0 = success, 1 = inconsistent, 2 = didn't converge, 3 = too many unknowns)
+    // Return status (0 = success, 1 = inconsistent, 2 = didn't converge, 3 = too many unknowns,
+    // 5 = timed out, 6 = over the memory budget)
     if (s->sys.result == SLVS_RESULT_OKAY) {
         return 0;
     } else if (s->sys.result == SLVS_RESULT_INCONSISTENT) {
@@ -733,125 +1413,331 @@ int real_slvs_solve(RealSlvsSystem* s) {
         return 2;
     } else if (s->sys.result == SLVS_RESULT_TOO_MANY_UNKNOWNS) {
         return 3;
+    } else if (s->sys.result == SLVS_RESULT_TIMED_OUT) {
+        return 5;
+    } else if (s->sys.result == SLVS_RESULT_RESOURCE_EXHAUSTED) {
+        return 6;
     }
     
     return -1;
 }
 
-// Get point position after solving
-int real_slvs_get_point_position(RealSlvsSystem* s, int point_id, double* x, double* y, double* z) {
-    if (!s || !x || !y || !z) return -1;
-    
-    // Find the point entity (look for internal ID with 1000+ offset)
-    Slvs_hEntity internal_id = 1000 + point_id;
-    for (int i = 0; i < s->sys.entities; i++) {
-        if (s->sys.entity[i].h == internal_id) {
-            if (s->sys.entity[i].type == SLVS_E_POINT_IN_3D) {
-                // 3D point - get x, y, z directly from parameters
-                for (int j = 0; j < s->sys.params; j++) {
-                    if (s->sys.param[j].h == s->sys.entity[i].param[0]) {
-                        *x = s->sys.param[j].val;
-                    }
-                    if (s->sys.param[j].h == s->sys.entity[i].param[1]) {
-                        *y = s->sys.param[j].val;
-                    }
-                    if (s->sys.param[j].h == s->sys.entity[i].param[2]) {
-                        *z = s->sys.param[j].val;
-                    }
-                }
-                return 0;
-            } else if (s->sys.entity[i].type == SLVS_E_POINT_IN_2D) {
-                // 2D point - get u, v from parameters, set z = 0
-                // Note: For proper 3D coordinates, we'd need to transform through the workplane
-                // For now, we return u as x, v as y, and z = 0
-                double u = 0.0, v = 0.0;
-                for (int j = 0; j < s->sys.params; j++) {
-                    if (s->sys.param[j].h == s->sys.entity[i].param[0]) {
-                        u = s->sys.param[j].val;
-                    }
-                    if (s->sys.param[j].h == s->sys.entity[i].param[1]) {
-                        v = s->sys.param[j].val;
-                    }
+// How many constraints the system has, each of those added in parts counted
+// once for each part
+int real_slvs_count_constraints(RealSlvsSystem* s) {
+    if (!s) return -1;
+    return s->sys.constraints;
+}
+
+// Check whether the points are where they are already a solution, without
+// solving: ids and residuals get, for up to max constraints in the order
+// they were added, each one's id (in the numbering it was added with) and
+// the largest of its residuals. Returns 0 if every equation is within the
+// tolerance, 2 if not, or -1 on bad arguments.
+int real_slvs_check(RealSlvsSystem* s, int* ids, double* residuals, int max) {
+    if (!s || max < 0 || (max > 0 && (!ids || !residuals))) return -1;
+
+    int n = s->sys.constraints;
+    double* r = malloc(sizeof(double) * (n > 0 ? n : 1));
+    if (!r) return -1;
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    int result = Slvs_Check(&s->sys, 1, r);
+    Slvs_SetCurrentContext(prev);
+
+    for (int i = 0; i < n && i < max; i++) {
+        ids[i] = constraint_user_id(s, s->sys.constraint[i].h);
+        residuals[i] = r[i];
+    }
+    free(r);
+    return result == SLVS_RESULT_OKAY ? 0 : 2;
+}
+
+// Find the parameter indices of a point's coordinates, -1 for none (z of a 2D point)
+static int find_point_params(RealSlvsSystem* s, int point_id, int idx[3]) {
+    Slvs_Entity* e = find_entity(s, find_handle(s, ROLE_ENTITY, point_id));
+    if (!e || (e->type != SLVS_E_POINT_IN_3D && e->type != SLVS_E_POINT_IN_2D)) return -1;
+
+    int n = (e->type == SLVS_E_POINT_IN_3D) ? 3 : 2;
+    for (int k = 0; k < 3; k++) {
+        idx[k] = (k < n) ? param_index(s, e->param[k]) : -1;
+    }
+    return 0;
+}
+
+// Add a constant with the given value, for dimensions' expressions to read
+// (see real_slvs_set_constraint_expression). Returns its param handle, or -1.
+int real_slvs_add_constant(RealSlvsSystem* s, double value) {
+    if (!s || reserve_slots(s) != 0) return -1;
+
+    int p = s->next_param++;
+    s->sys.param[s->sys.params++] = Slvs_MakeParam(p, CONSTANT_GROUP, value);
+    return p;
+}
+
+// Have the dimension of constraint id take its value from expr when the
+// system is compiled, as for a batch (see Slvs_SetConstraintExpression),
+// with $h reading the constant whose handle real_slvs_add_constant gave as
+// h; NULL or "" for the value it was added with. Returns 0, or -1 if expr
+// doesn't parse.
+int real_slvs_set_constraint_expression(RealSlvsSystem* s, int id, const char* expr) {
+    if (!s || reserve_slots(s) != 0) return -1;
+
+    Slvs_Context* prev = Slvs_GetCurrentContext();
+    Slvs_SetCurrentContext(s->ctx);
+    int r = Slvs_SetConstraintExpression(constraint_handle(s, id), expr);
+    Slvs_SetCurrentContext(prev);
+    return r;
+}
+
+// Solve the system once for each row of values, spreading the rows over the
+// given number of threads. values holds rows x n_constraints values for the
+// dimensions of the constraints in constraint_ids, and constant_values rows x
+// n_constants values for the constants in constant_ids; positions gets rows x
+// n_points x 3 coordinates of the points in point_ids (2D points as u, v, 0),
+// and results and dofs one SLVS_RESULT_* code and dof per row. Returns 0, 3
+// if the system has too many unknowns, or -1 on bad arguments.
+int real_slvs_solve_batch(RealSlvsSystem* s, int rows, int workers,
+                          const int* constraint_ids, int n_constraints, const double* values,
+                          const int* constant_ids, int n_constants, const double* constant_values,
+                          const int* point_ids, int n_points,
+                          double* positions, int* results, int* dofs) {
+    if (!s || rows < 0 || n_constraints < 0 || n_constants < 0 || n_points < 0) return -1;
+    if ((n_constraints > 0 && (!constraint_ids || !values)) ||
+        (n_constants > 0 && (!constant_ids || !constant_values)) ||
+        (n_points > 0 && (!point_ids || !positions)) || (rows > 0 && (!results || !dofs))) {
+        return -1;
+    }
+    if (rows == 0) return 0;
+
+    int* point_params = malloc(sizeof(int) * 3 * (n_points > 0 ? n_points : 1));
+    Slvs_hConstraint* constraint = malloc(sizeof(Slvs_hConstraint) * (n_constraints > 0 ? n_constraints : 1));
+    Slvs_hParam* constant = malloc(sizeof(Slvs_hParam) * (n_constants > 0 ? n_constants : 1));
+    double* solved = malloc(sizeof(double) * (size_t)rows * (s->sys.params > 0 ? s->sys.params : 1));
+    if (!point_params || !constraint || !constant || !solved) {
+        free(point_params);
+        free(constraint);
+        free(constant);
+        free(solved);
+        return -1;
+    }
+
+    int status = 0;
+    for (int i = 0; i < n_points && status == 0; i++) {
+        if (find_point_params(s, point_ids[i], &point_params[3 * i]) != 0) status = -1;
+    }
+    for (int i = 0; i < n_constraints; i++) {
+        constraint[i] = find_handle(s, ROLE_CONSTRAINT, constraint_ids[i]);
+    }
+    for (int i = 0; i < n_constants; i++) {
+        constant[i] = (Slvs_hParam)constant_ids[i];
+    }
+
+    if (status == 0) {
+        Slvs_Batch batch;
+        memset(&batch, 0, sizeof(batch));
+        batch.rows = rows;
+        batch.param = constant;
+        batch.params = n_constants;
+        batch.paramValue = (double*)constant_values;
+        batch.constraint = constraint;
+        batch.constraints = n_constraints;
+        batch.constraintValue = (double*)values;
+        batch.solved = solved;
+        batch.result = results;
+        batch.dof = dofs;
+
+        Slvs_Context* prev = Slvs_GetCurrentContext();
+        Slvs_SetCurrentContext(s->ctx);
+        Slvs_SetWorkerCount(workers > 0 ? workers : 1);
+        int r = Slvs_SolveBatch(&s->sys, 1, &batch);
+        Slvs_SetCurrentContext(prev);
+
+        if (r == SLVS_RESULT_TOO_MANY_UNKNOWNS) {
+            status = 3;
+        } else if (r != 0) {
+            status = -1;
+        }
+    }
+
+    if (status == 0) {
+        for (int row = 0; row < rows; row++) {
+            const double* v = &solved[(size_t)row * s->sys.params];
+            for (int i = 0; i < n_points; i++) {
+                for (int k = 0; k < 3; k++) {
+                    int j = point_params[3 * i + k];
+                    positions[((size_t)row * n_points + i) * 3 + k] = (j >= 0) ? v[j] : 0.0;
                 }
-                *x = u;
-                *y = v;
-                *z = 0.0;
-                return 0;
             }
         }
     }
-    
-    return -1;
+
+    free(point_params);
+    free(constraint);
+    free(constant);
+    free(solved);
+    return status;
 }
 
-// Get circle position and radius after solving
-int real_slvs_get_circle_position(RealSlvsSystem* s, int circle_id, double* cx, double* cy, double* cz, double* radius) {
-    if (!s || !cx || !cy || !cz || !radius) return -1;
-    
-    // Circle entity structure (from real_slvs_add_circle) with large offsets:
-    // - Normal at 100000 + id
-    // - Origin point (3D center) at 200000 + id
-    // - Workplane at 300000 + id
-    // - 2D center point at 400000 + id (relative to workplane, always 0,0)
-    // - Distance (radius) at 500000 + id
-    // - Circle entity at 600000 + id
-    
-    Slvs_hEntity origin_id = 200000 + circle_id;  // Origin point is the 3D center
-    Slvs_hEntity radius_entity_id = 500000 + circle_id;  // Distance entity for radius
-    
-    int found_center = 0;
-    int found_radius = 0;
-    
-    // Find the origin point (which is the 3D center of the circle)
-    for (int i = 0; i < s->sys.entities; i++) {
-        if (s->sys.entity[i].h == origin_id && 
-            s->sys.entity[i].type == SLVS_E_POINT_IN_3D) {
-            
-            // Get the parameter values for the center
-            for (int j = 0; j < s->sys.params; j++) {
-                if (s->sys.param[j].h == s->sys.entity[i].param[0]) {
-                    *cx = s->sys.param[j].val;
-                }
-                if (s->sys.param[j].h == s->sys.entity[i].param[1]) {
-                    *cy = s->sys.param[j].val;
-                }
-                if (s->sys.param[j].h == s->sys.entity[i].param[2]) {
-                    *cz = s->sys.param[j].val;
-                }
-            }
-            found_center = 1;
-            break;
+// Follow the solution as the constraint constraint_id's dimension moves
+// through n_values values in turn, each one continued from the solution at
+// the one before (see Slvs_SolveTrack); step, min_step and max_step are the
+// step lengths, 0 for the defaults. positions gets n_values x n_points x 3
+// coordinates of the points in point_ids, and results, dofs, iterations and
+// steps one entry per value. Returns 0, 3 if the system has too many
+// unknowns, or -1 on bad arguments.
+int real_slvs_solve_track(RealSlvsSystem* s, int constraint_id, int n_values, const double* values,
+                          double step, double min_step, double max_step,
+                          const int* point_ids, int n_points,
+                          double* positions, int* results, int* dofs, int* iterations, int* steps) {
+    if (!s || n_values < 0 || n_points < 0) return -1;
+    if ((n_values > 0 && (!values || !results || !dofs || !iterations || !steps)) ||
+        (n_points > 0 && (!point_ids || !positions))) {
+        return -1;
+    }
+    if (n_values == 0) return 0;
+
+    int* point_params = malloc(sizeof(int) * 3 * (n_points > 0 ? n_points : 1));
+    double* solved = malloc(sizeof(double) * (size_t)n_values * (s->sys.params > 0 ? s->sys.params : 1));
+    if (!point_params || !solved) {
+        free(point_params);
+        free(solved);
+        return -1;
+    }
+
+    int status = 0;
+    for (int i = 0; i < n_points && status == 0; i++) {
+        if (find_point_params(s, point_ids[i], &point_params[3 * i]) != 0) status = -1;
+    }
+
+    if (status == 0) {
+        Slvs_Track track;
+        memset(&track, 0, sizeof(track));
+        track.constraint = find_handle(s, ROLE_CONSTRAINT, constraint_id);
+        track.values = n_values;
+        track.value = (double*)values;
+        track.step = step;
+        track.minStep = min_step;
+        track.maxStep = max_step;
+        track.solved = solved;
+        track.result = results;
+        track.dof = dofs;
+        track.iterations = iterations;
+        track.steps = steps;
+
+        Slvs_Context* prev = Slvs_GetCurrentContext();
+        Slvs_SetCurrentContext(s->ctx);
+        int r = Slvs_SolveTrack(&s->sys, 1, &track);
+        Slvs_SetCurrentContext(prev);
+
+        if (r == SLVS_RESULT_TOO_MANY_UNKNOWNS) {
+            status = 3;
+        } else if (r != 0) {
+            status = -1;
         }
     }
-    
-    // Find the distance entity (radius)
-    for (int i = 0; i < s->sys.entities; i++) {
-        if (s->sys.entity[i].h == radius_entity_id && 
-            s->sys.entity[i].type == SLVS_E_DISTANCE) {
-            
-            // Get the radius parameter value
-            for (int j = 0; j < s->sys.params; j++) {
-                if (s->sys.param[j].h == s->sys.entity[i].param[0]) {
-                    *radius = s->sys.param[j].val;
-                    found_radius = 1;
-                    break;
+
+    if (status == 0) {
+        for (int k = 0; k < n_values; k++) {
+            const double* v = &solved[(size_t)k * s->sys.params];
+            for (int i = 0; i < n_points; i++) {
+                for (int j = 0; j < 3; j++) {
+                    int p = point_params[3 * i + j];
+                    positions[((size_t)k * n_points + i) * 3 + j] = (p >= 0) ? v[p] : 0.0;
                 }
             }
-            break;
         }
     }
+
+    free(point_params);
+    free(solved);
+    return status;
+}
+
+// Get point position after solving
+int real_slvs_get_point_position(RealSlvsSystem* s, int point_id, double* x, double* y, double* z) {
+    if (!s || !x || !y || !z) return -1;
     
-    // Also try the stored radius as fallback
-    if (!found_radius && circle_id < 1000) {
-        *radius = s->circle_radii[circle_id];
-        found_radius = 1;
+    // 3D points give x, y, z directly from their parameters; 2D points give
+    // u, v and z = 0.
+    // Note: For proper 3D coordinates, we'd need to transform through the workplane
+    int idx[3];
+    if (find_point_params(s, point_id, idx) != 0) return -1;
+    double* out[3] = { x, y, z };
+    for (int k = 0; k < 3; k++) {
+        if (idx[k] >= 0) {
+            *out[k] = s->sys.param[idx[k]].val;
+        } else if (k == 2) {
+            *out[k] = 0.0;
+        }
     }
+    return 0;
+}
+
+// Get circle position and radius after solving
+int real_slvs_get_circle_position(RealSlvsSystem* s, int circle_id, double* cx, double* cy, double* cz, double* radius) {
+    if (!s || !cx || !cy || !cz || !radius) return -1;
     
-    if (found_center && found_radius) {
-        return 0;
+    // Circle entity structure (from real_slvs_add_circle), each named by
+    // the circle's id under a role of its own:
+    // - Normal (ROLE_CIRCLE_NORMAL)
+    // - Origin point, the 3D center (ROLE_CIRCLE_ORIGIN)
+    // - Workplane (ROLE_CIRCLE_WORKPLANE)
+    // - 2D center point (ROLE_CIRCLE_CENTER), relative to workplane, always 0,0
+    // - Distance, the radius (ROLE_CIRCLE_RADIUS)
+    // - Circle entity (ROLE_CIRCLE)
+    
+    // The origin point is the 3D center of the circle, or in the sketch
+    // plane the 2D center is, with z = 0
+    Slvs_Entity* origin = find_entity(s, find_handle(s, ROLE_CIRCLE_ORIGIN, circle_id));
+    Slvs_Entity* distance = find_entity(s, find_handle(s, ROLE_CIRCLE_RADIUS, circle_id));
+    if (!origin) {
+        origin = find_entity(s, find_handle(s, ROLE_CIRCLE_CENTER, circle_id));
+        if (!origin || origin->wrkpl != SKETCH_PLANE) return -1;
+        *cz = 0.0;
+    } else if (origin->type != SLVS_E_POINT_IN_3D) {
+        return -1;
     }
+    if (!distance || distance->type != SLVS_E_DISTANCE) return -1;
+    
+    int ir = param_index(s, distance->param[0]);
+    if (ir < 0) return -1;
+    double* out[3] = { cx, cy, cz };
+    for (int k = 0; k < 3; k++) {
+        int j = param_index(s, origin->param[k]);
+        if (j >= 0) *out[k] = s->sys.param[j].val;
+    }
+    *radius = s->sys.param[ir].val;
     
-    return -1;
+    return 0;
+}
+
+// Read back many entities at once, after solving: for each i of n, kinds[i]
+// says what ids[i] is (REAL_SLVS_READ_*), and out[4*i..4*i+3] gets its x, y,
+// z and 0, or a circle's centre and radius; results[i] is 0, or -1 if it
+// isn't in the system (its out is left alone). Returns how many were found,
+// or -1 on bad arguments.
+#define REAL_SLVS_READ_NONE   0
+#define REAL_SLVS_READ_POINT  1
+#define REAL_SLVS_READ_CIRCLE 2
+int real_slvs_get_positions(RealSlvsSystem* s, const int* ids, const int* kinds, int n,
+                            double* out, int* results) {
+    if (!s || n < 0 || (n > 0 && (!ids || !kinds || !out || !results))) return -1;
+
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        double* o = &out[4 * (size_t)i];
+        int r = -1;
+        if (kinds[i] == REAL_SLVS_READ_POINT) {
+            r = real_slvs_get_point_position(s, ids[i], &o[0], &o[1], &o[2]);
+            if (r == 0) o[3] = 0.0;
+        } else if (kinds[i] == REAL_SLVS_READ_CIRCLE) {
+            r = real_slvs_get_circle_position(s, ids[i], &o[0], &o[1], &o[2], &o[3]);
+        }
+        results[i] = r;
+        if (r == 0) found++;
+    }
+    return found;
 }
 
 // Get solver DOF (degrees of freedom)
@@ -860,6 +1746,15 @@ int real_slvs_get_dof(RealSlvsSystem* s) {
     return s->sys.dof;
 }
 
+// Get what the last solve did: its iterations, residual, sizes and timings
+int real_slvs_get_stats(RealSlvsSystem* s, Slvs_Stats* stats) {
+    if (!s || !stats) return -1;
+    *stats = s->sys.stats;
+    // In the caller's numbering, as its constraints were added
+    stats->heaviestConstraint = (Slvs_hConstraint)constraint_user_id(s, stats->heaviestConstraint);
+    return 0;
+}
+
 // Helper function to convert a normal vector to a quaternion
 // The quaternion represents the rotation from default Z-axis (0,0,1) to the desired normal
 static void normal_to_quaternion(double nx, double ny, double nz, double* qw, double* qx, double* qy, double* qz) {
@@ -919,7 +1814,7 @@ static void normal_to_quaternion(double nx, double ny, double nz, double* qw, do
 // Creates a normal from the normal vector and a workplane entity
 int real_slvs_add_workplane(RealSlvsSystem* s, int id, int origin_point_id, 
                             double nx, double ny, double nz) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
     
@@ -939,27 +1834,55 @@ int real_slvs_add_workplane(RealSlvsSystem* s, int id, int origin_point_id,
     s->sys.param[s->sys.params++] = Slvs_MakeParam(pqz, g, qz);
     
     // Create normal entity
-    Slvs_hEntity normal_id = 800000 + id; // Use large offset to avoid collisions
-    s->sys.entity[s->sys.entities++] = Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz);
+    Slvs_hEntity normal_id = name_handle(s, ROLE_WORKPLANE_NORMAL, id);
+    add_entity(s, Slvs_MakeNormal3d(normal_id, g, pqw, pqx, pqy, pqz));
     
     // Create workplane entity
-    Slvs_hEntity wp_id = 1000 + id;
-    Slvs_hEntity origin = 1000 + origin_point_id;
-    s->sys.entity[s->sys.entities++] = Slvs_MakeWorkplane(wp_id, g, origin, normal_id);
+    Slvs_hEntity wp_id = entity_handle(s, id);
+    Slvs_hEntity origin = entity_handle(s, origin_point_id);
+    add_entity(s, Slvs_MakeWorkplane(wp_id, g, origin, normal_id));
     
     return 0;
 }
 
+// Make the points, circles, arcs and cubics added from here on in a fixed
+// sketch plane, the xy plane with u along x and v along y: a point has two
+// params rather than three, a circle or arc takes the plane's normal rather
+// than a quaternion of its own to solve for, and the constraints between
+// them are written in the plane (see project_into_sketch). Only for a
+// system that's all in that plane; it must come before anything's added.
+int real_slvs_set_planar(RealSlvsSystem* s) {
+    if (!s || s->planar || s->sys.entities > 0 || reserve_slots(s) != 0) return -1;
+
+    Slvs_hGroup g = SKETCH_GROUP;
+
+    int po = s->next_param;
+    for (int k = 0; k < 3; k++) {
+        s->sys.param[s->sys.params++] = Slvs_MakeParam(s->next_param++, g, 0.0);
+    }
+    add_entity(s, Slvs_MakePoint3d(SKETCH_ORIGIN, g, po, po + 1, po + 2));
+
+    int pq = s->next_param;
+    for (int k = 0; k < 4; k++) {
+        s->sys.param[s->sys.params++] = Slvs_MakeParam(s->next_param++, g, (k == 0) ? 1.0 : 0.0);
+    }
+    add_entity(s, Slvs_MakeNormal3d(SKETCH_NORMAL, g, pq, pq + 1, pq + 2, pq + 3));
+
+    add_entity(s, Slvs_MakeWorkplane(SKETCH_PLANE, g, SKETCH_ORIGIN, SKETCH_NORMAL));
+    s->planar = 1;
+    return 0;
+}
+
 // Add point-in-plane constraint
 int real_slvs_add_point_in_plane_constraint(RealSlvsSystem* s, int id, 
                                             int point_id, int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity wp = 1000 + workplane_id;
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity wp = entity_handle(s, workplane_id);
     
     // PT_IN_PLANE: point (ptA) must lie in workplane (entityA)
     // The constraint's coordinate system is FREE_IN_3D
@@ -974,13 +1897,13 @@ int real_slvs_add_point_in_plane_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_point_plane_distance_constraint(RealSlvsSystem* s, int id,
                                                    int point_id, int workplane_id,
                                                    double distance) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity wp = 1000 + workplane_id;
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity wp = entity_handle(s, workplane_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PT_PLANE_DISTANCE, SLVS_FREE_IN_3D,
@@ -993,13 +1916,13 @@ int real_slvs_add_point_plane_distance_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_point_line_distance_constraint(RealSlvsSystem* s, int id,
                                                   int point_id, int line_id,
                                                   double distance) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity line = 1000 + line_id;
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity line = entity_handle(s, line_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PT_LINE_DISTANCE, SLVS_FREE_IN_3D,
@@ -1012,13 +1935,13 @@ int real_slvs_add_point_line_distance_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_length_ratio_constraint(RealSlvsSystem* s, int id,
                                           int line1_id, int line2_id,
                                           double ratio) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_LENGTH_RATIO, SLVS_FREE_IN_3D,
@@ -1031,15 +1954,15 @@ int real_slvs_add_length_ratio_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_equal_angle_constraint(RealSlvsSystem* s, int id,
                                          int line1_id, int line2_id,
                                          int line3_id, int line4_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
-    Slvs_hEntity line3 = 1000 + line3_id;
-    Slvs_hEntity line4 = 1000 + line4_id;
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
+    Slvs_hEntity line3 = entity_handle(s, line3_id);
+    Slvs_hEntity line4 = entity_handle(s, line4_id);
     
     Slvs_Constraint c = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_EQUAL_ANGLE, SLVS_FREE_IN_3D,
@@ -1055,14 +1978,14 @@ int real_slvs_add_equal_angle_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_symmetric_horizontal_constraint(RealSlvsSystem* s, int id,
                                                    int entity1_id, int entity2_id,
                                                    int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity entity1 = 1000 + entity1_id;
-    Slvs_hEntity entity2 = 1000 + entity2_id;
-    Slvs_hEntity wp = 1000 + workplane_id;
+    Slvs_hEntity entity1 = entity_handle(s, entity1_id);
+    Slvs_hEntity entity2 = entity_handle(s, entity2_id);
+    Slvs_hEntity wp = entity_handle(s, workplane_id);
     
     // SYMMETRIC_HORIZ requires a workplane
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
@@ -1076,14 +1999,14 @@ int real_slvs_add_symmetric_horizontal_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_symmetric_vertical_constraint(RealSlvsSystem* s, int id,
                                                  int entity1_id, int entity2_id,
                                                  int workplane_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity entity1 = 1000 + entity1_id;
-    Slvs_hEntity entity2 = 1000 + entity2_id;
-    Slvs_hEntity wp = 1000 + workplane_id;
+    Slvs_hEntity entity1 = entity_handle(s, entity1_id);
+    Slvs_hEntity entity2 = entity_handle(s, entity2_id);
+    Slvs_hEntity wp = entity_handle(s, workplane_id);
     
     // SYMMETRIC_VERT requires a workplane
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
@@ -1096,12 +2019,12 @@ int real_slvs_add_symmetric_vertical_constraint(RealSlvsSystem* s, int id,
 // Add diameter constraint
 int real_slvs_add_diameter_constraint(RealSlvsSystem* s, int id,
                                       int circle_id, double diameter) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity circle = 600000 + circle_id;  // Match circle entity ID offset
+    Slvs_hEntity circle = name_handle(s, ROLE_CIRCLE, circle_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_DIAMETER, SLVS_FREE_IN_3D,
@@ -1113,13 +2036,13 @@ int real_slvs_add_diameter_constraint(RealSlvsSystem* s, int id,
 // Add same orientation constraint
 int real_slvs_add_same_orientation_constraint(RealSlvsSystem* s, int id,
                                               int entity1_id, int entity2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity entity1 = 1000 + entity1_id;
-    Slvs_hEntity entity2 = 1000 + entity2_id;
+    Slvs_hEntity entity1 = entity_handle(s, entity1_id);
+    Slvs_hEntity entity2 = entity_handle(s, entity2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_SAME_ORIENTATION, SLVS_FREE_IN_3D,
@@ -1132,14 +2055,14 @@ int real_slvs_add_same_orientation_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_projected_point_distance_constraint(RealSlvsSystem* s, int id,
                                                        int point1_id, int point2_id,
                                                        int workplane_id, double distance) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point1 = 1000 + point1_id;
-    Slvs_hEntity point2 = 1000 + point2_id;
-    Slvs_hEntity wp = 1000 + workplane_id;
+    Slvs_hEntity point1 = entity_handle(s, point1_id);
+    Slvs_hEntity point2 = entity_handle(s, point2_id);
+    Slvs_hEntity wp = entity_handle(s, workplane_id);
     
     // PROJ_PT_DISTANCE: constrains distance between point1 and point2 
     // when projected onto the workplane (entityA)
@@ -1154,13 +2077,13 @@ int real_slvs_add_projected_point_distance_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_length_difference_constraint(RealSlvsSystem* s, int id,
                                                 int line1_id, int line2_id,
                                                 double difference) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_LENGTH_DIFFERENCE, SLVS_FREE_IN_3D,
@@ -1172,13 +2095,13 @@ int real_slvs_add_length_difference_constraint(RealSlvsSystem* s, int id,
 // Add point-on-face constraint (requires face entity)
 int real_slvs_add_point_on_face_constraint(RealSlvsSystem* s, int id,
                                             int point_id, int face_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity face = 1000 + face_id;
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity face = entity_handle(s, face_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PT_ON_FACE, SLVS_FREE_IN_3D,
@@ -1191,13 +2114,13 @@ int real_slvs_add_point_on_face_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_point_face_distance_constraint(RealSlvsSystem* s, int id,
                                                   int point_id, int face_id,
                                                   double distance) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity face = 1000 + face_id;
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity face = entity_handle(s, face_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_PT_FACE_DISTANCE, SLVS_FREE_IN_3D,
@@ -1209,13 +2132,13 @@ int real_slvs_add_point_face_distance_constraint(RealSlvsSystem* s, int id,
 // Add equal line-arc length constraint
 int real_slvs_add_equal_line_arc_length_constraint(RealSlvsSystem* s, int id,
                                                      int line_id, int arc_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity line = 1000 + line_id;
-    Slvs_hEntity arc = 1000 + arc_id;
+    Slvs_hEntity line = entity_handle(s, line_id);
+    Slvs_hEntity arc = entity_handle(s, arc_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_EQUAL_LINE_ARC_LEN, SLVS_FREE_IN_3D,
@@ -1228,14 +2151,14 @@ int real_slvs_add_equal_line_arc_length_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_equal_length_point_line_distance_constraint(RealSlvsSystem* s, int id,
                                                                 int line_id, int point_id,
                                                                 int reference_line_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity line = 1000 + line_id;
-    Slvs_hEntity point = 1000 + point_id;
-    Slvs_hEntity ref_line = 1000 + reference_line_id;
+    Slvs_hEntity line = entity_handle(s, line_id);
+    Slvs_hEntity point = entity_handle(s, point_id);
+    Slvs_hEntity ref_line = entity_handle(s, reference_line_id);
     
     Slvs_Constraint c = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_EQ_LEN_PT_LINE_D, SLVS_FREE_IN_3D,
@@ -1249,15 +2172,15 @@ int real_slvs_add_equal_length_point_line_distance_constraint(RealSlvsSystem* s,
 int real_slvs_add_equal_point_line_distances_constraint(RealSlvsSystem* s, int id,
                                                           int point1_id, int line1_id,
                                                           int point2_id, int line2_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity point1 = 1000 + point1_id;
-    Slvs_hEntity line1 = 1000 + line1_id;
-    Slvs_hEntity point2 = 1000 + point2_id;
-    Slvs_hEntity line2 = 1000 + line2_id;
+    Slvs_hEntity point1 = entity_handle(s, point1_id);
+    Slvs_hEntity line1 = entity_handle(s, line1_id);
+    Slvs_hEntity point2 = entity_handle(s, point2_id);
+    Slvs_hEntity line2 = entity_handle(s, line2_id);
     
     Slvs_Constraint c = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_EQ_PT_LN_DISTANCES, SLVS_FREE_IN_3D,
@@ -1270,13 +2193,13 @@ int real_slvs_add_equal_point_line_distances_constraint(RealSlvsSystem* s, int i
 // Add cubic-line tangent constraint (requires cubic entity)
 int real_slvs_add_cubic_line_tangent_constraint(RealSlvsSystem* s, int id,
                                                   int cubic_id, int line_id) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity cubic = 1000 + cubic_id;
-    Slvs_hEntity line = 1000 + line_id;
+    Slvs_hEntity cubic = entity_handle(s, cubic_id);
+    Slvs_hEntity line = entity_handle(s, line_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_CUBIC_LINE_TANGENT, SLVS_FREE_IN_3D,
@@ -1289,13 +2212,13 @@ int real_slvs_add_cubic_line_tangent_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_arc_arc_length_ratio_constraint(RealSlvsSystem* s, int id,
                                                    int arc1_id, int arc2_id,
                                                    double ratio) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity arc1 = 1000 + arc1_id;
-    Slvs_hEntity arc2 = 1000 + arc2_id;
+    Slvs_hEntity arc1 = entity_handle(s, arc1_id);
+    Slvs_hEntity arc2 = entity_handle(s, arc2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_ARC_ARC_LEN_RATIO, SLVS_FREE_IN_3D,
@@ -1308,13 +2231,13 @@ int real_slvs_add_arc_arc_length_ratio_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_arc_line_length_ratio_constraint(RealSlvsSystem* s, int id,
                                                      int arc_id, int line_id,
                                                      double ratio) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity arc = 1000 + arc_id;
-    Slvs_hEntity line = 1000 + line_id;
+    Slvs_hEntity arc = entity_handle(s, arc_id);
+    Slvs_hEntity line = entity_handle(s, line_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_ARC_LINE_LEN_RATIO, SLVS_FREE_IN_3D,
@@ -1327,13 +2250,13 @@ int real_slvs_add_arc_line_length_ratio_constraint(RealSlvsSystem* s, int id,
 int real_slvs_add_arc_arc_length_difference_constraint(RealSlvsSystem* s, int id,
                                                          int arc1_id, int arc2_id,
                                                          double difference) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity arc1 = 1000 + arc1_id;
-    Slvs_hEntity arc2 = 1000 + arc2_id;
+    Slvs_hEntity arc1 = entity_handle(s, arc1_id);
+    Slvs_hEntity arc2 = entity_handle(s, arc2_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_ARC_ARC_DIFFERENCE, SLVS_FREE_IN_3D,
@@ -1346,17 +2269,416 @@ int real_slvs_add_arc_arc_length_difference_constraint(RealSlvsSystem* s, int id
 int real_slvs_add_arc_line_length_difference_constraint(RealSlvsSystem* s, int id,
                                                           int arc_id, int line_id,
                                                           double difference) {
-    if (!s) return -1;
+    if (!s || reserve_slots(s) != 0) return -1;
     
     Slvs_hGroup g = 1;
-    Slvs_hConstraint constraint_id = 10000 + id;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
     
-    Slvs_hEntity arc = 1000 + arc_id;
-    Slvs_hEntity line = 1000 + line_id;
+    Slvs_hEntity arc = entity_handle(s, arc_id);
+    Slvs_hEntity line = entity_handle(s, line_id);
     
     s->sys.constraint[s->sys.constraints++] = Slvs_MakeConstraint(
         constraint_id, g, SLVS_C_ARC_LINE_DIFFERENCE, SLVS_FREE_IN_3D,
         difference, 0, 0, line, arc);
     
     return 0;
-}
\ No newline at end of file
+}
+
+// Add gear mesh constraint: two circles as pitch circles, their centres
+// module * (teeth1 + teeth2) / 2 apart, teeth2 negative for a ring gear
+int real_slvs_add_gear_mesh_constraint(RealSlvsSystem* s, int id,
+                                       int circle1_id, int circle2_id,
+                                       int teeth1, int teeth2, double module) {
+    if (!s || reserve_slots(s) != 0 || teeth1 + teeth2 == 0) return -1;
+
+    Slvs_hGroup g = 1;
+    Slvs_hConstraint constraint_id = constraint_handle(s, id);
+
+    Slvs_hEntity circle1 = name_handle(s, ROLE_CIRCLE, circle1_id);
+    Slvs_hEntity circle2 = name_handle(s, ROLE_CIRCLE, circle2_id);
+
+    Slvs_Constraint c = Slvs_MakeConstraint(
+        constraint_id, g, SLVS_C_GEAR_MESH, SLVS_FREE_IN_3D,
+        module, 0, 0, circle1, circle2);
+    c.other = teeth1;
+    c.other2 = teeth2;
+    s->sys.constraint[s->sys.constraints++] = c;
+
+    return 0;
+}
+
+// Adding a whole system at once: one record per add call, naming the add
+// function, the id, and the function's other int and double arguments, each
+// in the order it takes them
+typedef struct {
+    int kind;       // REAL_SLVS_ENTITY_*
+    int id;
+    int arg[5];
+    double val[7];
+} RealSlvsEntityRecord;
+
+typedef struct {
+    int kind;       // REAL_SLVS_CONSTRAINT_*
+    int id;
+    int arg[4];
+    double val;     // no constraint takes more than one
+} RealSlvsConstraintRecord;
+
+// Kinds of RealSlvsEntityRecord, one for each entity add function
+enum {
+    REAL_SLVS_ENTITY_POINT = 1,
+    REAL_SLVS_ENTITY_POINT_2D = 2,
+    REAL_SLVS_ENTITY_LINE = 3,
+    REAL_SLVS_ENTITY_LINE_2D = 4,
+    REAL_SLVS_ENTITY_CIRCLE = 5,
+    REAL_SLVS_ENTITY_CIRCLE_WITH_CENTER_POINT = 6,
+    REAL_SLVS_ENTITY_ARC = 7,
+    REAL_SLVS_ENTITY_CUBIC = 8,
+    REAL_SLVS_ENTITY_WORKPLANE = 9,
+    REAL_SLVS_ENTITY_SKETCH_PLANE = 10,    // real_slvs_set_planar; no id
+};
+
+// Kinds of RealSlvsConstraintRecord, one for each constraint add function
+enum {
+    REAL_SLVS_CONSTRAINT_WHERE_DRAGGED = 1,
+    REAL_SLVS_CONSTRAINT_DISTANCE = 2,
+    REAL_SLVS_CONSTRAINT_FIXED = 3,
+    REAL_SLVS_CONSTRAINT_PARALLEL = 4,
+    REAL_SLVS_CONSTRAINT_PERPENDICULAR = 5,
+    REAL_SLVS_CONSTRAINT_ANGLE = 6,
+    REAL_SLVS_CONSTRAINT_HORIZONTAL = 7,
+    REAL_SLVS_CONSTRAINT_VERTICAL = 8,
+    REAL_SLVS_CONSTRAINT_EQUAL_LENGTH = 9,
+    REAL_SLVS_CONSTRAINT_EQUAL_RADIUS = 10,
+    REAL_SLVS_CONSTRAINT_TANGENT = 11,
+    REAL_SLVS_CONSTRAINT_POINT_ON_CIRCLE = 12,
+    REAL_SLVS_CONSTRAINT_SYMMETRIC = 13,
+    REAL_SLVS_CONSTRAINT_MIDPOINT = 14,
+    REAL_SLVS_CONSTRAINT_POINT_ON_LINE = 15,
+    REAL_SLVS_CONSTRAINT_POINTS_COINCIDENT = 16,
+    REAL_SLVS_CONSTRAINT_POINT_IN_PLANE = 17,
+    REAL_SLVS_CONSTRAINT_POINT_PLANE_DISTANCE = 18,
+    REAL_SLVS_CONSTRAINT_POINT_LINE_DISTANCE = 19,
+    REAL_SLVS_CONSTRAINT_LENGTH_RATIO = 20,
+    REAL_SLVS_CONSTRAINT_EQUAL_ANGLE = 21,
+    REAL_SLVS_CONSTRAINT_SYMMETRIC_HORIZONTAL = 22,
+    REAL_SLVS_CONSTRAINT_SYMMETRIC_VERTICAL = 23,
+    REAL_SLVS_CONSTRAINT_DIAMETER = 24,
+    REAL_SLVS_CONSTRAINT_SAME_ORIENTATION = 25,
+    REAL_SLVS_CONSTRAINT_PROJECTED_POINT_DISTANCE = 26,
+    REAL_SLVS_CONSTRAINT_LENGTH_DIFFERENCE = 27,
+    REAL_SLVS_CONSTRAINT_POINT_ON_FACE = 28,
+    REAL_SLVS_CONSTRAINT_POINT_FACE_DISTANCE = 29,
+    REAL_SLVS_CONSTRAINT_EQUAL_LINE_ARC_LENGTH = 30,
+    REAL_SLVS_CONSTRAINT_EQUAL_LENGTH_POINT_LINE_DISTANCE = 31,
+    REAL_SLVS_CONSTRAINT_EQUAL_POINT_LINE_DISTANCES = 32,
+    REAL_SLVS_CONSTRAINT_CUBIC_LINE_TANGENT = 33,
+    REAL_SLVS_CONSTRAINT_ARC_ARC_LENGTH_RATIO = 34,
+    REAL_SLVS_CONSTRAINT_ARC_LINE_LENGTH_RATIO = 35,
+    REAL_SLVS_CONSTRAINT_ARC_ARC_LENGTH_DIFFERENCE = 36,
+    REAL_SLVS_CONSTRAINT_ARC_LINE_LENGTH_DIFFERENCE = 37,
+    REAL_SLVS_CONSTRAINT_GEAR_MESH = 38,
+};
+
+static int add_entity_record(RealSlvsSystem* s, const RealSlvsEntityRecord* r) {
+    const int* a = r->arg;
+    const double* v = r->val;
+    switch (r->kind) {
+    case REAL_SLVS_ENTITY_POINT:
+        return real_slvs_add_point(s, r->id, v[0], v[1], v[2], a[0]);
+    case REAL_SLVS_ENTITY_POINT_2D:
+        return real_slvs_add_point_2d(s, r->id, a[0], v[0], v[1], a[1]);
+    case REAL_SLVS_ENTITY_LINE:
+        return real_slvs_add_line(s, r->id, a[0], a[1]);
+    case REAL_SLVS_ENTITY_LINE_2D:
+        return real_slvs_add_line_2d(s, r->id, a[0], a[1], a[2]);
+    case REAL_SLVS_ENTITY_CIRCLE:
+        return real_slvs_add_circle(s, r->id, v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+    case REAL_SLVS_ENTITY_CIRCLE_WITH_CENTER_POINT:
+        return real_slvs_add_circle_with_center_point(s, r->id, a[0], v[0], v[1], v[2], v[3]);
+    case REAL_SLVS_ENTITY_ARC:
+        return real_slvs_add_arc(s, r->id, a[0], a[1], a[2], v[0], v[1], v[2], a[3]);
+    case REAL_SLVS_ENTITY_CUBIC:
+        return real_slvs_add_cubic(s, r->id, a[0], a[1], a[2], a[3], a[4]);
+    case REAL_SLVS_ENTITY_WORKPLANE:
+        return real_slvs_add_workplane(s, r->id, a[0], v[0], v[1], v[2]);
+    case REAL_SLVS_ENTITY_SKETCH_PLANE:
+        return real_slvs_set_planar(s);
+    default: return -1;
+    }
+}
+
+// Put constraints from sys.constraint[from] on that were made free in 3D in
+// the sketch plane instead, for those that are the same there for points in
+// the plane. Written in the plane, they're an equation for each dimension of
+// it rather than one for z as well that's 0 = 0, or the same with one fewer
+// unknown. A point-line distance isn't: in a plane it's signed, so a point
+// on the other side of the line than its distance says would flip over.
+static void project_into_sketch(RealSlvsSystem* s, int from) {
+    for (int i = from; i < s->sys.constraints; i++) {
+        Slvs_Constraint* c = &s->sys.constraint[i];
+        if (c->wrkpl != SLVS_FREE_IN_3D) continue;
+        switch (c->type) {
+        case SLVS_C_PT_PT_DISTANCE:
+        case SLVS_C_POINTS_COINCIDENT:
+        case SLVS_C_PT_ON_LINE:
+        case SLVS_C_AT_MIDPOINT:
+        case SLVS_C_WHERE_DRAGGED:
+        case SLVS_C_PARALLEL:
+        case SLVS_C_PERPENDICULAR:
+        case SLVS_C_ANGLE:
+        case SLVS_C_EQUAL_ANGLE:
+        case SLVS_C_EQUAL_LENGTH_LINES:
+        case SLVS_C_LENGTH_RATIO:
+        case SLVS_C_LENGTH_DIFFERENCE:
+        case SLVS_C_CUBIC_LINE_TANGENT:
+        case SLVS_C_CURVE_CURVE_TANGENT:
+        case SLVS_C_GEAR_MESH:
+            c->wrkpl = SKETCH_PLANE;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static int add_constraint_record(RealSlvsSystem* s, const RealSlvsConstraintRecord* r) {
+    const int* a = r->arg;
+    switch (r->kind) {
+    case REAL_SLVS_CONSTRAINT_WHERE_DRAGGED:
+        return real_slvs_add_where_dragged_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_DISTANCE:
+        return real_slvs_add_distance_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_FIXED:
+        return real_slvs_add_fixed_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_PARALLEL:
+        return real_slvs_add_parallel_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_PERPENDICULAR:
+        return real_slvs_add_perpendicular_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_ANGLE:
+        return real_slvs_add_angle_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_HORIZONTAL:
+        return real_slvs_add_horizontal_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_VERTICAL:
+        return real_slvs_add_vertical_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_EQUAL_LENGTH:
+        return real_slvs_add_equal_length_constraint(s, r->id, a[0], a[1], a[2]);
+    case REAL_SLVS_CONSTRAINT_EQUAL_RADIUS:
+        return real_slvs_add_equal_radius_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_TANGENT:
+        return real_slvs_add_tangent_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_POINT_ON_CIRCLE:
+        return real_slvs_add_point_on_circle_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_SYMMETRIC:
+        return real_slvs_add_symmetric_constraint(s, r->id, a[0], a[1], a[2]);
+    case REAL_SLVS_CONSTRAINT_MIDPOINT:
+        return real_slvs_add_midpoint_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_POINT_ON_LINE:
+        return real_slvs_add_point_on_line_constraint(s, r->id, a[0], a[1], a[2]);
+    case REAL_SLVS_CONSTRAINT_POINTS_COINCIDENT:
+        return real_slvs_add_points_coincident_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_POINT_IN_PLANE:
+        return real_slvs_add_point_in_plane_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_POINT_PLANE_DISTANCE:
+        return real_slvs_add_point_plane_distance_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_POINT_LINE_DISTANCE:
+        return real_slvs_add_point_line_distance_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_LENGTH_RATIO:
+        return real_slvs_add_length_ratio_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_EQUAL_ANGLE:
+        return real_slvs_add_equal_angle_constraint(s, r->id, a[0], a[1], a[2], a[3]);
+    case REAL_SLVS_CONSTRAINT_SYMMETRIC_HORIZONTAL:
+        return real_slvs_add_symmetric_horizontal_constraint(s, r->id, a[0], a[1], a[2]);
+    case REAL_SLVS_CONSTRAINT_SYMMETRIC_VERTICAL:
+        return real_slvs_add_symmetric_vertical_constraint(s, r->id, a[0], a[1], a[2]);
+    case REAL_SLVS_CONSTRAINT_DIAMETER:
+        return real_slvs_add_diameter_constraint(s, r->id, a[0], r->val);
+    case REAL_SLVS_CONSTRAINT_SAME_ORIENTATION:
+        return real_slvs_add_same_orientation_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_PROJECTED_POINT_DISTANCE:
+        return real_slvs_add_projected_point_distance_constraint(s, r->id, a[0], a[1], a[2], r->val);
+    case REAL_SLVS_CONSTRAINT_LENGTH_DIFFERENCE:
+        return real_slvs_add_length_difference_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_POINT_ON_FACE:
+        return real_slvs_add_point_on_face_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_POINT_FACE_DISTANCE:
+        return real_slvs_add_point_face_distance_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_EQUAL_LINE_ARC_LENGTH:
+        return real_slvs_add_equal_line_arc_length_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_EQUAL_LENGTH_POINT_LINE_DISTANCE:
+        return real_slvs_add_equal_length_point_line_distance_constraint(s, r->id, a[0], a[1], a[2]);
+    case REAL_SLVS_CONSTRAINT_EQUAL_POINT_LINE_DISTANCES:
+        return real_slvs_add_equal_point_line_distances_constraint(s, r->id, a[0], a[1], a[2], a[3]);
+    case REAL_SLVS_CONSTRAINT_CUBIC_LINE_TANGENT:
+        return real_slvs_add_cubic_line_tangent_constraint(s, r->id, a[0], a[1]);
+    case REAL_SLVS_CONSTRAINT_ARC_ARC_LENGTH_RATIO:
+        return real_slvs_add_arc_arc_length_ratio_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_ARC_LINE_LENGTH_RATIO:
+        return real_slvs_add_arc_line_length_ratio_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_ARC_ARC_LENGTH_DIFFERENCE:
+        return real_slvs_add_arc_arc_length_difference_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_ARC_LINE_LENGTH_DIFFERENCE:
+        return real_slvs_add_arc_line_length_difference_constraint(s, r->id, a[0], a[1], r->val);
+    case REAL_SLVS_CONSTRAINT_GEAR_MESH:
+        return real_slvs_add_gear_mesh_constraint(s, r->id, a[0], a[1], a[2], a[3], r->val);
+    default: return -1;
+    }
+}
+
+// Add n_entities entities and then n_constraints constraints, as though each
+// record's add function were called in turn, making room for them all first.
+// Returns 0, or -1 with *failed set to the index of the record that failed
+// (constraints counting on from the entities) or -1 for bad arguments; what
+// came before that stays added.
+int real_slvs_add_records(RealSlvsSystem* s, const RealSlvsEntityRecord* entities, int n_entities,
+                          const RealSlvsConstraintRecord* constraints, int n_constraints, int* failed) {
+    if (failed) *failed = -1;
+    if (!s || n_entities < 0 || n_constraints < 0 || (n_entities > 0 && !entities) ||
+        (n_constraints > 0 && !constraints)) {
+        return -1;
+    }
+
+    // What each kind of entity writes, from its add function
+    int64_t params = 0, ents = 0, dragged = 0;
+    for (int i = 0; i < n_entities; i++) {
+        switch (entities[i].kind) {
+        case REAL_SLVS_ENTITY_POINT: params += 3; ents += 1; dragged += 3; break;
+        case REAL_SLVS_ENTITY_POINT_2D: params += 2; ents += 1; dragged += 2; break;
+        case REAL_SLVS_ENTITY_CIRCLE: params += 10; ents += 6; break;
+        case REAL_SLVS_ENTITY_CIRCLE_WITH_CENTER_POINT: params += 7; ents += 5; break;
+        case REAL_SLVS_ENTITY_ARC:
+        case REAL_SLVS_ENTITY_WORKPLANE: params += 4; ents += 2; break;
+        case REAL_SLVS_ENTITY_SKETCH_PLANE: params += 7; ents += 3; break;
+        default: ents += 1; break;
+        }
+    }
+    int64_t most = INT32_MAX - SLOT_HEADROOM;
+    if (params > most || ents > most || dragged > most || n_constraints > most ||
+        reserve_room(s, (int)params + SLOT_HEADROOM, (int)ents + SLOT_HEADROOM,
+                     n_constraints + SLOT_HEADROOM, (int)dragged + SLOT_HEADROOM) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < n_entities; i++) {
+        if (add_entity_record(s, &entities[i]) != 0) {
+            if (failed) *failed = i;
+            return -1;
+        }
+    }
+    for (int i = 0; i < n_constraints; i++) {
+        int from = s->sys.constraints;
+        if (add_constraint_record(s, &constraints[i]) != 0) {
+            if (failed) *failed = n_entities + i;
+            return -1;
+        }
+        if (s->planar) project_into_sketch(s, from);
+    }
+    return 0;
+}
+
+// The handle and type of the entity an entity record's add function names
+// after the record's id, or 0 for a kind there isn't or an id never named
+static Slvs_hEntity record_entity(const RealSlvsSystem* s, const RealSlvsEntityRecord* r, int* type) {
+    switch (r->kind) {
+    case REAL_SLVS_ENTITY_POINT: *type = s->planar ? SLVS_E_POINT_IN_2D : SLVS_E_POINT_IN_3D; break;
+    case REAL_SLVS_ENTITY_POINT_2D: *type = SLVS_E_POINT_IN_2D; break;
+    case REAL_SLVS_ENTITY_LINE:
+    case REAL_SLVS_ENTITY_LINE_2D: *type = SLVS_E_LINE_SEGMENT; break;
+    case REAL_SLVS_ENTITY_CIRCLE:
+    case REAL_SLVS_ENTITY_CIRCLE_WITH_CENTER_POINT: *type = SLVS_E_CIRCLE; return find_handle(s, ROLE_CIRCLE, r->id);
+    case REAL_SLVS_ENTITY_ARC: *type = SLVS_E_ARC_OF_CIRCLE; break;
+    case REAL_SLVS_ENTITY_CUBIC: *type = SLVS_E_CUBIC; break;
+    case REAL_SLVS_ENTITY_WORKPLANE: *type = SLVS_E_WORKPLANE; break;
+    default: return 0;
+    }
+    return find_handle(s, ROLE_ENTITY, r->id);
+}
+
+// Give the entities an entity record added before the param values the same
+// add call would give them now, by making them again at the end of the
+// arrays, copying their params' values over, and dropping them again
+static int update_entity_record(RealSlvsSystem* s, const RealSlvsEntityRecord* r) {
+    // The sketch plane has no values to update
+    if (r->kind == REAL_SLVS_ENTITY_SKETCH_PLANE) return s->planar ? 0 : -1;
+
+    int type;
+    Slvs_hEntity h = record_entity(s, r, &type);
+    Slvs_Entity* e = h ? find_entity(s, h) : NULL;
+    if (!e || e->type != type || reserve_slots(s) != 0) return -1;
+
+    int params = s->sys.params, entities = s->sys.entities;
+    int dragged = s->sys.ndragged, next_param = s->next_param;
+    int result = add_entity_record(s, r);
+    for (int i = entities; result == 0 && i < s->sys.entities; i++) {
+        // Every handle the call makes was made by the same call before, so
+        // the one found is the one from then
+        const Slvs_Entity* made = &s->sys.entity[i];
+        Slvs_Entity* was = find_entity(s, made->h);
+        if (!was || was->type != made->type) {
+            result = -1;
+            break;
+        }
+        for (int k = 0; k < 4; k++) {
+            int from = made->param[k] ? param_index(s, made->param[k]) : -1;
+            int to = was->param[k] ? param_index(s, was->param[k]) : -1;
+            if (from >= 0 && to >= 0) s->sys.param[to].val = s->sys.param[from].val;
+        }
+    }
+    s->sys.params = params;
+    s->sys.entities = entities;
+    s->sys.ndragged = dragged;
+    s->next_param = next_param;
+    return result;
+}
+
+// Give the constraint a constraint record added before the value the same
+// add call would give it now
+static int update_constraint_record(RealSlvsSystem* s, const RealSlvsConstraintRecord* r) {
+    if (reserve_slots(s) != 0) return -1;
+
+    int n = s->sys.constraints;
+    int result = add_constraint_record(s, r);
+    if (result == 0 && s->sys.constraints == n + 1) {
+        const Slvs_Constraint* made = &s->sys.constraint[n];
+        result = -1;
+        for (int i = 0; i < n; i++) {
+            if (s->sys.constraint[i].h == made->h) {
+                s->sys.constraint[i].valA = made->valA;
+                result = 0;
+                break;
+            }
+        }
+    }
+    s->sys.constraints = n;
+    return result;
+}
+
+// Update what records added before to the values in these ones, which must
+// each be for the same kind, id and references as one that was added: the
+// params of the entities its add call made (a point's position, a circle's
+// centre, radius and normal), or its constraint's value. The rest of the
+// system keeps its values, the solved ones after a solve. Returns 0, or -1
+// with *failed set as real_slvs_add_records does; the records before that
+// one are updated.
+int real_slvs_update_records(RealSlvsSystem* s, const RealSlvsEntityRecord* entities, int n_entities,
+                             const RealSlvsConstraintRecord* constraints, int n_constraints, int* failed) {
+    if (failed) *failed = -1;
+    if (!s || n_entities < 0 || n_constraints < 0 || (n_entities > 0 && !entities) ||
+        (n_constraints > 0 && !constraints)) {
+        return -1;
+    }
+
+    for (int i = 0; i < n_entities; i++) {
+        if (update_entity_record(s, &entities[i]) != 0) {
+            if (failed) *failed = i;
+            return -1;
+        }
+    }
+    for (int i = 0; i < n_constraints; i++) {
+        if (update_constraint_record(s, &constraints[i]) != 0) {
+            if (failed) *failed = n_entities + i;
+            return -1;
+        }
+    }
+    return 0;
+}
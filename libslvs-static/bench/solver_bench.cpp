@@ -0,0 +1,468 @@
+//-----------------------------------------------------------------------------
+// Microbenchmarks for the solver's hot paths: evaluating and differentiating
+// expressions, writing and evaluating the Jacobian, the least squares step,
+// the rank test and the substitution pass, whole solves through Slvs_Solve,
+// and the startup of a process that uses the library. The sketches come from
+// generators (chains of links, grids of horizontal and vertical lines, and
+// planetary gear trains), so each one can be run over a range of sizes. Run with --benchmark_format=json (or the
+// slvs-bench-json target) for output that a script can read.
+//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "solvespace.h"
+#include <slvs.h>
+#ifdef SLVS_STARTUP_EXE
+#   include <spawn.h>
+#   include <sys/wait.h>
+extern char **environ;
+#endif
+
+namespace {
+
+// The fixed workplane and its normal go in the first group, and everything
+// to be solved for in the second.
+const uint32_t FIXED  = 1;
+const uint32_t SOLVED = 2;
+
+// A sketch, as the arrays that Slvs_Solve takes; it's also left in SK, made
+// by the library's own sketch functions.
+struct Model {
+    std::vector<Slvs_Param>      param;
+    std::vector<Slvs_Entity>     entity;
+    std::vector<Slvs_Constraint> constraint;
+
+    Slvs_Entity E(Slvs_Entity e) {
+        entity.push_back(e);
+        return e;
+    }
+    void C(Slvs_Constraint c) {
+        constraint.push_back(c);
+    }
+
+    // Take the params of every entity, with their starting values, from SK.
+    void GatherParams() {
+        for(const Slvs_Entity &e : entity) {
+            for(Slvs_hParam h : e.param) {
+                if(h == 0) continue;
+                param.push_back(Slvs_MakeParam(h, e.group, SK.GetParam(hParam { h })->val));
+            }
+        }
+    }
+};
+
+typedef void (*Generator)(Model *m, int a, int b);
+
+// The xy plane, in the fixed group, and its normal.
+Slvs_Entity Workplane(Model *m, Slvs_Entity *nm = NULL) {
+    Slvs_Entity origin = m->E(Slvs_AddPoint3D(FIXED, 0, 0, 0));
+    Slvs_Entity normal = m->E(Slvs_AddNormal3D(FIXED, 1, 0, 0, 0));
+    if(nm) *nm = normal;
+    return m->E(Slvs_AddWorkplane(FIXED, origin, normal));
+}
+
+// A chain of n links, each of fixed length and at a fixed angle to the one
+// before, with the first point dragged and the first link horizontal; this
+// is well constrained. The points start near their solution.
+void Chain(Model *m, int n, int) {
+    Slvs_Entity wp = Workplane(m);
+    std::vector<Slvs_Entity> pt, ln;
+    double x = 0, y = 0, angle = 0;
+    for(int i = 0; i <= n; i++) {
+        pt.push_back(m->E(Slvs_AddPoint2D(SOLVED, x + 0.05 * sin(i), y + 0.05 * cos(i), wp)));
+        if(i > 0) angle += (5 + i % 5) * PI / 180;
+        x += (10 + i % 3) * cos(angle);
+        y += (10 + i % 3) * sin(angle);
+    }
+    m->C(Slvs_Dragged(SOLVED, pt[0], wp));
+    for(int i = 0; i < n; i++) {
+        ln.push_back(m->E(Slvs_AddLine2D(SOLVED, pt[i], pt[i + 1], wp)));
+        m->C(Slvs_Distance(SOLVED, pt[i], pt[i + 1], 10 + i % 3, wp));
+    }
+    m->C(Slvs_Horizontal(SOLVED, ln[0], wp, SLVS_E_NONE));
+    for(int i = 1; i < n; i++) {
+        m->C(Slvs_Angle(SOLVED, ln[i - 1], ln[i], 5 + i % 5, wp, 0));
+    }
+}
+
+// An n by k grid of points joined by horizontal lines along the rows and
+// vertical lines down the columns, with the lengths given along the first
+// row and column and the first point dragged. Most of its equations say
+// that two unknowns are equal, which is what substitution removes.
+void Grid(Model *m, int n, int k) {
+    Slvs_Entity wp = Workplane(m);
+    std::vector<std::vector<Slvs_Entity>> pt(n, std::vector<Slvs_Entity>(k));
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < k; j++) {
+            pt[i][j] = m->E(Slvs_AddPoint2D(SOLVED, i * 5 + 0.1 * j, j * 5 - 0.1 * i, wp));
+        }
+    }
+    m->C(Slvs_Dragged(SOLVED, pt[0][0], wp));
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < k; j++) {
+            if(i + 1 < n) {
+                Slvs_Entity l = m->E(Slvs_AddLine2D(SOLVED, pt[i][j], pt[i + 1][j], wp));
+                m->C(Slvs_Horizontal(SOLVED, l, wp, SLVS_E_NONE));
+                if(j == 0) m->C(Slvs_Distance(SOLVED, pt[i][j], pt[i + 1][j], 5, wp));
+            }
+            if(j + 1 < k) {
+                Slvs_Entity l = m->E(Slvs_AddLine2D(SOLVED, pt[i][j], pt[i][j + 1], wp));
+                m->C(Slvs_Vertical(SOLVED, l, wp, SLVS_E_NONE));
+                if(i == 0) m->C(Slvs_Distance(SOLVED, pt[i][j], pt[i][j + 1], 5, wp));
+            }
+        }
+    }
+}
+
+// A train of n planetary stages, each a sun, a ring concentric with it and
+// k planets between them on the arms of a carrier, with the sun of each
+// stage on the first planet of the one before. Each carrier is free to turn,
+// so there's one degree of freedom left per stage.
+void Gears(Model *m, int n, int k) {
+    Slvs_Entity nm;
+    Slvs_Entity wp = Workplane(m, &nm);
+    const double rs = 10, rp = 4;
+    double cx = 0, cy = 0;
+    Slvs_Entity onPlanet = SLVS_E_NONE;
+    for(int s = 0; s < n; s++) {
+        Slvs_Entity sun = m->E(Slvs_AddPoint2D(SOLVED, cx + 0.1, cy - 0.1, wp));
+        if(s == 0) {
+            m->C(Slvs_Dragged(SOLVED, sun, wp));
+        } else {
+            m->C(Slvs_Coincident(SOLVED, sun, onPlanet, wp));
+        }
+        Slvs_Entity sunCircle = m->E(Slvs_AddCircle(SOLVED, nm, sun,
+            m->E(Slvs_AddDistance(SOLVED, rs + 0.2, wp)), wp));
+        m->C(Slvs_Diameter(SOLVED, sunCircle, 2 * rs));
+
+        Slvs_Entity ringCenter = m->E(Slvs_AddPoint2D(SOLVED, cx - 0.1, cy + 0.1, wp));
+        m->C(Slvs_Coincident(SOLVED, ringCenter, sun, wp));
+        Slvs_Entity ring = m->E(Slvs_AddCircle(SOLVED, nm, ringCenter,
+            m->E(Slvs_AddDistance(SOLVED, rs + 2 * rp - 0.3, wp)), wp));
+        m->C(Slvs_Diameter(SOLVED, ring, 2 * (rs + 2 * rp)));
+
+        std::vector<Slvs_Entity> arm;
+        for(int i = 0; i < k; i++) {
+            double a = 2 * PI * i / k + 0.02 * s;
+            Slvs_Entity planet = m->E(Slvs_AddPoint2D(SOLVED,
+                cx + (rs + rp) * cos(a) + 0.1 * sin(i), cy + (rs + rp) * sin(a) - 0.1, wp));
+            Slvs_Entity planetCircle = m->E(Slvs_AddCircle(SOLVED, nm, planet,
+                m->E(Slvs_AddDistance(SOLVED, rp - 0.1, wp)), wp));
+            m->C(Slvs_Diameter(SOLVED, planetCircle, 2 * rp));
+            m->C(Slvs_Distance(SOLVED, sun, planet, rs + rp, wp));
+            arm.push_back(m->E(Slvs_AddLine2D(SOLVED, sun, planet, wp)));
+            if(i > 0) m->C(Slvs_Angle(SOLVED, arm[i - 1], arm[i], 360.0 / k, wp, 0));
+            if(i == 0) onPlanet = planet;
+        }
+        cx += (rs + rp) * cos(0.02 * s);
+        cy += (rs + rp) * sin(0.02 * s);
+    }
+}
+
+void Generate(Model *m, Generator gen, const benchmark::State &state) {
+    Slvs_ClearSketch();
+    gen(m, (int)state.range(0), (int)state.range(1));
+    m->GatherParams();
+}
+
+// The unknowns and equations of the solved group, written the way that
+// Slvs_SolveSketch writes them, with everything tagged for one Jacobian.
+void WriteSystem(System *sys, Group *g) {
+    sys->Clear();
+    FreeAllTemporary();
+    sys->maxUnknowns = 0;
+    g->h.v = SOLVED;
+    for(EntityBase &e : SK.entity) {
+        if(e.group.v != SOLVED) continue;
+        for(hParam hp : e.param) {
+            if(hp.v == 0) continue;
+            Param *p = SK.GetParam(hp);
+            p->known = false;
+            sys->param.Add(p);
+        }
+    }
+    sys->WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    sys->param.ClearTags();
+    sys->eq.ClearTags();
+}
+
+void Label(benchmark::State &state, const System &sys) {
+    state.counters["equations"] = sys.eq.n;
+    state.counters["unknowns"]  = sys.param.n;
+}
+
+// The equations as copies built out of shared nodes, with their params
+// resolved to pointers, the way that WriteJacobian copies them.
+std::vector<Expr *> Copies(System *sys, ExprFactory *exprs) {
+    std::vector<Expr *> e;
+    for(Equation &eq : sys->eq) {
+        e.push_back(exprs->CopyWithParamsAsPointers(eq.e, &sys->param, &SK.param));
+    }
+    return e;
+}
+
+void BM_ExprEval(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    WriteSystem(&sys, &g);
+    ExprFactory exprs;
+    std::vector<Expr *> e = Copies(&sys, &exprs);
+    for(auto _ : state) {
+        double sum = 0;
+        for(Expr *x : e) sum += x->Eval();
+        benchmark::DoNotOptimize(sum);
+    }
+    Label(state, sys);
+    state.SetItemsProcessed(state.iterations() * e.size());
+}
+
+// Folding the constants out of each equation as it was written, into a
+// copy. This allocates, so the arena is emptied (and the equations written
+// again) between iterations, untimed.
+void BM_FoldConstants(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    for(auto _ : state) {
+        state.PauseTiming();
+        WriteSystem(&sys, &g);
+        state.ResumeTiming();
+        for(Equation &eq : sys.eq) {
+            benchmark::DoNotOptimize(eq.e->FoldConstants());
+        }
+    }
+    Label(state, sys);
+    state.SetItemsProcessed(state.iterations() * sys.eq.n);
+}
+
+// Differentiating each equation by each of the params that it uses, as
+// WriteJacobian does; the copies to differentiate are made untimed, in a
+// new factory each time, so that no partial is found already.
+void BM_PartialWrt(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    size_t partials = 0;
+    for(auto _ : state) {
+        state.PauseTiming();
+        WriteSystem(&sys, &g);
+        std::unique_ptr<ExprFactory> exprs(new ExprFactory());
+        std::vector<Expr *> e = Copies(&sys, exprs.get());
+        state.ResumeTiming();
+        for(Expr *x : e) {
+            ParamSet used;
+            x->ParamsUsedList(&used);
+            for(hParam p : used) {
+                benchmark::DoNotOptimize(exprs->PartialWrt(x, p));
+                partials++;
+            }
+        }
+        state.PauseTiming();
+        exprs.reset();
+        state.ResumeTiming();
+    }
+    Label(state, sys);
+    state.SetItemsProcessed(partials);
+}
+
+void BM_WriteJacobian(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    for(auto _ : state) {
+        state.PauseTiming();
+        WriteSystem(&sys, &g);
+        state.ResumeTiming();
+        sys.WriteJacobian(0);
+    }
+    Label(state, sys);
+    state.counters["nonzeros"] = sys.mat.A.sym.nonZeros();
+}
+
+// The steps below run on a Jacobian that's written once, at the starting
+// values of the params.
+void Linearize(System *sys, Group *g) {
+    WriteSystem(sys, g);
+    sys->WriteJacobian(0);
+    sys->EvalResiduals();
+    sys->EvalJacobian(true);
+}
+
+void BM_EvalJacobian(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    Linearize(&sys, &g);
+    for(auto _ : state) {
+        sys.EvalJacobian();
+    }
+    Label(state, sys);
+    state.counters["nonzeros"] = sys.mat.A.num.nonZeros();
+}
+
+// The whole tape for ExprTape::LANES sets of values at once, labelled with
+// the instruction set that the lanes were picked to run with.
+void BM_EvalLanes(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    Linearize(&sys, &g);
+    std::vector<double> lanes;
+    sys.mat.tape.SpreadLanes(&lanes);
+    for(auto _ : state) {
+        sys.mat.tape.EvalLanes(0, sys.mat.tape.Size(), lanes.data());
+        benchmark::ClobberMemory();
+    }
+    Label(state, sys);
+    state.SetLabel(ExprTape::LaneIsa());
+}
+
+// SolveLeastSquares scales the Jacobian in place, so it's evaluated again
+// (untimed) before each step.
+void BM_SolveLeastSquares(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    Linearize(&sys, &g);
+    for(auto _ : state) {
+        state.PauseTiming();
+        sys.EvalJacobian(true);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(sys.SolveLeastSquares());
+    }
+    Label(state, sys);
+    state.counters["factorNonZeros"] = sys.factorNonZeros;
+}
+
+void BM_CalculateRank(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    Linearize(&sys, &g);
+    int rank = 0;
+    for(auto _ : state) {
+        rank = sys.CalculateRank();
+        benchmark::DoNotOptimize(rank);
+    }
+    Label(state, sys);
+    state.counters["rank"] = rank;
+}
+
+// Substitution marks the equations and params that it removes, so they're
+// written again (untimed) for each pass.
+void BM_SolveBySubstitution(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    System sys;
+    Group g = {};
+    size_t substituted = 0;
+    for(auto _ : state) {
+        state.PauseTiming();
+        WriteSystem(&sys, &g);
+        state.ResumeTiming();
+        SubstitutionMap subs = sys.SolveBySubstitution();
+        substituted = subs.size();
+    }
+    Label(state, sys);
+    state.counters["substituted"] = substituted;
+}
+
+// A whole solve through the public interface, from the same starting values
+// each time: importing the sketch, solving it, and writing the values back.
+void BM_Solve(benchmark::State &state, Generator gen) {
+    Model m;
+    Generate(&m, gen, state);
+    Slvs_SetMaxUnknowns(0);
+    std::vector<Slvs_Param> param = m.param;
+    Slvs_System sys = {};
+    sys.param       = param.data();
+    sys.params      = (int)param.size();
+    sys.entity      = m.entity.data();
+    sys.entities    = (int)m.entity.size();
+    sys.constraint  = m.constraint.data();
+    sys.constraints = (int)m.constraint.size();
+    for(auto _ : state) {
+        std::copy(m.param.begin(), m.param.end(), param.begin());
+        Slvs_Solve(&sys, SOLVED);
+        if(sys.result != SLVS_RESULT_OKAY) {
+            state.SkipWithError(("solve failed, result " + std::to_string(sys.result)).c_str());
+            break;
+        }
+    }
+    state.counters["equations"]  = sys.stats.equations;
+    state.counters["unknowns"]   = sys.stats.unknowns;
+    state.counters["iterations"] = sys.stats.iterations;
+    state.counters["dof"]        = sys.dof;
+    Slvs_SetMaxUnknowns(System::MAX_UNKNOWNS);
+}
+
+#ifdef SLVS_STARTUP_EXE
+// Spawning slvs-startup and waiting for it, the way a program that starts a
+// solver for each request does: with range(0) set, it solves its sketch;
+// otherwise it exits as soon as main runs, so that's the cost of loading
+// the library and its static initialisers.
+void BM_Startup(benchmark::State &state) {
+    char exe[] = SLVS_STARTUP_EXE, exitEarly[] = "--exit";
+    char *argvSolve[] = { exe, nullptr };
+    char *argvExit[]  = { exe, exitEarly, nullptr };
+    for(auto _ : state) {
+        pid_t pid;
+        if(posix_spawn(&pid, exe, nullptr, nullptr,
+                       state.range(0) ? argvSolve : argvExit, environ) != 0) {
+            state.SkipWithError("couldn't spawn " SLVS_STARTUP_EXE);
+            break;
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            state.SkipWithError("slvs-startup failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_Startup)->ArgName("solve")->Arg(0)->Arg(1)->UseRealTime();
+#endif
+
+// Chains of 16 to 1024 links, square grids 4 to 32 points on a side, and
+// trains of 1 to 64 stages of 4 planets.
+void ChainSizes(benchmark::internal::Benchmark *b) {
+    for(int n = 16; n <= 1024; n *= 4) b->Args({ n, 0 });
+}
+void GridSizes(benchmark::internal::Benchmark *b) {
+    for(int n = 4; n <= 32; n *= 2) b->Args({ n, n });
+}
+void GearSizes(benchmark::internal::Benchmark *b) {
+    for(int n = 1; n <= 64; n *= 4) b->Args({ n, 4 });
+}
+
+#define SLVS_BENCHMARK(fn)                                  \
+    BENCHMARK_CAPTURE(fn, chain, Chain)->Apply(ChainSizes); \
+    BENCHMARK_CAPTURE(fn, grid,  Grid)->Apply(GridSizes);   \
+    BENCHMARK_CAPTURE(fn, gears, Gears)->Apply(GearSizes)
+
+SLVS_BENCHMARK(BM_ExprEval);
+SLVS_BENCHMARK(BM_FoldConstants);
+SLVS_BENCHMARK(BM_PartialWrt);
+SLVS_BENCHMARK(BM_WriteJacobian);
+SLVS_BENCHMARK(BM_EvalJacobian);
+SLVS_BENCHMARK(BM_EvalLanes);
+SLVS_BENCHMARK(BM_SolveLeastSquares);
+SLVS_BENCHMARK(BM_CalculateRank);
+SLVS_BENCHMARK(BM_SolveBySubstitution);
+SLVS_BENCHMARK(BM_Solve);
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,38 @@
+/*-----------------------------------------------------------------------------
+ * A one-shot process, the way a program that spawns a solver per request
+ * uses the library: it solves two points 10 apart, and exits. Given any
+ * argument, it exits before touching the library, so what's left is the
+ * cost of loading it. BM_Startup in slvs-bench runs it both ways.
+ *---------------------------------------------------------------------------*/
+#include <slvs.h>
+
+int main(int argc, char **argv) {
+    (void)argv;
+    if(argc > 1) return 0;
+
+    Slvs_Param param[] = {
+        Slvs_MakeParam(1, 1, 0.0), Slvs_MakeParam(2, 1, 0.0), Slvs_MakeParam(3, 1, 0.0),
+        Slvs_MakeParam(4, 1, 3.0), Slvs_MakeParam(5, 1, 4.0), Slvs_MakeParam(6, 1, 0.0),
+    };
+    Slvs_Entity entity[] = {
+        Slvs_MakePoint3d(101, 1, 1, 2, 3),
+        Slvs_MakePoint3d(102, 1, 4, 5, 6),
+    };
+    Slvs_Constraint constraint[] = {
+        Slvs_MakeConstraint(1, 1, SLVS_C_PT_PT_DISTANCE, SLVS_FREE_IN_3D, 10.0,
+                            101, 102, 0, 0),
+    };
+    Slvs_hParam dragged[] = { 1, 2, 3 };
+
+    Slvs_System sys = {0};
+    sys.param       = param;
+    sys.params      = 6;
+    sys.entity      = entity;
+    sys.entities    = 2;
+    sys.constraint  = constraint;
+    sys.constraints = 1;
+    sys.dragged     = dragged;
+    sys.ndragged    = 3;
+    Slvs_Solve(&sys, 1);
+    return sys.result == SLVS_RESULT_OKAY ? 0 : 1;
+}
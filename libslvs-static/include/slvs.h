@@ -118,6 +118,11 @@ typedef struct {
 #define SLVS_C_ARC_LINE_LEN_RATIO       100035
 #define SLVS_C_ARC_ARC_DIFFERENCE       100036
 #define SLVS_C_ARC_LINE_DIFFERENCE      100037
+/* Two gears in mesh, entityA and entityB as their pitch circles (or arcs):
+ * their centres are held valA * (other + other2) / 2 apart, where valA is
+ * the module and other and other2 are the tooth counts, other2 negative for
+ * a ring gear that entityA turns inside. */
+#define SLVS_C_GEAR_MESH                100038
 
 typedef struct {
     Slvs_hConstraint    h;
@@ -139,6 +144,81 @@ typedef struct {
     int                 other2;
 } Slvs_Constraint;
 
+/* What a solve did, for finding out where its time goes. Times are in
+ * milliseconds and summed over the worker threads; the phases nest, so that
+ * solving the equations that are soluble alone includes writing and
+ * factoring their Jacobians, and so on. */
+typedef struct {
+    /* Newton iterations, summed over the parts of the sketch, and the norm
+     * of the residuals that they were left with */
+    int                 iterations;
+    double              residual;
+    /* The equations and unknowns written, and the nonzeros in the
+     * Jacobians that Newton's method worked on */
+    int                 equations;
+    int                 unknowns;
+    int64_t             jacobianNonZeros;
+    /* Writing the equations; solving the simplest ones by substitution;
+     * solving the equations in a single unknown each; writing and
+     * evaluating the Jacobians; factoring them for Newton steps and for rank
+     * tests; and searching for the constraints that cause a failure */
+    double              writeEquationsMs;
+    double              substituteMs;
+    double              aloneMs;
+    double              writeJacobianMs;
+    double              evalJacobianMs;
+    double              stepMs;
+    double              rankMs;
+    double              findBadMs;
+    /* The expression nodes allocated, and the bytes taken from the
+     * temporary arenas and the most they held at once, summed over the
+     * threads; the distinct nodes of the equations the Jacobians were
+     * written from, what folding and sharing left of them, and the nodes
+     * their partials added; the entries in the Jacobians that Newton's
+     * method worked on, of which jacobianNonZeros were filled; and the
+     * constraint whose equations took the most nodes to write (0 for none),
+     * and how many */
+    int64_t             exprsAllocated;
+    int64_t             temporaryBytes;
+    int64_t             temporaryPeakBytes;
+    int64_t             sourceNodes;
+    int64_t             foldedNodes;
+    int64_t             partialNodes;
+    int64_t             jacobianEntries;
+    Slvs_hConstraint    heaviestConstraint;
+    int64_t             heaviestConstraintExprs;
+    /* Placing the triangles of distances, and the distances along an axis,
+     * in closed form before Newton's method; and how many were placed */
+    double              placeMs;
+    int                 rigidClusters;
+    /* The blocks of equations that were copies of one solved before, and
+     * were put in place from its solution instead of being solved */
+    int                 copiedBlocks;
+    /* The equations and unknowns of the largest block that Newton's method
+     * worked on. The limit on unknowns goes by block, and when this one is
+     * over it, the solve fails with SLVS_RESULT_TOO_MANY_UNKNOWNS and lists
+     * the constraints that make it up in failed[] */
+    int                 largestBlockEquations;
+    int                 largestBlockUnknowns;
+    /* The iterations that reused the last one's Jacobian and factorization,
+     * with SLVS_JACOBIAN_UPDATE_CHORD */
+    int                 reusedSteps;
+} Slvs_Stats;
+
+/* What one constraint cost a solve, when asked for with cost[] below: the
+ * expression nodes allocated writing its equations; the nonzeros in their
+ * rows of the Jacobians that Newton's method worked on; the milliseconds
+ * spent evaluating those rows, each by itself once per iteration, which says
+ * what they cost relative to each other, not what share of the solve they
+ * took; and the iterations that began with one of its residuals out of
+ * tolerance. */
+typedef struct {
+    Slvs_hConstraint    h;
+    int64_t             exprNodes;
+    int64_t             jacobianNonZeros;
+    double              evalMs;
+    int                 iterationsAboveTolerance;
+} Slvs_ConstraintCost;
 
 typedef struct {
     /*** INPUT VARIABLES
@@ -201,13 +281,68 @@ typedef struct {
 #define SLVS_RESULT_DIDNT_CONVERGE      2
 #define SLVS_RESULT_TOO_MANY_UNKNOWNS   3
 #define SLVS_RESULT_REDUNDANT_OKAY      4
+#define SLVS_RESULT_TIMED_OUT           5
+#define SLVS_RESULT_RESOURCE_EXHAUSTED  6
     int                 result;
+
+    /* If calculateFree is true and the solve is successful, then the solver
+     * also reports the parameters that can still move without violating any
+     * constraint. This takes one extra factorization, not one per parameter.
+     * The caller should allocate the array freeParam[], and pass its size in
+     * freeParams; the solver sets freeParams to the number of free
+     * parameters, and writes their Slvs_hParams into freeParam[]. */
+    int                 calculateFree;
+    Slvs_hParam         *freeParam;
+    int                 freeParams;
+
+    /* If the solve is successful, then the solver can also report how the
+     * solution moves as the values of some dimensions change. The caller
+     * lists their handles in sensitivity[], and allocates dParam[] to hold
+     * sensitivities x params values. Row i then gets the derivative of each
+     * parameter (in the order of param[]) by the value of sensitivity[i].
+     * These come from the Jacobian at the solution, by the implicit function
+     * theorem: one factorization, and one back substitution per dimension,
+     * instead of a solve for each. Where the system isn't fully constrained,
+     * each row is the smallest motion that keeps it solved. A handle that
+     * isn't a dimension of the group being solved gets a row of zeros. */
+    Slvs_hConstraint    *sensitivity;
+    int                 sensitivities;
+    double              *dParam;
+
+    /* Settings for Newton's method; leaving any of them zero gives the
+     * default. The residuals must all fall within tolerance, in at most
+     * maxIterations steps (by default, within LENGTH_EPS/100 in 50 steps).
+     * With SLVS_STEP_DAMPED, a step that would increase the residuals, or
+     * take them out of range, is shortened until it doesn't; this converges
+     * from much further away, at the cost of more evaluations per step. */
+#define SLVS_STEP_NEWTON                0
+#define SLVS_STEP_DAMPED                1
+    double              tolerance;
+    int                 maxIterations;
+    int                 stepMode;
+
+    /* The solver indicates the most nonzeros in any one of the sparse
+     * factors it computed, which shows how well the ordering chosen with
+     * Slvs_SetFillOrdering keeps down the fill-in. */
+    int64_t             factorNonZeros;
+
+    /* and what else the solve did */
+    Slvs_Stats          stats;
+
+    /* If cost[] is allocated, the solver profiles the solve, and reports
+     * what each constraint cost it: the caller passes the size of cost[] in
+     * costs, and the solver sets costs to the number of constraints that
+     * were charged anything, and writes as many of them as fit to cost[], in
+     * order of their handles. Profiling slows the solve down. */
+    Slvs_ConstraintCost *cost;
+    int                 costs;
 } Slvs_System;
 
 typedef struct {
     int                 result;
     int                 dof;
     int                 nbad;
+    Slvs_Stats          stats;
 } Slvs_SolveResult;
 
 /* Our base coordinate system has basis vectors
@@ -493,9 +628,25 @@ DLL Slvs_Constraint Slvs_DistanceProj(uint32_t grouph, Slvs_Entity ptA, Slvs_Ent
 DLL Slvs_Constraint Slvs_LengthDiff(uint32_t grouph, Slvs_Entity entityA, Slvs_Entity entityB, double value,
                                     Slvs_Entity workplane);
 DLL Slvs_Constraint Slvs_Dragged(uint32_t grouph, Slvs_Entity ptA, Slvs_Entity workplane);
+DLL Slvs_Constraint Slvs_GearMesh(uint32_t grouph, Slvs_Entity entityA, Slvs_Entity entityB,
+                                  double module, int teethA, int teethB,
+                                  Slvs_Entity workplane);
 
 DLL double Slvs_GetParamValue(uint32_t ph);
 DLL void Slvs_SetParamValue(uint32_t ph, double value);
+/**
+ * Every param's value in one array, to read and write them in bulk rather
+ * than with a call per param; `Slvs_ParamSlot` gives where a param is in it,
+ * or -1 for no such param. A param's slot stays the same until the sketch
+ * is cleared or replaced. The array holds the values as of the call, with
+ * `count` set to its length, and stays valid until a param is added or the
+ * sketch cleared. Values written to it take effect with
+ * `Slvs_CommitParamValues`, as if each that changed were set with
+ * `Slvs_SetParamValue`.
+ */
+DLL int Slvs_ParamSlot(uint32_t ph);
+DLL double *Slvs_ParamValues(size_t *count);
+DLL void Slvs_CommitParamValues(void);
 
 DLL void Slvs_Solve(Slvs_System *sys, uint32_t hg);
 DLL void Slvs_MarkDragged(Slvs_Entity ptA);
@@ -505,9 +656,453 @@ DLL void Slvs_MarkDragged(Slvs_Entity ptA);
  * the handles of those constraints, while the `nbad` member of the returned
  * `Slvs_SolveResult` struct is set to the number of the bad constraints.
  * NOTE: the user is responsible for freeing the heap allocated memory using `free()`.
+ *
+ * After a group solves OKAY, solving it again only re-solves the parts of it
+ * (sets of constraints and entities that share no unknowns) that an edit has
+ * touched since: a param set with `Slvs_SetParamValue`, or a new entity or
+ * constraint. The rest keep their solution, and their degrees of freedom
+ * still count in `dof`. Setting a param of another group that this one
+ * reads, marking a point dragged, or a solve that isn't OKAY makes the next
+ * solve of the group a full one again. `Slvs_ClearSketch()` forgets it all.
  */
 DLL Slvs_SolveResult Slvs_SolveSketch(uint32_t hg, Slvs_hConstraint **bad);
+/**
+ * Solves every group of the sketch, as `Slvs_SolveSketch` would one by one,
+ * in dependency order: a group that refers to an entity of another is solved
+ * after it, and reads its params as constants. Groups that don't depend on
+ * each other are solved at once, on up to `Slvs_SetWorkerCount` threads.
+ * The timeout is for the whole of the call.
+ *
+ * The result is that of the first group (in the order they were solved) that
+ * wasn't OKAY, if any; `dof`, the bad constraints and the stats are summed
+ * over all the groups.
+ */
+DLL Slvs_SolveResult Slvs_SolveAllGroups(Slvs_hConstraint **bad);
 DLL void Slvs_ClearSketch();
+/**
+ * Parts of the sketch that share no unknowns are solved independently; this
+ * sets the number of threads that they're spread over, for `Slvs_Solve`,
+ * `Slvs_SolveSketch` and `Slvs_SolveAllGroups`. The default of 1 solves them all on
+ * the calling thread. A part with tens of thousands of instructions to
+ * evaluate has its residuals and Jacobian evaluated on that many threads
+ * too, and one with thousands of constraints and entities has their
+ * equations written on them. The results don't depend on the number of
+ * threads.
+ */
+DLL void Slvs_SetWorkerCount(int workers);
+/**
+ * How the solver finds the partial derivatives of the equations, for both
+ * `Slvs_Solve` and `Slvs_SolveSketch`: by differentiating them symbolically
+ * (the default), or by automatic differentiation, which finds each row of
+ * the Jacobian in one reverse pass over its equation and builds no
+ * derivative expressions. The two agree to within rounding.
+ */
+#define SLVS_JACOBIAN_SYMBOLIC          0
+#define SLVS_JACOBIAN_AUTODIFF          1
+DLL void Slvs_SetJacobianMode(int mode);
+/**
+ * How the solver finds each least squares step of Newton's method, for both
+ * `Slvs_Solve` and `Slvs_SolveSketch`: by a sparse factorization (the
+ * default), or iteratively by LSQR, which only multiplies by the Jacobian
+ * and its transpose. LSQR needs no memory beyond the Jacobian itself, so it
+ * suits very large connected sketches; it finds the steps only as accurately
+ * as convergence needs, and falls back to the factorization on a part of the
+ * sketch that it makes slow progress on. The rank tests still factor the
+ * Jacobian. Since LSQR's steps are true least squares ones, when the
+ * constraints can't all be met it leaves the error spread over more of them,
+ * so more are reported as failed.
+ */
+#define SLVS_LEAST_SQUARES_DIRECT       0
+#define SLVS_LEAST_SQUARES_ITERATIVE    1
+DLL void Slvs_SetLeastSquaresMode(int mode);
+/**
+ * When Newton's method re-evaluates and re-factors the Jacobian, for both
+ * `Slvs_Solve` and `Slvs_SolveSketch`: at every step (the default), or, as
+ * in the chord method, only once the residuals stop at least halving with
+ * each step, reusing the last factorization until then. On a large block,
+ * where the factorization is most of a step, that saves most of the later
+ * steps' work; a reused step that doesn't reduce the residuals is taken
+ * again with a fresh Jacobian. Small blocks, and those whose rank is in
+ * doubt, always get a fresh one. The solutions agree to within the
+ * convergence tolerance, and `reusedSteps` in the stats counts the steps
+ * that were reused.
+ */
+#define SLVS_JACOBIAN_UPDATE_EVERY_STEP 0
+#define SLVS_JACOBIAN_UPDATE_CHORD      1
+DLL void Slvs_SetJacobianUpdate(int update);
+/**
+ * Where `Slvs_Solve` and `Slvs_SolveSketch` start Newton's method: from the
+ * params as given (the default), or staged, for a rough start, such as one
+ * with the points scattered or piled up. A staged solve first solves only
+ * the coincidences and points held where dragged, then adds the distances
+ * and incidences (on a line, circle or plane, midpoints, horizontal and
+ * vertical, equal lengths and radii), then the angles, then the tangencies,
+ * each stage starting from where the last left the params, and then solves
+ * everything from there. A stage that doesn't converge is skipped. The
+ * iterations in the stats include the stages'.
+ */
+#define SLVS_START_AS_GIVEN             0
+#define SLVS_START_STAGED               1
+DLL void Slvs_SetStartMode(int mode);
+/**
+ * The order in which the sparse factorizations eliminate the unknowns, which
+ * decides how much they fill in, for both `Slvs_Solve` and
+ * `Slvs_SolveSketch`: COLAMD (the default), AMD, which can fill in less on
+ * mesh-like sketches, the order the unknowns come in, which suits chains,
+ * or AUTO, which picks whichever of those fills in the least on the pattern
+ * of the Jacobian. The choice changes the cost of a solve; where a sketch
+ * has more than one solution near its start, or can't be satisfied, which
+ * solution it converges to, and which constraints are reported as failed,
+ * can depend on it too.
+ */
+#define SLVS_ORDERING_COLAMD            0
+#define SLVS_ORDERING_AMD               1
+#define SLVS_ORDERING_NATURAL           2
+#define SLVS_ORDERING_AUTO              3
+DLL void Slvs_SetFillOrdering(int ordering);
+/**
+ * Which sparse QR `Slvs_Solve` and `Slvs_SolveSketch` factor the Jacobian
+ * with, for the rank tests and the least squares steps, on parts of the
+ * sketch too big to factor densely: Eigen's (the default), or SuiteSparseQR,
+ * a multifrontal QR that factors on every core, and pays off on parts with
+ * thousands of unknowns. SuiteSparseQR is only there in a library built with
+ * SLVS_USE_SPQR on a machine that has it; otherwise Eigen's is kept. Returns
+ * the one that's now in use. SuiteSparseQR takes its own COLAMD or AMD
+ * ordering rather than the one from `Slvs_SetFillOrdering`.
+ */
+#define SLVS_QR_EIGEN                   0
+#define SLVS_QR_SUITESPARSE             1
+DLL int Slvs_SetQRBackend(int backend);
+/**
+ * Which kinds of constraint `Slvs_Solve` and `Slvs_SolveSketch` write as
+ * polynomials rather than with square roots and quotients, OR'd together:
+ * point to point distances and points on circles as squared distances;
+ * equal lengths and length ratios as squared lengths; and perpendiculars,
+ * and angles in a workplane, as dot and cross products. Each is scaled so
+ * that near the solution it moves as the usual equation does, and so
+ * converges as fast, but is cheaper to evaluate and to differentiate. A
+ * constraint whose form would be degenerate (a distance or ratio of zero,
+ * lines of no length) or whose value comes from an expression is written
+ * as usual. An angle written this way holds for either direction of the
+ * second line, so from a start far from the solution it can settle with
+ * that line reversed. None of them by default.
+ */
+#define SLVS_FORM_DISTANCE              1
+#define SLVS_FORM_LENGTHS               2
+#define SLVS_FORM_ANGLE                 4
+DLL void Slvs_SetPolynomialForms(int forms);
+/**
+ * Whether `Slvs_Solve` and `Slvs_SolveSketch` write each free 3d normal as
+ * three of its quaternion's components, with the fourth (the largest when
+ * the solve starts) found from them, rather than as all four and an
+ * equation that keeps it of unit length. That's one unknown and one
+ * nonlinear equation fewer for each normal. Off by default; sketches
+ * solved again with `Slvs_Resolve` keep all four.
+ */
+DLL void Slvs_SetNormalCharts(int on);
+/**
+ * The most equations that `Slvs_Solve` and `Slvs_SolveSketch` will take on
+ * in any one part of the sketch before giving up with
+ * SLVS_RESULT_TOO_MANY_UNKNOWNS; 0 means no limit. The default is 2048. The
+ * Jacobian and its factorizations are sparse, and parts of the sketch that
+ * share no unknowns are factored separately, so the limit goes by part: a
+ * large sketch costs time roughly in proportion to its size, as long as the
+ * parts of it are small, and the stats say how big the largest one was.
+ */
+DLL void Slvs_SetMaxUnknowns(int n);
+/**
+ * The longest, in milliseconds, that each `Slvs_Solve`, `Slvs_SolveSketch`
+ * or `Slvs_Resolve` on the current context may take; 0 (the default) means
+ * no limit. `Slvs_Cancel` ends the solve that's running on ctx (NULL for the
+ * default context) as soon as it can, or the next one to start if none is,
+ * and may be called from any thread. Either way, the solve stops at its next
+ * check (every Newton iteration, part of the sketch, or constraint tested
+ * while looking for bad ones) with SLVS_RESULT_TIMED_OUT, and leaves the
+ * parameters at their starting values. A single factorization isn't
+ * interrupted, so a solve can overrun by as long as one takes.
+ */
+DLL void Slvs_SetTimeout(int ms);
+/**
+ * The most memory, in bytes, that each solve on the current context may
+ * hold; 0 (the default) means no limit. What counts is the expressions and
+ * other temporaries the solve allocates, and an estimate of its Jacobian and
+ * factorizations from their nonzeros; with `Slvs_SetWorkerCount` above 1,
+ * each worker has the whole budget for what it does on its own thread. A
+ * solve that goes over stops at its next check, as one that times out does,
+ * with SLVS_RESULT_RESOURCE_EXHAUSTED, and leaves the parameters at their
+ * starting values; writing a Jacobian checks after each partial derivative,
+ * so one huge derivative can overrun the budget by as much as it takes.
+ */
+DLL void Slvs_SetMemoryBudget(int64_t bytes);
+/**
+ * Called as each phase of a solve on the current context begins and ends,
+ * so that the solver's time can be lined up with a profiler's own trace:
+ * the whole of a solve, and within it writing a Jacobian, Newton's method on
+ * a set of equations, looking for the bad constraints, and finding the free
+ * params. The phases nest, and each one begins and ends on the same thread;
+ * with `Slvs_SetWorkerCount` above 1, the parts of the sketch solved on other
+ * threads are reported from those threads, so calls can come at once. timeNs
+ * is from a monotonic clock. The counters are those of the phase's own set
+ * of equations (of the whole solve, for SOLVE) at that moment: iterations
+ * is the Newton steps taken so far, and residual the norm of the residuals
+ * as last evaluated. exprsAllocated and temporaryBytes are the calling
+ * thread's: the expression nodes it has ever allocated, so that the
+ * difference between a phase's two events is what the phase allocated, and
+ * the bytes its temporary arena holds. Passing NULL (the default) stops the
+ * calls, and the solver then spends nothing on them.
+ */
+#define SLVS_TRACE_SOLVE                0
+#define SLVS_TRACE_WRITE_JACOBIAN       1
+#define SLVS_TRACE_NEWTON               2
+#define SLVS_TRACE_FIND_BAD             3
+#define SLVS_TRACE_MARK_FREE            4
+#define SLVS_TRACE_NEWTON_STEP          5
+typedef struct {
+    int         phase;
+    /* 1 as the phase begins, 0 as it ends */
+    int         begin;
+    int64_t     timeNs;
+    int         equations;
+    int         unknowns;
+    int64_t     jacobianNonZeros;
+    int         iterations;
+    double      residual;
+    int64_t     exprsAllocated;
+    int64_t     temporaryBytes;
+} Slvs_TraceEvent;
+typedef void (*Slvs_TraceCallback)(const Slvs_TraceEvent *event, void *user);
+DLL void Slvs_SetTraceCallback(Slvs_TraceCallback callback, void *user);
+/**
+ * With on nonzero, the trace callback is also told of the end of each
+ * Newton step, as SLVS_TRACE_NEWTON_STEP with begin 0 and no event to begin
+ * it: iterations counts the steps taken on the phase's equations, and
+ * residual is their norm after this one, for showing a long solve's
+ * progress as it goes. Off by default, so that a trace's events nest.
+ */
+DLL void Slvs_SetTraceSteps(int on);
+
+/**
+ * Everything that the functions above work on (the sketch, the dragged
+ * parameters and the solver's own state) lives in a context. By default
+ * every thread shares one context, so only one solve can run at a time.
+ * To solve concurrently, give each thread a context of its own: either make
+ * it current for the thread, so that all the other functions use it, or
+ * pass it to `Slvs_SolveInContext`. A context must only be used by one
+ * thread at a time.
+ */
+typedef struct Slvs_Context Slvs_Context;
+DLL Slvs_Context *Slvs_CreateContext();
+DLL void Slvs_DestroyContext(Slvs_Context *ctx);
+/* Passing NULL goes back to the default context. */
+DLL void Slvs_SetCurrentContext(Slvs_Context *ctx);
+DLL Slvs_Context *Slvs_GetCurrentContext();
+/* Like `Slvs_Solve`, but on ctx, whatever the current context is. */
+DLL void Slvs_SolveInContext(Slvs_Context *ctx, Slvs_System *sys, uint32_t hg);
+DLL void Slvs_Cancel(Slvs_Context *ctx);
+/* Empties ctx (NULL for the default context) for another system, as if it
+ * were new, settings and all; but the storage its solves grew is kept, so
+ * that a system of about the same size solves in it without allocating. */
+DLL void Slvs_ResetContext(Slvs_Context *ctx);
+/* Frees the calling thread's scratch memory past what its last solve
+ * needed; otherwise it is kept from one solve to the next. */
+DLL void Slvs_TrimThreadMemory();
+
+/**
+ * For building a system straight in to the current context's sketch,
+ * rather than in the arrays of a `Slvs_System` that `Slvs_Solve` copies in
+ * to it and its solution back out of. `Slvs_BeginSystem` replaces the sketch
+ * with an empty one, with room for as many of each as are given, for group
+ * hg to be solved. Params, entities, constraints and dragged params are
+ * then added, each as it would be in the arrays of a `Slvs_System`, and
+ * `Slvs_SolveSystem` solves them, once, with sys's settings; it sets sys's
+ * results as `Slvs_Solve` does, except that sys's own params aren't read or
+ * written, and `freeParam` lists any of the sketch's. The solution stays in
+ * the sketch: the params are in `Slvs_ParamValues` in the order that they
+ * were added, each at the slot that's its place in that order. It lasts
+ * until the sketch is next replaced or cleared.
+ */
+DLL void Slvs_BeginSystem(uint32_t hg, int params, int entities, int constraints);
+DLL void Slvs_AddSystemParam(const Slvs_Param *p);
+DLL void Slvs_AddSystemEntity(const Slvs_Entity *e);
+DLL void Slvs_AddSystemConstraint(const Slvs_Constraint *c);
+DLL void Slvs_AddSystemDragged(Slvs_hParam p);
+DLL void Slvs_SolveSystem(Slvs_System *sys);
+
+/**
+ * For solving the same system many times over, as its dimensions change.
+ * `Slvs_Compile` loads sys in to the current context, like `Slvs_Solve`
+ * does, and writes its equations once, with each dimension's value as a
+ * parameter; it returns SLVS_RESULT_OKAY, or SLVS_RESULT_TOO_MANY_UNKNOWNS.
+ * `Slvs_Resolve` then runs only the numeric solve, from the current values,
+ * and writes the parameters, `result` and `dof` of sys; bad constraints
+ * aren't looked for. In between, dimensions and starting values can be
+ * changed by handle; these return 0, or -1 if the handle isn't a dimension
+ * or unknown of the compiled system. The compiled system lasts until the
+ * next `Slvs_Compile`, `Slvs_Solve` or `Slvs_ClearSketch` on the context.
+ */
+DLL int Slvs_Compile(Slvs_System *sys, uint32_t hg);
+DLL int Slvs_SetConstraintValue(Slvs_hConstraint c, double value);
+DLL int Slvs_SetParamStart(Slvs_hParam p, double value);
+DLL void Slvs_Resolve(Slvs_System *sys);
+/**
+ * A compiled system's dimension can take its value from an expression of
+ * params, rather than as it's given: of params in another group than the
+ * one solved, say, that stand for named values that several dimensions are
+ * made from. Sweeping those then changes a few params, and the compiled
+ * equations stay as they are. expr is read by the solver's own parser:
+ * numbers, pi, + - * / and parentheses, sqrt, square, and sin, cos, asin
+ * and acos in degrees, with $h for the value of param h. It belongs to the
+ * context, for constraint c of each system compiled there from then on
+ * (by `Slvs_Compile`, `Slvs_SolveBatch` or `Slvs_SolveTrack`), until it's
+ * set again; NULL or "" removes it. The compiled system evaluates it for
+ * each `Slvs_Resolve`, `Slvs_Drag` and batch row, so the params it reads
+ * can be changed in between with `Slvs_SetParamStart`, and listed in a
+ * batch's param[]. A solve or row in which one doesn't come to a finite
+ * number (as one that reads a param the system hasn't got doesn't) gets
+ * SLVS_RESULT_DIDNT_CONVERGE, with dof -1. Returns 0, or -1 if expr doesn't
+ * parse.
+ */
+DLL int Slvs_SetConstraintExpression(Slvs_hConstraint c, const char *expr);
+/**
+ * One frame of dragging a compiled system, for steady frame times: move the
+ * dragged params (listed in sys->dragged when it was compiled) with
+ * `Slvs_SetParamStart`, then call this. It takes Newton steps from where the
+ * last frame left the unknowns, with no rank tests, for at most
+ * sys->maxIterations steps or budgetUs microseconds (0 for no limit). The
+ * params of sys get the step with the smallest residuals, converged or not,
+ * and `result` is SLVS_RESULT_OKAY if it converged, or else
+ * SLVS_RESULT_TIMED_OUT if the budget ran out, or DIDNT_CONVERGE; `dof` is
+ * -1. When the drag ends, `Slvs_Resolve` solves the final position in full.
+ */
+DLL void Slvs_Drag(Slvs_System *sys, int budgetUs);
+
+/**
+ * Checks whether the params of sys, as they are, already solve group hg,
+ * without solving it: loads sys in to the current context, like
+ * `Slvs_Solve` does, and evaluates each equation once, with no Jacobian,
+ * factorization or rank test. residual[] gets one entry for each of
+ * sys->constraint[], the largest magnitude of that constraint's residuals
+ * (0 for one of another group). Returns SLVS_RESULT_OKAY if every equation
+ * is within sys->tolerance, or else SLVS_RESULT_DIDNT_CONVERGE. sys itself
+ * isn't changed; as with `Slvs_Solve`, a system compiled on the context is
+ * gone.
+ */
+DLL int Slvs_Check(Slvs_System *sys, uint32_t hg, double *residual);
+
+/**
+ * Like `Slvs_Solve`, but when the solve from the given starting point
+ * doesn't converge (SLVS_RESULT_DIDNT_CONVERGE or INCONSISTENT), it's tried
+ * again from up to starts - 1 others, each a fixed perturbation of the
+ * given one: start k moves every unknown of group hg, other than the
+ * dragged ones and those of points held SLVS_C_WHERE_DRAGGED, by up to 2k%
+ * of (1 + its magnitude). Those are solved on
+ * the threads set by `Slvs_SetWorkerCount`, in contexts of their own, and
+ * the first start (in order, so the nearest the given one) that converges
+ * wins; the later ones still running are cancelled. The answer is the same
+ * for any number of threads. sys then gets that start's solution, solved
+ * once more from there to fill in the rest of its outputs; if none
+ * converged, it keeps what the given start left. The timeout applies to
+ * each start. Returns the winning start, 0 for the given one, or -1.
+ */
+DLL int Slvs_SolveMultiStart(Slvs_System *sys, uint32_t hg, int starts);
+
+/**
+ * Solves one system under many sets of values: each row of the batch gives
+ * starting values for the unknowns listed in param[] and values for the
+ * dimensions listed in constraint[], and gets back the solved value of every
+ * parameter of sys (in the order of sys->param), with its result and dof.
+ * The system is compiled once, as by `Slvs_Compile`, and every row starts
+ * from the values in sys, so rows don't depend on each other; they're
+ * spread over the threads set by `Slvs_SetWorkerCount`, and each thread
+ * evaluates the equations for several rows in one pass. Returns 0; or
+ * SLVS_RESULT_TOO_MANY_UNKNOWNS, or -1 if something in param[] or
+ * constraint[] isn't an unknown or a dimension of the system, in which case
+ * no rows are solved.
+ */
+typedef struct {
+    int                 rows;
+
+    Slvs_hParam         *param;
+    int                 params;
+    /* rows x params starting values, one row after another */
+    double              *paramValue;
+
+    Slvs_hConstraint    *constraint;
+    int                 constraints;
+    /* rows x constraints dimension values, one row after another */
+    double              *constraintValue;
+
+    /*** OUTPUT VARIABLES
+     *
+     * solved[] holds rows x sys->params values, and result[] and dof[] one
+     * entry for each row; the caller allocates them all. */
+    double              *solved;
+    int                 *result;
+    int                 *dof;
+} Slvs_Batch;
+DLL int Slvs_SolveBatch(Slvs_System *sys, uint32_t hg, Slvs_Batch *batch);
+/**
+ * `Slvs_SolveBatch` for group hg of the sketch: solved[] holds rows x count
+ * values, with count as `Slvs_ParamValues` gives it, each row laid out by
+ * `Slvs_ParamSlot` as that is. The sketch itself isn't changed.
+ */
+DLL int Slvs_SolveSketchBatch(uint32_t hg, Slvs_Batch *batch);
+/**
+ * The precision that `Slvs_SolveBatch` and `Slvs_SolveSketchBatch` evaluate
+ * the equations in: double throughout (the default); or mixed, where each
+ * row's first Newton steps evaluate them in single precision, which moves
+ * half the data, and the row goes over to double as its residuals near what
+ * single precision can resolve, or stop shrinking. A row only converges as
+ * checked in double, so the solutions meet the same tolerance either way,
+ * though they may differ within it, and a row may take a step more. Mixed
+ * precision pays where evaluating the equations is most of each step.
+ */
+#define SLVS_BATCH_PRECISION_DOUBLE     0
+#define SLVS_BATCH_PRECISION_MIXED      1
+DLL void Slvs_SetBatchPrecision(int precision);
+
+/**
+ * Follows one solution of a system as one of its dimensions moves through a
+ * list of values, such as the angle that drives a linkage through its
+ * motion. The first value is solved from the starting values in sys, as by
+ * `Slvs_Resolve`. To get to each value after it, the solver continues from
+ * the solution before: each step predicts along the tangent to the path and
+ * corrects by Newton's method, and the steps lengthen and shorten with how
+ * easily they correct. That takes fewer iterations than solving each value
+ * from the start, and it keeps to the branch that the first value solved
+ * to, rather than jumping to another assembly. A value that can't be
+ * reached (past the limit of the mechanism's motion, say) fails, and the
+ * next one is tried from the last point that was solved.
+ *
+ * Like `Slvs_SolveBatch`, this compiles sys and leaves its parameters as
+ * they were. It returns 0; or SLVS_RESULT_TOO_MANY_UNKNOWNS, or -1 if
+ * constraint isn't a dimension of the system.
+ */
+typedef struct {
+    Slvs_hConstraint    constraint;
+    int                 values;
+    double              *value;
+
+    /* The length of the first step, and the shortest and longest steps to
+     * take, in the dimension's units; 0 for the gap between the first two
+     * values, a ten thousandth of the first step, and no limit. */
+    double              step;
+    double              minStep;
+    double              maxStep;
+
+    /*** OUTPUT VARIABLES
+     *
+     * solved[] holds values x sys->params values; result[], dof[],
+     * iterations[] (the Newton iterations spent getting to the value) and
+     * steps[] (the steps taken to get there) one entry for each value. The
+     * caller allocates them all. */
+    double              *solved;
+    int                 *result;
+    int                 *dof;
+    int                 *iterations;
+    int                 *steps;
+} Slvs_Track;
+DLL int Slvs_SolveTrack(Slvs_System *sys, uint32_t hg, Slvs_Track *track);
 
 #ifdef __cplusplus
 }
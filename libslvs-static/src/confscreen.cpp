@@ -40,6 +40,11 @@ void TextWindow::ScreenChangeExportMaxSegments(int link, uint32_t v) {
     SS.TW.edit.i = 1;
 }
 
+void TextWindow::ScreenChangeExportMaxTriangles(int link, uint32_t v) {
+    SS.TW.ShowEditControl(3, ssprintf("%d", SS.exportMaxTriangles));
+    SS.TW.edit.meaning = Edit::EXPORT_MAX_TRIANGLES;
+}
+
 void TextWindow::ScreenChangeGridSpacing(int link, uint32_t v) {
     SS.TW.ShowEditControl(3, SS.MmToString(SS.gridSpacing, true));
     SS.TW.edit.meaning = Edit::GRID_SPACING;
@@ -247,6 +252,10 @@ void TextWindow::ShowConfiguration() {
     Printf(false, "%Ba   %d %Fl%Ll%f[change]%E",
         SS.exportMaxSegments,
         &ScreenChangeExportMaxSegments);
+    Printf(false, "%Ft export max triangles in a mesh (0=no limit)%E");
+    Printf(false, "%Ba   %d %Fl%Ll%f[change]%E",
+        SS.exportMaxTriangles,
+        &ScreenChangeExportMaxTriangles);
 
     Printf(false, "%Ft snap grid spacing%E");
     Printf(false, "%Ba   %s %Fl%Ll%f%D[change]%E",
@@ -439,6 +448,10 @@ bool TextWindow::EditControlDoneForConfiguration(const std::string &s) {
             }
             break;
         }
+        case Edit::EXPORT_MAX_TRIANGLES: {
+            SS.exportMaxTriangles = max(0, atoi(s.c_str()));
+            break;
+        }
         case Edit::CAMERA_TANGENT: {
             SS.cameraTangent = (min(2.0, max(0.0, atof(s.c_str()))))/1000.0;
             SS.GW.Invalidate();
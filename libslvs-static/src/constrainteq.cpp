@@ -23,6 +23,7 @@ bool ConstraintBase::HasLabel() const {
         case Type::LENGTH_DIFFERENCE:
         case Type::ARC_ARC_DIFFERENCE: 
         case Type::ARC_LINE_DIFFERENCE:
+        case Type::GEAR_MESH:
         case Type::ANGLE:
         case Type::COMMENT:
             return true;
@@ -48,6 +49,7 @@ bool ConstraintBase::IsProjectible() const {
         case Type::LENGTH_DIFFERENCE:
         case Type::ARC_ARC_DIFFERENCE: 
         case Type::ARC_LINE_DIFFERENCE:
+        case Type::GEAR_MESH:
         case Type::SYMMETRIC:
         case Type::SYMMETRIC_HORIZ:
         case Type::SYMMETRIC_VERT:
@@ -128,6 +130,24 @@ Expr *ConstraintBase::PointPlaneDistance(ExprVector p, hEntity hpl) {
     return (p.Dot(n))->Minus(d);
 }
 
+//-----------------------------------------------------------------------------
+// Find the parameters of a point that the equations will use as they are:
+// the u and v of a point in the workplane, or the x, y and z of a point in
+// free space. Returns how many there are, or zero if the point is anything
+// else, and so gets no closed-form kernel.
+//-----------------------------------------------------------------------------
+static int PointParamsIn(hEntity wrkpl, hEntity hpt, hParam *p) {
+    EntityBase *pt = SK.GetEntity(hpt);
+    if(wrkpl == EntityBase::FREE_IN_3D) {
+        if(pt->type != EntityBase::Type::POINT_IN_3D) return 0;
+        std::copy_n(pt->param, 3, p);
+        return 3;
+    }
+    if(pt->type != EntityBase::Type::POINT_IN_2D || pt->workplane != wrkpl) return 0;
+    std::copy_n(pt->param, 2, p);
+    return 2;
+}
+
 Expr *ConstraintBase::Distance(hEntity wrkpl, hEntity hpa, hEntity hpb) {
     EntityBase *pa = SK.GetEntity(hpa);
     EntityBase *pb = SK.GetEntity(hpb);
@@ -156,6 +176,27 @@ Expr *ConstraintBase::Distance(hEntity wrkpl, hEntity hpa, hEntity hpb) {
     }
 }
 
+// The square of Distance, which needs no square root.
+Expr *ConstraintBase::DistanceSquared(hEntity wrkpl, hEntity hpa, hEntity hpb) {
+    EntityBase *pa = SK.GetEntity(hpa);
+    EntityBase *pb = SK.GetEntity(hpb);
+    ssassert(pa->IsPoint() && pb->IsPoint(),
+             "Expected two points to measure projected distance between");
+
+    if(wrkpl == EntityBase::FREE_IN_3D) {
+        ExprVector eab = (pa->PointGetExprs()).Minus(pb->PointGetExprs());
+        return eab.Dot(eab);
+    } else {
+        Expr *au, *av, *bu, *bv;
+        pa->PointGetExprsInWorkplane(wrkpl, &au, &av);
+        pb->PointGetExprsInWorkplane(wrkpl, &bu, &bv);
+
+        Expr *du = au->Minus(bu);
+        Expr *dv = av->Minus(bv);
+        return (du->Square())->Plus(dv->Square());
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Return the cosine of the angle between two vectors. If a workplane is
 // specified, then it's the cosine of their projections into that workplane.
@@ -181,6 +222,29 @@ Expr *ConstraintBase::DirectionCosine(hEntity wrkpl,
     }
 }
 
+// The numerator of DirectionCosine, the dot product of the two vectors (or
+// of their projections), and in mags the product of their lengths as they
+// are now, which is what it's divided by.
+Expr *ConstraintBase::DirectionDot(hEntity wrkpl, ExprVector ae, ExprVector be,
+                                   double *mags)
+{
+    if(wrkpl == EntityBase::FREE_IN_3D) {
+        *mags = ae.Eval().Magnitude() * be.Eval().Magnitude();
+        return ae.Dot(be);
+    } else {
+        EntityBase *w = SK.GetEntity(wrkpl);
+        ExprVector u = w->Normal()->NormalExprsU();
+        ExprVector v = w->Normal()->NormalExprsV();
+        Expr *ua = u.Dot(ae);
+        Expr *va = v.Dot(ae);
+        Expr *ub = u.Dot(be);
+        Expr *vb = v.Dot(be);
+        *mags = sqrt(ua->Eval() * ua->Eval() + va->Eval() * va->Eval()) *
+                sqrt(ub->Eval() * ub->Eval() + vb->Eval() * vb->Eval());
+        return (ua->Times(ub))->Plus(va->Times(vb));
+    }
+}
+
 ExprVector ConstraintBase::PointInThreeSpace(hEntity workplane,
                                              Expr *u, Expr *v)
 {
@@ -223,8 +287,11 @@ void ConstraintBase::ModifyToSatisfy() {
         ssassert(l.n == 1, "Expected constraint to generate a single equation");
 
         // These equations are written in the form f(...) - d = 0, where
-        // d is the value of the valA.
-        valA += (l[0].e)->Eval();
+        // d is the value of the valA; or for a gear mesh, of the distance
+        // that valA is the module for.
+        double e = (l[0].e)->Eval();
+        if(type == Type::GEAR_MESH) e /= GearPitchSum();
+        valA += e;
 
         l.Clear();
     }
@@ -238,6 +305,16 @@ void ConstraintBase::AddEq(IdList<Equation,hEquation> *l, Expr *expr, int index)
     l->Add(&eq);
 }
 
+void ConstraintBase::AddEq(IdList<Equation,hEquation> *l, Expr *expr, int index,
+                           const EquationKernel &kernel) const
+{
+    Equation eq;
+    eq.e = expr;
+    eq.h = h.equation(index);
+    eq.kernel = kernel;
+    l->Add(&eq);
+}
+
 void ConstraintBase::AddEq(IdList<Equation,hEquation> *l, const ExprVector &v,
                            int baseIndex) const {
     AddEq(l, v.x, baseIndex);
@@ -268,15 +345,53 @@ void ConstraintBase::Generate(ParamList *l) {
     }
 }
 
+// With forms, the constraints of the kinds it names are written as
+// polynomials where that's sound, and scaled so that near the solution they
+// are the same as the usual equations to first order: f - d becomes
+// (f^2 - d^2) / 2d, and so on. Where the scale would be zero (a distance or
+// ratio of zero, lines with no length) or isn't known when they're written
+// (a value from an expression), they're written as usual.
 void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
-                                       bool forReference) const {
+                                       bool forReference, uint32_t forms) const {
     if(reference && !forReference) return;
 
-    Expr *exA = Expr::From(valA);
+    Expr *exA = valAParam.v ? Expr::From(valAParam) : Expr::From(valA);
     switch(type) {
-        case Type::PT_PT_DISTANCE:
-            AddEq(l, Distance(workplane, ptA, ptB)->Minus(exA), 0);
+        case Type::PT_PT_DISTANCE: {
+            if((forms & POLY_DISTANCE) && !valAParam.v && valA > LENGTH_EPS) {
+                Expr *d2 = DistanceSquared(workplane, ptA, ptB);
+                AddEq(l, (d2->Minus(Expr::From(valA * valA)))->Times(Expr::From(0.5 / valA)), 0);
+                return;
+            }
+            EquationKernel k = {};
+            int n = PointParamsIn(workplane, ptA, &k.param[0]);
+            if(n > 0 && PointParamsIn(workplane, ptB, &k.param[n]) == n) {
+                k.type = (n == 2) ? EquationKernel::Type::DISTANCE_2D
+                                  : EquationKernel::Type::DISTANCE_3D;
+                k.param[2*n] = valAParam;
+                k.value      = valA;
+            }
+            AddEq(l, Distance(workplane, ptA, ptB)->Minus(exA), 0, k);
             return;
+        }
+
+        case Type::GEAR_MESH: {
+            // The pitch circles roll on each other, so their centres are
+            // the sum of the pitch radii apart, or for a ring gear the
+            // difference: module * (teethA + teethB) / 2 either way.
+            hEntity ca = SK.GetEntity(entityA)->point[0];
+            hEntity cb = SK.GetEntity(entityB)->point[0];
+            double pitch = GearPitchSum();
+            EquationKernel k = {};
+            int n = PointParamsIn(workplane, ca, &k.param[0]);
+            if(!valAParam.v && n > 0 && PointParamsIn(workplane, cb, &k.param[n]) == n) {
+                k.type = (n == 2) ? EquationKernel::Type::DISTANCE_2D
+                                  : EquationKernel::Type::DISTANCE_3D;
+                k.value = valA * pitch;
+            }
+            AddEq(l, Distance(workplane, ca, cb)->Minus(exA->Times(Expr::From(pitch))), 0, k);
+            return;
+        }
 
         case Type::PROJ_PT_DISTANCE: {
             ExprVector pA = SK.GetEntity(ptA)->PointGetExprs(),
@@ -313,6 +428,16 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
         case Type::EQUAL_LENGTH_LINES: {
             EntityBase *a = SK.GetEntity(entityA);
             EntityBase *b = SK.GetEntity(entityB);
+            if(forms & POLY_LENGTHS) {
+                Expr *la2 = DistanceSquared(workplane, a->point[0], a->point[1]);
+                Expr *lb2 = DistanceSquared(workplane, b->point[0], b->point[1]);
+                // over twice the mean length now
+                double len = sqrt(la2->Eval()) + sqrt(lb2->Eval());
+                if(len > LENGTH_EPS) {
+                    AddEq(l, (la2->Minus(lb2))->Times(Expr::From(1 / len)), 0);
+                    return;
+                }
+            }
             AddEq(l, Distance(workplane, a->point[0], a->point[1])->Minus(
                      Distance(workplane, b->point[0], b->point[1])), 0);
             return;
@@ -337,6 +462,17 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
         case Type::LENGTH_RATIO: {
             EntityBase *a = SK.GetEntity(entityA);
             EntityBase *b = SK.GetEntity(entityB);
+            if((forms & POLY_LENGTHS) && !valAParam.v && valA > LENGTH_EPS) {
+                // la^2 - r^2 lb^2, over 2 r lb^2 with lb as it is now
+                Expr *la2 = DistanceSquared(workplane, a->point[0], a->point[1]);
+                Expr *lb2 = DistanceSquared(workplane, b->point[0], b->point[1]);
+                double lb = lb2->Eval();
+                if(lb > LENGTH_EPS * LENGTH_EPS) {
+                    Expr *eq = la2->Minus(lb2->Times(Expr::From(valA * valA)));
+                    AddEq(l, eq->Times(Expr::From(0.5 / (valA * lb))), 0);
+                    return;
+                }
+            }
             Expr *la = Distance(workplane, a->point[0], a->point[1]);
             Expr *lb = Distance(workplane, b->point[0], b->point[1]);
             AddEq(l, (la->Div(lb))->Minus(exA), 0);
@@ -621,19 +757,28 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
         case Type::POINTS_COINCIDENT: {
             EntityBase *a = SK.GetEntity(ptA);
             EntityBase *b = SK.GetEntity(ptB);
+            hParam pa[3], pb[3];
+            bool closed = PointParamsIn(workplane, ptA, pa) > 0 &&
+                          PointParamsIn(workplane, ptB, pb) > 0;
+            EquationKernel k[3] = {};
+            for(int i = 0; i < 3 && closed; i++) {
+                k[i].type     = EquationKernel::Type::DIFFERENCE;
+                k[i].param[0] = pa[i];
+                k[i].param[1] = pb[i];
+            }
             if(workplane == EntityBase::FREE_IN_3D) {
                 ExprVector pa = a->PointGetExprs();
                 ExprVector pb = b->PointGetExprs();
-                AddEq(l, pa.x->Minus(pb.x), 0);
-                AddEq(l, pa.y->Minus(pb.y), 1);
-                AddEq(l, pa.z->Minus(pb.z), 2);
+                AddEq(l, pa.x->Minus(pb.x), 0, k[0]);
+                AddEq(l, pa.y->Minus(pb.y), 1, k[1]);
+                AddEq(l, pa.z->Minus(pb.z), 2, k[2]);
             } else {
                 Expr *au, *av;
                 Expr *bu, *bv;
                 a->PointGetExprsInWorkplane(workplane, &au, &av);
                 b->PointGetExprsInWorkplane(workplane, &bu, &bv);
-                AddEq(l, au->Minus(bu), 0);
-                AddEq(l, av->Minus(bv), 1);
+                AddEq(l, au->Minus(bu), 0, k[0]);
+                AddEq(l, av->Minus(bv), 1, k[1]);
             }
             return;
         }
@@ -667,7 +812,25 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
             ExprVector ptOnLine = ea.Plus(eb.Minus(ea).ScaledBy(Expr::From(valP)));
             ExprVector eq = ptOnLine.Minus(ep);
 
-            AddEq(l, eq);
+            hParam pp[3], pa[3], pb[3];
+            if(PointParamsIn(workplane, ptA, pp) > 0 &&
+               PointParamsIn(workplane, ln->point[0], pa) > 0 &&
+               PointParamsIn(workplane, ln->point[1], pb) > 0)
+            {
+                Expr *c[3] = { eq.x, eq.y, eq.z };
+                int n = (workplane == EntityBase::FREE_IN_3D) ? 3 : 2;
+                for(int i = 0; i < n; i++) {
+                    EquationKernel k = {};
+                    k.type     = EquationKernel::Type::LERP;
+                    k.param[0] = pa[i];
+                    k.param[1] = pb[i];
+                    k.param[2] = valP;
+                    k.param[3] = pp[i];
+                    AddEq(l, c[i], i, k);
+                }
+            } else {
+                AddEq(l, eq);
+            }
             return;
         }
 
@@ -685,6 +848,12 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
 
             Expr *r = circle->CircleGetRadiusExpr();
 
+            double r0 = r->Eval();
+            if((forms & POLY_DISTANCE) && r0 > LENGTH_EPS) {
+                Expr *d2 = du->Square()->Plus(dv->Square());
+                AddEq(l, (d2->Minus(r->Square()))->Times(Expr::From(0.5 / r0)), 0);
+                return;
+            }
             AddEq(l, du->Square()->Plus(dv->Square())->Sqrt()->Minus(r), 0);
             return;
         }
@@ -855,7 +1024,15 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
             a->PointGetExprsInWorkplane(workplane, &au, &av);
             b->PointGetExprsInWorkplane(workplane, &bu, &bv);
 
-            AddEq(l, (type == Type::HORIZONTAL) ? av->Minus(bv) : au->Minus(bu), 0);
+            EquationKernel k = {};
+            hParam pa[2], pb[2];
+            if(PointParamsIn(workplane, ha, pa) > 0 && PointParamsIn(workplane, hb, pb) > 0) {
+                int i = (type == Type::HORIZONTAL) ? 1 : 0;
+                k.type     = EquationKernel::Type::DIFFERENCE;
+                k.param[0] = pa[i];
+                k.param[1] = pb[i];
+            }
+            AddEq(l, (type == Type::HORIZONTAL) ? av->Minus(bv) : au->Minus(bu), 0, k);
             return;
         }
 
@@ -892,8 +1069,43 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
             ExprVector ae = a->VectorGetExprs();
             ExprVector be = b->VectorGetExprs();
             if(other) ae = ae.ScaledBy(Expr::From(-1));
-            Expr *c = DirectionCosine(workplane, ae, be);
 
+            if((forms & POLY_ANGLE) && type == Type::PERPENDICULAR) {
+                // The dot product, over the lengths as they are now
+                double mags;
+                Expr *dot = DirectionDot(workplane, ae, be, &mags);
+                if(mags > LENGTH_EPS * LENGTH_EPS) {
+                    AddEq(l, dot->Times(Expr::From(1 / mags)), 0);
+                    return;
+                }
+            }
+            if((forms & POLY_ANGLE) && type == Type::ANGLE &&
+               workplane != EntityBase::FREE_IN_3D) {
+                // With the angle between them phi, dot = |a||b| cos phi and
+                // cross = |a||b| sin phi, so dot sin t - cross cos t is
+                // |a||b| sin(t - phi); it's zero at phi = t, and well
+                // conditioned there even for small angles. The angle is
+                // taken to the side that b is on now. It's zero at
+                // phi = t + 180 too, so it's only written this way while b
+                // is within a right angle of where it's going.
+                double mags;
+                Expr *dot = DirectionDot(workplane, ae, be, &mags);
+                EntityBase *w = SK.GetEntity(workplane);
+                ExprVector u = w->Normal()->NormalExprsU();
+                ExprVector v = w->Normal()->NormalExprsV();
+                Expr *cross = (u.Dot(ae)->Times(v.Dot(be)))->Minus(v.Dot(ae)->Times(u.Dot(be)));
+                double side = (cross->Eval() < 0) ? -1 : 1;
+                double t = exA->Eval() * side * PI/180;
+                if(mags > LENGTH_EPS * LENGTH_EPS &&
+                   dot->Eval() * cos(t) + cross->Eval() * sin(t) > 0) {
+                    Expr *rads = exA->Times(Expr::From(side * PI/180));
+                    Expr *eq = (dot->Times(rads->Sin()))->Minus(cross->Times(rads->Cos()));
+                    AddEq(l, eq->Times(Expr::From(1 / mags)), 0);
+                    return;
+                }
+            }
+
+            Expr *c = DirectionCosine(workplane, ae, be);
             if(type == Type::ANGLE) {
                 // The direction cosine is equal to the cosine of the
                 // specified angle
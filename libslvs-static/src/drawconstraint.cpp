@@ -572,6 +572,20 @@ void Constraint::DoLayout(DrawAs how, Canvas *canvas,
             return;
         }
 
+        case Type::GEAR_MESH: {
+            // Dimension the centre distance; the label shows the module.
+            Entity *ea = SK.GetEntity(entityA), *eb = SK.GetEntity(entityB);
+            Vector ap = SK.GetEntity(ea->point[0])->PointGetDrawNum();
+            Vector bp = SK.GetEntity(eb->point[0])->PointGetDrawNum();
+
+            Vector ref = ((ap.Plus(bp)).ScaledBy(0.5)).Plus(disp.offset);
+            if(refs) refs->push_back(ref);
+
+            DoLineWithArrows(canvas, hcs, ref, ap, bp, /*onlyOneExt=*/false);
+            DoLabel(canvas, hcs, ref, labelPos, gr, gu);
+            return;
+        }
+
         case Type::PROJ_PT_DISTANCE: {
             Vector ap = SK.GetEntity(ptA)->PointGetNum(),
                    bp = SK.GetEntity(ptB)->PointGetNum(),
@@ -1367,6 +1381,7 @@ bool Constraint::HasLabel() const {
         case Type::ARC_ARC_DIFFERENCE:
         case Type::ARC_LINE_DIFFERENCE:
         case Type::DIAMETER:
+        case Type::GEAR_MESH:
         case Type::ANGLE:
             return true;
 
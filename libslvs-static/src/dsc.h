@@ -270,12 +270,12 @@ public:
     void ReserveMore(int howMuch) {
         if(n + howMuch > elemsAllocated) {
             elemsAllocated = n + howMuch;
-            T *newElem = (T *)::operator new[]((size_t)elemsAllocated*sizeof(T));
+            T *newElem = (T *)Platform::AllocHeap((size_t)elemsAllocated*sizeof(T));
             for(int i = 0; i < n; i++) {
                 new(&newElem[i]) T(std::move(elem[i]));
                 elem[i].~T();
             }
-            ::operator delete[](elem);
+            Platform::FreeHeap(elem);
             elem = newElem;
         }
     }
@@ -341,7 +341,7 @@ public:
     void Clear() {
         for(int i = 0; i < n; i++)
             elem[i].~T();
-        if(elem) ::operator delete[](elem);
+        if(elem) Platform::FreeHeap(elem);
         elem = NULL;
         n = elemsAllocated = 0;
     }
@@ -406,12 +406,52 @@ private:
 
 // A list, where each element has an integer identifier. The list is kept
 // sorted by that identifier, and items can be looked up in log n time by
-// id.
+// id; or in constant time, while the identifiers are dense enough to index
+// an array by.
 template <class T, class H>
 class IdList {
-    std::vector<T> elemstore;
-    std::vector<int> elemidx;
-    std::vector<int> freelist;
+    std::vector<T, Platform::HeapAllocator<T>> elemstore;
+    std::vector<int, Platform::HeapAllocator<int>> elemidx;
+    std::vector<int, Platform::HeapAllocator<int>> freelist;
+    // The position in elemstore of the element with each handle value, counted
+    // from the first handle added, or -1. This is given up for good (until the
+    // next Clear) as soon as a handle is below the first one, or too far past
+    // the others for the array to stay small.
+    std::vector<int, Platform::HeapAllocator<int>> handleidx;
+    uint32_t handlebase = 0;
+    bool dense = true;
+    // Set by AddUnordered, until SortById puts elemidx back in order.
+    bool unordered = false;
+
+    static const uint32_t DENSE_SLACK = 1024;
+
+    void IndexHandle(uint32_t v, int store) {
+        if(!dense) return;
+        if(handleidx.empty()) handlebase = v;
+        if(v < handlebase || v - handlebase >= 2 * (uint32_t)n + DENSE_SLACK) {
+            dense = false;
+            handleidx.clear();
+            return;
+        }
+        uint32_t i = v - handlebase;
+        if(i >= handleidx.size()) {
+            handleidx.resize((size_t)i + 1, -1);
+        }
+        handleidx[i] = store;
+    }
+
+    int StoreElement(const T *t) {
+        if(freelist.empty()) {
+            elemstore.push_back(*t);
+            return (int)elemstore.size() - 1;
+        }
+        // Use the last element from the freelist
+        int store = freelist.back();
+        freelist.pop_back();
+        elemstore[store] = T(*t);
+        return store;
+    }
+
 public:
     int n = 0;  // PAR@@@@@ make this private to see all interesting and suspicious places in SoveSpace ;-)
 
@@ -482,11 +522,13 @@ public:
     }
 
     H AddAndAssignId(T *t) {
+        ssassert(!unordered, "List must be sorted before assigning ids");
         t->h.v = (MaximumId() + 1);
 
         // Add at the end of the list.
         elemstore.push_back(*t);
         elemidx.push_back(elemstore.size()-1);
+        IndexHandle(t->h.v, elemidx.back());
         ++n;
 
         return t->h;
@@ -502,33 +544,50 @@ public:
         // Look to see if we already have something with the same handle value.
         ssassert(FindByIdNoOops(t->h) == nullptr, "Handle isn't unique");
 
-        // Find out where the added element should be.
-        auto pos = std::lower_bound(elemidx.begin(), elemidx.end(), *t, Compare(this));
+        int store = StoreElement(t);
+        IndexHandle(t->h.v, store);
+        // Insert an index to the element at the correct position; usually
+        // that's the end, since handles tend to be added in order.
+        if(elemidx.empty() || elemstore[elemidx.back()].h.v < t->h.v) {
+            elemidx.push_back(store);
+        } else {
+            auto pos = std::lower_bound(elemidx.begin(), elemidx.end(), *t, Compare(this));
+            elemidx.insert(pos, store);
+        }
 
-        if(freelist.empty()) { // Add a new element to the store
-            elemstore.push_back(*t);
-            // Insert a pointer to the element at the correct position
-            if(elemidx.empty()) {
-                // The list is empty so pos, begin and end are all null.
-                // insert does not work in this case.
-                elemidx.push_back(elemstore.size()-1);
-            } else {
-                elemidx.insert(pos, elemstore.size() - 1);
-            }
-        } else { // Use the last element from the freelist
-            // Insert an index to the element at the correct position
-            elemidx.insert(pos, freelist.back());
-            // Remove the element from the freelist
-            freelist.pop_back();
-
-            // Copy-construct to the element storage.
-            elemstore[*pos] = T(*t);
-            //            *elemptr[pos] = *t;   // PAR@@@@@@ maybe this?
+        ++n;
+    }
+
+    // Add without keeping the list sorted, for loading many elements at once
+    // without an insertion each; SortById must be called before the list is
+    // iterated or searched again.
+    void AddUnordered(T *t) {
+        if(dense) {
+            ssassert(FindByIdNoOops(t->h) == nullptr, "Handle isn't unique");
+        }
+
+        int store = StoreElement(t);
+        IndexHandle(t->h.v, store);
+        if(!elemidx.empty() && elemstore[elemidx.back()].h.v >= t->h.v) {
+            unordered = true;
         }
+        elemidx.push_back(store);
 
         ++n;
     }
 
+    void SortById() {
+        if(!unordered) return;
+        std::sort(elemidx.begin(), elemidx.end(), [this](int a, int b) {
+            return elemstore[a].h.v < elemstore[b].h.v;
+        });
+        for(size_t i = 1; i < elemidx.size(); i++) {
+            ssassert(elemstore[elemidx[i - 1]].h.v != elemstore[elemidx[i]].h.v,
+                     "Handle isn't unique");
+        }
+        unordered = false;
+    }
+
     T *FindById(H h) {
         T *t = FindByIdNoOops(h);
         ssassert(t != nullptr, "Cannot find handle");
@@ -539,6 +598,14 @@ public:
         if(IsEmpty()) {
             return nullptr;
         }
+        if(dense) {
+            uint32_t i = h.v - handlebase;
+            if(h.v < handlebase || i >= handleidx.size() || handleidx[i] < 0) {
+                return nullptr;
+            }
+            return &elemstore[handleidx[i]];
+        }
+        ssassert(!unordered, "List must be sorted before searching it");
         auto it = std::lower_bound(elemidx.begin(), elemidx.end(), h, Compare(this));
         if(it == elemidx.end()) {
             return nullptr;
@@ -550,6 +617,16 @@ public:
         }
     }
 
+    // Where the element with handle h sits in storage, or -1. That stays the
+    // same until the element is removed, though the storage moves as the
+    // list grows. A removed element's place holds it until it's reused.
+    int StoreIndex(H h) {
+        T *t = FindByIdNoOops(h);
+        return t ? (int)(t - elemstore.data()) : -1;
+    }
+    int StoreSize() const { return (int)elemstore.size(); }
+    T &AtStore(int i) { return elemstore[i]; }
+
     T &Get(size_t i) { return elemstore[elemidx[i]]; }
     T &operator[](size_t i) { return Get(i); }
 
@@ -573,6 +650,7 @@ public:
         for(src = 0; src < n; src++) {
             if(elemstore[elemidx[src]].tag) {
                 // this item should be deleted
+                if(dense) handleidx[elemstore[elemidx[src]].h.v - handlebase] = -1;
                 elemstore[elemidx[src]].Clear();
 //                elemstore[elemidx[src]].~T(); // Clear below calls the destructors
                 freelist.push_back(elemidx[src]);
@@ -598,6 +676,10 @@ public:
         std::swap(l->elemstore, elemstore);
         std::swap(l->elemidx, elemidx);
         std::swap(l->freelist, freelist);
+        std::swap(l->handleidx, handleidx);
+        std::swap(l->handlebase, handlebase);
+        std::swap(l->dense, dense);
+        std::swap(l->unordered, unordered);
         std::swap(l->n, n);
     }
 
@@ -612,6 +694,10 @@ public:
             l->elemidx.push_back(it);
         }
 
+        l->handleidx  = handleidx;
+        l->handlebase = handlebase;
+        l->dense      = dense;
+        l->unordered  = unordered;
         l->n = n;
     }
 
@@ -623,24 +709,40 @@ public:
         freelist.clear();
         elemidx.clear();
         elemstore.clear();
+        handleidx.clear();
+        handlebase = 0;
+        dense      = true;
+        unordered  = false;
         n = 0;
     }
 
 };
 
+// A mostly banded matrix of any size, storing only the band and the last two
+// columns of each row, so that it takes O(n) memory and O(n) time to solve.
 class BandedMatrix {
 public:
     enum {
-        MAX_UNKNOWNS   = 16,
         RIGHT_OF_DIAG  = 1,
-        LEFT_OF_DIAG   = 2
+        LEFT_OF_DIAG   = 2,
+        BAND_WIDTH     = LEFT_OF_DIAG + RIGHT_OF_DIAG + 1
     };
 
-    double A[MAX_UNKNOWNS][MAX_UNKNOWNS];
-    double B[MAX_UNKNOWNS];
-    double X[MAX_UNKNOWNS];
+    // Row i of the band starts at i*BAND_WIDTH, with the diagonal element
+    // LEFT_OF_DIAG along; row i of the last two columns at 2*i.
+    std::vector<double> band;
+    std::vector<double> last;
+    std::vector<double> B;
+    std::vector<double> X;
     int n;
 
+    void Resize(int n);
+    double &A(int i, int j) {
+        if(j >= n - 2) return last[2*i + (j - (n - 2))];
+        ssassert(j >= i - LEFT_OF_DIAG && j <= i + RIGHT_OF_DIAG,
+                 "Element outside the band");
+        return band[i*BAND_WIDTH + (j - i + LEFT_OF_DIAG)];
+    }
     void Solve();
 };
 
@@ -410,22 +410,24 @@ void SolveSpaceUI::ExportLinesAndMesh(SEdgeList *sel, SBezierList *sbl, SMesh *s
                                        GW.showOutlines ? Style::OUTLINE : Style::SOLID_EDGE);
         }
 
-        root->ClearTags();
-        int cnt = 1234;
-
-        SEdge *se;
-        for(se = sel->l.First(); se; se = sel->l.NextAfter(se)) {
+        // Each edge is tested on its own against the shared tree, so they
+        // can all be done at once; the pieces are gathered up in order
+        // afterwards.
+        std::vector<SEdgeList> pieces(sel->l.n);
+#pragma omp parallel for schedule(dynamic, 16)
+        for(int i = 0; i < sel->l.n; i++) {
+            const SEdge *se = &sel->l[i];
+            SEdgeList &edges = pieces[i];
             if(se->auxA == Style::CONSTRAINT) {
                 // Constraints should not get hidden line removed; they're
                 // always on top.
-                hlrd.AddEdge(se->a, se->b, se->auxA);
+                edges.AddEdge(se->a, se->b, se->auxA);
                 continue;
             }
 
-            SEdgeList edges = {};
             // Split the original edge against the mesh
             edges.AddEdge(se->a, se->b, se->auxA);
-            root->OcclusionTestLine(*se, &edges, cnt);
+            root->OcclusionTestLine(*se, &edges);
             if(SS.GW.drawOccludedAs == GraphicsWindow::DrawOccludedAs::STIPPLED) {
                 for(SEdge &se : edges.l) {
                     if(se.tag == 1) {
@@ -438,11 +440,12 @@ void SolveSpaceUI::ExportLinesAndMesh(SEdgeList *sel, SBezierList *sbl, SMesh *s
 
             // the occlusion test splits unnecessarily; so fix those
             edges.MergeCollinearSegments(se->a, se->b);
-            cnt++;
-            // And add the results to our output
-            SEdge *sen;
-            for(sen = edges.l.First(); sen; sen = edges.l.NextAfter(sen)) {
-                hlrd.AddEdge(sen->a, sen->b, sen->auxA);
+        }
+
+        // And add the results to our output
+        for(SEdgeList &edges : pieces) {
+            for(const SEdge &sen : edges.l) {
+                hlrd.AddEdge(sen.a, sen.b, sen.auxA);
             }
             edges.Clear();
         }
@@ -756,14 +759,12 @@ void VectorFileWriter::OutputLinesAndMesh(SBezierLoopSetSet *sblss, SMesh *sm) {
 }
 
 void VectorFileWriter::BezierAsPwl(SBezier *sb) {
-    List<Vector> lv = {};
-    sb->MakePwlInto(&lv, SS.ExportChordTolMm());
+    const std::vector<Vector> &lv = sb->PwlPoints(SS.ExportChordTolMm());
 
-    for(int i = 1; i < lv.n; i++) {
+    for(size_t i = 1; i < lv.size(); i++) {
         SBezier sb = SBezier::From(lv[i-1], lv[i]);
         Bezier(&sb);
     }
-    lv.Clear();
 }
 
 void VectorFileWriter::BezierAsNonrationalCubic(SBezier *sb, int depth) {
@@ -825,6 +826,14 @@ void SolveSpaceUI::ExportMeshTo(const Platform::Path &filename) {
         return;
     }
     ShowNakedEdges(/*reportOnlyWhenNotOkay=*/true);
+
+    // A lighter mesh for a preview, if the export settings ask for one
+    SMesh simplified = {};
+    if(exportMaxTriangles > 0 && m->l.n > exportMaxTriangles) {
+        simplified.MakeFromSimplificationOf(m, exportMaxTriangles, 0.0);
+        m = &simplified;
+    }
+
     if(filename.HasExtension("stl")) {
         ExportMeshAsStlTo(f, m);
     } else if(filename.HasExtension("obj")) {
@@ -851,6 +860,7 @@ void SolveSpaceUI::ExportMeshTo(const Platform::Path &filename) {
     }
 
     fclose(f);
+    simplified.Clear();
 
     SS.justExportedInfo.showOrigin = false;
     SS.justExportedInfo.draw = true;
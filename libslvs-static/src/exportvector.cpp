@@ -363,17 +363,13 @@ public:
     }
 
     void writeBezierAsPwl(SBezier *sb) {
-        List<Vector> lv = {};
-        sb->MakePwlInto(&lv, SS.ExportChordTolMm());
         hStyle hs = { (uint32_t)sb->auxA };
         DRW_Polyline polyline;
         assignEntityDefaults(&polyline, hs);
-        for(int i = 0; i < lv.n; i++) {
-            Vector *v = &lv[i];
-            polyline.vertlist.push_back(std::make_shared<DRW_Vertex>(v->x, v->y, v->z, 0.0));
+        for(const Vector &v : sb->PwlPoints(SS.ExportChordTolMm())) {
+            polyline.vertlist.push_back(std::make_shared<DRW_Vertex>(v.x, v.y, v.z, 0.0));
         }
         dxf->writePolyline(&polyline);
-        lv.Clear();
     }
 
     void makeKnotsFor(DRW_Spline *spline) {
@@ -212,6 +212,8 @@ Expr *ExprQuaternion::Magnitude() const {
 }
 
 
+thread_local size_t Expr::allocatedOnThread = 0;
+
 Expr *Expr::From(hParam p) {
     Expr *r = AllocExpr();
     r->op = Op::PARAM;
@@ -520,19 +522,47 @@ Expr *Expr::FoldConstants(bool allocCopy, size_t depth) {
     return n;
 }
 
-void Expr::Substitute(const SubstitutionMap &subMap) {
+void Expr::Substitute(ParamList *pl, const std::vector<Substitution> &subs) {
     ssassert(op != Op::PARAM_PTR, "Expected an expression that refer to params via handles");
 
     if(op == Op::PARAM) {
-        auto it = subMap.find(parh);
-        if(it != subMap.end()) {
-            parh = it->second->h;
+        int i = pl->StoreIndex(parh);
+        if(i < 0 || subs[i].by == NULL) return;
+
+        const Substitution &s = subs[i];
+        if(s.IsIdentity()) {
+            parh = s.by->h;
+            return;
+        }
+        Expr *r = From(s.by->h);
+        if(s.k == -1.0) {
+            r = r->Negate();
+        } else if(s.k != 1.0) {
+            r = From(s.k)->Times(r);
         }
+        if(s.c != 0.0) r = r->Plus(From(s.c));
+        *this = *r;
     } else {
         int c = Children();
         if(c >= 1) {
-            a->Substitute(subMap);
-            if(c >= 2) b->Substitute(subMap);
+            a->Substitute(pl, subs);
+            if(c >= 2) b->Substitute(pl, subs);
+        }
+    }
+}
+
+void Expr::Substitute(ParamList *pl, const std::vector<Expr *> &by) {
+    ssassert(op != Op::PARAM_PTR, "Expected an expression that refer to params via handles");
+
+    if(op == Op::PARAM) {
+        int i = pl->StoreIndex(parh);
+        if(i < 0 || by[i] == NULL) return;
+        *this = *by[i];
+    } else {
+        int c = Children();
+        if(c >= 1) {
+            a->Substitute(pl, by);
+            if(c >= 2) b->Substitute(pl, by);
         }
     }
 }
@@ -576,6 +606,622 @@ hParam Expr::ReferencedParams(ParamList *pl) const {
 }
 
 
+//-----------------------------------------------------------------------------
+// Build expressions out of shared (hash-consed) nodes, folding each one as
+// it's built; this gives the same expressions as building them node by node
+// and then calling FoldConstants, but each distinct one only once.
+//-----------------------------------------------------------------------------
+size_t ExprFactory::KeyHasher::operator()(const Key &k) const {
+    size_t h = std::hash<uint64_t>()(k.b);
+    h ^= std::hash<uint32_t>()((uint32_t)k.op) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<const Expr *>()(k.a) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+Expr *ExprFactory::Intern(const Key &k, const Expr &e) {
+    auto it = nodes.find(k);
+    if(it != nodes.end()) return it->second;
+
+    Expr *n = Expr::AllocExpr();
+    *n = e;
+    nodes.emplace(k, n);
+    return n;
+}
+
+Expr *ExprFactory::Constant(double v) {
+    Key k = { Expr::Op::CONSTANT, NULL, 0 };
+    memcpy(&k.b, &v, sizeof(k.b));
+    return Intern(k, Expr(v));
+}
+
+Expr *ExprFactory::ParamPtr(Param *p) {
+    Key k = { Expr::Op::PARAM_PTR, NULL, (uint64_t)(uintptr_t)p };
+    Expr e;
+    e.op   = Expr::Op::PARAM_PTR;
+    e.a    = NULL;
+    e.parp = p;
+    return Intern(k, e);
+}
+
+Expr *ExprFactory::Op(Expr::Op op, Expr *a, Expr *b) {
+    Expr e;
+    e.op = op;
+    e.a  = a;
+    e.b  = b;
+
+    // The same rules, in the same order, as FoldConstants.
+    if(e.Children() == 2) {
+        bool ca = a->op == Expr::Op::CONSTANT,
+             cb = b->op == Expr::Op::CONSTANT;
+        if(ca && cb) return Constant(e.Eval());
+        if(op == Expr::Op::PLUS) {
+            if(cb && Expr::Tol(b->v, 0)) return a;
+            if(ca && Expr::Tol(a->v, 0)) return b;
+        }
+        if(op == Expr::Op::TIMES) {
+            if(cb && Expr::Tol(b->v, 1)) return a;
+            if(ca && Expr::Tol(a->v, 1)) return b;
+            if(cb && Expr::Tol(b->v, 0)) return Constant(0);
+            if(ca && Expr::Tol(a->v, 0)) return Constant(0);
+        }
+    } else if(a->op == Expr::Op::CONSTANT) {
+        return Constant(e.Eval());
+    }
+
+    Key k = { op, a, (uint64_t)(uintptr_t)b };
+    return Intern(k, e);
+}
+
+Expr *ExprFactory::CopyWithParamsAsPointers(const Expr *e, ParamList *firstTry,
+                                            ParamList *thenTry) {
+    auto it = copied.find(e);
+    if(it != copied.end()) return it->second;
+
+    Expr *n;
+    switch(e->op) {
+        case Expr::Op::PARAM: {
+            Param *p = firstTry->FindByIdNoOops(e->parh);
+            if(!p) p = thenTry->FindById(e->parh);
+            n = p->known ? Constant(p->val) : ParamPtr(p);
+            break;
+        }
+        case Expr::Op::PARAM_PTR:   n = ParamPtr(e->parp); break;
+        case Expr::Op::CONSTANT:    n = Constant(e->v); break;
+        case Expr::Op::VARIABLE:    ssassert(false, "Not supported yet");
+
+        default: {
+            Expr *a = CopyWithParamsAsPointers(e->a, firstTry, thenTry);
+            Expr *b = (e->Children() > 1)
+                    ? CopyWithParamsAsPointers(e->b, firstTry, thenTry) : NULL;
+            n = Op(e->op, a, b);
+            break;
+        }
+    }
+    copied.emplace(e, n);
+    return n;
+}
+
+const std::vector<hParam> &ExprFactory::ParamsUsed(const Expr *e) {
+    auto it = used.find(e);
+    if(it != used.end()) return it->second;
+
+    std::vector<hParam> r;
+    if(e->op == Expr::Op::PARAM_PTR) {
+        r.push_back(e->parp->h);
+    } else if(e->op == Expr::Op::PARAM) {
+        r.push_back(e->parh);
+    } else {
+        int c = e->Children();
+        if(c >= 1) r = ParamsUsed(e->a);
+        if(c >= 2) {
+            const std::vector<hParam> &b = ParamsUsed(e->b);
+            std::vector<hParam> both;
+            std::set_union(r.begin(), r.end(), b.begin(), b.end(), std::back_inserter(both),
+                           [](hParam x, hParam y) { return x.v < y.v; });
+            r = std::move(both);
+        }
+    }
+    // (the map's nodes don't move as it grows, so this stays good)
+    return used.emplace(e, std::move(r)).first->second;
+}
+
+Expr *ExprFactory::PartialWrt(Expr *e, hParam p) {
+    Key k = { e->op, e, p.v };
+    auto it = partials.find(k);
+    if(it != partials.end()) return it->second;
+
+    typedef Expr::Op O;
+    Expr *a = e->a, *b = e->b, *r;
+    const std::vector<hParam> &u = ParamsUsed(e);
+    if(!std::binary_search(u.begin(), u.end(), p,
+                           [](hParam x, hParam y) { return x.v < y.v; })) {
+        // Nothing below depends on p, so there's no need to go looking.
+        r = Constant(0.0);
+        partials.emplace(k, r);
+        return r;
+    }
+    switch(e->op) {
+        case O::PARAM_PTR:  r = Constant(p == e->parp->h ? 1 : 0); break;
+        case O::PARAM:      r = Constant(p == e->parh ? 1 : 0); break;
+
+        case O::CONSTANT:   r = Constant(0.0); break;
+        case O::VARIABLE:   ssassert(false, "Not supported yet");
+
+        case O::PLUS:       r = Op(O::PLUS,  PartialWrt(a, p), PartialWrt(b, p)); break;
+        case O::MINUS:      r = Op(O::MINUS, PartialWrt(a, p), PartialWrt(b, p)); break;
+
+        case O::TIMES: {
+            Expr *da = PartialWrt(a, p), *db = PartialWrt(b, p);
+            r = Op(O::PLUS, Op(O::TIMES, a, db), Op(O::TIMES, b, da));
+            break;
+        }
+        case O::DIV: {
+            Expr *da = PartialWrt(a, p), *db = PartialWrt(b, p);
+            r = Op(O::DIV, Op(O::MINUS, Op(O::TIMES, da, b), Op(O::TIMES, a, db)),
+                           Op(O::SQUARE, b));
+            break;
+        }
+
+        case O::SQRT:
+            r = Op(O::TIMES, Op(O::DIV, Constant(0.5), Op(O::SQRT, a)), PartialWrt(a, p));
+            break;
+
+        case O::SQUARE:
+            r = Op(O::TIMES, Op(O::TIMES, Constant(2.0), a), PartialWrt(a, p));
+            break;
+
+        case O::NEGATE:     r = Op(O::NEGATE, PartialWrt(a, p)); break;
+        case O::SIN:        r = Op(O::TIMES, Op(O::COS, a), PartialWrt(a, p)); break;
+        case O::COS:
+            r = Op(O::NEGATE, Op(O::TIMES, Op(O::SIN, a), PartialWrt(a, p)));
+            break;
+
+        case O::ASIN:
+            r = Op(O::TIMES, Op(O::DIV, Constant(1),
+                                Op(O::SQRT, Op(O::MINUS, Constant(1), Op(O::SQUARE, a)))),
+                   PartialWrt(a, p));
+            break;
+        case O::ACOS:
+            r = Op(O::TIMES, Op(O::DIV, Constant(-1),
+                                Op(O::SQRT, Op(O::MINUS, Constant(1), Op(O::SQUARE, a)))),
+                   PartialWrt(a, p));
+            break;
+
+        default: ssassert(false, "Unexpected operation");
+    }
+    partials.emplace(k, r);
+    return r;
+}
+
+//-----------------------------------------------------------------------------
+// Lower a set of expressions to a flat tape, so that they can be evaluated
+// many times (once per Newton iteration) without walking the trees.
+//-----------------------------------------------------------------------------
+void ExprTape::Clear() {
+    code.clear();
+    params.clear();
+    reg.clear();
+    isConstant.clear();
+    // Clearing a hash map costs time in its bucket count, not its size, and
+    // we're often cleared right after compiling something much bigger.
+    compiled = {};
+    unique = {};
+}
+
+void ExprTape::Forget() {
+    compiled.clear();
+    unique.clear();
+}
+
+size_t ExprTape::KeyHasher::operator()(const Key &k) const {
+    size_t h = std::hash<uint64_t>()(k.bits);
+    h ^= std::hash<uint32_t>()((uint32_t)k.op) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<int>()(k.a) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<int>()(k.b) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+int ExprTape::Intern(const Key &k, double constValue) {
+    auto it = unique.find(k);
+    if(it != unique.end()) return it->second;
+
+    int r = (int)reg.size();
+    reg.push_back(constValue);
+    isConstant.push_back(true);
+    unique.emplace(k, r);
+    return r;
+}
+
+Param *ExprTape::ParamOf(const Instr &in) const {
+    const Input &i = InputOf(in);
+    return (in.op == Expr::Op::PARAM_PTR) ? i.parp : SK.GetParam(i.parh);
+}
+
+int ExprTape::Emit(const Key &k, const Instr &in) {
+    auto it = unique.find(k);
+    if(it != unique.end()) return it->second;
+
+    Instr n = in;
+    n.dst = (int)reg.size();
+    reg.push_back(0.0);
+    isConstant.push_back(false);
+    code.push_back(n);
+    unique.emplace(k, n.dst);
+    return n.dst;
+}
+
+int ExprTape::Compile(const Expr *e) {
+    // The trees are DAGs in general (PartialWrt() reuses the subtrees of
+    // the expression it differentiates), so remember what we've already
+    // lowered by pointer before looking at the structure.
+    auto it = compiled.find(e);
+    if(it != compiled.end()) return it->second;
+
+    Key k = {};
+    k.op = e->op;
+    k.a  = -1;
+    k.b  = -1;
+    Instr in = {};
+    in.op = e->op;
+    in.a  = -1;
+    in.b  = -1;
+
+    int r;
+    switch(e->op) {
+        case Expr::Op::CONSTANT:
+            memcpy(&k.bits, &e->v, sizeof(k.bits));
+            r = Intern(k, e->v);
+            break;
+
+        case Expr::Op::PARAM:
+        case Expr::Op::PARAM_PTR: {
+            Input i = {};
+            if(e->op == Expr::Op::PARAM) {
+                k.bits = e->parh.v;
+                i.parh = e->parh;
+            } else {
+                k.bits = (uint64_t)(uintptr_t)e->parp;
+                i.parp = e->parp;
+            }
+            in.b = -2 - (int)params.size();
+            size_t n = code.size();
+            r = Emit(k, in);
+            if(code.size() > n) params.push_back(i);
+            break;
+        }
+
+        case Expr::Op::VARIABLE:
+            ssassert(false, "Not supported yet");
+
+        default: {
+            int c = e->Children();
+            k.a = Compile(e->a);
+            if(c > 1) k.b = Compile(e->b);
+
+            if(isConstant[k.a] && (c < 2 || isConstant[k.b])) {
+                // Everything below is known, so evaluate it right now.
+                Expr ca(reg[k.a]), cb(c > 1 ? reg[k.b] : 0.0);
+                Expr n = *e;
+                n.a = &ca;
+                if(c > 1) n.b = &cb;
+                double v = n.Eval();
+
+                Key ck = {};
+                ck.op = Expr::Op::CONSTANT;
+                ck.a  = -1;
+                ck.b  = -1;
+                memcpy(&ck.bits, &v, sizeof(ck.bits));
+                r = Intern(ck, v);
+                break;
+            }
+
+            if((e->op == Expr::Op::PLUS || e->op == Expr::Op::TIMES) && k.a > k.b) {
+                // Commutative, so canonicalize the operand order.
+                std::swap(k.a, k.b);
+            }
+            in.a = k.a;
+            in.b = k.b;
+            r = Emit(k, in);
+            break;
+        }
+    }
+    compiled.emplace(e, r);
+    return r;
+}
+
+inline void ExprTape::Run(const Instr &c, double *r) const {
+    double v;
+    switch(c.op) {
+        case Expr::Op::PARAM:       v = SK.GetParam(InputOf(c).parh)->val; break;
+        case Expr::Op::PARAM_PTR:   v = InputOf(c).parp->val; break;
+
+        case Expr::Op::PLUS:        v = r[c.a] + r[c.b]; break;
+        case Expr::Op::MINUS:       v = r[c.a] - r[c.b]; break;
+        case Expr::Op::TIMES:       v = r[c.a] * r[c.b]; break;
+        case Expr::Op::DIV:         v = r[c.a] / r[c.b]; break;
+
+        case Expr::Op::NEGATE:      v = -r[c.a]; break;
+        case Expr::Op::SQRT:        v = sqrt(r[c.a]); break;
+        case Expr::Op::SQUARE:      v = r[c.a] * r[c.a]; break;
+        case Expr::Op::SIN:         v = sin(r[c.a]); break;
+        case Expr::Op::COS:         v = cos(r[c.a]); break;
+        case Expr::Op::ACOS:        v = acos(r[c.a]); break;
+        case Expr::Op::ASIN:        v = asin(r[c.a]); break;
+
+        default: ssassert(false, "Unexpected operation");
+    }
+    r[c.dst] = v;
+}
+
+void ExprTape::Eval(size_t begin, size_t end) {
+    double *r = reg.data();
+    const Instr *in = code.data();
+    for(size_t i = begin; i < end; i++) {
+        Run(in[i], r);
+    }
+}
+
+void ExprTape::EvalEach(const int *instr, size_t count) {
+    double *r = reg.data();
+    const Instr *in = code.data();
+    for(size_t k = 0; k < count; k++) {
+        Run(in[instr[k]], r);
+    }
+}
+
+void ExprTape::Schedule(size_t begin, size_t end, Levels *levels) const {
+    // The level after the one that writes each register; a register written
+    // before begin (or a constant) is ready at level 0.
+    std::vector<int> ready(reg.size(), 0);
+    std::vector<int> level(end - begin);
+    int count = 0;
+    for(size_t i = begin; i < end; i++) {
+        const Instr &c = code[i];
+        int l = 0;
+        if(c.a >= 0) l = std::max(l, ready[c.a]);
+        if(c.b >= 0) l = std::max(l, ready[c.b]);
+        level[i - begin] = l;
+        ready[c.dst]     = l + 1;
+        count = std::max(count, l + 1);
+    }
+
+    // A counting sort by level, which keeps each level in tape order.
+    levels->start.assign(count + 1, 0);
+    for(int l : level) levels->start[l + 1]++;
+    for(int l = 0; l < count; l++) levels->start[l + 1] += levels->start[l];
+    levels->instr.resize(end - begin);
+    std::vector<int> fill(levels->start.begin(), levels->start.end() - 1);
+    for(size_t i = begin; i < end; i++) {
+        levels->instr[fill[level[i - begin]]++] = (int)i;
+    }
+}
+
+void ExprTape::Adjoints(const int *instr, size_t count, int out, double *adjoint) const {
+    const double *r = reg.data();
+    const Instr *in = code.data();
+    for(size_t k = 0; k < count; k++) {
+        const Instr &c = in[instr[k]];
+        adjoint[c.dst] = 0.0;
+        if(c.a >= 0) adjoint[c.a] = 0.0;
+        if(c.b >= 0) adjoint[c.b] = 0.0;
+    }
+    adjoint[out] = 1.0;
+
+    for(size_t k = count; k-- > 0;) {
+        const Instr &c = in[instr[k]];
+        const double g = adjoint[c.dst];
+        switch(c.op) {
+            case Expr::Op::PARAM:
+            case Expr::Op::PARAM_PTR:   break;
+
+            case Expr::Op::PLUS:    adjoint[c.a] += g; adjoint[c.b] += g; break;
+            case Expr::Op::MINUS:   adjoint[c.a] += g; adjoint[c.b] -= g; break;
+            case Expr::Op::TIMES:
+                adjoint[c.a] += g * r[c.b];
+                adjoint[c.b] += g * r[c.a];
+                break;
+            case Expr::Op::DIV:
+                adjoint[c.a] += g / r[c.b];
+                adjoint[c.b] -= g * r[c.dst] / r[c.b];
+                break;
+
+            case Expr::Op::NEGATE:  adjoint[c.a] -= g; break;
+            case Expr::Op::SQRT:    adjoint[c.a] += g * 0.5 / r[c.dst]; break;
+            case Expr::Op::SQUARE:  adjoint[c.a] += g * 2.0 * r[c.a]; break;
+            case Expr::Op::SIN:     adjoint[c.a] += g * cos(r[c.a]); break;
+            case Expr::Op::COS:     adjoint[c.a] -= g * sin(r[c.a]); break;
+            case Expr::Op::ASIN:    adjoint[c.a] += g / sqrt(1 - r[c.a] * r[c.a]); break;
+            case Expr::Op::ACOS:    adjoint[c.a] -= g / sqrt(1 - r[c.a] * r[c.a]); break;
+
+            default: ssassert(false, "Unexpected operation");
+        }
+    }
+}
+
+const int ExprTape::LANES;
+
+void ExprTape::SpreadLanes(std::vector<double> *lanes) const {
+    lanes->resize(reg.size() * LANES);
+    for(size_t r = 0; r < reg.size(); r++) {
+        std::fill_n(lanes->begin() + r * LANES, LANES, reg[r]);
+    }
+}
+
+// The lanes' kernels are built once for the baseline of the target and, on
+// x86 with SLVS_CPU_DISPATCH, again for AVX2, where a loop over the LANES is
+// two vector instructions instead of four. Which of those runs is picked
+// once, the first time lanes run, from what the CPU says it has, so that a
+// portable build still uses the wider registers where there are some.
+// (AVX-512 measured slower than either; a lane's register is a whole cache
+// line, and the tape is bound by its dispatch and its memory traffic, not
+// its arithmetic.)
+// Each instruction is one operation whichever runs, so they give the same
+// answers to the bit.
+#if defined(SLVS_CPU_DISPATCH) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#   include <cpuid.h>
+#   define LANES_DISPATCH
+#   define LANES_KERNEL static inline __attribute__((always_inline))
+#else
+#   define LANES_KERNEL static inline
+#endif
+
+// A register is written by one instruction only, and never read by it, so
+// the destination can't overlap either operand; saying so, through these,
+// is what lets the compiler vectorize the loops over the lanes.
+template<class T, class F>
+LANES_KERNEL void Unary(T *__restrict d, const T *__restrict a, F f) {
+    for(int l = 0; l < ExprTape::LANES; l++) d[l] = f(a[l]);
+}
+template<class T, class F>
+LANES_KERNEL void Binary(T *__restrict d, const T *__restrict a,
+                         const T *__restrict b, F f) {
+    for(int l = 0; l < ExprTape::LANES; l++) d[l] = f(a[l], b[l]);
+}
+
+template<class T>
+LANES_KERNEL void RunLanesKernel(const ExprTape::Instr *in, size_t begin,
+                                 size_t end, T *lanes) {
+    const int LANES = ExprTape::LANES;
+    for(size_t i = begin; i < end; i++) {
+        const ExprTape::Instr &c = in[i];
+        if(c.op == Expr::Op::PARAM || c.op == Expr::Op::PARAM_PTR) continue;
+
+        T       *d = lanes + (size_t)c.dst * LANES;
+        const T *a = lanes + (size_t)c.a * LANES;
+        const T *b = lanes + (size_t)std::max(c.b, 0) * LANES;
+        switch(c.op) {
+            case Expr::Op::PLUS:    Binary(d, a, b, [](T x, T y) { return x + y; }); break;
+            case Expr::Op::MINUS:   Binary(d, a, b, [](T x, T y) { return x - y; }); break;
+            case Expr::Op::TIMES:   Binary(d, a, b, [](T x, T y) { return x * y; }); break;
+            case Expr::Op::DIV:     Binary(d, a, b, [](T x, T y) { return x / y; }); break;
+
+            case Expr::Op::NEGATE:  Unary(d, a, [](T x) { return -x; }); break;
+            case Expr::Op::SQRT:    Unary(d, a, [](T x) { return std::sqrt(x); }); break;
+            case Expr::Op::SQUARE:  Unary(d, a, [](T x) { return x * x; }); break;
+            case Expr::Op::SIN:     Unary(d, a, [](T x) { return std::sin(x); }); break;
+            case Expr::Op::COS:     Unary(d, a, [](T x) { return std::cos(x); }); break;
+            case Expr::Op::ACOS:    Unary(d, a, [](T x) { return std::acos(x); }); break;
+            case Expr::Op::ASIN:    Unary(d, a, [](T x) { return std::asin(x); }); break;
+
+            default: ssassert(false, "Unexpected operation");
+        }
+    }
+}
+
+template<class T>
+LANES_KERNEL void MaxAbsLanesKernel(const int *regs, size_t count,
+                                    const T *lanes, T *maxAbs) {
+    const int LANES = ExprTape::LANES;
+    // v - v is zero unless v is NaN or infinite, when it's NaN, and that
+    // stays in the sum; kept apart from the max, both vectorize.
+    T m[LANES] = {}, bad[LANES] = {};
+    int l;
+    for(size_t i = 0; i < count; i++) {
+        const T *r = lanes + (size_t)regs[i] * LANES;
+        for(l = 0; l < LANES; l++) {
+            T v = std::fabs(r[l]);
+            m[l]    = (v > m[l]) ? v : m[l];
+            bad[l] += v - v;
+        }
+    }
+    for(l = 0; l < LANES; l++) maxAbs[l] = m[l] + bad[l];
+}
+
+namespace {
+template<class T>
+struct LaneKernelsOf {
+    void (*run)(const ExprTape::Instr *in, size_t begin, size_t end, T *lanes);
+    void (*maxAbs)(const int *regs, size_t count, const T *lanes, T *maxAbs);
+};
+struct LaneKernels {
+    LaneKernelsOf<double> dbl;
+    LaneKernelsOf<float>  flt;
+    const char *isa;
+};
+}
+
+#define LANES_VARIANT(name, attr)                                              \
+    template<class T>                                                          \
+    attr static void RunLanes_##name(const ExprTape::Instr *in, size_t begin,  \
+                                     size_t end, T *lanes) {                   \
+        RunLanesKernel(in, begin, end, lanes);                                 \
+    }                                                                          \
+    template<class T>                                                          \
+    attr static void MaxAbsLanes_##name(const int *regs, size_t count,         \
+                                        const T *lanes, T *maxAbs) {           \
+        MaxAbsLanesKernel(regs, count, lanes, maxAbs);                         \
+    }
+
+#define LANES_KERNELS(name)                                                    \
+    LaneKernels { { RunLanes_##name<double>, MaxAbsLanes_##name<double> },     \
+                  { RunLanes_##name<float>,  MaxAbsLanes_##name<float>  },     \
+                  #name }
+
+LANES_VARIANT(baseline, )
+#ifdef LANES_DISPATCH
+LANES_VARIANT(avx2, __attribute__((target("avx2"))))
+#endif
+
+#ifdef LANES_DISPATCH
+// Whether both the CPU and the OS (which has to save the YMM registers) do
+// AVX2. This reads only the cpuid leaves that say so; __builtin_cpu_supports
+// would have libgcc read them all in a constructor, at every startup, and
+// cpuid is slow under a hypervisor.
+static bool HasAvx2() {
+    unsigned a, b, c, d;
+    if(!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    if(!(c & bit_OSXSAVE) || !(c & bit_AVX)) return false;
+    unsigned xcr0, xcr0hi;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0));
+    if((xcr0 & 0x6) != 0x6) return false;
+    if(!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+    return (b & bit_AVX2) != 0;
+}
+#endif
+
+static LaneKernels PickLaneKernels() {
+#ifdef LANES_DISPATCH
+    if(HasAvx2()) return LANES_KERNELS(avx2);
+#endif
+    return LANES_KERNELS(baseline);
+}
+
+// Picked the first time lanes run, not at startup
+static const LaneKernels &Kernels() {
+    static const LaneKernels laneKernels = PickLaneKernels();
+    return laneKernels;
+}
+
+const char *ExprTape::LaneIsa() {
+    return Kernels().isa;
+}
+
+void ExprTape::SpreadLanes(std::vector<float> *lanes) const {
+    lanes->resize(reg.size() * LANES);
+    for(size_t r = 0; r < reg.size(); r++) {
+        std::fill_n(lanes->begin() + r * LANES, LANES, (float)reg[r]);
+    }
+}
+
+void ExprTape::EvalLanes(size_t begin, size_t end, double *lanes) const {
+    Kernels().dbl.run(code.data(), begin, end, lanes);
+}
+
+void ExprTape::EvalLanes(size_t begin, size_t end, float *lanes) const {
+    Kernels().flt.run(code.data(), begin, end, lanes);
+}
+
+void ExprTape::MaxAbsLanes(const int *regs, size_t count, const double *lanes,
+                           double *maxAbs) {
+    Kernels().dbl.maxAbs(regs, count, lanes, maxAbs);
+}
+
+void ExprTape::MaxAbsLanes(const int *regs, size_t count, const float *lanes,
+                           float *maxAbs) {
+    Kernels().flt.maxAbs(regs, count, lanes, maxAbs);
+}
+
 //-----------------------------------------------------------------------------
 // Routines to pretty-print an expression. Mostly for debugging.
 //-----------------------------------------------------------------------------
@@ -761,6 +1407,18 @@ ExprParser::Token ExprParser::Lex(std::string *error) {
         }
     } else if(isdigit(c) || c == '.') {
         return LexNumber(error);
+    } else if(c == '$') {
+        // A param, by its handle
+        ReadChar();
+        std::string s = ReadWord();
+        char *endptr;
+        unsigned long h = strtoul(s.c_str(), &endptr, 10);
+        if(!s.empty() && isdigit(s[0]) && *endptr == '\0' && h > 0 && h <= UINT32_MAX) {
+            t = Token::From(TokenType::OPERAND, Expr::Op::PARAM);
+            t.expr->parh = hParam { (uint32_t)h };
+        } else {
+            *error = "'$" + s + "' is not a valid param";
+        }
     } else if(ispunct(c)) {
         ReadChar();
         if(c == '+') {
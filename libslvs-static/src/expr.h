@@ -7,7 +7,16 @@
 #ifndef SOLVESPACE_EXPR_H
 #define SOLVESPACE_EXPR_H
 
-using SubstitutionMap = std::unordered_map<hParam, Param *, HandleHasher<hParam>>;
+// A param that was solved by substitution, as k*by + c
+struct Substitution {
+    Param   *by;
+    double  k;
+    double  c;
+
+    bool IsIdentity() const { return k == 1.0 && c == 0.0; }
+    double Value() const { return k * by->val + c; }
+};
+using SubstitutionMap = std::unordered_map<hParam, Substitution, HandleHasher<hParam>>;
 
 class Expr {
 public:
@@ -50,8 +59,10 @@ public:
     Expr() = default;
     Expr(double val) : op(Op::CONSTANT) { v = val; }
 
+    // The nodes that have been allocated on the calling thread, in all.
+    static thread_local size_t allocatedOnThread;
     static inline Expr *AllocExpr()
-        { return (Expr *)AllocTemporary(sizeof(Expr)); }
+        { allocatedOnThread++; return (Expr *)AllocTemporary(sizeof(Expr)); }
 
     static Expr *From(hParam p);
     static Expr *From(double v);
@@ -77,7 +88,12 @@ public:
     static bool Tol(double a, double b);
     bool IsZeroConst() const;
     Expr *FoldConstants(bool allocCopy = true, size_t depth = std::numeric_limits<size_t>::max());
-    void Substitute(const SubstitutionMap &subMap);
+    // Substitute for each param by where it sits in pl's storage, where
+    // subs has a substitution with a non-NULL by for the params that have
+    // one.
+    void Substitute(ParamList *pl, const std::vector<Substitution> &subs);
+    // Or by an expression for it, where there's one.
+    void Substitute(ParamList *pl, const std::vector<Expr *> &by);
 
     static const hParam NO_PARAMS, MULTIPLE_PARAMS;
     hParam ReferencedParams(ParamList *pl) const;
@@ -141,4 +157,166 @@ public:
 
     Expr *Magnitude() const;
 };
+
+// Builds expressions out of shared nodes: asking for a node with the same
+// operation and operands as one already built returns that node, so equal
+// subexpressions (a workplane's rotation, written out again for every point
+// in it) are the same pointer, and their partial derivatives are found just
+// once. Every node is folded as it's built, the same way FoldConstants would
+// fold it. The nodes are shared, so they must never be changed in place.
+class ExprFactory {
+public:
+    Expr *Constant(double v);
+    Expr *ParamPtr(Param *p);
+    Expr *Op(Expr::Op op, Expr *a, Expr *b = NULL);
+
+    // The same as e->DeepCopyWithParamsAsPointers(firstTry, thenTry, true),
+    // built out of shared nodes.
+    Expr *CopyWithParamsAsPointers(const Expr *e, IdList<Param,hParam> *firstTry,
+                                   IdList<Param,hParam> *thenTry);
+    // The folded partial derivative of e, which came from this factory.
+    Expr *PartialWrt(Expr *e, hParam p);
+    // The parameters that e, which came from this factory, depends on, in
+    // order of their handles; each node's are found once, and shared.
+    const std::vector<hParam> &ParamsUsed(const Expr *e);
+
+    // The distinct nodes that have been copied, and the distinct nodes that
+    // they and their partials were built out of.
+    size_t CopiedNodes() const { return copied.size(); }
+    size_t BuiltNodes() const { return nodes.size(); }
+
+private:
+    struct Key {
+        Expr::Op    op;
+        const Expr *a;
+        uint64_t    b;
+
+        bool operator==(const Key &k) const {
+            return op == k.op && a == k.a && b == k.b;
+        }
+    };
+    struct KeyHasher {
+        size_t operator()(const Key &k) const;
+    };
+
+    std::unordered_map<Key, Expr *, KeyHasher> nodes;
+    std::unordered_map<const Expr *, Expr *> copied;
+    // By node and parameter, in the same form as Key
+    std::unordered_map<Key, Expr *, KeyHasher> partials;
+    std::unordered_map<const Expr *, std::vector<hParam>> used;
+
+    Expr *Intern(const Key &k, const Expr &e);
+};
+
+// A set of expressions lowered to a flat list of instructions over a
+// register file. Each distinct subexpression (by pointer, or by structure)
+// is computed once, so a residual and its partial derivatives share their
+// common terms; evaluating the tape is then a single linear pass, with no
+// recursion and no pointer chasing through the tree.
+class ExprTape {
+public:
+    // Registers a and b are read, and dst written; -1 for none. A PARAM or
+    // PARAM_PTR reads no register, and its b holds -2 less the index of the
+    // parameter in params instead, so that it never reads as one. That keeps
+    // an instruction to 16 bytes, and the tape to one contiguous sweep.
+    struct Instr {
+        Expr::Op    op;
+        int         dst;
+        int         a, b;
+    };
+    struct Input {
+        hParam      parh;
+        Param      *parp;
+    };
+
+    std::vector<Instr>  code;
+    std::vector<Input>  params;
+    std::vector<double> reg;
+
+    // The parameter that a PARAM or PARAM_PTR instruction reads
+    const Input &InputOf(const Instr &in) const { return params[-2 - in.b]; }
+    Param *ParamOf(const Instr &in) const;
+
+    void Clear();
+    // Forget what's been compiled, keeping its instructions and registers,
+    // so that what's compiled next shares none of them and can be run by
+    // itself.
+    void Forget();
+
+    // Append the instructions needed to compute e, and return the register
+    // that will hold its value. Constants are folded in to registers here,
+    // and never show up as instructions.
+    int Compile(const Expr *e);
+
+    // Run the instructions in [begin, end). Registers written before begin
+    // must already be current.
+    void Eval(size_t begin, size_t end);
+    void Eval() { Eval(0, code.size()); }
+
+    // The instructions in [begin, end) by level: each one reads only
+    // registers written before begin, or at an earlier level, so those in
+    // one level can run in any order, or on several threads at once. Level
+    // k is instr[start[k]] up to instr[start[k + 1]], in tape order.
+    struct Levels {
+        std::vector<int> instr, start;
+    };
+    void Schedule(size_t begin, size_t end, Levels *levels) const;
+    // Run the count instructions listed in instr, in that order.
+    void EvalEach(const int *instr, size_t count);
+
+    size_t Size() const { return code.size(); }
+    double Value(int r) const { return reg[r]; }
+
+    // The same instructions can also run for LANES sets of values at once,
+    // with register r of lane l at lanes[r * LANES + l]; each instruction is
+    // then one loop over the lanes, which the compiler turns in to vector
+    // arithmetic for whatever the target has. Parameters aren't read in
+    // this form, so the caller writes each lane's values to their registers
+    // (the destinations of the PARAM and PARAM_PTR instructions) first.
+    // Find the partials of register out with respect to everything it
+    // depends on, by one reverse sweep over the count instructions listed
+    // in instr (in tape order), which must be all that out depends on. They
+    // end up in adjoint[], which doesn't need to be cleared first; Eval()
+    // must have left the registers current.
+    void Adjoints(const int *instr, size_t count, int out, double *adjoint) const;
+
+    // Or in single precision, with the registers rounded to float, for
+    // twice the lanes per vector and half the memory traffic.
+    static const int LANES = 8;
+    void SpreadLanes(std::vector<double> *lanes) const;
+    void SpreadLanes(std::vector<float> *lanes) const;
+    void EvalLanes(size_t begin, size_t end, double *lanes) const;
+    void EvalLanes(size_t begin, size_t end, float *lanes) const;
+    // The largest magnitude, for each lane, of the count registers in regs;
+    // NaN for a lane where any of them is NaN or infinite.
+    static void MaxAbsLanes(const int *regs, size_t count, const double *lanes,
+                            double *maxAbs);
+    static void MaxAbsLanes(const int *regs, size_t count, const float *lanes,
+                            float *maxAbs);
+    // The instruction set that the lanes run with on this CPU
+    static const char *LaneIsa();
+
+private:
+    struct Key {
+        Expr::Op    op;
+        int         a, b;
+        uint64_t    bits;
+
+        bool operator==(const Key &k) const {
+            return op == k.op && a == k.a && b == k.b && bits == k.bits;
+        }
+    };
+    struct KeyHasher {
+        size_t operator()(const Key &k) const;
+    };
+
+    std::unordered_map<const Expr *, int> compiled;
+    std::unordered_map<Key, int, KeyHasher> unique;
+    std::vector<bool> isConstant;
+
+    inline void Run(const Instr &c, double *r) const;
+
+    int Intern(const Key &k, double constValue);
+    int Emit(const Key &k, const Instr &in);
+};
 #endif
@@ -100,6 +100,7 @@ const SolveSpaceUI::SaveTable SolveSpaceUI::SAVED[] = {
     { 'g',  "Group.skipFirst",          'b',    &(SS.sv.g.skipFirst)          },
     { 'g',  "Group.meshCombine",        'd',    &(SS.sv.g.meshCombine)        },
     { 'g',  "Group.forceToMesh",        'd',    &(SS.sv.g.forceToMesh)        },
+    { 'g',  "Group.classifyBoolean",    'b',    &(SS.sv.g.classifyBoolean)    },
     { 'g',  "Group.predef.q.w",         'f',    &(SS.sv.g.predef.q.w)         },
     { 'g',  "Group.predef.q.vx",        'f',    &(SS.sv.g.predef.q.vx)        },
     { 'g',  "Group.predef.q.vy",        'f',    &(SS.sv.g.predef.q.vy)        },
@@ -220,6 +221,56 @@ struct SAVEDptr {
     uint32_t  &x() { return *((uint32_t *)this); }
 };
 
+// Whether two groups, params, requests and so on, of the given type in
+// SAVED, would be saved the same, comparing the fields it lists in place.
+bool SolveSpaceUI::SavesTheSame(char type, const void *a, const void *b) {
+    struct Field {
+        ptrdiff_t   offset;
+        char        fmt;
+    };
+    static const std::map<char, std::vector<Field>> fields = [] {
+        std::map<char, const char *> base = {
+            { 'g', (const char *)&SS.sv.g }, { 'p', (const char *)&SS.sv.p },
+            { 'r', (const char *)&SS.sv.r }, { 'e', (const char *)&SS.sv.e },
+            { 'c', (const char *)&SS.sv.c }, { 's', (const char *)&SS.sv.s },
+        };
+        std::map<char, std::vector<Field>> fields;
+        for(int i = 0; SAVED[i].type != 0; i++) {
+            if(SAVED[i].ptr == NULL) continue;
+            ptrdiff_t offset = (const char *)SAVED[i].ptr - base.at(SAVED[i].type);
+            fields[SAVED[i].type].push_back({ offset, SAVED[i].fmt });
+        }
+        return fields;
+    }();
+
+    for(const Field &f : fields.at(type)) {
+        SAVEDptr *pa = (SAVEDptr *)((const char *)a + f.offset),
+                 *pb = (SAVEDptr *)((const char *)b + f.offset);
+        bool same;
+        switch(f.fmt) {
+            case 'S': same = (pa->S() == pb->S());                              break;
+            case 'P': same = (pa->P().raw == pb->P().raw);                      break;
+            case 'b': same = (pa->b() == pb->b());                              break;
+            case 'c': same = (pa->c().ToPackedInt() == pb->c().ToPackedInt());  break;
+            case 'd': same = (pa->d() == pb->d());                              break;
+            case 'f': same = EXACT(pa->f() == pb->f());                         break;
+            case 'x': same = (pa->x() == pb->x());                              break;
+            case 'M': {
+                same = (pa->M().size() == pb->M().size());
+                for(const auto &it : pa->M()) {
+                    if(!same) break;
+                    auto found = pb->M().find(it.first);
+                    same = (found != pb->M().end() && found->second.v == it.second.v);
+                }
+                break;
+            }
+            default: ssassert(false, "Unexpected value format");
+        }
+        if(!same) return false;
+    }
+    return true;
+}
+
 void SolveSpaceUI::SaveUsingTable(const Platform::Path &filename, int type) {
     int i;
     for(i = 0; SAVED[i].type != 0; i++) {
@@ -277,7 +328,7 @@ void SolveSpaceUI::SaveUsingTable(const Platform::Path &filename, int type) {
     }
 }
 
-bool SolveSpaceUI::SaveToFile(const Platform::Path &filename) {
+bool SolveSpaceUI::PrepareToSave(const Platform::Path &filename) {
     // Make sure all the entities are regenerated up to date, since they will be exported.
     SS.ScheduleShowTW();
     SS.GenerateAll(SolveSpaceUI::Generate::ALL);
@@ -296,6 +347,11 @@ bool SolveSpaceUI::SaveToFile(const Platform::Path &filename) {
             return false;
         }
     }
+    return true;
+}
+
+bool SolveSpaceUI::SaveToFile(const Platform::Path &filename) {
+    if(!PrepareToSave(filename)) return false;
 
     fh = OpenFile(filename, "wb");
     if(!fh) {
@@ -404,69 +460,834 @@ bool SolveSpaceUI::SaveToFile(const Platform::Path &filename) {
     return true;
 }
 
-void SolveSpaceUI::LoadUsingTable(const Platform::Path &filename, char *key, char *val) {
-    int i;
-    for(i = 0; SAVED[i].type != 0; i++) {
-        if(strcmp(SAVED[i].desc, key)==0) {
-            SAVEDptr *p = (SAVEDptr *)SAVED[i].ptr;
-            unsigned int u = 0;
-            switch(SAVED[i].fmt) {
-                case 'S': p->S() = val;                     break;
-                case 'b': p->b() = (atoi(val) != 0);        break;
-                case 'd': p->d() = atoi(val);               break;
-                case 'f': p->f() = atof(val);               break;
-                case 'x': sscanf(val, "%x", &u); p->x()= u; break;
+//-----------------------------------------------------------------------------
+// The binary snapshot: a header, a table of sections, and the sections, each
+// starting on an 8-byte boundary, so that the sections that are arrays of
+// fixed-size records can be read in place from the mapped file. Groups,
+// requests, entities, constraints and styles still go through SAVED, as
+// (key, value) pairs with binary values; the keys are listed once, up front,
+// so a file from a build whose table has moved on still loads.
+//-----------------------------------------------------------------------------
+namespace {
+
+const char     SNAPSHOT_MAGIC[8]      = { 'S', 'L', 'V', 'S', 'S', 'N', 'A', 'P' };
+const uint32_t SNAPSHOT_VERSION       = 1;
+const uint32_t SNAPSHOT_BYTE_ORDER    = 0x01020304;
+const uint16_t SNAPSHOT_END_OF_RECORD = 0xffff;
+
+// The sections of SAVED records are tagged with their type in SAVED.
+enum : uint32_t {
+    SNAPSHOT_KEYS      = 'K',
+    SNAPSHOT_PARAMS    = 'p',
+    SNAPSHOT_TRIANGLES = 'T',
+    SNAPSHOT_SURFACES  = 'S',
+    SNAPSHOT_TRIMS     = 'B',
+    SNAPSHOT_CURVES    = 'C',
+    SNAPSHOT_CURVE_PTS = 'P',
+    SNAPSHOT_INPUTS    = 'I',
+};
+
+struct SnapshotHeader {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    byteOrder;
+    uint32_t    sections;
+    uint32_t    reserved;
+};
+
+struct SnapshotSection {
+    uint32_t    tag;
+    uint32_t    count;
+    uint64_t    offset;
+    uint64_t    size;
+};
+
+struct SnapshotParam {
+    uint32_t    h;
+    uint32_t    reserved;
+    double      val;
+};
+
+struct SnapshotTriangle {
+    uint32_t    face;
+    uint32_t    color;
+    double      a[3], b[3], c[3];
+};
+
+// A surface's trims are the next `trims` entries of the trim section.
+struct SnapshotSurface {
+    uint32_t    h;
+    uint32_t    color;
+    uint32_t    face;
+    int32_t     degm, degn;
+    uint32_t    trims;
+    double      ctrl[4][4][3];
+    double      weight[4][4];
+};
+
+struct SnapshotTrim {
+    uint32_t    curve;
+    uint32_t    backwards;
+    double      start[3];
+    double      finish[3];
+};
+
+// Likewise a curve's points are the next `pts` entries of their section.
+struct SnapshotCurve {
+    uint32_t    h;
+    uint32_t    isExact;
+    int32_t     deg;
+    uint32_t    surfA, surfB;
+    uint32_t    pts;
+    double      ctrl[4][3];
+    double      weight[4];
+};
+
+struct SnapshotCurvePt {
+    uint32_t    vertex;
+    uint32_t    reserved;
+    double      p[3];
+};
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0 && sizeof(SnapshotSection) % 8 == 0 &&
+              sizeof(SnapshotParam) % 8 == 0 && sizeof(SnapshotTriangle) % 8 == 0 &&
+              sizeof(SnapshotSurface) % 8 == 0 && sizeof(SnapshotTrim) % 8 == 0 &&
+              sizeof(SnapshotCurve) % 8 == 0 && sizeof(SnapshotCurvePt) % 8 == 0,
+              "Snapshot records must keep the sections after them aligned");
+
+template<class T>
+void SnapshotPut(std::string *out, const T &v) {
+    out->append((const char *)&v, sizeof(T));
+}
+
+void SnapshotPutString(std::string *out, const std::string &str) {
+    SnapshotPut<uint32_t>(out, (uint32_t)str.size());
+    out->append(str);
+}
+
+void VectorToArray(Vector v, double *a) {
+    a[0] = v.x;
+    a[1] = v.y;
+    a[2] = v.z;
+}
+
+Vector VectorFromArray(const double *a) {
+    return Vector::From(a[0], a[1], a[2]);
+}
+
+class SnapshotWriter {
+public:
+    struct Section {
+        uint32_t    tag;
+        uint32_t    count;
+        std::string data;
+    };
+    std::vector<Section> sections;
+
+    std::string *Add(uint32_t tag, uint32_t count) {
+        sections.push_back({ tag, count, {} });
+        return &sections.back().data;
+    }
+
+    template<class T>
+    void AddArray(uint32_t tag, const std::vector<T> &records) {
+        Add(tag, (uint32_t)records.size())->assign((const char *)records.data(),
+                                                   records.size() * sizeof(T));
+    }
+
+    bool WriteTo(FILE *f) const {
+        SnapshotHeader header = {};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version   = SNAPSHOT_VERSION;
+        header.byteOrder = SNAPSHOT_BYTE_ORDER;
+        header.sections  = (uint32_t)sections.size();
+
+        std::vector<SnapshotSection> table;
+        uint64_t offset = sizeof(header) + sections.size() * sizeof(SnapshotSection);
+        for(const Section &s : sections) {
+            table.push_back({ s.tag, s.count, offset, s.data.size() });
+            offset += (s.data.size() + 7) & ~(uint64_t)7;
+        }
+
+        static const char padding[8] = {};
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(table.data(), sizeof(SnapshotSection), table.size(), f) == table.size();
+        for(const Section &s : sections) {
+            if(!ok) break;
+            size_t pad = (8 - s.data.size() % 8) % 8;
+            ok = fwrite(s.data.data(), 1, s.data.size(), f) == s.data.size() &&
+                 fwrite(padding, 1, pad, f) == pad;
+        }
+        return ok;
+    }
+};
+
+// Everything read from the file is checked against the end of what's there,
+// and one short read leaves `ok` false for good.
+class SnapshotReader {
+public:
+    const char *at;
+    const char *end;
+    bool        ok;
+
+    template<class T>
+    T Get() {
+        T v = {};
+        if((size_t)(end - at) < sizeof(T)) {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, at, sizeof(T));
+        at += sizeof(T);
+        return v;
+    }
+
+    std::string GetString() {
+        uint32_t n = Get<uint32_t>();
+        if(!ok || (size_t)(end - at) < n) {
+            ok = false;
+            return "";
+        }
+        std::string str(at, n);
+        at += n;
+        return str;
+    }
+};
+
+class SnapshotView {
+public:
+    const Platform::FileView &view;
+    std::vector<SnapshotSection> table;
+
+    static bool Recognizes(const Platform::FileView &view) {
+        return view.size >= sizeof(SnapshotHeader) &&
+               memcmp(view.data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+    }
+
+    explicit SnapshotView(const Platform::FileView &view) : view(view) {}
+
+    bool ReadTable() {
+        SnapshotHeader header;
+        memcpy(&header, view.data, sizeof(header));
+        if(header.version != SNAPSHOT_VERSION || header.byteOrder != SNAPSHOT_BYTE_ORDER) {
+            return false;
+        }
+        if((view.size - sizeof(header)) / sizeof(SnapshotSection) < header.sections) {
+            return false;
+        }
+        table.resize(header.sections);
+        memcpy(table.data(), view.data + sizeof(header),
+               table.size() * sizeof(SnapshotSection));
+        for(const SnapshotSection &s : table) {
+            if(s.offset % 8 != 0 || s.offset > view.size || s.size > view.size - s.offset) {
+                return false;
+            }
+        }
+        // The mapping starts on a page, and a copy read into memory on a
+        // malloc boundary, so the sections start aligned for their records.
+        return (uintptr_t)view.data % 8 == 0;
+    }
+
+    const SnapshotSection *Find(uint32_t tag) const {
+        for(const SnapshotSection &s : table) {
+            if(s.tag == tag) return &s;
+        }
+        return NULL;
+    }
+
+    SnapshotReader Reader(const SnapshotSection *s) const {
+        if(s == NULL) return { NULL, NULL, true };
+        const char *start = view.data + s->offset;
+        return { start, start + s->size, true };
+    }
+
+    // The records of a section of fixed-size ones, in place; a section
+    // that's missing is empty, and one of the wrong size is an error.
+    template<class T>
+    bool Array(uint32_t tag, const T **records, size_t *count) const {
+        const SnapshotSection *s = Find(tag);
+        *records = NULL;
+        *count   = 0;
+        if(s == NULL) return true;
+        if(s->size != (uint64_t)s->count * sizeof(T)) return false;
+        *records = (const T *)(view.data + s->offset);
+        *count   = s->count;
+        return true;
+    }
+};
+
+}
+
+// For each key in the file, its format and where it is in SAVED, or -1 if
+// this build doesn't know it.
+struct SnapshotKey {
+    char fmt;
+    int  saved;
+};
+
+static bool ReadSnapshotKeys(const SnapshotView &snap, std::vector<SnapshotKey> *keys) {
+    const SnapshotSection *s = snap.Find(SNAPSHOT_KEYS);
+    if(s == NULL) return false;
+    SnapshotReader rd = snap.Reader(s);
+    for(uint32_t i = 0; i < s->count && rd.ok; i++) {
+        char fmt = rd.Get<char>();
+        std::string desc = rd.GetString();
+        int saved = -1;
+        for(int j = 0; SolveSpaceUI::SAVED[j].type != 0; j++) {
+            if(SolveSpaceUI::SAVED[j].fmt == fmt && desc == SolveSpaceUI::SAVED[j].desc) {
+                saved = j;
+                break;
+            }
+        }
+        keys->push_back({ fmt, saved });
+    }
+    return rd.ok;
+}
+
+static void PutSnapshotRecord(std::string *out, char type, const Platform::Path &filename) {
+    for(int i = 0; SolveSpaceUI::SAVED[i].type != 0; i++) {
+        if(SolveSpaceUI::SAVED[i].type != type) continue;
+
+        int fmt = SolveSpaceUI::SAVED[i].fmt;
+        SAVEDptr *p = (SAVEDptr *)SolveSpaceUI::SAVED[i].ptr;
+        // As in text, items that aren't specified are assumed to be zero
+        if(fmt == 'S' && p->S().empty())          continue;
+        if(fmt == 'P' && p->P().IsEmpty())        continue;
+        if(fmt == 'd' && p->d() == 0)             continue;
+        if(fmt == 'f' && EXACT(p->f() == 0.0))    continue;
+        if(fmt == 'x' && p->x() == 0)             continue;
+        if(fmt == 'i')                            continue;
+
+        SnapshotPut<uint16_t>(out, (uint16_t)i);
+        switch(fmt) {
+            case 'S': SnapshotPutString(out, p->S());                break;
+            case 'b': SnapshotPut<uint8_t>(out, p->b() ? 1 : 0);     break;
+            case 'c': SnapshotPut<uint32_t>(out, p->c().ToPackedInt()); break;
+            case 'd': SnapshotPut<int32_t>(out, p->d());             break;
+            case 'f': SnapshotPut<double>(out, p->f());              break;
+            case 'x': SnapshotPut<uint32_t>(out, p->x());            break;
+
+            case 'P': {
+                Platform::Path relativePath = p->P().Expand(/*fromCurrentDirectory=*/true).RelativeTo(filename.Expand(/*fromCurrentDirectory=*/true).Parent());
+                ssassert(!relativePath.IsEmpty(), "Cannot relativize path");
+                SnapshotPutString(out, relativePath.ToPortable());
+                break;
+            }
+
+            case 'M': {
+                // Sorted for the same reason as in text.
+                std::vector<std::pair<EntityKey, EntityId>> sorted(p->M().begin(), p->M().end());
+                std::sort(sorted.begin(), sorted.end(),
+                    [](std::pair<EntityKey, EntityId> &a, std::pair<EntityKey, EntityId> &b) {
+                        return a.second.v < b.second.v;
+                    });
+                SnapshotPut<uint32_t>(out, (uint32_t)sorted.size());
+                for(const auto &it : sorted) {
+                    SnapshotPut<uint32_t>(out, it.second.v);
+                    SnapshotPut<uint32_t>(out, it.first.input.v);
+                    SnapshotPut<int32_t>(out, it.first.copyNumber);
+                }
+                break;
+            }
+
+            default: ssassert(false, "Unexpected value format");
+        }
+    }
+    SnapshotPut<uint16_t>(out, SNAPSHOT_END_OF_RECORD);
+}
+
+// Reads the records of one type into SS.sv, calling add after each. Keys
+// this build doesn't know are skipped and flagged, as they are in text.
+template<class F>
+static bool GetSnapshotRecords(const SnapshotView &snap, const std::vector<SnapshotKey> &keys,
+                               char type, const Platform::Path &filename, F add) {
+    const SnapshotSection *s = snap.Find((uint32_t)type);
+    if(s == NULL) return true;
+
+    SnapshotReader rd = snap.Reader(s);
+    for(uint32_t n = 0; n < s->count && rd.ok; n++) {
+        for(;;) {
+            uint16_t key = rd.Get<uint16_t>();
+            if(!rd.ok || key == SNAPSHOT_END_OF_RECORD) break;
+            if(key >= keys.size()) return false;
+
+            int saved = keys[key].saved;
+            SAVEDptr *p = NULL;
+            if(saved >= 0 && SolveSpaceUI::SAVED[saved].type == type) {
+                p = (SAVEDptr *)SolveSpaceUI::SAVED[saved].ptr;
+            } else {
+                SS.fileLoadError = true;
+            }
+            switch(keys[key].fmt) {
+                case 'S': { std::string v = rd.GetString(); if(p) p->S() = v;     break; }
+                case 'b': { uint8_t v = rd.Get<uint8_t>();  if(p) p->b() = v != 0; break; }
+                case 'd': { int32_t v = rd.Get<int32_t>();  if(p) p->d() = v;     break; }
+                case 'f': { double v = rd.Get<double>();    if(p) p->f() = v;     break; }
+                case 'x': { uint32_t v = rd.Get<uint32_t>(); if(p) p->x() = v;    break; }
+
+                case 'c': {
+                    uint32_t v = rd.Get<uint32_t>();
+                    if(p) p->c() = RgbaColor::FromPackedInt(v);
+                    break;
+                }
 
                 case 'P': {
-                    Platform::Path path = Platform::Path::FromPortable(val);
-                    if(!path.IsEmpty()) {
+                    Platform::Path path = Platform::Path::FromPortable(rd.GetString());
+                    if(p && !path.IsEmpty()) {
                         p->P() = filename.Parent().Join(path).Expand();
                     }
                     break;
                 }
 
-                case 'c':
-                    sscanf(val, "%x", &u);
-                    p->c() = RgbaColor::FromPackedInt(u);
-                    break;
-
                 case 'M': {
-                    p->M().clear();
-                    for(;;) {
+                    if(p) p->M().clear();
+                    uint32_t count = rd.Get<uint32_t>();
+                    for(uint32_t i = 0; i < count && rd.ok; i++) {
                         EntityKey ek;
                         EntityId ei;
-                        char line2[1024];
-                        if (fgets(line2, (int)sizeof(line2), fh) == NULL)
-                            break;
-                        if(sscanf(line2, "%d %x %d", &(ei.v), &(ek.input.v),
-                                                     &(ek.copyNumber)) == 3) {
-                            if(ei.v == Entity::NO_ENTITY.v) {
-                                // Commit bd84bc1a mistakenly introduced code that would remap
-                                // some entities to NO_ENTITY. This was fixed in commit bd84bc1a,
-                                // but files created meanwhile are corrupt, and can cause crashes.
-                                //
-                                // To fix this, we skip any such remaps when loading; they will be
-                                // recreated on the next regeneration. Any resulting orphans will
-                                // be pruned in the usual way, recovering to a well-defined state.
-                                continue;
-                            }
-                            p->M().insert({ ek, ei });
-                        } else {
-                            break;
-                        }
+                        ei.v            = rd.Get<uint32_t>();
+                        ek.input.v      = rd.Get<uint32_t>();
+                        ek.copyNumber   = rd.Get<int32_t>();
+                        // Skipped for the same reason as in LoadUsingTable.
+                        if(ei.v == Entity::NO_ENTITY.v) continue;
+                        if(p) p->M().insert({ ek, ei });
                     }
                     break;
                 }
 
-                case 'i': break;
+                default: return false;
+            }
+        }
+        if(rd.ok) add();
+    }
+    return rd.ok;
+}
 
-                default: ssassert(false, "Unexpected value format");
+static void PutSnapshotMeshAndShell(SnapshotWriter *snap, SMesh *m, SShell *sh) {
+    std::vector<SnapshotTriangle> triangles;
+    triangles.reserve(m->l.n);
+    for(const STriangle &tr : m->l) {
+        SnapshotTriangle st = {};
+        st.face  = tr.meta.face;
+        st.color = tr.meta.color.ToPackedInt();
+        VectorToArray(tr.a, st.a);
+        VectorToArray(tr.b, st.b);
+        VectorToArray(tr.c, st.c);
+        triangles.push_back(st);
+    }
+    snap->AddArray(SNAPSHOT_TRIANGLES, triangles);
+
+    std::vector<SnapshotSurface> surfaces;
+    std::vector<SnapshotTrim> trims;
+    for(SSurface &srf : sh->surface) {
+        SnapshotSurface ss = {};
+        ss.h     = srf.h.v;
+        ss.color = srf.color.ToPackedInt();
+        ss.face  = srf.face;
+        ss.degm  = srf.degm;
+        ss.degn  = srf.degn;
+        ss.trims = (uint32_t)srf.trim.n;
+        for(int i = 0; i < 4; i++) {
+            for(int j = 0; j < 4; j++) {
+                VectorToArray(srf.ctrl[i][j], ss.ctrl[i][j]);
+                ss.weight[i][j] = srf.weight[i][j];
             }
-            break;
         }
+        surfaces.push_back(ss);
+
+        for(const STrimBy &stb : srf.trim) {
+            SnapshotTrim st = {};
+            st.curve     = stb.curve.v;
+            st.backwards = stb.backwards ? 1 : 0;
+            VectorToArray(stb.start, st.start);
+            VectorToArray(stb.finish, st.finish);
+            trims.push_back(st);
+        }
+    }
+    snap->AddArray(SNAPSHOT_SURFACES, surfaces);
+    snap->AddArray(SNAPSHOT_TRIMS, trims);
+
+    std::vector<SnapshotCurve> curves;
+    std::vector<SnapshotCurvePt> curvePts;
+    for(SCurve &sc : sh->curve) {
+        SnapshotCurve scs = {};
+        scs.h       = sc.h.v;
+        scs.isExact = sc.isExact ? 1 : 0;
+        scs.deg     = sc.exact.deg;
+        scs.surfA   = sc.surfA.v;
+        scs.surfB   = sc.surfB.v;
+        scs.pts     = (uint32_t)sc.pts.n;
+        if(sc.isExact) {
+            for(int i = 0; i <= sc.exact.deg; i++) {
+                VectorToArray(sc.exact.ctrl[i], scs.ctrl[i]);
+                scs.weight[i] = sc.exact.weight[i];
+            }
+        }
+        curves.push_back(scs);
+
+        for(const SCurvePt &scpt : sc.pts) {
+            SnapshotCurvePt sp = {};
+            sp.vertex = scpt.vertex ? 1 : 0;
+            VectorToArray(scpt.p, sp.p);
+            curvePts.push_back(sp);
+        }
+    }
+    snap->AddArray(SNAPSHOT_CURVES, curves);
+    snap->AddArray(SNAPSHOT_CURVE_PTS, curvePts);
+}
+
+static bool GetSnapshotMeshAndShell(const SnapshotView &snap, SMesh *m, SShell *sh) {
+    const SnapshotTriangle *triangles;
+    const SnapshotSurface  *surfaces;
+    const SnapshotTrim     *trims;
+    const SnapshotCurve    *curves;
+    const SnapshotCurvePt  *curvePts;
+    size_t triangleCount, surfaceCount, trimCount, curveCount, curvePtCount;
+    if(!snap.Array(SNAPSHOT_TRIANGLES, &triangles, &triangleCount) ||
+       !snap.Array(SNAPSHOT_SURFACES,  &surfaces,  &surfaceCount)  ||
+       !snap.Array(SNAPSHOT_TRIMS,     &trims,     &trimCount)     ||
+       !snap.Array(SNAPSHOT_CURVES,    &curves,    &curveCount)    ||
+       !snap.Array(SNAPSHOT_CURVE_PTS, &curvePts,  &curvePtCount)) {
+        return false;
+    }
+
+    m->l.ReserveMore((int)triangleCount);
+    for(size_t i = 0; i < triangleCount; i++) {
+        STriangle tr = {};
+        tr.meta.face  = triangles[i].face;
+        tr.meta.color = RgbaColor::FromPackedInt(triangles[i].color);
+        tr.a = VectorFromArray(triangles[i].a);
+        tr.b = VectorFromArray(triangles[i].b);
+        tr.c = VectorFromArray(triangles[i].c);
+        m->AddTriangle(&tr);
+    }
+
+    size_t trim = 0;
+    for(size_t i = 0; i < surfaceCount; i++) {
+        const SnapshotSurface &ss = surfaces[i];
+        if(ss.degm < 0 || ss.degm > 3 || ss.degn < 0 || ss.degn > 3 ||
+           ss.trims > trimCount - trim) {
+            return false;
+        }
+        SSurface srf = {};
+        srf.h.v   = ss.h;
+        srf.color = RgbaColor::FromPackedInt(ss.color);
+        srf.face  = ss.face;
+        srf.degm  = ss.degm;
+        srf.degn  = ss.degn;
+        for(int j = 0; j < 4; j++) {
+            for(int k = 0; k < 4; k++) {
+                srf.ctrl[j][k]   = VectorFromArray(ss.ctrl[j][k]);
+                srf.weight[j][k] = ss.weight[j][k];
+            }
+        }
+        for(uint32_t j = 0; j < ss.trims; j++, trim++) {
+            STrimBy stb = {};
+            stb.curve.v   = trims[trim].curve;
+            stb.backwards = (trims[trim].backwards != 0);
+            stb.start     = VectorFromArray(trims[trim].start);
+            stb.finish    = VectorFromArray(trims[trim].finish);
+            srf.trim.Add(&stb);
+        }
+        sh->surface.Add(&srf);
+    }
+
+    size_t pt = 0;
+    for(size_t i = 0; i < curveCount; i++) {
+        const SnapshotCurve &scs = curves[i];
+        if(scs.deg < 0 || scs.deg > 3 || scs.pts > curvePtCount - pt) return false;
+        SCurve crv = {};
+        crv.h.v       = scs.h;
+        crv.isExact   = (scs.isExact != 0);
+        crv.exact.deg = scs.deg;
+        crv.surfA.v   = scs.surfA;
+        crv.surfB.v   = scs.surfB;
+        if(crv.isExact) {
+            for(int j = 0; j <= scs.deg; j++) {
+                crv.exact.ctrl[j]   = VectorFromArray(scs.ctrl[j]);
+                crv.exact.weight[j] = scs.weight[j];
+            }
+        }
+        for(uint32_t j = 0; j < scs.pts; j++, pt++) {
+            SCurvePt scpt = {};
+            scpt.vertex = (curvePts[pt].vertex != 0);
+            scpt.p      = VectorFromArray(curvePts[pt].p);
+            crv.pts.Add(&scpt);
+        }
+        sh->curve.Add(&crv);
+    }
+    return true;
+}
+
+bool SolveSpaceUI::SaveSnapshot(const Platform::Path &filename) {
+    if(!PrepareToSave(filename)) return false;
+
+    SnapshotWriter snap;
+
+    std::string *keys = snap.Add(SNAPSHOT_KEYS, 0);
+    for(int i = 0; SAVED[i].type != 0; i++) {
+        SnapshotPut<char>(keys, SAVED[i].fmt);
+        SnapshotPutString(keys, SAVED[i].desc);
+        snap.sections.back().count++;
+    }
+
+    std::string *groups = snap.Add('g', (uint32_t)SK.group.n);
+    for(auto &g : SK.group) {
+        sv.g = g;
+        PutSnapshotRecord(groups, 'g', filename);
+    }
+
+    std::vector<SnapshotParam> params;
+    params.reserve(SK.param.n);
+    for(auto &p : SK.param) {
+        params.push_back({ p.h.v, 0, p.val });
+    }
+    snap.AddArray(SNAPSHOT_PARAMS, params);
+
+    std::string *requests = snap.Add('r', (uint32_t)SK.request.n);
+    for(auto &r : SK.request) {
+        sv.r = r;
+        PutSnapshotRecord(requests, 'r', filename);
+    }
+
+    std::string *entities = snap.Add('e', (uint32_t)SK.entity.n);
+    for(auto &e : SK.entity) {
+        e.CalculateNumerical(/*forExport=*/true);
+        sv.e = e;
+        PutSnapshotRecord(entities, 'e', filename);
+    }
+
+    std::string *constraints = snap.Add('c', (uint32_t)SK.constraint.n);
+    for(auto &c : SK.constraint) {
+        sv.c = c;
+        PutSnapshotRecord(constraints, 'c', filename);
+    }
+
+    std::string *styles = snap.Add('s', 0);
+    for(auto &s : SK.style) {
+        sv.s = s;
+        if(sv.s.h.v >= Style::FIRST_CUSTOM) {
+            PutSnapshotRecord(styles, 's', filename);
+            snap.sections.back().count++;
+        }
+    }
+
+    // The last group's mesh or shell, as SaveToFile writes it, for linking.
+    Group *g = SK.GetGroup(*SK.groupOrder.Last());
+    PutSnapshotMeshAndShell(&snap, &g->runningMesh, &g->runningShell);
+
+    fh = OpenFile(filename, "wb");
+    if(!fh) {
+        Error("Couldn't write to file '%s'", filename.raw.c_str());
+        return false;
+    }
+    bool ok = snap.WriteTo(fh);
+    if(fclose(fh) != 0) ok = false;
+    if(!ok) {
+        Error("Couldn't write to file '%s'", filename.raw.c_str());
+    }
+    return ok;
+}
+
+bool SolveSpaceUI::LoadSnapshot(const Platform::Path &filename) {
+    SnapshotView snap(loadView);
+    std::vector<SnapshotKey> keys;
+    if(!snap.ReadTable() || !ReadSnapshotKeys(snap, &keys)) return false;
+
+    bool ok = GetSnapshotRecords(snap, keys, 'g', filename, [&]() {
+        // legacy files have a spurious dependency between linked groups
+        // and their parent groups, remove
+        if(sv.g.type == Group::Type::LINKED)
+            sv.g.opA.v = 0;
+
+        SK.group.AddUnordered(&(sv.g));
+        sv.g = {};
+        sv.g.scale = 1;
+    });
+
+    const SnapshotParam *params;
+    size_t paramCount;
+    ok = ok && snap.Array(SNAPSHOT_PARAMS, &params, &paramCount);
+    if(ok) {
+        SK.param.ReserveMore((int)paramCount);
+        for(size_t i = 0; i < paramCount; i++) {
+            Param p = {};
+            p.h.v = params[i].h;
+            p.val = params[i].val;
+            SK.param.AddUnordered(&p);
+        }
+    }
+
+    ok = ok && GetSnapshotRecords(snap, keys, 'r', filename, [&]() {
+        SK.request.AddUnordered(&(sv.r));
+        sv.r = {};
+    });
+    ok = ok && GetSnapshotRecords(snap, keys, 'c', filename, [&]() {
+        SK.constraint.AddUnordered(&(sv.c));
+        sv.c = {};
+    });
+    ok = ok && GetSnapshotRecords(snap, keys, 's', filename, [&]() {
+        SK.style.AddUnordered(&(sv.s));
+        sv.s = {};
+        Style::FillDefaultStyle(&sv.s);
+    });
+    return ok;
+}
+
+bool SolveSpaceUI::LoadEntitiesFromSnapshot(const Platform::Path &filename, EntityList *le,
+                                            SMesh *m, SShell *sh)
+{
+    SnapshotView snap(loadView);
+    std::vector<SnapshotKey> keys;
+    if(!snap.ReadTable() || !ReadSnapshotKeys(snap, &keys)) return false;
+
+    bool ok = GetSnapshotRecords(snap, keys, 'e', filename, [&]() {
+        le->AddUnordered(&(sv.e));
+        sv.e = {};
+    });
+    ok = ok && GetSnapshotRecords(snap, keys, 's', filename, [&]() {
+        // Linked file contains a style that we don't have yet,
+        // so import it.
+        if(SK.style.FindByIdNoOops(sv.s.h) == nullptr) {
+            SK.style.Add(&(sv.s));
+        }
+        sv.s = {};
+        Style::FillDefaultStyle(&sv.s);
+    });
+    if(!ok) return false;
+    le->SortById();
+
+    return GetSnapshotMeshAndShell(snap, m, sh);
+}
+
+bool SolveSpaceUI::SaveMeshSnapshot(const Platform::Path &filename, SMesh *m, SShell *sh,
+                                    const std::string &inputs) {
+    SnapshotWriter snap;
+    *snap.Add(SNAPSHOT_INPUTS, 1) = inputs;
+    PutSnapshotMeshAndShell(&snap, m, sh);
+
+    FILE *f = OpenFile(filename, "wb");
+    if(!f) return false;
+    bool ok = snap.WriteTo(f);
+    if(fclose(f) != 0) ok = false;
+    return ok;
+}
+
+bool SolveSpaceUI::LoadMeshSnapshot(const Platform::Path &filename, SMesh *m, SShell *sh,
+                                    const std::string &inputs) {
+    Platform::FileView view;
+    if(!view.Open(filename) || !SnapshotView::Recognizes(view)) return false;
+
+    // The file is named for a hash of its inputs, which others can share.
+    SnapshotView snap(view);
+    if(!snap.ReadTable()) return false;
+    const SnapshotSection *s = snap.Find(SNAPSHOT_INPUTS);
+    if(s == NULL || s->size != inputs.size() ||
+       memcmp(view.data + s->offset, inputs.data(), inputs.size()) != 0) {
+        return false;
     }
-    if(SAVED[i].type == 0) {
+    if(!GetSnapshotMeshAndShell(snap, m, sh)) {
+        m->Clear();
+        sh->Clear();
+        return false;
+    }
+    return true;
+}
+
+bool SolveSpaceUI::ReadLoadLine(std::string *line) {
+    if(loadAt >= loadView.size) return false;
+
+    const char *start = loadView.data + loadAt,
+               *end   = loadView.data + loadView.size;
+    const char *nl = (const char *)memchr(start, '\n', (size_t)(end - start));
+    if(nl == NULL) nl = end;
+    loadAt = (size_t)(nl - loadView.data) + 1;
+
+    // We should never get files with \r characters in them, but mailers
+    // will sometimes mangle attachments.
+    const char *cr = (const char *)memchr(start, '\r', (size_t)(nl - start));
+    line->assign(start, cr ? cr : nl);
+    return true;
+}
+
+void SolveSpaceUI::LoadUsingTable(const Platform::Path &filename, char *key, char *val) {
+    // Every line of the file comes through here, so find the key by hash
+    // instead of walking the whole table; where a key is listed twice, the
+    // first entry wins, as it did for the walk.
+    struct KeyHash {
+        size_t operator()(const char *s) const {
+            size_t h = 2166136261u;
+            for(; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+            return h;
+        }
+    };
+    struct KeyEqual {
+        bool operator()(const char *a, const char *b) const { return strcmp(a, b) == 0; }
+    };
+    static const std::unordered_map<const char *, int, KeyHash, KeyEqual> index = [] {
+        std::unordered_map<const char *, int, KeyHash, KeyEqual> index;
+        for(int i = 0; SAVED[i].type != 0; i++) {
+            index.emplace(SAVED[i].desc, i);
+        }
+        return index;
+    }();
+
+    auto it = index.find(key);
+    if(it == index.end()) {
         fileLoadError = true;
+        return;
+    }
+
+    int i = it->second;
+    SAVEDptr *p = (SAVEDptr *)SAVED[i].ptr;
+    switch(SAVED[i].fmt) {
+        case 'S': p->S() = val;                                 break;
+        case 'b': p->b() = (atoi(val) != 0);                    break;
+        case 'd': p->d() = (int)strtol(val, NULL, 10);          break;
+        case 'f': p->f() = strtod(val, NULL);                   break;
+        case 'x': p->x() = (uint32_t)strtoul(val, NULL, 16);    break;
+
+        case 'P': {
+            Platform::Path path = Platform::Path::FromPortable(val);
+            if(!path.IsEmpty()) {
+                p->P() = filename.Parent().Join(path).Expand();
+            }
+            break;
+        }
+
+        case 'c':
+            p->c() = RgbaColor::FromPackedInt((uint32_t)strtoul(val, NULL, 16));
+            break;
+
+        case 'M': {
+            p->M().clear();
+            std::string line2;
+            while(ReadLoadLine(&line2)) {
+                EntityKey ek;
+                EntityId ei;
+                if(sscanf(line2.c_str(), "%d %x %d", &(ei.v), &(ek.input.v),
+                                                     &(ek.copyNumber)) == 3) {
+                    if(ei.v == Entity::NO_ENTITY.v) {
+                        // Commit bd84bc1a mistakenly introduced code that would remap
+                        // some entities to NO_ENTITY. This was fixed in commit bd84bc1a,
+                        // but files created meanwhile are corrupt, and can cause crashes.
+                        //
+                        // To fix this, we skip any such remaps when loading; they will be
+                        // recreated on the next regeneration. Any resulting orphans will
+                        // be pruned in the usual way, recovering to a well-defined state.
+                        continue;
+                    }
+                    p->M().insert({ ek, ei });
+                } else {
+                    break;
+                }
+            }
+            break;
+        }
+
+        case 'i': break;
+
+        default: ssassert(false, "Unexpected value format");
     }
 }
 
@@ -475,11 +1296,11 @@ bool SolveSpaceUI::LoadFromFile(const Platform::Path &filename, bool canCancel)
     allConsistent = false;
     fileLoadError = false;
 
-    fh = OpenFile(filename, "rb");
-    if(!fh) {
+    if(!loadView.Open(filename)) {
         Error("Couldn't read from file '%s'", filename.raw.c_str());
         return false;
     }
+    loadAt = 0;
 
     ClearExisting();
 
@@ -487,18 +1308,19 @@ bool SolveSpaceUI::LoadFromFile(const Platform::Path &filename, bool canCancel)
     sv.g.scale = 1; // default is 1, not 0; so legacy files need this
     Style::FillDefaultStyle(&sv.s);
 
-    char line[1024];
-    while(fgets(line, (int)sizeof(line), fh)) {
+    if(SnapshotView::Recognizes(loadView)) {
+        // Nothing is left for the text loop below to read.
         fileIsEmpty = false;
+        if(!LoadSnapshot(filename)) fileLoadError = true;
+        loadAt = loadView.size;
+    }
 
-        char *s = strchr(line, '\n');
-        if(s) *s = '\0';
-        // We should never get files with \r characters in them, but mailers
-        // will sometimes mangle attachments.
-        s = strchr(line, '\r');
-        if(s) *s = '\0';
+    std::string lineBuf;
+    while(ReadLoadLine(&lineBuf)) {
+        fileIsEmpty = false;
 
-        if(*line == '\0') continue;
+        if(lineBuf.empty()) continue;
+        char *line = &lineBuf[0];
 
         char *e = strchr(line, '=');
         if(e) {
@@ -511,24 +1333,24 @@ bool SolveSpaceUI::LoadFromFile(const Platform::Path &filename, bool canCancel)
             if(sv.g.type == Group::Type::LINKED)
                 sv.g.opA.v = 0;
 
-            SK.group.Add(&(sv.g));
+            SK.group.AddUnordered(&(sv.g));
             sv.g = {};
             sv.g.scale = 1; // default is 1, not 0; so legacy files need this
         } else if(strcmp(line, "AddParam")==0) {
             // params are regenerated, but we want to preload the values
             // for initial guesses
-            SK.param.Add(&(sv.p));
+            SK.param.AddUnordered(&(sv.p));
             sv.p = {};
         } else if(strcmp(line, "AddEntity")==0) {
             // entities are regenerated
         } else if(strcmp(line, "AddRequest")==0) {
-            SK.request.Add(&(sv.r));
+            SK.request.AddUnordered(&(sv.r));
             sv.r = {};
         } else if(strcmp(line, "AddConstraint")==0) {
-            SK.constraint.Add(&(sv.c));
+            SK.constraint.AddUnordered(&(sv.c));
             sv.c = {};
         } else if(strcmp(line, "AddStyle")==0) {
-            SK.style.Add(&(sv.s));
+            SK.style.AddUnordered(&(sv.s));
             sv.s = {};
             Style::FillDefaultStyle(&sv.s);
         } else if(strcmp(line, VERSION_STRING)==0) {
@@ -549,7 +1371,15 @@ bool SolveSpaceUI::LoadFromFile(const Platform::Path &filename, bool canCancel)
         }
     }
 
-    fclose(fh);
+    loadView.Close();
+
+    // Saved files list everything in handle order, so these sorts are
+    // usually just a check.
+    SK.group.SortById();
+    SK.param.SortById();
+    SK.request.SortById();
+    SK.constraint.SortById();
+    SK.style.SortById();
 
     if(fileIsEmpty) {
         Error(_("The file is empty. It may be corrupt."));
@@ -733,22 +1563,23 @@ bool SolveSpaceUI::LoadEntitiesFromSlvs(const Platform::Path &filename, EntityLi
     SSurface srf = {};
     SCurve crv = {};
 
-    fh = OpenFile(filename, "rb");
-    if(!fh) return false;
+    if(!loadView.Open(filename)) return false;
+    loadAt = 0;
 
     le->Clear();
     sv = {};
 
-    char line[1024];
-    while(fgets(line, (int)sizeof(line), fh)) {
-        char *s = strchr(line, '\n');
-        if(s) *s = '\0';
-        // We should never get files with \r characters in them, but mailers
-        // will sometimes mangle attachments.
-        s = strchr(line, '\r');
-        if(s) *s = '\0';
+    if(SnapshotView::Recognizes(loadView)) {
+        Style::FillDefaultStyle(&sv.s);
+        bool ok = LoadEntitiesFromSnapshot(filename, le, m, sh);
+        loadView.Close();
+        return ok;
+    }
 
-        if(*line == '\0') continue;
+    std::string lineBuf;
+    while(ReadLoadLine(&lineBuf)) {
+        if(lineBuf.empty()) continue;
+        char *line = &lineBuf[0];
 
         char *e = strchr(line, '=');
         if(e) {
@@ -761,7 +1592,7 @@ bool SolveSpaceUI::LoadEntitiesFromSlvs(const Platform::Path &filename, EntityLi
         } else if(strcmp(line, "AddParam")==0) {
 
         } else if(strcmp(line, "AddEntity")==0) {
-            le->Add(&(sv.e));
+            le->AddUnordered(&(sv.e));
             sv.e = {};
         } else if(strcmp(line, "AddRequest")==0) {
 
@@ -863,7 +1694,8 @@ bool SolveSpaceUI::LoadEntitiesFromSlvs(const Platform::Path &filename, EntityLi
         } else ssassert(false, "Unexpected operation");
     }
 
-    fclose(fh);
+    loadView.Close();
+    le->SortById();
     return true;
 }
 
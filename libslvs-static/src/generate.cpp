@@ -19,6 +19,7 @@ void SolveSpaceUI::MarkGroupDirty(hGroup hg, bool onlyThis) {
         Group *g = SK.GetGroup(gh);
         if(g->h == hg) {
             go = true;
+            g->solveDirty = true;
         }
         if(go) {
             g->clean = false;
@@ -144,7 +145,54 @@ bool SolveSpaceUI::PruneRequestsAndConstraints(hGroup hg) {
     SK.constraint.RemoveTagged();
     deleted.constraints += constraints - SK.constraint.n;
 
-    return (requests > SK.request.n) || (constraints > SK.constraint.n);
+    if((requests > SK.request.n) || (constraints > SK.constraint.n)) {
+        // What's left of the group has to be solved again.
+        SK.GetGroup(hg)->solveDirty = true;
+        return true;
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+// Whether a group's entities or equations are built from anything in the
+// given groups: its operands, the entities that place it, and whatever its
+// requests and constraints refer to. If not, then solving those groups again
+// can't move anything in this one.
+//-----------------------------------------------------------------------------
+bool SolveSpaceUI::GroupDependsOn(hGroup hg, const std::set<hGroup> &on) {
+    if(on.empty()) return false;
+
+    auto inOn = [&](hEntity he) {
+        if(he == Entity::NO_ENTITY) return false;
+        hGroup eg;
+        if(he.isFromRequest()) {
+            Request *r = SK.request.FindByIdNoOops(he.request());
+            if(r == nullptr) return false;
+            eg = r->group;
+        } else {
+            eg = he.group();
+        }
+        return eg != hg && on.count(eg) > 0;
+    };
+
+    Group *g = SK.GetGroup(hg);
+    if(on.count(g->opA) > 0 || on.count(g->opB) > 0) return true;
+    if(inOn(g->predef.origin) || inOn(g->predef.entityB) || inOn(g->predef.entityC)) {
+        return true;
+    }
+    for(Request &r : SK.request) {
+        if(r.group != hg) continue;
+        if(inOn(r.workplane)) return true;
+    }
+    for(Constraint &c : SK.constraint) {
+        if(c.group != hg) continue;
+        if(inOn(c.workplane) || inOn(c.ptA) || inOn(c.ptB) ||
+           inOn(c.entityA) || inOn(c.entityB) || inOn(c.entityC) || inOn(c.entityD))
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 void SolveSpaceUI::GenerateAll(Generate type, bool andFindFree, bool genForBBox) {
@@ -153,6 +201,9 @@ void SolveSpaceUI::GenerateAll(Generate type, bool andFindFree, bool genForBBox)
     uint64_t startMillis = GetMilliseconds(),
              endMillis;
 
+    // Curves that the solver moves won't be asked for again.
+    if(!genForBBox) SBezier::AgePwlCache();
+
     SK.groupOrder.Clear();
     for(auto &g : SK.group) { SK.groupOrder.Add(&g.h); }
     std::sort(SK.groupOrder.begin(), SK.groupOrder.end(),
@@ -232,6 +283,11 @@ void SolveSpaceUI::GenerateAll(Generate type, bool andFindFree, bool genForBBox)
     SK.entity.Clear();
     SK.entity.ReserveMore(oldEntityCount);
 
+    // The groups solved so far in this pass; when we're only regenerating
+    // what's dirty, a later group that's clean and built from none of these
+    // is left where it was.
+    std::set<hGroup> solvedNow;
+
     // Not using range-for because we're using the index inside the loop.
     for(i = 0; i < SK.groupOrder.n; i++) {
         hGroup hg = SK.groupOrder[i];
@@ -286,13 +342,32 @@ void SolveSpaceUI::GenerateAll(Generate type, bool andFindFree, bool genForBBox)
             if(i >= first && i <= last) {
                 // The group falls inside the range, so really solve it,
                 // and then regenerate the mesh based on the solved stuff.
+                // Unless it's untouched and built from nothing solved here;
+                // then it's left where it was, like one outside the range,
+                // but its mesh still gets remade on the previous group's.
                 Group *g = SK.GetGroup(hg);
                 if(genForBBox) {
-                    SolveGroupAndReport(hg, andFindFree);
-                    g->GenerateLoops();
+                    if(type != Generate::DIRTY || g->solveDirty || !g->IsSolvedOkay() ||
+                       GroupDependsOn(hg, solvedNow))
+                    {
+                        auto start = std::chrono::steady_clock::now();
+                        SolveGroupAndReport(hg, andFindFree);
+                        g->timing.solve = std::chrono::duration<double, std::milli>(
+                                              std::chrono::steady_clock::now() - start).count();
+                        g->GenerateLoops();
+                        solvedNow.insert(hg);
+                    } else {
+                        for(auto &p : SK.param) {
+                            Param *newp = &p;
+
+                            Param *prevp = prev.FindByIdNoOops(newp->h);
+                            if(prevp) newp->known = true;
+                        }
+                    }
                 } else {
                     g->GenerateShellAndMesh();
                     g->clean = true;
+                    g->solveDirty = false;
                 }
             } else {
                 // The group falls outside the range, so just assume that
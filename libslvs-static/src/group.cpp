@@ -25,6 +25,8 @@ void Group::Clear() {
     runningMesh.Clear();
     thisShell.Clear();
     runningShell.Clear();
+    thisKey = {};
+    runningKey = {};
     displayMesh.Clear();
     displayOutlines.Clear();
     impMesh.Clear();
@@ -354,6 +356,7 @@ void Group::MenuGroup(Command id, Platform::Path linkFile) {
         SS.ReloadAllLinked(SS.saveFile);
     }
     gg->clean = false;
+    gg->solveDirty = true;
     SS.GW.activeGroup = gg->h;
     SS.GenerateAll();
     if(gg->type == Type::DRAWING_WORKPLANE) {
@@ -7,6 +7,11 @@
 //-----------------------------------------------------------------------------
 #include "solvespace.h"
 
+static double ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start).count();
+}
+
 void Group::AssembleLoops(bool *allClosed,
                           bool *allCoplanar,
                           bool *allNonZeroLen)
@@ -103,6 +108,51 @@ void SMesh::RemapFaces(Group *g, int remap) {
     }
 }
 
+// A mesh can be combined with a BSP or by classifying its triangles, as the
+// group asks; a shell has just the one way.
+static void UseMeshBoolean(SShell *, bool) {}
+static void UseMeshBoolean(SMesh *m, bool classify) { m->classifyBoolean = classify; }
+
+// A mesh is welded once, so that each copy transforms its shared vertices
+// and not three per triangle; a shell is transformed surface by surface.
+static void WeldSteps(SShell *, SMeshIndexed *) {}
+static void WeldSteps(SMesh *steps, SMeshIndexed *welded) { welded->MakeFromMesh(steps); }
+static void MakeStepCopy(SShell *out, SShell *steps, const SMeshIndexed &,
+                         Vector trans, Quaternion q) {
+    out->MakeFromTransformationOf(steps, trans, q, 1.0);
+}
+static void MakeStepCopy(SMesh *out, SMesh *, const SMeshIndexed &welded,
+                         Vector trans, Quaternion q) {
+    SMeshIndexed copy = welded;
+    copy.Transform(trans, q, 1.0);
+    copy.MakeMeshInto(out);
+}
+
+// The box around a shell's surfaces or a mesh's triangles; around the
+// surfaces' control points, which hold the surfaces however they're trimmed.
+static void GetBounding(SShell *sh, Vector *vmax, Vector *vmin) {
+    *vmax = Vector::From(VERY_NEGATIVE, VERY_NEGATIVE, VERY_NEGATIVE);
+    *vmin = Vector::From(VERY_POSITIVE, VERY_POSITIVE, VERY_POSITIVE);
+    for(const SSurface &srf : sh->surface) {
+        Vector smax, smin;
+        srf.GetAxisAlignedBounding(&smax, &smin);
+        smax.MakeMaxMin(vmax, vmin);
+        smin.MakeMaxMin(vmax, vmin);
+    }
+}
+static void GetBounding(SMesh *m, Vector *vmax, Vector *vmin) { m->GetBounding(vmax, vmin); }
+
+// Whether two shells or meshes are too far apart to touch, so that neither
+// cuts the other and a Boolean of them needn't be worked out: a union is
+// the two as they are, a difference the first alone, an intersection empty.
+template<class T>
+static bool CannotMeet(T *a, T *b) {
+    Vector amax, amin, bmax, bmin;
+    GetBounding(a, &amax, &amin);
+    GetBounding(b, &bmax, &bmin);
+    return Vector::BoundingBoxesDisjoint(amax, amin, bmax, bmin);
+}
+
 template<class T>
 void Group::GenerateForStepAndRepeat(T *steps, T *outs, Group::CombineAs forWhat) {
 
@@ -116,6 +166,8 @@ void Group::GenerateForStepAndRepeat(T *steps, T *outs, Group::CombineAs forWhat
     std::vector <T> transd(n);
     std::vector <T> workA(n);
     workA[0] = {};
+    SMeshIndexed welded = {};
+    WeldSteps(steps, &welded);
     // first generate a shell/mesh with each transformed copy
 #pragma omp parallel for
     for(a = a0; a < n; a++) {
@@ -126,8 +178,7 @@ void Group::GenerateForStepAndRepeat(T *steps, T *outs, Group::CombineAs forWhat
         if(type == Type::TRANSLATE) {
             Vector trans = Vector::From(h.param(0), h.param(1), h.param(2));
             trans = trans.ScaledBy(ap);
-            transd[a].MakeFromTransformationOf(steps,
-                trans, Quaternion::IDENTITY, 1.0);
+            MakeStepCopy(&transd[a], steps, welded, trans, Quaternion::IDENTITY);
         } else {
             Vector trans = Vector::From(h.param(0), h.param(1), h.param(2));
             double theta = ap * SK.GetParam(h.param(3))->val;
@@ -135,8 +186,7 @@ void Group::GenerateForStepAndRepeat(T *steps, T *outs, Group::CombineAs forWhat
             Vector axis = Vector::From(h.param(4), h.param(5), h.param(6));
             Quaternion q = Quaternion::From(c, s*axis.x, s*axis.y, s*axis.z);
             // Rotation is centered at t; so A(x - t) + t = Ax + (t - At)
-            transd[a].MakeFromTransformationOf(steps,
-                trans.Minus(q.Rotate(trans)), q, 1.0);
+            MakeStepCopy(&transd[a], steps, welded, trans.Minus(q.Rotate(trans)), q);
         }
     }
     for(a = a0; a < n; a++) {
@@ -149,28 +199,50 @@ void Group::GenerateForStepAndRepeat(T *steps, T *outs, Group::CombineAs forWhat
     std::vector<T> *scratch = &workA;
     // do the boolean operations on pairs of equal size
     while(n > 1) {
-        for(a = 0; a < n; a+=2) {
-            scratch->at(a/2).Clear();
+        int pairs = (n+1)/2;
+        bool skipped = (a0 == 1);
+        auto combine = [&](int p) {
+            int a = p*2;
+            // The Boolean's scratch goes in this thread's temporary arena;
+            // the result doesn't point into it, so we can rewind after.
+            TemporaryMark mark = MarkTemporary();
+            scratch->at(p).Clear();
             // combine a pair of shells
-            if((a==0) && (a0==1)) { // if the first was skipped just copy the 2nd
-                scratch->at(a/2).MakeFromCopyOf(&(soFar->at(a+1)));
+            if((a==0) && skipped) { // if the first was skipped just copy the 2nd
+                scratch->at(p).MakeFromCopyOf(&(soFar->at(a+1)));
                 (soFar->at(a+1)).Clear();
-                a0 = 0;
             } else if (a == n-1) { // for an odd number just copy the last one
-                scratch->at(a/2).MakeFromCopyOf(&(soFar->at(a)));
+                scratch->at(p).MakeFromCopyOf(&(soFar->at(a)));
                 (soFar->at(a)).Clear();
-            } else if(forWhat == CombineAs::ASSEMBLE) {
-                scratch->at(a/2).MakeFromAssemblyOf(&(soFar->at(a)), &(soFar->at(a+1)));
+            } else if(forWhat == CombineAs::ASSEMBLE ||
+                      CannotMeet(&(soFar->at(a)), &(soFar->at(a+1)))) {
+                scratch->at(p).MakeFromAssemblyOf(&(soFar->at(a)), &(soFar->at(a+1)));
                 (soFar->at(a)).Clear();
                 (soFar->at(a+1)).Clear();
             } else {
-                scratch->at(a/2).MakeFromUnionOf(&(soFar->at(a)), &(soFar->at(a+1)));
+                UseMeshBoolean(&(scratch->at(p)), classifyBoolean);
+                scratch->at(p).MakeFromUnionOf(&(soFar->at(a)), &(soFar->at(a+1)));
                 (soFar->at(a)).Clear();
                 (soFar->at(a+1)).Clear();
             }
+            ReleaseTemporary(mark);
+        };
+        if(pairs > 1) {
+            // The pairs don't touch each other and take very different
+            // times, so each goes to whichever thread is free next.
+#pragma omp parallel for schedule(dynamic, 1)
+            for(int p = 0; p < pairs; p++) {
+                combine(p);
+            }
+        } else {
+            // The last union gets the threads for its own loops. Not from
+            // inside a parallel region even with one thread, since a nested
+            // team's threads exit at its end, taking their arenas along.
+            combine(0);
         }
+        a0 = 0;
         swap(scratch, soFar);
-        n = (n+1)/2;
+        n = pairs;
     }
     outs->Clear();
     *outs = soFar->at(0);
@@ -186,8 +258,19 @@ void Group::GenerateForBoolean(T *prevs, T *thiss, T *outs, Group::CombineAs how
         return;
     }
 
+    // A part placed clear of everything before it leaves it as it was.
+    if(how != CombineAs::ASSEMBLE && CannotMeet(prevs, thiss)) {
+        if(how == CombineAs::UNION) {
+            outs->MakeFromAssemblyOf(prevs, thiss);
+        } else if(how == CombineAs::DIFFERENCE) {
+            outs->MakeFromCopyOf(prevs);
+        }
+        return;
+    }
+
     // So our group's shell appears in thisShell. Combine this with the
     // previous group's shell, using the requested operation.
+    UseMeshBoolean(outs, classifyBoolean);
     switch(how) {
         case CombineAs::UNION:
             outs->MakeFromUnionOf(prevs, thiss);
@@ -207,17 +290,339 @@ void Group::GenerateForBoolean(T *prevs, T *thiss, T *outs, Group::CombineAs how
     }
 }
 
-void Group::GenerateShellAndMesh() {
-    bool prevBooleanFailed = booleanFailed;
-    booleanFailed = false;
+//-----------------------------------------------------------------------------
+// The groups' shells and meshes, found by a hash of everything each was made
+// from: the solved values and group settings it read, and the keys of the
+// shells and meshes it was made out of, so that a group whose inputs are as
+// they were is copied instead of being extruded or combined again. What was
+// hashed is kept with each, and a hit is taken only if it's the same. What's
+// kept is forgotten least recently used first; with SS.meshCacheFolder set,
+// it's also written there, a snapshot each, to be found in later sessions.
+//-----------------------------------------------------------------------------
+class SolveSpace::ShellAndMeshForm {
+public:
+    // The bytes that were hashed, and the forms of the keys that were, which
+    // are shared with those keys rather than copied.
+    std::string                                             bytes;
+    std::vector<std::shared_ptr<const ShellAndMeshForm>>    parts;
+
+    static bool Same(const ShellAndMeshForm *a, const ShellAndMeshForm *b) {
+        if(a == b) return true;
+        if(a == NULL || b == NULL) return false;
+        if(a->bytes != b->bytes || a->parts.size() != b->parts.size()) return false;
+        for(size_t i = 0; i < a->parts.size(); i++) {
+            if(!Same(a->parts[i].get(), b->parts[i].get())) return false;
+        }
+        return true;
+    }
 
-    Group *srcg = this;
+    // All of it in one string, as it's written to disk.
+    static void Flatten(const ShellAndMeshForm *f, std::string *out) {
+        uint64_t sizes[2] = { UINT64_MAX, 0 };
+        if(f) {
+            sizes[0] = f->bytes.size();
+            sizes[1] = f->parts.size();
+        }
+        out->append((const char *)sizes, sizeof(sizes));
+        if(f == NULL) return;
+        out->append(f->bytes);
+        for(const auto &part : f->parts) {
+            Flatten(part.get(), out);
+        }
+    }
+};
+
+class ShellAndMeshHash {
+public:
+    uint64_t                            hash = 14695981039346656037ull;
+    std::shared_ptr<ShellAndMeshForm>   form = std::make_shared<ShellAndMeshForm>();
+
+    template<class T>
+    void Add(const T &v) {
+        const unsigned char *bytes = (const unsigned char *)&v;
+        for(size_t i = 0; i < sizeof(T); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        form->bytes.append((const char *)bytes, sizeof(T));
+    }
+    void Add(Vector v) {
+        Add(v.x);
+        Add(v.y);
+        Add(v.z);
+    }
+    void Add(const ShellAndMeshKey &key) {
+        Add(key.hash);
+        form->parts.push_back(key.form);
+    }
 
-    thisShell.Clear();
-    thisMesh.Clear();
-    runningShell.Clear();
-    runningMesh.Clear();
+    void AddShellAndMesh(SShell *sh, SMesh *m) {
+        Add(m->l.n);
+        for(const STriangle &tr : m->l) {
+            Add(tr.meta.face);
+            Add(tr.meta.color.ToPackedInt());
+            Add(tr.a);
+            Add(tr.b);
+            Add(tr.c);
+        }
+        Add(sh->surface.n);
+        for(const SSurface &srf : sh->surface) {
+            Add(srf.h.v);
+            Add(srf.color.ToPackedInt());
+            Add(srf.face);
+            Add(srf.degm);
+            Add(srf.degn);
+            for(int i = 0; i <= srf.degm; i++) {
+                for(int j = 0; j <= srf.degn; j++) {
+                    Add(srf.ctrl[i][j]);
+                    Add(srf.weight[i][j]);
+                }
+            }
+            Add(srf.trim.n);
+            for(const STrimBy &stb : srf.trim) {
+                Add(stb.curve.v);
+                Add(stb.backwards);
+                Add(stb.start);
+                Add(stb.finish);
+            }
+        }
+        Add(sh->curve.n);
+        for(const SCurve &sc : sh->curve) {
+            Add(sc.h.v);
+            Add(sc.isExact);
+            Add(sc.surfA.v);
+            Add(sc.surfB.v);
+            if(sc.isExact) {
+                Add(sc.exact.deg);
+                for(int i = 0; i <= sc.exact.deg; i++) {
+                    Add(sc.exact.ctrl[i]);
+                    Add(sc.exact.weight[i]);
+                }
+            }
+            Add(sc.pts.n);
+            for(const SCurvePt &scpt : sc.pts) {
+                Add(scpt.vertex);
+                Add(scpt.p);
+            }
+        }
+    }
 
+    // Zero stands for a shell and mesh whose inputs aren't known.
+    ShellAndMeshKey Key() const { return { hash ? hash : 1, form }; }
+};
+
+class ShellAndMeshCache {
+public:
+    // The most bytes of surfaces, curves and triangles kept; the least
+    // recently used beyond that are forgotten as more are stored.
+    static const size_t MAX_BYTES = 256 << 20;
+
+    // On a hit, the key takes the form kept with the entry, so that keys
+    // made out of it share it and are compared quickly.
+    bool Find(ShellAndMeshKey *key, SShell *sh, SMesh *m, bool *booleanFailed) {
+        if(key->hash == 0) return false;
+        auto it = entries.find(key->hash);
+        if(it == entries.end()) {
+            // Not made in this session, but maybe in an earlier one.
+            Entry entry = {};
+            std::string inputs;
+            if(SS.meshCacheFolder.IsEmpty()) return false;
+            ShellAndMeshForm::Flatten(key->form.get(), &inputs);
+            if(!SS.LoadMeshSnapshot(PathFor(key->hash), &entry.mesh, &entry.shell, inputs)) {
+                return false;
+            }
+            entry.form = key->form;
+            it = Insert(key->hash, entry);
+        } else if(!ShellAndMeshForm::Same(it->second.form.get(), key->form.get())) {
+            // Other inputs with the same hash.
+            return false;
+        }
+        key->form = it->second.form;
+        it->second.used = ++generation;
+        sh->MakeFromCopyOf(&it->second.shell);
+        m->MakeFromCopyOf(&it->second.mesh);
+        if(booleanFailed) *booleanFailed = it->second.booleanFailed;
+        return true;
+    }
+
+    // Where other inputs with the same hash are kept already, they stay.
+    void Store(const ShellAndMeshKey &key, SShell *sh, SMesh *m, bool booleanFailed) {
+        if(key.hash == 0 || entries.find(key.hash) != entries.end()) return;
+        Entry entry = {};
+        entry.form = key.form;
+        entry.shell.MakeFromCopyOf(sh);
+        entry.mesh.MakeFromCopyOf(m);
+        entry.booleanFailed = booleanFailed;
+        // A Boolean that failed gets another try in the next session.
+        if(!booleanFailed && !SS.meshCacheFolder.IsEmpty()) {
+            std::string inputs;
+            ShellAndMeshForm::Flatten(key.form.get(), &inputs);
+            SS.SaveMeshSnapshot(PathFor(key.hash), &entry.mesh, &entry.shell, inputs);
+        }
+        Insert(key.hash, entry);
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const ShellAndMeshForm> form;
+        SShell                                  shell;
+        SMesh                                   mesh;
+        bool                                    booleanFailed;
+        uint64_t                                used;
+        size_t                                  bytes;
+    };
+
+    std::unordered_map<uint64_t, Entry>    entries;
+    uint64_t                               generation = 0;
+    size_t                                 held = 0;
+
+    static Platform::Path PathFor(uint64_t key) {
+        return SS.meshCacheFolder.Join(ssprintf("%016llx.slvsmesh", (unsigned long long)key));
+    }
+
+    std::unordered_map<uint64_t, Entry>::iterator Insert(uint64_t key, Entry &entry) {
+        entry.bytes = entry.mesh.l.n * sizeof(STriangle) + entry.form->bytes.size();
+        for(const SSurface &srf : entry.shell.surface) {
+            entry.bytes += sizeof(SSurface) + srf.trim.n * sizeof(STrimBy);
+        }
+        for(const SCurve &sc : entry.shell.curve) {
+            entry.bytes += sizeof(SCurve) + sc.pts.n * sizeof(SCurvePt);
+        }
+
+        // Make room before the new entry goes in, so it isn't what goes.
+        if(held + entry.bytes > MAX_BYTES) {
+            std::vector<std::pair<uint64_t, uint64_t>> byUse;
+            for(const auto &it : entries) {
+                byUse.emplace_back(it.second.used, it.first);
+            }
+            std::sort(byUse.begin(), byUse.end());
+            for(const auto &u : byUse) {
+                if(held + entry.bytes <= MAX_BYTES / 2) break;
+                auto it = entries.find(u.second);
+                held -= it->second.bytes;
+                it->second.shell.Clear();
+                it->second.mesh.Clear();
+                entries.erase(it);
+            }
+        }
+
+        held += entry.bytes;
+        entry.used = ++generation;
+        return entries.emplace(key, entry).first;
+    }
+};
+
+static ShellAndMeshCache GroupMeshes;
+
+// Everything GenerateThisShellAndMesh reads, for this group and its type;
+// without its placement, for a linked part, everything it reads but where
+// the part is put.
+ShellAndMeshKey Group::ThisShellAndMeshKey(Group *srcg, bool withPlacement) {
+    bool placed = withPlacement || type != Type::LINKED;
+    ShellAndMeshHash key;
+    key.Add(placed);
+    key.Add(SS.ChordTolMm());
+    key.Add(SS.maxSegments);
+    key.Add(h.v);
+    key.Add(type);
+    key.Add(subtype);
+    key.Add(opA.v);
+    key.Add(color.ToPackedInt());
+    key.Add(scale);
+    key.Add(valA);
+    key.Add(skipFirst);
+    key.Add(classifyBoolean);
+    key.Add(IsForcedToMesh());
+    key.Add(srcg->meshCombine);
+    for(int i = 0; i < 8; i++) {
+        Param *p = SK.param.FindByIdNoOops(h.param(i));
+        key.Add(p != NULL);
+        // A linked part's offset and rotation are its first seven
+        if(p && (placed || i >= 7)) key.Add(p->val);
+    }
+
+    // The faces are renumbered through the remap table, so that's an input
+    // as well; it's unordered, so its entries are sorted first.
+    std::vector<std::pair<uint32_t, std::pair<uint32_t, int>>> remapped;
+    for(const auto &it : remap) {
+        remapped.push_back({ it.second.v, { it.first.input.v, it.first.copyNumber } });
+    }
+    std::sort(remapped.begin(), remapped.end());
+    key.Add(remapped.size());
+    for(const auto &it : remapped) {
+        key.Add(it.first);
+        key.Add(it.second.first);
+        key.Add(it.second.second);
+    }
+
+    if(type == Type::TRANSLATE || type == Type::ROTATE) {
+        if(srcg->thisKey.hash == 0) return {};
+        key.Add(srcg->thisKey);
+        key.Add(srcg->suppress);
+    } else if(type == Type::EXTRUDE || type == Type::LATHE ||
+              type == Type::REVOLVE || type == Type::HELIX) {
+        Group *src = SK.GetGroup(opA);
+        key.Add(src->polyError.how);
+        for(SBezierLoopSet &sbls : src->bezierLoops.l) {
+            key.Add(sbls.normal);
+            key.Add(sbls.point);
+            for(SBezierLoop &sbl : sbls.l) {
+                key.Add(sbl.l.n);
+                for(const SBezier &sb : sbl.l) {
+                    key.Add(sb.auxA);
+                    key.Add(sb.auxB);
+                    key.Add(sb.entity);
+                    key.Add(sb.deg);
+                    for(int i = 0; i <= sb.deg; i++) {
+                        key.Add(sb.ctrl[i]);
+                        key.Add(sb.weight[i]);
+                    }
+                }
+            }
+        }
+        if(type == Type::EXTRUDE) {
+            // The sides are matched to the line segments for their faces.
+            for(Entity &e : SK.entity) {
+                if(e.group != opA) continue;
+                if(e.type != Entity::Type::LINE_SEGMENT) continue;
+                key.Add(e.h.v);
+                key.Add(SK.GetEntity(e.point[0])->PointGetNum());
+                key.Add(SK.GetEntity(e.point[1])->PointGetNum());
+            }
+        } else {
+            key.Add(SK.GetEntity(predef.origin)->PointGetNum());
+            key.Add(SK.GetEntity(predef.entityB)->VectorGetNum());
+        }
+    } else if(type == Type::LINKED) {
+        key.AddShellAndMesh(&impShell, &impMesh);
+    }
+    return key.Key();
+}
+
+// And what the Boolean with the previous group's running shell or mesh reads.
+ShellAndMeshKey Group::RunningShellAndMeshKey(Group *srcg, Group *prevg) {
+    ShellAndMeshKey prevKey = prevg->runningKey;
+    if(prevKey.hash == 0) {
+        // Not made by GenerateShellAndMesh, like the references'; if it's
+        // empty, it's known all the same.
+        if(!prevg->runningShell.IsEmpty() || !prevg->runningMesh.IsEmpty()) return {};
+        prevKey.hash = 1;
+    }
+    if(thisKey.hash == 0) return {};
+
+    ShellAndMeshHash key;
+    key.Add(SS.ChordTolMm());
+    key.Add(SS.maxSegments);
+    key.Add(thisKey);
+    key.Add(prevg->h.v);
+    key.Add(prevKey);
+    key.Add(srcg->meshCombine);
+    key.Add(IsForcedToMesh());
+    key.Add(classifyBoolean);
+    key.Add(suppress);
+    return key.Key();
+}
+
+void Group::GenerateThisShellAndMesh(Group *srcg) {
     // Don't attempt a lathe or extrusion unless the source section is good:
     // planar and not self-intersecting.
     bool haveSrc = true;
@@ -229,10 +634,6 @@ void Group::GenerateShellAndMesh() {
     }
 
     if(type == Type::TRANSLATE || type == Type::ROTATE) {
-        // A step and repeat gets merged against the group's previous group,
-        // not our own previous group.
-        srcg = SK.GetGroup(opA);
-
         if(!srcg->suppress) {
             if(!IsForcedToMesh()) {
                 GenerateForStepAndRepeat<SShell>(&(srcg->thisShell), &thisShell, srcg->meshCombine);
@@ -370,36 +771,98 @@ void Group::GenerateShellAndMesh() {
                                                   angles, anglef, dists, distf);
         }
     } else if(type == Type::LINKED) {
-        // The imported shell or mesh are copied over, with the appropriate
-        // transformation applied. We also must remap the face entities.
-        Vector offset = {
-            SK.GetParam(h.param(0))->val,
-            SK.GetParam(h.param(1))->val,
-            SK.GetParam(h.param(2))->val };
-        Quaternion q = {
-            SK.GetParam(h.param(3))->val,
-            SK.GetParam(h.param(4))->val,
-            SK.GetParam(h.param(5))->val,
-            SK.GetParam(h.param(6))->val };
-
-        thisMesh.MakeFromTransformationOf(&impMesh, offset, q, scale);
-        thisMesh.RemapFaces(this, 0);
-
-        thisShell.MakeFromTransformationOf(&impShell, offset, q, scale);
-        thisShell.RemapFaces(this, 0);
+        PlaceLinkedShellAndMesh(srcg);
+        return;
     }
 
     if(srcg->meshCombine != CombineAs::ASSEMBLE) {
         thisShell.MergeCoincidentSurfaces();
     }
+}
+
+// The imported shell and mesh are copied over, scaled and with the face
+// entities remapped, and then put where the group places them. What's made
+// before placing is cached without the placement, so that moving a part
+// about an assembly transforms it into place and does nothing else.
+void Group::PlaceLinkedShellAndMesh(Group *srcg) {
+    Vector offset = {
+        SK.GetParam(h.param(0))->val,
+        SK.GetParam(h.param(1))->val,
+        SK.GetParam(h.param(2))->val };
+    Quaternion q = {
+        SK.GetParam(h.param(3))->val,
+        SK.GetParam(h.param(4))->val,
+        SK.GetParam(h.param(5))->val,
+        SK.GetParam(h.param(6))->val };
+
+    SShell partShell = {};
+    SMesh partMesh = {};
+    ShellAndMeshKey partKey = ThisShellAndMeshKey(srcg, /*withPlacement=*/false);
+    if(!GroupMeshes.Find(&partKey, &partShell, &partMesh, NULL)) {
+        size_t remapped = remap.size();
+        Vector origin = Vector::From(0, 0, 0);
+        partMesh.MakeFromTransformationOf(&impMesh, origin, Quaternion::IDENTITY, scale);
+        partMesh.RemapFaces(this, 0);
+
+        partShell.MakeFromTransformationOf(&impShell, origin, Quaternion::IDENTITY, scale);
+        partShell.RemapFaces(this, 0);
+        if(srcg->meshCombine != CombineAs::ASSEMBLE) {
+            partShell.MergeCoincidentSurfaces();
+        }
+        if(remap.size() == remapped) {
+            GroupMeshes.Store(partKey, &partShell, &partMesh, false);
+        }
+    }
+
+    thisMesh.MakeFromTransformationOf(&partMesh, offset, q, 1.0);
+    thisShell.MakeFromTransformationOf(&partShell, offset, q, 1.0);
+    partMesh.Clear();
+    partShell.Clear();
+}
+
+void Group::GenerateShellAndMesh() {
+    bool prevBooleanFailed = booleanFailed;
+    booleanFailed = false;
+
+    Group *srcg = this;
+    if(type == Type::TRANSLATE || type == Type::ROTATE) {
+        // A step and repeat gets merged against the group's previous group,
+        // not our own previous group.
+        srcg = SK.GetGroup(opA);
+    }
+
+    thisShell.Clear();
+    thisMesh.Clear();
+    runningShell.Clear();
+    runningMesh.Clear();
+
+    // Anything made from the same inputs before is copied from the cache
+    // instead of being made again.
+    thisKey = ThisShellAndMeshKey(srcg);
+    auto start = std::chrono::steady_clock::now();
+    if(!GroupMeshes.Find(&thisKey, &thisShell, &thisMesh, NULL)) {
+        size_t remapped = remap.size();
+        GenerateThisShellAndMesh(srcg);
+        // A copy wouldn't add the faces that were remapped just now, so
+        // it's kept only once there are none.
+        if(remap.size() == remapped) {
+            GroupMeshes.Store(thisKey, &thisShell, &thisMesh, false);
+        }
+    }
 
     // So now we've got the mesh or shell for this group. Combine it with
     // the previous group's mesh or shell with the requested Boolean, and
     // we're done.
 
+    timing.shell = ElapsedMs(start);
+
     Group *prevg = srcg->RunningMeshGroup();
 
-    if(!IsForcedToMesh()) {
+    start = std::chrono::steady_clock::now();
+    runningKey = RunningShellAndMeshKey(srcg, prevg);
+    if(GroupMeshes.Find(&runningKey, &runningShell, &runningMesh, &booleanFailed)) {
+        runningShell.booleanFailed = booleanFailed;
+    } else if(!IsForcedToMesh()) {
         SShell *prevs = &(prevg->runningShell);
         GenerateForBoolean<SShell>(prevs, &thisShell, &runningShell,
             srcg->meshCombine);
@@ -408,12 +871,8 @@ void Group::GenerateShellAndMesh() {
             runningShell.MergeCoincidentSurfaces();
         }
 
-        // If the Boolean failed, then we should note that in the text screen
-        // for this group.
         booleanFailed = runningShell.booleanFailed;
-        if(booleanFailed != prevBooleanFailed) {
-            SS.ScheduleShowTW();
-        }
+        GroupMeshes.Store(runningKey, &runningShell, &runningMesh, booleanFailed);
     } else {
         SMesh prevm, thism;
         prevm = {};
@@ -445,6 +904,15 @@ void Group::GenerateShellAndMesh() {
         outm.Clear();
         thism.Clear();
         prevm.Clear();
+
+        GroupMeshes.Store(runningKey, &runningShell, &runningMesh, false);
+    }
+    timing.boolean = ElapsedMs(start);
+
+    // If the Boolean failed, then we should note that in the text screen
+    // for this group.
+    if(booleanFailed != prevBooleanFailed) {
+        SS.ScheduleShowTW();
     }
 
     displayDirty = true;
@@ -477,6 +945,7 @@ void Group::GenerateDisplayItems() {
         } else {
             // We do contribute new solid model, so we have to triangulate the
             // shell, and edge-find the mesh.
+            auto start = std::chrono::steady_clock::now();
             displayMesh.Clear();
             runningShell.TriangulateInto(&displayMesh);
             STriangle *t;
@@ -505,6 +974,7 @@ void Group::GenerateDisplayItems() {
                 builder.GenerateOutlines(&displayOutlines);
                 rawOutlines.Clear();
             }
+            timing.mesh = ElapsedMs(start);
         }
 
         // If we render this mesh, we need to know whether it's transparent,
@@ -443,28 +443,48 @@ public:
         r->style = hs;
     }
 
-    struct VectorHash {
-        size_t operator()(const Vector &v) const {
-            static const size_t size = std::numeric_limits<size_t>::max() / 2 - 1;
-            static const double eps = (4.0 * LENGTH_EPS);
+    // The points placed so far, hashed by the cell of side POINT_CELL that
+    // they fall in. A point within LENGTH_EPS of another is at most one cell
+    // over from it on each axis, so looking in the cells that its tolerance
+    // box touches finds every point it Equals().
+    static constexpr double POINT_CELL = 4.0 * LENGTH_EPS;
 
-            double x = fabs(v.x) / eps;
-            double y = fabs(v.y) / eps;
+    struct PointCell {
+        int64_t x, y, z;
 
-            size_t xs = size_t(fmod(x, double(size)));
-            size_t ys = size_t(fmod(y, double(size)));
-
-            return ys * size + xs;
+        bool operator==(const PointCell &o) const {
+            return x == o.x && y == o.y && z == o.z;
         }
     };
 
-    struct VectorPred {
-        bool operator()(Vector a, Vector b) const {
-            return a.Equals(b, LENGTH_EPS);
+    struct PointCellHash {
+        size_t operator()(const PointCell &c) const {
+            uint64_t h = (uint64_t)c.x * 0x9E3779B97F4A7C15ull;
+            h = (h ^ (uint64_t)c.y) * 0xC2B2AE3D27D4EB4Full;
+            h = (h ^ (uint64_t)c.z) * 0x165667B19E3779F9ull;
+            return (size_t)(h ^ (h >> 32));
         }
     };
 
-    std::unordered_map<Vector, hEntity, VectorHash, VectorPred> points;
+    struct IndexedPoint {
+        Vector  pos;
+        hEntity he;
+        int     next;
+    };
+
+    std::vector<IndexedPoint> points;
+    std::unordered_map<PointCell, int, PointCellHash> pointCells;
+
+    static int64_t pointCellOf(double v) {
+        return (int64_t)floor(v / POINT_CELL);
+    }
+
+    void indexPoint(const Vector &pos, hEntity he) {
+        PointCell c = { pointCellOf(pos.x), pointCellOf(pos.y), pointCellOf(pos.z) };
+        auto it = pointCells.emplace(c, -1).first;
+        points.push_back({ pos, he, it->second });
+        it->second = (int)points.size() - 1;
+    }
 
     void processPoint(hEntity he, bool constrain = true) {
         Entity *e = SK.GetEntity(he);
@@ -479,13 +499,30 @@ public:
             // have point in this position
             return;
         }
-        points.emplace(pos, he);
+        indexPoint(pos, he);
     }
 
+    // The first point placed that Equals p, so which one a cluster of
+    // nearby points is constrained to doesn't depend on the hashing.
     hEntity findPoint(const Vector &p) {
-        auto it = points.find(p);
-        if(it == points.end()) return Entity::NO_ENTITY;
-        return it->second;
+        int best = -1;
+        int64_t x0 = pointCellOf(p.x - LENGTH_EPS), x1 = pointCellOf(p.x + LENGTH_EPS),
+                y0 = pointCellOf(p.y - LENGTH_EPS), y1 = pointCellOf(p.y + LENGTH_EPS),
+                z0 = pointCellOf(p.z - LENGTH_EPS), z1 = pointCellOf(p.z + LENGTH_EPS);
+        for(int64_t x = x0; x <= x1; x++) {
+            for(int64_t y = y0; y <= y1; y++) {
+                for(int64_t z = z0; z <= z1; z++) {
+                    auto it = pointCells.find({ x, y, z });
+                    if(it == pointCells.end()) continue;
+                    for(int i = it->second; i >= 0; i = points[i].next) {
+                        if((best < 0 || i < best) && points[i].pos.Equals(p, LENGTH_EPS)) {
+                            best = i;
+                        }
+                    }
+                }
+            }
+        }
+        return (best < 0) ? Entity::NO_ENTITY : points[best].he;
     }
 
     hEntity createOrGetPoint(const Vector &p) {
@@ -495,7 +532,7 @@ public:
         hRequest hr = SS.GW.AddRequest(Request::Type::DATUM_POINT, /*rememberForUndo=*/false);
         he = hr.entity(0);
         SK.GetEntity(he)->PointForceTo(p);
-        points.emplace(p, he);
+        indexPoint(p, he);
         return he;
     }
 
@@ -539,20 +576,35 @@ public:
         return hr.entity(0);
     }
 
+    // The workplanes in the active group: found among the requests the first
+    // time one's wanted, and then added to as they're made, so that every
+    // arc off the XY plane doesn't look through all of the requests.
+    std::vector<hRequest> workplanes;
+    bool workplanesFound = false;
+
     hEntity findOrCreateWorkplane(const Vector &p, const Quaternion &q) {
+        if(!workplanesFound) {
+            for(auto &r : SK.request) {
+                if((r.type == Request::Type::WORKPLANE) && (r.group == SS.GW.activeGroup)) {
+                    workplanes.push_back(r.h);
+                }
+            }
+            workplanesFound = true;
+        }
+
         Vector z = q.RotationN();
-        for(auto &r : SK.request) {
-            if((r.type == Request::Type::WORKPLANE) && (r.group == SS.GW.activeGroup)) {
-                Vector wp = SK.GetEntity(r.h.entity(1))->PointGetNum();
-                Vector wz = SK.GetEntity(r.h.entity(32))->NormalN();
+        for(hRequest hr : workplanes) {
+            Vector wp = SK.GetEntity(hr.entity(1))->PointGetNum();
+            Vector wz = SK.GetEntity(hr.entity(32))->NormalN();
 
-                if ((p.DistanceToPlane(wz, wp) < LENGTH_EPS) && z.Equals(wz)) {
-                   return r.h.entity(0);
-                }
+            if ((p.DistanceToPlane(wz, wp) < LENGTH_EPS) && z.Equals(wz)) {
+               return hr.entity(0);
             }
         }
 
-        return createWorkplane(p, q);
+        hEntity he = createWorkplane(p, q);
+        workplanes.push_back(he.request());
+        return he;
     }
 
     static void activateWorkplane(hEntity he) {
@@ -1,6 +1,7 @@
 //-----------------------------------------------------------------------------
-// Triangle mesh file reader. Reads an STL file triangle mesh and creates
-// a SovleSpace SMesh from it. Supports only Linking, not import.
+// Triangle mesh file reader. Reads an STL file triangle mesh, binary or
+// text, and creates a SovleSpace SMesh from it. Supports only Linking, not
+// import.
 //
 // Copyright 2020 Paul Kahler.
 //-----------------------------------------------------------------------------
@@ -29,18 +30,56 @@ static bool isEdgeVertex(vertex &v) {
     }
     return result;
 }
-// This function has poor performance, used inside a loop it is O(n**2)
-static void addUnique(std::vector<vertex> &lv, Vector &p, Vector &n) {
-    unsigned int i;
-    for(i=0; i<lv.size(); i++) {
-        if(lv[i].p.Equals(p, MIN_POINT_DISTANCE)) {
-            break;
+// The vertices seen so far, hashed by a grid of cells 2*MIN_POINT_DISTANCE
+// across; a point within MIN_POINT_DISTANCE of a vertex must be in one of the
+// (at most eight) cells its box touches.
+class VertexGrid {
+public:
+    struct Cell {
+        int64_t x, y, z;
+        bool operator==(const Cell &o) const { return x == o.x && y == o.y && z == o.z; }
+    };
+    struct CellHash {
+        size_t operator()(const Cell &c) const {
+            return (size_t)(((uint64_t)c.x * 73856093) ^ ((uint64_t)c.y * 19349663) ^
+                            ((uint64_t)c.z * 83492791));
+        }
+    };
+
+    std::unordered_map<Cell, std::vector<unsigned int>, CellHash> cells;
+
+    static int64_t CellOf(double t) { return (int64_t)floor(t / (2*MIN_POINT_DISTANCE)); }
+
+    // The first vertex added that's within MIN_POINT_DISTANCE of p, as the
+    // linear search through them all would find; or lv.size() if none is.
+    unsigned int Find(const std::vector<vertex> &lv, const Vector &p) const {
+        unsigned int best = (unsigned int)lv.size();
+        for(int64_t x = CellOf(p.x - MIN_POINT_DISTANCE); x <= CellOf(p.x + MIN_POINT_DISTANCE); x++) {
+            for(int64_t y = CellOf(p.y - MIN_POINT_DISTANCE); y <= CellOf(p.y + MIN_POINT_DISTANCE); y++) {
+                for(int64_t z = CellOf(p.z - MIN_POINT_DISTANCE); z <= CellOf(p.z + MIN_POINT_DISTANCE); z++) {
+                    auto it = cells.find(Cell { x, y, z });
+                    if(it == cells.end()) continue;
+                    for(unsigned int i : it->second) {
+                        if(i < best && lv[i].p.Equals(p, MIN_POINT_DISTANCE)) best = i;
+                    }
+                }
+            }
         }
+        return best;
     }
+
+    void Add(const Vector &p, unsigned int i) {
+        cells[Cell { CellOf(p.x), CellOf(p.y), CellOf(p.z) }].push_back(i);
+    }
+};
+
+static void addUnique(std::vector<vertex> &lv, VertexGrid *grid, Vector &p, Vector &n) {
+    unsigned int i = grid->Find(lv, p);
     if(i==lv.size()) {
         vertex v;
         v.p = p;
         lv.push_back(v);
+        grid->Add(p, i);
     }
     // we could improve a little by only storing unique normals
     lv[i].normal.push_back(n);
@@ -114,90 +153,148 @@ static hEntity newLine(EntityList *el, int *id, hEntity p0, hEntity p1) {
     return en.h;
 }
 
+static void SetStlColor(STriangle *tr, uint16_t color) {
+    if(color & 0x8000) {
+        tr->meta.color.red = (color >> 7) & 0xf8;
+        tr->meta.color.green = (color >> 2) & 0xf8;
+        tr->meta.color.blue = (color << 3);
+        tr->meta.color.alpha = 255;
+    } else {
+        tr->meta.color.red = 90;
+        tr->meta.color.green = 120;
+        tr->meta.color.blue = 140;
+        tr->meta.color.alpha = 255;
+    }
+}
+
+// Binary STL: an 80 byte header, a triangle count, and then 50 bytes for each
+// triangle; every triangle is independent, so they're read in parallel.
+static void ReadBinaryStl(const char *data, uint32_t n, std::vector<STriangle> *trs) {
+    trs->resize(n);
+#pragma omp parallel for
+    for(int i = 0; i < (int)n; i++) {
+        const char *p = data + 84 + 50*(size_t)i;
+        float f[12];
+        uint16_t color;
+        memcpy(f, p, sizeof(f));
+        memcpy(&color, p + 48, sizeof(color));
+
+        STriangle tr = {};
+        tr.an = Vector::From(f[0], f[1], f[2]);
+        tr.bn = tr.an;
+        tr.cn = tr.an;
+        tr.a = Vector::From(f[3], f[4], f[5]);
+        tr.b = Vector::From(f[6], f[7], f[8]);
+        tr.c = Vector::From(f[9], f[10], f[11]);
+        SetStlColor(&tr, color);
+        (*trs)[i] = tr;
+    }
+}
+
+// Text STL: "facet normal", "outer loop", three "vertex" lines, "endloop",
+// "endfacet", over and over. Only the keywords that carry numbers matter.
+static bool ReadTextStl(const char *data, size_t size, std::vector<STriangle> *trs) {
+    const char *p = data, *end = data + size;
+    auto token = [&](const char **start) {
+        while(p < end && isspace((unsigned char)*p)) p++;
+        *start = p;
+        while(p < end && !isspace((unsigned char)*p)) p++;
+        return (size_t)(p - *start);
+    };
+    auto number = [&](double *d) {
+        const char *start;
+        size_t len = token(&start);
+        // The mapping isn't NUL-terminated, so strtod gets a copy.
+        char buf[64];
+        if(len == 0 || len >= sizeof(buf)) return false;
+        memcpy(buf, start, len);
+        buf[len] = '\0';
+        char *endptr;
+        *d = strtod(buf, &endptr);
+        return endptr == buf + len;
+    };
+    auto vector = [&](Vector *v) {
+        return number(&v->x) && number(&v->y) && number(&v->z);
+    };
+    auto is = [](const char *start, size_t len, const char *word) {
+        return len == strlen(word) && memcmp(start, word, len) == 0;
+    };
+
+    STriangle tr = {};
+    int vertices = 0;
+    const char *start;
+    size_t len;
+    while((len = token(&start)) > 0) {
+        if(is(start, len, "facet")) {
+            tr = {};
+            vertices = 0;
+            len = token(&start);
+            if(!is(start, len, "normal") || !vector(&tr.an)) return false;
+            tr.bn = tr.an;
+            tr.cn = tr.an;
+            SetStlColor(&tr, 0);
+        } else if(is(start, len, "vertex")) {
+            if(vertices == 3) return false;
+            Vector *v = (vertices == 0) ? &tr.a : (vertices == 1) ? &tr.b : &tr.c;
+            if(!vector(v)) return false;
+            vertices++;
+        } else if(is(start, len, "endfacet")) {
+            if(vertices != 3) return false;
+            trs->push_back(tr);
+        } else if(is(start, len, "solid") || is(start, len, "endsolid")) {
+            // Followed by a name, maybe with spaces; skip the line.
+            while(p < end && *p != '\n') p++;
+        }
+    }
+    return true;
+}
+
 namespace SolveSpace {
 
 bool LinkStl(const Platform::Path &filename, EntityList *el, SMesh *m, SShell *sh) {
     dbp("\nLink STL triangle mesh.");
     el->Clear();
-    std::string data;
-    if(!ReadFile(filename, &data)) {
+    Platform::FileView f;
+    if(!f.Open(filename)) {
         Error("Couldn't read from '%s'", filename.raw.c_str());
         return false;
     }
-    
-    std::stringstream f(data);
 
-    char str[80] = {};
-    f.read(str, 80);
-    
-    if(0==memcmp("solid", str, 5)) {
-    // just returning false will trigger the warning that linked file is not present
-    // best solution is to add an importer for text STL.
-        Message(_("Text-formated STL files are not currently supported"));
+    // A binary file may start with "solid" too, but then its size is just
+    // what its triangle count says.
+    std::vector<STriangle> trs;
+    uint32_t n = 0;
+    if(f.size >= 84) memcpy(&n, f.data + 80, 4);
+    if(f.size >= 84 && f.size == 84 + 50*(uint64_t)n) {
+        ReadBinaryStl(f.data, n, &trs);
+    } else if(f.size >= 5 && 0==memcmp("solid", f.data, 5)) {
+        if(!ReadTextStl(f.data, f.size, &trs)) {
+            Error("Couldn't parse text STL file '%s'", filename.raw.c_str());
+            return false;
+        }
+    } else if(f.size >= 84 && f.size > 84 + 50*(uint64_t)n) {
+        // Some writers leave junk after the last triangle.
+        ReadBinaryStl(f.data, n, &trs);
+    } else {
+        Error("Couldn't read from '%s'", filename.raw.c_str());
+        return false;
+    }
+    f.Close();
+    dbp("%d triangles", (int)trs.size());
+    if(trs.empty()) {
+        Error("No triangles in '%s'", filename.raw.c_str());
         return false;
     }
-    
-    uint32_t n;
-    uint32_t color;
-    
-    f.read((char*)&n, 4);
-    dbp("%d triangles", n);
-    
-    float x,y,z;
-    float xn,yn,zn;
-    
-    std::vector<vertex> verts = {};
-    
-    for(uint32_t i = 0; i<n; i++) {
-        STriangle tr = {};
-
-        // read the triangle normal
-        f.read((char*)&xn, 4);
-        f.read((char*)&yn, 4);
-        f.read((char*)&zn, 4);
-        tr.an = Vector::From(xn,yn,zn);
-        tr.bn = tr.an;
-        tr.cn = tr.an;
-
-        f.read((char*)&x, 4);
-        f.read((char*)&y, 4);
-        f.read((char*)&z, 4);
-        tr.a.x = x;
-        tr.a.y = y;
-        tr.a.z = z;
-
-        f.read((char*)&x, 4);
-        f.read((char*)&y, 4);
-        f.read((char*)&z, 4);
-        tr.b.x = x;
-        tr.b.y = y;
-        tr.b.z = z;
-
-        f.read((char*)&x, 4);
-        f.read((char*)&y, 4);
-        f.read((char*)&z, 4);
-        tr.c.x = x;
-        tr.c.y = y;
-        tr.c.z = z;
-
-        f.read((char*)&color,2);
-        if(color & 0x8000) {
-            tr.meta.color.red = (color >> 7) & 0xf8;
-            tr.meta.color.green = (color >> 2) & 0xf8;
-            tr.meta.color.blue = (color << 3);
-            tr.meta.color.alpha = 255;
-        } else {
-            tr.meta.color.red = 90;
-            tr.meta.color.green = 120;
-            tr.meta.color.blue = 140;
-            tr.meta.color.alpha = 255;        
-        }
 
+    std::vector<vertex> verts = {};
+    VertexGrid grid;
+    m->l.ReserveMore((int)trs.size());
+    for(STriangle &tr : trs) {
         m->AddTriangle(&tr);
         Vector normal = tr.Normal().WithMagnitude(1.0);
-        addUnique(verts, tr.a, normal);
-        addUnique(verts, tr.b, normal);
-        addUnique(verts, tr.c, normal);
+        addUnique(verts, &grid, tr.a, normal);
+        addUnique(verts, &grid, tr.b, normal);
+        addUnique(verts, &grid, tr.c, normal);
     }
     dbp("%d vertices", verts.size());
 
@@ -7,6 +7,7 @@
 #include "solvespace.h"
 
 #include <set>
+#include <queue>
 
 void SMesh::Clear() {
     l.Clear();
@@ -260,47 +261,369 @@ void SMesh::AddAgainstBsp(SMesh *srcm, SBsp3 *bsp3) {
     }
 }
 
-void SMesh::MakeFromUnionOf(SMesh *a, SMesh *b) {
-    SBsp3 *bspa = SBsp3::FromMesh(a);
-    SBsp3 *bspb = SBsp3::FromMesh(b);
+//-----------------------------------------------------------------------------
+// The other way to do a mesh Boolean, without a BSP: each triangle is split
+// only by the triangles of the other mesh that cross it, found with a
+// kd-tree, and then each piece is classified as inside or outside the other
+// mesh by casting a ray from it. A triangle that nothing crosses is one
+// piece, so none of its neighbors' triangles get split against its plane,
+// and the time to build the tree doesn't depend on the order of triangles.
+//-----------------------------------------------------------------------------
+class MeshClassifier {
+public:
+    SKdNode     *other;
+    bool         keepInsideOtherShell;
+    bool         keepCoplanar;
+    bool         flipNormal;
+
+    // A plane to split our triangle along, and the segment in our plane
+    // where the other mesh's triangle meets it, or the edge of a triangle
+    // that's coplanar with ours; the split is needed only where that segment
+    // goes through the piece being split.
+    struct Cut {
+        Vector n;
+        double d;
+        Vector a, b;
+    };
+
+    // Tags would weed out the triangles that are listed twice, but not from
+    // many threads at once. The tree's triangles are all in one array, so
+    // sorting them by address sorts them in a deterministic order too.
+    void ListTrianglesNear(Vector vmin, Vector vmax, std::vector<STriangle *> *tl) const {
+        tl->clear();
+        other->ListTrianglesNear(vmin, vmax, tl);
+        std::sort(tl->begin(), tl->end());
+        tl->erase(std::unique(tl->begin(), tl->end()), tl->end());
+    }
+
+    // The parts of the convex polygon v on either side of the cut's plane;
+    // a vertex within LENGTH_EPS of the plane goes in both.
+    static void SplitConvex(const std::vector<Vector> &v, const Cut &pl,
+                            std::vector<Vector> *pos, std::vector<Vector> *neg)
+    {
+        size_t cnt = v.size();
+        std::vector<double> dt(cnt);
+        bool anyPos = false, anyNeg = false;
+        for(size_t i = 0; i < cnt; i++) {
+            dt[i] = pl.n.Dot(v[i]) - pl.d;
+            if(dt[i] >  LENGTH_EPS) anyPos = true;
+            if(dt[i] < -LENGTH_EPS) anyNeg = true;
+        }
+        if(!anyNeg) { *pos = v; return; }
+        if(!anyPos) { *neg = v; return; }
+
+        for(size_t i = 0; i < cnt; i++) {
+            size_t ip = WRAP(i + 1, cnt);
+            if(dt[i] >= -LENGTH_EPS) pos->push_back(v[i]);
+            if(dt[i] <=  LENGTH_EPS) neg->push_back(v[i]);
+            if((dt[i] >  LENGTH_EPS && dt[ip] < -LENGTH_EPS) ||
+               (dt[i] < -LENGTH_EPS && dt[ip] >  LENGTH_EPS))
+            {
+                double t = dt[i] / (dt[i] - dt[ip]);
+                Vector vi = v[i].Plus((v[ip].Minus(v[i])).ScaledBy(t));
+                pos->push_back(vi);
+                neg->push_back(vi);
+            }
+        }
+    }
+
+    // We cut along the segment from a to b, by the plane through it normal
+    // to ours; that's the other triangle's plane, where it crosses ours, but
+    // neighboring triangles' cuts meet exactly at the ends of their segments.
+    static void AddCut(Vector n, Vector a, Vector b, std::vector<Cut> *cuts) {
+        Vector cn = n.Cross(b.Minus(a));
+        if(cn.Magnitude() < LENGTH_EPS) return;
+        cn = cn.WithMagnitude(1);
+        cuts->push_back({ cn, cn.Dot(a), a, b });
+    }
+
+    // Whether the cut's segment passes through the inside of the convex
+    // piece v, whose vertices go counter-clockwise about n.
+    static bool Crosses(const std::vector<Vector> &v, Vector n, const Cut &cut) {
+        double t0 = 0, t1 = 1;
+        Vector ab = cut.b.Minus(cut.a);
+        for(size_t i = 0; i < v.size(); i++) {
+            Vector e  = v[WRAP(i + 1, v.size())].Minus(v[i]);
+            Vector en = n.Cross(e);
+            double m = en.Magnitude();
+            if(m < LENGTH_EPS) continue;
+            // Inside by more than LENGTH_EPS, at fa + t*fab > 0
+            double fa  = en.Dot(cut.a.Minus(v[i]))/m - LENGTH_EPS,
+                   fab = en.Dot(ab)/m;
+            if(fabs(fab) < LENGTH_EPS*LENGTH_EPS) {
+                if(fa <= 0) return false;
+            } else if(fab > 0) {
+                t0 = max(t0, -fa/fab);
+            } else {
+                t1 = min(t1, -fa/fab);
+            }
+            if(t0 >= t1) return false;
+        }
+        return true;
+    }
+
+    // Whether p is inside the other mesh, by the parity of the number of
+    // its triangles that a ray from p along a coordinate axis goes through.
+    // A ray that passes within LENGTH_EPS of an edge can't be trusted, so
+    // then we try the next axis.
+    bool IsInside(Vector p) const {
+        std::vector<STriangle *> tris;
+        int crossings = 0;
+        for(int k : { 2, 0, 1 }) {
+            int u = WRAP(k + 1, 3), v = WRAP(k + 2, 3);
+            Vector vmin = p, vmax = p;
+            switch(k) {
+                case 0: vmax.x = VERY_POSITIVE; break;
+                case 1: vmax.y = VERY_POSITIVE; break;
+                case 2: vmax.z = VERY_POSITIVE; break;
+            }
+            ListTrianglesNear(vmin, vmax, &tris);
+
+            bool grazes = false;
+            crossings = 0;
+            for(STriangle *tr : tris) {
+                double au = tr->a.Element(u) - p.Element(u),
+                       av = tr->a.Element(v) - p.Element(v),
+                       bu = tr->b.Element(u) - p.Element(u),
+                       bv = tr->b.Element(v) - p.Element(v),
+                       cu = tr->c.Element(u) - p.Element(u),
+                       cv = tr->c.Element(v) - p.Element(v);
+                double area = (bu - au)*(cv - av) - (bv - av)*(cu - au);
+                // Edge-on to the ray; its neighbors will report any graze.
+                if(fabs(area) < LENGTH_EPS*LENGTH_EPS) continue;
+
+                // How far the ray is inside each edge, signed so that
+                // positive is inside.
+                double s = (area > 0) ? 1 : -1;
+                double ea = s*(au*bv - av*bu),
+                       eb = s*(bu*cv - bv*cu),
+                       ec = s*(cu*av - cv*au);
+                double la = sqrt((bu - au)*(bu - au) + (bv - av)*(bv - av)),
+                       lb = sqrt((cu - bu)*(cu - bu) + (cv - bv)*(cv - bv)),
+                       lc = sqrt((au - cu)*(au - cu) + (av - cv)*(av - cv));
+                if(ea < -LENGTH_EPS*la || eb < -LENGTH_EPS*lb ||
+                   ec < -LENGTH_EPS*lc)
+                {
+                    continue;
+                }
+                if(ea <= LENGTH_EPS*la || eb <= LENGTH_EPS*lb ||
+                   ec <= LENGTH_EPS*lc)
+                {
+                    grazes = true;
+                    break;
+                }
+                // Where the ray meets the triangle's plane, by the
+                // barycentric coordinates of the ray in the triangle.
+                double hit = (eb*tr->a.Element(k) + ec*tr->b.Element(k) +
+                              ea*tr->c.Element(k)) / (ea + eb + ec);
+                if(fabs(hit - p.Element(k)) < LENGTH_EPS) {
+                    grazes = true;
+                    break;
+                }
+                if(hit > p.Element(k)) crossings++;
+            }
+            if(!grazes) break;
+        }
+        return (crossings % 2) != 0;
+    }
+
+    // Split tr against the other mesh, and write the pieces that the
+    // Boolean keeps into out. Returns whether any piece was discarded.
+    bool ClassifyTriangle(const STriangle *tr, std::vector<STriangle> *out) const {
+        Vector n = tr->Normal();
+        if(n.Magnitude() < LENGTH_EPS*LENGTH_EPS) return true;
+        n = n.WithMagnitude(1);
+        double d = n.Dot(tr->a);
+
+        Vector vmax = tr->a, vmin = tr->a;
+        (tr->b).MakeMaxMin(&vmax, &vmin);
+        (tr->c).MakeMaxMin(&vmax, &vmin);
+        std::vector<STriangle *> near;
+        ListTrianglesNear(vmin, vmax, &near);
+
+        // The planes of the triangles that cross ours, and the triangles
+        // that lie in our plane; those we cut along their edges instead.
+        std::vector<Cut> cuts;
+        std::vector<STriangle *> coplanar;
+        for(STriangle *ot : near) {
+            Vector on = ot->Normal();
+            if(on.Magnitude() < LENGTH_EPS*LENGTH_EPS) continue;
+            on = on.WithMagnitude(1);
+            double od = on.Dot(ot->a);
+
+            int ourPos = 0, ourNeg = 0;
+            for(const Vector &v : tr->vertices) {
+                double dt = on.Dot(v) - od;
+                if(dt >  LENGTH_EPS) ourPos++;
+                if(dt < -LENGTH_EPS) ourNeg++;
+            }
+            int theirPos = 0, theirNeg = 0;
+            double dt[3];
+            for(int i = 0; i < 3; i++) {
+                dt[i] = n.Dot(ot->vertices[i]) - d;
+                if(dt[i] >  LENGTH_EPS) theirPos++;
+                if(dt[i] < -LENGTH_EPS) theirNeg++;
+            }
+
+            if(ourPos == 0 && ourNeg == 0 && theirPos == 0 && theirNeg == 0) {
+                coplanar.push_back(ot);
+                for(int i = 0; i < 3; i++) {
+                    AddCut(n, ot->vertices[i], ot->vertices[WRAP(i + 1, 3)], &cuts);
+                }
+            } else if(ourPos > 0 && ourNeg > 0 && theirPos < 3 && theirNeg < 3) {
+                // Where the other triangle's edges go through our plane
+                std::vector<Vector> pts;
+                for(int i = 0; i < 3; i++) {
+                    int ip = WRAP(i + 1, 3);
+                    if(fabs(dt[i]) <= LENGTH_EPS) {
+                        pts.push_back(ot->vertices[i]);
+                    } else if((dt[i] >  LENGTH_EPS && dt[ip] < -LENGTH_EPS) ||
+                              (dt[i] < -LENGTH_EPS && dt[ip] >  LENGTH_EPS))
+                    {
+                        double t = dt[i] / (dt[i] - dt[ip]);
+                        Vector a = ot->vertices[i], b = ot->vertices[ip];
+                        pts.push_back(a.Plus((b.Minus(a)).ScaledBy(t)));
+                    }
+                }
+                if(pts.size() < 2) continue;
+                AddCut(n, pts[0], pts[1], &cuts);
+            }
+        }
+
+        std::vector<std::vector<Vector>> pieces, next;
+        pieces.push_back({ tr->a, tr->b, tr->c });
+        for(const Cut &cut : cuts) {
+            next.clear();
+            for(std::vector<Vector> &piece : pieces) {
+                if(!Crosses(piece, n, cut)) {
+                    next.push_back(std::move(piece));
+                    continue;
+                }
+                std::vector<Vector> pos, neg;
+                SplitConvex(piece, cut, &pos, &neg);
+                if(pos.size() >= 3) next.push_back(std::move(pos));
+                if(neg.size() >= 3) next.push_back(std::move(neg));
+            }
+            swap(pieces, next);
+        }
+
+        bool discarded = false;
+        size_t start = out->size();
+        for(const std::vector<Vector> &piece : pieces) {
+            Vector tc = Vector::From(0, 0, 0);
+            for(const Vector &v : piece) tc = tc.Plus(v);
+            tc = tc.ScaledBy(1.0/piece.size());
+
+            // As in SBsp3::InsertInPlane, on a face of the other mesh we
+            // trust the largest triangle to tell which way that face points.
+            bool onFace = false, sameNormal = false;
+            double maxNormalMag = -1;
+            for(STriangle *ot : coplanar) {
+                if(!ot->ContainsPoint(tc)) continue;
+                onFace = true;
+                Vector on = ot->Normal();
+                if(on.Magnitude() > maxNormalMag) {
+                    sameNormal = n.Dot(on) > 0;
+                    maxNormalMag = on.Magnitude();
+                }
+            }
+
+            bool keep;
+            if(onFace) {
+                keep = keepCoplanar && (flipNormal ? !sameNormal : sameNormal);
+            } else {
+                keep = (IsInside(tc) == keepInsideOtherShell);
+            }
+            if(!keep) {
+                discarded = true;
+                continue;
+            }
+            for(size_t i = 1; i + 1 < piece.size(); i++) {
+                out->push_back(STriangle::From(tr->meta, piece[0], piece[i], piece[i+1]));
+            }
+        }
+
+        // Nothing lost, so the pieces tile the whole triangle; keep it whole.
+        if(!discarded) {
+            out->resize(start);
+            out->push_back(*tr);
+        }
+        if(flipNormal) {
+            for(size_t i = start; i < out->size(); i++) {
+                (*out)[i].FlipNormal();
+            }
+        }
+        return discarded;
+    }
+};
+
+void SMesh::AddAgainstKd(SMesh *srcm, SKdNode *kd) {
+    MeshClassifier mc = {};
+    mc.other                = kd;
+    mc.keepInsideOtherShell = keepInsideOtherShell;
+    mc.keepCoplanar         = keepCoplanar;
+    mc.flipNormal           = flipNormal;
+
+    // Each triangle is classified on its own, so they can all be done at
+    // once; the pieces are gathered up in order afterwards.
+    std::vector<std::vector<STriangle>> pieces(srcm->l.n);
+    std::vector<char> discarded(srcm->l.n);
+#pragma omp parallel for schedule(dynamic, 64)
+    for(int i = 0; i < srcm->l.n; i++) {
+        discarded[i] = mc.ClassifyTriangle(&(srcm->l[i]), &pieces[i]);
+    }
+
+    for(int i = 0; i < srcm->l.n; i++) {
+        int pn = l.n;
+        for(const STriangle &tr : pieces[i]) {
+            AddTriangle(&tr);
+        }
+        if(discarded[i] && l.n - pn > 1) {
+            Simplify(pn);
+        }
+    }
+}
 
+void SMesh::AddAgainst(SMesh *srcm, SMesh *other) {
+    if(classifyBoolean) {
+        AddAgainstKd(srcm, SKdNode::From(other));
+    } else {
+        AddAgainstBsp(srcm, SBsp3::FromMesh(other));
+    }
+}
+
+void SMesh::MakeFromUnionOf(SMesh *a, SMesh *b) {
     flipNormal = false;
     keepInsideOtherShell = false;
 
     keepCoplanar = true;
-    AddAgainstBsp(b, bspa);
+    AddAgainst(b, a);
 
     keepCoplanar = false;
-    AddAgainstBsp(a, bspb);
+    AddAgainst(a, b);
 }
 
 void SMesh::MakeFromDifferenceOf(SMesh *a, SMesh *b) {
-    SBsp3 *bspa = SBsp3::FromMesh(a);
-    SBsp3 *bspb = SBsp3::FromMesh(b);
-
     flipNormal = true;
     keepCoplanar = true;
     keepInsideOtherShell = true;
-    AddAgainstBsp(b, bspa);
+    AddAgainst(b, a);
 
     flipNormal = false;
     keepCoplanar = false;
     keepInsideOtherShell = false;
-    AddAgainstBsp(a, bspb);
+    AddAgainst(a, b);
 }
 
 void SMesh::MakeFromIntersectionOf(SMesh *a, SMesh *b) {
-    SBsp3 *bspa = SBsp3::FromMesh(a);
-    SBsp3 *bspb = SBsp3::FromMesh(b);
-
     keepInsideOtherShell = true;
     flipNormal = false;
 
     keepCoplanar = false;
-    AddAgainstBsp(a, bspb);
+    AddAgainst(a, b);
 
     keepCoplanar = true;
-    AddAgainstBsp(b, bspa);
+    AddAgainst(b, a);
 }
 
 void SMesh::MakeFromCopyOf(SMesh *a) {
@@ -327,14 +650,124 @@ void SMesh::MakeFromTransformationOf(SMesh *a, Vector trans,
         if(scale < 0) {
             // The mirroring would otherwise turn a closed mesh inside out.
             swap(tt.a, tt.b);
+            swap(tt.an, tt.bn);
+            tt.an = (tt.an).ScaledBy(-1);
+            tt.bn = (tt.bn).ScaledBy(-1);
+            tt.cn = (tt.cn).ScaledBy(-1);
         }
         tt.a = (q.Rotate(tt.a)).Plus(trans);
         tt.b = (q.Rotate(tt.b)).Plus(trans);
         tt.c = (q.Rotate(tt.c)).Plus(trans);
+        tt.an = q.Rotate(tt.an);
+        tt.bn = q.Rotate(tt.bn);
+        tt.cn = q.Rotate(tt.cn);
         AddTriangle(&tt);
     }
 }
 
+void SMeshIndexed::Clear() {
+    *this = {};
+}
+
+// Vertices are shared only where they're exactly equal, so that the mesh we
+// make back is exactly the one we were made from.
+struct ExactVectorHash {
+    size_t operator()(const Vector &v) const {
+        std::hash<double> hd;
+        return (hd(v.x)*31 + hd(v.y))*31 + hd(v.z);
+    }
+};
+struct ExactVectorEqual {
+    bool operator()(const Vector &a, const Vector &b) const {
+        return a.EqualsExactly(b);
+    }
+};
+
+void SMeshIndexed::MakeFromMesh(const SMesh *m) {
+    Clear();
+    std::unordered_map<Vector, uint32_t, ExactVectorHash, ExactVectorEqual> vi, ni;
+    vertex.reserve(3*m->l.n);
+    normal.reserve(3*m->l.n);
+    meta.reserve(m->l.n);
+    for(const STriangle &tr : m->l) {
+        for(int i = 0; i < 3; i++) {
+            const Vector &p = tr.vertices[i];
+            auto it = vi.emplace(p, (uint32_t)x.size());
+            if(it.second) {
+                x.push_back(p.x);
+                y.push_back(p.y);
+                z.push_back(p.z);
+            }
+            vertex.push_back(it.first->second);
+
+            const Vector &n = tr.normals[i];
+            it = ni.emplace(n, (uint32_t)nx.size());
+            if(it.second) {
+                nx.push_back(n.x);
+                ny.push_back(n.y);
+                nz.push_back(n.z);
+            }
+            normal.push_back(it.first->second);
+        }
+        meta.push_back(tr.meta);
+    }
+}
+
+void SMeshIndexed::MakeMeshInto(SMesh *m) const {
+    m->l.ReserveMore((int)meta.size());
+    for(size_t t = 0; t < meta.size(); t++) {
+        STriangle tr = {};
+        tr.meta = meta[t];
+        for(int i = 0; i < 3; i++) {
+            uint32_t v = vertex[3*t + i], n = normal[3*t + i];
+            tr.vertices[i] = Vector::From(x[v], y[v], z[v]);
+            tr.normals[i]  = Vector::From(nx[n], ny[n], nz[n]);
+        }
+        m->AddTriangle(&tr);
+    }
+}
+
+// As SMesh::MakeFromTransformationOf, but each shared vertex and normal is
+// transformed just once.
+void SMeshIndexed::Transform(Vector trans, Quaternion q, double scale) {
+    Vector u = q.RotationU(), v = q.RotationV(), n = q.RotationN();
+
+    Vector su = u.ScaledBy(scale), sv = v.ScaledBy(scale), sn = n.ScaledBy(scale);
+    double *px = x.data(), *py = y.data(), *pz = z.data();
+    size_t count = x.size();
+#pragma omp simd
+    for(size_t i = 0; i < count; i++) {
+        double xi = px[i], yi = py[i], zi = pz[i];
+        px[i] = su.x*xi + sv.x*yi + sn.x*zi + trans.x;
+        py[i] = su.y*xi + sv.y*yi + sn.y*zi + trans.y;
+        pz[i] = su.z*xi + sv.z*yi + sn.z*zi + trans.z;
+    }
+
+    // A negative scale turns the normals around along with the points.
+    if(scale < 0) {
+        u = u.ScaledBy(-1);
+        v = v.ScaledBy(-1);
+        n = n.ScaledBy(-1);
+    }
+    px = nx.data(), py = ny.data(), pz = nz.data();
+    count = nx.size();
+#pragma omp simd
+    for(size_t i = 0; i < count; i++) {
+        double xi = px[i], yi = py[i], zi = pz[i];
+        px[i] = u.x*xi + v.x*yi + n.x*zi;
+        py[i] = u.y*xi + v.y*yi + n.y*zi;
+        pz[i] = u.z*xi + v.z*yi + n.z*zi;
+    }
+
+    if(scale < 0) {
+        // The mirroring would otherwise turn a closed mesh inside out.
+        for(size_t t = 0; t < meta.size(); t++) {
+            swap(vertex[3*t], vertex[3*t + 1]);
+            swap(normal[3*t], normal[3*t + 1]);
+        }
+    }
+}
+
 bool SMesh::IsEmpty() const { return (l.IsEmpty()); }
 
 uint32_t SMesh::FirstIntersectionWith(Point2d mp) const {
@@ -359,19 +792,544 @@ uint32_t SMesh::FirstIntersectionWith(Point2d mp) const {
 }
 
 Vector SMesh::GetCenterOfMass() const {
-    Vector center = {};
-    double vol = 0.0;
-    for(int i = 0; i < l.n; i++) {
-        const STriangle &tr = l[i];
-        double tvol = tr.SignedVolume();
-        center = center.Plus(tr.a.Plus(tr.b.Plus(tr.c)).ScaledBy(tvol / 4.0));
-        vol += tvol;
+    return GetMassProperties().centroid;
+}
+
+//-----------------------------------------------------------------------------
+// Mass properties, by the divergence theorem: each triangle and the origin
+// make a tetrahedron of signed volume, whose integrals are exact, and the
+// sum over a closed mesh is the solid's. Each thread adds up its share of
+// the triangles into its own sums, which are added together at the end.
+//-----------------------------------------------------------------------------
+enum {
+    MASS_VOLUME,                            // of six times the volume
+    MASS_AREA,                              // of twice the area
+    MASS_X, MASS_Y, MASS_Z,                 // of 24 times the first moments
+    MASS_XX, MASS_YY, MASS_ZZ,              // of 120 times the second
+    MASS_XY, MASS_YZ, MASS_ZX,
+    MASS_SUMS
+};
+
+static inline void AddMassOf(double *s, double ax, double ay, double az,
+                             double bx, double by, double bz,
+                             double cx, double cy, double cz) {
+    double d = ax*(by*cz - bz*cy) + ay*(bz*cx - bx*cz) + az*(bx*cy - by*cx);
+    double ux = bx - ax, uy = by - ay, uz = bz - az;
+    double vx = cx - ax, vy = cy - ay, vz = cz - az;
+    double nx = uy*vz - uz*vy, ny = uz*vx - ux*vz, nz = ux*vy - uy*vx;
+    double sx = ax + bx + cx, sy = ay + by + cy, sz = az + bz + cz;
+
+    s[MASS_VOLUME] += d;
+    s[MASS_AREA]   += sqrt(nx*nx + ny*ny + nz*nz);
+    s[MASS_X]      += d*sx;
+    s[MASS_Y]      += d*sy;
+    s[MASS_Z]      += d*sz;
+    // The integral of x_i*x_j over the tetrahedron is V/20 times the sum,
+    // over its vertices, of their x_i*x_j, plus sx_i*sx_j.
+    s[MASS_XX]     += d*(ax*ax + bx*bx + cx*cx + sx*sx);
+    s[MASS_YY]     += d*(ay*ay + by*by + cy*cy + sy*sy);
+    s[MASS_ZZ]     += d*(az*az + bz*bz + cz*cz + sz*sz);
+    s[MASS_XY]     += d*(ax*ay + bx*by + cx*cy + sx*sy);
+    s[MASS_YZ]     += d*(ay*az + by*bz + cy*cz + sy*sz);
+    s[MASS_ZX]     += d*(az*ax + bz*bx + cz*cx + sz*sx);
+}
+
+static SMassProperties MassPropertiesOf(const double *s) {
+    SMassProperties mp = {};
+    mp.volume = s[MASS_VOLUME] / 6.0;
+    mp.area   = s[MASS_AREA] / 2.0;
+    if(mp.volume == 0.0) return mp;
+
+    double v = mp.volume;
+    Vector c = Vector::From(s[MASS_X], s[MASS_Y], s[MASS_Z]).ScaledBy(1.0 / (24.0*v));
+    mp.centroid = c;
+    // The second moments about the centroid, moved there from the origin
+    double xx = s[MASS_XX] / 120.0 - v*c.x*c.x,
+           yy = s[MASS_YY] / 120.0 - v*c.y*c.y,
+           zz = s[MASS_ZZ] / 120.0 - v*c.z*c.z,
+           xy = s[MASS_XY] / 120.0 - v*c.x*c.y,
+           yz = s[MASS_YZ] / 120.0 - v*c.y*c.z,
+           zx = s[MASS_ZX] / 120.0 - v*c.z*c.x;
+    mp.ixx = yy + zz;
+    mp.iyy = zz + xx;
+    mp.izz = xx + yy;
+    mp.ixy = -xy;
+    mp.iyz = -yz;
+    mp.izx = -zx;
+    return mp;
+}
+
+SMassProperties SMesh::GetMassProperties() const {
+    double s[MASS_SUMS] = {};
+    int n = l.n;
+#pragma omp parallel
+    {
+        double part[MASS_SUMS] = {};
+#pragma omp for nowait
+        for(int i = 0; i < n; i++) {
+            const Vector &a = l[i].a, &b = l[i].b, &c = l[i].c;
+            AddMassOf(part, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z);
+        }
+#pragma omp critical
+        for(int k = 0; k < MASS_SUMS; k++) s[k] += part[k];
+    }
+    return MassPropertiesOf(s);
+}
+
+// As SMesh::GetMassProperties, straight from the coordinate arrays.
+SMassProperties SMeshIndexed::GetMassProperties() const {
+    double s[MASS_SUMS] = {};
+    const double *px = x.data(), *py = y.data(), *pz = z.data();
+    const uint32_t *pv = vertex.data();
+    long n = (long)meta.size();
+#pragma omp parallel
+    {
+        double part[MASS_SUMS] = {};
+#pragma omp for nowait
+        for(long i = 0; i < n; i++) {
+            uint32_t a = pv[3*i], b = pv[3*i + 1], c = pv[3*i + 2];
+            AddMassOf(part, px[a], py[a], pz[a], px[b], py[b], pz[b], px[c], py[c], pz[c]);
+        }
+#pragma omp critical
+        for(int k = 0; k < MASS_SUMS; k++) s[k] += part[k];
+    }
+    return MassPropertiesOf(s);
+}
+
+//-----------------------------------------------------------------------------
+// Simplify a mesh by collapsing its edges, cheapest first. The cost of moving
+// a vertex is the sum of its squared distances from the planes of the
+// triangles that met there originally (Garland and Heckbert's quadric error).
+// A vertex on a naked edge, or on an edge between triangles of different
+// faces or colors, stays where it is, so that outlines survive.
+//-----------------------------------------------------------------------------
+class QuadricSimplifier {
+public:
+    // The symmetric 4x4 matrix of p -> sum((n.p + d)^2), by its upper triangle
+    struct Quadric {
+        double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+
+        void AddPlane(Vector n, double d) {
+            xx += n.x*n.x; xy += n.x*n.y; xz += n.x*n.z; xw += n.x*d;
+            yy += n.y*n.y; yz += n.y*n.z; yw += n.y*d;
+            zz += n.z*n.z; zw += n.z*d;
+            ww += d*d;
+        }
+        void Add(const Quadric &q) {
+            xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+            yy += q.yy; yz += q.yz; yw += q.yw;
+            zz += q.zz; zw += q.zw;
+            ww += q.ww;
+        }
+        double Error(Vector p) const {
+            return p.x*(xx*p.x + 2*(xy*p.y + xz*p.z + xw)) +
+                   p.y*(yy*p.y + 2*(yz*p.z + yw)) +
+                   p.z*(zz*p.z + 2*zw) + ww;
+        }
+        // Where the error is least, if that's well defined
+        bool Minimum(Vector *p) const {
+            double det = xx*(yy*zz - yz*yz) - xy*(xy*zz - yz*xz) + xz*(xy*yz - yy*xz);
+            if(fabs(det) < 1e-12) return false;
+            *p = Vector::From(
+                -(xw*(yy*zz - yz*yz) - xy*(yw*zz - yz*zw) + xz*(yw*yz - yy*zw))/det,
+                -(xx*(yw*zz - zw*yz) - xw*(xy*zz - yz*xz) + xz*(xy*zw - yw*xz))/det,
+                -(xx*(yy*zw - yz*yw) - xy*(xy*zw - yw*xz) + xw*(xy*yz - yy*xz))/det);
+            return true;
+        }
+    };
+
+    struct Tri {
+        int         v[3];
+        Vector      n[3];
+        STriMeta    meta;
+        bool        alive;
+    };
+
+    // Collapse the edge from vertex gone into vertex kept, which moves to p
+    struct Collapse {
+        double      cost;
+        int         gone, kept;
+        int         goneStamp, keptStamp;
+        Vector      p;
+
+        bool operator<(const Collapse &c) const { return cost > c.cost; }
+    };
+
+    std::vector<Vector>             pos;
+    std::vector<Quadric>            quadric;
+    // A fixed vertex doesn't move, but others may be collapsed into it; no
+    // edge at a frozen vertex is collapsed at all.
+    std::vector<bool>               fixed;
+    std::vector<bool>               frozen;
+    std::vector<int>                stamp;
+    std::vector<std::vector<int>>   vtris;
+    std::vector<Tri>                tris;
+    int                             alive;
+    std::priority_queue<Collapse>   heap;
+
+    int AddVertex(Vector p, const Quadric &q, bool isFixed, bool isFrozen) {
+        pos.push_back(p);
+        quadric.push_back(q);
+        fixed.push_back(isFixed || isFrozen);
+        frozen.push_back(isFrozen);
+        return (int)pos.size() - 1;
+    }
+
+    // The quadric of the planes of a triangle's neighborhood, at each of its
+    // vertices
+    static void AddPlanesOf(const Tri &tr, const std::vector<Vector> &pos,
+                            std::vector<Quadric> *quadric) {
+        Vector n = (pos[tr.v[1]].Minus(pos[tr.v[0]])).Cross(
+                    pos[tr.v[2]].Minus(pos[tr.v[0]]));
+        if(n.MagSquared() < LENGTH_EPS*LENGTH_EPS) return;
+        n = n.WithMagnitude(1);
+        double d = -n.Dot(pos[tr.v[0]]);
+        for(int i = 0; i < 3; i++) (*quadric)[tr.v[i]].AddPlane(n, d);
+    }
+
+    void Setup() {
+        stamp.assign(pos.size(), 0);
+        vtris.assign(pos.size(), std::vector<int>());
+        alive = (int)tris.size();
+        for(size_t t = 0; t < tris.size(); t++) {
+            for(int i = 0; i < 3; i++) vtris[tris[t].v[i]].push_back((int)t);
+        }
+        for(size_t v = 0; v < pos.size(); v++) PushEdgesOf((int)v, /*onlyAfter=*/true);
+    }
+
+    void PushEdgesOf(int v, bool onlyAfter) {
+        for(int t : vtris[v]) {
+            const Tri &tr = tris[t];
+            if(!tr.alive) continue;
+            for(int i = 0; i < 3; i++) {
+                int w = tr.v[i];
+                if(w == v || (onlyAfter && w < v)) continue;
+                Collapse c;
+                if(Evaluate(v, w, &c)) heap.push(c);
+            }
+        }
+    }
+
+    bool Evaluate(int a, int b, Collapse *c) const {
+        if((fixed[a] && fixed[b]) || frozen[a] || frozen[b]) return false;
+        Quadric q = quadric[a];
+        q.Add(quadric[b]);
+        if(fixed[a]) {
+            c->kept = a; c->gone = b; c->p = pos[a];
+        } else if(fixed[b]) {
+            c->kept = b; c->gone = a; c->p = pos[b];
+        } else {
+            c->kept = b; c->gone = a;
+            if(!q.Minimum(&c->p) ||
+               c->p.Minus(pos[a]).Magnitude() > 2*pos[b].Minus(pos[a]).Magnitude())
+            {
+                // No one best place, or it's far off; so the best of the two
+                // ends and the middle.
+                Vector mid = pos[a].Plus(pos[b]).ScaledBy(0.5);
+                c->p = mid;
+                if(q.Error(pos[a]) < q.Error(c->p)) c->p = pos[a];
+                if(q.Error(pos[b]) < q.Error(c->p)) c->p = pos[b];
+            }
+        }
+        c->cost      = max(0.0, q.Error(c->p));
+        c->goneStamp = stamp[c->gone];
+        c->keptStamp = stamp[c->kept];
+        return true;
+    }
+
+    // Whether moving vertex v to p turns any of its triangles that don't
+    // also have vertex other too far over, or makes it degenerate.
+    bool Folds(int v, Vector p, int other) const {
+        for(int t : vtris[v]) {
+            const Tri &tr = tris[t];
+            if(!tr.alive) continue;
+            if(tr.v[0] == other || tr.v[1] == other || tr.v[2] == other) continue;
+            Vector a[3], b[3];
+            for(int i = 0; i < 3; i++) {
+                a[i] = pos[tr.v[i]];
+                b[i] = (tr.v[i] == v) ? p : a[i];
+            }
+            Vector n0 = (a[1].Minus(a[0])).Cross(a[2].Minus(a[0])),
+                   n1 = (b[1].Minus(b[0])).Cross(b[2].Minus(b[0]));
+            double m1 = n1.Magnitude();
+            if(m1 < LENGTH_EPS*LENGTH_EPS) return true;
+            if(n0.Dot(n1) < 0.2*n0.Magnitude()*m1) return true;
+        }
+        return false;
+    }
+
+    // An edge may be collapsed only if its ends have no neighbors in common
+    // but the far corners of the triangles on it; else we'd pinch the mesh.
+    bool KeepsManifold(int a, int b) const {
+        std::vector<int> na, nb;
+        int shared = 0;
+        for(int t : vtris[a]) {
+            const Tri &tr = tris[t];
+            if(!tr.alive) continue;
+            bool hasB = false;
+            for(int i = 0; i < 3; i++) {
+                if(tr.v[i] == b) hasB = true;
+                if(tr.v[i] != a) na.push_back(tr.v[i]);
+            }
+            if(hasB) shared++;
+        }
+        for(int t : vtris[b]) {
+            const Tri &tr = tris[t];
+            if(!tr.alive) continue;
+            for(int i = 0; i < 3; i++) {
+                if(tr.v[i] != b) nb.push_back(tr.v[i]);
+            }
+        }
+        std::sort(na.begin(), na.end());
+        na.erase(std::unique(na.begin(), na.end()), na.end());
+        std::sort(nb.begin(), nb.end());
+        nb.erase(std::unique(nb.begin(), nb.end()), nb.end());
+        std::vector<int> common;
+        std::set_intersection(na.begin(), na.end(), nb.begin(), nb.end(),
+                              std::back_inserter(common));
+        return (int)common.size() == shared;
+    }
+
+    void Run(int target, double maxCost) {
+        while(alive > target && !heap.empty()) {
+            Collapse c = heap.top();
+            heap.pop();
+            if(c.cost > maxCost) break;
+            if(c.goneStamp != stamp[c.gone] || c.keptStamp != stamp[c.kept]) continue;
+            if(!KeepsManifold(c.gone, c.kept)) continue;
+            if(Folds(c.gone, c.p, c.kept) || Folds(c.kept, c.p, c.gone)) continue;
+
+            for(int t : vtris[c.gone]) {
+                Tri &tr = tris[t];
+                if(!tr.alive) continue;
+                int i;
+                for(i = 0; i < 3; i++) {
+                    if(tr.v[i] == c.kept) break;
+                }
+                if(i < 3) {
+                    tr.alive = false;
+                    alive--;
+                    continue;
+                }
+                // The corner keeps its normal; it's near enough.
+                for(i = 0; i < 3; i++) {
+                    if(tr.v[i] == c.gone) tr.v[i] = c.kept;
+                }
+                vtris[c.kept].push_back(t);
+            }
+            vtris[c.gone].clear();
+            stamp[c.gone]++;
+            stamp[c.kept]++;
+            pos[c.kept] = c.p;
+            quadric[c.kept].Add(quadric[c.gone]);
+
+            // Drop the dead triangles, and queue the edges again at their
+            // new costs.
+            std::vector<int> &vt = vtris[c.kept];
+            vt.erase(std::remove_if(vt.begin(), vt.end(),
+                        [&](int t) { return !tris[t].alive; }), vt.end());
+            PushEdgesOf(c.kept, /*onlyAfter=*/false);
+        }
+    }
+};
+
+// The state of a mesh being simplified in passes: its vertices, with their
+// quadrics, and its triangles, as indices to those.
+struct SimplifyState {
+    std::vector<Vector>                         pos;
+    std::vector<QuadricSimplifier::Quadric>     quadric;
+    std::vector<bool>                           fixed;
+    std::vector<QuadricSimplifier::Tri>         tris;
+};
+
+// Simplify the triangles tl of st, leaving alone the vertices marked frozen,
+// until there are target of them left or the next collapse costs more than
+// maxCost. What's left of those triangles is added to out, and the vertices
+// that moved are written back to st.
+static void SimplifyRegion(SimplifyState *st, const std::vector<bool> &frozen,
+                           const std::vector<int> &tl, int target, double maxCost,
+                           std::vector<QuadricSimplifier::Tri> *out)
+{
+    QuadricSimplifier qs = {};
+    std::unordered_map<int, int> local;
+    std::vector<int> global;
+    qs.tris.reserve(tl.size());
+    for(int t : tl) {
+        QuadricSimplifier::Tri tr = st->tris[t];
+        for(int i = 0; i < 3; i++) {
+            int g = tr.v[i];
+            auto it = local.emplace(g, (int)global.size());
+            if(it.second) {
+                qs.AddVertex(st->pos[g], st->quadric[g], st->fixed[g],
+                             !frozen.empty() && frozen[g]);
+                global.push_back(g);
+            }
+            tr.v[i] = it.first->second;
+        }
+        qs.tris.push_back(tr);
+    }
+
+    qs.Setup();
+    qs.Run(target, maxCost);
+
+    for(size_t v = 0; v < global.size(); v++) {
+        if(qs.frozen[v]) continue;
+        st->pos[global[v]]     = qs.pos[v];
+        st->quadric[global[v]] = qs.quadric[v];
+    }
+    for(QuadricSimplifier::Tri &tr : qs.tris) {
+        if(!tr.alive) continue;
+        for(int i = 0; i < 3; i++) tr.v[i] = global[tr.v[i]];
+        out->push_back(tr);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Make a simplified copy of mesh a, with at most maxTriangles triangles, or
+// with no vertex moved by much more than maxError; zero for either means no
+// limit.
+//
+// A big mesh is cut into slabs along its longest axis, and the slabs are
+// simplified each on a thread of its own, with the vertices they share left
+// alone. That's done in passes, each allowed collapses up to a greater cost,
+// and with the cuts between the slabs moved each time so that what was left
+// alone at one gets simplified at the next. Then what's left goes once more
+// to meet the budget. The number of slabs doesn't depend on the number of
+// threads, so nor does the result.
+//-----------------------------------------------------------------------------
+void SMesh::MakeFromSimplificationOf(SMesh *a, int maxTriangles, double maxError) {
+    ssassert(this != a, "Can't make from simplification of self");
+    int target = max(0, maxTriangles);
+    double maxCost = (maxError > 0) ? maxError*maxError : VERY_POSITIVE;
+    if((target == 0 || a->l.n <= target) && maxError <= 0) {
+        MakeFromCopyOf(a);
+        return;
+    }
+
+    SimplifyState st = {};
+    SMeshIndexed w = {};
+    w.MakeFromMesh(a);
+    int n = (int)w.meta.size();
+    st.pos.resize(w.x.size());
+    for(size_t v = 0; v < st.pos.size(); v++) {
+        st.pos[v] = Vector::From(w.x[v], w.y[v], w.z[v]);
+    }
+    st.tris.resize(n);
+    st.quadric.assign(st.pos.size(), QuadricSimplifier::Quadric {});
+    for(int t = 0; t < n; t++) {
+        QuadricSimplifier::Tri &tr = st.tris[t];
+        for(int i = 0; i < 3; i++) {
+            uint32_t nv = w.normal[3*t + i];
+            tr.v[i] = (int)w.vertex[3*t + i];
+            tr.n[i] = Vector::From(w.nx[nv], w.ny[nv], w.nz[nv]);
+        }
+        tr.meta  = w.meta[t];
+        tr.alive = true;
+        QuadricSimplifier::AddPlanesOf(tr, st.pos, &st.quadric);
+    }
+    w.Clear();
+
+    // An edge that isn't on exactly two triangles, or is between triangles
+    // of different faces or colors, is part of an outline; hold it still.
+    st.fixed.assign(st.pos.size(), false);
+    std::unordered_map<uint64_t, std::pair<int, int>> edges;
+    for(int t = 0; t < n; t++) {
+        for(int i = 0; i < 3; i++) {
+            uint64_t p = (uint64_t)st.tris[t].v[i], q = (uint64_t)st.tris[t].v[WRAP(i+1, 3)];
+            auto it = edges.emplace(min(p, q) << 32 | max(p, q), std::make_pair(0, t));
+            it.first->second.first++;
+            const STriMeta &m0 = st.tris[it.first->second.second].meta, &m1 = st.tris[t].meta;
+            if(m0.face != m1.face || !m0.color.Equals(m1.color)) {
+                it.first->second.first = -1;
+            }
+        }
+    }
+    for(const auto &e : edges) {
+        if(e.second.first == 2) continue;
+        st.fixed[(size_t)(e.first >> 32)] = true;
+        st.fixed[(size_t)(e.first & 0xffffffff)] = true;
+    }
+    edges.clear();
+
+    const int MIN_SLAB_TRIANGLES = 4096, MAX_SLABS = 16, PASSES = 8;
+    int slabs = max(1, min(MAX_SLABS, n / MIN_SLAB_TRIANGLES));
+    Vector vmax, vmin;
+    a->GetBounding(&vmax, &vmin);
+    Vector size = vmax.Minus(vmin);
+    int axis = (size.x > size.y) ? ((size.x > size.z) ? 0 : 2)
+                                 : ((size.y > size.z) ? 1 : 2);
+    // Start from collapses that move a vertex by a millionth of the model,
+    // and allow sixteen times the cost (four times the distance) each pass.
+    double passCost = 1e-12*size.MagSquared();
+    std::vector<QuadricSimplifier::Tri> out;
+    for(int pass = 0; slabs > 1 && pass < PASSES; pass++) {
+        int m = (int)st.tris.size();
+        if(target > 0 && m <= target) break;
+        passCost = min(passCost*16, maxCost);
+
+        std::vector<double> along(m);
+        for(int t = 0; t < m; t++) {
+            const QuadricSimplifier::Tri &tr = st.tris[t];
+            along[t] = st.pos[tr.v[0]].Element(axis) + st.pos[tr.v[1]].Element(axis) +
+                       st.pos[tr.v[2]].Element(axis);
+        }
+        std::vector<int> order(m);
+        for(int t = 0; t < m; t++) order[t] = t;
+        std::sort(order.begin(), order.end(), [&](int p, int q) {
+            return along[p] < along[q] || (along[p] == along[q] && p < q);
+        });
+
+        // A vertex in more than one slab is left alone in all of them, so
+        // that no slab changes a triangle in another. Every other pass, the
+        // cuts go half a slab over.
+        std::vector<std::vector<int>> tl(slabs);
+        std::vector<int> slabOf(st.pos.size(), -1);
+        std::vector<bool> shared(st.pos.size(), false);
+        int64_t shift = (pass % 2) ? m/(2*slabs) : 0;
+        for(int k = 0; k < m; k++) {
+            int s = (int)(((k + shift)*slabs/m) % slabs), t = order[k];
+            tl[s].push_back(t);
+            for(int i = 0; i < 3; i++) {
+                int v = st.tris[t].v[i];
+                if(slabOf[v] < 0) {
+                    slabOf[v] = s;
+                } else if(slabOf[v] != s) {
+                    shared[v] = true;
+                }
+            }
+        }
+
+        std::vector<std::vector<QuadricSimplifier::Tri>> slabOut(slabs);
+#pragma omp parallel for schedule(dynamic)
+        for(int s = 0; s < slabs; s++) {
+            int slabTarget = (int)((int64_t)target*(int)tl[s].size()/m);
+            SimplifyRegion(&st, shared, tl[s], slabTarget, passCost, &slabOut[s]);
+        }
+        out.clear();
+        for(auto &so : slabOut) {
+            out.insert(out.end(), so.begin(), so.end());
+        }
+        std::swap(st.tris, out);
+        if(passCost >= maxCost) break;
+    }
+
+    std::vector<int> all(st.tris.size());
+    for(size_t t = 0; t < st.tris.size(); t++) all[t] = (int)t;
+    out.clear();
+    SimplifyRegion(&st, {}, all, target, maxCost, &out);
+
+    l.ReserveMore((int)out.size());
+    for(const QuadricSimplifier::Tri &tr : out) {
+        STriangle t = {};
+        t.meta = tr.meta;
+        for(int i = 0; i < 3; i++) {
+            t.vertices[i] = st.pos[tr.v[i]];
+            t.normals[i]  = tr.n[i];
+        }
+        AddTriangle(&t);
     }
-    return center.ScaledBy(1.0 / vol);
 }
 
-STriangleLl *STriangleLl::Alloc()
-    { return (STriangleLl *)AllocTemporary(sizeof(STriangleLl)); }
 SKdNode *SKdNode::Alloc()
     { return (SKdNode *)AllocTemporary(sizeof(SKdNode)); }
 
@@ -391,114 +1349,167 @@ SKdNode *SKdNode::From(SMesh *m) {
         swap(tra[k], tra[n]);
     }
 
-    STriangleLl *tll = NULL;
+    STriangle **tris = (STriangle **)AllocTemporary((m->l.n) * sizeof(*tris));
     for(i = 0; i < m->l.n; i++) {
-        STriangleLl *tn = STriangleLl::Alloc();
-        tn->tri = &(tra[i]);
-        tn->next = tll;
-        tll = tn;
+        tris[i] = &(tra[i]);
     }
 
-    return SKdNode::From(tll);
+    return SKdNode::From(tris, m->l.n);
 }
 
-SKdNode *SKdNode::From(STriangleLl *tll) {
-    int which = 0;
+SKdNode *SKdNode::From(STriangle **tris, int n) {
     SKdNode *ret = Alloc();
 
-    int i;
-    int gtc[3] = { 0, 0, 0 }, ltc[3] = { 0, 0, 0 }, allc = 0;
+    int i, k;
+    int gtc[3] = { 0, 0, 0 }, ltc[3] = { 0, 0, 0 };
     double badness[3] = { 0, 0, 0 };
     double split[3] = { 0, 0, 0 };
 
-    if(!tll) {
-        goto leaf;
-    }
-
-    for(i = 0; i < 3; i++) {
-        int tcnt = 0;
-        STriangleLl *ll;
-        for(ll = tll; ll; ll = ll->next) {
-            split[i] += (ll->tri->a).Element(i);
-            split[i] += (ll->tri->b).Element(i);
-            split[i] += (ll->tri->c).Element(i);
-            tcnt++;
-        }
-        split[i] /= (tcnt*3);
+    if(n >= 3) {
+        for(i = 0; i < 3; i++) {
+            for(k = 0; k < n; k++) {
+                split[i] += (tris[k]->a).Element(i);
+                split[i] += (tris[k]->b).Element(i);
+                split[i] += (tris[k]->c).Element(i);
+            }
+            split[i] /= (n*3);
 
-        for(ll = tll; ll; ll = ll->next) {
-            STriangle *tr = ll->tri;
+            for(k = 0; k < n; k++) {
+                STriangle *tr = tris[k];
 
-            double a = (tr->a).Element(i),
-                   b = (tr->b).Element(i),
-                   c = (tr->c).Element(i);
+                double a = (tr->a).Element(i),
+                       b = (tr->b).Element(i),
+                       c = (tr->c).Element(i);
 
-            if(a < split[i] + KDTREE_EPS ||
-               b < split[i] + KDTREE_EPS ||
-               c < split[i] + KDTREE_EPS)
-            {
-                ltc[i]++;
+                if(a < split[i] + KDTREE_EPS ||
+                   b < split[i] + KDTREE_EPS ||
+                   c < split[i] + KDTREE_EPS)
+                {
+                    ltc[i]++;
+                }
+                if(a > split[i] - KDTREE_EPS ||
+                   b > split[i] - KDTREE_EPS ||
+                   c > split[i] - KDTREE_EPS)
+                {
+                    gtc[i]++;
+                }
             }
-            if(a > split[i] - KDTREE_EPS ||
-               b > split[i] - KDTREE_EPS ||
-               c > split[i] - KDTREE_EPS)
-            {
-                gtc[i]++;
+            badness[i] = pow((double)ltc[i], 4) + pow((double)gtc[i], 4);
+        }
+        int which;
+        if(badness[0] < badness[1] && badness[0] < badness[2]) {
+            which = 0;
+        } else if(badness[1] < badness[2]) {
+            which = 1;
+        } else {
+            which = 2;
+        }
+
+        if(n != gtc[which] && n != ltc[which]) {
+            STriangle **lgt = (STriangle **)AllocTemporary(gtc[which] * sizeof(*lgt));
+            STriangle **llt = (STriangle **)AllocTemporary(ltc[which] * sizeof(*llt));
+            int ngt = 0, nlt = 0;
+            // Taken from the back, so each side lists its triangles in the
+            // opposite order to ours, as it always has.
+            for(k = n - 1; k >= 0; k--) {
+                STriangle *tr = tris[k];
+
+                double a = (tr->a).Element(which),
+                       b = (tr->b).Element(which),
+                       c = (tr->c).Element(which);
+
+                if(a < split[which] + KDTREE_EPS ||
+                   b < split[which] + KDTREE_EPS ||
+                   c < split[which] + KDTREE_EPS)
+                {
+                    llt[nlt++] = tr;
+                }
+                if(a > split[which] - KDTREE_EPS ||
+                   b > split[which] - KDTREE_EPS ||
+                   c > split[which] - KDTREE_EPS)
+                {
+                    lgt[ngt++] = tr;
+                }
             }
-            if(i == 0) allc++;
+
+            ret->which = which;
+            ret->c = split[which];
+            ret->gt = SKdNode::From(lgt, ngt);
+            ret->lt = SKdNode::From(llt, nlt);
+            return ret;
         }
-        badness[i] = pow((double)ltc[i], 4) + pow((double)gtc[i], 4);
-    }
-    if(badness[0] < badness[1] && badness[0] < badness[2]) {
-        which = 0;
-    } else if(badness[1] < badness[2]) {
-        which = 1;
-    } else {
-        which = 2;
     }
 
-    if(allc < 3 || allc == gtc[which] || allc == ltc[which]) {
-        goto leaf;
+    ret->ReserveLeaf(n);
+    for(k = 0; k < n; k++) {
+        ret->AddToLeaf(tris[k]);
     }
+    return ret;
+}
 
-    STriangleLl *ll;
-    STriangleLl *lgt, *llt; lgt = llt = NULL;
-    for(ll = tll; ll; ll = ll->next) {
-        STriangle *tr = ll->tri;
+void SKdNode::ReserveLeaf(int n) {
+    if(n <= trisAllocated) return;
+
+    STriangle **nt = (STriangle **)AllocTemporary(n * sizeof(*nt));
+    if(trisN > 0) memcpy(nt, tris, trisN * sizeof(*nt));
+    tris = nt;
+    // Everything before is left in the temporary arena, like the rest of
+    // the tree.
+    for(int k = 0; k < 3; k++) {
+        double *nmin = (double *)AllocTemporary(n * sizeof(double)),
+               *nmax = (double *)AllocTemporary(n * sizeof(double));
+        if(trisN > 0) {
+            memcpy(nmin, boxMin[k], trisN * sizeof(double));
+            memcpy(nmax, boxMax[k], trisN * sizeof(double));
+        }
+        boxMin[k] = nmin;
+        boxMax[k] = nmax;
+    }
+    trisAllocated = n;
+}
 
-        double a = (tr->a).Element(which),
-               b = (tr->b).Element(which),
-               c = (tr->c).Element(which);
+void SKdNode::AddToLeaf(STriangle *tr) {
+    if(trisN == trisAllocated) {
+        ReserveLeaf(max(8, 2*trisAllocated));
+    }
+    tris[trisN] = tr;
+    UpdateBox(trisN);
+    trisN++;
+}
 
-        if(a < split[which] + KDTREE_EPS ||
-           b < split[which] + KDTREE_EPS ||
-           c < split[which] + KDTREE_EPS)
-        {
-            STriangleLl *n = STriangleLl::Alloc();
-            *n = *ll;
-            n->next = llt;
-            llt = n;
-        }
-        if(a > split[which] - KDTREE_EPS ||
-           b > split[which] - KDTREE_EPS ||
-           c > split[which] - KDTREE_EPS)
-        {
-            STriangleLl *n = STriangleLl::Alloc();
-            *n = *ll;
-            n->next = lgt;
-            lgt = n;
-        }
+void SKdNode::UpdateBox(int i) {
+    STriangle *tr = tris[i];
+    for(int k = 0; k < 3; k++) {
+        double a = (tr->a).Element(k),
+               b = (tr->b).Element(k),
+               c = (tr->c).Element(k);
+        boxMin[k][i] = min(a, min(b, c));
+        boxMax[k][i] = max(a, max(b, c));
     }
+}
 
-    ret->which = which;
-    ret->c = split[which];
-    ret->gt = SKdNode::From(lgt);
-    ret->lt = SKdNode::From(llt);
-    return ret;
+// Whether the box around leaf triangle i comes within KDTREE_EPS of the box
+// from min to max, along the first axes axes (so 2 tests in xy only).
+bool SKdNode::BoxMeets(int i, Vector min, Vector max, int axes) const {
+    for(int k = 0; k < axes; k++) {
+        if(boxMax[k][i] < min.Element(k) - KDTREE_EPS) return false;
+        if(boxMin[k][i] > max.Element(k) + KDTREE_EPS) return false;
+    }
+    return true;
+}
 
-leaf:
-    ret->tris = tll;
-    return ret;
+// Every triangle whose box comes near the box from min to max; one that
+// straddles a split is listed once for each leaf that it's in.
+void SKdNode::ListTrianglesNear(Vector min, Vector max,
+                                std::vector<STriangle *> *tl) const {
+    if(gt && lt) {
+        if(min.Element(which) < c + KDTREE_EPS) lt->ListTrianglesNear(min, max, tl);
+        if(max.Element(which) > c - KDTREE_EPS) gt->ListTrianglesNear(min, max, tl);
+        return;
+    }
+    for(int i = trisN - 1; i >= 0; i--) {
+        if(BoxMeets(i, min, max, 3)) tl->push_back(tris[i]);
+    }
 }
 
 void SKdNode::ClearTags() const {
@@ -506,9 +1517,8 @@ void SKdNode::ClearTags() const {
         gt->ClearTags();
         lt->ClearTags();
     } else {
-        STriangleLl *ll;
-        for(ll = tris; ll; ll = ll->next) {
-            ll->tri->tag = 0;
+        for(int i = 0; i < trisN; i++) {
+            tris[i]->tag = 0;
         }
     }
 }
@@ -531,10 +1541,7 @@ void SKdNode::AddTriangle(STriangle *tr) {
             gt->AddTriangle(tr);
         }
     } else {
-        STriangleLl *tn = STriangleLl::Alloc();
-        tn->tri = tr;
-        tn->next = tris;
-        tris = tn;
+        AddToLeaf(tr);
     }
 }
 
@@ -542,12 +1549,12 @@ void SKdNode::MakeMeshInto(SMesh *m) const {
     if(gt) gt->MakeMeshInto(m);
     if(lt) lt->MakeMeshInto(m);
 
-    STriangleLl *ll;
-    for(ll = tris; ll; ll = ll->next) {
-        if(ll->tri->tag) continue;
+    for(int i = trisN - 1; i >= 0; i--) {
+        STriangle *tr = tris[i];
+        if(tr->tag) continue;
 
-        m->AddTriangle(ll->tri);
-        ll->tri->tag = 1;
+        m->AddTriangle(tr);
+        tr->tag = 1;
     }
 }
 
@@ -555,12 +1562,12 @@ void SKdNode::ListTrianglesInto(std::vector<STriangle *> *tl) const {
     if(gt) gt->ListTrianglesInto(tl);
     if(lt) lt->ListTrianglesInto(tl);
 
-    STriangleLl *ll;
-    for(ll = tris; ll; ll = ll->next) {
-        if(ll->tri->tag) continue;
+    for(int i = trisN - 1; i >= 0; i--) {
+        STriangle *tr = tris[i];
+        if(tr->tag) continue;
 
-        tl->push_back(ll->tri);
-        ll->tri->tag = 1;
+        tl->push_back(tr);
+        tr->tag = 1;
     }
 }
 
@@ -584,36 +1591,11 @@ void SKdNode::SnapToVertex(Vector v, SMesh *extras) {
         // second call will do nothing, because the modified triangle will
         // already contain v
     } else {
-        STriangleLl *ll;
-        for(ll = tris; ll; ll = ll->next) {
-            STriangle *tr = ll->tri;
-
+        for(int i = trisN - 1; i >= 0; i--) {
             // Do a cheap bbox test first
-            int k;
-            bool mightHit = true;
-
-            for(k = 0; k < 3; k++) {
-                double trA = (tr->a).Element(k);
-                double trB = (tr->b).Element(k);
-                double trC = (tr->c).Element(k);
-                double vk = v.Element(k);
-                if(trA < vk - KDTREE_EPS &&
-                   trB < vk - KDTREE_EPS &&
-                   trC < vk - KDTREE_EPS)
-                {
-                    mightHit = false;
-                    break;
-                }
-                if(trA > vk + KDTREE_EPS &&
-                   trB > vk + KDTREE_EPS &&
-                   trC > vk + KDTREE_EPS)
-                {
-                    mightHit = false;
-                    break;
-                }
-            }
-            if(!mightHit) continue;
+            if(!BoxMeets(i, v, v, 3)) continue;
 
+            STriangle *tr = tris[i];
             if(tr->a.Equals(v)) { tr->a = v; continue; }
             if(tr->b.Equals(v)) { tr->b = v; continue; }
             if(tr->c.Equals(v)) { tr->c = v; continue; }
@@ -622,22 +1604,27 @@ void SKdNode::SnapToVertex(Vector v, SMesh *extras) {
                 continue;
             }
 
+            // Splitting only shrinks the triangle, so the box of any other
+            // leaf it's in still holds it; this leaf's is kept tight.
             if(v.OnLineSegment(tr->a, tr->b)) {
                 STriangle nt = STriangle::From(tr->meta, tr->a, v, tr->c);
                 extras->AddTriangle(&nt);
                 tr->a = v;
+                UpdateBox(i);
                 continue;
             }
             if(v.OnLineSegment(tr->b, tr->c)) {
                 STriangle nt = STriangle::From(tr->meta, tr->b, v, tr->a);
                 extras->AddTriangle(&nt);
                 tr->b = v;
+                UpdateBox(i);
                 continue;
             }
             if(v.OnLineSegment(tr->c, tr->a)) {
                 STriangle nt = STriangle::From(tr->meta, tr->c, v, tr->b);
                 extras->AddTriangle(&nt);
                 tr->c = v;
+                UpdateBox(i);
                 continue;
             }
         }
@@ -811,11 +1798,14 @@ void SKdNode::OcclusionTestLine(SEdge orig, SEdgeList *sel, int cnt) const {
             gt->OcclusionTestLine(orig, sel, cnt);
         }
     } else {
-        STriangleLl *ll;
-        for(ll = tris; ll; ll = ll->next) {
-            STriangle *tr = ll->tri;
+        // A triangle that misses the edge in xy can't hide any of it.
+        Vector emax = orig.a, emin = orig.a;
+        (orig.b).MakeMaxMin(&emax, &emin);
+        for(int i = trisN - 1; i >= 0; i--) {
+            STriangle *tr = tris[i];
 
             if(tr->tag == cnt) continue;
+            if(!BoxMeets(i, emin, emax, 2)) continue;
 
             SplitLinesAgainstTriangle(sel, tr);
             tr->tag = cnt;
@@ -823,6 +1813,83 @@ void SKdNode::OcclusionTestLine(SEdge orig, SEdgeList *sel, int cnt) const {
     }
 }
 
+//-----------------------------------------------------------------------------
+// The triangles that OcclusionTestLine would split the edge orig against, in
+// the same order and each once, less those that can't hide any of it: the
+// ones facing away, and the ones it lies wholly in front of. Nothing in the
+// tree is written, so any number of threads can ask at once.
+//-----------------------------------------------------------------------------
+void SKdNode::ListOccludersOf(SEdge orig, std::vector<STriangle *> *tl) const {
+    size_t start = tl->size();
+    ListOccludersNear(orig, tl);
+
+    // A triangle that straddles a split is found in each leaf it's in; keep
+    // only the first of those, as the tags would.
+    size_t n = tl->size() - start;
+    if(n < 2) return;
+    std::vector<std::pair<STriangle *, size_t>> order(n);
+    for(size_t i = 0; i < n; i++) {
+        order[i] = { (*tl)[start + i], i };
+    }
+    std::sort(order.begin(), order.end());
+    std::vector<char> repeat(n);
+    bool any = false;
+    for(size_t i = 1; i < n; i++) {
+        if(order[i].first == order[i - 1].first) {
+            repeat[order[i].second] = 1;
+            any = true;
+        }
+    }
+    if(!any) return;
+    size_t kept = start;
+    for(size_t i = 0; i < n; i++) {
+        if(!repeat[i]) (*tl)[kept++] = (*tl)[start + i];
+    }
+    tl->resize(kept);
+}
+
+void SKdNode::ListOccludersNear(const SEdge &orig, std::vector<STriangle *> *tl) const {
+    if(gt && lt) {
+        double ac = (orig.a).Element(which),
+               bc = (orig.b).Element(which);
+        if(ac < c + KDTREE_EPS || bc < c + KDTREE_EPS || which == 2) {
+            lt->ListOccludersNear(orig, tl);
+        }
+        if(ac > c - KDTREE_EPS || bc > c - KDTREE_EPS || which == 2) {
+            gt->ListOccludersNear(orig, tl);
+        }
+        return;
+    }
+
+    Vector emax = orig.a, emin = orig.a;
+    (orig.b).MakeMaxMin(&emax, &emin);
+    for(int i = trisN - 1; i >= 0; i--) {
+        if(!BoxMeets(i, emin, emax, 2)) continue;
+
+        STriangle *tr = tris[i];
+        Vector tn = tr->Normal().WithMagnitude(1);
+        if(!(tn.z > LENGTH_EPS)) continue;
+        // Well clear of the LENGTH_EPS that SplitLinesAgainstTriangle allows,
+        // so no piece of the edge could be found behind the plane there.
+        double td = tn.Dot(tr->a);
+        if((orig.a).Dot(tn) - td >= 0 && (orig.b).Dot(tn) - td >= 0) continue;
+
+        tl->push_back(tr);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// As OcclusionTestLine, but without tagging the triangles as they're tested,
+// so that many edges can be tested at once against the one tree.
+//-----------------------------------------------------------------------------
+void SKdNode::OcclusionTestLine(SEdge orig, SEdgeList *sel) const {
+    std::vector<STriangle *> tl;
+    ListOccludersOf(orig, &tl);
+    for(STriangle *tr : tl) {
+        SplitLinesAgainstTriangle(sel, tr);
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Search the mesh for a triangle with an edge from b to a (i.e., the mate
 // for the edge from a to b), and increment info->count each time that we
@@ -852,12 +1919,15 @@ void SKdNode::FindEdgeOn(Vector a, Vector b, int cnt, bool coplanarIsInter,
     }
 
     // We are a leaf node; so we iterate over all the triangles in our
-    // linked list.
-    STriangleLl *ll;
-    for(ll = tris; ll; ll = ll->next) {
-        STriangle *tr = ll->tri;
+    // list. One whose box misses the edge's can't share an edge with it or
+    // be crossed by it, so it can be passed over.
+    Vector emax = a, emin = a;
+    b.MakeMaxMin(&emax, &emin);
+    for(int i = trisN - 1; i >= 0; i--) {
+        STriangle *tr = tris[i];
 
         if(tr->tag == cnt) continue;
+        if(!BoxMeets(i, emin, emax, 3)) continue;
 
         // Test if this triangle matches up with the given edge
         if((a.Equals(tr->b) && b.Equals(tr->a)) ||
@@ -1154,7 +2224,10 @@ void SMesh::RemoveDegenerateTriangles() {
 
 double SMesh::CalculateVolume() const {
     double vol = 0;
-    for(STriangle tr : l) {
+    int n = l.n;
+#pragma omp parallel for reduction(+:vol)
+    for(int i = 0; i < n; i++) {
+        STriangle tr = l[i];
         // Translate to place vertex A at (x, y, 0)
         Vector trans = Vector::From(tr.a.x, tr.a.y, 0);
         tr.a = (tr.a).Minus(trans);
@@ -1206,12 +2279,18 @@ double SMesh::CalculateVolume() const {
 }
 
 double SMesh::CalculateSurfaceArea(const std::vector<uint32_t> &faces) const {
+    // One pass over the triangles, however many faces are asked for
+    std::vector<uint32_t> sorted = faces;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
     double area = 0.0;
-    for(uint32_t f : faces) {
-        for(const STriangle &t : l) {
-            if(f != t.meta.face) continue;
-            area += t.Area();
-        }
+    int n = l.n;
+#pragma omp parallel for reduction(+:area)
+    for(int i = 0; i < n; i++) {
+        const STriangle &t = l[i];
+        if(!std::binary_search(sorted.begin(), sorted.end(), t.meta.face)) continue;
+        area += t.Area();
     }
     return area;
 }
@@ -47,10 +47,15 @@ Commands:
         being triangulated first.
     export-surfaces --output <pattern>
         Exports exact surfaces of solids in the sketch, if any.
-    regenerate [--chord-tol <tolerance>]
+    regenerate [--output <pattern>] [--chord-tol <tolerance>] [--timing]
         Reloads all imported files, regenerates the sketch, and saves it.
         Note that, although this is not an export command, it uses absolute
         chord tolerance, and can be used to prepare assemblies for export.
+        The output defaults to the input file; one that isn't a .slvs file
+        gets the regenerated mesh instead, as with export-mesh. With
+        --timing, a line of JSON giving the milliseconds each group took
+        to solve, make its shell, combine with the groups before it, and
+        triangulate is written to stdout for every file.
 )");
 
     auto FormatListFromFileFilters = [](const std::vector<Platform::FileFilter> &filters) {
@@ -86,6 +91,45 @@ File formats:
     FormatListFromFileFilters(Platform::SurfaceFileFilters).c_str());
 }
 
+static std::string JsonString(const std::string &str) {
+    std::string out = "\"";
+    for(char c : str) {
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if((unsigned char)c < 0x20) {
+            char escape[8];
+            sprintf(escape, "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Writes a line of JSON with what each group of the sketch just regenerated
+// cost; the groups' meshes are made first, if they haven't been.
+static void WriteGroupTimings(const Platform::Path &input) {
+    printf("{\"file\":%s,\"groups\":[", JsonString(input.raw).c_str());
+    bool first = true;
+    for(hGroup hg : SK.groupOrder) {
+        Group *g = SK.GetGroup(hg);
+        if(hg == Group::HGROUP_REFERENCES) continue;
+        g->GenerateDisplayItems();
+
+        printf("%s{\"name\":%s,\"solved\":%s,\"dof\":%d,"
+               "\"solve_ms\":%.3f,\"shell_ms\":%.3f,\"boolean_ms\":%.3f,"
+               "\"mesh_ms\":%.3f}",
+               first ? "" : ",", JsonString(g->name).c_str(),
+               g->IsSolvedOkay() ? "true" : "false", g->solved.dof,
+               g->timing.solve, g->timing.shell, g->timing.boolean, g->timing.mesh);
+        first = false;
+    }
+    printf("]}\n");
+    fflush(stdout);
+}
+
 static bool RunCommand(const std::vector<std::string> args) {
     if(args.size() < 2) return false;
 
@@ -99,6 +143,7 @@ static bool RunCommand(const std::vector<std::string> args) {
     std::function<void(const Platform::Path &)> runner;
 
     std::vector<Platform::Path> inputFiles;
+    Platform::Path inputFile;
     auto ParseInputFile = [&](size_t &argn) {
         std::string arg = args[argn];
         if(arg[0] != '-') {
@@ -310,21 +355,40 @@ static bool RunCommand(const std::vector<std::string> args) {
             sfw.ExportSurfacesTo(output);
         };
     } else if(args[1] == "regenerate") {
+        bool timing = false;
+        auto ParseTiming = [&](size_t &argn) {
+            if(args[argn] == "--timing") {
+                timing = true;
+                return true;
+            } else return false;
+        };
+
         for(size_t argn = 2; argn < args.size(); argn++) {
             if(!(ParseInputFile(argn) ||
-                 ParseChordTolerance(argn))) {
+                 ParseOutputPattern(argn) ||
+                 ParseChordTolerance(argn) ||
+                 ParseTiming(argn))) {
                 fprintf(stderr, "Unrecognized option '%s'.\n", args[argn].c_str());
                 return false;
             }
         }
 
-        outputPattern = "%.slvs";
+        if(outputPattern.empty()) {
+            outputPattern = "%.slvs";
+        }
 
         runner = [&](const Platform::Path &output) {
             SS.exportChordTol = chordTol;
-            SS.exportMode = true;
 
-            SS.SaveToFile(output);
+            if(output.HasExtension("slvs")) {
+                SS.exportMode = true;
+                SS.SaveToFile(output);
+            } else {
+                SS.ExportMeshTo(output);
+            }
+            if(timing) {
+                WriteGroupTimings(inputFile);
+            }
         };
     } else {
         fprintf(stderr, "Unrecognized command '%s'.\n", args[1].c_str());
@@ -345,7 +409,8 @@ static bool RunCommand(const std::vector<std::string> args) {
         return false;
     }
 
-    for(const Platform::Path &inputFile : inputFiles) {
+    for(const Platform::Path &input : inputFiles) {
+        inputFile = input;
         Platform::Path absInputFile = inputFile.Expand(/*fromCurrentDirectory=*/true);
 
         Platform::Path outputFile = Platform::Path::From(outputPattern);
@@ -16,7 +16,9 @@
 #   include <windows.h>
 #   include <shellapi.h>
 #else
+#   include <fcntl.h>
 #   include <unistd.h>
+#   include <sys/mman.h>
 #   include <sys/stat.h>
 #endif
 
@@ -448,6 +450,66 @@ bool ReadFile(const Platform::Path &filename, std::string *data) {
     return true;
 }
 
+bool FileView::Open(const Platform::Path &filename) {
+    Close();
+    ssassert(filename.raw.length() == strlen(filename.raw.c_str()),
+             "Unexpected null byte in middle of a path");
+#if defined(WIN32)
+    HANDLE file = CreateFileW(Widen(filename.Expand(/*fromCurrentDirectory=*/true).raw).c_str(),
+                              GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER length;
+        if(GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+            HANDLE view = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if(view != NULL) {
+                mapping = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(view);
+                if(mapping != NULL) size = (size_t)length.QuadPart;
+            }
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = open(filename.raw.c_str(), O_RDONLY);
+    if(fd >= 0) {
+        struct stat st;
+        if(fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p != MAP_FAILED) {
+                mapping = p;
+                size = (size_t)st.st_size;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if(mapping != NULL) {
+        data = (const char *)mapping;
+        return true;
+    }
+
+    // Empty, or not something we can map; read it instead.
+    if(!ReadFile(filename, &copy)) return false;
+    data = copy.data();
+    size = copy.size();
+    return true;
+}
+
+void FileView::Close() {
+    if(mapping != NULL) {
+#if defined(WIN32)
+        UnmapViewOfFile(mapping);
+#else
+        munmap(mapping, size);
+#endif
+        mapping = NULL;
+    }
+    copy.clear();
+    data = NULL;
+    size = 0;
+}
+
 bool WriteFile(const Platform::Path &filename, const std::string &data) {
     FILE *f = OpenFile(filename, "wb");
     if(f == NULL) return false;
@@ -18,10 +18,12 @@ std::string Narrow(const std::wstring &s);
 std::wstring Widen(const std::string &s);
 #endif
 
+// Plain strings, so that each file including this doesn't construct a copy
+// at startup.
 #if defined(_WIN32)
-    const std::string embeddedFont = "res://fonts/BitstreamVeraSans-Roman-builtin.ttf";
+    const char *const embeddedFont = "res://fonts/BitstreamVeraSans-Roman-builtin.ttf";
 #else   // Linux and macOS
-    const std::string embeddedFont = "BitstreamVeraSans-Roman-builtin.ttf";
+    const char *const embeddedFont = "BitstreamVeraSans-Roman-builtin.ttf";
 #endif
 
 // A filesystem path, respecting the conventions of the current platform.
@@ -68,6 +70,26 @@ bool ReadFile(const Platform::Path &filename, std::string *data);
 bool WriteFile(const Platform::Path &filename, const std::string &data);
 void RemoveFile(const Platform::Path &filename);
 
+// A file's contents, read-only; mapped into memory where that works, so
+// that a large file is paged in as it's read instead of copied up front.
+class FileView {
+public:
+    const char *data = NULL;
+    size_t      size = 0;
+
+    FileView() {}
+    FileView(const FileView &) = delete;
+    FileView &operator=(const FileView &) = delete;
+    ~FileView() { Close(); }
+
+    bool Open(const Platform::Path &filename);
+    void Close();
+
+private:
+    void        *mapping = NULL;
+    std::string  copy;
+};
+
 // Resource loading function.
 const void *LoadResource(const std::string &name, size_t *size);
 
@@ -77,10 +99,68 @@ std::vector<std::string> InitCli(int argc, char **argv);
 // Debug print function.
 void DebugPrint(const char *fmt, ...);
 
+// Heap allocation for the solver's long-lived storage; this comes from the
+// bundled mimalloc in builds with SLVS_USE_MIMALLOC, and from malloc otherwise.
+void *AllocHeap(size_t size);
+void FreeHeap(void *ptr);
+
+// A standard allocator over AllocHeap, for containers.
+template<class T>
+struct HeapAllocator {
+    typedef T value_type;
+
+    HeapAllocator() = default;
+    template<class U>
+    HeapAllocator(const HeapAllocator<U> &) {}
+
+    T *allocate(size_t n) { return (T *)AllocHeap(n * sizeof(T)); }
+    void deallocate(T *ptr, size_t) { FreeHeap(ptr); }
+
+    template<class U>
+    bool operator==(const HeapAllocator<U> &) const { return true; }
+    template<class U>
+    bool operator!=(const HeapAllocator<U> &) const { return false; }
+};
+
 // Temporary arena functions.
 void *AllocTemporary(size_t size);
 void FreeAllTemporary();
 
+// A position in the temporary arena; releasing to it frees everything
+// allocated since it was taken, so nested work can free its temporaries early.
+struct TemporaryMark {
+    size_t page;
+    size_t used;
+};
+TemporaryMark MarkTemporary();
+void ReleaseTemporary(const TemporaryMark &mark);
+
+// The bytes that the calling thread's temporary arena has handed out in all,
+// the bytes it holds now, and the most it has held at once since the peak
+// was last reset.
+struct TemporaryUsage {
+    size_t allocated;
+    size_t held;
+    size_t peak;
+};
+TemporaryUsage GetTemporaryUsage();
+void ResetTemporaryPeak();
+// Free the calling thread's empty temporary pages, past the ones that the
+// peak needs.
+void TrimTemporary();
+
+// The pages of a temporary arena, handed from one thread to another: a
+// thread that has done some of another's work gives its pages up, and the
+// other takes them in to its own arena, which then frees them as if it had
+// allocated what's on them.
+struct TemporaryPage {
+    void   *data;
+    size_t  size;
+    size_t  used;
+};
+std::vector<TemporaryPage> GiveTemporary();
+void TakeTemporary(const std::vector<TemporaryPage> &pages);
+
 } // namespace Platform
 } // namespace SolveSpace
 
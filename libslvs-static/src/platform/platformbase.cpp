@@ -2,11 +2,18 @@
 #include <vector>
 #include <memory>
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
 
 #if defined(WIN32)
 #   include <Windows.h>
 #endif // defined(WIN32)
 
+#if defined(SLVS_USE_MIMALLOC)
+#   include <mimalloc.h>
+#endif
+
 namespace SolveSpace {
 namespace Platform {
 
@@ -64,46 +71,157 @@ void DebugPrint(const char *fmt, ...) {
 
 #endif
 
+//-----------------------------------------------------------------------------
+// Heap allocation.
+//-----------------------------------------------------------------------------
+
+// mimalloc keeps a heap for each thread, so solves running on several threads
+// don't contend for one allocator lock the way they do with glibc malloc.
+void *AllocHeap(size_t size) {
+#if defined(SLVS_USE_MIMALLOC)
+    void *ptr = mi_malloc(size);
+#else
+    void *ptr = malloc(size);
+#endif
+    ssassert(ptr != NULL || size == 0, "out of memory");
+    return ptr;
+}
+
+void FreeHeap(void *ptr) {
+#if defined(SLVS_USE_MIMALLOC)
+    mi_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 //-----------------------------------------------------------------------------
 // Temporary arena.
 //-----------------------------------------------------------------------------
 
-// Arena-style memory pool for temporary allocations
+// A bump allocator over pages that are kept from one use to the next, so that
+// freeing everything is just rewinding to the first page.
 struct TempMemoryPool {
-    struct Arena {
-        std::vector<void*> allocations;
-        
-        ~Arena() {
-            for(void* ptr : allocations) {
-                free(ptr);
-            }
-        }
-        
-        void *alloc(size_t size) {
-            void *ptr = calloc(1, size);
-            ssassert(ptr != NULL, "out of memory");
-            allocations.push_back(ptr);
-            return ptr;
-        }
+    static const size_t PAGE_SIZE = 64 * 1024;
+    static const size_t ALIGN     = alignof(std::max_align_t);
+
+    struct Page {
+        char   *data;
+        size_t  size;
+        size_t  used;
     };
-    
-    std::unique_ptr<Arena> current;
-    
-    TempMemoryPool() : current(new Arena()) {}
-    
+
+    std::vector<Page> pages;
+    // The page we are allocating from; all the ones after it are empty.
+    size_t current = 0;
+    // What's been handed out in all, what's held now, and the most held.
+    size_t allocated = 0;
+    size_t held      = 0;
+    size_t peak      = 0;
+
+    ~TempMemoryPool() {
+        for(Page &p : pages) {
+            FreeHeap(p.data);
+        }
+    }
+
     void *alloc(size_t size) {
-        if (!current) {
-            current.reset(new Arena());
+        size = (std::max(size, (size_t)1) + ALIGN - 1) & ~(ALIGN - 1);
+        if(current < pages.size() && pages[current].used > 0 &&
+           pages[current].size - pages[current].used < size) {
+            current++;
+        }
+        if(current == pages.size() || pages[current].size < size) {
+            // Too big for the next empty page (or there isn't one), so put a
+            // new page in front of it; oversized requests get their own.
+            Page p = {};
+            p.size = std::max(size, PAGE_SIZE);
+            p.data = (char *)AllocHeap(p.size);
+            pages.insert(pages.begin() + current, p);
+        }
+
+        Page &p = pages[current];
+        void *ptr = p.data + p.used;
+        p.used += size;
+        allocated += size;
+        held      += size;
+        peak       = std::max(peak, held);
+        // Callers expect zeroed memory, as from calloc.
+        memset(ptr, 0, size);
+        return ptr;
+    }
+
+    TemporaryMark mark() const {
+        TemporaryMark m = {};
+        m.page = current;
+        m.used = current < pages.size() ? pages[current].used : 0;
+        return m;
+    }
+
+    void release(const TemporaryMark &m) {
+        ssassert(m.page <= current, "Releasing past the current temporary mark");
+        for(size_t i = m.page + 1; i <= current && i < pages.size(); i++) {
+            pages[i].used = 0;
+        }
+        if(m.page < pages.size()) pages[m.page].used = m.used;
+        current = m.page;
+        held = 0;
+        for(size_t i = 0; i <= current && i < pages.size(); i++) {
+            held += pages[i].used;
         }
-        return current->alloc(size);
     }
-    
+
     void reset() {
-        // Create a new arena, destroying the old one
-        current.reset(new Arena());
+        release(TemporaryMark {});
+    }
+
+    void trim() {
+        size_t keep = 0, i;
+        for(i = 0; i < pages.size(); i++) {
+            if(i > current && keep >= peak) break;
+            keep += pages[i].size;
+        }
+        for(size_t j = i; j < pages.size(); j++) {
+            FreeHeap(pages[j].data);
+        }
+        pages.resize(i);
+    }
+
+    std::vector<TemporaryPage> give() {
+        std::vector<TemporaryPage> given;
+        size_t end = std::min(current + 1, pages.size());
+        for(size_t i = 0; i < end; i++) {
+            if(pages[i].used > 0) given.push_back({ pages[i].data, pages[i].size, pages[i].used });
+        }
+        // (the empty ones we keep)
+        pages.erase(std::remove_if(pages.begin(), pages.end(),
+                                   [](const Page &p) { return p.used > 0; }),
+                    pages.end());
+        current = 0;
+        held    = 0;
+        return given;
+    }
+
+    void take(const std::vector<TemporaryPage> &given) {
+        if(given.empty()) return;
+        // After the page we're allocating from, so that releasing to any
+        // mark taken before frees them too; what's left on that page goes
+        // unused until then.
+        size_t at = (current < pages.size() && pages[current].used > 0) ? current + 1 : current;
+        for(const TemporaryPage &g : given) {
+            pages.insert(pages.begin() + at, Page { (char *)g.data, g.size, g.used });
+            at++;
+            allocated += g.used;
+            held      += g.used;
+        }
+        current = at - 1;
+        peak    = std::max(peak, held);
     }
 };
 
+const size_t TempMemoryPool::PAGE_SIZE;
+const size_t TempMemoryPool::ALIGN;
+
 static thread_local TempMemoryPool TempArena;
 
 void *AllocTemporary(size_t size) {
@@ -114,5 +232,37 @@ void FreeAllTemporary() {
     TempArena.reset();
 }
 
+TemporaryMark MarkTemporary() {
+    return TempArena.mark();
+}
+
+void ReleaseTemporary(const TemporaryMark &mark) {
+    TempArena.release(mark);
+}
+
+TemporaryUsage GetTemporaryUsage() {
+    TemporaryUsage u = {};
+    u.allocated = TempArena.allocated;
+    u.held      = TempArena.held;
+    u.peak      = TempArena.peak;
+    return u;
+}
+
+void ResetTemporaryPeak() {
+    TempArena.peak = TempArena.held;
+}
+
+void TrimTemporary() {
+    TempArena.trim();
+}
+
+std::vector<TemporaryPage> GiveTemporary() {
+    return TempArena.give();
+}
+
+void TakeTemporary(const std::vector<TemporaryPage> &pages) {
+    TempArena.take(pages);
+}
+
 }
 }
@@ -223,35 +223,84 @@ void SEdgeList::AddEdge(Vector a, Vector b, int auxA, int auxB, int tag) {
     l.Add(&e);
 }
 
-bool SEdgeList::AssembleContour(Vector first, Vector last, SContour *dest,
-                                SEdge *errorAt, bool keepDir, int start) const
-{
-    int i;
+//-----------------------------------------------------------------------------
+// The ends of the edges in a list, hashed by a grid of cells at least
+// 2*LENGTH_EPS across, so that every end that Equals() a point is in one of
+// the (at most eight) cells its LENGTH_EPS box touches. Finding the next
+// edge of a contour then doesn't mean a scan over the whole list.
+//-----------------------------------------------------------------------------
+namespace {
+class SEdgeEnds {
+public:
+    struct Cell {
+        int64_t x, y, z;
+        bool operator==(const Cell &o) const { return x == o.x && y == o.y && z == o.z; }
+    };
+    struct CellHash {
+        size_t operator()(const Cell &c) const {
+            return (size_t)(((uint64_t)c.x * 73856093) ^ ((uint64_t)c.y * 19349663) ^
+                            ((uint64_t)c.z * 83492791));
+        }
+    };
+
+    const SEdgeList *sel;
+    std::unordered_map<Cell, int, CellHash> head;
+    // End e is edge e/2's a if even and b if odd; the chains run from the
+    // last added, so each goes in decreasing order.
+    std::vector<int> next;
+
+    static constexpr double CELL = 4*LENGTH_EPS;
+
+    static int64_t CellOf(double t) { return (int64_t)floor(t/CELL); }
+
+    Vector EndOf(int e) const { return (e % 2 == 0) ? sel->l[e/2].a : sel->l[e/2].b; }
+
+    void Build(const SEdgeList *el, int start, bool keepDir) {
+        sel = el;
+        next.assign(2*el->l.n, -1);
+        head.reserve(2*(el->l.n - start));
+        for(int i = start; i < el->l.n; i++) {
+            if(el->l[i].tag) continue;
+            for(int e = 2*i; e < 2*i + (keepDir ? 1 : 2); e++) {
+                Vector p = EndOf(e);
+                auto it = head.emplace(Cell { CellOf(p.x), CellOf(p.y), CellOf(p.z) }, -1).first;
+                next[e] = it->second;
+                it->second = e;
+            }
+        }
+    }
+
+    // The same end that a scan through the list would find first: the
+    // untagged edge of least index with an end at p, and its a before its b.
+    int Find(Vector p) const {
+        int best = -1;
+        for(int64_t x = CellOf(p.x - LENGTH_EPS); x <= CellOf(p.x + LENGTH_EPS); x++) {
+            for(int64_t y = CellOf(p.y - LENGTH_EPS); y <= CellOf(p.y + LENGTH_EPS); y++) {
+                for(int64_t z = CellOf(p.z - LENGTH_EPS); z <= CellOf(p.z + LENGTH_EPS); z++) {
+                    auto it = head.find(Cell { x, y, z });
+                    if(it == head.end()) continue;
+                    for(int e = it->second; e >= 0; e = next[e]) {
+                        if(best >= 0 && e > best) continue;
+                        if(sel->l[e/2].tag) continue;
+                        if(EndOf(e).Equals(p)) best = e;
+                    }
+                }
+            }
+        }
+        return best;
+    }
+};
+}
 
+static bool AssembleContourFrom(const SEdgeEnds &ends, Vector first, Vector last,
+                                SContour *dest, SEdge *errorAt)
+{
     dest->AddPoint(first);
     dest->AddPoint(last);
 
     do {
-        for(i = start; i < l.n; i++) {
-            /// @todo fix const!
-            SEdge *se = const_cast<SEdge*>(&(l[i]));
-            if(se->tag) continue;
-
-            if(se->a.Equals(last)) {
-                dest->AddPoint(se->b);
-                last = se->b;
-                se->tag = 1;
-                break;
-            }
-            // Don't allow backwards edges if keepDir is true.
-            if(!keepDir && se->b.Equals(last)) {
-                dest->AddPoint(se->a);
-                last = se->a;
-                se->tag = 1;
-                break;
-            }
-        }
-        if(i >= l.n) {
+        int e = ends.Find(last);
+        if(e < 0) {
             // Couldn't assemble a closed contour; mark where.
             if(errorAt) {
                 errorAt->a = first;
@@ -259,15 +308,33 @@ bool SEdgeList::AssembleContour(Vector first, Vector last, SContour *dest,
             }
             return false;
         }
-
+        /// @todo fix const!
+        SEdge *se = const_cast<SEdge*>(&(ends.sel->l[e/2]));
+        // An end at b is a backwards edge, only there without keepDir.
+        last = (e % 2 == 0) ? se->b : se->a;
+        dest->AddPoint(last);
+        se->tag = 1;
     } while(!last.Equals(first));
 
     return true;
 }
 
+bool SEdgeList::AssembleContour(Vector first, Vector last, SContour *dest,
+                                SEdge *errorAt, bool keepDir, int start) const
+{
+    SEdgeEnds ends;
+    ends.Build(this, start, keepDir);
+    return AssembleContourFrom(ends, first, last, dest, errorAt);
+}
+
 bool SEdgeList::AssemblePolygon(SPolygon *dest, SEdge *errorAt, bool keepDir) const {
     dest->Clear();
 
+    // Every contour starts from an edge after the ones used so far, and
+    // those before it are all tagged; so one hash of the ends does for all.
+    SEdgeEnds ends;
+    ends.Build(this, 0, keepDir);
+
     bool allClosed = true;
     Vector first = Vector::From(0, 0, 0);
     Vector last  = Vector::From(0, 0, 0);
@@ -281,7 +348,7 @@ bool SEdgeList::AssemblePolygon(SPolygon *dest, SEdge *errorAt, bool keepDir) co
             // Create a new empty contour in our polygon, and finish assembling
             // into that contour.
             dest->AddEmptyContour();
-            if(!AssembleContour(first, last, dest->l.Last(), errorAt, keepDir, i+1)) {
+            if(!AssembleContourFrom(ends, first, last, dest->l.Last(), errorAt)) {
                 allClosed = false;
             }
             // But continue assembling, even if some of the contours are open
@@ -480,6 +547,105 @@ int SKdNodeEdges::AnyEdgeCrossings(Vector a, Vector b, int cnt,
     return inters;
 }
 
+//-----------------------------------------------------------------------------
+// A uniform grid over an edge list. Two edges can only cross within
+// LENGTH_EPS of both, so each edge goes in every cell its box (grown by a
+// bit more than that) reaches, and a crossing test looks only at the edges
+// in the cells under its own box.
+//-----------------------------------------------------------------------------
+static const double EDGE_GRID_SLOP = 2*LENGTH_EPS;
+static const int EDGE_GRID_MAX_CELLS = 1024;
+
+void SEdgeGrid::Build(const SEdgeList *el) {
+    sel = el;
+    start.clear();
+    edge.clear();
+    int n = el->l.n;
+
+    Vector max = Vector::From(VERY_NEGATIVE, VERY_NEGATIVE, VERY_NEGATIVE),
+           min = Vector::From(VERY_POSITIVE, VERY_POSITIVE, VERY_POSITIVE);
+    for(const SEdge &se : el->l) {
+        (se.a).MakeMaxMin(&max, &min);
+        (se.b).MakeMaxMin(&max, &min);
+    }
+    Vector d = (n > 0) ? max.Minus(min) : Vector::From(0, 0, 0);
+    // Across the two axes the edges spread along the most, with about one
+    // edge to a cell
+    int flat = (d.x <= d.y && d.x <= d.z) ? 0 : (d.y <= d.z ? 1 : 2);
+    ax = (flat + 1) % 3;
+    ay = (flat + 2) % 3;
+    double w = d.Element(ax), h = d.Element(ay);
+    cell = std::max(sqrt(w*h/std::max(n, 1)), std::max(w, h)/EDGE_GRID_MAX_CELLS);
+    if(!(cell > LENGTH_EPS)) cell = 1;
+    x0 = (n > 0) ? min.Element(ax) : 0;
+    y0 = (n > 0) ? min.Element(ay) : 0;
+    nx = std::min((int)(w/cell) + 1, EDGE_GRID_MAX_CELLS);
+    ny = std::min((int)(h/cell) + 1, EDGE_GRID_MAX_CELLS);
+
+    // Counted first, then filled, so each cell's edges are in list order.
+    start.assign(nx*ny + 1, 0);
+    for(int pass = 0; pass < 2; pass++) {
+        std::vector<int> at;
+        if(pass == 1) {
+            for(int c = 0; c < nx*ny; c++) start[c + 1] += start[c];
+            edge.resize(start[nx*ny]);
+            at.assign(start.begin(), start.end() - 1);
+        }
+        for(int k = 0; k < n; k++) {
+            const SEdge &se = el->l[k];
+            Vector emax = se.a, emin = se.a;
+            (se.b).MakeMaxMin(&emax, &emin);
+            int i0, j0, i1, j1;
+            CellsOf(emax, emin, &i0, &j0, &i1, &j1);
+            for(int j = j0; j <= j1; j++) {
+                for(int i = i0; i <= i1; i++) {
+                    if(pass == 0) {
+                        start[j*nx + i + 1]++;
+                    } else {
+                        edge[at[j*nx + i]++] = k;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SEdgeGrid::CellsOf(Vector max, Vector min, int *i0, int *j0, int *i1, int *j1) const {
+    auto clamp = [](double t, int n) {
+        return (int)std::max(0.0, std::min((double)(n - 1), floor(t)));
+    };
+    *i0 = clamp((min.Element(ax) - EDGE_GRID_SLOP - x0)/cell, nx);
+    *i1 = clamp((max.Element(ax) + EDGE_GRID_SLOP - x0)/cell, nx);
+    *j0 = clamp((min.Element(ay) - EDGE_GRID_SLOP - y0)/cell, ny);
+    *j1 = clamp((max.Element(ay) + EDGE_GRID_SLOP - y0)/cell, ny);
+}
+
+int SEdgeGrid::AnyEdgeCrossings(Vector a, Vector b, Vector *ppi, SPointList *spl) const {
+    if(edge.empty()) return 0;
+
+    Vector max = a, min = a;
+    b.MakeMaxMin(&max, &min);
+    int i0, j0, i1, j1;
+    CellsOf(max, min, &i0, &j0, &i1, &j1);
+    std::vector<int> near;
+    for(int j = j0; j <= j1; j++) {
+        for(int i = i0; i <= i1; i++) {
+            near.insert(near.end(), edge.begin() + start[j*nx + i],
+                                    edge.begin() + start[j*nx + i + 1]);
+        }
+    }
+    if(i0 != i1 || j0 != j1) {
+        std::sort(near.begin(), near.end());
+        near.erase(std::unique(near.begin(), near.end()), near.end());
+    }
+
+    int cnt = 0;
+    for(int k : near) {
+        if(sel->l[k].EdgeCrosses(a, b, ppi, spl)) cnt++;
+    }
+    return cnt;
+}
+
 //-----------------------------------------------------------------------------
 // We have an edge list that contains only collinear edges, maybe with more
 // splits than necessary. Merge any collinear segments that join.
@@ -706,6 +872,11 @@ void SPolygon::FixContourDirections() {
     l.ClearTags();
 
     // Outside curve looks counterclockwise, projected against our normal.
+    // Reversing a contour doesn't change what it contains, so the bands made
+    // up front do for all of them.
+    SPolygonBands bands;
+    bands.Build(this);
+    std::vector<bool> inside;
     int i, j;
     for(i = 0; i < l.n; i++) {
         SContour *sc = &(l[i]);
@@ -717,10 +888,10 @@ void SPolygon::FixContourDirections() {
 
         sc->timesEnclosed = 0;
         bool outer = true;
+        bands.ContainingContours(pt, &inside);
         for(j = 0; j < l.n; j++) {
             if(i == j) continue;
-            SContour *sct = &(l[j]);
-            if(sct->ContainsPointProjdToNormal(normal, pt)) {
+            if(inside[j]) {
                 outer = !outer;
                 (sc->timesEnclosed)++;
             }
@@ -768,6 +939,93 @@ bool SPolygon::SelfIntersecting(Vector *intersectsAt) const {
     return ret;
 }
 
+//-----------------------------------------------------------------------------
+// A polygon's edges in bands of v. The horizontal ray from a point crosses
+// only edges whose span of v holds the point's, and those are all in its
+// band; the test on each is SContour::ContainsPointProjdToNormal's own.
+//-----------------------------------------------------------------------------
+void SPolygonBands::Build(const SPolygon *sp) {
+    u = (sp->normal).Normal(0);
+    v = (sp->normal).Normal(1);
+    contours = sp->l.n;
+    start.clear();
+    edge.clear();
+
+    std::vector<Edge> all;
+    double vmin = VERY_POSITIVE, vmax = VERY_NEGATIVE;
+    for(int c = 0; c < sp->l.n; c++) {
+        const SContour *sc = &(sp->l[c]);
+        for(int i = 0; i < (sc->l.n - 1); i++) {
+            Edge e;
+            e.ua = (sc->l[i  ].p).Dot(u);
+            e.va = (sc->l[i  ].p).Dot(v);
+            e.ub = (sc->l[(i+1)%(sc->l.n-1)].p).Dot(u);
+            e.vb = (sc->l[(i+1)%(sc->l.n-1)].p).Dot(v);
+            e.contour = c;
+            // A horizontal edge is never crossed.
+            if(e.va == e.vb) continue;
+            all.push_back(e);
+            vmin = std::min(vmin, std::min(e.va, e.vb));
+            vmax = std::max(vmax, std::max(e.va, e.vb));
+        }
+    }
+
+    int bands = std::max(1, std::min((int)all.size()/4, 4096));
+    v0 = all.empty() ? 0 : vmin;
+    height = all.empty() ? 1 : (vmax - vmin)/bands;
+    if(!(height > 0)) {
+        bands = 1;
+        height = 1;
+    }
+    start.assign(bands + 1, 0);
+    for(const Edge &e : all) {
+        for(int b = BandOf(std::min(e.va, e.vb)); b <= BandOf(std::max(e.va, e.vb)); b++) {
+            start[b + 1]++;
+        }
+    }
+    for(int b = 0; b < bands; b++) start[b + 1] += start[b];
+    edge.resize(start[bands]);
+    std::vector<int> at(start.begin(), start.end() - 1);
+    for(const Edge &e : all) {
+        for(int b = BandOf(std::min(e.va, e.vb)); b <= BandOf(std::max(e.va, e.vb)); b++) {
+            edge[at[b]++] = e;
+        }
+    }
+}
+
+int SPolygonBands::BandOf(double vp) const {
+    int bands = (int)start.size() - 1;
+    return (int)std::max(0.0, std::min((double)(bands - 1), floor((vp - v0)/height)));
+}
+
+void SPolygonBands::ContainingContours(Vector p, std::vector<bool> *inside) const {
+    inside->assign(contours, false);
+    if(edge.empty()) return;
+
+    double up = p.Dot(u);
+    double vp = p.Dot(v);
+    int b = BandOf(vp);
+    for(int k = start[b]; k < start[b + 1]; k++) {
+        const Edge &e = edge[k];
+        if ((((e.va <= vp) && (vp < e.vb)) ||
+             ((e.vb <= vp) && (vp < e.va))) &&
+            (up < (e.ub - e.ua) * (vp - e.va) / (e.vb - e.va) + e.ua))
+        {
+            (*inside)[e.contour] = !(*inside)[e.contour];
+        }
+    }
+}
+
+size_t SPolygonBands::WindingNumberForPoint(Vector p) const {
+    std::vector<bool> inside;
+    ContainingContours(p, &inside);
+    return std::count(inside.begin(), inside.end(), true);
+}
+
+bool SPolygonBands::ContainsPoint(Vector p) const {
+    return (WindingNumberForPoint(p) % 2) == 1;
+}
+
 void SPolygon::InverseTransformInto(SPolygon *sp, Vector u, Vector v, Vector n) const {
     for(const SContour &sc : l) {
         SContour tsc = {};
@@ -780,17 +1038,22 @@ void SPolygon::InverseTransformInto(SPolygon *sp, Vector u, Vector v, Vector n)
 }
 
 //-----------------------------------------------------------------------------
-// Low-quality routines to cutter radius compensate a polygon. Assumes the
-// polygon is in the xy plane, and the contours all go in the right direction
-// with respect to normal (0, 0, -1).
+// Routines to cutter radius compensate a polygon. Assumes the polygon is in
+// the xy plane, and the contours all go in the right direction with respect
+// to normal (0, 0, -1). Each contour is offset on its own, so they're shared
+// out among the threads; one that the cutter doesn't fit inside vanishes.
 //-----------------------------------------------------------------------------
 void SPolygon::OffsetInto(SPolygon *dest, double r) const {
-    int i;
     dest->Clear();
-    for(i = 0; i < l.n; i++) {
-        const SContour *sc = &(l[i]);
-        dest->AddEmptyContour();
-        sc->OffsetInto(&(dest->l[dest->l.n-1]), r);
+    std::vector<SContour> offset(l.n);
+#pragma omp parallel for schedule(dynamic)
+    for(int i = 0; i < l.n; i++) {
+        offset[i] = {};
+        l[i].OffsetInto(&offset[i], r);
+    }
+    for(SContour &sc : offset) {
+        if(sc.l.IsEmpty()) continue;
+        dest->l.Add(&sc);
     }
 }
 //-----------------------------------------------------------------------------
@@ -837,17 +1100,170 @@ static bool IntersectionOfLines(double x0A, double y0A, double dxA, double dyA,
 
     return true;
 }
+//-----------------------------------------------------------------------------
+// Where an offset contour crosses itself, around an inside corner or into a
+// slot narrower than the cutter, the part between the crossings runs the
+// wrong way around; that part is cut out. The crossings are found through a
+// grid of the contour's edges, so that each edge is tested only against the
+// edges near it.
+//-----------------------------------------------------------------------------
+static bool OffsetEdgesCross(Vector a0, Vector a1, Vector b0, Vector b1, Vector *at) {
+    Vector da = a1.Minus(a0),
+           db = b1.Minus(b0),
+           d0 = b0.Minus(a0);
+    double den = da.x*db.y - da.y*db.x;
+    if(fabs(den) < LENGTH_EPS*da.Magnitude()*db.Magnitude()) return false;
+
+    double t = (d0.x*db.y - d0.y*db.x)/den,
+           s = (d0.x*da.y - d0.y*da.x)/den;
+    // Ends are counted in, so that edges that meet at a vertex cross once
+    if(t <= 0 || t > 1 || s <= 0 || s > 1) return false;
+    *at = a0.Plus(da.ScaledBy(t));
+    return true;
+}
+
+static double OffsetSignedArea(const std::vector<Vector> &pts) {
+    double area = 0;
+    for(size_t i = 0; i < pts.size(); i++) {
+        const Vector &a = pts[i],
+                     &b = pts[(i + 1) % pts.size()];
+        area += a.x*b.y - b.x*a.y;
+    }
+    return area/2;
+}
+
+static int OffsetWindingAround(const std::vector<Vector> &pts, Vector p) {
+    int winding = 0;
+    for(size_t i = 0; i < pts.size(); i++) {
+        const Vector &a = pts[i],
+                     &b = pts[(i + 1) % pts.size()];
+        double side = (b.x - a.x)*(p.y - a.y) - (p.x - a.x)*(b.y - a.y);
+        if(a.y <= p.y && b.y > p.y && side > 0) winding++;
+        if(a.y > p.y && b.y <= p.y && side < 0) winding--;
+    }
+    return winding;
+}
+
+// Whether one side of a crossing goes: if it runs backwards, or if it lies
+// inside the other side, and so covers only what that covers already.
+static bool OffsetLoopGoes(const std::vector<Vector> &loop, const std::vector<Vector> &other,
+                           double sign) {
+    return OffsetSignedArea(loop)*sign < 0 ||
+           OffsetWindingAround(other, loop[loop.size()/2]) != 0;
+}
+
+static void CutOffsetLoops(std::vector<Vector> *pts, double sign) {
+    struct Crossing {
+        int     i, j;
+        Vector  at;
+        bool operator<(const Crossing &o) const {
+            return i < o.i || (i == o.i && j < o.j);
+        }
+    };
+
+    bool cut = true;
+    while(cut && pts->size() >= 4) {
+        std::vector<Vector> &p = *pts;
+        int n = (int)p.size();
+
+        double length = 0;
+        for(int k = 0; k < n; k++) {
+            length += p[(k + 1) % n].Minus(p[k]).Magnitude();
+        }
+        double cell = max(2*length/n, LENGTH_EPS);
+        auto cellOf = [&](double x) { return (int64_t)floor(x/cell); };
+
+        std::unordered_map<uint64_t, std::vector<int>> grid;
+        for(int k = 0; k < n; k++) {
+            const Vector &a = p[k], &b = p[(k + 1) % n];
+            for(int64_t x = cellOf(min(a.x, b.x)); x <= cellOf(max(a.x, b.x)); x++) {
+                for(int64_t y = cellOf(min(a.y, b.y)); y <= cellOf(max(a.y, b.y)); y++) {
+                    grid[((uint64_t)x << 32) ^ (uint32_t)y].push_back(k);
+                }
+            }
+        }
+
+        std::vector<Crossing> crossings;
+        for(const auto &it : grid) {
+            const std::vector<int> &edges = it.second;
+            for(size_t a = 0; a < edges.size(); a++) {
+                for(size_t b = a + 1; b < edges.size(); b++) {
+                    int i = min(edges[a], edges[b]),
+                        j = max(edges[a], edges[b]);
+                    // Neighbours meet at their shared vertex anyway
+                    if(j - i < 2 || (i == 0 && j == n - 1)) continue;
+                    Crossing c = { i, j, {} };
+                    if(OffsetEdgesCross(p[i], p[i + 1], p[j], p[(j + 1) % n], &c.at)) {
+                        crossings.push_back(c);
+                    }
+                }
+            }
+        }
+        // An edge pair that shares more than one cell is found once for each
+        std::sort(crossings.begin(), crossings.end());
+        crossings.erase(std::unique(crossings.begin(), crossings.end(),
+            [](const Crossing &a, const Crossing &b) { return a.i == b.i && a.j == b.j; }),
+            crossings.end());
+
+        // Each crossing splits the contour into the loop between its edges
+        // and the rest. Loops are cut out as they're found, unless one
+        // overlaps a loop already cut, which is left for the next pass; if
+        // it's the rest that goes, the loop is all that's left.
+        std::vector<Vector> kept;
+        int next = 0;
+        cut = false;
+        for(const Crossing &c : crossings) {
+            if(c.i < next) continue;
+            std::vector<Vector> loop(p.begin() + c.i + 1, p.begin() + c.j + 1);
+            loop.push_back(c.at);
+            std::vector<Vector> rest(p.begin() + c.j + 1, p.end());
+            rest.insert(rest.end(), p.begin(), p.begin() + c.i + 1);
+            rest.push_back(c.at);
+
+            bool loopGoes = OffsetLoopGoes(loop, rest, sign),
+                 restGoes = OffsetLoopGoes(rest, loop, sign);
+            if(loopGoes && restGoes) {
+                // Keep the larger, if it's the right way round.
+                loopGoes = fabs(OffsetSignedArea(loop)) < fabs(OffsetSignedArea(rest));
+                restGoes = !loopGoes;
+            }
+            if(restGoes && next == 0) {
+                kept = std::move(loop);
+                next = n;
+                cut = true;
+                break;
+            } else if(loopGoes) {
+                kept.insert(kept.end(), p.begin() + next, p.begin() + c.i + 1);
+                kept.push_back(c.at);
+                next = c.j + 1;
+                cut = true;
+            }
+        }
+        if(!cut) break;
+        kept.insert(kept.end(), p.begin() + next, p.end());
+        *pts = std::move(kept);
+    }
+}
+
 void SContour::OffsetInto(SContour *dest, double r) const {
     int i;
 
-    for(i = 0; i < l.n; i++) {
+    // The contour's first point is repeated at its end.
+    int n = l.n - 1;
+    std::vector<Vector> pts;
+    std::vector<Vector> contour;
+    for(i = 0; i < n; i++) {
+        contour.push_back(l[i].p);
+    }
+
+    for(i = 0; i < n; i++) {
         Vector a, b, c;
         Vector dp, dn;
         double thetan, thetap;
 
-        a = l[WRAP(i-1, (l.n-1))].p;
-        b = l[WRAP(i,   (l.n-1))].p;
-        c = l[WRAP(i+1, (l.n-1))].p;
+        a = l[WRAP(i-1, n)].p;
+        b = l[WRAP(i,   n)].p;
+        c = l[WRAP(i+1, n)].p;
 
         dp = a.Minus(b);
         thetap = atan2(dp.y, dp.x);
@@ -869,8 +1285,13 @@ void SContour::OffsetInto(SContour *dest, double r) const {
         }
 
         if(fabs(thetan - thetap) < (1*PI)/180) {
-            Vector p = { b.x - r*sin(thetap), b.y + r*cos(thetap), 0 };
-            dest->AddPoint(p);
+            // Nearly straight on, so mitred along the bisector; that way a
+            // circle of many short segments offsets to a concentric one of
+            // as many, instead of one turned by half a segment.
+            double theta = (thetap + thetan)/2,
+                   miter = r/cos((thetan - thetap)/2);
+            Vector p = { b.x - miter*sin(theta), b.y + miter*cos(theta), 0 };
+            pts.push_back(p);
         } else if(thetan < thetap) {
             // This is an inside corner. We have two edges, Ep and En. Move
             // out from their intersection by radius, normal to En, and
@@ -897,25 +1318,28 @@ void SContour::OffsetInto(SContour *dest, double r) const {
                                 nx0, ny0, ndx, ndy,
                                 &x, &y);
 
-            dest->AddPoint(Vector::From(x, y, 0));
+            pts.push_back(Vector::From(x, y, 0));
         } else {
-            if(fabs(thetap - thetan) < (6*PI)/180) {
-                Vector pp = { b.x - r*sin(thetap),
-                              b.y + r*cos(thetap), 0 };
-                dest->AddPoint(pp);
-
-                Vector pn = { b.x - r*sin(thetan),
-                              b.y + r*cos(thetan), 0 };
-                dest->AddPoint(pn);
-            } else {
-                double theta;
-                for(theta = thetap; theta <= thetan; theta += (6*PI)/180) {
-                    Vector p = { b.x - r*sin(theta),
-                                 b.y + r*cos(theta), 0 };
-                    dest->AddPoint(p);
-                }
+            // An outside corner, rounded with the cutter's radius in steps
+            // of no more than six degrees, that end on both edges' offsets.
+            int steps = max(1, (int)ceil((thetan - thetap)/((6*PI)/180)));
+            for(int j = 0; j <= steps; j++) {
+                double theta = thetap + (thetan - thetap)*j/steps;
+                Vector p = { b.x - r*sin(theta),
+                             b.y + r*cos(theta), 0 };
+                pts.push_back(p);
             }
         }
     }
+
+    double sign = OffsetSignedArea(contour);
+    CutOffsetLoops(&pts, sign);
+    // If what's left runs backwards, the cutter didn't fit at all.
+    if(pts.size() < 3 || OffsetSignedArea(pts)*sign <= 0) return;
+
+    for(const Vector &p : pts) {
+        dest->AddPoint(p);
+    }
+    dest->AddPoint(pts[0]);
 }
 
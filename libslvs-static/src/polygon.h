@@ -13,6 +13,7 @@ class SPolygon;
 class SContour;
 class SMesh;
 class SBsp3;
+class SKdNode;
 class SOutlineList;
 
 enum class EarType : uint32_t {
@@ -91,6 +92,27 @@ public:
         Vector *pi=NULL, SPointList *spl=NULL) const;
 };
 
+// A uniform grid over an edge list, across the two axes it spreads along the
+// most, for many crossing tests against the same edges. It finds just what
+// SEdgeList::AnyEdgeCrossings would, in the same order; the list mustn't
+// change while the grid is in use.
+class SEdgeGrid {
+public:
+    const SEdgeList     *sel;
+    int                 ax, ay;
+    double              x0, y0, cell;
+    int                 nx, ny;
+    // The edges (by index into sel) in cell i are edge[start[i]] up to
+    // edge[start[i+1]].
+    std::vector<int>    start;
+    std::vector<int>    edge;
+
+    void Build(const SEdgeList *sel);
+    int AnyEdgeCrossings(Vector a, Vector b,
+        Vector *pi=NULL, SPointList *spl=NULL) const;
+    void CellsOf(Vector max, Vector min, int *i0, int *j0, int *i1, int *j1) const;
+};
+
 class SPoint {
 public:
     int     tag;
@@ -166,6 +188,30 @@ public:
     void InverseTransformInto(SPolygon *sp, Vector u, Vector v, Vector n) const;
 };
 
+// A polygon's contours projected along its normal, with their edges sorted
+// into bands by the span of v they cross, so that a point-in-contour test
+// looks at only the band its ray lies in. It finds just what
+// SContour::ContainsPointProjdToNormal would, for every contour at once.
+class SPolygonBands {
+public:
+    struct Edge {
+        double  ua, va, ub, vb;
+        int     contour;
+    };
+    Vector              u, v;
+    double              v0, height;
+    int                 contours;
+    // The edges in band i are edge[start[i]] up to edge[start[i+1]].
+    std::vector<int>    start;
+    std::vector<Edge>   edge;
+
+    void Build(const SPolygon *sp);
+    int BandOf(double vp) const;
+    void ContainingContours(Vector p, std::vector<bool> *inside) const;
+    size_t WindingNumberForPoint(Vector p) const;
+    bool ContainsPoint(Vector p) const;
+};
+
 class STriangle {
 public:
     int         tag;
@@ -248,6 +294,16 @@ public:
     void GenerateInPaintOrder(SMesh *m) const;
 };
 
+// Of the solid a closed mesh bounds, at unit density
+struct SMassProperties {
+    double volume;
+    double area;
+    Vector centroid;
+    // The inertia tensor about the centroid; the off-diagonal entries are
+    // the products of inertia negated
+    double ixx, iyy, izz, ixy, iyz, izx;
+};
+
 class SMesh {
 public:
     List<STriangle>     l;
@@ -257,6 +313,9 @@ public:
     bool    keepCoplanar;
     bool    atLeastOneDiscarded;
     bool    isTransparent;
+    // Whether Booleans classify triangles against a kd-tree of the other
+    // mesh, instead of inserting them into its BSP
+    bool    classifyBoolean;
 
     void Clear();
     void AddTriangle(const STriangle *st);
@@ -269,6 +328,8 @@ public:
     void Simplify(int start);
 
     void AddAgainstBsp(SMesh *srcm, SBsp3 *bsp3);
+    void AddAgainstKd(SMesh *srcm, SKdNode *kd);
+    void AddAgainst(SMesh *srcm, SMesh *other);
     void MakeFromUnionOf(SMesh *a, SMesh *b);
     void MakeFromDifferenceOf(SMesh *a, SMesh *b);
     void MakeFromIntersectionOf(SMesh *a, SMesh *b);
@@ -277,6 +338,7 @@ public:
     void MakeFromTransformationOf(SMesh *a, Vector trans,
                                   Quaternion q, double scale);
     void MakeFromAssemblyOf(SMesh *a, SMesh *b);
+    void MakeFromSimplificationOf(SMesh *a, int maxTriangles, double maxError);
 
     void MakeEdgesInPlaneInto(SEdgeList *sel, Vector n, double d);
     void MakeOutlinesInto(SOutlineList *sol, EdgeKind type);
@@ -292,16 +354,27 @@ public:
     uint32_t FirstIntersectionWith(Point2d mp) const;
 
     Vector GetCenterOfMass() const;
+    SMassProperties GetMassProperties() const;
 };
 
-// A linked list of triangles
-class STriangleLl {
+// A mesh with each distinct vertex stored once, its coordinates in separate
+// arrays so that transforming them is a simple loop, and each triangle as
+// indices into those. The vertex normals are likewise stored once each.
+class SMeshIndexed {
 public:
-    STriangle       *tri;
+    std::vector<double>     x, y, z;
+    std::vector<double>     nx, ny, nz;
+    // Three of each per triangle
+    std::vector<uint32_t>   vertex;
+    std::vector<uint32_t>   normal;
+    std::vector<STriMeta>   meta;
 
-    STriangleLl     *next;
+    void Clear();
+    void MakeFromMesh(const SMesh *m);
+    void MakeMeshInto(SMesh *m) const;
+    void Transform(Vector trans, Quaternion q, double scale);
 
-    static STriangleLl *Alloc();
+    SMassProperties GetMassProperties() const;
 };
 
 class SOutline {
@@ -340,15 +413,28 @@ public:
     SKdNode      *gt;
     SKdNode      *lt;
 
-    STriangleLl  *tris;
+    // A leaf's triangles, in the order they were added; they're visited
+    // newest first. The bounding box of each is kept beside it, in an array
+    // per axis and side, so that a query can pass over the triangles it
+    // can't touch reading only those arrays, without loading the triangles.
+    STriangle   **tris;
+    double       *boxMin[3];
+    double       *boxMax[3];
+    int           trisN;
+    int           trisAllocated;
 
     static SKdNode *Alloc();
     static SKdNode *From(SMesh *m);
-    static SKdNode *From(STriangleLl *tll);
+    static SKdNode *From(STriangle **tris, int n);
 
     void AddTriangle(STriangle *tr);
+    void AddToLeaf(STriangle *tr);
+    void ReserveLeaf(int n);
+    void UpdateBox(int i);
+    bool BoxMeets(int i, Vector min, Vector max, int axes) const;
     void MakeMeshInto(SMesh *m) const;
     void ListTrianglesInto(std::vector<STriangle *> *tl) const;
+    void ListTrianglesNear(Vector min, Vector max, std::vector<STriangle *> *tl) const;
     void ClearTags() const;
 
     void FindEdgeOn(Vector a, Vector b, int cnt, bool coplanarIsInter, EdgeOnInfo *info) const;
@@ -357,6 +443,9 @@ public:
     void MakeOutlinesInto(SOutlineList *sel, EdgeKind tagKind) const;
 
     void OcclusionTestLine(SEdge orig, SEdgeList *sel, int cnt) const;
+    void OcclusionTestLine(SEdge orig, SEdgeList *sel) const;
+    void ListOccludersOf(SEdge orig, std::vector<STriangle *> *tl) const;
+    void ListOccludersNear(const SEdge &orig, std::vector<STriangle *> *tl) const;
     void SplitLinesAgainstTriangle(SEdgeList *sel, STriangle *tr) const;
 
     void SnapToMesh(SMesh *m);
@@ -240,12 +240,7 @@ void SurfaceRenderer::ConvertBeziersToEdges() {
             if(b.deg == 1) {
                 el.AddEdge(b.ctrl[0], b.ctrl[1]);
             } else {
-                List<Vector> lv = {};
-                b.MakePwlInto(&lv, chordTolerance);
-                for(int i = 1; i < lv.n; i++) {
-                    el.AddEdge(lv[i-1], lv[i]);
-                }
-                lv.Clear();
+                b.MakePwlInto(&el, chordTolerance);
             }
         }
         bl.l.Clear();
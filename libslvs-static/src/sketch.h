@@ -19,7 +19,9 @@ class hEquation;
 class Entity;
 class Param;
 class Equation;
+class EquationKernel;
 class Style;
+class ShellAndMeshForm;
 
 enum class PolyError : uint32_t {
     GOOD              = 0,
@@ -138,6 +140,14 @@ struct EntityKeyEqual {
 };
 typedef std::unordered_map<EntityKey, EntityId, EntityKeyHash, EntityKeyEqual> EntityMap;
 
+// How a shell and mesh are found in the cache: a hash of everything they
+// were made from, zero where that isn't known, and what was hashed, which
+// a hit has to match as well.
+struct ShellAndMeshKey {
+    uint64_t                                hash;
+    std::shared_ptr<const ShellAndMeshForm> form;
+};
+
 // A set of requests. Every request must have an associated group.
 class Group {
 public:
@@ -180,6 +190,9 @@ public:
     double      scale;
 
     bool        clean;
+    // Edited since it was last solved, so it must be solved again even if
+    // nothing it depends on changed
+    bool        solveDirty;
     bool        dofCheckOk;
     hEntity     activeWorkplane;
     double      valA;
@@ -239,6 +252,19 @@ public:
 
     SMesh           thisMesh;
     SMesh           runningMesh;
+    // Everything the shells and meshes above were made from, by which
+    // they're cached
+    ShellAndMeshKey thisKey;
+    ShellAndMeshKey runningKey;
+    // Milliseconds spent the last time this group was solved, had its own
+    // shell or mesh made, was combined with the groups before it, and was
+    // triangulated for display or export
+    struct {
+        double      solve;
+        double      shell;
+        double      boolean;
+        double      mesh;
+    }               timing;
 
     bool            displayDirty;
     SMesh           displayMesh;
@@ -253,6 +279,8 @@ public:
     CombineAs meshCombine;
 
     bool forceToMesh;
+    // Do this group's mesh Booleans by classifying triangles, not with a BSP
+    bool classifyBoolean;
 
     EntityMap remap;
 
@@ -320,6 +348,10 @@ public:
     bool IsMeshGroup();
 
     void GenerateShellAndMesh();
+    void GenerateThisShellAndMesh(Group *srcg);
+    void PlaceLinkedShellAndMesh(Group *srcg);
+    ShellAndMeshKey ThisShellAndMeshKey(Group *srcg, bool withPlacement = true);
+    ShellAndMeshKey RunningShellAndMeshKey(Group *srcg, Group *prevg);
     template<class T> void GenerateForStepAndRepeat(T *steps, T *outs, Group::CombineAs forWhat);
     template<class T> void GenerateForBoolean(T *a, T *b, T *o, Group::CombineAs how);
     void GenerateDisplayItems();
@@ -687,6 +719,7 @@ public:
         ARC_LINE_LEN_RATIO     = 211,
         ARC_ARC_DIFFERENCE     = 212,
         ARC_LINE_DIFFERENCE    = 213,
+        GEAR_MESH              = 220,
         COMMENT                = 1000
     };
 
@@ -698,6 +731,9 @@ public:
     // These are the parameters for the constraint.
     double      valA;
     hParam      valP;
+    // When set, the equations take valA from this param instead of as a
+    // constant, so it can change without writing them again.
+    hParam      valAParam;
     hEntity     ptA;
     hEntity     ptB;
     hEntity     entityA;
@@ -706,16 +742,23 @@ public:
     hEntity     entityD;
     bool        other;
     bool        other2;
+    // A GEAR_MESH's tooth counts, the second negative for a ring gear that
+    // the first turns inside; valA is the module.
+    int         teethA;
+    int         teethB;
 
     bool        reference;  // a ref dimension, that generates no eqs
     std::string comment;    // since comments are represented as constraints
 
-    bool Equals(const ConstraintBase &c) const {
+    // With andValue false, whatever valA is
+    bool Equals(const ConstraintBase &c, bool andValue = true) const {
         return type == c.type && group == c.group && workplane == c.workplane &&
-            valA == c.valA && valP == c.valP && ptA == c.ptA && ptB == c.ptB &&
+            (!andValue || valA == c.valA) && valP == c.valP && valAParam == c.valAParam &&
+            ptA == c.ptA && ptB == c.ptB &&
             entityA == c.entityA && entityB == c.entityB &&
             entityC == c.entityC && entityD == c.entityD &&
-            other == c.other && other2 == c.other2 && reference == c.reference &&
+            other == c.other && other2 == c.other2 &&
+            teethA == c.teethA && teethB == c.teethB && reference == c.reference &&
             comment == c.comment;
     }
 
@@ -724,14 +767,33 @@ public:
 
     void Generate(ParamList *param);
 
+    // The kinds of constraint whose equations GenerateEquations can write as
+    // polynomials, without the square roots and the divisions by what's
+    // solved for; an OR of these is the forms it takes.
+    enum Form : uint32_t {
+        // a point-point distance, and a point on a circle
+        POLY_DISTANCE = 1 << 0,
+        // equal lengths, and a length ratio
+        POLY_LENGTHS  = 1 << 1,
+        // a perpendicular, and an angle in a workplane
+        POLY_ANGLE    = 1 << 2
+    };
+
     void GenerateEquations(IdList<Equation,hEquation> *entity,
-                           bool forReference = false) const;
+                           bool forReference = false, uint32_t forms = 0) const;
     // Some helpers when generating symbolic constraint equations
     void ModifyToSatisfy();
     void AddEq(IdList<Equation,hEquation> *l, Expr *expr, int index) const;
+    void AddEq(IdList<Equation,hEquation> *l, Expr *expr, int index,
+               const EquationKernel &kernel) const;
     void AddEq(IdList<Equation,hEquation> *l, const ExprVector &v, int baseIndex = 0) const;
     static Expr *DirectionCosine(hEntity wrkpl, ExprVector ae, ExprVector be);
     static Expr *Distance(hEntity workplane, hEntity pa, hEntity pb);
+    static Expr *DistanceSquared(hEntity workplane, hEntity pa, hEntity pb);
+    // For a GEAR_MESH, half the sum of the tooth counts, which the module
+    // is multiplied by for the distance between the gears' centres
+    double GearPitchSum() const { return fabs((double)(teethA + teethB)) / 2; }
+    static Expr *DirectionDot(hEntity wrkpl, ExprVector ae, ExprVector be, double *mags);
     static Expr *PointLineDistance(hEntity workplane, hEntity pt, hEntity ln);
     static Expr *PointPlaneDistance(ExprVector p, hEntity plane);
     static ExprVector VectorsParallel3d(ExprVector a, ExprVector b, hParam p);
@@ -824,12 +886,38 @@ public:
 template<>
 struct IsHandleOracle<hEquation> : std::true_type {};
 
+// The closed form of an equation that's written directly in terms of its
+// parameters, so that its partials can be written without differentiating
+// the expression (which is still there, for everything else).
+class EquationKernel {
+public:
+    enum class Type : uint32_t {
+        NONE        = 0,
+        // param[0] - param[1]
+        DIFFERENCE  = 1,
+        // param[0] + (param[1] - param[0])*param[2] - param[3]
+        LERP        = 2,
+        // The distance from (param[0], param[1]) to (param[2], param[3]),
+        // less param[4]
+        DISTANCE_2D = 3,
+        // The distance from (param[0], param[1], param[2]) to (param[3],
+        // param[4], param[5]), less param[6]
+        DISTANCE_3D = 4,
+    };
+
+    Type        type = Type::NONE;
+    // A zero handle stands for the constant value
+    hParam      param[7];
+    double      value;
+};
+
 class Equation {
 public:
     int         tag;
     hEquation   h;
 
     Expr        *e;
+    EquationKernel kernel;
 
     void Clear() {}
 };
@@ -982,15 +1070,18 @@ inline hRequest hParam::request() const
     { hRequest r; r.v = (v >> 16); return r; }
 
 
+// A constraint writes only a handful of equations, so the index gets the low
+// 8 bits, which leaves room for 2^22 constraints below the entity and group
+// equations' flag bits.
 inline hEquation hConstraint::equation(int i) const
-    { hEquation r; r.v = (v << 16) | (uint32_t)i; return r; }
+    { hEquation r; r.v = (v << 8) | (uint32_t)i; return r; }
 inline hParam hConstraint::param(int i) const
     { hParam r; r.v = v | 0x40000000 | (uint32_t)i; return r; }
 
 inline bool hEquation::isFromConstraint() const
     { if(v & 0xc0000000) return false; else return true; }
 inline hConstraint hEquation::constraint() const
-    { hConstraint r; r.v = (v >> 16); return r; }
+    { hConstraint r; r.v = (v >> 8); return r; }
 
 // The format for entities stored on the clipboard.
 class ClipboardRequest {
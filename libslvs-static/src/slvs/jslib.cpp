@@ -9,6 +9,15 @@ struct JsSolveResult {
   emscripten::val bad;
 };
 
+// Every param's value, as a view of the library's memory (see
+// Slvs_ParamValues): good until a param is added or the sketch cleared, or
+// the memory grows, so take a new one after any of those.
+static emscripten::val paramValues() {
+  size_t n = 0;
+  double *values = Slvs_ParamValues(&n);
+  return emscripten::val(emscripten::typed_memory_view(n, values));
+}
+
 static JsSolveResult solveSketch(Slvs_hGroup g, bool calculateFaileds) {
   JsSolveResult jsResult = {};
   Slvs_hConstraint *c = nullptr;
@@ -63,6 +72,7 @@ EMSCRIPTEN_BINDINGS(slvs) {
   emscripten::constant("C_ARC_LINE_LEN_RATIO",  SLVS_C_ARC_LINE_LEN_RATIO);
   emscripten::constant("C_ARC_ARC_DIFFERENCE",  SLVS_C_ARC_ARC_DIFFERENCE);
   emscripten::constant("C_ARC_LINE_DIFFERENCE", SLVS_C_ARC_LINE_DIFFERENCE);
+  emscripten::constant("C_GEAR_MESH", SLVS_C_GEAR_MESH);
 
   emscripten::constant("E_POINT_IN_3D",         SLVS_E_POINT_IN_3D);
   emscripten::constant("E_POINT_IN_2D",         SLVS_E_POINT_IN_2D);
@@ -83,6 +93,8 @@ EMSCRIPTEN_BINDINGS(slvs) {
   emscripten::constant("RESULT_DIDNT_CONVERGE", SLVS_RESULT_DIDNT_CONVERGE);
   emscripten::constant("RESULT_TOO_MANY_UNKNOWNS", SLVS_RESULT_TOO_MANY_UNKNOWNS);
   emscripten::constant("RESULT_REDUNDANT_OKAY", SLVS_RESULT_REDUNDANT_OKAY);
+  emscripten::constant("RESULT_TIMED_OUT", SLVS_RESULT_TIMED_OUT);
+  emscripten::constant("RESULT_RESOURCE_EXHAUSTED", SLVS_RESULT_RESOURCE_EXHAUSTED);
 
   emscripten::value_array<std::array<uint32_t, 4>>("array_uint32_4")
     .element(emscripten::index<0>())
@@ -198,10 +210,20 @@ EMSCRIPTEN_BINDINGS(slvs) {
   emscripten::function("distanceProj", &Slvs_DistanceProj);
   emscripten::function("lengthDiff", &Slvs_LengthDiff);
   emscripten::function("dragged", &Slvs_Dragged);
+  emscripten::function("gearMesh", &Slvs_GearMesh);
 
   emscripten::function("getParamValue", &Slvs_GetParamValue);
   emscripten::function("setParamValue", &Slvs_SetParamValue);
   emscripten::function("markDragged", &Slvs_MarkDragged);
+  emscripten::function("paramSlot", &Slvs_ParamSlot);
+  emscripten::function("paramValues", &paramValues);
+  emscripten::function("commitParamValues", &Slvs_CommitParamValues);
   emscripten::function("solveSketch", &solveSketch);
   emscripten::function("clearSketch", &Slvs_ClearSketch);
+  emscripten::function("setWorkerCount", &Slvs_SetWorkerCount);
+#ifdef __EMSCRIPTEN_PTHREADS__
+  emscripten::constant("THREADED", true);
+#else
+  emscripten::constant("THREADED", false);
+#endif
 }
@@ -5,13 +5,72 @@
 // Copyright 2008-2013 Jonathan Westhues.
 //-----------------------------------------------------------------------------
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include "solvespace.h"
 #include <slvs.h>
 #include <string>
 
-Sketch SolveSpace::SK = {};
-static System SYS;
-static ParamSet dragged;
+// What Slvs_SolveSketch keeps of a group between solves, so that the next
+// one only re-solves what's been edited since. The group's unknowns,
+// constraints and entities are split into components that share no
+// unknowns; each is numbered, and remembers the dof it was left with.
+struct Slvs_Settled {
+    std::unordered_map<uint32_t, int> param, constraint, entity;
+    std::vector<int>                  dof;
+    // Params of other groups that this group's equations read
+    std::unordered_set<uint32_t>      external;
+    // Params whose values were set, or re-solved in another group, since
+    std::vector<uint32_t>             edited;
+};
+
+// Everything that a solve works on; each thread uses its current context,
+// which is the shared default one until it picks another.
+struct Slvs_Context {
+    Sketch    sketch;
+    System    sys;
+    ParamSet  dragged;
+    // The params generated for one constraint at a time, while importing.
+    ParamList generated;
+    // Whether sys holds a system compiled by Slvs_Compile.
+    bool      compiled = false;
+    // The expressions that dimensions take their values from, by
+    // constraint (see Slvs_SetConstraintExpression); and for the compiled
+    // system, those expressions as a tape, with the register that holds
+    // each dimension's value.
+    std::map<uint32_t, std::string>          expressions;
+    ExprTape                                 dimensions;
+    std::vector<std::pair<hConstraint, int>> dimensionValue;
+    // Each param's value by its place in the param list, for
+    // Slvs_ParamValues and Slvs_CommitParamValues.
+    std::vector<double> values;
+    // The groups that Slvs_SolveSketch last solved, by group.
+    std::unordered_map<uint32_t, Slvs_Settled> settled;
+    // The equations that each group's constraints last wrote, by group; they
+    // outlast the sketch that Slvs_Solve imports, so solving the same
+    // system again doesn't write them again.
+    std::unordered_map<uint32_t, EquationCache> equations;
+    // The group of the system that Slvs_BeginSystem started.
+    uint32_t          group = 0;
+    // How long each solve may take, in milliseconds (0 for no limit), and
+    // whether it's been cancelled from another thread. A cancel holds until
+    // the solve it ends finishes, so one made while a solve is still setting
+    // up, or before it starts, isn't lost.
+    int               timeout = 0;
+    std::atomic<bool> cancelled{false};
+    // How many solves are running on the context, one inside another.
+    int               solving = 0;
+    // The most bytes each solve may hold (0 for no limit); see
+    // System::memoryBudget.
+    size_t            memoryBudget = 0;
+    // Told of the phases of each solve, if set.
+    Slvs_TraceCallback trace     = nullptr;
+    void              *traceUser = nullptr;
+};
+
+static Slvs_Context DefaultContext;
+static thread_local Slvs_Context *CTX = &DefaultContext;
+thread_local Sketch *SolveSpace::ThreadSketch = &DefaultContext.sketch;
 
 void SolveSpace::Platform::FatalError(const std::string &message) {
     fprintf(stderr, "%s", message.c_str());
@@ -45,6 +104,7 @@ case SLVS_C_EQUAL_LINE_ARC_LEN:  return ConstraintBase::Type::EQUAL_LINE_ARC_LEN
 case SLVS_C_LENGTH_DIFFERENCE:   return ConstraintBase::Type::LENGTH_DIFFERENCE;
 case SLVS_C_ARC_ARC_DIFFERENCE:  return ConstraintBase::Type::ARC_ARC_DIFFERENCE;
 case SLVS_C_ARC_LINE_DIFFERENCE: return ConstraintBase::Type::ARC_LINE_DIFFERENCE;
+case SLVS_C_GEAR_MESH:           return ConstraintBase::Type::GEAR_MESH;
 case SLVS_C_SYMMETRIC:           return ConstraintBase::Type::SYMMETRIC;
 case SLVS_C_SYMMETRIC_HORIZ:     return ConstraintBase::Type::SYMMETRIC_HORIZ;
 case SLVS_C_SYMMETRIC_VERT:      return ConstraintBase::Type::SYMMETRIC_VERT;
@@ -105,6 +165,7 @@ static bool Slvs_CanInitiallySatisfy(const ConstraintBase &c) {
     case ConstraintBase::Type::LENGTH_DIFFERENCE:
     case ConstraintBase::Type::ARC_ARC_DIFFERENCE:
     case ConstraintBase::Type::ARC_LINE_DIFFERENCE:
+    case ConstraintBase::Type::GEAR_MESH:
     case ConstraintBase::Type::DIAMETER:
     case ConstraintBase::Type::EQUAL_RADIUS:
     case ConstraintBase::Type::EQUAL_LINE_ARC_LEN:
@@ -227,6 +288,7 @@ Slvs_Entity Slvs_AddPoint2D(uint32_t grouph, double u, double v, Slvs_Entity wor
     e.param[0].v  = uph;
     e.param[1].v  = vph;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -250,6 +312,7 @@ Slvs_Entity Slvs_AddPoint3D(uint32_t grouph, double x, double y, double z) {
     e.param[1].v  = yph;
     e.param[2].v  = zph;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -271,6 +334,7 @@ Slvs_Entity Slvs_AddNormal2D(uint32_t grouph, Slvs_Entity workplane) {
     e.group.v     = grouph;
     e.workplane.v = workplane.h;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -294,6 +358,7 @@ Slvs_Entity Slvs_AddNormal3D(uint32_t grouph, double qw, double qx, double qy, d
     e.param[2].v  = yph;
     e.param[3].v  = zph;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -318,6 +383,7 @@ Slvs_Entity Slvs_AddDistance(uint32_t grouph, double value, Slvs_Entity workplan
     e.workplane.v = workplane.h;
     e.param[0].v  = valueph;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -343,6 +409,7 @@ Slvs_Entity Slvs_AddLine2D(uint32_t grouph, Slvs_Entity ptA, Slvs_Entity ptB, Sl
     e.point[0].v  = ptA.h;
     e.point[1].v  = ptB.h;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -367,6 +434,7 @@ Slvs_Entity Slvs_AddLine3D(uint32_t grouph, Slvs_Entity ptA, Slvs_Entity ptB) {
     e.point[0].v  = ptA.h;
     e.point[1].v  = ptB.h;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -399,6 +467,7 @@ Slvs_Entity Slvs_AddCubic(uint32_t grouph, Slvs_Entity ptA, Slvs_Entity ptB, Slv
     e.point[2].v  = ptC.h;
     e.point[3].v  = ptD.h;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -435,6 +504,7 @@ Slvs_Entity Slvs_AddArc(uint32_t grouph, Slvs_Entity normal, Slvs_Entity center,
     e.point[1].v  = start.h;
     e.point[2].v  = end.h;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -467,6 +537,7 @@ Slvs_Entity Slvs_AddCircle(uint32_t grouph, Slvs_Entity normal, Slvs_Entity cent
     e.point[0].v  = center.h;
     e.distance.v  = radius.h;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -487,6 +558,7 @@ Slvs_Entity Slvs_AddWorkplane(uint32_t grouph, Slvs_Entity origin, Slvs_Entity n
     e.point[0].v  = origin.h;
     e.normal.v    = nm.h;
     SK.entity.AddAndAssignId(&e);
+    SK.AddToIndex(e);
 
     Slvs_Entity ce = Slvs_Entity {};
     ce.h = e.h.v;
@@ -526,7 +598,12 @@ Slvs_Constraint Slvs_AddConstraint(uint32_t grouph,
     c.entityD.v      = entityD.h;
     c.other          = other ? true : false;
     c.other2         = other2 ? true : false;
+    if(c.type == ConstraintBase::Type::GEAR_MESH) {
+        c.teethA = other;
+        c.teethB = other2;
+    }
     SK.constraint.AddAndAssignId(&c);
+    SK.AddToIndex(c);
 
     Slvs_Constraint cc = Slvs_Constraint {};
     cc.h = c.h.v;
@@ -542,6 +619,10 @@ Slvs_Constraint Slvs_AddConstraint(uint32_t grouph,
     cc.entityD = entityD.h;
     cc.other = other ? true : false;
     cc.other2 = other2 ? true : false;
+    if(c.type == ConstraintBase::Type::GEAR_MESH) {
+        cc.other  = other;
+        cc.other2 = other2;
+    }
     return cc;
 }
 
@@ -786,6 +867,18 @@ Slvs_Constraint Slvs_Dragged(uint32_t grouph, Slvs_Entity ptA, Slvs_Entity workp
     SolveSpace::Platform::FatalError("Invalid arguments for dragged constraint");
 }
 
+Slvs_Constraint Slvs_GearMesh(uint32_t grouph, Slvs_Entity entityA, Slvs_Entity entityB,
+                              double module, int teethA, int teethB,
+                              Slvs_Entity workplane = SLVS_E_FREE_IN_3D) {
+    if((Slvs_IsArc(entityA) || Slvs_IsCircle(entityA)) &&
+       (Slvs_IsArc(entityB) || Slvs_IsCircle(entityB)) && teethA + teethB != 0) {
+        return Slvs_AddConstraint(grouph, SLVS_C_GEAR_MESH, workplane, module, SLVS_E_NONE,
+                                  SLVS_E_NONE, entityA, entityB, SLVS_E_NONE, SLVS_E_NONE,
+                                  teethA, teethB);
+    }
+    SolveSpace::Platform::FatalError("Invalid arguments for gear mesh constraint");
+}
+
 void Slvs_QuaternionU(double qw, double qx, double qy, double qz,
                          double *x, double *y, double *z)
 {
@@ -829,139 +922,681 @@ void Slvs_MakeQuaternion(double ux, double uy, double uz,
     *qz = q.vz;
 }
 
+Slvs_Context *Slvs_CreateContext()
+{
+    return new Slvs_Context();
+}
+
+void Slvs_DestroyContext(Slvs_Context *ctx)
+{
+    if(ctx == nullptr || ctx == &DefaultContext) return;
+    if(CTX == ctx) Slvs_SetCurrentContext(nullptr);
+    ctx->sys.Clear();
+    ctx->sketch.param.Clear();
+    ctx->sketch.entity.Clear();
+    ctx->sketch.constraint.Clear();
+    delete ctx;
+}
+
+void Slvs_SetCurrentContext(Slvs_Context *ctx)
+{
+    CTX = (ctx != nullptr) ? ctx : &DefaultContext;
+    ThreadSketch = &CTX->sketch;
+}
+
+Slvs_Context *Slvs_GetCurrentContext()
+{
+    return (CTX == &DefaultContext) ? nullptr : CTX;
+}
+
+void Slvs_SolveInContext(Slvs_Context *ctx, Slvs_System *sys, uint32_t hg)
+{
+    Slvs_Context *prev = CTX;
+    Slvs_SetCurrentContext(ctx);
+    Slvs_Solve(sys, hg);
+    Slvs_SetCurrentContext(prev);
+}
+
 void Slvs_ClearSketch()
 {
-    dragged.clear();
-    SYS.Clear();
+    CTX->compiled = false;
+    CTX->values.clear();
+    CTX->settled.clear();
+    CTX->equations.clear();
+    CTX->sys.equationCache = nullptr;
+    CTX->dragged.clear();
+    CTX->sys.Clear();
     SK.param.Clear();
     SK.entity.Clear();
     SK.constraint.Clear();
+    SK.byGroup.clear();
+}
+
+static void Slvs_SetSolverSettings(double tolerance, int maxIterations, int stepMode)
+{
+    CTX->sys.convergeTolerance = (tolerance > 0) ? tolerance : System::CONVERGE_TOLERANCE;
+    CTX->sys.maxIterations     = (maxIterations > 0) ? maxIterations : 50;
+    CTX->sys.stepMode          = (stepMode == SLVS_STEP_DAMPED) ? System::StepMode::DAMPED
+                                                           : System::StepMode::NEWTON;
+}
+
+void Slvs_SetWorkerCount(int workers)
+{
+    CTX->sys.workers = std::max(workers, 1);
+}
+
+void Slvs_SetJacobianMode(int mode)
+{
+    CTX->sys.jacobianMode = (mode == SLVS_JACOBIAN_AUTODIFF) ? System::JacobianMode::AUTODIFF
+                                                             : System::JacobianMode::SYMBOLIC;
+}
+
+void Slvs_SetLeastSquaresMode(int mode)
+{
+    CTX->sys.leastSquaresMode = (mode == SLVS_LEAST_SQUARES_ITERATIVE)
+                                    ? System::LeastSquaresMode::ITERATIVE
+                                    : System::LeastSquaresMode::DIRECT;
+}
+
+void Slvs_SetJacobianUpdate(int update)
+{
+    CTX->sys.jacobianUpdate = (update == SLVS_JACOBIAN_UPDATE_CHORD)
+                                  ? System::JacobianUpdate::CHORD
+                                  : System::JacobianUpdate::EVERY_STEP;
+}
+
+void Slvs_SetStartMode(int mode)
+{
+    CTX->sys.startMode = (mode == SLVS_START_STAGED) ? System::StartMode::STAGED
+                                                     : System::StartMode::AS_GIVEN;
+}
+
+void Slvs_SetBatchPrecision(int precision)
+{
+    CTX->sys.lanePrecision = (precision == SLVS_BATCH_PRECISION_MIXED)
+                                 ? System::LanePrecision::MIXED
+                                 : System::LanePrecision::DOUBLE;
+}
+
+void Slvs_SetFillOrdering(int ordering)
+{
+    switch(ordering) {
+        case SLVS_ORDERING_AMD:     CTX->sys.fillOrdering = FillOrdering::AMD;     break;
+        case SLVS_ORDERING_NATURAL: CTX->sys.fillOrdering = FillOrdering::NATURAL; break;
+        case SLVS_ORDERING_AUTO:    CTX->sys.fillOrdering = FillOrdering::AUTO;    break;
+        default:                    CTX->sys.fillOrdering = FillOrdering::COLAMD;  break;
+    }
+}
+
+int Slvs_SetQRBackend(int backend)
+{
+    QRBackend b = (backend == SLVS_QR_SUITESPARSE) ? QRBackend::SPQR : QRBackend::EIGEN;
+    if(!ReusableSparseQR::Available(b)) b = QRBackend::EIGEN;
+    CTX->sys.qrBackend = b;
+    return (b == QRBackend::SPQR) ? SLVS_QR_SUITESPARSE : SLVS_QR_EIGEN;
+}
+
+void Slvs_SetPolynomialForms(int forms)
+{
+    CTX->sys.polynomialForms = (uint32_t)forms &
+        (ConstraintBase::POLY_DISTANCE | ConstraintBase::POLY_LENGTHS |
+         ConstraintBase::POLY_ANGLE);
+}
+
+void Slvs_SetNormalCharts(int on)
+{
+    CTX->sys.chartNormals = (on != 0);
+}
+
+void Slvs_SetMaxUnknowns(int n)
+{
+    CTX->sys.maxUnknowns = std::max(n, 0);
+}
+
+void Slvs_SetTimeout(int ms)
+{
+    CTX->timeout = std::max(ms, 0);
+}
+
+void Slvs_SetMemoryBudget(int64_t bytes)
+{
+    CTX->memoryBudget = (size_t)std::max(bytes, (int64_t)0);
+}
+
+// Passes the system's trace events on to the context's callback.
+static void Slvs_ForwardTrace(const System::TraceEvent &ev, void *user)
+{
+    Slvs_Context *ctx = (Slvs_Context *)user;
+    Slvs_TraceEvent sev = {};
+    sev.phase            = (int)ev.phase;
+    sev.begin            = ev.begin ? 1 : 0;
+    sev.timeNs           = ev.timeNs;
+    sev.equations        = ev.equations;
+    sev.unknowns         = ev.unknowns;
+    sev.jacobianNonZeros = (int64_t)ev.jacobianNonZeros;
+    sev.iterations       = ev.iterations;
+    sev.residual         = ev.residual;
+    sev.exprsAllocated   = (int64_t)ev.exprsAllocated;
+    sev.temporaryBytes   = (int64_t)ev.temporaryBytes;
+    ctx->trace(&sev, ctx->traceUser);
+}
+
+static void Slvs_SetTraceIn(Slvs_Context *ctx, Slvs_TraceCallback callback, void *user)
+{
+    ctx->trace         = callback;
+    ctx->traceUser     = user;
+    ctx->sys.trace     = (callback != nullptr) ? Slvs_ForwardTrace : nullptr;
+    ctx->sys.traceUser = ctx;
+}
+
+void Slvs_SetTraceCallback(Slvs_TraceCallback callback, void *user)
+{
+    Slvs_SetTraceIn(CTX, callback, user);
+}
+
+void Slvs_SetTraceSteps(int on)
+{
+    CTX->sys.traceSteps = (on != 0);
+}
+
+void Slvs_Cancel(Slvs_Context *ctx)
+{
+    if(ctx == nullptr) ctx = &DefaultContext;
+    ctx->cancelled = true;
+}
+
+static Slvs_Stats Slvs_StatsOf(const System::Stats &s)
+{
+    Slvs_Stats ss = {};
+    ss.iterations       = s.iterations;
+    ss.residual         = sqrt(s.residualSq);
+    ss.equations        = s.equations;
+    ss.unknowns         = s.unknowns;
+    ss.jacobianNonZeros = (int64_t)s.jacobianNonZeros;
+    ss.writeEquationsMs = s.writeEquationsMs;
+    ss.substituteMs     = s.substituteMs;
+    ss.aloneMs          = s.aloneMs;
+    ss.writeJacobianMs  = s.writeJacobianMs;
+    ss.evalJacobianMs   = s.evalJacobianMs;
+    ss.stepMs           = s.stepMs;
+    ss.rankMs           = s.rankMs;
+    ss.findBadMs        = s.findBadMs;
+
+    ss.exprsAllocated          = (int64_t)s.exprsAllocated;
+    ss.temporaryBytes          = (int64_t)s.temporaryBytes;
+    ss.temporaryPeakBytes      = (int64_t)s.temporaryPeakBytes;
+    ss.sourceNodes             = (int64_t)s.sourceNodes;
+    ss.foldedNodes             = (int64_t)s.foldedNodes;
+    ss.partialNodes            = (int64_t)s.partialNodes;
+    ss.jacobianEntries         = (int64_t)s.jacobianEntries;
+    ss.heaviestConstraint      = s.heaviestConstraint.v;
+    ss.heaviestConstraintExprs = (int64_t)s.heaviestConstraintExprs;
+    ss.placeMs                 = s.placeMs;
+    ss.rigidClusters           = s.rigidClusters;
+    ss.copiedBlocks            = s.copiedBlocks;
+    ss.largestBlockEquations   = s.largestBlockEquations;
+    ss.largestBlockUnknowns    = s.largestBlockUnknowns;
+    ss.reusedSteps             = s.reusedSteps;
+    return ss;
+}
+
+// Each solve gets the whole of the timeout, from when it starts, and the
+// whole of the memory budget.
+static void Slvs_StartClock()
+{
+    CTX->sys.cancel       = &CTX->cancelled;
+    CTX->sys.deadline     = (CTX->timeout > 0) ? GetMilliseconds() + CTX->timeout : 0;
+    CTX->sys.timedOut     = false;
+    CTX->sys.memoryBudget = CTX->memoryBudget;
+    CTX->sys.outOfMemory  = false;
+}
+
+// Held for the whole of a solve; when the outermost one finishes, any cancel
+// it was given is spent.
+class Slvs_Solving {
+public:
+    Slvs_Solving() : ctx(CTX) { ctx->solving++; }
+    ~Slvs_Solving() {
+        if(--ctx->solving == 0) ctx->cancelled = false;
+    }
+
+private:
+    Slvs_Context *ctx;
+};
+
+// What a solve that ended with TIMED_OUT failed with: the memory budget, if
+// it was that rather than the clock that ran out.
+static int Slvs_TimedOutResult()
+{
+    return CTX->sys.outOfMemory ? SLVS_RESULT_RESOURCE_EXHAUSTED : SLVS_RESULT_TIMED_OUT;
 }
 
 void Slvs_MarkDragged(Slvs_Entity ptA) {
+    // Dragged params change what every solution is, so nothing is settled.
+    CTX->settled.clear();
     if(Slvs_IsPoint(ptA)) {
         const size_t params = Slvs_IsPoint3D(ptA) ? 3 : 2;
         for(size_t i = 0; i < params; ++i) {
             hParam p = hParam { ptA.param[i] };
-            dragged.insert(p);
+            CTX->dragged.insert(p);
         }
     }
     SolveSpace::Platform::FatalError("Invalid entity for marking dragged");
 }
 
-Slvs_SolveResult Slvs_SolveSketch(uint32_t shg, Slvs_hConstraint **bad = nullptr)
-{
-    SYS.Clear();
-
-    Group g = {};
-    g.h.v = shg;
+// Union-find over the components of a sketch, for Slvs_SolveSketch: each
+// one is dirty if it has to be solved again.
+struct Slvs_Components {
+    std::vector<int>  parent;
+    std::vector<bool> dirty;
 
-    // add params from entities on sketch
-    for(EntityBase &ent : SK.entity) {
-        EntityBase *e = &ent;
-        // skip entities from other groups
-        if (e->group.v != shg) {
-            continue;
+    explicit Slvs_Components(size_t n = 0) : parent(n), dirty(n, false) {
+        for(size_t i = 0; i < n; i++) parent[i] = (int)i;
+    }
+    int Add() {
+        parent.push_back((int)parent.size());
+        dirty.push_back(true);
+        return (int)parent.size() - 1;
+    }
+    int Root(int i) {
+        while(parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
         }
-        for (hParam &parh : e->param) {
-            if (parh.v != 0) {
-                // get params for this entity and add it to the system
-                Param *p = SK.GetParam(parh);
-                p->known = false;
-                SYS.param.Add(p);
-            }
+        return i;
+    }
+    void Join(int a, int b) {
+        a = Root(a);
+        b = Root(b);
+        if(a == b) return;
+        parent[std::max(a, b)] = std::min(a, b);
+        dirty[std::min(a, b)] = dirty[a] || dirty[b];
+    }
+    bool IsDirty(int i) { return dirty[Root(i)]; }
+    // The component that handle h is in, or a new dirty one if it's new
+    int Of(std::unordered_map<uint32_t, int> *m, uint32_t h) {
+        auto it = m->find(h);
+        if(it == m->end()) it = m->emplace(h, Add()).first;
+        return it->second;
+    }
+};
+
+// The solve of one group, by Slvs_SolveSketch or Slvs_SolveAllGroups: it's
+// begun and finished on the calling thread, and the System's Solve in
+// between is all that may run on another.
+struct Slvs_GroupSolve {
+    Group             g      = {};
+    System           *sys    = nullptr;
+    Slvs_Components   comp;
+    SolveResult       status = SolveResult::OKAY;
+    int               dof    = 0;
+    List<hConstraint> bad    = {};
+};
+
+// Work out which components of the group have to be solved again, and put
+// their unknowns in to gs->sys. Params of other groups aren't copied; the
+// equations read them from the sketch as constants.
+static void Slvs_BeginGroup(Slvs_GroupSolve *gs)
+{
+    uint32_t shg = gs->g.h.v;
+    System *sys = gs->sys;
+    sys->Clear();
+    sys->equationCache = &CTX->equations[shg];
+
+    // Everything is solved the first time; after that, only the components
+    // that a param set since, a new entity or a new constraint is in. An
+    // edit to a param of another group that this one reads means anything
+    // could have moved, so then it's all solved again too.
+    Slvs_Settled &st = CTX->settled[shg];
+    Slvs_Components &comp = gs->comp;
+    comp = Slvs_Components(st.dof.size());
+    bool all = st.dof.empty();
+    for(uint32_t ph : st.edited) {
+        auto it = st.param.find(ph);
+        if(it != st.param.end()) {
+            comp.dirty[it->second] = true;
+        } else if(st.external.count(ph)) {
+            all = true;
         }
     }
+    st.edited.clear();
+    if(all) std::fill(comp.dirty.begin(), comp.dirty.end(), true);
 
-    // add params from constraints
-    for(ConstraintBase &con : SK.constraint) {
-        ConstraintBase *c = &con;
-        if(c->group.v != shg)
-            continue;
+    SK.ForEachEntityIn(gs->g.h, [&](EntityBase *e) {
+        int ce = comp.Of(&st.entity, e->h.v);
+        for (hParam &parh : e->param) {
+            if (parh.v != 0) comp.Join(ce, comp.Of(&st.param, parh.v));
+        }
+    });
+    // New constraints join the components of everything they reference.
+    // Their params are generated here; the existing code path below would
+    // otherwise do it.
+    IdList<Equation,hEquation> newEq;
+    ParamSet used;
+    SK.ForEachConstraintIn(gs->g.h, [&](ConstraintBase *c) {
+        if(st.constraint.count(c->h.v)) return;
+        int cc = comp.Of(&st.constraint, c->h.v);
         // If we're solving a sketch twice without calling `Slvs_ClearSketch()` in between,
         // we already have a constraint param in the sketch, and regeneration would simply
         // create another one and orphan the existing one. While this doesn't create any
         // correctness issues, it does waste memory, so identify this case and regenerate
         // only if we actually need to.
-        if(c->valP.v) {
-            SYS.param.Add(SK.GetParam(c->valP));
-            continue;
-        }
-        // If `valP` is 0, this is either a constraint which doesn't have a param, or one
-        // which we haven't seen before, so try to regenerate.
-        // This generates at most a single additional param
-        c->Generate(&SK.param);
-        if(c->valP.v) {
-            SYS.param.Add(SK.GetParam(c->valP));
-
-            if(Slvs_CanInitiallySatisfy(*c)) {
+        if(!c->valP.v) {
+            // If `valP` is 0, this is either a constraint which doesn't have a param, or one
+            // which we haven't seen before, so try to regenerate.
+            // This generates at most a single additional param
+            c->Generate(&SK.param);
+            if(c->valP.v && Slvs_CanInitiallySatisfy(*c)) {
                 c->ModifyToSatisfy();
             }
         }
-    }
+        if(c->valP.v) comp.Join(cc, comp.Of(&st.param, c->valP.v));
+        newEq.Clear();
+        c->GenerateEquations(&newEq);
+        for(Equation &eq : newEq) {
+            used.clear();
+            eq.e->ParamsUsedList(&used);
+            for(hParam hp : used) {
+                auto it = st.param.find(hp.v);
+                if(it != st.param.end()) {
+                    comp.Join(cc, it->second);
+                } else {
+                    st.external.insert(hp.v);
+                }
+            }
+        }
+    });
+    newEq.Clear();
+
+    // add the params of dirty components to the system, and leave the
+    // equations of the rest out
+    SK.ForEachEntityIn(gs->g.h, [&](EntityBase *e) {
+        if(!comp.IsDirty(st.entity[e->h.v])) {
+            sys->settledEntities.insert(e->h);
+            return;
+        }
+        for (hParam &parh : e->param) {
+            if (parh.v != 0) {
+                // get params for this entity and add it to the system
+                Param *p = SK.GetParam(parh);
+                p->known = false;
+                sys->param.Add(p);
+            }
+        }
+    });
+    SK.ForEachConstraintIn(gs->g.h, [&](ConstraintBase *c) {
+        if(!comp.IsDirty(st.constraint[c->h.v])) {
+            sys->settledConstraints.insert(c->h);
+            return;
+        }
+        if(c->valP.v) {
+            sys->param.Add(SK.GetParam(c->valP));
+        }
+    });
 
     // mark dragged params
-    for(hParam p : dragged) {
-        SYS.dragged.insert(p);
+    for(hParam p : CTX->dragged) {
+        sys->dragged.insert(p);
     }
 
-    // for(hParam &par : SYS.dragged) {
+    // for(hParam &par : sys->dragged) {
     //     std::cout << "DraggedParam( h:" << par.v << " )\n";
     // }
 
-    // for(Param &par : SYS.param) {
+    // for(Param &par : sys->param) {
     //     std::cout << "SysParam( " << par.ToString() << " )\n";
     // }
 
-    // for(EntityBase &ent : SK.entity) {
-    //     std::cout << "SketchEntityBase( " << ent.ToString() << " )\n";
-    // }
+    gs->dof = 0;
+    gs->bad.Clear();
+}
 
-    // for(ConstraintBase &con : SK.constraint) {
-    //     std::cout << "SketchConstraintBase( " << con.ToString() << " )\n";
-    // }
+static void Slvs_SolveGroup(Slvs_GroupSolve *gs, bool andFindBad)
+{
+    gs->status = gs->sys->Solve(&gs->g, &gs->dof, &gs->bad, andFindBad, false, false);
+}
+
+// Remember what the solve settled, and count the dof of the components
+// that weren't solved again.
+static void Slvs_FinishGroup(Slvs_GroupSolve *gs)
+{
+    uint32_t shg = gs->g.h.v;
+    Slvs_Settled &st = CTX->settled[shg];
+    Slvs_Components &comp = gs->comp;
+
+    // Other groups that read the params just solved have to solve again.
+    for(auto &other : CTX->settled) {
+        if(other.first == shg) continue;
+        for(Param &p : gs->sys->param) other.second.edited.push_back(p.h.v);
+    }
+    if(gs->status == SolveResult::OKAY && gs->dof >= 0) {
+        // Renumber the components, with the dof of each clean one carried
+        // over and that of each solved one summed from its blocks.
+        std::vector<int> number(comp.parent.size(), -1), settledDof;
+        for(size_t i = 0; i < comp.parent.size(); i++) {
+            int r = comp.Root((int)i);
+            if(number[r] >= 0) continue;
+            number[r] = (int)settledDof.size();
+            settledDof.push_back(comp.dirty[r] ? 0 : st.dof[r]);
+            if(!comp.dirty[r]) gs->dof += st.dof[r];
+        }
+        for(auto *m : { &st.param, &st.constraint, &st.entity }) {
+            for(auto &h : *m) h.second = number[comp.Root(h.second)];
+        }
+        for(auto &d : gs->sys->dofOf) {
+            auto it = st.param.find(d.first);
+            if(it != st.param.end()) settledDof[it->second] += d.second;
+        }
+        st.dof = settledDof;
+    } else {
+        CTX->settled.erase(shg);
+    }
+}
+
+static int Slvs_SketchResultOf(SolveResult status)
+{
+    switch(status) {
+        case SolveResult::OKAY:                     return SLVS_RESULT_OKAY;
+        case SolveResult::DIDNT_CONVERGE:           return SLVS_RESULT_DIDNT_CONVERGE;
+        case SolveResult::REDUNDANT_DIDNT_CONVERGE: return SLVS_RESULT_INCONSISTENT;
+        case SolveResult::REDUNDANT_OKAY:           return SLVS_RESULT_REDUNDANT_OKAY;
+        case SolveResult::TOO_MANY_UNKNOWNS:        return SLVS_RESULT_TOO_MANY_UNKNOWNS;
+        case SolveResult::TIMED_OUT:                return Slvs_TimedOutResult();
+    }
+    return 0;
+}
 
-    List<hConstraint> badList;
-    bool andFindBad = bad != nullptr;
+// Hand the bad constraints to the caller, in a heap allocated array.
+static void Slvs_WriteBad(const List<hConstraint> &badList, Slvs_hConstraint **bad)
+{
+    if(badList.n <= 0) {
+        *bad = nullptr;
+        return;
+    }
+    *bad = static_cast<Slvs_hConstraint *>(malloc(sizeof(Slvs_hConstraint) * badList.n));
+    for(int i = 0; i < badList.n; ++i) {
+        (*bad)[i] = badList[i].v;
+    }
+}
+
+Slvs_SolveResult Slvs_SolveSketch(uint32_t shg, Slvs_hConstraint **bad = nullptr)
+{
+    Slvs_Solving solving;
+    CTX->compiled = false;
+
+    Slvs_GroupSolve gs;
+    gs.g.h.v = shg;
+    gs.sys   = &CTX->sys;
+    Slvs_BeginGroup(&gs);
+
+    Slvs_SetSolverSettings(0, 0, SLVS_STEP_NEWTON);
+    Slvs_StartClock();
+    Slvs_SolveGroup(&gs, bad != nullptr);
+    Slvs_FinishGroup(&gs);
 
-    int dof = 0;
-    SolveResult status = SYS.Solve(&g, &dof, &badList, andFindBad, false, false);
     Slvs_SolveResult sr = {};
-    sr.dof = dof;
-    sr.nbad = badList.n;
-    if(bad) {
-        if(sr.nbad <= 0) {
-            *bad = nullptr;
-        } else {
-            *bad = static_cast<Slvs_hConstraint *>(malloc(sizeof(Slvs_hConstraint) * sr.nbad));
-            for(int i = 0; i < sr.nbad; ++i) {
-                (*bad)[i] = badList[i].v;
+    sr.dof    = gs.dof;
+    sr.nbad   = gs.bad.n;
+    sr.stats  = Slvs_StatsOf(CTX->sys.stats);
+    sr.result = Slvs_SketchResultOf(gs.status);
+    if(bad) Slvs_WriteBad(gs.bad, bad);
+    gs.bad.Clear();
+    return sr;
+}
+
+// The groups of the sketch in the order they're solved, each tagged with
+// its level: a group reads the params of groups at lower levels only, so
+// the groups of a level can be solved at once. Group a goes before group b
+// when something in b refers to an entity of a; where the references go
+// round in a cycle, the group with the lowest handle goes first.
+static std::vector<std::pair<int, uint32_t>> Slvs_GroupLevels()
+{
+    std::unordered_map<uint32_t, std::unordered_set<uint32_t>> after;
+    std::unordered_map<uint32_t, int> before;
+    std::vector<uint32_t> groups;
+    for(auto &gi : SK.byGroup) {
+        groups.push_back(gi.first);
+        before[gi.first];
+    }
+    std::sort(groups.begin(), groups.end());
+
+    auto refer = [&](uint32_t hg, hEntity he) {
+        if(he.v == 0) return;
+        EntityBase *e = SK.entity.FindByIdNoOops(he);
+        if(e == nullptr || e->group.v == hg) return;
+        if(after[e->group.v].insert(hg).second) before[hg]++;
+    };
+    for(uint32_t hg : groups) {
+        SK.ForEachEntityIn(hGroup { hg }, [&](EntityBase *e) {
+            for(hEntity p : e->point) refer(hg, p);
+            refer(hg, e->normal);
+            refer(hg, e->distance);
+            refer(hg, e->workplane);
+        });
+        SK.ForEachConstraintIn(hGroup { hg }, [&](ConstraintBase *c) {
+            for(hEntity he : { c->ptA, c->ptB, c->entityA, c->entityB, c->entityC,
+                               c->entityD, c->workplane }) {
+                refer(hg, he);
             }
-        }
+        });
     }
-    sr.result = 0;
-    switch(status) {
-        case SolveResult::OKAY: {
-            sr.result = SLVS_RESULT_OKAY;
-            return sr;
+
+    // Kahn's algorithm, taking the groups in handle order
+    std::vector<std::pair<int, uint32_t>> order;
+    std::unordered_map<uint32_t, int> level;
+    std::unordered_set<uint32_t> done;
+    while(order.size() < groups.size()) {
+        uint32_t next = 0;
+        bool found = false;
+        for(uint32_t hg : groups) {
+            if(done.count(hg) || before[hg] > 0) continue;
+            next = hg;
+            found = true;
+            break;
+        }
+        if(!found) {
+            // a cycle, so break it at its lowest group
+            for(uint32_t hg : groups) {
+                if(done.count(hg)) continue;
+                next = hg;
+                break;
+            }
         }
-        case SolveResult::DIDNT_CONVERGE: {
-            sr.result = SLVS_RESULT_DIDNT_CONVERGE;
-            return sr;
+        done.insert(next);
+        order.emplace_back(level[next], next);
+        for(uint32_t hb : after[next]) {
+            if(done.count(hb)) continue;
+            before[hb]--;
+            level[hb] = std::max(level[hb], level[next] + 1);
         }
-        case SolveResult::REDUNDANT_DIDNT_CONVERGE: {
-            sr.result = SLVS_RESULT_INCONSISTENT;
-            return sr;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<int, uint32_t> &a, const std::pair<int, uint32_t> &b) {
+                         return a.first < b.first;
+                     });
+    return order;
+}
+
+Slvs_SolveResult Slvs_SolveAllGroups(Slvs_hConstraint **bad = nullptr)
+{
+    Slvs_Solving solving;
+    CTX->compiled = false;
+    CTX->sys.Clear();
+    Slvs_SetSolverSettings(0, 0, SLVS_STEP_NEWTON);
+    Slvs_StartClock();
+
+    std::vector<std::pair<int, uint32_t>> order = Slvs_GroupLevels();
+
+    Slvs_SolveResult sr = {};
+    sr.result = SLVS_RESULT_OKAY;
+    System::Stats stats;
+    List<hConstraint> badList = {};
+
+    // The first group of each level is solved on the context's own System,
+    // and the others (when there are workers to spare) each on one of their
+    // own, with the same settings.
+    std::vector<std::unique_ptr<System>> spare;
+    std::vector<Slvs_GroupSolve> level;
+    for(size_t i = 0; i < order.size();) {
+        size_t end = i;
+        while(end < order.size() && order[end].first == order[i].first) end++;
+        int threads = std::min(CTX->sys.workers, (int)(end - i));
+        if(threads <= 1) end = i + 1;
+
+        level.clear();
+        level.resize(end - i);
+        while(spare.size() + 1 < level.size()) spare.push_back(CTX->sys.MakeWorker());
+        for(size_t j = 0; j < level.size(); j++) {
+            level[j].g.h.v = order[i + j].second;
+            level[j].sys   = (j == 0) ? &CTX->sys : spare[j - 1].get();
+            Slvs_BeginGroup(&level[j]);
         }
-        case SolveResult::REDUNDANT_OKAY: {
-            sr.result = SLVS_RESULT_REDUNDANT_OKAY;
-            return sr;
+
+        if(threads <= 1) {
+            Slvs_SolveGroup(&level[0], bad != nullptr);
+        } else {
+            // The workers solve on the sketch of this thread; they only write
+            // the params of their own groups, and the sketch's lists don't
+            // grow until they've all finished. The context's System is
+            // solved on this thread, so that its expressions outlive them.
+            std::atomic<size_t> next(1);
+            Slvs_Context *ctx = CTX;
+            auto work = [&]() {
+                CTX = ctx;
+                SolveSpace::ThreadSketch = &ctx->sketch;
+                for(size_t j; (j = next++) < level.size();) {
+                    Slvs_SolveGroup(&level[j], bad != nullptr);
+                }
+            };
+            std::vector<std::thread> pool;
+            for(int t = 1; t < threads; t++) {
+                pool.emplace_back(work);
+            }
+            Slvs_SolveGroup(&level[0], bad != nullptr);
+            work();
+            for(std::thread &th : pool) {
+                th.join();
+            }
         }
-        case SolveResult::TOO_MANY_UNKNOWNS: {
-            sr.result = SLVS_RESULT_TOO_MANY_UNKNOWNS;
-            return sr;
+
+        for(Slvs_GroupSolve &gs : level) {
+            Slvs_FinishGroup(&gs);
+            stats.Add(gs.sys->stats);
+            stats.equations += gs.sys->stats.equations;
+            stats.unknowns  += gs.sys->stats.unknowns;
+            sr.dof += gs.dof;
+            int result = Slvs_SketchResultOf(gs.status);
+            if(sr.result == SLVS_RESULT_OKAY) sr.result = result;
+            for(hConstraint hc : gs.bad) badList.Add(&hc);
+            gs.bad.Clear();
         }
+        i = end;
     }
+
+    sr.nbad  = badList.n;
+    sr.stats = Slvs_StatsOf(stats);
+    if(bad) Slvs_WriteBad(badList, bad);
+    badList.Clear();
     return sr;
 }
 
@@ -975,97 +1610,254 @@ void Slvs_SetParamValue(uint32_t ph, double value)
 {
     Param* p = SK.param.FindById(hParam { ph });
     p->val = value;
+    for(auto &st : CTX->settled) st.second.edited.push_back(ph);
 }
 
-void Slvs_Solve(Slvs_System *ssys, uint32_t shg)
+int Slvs_ParamSlot(uint32_t ph)
+{
+    return SK.param.StoreIndex(hParam { ph });
+}
+
+double *Slvs_ParamValues(size_t *count)
 {
-    SYS.Clear();
+    std::vector<double> &values = CTX->values;
+    values.resize(SK.param.StoreSize());
+    for(size_t i = 0; i < values.size(); i++) {
+        values[i] = SK.param.AtStore((int)i).val;
+    }
+    if(count) *count = values.size();
+    return values.data();
+}
+
+void Slvs_CommitParamValues()
+{
+    const std::vector<double> &values = CTX->values;
+    int n = std::min((int)values.size(), SK.param.StoreSize());
+    for(int i = 0; i < n; i++) {
+        Param &p = SK.param.AtStore(i);
+        if(p.val == values[i]) continue;
+        // A removed param's place may not have been reused yet
+        if(SK.param.FindByIdNoOops(p.h) != &p) continue;
+        p.val = values[i];
+        for(auto &st : CTX->settled) st.second.edited.push_back(p.h.v);
+    }
+}
+
+void Slvs_BeginSystem(uint32_t shg, int params, int entities, int constraints)
+{
+    // The sketch is replaced, so whatever Slvs_SolveSketch settled is gone.
+    CTX->settled.clear();
+    CTX->compiled = false;
+    CTX->sys.Clear();
+    // What the constraints wrote is kept, for as long as they're the same.
+    CTX->sys.equationCache = &CTX->equations[shg];
+    CTX->group = shg;
     SK.param.Clear();
     SK.entity.Clear();
     SK.constraint.Clear();
-    int i;
-    for(i = 0; i < ssys->params; i++) {
-        Slvs_Param *sp = &(ssys->param[i]);
-        Param p = {};
+    SK.byGroup.clear();
 
-        p.h.v = sp->h;
-        p.val = sp->val;
-        SK.param.Add(&p);
-        if(sp->group == shg) {
-            SYS.param.Add(&p);
-        }
+    SK.param.ReserveMore(std::max(params, 0) + std::max(constraints, 0));
+    SK.entity.ReserveMore(std::max(entities, 0));
+    SK.constraint.ReserveMore(std::max(constraints, 0));
+}
+
+void Slvs_AddSystemParam(const Slvs_Param *sp)
+{
+    Param p = {};
+    p.h.v = sp->h;
+    p.val = sp->val;
+    // The params of other groups are fixed, so the equations that read
+    // them fold them in as constants.
+    p.known = (sp->group != CTX->group);
+    SK.param.AddUnordered(&p);
+    if(sp->group == CTX->group) {
+        CTX->sys.param.AddUnordered(&p);
     }
+}
 
-    for(i = 0; i < ssys->entities; i++) {
-        Slvs_Entity *se = &(ssys->entity[i]);
-        EntityBase e = {};
-        e.type = Slvs_CTypeToEntityBaseType(se->type);
-        e.h.v           = se->h;
-        e.group.v       = se->group;
-        e.workplane.v   = se->wrkpl;
-        e.point[0].v    = se->point[0];
-        e.point[1].v    = se->point[1];
-        e.point[2].v    = se->point[2];
-        e.point[3].v    = se->point[3];
-        e.normal.v      = se->normal;
-        e.distance.v    = se->distance;
-        e.param[0].v    = se->param[0];
-        e.param[1].v    = se->param[1];
-        e.param[2].v    = se->param[2];
-        e.param[3].v    = se->param[3];
-
-        SK.entity.Add(&e);
-    }
-    ParamList params = {};
-    for(i = 0; i < ssys->constraints; i++) {
-        Slvs_Constraint *sc = &(ssys->constraint[i]);
-        ConstraintBase c = {};
-        c.type = Slvs_CTypeToConstraintBaseType(sc->type);
-        c.h.v           = sc->h;
-        c.group.v       = sc->group;
-        c.workplane.v   = sc->wrkpl;
-        c.valA          = sc->valA;
-        c.ptA.v         = sc->ptA;
-        c.ptB.v         = sc->ptB;
-        c.entityA.v     = sc->entityA;
-        c.entityB.v     = sc->entityB;
-        c.entityC.v     = sc->entityC;
-        c.entityD.v     = sc->entityD;
-        c.other         = (sc->other) ? true : false;
-        c.other2        = (sc->other2) ? true : false;
+void Slvs_AddSystemEntity(const Slvs_Entity *se)
+{
+    EntityBase e = {};
+    e.type = Slvs_CTypeToEntityBaseType(se->type);
+    e.h.v           = se->h;
+    e.group.v       = se->group;
+    e.workplane.v   = se->wrkpl;
+    e.point[0].v    = se->point[0];
+    e.point[1].v    = se->point[1];
+    e.point[2].v    = se->point[2];
+    e.point[3].v    = se->point[3];
+    e.normal.v      = se->normal;
+    e.distance.v    = se->distance;
+    e.param[0].v    = se->param[0];
+    e.param[1].v    = se->param[1];
+    e.param[2].v    = se->param[2];
+    e.param[3].v    = se->param[3];
+
+    SK.entity.AddUnordered(&e);
+}
+
+void Slvs_AddSystemConstraint(const Slvs_Constraint *sc)
+{
+    ConstraintBase c = {};
+    c.type = Slvs_CTypeToConstraintBaseType(sc->type);
+    c.h.v           = sc->h;
+    c.group.v       = sc->group;
+    c.workplane.v   = sc->wrkpl;
+    c.valA          = sc->valA;
+    c.ptA.v         = sc->ptA;
+    c.ptB.v         = sc->ptB;
+    c.entityA.v     = sc->entityA;
+    c.entityB.v     = sc->entityB;
+    c.entityC.v     = sc->entityC;
+    c.entityD.v     = sc->entityD;
+    c.other         = (sc->other) ? true : false;
+    c.other2        = (sc->other2) ? true : false;
+    if(c.type == ConstraintBase::Type::GEAR_MESH) {
+        c.teethA    = sc->other;
+        c.teethB    = sc->other2;
+    }
 
+    SK.constraint.AddUnordered(&c);
+}
+
+void Slvs_AddSystemDragged(Slvs_hParam ph)
+{
+    if(ph) {
+        hParam hp = { ph };
+        CTX->sys.dragged.insert(hp);
+    }
+}
+
+// Sort what was added to the sketch since Slvs_BeginSystem, and give the
+// constraints that need them, and don't have them yet, their params, in the
+// order that they were added.
+static void Slvs_FinishSystem()
+{
+    SK.param.SortById();
+    // Making constraints satisfied to start with looks up their entities.
+    SK.entity.SortById();
+
+    ParamList &params = CTX->generated;
+    for(int i = 0; i < SK.constraint.StoreSize(); i++) {
+        ConstraintBase &c = SK.constraint.AtStore(i);
+        if(c.valP.v) continue;
         c.Generate(&params);
-        if(!params.IsEmpty()) {
-            for(Param &p : params) {
-                p.h = SK.param.AddAndAssignId(&p);
-                c.valP = p.h;
-                SYS.param.Add(&p);
-            }
-            params.Clear();
+        if(params.IsEmpty()) continue;
 
-            if(Slvs_CanInitiallySatisfy(c)) {
-                c.ModifyToSatisfy();
-            }
+        for(Param &p : params) {
+            p.h = SK.param.AddAndAssignId(&p);
+            c.valP = p.h;
+            CTX->sys.param.AddUnordered(&p);
         }
+        params.Clear();
 
-        SK.constraint.Add(&c);
+        if(Slvs_CanInitiallySatisfy(c)) {
+            c.ModifyToSatisfy();
+        }
     }
+    CTX->sys.param.SortById();
+    SK.constraint.SortById();
+    SK.IndexGroups();
+}
 
+// Copy a system into the current context's sketch. Lists are cleared rather
+// than freed after each solve, so importing a system no bigger than the last
+// one reuses their storage; everything is appended and then sorted once.
+// Its params are the first in the store, in order.
+static void Slvs_ImportSystem(const Slvs_System *ssys, uint32_t shg)
+{
+    Slvs_BeginSystem(shg, ssys->params, ssys->entities, ssys->constraints);
+    int i;
+    for(i = 0; i < ssys->params; i++) {
+        Slvs_AddSystemParam(&ssys->param[i]);
+    }
+    for(i = 0; i < ssys->entities; i++) {
+        Slvs_AddSystemEntity(&ssys->entity[i]);
+    }
+    for(i = 0; i < ssys->constraints; i++) {
+        Slvs_AddSystemConstraint(&ssys->constraint[i]);
+    }
     for(i = 0; i < ssys->ndragged; i++) {
-        if(ssys->dragged[i]) {
-            hParam hp = { ssys->dragged[i] };
-            SYS.dragged.insert(hp);
+        Slvs_AddSystemDragged(ssys->dragged[i]);
+    }
+    Slvs_FinishSystem();
+}
+
+// Fill in ssys->dParam from the compiled system, at its current solution.
+static void Slvs_WriteSensitivities(Slvs_System *ssys)
+{
+    const int n = ssys->params;
+    std::fill(ssys->dParam, ssys->dParam + (size_t)ssys->sensitivities * n, 0.0);
+
+    std::vector<Param *> values;
+    std::vector<int>     rows;
+    for(int i = 0; i < ssys->sensitivities; i++) {
+        ConstraintBase *c = SK.constraint.FindByIdNoOops(hConstraint { ssys->sensitivity[i] });
+        if(c == nullptr || !c->valAParam.v) continue;
+        values.push_back(SK.GetParam(c->valAParam));
+        rows.push_back(i);
+    }
+    System &sys = CTX->sys;
+    Eigen::MatrixXd dX;
+    if(values.empty() || !sys.Sensitivities(values, &dX)) return;
+
+    std::unordered_map<uint32_t, int> column;
+    for(int j = 0; j < sys.mat.n; j++) {
+        column[sys.mat.param[j].v] = j;
+    }
+    for(int k = 0; k < n; k++) {
+        // A param that was substituted away moves with its substitute.
+        hParam hp    = { ssys->param[k].h };
+        double scale = 1.0;
+        auto sub = sys.compiledSubs.find(hp);
+        if(sub != sys.compiledSubs.end()) {
+            scale = sub->second.k;
+            hp    = sub->second.by->h;
+        }
+        auto it = column.find(hp.v);
+        if(it == column.end()) continue;
+        for(size_t i = 0; i < rows.size(); i++) {
+            ssys->dParam[(size_t)rows[i] * n + k] = scale * dX(it->second, (int)i);
         }
     }
+}
 
+// Solve the system that's in the sketch for group shg, with ssys's settings,
+// and set its results other than the params' values.
+static SolveResult Slvs_SolveImported(Slvs_System *ssys, uint32_t shg,
+                                      List<hConstraint> *bad)
+{
     Group g = {};
     g.h.v = shg;
 
-    List<hConstraint> bad = {};
-
     // Now we're finally ready to solve!
     bool andFindBad = ssys->calculateFaileds ? true : false;
-    SolveResult how = SYS.Solve(&g, &(ssys->dof), &bad, andFindBad, /*andFindFree=*/false);
+    bool andFindFree = ssys->calculateFree ? true : false;
+    Slvs_SetSolverSettings(ssys->tolerance, ssys->maxIterations, ssys->stepMode);
+    Slvs_StartClock();
+    CTX->sys.profile = (ssys->cost != NULL);
+    SolveResult how = CTX->sys.Solve(&g, &(ssys->dof), bad, andFindBad, andFindFree);
+    CTX->sys.profile = false;
+    ssys->factorNonZeros = (int64_t)CTX->sys.factorNonZeros;
+    ssys->stats          = Slvs_StatsOf(CTX->sys.stats);
+
+    if(ssys->cost) {
+        int ncost = 0;
+        for(const auto &it : CTX->sys.stats.constraints) {
+            if(ncost < ssys->costs) {
+                Slvs_ConstraintCost *sc = &(ssys->cost[ncost]);
+                const System::ConstraintCost &c = it.second;
+                sc->h                        = it.first;
+                sc->exprNodes                = (int64_t)c.exprNodes;
+                sc->jacobianNonZeros         = (int64_t)c.jacobianNonZeros;
+                sc->evalMs                   = c.evalMs;
+                sc->iterationsAboveTolerance = c.iterationsAboveTolerance;
+            }
+            ncost++;
+        }
+        ssys->costs = ncost;
+    }
 
     switch(how) {
         case SolveResult::OKAY:
@@ -1087,30 +1879,784 @@ void Slvs_Solve(Slvs_System *ssys, uint32_t shg)
         case SolveResult::TOO_MANY_UNKNOWNS:
             ssys->result = SLVS_RESULT_TOO_MANY_UNKNOWNS;
             break;
-    }
 
-    // Write the new parameter values back to our caller.
-    for(i = 0; i < ssys->params; i++) {
-        Slvs_Param *sp = &(ssys->param[i]);
-        hParam hp = { sp->h };
-        sp->val = SK.GetParam(hp)->val;
+        case SolveResult::TIMED_OUT:
+            ssys->result = Slvs_TimedOutResult();
+            break;
     }
 
     if(ssys->failed) {
         // Copy over any the list of problematic constraints.
-        for(i = 0; i < ssys->faileds && i < bad.n; i++) {
-            ssys->failed[i] = bad[i].v;
+        for(int i = 0; i < ssys->faileds && i < bad->n; i++) {
+            ssys->failed[i] = (*bad)[i].v;
+        }
+        ssys->faileds = bad->n;
+    }
+    return how;
+}
+
+void Slvs_Solve(Slvs_System *ssys, uint32_t shg)
+{
+    Slvs_Solving solving;
+    Slvs_ImportSystem(ssys, shg);
+
+    int i;
+    List<hConstraint> bad = {};
+    SolveResult how = Slvs_SolveImported(ssys, shg, &bad);
+
+    // Write the new parameter values back to our caller; they're the first
+    // params in the store, in order.
+    for(i = 0; i < ssys->params; i++) {
+        ssys->param[i].val = SK.param.AtStore(i).val;
+    }
+
+    if(ssys->calculateFree && ssys->freeParam) {
+        // Copy over the parameters that are still free to move.
+        int nfree = 0;
+        if(how == SolveResult::OKAY) {
+            for(i = 0; i < ssys->params; i++) {
+                if(!SK.param.AtStore(i).free) continue;
+                if(nfree < ssys->freeParams) ssys->freeParam[nfree] = ssys->param[i].h;
+                nfree++;
+            }
+        }
+        ssys->freeParams = nfree;
+    }
+
+    if(ssys->sensitivities > 0 && ssys->dParam) {
+        // The solve doesn't keep the dimensions' values as params, so the
+        // solution is compiled, to differentiate with respect to them.
+        bool solved = (how == SolveResult::OKAY || how == SolveResult::REDUNDANT_OKAY);
+        std::fill(ssys->dParam, ssys->dParam + (size_t)ssys->sensitivities * ssys->params, 0.0);
+        if(solved && Slvs_Compile(ssys, shg) == SLVS_RESULT_OKAY) {
+            Slvs_WriteSensitivities(ssys);
+        }
+        CTX->compiled = false;
+    }
+
+    bad.Clear();
+    CTX->sys.Clear();
+    SK.param.Clear();
+    SK.entity.Clear();
+    SK.constraint.Clear();
+    SK.byGroup.clear();
+
+    FreeAllTemporary();
+}
+
+void Slvs_SolveSystem(Slvs_System *ssys)
+{
+    Slvs_Solving solving;
+    Slvs_FinishSystem();
+
+    List<hConstraint> bad = {};
+    SolveResult how = Slvs_SolveImported(ssys, CTX->group, &bad);
+
+    if(ssys->calculateFree && ssys->freeParam) {
+        int nfree = 0;
+        if(how == SolveResult::OKAY) {
+            for(const Param &p : SK.param) {
+                if(!p.free) continue;
+                if(nfree < ssys->freeParams) ssys->freeParam[nfree] = p.h.v;
+                nfree++;
+            }
         }
-        ssys->faileds = bad.n;
+        ssys->freeParams = nfree;
     }
 
+    // The sketch stays, to be read; nothing else of the solve does.
     bad.Clear();
-    SYS.Clear();
+    CTX->sys.Clear();
+    FreeAllTemporary();
+}
+
+// Whether e can be evaluated: it reads no variables, and, if they're wanted,
+// only params that the sketch has.
+static bool Slvs_CanEvaluate(const Expr *e, bool withParams)
+{
+    switch(e->op) {
+        case Expr::Op::PARAM:
+            return !withParams || SK.param.FindByIdNoOops(e->parh) != nullptr;
+        case Expr::Op::VARIABLE:
+            return false;
+        default:
+            break;
+    }
+    int n = e->Children();
+    return (n < 1 || Slvs_CanEvaluate(e->a, withParams)) &&
+           (n < 2 || Slvs_CanEvaluate(e->b, withParams));
+}
+
+// Set each dimension that has an expression to its value, from the params
+// that it reads as they are now. Returns false if one of them isn't a
+// finite number; that dimension keeps the value it had.
+static bool Slvs_EvalDimensions()
+{
+    if(CTX->dimensionValue.empty()) return true;
+
+    CTX->dimensions.Eval();
+    bool ok = true;
+    for(const auto &dv : CTX->dimensionValue) {
+        double v = CTX->dimensions.Value(dv.second);
+        if(!std::isfinite(v)) {
+            ok = false;
+            continue;
+        }
+        ConstraintBase *c = SK.constraint.FindById(dv.first);
+        c->valA = v;
+        SK.GetParam(c->valAParam)->val = v;
+    }
+    return ok;
+}
+
+// Whether a dimension's expression, in the compiled system, reads param hp
+static bool Slvs_DimensionsRead(hParam hp)
+{
+    for(const ExprTape::Input &in : CTX->dimensions.params) {
+        if(in.parh == hp) return true;
+    }
+    return false;
+}
+
+// Lower the expressions of the dimensions that have them to a tape, to
+// evaluate before each solve, and set the dimensions to their values. An
+// expression that reads a param the system doesn't have evaluates to NaN,
+// so every solve of it fails.
+static void Slvs_CompileDimensions()
+{
+    CTX->dimensions.Clear();
+    CTX->dimensionValue.clear();
+    for(const auto &it : CTX->expressions) {
+        ConstraintBase *c = SK.constraint.FindByIdNoOops(hConstraint { it.first });
+        if(c == nullptr || !c->valAParam.v) continue;
+
+        std::string error;
+        Expr *e = Expr::Parse(it.second, &error);
+        if(e == nullptr || !Slvs_CanEvaluate(e, /*withParams=*/true)) e = Expr::From(NAN);
+        CTX->dimensionValue.emplace_back(c->h, CTX->dimensions.Compile(e));
+    }
+    Slvs_EvalDimensions();
+}
+
+int Slvs_Compile(Slvs_System *ssys, uint32_t shg)
+{
+    Slvs_ImportSystem(ssys, shg);
+
+    // Each dimension gets a param of its own for its value. It's neither
+    // known nor solved for, so it stays in the equations as a reference,
+    // rather than being folded in to them as a constant.
+    SK.ForEachConstraintIn(hGroup { shg }, [&](ConstraintBase *c) {
+        if(!c->HasLabel() || c->type == ConstraintBase::Type::COMMENT) return;
+
+        Param p = {};
+        p.val = c->valA;
+        c->valAParam = SK.param.AddAndAssignId(&p);
+    });
+    Slvs_CompileDimensions();
+
+    Group g = {};
+    g.h.v = shg;
+    CTX->compiled = CTX->sys.Compile(&g);
+    FreeAllTemporary();
+    return CTX->compiled ? SLVS_RESULT_OKAY : SLVS_RESULT_TOO_MANY_UNKNOWNS;
+}
+
+int Slvs_SetConstraintValue(Slvs_hConstraint hc, double value)
+{
+    if(!CTX->compiled) return -1;
+    ConstraintBase *c = SK.constraint.FindByIdNoOops(hConstraint { hc });
+    if(c == nullptr || !c->valAParam.v) return -1;
+
+    c->valA = value;
+    SK.GetParam(c->valAParam)->val = value;
+    return 0;
+}
+
+int Slvs_SetConstraintExpression(Slvs_hConstraint hc, const char *expr)
+{
+    if(expr == nullptr || *expr == '\0') {
+        CTX->expressions.erase(hc);
+        return 0;
+    }
+    std::string error;
+    Expr *e = Expr::Parse(expr, &error);
+    bool ok = (e != nullptr && Slvs_CanEvaluate(e, /*withParams=*/false));
+    FreeAllTemporary();
+    if(!ok) return -1;
+
+    CTX->expressions[hc] = expr;
+    return 0;
+}
+
+int Slvs_SetParamStart(Slvs_hParam hp, double value)
+{
+    if(!CTX->compiled) return -1;
+    Param *p = CTX->sys.param.FindByIdNoOops(hParam { hp });
+    if(p == nullptr) {
+        // A param that a dimension's expression reads isn't solved for, but
+        // the next solve reads it.
+        if(!Slvs_DimensionsRead(hParam { hp })) return -1;
+        SK.GetParam(hParam { hp })->val = value;
+        return 0;
+    }
+
+    p->val = value;
+    SK.GetParam(p->h)->val = value;
+    // A param that was substituted away starts wherever its substitute
+    // puts it.
+    auto it = CTX->sys.compiledSubs.find(p->h);
+    if(it != CTX->sys.compiledSubs.end()) {
+        const Substitution &s = it->second;
+        s.by->val = (value - s.c) / s.k;
+        SK.GetParam(s.by->h)->val = s.by->val;
+    }
+    return 0;
+}
+
+static int Slvs_ResultOf(SolveResult how)
+{
+    switch(how) {
+        case SolveResult::OKAY:
+            return SLVS_RESULT_OKAY;
+
+        case SolveResult::REDUNDANT_OKAY:
+            return SLVS_RESULT_REDUNDANT_OKAY;
+
+        case SolveResult::TIMED_OUT:
+            return Slvs_TimedOutResult();
+
+        default:
+            return SLVS_RESULT_DIDNT_CONVERGE;
+    }
+}
+
+void Slvs_Resolve(Slvs_System *ssys)
+{
+    ssassert(CTX->compiled, "No compiled system to solve");
+    Slvs_Solving solving;
+
+    Slvs_SetSolverSettings(ssys->tolerance, ssys->maxIterations, ssys->stepMode);
+    Slvs_StartClock();
+    if(Slvs_EvalDimensions()) {
+        ssys->result = Slvs_ResultOf(CTX->sys.Resolve(&(ssys->dof)));
+    } else {
+        ssys->result = SLVS_RESULT_DIDNT_CONVERGE;
+        ssys->dof    = -1;
+    }
+    ssys->factorNonZeros = (int64_t)CTX->sys.factorNonZeros;
+    ssys->stats          = Slvs_StatsOf(CTX->sys.stats);
+
+    for(int i = 0; i < ssys->params; i++) {
+        Slvs_Param *sp = &(ssys->param[i]);
+        sp->val = SK.GetParam(hParam { sp->h })->val;
+    }
+    if(ssys->failed) ssys->faileds = 0;
+
+    if(ssys->sensitivities > 0 && ssys->dParam) {
+        if(ssys->result == SLVS_RESULT_OKAY || ssys->result == SLVS_RESULT_REDUNDANT_OKAY) {
+            Slvs_WriteSensitivities(ssys);
+        } else {
+            std::fill(ssys->dParam, ssys->dParam + (size_t)ssys->sensitivities * ssys->params, 0.0);
+        }
+    }
+}
+
+void Slvs_Drag(Slvs_System *ssys, int budgetUs)
+{
+    ssassert(CTX->compiled, "No compiled system to drag");
+    Slvs_Solving solving;
+
+    Slvs_SetSolverSettings(ssys->tolerance, ssys->maxIterations, ssys->stepMode);
+    Slvs_StartClock();
+    ssys->result = Slvs_EvalDimensions() ? Slvs_ResultOf(CTX->sys.Drag(std::max(budgetUs, 0)))
+                                         : SLVS_RESULT_DIDNT_CONVERGE;
+    ssys->dof    = -1;
+    ssys->factorNonZeros = (int64_t)CTX->sys.factorNonZeros;
+    ssys->stats          = Slvs_StatsOf(CTX->sys.stats);
+
+    for(int i = 0; i < ssys->params; i++) {
+        Slvs_Param *sp = &(ssys->param[i]);
+        sp->val = SK.GetParam(hParam { sp->h })->val;
+    }
+    if(ssys->failed) ssys->faileds = 0;
+}
+
+int Slvs_Check(Slvs_System *ssys, uint32_t shg, double *residual)
+{
+    Slvs_ImportSystem(ssys, shg);
+
+    Group g = {};
+    g.h.v = shg;
+    Slvs_SetSolverSettings(ssys->tolerance, ssys->maxIterations, ssys->stepMode);
+    std::unordered_map<uint32_t, double> worst;
+    bool ok = CTX->sys.Check(&g, &worst);
+    for(int i = 0; i < ssys->constraints; i++) {
+        auto it = worst.find(ssys->constraint[i].h);
+        residual[i] = (it == worst.end()) ? 0.0 : it->second;
+    }
+
+    CTX->sys.Clear();
     SK.param.Clear();
     SK.entity.Clear();
     SK.constraint.Clear();
+    SK.byGroup.clear();
 
     FreeAllTemporary();
+    return ok ? SLVS_RESULT_OKAY : SLVS_RESULT_DIDNT_CONVERGE;
+}
+
+// Give ctx the same solver settings as from.
+static void Slvs_CopySettings(Slvs_Context *ctx, const Slvs_Context *from)
+{
+    ctx->sys.workers          = from->sys.workers;
+    ctx->sys.jacobianMode     = from->sys.jacobianMode;
+    ctx->sys.leastSquaresMode = from->sys.leastSquaresMode;
+    ctx->sys.jacobianUpdate   = from->sys.jacobianUpdate;
+    ctx->sys.startMode        = from->sys.startMode;
+    ctx->sys.lanePrecision    = from->sys.lanePrecision;
+    ctx->sys.fillOrdering     = from->sys.fillOrdering;
+    ctx->sys.qrBackend        = from->sys.qrBackend;
+    ctx->sys.polynomialForms  = from->sys.polynomialForms;
+    ctx->sys.chartNormals     = from->sys.chartNormals;
+    ctx->sys.traceSteps       = from->sys.traceSteps;
+    ctx->sys.maxUnknowns      = from->sys.maxUnknowns;
+    ctx->timeout              = from->timeout;
+    ctx->memoryBudget         = from->memoryBudget;
+    ctx->expressions          = from->expressions;
+    Slvs_SetTraceIn(ctx, from->trace, from->traceUser);
+}
+
+void Slvs_ResetContext(Slvs_Context *ctx)
+{
+    if(ctx == nullptr) ctx = &DefaultContext;
+    // The settings that a new context starts with
+    static const Slvs_Context *const Fresh = new Slvs_Context();
+
+    // The lists and tables clear to empty, but keep their storage.
+    ctx->sys.Clear();
+    ctx->sketch.param.Clear();
+    ctx->sketch.entity.Clear();
+    ctx->sketch.constraint.Clear();
+    ctx->sketch.byGroup.clear();
+    ctx->dragged.clear();
+    ctx->generated.Clear();
+    ctx->compiled = false;
+    ctx->dimensions.Clear();
+    ctx->dimensionValue.clear();
+    ctx->values.clear();
+    ctx->settled.clear();
+    ctx->equations.clear();
+    ctx->group     = 0;
+    ctx->cancelled = false;
+    Slvs_CopySettings(ctx, Fresh);
+}
+
+void Slvs_TrimThreadMemory()
+{
+    TrimTemporary();
+}
+
+// How far start k of a multi-start solve moves param h, which has value v:
+// a fixed pseudo-random fraction of (1 + |v|), up to SPREAD of it per start.
+static double Slvs_StartOffset(uint32_t h, int k, double v)
+{
+    const double SPREAD = 0.02;
+    // splitmix64, of the param and the start together
+    uint64_t z = ((uint64_t)h << 32 | (uint32_t)k) + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    double u = (double)(z >> 11) / (double)(1ull << 53) * 2 - 1;
+    return SPREAD * k * (1 + fabs(v)) * u;
+}
+
+int Slvs_SolveMultiStart(Slvs_System *ssys, uint32_t shg, int starts)
+{
+    auto converged = [](int result) {
+        return result == SLVS_RESULT_OKAY || result == SLVS_RESULT_REDUNDANT_OKAY;
+    };
+    auto retry = [](int result) {
+        return result == SLVS_RESULT_DIDNT_CONVERGE || result == SLVS_RESULT_INCONSISTENT;
+    };
+
+    std::vector<double> start(ssys->params);
+    for(int i = 0; i < ssys->params; i++) {
+        start[i] = ssys->param[i].val;
+    }
+    Slvs_Solve(ssys, shg);
+    if(starts <= 1 || !retry(ssys->result)) return converged(ssys->result) ? 0 : -1;
+
+    // Each of the other starts is solved on a copy of sys, with only the
+    // params of its own, in a context of its own; nothing else is written.
+    // The dragged params stay where they are, and so do the points held
+    // where they're dragged, since they're held wherever they start.
+    std::unordered_set<uint32_t> held;
+    for(int i = 0; i < ssys->ndragged; i++) {
+        held.insert(ssys->dragged[i]);
+    }
+    for(int i = 0; i < ssys->constraints; i++) {
+        const Slvs_Constraint &c = ssys->constraint[i];
+        if(c.type != SLVS_C_WHERE_DRAGGED) continue;
+        for(int j = 0; j < ssys->entities; j++) {
+            if(ssys->entity[j].h != c.ptA) continue;
+            for(Slvs_hParam h : ssys->entity[j].param) {
+                if(h) held.insert(h);
+            }
+        }
+    }
+    Slvs_System base = *ssys;
+    base.calculateFaileds = 0;
+    base.calculateFree    = 0;
+    base.failed           = nullptr;
+    base.faileds          = 0;
+    base.freeParam        = nullptr;
+    base.freeParams       = 0;
+    base.sensitivities    = 0;
+    base.dParam           = nullptr;
+    base.cost             = nullptr;
+    base.costs            = 0;
+
+    // The starts are taken in order, and the first (the nearest the given
+    // one) that converges wins, so the answer doesn't depend on the number
+    // of threads; once one has, the later ones still running are cancelled.
+    Slvs_Context *home = CTX;
+    int threads = std::max(1, std::min(home->sys.workers, starts - 1));
+    std::vector<Slvs_Context *> ctx(threads);
+    std::vector<std::atomic<int>> running(threads);
+    std::vector<std::vector<double>> solved(starts);
+    std::atomic<int> next(1), best(starts);
+    auto work = [&](int t) {
+        Slvs_SetCurrentContext(ctx[t]);
+        std::vector<Slvs_Param> param(ssys->param, ssys->param + ssys->params);
+        Slvs_System sys = base;
+        sys.param = param.data();
+        for(int k; (k = next++) < starts;) {
+            running[t] = k;
+            if(k > best) break;
+
+            for(int i = 0; i < ssys->params; i++) {
+                double v = start[i];
+                if(param[i].group == shg && !held.count(param[i].h)) {
+                    v += Slvs_StartOffset(param[i].h, k, v);
+                }
+                param[i].val = v;
+            }
+            Slvs_Solve(&sys, shg);
+            if(!converged(sys.result)) continue;
+
+            solved[k].resize(ssys->params);
+            for(int i = 0; i < ssys->params; i++) {
+                solved[k][i] = param[i].val;
+            }
+            int b = best;
+            while(k < b && !best.compare_exchange_weak(b, k)) {}
+            for(int u = 0; u < threads; u++) {
+                if(running[u] > k) Slvs_Cancel(ctx[u]);
+            }
+        }
+        running[t] = starts;
+    };
+    std::vector<std::thread> pool;
+    for(int t = 0; t < threads; t++) {
+        ctx[t] = new Slvs_Context;
+        Slvs_CopySettings(ctx[t], home);
+        ctx[t]->sys.workers = 1;
+        running[t] = 0;
+    }
+    for(int t = 1; t < threads; t++) {
+        pool.emplace_back(work, t);
+    }
+    work(0);
+    for(std::thread &th : pool) {
+        th.join();
+    }
+    for(Slvs_Context *c : ctx) {
+        Slvs_DestroyContext(c);
+    }
+    Slvs_SetCurrentContext(home == &DefaultContext ? nullptr : home);
+
+    // If none did, sys keeps what the given start left.
+    if(best == starts) return -1;
+    // Solve once more from the winner's solution, which takes no steps,
+    // to fill in everything else that sys asks for.
+    for(int i = 0; i < ssys->params; i++) {
+        ssys->param[i].val = solved[best][i];
+    }
+    Slvs_Solve(ssys, shg);
+    return best;
+}
+
+int Slvs_SolveBatch(Slvs_System *ssys, uint32_t shg, Slvs_Batch *batch)
+{
+    if(Slvs_Compile(ssys, shg) != SLVS_RESULT_OKAY) {
+        return SLVS_RESULT_TOO_MANY_UNKNOWNS;
+    }
+    // Check every override before solving any row.
+    for(int j = 0; j < batch->params; j++) {
+        hParam hp = { batch->param[j] };
+        if(!CTX->sys.param.FindByIdNoOops(hp) && !Slvs_DimensionsRead(hp)) return -1;
+    }
+    for(int j = 0; j < batch->constraints; j++) {
+        ConstraintBase *c = SK.constraint.FindByIdNoOops(hConstraint { batch->constraint[j] });
+        if(c == nullptr || !c->valAParam.v) return -1;
+    }
+
+    // Each thread other than this one compiles the system again, in a
+    // context of its own, and then takes rows until there are none left.
+    Slvs_Context *home = CTX;
+    std::atomic<int> next(0);
+    auto work = [&](Slvs_Context *ctx) {
+        Slvs_SetCurrentContext(ctx);
+        if(ctx != home) Slvs_Compile(ssys, shg);
+
+        // Every row starts from the same values, so its solution doesn't
+        // depend on which rows were solved before it on this thread.
+        std::vector<double> start;
+        for(Param &p : CTX->sys.param) {
+            start.push_back(p.val);
+        }
+        // Returns false if the row's dimensions don't all have values.
+        auto startRow = [&](int r) {
+            size_t i = 0;
+            for(Param &p : CTX->sys.param) {
+                p.val = start[i++];
+                SK.GetParam(p.h)->val = p.val;
+            }
+            for(int j = 0; j < batch->params; j++) {
+                Slvs_SetParamStart(batch->param[j],
+                                   batch->paramValue[(size_t)r * batch->params + j]);
+            }
+            bool valued = Slvs_EvalDimensions();
+            for(int j = 0; j < batch->constraints; j++) {
+                Slvs_SetConstraintValue(batch->constraint[j],
+                                        batch->constraintValue[(size_t)r * batch->constraints + j]);
+            }
+            return valued;
+        };
+        Slvs_SetSolverSettings(ssys->tolerance, ssys->maxIterations, ssys->stepMode);
+
+        // Rows go in groups of one per lane, solved together.
+        const int L = ExprTape::LANES;
+        for(int r0; (r0 = next.fetch_add(L)) < batch->rows;) {
+            int count = std::min(L, batch->rows - r0);
+            bool valued[L];
+            for(int l = 0; l < count; l++) {
+                valued[l] = startRow(r0 + l);
+                CTX->sys.LoadLane(l);
+            }
+            CTX->sys.NewtonSolveLanes(count);
+
+            for(int l = 0; l < count; l++) {
+                int r = r0 + l;
+                // From the row's own start, as if it had been solved alone
+                startRow(r);
+                batch->result[r] = Slvs_ResultOf(CTX->sys.StoreLane(l, &batch->dof[r]));
+                if(!valued[l]) {
+                    batch->result[r] = SLVS_RESULT_DIDNT_CONVERGE;
+                    batch->dof[r]    = -1;
+                }
+                double *solved = &batch->solved[(size_t)r * ssys->params];
+                for(int k = 0; k < ssys->params; k++) {
+                    solved[k] = SK.GetParam(hParam { ssys->param[k].h })->val;
+                }
+            }
+        }
+
+        if(ctx != home) Slvs_DestroyContext(ctx);
+    };
+
+    int groups  = (batch->rows + ExprTape::LANES - 1) / ExprTape::LANES;
+    int threads = std::max(1, std::min(home->sys.workers, groups));
+    std::vector<std::thread> pool;
+    for(int t = 1; t < threads; t++) {
+        Slvs_Context *ctx = new Slvs_Context;
+        Slvs_CopySettings(ctx, home);
+        pool.emplace_back(work, ctx);
+    }
+    work(home);
+    for(std::thread &th : pool) {
+        th.join();
+    }
+    Slvs_SetCurrentContext(home == &DefaultContext ? nullptr : home);
+    return 0;
+}
+
+// The SLVS_E_ or SLVS_C_ type that a sketch's entity or constraint was
+// added with.
+static int Slvs_EntityTypeOf(EntityBase::Type type)
+{
+    static const int types[] = {
+        SLVS_E_POINT_IN_3D, SLVS_E_POINT_IN_2D, SLVS_E_NORMAL_IN_3D, SLVS_E_NORMAL_IN_2D,
+        SLVS_E_DISTANCE, SLVS_E_WORKPLANE, SLVS_E_LINE_SEGMENT, SLVS_E_CUBIC,
+        SLVS_E_CIRCLE, SLVS_E_ARC_OF_CIRCLE,
+    };
+    for(int t : types) {
+        if(Slvs_CTypeToEntityBaseType(t) == type) return t;
+    }
+    SolveSpace::Platform::FatalError("no library type for entity type " +
+                                     std::to_string((int)type));
+}
+
+static int Slvs_ConstraintTypeOf(ConstraintBase::Type type)
+{
+    for(int t = SLVS_C_POINTS_COINCIDENT; t <= SLVS_C_GEAR_MESH; t++) {
+        if(Slvs_CTypeToConstraintBaseType(t) == type) return t;
+    }
+    SolveSpace::Platform::FatalError("no library type for constraint type " +
+                                     std::to_string((int)type));
+}
+
+int Slvs_SolveSketchBatch(uint32_t shg, Slvs_Batch *batch)
+{
+    // The sketch is copied out as a system, and the batch solved on that in
+    // a context of its own, so the sketch and what's settled of it are left
+    // as they were. A param is an unknown of the group its entity is in.
+    Slvs_Context *home = CTX;
+    std::unordered_map<uint32_t, uint32_t> groupOf;
+    std::vector<Slvs_Entity> entities;
+    for(EntityBase &e : SK.entity) {
+        Slvs_Entity se = {};
+        se.h        = e.h.v;
+        se.group    = e.group.v;
+        se.type     = Slvs_EntityTypeOf(e.type);
+        se.wrkpl    = e.workplane.v;
+        se.normal   = e.normal.v;
+        se.distance = e.distance.v;
+        for(int i = 0; i < 4; i++) {
+            se.point[i] = e.point[i].v;
+            se.param[i] = e.param[i].v;
+            if(e.param[i].v) groupOf[e.param[i].v] = e.group.v;
+        }
+        entities.push_back(se);
+    }
+    // Params that constraints generated for themselves are generated again
+    // on import, so only those of entities go.
+    std::vector<Slvs_Param> params;
+    std::vector<int>        slots;
+    for(int i = 0; i < SK.param.StoreSize(); i++) {
+        Param &p = SK.param.AtStore(i);
+        if(SK.param.FindByIdNoOops(p.h) != &p) continue;
+        auto it = groupOf.find(p.h.v);
+        if(it == groupOf.end()) continue;
+        params.push_back(Slvs_MakeParam(p.h.v, it->second, p.val));
+        slots.push_back(i);
+    }
+    std::vector<Slvs_Constraint> constraints;
+    for(ConstraintBase &c : SK.constraint) {
+        Slvs_Constraint sc = {};
+        sc.h       = c.h.v;
+        sc.group   = c.group.v;
+        sc.type    = Slvs_ConstraintTypeOf(c.type);
+        sc.wrkpl   = c.workplane.v;
+        sc.valA    = c.valA;
+        sc.ptA     = c.ptA.v;
+        sc.ptB     = c.ptB.v;
+        sc.entityA = c.entityA.v;
+        sc.entityB = c.entityB.v;
+        sc.entityC = c.entityC.v;
+        sc.entityD = c.entityD.v;
+        sc.other   = c.other;
+        sc.other2  = c.other2;
+        if(c.type == ConstraintBase::Type::GEAR_MESH) {
+            sc.other  = c.teethA;
+            sc.other2 = c.teethB;
+        }
+        constraints.push_back(sc);
+    }
+    std::vector<Slvs_hParam> dragged;
+    for(hParam hp : home->dragged) {
+        dragged.push_back(hp.v);
+    }
+
+    Slvs_System ssys = {};
+    ssys.param       = params.data();
+    ssys.params      = (int)params.size();
+    ssys.entity      = entities.data();
+    ssys.entities    = (int)entities.size();
+    ssys.constraint  = constraints.data();
+    ssys.constraints = (int)constraints.size();
+    ssys.dragged     = dragged.data();
+    ssys.ndragged    = (int)dragged.size();
+
+    // Solved into the system's order, then spread out to the sketch's slots
+    std::vector<double> solved((size_t)std::max(batch->rows, 0) * params.size());
+    Slvs_Batch inner = *batch;
+    inner.solved     = solved.data();
+
+    Slvs_Context *ctx = new Slvs_Context;
+    Slvs_CopySettings(ctx, home);
+    Slvs_SetCurrentContext(ctx);
+    int status = Slvs_SolveBatch(&ssys, shg, &inner);
+    Slvs_DestroyContext(ctx);
+    Slvs_SetCurrentContext(home == &DefaultContext ? nullptr : home);
+    if(status != 0) return status;
+
+    const size_t n = (size_t)SK.param.StoreSize();
+    for(int r = 0; r < batch->rows; r++) {
+        double *row = &batch->solved[(size_t)r * n];
+        for(size_t i = 0; i < n; i++) {
+            row[i] = SK.param.AtStore((int)i).val;
+        }
+        for(size_t k = 0; k < slots.size(); k++) {
+            row[slots[k]] = solved[(size_t)r * params.size() + k];
+        }
+    }
+    return 0;
+}
+
+int Slvs_SolveTrack(Slvs_System *ssys, uint32_t shg, Slvs_Track *track)
+{
+    Slvs_Solving solving;
+    if(Slvs_Compile(ssys, shg) != SLVS_RESULT_OKAY) {
+        return SLVS_RESULT_TOO_MANY_UNKNOWNS;
+    }
+    ConstraintBase *c = SK.constraint.FindByIdNoOops(hConstraint { track->constraint });
+    if(c == nullptr || !c->valAParam.v) return -1;
+    if(track->values <= 0) return 0;
+
+    Param *value = SK.GetParam(c->valAParam);
+    double step = track->step;
+    if(step <= 0) {
+        step = (track->values > 1) ? fabs(track->value[1] - track->value[0]) : 1.0;
+        if(step <= 0) step = 1.0;
+    }
+    const double firstStep = step;
+    double minStep = (track->minStep > 0) ? track->minStep : step / 1e4;
+    double maxStep = (track->maxStep > 0) ? track->maxStep : INFINITY;
+    Slvs_SetSolverSettings(ssys->tolerance, ssys->maxIterations, ssys->stepMode);
+
+    // Whether the unknowns are at a solution, for value's current value, to
+    // continue from; until the first one, each value is solved from the
+    // start instead.
+    bool onPath = false;
+    for(int k = 0; k < track->values; k++) {
+        Slvs_StartClock();
+        SolveResult how;
+        track->steps[k] = 0;
+        if(onPath) {
+            how = CTX->sys.Track(value, track->value[k], &step, minStep, maxStep,
+                                 &track->steps[k], &track->dof[k]);
+            // Whatever stopped it, the next value starts afresh.
+            if(how != SolveResult::OKAY && how != SolveResult::REDUNDANT_OKAY) {
+                step = firstStep;
+            }
+        } else {
+            value->val = track->value[k];
+            how = CTX->sys.Resolve(&track->dof[k]);
+            onPath = (how == SolveResult::OKAY || how == SolveResult::REDUNDANT_OKAY);
+        }
+        c->valA = value->val;
+
+        track->result[k]     = Slvs_ResultOf(how);
+        track->iterations[k] = CTX->sys.stats.iterations;
+        // A value that couldn't be reached gets the last solution, as a
+        // failed Slvs_Resolve would leave it.
+        double *solved = &track->solved[(size_t)k * ssys->params];
+        for(int j = 0; j < ssys->params; j++) {
+            solved[j] = SK.GetParam(hParam { ssys->param[j].h })->val;
+        }
+    }
+    return 0;
 }
 
 } /* extern "C" */
@@ -2,6 +2,7 @@
 from enum import IntEnum, auto
 from libc.stdint cimport uint32_t
 from libc.stdlib cimport free
+import numpy as np
 
 cdef extern from "slvs.h" nogil:
     ctypedef uint32_t Slvs_hEntity
@@ -39,6 +40,18 @@ cdef extern from "slvs.h" nogil:
         int dof
         int nbad
 
+    ctypedef struct Slvs_Batch:
+        int rows
+        Slvs_hParam *param
+        int params
+        double *paramValue
+        Slvs_hConstraint *constraint
+        int constraints
+        double *constraintValue
+        double *solved
+        int *result
+        int *dof
+
     void Slvs_QuaternionU(double qw, double qx, double qy, double qz,
                              double *x, double *y, double *z)
     void Slvs_QuaternionV(double qw, double qx, double qy, double qz,
@@ -91,6 +104,11 @@ cdef extern from "slvs.h" nogil:
     double Slvs_GetParamValue(int ph)
     double Slvs_SetParamValue(int ph, double value)
     void Slvs_ClearSketch()
+    int Slvs_ParamSlot(uint32_t ph)
+    double *Slvs_ParamValues(size_t *count)
+    void Slvs_CommitParamValues()
+    int Slvs_SolveSketchBatch(uint32_t hg, Slvs_Batch *batch)
+    void Slvs_SetWorkerCount(int workers)
 
     cdef Slvs_Entity _E_NONE "SLVS_E_NONE"
     cdef Slvs_Entity _E_FREE_IN_3D "SLVS_E_FREE_IN_3D"
@@ -389,3 +407,109 @@ def set_param_value(ph: int, value: float):
 
 def clear_sketch():
     Slvs_ClearSketch()
+
+def set_worker_count(workers: int):
+    Slvs_SetWorkerCount(workers)
+
+def param_slot(ph: int) -> int:
+    """The column of param `ph` in the rows that [solve_batch](#solve_batch)
+    returns.
+    """
+    return Slvs_ParamSlot(ph)
+
+def param_slots(handles) -> np.ndarray:
+    """[param_slot](#param_slot) for each param in `handles`, as an array.
+    """
+    cdef uint32_t[::1] hp = np.ascontiguousarray(handles, dtype=np.uint32).reshape(-1)
+    slots = np.empty(hp.shape[0], dtype=np.intc)
+    cdef int[::1] sv = slots
+    cdef Py_ssize_t i
+    for i in range(hp.shape[0]):
+        sv[i] = Slvs_ParamSlot(hp[i])
+    return slots
+
+def param_values() -> np.ndarray:
+    """Every param's value, in the column that [param_slot](#param_slot)
+    gives, as a NumPy array over the library's own memory rather than a copy.
+
+    Edits to the array take effect with
+    [commit_param_values](#commit_param_values); a solve doesn't update it,
+    so call this again to read the results. The array is good until a param
+    is added or the sketch is cleared.
+    """
+    cdef size_t count = 0
+    cdef double *values = Slvs_ParamValues(&count)
+    if count == 0:
+        return np.empty(0, dtype=np.float64)
+    return np.asarray(<double[:count]> values)
+
+def commit_param_values():
+    """Set every param whose value in the array from
+    [param_values](#param_values) was changed, as
+    [set_param_value](#set_param_value) would one at a time.
+    """
+    Slvs_CommitParamValues()
+
+def solve_batch(grouph: int, constraints=(), values=None, params=(), starts=None):
+    """Solve group `grouph` once for each row of `values` and `starts`: row i
+    sets the dimensions listed in `constraints` to `values[i]`, and starts the
+    unknowns listed in `params` from `starts[i]`; every row otherwise starts
+    from the sketch as it is, which is left unchanged.
+
+    Returns `(solved, result, dof)`: `solved[i]` holds the value of every
+    param after row i, in the column that [param_slot](#param_slot) gives,
+    and `result` and `dof` are the result flag and dof of each row. The rows
+    are solved with the GIL released, on the threads set by
+    [set_worker_count](#set_worker_count).
+    """
+    cdef uint32_t[::1] hc = np.ascontiguousarray(constraints, dtype=np.uint32).reshape(-1)
+    cdef uint32_t[::1] hp = np.ascontiguousarray(params, dtype=np.uint32).reshape(-1)
+    rows = None
+    for name, array, columns in (("values", values, hc.shape[0]), ("starts", starts, hp.shape[0])):
+        if array is None:
+            if columns:
+                raise ValueError(f"{name} is needed for {columns} columns")
+            continue
+        if np.ndim(array) != 2 or np.shape(array)[1] != columns:
+            raise ValueError(f"{name} must have one row per scenario, of {columns} columns")
+        if rows is not None and np.shape(array)[0] != rows:
+            raise ValueError("values and starts must have as many rows as each other")
+        rows = np.shape(array)[0]
+    if rows is None:
+        raise ValueError("no scenarios to solve")
+
+    cdef double[:, ::1] cv = np.ascontiguousarray(
+        values if values is not None else np.empty((rows, 0)), dtype=np.float64)
+    cdef double[:, ::1] pv = np.ascontiguousarray(
+        starts if starts is not None else np.empty((rows, 0)), dtype=np.float64)
+    cdef size_t count = 0
+    Slvs_ParamValues(&count)
+    solved = np.empty((rows, count), dtype=np.float64)
+    result = np.empty(rows, dtype=np.intc)
+    dof = np.empty(rows, dtype=np.intc)
+    if rows == 0:
+        return solved, result, dof
+    cdef double[:, ::1] sv = solved
+    cdef int[::1] rv = result
+    cdef int[::1] dv = dof
+
+    cdef Slvs_Batch batch
+    batch.rows = rows
+    batch.param = &hp[0] if hp.shape[0] else NULL
+    batch.params = hp.shape[0]
+    batch.paramValue = &pv[0, 0] if pv.shape[1] else NULL
+    batch.constraint = &hc[0] if hc.shape[0] else NULL
+    batch.constraints = hc.shape[0]
+    batch.constraintValue = &cv[0, 0] if cv.shape[1] else NULL
+    batch.solved = &sv[0, 0] if count else NULL
+    batch.result = &rv[0]
+    batch.dof = &dv[0]
+    cdef uint32_t hg = grouph
+    cdef int status
+    with nogil:
+        status = Slvs_SolveSketchBatch(hg, &batch)
+    if status == _SLVS_RESULT_TOO_MANY_UNKNOWNS:
+        raise ValueError("too many unknowns to solve")
+    if status != 0:
+        raise ValueError("constraints must be dimensions, and params unknowns, of the group")
+    return solved, result, dof
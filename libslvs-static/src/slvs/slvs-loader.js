@@ -0,0 +1,42 @@
+// Load the solver's JavaScript module: slvs-mt.js, built for WebAssembly SIMD
+// and threads, where the browser can run it, or the scalar slvs.js where not.
+
+// The smallest module with a SIMD instruction (i8x16.popcnt of a splat);
+// only an engine with SIMD validates it.
+const SIMD_PROBE = new Uint8Array([
+  0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x05, 0x01, 0x60,
+  0x00, 0x01, 0x7b, 0x03, 0x02, 0x01, 0x00, 0x0a, 0x0a, 0x01, 0x08, 0x00,
+  0x41, 0x00, 0xfd, 0x0f, 0xfd, 0x62, 0x0b,
+]);
+
+export function supportsSimdThreads() {
+  if (typeof WebAssembly !== 'object' || !WebAssembly.validate(SIMD_PROBE)) {
+    return false;
+  }
+  // Browsers only give out SharedArrayBuffer to cross-origin isolated pages
+  if (typeof SharedArrayBuffer === 'undefined') {
+    return false;
+  }
+  return globalThis.crossOriginIsolated !== false;
+}
+
+async function load(file, base) {
+  const { default: solvespace } = await import(new URL(file, base).href);
+  return solvespace();
+}
+
+// Resolves to the initialized module. With threads, independent parts of a
+// sketch are solved on up to `workers` of them (one per core by default).
+// If slvs-mt.js can't be loaded after all, slvs.js is.
+export async function loadSolvespace({ base = new URL('.', import.meta.url), workers } = {}) {
+  if (supportsSimdThreads()) {
+    try {
+      const slvs = await load('slvs-mt.js', base);
+      slvs.setWorkerCount(workers ?? (globalThis.navigator?.hardwareConcurrency || 1));
+      return slvs;
+    } catch (e) {
+      console.warn('Falling back to the scalar solver:', e);
+    }
+  }
+  return load('slvs.js', base);
+}
@@ -52,6 +52,10 @@ void SolveSpaceUI::Init() {
     exportChordTol = settings->ThawFloat("ExportChordTolerance", 0.1);
     // Max pwl segments to generate
     exportMaxSegments = settings->ThawInt("ExportMaxSegments", 64);
+    // Most triangles in an exported mesh, or zero for no limit
+    exportMaxTriangles = settings->ThawInt("ExportMaxTriangles", 0);
+    // Folder for the mesh cache, if it's to be kept on disk
+    meshCacheFolder = Platform::Path::From(settings->ThawString("MeshCacheFolder", ""));
     // Timeout value for finding redundant constrains (ms)
     timeoutRedundantConstr = settings->ThawInt("TimeoutRedundantConstraints", 1000);
     // Animation speed calculation base time (ms)
@@ -239,6 +243,10 @@ void SolveSpaceUI::Exit() {
     settings->FreezeFloat("ExportChordTolerance", (float)exportChordTol);
     // Export Max pwl segments to generate
     settings->FreezeInt("ExportMaxSegments", (uint32_t)exportMaxSegments);
+    // Export max triangles in a mesh
+    settings->FreezeInt("ExportMaxTriangles", (uint32_t)exportMaxTriangles);
+    // Folder for the mesh cache
+    settings->FreezeString("MeshCacheFolder", meshCacheFolder.raw);
     // Timeout for finding which constraints to fix Jacobian
     settings->FreezeInt("TimeoutRedundantConstraints", (uint32_t)timeoutRedundantConstr);
     // Animation speed
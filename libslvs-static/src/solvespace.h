@@ -22,6 +22,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <locale>
@@ -37,6 +38,8 @@
 #define EIGEN_NO_DEBUG
 #undef Success
 #include <Eigen/SparseCore>
+#include <Eigen/SparseQR>
+#include <Eigen/SparseCholesky>
 
 // We declare these in advance instead of simply using FT_Library
 // (defined as typedef FT_LibraryRec_* FT_Library) because including
@@ -133,6 +136,13 @@ static constexpr double VERY_NEGATIVE = -1e10;
 
 using Platform::AllocTemporary;
 using Platform::FreeAllTemporary;
+using Platform::TemporaryMark;
+using Platform::MarkTemporary;
+using Platform::ReleaseTemporary;
+using Platform::TemporaryUsage;
+using Platform::GetTemporaryUsage;
+using Platform::ResetTemporaryPeak;
+using Platform::TrimTemporary;
 
 class Expr;
 class ExprVector;
@@ -169,7 +179,8 @@ enum class SolveResult : uint32_t {
     DIDNT_CONVERGE           = 10,
     REDUNDANT_OKAY           = 11,
     REDUNDANT_DIDNT_CONVERGE = 12,
-    TOO_MANY_UNKNOWNS        = 20
+    TOO_MANY_UNKNOWNS        = 20,
+    TIMED_OUT                = 30
 };
 
 using ParamSet = std::unordered_set<hParam, HandleHasher<hParam>>;
@@ -220,9 +231,199 @@ void Message(const char *fmt, ...);
 void MessageAndRun(std::function<void()> onDismiss, const char *fmt, ...);
 void Error(const char *fmt, ...);
 
+typedef Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> Permutation;
+
+// How the sparse factorizations order the columns that they eliminate, to keep
+// down the fill-in: by COLAMD on the factored matrix, by AMD on the pattern
+// of its normal matrix, in the order they come in, or by whichever of those
+// the structure of the Jacobian suggests.
+enum class FillOrdering : uint32_t {
+    COLAMD  = 0,
+    AMD     = 1,
+    NATURAL = 2,
+    AUTO    = 3
+};
+
+// The ordering P of A's columns that the factorization of A P (or of
+// P^T A^T A P, which fills in the same way) should take; not AUTO.
+Permutation OrderColumns(const Eigen::SparseMatrix<double> &A, FillOrdering ordering);
+// The ordering that AUTO stands for, for a Jacobian with the pattern of A.
+FillOrdering PickOrdering(const Eigen::SparseMatrix<Expr *> &A);
+
+// Which sparse QR factors the blocks too big for a dense one: Eigen's, which
+// is left-looking and on one thread, or SuiteSparseQR's, which is
+// multifrontal and factors the fronts on several threads. SPQR is only
+// there in a build that found SuiteSparseQR (SLVS_HAVE_SPQR); without it,
+// it's Eigen's.
+enum class QRBackend : uint32_t {
+    EIGEN = 0,
+    SPQR  = 1
+};
+
+// A sparse QR factorization that keeps its symbolic analysis (the
+// fill-reducing column ordering and the elimination tree) between uses, and
+// only redoes it when the sparsity pattern of the factored matrix, or the
+// ordering asked for, changes. With SuiteSparseQR, that does its own
+// ordering and analysis each time, which it does quickly.
+class ReusableSparseQR {
+public:
+    ReusableSparseQR();
+    ~ReusableSparseQR();
+
+    static bool Available(QRBackend backend);
+
+    void Factorize(const Eigen::SparseMatrix<double> &A, FillOrdering ordering,
+                   QRBackend backend = QRBackend::EIGEN);
+    // Of the last factorization, A P = Q R:
+    Eigen::ComputationInfo Info() const;
+    Eigen::Index Rank() const;
+    const Eigen::SparseMatrix<double> &MatrixR() const;
+    // Q times X
+    Eigen::MatrixXd ApplyQ(const Eigen::MatrixXd &X) const;
+    // The P in A P = Q R, which is the fill-reducing ordering and then the
+    // QR's own permutation of the columns that it finds dependent.
+    Permutation ColsPermutation() const;
+    size_t FactorNonZeros() const { return (size_t)MatrixR().nonZeros(); }
+    void Clear();
+
+private:
+    // The QR of A with its columns already in the fill-reducing order.
+    Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::NaturalOrdering<int>> qr;
+    bool                        analyzed = false;
+    FillOrdering                orderedBy;
+    Eigen::Index                rows = 0, cols = 0;
+    std::vector<int>            outer, inner;
+    Permutation                 perm;
+    Eigen::SparseMatrix<double> AP;
+
+    // SuiteSparseQR's factorization, when the last one was by it
+    struct Spqr;
+    std::unique_ptr<Spqr>       spqr;
+    bool                        bySpqr = false;
+};
+
+// A sparse LDL^T factorization of A A^T, which is much cheaper than the QR of
+// A^T for a big block, but squares its condition number; so it's only used
+// when A clearly has full row rank, and Factorize says whether it does. Like
+// ReusableSparseQR, it keeps its symbolic analysis while the pattern holds.
+class ReusableNormalLDLT {
+public:
+    // A A^T, with the rows of A in the fill-reducing order.
+    Eigen::SparseMatrix<double> AAt;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>, Eigen::Lower,
+                          Eigen::NaturalOrdering<int>> ldlt;
+
+    // Factors A A^T + shift I, and returns whether A clearly has full row
+    // rank (which means something only without the shift).
+    bool Factorize(const Eigen::SparseMatrix<double> &A, FillOrdering ordering,
+                   double shift = 0.0);
+    // The Y for which A A^T Y = B, from the last factorization.
+    Eigen::VectorXd Solve(const Eigen::VectorXd &B) const;
+    size_t FactorNonZeros() const {
+        return (size_t)ldlt.matrixL().nestedExpression().nonZeros();
+    }
+    void Clear();
+
+private:
+    bool             analyzed = false;
+    FillOrdering     orderedBy;
+    Eigen::Index     rows = 0;
+    std::vector<int> outer, inner;
+    // that orders A's rows, as the columns of A^T
+    Permutation      perm;
+};
+
+// The equations that the constraints of a group wrote when it was last
+// solved, kept from one solve to the next so that a constraint that hasn't
+// changed doesn't write them again. Each constraint's are kept flat, with a
+// node's operands by their place in its nodes, and copied out as fresh
+// expressions for every solve, which is free to rewrite them. They hold as
+// long as the constraint and the structure of the entities it refers to are
+// the same. Its value goes in to them as VALUE, a param that's made the
+// constant again as they're copied out, so a new value doesn't matter
+// either; constraints whose equations depend on the values of things in
+// other ways aren't kept.
+class EquationCache {
+public:
+    // The fewest expression nodes that a constraint has to write for its
+    // equations to be kept; smaller ones are quicker to write again than to
+    // copy.
+    enum { KEEP_NODES = 64 };
+    static const hParam VALUE;
+
+    struct Node {
+        Expr::Op op;
+        // The operands' places in nodes, or -1
+        int      a, b;
+        union {
+            double v;
+            hParam parh;
+        };
+    };
+    struct Root {
+        hEquation      h;
+        int            node;
+        EquationKernel kernel;
+        // Whether the kernel takes the constraint's value
+        bool           value;
+    };
+    struct Entry {
+        ConstraintBase    constraint;
+        // Whether its equations are worth flattening the next time they're
+        // written
+        bool              flatten;
+        uint64_t          structure;
+        std::vector<Node> nodes;
+        std::vector<Root> roots;
+    };
+
+    // A hash of everything about the entities that a constraint refers to,
+    // and the ones that they refer to in turn, that its equations are
+    // written from; each entity's is found once.
+    class Structures {
+    public:
+        uint64_t Of(const ConstraintBase *c);
+    private:
+        uint64_t Of(hEntity he, int depth);
+        std::vector<uint64_t> entity;
+    };
+
+    static bool Keeps(const ConstraintBase *c, uint32_t forms);
+    // Writes c's equations in to l, and notes in an entry for it whether
+    // they're big enough to be worth keeping; if not, neither is the entry.
+    static Entry Note(const ConstraintBase *c, IdList<Equation,hEquation> *l);
+    // Writes c's equations in to l, and flattens them in to an entry for it,
+    // which has none if they can't be.
+    static Entry Flatten(const ConstraintBase *c, Structures *structures,
+                         IdList<Equation,hEquation> *l);
+
+    // The entry for c, if there is one that still holds.
+    const Entry *Find(const ConstraintBase *c, Structures *structures) const;
+    // Adds the equations of c's entry k to l.
+    static void Write(const Entry &k, const ConstraintBase *c,
+                      IdList<Equation,hEquation> *l);
+    void Keep(Entry &&e);
+    // Forgets the constraints that aren't in group hg any more, once there
+    // are more kept than the inGroup that it has.
+    void Prune(hGroup hg, size_t inGroup);
+    void Clear() { entries.clear(); }
+
+private:
+    std::unordered_map<hConstraint, Entry, HandleHasher<hConstraint>> entries;
+};
+
 class System {
 public:
-    enum { MAX_UNKNOWNS = 2048 };
+    enum { MAX_UNKNOWNS = 2048, LARGE_BLOCK = 512, SMALL_BLOCK = 32 };
+    // The fewest instructions on a tape, and in each of its levels on
+    // average, for it to be evaluated on more than one thread.
+    enum { PARALLEL_EVAL = 32768, PARALLEL_EVAL_LEVEL = 1024 };
+    // The fewest equations soluble alone for them to be solved on more than
+    // one thread.
+    enum { PARALLEL_ALONE = 4096 };
+    // The fewest constraints and entities for their equations to be written
+    // on more than one thread.
+    enum { PARALLEL_EQUATIONS = 8192 };
 
     EntityList                      entity;
     ParamList                       param;
@@ -232,13 +433,237 @@ public:
     // we should put as close as possible to their initial positions.
     ParamSet                        dragged;
 
+    // Constraints and entities of the group whose equations are left out,
+    // because the blocks they're in are solved already and nothing in them
+    // has changed; their unknowns mustn't be in param either.
+    std::unordered_set<hConstraint, HandleHasher<hConstraint>> settledConstraints;
+    std::unordered_set<hEntity, HandleHasher<hEntity>>         settledEntities;
+
+    // Where the constraints' equations are kept between solves of the
+    // group, if anywhere; only the thread that calls Solve changes it.
+    EquationCache                  *equationCache = nullptr;
+
+    // After Solve, the degrees of freedom that each block left, counted on
+    // its first unknown (and one on each unknown that no equation uses), so
+    // they can be summed over any set of blocks.
+    std::unordered_map<uint32_t, int> dofOf;
+
+    // The number of threads that independent blocks are solved on; with
+    // one, they're solved in turn on the calling thread.
+    int                             workers = 1;
+
+    // The most equations we'll write a Jacobian for, or 0 for no limit; the
+    // storage and factorizations are all sparse, so this only bounds the
+    // time a big system can take.
+    int                             maxUnknowns = MAX_UNKNOWNS;
+
+    // How NewtonSolve steps: always the full Newton step, or damped by a
+    // backtracking line search on the norm of the residuals.
+    enum class StepMode : uint32_t {
+        NEWTON = 0,
+        DAMPED = 1
+    };
+    StepMode                        stepMode = StepMode::NEWTON;
+
+    // How the partials in the Jacobian are found: by differentiating each
+    // equation symbolically, and lowering the derivatives to the tape; or
+    // by a reverse sweep over the residual's own instructions, which gives
+    // a whole row at once and builds no derivative expressions.
+    enum class JacobianMode : uint32_t {
+        SYMBOLIC = 0,
+        AUTODIFF = 1
+    };
+    JacobianMode                    jacobianMode = JacobianMode::SYMBOLIC;
+
+    // How the least squares step is found: by a sparse factorization (QR,
+    // or LDLT of A A^T on large blocks), which gives the rank too; or by
+    // LSQR, which only takes products with A and A^T, so it needs no more
+    // memory than the Jacobian, but leaves the rank unknown.
+    enum class LeastSquaresMode : uint32_t {
+        DIRECT    = 0,
+        ITERATIVE = 1
+    };
+    LeastSquaresMode                leastSquaresMode = LeastSquaresMode::DIRECT;
+
+    // When NewtonSolve re-evaluates the Jacobian: at every step; or, as in
+    // the chord method, only when the last step didn't shrink the norm of the
+    // residuals by CHORD_CONTRACTION, reusing the last factorization until
+    // then. Only a full rank LDLT step can be reused.
+    enum class JacobianUpdate : uint32_t {
+        EVERY_STEP = 0,
+        CHORD      = 1
+    };
+    JacobianUpdate                  jacobianUpdate = JacobianUpdate::EVERY_STEP;
+    static constexpr double         CHORD_CONTRACTION = 0.5;
+
+    // How Solve starts: from the values as given; or in stages, solving
+    // first only the constraints that hold points together or in place,
+    // then adding the distances and incidences, the angles and the
+    // tangencies in turn, each stage starting from where the last left the
+    // unknowns, before the full solve. While staging, stage is the last
+    // class of constraint written (see StageOf), and otherwise -1 for all.
+    enum class StartMode : uint32_t {
+        AS_GIVEN = 0,
+        STAGED   = 1
+    };
+    StartMode                       startMode = StartMode::AS_GIVEN;
+    int                             stage = -1;
+
+    // What precision NewtonSolveLanes evaluates the tape in: double
+    // throughout; or mixed, where each lane starts in single precision and
+    // goes over to double as its residuals near what single can resolve, or
+    // stop shrinking by CHORD_CONTRACTION with each step. A lane only
+    // converges as checked in double.
+    enum class LanePrecision : uint32_t {
+        DOUBLE = 0,
+        MIXED  = 1
+    };
+    LanePrecision                   lanePrecision = LanePrecision::DOUBLE;
+
+    // How the sparse factorizations order what they eliminate; and the
+    // most nonzeros in any one factor that the last solve computed, which
+    // is how much that ordering filled in.
+    FillOrdering                    fillOrdering = FillOrdering::COLAMD;
+    size_t                          factorNonZeros = 0;
+    // Which sparse QR the rank tests and least squares steps take
+    QRBackend                       qrBackend = QRBackend::EIGEN;
+    // Which kinds of constraint are written as polynomials, from
+    // ConstraintBase::Form; those aren't kept in the equation cache.
+    uint32_t                        polynomialForms = 0;
+    // Whether Solve writes each free normal in three unknowns rather than
+    // four and the equation that keeps it of unit length
+    bool                            chartNormals = false;
+
+    // What the last solve did: the Newton steps it took, and the squared
+    // norm of the residuals they left, summed over the blocks; how many
+    // equations and unknowns it wrote, and the nonzeros in the Jacobians
+    // that Newton's method worked on; and the milliseconds it spent in each
+    // phase, summed over the threads. The phases nest: solving equations
+    // alone includes writing and factoring their Jacobians, for example.
+    //
+    // Then what it took in memory: the expression nodes allocated, and the
+    // bytes taken from the temporary arenas and the most they held at once,
+    // summed over the threads; the distinct nodes of the equations that the
+    // Jacobians were written from, what folding and sharing left of them,
+    // and the nodes their partials added; the entries of the Jacobians that
+    // Newton's method worked on, of which jacobianNonZeros were filled; and
+    // the constraint whose equations took the most nodes to write.
+    //
+    // With profile set, it also charges what it can to the constraint that
+    // each equation came from: the nodes allocated writing its equations;
+    // the nonzeros in their rows of the Jacobians that Newton's method
+    // worked on; the time to evaluate those rows (each by itself, once per
+    // iteration, so this is what they cost relative to each other, not a
+    // share of the solve); and the iterations that started with one of its
+    // residuals above tolerance. Equations from entities and groups aren't
+    // charged to anything.
+    struct ConstraintCost {
+        size_t exprNodes                = 0;
+        size_t jacobianNonZeros         = 0;
+        double evalMs                   = 0.0;
+        int    iterationsAboveTolerance = 0;
+    };
+    struct Stats {
+        int    iterations       = 0;
+        double residualSq       = 0.0;
+        int    equations        = 0;
+        int    unknowns         = 0;
+        size_t jacobianNonZeros = 0;
+        double writeEquationsMs = 0.0;
+        double substituteMs     = 0.0;
+        double placeMs          = 0.0;
+        double aloneMs          = 0.0;
+        double writeJacobianMs  = 0.0;
+        double evalJacobianMs   = 0.0;
+        double stepMs           = 0.0;
+        double rankMs           = 0.0;
+        double findBadMs        = 0.0;
+
+        size_t      exprsAllocated          = 0;
+        size_t      temporaryBytes          = 0;
+        size_t      temporaryPeakBytes      = 0;
+        size_t      sourceNodes             = 0;
+        size_t      foldedNodes             = 0;
+        size_t      partialNodes            = 0;
+        size_t      jacobianEntries         = 0;
+        hConstraint heaviestConstraint      = {};
+        size_t      heaviestConstraintExprs = 0;
+        int         rigidClusters           = 0;
+        int         copiedBlocks            = 0;
+        int         largestBlockEquations   = 0;
+        int         largestBlockUnknowns    = 0;
+        int         reusedSteps             = 0;
+
+        // By constraint handle, when profiling
+        std::map<uint32_t, ConstraintCost> constraints;
+
+        // Adds in what a worker did.
+        void Add(const Stats &s);
+    };
+    Stats                           stats;
+
+    int                             maxIterations = 50;
+    double                          convergeTolerance = CONVERGE_TOLERANCE;
+
+    // The GetMilliseconds() time that a solve gives up at, or 0 for never;
+    // and a flag that another thread can set to make it give up at once.
+    // Either ends the solve with TIMED_OUT, and sets timedOut; the caller
+    // clears that before each solve.
+    int64_t                         deadline = 0;
+    const std::atomic<bool>        *cancel = nullptr;
+    bool                            timedOut = false;
+    // The most bytes a solve may hold, in the calling thread's temporary
+    // arena and roughly in its Jacobian and factorizations, or 0 for no
+    // limit; each worker has the same budget on its own thread. Going over
+    // ends the solve as the deadline does, and sets outOfMemory as well,
+    // which the caller clears likewise.
+    size_t                          memoryBudget = 0;
+    bool                            outOfMemory = false;
+
+    // The phases of a solve that trace is told the beginning and end of, if
+    // it's set; with the counters of the phase's own system (those of the
+    // whole solve, for SOLVE) as they are at that moment, and the expression
+    // nodes allocated on the calling thread so far and the bytes its
+    // temporary arena holds. Workers get the same trace, and call it from
+    // their own threads.
+    enum class Phase : int {
+        SOLVE          = 0,
+        WRITE_JACOBIAN = 1,
+        NEWTON         = 2,
+        FIND_BAD       = 3,
+        MARK_FREE      = 4,
+        // Not a phase but a moment within NEWTON, the end of each step,
+        // told only with traceSteps
+        NEWTON_STEP    = 5
+    };
+    struct TraceEvent {
+        Phase   phase;
+        bool    begin;
+        int64_t timeNs;
+        int     equations;
+        int     unknowns;
+        size_t  jacobianNonZeros;
+        int     iterations;
+        double  residual;
+        size_t  exprsAllocated;
+        size_t  temporaryBytes;
+    };
+    void                          (*trace)(const TraceEvent &event, void *user) = nullptr;
+    void                           *traceUser = nullptr;
+    bool                            traceSteps = false;
+    bool                            profile = false;
+    void Trace(Phase phase, bool begin, int iterations);
+
     enum {
         // In general, the tag indicates the subsys that a variable/equation
         // has been assigned to; these are exceptions for variables:
         VAR_SUBSTITUTED      = 10000,
         VAR_DOF_TEST         = 10001,
+        VAR_IN_BLOCK         = 10002,
+        VAR_PINNED           = 10003,
         // and for equations:
-        EQ_SUBSTITUTED       = 20000
+        EQ_SUBSTITUTED       = 20000,
+        EQ_PINNED            = 20001
     };
 
     // The system Jacobian matrix
@@ -255,6 +680,8 @@ public:
             // This only observes the Expr - does not own them!
             Eigen::SparseMatrix<Expr *> sym;
             Eigen::SparseMatrix<double> num;
+            // The tape register for each entry of sym, in storage order
+            std::vector<int>            reg;
         } A;
 
         Eigen::VectorXd X;
@@ -263,27 +690,165 @@ public:
             // This only observes the Expr - does not own them!
             std::vector<Expr *> sym;
             Eigen::VectorXd     num;
+            // The tape register for each entry of sym
+            std::vector<int>    reg;
         } B;
+
+        // Factorizations of A (for the rank tests) and of A^T (for the
+        // least squares step); their patterns are fixed by WriteJacobian.
+        ReusableSparseQR rankQR, stepQR;
+        // and of A A^T, for the steps while A clearly has full row rank
+        ReusableNormalLDLT stepLDLT;
+        bool             stepRankInDoubt;
+        // Whether the last step came from the full rank stepLDLT, of the
+        // scaled A.num that's still here, so that a chord step can reuse it.
+        bool             stepByLDLT;
+        // The rank of A, as found by the last least squares step
+        int              stepRank;
+        // The fill-reducing ordering that they all take; fillOrdering, with
+        // AUTO resolved for this pattern.
+        FillOrdering     ordering;
+
+        // The residuals and partials above, lowered for evaluation. The
+        // instructions for the residuals come first, up to residualEnd.
+        ExprTape tape;
+        size_t   residualEnd;
+
+        // With JacobianMode::AUTODIFF, the instructions each row depends on
+        // (in tape order), and the row's entries of A (by index in storage
+        // order) with the register of each one's parameter, or -1.
+        struct {
+            std::vector<int>    instrStart, instr;
+            std::vector<int>    entryStart, entry, entryReg;
+            std::vector<double> adjoint;
+        } ad;
+
+        // With more than one worker and a big enough tape, the threads that
+        // evaluate it, a level at a time; with AUTODIFF, each has its own
+        // tape-sized stretch of ad.adjoint for the reverse sweeps.
+        int              evalThreads = 1;
+        ExprTape::Levels residualLevels, partialLevels;
     } mat;
 
     static const double CONVERGE_TOLERANCE;
+    static const double NULLSPACE_TOLERANCE;
     int CalculateRank();
+    int StructuralRank(std::vector<char> *overdetermined = NULL);
     bool TestRank(int *dof = NULL, int *rank = NULL);
-    static bool SolveLinearSystem(const Eigen::SparseMatrix<double> &A,
-                                  const Eigen::VectorXd &B, Eigen::VectorXd *X);
-    bool SolveLeastSquares();
+    bool SolveMinimumNorm(const Eigen::SparseMatrix<double> &A,
+                          const Eigen::VectorXd &B, Eigen::VectorXd *X, int *rank);
+    bool SolveLeastSquares(bool reuse = false);
 
+    void OrderForLocality(std::vector<Equation *> *eqs, std::vector<Param *> *params);
     bool WriteJacobian(int tag);
-    void EvalJacobian();
+    void WriteJacobian();
+    void WriteAdjoints();
+    void ScheduleEval();
+    Expr *WriteKernel(ExprFactory *exprs, const EquationKernel &kernel, int row,
+                      const std::unordered_map<uint32_t, int> &paramToIndex);
+    void EvalJacobian(bool residualsCurrent = false);
+    void EvalResiduals();
 
     void WriteEquationsExceptFor(hConstraint hc, Group *g);
+    void SolveStages(Group *g);
+    bool NullspaceBasis(const Eigen::SparseMatrix<double> &A, Eigen::MatrixXd *U);
+    void FindRedundantFromNullspace(Group *g, const std::vector<hConstraint> &candidates,
+                                    bool forceDofCheck, std::vector<char> *fixes,
+                                    std::vector<char> *decided);
+    bool RemovingFixesJacobian(hConstraint hc, Group *g, bool forceDofCheck);
     void FindWhichToRemoveToFixJacobian(Group *g, List<hConstraint> *bad,
                                         bool forceDofCheck);
     SubstitutionMap SolveBySubstitution();
+    void FoldPinnedParams(std::vector<Param *> *pinned);
+    // A component of a free normal's quaternion that's written in terms of
+    // the other three, as sign*sqrt(1 - the sum of their squares).
+    struct NormalChart {
+        Param  *param;
+        Param  *other[3];
+        double  sign;
+
+        double Value() const;
+    };
+    void ChartNormals(std::vector<NormalChart> *charts);
+    void PlaceRigidClusters();
 
     bool IsDragged(hParam p);
+    void CountFactor(size_t nonZeros) {
+        factorNonZeros = std::max(factorNonZeros, nonZeros);
+    }
+    void ResetStats() {
+        stats          = Stats();
+        factorNonZeros = 0;
+    }
+    bool TooManyUnknowns(size_t count) const {
+        return maxUnknowns > 0 && count >= (size_t)maxUnknowns;
+    }
+    // What the Jacobian and the largest factorization so far take: a value
+    // and an index for each nonzero of the symbolic and numeric Jacobians,
+    // and of the factor.
+    size_t MatrixBytes() const {
+        return (2 * (size_t)mat.A.sym.nonZeros() + factorNonZeros) *
+               (sizeof(double) + sizeof(int));
+    }
+    bool Exhausted() {
+        if(!outOfMemory && memoryBudget > 0) {
+            outOfMemory = GetTemporaryUsage().held + MatrixBytes() > memoryBudget;
+        }
+        return outOfMemory;
+    }
+    bool Expired() {
+        if(!timedOut) {
+            timedOut = Exhausted() ||
+                       (cancel != nullptr && cancel->load(std::memory_order_relaxed)) ||
+                       (deadline > 0 && GetMilliseconds() >= deadline);
+        }
+        return timedOut;
+    }
 
-    bool NewtonSolve();
+    bool NewtonSolve(int *rankBefore = NULL, int *rankAfter = NULL);
+    bool NewtonSolveScalar(ExprTape *tape, size_t begin, size_t end, int f, int d, Param *p,
+                           int *iterations) const;
+    bool SolveAlone(std::vector<Equation *> *unsatisfied);
+    bool LineSearch(const std::vector<Param *> &params, double *normSq);
+    void FindUnsatisfied(std::vector<Equation *> *unsatisfied);
+
+    // A set of equations and the unknowns that they reference, that shares
+    // no unknowns with any other block.
+    struct Block {
+        std::vector<Equation *> eq;
+        std::vector<Param *>    param;
+    };
+    std::vector<Block> FindIndependentBlocks(int *unusedParams);
+
+    // What became of one block; these are summed over the blocks in order,
+    // so the outcome doesn't depend on which thread solved which block.
+    struct BlockResult {
+        bool                    rankOkFirst = true;
+        bool                    converged   = true;
+        bool                    rankOkAfter = true;
+        int                     dofFirst    = 0;
+        int                     dofAfter    = 0;
+        std::vector<Equation *> unsatisfied;
+    };
+    std::unique_ptr<System> MakeWorker();
+    void SolveBlock(const Block &b, bool testRankFirst, bool testRankAfter,
+                    BlockResult *r);
+    void SolveBlocks(const std::vector<Block> &blocks, bool testRankFirst,
+                     bool testRankAfter, std::vector<BlockResult> *results);
+    void SolveSomeBlocks(const std::vector<Block> &blocks, const std::vector<size_t> &which,
+                         bool testRankFirst, bool testRankAfter,
+                         std::vector<BlockResult> *results);
+
+    // The params that a block's equations use, in the order that they first
+    // use them, and the shape of those equations with the params numbered in
+    // that order; two blocks with the same shape are copies of one another,
+    // that differ only in the values of those params.
+    void ShapeOfBlock(const Block &b, std::vector<Param *> *order,
+                      std::vector<uint64_t> *shape);
+    bool PlaceCopy(const std::vector<Param *> &original, const std::vector<double> &originalStart,
+                   const std::vector<Param *> &copy, const std::vector<double> &copyStart,
+                   const Eigen::SparseMatrix<double> &jacobianStart,
+                   const Eigen::SparseMatrix<double> &jacobianEnd);
 
     void MarkParamsFree(bool findFree);
 
@@ -295,6 +860,69 @@ public:
                           List<hConstraint> *bad = NULL,
                           bool andFindBad = false, bool andFindFree = false);
 
+    // Write and lower the equations for a group once, so that Resolve can
+    // solve them again, numerically only, each time the values change.
+    SubstitutionMap                 compiledSubs;
+    bool Compile(Group *g);
+    SolveResult Resolve(int *dof = NULL);
+    SolveResult FinishResolve(bool converged, int rankAfter, int *dof);
+    // Or take one frame of a drag on the compiled system: Newton steps from
+    // where the unknowns are, with no rank tests and no dof, until they
+    // converge, maxIterations steps, or budgetUs microseconds (0 for no
+    // limit). Converged or not, the unknowns are left at the step with the
+    // smallest residuals, which the next frame starts from.
+    SolveResult Drag(int64_t budgetUs);
+    // Or only check whether the params as they are already solve group g:
+    // each equation is evaluated once, with no Jacobian, factorization or
+    // rank test, and the largest residual of each constraint's equations
+    // goes in residual, by the constraint's handle. Returns whether every
+    // equation, the entities' included, is within tolerance.
+    bool Check(Group *g, std::unordered_map<uint32_t, double> *residual);
+
+    // Or solve the compiled system from up to ExprTape::LANES starting
+    // points at once: LoadLane takes the current parameter values as the
+    // start for a lane, and StoreLane puts that lane's solution back in to
+    // the parameters, as Resolve would have.
+    struct {
+        // Everything the tape reads, then any unknowns it doesn't
+        std::vector<Param *> input;
+        // The register for each input, or -1
+        std::vector<int>     inputReg;
+        // The input for each column of the Jacobian
+        std::vector<int>     column;
+        // The inputs' values and tape registers, ExprTape::LANES wide, and
+        // the registers again in single precision
+        std::vector<double>  value;
+        std::vector<double>  reg;
+        std::vector<float>   regSingle;
+
+        bool                 converged[ExprTape::LANES];
+        int                  rankAfter[ExprTape::LANES];
+    } lanes;
+    void LoadLane(int lane);
+    void NewtonSolveLanes(int count);
+    SolveResult StoreLane(int lane, int *dof = NULL);
+
+    // Or follow one solution of the compiled system as value, the param of
+    // one of its dimensions, moves from a value it's solved at to another,
+    // so that the solution stays on the same branch (the same assembly of a
+    // linkage, say) instead of going to whichever is nearest the start.
+    // Each step predicts the solution along the tangent to the path, from
+    // the Jacobian at the last point solved, and corrects the prediction by
+    // Newton's method. A step whose correction takes too many iterations or
+    // moves too far is halved and taken again, down to minStep. A step that
+    // corrects easily makes the next one longer, up to maxStep. step holds
+    // the length to try first, and afterwards the length to carry on with;
+    // steps is how many steps were taken. On failure, the unknowns and value
+    // are left at the last point that was solved.
+    bool Tangent(Param *value, Eigen::VectorXd *dx);
+    // Or how the compiled system's solution moves with several values at
+    // once: column k of dX is the rate of change of each unknown (one per
+    // column of the Jacobian) with values[k], from one factorization.
+    bool Sensitivities(const std::vector<Param *> &values, Eigen::MatrixXd *dX);
+    SolveResult Track(Param *value, double to, double *step, double minStep,
+                      double maxStep, int *steps = NULL, int *dof = NULL);
+
     void Clear();
 };
 
@@ -560,6 +1188,52 @@ public:
     inline Group   *GetGroup  (hGroup   h) { return group.  FindById(h); }
     // Styles are handled a bit differently.
 
+#ifdef LIBRARY
+    // The library's sketches can hold many groups, but each solve is of one,
+    // so the entities and constraints of each group are indexed as they're
+    // added, in handle order. Their params are reached through them.
+    struct GroupIndex {
+        std::vector<hEntity>     entity;
+        std::vector<hConstraint> constraint;
+    };
+    std::unordered_map<uint32_t, GroupIndex> byGroup;
+
+    void AddToIndex(const ENTITY &e)     { byGroup[e.group.v].entity.push_back(e.h); }
+    void AddToIndex(const CONSTRAINT &c) { byGroup[c.group.v].constraint.push_back(c.h); }
+    // Index everything in the lists afresh, after they've been sorted
+    void IndexGroups() {
+        byGroup.clear();
+        for(ENTITY &e : entity)         AddToIndex(e);
+        for(CONSTRAINT &c : constraint) AddToIndex(c);
+    }
+#endif
+
+    // Call f on each entity, or constraint, of group hg, in handle order.
+    template<class F>
+    void ForEachEntityIn(hGroup hg, F f) {
+#ifdef LIBRARY
+        auto it = byGroup.find(hg.v);
+        if(it == byGroup.end()) return;
+        for(hEntity h : it->second.entity) f(GetEntity(h));
+#else
+        for(ENTITY &e : entity) {
+            if(e.group == hg) f(&e);
+        }
+#endif
+    }
+    template<class F>
+    void ForEachConstraintIn(hGroup hg, F f) {
+#ifdef LIBRARY
+        auto it = byGroup.find(hg.v);
+        if(it == byGroup.end()) return;
+        for(hConstraint h : it->second.constraint) f(GetConstraint(h));
+#else
+        for(CONSTRAINT &c : constraint) {
+            if(c.group == hg) f(&c);
+        }
+#endif
+    }
+
     void Clear();
 
     BBox CalculateEntityBBox(bool includingInvisible);
@@ -583,6 +1257,15 @@ public:
         ParamList                       param;
         IdList<Style,hStyle>            style;
         hGroup                          activeGroup;
+        // Only the state on top of a stack holds the whole sketch. Each one
+        // under it holds just what it takes to get back to it from the one
+        // above: in the lists above, the elements that one changed or took
+        // out, and here, the handles of those it added.
+        std::vector<hGroup>             addedGroup;
+        std::vector<hRequest>           addedRequest;
+        std::vector<hConstraint>        addedConstraint;
+        std::vector<hParam>             addedParam;
+        std::vector<hStyle>             addedStyle;
 
         void Clear() {
             group.Clear();
@@ -625,6 +1308,10 @@ public:
     int      maxSegments;
     double   exportChordTol;
     int      exportMaxSegments;
+    int      exportMaxTriangles;
+    // Where the groups' shells and meshes are kept between sessions, or
+    // empty to keep them only in memory
+    Platform::Path meshCacheFolder;
     int      timeoutRedundantConstr; //milliseconds
     int      animationSpeed; //milliseconds
     double   cameraTangent;
@@ -706,6 +1393,10 @@ public:
     // File load/save routines, including the additional files that get
     // loaded when we have link groups.
     FILE        *fh;
+    // The file being loaded, mapped whole, and how far into it we've read.
+    Platform::FileView loadView;
+    size_t             loadAt;
+    bool ReadLoadLine(std::string *line);
     void AfterNewFile();
     void AddToRecentList(const Platform::Path &filename);
     Platform::Path saveFile;
@@ -720,6 +1411,7 @@ public:
     static const SaveTable SAVED[];
     void SaveUsingTable(const Platform::Path &filename, int type);
     void LoadUsingTable(const Platform::Path &filename, char *key, char *val);
+    static bool SavesTheSame(char type, const void *a, const void *b);
     struct {
         Group        g;
         Request      r;
@@ -742,7 +1434,11 @@ public:
     void UpdateWindowTitles();
     void ClearExisting();
     void NewFile();
+    bool PrepareToSave(const Platform::Path &filename);
     bool SaveToFile(const Platform::Path &filename);
+    // The same sketch as a binary snapshot; LoadFromFile and linking read
+    // it back from the mapped file, with no text to parse.
+    bool SaveSnapshot(const Platform::Path &filename);
     bool LoadAutosaveFor(const Platform::Path &filename);
     std::function<void(const Platform::Path &filename, bool is_saveAs, bool is_autosave)> OnSaveFinished;
     bool LoadFromFile(const Platform::Path &filename, bool canCancel = false);
@@ -751,6 +1447,16 @@ public:
                               SMesh *m, SShell *sh);
     bool LoadEntitiesFromSlvs(const Platform::Path &filename, EntityList *le,
                               SMesh *m, SShell *sh);
+    bool LoadSnapshot(const Platform::Path &filename);
+    bool LoadEntitiesFromSnapshot(const Platform::Path &filename, EntityList *le,
+                                  SMesh *m, SShell *sh);
+    // A mesh and shell alone, in the same format, as the mesh cache keeps
+    // them on disk with the inputs they were made from; a load finds them
+    // only if those are the inputs given. See Group::GenerateShellAndMesh
+    bool SaveMeshSnapshot(const Platform::Path &filename, SMesh *m, SShell *sh,
+                          const std::string &inputs);
+    bool LoadMeshSnapshot(const Platform::Path &filename, SMesh *m, SShell *sh,
+                          const std::string &inputs);
     bool ReloadAllLinked(const Platform::Path &filename, bool canCancel = false);
     // And the various export options
     void ExportAsPngTo(const Platform::Path &filename);
@@ -821,6 +1527,7 @@ public:
     bool GroupsInOrder(hGroup before, hGroup after);
     bool PruneGroups(hGroup hg);
     bool PruneRequestsAndConstraints(hGroup hg);
+    bool GroupDependsOn(hGroup hg, const std::set<hGroup> &on);
     static void ShowNakedEdges(bool reportOnlyWhenNotOkay);
 
     enum class Generate : uint32_t {
@@ -886,7 +1593,14 @@ bool LinkIDF(const Platform::Path &filename, EntityList *le, SMesh *m, SShell *s
 bool LinkStl(const Platform::Path &filename, EntityList *le, SMesh *m, SShell *sh);
 
 extern SolveSpaceUI SS;
+#ifdef LIBRARY
+// The library can work on several sketches at once, one per thread, so SK
+// is whichever sketch the calling thread is working on.
+extern thread_local Sketch *ThreadSketch;
+#   define SK (*SolveSpace::ThreadSketch)
+#else
 extern Sketch SK;
+#endif
 
 }
 
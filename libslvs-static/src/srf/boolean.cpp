@@ -5,8 +5,9 @@
 // Copyright 2008-2013 Jonathan Westhues.
 //-----------------------------------------------------------------------------
 #include "solvespace.h"
+#include <mutex>
 
-static int I;
+static std::atomic<int> I;
 
 void SShell::MakeFromUnionOf(SShell *a, SShell *b) {
     MakeFromBoolean(a, b, SSurface::CombineAs::UNION);
@@ -201,19 +202,20 @@ SCurve SCurve::MakeCopySplitAgainst(SShell *agnstA, SShell *agnstB,
 }
 
 void SShell::CopyCurvesSplitAgainst(bool opA, SShell *agnst, SShell *into) {
-#pragma omp parallel for
+    std::vector<SCurve> scn(curve.n);
+#pragma omp parallel for schedule(dynamic)
     for(int i=0; i<curve.n; i++) {
         SCurve *sc = &curve[i];
-        SCurve scn = sc->MakeCopySplitAgainst(agnst, NULL,
+        scn[i] = sc->MakeCopySplitAgainst(agnst, NULL,
                                 surface.FindById(sc->surfA),
                                 surface.FindById(sc->surfB));
-        scn.source = opA ? SCurve::Source::A : SCurve::Source::B;
-#pragma omp critical
-        {
-            hSCurve hsc = into->curve.AddAndAssignId(&scn);
-            // And note the new ID so that we can rewrite the trims appropriately
-            sc->newH = hsc;
-        }
+        scn[i].source = opA ? SCurve::Source::A : SCurve::Source::B;
+    }
+
+    // Added in order, so the new IDs don't depend on the threads.
+    for(int i=0; i<curve.n; i++) {
+        // And note the new ID so that we can rewrite the trims appropriately
+        curve[i].newH = into->curve.AddAndAssignId(&scn[i]);
     }
 }
 
@@ -535,14 +537,21 @@ SSurface SSurface::MakeCopyTrimAgainst(SShell *parent,
             if(sc.surfB != h) continue;
             ss = sha->surface.FindById(sc.surfA);
         }
+        // Each point ends one edge and starts the next, so project each
+        // just once.
+        std::vector<Vector>  xyz;
+        std::vector<Point2d> uv(sc.pts.n);
+        for(const SCurvePt &pt : sc.pts) {
+            xyz.push_back(pt.p);
+        }
+        ss->ClosestPointsTo(xyz.data(), uv.data(), xyz.size());
+
         int i;
         for(i = 1; i < sc.pts.n; i++) {
             Vector a = sc.pts[i-1].p,
                    b = sc.pts[i].p;
 
-            Point2d auv, buv;
-            ss->ClosestPointTo(a, &(auv.x), &(auv.y));
-            ss->ClosestPointTo(b, &(buv.x), &(buv.y));
+            Point2d auv = uv[i-1], buv = uv[i];
 
             SBspUv::Class c = (ss->bsp) ? ss->bsp->ClassifyEdge(auv, buv, ss) : SBspUv::Class::OUTSIDE;
             if(c != SBspUv::Class::OUTSIDE) {
@@ -682,7 +691,7 @@ SSurface SSurface::MakeCopyTrimAgainst(SShell *parent,
 #pragma omp critical
     {
         into->booleanFailed = true;
-        dbp("failed: I=%d, avoid=%d", I+dbg_index, choosing.l.n);
+        dbp("failed: I=%d, avoid=%d", I.load()+dbg_index, choosing.l.n);
         DEBUGEDGELIST(&final, &ret);
     }
     poly.Clear();
@@ -696,7 +705,9 @@ SSurface SSurface::MakeCopyTrimAgainst(SShell *parent,
 
 void SShell::CopySurfacesTrimAgainst(SShell *sha, SShell *shb, SShell *into, SSurface::CombineAs type) {
     std::vector <SSurface> ssn(surface.n);
-#pragma omp parallel for
+    // Surfaces take very different times to trim and classify, so each
+    // thread takes the next one as it finishes rather than a fixed share.
+#pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < surface.n; i++)
     {
         SSurface *ss = &surface[i];
@@ -711,17 +722,29 @@ void SShell::CopySurfacesTrimAgainst(SShell *sha, SShell *shb, SShell *into, SSu
 }
 
 void SShell::MakeIntersectionCurvesAgainst(SShell *agnst, SShell *into) {
-#pragma omp parallel for
+    // Each of our surfaces keeps the curves it finds to itself, so the
+    // threads share no lists and take no locks; into is only read until
+    // they're done.
+    std::vector<List<SCurve>> found(surface.n);
+#pragma omp parallel for schedule(dynamic)
     for(int i = 0; i< surface.n; i++) {
         SSurface *sa = &surface[i];
 
-        for(SSurface &sb : agnst->surface){
-            // Intersect every surface from our shell against every surface
-            // from agnst; this will add zero or more curves to the curve
-            // list for into.
-            sa->IntersectAgainst(&sb, this, agnst, into);
+        // Intersect every surface from our shell against every surface
+        // from agnst whose bounding box meets its own; this will find zero
+        // or more curves for into.
+        Vector amax, amin;
+        sa->GetAxisAlignedBounding(&amax, &amin);
+        std::vector<int> near;
+        agnst->bvh.FindOverlapping(amax, amin, &near);
+        for(int j : near) {
+            sa->IntersectAgainst(&agnst->surface[j], this, agnst, into, &found[i]);
         }
     }
+
+    for(List<SCurve> &fl : found) {
+        into->AddIntersectionCurves(&fl);
+    }
 }
 
 void SShell::CleanupAfterBoolean() {
@@ -796,10 +819,17 @@ void SShell::MakeFromAssemblyOf(SShell *a, SShell *b) {
 
 void SShell::MakeFromBoolean(SShell *a, SShell *b, SSurface::CombineAs type) {
     booleanFailed = false;
+    SBspUv::AgeCache();
 
     a->MakeClassifyingBsps(NULL);
     b->MakeClassifyingBsps(NULL);
 
+    // Splitting the curves, intersecting the surfaces, and classifying the
+    // trimmed edges all find the surfaces of one shell near an edge or a
+    // ray from the other; the surfaces don't move until we're done.
+    a->bvh.Build(a);
+    b->bvh.Build(b);
+
     // Copy over all the original curves, splitting them so that a
     // piecewise linear segment never crosses a surface from the other
     // shell.
@@ -844,6 +874,128 @@ void SShell::MakeFromBoolean(SShell *a, SShell *b, SSurface::CombineAs type) {
     b->CleanupAfterBoolean();
 }
 
+//-----------------------------------------------------------------------------
+// The bounding volume hierarchy over a shell's surfaces, so that intersecting
+// one shell against another tests each surface against the few surfaces
+// near it, rather than against all of them.
+//-----------------------------------------------------------------------------
+void SSurfaceBvh::Build(SShell *sh) {
+    Clear();
+    int n = sh->surface.n;
+    shell = sh;
+    surfaces = n;
+    if(n == 0) return;
+
+    std::vector<Vector> max(n), min(n), mid(n);
+    for(int i = 0; i < n; i++) {
+        sh->surface[i].GetAxisAlignedBounding(&max[i], &min[i]);
+        mid[i] = (max[i].Plus(min[i])).ScaledBy(0.5);
+        surface.push_back(i);
+    }
+    node.reserve(2*(n/LEAF_SIZE + 1));
+    AddNode(0, n, max, min, mid);
+}
+
+int SSurfaceBvh::AddNode(int first, int n, const std::vector<Vector> &max,
+                         const std::vector<Vector> &min, const std::vector<Vector> &mid)
+{
+    Node nd = {};
+    nd.max = Vector::From(VERY_NEGATIVE, VERY_NEGATIVE, VERY_NEGATIVE);
+    nd.min = Vector::From(VERY_POSITIVE, VERY_POSITIVE, VERY_POSITIVE);
+    Vector cmax = nd.max, cmin = nd.min;
+    for(int k = first; k < first + n; k++) {
+        int i = surface[k];
+        max[i].MakeMaxMin(&nd.max, &nd.min);
+        min[i].MakeMaxMin(&nd.max, &nd.min);
+        mid[i].MakeMaxMin(&cmax, &cmin);
+    }
+    int at = (int)node.size();
+    node.push_back(nd);
+    if(n <= LEAF_SIZE) {
+        node[at].first = first;
+        node[at].n = n;
+        return at;
+    }
+
+    // Split at the median of the centers, across the axis they spread
+    // along the most.
+    Vector d = cmax.Minus(cmin);
+    int axis = (d.x >= d.y && d.x >= d.z) ? 0 : (d.y >= d.z ? 1 : 2);
+    int half = n / 2;
+    std::nth_element(surface.begin() + first, surface.begin() + first + half,
+                     surface.begin() + first + n, [&](int a, int b) {
+        return mid[a].Element(axis) < mid[b].Element(axis);
+    });
+    AddNode(first, half, max, min, mid);
+    int right = AddNode(first + half, n - half, max, min, mid);
+    node[at].right = right;
+    return at;
+}
+
+// The surfaces whose nodes' boxes meet the given box, in the order of the
+// shell's surfaces.
+void SSurfaceBvh::FindOverlapping(Vector max, Vector min, std::vector<int> *found) const {
+    found->clear();
+    if(node.empty()) return;
+
+    std::vector<int> stack = { 0 };
+    while(!stack.empty()) {
+        int at = stack.back();
+        stack.pop_back();
+        const Node &nd = node[at];
+        if(Vector::BoundingBoxesDisjoint(max, min, nd.max, nd.min)) continue;
+        if(nd.n > 0) {
+            found->insert(found->end(), surface.begin() + nd.first,
+                          surface.begin() + nd.first + nd.n);
+        } else {
+            stack.push_back(nd.right);
+            stack.push_back(at + 1);
+        }
+    }
+    std::sort(found->begin(), found->end());
+}
+
+// The surfaces whose nodes' boxes a line might pass through (or, as a
+// segment, lie within), in the order of the shell's surfaces; the same test
+// as SSurface::LineEntirelyOutsideBbox, so no surface it would keep is lost.
+void SSurfaceBvh::FindAlongLine(Vector a, Vector b, bool asSegment,
+                                std::vector<int> *found) const
+{
+    found->clear();
+    if(node.empty()) return;
+
+    std::vector<int> stack = { 0 };
+    while(!stack.empty()) {
+        int at = stack.back();
+        stack.pop_back();
+        const Node &nd = node[at];
+        if(!Vector::BoundingBoxIntersectsLine(nd.max, nd.min, a, b, asSegment) &&
+           a.OutsideAndNotOn(nd.max, nd.min) && b.OutsideAndNotOn(nd.max, nd.min))
+        {
+            continue;
+        }
+        if(nd.n > 0) {
+            found->insert(found->end(), surface.begin() + nd.first,
+                          surface.begin() + nd.first + nd.n);
+        } else {
+            stack.push_back(nd.right);
+            stack.push_back(at + 1);
+        }
+    }
+    std::sort(found->begin(), found->end());
+}
+
+bool SSurfaceBvh::IsFor(const SShell *sh) const {
+    return shell == sh && surfaces == sh->surface.n && surfaces > 0;
+}
+
+void SSurfaceBvh::Clear() {
+    node.clear();
+    surface.clear();
+    shell = NULL;
+    surfaces = 0;
+}
+
 //-----------------------------------------------------------------------------
 // All of the BSP routines that we use to perform and accelerate polygon ops.
 //-----------------------------------------------------------------------------
@@ -858,7 +1010,7 @@ void SSurface::MakeClassifyingBsp(SShell *shell, SShell *useCurvesFrom) {
     SEdgeList el = {};
 
     MakeEdgesInto(shell, &el, MakeAs::UV, useCurvesFrom);
-    bsp = SBspUv::From(&el, this);
+    bsp = SBspUv::CachedFrom(&el, this);
     el.Clear();
 
     edges = {};
@@ -891,6 +1043,136 @@ SBspUv *SBspUv::From(SEdgeList *el, SSurface *srf) {
     return bsp;
 }
 
+size_t SBspUv::Count() const {
+    size_t n = 1;
+    if(pos)  n += pos->Count();
+    if(neg)  n += neg->Count();
+    if(more) n += more->Count();
+    return n;
+}
+
+// Copies the tree to the end of nodes, which must have room for it already,
+// so that the nodes don't move while they're pointed to.
+SBspUv *SBspUv::CopyInto(std::vector<SBspUv> *nodes) const {
+    ssassert(nodes->size() < nodes->capacity(), "Unexpected reallocation");
+    nodes->push_back(*this);
+    SBspUv *copy = &nodes->back();
+    if(pos)  copy->pos  = pos->CopyInto(nodes);
+    if(neg)  copy->neg  = neg->CopyInto(nodes);
+    if(more) copy->more = more->CopyInto(nodes);
+    return copy;
+}
+
+//-----------------------------------------------------------------------------
+// Classifying BSPs kept between booleans. A surface whose trims and shape are
+// as they were gets the same tree, wherever the surface has moved to, since
+// the tree's distances are scaled by the surface's tangents alone; so each
+// copy of a step-and-repeat shares one, and an unchanged group regenerates
+// without building its trees again. The trees are copied out of the temporary
+// arena, and found by a hash of what they were built from, then checked
+// against all of that.
+//-----------------------------------------------------------------------------
+class BspUvCache {
+public:
+    // The most nodes kept between booleans; the least recently used trees
+    // beyond that are forgotten as the next boolean begins.
+    static const size_t MAX_NODES = 1 << 20;
+
+    SBspUv *Find(SEdgeList *el, SSurface *srf) {
+        std::vector<double> key;
+        key.push_back(srf->degm);
+        key.push_back(srf->degn);
+        Vector origin = srf->ctrl[0][0];
+        for(int i = 0; i <= srf->degm; i++) {
+            for(int j = 0; j <= srf->degn; j++) {
+                Vector p = srf->ctrl[i][j].Minus(origin);
+                key.insert(key.end(), { p.x, p.y, p.z, srf->weight[i][j] });
+            }
+        }
+        for(const SEdge &se : el->l) {
+            key.insert(key.end(), { se.a.x, se.a.y, se.b.x, se.b.y });
+        }
+        uint64_t hash = 14695981039346656037ull;
+        for(double v : key) {
+            uint64_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            hash = (hash ^ bits) * 1099511628211ull;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(hash);
+            if(it != entries.end() && it->second.key == key) {
+                it->second.used = generation;
+                return it->second.nodes.empty() ? NULL : &it->second.nodes[0];
+            }
+        }
+
+        SBspUv *bsp = SBspUv::From(el, srf);
+        Entry entry;
+        entry.key  = std::move(key);
+        entry.used = generation;
+        if(bsp) {
+            entry.nodes.reserve(bsp->Count());
+            bsp->CopyInto(&entry.nodes);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(hash);
+        if(it == entries.end()) {
+            held += entry.nodes.size();
+            it = entries.emplace(hash, std::move(entry)).first;
+        } else if(it->second.key != entry.key) {
+            // A collision; the tree just built serves this once.
+            return bsp;
+        }
+        it->second.used = generation;
+        return it->second.nodes.empty() ? NULL : &it->second.nodes[0];
+    }
+
+    // Called as a boolean begins, before any tree of it is found, so that
+    // no tree forgotten here is still in use.
+    void Age() {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        if(held <= MAX_NODES) return;
+
+        std::vector<std::pair<uint64_t, uint64_t>> byUse;
+        for(const auto &it : entries) {
+            byUse.emplace_back(it.second.used, it.first);
+        }
+        std::sort(byUse.begin(), byUse.end());
+        for(const auto &u : byUse) {
+            if(held <= MAX_NODES / 2) break;
+            auto it = entries.find(u.second);
+            held -= it->second.nodes.size();
+            entries.erase(it);
+        }
+    }
+
+private:
+    struct Entry {
+        std::vector<double>  key;
+        std::vector<SBspUv>  nodes;
+        uint64_t             used;
+    };
+
+    std::mutex                             mutex;
+    std::unordered_map<uint64_t, Entry>    entries;
+    uint64_t                               generation = 0;
+    size_t                                 held = 0;
+};
+
+static BspUvCache ClassifyingBsps;
+
+SBspUv *SBspUv::CachedFrom(SEdgeList *el, SSurface *srf) {
+    return ClassifyingBsps.Find(el, srf);
+}
+
+void SBspUv::AgeCache() {
+    ClassifyingBsps.Age();
+}
+
 //-----------------------------------------------------------------------------
 // The points in this BSP are in uv space, but we want to apply our tolerances
 // consistently in xyz (i.e., we want to say a point is on-edge if its xyz
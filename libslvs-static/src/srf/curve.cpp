@@ -229,6 +229,130 @@ void SBezierList::ScaleSelfBy(double s) {
     }
 }
 
+//-----------------------------------------------------------------------------
+// Add a cubic, second derivative continuous, interpolating spline through any
+// number of points. A periodic spline goes through them in a loop; an open one
+// from the first to the last, with its end tangents set by the control points
+// ctrlStart and ctrlFinish.
+//-----------------------------------------------------------------------------
+void SBezierList::AddInterpolatingSpline(const std::vector<Vector> &pts, bool periodic,
+                                         Vector ctrlStart, Vector ctrlFinish)
+{
+    // The number of unknowns to solve for, and of on-curve points, one more
+    // than the number of segments.
+    int n   = periodic ? (int)pts.size() : (int)pts.size() - 2;
+    int npt = periodic ? n + 1 : n + 2;
+    if(n < 0 || (periodic && n < 3)) return;
+
+    int i, a;
+
+    std::vector<Vector> pt(pts);
+    if(periodic) pt.push_back(pts[0]);
+
+    // The unknowns that we will be solving for, a set for each coordinate.
+    std::vector<double> Xx(n), Xy(n), Xz(n);
+    // For a cubic Bezier section f(t) as t goes from 0 to 1,
+    //    f' (0) = 3*(P1 - P0)
+    //    f' (1) = 3*(P3 - P2)
+    //    f''(0) = 6*(P0 - 2*P1 + P2)
+    //    f''(1) = 6*(P3 - 2*P2 + P1)
+    BandedMatrix bm = {};
+    for(a = 0; a < 3; a++) {
+        bm.Resize(n);
+
+        for(i = 0; i < n; i++) {
+            int im, it, ip;
+            if(periodic) {
+                im = WRAP(i - 1, n);
+                it = i;
+                ip = WRAP(i + 1, n);
+            } else {
+                im = i;
+                it = i + 1;
+                ip = i + 2;
+            }
+            // All of these are expressed in terms of a constant part, and
+            // of X[i-1], X[i], and X[i+1]; so let these be the four
+            // components of that vector;
+            Vector4 A, B, C, D, E;
+            // The on-curve interpolated point
+            C = Vector4::From((pt[it]).Element(a), 0, 0, 0);
+            // control point one back, C - X[i]
+            B = C.Plus(Vector4::From(0, 0, -1, 0));
+            // control point one forward, C + X[i]
+            D = C.Plus(Vector4::From(0, 0, 1, 0));
+            // control point two back
+            if(i == 0 && !periodic) {
+                A = Vector4::From(ctrlStart.Element(a), 0, 0, 0);
+            } else {
+                // pt[im] + X[i-1]
+                A = Vector4::From(pt[im].Element(a), 1, 0, 0);
+            }
+            // control point two forward
+            if(i == (n - 1) && !periodic) {
+                E = Vector4::From(ctrlFinish.Element(a), 0, 0, 0);
+            } else {
+                // pt[ip] - X[i+1]
+                E = Vector4::From((pt[ip]).Element(a), 0, 0, -1);
+            }
+            // Write the second derivatives of each segment, dropping constant
+            Vector4 fprev_pp = (C.Minus(B.ScaledBy(2))).Plus(A),
+                    fnext_pp = (C.Minus(D.ScaledBy(2))).Plus(E),
+                    eq       = fprev_pp.Minus(fnext_pp);
+
+            bm.B[i] = -eq.w;
+            if(periodic) {
+                bm.A(i, WRAP(i-2, n)) = eq.x;
+                bm.A(i, WRAP(i-1, n)) = eq.y;
+                bm.A(i, i)            = eq.z;
+            } else {
+                // The wrapping would work, except when n = 1 and everything
+                // wraps to zero...
+                if(i > 0) {
+                    bm.A(i, i - 1) = eq.x;
+                }
+                bm.A(i, i) = eq.y;
+                if(i < (n-1)) {
+                    bm.A(i, i + 1) = eq.z;
+                }
+            }
+        }
+        bm.Solve();
+        std::vector<double> &X = (a == 0) ? Xx :
+                                 (a == 1) ? Xy :
+                                            Xz;
+        X = bm.X;
+    }
+
+    for(i = 0; i < npt - 1; i++) {
+        Vector p0, p1, p2, p3;
+        if(periodic) {
+            p0 = pt[i];
+            int iw = WRAP(i - 1, n);
+            p1 = p0.Plus(Vector::From(Xx[iw], Xy[iw], Xz[iw]));
+        } else if(i == 0) {
+            p0 = pt[0];
+            p1 = ctrlStart;
+        } else {
+            p0 = pt[i];
+            p1 = p0.Plus(Vector::From(Xx[i-1], Xy[i-1], Xz[i-1]));
+        }
+        if(periodic) {
+            p3 = pt[i+1];
+            int iw = WRAP(i, n);
+            p2 = p3.Minus(Vector::From(Xx[iw], Xy[iw], Xz[iw]));
+        } else if(i == (npt - 2)) {
+            p3 = pt[npt-1];
+            p2 = ctrlFinish;
+        } else {
+            p3 = pt[i+1];
+            p2 = p3.Minus(Vector::From(Xx[i], Xy[i], Xz[i]));
+        }
+        SBezier sb = SBezier::From(p0, p1, p2, p3);
+        l.Add(&sb);
+    }
+}
+
 //-----------------------------------------------------------------------------
 // If our list contains multiple identical Beziers (in either forward or
 // reverse order), then cull them. If both is true, both beziers are removed.
@@ -270,20 +394,67 @@ void SBezierList::AllIntersectionsWith(SBezierList *sblb, SPointList *spl) const
         }
     }
 }
+// Find the pairs of leaves, one from each tree, whose boxes overlap; only
+// the edges in those can cross.
+static void OverlappingRuns(const std::vector<SBezier::PwlBox> &ta, int ia,
+                            const std::vector<SBezier::PwlBox> &tb, int ib,
+                            std::vector<std::pair<int, int>> *runs)
+{
+    const SBezier::PwlBox &a = ta[ia], &b = tb[ib];
+    if(!a.box.Overlaps(b.box)) return;
+
+    // Split the longer run, so that the boxes we compare stay about the
+    // same size.
+    if(a.lt >= 0 && (b.lt < 0 || (a.last - a.first) >= (b.last - b.first))) {
+        OverlappingRuns(ta, a.lt, tb, ib, runs);
+        OverlappingRuns(ta, a.gt, tb, ib, runs);
+    } else if(b.lt >= 0) {
+        OverlappingRuns(ta, ia, tb, b.lt, runs);
+        OverlappingRuns(ta, ia, tb, b.gt, runs);
+    } else {
+        runs->emplace_back(ia, ib);
+    }
+}
+
 void SBezier::AllIntersectionsWith(const SBezier *sbb, SPointList *spl) const {
+    const std::vector<Vector> *pts;
+    const std::vector<PwlBox> *boxes;
+    // Our own get copied, since looking up the other curve's may drop them
+    // from the cache.
+    PwlPointsAndBoxes(&pts, &boxes);
+    std::vector<Vector> pa = *pts;
+    std::vector<PwlBox> ba = *boxes;
+    const std::vector<Vector> *pb;
+    const std::vector<PwlBox> *bb;
+    sbb->PwlPointsAndBoxes(&pb, &bb);
+    if(ba.empty() || bb->empty()) return;
+
+    std::vector<std::pair<int, int>> runs;
+    OverlappingRuns(ba, 0, *bb, 0, &runs);
+
+    // Test the edges that might cross in the same order as we would if we
+    // tested every edge against every other, so that the points come out
+    // in the same order too.
+    std::vector<std::pair<int, int>> edges;
+    for(const std::pair<int, int> &run : runs) {
+        const PwlBox &ra = ba[run.first], &rb = (*bb)[run.second];
+        for(int i = ra.first; i < ra.last; i++) {
+            for(int j = rb.first; j < rb.last; j++) {
+                edges.emplace_back(i, j);
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
     SPointList splRaw = {};
-    SEdgeList sea, seb;
-    sea = {};
-    seb = {};
-    this->MakePwlInto(&sea);
-    sbb ->MakePwlInto(&seb);
-    SEdge *se;
-    for(se = sea.l.First(); se; se = sea.l.NextAfter(se)) {
-        // This isn't quite correct, since AnyEdgeCrossings doesn't count
-        // the case where two pairs of line segments intersect at their
-        // vertices. So this isn't robust, although that case isn't very
-        // likely.
-        seb.AnyEdgeCrossings(se->a, se->b, NULL, &splRaw);
+    for(const std::pair<int, int> &edge : edges) {
+        // This isn't quite correct, since EdgeCrosses doesn't count the case
+        // where two pairs of line segments intersect at their vertices. So
+        // this isn't robust, although that case isn't very likely.
+        SEdge se = {};
+        se.a = (*pb)[edge.second];
+        se.b = (*pb)[edge.second + 1];
+        se.EdgeCrosses(pa[edge.first], pa[edge.first + 1], NULL, &splRaw);
     }
     SPoint *sp;
     for(sp = splRaw.l.First(); sp; sp = splRaw.l.NextAfter(sp)) {
@@ -292,8 +463,6 @@ void SBezier::AllIntersectionsWith(const SBezier *sbb, SPointList *spl) const {
             if(!spl->ContainsPoint(p)) spl->Add(p);
         }
     }
-    sea.Clear();
-    seb.Clear();
     splRaw.Clear();
 }
 
@@ -617,11 +786,15 @@ void SBezierLoopSetSet::FindOuterFacesFrom(SBezierList *sbl, SPolygon *spxyz,
     SContour *sc;
     for(sc = spxyz->l.First(); sc; sc = spxyz->l.NextAfter(sc)) {
         spuv.AddEmptyContour();
+        std::vector<Vector>  xyz;
+        std::vector<Point2d> uv(sc->l.n);
         SPoint *pt;
         for(pt = sc->l.First(); pt; pt = sc->l.NextAfter(pt)) {
-            double u, v;
-            srfuv->ClosestPointTo(pt->p, &u, &v);
-            spuv.l.Last()->AddPoint(Vector::From(u, v, 0));
+            xyz.push_back(pt->p);
+        }
+        srfuv->ClosestPointsTo(xyz.data(), uv.data(), xyz.size());
+        for(const Point2d &puv : uv) {
+            spuv.l.Last()->AddPoint(Vector::From(puv.x, puv.y, 0));
         }
     }
     spuv.normal = Vector::From(0, 0, 1); // must be, since it's in xy plane now
@@ -647,6 +820,25 @@ void SBezierLoopSetSet::FindOuterFacesFrom(SBezierList *sbl, SPolygon *spxyz,
         }
     }
 
+    // Which contours hold each contour's edge midpoint, looked up below for
+    // every pair of loops; sorted, for binary search.
+    std::vector<std::vector<int>> holders(spuv.l.n);
+    {
+        SPolygonBands bands;
+        bands.Build(&spuv);
+        std::vector<bool> inside;
+        for(j = 0; j < spuv.l.n; j++) {
+            if(spuv.l[j].l.n < 2) continue;
+            bands.ContainingContours(spuv.l[j].AnyEdgeMidpoint(), &inside);
+            for(i = 0; i < spuv.l.n; i++) {
+                if(inside[i]) holders[j].push_back(i);
+            }
+        }
+    }
+    auto contains = [&](int outer, int inner) {
+        return std::binary_search(holders[inner].begin(), holders[inner].end(), outer);
+    };
+
     bool loopsRemaining = true;
     while(loopsRemaining) {
         loopsRemaining = false;
@@ -663,8 +855,7 @@ void SBezierLoopSetSet::FindOuterFacesFrom(SBezierList *sbl, SPolygon *spxyz,
                 if(i == j) continue;
                 if(outer->tag != OUTER_LOOP) continue;
 
-                Vector p = spuv.l[j].AnyEdgeMidpoint();
-                if(spuv.l[i].ContainsPointProjdToNormal(spuv.normal, p)) {
+                if(contains(i, j)) {
                     break;
                 }
             }
@@ -686,8 +877,7 @@ void SBezierLoopSetSet::FindOuterFacesFrom(SBezierList *sbl, SPolygon *spxyz,
                 if(inner->l.n < 1) continue;
                 if(inner->l[0].auxA != auxA) continue;
 
-                Vector p = spuv.l[j].AnyEdgeMidpoint();
-                if(spuv.l[i].ContainsPointProjdToNormal(spuv.normal, p)) {
+                if(contains(i, j)) {
                     outerAndInners.l.Add(inner);
                     inner->tag = USED_LOOP;
                 }
@@ -169,36 +169,180 @@ void SBezier::SplitAt(double t, SBezier *bef, SBezier *aft) const {
     }
 }
 
+//-----------------------------------------------------------------------------
+// The same curves get made piecewise linear over and over, for the edges, the
+// triangulation and each export, at the same tolerance. So remember the points
+// for each curve, keyed by its control points and weights, and the tolerances;
+// if the solver moves the curve, then that's a different key. Entries that go
+// unused for a regeneration are dropped. Each thread has its own, so that
+// there's no locking for the curves that get split in parallel.
+//-----------------------------------------------------------------------------
+class PwlCache {
+public:
+    struct Key {
+        int         deg;
+        Vector      ctrl[4];
+        double      weight[4];
+        double      chordTol, max_dt;
+        int         maxSegments;
+
+        bool operator==(const Key &k) const {
+            if(deg != k.deg || maxSegments != k.maxSegments) return false;
+            if(EXACT(chordTol != k.chordTol || max_dt != k.max_dt)) return false;
+            for(int i = 0; i <= deg; i++) {
+                if(!ctrl[i].EqualsExactly(k.ctrl[i])) return false;
+                if(EXACT(weight[i] != k.weight[i])) return false;
+            }
+            return true;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &k) const {
+            std::hash<double> hd;
+            size_t h = hd(k.chordTol) ^ (hd(k.max_dt) << 1) ^ (size_t)k.maxSegments;
+            for(int i = 0; i <= k.deg; i++) {
+                h = h*31 + hd(k.ctrl[i].x);
+                h = h*31 + hd(k.ctrl[i].y);
+                h = h*31 + hd(k.ctrl[i].z);
+                h = h*31 + hd(k.weight[i]);
+            }
+            return h;
+        }
+    };
+    struct Entry {
+        std::vector<Vector>          pts;
+        std::vector<SBezier::PwlBox> boxes;
+        uint32_t                     used;
+    };
+
+    // Don't let one regeneration with a great many curves grow us forever.
+    static const size_t MAX_ENTRIES = 1 << 16;
+
+    static std::atomic<uint32_t> generation;
+
+    std::unordered_map<Key, Entry, KeyHash> items;
+    uint32_t                                seen;
+
+    Entry *Lookup(const Key &k, bool *found) {
+        uint32_t now = generation.load(std::memory_order_relaxed);
+        if(now != seen) {
+            // Keep what the last regeneration used; those curves are likely
+            // to be asked for again, if their parameters didn't change.
+            for(auto it = items.begin(); it != items.end();) {
+                if(now - it->second.used > 1) {
+                    it = items.erase(it);
+                } else {
+                    it++;
+                }
+            }
+            seen = now;
+        }
+        if(items.size() >= MAX_ENTRIES) items.clear();
+
+        Entry &e = items[k];
+        *found = (e.used != 0);
+        e.used = now;
+        return &e;
+    }
+};
+// Start from 1, so that zero means a new entry.
+std::atomic<uint32_t> PwlCache::generation(1);
+static thread_local PwlCache pwlCache;
+
+void SBezier::AgePwlCache() {
+    PwlCache::generation++;
+}
+
+static PwlCache::Entry *PwlEntry(const SBezier *sb, double chordTol, double max_dt) {
+    if(EXACT(chordTol == 0)) {
+        chordTol = SS.ChordTolMm();
+    }
+    PwlCache::Key k = {};
+    k.deg = sb->deg;
+    for(int i = 0; i <= sb->deg; i++) {
+        k.ctrl[i]   = sb->ctrl[i];
+        k.weight[i] = sb->weight[i];
+    }
+    k.chordTol    = chordTol;
+    k.max_dt      = max_dt;
+    k.maxSegments = SS.GetMaxSegments();
+
+    bool found;
+    PwlCache::Entry *e = pwlCache.Lookup(k, &found);
+    if(!found) {
+        List<Vector> lv = {};
+        sb->MakePwlInto(&lv, chordTol, max_dt);
+        e->pts.assign(lv.begin(), lv.end());
+        e->boxes.clear();
+        lv.Clear();
+    }
+    return e;
+}
+
+const std::vector<Vector> &SBezier::PwlPoints(double chordTol, double max_dt) const {
+    return PwlEntry(this, chordTol, max_dt)->pts;
+}
+
+static int MakePwlBoxes(const std::vector<Vector> &pts, int first, int last,
+                        std::vector<SBezier::PwlBox> *boxes)
+{
+    // A handful of edges to a leaf; any fewer, and the boxes cost more to
+    // test than the edges would.
+    static const int LEAF_EDGES = 4;
+
+    SBezier::PwlBox b = {};
+    b.box = BBox::From(pts[first], pts[first]);
+    for(int i = first; i <= last; i++) {
+        b.box.Include(pts[i], 2*LENGTH_EPS);
+    }
+    b.first = first;
+    b.last  = last;
+    b.lt = b.gt = -1;
+
+    int n = (int)boxes->size();
+    boxes->push_back(b);
+    if(last - first > LEAF_EDGES) {
+        int mid = (first + last) / 2;
+        int lt = MakePwlBoxes(pts, first, mid, boxes);
+        int gt = MakePwlBoxes(pts, mid, last, boxes);
+        (*boxes)[n].lt = lt;
+        (*boxes)[n].gt = gt;
+    }
+    return n;
+}
+
+void SBezier::PwlPointsAndBoxes(const std::vector<Vector> **pts,
+                                const std::vector<PwlBox> **boxes,
+                                double chordTol, double max_dt) const
+{
+    PwlCache::Entry *e = PwlEntry(this, chordTol, max_dt);
+    if(e->boxes.empty() && e->pts.size() >= 2) {
+        MakePwlBoxes(e->pts, 0, (int)e->pts.size() - 1, &e->boxes);
+    }
+    *pts   = &e->pts;
+    *boxes = &e->boxes;
+}
+
 void SBezier::MakePwlInto(SEdgeList *sel, double chordTol, double max_dt) const {
-    List<Vector> lv = {};
-    MakePwlInto(&lv, chordTol, max_dt);
-    int i;
-    for(i = 1; i < lv.n; i++) {
+    const std::vector<Vector> &lv = PwlPoints(chordTol, max_dt);
+    for(size_t i = 1; i < lv.size(); i++) {
         sel->AddEdge(lv[i-1], lv[i]);
     }
-    lv.Clear();
 }
 void SBezier::MakePwlInto(List<SCurvePt> *l, double chordTol, double max_dt) const {
-    List<Vector> lv = {};
-    MakePwlInto(&lv, chordTol, max_dt);
-    int i;
-    for(i = 0; i < lv.n; i++) {
+    const std::vector<Vector> &lv = PwlPoints(chordTol, max_dt);
+    for(size_t i = 0; i < lv.size(); i++) {
         SCurvePt scpt;
         scpt.tag    = 0;
         scpt.p      = lv[i];
-        scpt.vertex = (i == 0) || (i == (lv.n - 1));
+        scpt.vertex = (i == 0) || (i == (lv.size() - 1));
         l->Add(&scpt);
     }
-    lv.Clear();
 }
 void SBezier::MakePwlInto(SContour *sc, double chordTol, double max_dt) const {
-    List<Vector> lv = {};
-    MakePwlInto(&lv, chordTol, max_dt);
-    int i;
-    for(i = 0; i < lv.n; i++) {
-        sc->AddPoint(lv[i]);
+    for(const Vector &v : PwlPoints(chordTol, max_dt)) {
+        sc->AddPoint(v);
     }
-    lv.Clear();
 }
 //--------------------------------------------------------------------------------------
 // all variants of MakePwlInto come here. Split a rational Bezier into Piecewise Linear
@@ -329,6 +473,28 @@ Vector SSurface::PointAt(double u, double v) const {
 }
 
 void SSurface::TangentsAt(double u, double v, Vector *tu, Vector *tv, bool retry) const {
+    if(degm == 1 && degn == 1 &&
+       weight[0][0] == weight[0][1] && weight[0][0] == weight[1][0] &&
+       weight[0][0] == weight[1][1])
+    {
+        // A bilinear patch, the planes and most of the trimming work; with
+        // equal weights it's just a polynomial, so no quotient rule.
+        *tu = (ctrl[1][0].Minus(ctrl[0][0])).ScaledBy(1 - v).Plus(
+              (ctrl[1][1].Minus(ctrl[0][1])).ScaledBy(v));
+        *tv = (ctrl[0][1].Minus(ctrl[0][0])).ScaledBy(1 - u).Plus(
+              (ctrl[1][1].Minus(ctrl[1][0])).ScaledBy(u));
+    } else {
+        RationalTangentsAt(u, v, tu, tv);
+    }
+
+    // Tangent is zero at sungularities like the north pole. Move away a bit and retry. 
+    if(tv->Equals(Vector::From(0,0,0)) && retry)
+        TangentsAt(u+(0.5-u)*0.00001, v, tu, tv, false);
+    if(tu->Equals(Vector::From(0,0,0)) && retry)
+        TangentsAt(u, v+(0.5-v)*0.00001, tu, tv, false);
+}
+
+void SSurface::RationalTangentsAt(double u, double v, Vector *tu, Vector *tv) const {
     Vector num   = Vector::From(0, 0, 0),
            num_u = Vector::From(0, 0, 0),
            num_v = Vector::From(0, 0, 0);
@@ -360,12 +526,6 @@ void SSurface::TangentsAt(double u, double v, Vector *tu, Vector *tv, bool retry
 
     *tv = ((num_v.ScaledBy(den)).Minus(num.ScaledBy(den_v)));
     *tv = tv->ScaledBy(1.0/(den*den));
-    
-    // Tangent is zero at sungularities like the north pole. Move away a bit and retry. 
-    if(tv->Equals(Vector::From(0,0,0)) && retry)
-        TangentsAt(u+(0.5-u)*0.00001, v, tu, tv, false);
-    if(tu->Equals(Vector::From(0,0,0)) && retry)
-        TangentsAt(u, v+(0.5-v)*0.00001, tu, tv, false);
 }
 
 Vector SSurface::NormalAt(Point2d puv) const {
@@ -383,14 +543,105 @@ void SSurface::ClosestPointTo(Vector p, Point2d *puv, bool mustConverge) {
 }
 
 void SSurface::ClosestPointTo(Vector p, double *u, double *v, bool mustConverge) {
+    if(ClosestPointExactly(p, u, v)) return;
+    if(ClosestPointNearCached(p, u, v, mustConverge)) return;
+
+    // Search for a reasonable initial guess
+    int i, j;
+    double minDist = VERY_POSITIVE;
+    int res = (max(degm, degn) == 2) ? 7 : 20;
+    for(i = 0; i < res; i++) {
+        for(j = 0; j < res; j++) {
+            double tryu = (i + 0.5)/res, tryv = (j + 0.5)/res;
+
+            Vector tryp = PointAt(tryu, tryv);
+            double d = (tryp.Minus(p)).Magnitude();
+            if(d < minDist) {
+                *u = tryu;
+                *v = tryv;
+                minDist = d;
+            }
+        }
+    }
+
+    ClosestPointFromGuess(p, u, v, mustConverge);
+}
+
+//-----------------------------------------------------------------------------
+// The surface at the grid of (u, v) that ClosestPointTo searches for its
+// initial guess, kept a coordinate to an array so that one point's distance
+// to all of them is worked out a few grid points at a time.
+//-----------------------------------------------------------------------------
+class SSurfaceGuessGrid {
+public:
+    int                 res = 0;
+    std::vector<double> x, y, z, d;
+
+    void Make(const SSurface *srf) {
+        res = (max(srf->degm, srf->degn) == 2) ? 7 : 20;
+        x.resize(res*res);
+        y.resize(res*res);
+        z.resize(res*res);
+        d.resize(res*res);
+        for(int i = 0; i < res; i++) {
+            for(int j = 0; j < res; j++) {
+                Vector tryp = srf->PointAt((i + 0.5)/res, (j + 0.5)/res);
+                x[i*res + j] = tryp.x;
+                y[i*res + j] = tryp.y;
+                z[i*res + j] = tryp.z;
+            }
+        }
+    }
+
+    // Same guess as the search in ClosestPointTo, down to which of two
+    // equally distant grid points wins.
+    void Guess(Vector p, double *u, double *v) {
+        int n = res*res;
+        const double *xs = x.data(), *ys = y.data(), *zs = z.data();
+        double *ds = d.data();
+#pragma omp simd
+        for(int k = 0; k < n; k++) {
+            double dx = xs[k] - p.x, dy = ys[k] - p.y, dz = zs[k] - p.z;
+            ds[k] = sqrt(dx*dx + dy*dy + dz*dz);
+        }
+
+        double minDist = VERY_POSITIVE;
+        for(int k = 0; k < n; k++) {
+            if(ds[k] < minDist) {
+                *u = (k / res + 0.5)/res;
+                *v = (k % res + 0.5)/res;
+                minDist = ds[k];
+            }
+        }
+    }
+};
+
+void SSurface::ClosestPointsTo(const Vector *p, Point2d *puv, size_t n,
+                               bool mustConverge)
+{
+    SSurfaceGuessGrid grid;
+    for(size_t i = 0; i < n; i++) {
+        double *u = &(puv[i].x), *v = &(puv[i].y);
+        if(ClosestPointExactly(p[i], u, v)) continue;
+        if(ClosestPointNearCached(p[i], u, v, mustConverge)) continue;
+
+        // Only made once some point needs it; along a curve, the cached
+        // guess usually does.
+        if(grid.res == 0) grid.Make(this);
+        grid.Guess(p[i], u, v);
+        ClosestPointFromGuess(p[i], u, v, mustConverge);
+    }
+}
+
+bool SSurface::ClosestPointExactly(Vector p, double *u, double *v) const {
     // A few special cases first; when control points are coincident the
     // derivative goes to zero at the control points, and would result in
     // nonconvergence. We avoid that here, and also guarantee a consistent
     // (u, v) (of the infinitely many possible in one parameter).
-    if(p.Equals(ctrl[0]   [0]   )) { *u = 0; *v = 0; return; }
-    if(p.Equals(ctrl[degm][0]   )) { *u = 1; *v = 0; return; }
-    if(p.Equals(ctrl[degm][degn])) { *u = 1; *v = 1; return; }
-    if(p.Equals(ctrl[0]   [degn])) { *u = 0; *v = 1; return; }
+    if(p.Equals(ctrl[0]   [0]   )) { *u = 0; *v = 0; return true; }
+    if(p.Equals(ctrl[degm][0]   )) { *u = 1; *v = 0; return true; }
+    if(p.Equals(ctrl[degm][degn])) { *u = 1; *v = 1; return true; }
+    if(p.Equals(ctrl[0]   [degn])) { *u = 0; *v = 1; return true; }
 
     // And planes are trivial, so don't waste time iterating over those.
     if(degm == 1 && degn == 1) {
@@ -406,10 +657,15 @@ void SSurface::ClosestPointTo(Vector p, double *u, double *v, bool mustConverge)
             Vector dp = p.Minus(orig);
             *u = dp.Dot(bu) / tx.MagSquared();
             *v = dp.Dot(bv) / ty.MagSquared();
-            return;
+            return true;
         }
     }
+    return false;
+}
 
+bool SSurface::ClosestPointNearCached(Vector p, double *u, double *v,
+                                      bool mustConverge)
+{
     // Try whatever the previous guess was. This is likely to do something
     // good if we're working our way along a curve or something else where
     // we project successive points that are close to each other; something
@@ -419,28 +675,15 @@ void SSurface::ClosestPointTo(Vector p, double *u, double *v, bool mustConverge)
         if(ClosestPointNewton(p, &ut, &vt, mustConverge)) {
             cached.x = *u = ut;
             cached.y = *v = vt;
-            return;
-        }
-    }
-
-    // Search for a reasonable initial guess
-    int i, j;
-    double minDist = VERY_POSITIVE;
-    int res = (max(degm, degn) == 2) ? 7 : 20;
-    for(i = 0; i < res; i++) {
-        for(j = 0; j < res; j++) {
-            double tryu = (i + 0.5)/res, tryv = (j + 0.5)/res;
-
-            Vector tryp = PointAt(tryu, tryv);
-            double d = (tryp.Minus(p)).Magnitude();
-            if(d < minDist) {
-                *u = tryu;
-                *v = tryv;
-                minDist = d;
-            }
+            return true;
         }
     }
+    return false;
+}
 
+void SSurface::ClosestPointFromGuess(Vector p, double *u, double *v,
+                                     bool mustConverge)
+{
     if(ClosestPointNewton(p, u, v, mustConverge)) {
         cached.x = *u;
         cached.y = *v;
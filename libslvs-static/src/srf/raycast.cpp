@@ -381,6 +381,15 @@ void SShell::AllPointsIntersecting(Vector a, Vector b,
                                    List<SInter> *il,
                                    bool asSegment, bool trimmed, bool inclTangent)
 {
+    if(bvh.IsFor(this)) {
+        std::vector<int> near;
+        bvh.FindAlongLine(a, b, asSegment, &near);
+        for(int i : near) {
+            surface[i].AllPointsIntersecting(a, b, il,
+                asSegment, trimmed, inclTangent);
+        }
+        return;
+    }
     for(SSurface &ss : surface) {
         ss.AllPointsIntersecting(a, b, il,
             asSegment, trimmed, inclTangent);
@@ -430,10 +439,34 @@ bool SShell::ClassifyEdge(Class *indir, Class *outdir,
 {
     List<SInter> l = {};
 
+    // Only the surfaces whose boxes reach the edge or p can have the edge on
+    // an edge of theirs or p on them; p is inverted onto each of those at
+    // most once, for both tests.
+    std::vector<int> near;
+    if(bvh.IsFor(this)) {
+        Vector bmax = ea, bmin = ea;
+        eb.MakeMaxMin(&bmax, &bmin);
+        p.MakeMaxMin(&bmax, &bmin);
+        Vector eps = Vector::From(LENGTH_EPS, LENGTH_EPS, LENGTH_EPS);
+        bvh.FindOverlapping(bmax.Plus(eps), bmin.Minus(eps), &near);
+    } else {
+        for(int i = 0; i < surface.n; i++) near.push_back(i);
+    }
+    std::vector<Point2d> puvNear(near.size());
+    std::vector<bool> inverted(near.size(), false);
+    auto invertOnto = [&](size_t k) {
+        if(!inverted[k]) {
+            surface[near[k]].ClosestPointTo(p, &puvNear[k], /*mustConverge=*/false);
+            inverted[k] = true;
+        }
+        return puvNear[k];
+    };
+
     // First, check for edge-on-edge
     int edge_inters = 0;
     Vector inter_surf_n[2], inter_edge_n[2];
-    for(SSurface &srf : surface) {
+    for(size_t k = 0; k < near.size(); k++) {
+        SSurface &srf = surface[near[k]];
         if(srf.LineEntirelyOutsideBbox(ea, eb, /*asSegment=*/true)) continue;
 
         SEdgeList *sel = &(srf.edges);
@@ -445,8 +478,7 @@ bool SShell::ClassifyEdge(Class *indir, Class *outdir,
             {
                 if(edge_inters < 2) {
                     // Edge-on-edge case
-                    Point2d pm;
-                    srf.ClosestPointTo(p,  &pm, /*mustConverge=*/false);
+                    Point2d pm = invertOnto(k);
                     // A vector normal to the surface, at the intersection point
                     inter_surf_n[edge_inters] = srf.NormalAt(pm);
                     // A vector normal to the intersecting edge (but within the
@@ -518,11 +550,11 @@ bool SShell::ClassifyEdge(Class *indir, Class *outdir,
     // are on surface) and for numerical stability, so we don't pick up
     // the additional error from the line intersection.
 
-    for(SSurface &srf : surface) {
+    for(size_t k = 0; k < near.size(); k++) {
+        SSurface &srf = surface[near[k]];
         if(srf.LineEntirelyOutsideBbox(ea, eb, /*asSegment=*/true)) continue;
 
-        Point2d puv;
-        srf.ClosestPointTo(p, &(puv.x), &(puv.y), /*mustConverge=*/false);
+        Point2d puv = invertOnto(k);
         Vector pp = srf.PointAt(puv);
 
         if((pp.Minus(p)).Magnitude() > LENGTH_EPS) continue;
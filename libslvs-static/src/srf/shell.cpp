@@ -5,6 +5,7 @@
 // Copyright 2008-2013 Jonathan Westhues.
 //-----------------------------------------------------------------------------
 #include "../solvespace.h"
+#include <thread>
 
 typedef struct {
     hSCurve     hc;
@@ -585,13 +586,33 @@ void SShell::MakeSectionEdgesInto(Vector n, double d, SEdgeList *sel, SBezierLis
     }
 }
 
+// The surfaces are triangulated independently, on up to one thread per
+// core, each into a mesh of its own; the meshes are then joined in the
+// surfaces' order, so the result is the same however the work was shared.
 void SShell::TriangulateInto(SMesh *sm) {
-#pragma omp parallel for
-    for(int i=0; i<surface.n; i++) {
-        SSurface *s = &surface[i];
-        SMesh m;
-        s->TriangulateInto(this, &m);
-        #pragma omp critical
+    std::vector<SMesh> meshes(surface.n);
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        for(int i; (i = next++) < surface.n;) {
+            // Whatever the surface needed from the calling thread's
+            // temporary arena is done with once its mesh is made.
+            TemporaryMark mark = MarkTemporary();
+            surface[i].TriangulateInto(this, &meshes[i]);
+            ReleaseTemporary(mark);
+        }
+    };
+    int threads = (int)std::min<unsigned>(std::max(1u, std::thread::hardware_concurrency()),
+                                           (unsigned)std::max(surface.n, 1));
+    std::vector<std::thread> pool;
+    for(int t = 1; t < threads; t++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for(std::thread &th : pool) {
+        th.join();
+    }
+
+    for(SMesh &m : meshes) {
         sm->MakeFromCopyOf(&m);
         m.Clear();
     }
@@ -611,4 +632,5 @@ void SShell::Clear() {
         c.Clear();
     }
     curve.Clear();
+    bvh.Clear();
 }
@@ -222,7 +222,6 @@ void SSurface::MakeTrimEdgesInto(SEdgeList *sel, MakeAs flags,
 {
     Vector prev = Vector::From(0, 0, 0);
     bool inCurve = false, empty = true;
-    double u = 0, v = 0;
 
     int i, first, last, increment;
     if(stb->backwards) {
@@ -234,12 +233,22 @@ void SSurface::MakeTrimEdgesInto(SEdgeList *sel, MakeAs flags,
         last = sc->pts.n - 1;
         increment = 1;
     }
+    // Project the whole curve into uv at once, in the order we walk it.
+    std::vector<Vector>  xyz;
+    std::vector<Point2d> uv;
+    if(flags == MakeAs::UV) {
+        for(i = first; i != (last + increment); i += increment) {
+            xyz.push_back(sc->pts[i].p);
+        }
+        uv.resize(xyz.size());
+        ClosestPointsTo(xyz.data(), uv.data(), xyz.size());
+    }
     for(i = first; i != (last + increment); i += increment) {
         Vector tpt, *pt = &(sc->pts[i].p);
 
         if(flags == MakeAs::UV) {
-            ClosestPointTo(*pt, &u, &v);
-            tpt = Vector::From(u, v, 0);
+            Point2d puv = uv[(i - first)*increment];
+            tpt = Vector::From(puv.x, puv.y, 0);
         } else {
             tpt = *pt;
         }
@@ -35,6 +35,11 @@ public:
 
     static SBspUv *Alloc();
     static SBspUv *From(SEdgeList *el, SSurface *srf);
+    static SBspUv *CachedFrom(SEdgeList *el, SSurface *srf);
+    static void AgeCache();
+
+    size_t Count() const;
+    SBspUv *CopyInto(std::vector<SBspUv> *nodes) const;
 
     void ScalePoints(Point2d *pt, Point2d *a, Point2d *b, SSurface *srf) const;
     double ScaledSignedDistanceToLine(Point2d pt, Point2d a, Point2d b,
@@ -96,6 +101,21 @@ public:
     void MakePwlInto(List<SCurvePt> *l, double chordTol=0, double max_dt=0.0) const;
     void MakePwlInto(SContour *sc, double chordTol=0, double max_dt=0.0) const;
     void MakePwlInto(List<Vector> *l, double chordTol=0, double max_dt=0.0) const;
+    // The same points, cached; good until the next regeneration.
+    const std::vector<Vector> &PwlPoints(double chordTol=0, double max_dt=0.0) const;
+    static void AgePwlCache();
+    // A tree of boxes around runs of the PwlPoints, cached along with them.
+    // Each box is padded a little, so that edges that EdgeCrosses() might
+    // find to touch are in boxes that overlap.
+    class PwlBox {
+    public:
+        BBox    box;
+        int     first, last;    // the points in the run
+        int     lt, gt;         // the two halves of the run, or -1 if none
+    };
+    void PwlPointsAndBoxes(const std::vector<Vector> **pts,
+                           const std::vector<PwlBox> **boxes,
+                           double chordTol=0, double max_dt=0.0) const;
     void MakePwlWorker(List<Vector> *l, double ta, double tb, double chordTol, double max_dt) const;
     void MakePwlInitialWorker(List<Vector> *l, double ta, double tb, double chordTol, double max_dt) const;
     void MakeNonrationalCubicInto(SBezierList *bl, double tolerance, int depth = 0) const;
@@ -131,6 +151,8 @@ public:
     void AllIntersectionsWith(SBezierList *sblb, SPointList *spl) const;
     bool GetPlaneContainingBeziers(Vector *p, Vector *u, Vector *v,
                                         Vector *notCoplanarAt) const;
+    void AddInterpolatingSpline(const std::vector<Vector> &pts, bool periodic,
+                                Vector ctrlStart, Vector ctrlFinish);
 };
 
 class SBezierLoop {
@@ -303,9 +325,10 @@ public:
                                     SShell *into, SSurface::CombineAs type, int dbg_index);
     void TrimFromEdgeList(SEdgeList *el, bool asUv);
     void IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
-                          SShell *into);
+                          SShell *into, List<SCurve> *found);
     void AddExactIntersectionCurve(SBezier *sb, SSurface *srfB,
-                          SShell *agnstA, SShell *agnstB, SShell *into);
+                          SShell *agnstA, SShell *agnstB, SShell *into,
+                          List<SCurve> *found);
 
     typedef struct {
         int     tag;
@@ -328,6 +351,12 @@ public:
 
     void ClosestPointTo(Vector p, Point2d *puv, bool mustConverge=true);
     void ClosestPointTo(Vector p, double *u, double *v, bool mustConverge=true);
+    // The same as ClosestPointTo on each of p[0..n) in turn.
+    void ClosestPointsTo(const Vector *p, Point2d *puv, size_t n,
+                         bool mustConverge=true);
+    bool ClosestPointExactly(Vector p, double *u, double *v) const;
+    bool ClosestPointNearCached(Vector p, double *u, double *v, bool mustConverge);
+    void ClosestPointFromGuess(Vector p, double *u, double *v, bool mustConverge);
     bool ClosestPointNewton(Vector p, double *u, double *v, bool mustConverge=true) const;
 
     bool PointIntersectingLine(Vector p0, Vector p1, double *u, double *v) const;
@@ -337,6 +366,7 @@ public:
     Vector PointAt(double u, double v) const;
     Vector PointAt(Point2d puv) const;
     void TangentsAt(double u, double v, Vector *tu, Vector *tv, bool retry=true) const;
+    void RationalTangentsAt(double u, double v, Vector *tu, Vector *tv) const;
     Vector NormalAt(Point2d puv) const;
     Vector NormalAt(double u, double v) const;
     bool LineEntirelyOutsideBbox(Vector a, Vector b, bool asSegment) const;
@@ -373,6 +403,39 @@ public:
     void Clear();
 };
 
+// A bounding volume hierarchy over the surfaces of a shell, built from the
+// boxes around their control points, to find the surfaces near a box without
+// testing every one.
+class SSurfaceBvh {
+public:
+    struct Node {
+        Vector      max, min;
+        // An inner node has no surfaces of its own; its children are the
+        // node after it and node[right]. A leaf has the n surfaces from
+        // surface[first].
+        int         right;
+        int         first, n;
+    };
+    std::vector<Node>   node;
+    // Indices into the shell's surfaces, in leaf order
+    std::vector<int>    surface;
+
+    // The shell it was built for and how many surfaces that had; it only
+    // answers for that shell, as it was.
+    const SShell        *shell = NULL;
+    int                 surfaces = 0;
+
+    static const int LEAF_SIZE = 4;
+
+    void Build(SShell *shell);
+    int AddNode(int first, int n, const std::vector<Vector> &max,
+                const std::vector<Vector> &min, const std::vector<Vector> &mid);
+    bool IsFor(const SShell *sh) const;
+    void FindOverlapping(Vector max, Vector min, std::vector<int> *found) const;
+    void FindAlongLine(Vector a, Vector b, bool asSegment, std::vector<int> *found) const;
+    void Clear();
+};
+
 class SShell {
 public:
     IdList<SCurve,hSCurve>      curve;
@@ -380,6 +443,10 @@ public:
 
     bool                        booleanFailed;
 
+    // Over the surfaces as they were when it was last built; a boolean
+    // rebuilds it for the shell it intersects against.
+    SSurfaceBvh                 bvh;
+
     void MakeFromExtrusionOf(SBezierLoopSet *sbls, Vector t0, Vector t1,
                              RgbaColor color);
     bool CheckNormalAxisRelationship(SBezierLoopSet *sbls, Vector pt, Vector axis, double da, double dx);
@@ -395,6 +462,7 @@ public:
     void CopyCurvesSplitAgainst(bool opA, SShell *agnst, SShell *into);
     void CopySurfacesTrimAgainst(SShell *sha, SShell *shb, SShell *into, SSurface::CombineAs type);
     void MakeIntersectionCurvesAgainst(SShell *against, SShell *into);
+    void AddIntersectionCurves(List<SCurve> *found);
     void MakeClassifyingBsps(SShell *useCurvesFrom);
     void AllPointsIntersecting(Vector a, Vector b, List<SInter> *il,
                                 bool asSegment, bool trimmed, bool inclTangent);
@@ -9,8 +9,28 @@
 
 extern int FLAG;
 
+// The exact curve in l, if any, that follows sb either way along it.
+template<class L>
+static SCurve *FindExactCurve(L *l, SBezier *sb, bool *backwards) {
+    SBezier sbrev = *sb;
+    sbrev.Reverse();
+    for(SCurve &se : *l) {
+        if(!se.isExact) continue;
+        if(sb->Equals(&(se.exact))) {
+            *backwards = false;
+            return &se;
+        }
+        if(sbrev.Equals(&(se.exact))) {
+            *backwards = true;
+            return &se;
+        }
+    }
+    return NULL;
+}
+
 void SSurface::AddExactIntersectionCurve(SBezier *sb, SSurface *srfB,
-                                         SShell *agnstA, SShell *agnstB, SShell *into)
+                                         SShell *agnstA, SShell *agnstB, SShell *into,
+                                         List<SCurve> *found)
 {
     SCurve sc = {};
     // Important to keep the order of (surfA, surfB) consistent; when we later
@@ -22,27 +42,13 @@ void SSurface::AddExactIntersectionCurve(SBezier *sb, SSurface *srfB,
 
     // Now we have to piecewise linearize the curve. If there's already an
     // identical curve in the shell, then follow that pwl exactly, otherwise
-    // calculate from scratch.
-    SCurve split, *existing = NULL;
-    SBezier sbrev = *sb;
-    sbrev.Reverse();
+    // calculate from scratch. Nothing is added to into while the surfaces
+    // are intersected, so it's safe to read here; a curve that another
+    // surface finds too is matched up by AddIntersectionCurves.
+    SCurve split;
     bool backwards = false;
-#pragma omp critical(into)
-    {
-        for(SCurve &se : into->curve) {
-            if(se.isExact) {
-                if(sb->Equals(&(se.exact))) {
-                    existing = &se;
-                    break;
-                }
-                if(sbrev.Equals(&(se.exact))) {
-                    existing = &se;
-                    backwards = true;
-                    break;
-                }
-            }
-        }
-    }// end omp critical
+    SCurve *existing = FindExactCurve(&(into->curve), sb, &backwards);
+    if(!existing) existing = FindExactCurve(found, sb, &backwards);
     if(existing) {
         SCurvePt *v;
         for(v = existing->pts.First(); v; v = existing->pts.NextAfter(v)) {
@@ -104,14 +110,35 @@ void SSurface::AddExactIntersectionCurve(SBezier *sb, SSurface *srfB,
              "Unexpected zero-length edge");
 
     split.source = SCurve::Source::INTERSECTION;
-#pragma omp critical(into)
-    {
-        into->curve.AddAndAssignId(&split);
+    found->Add(&split);
+}
+
+//-----------------------------------------------------------------------------
+// Add the curves that one surface found against a shell, as they were found.
+// An exact curve that a surface before it found too takes the points of that
+// one's, just as if the two had been found one after the other, so the trims
+// on both sides of it meet. Adding each surface's curves in turn gives them
+// the same handles however the intersections were shared out over threads.
+//-----------------------------------------------------------------------------
+void SShell::AddIntersectionCurves(List<SCurve> *found) {
+    for(SCurve &sc : *found) {
+        bool backwards;
+        SCurve *existing = sc.isExact ? FindExactCurve(&curve, &(sc.exact), &backwards)
+                                      : NULL;
+        if(existing) {
+            sc.pts.Clear();
+            for(SCurvePt &v : existing->pts) {
+                sc.pts.Add(&v);
+            }
+            if(backwards) sc.pts.Reverse();
+        }
+        curve.AddAndAssignId(&sc);
     }
+    found->Clear();
 }
 
 void SSurface::IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
-                                SShell *into)
+                                SShell *into, List<SCurve> *found)
 {
     Vector amax, amin, bmax, bmin;
     GetAxisAlignedBounding(&amax, &amin);
@@ -185,7 +212,7 @@ void SSurface::IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
         if(tmax > tmin + LENGTH_EPS) {
             SBezier bezier = SBezier::From(p.Plus(dl.ScaledBy(tmin)),
                                            p.Plus(dl.ScaledBy(tmax)));
-            AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into);
+            AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into, found);
         }
     } else if((degm == 1 && degn == 1 && isExtdb) ||
               (b->degm == 1 && b->degn == 1 && isExtdt))
@@ -230,7 +257,7 @@ void SSurface::IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
                 Vector al = along.ScaledBy(0.5);
                 SBezier bezier;
                 bezier = SBezier::From((si->p).Minus(al), (si->p).Plus(al));
-                AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into);
+                AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into, found);
             }
 
             inters.Clear();
@@ -246,7 +273,7 @@ void SSurface::IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
                     Vector::AtIntersectionOfPlaneAndLine(n, d, p0, p1, NULL);
             }
 
-            AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into);
+            AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into, found);
         }
     } else if(isExtdt && isExtdb &&
                 sqrt(fabs(alongt.Dot(alongb))) >
@@ -307,7 +334,7 @@ void SSurface::IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
 
             SBezier bezier;
             bezier = SBezier::From(p.Plus(axis0), p.Plus(axis1));
-            AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into);
+            AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into, found);
         }
 
         inters.Clear();
@@ -340,7 +367,7 @@ void SSurface::IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
                 // does it lie completely in the plane?
                 if(splane->ContainsPlaneCurve(&sc)) {
                     SBezier bezier = sc.exact;
-                    AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into);
+                    AddExactIntersectionCurve(&bezier, b, agnstA, agnstB, into, found);
                     foundExact = true;
                 }
             }
@@ -498,10 +525,7 @@ void SSurface::IntersectAgainst(SSurface *b, SShell *agnstA, SShell *agnstB,
             // And now we split and insert the curve
             SCurve split = sc.MakeCopySplitAgainst(agnstA, agnstB, this, b);
             sc.Clear();
-#pragma omp critical(into)
-            {
-                into->curve.AddAndAssignId(&split);
-            }
+            found->Add(&split);
         }
         spl.Clear();
     }
@@ -8,6 +8,337 @@
 //-----------------------------------------------------------------------------
 #include "../solvespace.h"
 
+#include <set>
+
+// We would like to apply our tolerances in xyz; but that would be a lot of
+// work, so at least scale the epsilon semi-reasonably. That's perfect for
+// square planes, less perfect for anything else.
+static double ScaledEpsFor(SSurface *srf) {
+    Vector tu, tv;
+    srf->TangentsAt(0.5, 0.5, &tu, &tv);
+    double s = sqrt(tu.MagSquared() + tv.MagSquared());
+    return LENGTH_EPS / s;
+}
+
+//-----------------------------------------------------------------------------
+// Triangulate a plane face with a sweep line, in O(n log n): cut the outer
+// contour and its holes into y-monotone pieces with diagonals from the split
+// and merge vertices, and triangulate each piece with a stack. Ear clipping
+// tests every remaining vertex for every ear, and bridging holes does the
+// same for every bridge, so this is for the faces with many vertices, like
+// the caps of a finely tessellated cylinder or a line of text.
+//-----------------------------------------------------------------------------
+class SweepTriangulator {
+public:
+    // Only for faces with at least this many vertices; ear clipping makes
+    // better shaped triangles for the rest.
+    static const int MIN_VERTICES = 128;
+
+    struct Vertex {
+        double x, y;
+        int    prev, next;
+    };
+    std::vector<Vertex>             v;
+    std::vector<std::vector<int>>   adj;
+    std::vector<int>                helper;
+    std::vector<bool>               onLeft;
+    int                             sweep;
+
+    static double Orient(const Vertex &a, const Vertex &b, const Vertex &c) {
+        return (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
+    }
+
+    // Whether a is met before b, sweeping down and then to the right.
+    bool Above(int a, int b) const {
+        if(v[a].y != v[b].y) return v[a].y > v[b].y;
+        return v[a].x < v[b].x;
+    }
+
+    // The edges from each vertex to the next, for which the face is on the
+    // right, ordered left to right where they cross the sweep line. Edge -1
+    // stands for the vertex at the sweep line.
+    struct LeftOf {
+        const SweepTriangulator *t;
+        bool operator()(int e, int f) const {
+            if(e == f) return false;
+            if(f == -1) return t->East(e, t->sweep) > 0;
+            if(e == -1) return t->East(f, t->sweep) < 0;
+            // Whichever edge starts lower starts within the other's span;
+            // if they start together, then compare where they end.
+            int te = t->Top(e), tf = t->Top(f);
+            if(te == tf) {
+                return t->East(f, t->Bottom(e)) < 0;
+            } else if(t->Above(tf, te)) {
+                return t->East(f, te) < 0;
+            } else {
+                return t->East(e, tf) > 0;
+            }
+        }
+    };
+    std::set<int, LeftOf>                   status;
+    std::vector<std::set<int, LeftOf>::iterator> inStatus;
+
+    int Top(int e) const    { return Above(e, v[e].next) ? e : v[e].next; }
+    int Bottom(int e) const { return Above(e, v[e].next) ? v[e].next : e; }
+    // Positive if p is to the right (in x) of the edge from e
+    double East(int e, int p) const {
+        return Orient(v[Top(e)], v[Bottom(e)], v[p]);
+    }
+
+    void AddDiagonal(int a, int b) {
+        adj[a].push_back(b);
+        adj[b].push_back(a);
+    }
+    void Insert(int e, int h) {
+        inStatus[e] = status.insert(e).first;
+        helper[e] = h;
+    }
+    void Remove(int e) {
+        status.erase(inStatus[e]);
+    }
+    bool IsMerge(int i) const {
+        int a = v[i].prev, b = v[i].next;
+        return Above(a, i) && Above(b, i) && Orient(v[a], v[i], v[b]) < 0;
+    }
+    // The edge directly to the left of vertex i on the sweep line
+    int EdgeLeftOf(int i) {
+        sweep = i;
+        auto it = status.upper_bound(-1);
+        if(it == status.begin()) return -1;
+        return *(--it);
+    }
+
+    bool MakeMonotone() {
+        std::vector<int> order(v.size());
+        for(size_t i = 0; i < v.size(); i++) order[i] = (int)i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return Above(a, b); });
+
+        helper.assign(v.size(), -1);
+        inStatus.resize(v.size());
+        for(int i : order) {
+            sweep = i;
+            int a = v[i].prev, b = v[i].next;
+            bool prevAbove = Above(a, i), nextAbove = Above(b, i);
+            bool convex = Orient(v[a], v[i], v[b]) > 0;
+
+            if(!prevAbove && !nextAbove) {
+                if(convex) {
+                    // start
+                    Insert(i, i);
+                } else {
+                    // split
+                    int e = EdgeLeftOf(i);
+                    if(e < 0) return false;
+                    AddDiagonal(i, helper[e]);
+                    helper[e] = i;
+                    Insert(i, i);
+                }
+            } else if(prevAbove && nextAbove) {
+                if(helper[a] < 0) return false;
+                if(IsMerge(helper[a])) AddDiagonal(i, helper[a]);
+                Remove(a);
+                if(!convex) {
+                    // merge
+                    int e = EdgeLeftOf(i);
+                    if(e < 0) return false;
+                    if(IsMerge(helper[e])) AddDiagonal(i, helper[e]);
+                    helper[e] = i;
+                }
+            } else if(prevAbove) {
+                // regular, with the face to its right
+                if(helper[a] < 0) return false;
+                if(IsMerge(helper[a])) AddDiagonal(i, helper[a]);
+                Remove(a);
+                Insert(i, i);
+            } else {
+                // regular, with the face to its left
+                int e = EdgeLeftOf(i);
+                if(e < 0) return false;
+                if(IsMerge(helper[e])) AddDiagonal(i, helper[e]);
+                helper[e] = i;
+            }
+        }
+        return true;
+    }
+
+    // Triangulate the y-monotone polygon f, counter-clockwise.
+    void TriangulateMonotone(const std::vector<int> &f, std::vector<int> *tris) {
+        size_t n = f.size();
+        if(n < 3) return;
+        size_t top = 0, bottom = 0;
+        for(size_t i = 1; i < n; i++) {
+            if(Above(f[i], f[top])) top = i;
+            if(Above(f[bottom], f[i])) bottom = i;
+        }
+        // Counter-clockwise from the top is down the left chain.
+        for(size_t i = top; i != bottom; i = (i + 1) % n) onLeft[f[i]] = true;
+        const std::vector<bool> &left = onLeft;
+        std::vector<int> u(f);
+        std::sort(u.begin(), u.end(), [&](int a, int b) { return Above(a, b); });
+
+        auto emit = [&](int a, int b, int c) {
+            // counter-clockwise, whichever order they came in
+            if(Orient(v[a], v[b], v[c]) < 0) swap(b, c);
+            tris->push_back(a);
+            tris->push_back(b);
+            tris->push_back(c);
+        };
+
+        std::vector<int> stack = { u[0], u[1] };
+        for(size_t j = 2; j + 1 < n; j++) {
+            int uj = u[j];
+            if(left[uj] != left[stack.back()]) {
+                for(size_t k = 0; k + 1 < stack.size(); k++) {
+                    emit(uj, stack[k], stack[k+1]);
+                }
+                int last = stack.back();
+                stack = { last, uj };
+            } else {
+                int a = stack.back();
+                stack.pop_back();
+                while(!stack.empty()) {
+                    int b = stack.back();
+                    double o = left[uj] ? Orient(v[b], v[a], v[uj])
+                                        : Orient(v[uj], v[a], v[b]);
+                    if(o <= 0) break;
+                    emit(uj, a, b);
+                    a = b;
+                    stack.pop_back();
+                }
+                stack.push_back(a);
+                stack.push_back(uj);
+            }
+        }
+        int un = u[n - 1];
+        for(size_t k = 0; k + 1 < stack.size(); k++) {
+            emit(un, stack[k], stack[k+1]);
+        }
+        for(int i : f) onLeft[i] = false;
+    }
+
+    // The faces that the diagonals cut the polygon into, each traced
+    // counter-clockwise, and then triangulated; false if the sweep went
+    // wrong, as it may where contours touch.
+    bool Triangulate(std::vector<int> *tris) {
+        adj.assign(v.size(), std::vector<int>());
+        for(size_t i = 0; i < v.size(); i++) {
+            adj[i].push_back(v[i].prev);
+            adj[i].push_back(v[i].next);
+        }
+        if(!MakeMonotone()) return false;
+
+        // Around each vertex, its neighbors counter-clockwise
+        for(size_t i = 0; i < v.size(); i++) {
+            std::vector<int> &a = adj[i];
+            std::sort(a.begin(), a.end(), [&](int p, int q) {
+                return atan2(v[p].y - v[i].y, v[p].x - v[i].x) <
+                       atan2(v[q].y - v[i].y, v[q].x - v[i].x);
+            });
+        }
+        onLeft.assign(v.size(), false);
+        std::set<std::pair<int, int>> done;
+        std::vector<int> face;
+        for(size_t i = 0; i < v.size(); i++) {
+            for(int j : adj[i]) {
+                // The face is on the left of the contour's edges, and of
+                // the diagonals either way.
+                if(j == v[i].prev || done.count({ (int)i, j })) continue;
+
+                face.clear();
+                int a = (int)i, b = j;
+                while(!done.count({ a, b })) {
+                    if(face.size() > v.size()) return false;
+                    done.insert({ a, b });
+                    face.push_back(a);
+                    // Turn as far right as we can at b.
+                    const std::vector<int> &nb = adj[b];
+                    size_t k = std::find(nb.begin(), nb.end(), a) - nb.begin();
+                    if(k == nb.size()) return false;
+                    int c = nb[(k + nb.size() - 1) % nb.size()];
+                    a = b;
+                    b = c;
+                }
+                if(a != (int)i || b != j) return false;
+                TriangulateMonotone(face, tris);
+            }
+        }
+        return true;
+    }
+};
+
+// Triangulate the contours in cl, the first of them outer and the rest its
+// holes, with a sweep line; false if that fails, and nothing was added.
+static bool SweepTriangulateInto(const std::vector<SContour *> &cl, SMesh *m,
+                                 double scaledEps)
+{
+    SweepTriangulator st = {};
+    st.status = std::set<int, SweepTriangulator::LeftOf>(SweepTriangulator::LeftOf { &st });
+
+    // Work with the outer contour counter-clockwise; flip our triangles
+    // back at the end if it wasn't.
+    bool reversed = false;
+    double area = 0;
+    int holes = -1;
+    for(size_t c = 0; c < cl.size(); c++) {
+        std::vector<Vector> pts;
+        for(const SPoint &sp : cl[c]->l) {
+            if(!pts.empty() && (sp.p).Equals(pts.back())) continue;
+            pts.push_back(sp.p);
+        }
+        while(pts.size() > 1 && pts.back().Equals(pts[0])) pts.pop_back();
+        if(pts.size() < 3) {
+            if(c == 0) return false;
+            continue;
+        }
+        holes++;
+
+        double a = 0;
+        for(size_t i = 0; i < pts.size(); i++) {
+            const Vector &p = pts[i], &q = pts[(i + 1) % pts.size()];
+            a += p.x*q.y - q.x*p.y;
+        }
+        if(c == 0) reversed = (a < 0);
+        if(reversed) {
+            std::reverse(pts.begin(), pts.end());
+            a = -a;
+        }
+        // Holes must go the other way.
+        if((c == 0) != (a > 0)) return false;
+        area += a/2;
+
+        int base = (int)st.v.size(), n = (int)pts.size();
+        for(int i = 0; i < n; i++) {
+            st.v.push_back({ pts[i].x, pts[i].y,
+                             base + WRAP(i - 1, n), base + WRAP(i + 1, n) });
+        }
+    }
+
+    std::vector<int> tris;
+    if(!st.Triangulate(&tris)) return false;
+
+    // A triangulation of a polygon with holes has two triangles for every
+    // hole plus the number of vertices, less two, and covers the area.
+    double sum = 0;
+    for(size_t i = 0; i < tris.size(); i += 3) {
+        sum += fabs(SweepTriangulator::Orient(st.v[tris[i]], st.v[tris[i+1]],
+                                              st.v[tris[i+2]]))/2;
+    }
+    if((int)tris.size()/3 != (int)st.v.size() + 2*holes - 2) return false;
+    if(fabs(sum - area) > LENGTH_EPS*max(1.0, area)) return false;
+
+    for(size_t i = 0; i < tris.size(); i += 3) {
+        STriangle tr = {};
+        tr.a = Vector::From(st.v[tris[i]].x,   st.v[tris[i]].y,   0);
+        tr.b = Vector::From(st.v[tris[i+1]].x, st.v[tris[i+1]].y, 0);
+        tr.c = Vector::From(st.v[tris[i+2]].x, st.v[tris[i+2]].y, 0);
+        if(reversed) swap(tr.b, tr.c);
+        // As in ClipEarInto, zero-area triangles are culled.
+        if(tr.Normal().MagSquared() < scaledEps*scaledEps) continue;
+        m->AddTriangle(&tr);
+    }
+    return true;
+}
+
 void SPolygon::UvTriangulateInto(SMesh *m, SSurface *srf) {
     if(l.n <= 0) return;
 
@@ -65,6 +396,26 @@ void SPolygon::UvTriangulateInto(SMesh *m, SSurface *srf) {
         }
 
 //        dbp("finished finding holes: %d ms", (int)(GetMilliseconds() - in));
+        // A big plane face is quicker to sweep than to bridge and clip.
+        bool swept = false;
+        if(srf->degm == 1 && srf->degn == 1) {
+            std::vector<SContour *> cl = { top };
+            int n = top->l.n;
+            for(sc = l.First(); sc; sc = l.NextAfter(sc)) {
+                if(sc->tag != 2) continue;
+                cl.push_back(sc);
+                n += sc->l.n;
+            }
+            if(n >= SweepTriangulator::MIN_VERTICES &&
+               SweepTriangulateInto(cl, m, ScaledEpsFor(srf)))
+            {
+                for(sc = l.First(); sc; sc = l.NextAfter(sc)) {
+                    if(sc->tag == 2) sc->tag = 3;
+                }
+                swept = true;
+            }
+        }
+
         for(;;) {
             double xmin = 1e10;
             SContour *scmin = NULL;
@@ -88,7 +439,7 @@ void SPolygon::UvTriangulateInto(SMesh *m, SSurface *srf) {
         }
 //        dbp("finished merging holes: %d ms", (int)(GetMilliseconds() - in));
 
-        merged.UvTriangulateInto(m, srf);
+        if(!swept) merged.UvTriangulateInto(m, srf);
 //        dbp("finished ear clippping: %d ms", (int)(GetMilliseconds() - in));
         merged.l.Clear();
         el.Clear();
@@ -365,13 +716,7 @@ void SContour::ClipEarInto(SMesh *m, int bp, double scaledEps) {
 }
 
 void SContour::UvTriangulateInto(SMesh *m, SSurface *srf) {
-    Vector tu, tv;
-    srf->TangentsAt(0.5, 0.5, &tu, &tv);
-    double s = sqrt(tu.MagSquared() + tv.MagSquared());
-    // We would like to apply our tolerances in xyz; but that would be a lot
-    // of work, so at least scale the epsilon semi-reasonably. That's
-    // perfect for square planes, less perfect for anything else.
-    double scaledEps = LENGTH_EPS / s;
+    double scaledEps = ScaledEpsFor(srf);
 
     int i;
     // Clean the original contour by removing any zero-length edges.
@@ -607,6 +952,12 @@ void SPolygon::UvGridTriangulateInto(SMesh *mesh, SSurface *srf) {
     }
 
     if ((li.n > 3) && (lj.n > 3)) {
+        // Every quad is tested against the same edges and contours.
+        SEdgeGrid origGrid;
+        origGrid.Build(&orig);
+        SPolygonBands bands;
+        bands.Build(this);
+
         // Now iterate over each quad in the grid. If it's outside the polygon,
         // or if it intersects the polygon, then we discard it. Otherwise we
         // generate two triangles in the mesh, and cut it out of our polygon.
@@ -634,17 +985,17 @@ void SPolygon::UvGridTriangulateInto(SMesh *mesh, SSurface *srf) {
                 //  +-------------> j/v axis
 
                 if( (i==(li.n-2)) || (j==(lj.n-2)) ||
-                   orig.AnyEdgeCrossings(a, b, NULL) ||
-                   orig.AnyEdgeCrossings(b, c, NULL) ||
-                   orig.AnyEdgeCrossings(c, d, NULL) ||
-                   orig.AnyEdgeCrossings(d, a, NULL))
+                   origGrid.AnyEdgeCrossings(a, b, NULL) ||
+                   origGrid.AnyEdgeCrossings(b, c, NULL) ||
+                   origGrid.AnyEdgeCrossings(c, d, NULL) ||
+                   origGrid.AnyEdgeCrossings(d, a, NULL))
                 {
                     this_flag = false;
                 }
 
                 // There's no intersections, so it doesn't matter which point
                 // we decide to test.
-                if(!this->ContainsPoint(a)) {
+                if(!bands.ContainsPoint(a)) {
                     this_flag = false;
                 }
                 
@@ -8,240 +8,1661 @@
 //-----------------------------------------------------------------------------
 #include "solvespace.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 #include <Eigen/Core>
-#include <Eigen/SparseQR>
+#include <Eigen/QR>
+#include <Eigen/SVD>
+#ifdef SLVS_HAVE_SPQR
+#include <Eigen/SPQRSupport>
+#endif
 
 // The solver will converge all unknowns to within this tolerance. This must
 // always be much less than LENGTH_EPS, and in practice should be much less.
 const double System::CONVERGE_TOLERANCE = (LENGTH_EPS/(1e2));
+// Components of an orthonormal nullspace basis smaller than this are zero.
+const double System::NULLSPACE_TOLERANCE = 1e-8;
 
 constexpr size_t LikelyPartialCountPerEq = 10;
 
+// Worker threads work on the same sketch as the thread that started them.
+// Adds the time from its construction to its destruction to *ms.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(double *ms) : ms(ms), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() {
+        *ms += std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    double                                *ms;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Tells the system's trace, if it has one, that a phase begins, and that it
+// ends when the scope does; with no trace, this is a test and nothing more.
+// iterations is what to report for the Newton steps, if not the solve's.
+class PhaseTrace {
+public:
+    PhaseTrace(System *sys, System::Phase phase, const int *iterations = nullptr)
+        : sys(sys), phase(phase), iterations(iterations)
+    {
+        if(sys->trace) sys->Trace(phase, /*begin=*/true, Iterations());
+    }
+    ~PhaseTrace() {
+        if(sys->trace) sys->Trace(phase, /*begin=*/false, Iterations());
+    }
+
+private:
+    int Iterations() const { return iterations ? *iterations : sys->stats.iterations; }
+
+    System        *sys;
+    System::Phase  phase;
+    const int     *iterations;
+};
+
+// Adds what the calling thread allocates while it's in scope to stats: the
+// expression nodes, and the temporary arena's bytes and the most it held.
+class AllocationCount {
+public:
+    AllocationCount(System::Stats *stats)
+        : stats(stats), exprs(Expr::allocatedOnThread), start(GetTemporaryUsage())
+    {
+        ResetTemporaryPeak();
+    }
+    ~AllocationCount() {
+        TemporaryUsage end = GetTemporaryUsage();
+        stats->exprsAllocated    += Expr::allocatedOnThread - exprs;
+        stats->temporaryBytes    += end.allocated - start.allocated;
+        stats->temporaryPeakBytes = std::max(stats->temporaryPeakBytes, end.peak);
+    }
+
+private:
+    System::Stats  *stats;
+    size_t          exprs;
+    TemporaryUsage  start;
+};
+
+// With the system's profile set, charges the rows of the Jacobian that
+// Newton's method is working on to the constraints they came from; with it
+// clear, this does nothing.
+class RowProfile {
+public:
+    RowProfile(System *sys) : sys(sys) {
+        if(!sys->profile) return;
+        auto &mat = sys->mat;
+        cost.resize(mat.m, nullptr);
+        partials.resize(mat.m);
+        for(int i = 0; i < mat.m; i++) {
+            hEquation h = mat.eq[i]->h;
+            if(h.isFromConstraint()) cost[i] = &sys->stats.constraints[h.constraint().v];
+        }
+        for(int k = 0; k < mat.A.sym.outerSize(); k++) {
+            for(Eigen::SparseMatrix<Expr *>::InnerIterator it(mat.A.sym, k); it; ++it) {
+                System::ConstraintCost *c = cost[it.row()];
+                if(c == nullptr) continue;
+                c->jacobianNonZeros++;
+                // With automatic differentiation there are no partials to
+                // evaluate, only the residual, which is in every entry.
+                if(sys->jacobianMode == System::JacobianMode::SYMBOLIC) {
+                    partials[it.row()].push_back(it.value());
+                }
+            }
+        }
+    }
+
+    // Once per iteration, with the residuals current.
+    void Iteration() {
+        auto &mat = sys->mat;
+        for(size_t i = 0; i < cost.size(); i++) {
+            System::ConstraintCost *c = cost[i];
+            if(c == nullptr) continue;
+            if(fabs(mat.B.num[i]) > sys->convergeTolerance) c->iterationsAboveTolerance++;
+
+            auto start = std::chrono::steady_clock::now();
+            double v = mat.B.sym[i]->Eval();
+            for(Expr *pd : partials[i]) v += pd->Eval();
+            c->evalMs += std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start).count();
+            sink += v;
+        }
+    }
+
+private:
+    System                                *sys;
+    std::vector<System::ConstraintCost *>  cost;
+    std::vector<std::vector<Expr *>>       partials;
+    // So that the evaluations aren't optimized away
+    volatile double                        sink = 0.0;
+};
+
+void System::Trace(Phase phase, bool begin, int iterations) {
+    TraceEvent ev = {};
+    ev.phase      = phase;
+    ev.begin      = begin;
+    ev.timeNs     = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+    ev.iterations = iterations;
+    ev.exprsAllocated = Expr::allocatedOnThread;
+    ev.temporaryBytes = GetTemporaryUsage().held;
+    if(phase == Phase::SOLVE) {
+        ev.equations        = stats.equations;
+        ev.unknowns         = stats.unknowns;
+        ev.jacobianNonZeros = stats.jacobianNonZeros;
+        ev.residual         = sqrt(stats.residualSq);
+    } else {
+        ev.equations        = (int)mat.eq.size();
+        ev.unknowns         = (int)mat.param.size();
+        ev.jacobianNonZeros = (size_t)mat.A.sym.nonZeros();
+        // The residuals as last evaluated, if they're of these equations
+        if(mat.B.num.size() == (Eigen::Index)mat.eq.size()) {
+            ev.residual = mat.B.num.norm();
+        }
+    }
+    trace(ev, traceUser);
+}
+
+void System::Stats::Add(const Stats &s) {
+    iterations       += s.iterations;
+    residualSq       += s.residualSq;
+    jacobianNonZeros += s.jacobianNonZeros;
+    writeEquationsMs += s.writeEquationsMs;
+    substituteMs     += s.substituteMs;
+    placeMs          += s.placeMs;
+    aloneMs          += s.aloneMs;
+    writeJacobianMs  += s.writeJacobianMs;
+    evalJacobianMs   += s.evalJacobianMs;
+    stepMs           += s.stepMs;
+    rankMs           += s.rankMs;
+    findBadMs        += s.findBadMs;
+
+    exprsAllocated     += s.exprsAllocated;
+    temporaryBytes     += s.temporaryBytes;
+    temporaryPeakBytes += s.temporaryPeakBytes;
+    sourceNodes        += s.sourceNodes;
+    foldedNodes        += s.foldedNodes;
+    partialNodes       += s.partialNodes;
+    jacobianEntries    += s.jacobianEntries;
+    rigidClusters      += s.rigidClusters;
+    copiedBlocks       += s.copiedBlocks;
+    reusedSteps        += s.reusedSteps;
+    if(s.largestBlockEquations > largestBlockEquations) {
+        largestBlockEquations = s.largestBlockEquations;
+        largestBlockUnknowns  = s.largestBlockUnknowns;
+    }
+    if(s.heaviestConstraintExprs > heaviestConstraintExprs) {
+        heaviestConstraint      = s.heaviestConstraint;
+        heaviestConstraintExprs = s.heaviestConstraintExprs;
+    }
+    // Each worker writes the equations it needs for itself, so the same
+    // constraint's can get written on more than one.
+    for(const auto &it : s.constraints) {
+        ConstraintCost &c = constraints[it.first];
+        c.exprNodes                 = std::max(c.exprNodes, it.second.exprNodes);
+        c.jacobianNonZeros         += it.second.jacobianNonZeros;
+        c.evalMs                   += it.second.evalMs;
+        c.iterationsAboveTolerance += it.second.iterationsAboveTolerance;
+    }
+}
+
+static void ShareSketch(Sketch *sketch) {
+#ifdef LIBRARY
+    ThreadSketch = sketch;
+#else
+    (void)sketch;
+#endif
+}
+
+Permutation SolveSpace::OrderColumns(const Eigen::SparseMatrix<double> &A, FillOrdering ordering) {
+    using namespace Eigen;
+    Permutation perm;
+    switch(ordering) {
+        case FillOrdering::COLAMD:
+            // This gives the position that each column goes to (as SparseQR
+            // takes it), where A P puts column P(j) at j.
+            COLAMDOrdering<int>()(A, perm);
+            return perm.inverse();
+
+        case FillOrdering::AMD: {
+            // and this the column for each position (as SimplicialLDLT
+            // takes it), on the symmetric pattern that fills the same way.
+            SparseMatrix<double> AtA = SparseMatrix<double>(A.transpose()) * A;
+            AMDOrdering<int>()(AtA, perm);
+            return perm;
+        }
+
+        case FillOrdering::NATURAL:
+        case FillOrdering::AUTO:
+            break;
+    }
+    perm.setIdentity(A.cols());
+    return perm;
+}
+
+// The number of nonzeros below the diagonal of the Cholesky factor of a
+// matrix with the (symmetric, and stored in full) pattern of S, from its
+// elimination tree, without factoring it.
+static size_t CholeskyNonZeros(const Eigen::SparseMatrix<double> &S) {
+    const int n = (int)S.cols();
+    std::vector<int> parent(n), mark(n);
+    size_t count = 0;
+    for(int k = 0; k < n; k++) {
+        parent[k] = -1;
+        mark[k] = k;
+        // Row k of the factor has an entry in every column on the paths up
+        // the tree from the entries in row k of S.
+        for(Eigen::SparseMatrix<double>::InnerIterator it(S, k); it; ++it) {
+            for(int i = (int)it.row(); i < k && mark[i] != k; i = parent[i]) {
+                if(parent[i] == -1) parent[i] = k;
+                mark[i] = k;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+FillOrdering SolveSpace::PickOrdering(const Eigen::SparseMatrix<Expr *> &A) {
+    using namespace Eigen;
+    // Below this, any ordering costs more to find than it saves.
+    if(A.cols() < 16) return FillOrdering::NATURAL;
+
+    // The step factors A A^T (as R^T R, from a QR of A^T, or as LDL^T), every
+    // Newton iteration, so pick the ordering of A's rows that it fills in the
+    // least under; that's a symbolic factorization for each, which costs
+    // about as much as one numeric one.
+    std::vector<double> ones(A.nonZeros(), 1.0);
+    SparseMatrix<double> pattern = Map<const SparseMatrix<double>>(
+        A.rows(), A.cols(), A.nonZeros(), A.outerIndexPtr(), A.innerIndexPtr(), ones.data());
+    SparseMatrix<double> At = pattern.transpose();
+
+    FillOrdering best = FillOrdering::NATURAL;
+    size_t bestCount = SIZE_MAX;
+    for(FillOrdering ordering : { FillOrdering::NATURAL, FillOrdering::COLAMD,
+                                  FillOrdering::AMD }) {
+        SparseMatrix<double> PA = OrderColumns(At, ordering).transpose() * pattern;
+        SparseMatrix<double> AAt = PA * SparseMatrix<double>(PA.transpose());
+        size_t count = CholeskyNonZeros(AAt);
+        if(count < bestCount) {
+            best = ordering;
+            bestCount = count;
+        }
+    }
+    return best;
+}
+
+#ifdef SLVS_HAVE_SPQR
+struct ReusableSparseQR::Spqr {
+    Eigen::SPQR<Eigen::SparseMatrix<double>> qr;
+    // qr's R, which it gives with its own index type
+    Eigen::SparseMatrix<double>              R;
+};
+#else
+struct ReusableSparseQR::Spqr {};
+#endif
+
+ReusableSparseQR::ReusableSparseQR() {}
+ReusableSparseQR::~ReusableSparseQR() {}
+
+bool ReusableSparseQR::Available(QRBackend backend) {
+#ifdef SLVS_HAVE_SPQR
+    (void)backend;
+    return true;
+#else
+    return backend == QRBackend::EIGEN;
+#endif
+}
+
+void ReusableSparseQR::Factorize(const Eigen::SparseMatrix<double> &A, FillOrdering ordering,
+                                 QRBackend backend) {
+#ifdef SLVS_HAVE_SPQR
+    if(backend == QRBackend::SPQR) {
+        if(!spqr) {
+            spqr.reset(new Spqr);
+            // Fronts are factored in parallel down to about this many tasks
+            // per core, as its manual suggests.
+            unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            spqr->qr.cholmodCommon()->SPQR_grain = 2.0 * cores;
+        }
+        // Its own COLAMD or AMD ordering, which always gives the
+        // permutation; a natural one can leave that out.
+        spqr->qr.setSPQROrdering(ordering == FillOrdering::AMD ? SPQR_ORDERING_AMD
+                                                               : SPQR_ORDERING_COLAMD);
+        spqr->qr.compute(A);
+        if(spqr->qr.info() == Eigen::Success) spqr->R = spqr->qr.matrixR();
+        bySpqr = true;
+        return;
+    }
+#else
+    (void)backend;
+#endif
+    bySpqr = false;
+
+    const int *op = A.outerIndexPtr();
+    const int *ip = A.innerIndexPtr();
+    const size_t nnz = (size_t)A.nonZeros();
+    bool samePattern = analyzed && orderedBy == ordering &&
+        rows == A.rows() && cols == A.cols() &&
+        std::equal(outer.begin(), outer.end(), op) &&
+        nnz == inner.size() && std::equal(inner.begin(), inner.end(), ip);
+
+    if(!samePattern) {
+        perm = OrderColumns(A, ordering);
+        AP = A * perm;
+        AP.makeCompressed();
+        qr.analyzePattern(AP);
+        analyzed = true;
+        orderedBy = ordering;
+        rows = A.rows();
+        cols = A.cols();
+        outer.assign(op, op + A.outerSize() + 1);
+        inner.assign(ip, ip + nnz);
+    } else {
+        AP = A * perm;
+        AP.makeCompressed();
+    }
+    qr.factorize(AP);
+}
+
+Eigen::ComputationInfo ReusableSparseQR::Info() const {
+#ifdef SLVS_HAVE_SPQR
+    if(bySpqr) return spqr->qr.info();
+#endif
+    return qr.info();
+}
+
+Eigen::Index ReusableSparseQR::Rank() const {
+#ifdef SLVS_HAVE_SPQR
+    if(bySpqr) return spqr->qr.rank();
+#endif
+    return qr.rank();
+}
+
+const Eigen::SparseMatrix<double> &ReusableSparseQR::MatrixR() const {
+#ifdef SLVS_HAVE_SPQR
+    if(bySpqr) return spqr->R;
+#endif
+    return qr.matrixR();
+}
+
+Eigen::MatrixXd ReusableSparseQR::ApplyQ(const Eigen::MatrixXd &X) const {
+#ifdef SLVS_HAVE_SPQR
+    if(bySpqr) return spqr->qr.matrixQ() * X;
+#endif
+    return qr.matrixQ() * X;
+}
+
+Permutation ReusableSparseQR::ColsPermutation() const {
+#ifdef SLVS_HAVE_SPQR
+    if(bySpqr) {
+        auto E = spqr->qr.colsPermutation();
+        Permutation P((int)E.size());
+        for(Eigen::Index j = 0; j < E.size(); j++) P.indices()(j) = (int)E.indices()(j);
+        return P;
+    }
+#endif
+    return perm * qr.colsPermutation();
+}
+
+void ReusableSparseQR::Clear() {
+    analyzed = false;
+    outer.clear();
+    inner.clear();
+    spqr.reset();
+    bySpqr = false;
+}
+
+bool ReusableNormalLDLT::Factorize(const Eigen::SparseMatrix<double> &A,
+                                   FillOrdering ordering, double shift) {
+    using namespace Eigen;
+    SparseMatrix<double> At = A.transpose(), I(A.rows(), A.rows());
+    I.setIdentity();
+    // The rows of A are the columns of A^T, and the LDL^T of A A^T fills in
+    // like a factorization of A^T does.
+    const int *op = At.outerIndexPtr();
+    const int *ip = At.innerIndexPtr();
+    const size_t nnz = (size_t)At.nonZeros();
+    bool samePattern = analyzed && orderedBy == ordering && rows == A.rows() &&
+        std::equal(outer.begin(), outer.end(), op) &&
+        nnz == inner.size() && std::equal(inner.begin(), inner.end(), ip);
+    if(!samePattern) {
+        perm = OrderColumns(At, ordering);
+    }
+
+    // The diagonal is always there, shifted or not, so the pattern doesn't
+    // depend on the shift.
+    SparseMatrix<double> PA = perm.transpose() * A;
+    AAt = (PA * SparseMatrix<double>(PA.transpose()) + shift * I).triangularView<Lower>();
+    AAt.makeCompressed();
+
+    if(!samePattern) {
+        ldlt.analyzePattern(AAt);
+        analyzed = true;
+        orderedBy = ordering;
+        rows = A.rows();
+        outer.assign(op, op + At.outerSize() + 1);
+        inner.assign(ip, ip + nnz);
+    }
+    ldlt.factorize(AAt);
+    if(ldlt.info() != Success) return false;
+
+    // The pivots are the squares of those that a QR would find, so one that
+    // small compared to the biggest means the rank is in doubt; leave those
+    // to the QR.
+    const VectorXd &d = ldlt.vectorD();
+    double big = d.cwiseAbs().maxCoeff();
+    // (and a NaN from a singular partial fails this too)
+    return (d.array() > 1e-12 * big).all();
+}
+
+Eigen::VectorXd ReusableNormalLDLT::Solve(const Eigen::VectorXd &B) const {
+    // With the rows of A ordered by P^T, this factored P^T A A^T P.
+    return perm * ldlt.solve(perm.transpose() * B);
+}
+
+void ReusableNormalLDLT::Clear() {
+    analyzed = false;
+    outer.clear();
+    inner.clear();
+}
+
+// Reverse Cuthill-McKee: number the n unknowns breadth first out from one end
+// of the graph that the equations (each a list of the unknowns it uses) make
+// of them, least connected first, and reverse that, so the unknowns that share
+// equations get columns near each other. It goes by the structure alone, with
+// ties broken by the order the unknowns came in, so the same sketch always
+// gets the same order. Returns the unknowns in their new order.
+static std::vector<int> OrderByBandwidth(int n, const std::vector<std::vector<int>> &eqs) {
+    std::vector<std::vector<int>> eqsOf(n);
+    std::vector<int> degree(n, 0);
+    for(size_t i = 0; i < eqs.size(); i++) {
+        for(int j : eqs[i]) {
+            eqsOf[j].push_back((int)i);
+            degree[j] += (int)eqs[i].size() - 1;
+        }
+    }
+
+    std::vector<int> order, level(n, -1);
+    std::vector<int> next;
+    // Breadth first from start, over the unknowns not yet ordered; returns
+    // where in order this search began.
+    auto search = [&](int start) {
+        size_t begin = order.size();
+        level[start] = 0;
+        order.push_back(start);
+        for(size_t k = begin; k < order.size(); k++) {
+            int j = order[k];
+            next.clear();
+            for(int i : eqsOf[j]) {
+                for(int o : eqs[i]) {
+                    if(level[o] >= 0) continue;
+                    level[o] = level[j] + 1;
+                    next.push_back(o);
+                }
+            }
+            std::stable_sort(next.begin(), next.end(), [&](int a, int b) {
+                return degree[a] < degree[b];
+            });
+            order.insert(order.end(), next.begin(), next.end());
+        }
+        return begin;
+    };
+
+    for(int j = 0; j < n; j++) {
+        if(level[j] >= 0) continue;
+        // Start from a pseudo-peripheral unknown: search from this one, then
+        // again from the least connected of those that the first search
+        // found furthest away.
+        int start = j;
+        size_t begin = search(start);
+        for(size_t k = begin; k < order.size(); k++) {
+            int o = order[k];
+            if(level[o] > level[start] ||
+               (level[o] == level[start] && degree[o] < degree[start])) {
+                start = o;
+            }
+        }
+        for(size_t k = begin; k < order.size(); k++) level[order[k]] = -1;
+        order.resize(begin);
+        search(start);
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+// The equations and unknowns come in the order of their handles, which has
+// nothing to do with which of them meet; so when there are too many to factor
+// dense, put the unknowns in bandwidth order, and the equations in the order
+// of the first of their unknowns in that. Then neighbouring rows and columns
+// of the Jacobian, and the tape that evaluates them, stay close in memory,
+// and the factorizations start from less fill.
+void System::OrderForLocality(std::vector<Equation *> *eqs, std::vector<Param *> *params) {
+    if(params->size() <= (size_t)SMALL_BLOCK) return;
+
+    std::unordered_map<Param *, int> index;
+    for(size_t j = 0; j < params->size(); j++) index[(*params)[j]] = (int)j;
+    std::vector<std::vector<int>> uses;
+    ParamSet paramsUsed;
+    for(Equation *e : *eqs) {
+        paramsUsed.clear();
+        e->e->ParamsUsedList(&paramsUsed);
+        uses.emplace_back();
+        for(hParam hp : paramsUsed) {
+            Param *p = param.FindByIdNoOops(hp);
+            auto it = (p != NULL) ? index.find(p) : index.end();
+            if(it != index.end()) uses.back().push_back(it->second);
+        }
+    }
+    std::vector<int> order = OrderByBandwidth((int)params->size(), uses);
+
+    std::vector<int> position(order.size());
+    std::vector<Param *> ps;
+    for(size_t k = 0; k < order.size(); k++) {
+        position[order[k]] = (int)k;
+        ps.push_back((*params)[order[k]]);
+    }
+    *params = ps;
+
+    std::vector<int> firstOf;
+    for(const std::vector<int> &u : uses) {
+        int first = (int)order.size();
+        for(int j : u) first = std::min(first, position[j]);
+        firstOf.push_back(first);
+    }
+    std::vector<int> rows(eqs->size());
+    for(size_t i = 0; i < rows.size(); i++) rows[i] = (int)i;
+    std::stable_sort(rows.begin(), rows.end(), [&](int a, int b) {
+        return firstOf[a] < firstOf[b];
+    });
+    std::vector<Equation *> es;
+    for(int i : rows) es.push_back((*eqs)[i]);
+    *eqs = es;
+}
+
 bool System::WriteJacobian(int tag) {
-    // Clear all
     mat.param.clear();
     mat.eq.clear();
-    mat.A.sym.setZero();
-    mat.B.sym.clear();
 
     for(Equation &e : eq) {
         if(e.tag != tag) continue;
         mat.eq.push_back(&e);
     }
-    if(mat.eq.size() >= MAX_UNKNOWNS) {
+    if(TooManyUnknowns(mat.eq.size())) {
+        // Leave an empty (but consistent) Jacobian behind.
+        mat.eq.clear();
+        WriteJacobian();
         return false;
     }
-    mat.m = mat.eq.size();
 
-    std::unordered_map<uint32_t, int> paramToIndex;
+    std::vector<Param *> params;
     for(Param &p : param) {
         if(p.tag != tag) continue;
-        // Fill the param id to index map
-        paramToIndex[p.h.v] = mat.param.size();
-        mat.param.push_back(p.h);
+        params.push_back(&p);
+    }
+    OrderForLocality(&mat.eq, &params);
+    for(Param *p : params) mat.param.push_back(p->h);
+
+    WriteJacobian();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// The closed-form kernels: each one writes the residual of its equation, and
+// the partial with respect to the parameter in each of its slots, straight
+// from the formula, with the dimensions known at compile time. WriteKernel
+// returns the residual, having written the partials, or NULL if the equation
+// has to be differentiated after all.
+//-----------------------------------------------------------------------------
+namespace {
+struct KernelTerms {
+    Expr *f;
+    int   n;
+    Expr *d[7];
+};
+
+void DifferenceKernel(ExprFactory *x, Expr *const *p, KernelTerms *k) {
+    k->f    = x->Op(Expr::Op::MINUS, p[0], p[1]);
+    k->d[0] = x->Constant(1);
+    k->d[1] = x->Constant(-1);
+    k->n    = 2;
+}
+
+void LerpKernel(ExprFactory *x, Expr *const *p, KernelTerms *k) {
+    typedef Expr::Op O;
+    Expr *ab = x->Op(O::MINUS, p[1], p[0]);
+    k->f    = x->Op(O::MINUS, x->Op(O::PLUS, p[0], x->Op(O::TIMES, ab, p[2])), p[3]);
+    k->d[0] = x->Op(O::MINUS, x->Constant(1), p[2]);
+    k->d[1] = p[2];
+    k->d[2] = ab;
+    k->d[3] = x->Constant(-1);
+    k->n    = 4;
+}
+
+template<int D>
+void DistanceKernel(ExprFactory *x, Expr *const *p, KernelTerms *k) {
+    typedef Expr::Op O;
+    Expr *diff[D], *sum = NULL;
+    for(int c = 0; c < D; c++) {
+        diff[c] = x->Op(O::MINUS, p[c], p[D + c]);
+        Expr *sq = x->Op(O::SQUARE, diff[c]);
+        sum = (c == 0) ? sq : x->Op(O::PLUS, sum, sq);
     }
+    Expr *r = x->Op(O::SQRT, sum);
+    k->f = x->Op(O::MINUS, r, p[2*D]);
+    // Written as (1/2r)*(2*diff), not diff/r, so that the partials round
+    // exactly the same as the differentiated expression would.
+    Expr *h = x->Op(O::DIV, x->Constant(0.5), r);
+    for(int c = 0; c < D; c++) {
+        k->d[c]     = x->Op(O::TIMES, h, x->Op(O::TIMES, x->Constant(2), diff[c]));
+        k->d[D + c] = x->Op(O::NEGATE, k->d[c]);
+    }
+    k->d[2*D] = x->Constant(-1);
+    k->n      = 2*D + 1;
+}
+}
+
+Expr *System::WriteKernel(ExprFactory *exprs, const EquationKernel &kernel, int row,
+                          const std::unordered_map<uint32_t, int> &paramToIndex) {
+    // The parameters in the slots, as the copied expression would have them.
+    Expr *p[7];
+    for(int s = 0; s < 7; s++) {
+        hParam hp = kernel.param[s];
+        if(!hp.v) {
+            p[s] = exprs->Constant(kernel.value);
+            continue;
+        }
+        Param *pp = param.FindByIdNoOops(hp);
+        if(!pp) pp = SK.param.FindById(hp);
+        p[s] = pp->known ? exprs->Constant(pp->val) : exprs->ParamPtr(pp);
+    }
+
+    KernelTerms k;
+    switch(kernel.type) {
+        case EquationKernel::Type::DIFFERENCE:  DifferenceKernel(exprs, p, &k);   break;
+        case EquationKernel::Type::LERP:        LerpKernel(exprs, p, &k);         break;
+        case EquationKernel::Type::DISTANCE_2D: DistanceKernel<2>(exprs, p, &k);  break;
+        case EquationKernel::Type::DISTANCE_3D: DistanceKernel<3>(exprs, p, &k);  break;
+        default: ssassert(false, "Unexpected equation kernel");
+    }
+
+    int col[7];
+    int cols = 0;
+    for(int s = 0; s < k.n; s++) {
+        if(p[s]->op != Expr::Op::PARAM_PTR) continue;
+        auto it = paramToIndex.find(p[s]->parp->h.v);
+        if(it == paramToIndex.end()) continue;
+        // One parameter in two slots (after substitution, say) is left to
+        // the general path, which finds that the terms cancel.
+        if(std::find(col, col + cols, it->second) != col + cols) return NULL;
+        col[cols++] = it->second;
+    }
+
+    cols = 0;
+    for(int s = 0; s < k.n; s++) {
+        if(p[s]->op != Expr::Op::PARAM_PTR) continue;
+        if(paramToIndex.find(p[s]->parp->h.v) == paramToIndex.end()) continue;
+        if(!k.d[s]->IsZeroConst()) mat.A.sym.insert(row, col[cols]) = k.d[s];
+        cols++;
+    }
+    return k.f;
+}
+
+// Linearize the equations in mat.eq with respect to the unknowns in
+// mat.param, which the caller has already listed.
+void System::WriteJacobian() {
+    PhaseTimer timer(&stats.writeJacobianMs);
+    PhaseTrace span(this, Phase::WRITE_JACOBIAN);
+    // Clear all
+    mat.A.sym.setZero();
+    mat.B.sym.clear();
+    mat.tape.Clear();
+
+    mat.m = mat.eq.size();
     mat.n = mat.param.size();
 
+    std::unordered_map<uint32_t, int> paramToIndex;
+    for(size_t j = 0; j < mat.param.size(); j++) {
+        // Fill the param id to index map
+        paramToIndex[mat.param[j].v] = (int)j;
+    }
+
     // In some experimenting, this is almost always the right size.
     // Value is usually between 0 and 20, comes from number of constraints?
     mat.A.sym.resize(mat.m, mat.n);
-    mat.A.sym.reserve(Eigen::VectorXi::Constant(mat.n, LikelyPartialCountPerEq));
+    // A block of equations with no unknowns left has no columns to reserve,
+    // and Eigen can't compress a matrix that was reserved with none.
+    if(mat.n > 0) {
+        mat.A.sym.reserve(Eigen::VectorXi::Constant(mat.n, LikelyPartialCountPerEq));
+    }
 
+    // The equations share much of their structure, so build the copies and
+    // their partials out of shared nodes.
+    ExprFactory exprs;
+    size_t partialNodes = 0;
     mat.B.sym.reserve(mat.eq.size());
     for(size_t i = 0; i < mat.eq.size(); i++) {
+        // Past the memory budget, the rest of the rows are left empty, with
+        // zero residuals, and the solve stops at its next check.
+        if(Exhausted()) {
+            mat.B.sym.push_back(exprs.Constant(0));
+            continue;
+        }
         Equation *e = mat.eq[i];
-        // Deep-copy and simplify (fold) the current equation.
-        Expr *f = e->e->DeepCopyWithParamsAsPointers(&param, &(SK.param), /*foldConstants=*/true);
+        if(e->kernel.type != EquationKernel::Type::NONE &&
+           jacobianMode == JacobianMode::SYMBOLIC)
+        {
+            Expr *f = WriteKernel(&exprs, e->kernel, (int)i, paramToIndex);
+            if(f != NULL) {
+                mat.B.sym.push_back(f);
+                continue;
+            }
+        }
 
-        ParamSet paramsUsed;
-        f->ParamsUsedList(&paramsUsed);
+        // Deep-copy and simplify (fold) the current equation.
+        Expr *f = exprs.CopyWithParamsAsPointers(e->e, &param, &(SK.param));
 
-        for(hParam p : paramsUsed) {
+        for(hParam p : exprs.ParamsUsed(f)) {
+            if(Exhausted()) break;
             // Find the index of this parameter
             auto it = paramToIndex.find(p.v);
             if(it == paramToIndex.end()) continue;
             // this is the parameter index
             const int j = it->second;
+            if(jacobianMode == JacobianMode::AUTODIFF) {
+                // Only the pattern is needed; the values come from the tape.
+                mat.A.sym.insert(i, j) = f;
+                continue;
+            }
             // compute partial derivative of f
-            Expr *pd = f->PartialWrt(p);
-            pd = pd->FoldConstants(/*allocCopy=*/false);
+            size_t built = exprs.BuiltNodes();
+            Expr *pd = exprs.PartialWrt(f, p);
+            partialNodes += exprs.BuiltNodes() - built;
             if(pd->IsZeroConst())
                 continue;
             mat.A.sym.insert(i, j) = pd;
         }
         mat.B.sym.push_back(f);
     }
-    return true;
+    mat.A.sym.makeCompressed();
+    stats.sourceNodes  += exprs.CopiedNodes();
+    stats.foldedNodes  += exprs.BuiltNodes() - partialNodes;
+    stats.partialNodes += partialNodes;
+    mat.stepRankInDoubt = false;
+    mat.stepByLDLT      = false;
+    mat.ordering = (fillOrdering == FillOrdering::AUTO) ? PickOrdering(mat.A.sym)
+                                                        : fillOrdering;
+
+    // The numeric Jacobian gets exactly the pattern of the symbolic one, once;
+    // after that only its values are written, so its structure (and thus the
+    // analysis of its factorizations) stays fixed, even when some partials
+    // happen to evaluate to zero.
+    const Eigen::Index nnz = mat.A.sym.nonZeros();
+    mat.A.num.resize(mat.m, mat.n);
+    mat.A.num.resizeNonZeros(nnz);
+    std::copy(mat.A.sym.outerIndexPtr(), mat.A.sym.outerIndexPtr() + mat.n + 1,
+              mat.A.num.outerIndexPtr());
+    std::copy(mat.A.sym.innerIndexPtr(), mat.A.sym.innerIndexPtr() + nnz,
+              mat.A.num.innerIndexPtr());
+
+    // Lower the residuals and then the partials to a single tape, so that
+    // the partials reuse whatever they have in common with the residuals.
+    mat.B.reg.clear();
+    for(Expr *f : mat.B.sym) {
+        mat.B.reg.push_back(mat.tape.Compile(f));
+    }
+    mat.residualEnd = mat.tape.Size();
+
+    mat.A.reg.clear();
+    if(jacobianMode == JacobianMode::AUTODIFF) {
+        WriteAdjoints();
+    } else {
+        for(int k = 0; k < mat.A.sym.outerSize(); k++) {
+            for(Eigen::SparseMatrix<Expr *>::InnerIterator it(mat.A.sym, k); it; ++it) {
+                mat.A.reg.push_back(mat.tape.Compile(it.value()));
+            }
+        }
+    }
+    ScheduleEval();
 }
 
-void System::EvalJacobian() {
-    using namespace Eigen;
-    mat.A.num.setZero();
-    mat.A.num.resize(mat.m, mat.n);
-    const int size = mat.A.sym.outerSize();
+// Decide whether the tape is worth evaluating on the workers, and if so,
+// level it. A tape that's mostly one long chain has levels too small to
+// share out, and waiting for every thread after each would cost more than
+// it saves.
+void System::ScheduleEval() {
+    mat.evalThreads = 1;
+    mat.residualLevels = {};
+    mat.partialLevels  = {};
+    if(workers <= 1 || mat.tape.Size() < PARALLEL_EVAL) return;
+
+    mat.tape.Schedule(0, mat.residualEnd, &mat.residualLevels);
+    mat.tape.Schedule(mat.residualEnd, mat.tape.Size(), &mat.partialLevels);
+    size_t levels = mat.residualLevels.start.size() + mat.partialLevels.start.size() - 2;
+    if(mat.tape.Size() < PARALLEL_EVAL_LEVEL * levels) {
+        mat.residualLevels = {};
+        mat.partialLevels  = {};
+        return;
+    }
+    mat.evalThreads = workers;
+    if(jacobianMode == JacobianMode::AUTODIFF) {
+        mat.ad.adjoint.assign(mat.tape.reg.size() * workers, 0.0);
+    }
+}
+
+namespace {
+// The calling thread and threads - 1 more, which all run the same work on
+// one tape, in phases that they all finish before any starts the next.
+class EvalTeam {
+public:
+    explicit EvalTeam(int threads) : threads(threads), arrived(0), generation(0) {}
+
+    template<class F> void Run(F work) {
+        Sketch *sketch = &SK;
+        std::vector<std::thread> pool;
+        for(int t = 1; t < threads; t++) {
+            pool.emplace_back([&work, sketch, t] {
+                ShareSketch(sketch);
+                work(t);
+            });
+        }
+        work(0);
+        for(std::thread &th : pool) {
+            th.join();
+        }
+    }
+
+    // Thread t's share [*begin, *end) of count things.
+    void Share(int t, size_t count, size_t *begin, size_t *end) const {
+        *begin = count * t / threads;
+        *end   = count * (t + 1) / threads;
+    }
+
+    // Thread t's part of the instructions in levels, a level at a time.
+    void Eval(int t, ExprTape *tape, const ExprTape::Levels &levels) {
+        for(size_t k = 0; k + 1 < levels.start.size(); k++) {
+            size_t begin, end;
+            Share(t, levels.start[k + 1] - levels.start[k], &begin, &end);
+            tape->EvalEach(&levels.instr[levels.start[k] + begin], end - begin);
+            Wait();
+        }
+    }
+
+private:
+    void Wait() {
+        int g = generation.load();
+        if(++arrived == threads) {
+            arrived = 0;
+            generation++;
+            return;
+        }
+        while(generation.load() == g) {
+            std::this_thread::yield();
+        }
+    }
+
+    const int        threads;
+    std::atomic<int> arrived, generation;
+};
+}
+
+// With only the residuals on the tape, list what each row's reverse sweep
+// needs: the instructions its residual depends on, in tape order, and its
+// entries in A, with the register of each one's parameter.
+void System::WriteAdjoints() {
+    const std::vector<ExprTape::Instr> &code = mat.tape.code;
+    std::vector<int> writer(mat.tape.reg.size(), -1);
+    std::unordered_map<const Param *, int> regOf;
+    for(size_t k = 0; k < code.size(); k++) {
+        writer[code[k].dst] = (int)k;
+        if(code[k].op == Expr::Op::PARAM_PTR) regOf[mat.tape.ParamOf(code[k])] = code[k].dst;
+    }
+
+    mat.ad.instr.clear();
+    mat.ad.instrStart.assign(1, 0);
+    std::vector<int> seen(code.size(), -1);
+    std::vector<int> stack;
+    for(int i = 0; i < mat.m; i++) {
+        const size_t first = mat.ad.instr.size();
+        stack.push_back(mat.B.reg[i]);
+        while(!stack.empty()) {
+            int r = stack.back();
+            stack.pop_back();
+            int k = writer[r];
+            if(k < 0 || seen[k] == i) continue;
+            seen[k] = i;
+            mat.ad.instr.push_back(k);
+            if(code[k].a >= 0) stack.push_back(code[k].a);
+            if(code[k].b >= 0) stack.push_back(code[k].b);
+        }
+        std::sort(mat.ad.instr.begin() + first, mat.ad.instr.end());
+        mat.ad.instrStart.push_back((int)mat.ad.instr.size());
+    }
 
-    for(int k = 0; k < size; k++) {
-        for(SparseMatrix <Expr *>::InnerIterator it(mat.A.sym, k); it; ++it) {
-            double value = it.value()->Eval();
-            if(EXACT(value == 0.0)) continue;
-            mat.A.num.insert(it.row(), it.col()) = value;
+    // The entries are in storage order (by column), so bucket them by row.
+    std::vector<int> colReg(mat.n, -1);
+    for(int j = 0; j < mat.n; j++) {
+        auto it = regOf.find(param.FindById(mat.param[j]));
+        if(it != regOf.end()) colReg[j] = it->second;
+    }
+    mat.ad.entryStart.assign(mat.m + 1, 0);
+    for(int k = 0; k < mat.A.sym.outerSize(); k++) {
+        for(Eigen::SparseMatrix<Expr *>::InnerIterator it(mat.A.sym, k); it; ++it) {
+            mat.ad.entryStart[it.row() + 1]++;
         }
     }
-    mat.A.num.makeCompressed();
+    for(int i = 0; i < mat.m; i++) {
+        mat.ad.entryStart[i + 1] += mat.ad.entryStart[i];
+    }
+    const size_t nnz = (size_t)mat.ad.entryStart[mat.m];
+    mat.ad.entry.resize(nnz);
+    mat.ad.entryReg.resize(nnz);
+    std::vector<int> fill(mat.ad.entryStart.begin(), mat.ad.entryStart.end() - 1);
+    int index = 0;
+    for(int k = 0; k < mat.A.sym.outerSize(); k++) {
+        for(Eigen::SparseMatrix<Expr *>::InnerIterator it(mat.A.sym, k); it; ++it) {
+            int e = fill[it.row()]++;
+            mat.ad.entry[e]    = index++;
+            mat.ad.entryReg[e] = colReg[k];
+        }
+    }
+    mat.ad.adjoint.assign(mat.tape.reg.size(), 0.0);
+}
+
+void System::EvalJacobian(bool residualsCurrent) {
+    PhaseTimer timer(&stats.evalJacobianMs);
+    if(mat.evalThreads > 1) {
+        // Each thread writes only its own rows' entries, or its own share of
+        // the entries, in to the values of A.
+        EvalTeam team(mat.evalThreads);
+        team.Run([&](int t) {
+            if(!residualsCurrent) team.Eval(t, &mat.tape, mat.residualLevels);
+            double *value = mat.A.num.valuePtr();
+            size_t begin, end;
+            if(jacobianMode == JacobianMode::AUTODIFF) {
+                double *adjoint = mat.ad.adjoint.data() + (size_t)t * mat.tape.reg.size();
+                team.Share(t, mat.m, &begin, &end);
+                for(size_t i = begin; i < end; i++) {
+                    const int first = mat.ad.instrStart[i];
+                    mat.tape.Adjoints(&mat.ad.instr[first], mat.ad.instrStart[i + 1] - first,
+                                      mat.B.reg[i], adjoint);
+                    for(int e = mat.ad.entryStart[i]; e < mat.ad.entryStart[i + 1]; e++) {
+                        int r = mat.ad.entryReg[e];
+                        value[mat.ad.entry[e]] = (r >= 0) ? adjoint[r] : 0.0;
+                    }
+                }
+                return;
+            }
+            team.Eval(t, &mat.tape, mat.partialLevels);
+            team.Share(t, mat.A.reg.size(), &begin, &end);
+            for(size_t i = begin; i < end; i++) {
+                value[i] = mat.tape.Value(mat.A.reg[i]);
+            }
+        });
+        return;
+    }
+
+    if(jacobianMode == JacobianMode::AUTODIFF) {
+        // Every partial in a row comes from one reverse sweep from its
+        // residual, at the values that the forward pass left behind.
+        if(!residualsCurrent) mat.tape.Eval(0, mat.residualEnd);
+        double *value   = mat.A.num.valuePtr();
+        double *adjoint = mat.ad.adjoint.data();
+        for(int i = 0; i < mat.m; i++) {
+            const int first = mat.ad.instrStart[i];
+            mat.tape.Adjoints(&mat.ad.instr[first], mat.ad.instrStart[i + 1] - first,
+                              mat.B.reg[i], adjoint);
+            for(int e = mat.ad.entryStart[i]; e < mat.ad.entryStart[i + 1]; e++) {
+                int r = mat.ad.entryReg[e];
+                value[mat.ad.entry[e]] = (r >= 0) ? adjoint[r] : 0.0;
+            }
+        }
+        return;
+    }
+
+    // If the residuals were just evaluated at this operating point, then
+    // only the instructions for the partials need to run.
+    mat.tape.Eval(residualsCurrent ? mat.residualEnd : 0, mat.tape.Size());
+
+    // The registers are in the same (storage) order as the entries.
+    double *value = mat.A.num.valuePtr();
+    const size_t size = mat.A.reg.size();
+    for(size_t i = 0; i < size; i++) {
+        value[i] = mat.tape.Value(mat.A.reg[i]);
+    }
+}
+
+void System::EvalResiduals() {
+    mat.B.num.resize(mat.m);
+    if(mat.evalThreads > 1) {
+        EvalTeam team(mat.evalThreads);
+        team.Run([&](int t) {
+            team.Eval(t, &mat.tape, mat.residualLevels);
+            size_t begin, end;
+            team.Share(t, mat.m, &begin, &end);
+            for(size_t i = begin; i < end; i++) {
+                mat.B.num[i] = mat.tape.Value(mat.B.reg[i]);
+            }
+        });
+        return;
+    }
+    mat.tape.Eval(0, mat.residualEnd);
+    for(int i = 0; i < mat.m; i++) {
+        mat.B.num[i] = mat.tape.Value(mat.B.reg[i]);
+    }
 }
 
 bool System::IsDragged(hParam p) {
     return dragged.find(p) != dragged.end();
 }
 
+// If e is ka*a + kb*b + c for two solver params a and b and constants ka, kb
+// and c, then return those; the coefficients of a param that appears more
+// than once are summed, so a or b may have a zero coefficient, or be missing.
+static bool AffineInTwoParams(const Expr *e, double scale, ParamList *pl,
+                              hParam *p, double *k, double *c) {
+    switch(e->op) {
+        case Expr::Op::CONSTANT:
+            *c += scale * e->v;
+            return true;
+
+        case Expr::Op::PARAM:
+            if(!pl->FindByIdNoOops(e->parh)) return false;
+            for(int i = 0; i < 2; i++) {
+                if(p[i] == e->parh) {
+                    k[i] += scale;
+                    return true;
+                }
+                if(!p[i].v) {
+                    p[i] = e->parh;
+                    k[i] = scale;
+                    return true;
+                }
+            }
+            return false;
+
+        case Expr::Op::PLUS:
+            return AffineInTwoParams(e->a, scale, pl, p, k, c) &&
+                   AffineInTwoParams(e->b, scale, pl, p, k, c);
+
+        case Expr::Op::MINUS:
+            return AffineInTwoParams(e->a, scale, pl, p, k, c) &&
+                   AffineInTwoParams(e->b, -scale, pl, p, k, c);
+
+        case Expr::Op::NEGATE:
+            return AffineInTwoParams(e->a, -scale, pl, p, k, c);
+
+        case Expr::Op::TIMES:
+            if(e->a->op == Expr::Op::CONSTANT) {
+                return AffineInTwoParams(e->b, scale * e->a->v, pl, p, k, c);
+            }
+            if(e->b->op == Expr::Op::CONSTANT) {
+                return AffineInTwoParams(e->a, scale * e->b->v, pl, p, k, c);
+            }
+            return false;
+
+        case Expr::Op::DIV:
+            if(e->b->op == Expr::Op::CONSTANT && e->b->v != 0.0) {
+                return AffineInTwoParams(e->a, scale / e->b->v, pl, p, k, c);
+            }
+            return false;
+
+        default:
+            return false;
+    }
+}
+
 SubstitutionMap System::SolveBySubstitution() {
-    // Contains pointers to last substitutions in a substitution chain
-    std::vector<Param *> subVec;
-    // Maps a parameter to the index of its last substitution in  `subVec`
-    std::unordered_map<hParam, size_t, HandleHasher<hParam>> leaves;
-    // Tracks how many slots in `subVec` contain a specific last substitution
-    // (this can happen as slots that once contained a specific substitution
-    //  are updated to point to another over the run of the substitution algorithm)
-    std::unordered_map<hParam, std::vector<size_t>, HandleHasher<hParam>> slotTrack;
+    PhaseTimer timer(&stats.substituteMs);
+    // A union-find over the params, by where they sit in storage: each one
+    // is k*parent + c, and those that are their own parents are the ones
+    // that stay unknowns. Coincident points make tens of thousands of these,
+    // so they're kept flat rather than in a hash map.
+    struct Link {
+        int    parent;
+        int    rank;
+        double k, c;
+    };
+    std::vector<Link> link(param.StoreSize());
+    for(int i = 0; i < (int)link.size(); i++) link[i] = { i, 0, 1.0, 0.0 };
+
+    // Find the unknown that i rests on, and point everything along the way
+    // straight at it, as a function of it.
+    std::vector<int> chain;
+    auto find = [&](int i) {
+        chain.clear();
+        for(; link[i].parent != i; i = link[i].parent) chain.push_back(i);
+        double k = 1.0, c = 0.0;
+        for(size_t j = chain.size(); j-- > 0; ) {
+            Link &l = link[chain[j]];
+            c = l.k * c + l.c;
+            k = l.k * k;
+            l = { i, l.rank, k, c };
+        }
+        return i;
+    };
 
     for(auto &teq : eq) {
-        Expr *tex = teq.e;
+        // If we have `ka*a + kb*b + c = 0` where both a and b are parameters,
+        // then `a = k*b + c` and we can substitute
+        hParam hp[2] = {};
+        double hk[2] = { 0.0, 0.0 }, hc = 0.0;
+        if(!AffineInTwoParams(teq.e, 1.0, &param, hp, hk, &hc)) continue;
+
+        if(hk[0] == 0.0 && hk[1] == 0.0 && hc == 0.0) {
+            // Something like `a - a`, which always holds.
+            teq.tag = EQ_SUBSTITUTED;
+            continue;
+        }
+        // Anything in one param is solved on its own, if at all.
+        if(hk[0] == 0.0 || hk[1] == 0.0) continue;
+
+        double rk = -hk[1] / hk[0], rc = -hc / hk[0];
+        if(!std::isfinite(rk) || !std::isfinite(rc) || rk == 0.0) continue;
+
+        // Resolve both to the unknowns they rest on, and write the relation
+        // between those instead
+        int a = param.StoreIndex(hp[0]), b = param.StoreIndex(hp[1]);
+        int sub = find(a), by = find(b);
+        const Link &la = link[a], &lb = link[b];
+        double k = rk * lb.k / la.k,
+               c = (rk * lb.c + rc - la.c) / la.k;
+
+        // If both already rest on the same unknown then this is redundant,
+        // or inconsistent, or fixes it; leave it to the rank test and Newton.
+        if(sub == by) continue;
+
+        // A dragged param stays an unknown if it can; otherwise the shorter
+        // tree goes under the taller one.
+        bool subDragged = IsDragged(param.AtStore(sub).h),
+             byDragged  = IsDragged(param.AtStore(by).h);
+        if(subDragged != byDragged ? subDragged : link[sub].rank > link[by].rank) {
+            std::swap(sub, by);
+            c = -c / k;
+            k = 1.0 / k;
+        }
+        if(link[sub].rank == link[by].rank) link[by].rank++;
+        link[sub] = { by, link[sub].rank, k, c };
 
-        // If we have `(a - b) = 0` where both a and b are parameters, then `a = b` and we can substitute
-        if(tex->op    == Expr::Op::MINUS &&
-           tex->a->op == Expr::Op::PARAM &&
-           tex->b->op == Expr::Op::PARAM)
-        {
-            Param *sub = param.FindByIdNoOops(tex->a->parh);
-            Param *by = param.FindByIdNoOops(tex->b->parh);
-            if(!sub || !by) {
-                // Don't substitute unless they're both solver params;
-                // otherwise it's an equation that can be solved immediately,
-                // or an error to flag later.
-                continue;
+        param.AtStore(sub).tag = VAR_SUBSTITUTED;
+        teq.tag = EQ_SUBSTITUTED;
+    }
+
+    // Point every substitution straight at an unknown
+    std::vector<Substitution> byStore(link.size(), { NULL, 1.0, 0.0 });
+    size_t substituted = 0;
+    for(int i = 0; i < (int)link.size(); i++) {
+        if(link[i].parent == i) continue;
+        int root = find(i);
+        byStore[i] = { &param.AtStore(root), link[i].k, link[i].c };
+        substituted++;
+    }
+
+    // Substitute all the equations
+    for(auto &req : eq) {
+        req.e->Substitute(&param, byStore);
+        if(req.kernel.type == EquationKernel::Type::NONE) continue;
+        for(hParam &p : req.kernel.param) {
+            int i = param.StoreIndex(p);
+            if(i < 0 || byStore[i].by == NULL) continue;
+            if(!byStore[i].IsIdentity()) {
+                // The closed forms don't carry the offsets
+                req.kernel.type = EquationKernel::Type::NONE;
+                break;
             }
+            p = byStore[i].by->h;
+        }
+    }
 
-            if(sub->h == by->h) {
-                teq.tag = EQ_SUBSTITUTED;
-                continue;
+    SubstitutionMap subs;
+    subs.reserve(substituted);
+    for(int i = 0; i < (int)link.size(); i++) {
+        if(byStore[i].by) subs.emplace(param.AtStore(i).h, byStore[i]);
+    }
+    return subs;
+}
+
+// An equation that's affine in a single unknown, as fixing a point where it
+// is writes for each coordinate, pins that unknown: so put it there, and make
+// it a constant that the equations left fold in when they're copied for the
+// Jacobian, rather than solving for it with Newton's method. The pinned
+// params are listed, to be made unknowns again once the solve is done with
+// them.
+void System::FoldPinnedParams(std::vector<Param *> *pinned) {
+    for(auto &e : eq) {
+        if(e.tag != 0) continue;
+
+        hParam hp[2] = {};
+        double hk[2] = { 0.0, 0.0 }, hc = 0.0;
+        if(!AffineInTwoParams(e.e, 1.0, &param, hp, hk, &hc)) continue;
+        // (a param that cancels out counts as not being there)
+        int i = (hk[0] != 0.0) ? 0 : 1;
+        if(hk[i] == 0.0 || hk[1 - i] != 0.0) continue;
+        // (plus zero, so that pinning at zero doesn't leave it at -0)
+        double v = -hc / hk[i] + 0.0;
+        if(!std::isfinite(v)) continue;
+
+        Param *p = param.FindById(hp[i]);
+        if(p->tag != 0 || p->known) continue; // let rank test catch inconsistency
+        p->val   = v;
+        p->known = true;
+        p->tag   = VAR_PINNED;
+        e.tag    = EQ_PINNED;
+        pinned->push_back(p);
+    }
+}
+
+double System::NormalChart::Value() const {
+    double r = 1.0;
+    for(Param *p : other) r -= p->val * p->val;
+    return sign * sqrt(std::max(r, 0.0));
+}
+
+// A normal in 3d is four params, and an equation that keeps it of unit
+// length; so one of them is a function of the other three, and can be
+// written as that everywhere, which leaves one unknown and one equation
+// fewer. That's the one that's largest now, which is at least a half, so
+// the others can move it a long way before the square root gets steep; and
+// it's chosen again on every solve.
+void System::ChartNormals(std::vector<NormalChart> *charts) {
+    std::vector<Expr *> by;
+    for(auto &e : eq) {
+        if(e.tag != 0 || (e.h.v & 0xc0000000) != 0x40000000) continue;
+        hEntity he = { e.h.v & ~0x40000000u };
+        EntityBase *n = SK.entity.FindByIdNoOops(he);
+        if(n == NULL || n->type != EntityBase::Type::NORMAL_IN_3D ||
+           e.h.v != he.equation(0).v) continue;
+
+        Param *q[4];
+        bool unknown = true;
+        for(int i = 0; i < 4 && unknown; i++) {
+            q[i] = param.FindByIdNoOops(n->param[i]);
+            unknown = (q[i] != NULL && q[i]->tag == 0 && !q[i]->known);
+        }
+        if(!unknown) continue;
+
+        int k = 0;
+        for(int i = 1; i < 4; i++) {
+            if(fabs(q[i]->val) > fabs(q[k]->val)) k = i;
+        }
+        NormalChart c;
+        c.param = q[k];
+        c.sign  = (q[k]->val < 0) ? -1.0 : 1.0;
+        Expr *r = Expr::From(1.0);
+        for(int i = 0, j = 0; i < 4; i++) {
+            if(i == k) continue;
+            c.other[j++] = q[i];
+            r = r->Minus(Expr::From(q[i]->h)->Square());
+        }
+        r = r->Sqrt();
+        if(c.sign < 0) r = r->Negate();
+
+        if(by.empty()) by.resize(param.StoreSize(), NULL);
+        by[param.StoreIndex(q[k]->h)] = r;
+        q[k]->tag = VAR_SUBSTITUTED;
+        e.tag     = EQ_SUBSTITUTED;
+        charts->push_back(c);
+    }
+    if(charts->empty()) return;
+
+    for(auto &e : eq) {
+        if(e.tag != 0) continue;
+        e.e->Substitute(&param, by);
+        if(e.kernel.type == EquationKernel::Type::NONE) continue;
+        for(hParam &p : e.kernel.param) {
+            int i = param.StoreIndex(p);
+            if(i >= 0 && by[i] != NULL) {
+                e.kernel.type = EquationKernel::Type::NONE;
+                break;
             }
+        }
+    }
+}
 
-            // Take the last substitution of parameter a
-            size_t subIdx = 0;
-            auto it = leaves.find(sub->h);
-            if(it != leaves.end()) {
-                subIdx = it->second;
-                sub = subVec.at(it->second - 1);
+namespace {
+// Makes the params that FoldPinnedParams pinned unknowns again, when it's
+// told to or when it goes
+struct Unpin {
+    std::vector<Param *> params;
+    void Now() {
+        for(Param *p : params) p->known = false;
+        params.clear();
+    }
+    ~Unpin() { Now(); }
+};
+}
+
+// Triangles of three distances, and distances along an axis between points
+// that share their other coordinates (as the corners of a rectangle do, once
+// horizontal and vertical are substituted), are rigid: each has a closed-form
+// placement, up to where it sits and which way it points. So put their points
+// there, keeping where the first point is, which way its first edge points
+// and which side of that its third point is on, and Newton's method starts
+// with their equations satisfied, and has only to move each one as a whole.
+// A point that's dragged, or was solved alone, or that an earlier cluster
+// placed, stays put.
+void System::PlaceRigidClusters() {
+    PhaseTimer timer(&stats.placeMs);
+    // The params of a point's coordinates, with a zero handle for z in 2d
+    typedef std::array<uint32_t, 3> Point;
+    struct Edge {
+        Point  a, b;
+        double length;
+    };
+    std::vector<Edge> edges;
+    std::map<Point, std::map<Point, double>> adjacent;
+    for(Equation &e : eq) {
+        const EquationKernel &k = e.kernel;
+        int n;
+        if(k.type == EquationKernel::Type::DISTANCE_2D) {
+            n = 2;
+        } else if(k.type == EquationKernel::Type::DISTANCE_3D) {
+            n = 3;
+        } else {
+            continue;
+        }
+        if(e.tag != 0 || k.param[2*n].v != 0 || !(k.value > LENGTH_EPS)) continue;
+        bool ok = true;
+        for(int i = 0; i < 2*n; i++) ok = ok && param.FindByIdNoOops(k.param[i]) != NULL;
+        if(!ok) continue;
+
+        Point a = {}, b = {};
+        for(int i = 0; i < n; i++) {
+            a[i] = k.param[i].v;
+            b[i] = k.param[n + i].v;
+        }
+        if(a == b || adjacent[a].count(b)) continue;
+        adjacent[a][b] = adjacent[b][a] = k.value;
+        edges.push_back({ a, b, k.value });
+    }
+    if(edges.empty()) return;
+
+    // Those solved alone are where they'll stay, as well.
+    std::unordered_set<uint32_t> placed;
+    auto fixed = [&](uint32_t h) {
+        return h == 0 || placed.count(h) > 0 || IsDragged(hParam { h }) ||
+               param.FindById(hParam { h })->tag != 0;
+    };
+    auto get = [&](const Point &p) {
+        double v[3] = {};
+        for(int i = 0; i < 3; i++) {
+            if(p[i] != 0) v[i] = param.FindById(hParam { p[i] })->val;
+        }
+        return Vector::From(v[0], v[1], v[2]);
+    };
+    auto set = [&](const Point &p, Vector v) {
+        for(int i = 0; i < 3; i++) {
+            if(p[i] != 0) param.FindById(hParam { p[i] })->val = v.Element(i);
+        }
+    };
+
+    // The triangles first, in the order that their first edge was written.
+    for(const Edge &ab : edges) {
+        for(const auto &it : adjacent[ab.a]) {
+            const Point &c = it.first;
+            if(c == ab.b || !adjacent[ab.b].count(c)) continue;
+            std::set<uint32_t> params;
+            for(const Point &p : { ab.a, ab.b, c }) {
+                for(uint32_t h : p) {
+                    if(h != 0) params.insert(h);
+                }
+            }
+            bool in2d = (c[2] == 0);
+            if(params.size() != (in2d ? 6u : 9u)) continue;
+
+            // Those of its points that stay, then those that move; a point
+            // with some coordinates of each can't be placed either way.
+            std::vector<Point> pts;
+            int stay = 0;
+            for(const Point &p : { ab.a, ab.b, c }) {
+                int f = (int)fixed(p[0]) + (int)fixed(p[1]) + (int)fixed(p[2]) -
+                        (in2d ? 1 : 0);
+                if(f == (in2d ? 2 : 3)) {
+                    pts.insert(pts.begin(), p);
+                    stay++;
+                } else if(f == 0) {
+                    pts.push_back(p);
+                }
+            }
+            if(pts.size() != 3 || stay == 3) continue;
+
+            const Point &pa = pts[0], &pb = pts[1], &pc = pts[2];
+            Vector a = get(pa), b = get(pb), cc = get(pc);
+            Vector e1 = b.Minus(a);
+            if(stay < 2) {
+                if(e1.Magnitude() < LENGTH_EPS) e1 = Vector::From(1, 0, 0);
+                b = a.Plus(e1.WithMagnitude(adjacent[pa][pb]));
+                e1 = b.Minus(a);
+            }
+            double d = e1.Magnitude();
+            if(d < LENGTH_EPS) continue;
+            e1 = e1.ScaledBy(1 / d);
+
+            // Where the circles about a and b meet, on the side that c is on
+            double ra = adjacent[pa][pc], rb = adjacent[pb][pc];
+            double x  = (d*d + ra*ra - rb*rb) / (2*d),
+                   h2 = ra*ra - x*x;
+            if(h2 < -LENGTH_EPS*LENGTH_EPS) continue;
+            Vector ac = cc.Minus(a);
+            Vector e2 = ac.Minus(e1.ScaledBy(ac.Dot(e1)));
+            if(e2.Magnitude() < LENGTH_EPS) {
+                e2 = in2d ? Vector::From(-e1.y, e1.x, 0) : e1.Normal(0);
             }
+            e2 = e2.WithMagnitude(sqrt(std::max(h2, 0.0)));
+
+            set(pb, b);
+            set(pc, a.Plus(e1.ScaledBy(x)).Plus(e2));
+            placed.insert(params.begin(), params.end());
+            stats.rigidClusters++;
+        }
+    }
+
+    // Then the distances along an axis, each of which places one coordinate
+    // of one of its points relative to the other's.
+    for(const Edge &e : edges) {
+        uint32_t ha = 0, hb = 0;
+        int differ = 0;
+        for(int i = 0; i < 3; i++) {
+            if(e.a[i] == e.b[i]) continue;
+            ha = e.a[i];
+            hb = e.b[i];
+            differ++;
+        }
+        if(differ != 1) continue;
+        if(fixed(hb)) std::swap(ha, hb);
+        if(fixed(hb)) continue;
+
+        Param *pa = param.FindById(hParam { ha }), *pb = param.FindById(hParam { hb });
+        pb->val = (pb->val < pa->val) ? pa->val - e.length : pa->val + e.length;
+        placed.insert(ha);
+        placed.insert(hb);
+        stats.rigidClusters++;
+    }
+}
+
+// A block with no more than SMALL_BLOCK equations and unknowns is factored
+// densely, in storage on the stack; for those, the bookkeeping of the sparse
+// factorizations costs more than the arithmetic.
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor,
+                      System::SMALL_BLOCK, System::SMALL_BLOCK> SmallMatrix;
+typedef Eigen::ColPivHouseholderQR<SmallMatrix> SmallQR;
+
+static bool IsSmall(const Eigen::SparseMatrix<double> &A) {
+    return A.rows() <= System::SMALL_BLOCK && A.cols() <= System::SMALL_BLOCK;
+}
+
+// The dense QR of A, with the same threshold on the pivots that SparseQR
+// takes by default, so that both find the same rank.
+static void FactorSmall(const Eigen::SparseMatrix<double> &A, SmallQR *qr) {
+    SmallMatrix D = A;
+    qr->setThreshold(20 * (D.rows() + D.cols()) * Eigen::NumTraits<double>::epsilon());
+    qr->compute(D);
+}
+
+static size_t SmallFactorNonZeros(const SmallQR &qr) {
+    size_t k = (size_t)std::min(qr.rows(), qr.cols()), n = (size_t)qr.cols();
+    return k * (k + 1) / 2 + k * (n - k);
+}
+
+//-----------------------------------------------------------------------------
+// Calculate the rank of the Jacobian matrix
+//-----------------------------------------------------------------------------
+int System::CalculateRank() {
+    using namespace Eigen;
+    PhaseTimer timer(&stats.rankMs);
+    if(mat.n == 0 || mat.m == 0) return 0;
+    if(IsSmall(mat.A.num)) {
+        SmallQR qr(mat.m, mat.n);
+        FactorSmall(mat.A.num, &qr);
+        CountFactor(SmallFactorNonZeros(qr));
+        return (int)qr.rank();
+    }
+    // A big block that clearly has full rank doesn't need the QR to say so.
+    if(mat.m >= LARGE_BLOCK) {
+        bool fullRank = mat.stepLDLT.Factorize(mat.A.num, mat.ordering);
+        CountFactor(mat.stepLDLT.FactorNonZeros());
+        if(fullRank) return mat.m;
+    }
+    mat.rankQR.Factorize(mat.A.num, mat.ordering, qrBackend);
+    CountFactor(mat.rankQR.FactorNonZeros());
+    return (int)mat.rankQR.Rank();
+}
 
-            // Take the last substitution of parameter b
-            size_t byIdx = 0;
-            it = leaves.find(by->h);
-            if(it != leaves.end()) {
-                byIdx = it->second;
-                by = subVec.at(it->second - 1);
+// A maximum matching of the rows of a sparsity pattern (with row i's columns
+// at cols[start[i]] to cols[start[i + 1]]) to its columns, by Hopcroft and
+// Karp: each phase finds the shortest augmenting paths from the unmatched
+// rows breadth first, and then follows as many disjoint ones as it can depth
+// first. The matching goes in rowMatch and colMatch, -1 for unmatched, and
+// its size is returned.
+static int MaximumMatching(int m, int n, const std::vector<int> &start,
+                           const std::vector<int> &cols,
+                           std::vector<int> *rowMatch, std::vector<int> *colMatch) {
+    const int UNREACHED = INT_MAX;
+    std::vector<int> &rm = *rowMatch, &cm = *colMatch;
+    rm.assign(m, -1);
+    cm.assign(n, -1);
+
+    // Most rows can be matched greedily, which leaves the phases less to do.
+    int matched = 0;
+    for(int i = 0; i < m; i++) {
+        for(int k = start[i]; k < start[i + 1]; k++) {
+            if(cm[cols[k]] < 0) {
+                rm[i] = cols[k];
+                cm[cols[k]] = i;
+                matched++;
+                break;
             }
+        }
+    }
 
-            // If the last substituton of `a` is a dragged param, keep it
-            // and substitute the other param
-            if(IsDragged(sub->h)) {
-                std::swap(sub, by);
-                std::swap(subIdx, byIdx);
+    std::vector<int> dist(m), queue, next(m), stack;
+    queue.reserve(m);
+    while(matched < m) {
+        // Layer the rows by their distance from an unmatched one, along
+        // alternating paths, and stop at the layer that reaches a free column.
+        queue.clear();
+        for(int i = 0; i < m; i++) {
+            dist[i] = (rm[i] < 0) ? 0 : UNREACHED;
+            if(rm[i] < 0) queue.push_back(i);
+        }
+        bool found = false;
+        for(size_t q = 0; q < queue.size(); q++) {
+            int i = queue[q];
+            for(int k = start[i]; k < start[i + 1]; k++) {
+                int r = cm[cols[k]];
+                if(r < 0) {
+                    found = true;
+                } else if(dist[r] == UNREACHED) {
+                    dist[r] = dist[i] + 1;
+                    queue.push_back(r);
+                }
             }
-
-            if(subIdx == 0) {
-                if(byIdx == 0) {
-                    // Neither `sub` nor `by` are in the map, so add them and
-                    // set the target index
-                    subVec.push_back(by);
-                    leaves[by->h] = leaves[sub->h] = subVec.size();
-                } else {
-                    // `sub` isn't in the map, but `by` is, so just add `sub` to
-                    // the map with `by` as the target
-                    leaves[sub->h] = byIdx;
+        }
+        if(!found) break;
+
+        // Then augment along the layers, without recursion; a row that leads
+        // nowhere is taken out of its layer so that no path tries it again.
+        for(int i = 0; i < m; i++) next[i] = start[i];
+        for(int root = 0; root < m; root++) {
+            if(rm[root] >= 0 || dist[root] != 0) continue;
+            stack.assign(1, root);
+            while(!stack.empty()) {
+                int i = stack.back();
+                if(next[i] == start[i + 1]) {
+                    dist[i] = UNREACHED;
+                    stack.pop_back();
+                    continue;
                 }
-            } else {
-                // `sub` already exists in the map, so just update any slots
-                // that point to it as the last substitution to point to `by`
-                // instead
-                auto it = slotTrack.find(sub->h);
-                if(it == slotTrack.end()) {
-                    // There's only this one slot, so just replace it with `by`
-                    subVec[subIdx - 1] = by;
-
-                    // If `by` was already in the map, that means we now have
-                    // an additional slot where it resides, so add it to the
-                    // slot tracker
-                    if(byIdx != 0) {
-                        // If `by` is already in the slot tracker, we'll get
-                        // back a vector with at least two elements; otherwise
-                        // this access will add a new item to the slot tracker
-                        // with an empty vector
-                        auto &bySlots = slotTrack[by->h];
-                        if(bySlots.empty()) {
-                            bySlots.push_back(byIdx);
-                        }
-                        bySlots.push_back(subIdx);
+                int r = cm[cols[next[i]]];
+                if(r < 0) {
+                    for(int s : stack) {
+                        int c = cols[next[s]];
+                        rm[s] = c;
+                        cm[c] = s;
                     }
+                    matched++;
+                    break;
+                }
+                if(dist[r] == dist[i] + 1) {
+                    stack.push_back(r);
                 } else {
-                    // We have more than one slot pointing to `sub`, so update
-                    // all of the slots to point to `by`
-                    for(size_t i : it->second) {
-                        subVec[i - 1] = by;
-                    }
-
-                    // No more slots are pointing to `sub`, so extract the slot list
-                    // and erase `sub` from the tracker
-                    auto subSlots = std::move(it->second);
-                    slotTrack.erase(it);
-
-                    // Same as above: this access either gives us an existing vector
-                    // with at least two elements, or creates an empty vector
-                    auto &bySlots = slotTrack[by->h];
-                    if(bySlots.empty()) {
-                        bySlots = std::move(subSlots);
-                        if(byIdx != 0) {
-                            bySlots.push_back(byIdx);
-                        }
-                    } else {
-                        bySlots.insert(bySlots.end(), subSlots.begin(), subSlots.end());
-                    }
+                    next[i]++;
                 }
-
-                leaves[by->h] = subIdx;
             }
-
-            sub->tag = VAR_SUBSTITUTED;
-            teq.tag = EQ_SUBSTITUTED;
         }
     }
+    return matched;
+}
 
-    SubstitutionMap subMap;
-    for(auto &sub : leaves) {
-        Param *by = subVec[sub.second - 1];
-        if(sub.first != by->h) {
-            subMap[sub.first] = by;
+// The structural rank of the Jacobian: the most entries of its sparsity
+// pattern with no two in the same row or column, which is the rank that it
+// has for almost all values of its nonzeros. It bounds the numeric rank from
+// above, with no floating point work at all. If overdetermined is given, it
+// gets the rows that some maximum matching leaves unmatched, and those that
+// alternating paths reach from them: the part of the Jacobian with more
+// rows than the columns they touch. Taking out rows anywhere else can't
+// make up the shortfall.
+int System::StructuralRank(std::vector<char> *overdetermined) {
+    std::vector<int> start(mat.m + 1, 0), cols(mat.A.sym.nonZeros());
+    for(int k = 0; k < mat.A.sym.outerSize(); k++) {
+        for(Eigen::SparseMatrix<Expr *>::InnerIterator it(mat.A.sym, k); it; ++it) {
+            start[it.row() + 1]++;
         }
     }
-
-    // Substitute all the equations
-    for(auto &req : eq) {
-        req.e->Substitute(subMap);
+    for(int i = 0; i < mat.m; i++) start[i + 1] += start[i];
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for(int k = 0; k < mat.A.sym.outerSize(); k++) {
+        for(Eigen::SparseMatrix<Expr *>::InnerIterator it(mat.A.sym, k); it; ++it) {
+            cols[fill[it.row()]++] = (int)it.col();
+        }
     }
 
-    return subMap;
-}
-
-//-----------------------------------------------------------------------------
-// Calculate the rank of the Jacobian matrix
-//-----------------------------------------------------------------------------
-int System::CalculateRank() {
-    using namespace Eigen;
-    if(mat.n == 0 || mat.m == 0) return 0;
-    SparseQR <SparseMatrix<double>, COLAMDOrdering<int>> solver;
-    solver.compute(mat.A.num);
-    int result = solver.rank();
-    return result;
+    std::vector<int> rowMatch, colMatch;
+    int rank = MaximumMatching(mat.m, mat.n, start, cols, &rowMatch, &colMatch);
+    if(overdetermined) {
+        overdetermined->assign(mat.m, 0);
+        std::vector<int> queue;
+        for(int i = 0; i < mat.m; i++) {
+            if(rowMatch[i] < 0) {
+                (*overdetermined)[i] = 1;
+                queue.push_back(i);
+            }
+        }
+        for(size_t q = 0; q < queue.size(); q++) {
+            int i = queue[q];
+            for(int k = start[i]; k < start[i + 1]; k++) {
+                int r = colMatch[cols[k]];
+                if(r >= 0 && !(*overdetermined)[r]) {
+                    (*overdetermined)[r] = 1;
+                    queue.push_back(r);
+                }
+            }
+        }
+    }
+    return rank;
 }
 
 bool System::TestRank(int *dof, int *rank) {
@@ -256,19 +1677,172 @@ bool System::TestRank(int *dof, int *rank) {
     return jacobianRank == mat.m;
 }
 
-bool System::SolveLinearSystem(const Eigen::SparseMatrix <double> &A,
-                               const Eigen::VectorXd &B, Eigen::VectorXd *X)
+// The negation of IsReasonable() for every entry of v at once; a NaN fails
+// the comparison, so it still counts as unreasonable.
+static bool AllReasonable(const Eigen::Ref<const Eigen::VectorXd> &v) {
+    return (v.array().abs() <= 1e11).all();
+}
+
+// LSQR (Paige and Saunders): starting from zero, it stays in the row space
+// of A, so it converges to the shortest X that minimizes |A X - B|. It stops
+// once the residual is down to tol, or (when A X = B has no solution) once
+// A^T times the residual is small for the size of A and of the residual;
+// false if it got to maxIterations first.
+static bool SolveLsqr(const Eigen::SparseMatrix<double> &A, const Eigen::VectorXd &B,
+                      double tol, int maxIterations, Eigen::VectorXd *X) {
+    using namespace Eigen;
+    const double ATOL = 1e-12;
+
+    VectorXd &x = *X;
+    x = VectorXd::Zero(A.cols());
+    VectorXd u = B;
+    double beta = u.norm();
+    if(beta <= tol) return true;
+    u /= beta;
+    VectorXd v = A.transpose() * u;
+    double alpha = v.norm();
+    if(alpha == 0) return true;
+    v /= alpha;
+
+    VectorXd w = v;
+    double phibar = beta, rhobar = alpha;
+    double anormSq = alpha * alpha;
+    for(int k = 0; k < maxIterations; k++) {
+        // Continue the bidiagonalization,
+        u = A * v - alpha * u;
+        beta = u.norm();
+        if(beta > 0) u /= beta;
+        v = A.transpose() * u - beta * v;
+        alpha = v.norm();
+        if(alpha > 0) v /= alpha;
+        anormSq += alpha * alpha + beta * beta;
+
+        // and eliminate the new subdiagonal entry with a plane rotation.
+        double rho = std::hypot(rhobar, beta);
+        double c = rhobar / rho, s = beta / rho;
+        double theta = s * alpha;
+        rhobar = -c * alpha;
+        double phi = c * phibar;
+        phibar = s * phibar;
+
+        x += (phi / rho) * w;
+        w = v - (theta / rho) * w;
+
+        // phibar is the norm of the residual, and phibar*alpha*|c| that of
+        // A^T times it.
+        if(phibar <= tol) return true;
+        if(alpha * fabs(c) <= ATOL * sqrt(anormSq)) return true;
+        if(alpha == 0) return true;
+    }
+    return false;
+}
+
+bool System::SolveMinimumNorm(const Eigen::SparseMatrix<double> &A,
+                              const Eigen::VectorXd &B, Eigen::VectorXd *X, int *rank)
 {
-    if(A.outerSize() == 0) return true;
     using namespace Eigen;
-    SparseQR<SparseMatrix<double>, COLAMDOrdering<int>> solver;
-    //SimplicialLDLT<SparseMatrix<double>> solver;
-    solver.compute(A);
-    *X = solver.solve(B);
-    return (solver.info() == Success);
+    PhaseTimer timer(&stats.stepMs);
+    const int m = (int)A.rows(), n = (int)A.cols();
+    if(m == 0 || n == 0) {
+        *X = VectorXd::Zero(n);
+        *rank = 0;
+        return true;
+    }
+
+    // A partial that's singular where it's evaluated (a distance between
+    // coincident points, say) leaves nothing for LSQR to work with, so leave
+    // steps like that to the factorizations.
+    if(leastSquaresMode == LeastSquaresMode::ITERATIVE &&
+       AllReasonable(Map<const VectorXd>(A.valuePtr(), A.nonZeros())))
+    {
+        // The step only has to leave the linearized residuals well below the
+        // tolerance that NewtonSolve converges to; when the residuals are
+        // still big, a millionth of them will do (an inexact Newton step),
+        // and the next step takes care of the rest. In exact arithmetic LSQR
+        // would be done in min(m, n) iterations; if it takes much longer
+        // than that, then A is badly conditioned (a long chain of links, say)
+        // and a factorization will do better.
+        double tol = std::max(1e-6 * B.norm(), 0.1 * convergeTolerance);
+        if(SolveLsqr(A, B, tol, std::min(m, n) + 100, X) && AllReasonable(*X)) {
+            *rank = -1;
+            return true;
+        }
+    }
+
+    // A small block gets the same solve as the QR below, only dense.
+    if(IsSmall(A)) {
+        SmallQR qr(n, m);
+        FactorSmall(A.transpose(), &qr);
+        CountFactor(SmallFactorNonZeros(qr));
+        const int r = (int)qr.rank();
+        VectorXd c = qr.colsPermutation().transpose() * B;
+        VectorXd w = VectorXd::Zero(n);
+        if(r > 0) {
+            w.head(r) = qr.matrixR().topLeftCorner(r, r).transpose()
+                          .triangularView<Lower>().solve(c.head(r));
+        }
+        *X = qr.householderQ() * w;
+        *rank = r;
+        return true;
+    }
+
+    // With full row rank, the shortest X is A^T Y, with A A^T Y = B; and
+    // A A^T is positive definite, so an LDL^T of it is much cheaper than the
+    // QR of A^T. When its pivots say that the rank is in doubt, that's left
+    // to the QR, and since the rank rarely changes between iterations, so
+    // are the rest of this Jacobian's steps.
+    mat.stepByLDLT = false;
+    if(!mat.stepRankInDoubt) {
+        bool fullRank = mat.stepLDLT.Factorize(A, mat.ordering);
+        CountFactor(mat.stepLDLT.FactorNonZeros());
+        if(fullRank) {
+            *X = A.transpose() * mat.stepLDLT.Solve(B);
+            *rank = m;
+            mat.stepByLDLT = (&A == &mat.A.num);
+            return true;
+        }
+        mat.stepRankInDoubt = true;
+    }
+
+    // On a big block, a QR could take minutes, so shift A A^T just enough
+    // to factor it, which damps the step in the directions that the rank is
+    // in doubt along, and leave the rank unknown for the rank tests to find.
+    if(m >= LARGE_BLOCK) {
+        double big = mat.stepLDLT.AAt.diagonal().maxCoeff();
+        mat.stepLDLT.Factorize(A, mat.ordering, 1e-10 * big);
+        if(big > 0 && mat.stepLDLT.ldlt.info() == Success) {
+            *X = A.transpose() * mat.stepLDLT.Solve(B);
+            *rank = -1;
+            return true;
+        }
+    }
+
+    // With A^T P = Q R, A X = B becomes R^T (Q^T X) = P^T B; the shortest X
+    // comes from solving the leading (rank by rank) triangle of that, and
+    // taking the rest of Q^T X as zero. The same factorization gives the
+    // rank of A.
+    SparseMatrix<double> At = A.transpose();
+    At.makeCompressed();
+    const ReusableSparseQR &qr = mat.stepQR;
+    mat.stepQR.Factorize(At, mat.ordering, qrBackend);
+    if(qr.Info() != Success) return false;
+    CountFactor(qr.FactorNonZeros());
+
+    const int r = (int)qr.Rank();
+    VectorXd c = qr.ColsPermutation().transpose() * B;
+    VectorXd w = VectorXd::Zero(n);
+    if(r > 0) {
+        SparseMatrix<double> R11t = qr.MatrixR().topLeftCorner(r, r).transpose();
+        w.head(r) = R11t.triangularView<Lower>().solve(c.head(r));
+    }
+    *X = qr.ApplyQ(w);
+    *rank = r;
+    return true;
 }
 
-bool System::SolveLeastSquares() {
+// With reuse, mat.A.num is still the scaled Jacobian from an earlier step,
+// which mat.stepLDLT has factored, and only the residuals are new.
+bool System::SolveLeastSquares(bool reuse) {
     using namespace Eigen;
     // Scale the columns; this scale weights the parameters for the least
     // squares solve, so that we can encourage the solver to make bigger
@@ -282,20 +1856,21 @@ bool System::SolveLeastSquares() {
         }
     }
 
-    const int size = mat.A.num.outerSize();
-    for(int k = 0; k < size; k++) {
-        for(SparseMatrix<double>::InnerIterator it(mat.A.num, k); it; ++it) {
-            it.valueRef() *= scale[it.col()];
+    if(reuse) {
+        PhaseTimer timer(&stats.stepMs);
+        mat.X = mat.A.num.transpose() * mat.stepLDLT.Solve(mat.B.num);
+    } else {
+        const int size = mat.A.num.outerSize();
+        for(int k = 0; k < size; k++) {
+            for(SparseMatrix<double>::InnerIterator it(mat.A.num, k); it; ++it) {
+                it.valueRef() *= scale[it.col()];
+            }
         }
-    }
-
-    SparseMatrix<double> AAt = mat.A.num * mat.A.num.transpose();
-    AAt.makeCompressed();
-    VectorXd z(mat.n);
-
-    if(!SolveLinearSystem(AAt, mat.B.num, &z)) return false;
 
-    mat.X = mat.A.num.transpose() * z;
+        // The scaling doesn't change the rank, so this is the rank of the
+        // Jacobian too.
+        if(!SolveMinimumNorm(mat.A.num, mat.B.num, &mat.X, &mat.stepRank)) return false;
+    }
 
     for(int c = 0; c < mat.n; c++) {
         mat.X[c] *= scale[c];
@@ -303,62 +1878,575 @@ bool System::SolveLeastSquares() {
     return true;
 }
 
-bool System::NewtonSolve() {
+// Shorten the step in mat.X, which has already been taken from the values
+// in params, until the residuals decrease (or at least stay in range); a
+// full step that does that is kept as it is. On entry normSq is the squared
+// norm of the residuals before the step, and on exit the one after it.
+bool System::LineSearch(const std::vector<Param *> &params, double *normSq) {
+    const double before = *normSq;
+    double alpha = 1.0;
+    for(int tries = 0; ; tries++) {
+        EvalResiduals();
+        bool reasonable = AllReasonable(mat.B.num);
+        double after = reasonable ? mat.B.num.squaredNorm() : INFINITY;
+        // The Gauss-Newton step goes downhill at a rate of twice the
+        // squared norm, so ask for a small fraction of that.
+        if(after <= (1 - 1e-4 * alpha) * before) {
+            *normSq = after;
+            return true;
+        }
+        if(tries == 10) {
+            // Take the shortest step anyway, if it's usable; the next
+            // iteration may do better from there.
+            *normSq = after;
+            return reasonable;
+        }
+
+        // Back up half of what's left of the step.
+        alpha /= 2;
+        for(int i = 0; i < mat.n; i++) {
+            params[i]->val += alpha * mat.X[i];
+        }
+    }
+}
+
+bool System::NewtonSolve(int *rankBefore, int *rankAfter) {
 
     int iter = 0;
+    PhaseTrace span(this, Phase::NEWTON, &iter);
     bool converged = false;
     int i;
 
-    // Evaluate the functions at our operating point.
-    mat.B.num = Eigen::VectorXd(mat.m);
-    for(i = 0; i < mat.m; i++) {
-        mat.B.num[i] = (mat.B.sym[i])->Eval();
+    // The least squares step finds the rank of the Jacobian as it goes, the
+    // first one at the starting point. The last one is of the Jacobian
+    // before the last step, whose rank can differ from the one at the
+    // solution (constraints can become dependent just there), so the rank
+    // after is found from the Jacobian at the solution.
+    if(rankBefore) *rankBefore = -1;
+    if(rankAfter)  *rankAfter  = -1;
+
+    std::vector<Param *> params(mat.n);
+    for(i = 0; i < mat.n; i++) {
+        params[i] = param.FindById(mat.param[i]);
     }
+
+    stats.jacobianNonZeros += (size_t)mat.A.num.nonZeros();
+    stats.jacobianEntries  += (size_t)mat.m * (size_t)mat.n;
+    RowProfile profile(this);
+
+    // Evaluate the functions at our operating point.
+    EvalResiduals();
+    double normSq = mat.B.num.squaredNorm();
+    // Whether this step reuses the last one's Jacobian and factorization,
+    // and where it started from, in case it has to be taken back.
+    bool reuse = false;
+    std::vector<double> from;
     do {
-        // And evaluate the Jacobian at our initial operating point.
-        EvalJacobian();
+        if(Expired()) return false;
 
-        if(!SolveLeastSquares()) break;
+        // And evaluate the Jacobian at our initial operating point.
+        if(!reuse) EvalJacobian(/*residualsCurrent=*/true);
+        profile.Iteration();
+
+        if(!SolveLeastSquares(reuse)) break;
+        if(iter == 0 && rankBefore) *rankBefore = mat.stepRank;
+        stats.iterations++;
+        if(reuse) {
+            stats.reusedSteps++;
+            from.resize(mat.n);
+            for(i = 0; i < mat.n; i++) from[i] = params[i]->val;
+        }
 
         // Take the Newton step;
         //      J(x_n) (x_{n+1} - x_n) = 0 - F(x_n)
+        bool wild = false;
         for(i = 0; i < mat.n; i++) {
-            Param *p = param.FindById(mat.param[i]);
+            Param *p = params[i];
             p->val -= mat.X[i];
-            if(IsReasonable(p->val)) {
-                // Very bad, and clearly not convergent
-                return false;
-            }
+            if(stepMode == StepMode::NEWTON && IsReasonable(p->val)) wild = true;
         }
 
-        // Re-evalute the functions, since the params have just changed.
-        for(i = 0; i < mat.m; i++) {
-            mat.B.num[i] = (mat.B.sym[i])->Eval();
-            if(IsReasonable(mat.B.num[i])) {
-                // Very bad, and clearly not convergent
-                return false;
+        const double before = normSq;
+        if(!wild) {
+            if(stepMode == StepMode::DAMPED) {
+                if(!LineSearch(params, &normSq)) wild = true;
+            } else {
+                // Re-evalute the functions, since the params have just changed.
+                EvalResiduals();
+                if(!AllReasonable(mat.B.num)) wild = true;
+                normSq = mat.B.num.squaredNorm();
             }
         }
-        
+
+        if(reuse && (wild || !(normSq < before))) {
+            // A stale Jacobian can point the wrong way; take the step back,
+            // and again with a fresh one.
+            for(i = 0; i < mat.n; i++) params[i]->val = from[i];
+            EvalResiduals();
+            normSq = before;
+            reuse  = false;
+            continue;
+        }
+        // Very bad, and clearly not convergent
+        if(wild) return false;
+
         // Check for convergence
-        converged = true;
-        for(i = 0; i < mat.m; i++) {
-            if(fabs(mat.B.num[i]) > CONVERGE_TOLERANCE) {
-                converged = false;
+        converged = !(mat.B.num.array().abs() > convergeTolerance).any();
+        if(trace && traceSteps) Trace(Phase::NEWTON_STEP, /*begin=*/false, iter + 1);
+
+        // The Jacobian changes little where the residuals are converging
+        // quickly, so it's worth keeping until they stop.
+        reuse = jacobianUpdate == JacobianUpdate::CHORD && mat.stepByLDLT &&
+                normSq <= CHORD_CONTRACTION * CHORD_CONTRACTION * before;
+    } while(iter++ < maxIterations && !converged);
+    // A step that went out of range returned above, with no residuals
+    // worth reporting.
+    stats.residualSq += mat.B.num.squaredNorm();
+
+    // An LDL^T of it can say cheaply that it has full rank; anything less
+    // is left to the rank test.
+    if(converged && rankAfter) {
+        if(mat.m == 0) {
+            *rankAfter = 0;
+        } else {
+            EvalJacobian(/*residualsCurrent=*/true);
+            PhaseTimer timer(&stats.rankMs);
+            bool fullRank = mat.stepLDLT.Factorize(mat.A.num, mat.ordering);
+            CountFactor(mat.stepLDLT.FactorNonZeros());
+            if(fullRank) *rankAfter = mat.m;
+        }
+    }
+    return converged;
+}
+
+// Newton's method on one equation in one unknown, p, with f the register of
+// its residual on tape and d that of its derivative: the steps NewtonSolve
+// would take on the 1 by 1 system, without a Jacobian to write or factor.
+// It adds its steps to *iterations, and leaves the residual in register f.
+bool System::NewtonSolveScalar(ExprTape *tape, size_t begin, size_t end, int f, int d,
+                               Param *p, int *iterations) const {
+    tape->Eval(begin, end);
+    double r = tape->Value(f);
+    for(int iter = 0; iter <= maxIterations; iter++) {
+        // With a zero derivative, the shortest step is none.
+        const double j = tape->Value(d);
+        const double x = (j != 0) ? r / j : 0;
+        const double before = r * r;
+        (*iterations)++;
+
+        p->val -= x;
+        if(stepMode == StepMode::NEWTON && IsReasonable(p->val)) return false;
+        tape->Eval(begin, end);
+        r = tape->Value(f);
+        if(stepMode == StepMode::DAMPED) {
+            // As LineSearch does it, in one dimension.
+            double alpha = 1.0;
+            for(int tries = 0; ; tries++) {
+                double after = IsReasonable(r) ? INFINITY : r * r;
+                if(after <= (1 - 1e-4 * alpha) * before) break;
+                if(tries == 10) {
+                    if(IsReasonable(r)) return false;
+                    break;
+                }
+                alpha /= 2;
+                p->val += alpha * x;
+                tape->Eval(begin, end);
+                r = tape->Value(f);
+            }
+        } else if(IsReasonable(r)) {
+            return false;
+        }
+        if(!(fabs(r) > convergeTolerance)) return true;
+    }
+    return false;
+}
+
+// Before solving the rest, solve each equation that's in just one unknown
+// which no other such equation has had, tagging both with a tag of their
+// own. They're found in one pass, and each one is solved by itself with
+// NewtonSolveScalar, on several threads when there are many. Those that
+// are solved leave their unknowns where they are; if one doesn't converge,
+// the ones after it are left as they were, it's added to unsatisfied if
+// its residual is out of tolerance, and the result is false.
+bool System::SolveAlone(std::vector<Equation *> *unsatisfied) {
+    struct Alone {
+        Equation *e;
+        Param    *p;
+        size_t    begin, end;
+        int       f, d;
+    };
+    std::vector<Alone> alone;
+    int tag = 1;
+    for(auto &e : eq) {
+        if(e.tag != 0)
+            continue;
+
+        hParam hp = e.e->ReferencedParams(&param);
+        if(hp == Expr::NO_PARAMS) continue;
+        if(hp == Expr::MULTIPLE_PARAMS) continue;
+
+        Param *p = param.FindById(hp);
+        if(p->tag != 0) continue; // let rank test catch inconsistency
+
+        e.tag  = tag;
+        p->tag = tag;
+        tag++;
+        alone.push_back({ &e, p, 0, 0, -1, -1 });
+    }
+    if(alone.empty()) return true;
+
+    // They all go on one tape, each with a factory of its own and sharing
+    // nothing with those before it, so that once the whole tape has run,
+    // each needs only its own stretch of it run again as its unknown moves.
+    ExprTape tape;
+    {
+        PhaseTimer timer(&stats.writeJacobianMs);
+        for(Alone &a : alone) {
+            ExprFactory exprs;
+            Expr *f = exprs.CopyWithParamsAsPointers(a.e->e, &param, &(SK.param));
+            Expr *d = exprs.PartialWrt(f, a.p->h);
+            tape.Forget();
+            a.begin = tape.Size();
+            a.f     = tape.Compile(f);
+            a.d     = tape.Compile(d);
+            a.end   = tape.Size();
+            stats.sourceNodes += exprs.CopiedNodes();
+        }
+        tape.Eval();
+    }
+
+    // Each one reads and writes only its own unknown, so they can be solved
+    // in any order; failing that, the first one that failed in order is the
+    // one reported, with what came after it untouched, as if they'd been
+    // solved in turn.
+    const size_t n = alone.size();
+    std::vector<char> solved(n, 0);
+    std::vector<double> start(n);
+    for(size_t i = 0; i < n; i++) start[i] = alone[i].p->val;
+    size_t failed = n;
+    if(workers > 1 && n >= PARALLEL_ALONE) {
+        EvalTeam team(workers);
+        std::vector<int> iterations(workers, 0);
+        team.Run([&](int t) {
+            size_t begin, end;
+            team.Share(t, n, &begin, &end);
+            for(size_t i = begin; i < end; i++) {
+                Alone &a = alone[i];
+                solved[i] = NewtonSolveScalar(&tape, a.begin, a.end, a.f, a.d, a.p,
+                                              &iterations[t]);
+            }
+        });
+        for(int k : iterations) stats.iterations += k;
+        for(size_t i = 0; i < n && failed == n; i++) {
+            if(!solved[i]) failed = i;
+        }
+        if(Expired()) return false;
+    } else {
+        for(size_t i = 0; i < n; i++) {
+            if(Expired()) return false;
+            Alone &a = alone[i];
+            if(!NewtonSolveScalar(&tape, a.begin, a.end, a.f, a.d, a.p, &stats.iterations)) {
+                failed = i;
                 break;
             }
         }
-    } while(iter++ < 50 && !converged);
+    }
 
-    return converged;
+    for(size_t i = 0; i < failed; i++) {
+        double r = tape.Value(alone[i].f);
+        stats.residualSq += r * r;
+    }
+    if(failed == n) return true;
+    for(size_t i = failed + 1; i < n; i++) alone[i].p->val = start[i];
+    double r = tape.Value(alone[failed].f);
+    if(fabs(r) > convergeTolerance || IsReasonable(r)) {
+        unsatisfied->push_back(alone[failed].e);
+    }
+    return false;
+}
+
+// The stage of a staged start that a constraint is first solved in: those
+// that hold points together or in place, then the distances and incidences,
+// the angles, and the tangencies; the rest wait for the full solve.
+static int StageOf(Constraint::Type type) {
+    switch(type) {
+        case Constraint::Type::POINTS_COINCIDENT:
+        case Constraint::Type::WHERE_DRAGGED:
+            return 0;
+
+        case Constraint::Type::PT_PT_DISTANCE:
+        case Constraint::Type::PT_PLANE_DISTANCE:
+        case Constraint::Type::PT_LINE_DISTANCE:
+        case Constraint::Type::PT_FACE_DISTANCE:
+        case Constraint::Type::PROJ_PT_DISTANCE:
+        case Constraint::Type::PT_IN_PLANE:
+        case Constraint::Type::PT_ON_LINE:
+        case Constraint::Type::PT_ON_FACE:
+        case Constraint::Type::PT_ON_CIRCLE:
+        case Constraint::Type::AT_MIDPOINT:
+        case Constraint::Type::HORIZONTAL:
+        case Constraint::Type::VERTICAL:
+        case Constraint::Type::DIAMETER:
+        case Constraint::Type::EQUAL_LENGTH_LINES:
+        case Constraint::Type::EQUAL_RADIUS:
+        case Constraint::Type::LENGTH_RATIO:
+        case Constraint::Type::LENGTH_DIFFERENCE:
+        case Constraint::Type::GEAR_MESH:
+            return 1;
+
+        case Constraint::Type::ANGLE:
+        case Constraint::Type::EQUAL_ANGLE:
+        case Constraint::Type::PARALLEL:
+        case Constraint::Type::PERPENDICULAR:
+        case Constraint::Type::SAME_ORIENTATION:
+            return 2;
+
+        case Constraint::Type::ARC_LINE_TANGENT:
+        case Constraint::Type::CUBIC_LINE_TANGENT:
+        case Constraint::Type::CURVE_CURVE_TANGENT:
+            return 3;
+
+        default:
+            return 4;
+    }
+}
+
+const hParam EquationCache::VALUE = { std::numeric_limits<decltype(hParam::v)>::max() - 1 };
+
+bool EquationCache::Keeps(const ConstraintBase *c, uint32_t forms) {
+    switch(c->type) {
+        // These are scaled by how long things are when they're written, if
+        // they're written as polynomials.
+        case Constraint::Type::PT_PT_DISTANCE:
+        case Constraint::Type::PT_ON_CIRCLE:
+            return !(forms & ConstraintBase::POLY_DISTANCE);
+        case Constraint::Type::EQUAL_LENGTH_LINES:
+        case Constraint::Type::LENGTH_RATIO:
+            return !(forms & ConstraintBase::POLY_LENGTHS);
+        case Constraint::Type::PERPENDICULAR:
+            return !(forms & ConstraintBase::POLY_ANGLE);
+
+        // These pick their equations, or write in constants, by where
+        // things are when they're written;
+        case Constraint::Type::SAME_ORIENTATION:
+        case Constraint::Type::WHERE_DRAGGED:
+        // and this gains its equation up by the angle it's given.
+        case Constraint::Type::ANGLE:
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+static uint64_t MixStructure(uint64_t h, uint64_t v) {
+    // splitmix64, of the hash so far and the next word
+    uint64_t z = h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t MixStructure(uint64_t h, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return MixStructure(h, bits);
+}
+
+// A point refers to its workplane, which refers to its origin and normal,
+// and so on; nothing refers further than this.
+uint64_t EquationCache::Structures::Of(hEntity he, int depth) {
+    uint64_t h = MixStructure(0, (uint64_t)he.v);
+    if(he.v == 0 || depth == 0) return h;
+    // As the list's own element type, which is Entity outside the library,
+    // for its place in the list's store
+    const auto *e = SK.entity.FindByIdNoOops(he);
+    if(e == nullptr) return h;
+    size_t i = (size_t)(e - &SK.entity.AtStore(0));
+    if(entity.size() <= i) entity.resize(SK.entity.StoreSize(), 0);
+    if(entity[i] != 0) return entity[i];
+
+    h = MixStructure(h, (uint64_t)e->type);
+    for(const hParam &hp : e->param) h = MixStructure(h, (uint64_t)hp.v);
+    h = MixStructure(h, (uint64_t)e->extraPoints);
+    h = MixStructure(h, (uint64_t)e->timesApplied);
+    h = MixStructure(h, e->numPoint.x);
+    h = MixStructure(h, e->numPoint.y);
+    h = MixStructure(h, e->numPoint.z);
+    h = MixStructure(h, e->numNormal.w);
+    h = MixStructure(h, e->numNormal.vx);
+    h = MixStructure(h, e->numNormal.vy);
+    h = MixStructure(h, e->numNormal.vz);
+    h = MixStructure(h, e->numDistance);
+    h = MixStructure(h, Of(e->workplane, depth - 1));
+    for(const hEntity &hp : e->point) {
+        if(hp.v != 0) h = MixStructure(h, Of(hp, depth - 1));
+    }
+    h = MixStructure(h, Of(e->normal, depth - 1));
+    h = MixStructure(h, Of(e->distance, depth - 1));
+    entity[i] = h;
+    return h;
+}
+
+uint64_t EquationCache::Structures::Of(const ConstraintBase *c) {
+    uint64_t h = 0;
+    for(hEntity he : { c->workplane, c->ptA, c->ptB,
+                       c->entityA, c->entityB, c->entityC, c->entityD }) {
+        h = MixStructure(h, Of(he, 6));
+    }
+    return h;
+}
+
+// Flattens e in to nodes, operands first, and returns its place there, or
+// -1 if that would take more than limit nodes. What's shared is copied, so
+// the limit is what keeps that from running away.
+static int FlattenExpr(const Expr *e, std::vector<EquationCache::Node> *nodes, size_t limit) {
+    EquationCache::Node n;
+    n.op = e->op;
+    n.a  = -1;
+    n.b  = -1;
+    int c = e->Children();
+    if(c == 0) {
+        if(e->op == Expr::Op::PARAM) {
+            n.parh = e->parh;
+        } else {
+            n.v = e->v;
+        }
+    } else {
+        n.a = FlattenExpr(e->a, nodes, limit);
+        if(n.a < 0) return -1;
+        if(c >= 2) {
+            n.b = FlattenExpr(e->b, nodes, limit);
+            if(n.b < 0) return -1;
+        }
+    }
+    if(nodes->size() >= limit) return -1;
+    nodes->push_back(n);
+    return (int)nodes->size() - 1;
+}
+
+EquationCache::Entry EquationCache::Note(const ConstraintBase *c,
+                                         IdList<Equation,hEquation> *l) {
+    Entry k;
+    k.constraint = *c;
+    size_t before = Expr::allocatedOnThread;
+    c->GenerateEquations(l);
+    k.flatten = (Expr::allocatedOnThread - before >= KEEP_NODES);
+    return k;
+}
+
+EquationCache::Entry EquationCache::Flatten(const ConstraintBase *c, Structures *structures,
+                                            IdList<Equation,hEquation> *l) {
+    // With the value as a parameter, so that the trees hold for any value
+    IdList<Equation,hEquation> general = {};
+    ConstraintBase g = *c;
+    if(!g.valAParam.v) g.valAParam = VALUE;
+    size_t before = Expr::allocatedOnThread;
+    g.GenerateEquations(&general);
+    size_t exprs = Expr::allocatedOnThread - before;
+
+    Entry k;
+    k.constraint = *c;
+    k.flatten    = false;
+    k.nodes.reserve(exprs);
+    for(Equation &eq : general) {
+        Root r;
+        r.h      = eq.h;
+        r.node   = FlattenExpr(eq.e, &k.nodes, 4 * exprs);
+        r.kernel = eq.kernel;
+        r.value  = false;
+        for(hParam &hp : r.kernel.param) {
+            if(hp == VALUE) {
+                hp      = {};
+                r.value = true;
+            }
+        }
+        if(r.node < 0) {
+            k.roots.clear();
+            break;
+        }
+        k.roots.push_back(r);
+    }
+    general.Clear();
+
+    if(k.roots.empty()) {
+        // Too shared to copy, so they're written each time.
+        k.nodes.clear();
+        k.nodes.shrink_to_fit();
+        c->GenerateEquations(l);
+    } else {
+        k.structure = structures->Of(c);
+        Write(k, c, l);
+    }
+    return k;
+}
+
+const EquationCache::Entry *EquationCache::Find(const ConstraintBase *c,
+                                                Structures *structures) const {
+    auto it = entries.find(c->h);
+    if(it == entries.end()) return NULL;
+    const Entry &k = it->second;
+    if(!k.constraint.Equals(*c, /*andValue=*/false)) return NULL;
+    if(!k.roots.empty() && k.structure != structures->Of(c)) return NULL;
+    return &k;
+}
+
+void EquationCache::Write(const Entry &k, const ConstraintBase *c,
+                          IdList<Equation,hEquation> *l) {
+    // All of them at once, as if each had been allocated in turn
+    Expr *nodes = (Expr *)AllocTemporary(k.nodes.size() * sizeof(Expr));
+    Expr::allocatedOnThread += k.nodes.size();
+    for(size_t i = 0; i < k.nodes.size(); i++) {
+        const Node &n = k.nodes[i];
+        Expr &e = nodes[i];
+        e.op = n.op;
+        if(n.a >= 0) {
+            e.a = &nodes[n.a];
+            e.b = (n.b >= 0) ? &nodes[n.b] : NULL;
+        } else if(n.op != Expr::Op::PARAM) {
+            e.v = n.v;
+        } else if(n.parh == VALUE) {
+            e = Expr(c->valA);
+        } else {
+            e.parh = n.parh;
+        }
+    }
+    for(const Root &r : k.roots) {
+        Equation eq = {};
+        eq.h      = r.h;
+        eq.e      = &nodes[r.node];
+        eq.kernel = r.kernel;
+        if(r.value) eq.kernel.value = c->valA;
+        l->Add(&eq);
+    }
+}
+
+void EquationCache::Keep(Entry &&e) {
+    hConstraint hc = e.constraint.h;
+    entries[hc] = std::move(e);
+}
+
+void EquationCache::Prune(hGroup hg, size_t inGroup) {
+    if(entries.size() <= inGroup) return;
+    for(auto it = entries.begin(); it != entries.end();) {
+        const ConstraintBase *c = SK.constraint.FindByIdNoOops(it->first);
+        if(c == nullptr || c->group != hg) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 void System::WriteEquationsExceptFor(hConstraint hc, Group *g) {
-    // Generate all the equations from constraints in this group
-    for(auto &con : SK.constraint) {
-        ConstraintBase *c = &con;
-        if(c->group != g->h) continue;
-        if(c->h == hc) continue;
+    PhaseTimer timer(&stats.writeEquationsMs);
+    // Find the constraints in this group to generate equations for
+    std::vector<ConstraintBase *> constraints;
+    size_t inGroup = 0;
+    SK.ForEachConstraintIn(g->h, [&](ConstraintBase *c) {
+        inGroup++;
+        if(c->h == hc) return;
+        if(settledConstraints.count(c->h)) return;
 
         if(c->HasLabel() && c->type != Constraint::Type::COMMENT &&
                 g->allDimsReference)
@@ -366,80 +2454,420 @@ void System::WriteEquationsExceptFor(hConstraint hc, Group *g) {
             // When all dimensions are reference, we adjust them to display
             // the correct value, and then don't generate any equations.
             c->ModifyToSatisfy();
-            continue;
+            return;
         }
         if(g->relaxConstraints && c->type != Constraint::Type::POINTS_COINCIDENT) {
             // When the constraints are relaxed, we keep only the point-
             // coincident constraints, and the constraints generated by
             // the entities and groups.
-            continue;
+            return;
         }
-
-        c->GenerateEquations(&eq);
+        if(stage >= 0 && StageOf(c->type) > stage) return;
+        constraints.push_back(c);
+    });
+    // And the entities
+    std::vector<EntityBase *> entities;
+    SK.ForEachEntityIn(g->h, [&](EntityBase *e) {
+        if(settledEntities.count(e->h)) return;
+        entities.push_back(e);
+    });
+
+    // Each one's equations depend on nothing but the sketch, so they can be
+    // generated in any order, or on several threads at once, each in to
+    // lists and arenas of its own that are merged after; the equations'
+    // handles say where they go. A constraint's equations that were kept
+    // from the last solve are copied rather than written again; a big one's
+    // are kept the second time that they're written, so that a sketch that's
+    // solved once pays nothing for it, and what's new is kept once they're
+    // all merged.
+    struct Share {
+        IdList<Equation,hEquation>          eq;
+        std::vector<Platform::TemporaryPage> pages;
+        size_t                              exprs = 0;
+        hConstraint                         heaviest = {};
+        size_t                              heaviestExprs = 0;
+        std::vector<std::pair<hConstraint, size_t>> exprNodes;
+        EquationCache::Structures           structures;
+        std::vector<EquationCache::Entry>   fresh;
+    };
+    auto write = [&](Share *s, ConstraintBase *c, IdList<Equation,hEquation> *l) {
+        if(equationCache == nullptr || !EquationCache::Keeps(c, polynomialForms)) {
+            c->GenerateEquations(l, /*forReference=*/false, polynomialForms);
+            return;
+        }
+        const EquationCache::Entry *k = equationCache->Find(c, &s->structures);
+        if(k == NULL) {
+            EquationCache::Entry e = EquationCache::Note(c, l);
+            if(e.flatten) s->fresh.push_back(std::move(e));
+        } else if(!k->roots.empty()) {
+            EquationCache::Write(*k, c, l);
+        } else if(k->flatten) {
+            s->fresh.push_back(EquationCache::Flatten(c, &s->structures, l));
+        } else {
+            c->GenerateEquations(l);
+        }
+    };
+    auto generate = [&](Share *s, IdList<Equation,hEquation> *l,
+                        size_t cBegin, size_t cEnd, size_t eBegin, size_t eEnd) {
+        size_t start = Expr::allocatedOnThread;
+        for(size_t i = cBegin; i < cEnd; i++) {
+            ConstraintBase *c = constraints[i];
+            size_t before = Expr::allocatedOnThread;
+            write(s, c, l);
+            size_t exprs = Expr::allocatedOnThread - before;
+            if(exprs > s->heaviestExprs) {
+                s->heaviest      = c->h;
+                s->heaviestExprs = exprs;
+            }
+            if(profile && exprs > 0) s->exprNodes.emplace_back(c->h, exprs);
+        }
+        for(size_t i = eBegin; i < eEnd; i++) {
+            entities[i]->GenerateEquations(l);
+        }
+        s->exprs = Expr::allocatedOnThread - start;
+    };
+
+    const size_t count = constraints.size() + entities.size();
+    std::vector<Share> shares;
+    if(workers > 1 && count >= PARALLEL_EQUATIONS) {
+        EvalTeam team(workers);
+        shares.resize(workers);
+        team.Run([&](int t) {
+            size_t cBegin, cEnd, eBegin, eEnd;
+            team.Share(t, constraints.size(), &cBegin, &cEnd);
+            team.Share(t, entities.size(), &eBegin, &eEnd);
+            generate(&shares[t], &shares[t].eq, cBegin, cEnd, eBegin, eEnd);
+            // The other threads' expressions have to outlive them.
+            if(t > 0) shares[t].pages = Platform::GiveTemporary();
+        });
+        for(Share &s : shares) {
+            Platform::TakeTemporary(s.pages);
+            if(&s != &shares[0]) Expr::allocatedOnThread += s.exprs;
+            for(Equation &e : s.eq) eq.AddUnordered(&e);
+        }
+        eq.SortById();
+    } else {
+        shares.resize(1);
+        generate(&shares[0], &eq, 0, constraints.size(), 0, entities.size());
     }
-    // And the equations from entities
-    for(auto &ent : SK.entity) {
-        EntityBase *e = &ent;
-        if(e->group != g->h) continue;
 
-        e->GenerateEquations(&eq);
+    for(Share &s : shares) {
+        if(s.heaviestExprs > stats.heaviestConstraintExprs) {
+            stats.heaviestConstraint      = s.heaviest;
+            stats.heaviestConstraintExprs = s.heaviestExprs;
+        }
+        for(auto &n : s.exprNodes) stats.constraints[n.first.v].exprNodes = n.second;
+        if(equationCache != nullptr) {
+            for(EquationCache::Entry &e : s.fresh) equationCache->Keep(std::move(e));
+        }
     }
+    if(equationCache != nullptr) equationCache->Prune(g->h, inGroup);
     // And from the groups themselves
     g->GenerateEquations(&eq);
 }
 
+// With StartMode::STAGED, move the unknowns toward a solution a class of
+// constraints at a time, before Solve writes them all. A stage that doesn't
+// converge (say one that leaves a mechanism that only the later constraints
+// hold) is taken back, so that the full solve starts from no worse than the
+// stage before it.
+void System::SolveStages(Group *g) {
+    if(g->relaxConstraints || g->allDimsReference) return;
+
+    int present[5] = {};
+    SK.ForEachConstraintIn(g->h, [&](ConstraintBase *c) {
+        if(settledConstraints.count(c->h)) return;
+        present[StageOf(c->type)]++;
+    });
+    int last = 4;
+    while(last > 0 && present[last] == 0) last--;
+
+    std::vector<double> before(param.n);
+    for(stage = 0; stage < last && !Expired(); stage++) {
+        if(present[stage] == 0) continue;
+
+        eq.Clear();
+        WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+        param.ClearTags();
+        eq.ClearTags();
+        for(int i = 0; i < param.n; i++) {
+            before[i] = param[i].val;
+        }
+        if(WriteJacobian(0) && NewtonSolve()) continue;
+        for(int i = 0; i < param.n; i++) {
+            param[i].val = before[i];
+        }
+    }
+    stage = -1;
+    eq.Clear();
+}
+
+bool System::RemovingFixesJacobian(hConstraint hc, Group *g, bool forceDofCheck) {
+    param.ClearTags();
+    eq.Clear();
+    WriteEquationsExceptFor(hc, g);
+    eq.ClearTags();
+
+    // It's a major speedup to solve the easy ones by substitution here,
+    // and that doesn't break anything.
+    if(!forceDofCheck) {
+        SolveBySubstitution();
+    }
+
+    if(!WriteJacobian(0)) return false;
+    // If the pattern is short of full rank, then so are the values.
+    if(StructuralRank() < mat.m) return false;
+    EvalJacobian();
+
+    // We fixed it by removing this constraint
+    return CalculateRank() == mat.m;
+}
+
+// Find an orthonormal basis for the nullspace of A, from a rank revealing QR:
+// with A P = Q [R11 R12; 0 0], the null vectors are P [-R11^-1 R12; I].
+bool System::NullspaceBasis(const Eigen::SparseMatrix<double> &A, Eigen::MatrixXd *U) {
+    using namespace Eigen;
+    const int n = (int)A.cols();
+    if(A.rows() == 0 || n == 0) {
+        *U = MatrixXd::Identity(n, n);
+        return true;
+    }
+
+    ReusableSparseQR factored;
+    factored.Factorize(A, mat.ordering, qrBackend);
+    if(factored.Info() != Success) return false;
+    CountFactor(factored.FactorNonZeros());
+    const int r = (int)factored.Rank(), d = n - r;
+    if(d == 0) {
+        U->resize(n, 0);
+        return true;
+    }
+
+    const SparseMatrix<double> &R = factored.MatrixR();
+    MatrixXd N(n, d);
+    if(r > 0) {
+        MatrixXd R12 = MatrixXd(R.block(0, r, r, d));
+        N.topRows(r) = -R.topLeftCorner(r, r).triangularView<Upper>().solve(R12);
+    }
+    N.bottomRows(d).setIdentity();
+    N = factored.ColsPermutation() * N;
+
+    // Orthonormalize, so that tests on the basis have a fixed scale.
+    HouseholderQR<MatrixXd> nqr(N);
+    *U = nqr.householderQ() * MatrixXd::Identity(n, d);
+    return true;
+}
+
+void System::FindRedundantFromNullspace(Group *g, const std::vector<hConstraint> &candidates,
+                                        bool forceDofCheck, std::vector<char> *fixes,
+                                        std::vector<char> *decided)
+{
+    using namespace Eigen;
+
+    param.ClearTags();
+    eq.Clear();
+    WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    eq.ClearTags();
+    if(!forceDofCheck) {
+        SolveBySubstitution();
+    }
+    if(!WriteJacobian(0)) return;
+    EvalJacobian();
+    if(mat.m == 0) return;
+
+    // Removing a constraint changes what gets substituted only if one of its
+    // equations was substituted; otherwise the system without it is exactly
+    // this one, less its rows. The rest have to be tested the long way.
+    std::unordered_map<uint32_t, int> candidateIndex;
+    for(size_t i = 0; i < candidates.size(); i++) {
+        candidateIndex[candidates[i].v] = (int)i;
+    }
+    std::vector<char> substituted(candidates.size(), 0);
+    for(Equation &e : eq) {
+        if(e.tag != EQ_SUBSTITUTED || !e.h.isFromConstraint()) continue;
+        auto it = candidateIndex.find(e.h.constraint().v);
+        if(it != candidateIndex.end()) substituted[it->second] = 1;
+    }
+    std::vector<std::vector<int>> rows(candidates.size());
+    for(int i = 0; i < mat.m; i++) {
+        if(!mat.eq[i]->h.isFromConstraint()) continue;
+        auto it = candidateIndex.find(mat.eq[i]->h.constraint().v);
+        if(it != candidateIndex.end()) rows[it->second].push_back(i);
+    }
+
+    // The rows are at least as dependent as the pattern says: there are as
+    // many dependencies as the rows' shortfall from the structural rank, or
+    // more, and they're all among the overdetermined rows. A candidate with
+    // fewer rows than that, or without one of its rows in there, can't fix
+    // the Jacobian; if that's all of them, nothing needs factoring.
+    std::vector<char> overdetermined;
+    const int shortfall = mat.m - StructuralRank(&overdetermined);
+    bool anyLeft = false;
+    for(size_t c = 0; c < candidates.size(); c++) {
+        if(substituted[c] || shortfall == 0) {
+            anyLeft = anyLeft || !substituted[c];
+            continue;
+        }
+        bool touches = false;
+        for(int i : rows[c]) touches = touches || overdetermined[i];
+        if(!touches || (int)rows[c].size() < shortfall) {
+            (*decided)[c] = 1;
+        } else {
+            anyLeft = true;
+        }
+    }
+    if(!anyLeft) return;
+
+    // The dependencies among the rows are the left nullspace of the Jacobian.
+    SparseMatrix<double> At = mat.A.num.transpose();
+    At.makeCompressed();
+    MatrixXd U;
+    if(!NullspaceBasis(At, &U)) return;
+    const int d = (int)U.cols();
+    if(d == 0) return;
+
+    // Removing a constraint leaves the remaining rows independent exactly
+    // when every dependency involves its rows, i.e. when U restricted to
+    // its rows still has full column rank.
+    for(size_t c = 0; c < candidates.size(); c++) {
+        if(substituted[c] || (*decided)[c]) continue;
+        (*decided)[c] = 1;
+        if((int)rows[c].size() < d) continue;
+
+        MatrixXd Uc(rows[c].size(), d);
+        for(size_t i = 0; i < rows[c].size(); i++) {
+            Uc.row(i) = U.row(rows[c][i]);
+        }
+        JacobiSVD<MatrixXd> svd(Uc);
+        if(svd.singularValues()(d - 1) > NULLSPACE_TOLERANCE) {
+            (*fixes)[c] = 1;
+        }
+    }
+}
+
 void System::FindWhichToRemoveToFixJacobian(Group *g, List<hConstraint> *bad, bool forceDofCheck) {
+    PhaseTimer timer(&stats.findBadMs);
+    PhaseTrace span(this, Phase::FIND_BAD);
     auto time = GetMilliseconds();
     g->solved.timeout = false;
-    int a;
-
-    for(a = 0; a < 2; a++) {
-        for(auto &con : SK.constraint) {
-            if((GetMilliseconds() - time) > g->solved.findToFixTimeout) {
-                g->solved.timeout = true;
-                return;
-            }
-
-            ConstraintBase *c = &con;
-            if(c->group != g->h) continue;
+    // The search's own time limit, if it has one, as well as the solve's.
+    auto outOfTime = [&](System *s) {
+        return s->Expired() || (g->solved.findToFixTimeout > 0 &&
+                                (GetMilliseconds() - time) > g->solved.findToFixTimeout);
+    };
+
+    // Do the constraints in two passes: first everything but the point-
+    // coincident constraints, then only those constraints (so they appear
+    // last in the list).
+    std::vector<hConstraint> candidates;
+    for(int a = 0; a < 2; a++) {
+        SK.ForEachConstraintIn(g->h, [&](ConstraintBase *c) {
             if((c->type == Constraint::Type::POINTS_COINCIDENT && a == 0) ||
                (c->type != Constraint::Type::POINTS_COINCIDENT && a == 1))
             {
-                // Do the constraints in two passes: first everything but
-                // the point-coincident constraints, then only those
-                // constraints (so they appear last in the list).
-                continue;
+                return;
             }
+            candidates.push_back(c->h);
+        });
+    }
+
+    // Whether removing each candidate fixes the Jacobian, and whether it got
+    // tested at all before we timed out.
+    std::vector<char> fixes(candidates.size(), 0), tested(candidates.size(), 0);
+
+    // Most of them can be decided at once, from one factorization; the
+    // exhaustive search below only does the ones that can't.
+    FindRedundantFromNullspace(g, candidates, forceDofCheck, &fixes, &tested);
+    // Those with equations that were substituted away are decided the same
+    // way, from the Jacobian written without substituting anything: a bigger
+    // one than before, but just the one, rather than one for each of them.
+    if(!forceDofCheck && std::find(tested.begin(), tested.end(), 0) != tested.end()) {
+        FindRedundantFromNullspace(g, candidates, /*forceDofCheck=*/true, &fixes, &tested);
+    }
+    std::vector<size_t> search;
+    for(size_t i = 0; i < candidates.size(); i++) {
+        if(!tested[i]) search.push_back(i);
+    }
 
-            param.ClearTags();
+    // With all dimensions reference, writing the equations modifies the
+    // constraints, so those can't be written from more than one thread.
+    int threads = std::min(workers, (int)search.size());
+    if(threads <= 1 || g->allDimsReference) {
+        for(size_t i : search) {
+            if(outOfTime(this)) break;
+            TemporaryMark mark = MarkTemporary();
+            fixes[i] = RemovingFixesJacobian(candidates[i], g, forceDofCheck);
+            tested[i] = 1;
+            // Nothing outlives the test, so the equations can go.
             eq.Clear();
-            WriteEquationsExceptFor(c->h, g);
-            eq.ClearTags();
+            ReleaseTemporary(mark);
+        }
+    } else {
+        // Each candidate is written and tested from scratch on a System of
+        // the worker's own; the timeout applies to the batch as a whole.
+        std::vector<std::unique_ptr<System>> local(threads);
+        for(auto &ls : local) {
+            ls = MakeWorker();
+        }
 
-            // It's a major speedup to solve the easy ones by substitution here,
-            // and that doesn't break anything.
-            if(!forceDofCheck) {
-                SolveBySubstitution();
+        std::atomic<size_t> next(0);
+        std::atomic<bool> stop(false);
+        Sketch *sketch = &SK;
+        auto work = [&](System *ls) {
+            ShareSketch(sketch);
+            AllocationCount count(&ls->stats);
+            for(size_t k; !stop && (k = next++) < search.size();) {
+                size_t i = search[k];
+                if(outOfTime(ls)) {
+                    stop = true;
+                    break;
+                }
+                fixes[i] = ls->RemovingFixesJacobian(candidates[i], g, forceDofCheck);
+                tested[i] = 1;
+                // Nothing outlives the test, so the equations can go.
+                ls->eq.Clear();
+                FreeAllTemporary();
             }
+        };
+        std::vector<std::thread> pool;
+        for(int t = 0; t < threads; t++) {
+            pool.emplace_back(work, local[t].get());
+        }
+        for(std::thread &th : pool) {
+            th.join();
+        }
+        for(auto &ls : local) {
+            stats.Add(ls->stats);
+            if(ls->timedOut) timedOut = true;
+            if(ls->outOfMemory) outOfMemory = true;
+        }
+    }
 
-            WriteJacobian(0);
-            EvalJacobian();
-
-            int rank = CalculateRank();
-            if(rank == mat.m) {
-                // We fixed it by removing this constraint
-                bad->Add(&(c->h));
-            }
+    // Report the same thing as a serial search that stopped at the first
+    // candidate that didn't get tested.
+    for(size_t i = 0; i < candidates.size(); i++) {
+        if(!tested[i]) {
+            g->solved.timeout = true;
+            return;
         }
+        if(fixes[i]) bad->Add(&candidates[i]);
     }
 }
 
 SolveResult System::Solve(Group *g, int *dof, List<hConstraint> *bad,
                           bool andFindBad, bool andFindFree, bool forceDofCheck)
 {
+    ResetStats();
+    PhaseTrace span(this, Phase::SOLVE);
+    AllocationCount count(&stats);
+    if(startMode == StartMode::STAGED) SolveStages(g);
     WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    stats.equations = eq.n;
+    stats.unknowns  = param.n;
 
     bool rankOk;
+    // The equations left unsatisfied, if we fail to converge
+    std::vector<Equation *> unsatisfied;
 
     // int x;
     // printf("%d equations", eq.n);
@@ -462,63 +2890,115 @@ SolveResult System::Solve(Group *g, int *dof, List<hConstraint> *bad,
     if(g->suppressDofCalculation || g->allowRedundant || !forceDofCheck) {
         subMap = SolveBySubstitution();
     }
+    std::vector<NormalChart> charts;
+    if(chartNormals) ChartNormals(&charts);
+    stats.equations -= (int)charts.size();
+    stats.unknowns  -= (int)charts.size();
 
     // Before solving the big system, see if we can find any equations that
     // are soluble alone. This can be a huge speedup. We don't know whether
     // the system is consistent yet, but if it isn't then we'll catch that
     // later.
-    int alone = 1;
-    for(auto &e : eq) {
-        if(e.tag != 0)
-            continue;
-
-        hParam hp = e.e->ReferencedParams(&param);
-        if(hp == Expr::NO_PARAMS) continue;
-        if(hp == Expr::MULTIPLE_PARAMS) continue;
-
-        Param *p = param.FindById(hp);
-        if(p->tag != 0) continue; // let rank test catch inconsistency
-
-        e.tag  = alone;
-        p->tag = alone;
-        WriteJacobian(alone);
-        if(!NewtonSolve()) {
+    Unpin pinned;
+    {
+        PhaseTimer timer(&stats.aloneMs);
+        FoldPinnedParams(&pinned.params);
+        if(!SolveAlone(&unsatisfied)) {
+            if(timedOut) return SolveResult::TIMED_OUT;
             // We don't do the rank test, so let's arbitrarily return
             // the DIDNT_CONVERGE result here.
             rankOk = true;
             // Failed to converge, bail out early
             goto didnt_converge;
         }
-        alone++;
     }
 
-    // Now write the Jacobian for what's left, and do a rank test; that
-    // tells us if the system is inconsistently constrained.
-    if(!WriteJacobian(0)) {
-        return SolveResult::TOO_MANY_UNKNOWNS;
-    }
-    // Clear dof value in order to have indication when dof is actually not calculated
-    if(dof != NULL) *dof = -1;
-    // We are suppressing or allowing redundant, so we no need to catch unsolveable + redundant
-    rankOk = (!g->suppressDofCalculation && !g->allowRedundant) ? TestRank(dof) : true;
+    PlaceRigidClusters();
+
+    {
+        // Everything that's left splits into blocks that share no unknowns
+        // (the terms in the Jacobian are block diagonal), so each one can be
+        // linearized, rank tested and solved on its own, and the cost of the
+        // factorizations goes with the largest block, not the whole sketch.
+        // So does the limit on unknowns.
+        int unusedParams;
+        std::vector<Block> blocks = FindIndependentBlocks(&unusedParams);
+        const Block *largest = NULL;
+        for(const Block &b : blocks) {
+            if(largest == NULL || b.eq.size() > largest->eq.size()) largest = &b;
+        }
+        if(largest != NULL) {
+            stats.largestBlockEquations = (int)largest->eq.size();
+            stats.largestBlockUnknowns  = (int)largest->param.size();
+            if(TooManyUnknowns(largest->eq.size())) {
+                // Report the constraints that make it up, which are the ones
+                // to split it at.
+                std::unordered_set<hConstraint, HandleHasher<hConstraint>> reported;
+                for(Equation *e : largest->eq) {
+                    if(!e->h.isFromConstraint()) continue;
+                    hConstraint hc = e->h.constraint();
+                    if(reported.insert(hc).second) bad->Add(&hc);
+                }
+                return SolveResult::TOO_MANY_UNKNOWNS;
+            }
+        }
+
+        // Clear dof value in order to have indication when dof is actually not calculated
+        if(dof != NULL) *dof = -1;
+        // We are suppressing or allowing redundant, so we no need to catch unsolveable + redundant
+        bool testRankFirst = !g->suppressDofCalculation && !g->allowRedundant;
+        // Here we are want to calculate dof even when redundant is allowed, so just handle suppressing
+        bool testRankAfter = !g->suppressDofCalculation;
+
+        std::vector<BlockResult> results;
+        SolveBlocks(blocks, testRankFirst, testRankAfter, &results);
+        if(timedOut) return SolveResult::TIMED_OUT;
+
+        bool converged = true;
+        bool rankOkAfter = true;
+        int dofFirst = unusedParams, dofAfter = unusedParams;
+        rankOk = true;
+        dofOf.clear();
+        for(size_t i = 0; i < blocks.size(); i++) {
+            if(!blocks[i].param.empty()) dofOf[blocks[i].param[0]->h.v] = results[i].dofAfter;
+            for(Param *p : blocks[i].param) p->tag = VAR_IN_BLOCK;
+        }
+        for(Param &p : param) {
+            if(p.tag == 0) dofOf[p.h.v] = 1;
+            if(p.tag == VAR_IN_BLOCK) p.tag = 0;
+        }
+        for(BlockResult &r : results) {
+            if(!r.rankOkFirst) rankOk = false;
+            if(!r.converged)   converged = false;
+            if(!r.rankOkAfter) rankOkAfter = false;
+            dofFirst += r.dofFirst;
+            dofAfter += r.dofAfter;
+            unsatisfied.insert(unsatisfied.end(),
+                               r.unsatisfied.begin(), r.unsatisfied.end());
+        }
 
-    // And do the leftovers as one big system
-    if(!NewtonSolve()) {
-        goto didnt_converge;
+        if(!converged) {
+            if(dof != NULL && testRankFirst) *dof = dofFirst;
+            goto didnt_converge;
+        }
+        if(dof != NULL && testRankAfter) *dof = dofAfter;
+        rankOk = testRankAfter ? rankOkAfter : true;
     }
+    // Finding what to remove, or what's free, takes them as unknowns again.
+    pinned.Now();
 
-    // Here we are want to calculate dof even when redundant is allowed, so just handle suppressing
-    rankOk = (!g->suppressDofCalculation) ? TestRank(dof) : true;
     if(!rankOk) {
         if(andFindBad) FindWhichToRemoveToFixJacobian(g, bad, forceDofCheck);
     } else {
         MarkParamsFree(andFindFree);
     }
+    if(timedOut) return SolveResult::TIMED_OUT;
     // System solved correctly, so write the new values back in to the
     // main parameter table.
+    for(NormalChart &c : charts) c.param->val = c.Value();
     for(auto &p : param) {
         auto it = subMap.find(p.h);
-        double val = it == subMap.end() ? p.val : it->second->val;
+        double val = it == subMap.end() ? p.val : it->second.Value();
 
         Param *pp = SK.GetParam(p.h);
         pp->val = val;
@@ -528,21 +3008,20 @@ SolveResult System::Solve(Group *g, int *dof, List<hConstraint> *bad,
     return rankOk ? SolveResult::OKAY : SolveResult::REDUNDANT_OKAY;
 
 didnt_converge:
-    SK.constraint.ClearTags();
-    // Not using range-for here because index is used in additional ways
-    for(size_t i = 0; i < mat.eq.size(); i++) {
-        if(fabs(mat.B.num[i]) > CONVERGE_TOLERANCE || IsReasonable(mat.B.num[i])) {
-            // This constraint is unsatisfied.
-            if(!mat.eq[i]->h.isFromConstraint()) continue;
-
-            hConstraint hc = mat.eq[i]->h.constraint();
+    {
+        // Groups of one sketch can be solved at once, so the constraints'
+        // tags aren't ours to use here.
+        std::unordered_set<hConstraint, HandleHasher<hConstraint>> reported;
+        for(Equation *e : unsatisfied) {
+            if(!e->h.isFromConstraint()) continue;
+
+            hConstraint hc = e->h.constraint();
             ConstraintBase *c = SK.constraint.FindByIdNoOops(hc);
             if(!c) continue;
             // Don't double-show constraints that generated multiple
             // unsatisfied equations
-            if(!c->tag) {
+            if(reported.insert(c->h).second) {
                 bad->Add(&(c->h));
-                c->tag = 1;
             }
         }
     }
@@ -550,10 +3029,421 @@ didnt_converge:
     return rankOk ? SolveResult::DIDNT_CONVERGE : SolveResult::REDUNDANT_DIDNT_CONVERGE;
 }
 
+void System::FindUnsatisfied(std::vector<Equation *> *unsatisfied) {
+    // Not using range-for here because index is used in additional ways
+    for(size_t i = 0; i < mat.eq.size(); i++) {
+        if(fabs(mat.B.num[i]) > convergeTolerance || IsReasonable(mat.B.num[i])) {
+            // This constraint is unsatisfied.
+            unsatisfied->push_back(mat.eq[i]);
+        }
+    }
+}
+
+std::vector<System::Block> System::FindIndependentBlocks(int *unusedParams) {
+    // Number the unknowns, and union-find them into connected components,
+    // joining all the unknowns that appear in the same equation.
+    std::unordered_map<uint32_t, int> paramToIndex;
+    std::vector<Param *> params;
+    for(Param &p : param) {
+        if(p.tag != 0) continue;
+        paramToIndex[p.h.v] = (int)params.size();
+        params.push_back(&p);
+    }
+
+    std::vector<int> parent(params.size());
+    for(size_t i = 0; i < parent.size(); i++) parent[i] = (int)i;
+    auto root = [&](int i) {
+        while(parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+
+    // The first unknown of each equation, or -1 for an equation that doesn't
+    // reference any of them.
+    std::vector<Equation *> eqs;
+    std::vector<int> eqParam;
+    ParamSet paramsUsed;
+    for(Equation &e : eq) {
+        if(e.tag != 0) continue;
+        paramsUsed.clear();
+        e.e->ParamsUsedList(&paramsUsed);
+
+        int first = -1;
+        for(hParam hp : paramsUsed) {
+            auto it = paramToIndex.find(hp.v);
+            if(it == paramToIndex.end()) continue;
+            if(first < 0) {
+                first = it->second;
+            } else {
+                int ra = root(first), rb = root(it->second);
+                if(ra != rb) parent[std::max(ra, rb)] = std::min(ra, rb);
+            }
+        }
+        eqs.push_back(&e);
+        eqParam.push_back(first);
+    }
+
+    // Blocks are numbered in the order that their first equation appears,
+    // so that the order we solve in is deterministic.
+    std::vector<Block> blocks;
+    std::vector<int> rootToBlock(params.size(), -1);
+    int constBlock = -1;
+    for(size_t i = 0; i < eqs.size(); i++) {
+        int *bi;
+        if(eqParam[i] < 0) {
+            // These can't be satisfied by changing any unknowns, but keep them
+            // together so that the rank test and Newton's method fail on them
+            // just like they would have in a single system.
+            bi = &constBlock;
+        } else {
+            bi = &rootToBlock[root(eqParam[i])];
+        }
+        if(*bi < 0) {
+            *bi = (int)blocks.size();
+            blocks.emplace_back();
+        }
+        blocks[*bi].eq.push_back(eqs[i]);
+    }
+
+    *unusedParams = 0;
+    for(size_t i = 0; i < params.size(); i++) {
+        int bi = rootToBlock[root((int)i)];
+        if(bi < 0) {
+            // Not referenced by any equation, so it's an unconstrained degree
+            // of freedom all by itself.
+            (*unusedParams)++;
+            continue;
+        }
+        blocks[bi].param.push_back(params[i]);
+    }
+    for(Block &b : blocks) {
+        OrderForLocality(&b.eq, &b.param);
+    }
+    return blocks;
+}
+
+// A System that can solve or test parts of this one on another thread: it has
+// the same settings, and its own copy of the parameters.
+std::unique_ptr<System> System::MakeWorker() {
+    std::unique_ptr<System> ls(new System());
+    param.DeepCopyInto(&ls->param);
+    ls->dragged           = dragged;
+    ls->maxUnknowns       = maxUnknowns;
+    ls->stepMode          = stepMode;
+    ls->jacobianMode      = jacobianMode;
+    ls->leastSquaresMode  = leastSquaresMode;
+    ls->jacobianUpdate    = jacobianUpdate;
+    ls->startMode         = startMode;
+    ls->fillOrdering      = fillOrdering;
+    ls->qrBackend         = qrBackend;
+    ls->polynomialForms   = polynomialForms;
+    ls->chartNormals      = chartNormals;
+    ls->maxIterations     = maxIterations;
+    ls->convergeTolerance = convergeTolerance;
+    ls->profile           = profile;
+    ls->deadline          = deadline;
+    ls->cancel            = cancel;
+    ls->memoryBudget      = memoryBudget;
+    ls->trace             = trace;
+    ls->traceUser         = traceUser;
+    ls->traceSteps        = traceSteps;
+    return ls;
+}
+
+void System::SolveBlock(const Block &b, bool testRankFirst, bool testRankAfter,
+                        BlockResult *r)
+{
+    mat.eq = b.eq;
+    mat.param.clear();
+    for(Param *p : b.param) mat.param.push_back(p->h);
+    WriteJacobian();
+
+    // Newton's method factors the Jacobian anyway, so the rank tests only
+    // need factorizations of their own when it couldn't give us the rank.
+    std::vector<double> start;
+    if(testRankFirst) {
+        for(Param *p : b.param) start.push_back(param.FindById(p->h)->val);
+    }
+    int rankBefore, rankAfter;
+    bool converged = NewtonSolve(&rankBefore, &rankAfter);
+
+    if(testRankFirst) {
+        if(rankBefore < 0) {
+            // Go back to where we started for the test.
+            std::vector<double> end;
+            for(size_t i = 0; i < b.param.size(); i++) {
+                Param *p = param.FindById(b.param[i]->h);
+                end.push_back(p->val);
+                p->val = start[i];
+            }
+            r->rankOkFirst = TestRank(&r->dofFirst);
+            for(size_t i = 0; i < b.param.size(); i++) {
+                param.FindById(b.param[i]->h)->val = end[i];
+            }
+        } else {
+            r->rankOkFirst = (rankBefore == mat.m);
+            r->dofFirst = mat.n - rankBefore;
+        }
+    }
+    if(converged) {
+        if(testRankAfter) {
+            if(rankAfter < 0) {
+                r->rankOkAfter = TestRank(&r->dofAfter);
+            } else {
+                r->rankOkAfter = (rankAfter == mat.m);
+                r->dofAfter = mat.n - rankAfter;
+            }
+        }
+    } else {
+        // Keep going, so that the unsatisfied constraints in every
+        // block get reported, and not just those in the first one.
+        r->converged = false;
+        FindUnsatisfied(&r->unsatisfied);
+    }
+}
+
+void System::ShapeOfBlock(const Block &b, std::vector<Param *> *order,
+                          std::vector<uint64_t> *shape)
+{
+    order->clear();
+    shape->clear();
+    std::unordered_set<Param *> inBlock(b.param.begin(), b.param.end());
+    std::unordered_map<Param *, uint64_t> number;
+    auto bits = [](double v) {
+        uint64_t u;
+        memcpy(&u, &v, sizeof(u));
+        return u;
+    };
+    std::function<void(const Expr *)> walk = [&](const Expr *e) {
+        shape->push_back((uint64_t)e->op);
+        if(e->op == Expr::Op::PARAM) {
+            Param *p = param.FindByIdNoOops(e->parh);
+            if(p != NULL) {
+                auto it = number.find(p);
+                if(it == number.end()) {
+                    it = number.emplace(p, order->size()).first;
+                    order->push_back(p);
+                }
+                // Whether it's an unknown, or one that's dragged (and so is
+                // solved for differently), or already solved alone
+                uint64_t kind = !inBlock.count(p) ? 2 : IsDragged(p->h) ? 1 : 0;
+                shape->push_back(it->second * 4 + kind);
+            } else {
+                // Anything from another group is a constant, here.
+                shape->push_back(bits(SK.GetParam(e->parh)->val));
+            }
+        } else if(e->op == Expr::Op::CONSTANT) {
+            shape->push_back(bits(e->v));
+        } else {
+            int c = e->Children();
+            if(c >= 1) walk(e->a);
+            if(c >= 2) walk(e->b);
+        }
+    };
+    for(Equation *eq : b.eq) {
+        walk(eq->e);
+    }
+}
+
+// With the original's Jacobian written, try putting a copy of it where the
+// original went, moved by as much as the copy started from somewhere else
+// (the params that were solved alone, which the copy is placed relative to,
+// don't move): if the equations hold there, and the Jacobians at the start
+// and the end are the same as the original's, then that's what solving the
+// copy would have found, ranks and all. The original's params stand in for
+// the copy's to evaluate it, and are left as they were.
+bool System::PlaceCopy(const std::vector<Param *> &original,
+                       const std::vector<double> &originalStart,
+                       const std::vector<Param *> &copy, const std::vector<double> &copyStart,
+                       const Eigen::SparseMatrix<double> &jacobianStart,
+                       const Eigen::SparseMatrix<double> &jacobianEnd)
+{
+    auto same = [](const Eigen::SparseMatrix<double> &a, const Eigen::SparseMatrix<double> &b) {
+        const double *va = a.valuePtr(), *vb = b.valuePtr();
+        for(Eigen::Index i = 0; i < a.nonZeros(); i++) {
+            if(fabs(va[i] - vb[i]) > 1e-9 * (1 + fabs(vb[i]))) return false;
+        }
+        return true;
+    };
+    size_t n = original.size();
+    std::vector<double> end(n), moved(n);
+    for(size_t i = 0; i < n; i++) {
+        end[i]   = original[i]->val;
+        moved[i] = end[i] + (copyStart[i] - originalStart[i]);
+    }
+
+    for(size_t i = 0; i < n; i++) original[i]->val = copyStart[i];
+    EvalResiduals();
+    EvalJacobian(/*residualsCurrent=*/true);
+    bool ok = same(mat.A.num, jacobianStart);
+    if(ok) {
+        for(size_t i = 0; i < n; i++) original[i]->val = moved[i];
+        EvalResiduals();
+        EvalJacobian(/*residualsCurrent=*/true);
+        ok = !(mat.B.num.array().abs() > convergeTolerance).any() &&
+             same(mat.A.num, jacobianEnd);
+    }
+    for(size_t i = 0; i < n; i++) original[i]->val = end[i];
+    if(!ok) return false;
+
+    for(size_t i = 0; i < n; i++) copy[i]->val = moved[i];
+    return true;
+}
+
+void System::SolveBlocks(const std::vector<Block> &blocks, bool testRankFirst,
+                         bool testRankAfter, std::vector<BlockResult> *results)
+{
+    results->clear();
+    results->resize(blocks.size());
+
+    // Repeated sub-sketches make blocks that are copies of one another. Solve
+    // the first of each, and then try just moving it to where each copy is,
+    // and solve only the copies where that doesn't work.
+    std::vector<std::vector<Param *>> order(blocks.size());
+    std::vector<std::vector<size_t>> copies(blocks.size());
+    std::vector<char> isCopy(blocks.size(), 0);
+    {
+        std::map<std::vector<uint64_t>, size_t> first;
+        std::vector<uint64_t> shape;
+        for(size_t i = 0; i < blocks.size(); i++) {
+            ShapeOfBlock(blocks[i], &order[i], &shape);
+            auto it = first.emplace(std::move(shape), i).first;
+            if(it->second != i) {
+                copies[it->second].push_back(i);
+                isCopy[i] = 1;
+            }
+        }
+    }
+    std::vector<std::vector<double>> start(blocks.size());
+    std::vector<size_t> solve;
+    for(size_t i = 0; i < blocks.size(); i++) {
+        if(isCopy[i] || !copies[i].empty()) {
+            for(Param *p : order[i]) start[i].push_back(p->val);
+        }
+        if(!isCopy[i]) solve.push_back(i);
+    }
+    SolveSomeBlocks(blocks, solve, testRankFirst, testRankAfter, results);
+    if(timedOut) return;
+
+    solve.clear();
+    Eigen::SparseMatrix<double> jacobianStart, jacobianEnd;
+    for(size_t i = 0; i < blocks.size(); i++) {
+        if(copies[i].empty()) continue;
+        const BlockResult &r = (*results)[i];
+        if(!r.converged) {
+            solve.insert(solve.end(), copies[i].begin(), copies[i].end());
+            continue;
+        }
+        // The copies are placed relative to the params pinned outside the
+        // block, so those are read here rather than folded in.
+        std::vector<Param *> pinned;
+        for(Param *p : order[i]) {
+            if(p->tag != VAR_PINNED || !p->known) continue;
+            p->known = false;
+            pinned.push_back(p);
+        }
+        mat.eq = blocks[i].eq;
+        mat.param.clear();
+        for(Param *p : blocks[i].param) mat.param.push_back(p->h);
+        WriteJacobian();
+        std::vector<double> end;
+        for(size_t k = 0; k < order[i].size(); k++) {
+            end.push_back(order[i][k]->val);
+            order[i][k]->val = start[i][k];
+        }
+        EvalResiduals();
+        EvalJacobian(/*residualsCurrent=*/true);
+        jacobianStart = mat.A.num;
+        for(size_t k = 0; k < order[i].size(); k++) order[i][k]->val = end[k];
+        EvalResiduals();
+        EvalJacobian(/*residualsCurrent=*/true);
+        jacobianEnd = mat.A.num;
+
+        for(size_t j : copies[i]) {
+            if(PlaceCopy(order[i], start[i], order[j], start[j], jacobianStart, jacobianEnd)) {
+                (*results)[j] = r;
+                stats.copiedBlocks++;
+            } else {
+                solve.push_back(j);
+            }
+        }
+        for(Param *p : pinned) p->known = true;
+    }
+    std::sort(solve.begin(), solve.end());
+    SolveSomeBlocks(blocks, solve, testRankFirst, testRankAfter, results);
+}
+
+void System::SolveSomeBlocks(const std::vector<Block> &blocks, const std::vector<size_t> &which,
+                             bool testRankFirst, bool testRankAfter,
+                             std::vector<BlockResult> *results)
+{
+    int threads = std::min(workers, (int)which.size());
+    if(threads <= 1) {
+        for(size_t i = 0; i < which.size() && !Expired(); i++) {
+            SolveBlock(blocks[which[i]], testRankFirst, testRankAfter, &(*results)[which[i]]);
+        }
+        return;
+    }
+
+    // Each worker solves on a System of its own, with its own copy of the
+    // parameter table for the Newton iterations to write in to, so that the
+    // only thing shared between the threads is the (read only) equations.
+    // The expressions that a worker builds go in to its thread's temporary
+    // arena, which is freed when the thread exits; nothing in a result
+    // points in to it.
+    std::vector<std::unique_ptr<System>> local(threads);
+    for(auto &ls : local) {
+        ls = MakeWorker();
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<System *> solvedBy(which.size());
+    Sketch *sketch = &SK;
+    auto work = [&](System *ls) {
+        ShareSketch(sketch);
+        AllocationCount count(&ls->stats);
+        for(size_t i; !ls->Expired() && (i = next++) < which.size();) {
+            ls->SolveBlock(blocks[which[i]], testRankFirst, testRankAfter,
+                           &(*results)[which[i]]);
+            solvedBy[i] = ls;
+        }
+    };
+    std::vector<std::thread> pool;
+    for(int t = 0; t < threads; t++) {
+        pool.emplace_back(work, local[t].get());
+    }
+    for(std::thread &th : pool) {
+        th.join();
+    }
+    for(auto &ls : local) {
+        CountFactor(ls->factorNonZeros);
+        stats.Add(ls->stats);
+        if(ls->timedOut) timedOut = true;
+        if(ls->outOfMemory) outOfMemory = true;
+    }
+    // and then not every block got solved.
+    if(timedOut) return;
+
+    // Every block started from the same values as it would have serially,
+    // and touched only its own unknowns, so the values are the same whatever
+    // the schedule was.
+    for(size_t i = 0; i < which.size(); i++) {
+        for(Param *p : blocks[which[i]].param) {
+            p->val = solvedBy[i]->param.FindById(p->h)->val;
+        }
+    }
+}
+
 SolveResult System::SolveRank(Group *g, int *rank, int *dof, List<hConstraint> *bad,
                               bool andFindBad, bool andFindFree)
 {
+    ResetStats();
+    AllocationCount count(&stats);
     WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    stats.equations = eq.n;
+    stats.unknowns  = param.n;
 
     // All params and equations are assigned to group zero.
     param.ClearTags();
@@ -564,6 +3454,8 @@ SolveResult System::SolveRank(Group *g, int *rank, int *dof, List<hConstraint> *
     if(!WriteJacobian(0)) {
         return SolveResult::TOO_MANY_UNKNOWNS;
     }
+    stats.jacobianNonZeros = (size_t)mat.A.sym.nonZeros();
+    stats.jacobianEntries  = (size_t)mat.m * (size_t)mat.n;
 
     bool rankOk = TestRank(dof, rank);
     if(!rankOk) {
@@ -575,37 +3467,603 @@ SolveResult System::SolveRank(Group *g, int *rank, int *dof, List<hConstraint> *
     } else {
         MarkParamsFree(andFindFree);
     }
+    if(timedOut) return SolveResult::TIMED_OUT;
     return rankOk ? SolveResult::OKAY : SolveResult::REDUNDANT_OKAY;
 }
 
+bool System::Compile(Group *g) {
+    WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+
+    param.ClearTags();
+    eq.ClearTags();
+    compiledSubs = SolveBySubstitution();
+    bool ok = WriteJacobian(0);
+
+    // Find everything the tape reads, so that each lane can have values of
+    // its own for it.
+    lanes.input.clear();
+    lanes.inputReg.clear();
+    lanes.column.clear();
+    std::unordered_map<Param *, int> inputOf;
+    for(const ExprTape::Instr &in : mat.tape.code) {
+        if(in.op != Expr::Op::PARAM && in.op != Expr::Op::PARAM_PTR) continue;
+        Param *p = mat.tape.ParamOf(in);
+        inputOf[p] = (int)lanes.input.size();
+        lanes.input.push_back(p);
+        lanes.inputReg.push_back(in.dst);
+    }
+    if(ok) {
+        for(int j = 0; j < mat.n; j++) {
+            Param *p = param.FindById(mat.param[j]);
+            auto it = inputOf.find(p);
+            if(it == inputOf.end()) {
+                it = inputOf.emplace(p, (int)lanes.input.size()).first;
+                lanes.input.push_back(p);
+                lanes.inputReg.push_back(-1);
+            }
+            lanes.column.push_back(it->second);
+        }
+    }
+    lanes.value.resize(lanes.input.size() * ExprTape::LANES);
+    mat.tape.SpreadLanes(&lanes.reg);
+    mat.tape.SpreadLanes(&lanes.regSingle);
+
+    // Only the tape is needed from here on, so the expressions can go.
+    mat.eq.clear();
+    mat.A.sym.setZero();
+    mat.B.sym.clear();
+    eq.Clear();
+    return ok;
+}
+
+SolveResult System::Resolve(int *dof) {
+    ResetStats();
+    AllocationCount count(&stats);
+    stats.equations = mat.m;
+    stats.unknowns  = mat.n;
+    int rankBefore = 0, rankAfter = 0;
+    bool converged = true;
+    if(mat.m > 0) {
+        converged = NewtonSolve(&rankBefore, &rankAfter);
+    }
+    return FinishResolve(converged, rankAfter, dof);
+}
+
+SolveResult System::FinishResolve(bool converged, int rankAfter, int *dof) {
+    if(!converged) {
+        // Start the next attempt from where this one did, not from wherever
+        // it diverged to.
+        for(auto &p : param) {
+            p.val = SK.GetParam(p.h)->val;
+        }
+        if(dof != NULL) *dof = -1;
+        return timedOut ? SolveResult::TIMED_OUT : SolveResult::DIDNT_CONVERGE;
+    }
+
+    int rank = rankAfter;
+    if(rank < 0) {
+        // Newton's method couldn't say that the Jacobian at the solution has
+        // full rank.
+        EvalJacobian();
+        rank = CalculateRank();
+    }
+    if(dof != NULL) *dof = mat.n - rank;
+
+    for(auto &p : param) {
+        auto it = compiledSubs.find(p.h);
+        if(it != compiledSubs.end()) p.val = it->second.Value();
+
+        Param *pp = SK.GetParam(p.h);
+        pp->val   = p.val;
+        pp->known = true;
+    }
+    return (rank == mat.m) ? SolveResult::OKAY : SolveResult::REDUNDANT_OKAY;
+}
+
+SolveResult System::Drag(int64_t budgetUs) {
+    ResetStats();
+    AllocationCount count(&stats);
+    stats.equations = mat.m;
+    stats.unknowns  = mat.n;
+    const auto start = std::chrono::steady_clock::now();
+    auto outOfTime = [&]() {
+        if(budgetUs <= 0) return false;
+        auto spent = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::microseconds>(spent).count() >= budgetUs;
+    };
+
+    std::vector<Param *> params(mat.n);
+    for(int i = 0; i < mat.n; i++) {
+        params[i] = param.FindById(mat.param[i]);
+    }
+    std::vector<double> best(mat.n);
+    auto keep = [&]() {
+        for(int i = 0; i < mat.n; i++) best[i] = params[i]->val;
+    };
+    keep();
+
+    bool converged = true, outOfBudget = false;
+    double bestSq = 0;
+    if(mat.m > 0) {
+        stats.jacobianNonZeros += (size_t)mat.A.num.nonZeros();
+        stats.jacobianEntries  += (size_t)mat.m * (size_t)mat.n;
+        EvalResiduals();
+        double normSq = mat.B.num.squaredNorm();
+        bestSq = normSq;
+        converged = !(mat.B.num.array().abs() > convergeTolerance).any();
+        for(int iter = 0; !converged && iter < maxIterations; iter++) {
+            if(Expired() || (outOfBudget = outOfTime())) break;
+            EvalJacobian(/*residualsCurrent=*/true);
+            if(!SolveLeastSquares()) break;
+            stats.iterations++;
+
+            for(int i = 0; i < mat.n; i++) {
+                params[i]->val -= mat.X[i];
+            }
+            if(stepMode == StepMode::DAMPED) {
+                if(!LineSearch(params, &normSq)) break;
+            } else {
+                EvalResiduals();
+                if(!AllReasonable(mat.B.num)) break;
+                normSq = mat.B.num.squaredNorm();
+            }
+            converged = !(mat.B.num.array().abs() > convergeTolerance).any();
+            if(normSq < bestSq || converged) {
+                bestSq = normSq;
+                keep();
+            }
+        }
+    }
+    stats.residualSq = bestSq;
+
+    for(int i = 0; i < mat.n; i++) {
+        params[i]->val = best[i];
+    }
+    for(auto &p : param) {
+        auto it = compiledSubs.find(p.h);
+        if(it != compiledSubs.end()) p.val = it->second.Value();
+        SK.GetParam(p.h)->val = p.val;
+    }
+    if(converged) return SolveResult::OKAY;
+    return (timedOut || outOfBudget) ? SolveResult::TIMED_OUT : SolveResult::DIDNT_CONVERGE;
+}
+
+bool System::Check(Group *g, std::unordered_map<uint32_t, double> *residual) {
+    ResetStats();
+    WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    stats.equations = eq.n;
+    stats.unknowns  = param.n;
+
+    // A constraint's own unknown, like how far along the line a point on a
+    // line in 3d is, isn't given with the rest; it gets the value that best
+    // satisfies that constraint's equations, which are linear in it.
+    struct Fit { Param *p; double dr, dd; };
+    std::unordered_map<uint32_t, Fit> fits;
+    for(Equation &e : eq) {
+        if(!e.h.isFromConstraint()) continue;
+        ConstraintBase *c = SK.constraint.FindByIdNoOops(e.h.constraint());
+        if(c == nullptr || !c->valP.v) continue;
+        Fit &f = fits.emplace(c->h.v, Fit { SK.GetParam(c->valP), 0.0, 0.0 }).first->second;
+        double d = e.e->PartialWrt(c->valP)->Eval();
+        f.dr += d * e.e->Eval();
+        f.dd += d * d;
+    }
+    for(auto &it : fits) {
+        Fit &f = it.second;
+        if(f.dd > 0) f.p->val -= f.dr / f.dd;
+    }
+
+    bool ok = true;
+    for(Equation &e : eq) {
+        double r = fabs(e.e->Eval());
+        if(r > convergeTolerance || IsReasonable(r)) ok = false;
+        if(!e.h.isFromConstraint()) continue;
+        double &worst = (*residual)[e.h.constraint().v];
+        // So that a NaN stays
+        if(!(r <= worst)) worst = r;
+    }
+    return ok;
+}
+
+void System::LoadLane(int lane) {
+    for(size_t k = 0; k < lanes.input.size(); k++) {
+        lanes.value[k * ExprTape::LANES + lane] = lanes.input[k]->val;
+    }
+}
+
+SolveResult System::StoreLane(int lane, int *dof) {
+    for(size_t k = 0; k < lanes.input.size(); k++) {
+        lanes.input[k]->val = lanes.value[k * ExprTape::LANES + lane];
+    }
+    return FinishResolve(lanes.converged[lane], lanes.rankAfter[lane], dof);
+}
+
+// The same iteration as NewtonSolve, for the first count lanes together:
+// each pass over the tape evaluates all of them, and then each lane that's
+// still going takes its own step. A lane drops out once it has converged or
+// failed, the same way (and after the same number of steps) that it would
+// have in NewtonSolve; in mixed precision, to the same tolerance, after
+// perhaps a step more.
+void System::NewtonSolveLanes(int count) {
+    const int L = ExprTape::LANES;
+    int i, l;
+
+    bool active[L];
+    for(l = 0; l < L; l++) {
+        active[l]            = (l < count && mat.m > 0);
+        lanes.converged[l]   = (mat.m == 0);
+        lanes.rankAfter[l]   = (mat.m == 0) ? 0 : -1;
+    }
+    if(mat.m == 0) return;
+
+    if(stepMode != StepMode::NEWTON || jacobianMode != JacobianMode::SYMBOLIC) {
+        // Each lane would back off its step by a different amount in the
+        // line search, and the reverse sweeps don't run in lanes, so solve
+        // them one at a time.
+        for(l = 0; l < count; l++) {
+            for(size_t k = 0; k < lanes.input.size(); k++) {
+                lanes.input[k]->val = lanes.value[k * L + l];
+            }
+            int rankBefore;
+            lanes.converged[l] = NewtonSolve(&rankBefore, &lanes.rankAfter[l]);
+            LoadLane(l);
+        }
+        return;
+    }
+
+    // In mixed precision, a lane in single (see LanePrecision) reads the
+    // tape's single precision registers, and lastSingle is the largest of
+    // its residuals there after its last step. Rounding to float puts a floor
+    // on those near float epsilon times the size of the unknowns, so a lane
+    // goes over to double (by handoff) well before it reaches that, in time
+    // for the steps in double to be the ones that double alone would take.
+    bool  single[L];
+    float lastSingle[L], handoff[L];
+    for(l = 0; l < L; l++) {
+        single[l]     = (lanePrecision == LanePrecision::MIXED && active[l]);
+        lastSingle[l] = INFINITY;
+        double size = 1;
+        for(size_t k = 0; k < lanes.input.size(); k++) {
+            size = std::max(size, fabs(lanes.value[k * L + l]));
+        }
+        handoff[l] = (float)(sqrt(std::numeric_limits<float>::epsilon()) * size);
+    }
+    auto anyIn = [&](bool inSingle) {
+        for(int k = 0; k < count; k++) {
+            if(active[k] && single[k] == inSingle) return true;
+        }
+        return false;
+    };
+
+    double *reg       = lanes.reg.data();
+    float  *regSingle = lanes.regSingle.data();
+    auto loadRegisters = [&]() {
+        bool toSingle = anyIn(true);
+        for(size_t k = 0; k < lanes.input.size(); k++) {
+            int r = lanes.inputReg[k];
+            if(r < 0) continue;
+            std::copy_n(&lanes.value[k * L], L, &reg[(size_t)r * L]);
+            if(toSingle) {
+                std::copy_n(&lanes.value[k * L], L, &regSingle[(size_t)r * L]);
+            }
+        }
+    };
+
+    mat.B.num.resize(mat.m);
+    loadRegisters();
+    if(anyIn(false)) mat.tape.EvalLanes(0, mat.residualEnd, reg);
+    if(anyIn(true))  mat.tape.EvalLanes(0, mat.residualEnd, regSingle);
+    for(int iter = 0; iter <= maxIterations; iter++) {
+        if(std::find(active, active + count, true) == active + count) break;
+
+        if(anyIn(false)) mat.tape.EvalLanes(mat.residualEnd, mat.tape.Size(), reg);
+        if(anyIn(true))  mat.tape.EvalLanes(mat.residualEnd, mat.tape.Size(), regSingle);
+        for(l = 0; l < count; l++) {
+            if(!active[l]) continue;
+
+            double *value = mat.A.num.valuePtr();
+            if(single[l]) {
+                for(i = 0; i < (int)mat.A.reg.size(); i++) {
+                    value[i] = regSingle[(size_t)mat.A.reg[i] * L + l];
+                }
+                for(i = 0; i < mat.m; i++) {
+                    mat.B.num[i] = regSingle[(size_t)mat.B.reg[i] * L + l];
+                }
+            } else {
+                for(i = 0; i < (int)mat.A.reg.size(); i++) {
+                    value[i] = reg[(size_t)mat.A.reg[i] * L + l];
+                }
+                for(i = 0; i < mat.m; i++) {
+                    mat.B.num[i] = reg[(size_t)mat.B.reg[i] * L + l];
+                }
+            }
+            if(!SolveLeastSquares()) {
+                active[l] = false;
+                continue;
+            }
+
+            for(i = 0; i < mat.n; i++) {
+                double &v = lanes.value[(size_t)lanes.column[i] * L + l];
+                v -= mat.X[i];
+                if(IsReasonable(v)) {
+                    // Very bad, and clearly not convergent
+                    active[l] = false;
+                    break;
+                }
+            }
+        }
+
+        loadRegisters();
+        // A lane in single precision goes over to double once it's near
+        // enough, or stops gaining, and is checked again below; the
+        // registers in double are always loaded, so that it can be.
+        if(anyIn(true)) {
+            mat.tape.EvalLanes(0, mat.residualEnd, regSingle);
+            float residualMax[L];
+            ExprTape::MaxAbsLanes(mat.B.reg.data(), (size_t)mat.m, regSingle, residualMax);
+            for(l = 0; l < count; l++) {
+                if(!active[l] || !single[l]) continue;
+
+                float r = residualMax[l];
+                if(!(r > handoff[l] && r < CHORD_CONTRACTION * lastSingle[l]) ||
+                   IsReasonable(r)) {
+                    single[l] = false;
+                }
+                lastSingle[l] = r;
+            }
+        }
+        if(anyIn(false)) {
+            mat.tape.EvalLanes(0, mat.residualEnd, reg);
+            double residualMax[L];
+            ExprTape::MaxAbsLanes(mat.B.reg.data(), (size_t)mat.m, reg, residualMax);
+            for(l = 0; l < count; l++) {
+                if(!active[l] || single[l]) continue;
+
+                if(IsReasonable(residualMax[l])) {
+                    active[l] = false;
+                } else if(residualMax[l] <= convergeTolerance) {
+                    active[l] = false;
+                    lanes.converged[l] = true;
+                }
+            }
+        }
+    }
+}
+
+// The rate at which the unknowns move with value, at a solution: the least
+// squares solution of J dx = -dF/dvalue, with dF/dvalue by a forward
+// difference. The residuals needn't be linear in the value (an angle goes
+// in through its cosine), but the prediction only has to be close enough
+// for Newton's method to correct.
+bool System::Tangent(Param *value, Eigen::VectorXd *dx) {
+    EvalResiduals();
+    Eigen::VectorXd at = mat.B.num;
+    EvalJacobian(/*residualsCurrent=*/true);
+
+    const double v = value->val;
+    const double h = 1e-6 * std::max(1.0, fabs(v));
+    value->val = v + h;
+    EvalResiduals();
+    value->val = v;
+    mat.B.num = (mat.B.num - at) / h;
+    if(!AllReasonable(mat.B.num) || !SolveLeastSquares()) return false;
+
+    *dx = -mat.X;
+    return true;
+}
+
+// The same rates as Tangent, for each of the values, with J dX = -dF/dvalues
+// solved for all of them from one QR of J^T (which also covers a Jacobian
+// that isn't of full rank). Central differences keep dF/dvalues to about the
+// precision of the residuals, since a caller may be differentiating them
+// further, in an optimization.
+bool System::Sensitivities(const std::vector<Param *> &values, Eigen::MatrixXd *dX) {
+    using namespace Eigen;
+    const int k = (int)values.size();
+    *dX = MatrixXd::Zero(mat.n, k);
+    if(mat.m == 0 || mat.n == 0 || k == 0) return true;
+
+    EvalResiduals();
+    EvalJacobian(/*residualsCurrent=*/true);
+    MatrixXd dF(mat.m, k);
+    for(int j = 0; j < k; j++) {
+        Param *p = values[j];
+        const double v = p->val;
+        const double h = 1e-5 * std::max(1.0, fabs(v));
+        p->val = v + h;
+        EvalResiduals();
+        VectorXd above = mat.B.num;
+        p->val = v - h;
+        EvalResiduals();
+        p->val = v;
+        dF.col(j) = (above - mat.B.num) / (2 * h);
+    }
+    EvalResiduals();
+    if(!AllReasonable(Map<const VectorXd>(dF.data(), dF.size()))) return false;
+
+    PhaseTimer timer(&stats.stepMs);
+    SparseMatrix<double> At = mat.A.num.transpose();
+    At.makeCompressed();
+    const ReusableSparseQR &qr = mat.stepQR;
+    mat.stepQR.Factorize(At, mat.ordering, qrBackend);
+    if(qr.Info() != Success) return false;
+    CountFactor(qr.FactorNonZeros());
+
+    const int r = (int)qr.Rank();
+    MatrixXd c = qr.ColsPermutation().transpose() * (-dF);
+    MatrixXd w = MatrixXd::Zero(mat.n, k);
+    if(r > 0) {
+        SparseMatrix<double> R11t = qr.MatrixR().topLeftCorner(r, r).transpose();
+        w.topRows(r) = R11t.triangularView<Lower>().solve(c.topRows(r));
+    }
+    *dX = qr.ApplyQ(w);
+
+    // A row with a single param in it gives that param's rates outright;
+    // taking them from there rather than from the factorization keeps a
+    // fixed point's rates exactly zero, not roundoff.
+    for(int col = 0; col < At.outerSize(); col++) {
+        SparseMatrix<double>::InnerIterator it(At, col);
+        if(!it) continue;
+        int j = (int)it.row();
+        double d = it.value();
+        if(++it || d == 0) continue;
+        dX->row(j) = -dF.row(col) / d;
+    }
+    return AllReasonable(Map<const VectorXd>(dX->data(), dX->size()));
+}
+
+SolveResult System::Track(Param *value, double to, double *step, double minStep,
+                          double maxStep, int *steps, int *dof) {
+    // A corrector that converges in this many iterations makes the next
+    // step longer; one that needs more than HARD makes it shorter.
+    const int EASY = 2, HARD = 4;
+
+    ResetStats();
+    AllocationCount count(&stats);
+    stats.equations = mat.m;
+    stats.unknowns  = mat.n;
+    if(steps) *steps = 0;
+    if(mat.m == 0) {
+        value->val = to;
+        return FinishResolve(/*converged=*/true, 0, dof);
+    }
+
+    std::vector<Param *> params(mat.n);
+    for(int i = 0; i < mat.n; i++) {
+        params[i] = param.FindById(mat.param[i]);
+    }
+    Eigen::VectorXd from(mat.n), dx;
+    int rankAfter = -1;
+    double at = value->val;
+    while(at != to) {
+        double h = std::min(*step, fabs(to - at));
+        if(to < at) h = -h;
+        for(int i = 0; i < mat.n; i++) {
+            from[i] = params[i]->val;
+        }
+
+        // Predict,
+        bool tangent = Tangent(value, &dx);
+        if(!tangent) dx = Eigen::VectorXd::Zero(mat.n);
+        for(int i = 0; i < mat.n; i++) {
+            params[i]->val = from[i] + h * dx[i];
+        }
+        value->val = (fabs(h) == fabs(to - at)) ? to : at + h;
+
+        // and correct.
+        int before     = stats.iterations;
+        bool converged = NewtonSolve(NULL, &rankAfter);
+        int iterations = stats.iterations - before;
+
+        // A correction that's big next to the prediction means the path
+        // curved away within the step, and Newton's method may have found
+        // a different branch. There's nothing to compare with where the
+        // tangent vanishes, as it does at a singular point.
+        double predicted = fabs(h) * dx.lpNorm<Eigen::Infinity>(), corrected = 0;
+        for(int i = 0; i < mat.n; i++) {
+            corrected = std::max(corrected, fabs(params[i]->val - (from[i] + h * dx[i])));
+        }
+        bool jumped = predicted > LENGTH_EPS && corrected > 0.5 * predicted + LENGTH_EPS;
+
+        if(!converged || jumped || iterations > 2 * HARD) {
+            for(int i = 0; i < mat.n; i++) {
+                params[i]->val = from[i];
+            }
+            value->val = at;
+            if(timedOut || fabs(h) <= minStep) {
+                if(dof != NULL) *dof = -1;
+                return timedOut ? SolveResult::TIMED_OUT : SolveResult::DIDNT_CONVERGE;
+            }
+            *step = std::max(minStep, fabs(h) / 2);
+            continue;
+        }
+
+        at = value->val;
+        if(steps) (*steps)++;
+        if(iterations <= EASY) {
+            *step = std::min(maxStep, std::max(*step, 2 * fabs(h)));
+        } else if(iterations > HARD) {
+            *step = std::max(minStep, fabs(h) / 2);
+        }
+    }
+    return FinishResolve(/*converged=*/true, rankAfter, dof);
+}
+
 void System::Clear() {
     entity.Clear();
     param.Clear();
     eq.Clear();
     dragged.clear();
+    settledConstraints.clear();
+    settledEntities.clear();
+    dofOf.clear();
+    compiledSubs.clear();
     mat.A.num.setZero();
     mat.A.sym.setZero();
+    mat.rankQR.Clear();
+    mat.stepQR.Clear();
+    mat.stepLDLT.Clear();
 }
 
 void System::MarkParamsFree(bool find) {
+    PhaseTrace span(this, Phase::MARK_FREE);
     // If requested, find all the free (unbound) variables. This might be
     // more than the number of degrees of freedom. Don't always do this,
     // because the display would get annoying and it's slow.
     for(auto &p : param) {
         p.free = false;
+    }
+    if(!find) return;
 
-        if(find) {
-            if(p.tag == 0) {
-                p.tag = VAR_DOF_TEST;
-                WriteJacobian(0);
-                EvalJacobian();
-                int rank = CalculateRank();
-                if(rank == mat.m) {
-                    p.free = true;
+    // An unknown is free when the Jacobian keeps its rank without it, which
+    // is when some direction in the nullspace moves it; so one factorization
+    // answers for all of them.
+    if(WriteJacobian(0)) {
+        EvalJacobian();
+        Eigen::MatrixXd U;
+        if(NullspaceBasis(mat.A.num, &U)) {
+            // With dependent equations, dropping a column never brings the
+            // rank up to the number of equations, so nothing is free.
+            if(mat.n - U.cols() < mat.m) return;
+            for(int j = 0; j < mat.n; j++) {
+                if(U.row(j).norm() > NULLSPACE_TOLERANCE) {
+                    param.FindById(mat.param[j])->free = true;
                 }
+            }
+            return;
+        }
+    }
+
+    // Otherwise, test them one at a time. Without a param, the Jacobian is
+    // the same one less that column, so it's enough to zero that; it keeps
+    // its pattern, and so the analysis of its factorization, too.
+    if(mat.n > 0) {
+        Eigen::SparseMatrix<double> A = mat.A.num;
+        for(int j = 0; j < mat.n; j++) {
+            if(Expired()) break;
+            mat.A.num.col(j) *= 0.0;
+            if(CalculateRank() == mat.m) {
+                param.FindById(mat.param[j])->free = true;
+            }
+            mat.A.num = A;
+        }
+        return;
+    }
+    for(auto &p : param) {
+        if(Expired()) return;
+        if(p.tag == 0) {
+            p.tag = VAR_DOF_TEST;
+            // (a system too big to write says nothing about what's free)
+            if(!WriteJacobian(0)) {
                 p.tag = 0;
+                return;
+            }
+            EvalJacobian();
+            int rank = CalculateRank();
+            if(rank == mat.m) {
+                p.free = true;
             }
+            p.tag = 0;
         }
     }
 }
-
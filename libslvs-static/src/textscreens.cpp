@@ -298,6 +298,8 @@ void TextWindow::ScreenChangeGroupOption(int link, uint32_t v) {
         case 'd': g->allDimsReference = !(g->allDimsReference); break;
 
         case 'f': g->forceToMesh = !(g->forceToMesh); break;
+
+        case 'm': g->classifyBoolean = !(g->classifyBoolean); break;
     }
 
     SS.MarkGroupDirty(g->h);
@@ -553,6 +555,11 @@ void TextWindow::ShowGroupInfo() {
     } else {
         Printf(false, " (model already forced to triangle mesh)");
     }
+    if(g->IsForcedToMesh()) {
+        Printf(false, " %f%Lm%Fd%s  combine meshes by classifying triangles",
+            &TextWindow::ScreenChangeGroupOption,
+            g->classifyBoolean ? CHECK_TRUE : CHECK_FALSE);
+    }
 
     Printf(true, " %f%Lr%Fd%s  relax constraints and dimensions",
         &TextWindow::ScreenChangeGroupOption,
@@ -662,6 +669,10 @@ void TextWindow::ShowGroupSolveInfo() {
             Printf(true, "Too many unknowns in a single group!");
             return;
 
+        case SolveResult::TIMED_OUT:
+            Printf(true, "%FxSOLVE FAILED!%Fd timed out");
+            return;
+
         default: ssassert(false, "Unexpected solve result");
     }
 
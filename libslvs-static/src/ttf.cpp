@@ -265,72 +265,73 @@ bool TtfFont::ExtractTTFData(bool keepOpen) {
     return true;
 }
 
-typedef struct OutlineData {
-    Vector       origin, u, v; // input parameters
-    SBezierList *beziers;      // output bezier list
-    float        factor;       // ratio between freetype and solvespace coordinates
-    FT_Pos       bx;           // x offset of the current glyph
-    FT_Pos       px, py;       // current point
-} OutlineData;
-
-static Vector Transform(OutlineData *data, FT_Pos x, FT_Pos y) {
-    Vector r = data->origin;
-    r = r.Plus(data->u.ScaledBy((float)(data->bx + x) * data->factor));
-    r = r.Plus(data->v.ScaledBy((float)y * data->factor));
-    return r;
+//-----------------------------------------------------------------------------
+// Load a glyph's outline and metrics, or find them if they're loaded already;
+// NULL if FreeType can't load it.
+//-----------------------------------------------------------------------------
+static void AddStep(TtfFont::Glyph *glyph, int step, std::initializer_list<const FT_Vector *> pts) {
+    glyph->outline.push_back(step);
+    for(const FT_Vector *p : pts) {
+        glyph->outline.push_back(p->x);
+        glyph->outline.push_back(p->y);
+    }
 }
 
 static int MoveTo(const FT_Vector *p, void *cc)
 {
-    OutlineData *data = (OutlineData *) cc;
-    data->px = p->x;
-    data->py = p->y;
+    AddStep((TtfFont::Glyph *)cc, TtfFont::Glyph::MOVE_TO, { p });
     return 0;
 }
 
 static int LineTo(const FT_Vector *p, void *cc)
 {
-    OutlineData *data = (OutlineData *) cc;
-    SBezier sb = SBezier::From(
-        Transform(data, data->px, data->py),
-        Transform(data, p->x,     p->y));
-    data->beziers->l.Add(&sb);
-    data->px = p->x;
-    data->py = p->y;
+    AddStep((TtfFont::Glyph *)cc, TtfFont::Glyph::LINE_TO, { p });
     return 0;
 }
 
 static int ConicTo(const FT_Vector *c, const FT_Vector *p, void *cc)
 {
-    OutlineData *data = (OutlineData *) cc;
-    SBezier sb = SBezier::From(
-        Transform(data, data->px, data->py),
-        Transform(data, c->x,     c->y),
-        Transform(data, p->x,     p->y));
-    data->beziers->l.Add(&sb);
-    data->px = p->x;
-    data->py = p->y;
+    AddStep((TtfFont::Glyph *)cc, TtfFont::Glyph::CONIC_TO, { c, p });
     return 0;
 }
 
 static int CubicTo(const FT_Vector *c1, const FT_Vector *c2, const FT_Vector *p, void *cc)
 {
-    OutlineData *data = (OutlineData *) cc;
-    SBezier sb = SBezier::From(
-        Transform(data, data->px, data->py),
-        Transform(data, c1->x,    c1->y),
-        Transform(data, c2->x,    c2->y),
-        Transform(data, p->x,     p->y));
-    data->beziers->l.Add(&sb);
-    data->px = p->x;
-    data->py = p->y;
+    AddStep((TtfFont::Glyph *)cc, TtfFont::Glyph::CUBIC_TO, { c1, c2, p });
     return 0;
 }
 
-void TtfFont::PlotString(const std::string &str,
-                         SBezierList *sbl, bool kerning, Vector origin, Vector u, Vector v)
-{
-    ssassert(fontFace != NULL, "Expected font face to be loaded");
+const TtfFont::Glyph *TtfFont::LoadGlyph(uint32_t gid) {
+    auto it = glyphs.find(gid);
+    if(it != glyphs.end()) return &it->second;
+
+    /*
+     * Stupid hacks:
+     *  - if we want fake-bold, use FT_Outline_Embolden(). This actually looks
+     *    quite good.
+     *  - if we want fake-italic, apply a shear transform [1 s s 1 0 0] here using
+     *    FT_Set_Transform. This looks decent at small font sizes and bad at larger
+     *    ones, antialiasing mitigates this considerably though.
+     */
+    if(int fterr = FT_Load_Glyph(fontFace, gid, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING)) {
+        dbp("freetype: cannot load glyph for GID 0x%04x in file '%s': %s",
+            gid, fontFile.raw.c_str(), ft_error_string(fterr));
+        return NULL;
+    }
+
+    /* There's no point in getting the glyph BBox here - not only can it be
+     * needlessly slow sometimes, but because we're about to render a single glyph,
+     * what we want actually *is* the CBox.
+     */
+    FT_BBox cbox;
+    FT_Outline_Get_CBox(&fontFace->glyph->outline, &cbox);
+
+    Glyph glyph = {};
+    glyph.xMin     = cbox.xMin;
+    // Yes, this is what FreeType calls left-side bearing.
+    // Then interchangeably uses that with "left-side bearing". Sigh.
+    glyph.bearingX = fontFace->glyph->metrics.horiBearingX;
+    glyph.advance  = fontFace->glyph->advance.x;
 
     FT_Outline_Funcs outlineFuncs;
     outlineFuncs.move_to  = MoveTo;
@@ -339,6 +340,74 @@ void TtfFont::PlotString(const std::string &str,
     outlineFuncs.cubic_to = CubicTo;
     outlineFuncs.shift    = 0;
     outlineFuncs.delta    = 0;
+    if(int fterr = FT_Outline_Decompose(&fontFace->glyph->outline, &outlineFuncs, &glyph)) {
+        dbp("freetype: bezier decomposition failed for GID 0x%4x in file '%s': %s",
+            gid, fontFile.raw.c_str(), ft_error_string(fterr));
+    }
+
+    return &glyphs.emplace(gid, std::move(glyph)).first->second;
+}
+
+typedef struct OutlineData {
+    Vector       origin, u, v; // input parameters
+    float        factor;       // ratio between freetype and solvespace coordinates
+    FT_Pos       bx;           // x offset of the current glyph
+} OutlineData;
+
+static Vector Transform(OutlineData *data, FT_Pos x, FT_Pos y) {
+    Vector r = data->origin;
+    r = r.Plus(data->u.ScaledBy((float)(data->bx + x) * data->factor));
+    r = r.Plus(data->v.ScaledBy((float)y * data->factor));
+    return r;
+}
+
+static void PlotGlyph(OutlineData *data, const TtfFont::Glyph *glyph, SBezierList *sbl) {
+    const std::vector<long> &o = glyph->outline;
+    FT_Pos px = 0, py = 0;  // current point
+    for(size_t i = 0; i < o.size();) {
+        int step = (int)o[i];
+        const long *p = &o[i + 1];
+        SBezier sb;
+        switch(step) {
+            case TtfFont::Glyph::MOVE_TO:
+                break;
+
+            case TtfFont::Glyph::LINE_TO:
+                sb = SBezier::From(
+                    Transform(data, px,   py),
+                    Transform(data, p[0], p[1]));
+                sbl->l.Add(&sb);
+                break;
+
+            case TtfFont::Glyph::CONIC_TO:
+                sb = SBezier::From(
+                    Transform(data, px,   py),
+                    Transform(data, p[0], p[1]),
+                    Transform(data, p[2], p[3]));
+                sbl->l.Add(&sb);
+                break;
+
+            case TtfFont::Glyph::CUBIC_TO:
+                sb = SBezier::From(
+                    Transform(data, px,   py),
+                    Transform(data, p[0], p[1]),
+                    Transform(data, p[2], p[3]),
+                    Transform(data, p[4], p[5]));
+                sbl->l.Add(&sb);
+                break;
+        }
+        // The step's last point is where the next begins.
+        int points = max(step, 1);
+        px = p[2 * points - 2];
+        py = p[2 * points - 1];
+        i += 1 + 2 * points;
+    }
+}
+
+void TtfFont::PlotString(const std::string &str,
+                         SBezierList *sbl, bool kerning, Vector origin, Vector u, Vector v)
+{
+    ssassert(fontFace != NULL, "Expected font face to be loaded");
 
     FT_Pos dx = 0;
     uint32_t prevGid = 0;
@@ -351,62 +420,38 @@ void TtfFont::PlotString(const std::string &str,
             gid = cid;
         }
 
-        /*
-         * Stupid hacks:
-         *  - if we want fake-bold, use FT_Outline_Embolden(). This actually looks
-         *    quite good.
-         *  - if we want fake-italic, apply a shear transform [1 s s 1 0 0] here using
-         *    FT_Set_Transform. This looks decent at small font sizes and bad at larger
-         *    ones, antialiasing mitigates this considerably though.
-         */
-        if(int fterr = FT_Load_Glyph(fontFace, gid, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING)) {
-            dbp("freetype: cannot load glyph for GID 0x%04x in file '%s': %s",
-                gid, fontFile.raw.c_str(), ft_error_string(fterr));
-            return;
+        const Glyph *glyph = LoadGlyph(gid);
+        if(glyph == NULL) return;
+
+        // Apply Kerning, if any:
+        FT_Vector kernVector;
+        if(kerning && FT_Get_Kerning(fontFace, prevGid, gid, FT_KERNING_DEFAULT, &kernVector) == 0) {
+            dx += kernVector.x;
         }
 
         /* A point that has x = xMin should be plotted at (dx0 + lsb); fix up
          * our x-position so that the curve-generating code will put stuff
          * at the right place.
          *
-         * There's no point in getting the glyph BBox here - not only can it be
-         * needlessly slow sometimes, but because we're about to render a single glyph,
-         * what we want actually *is* the CBox.
-         *
          * This is notwithstanding that this makes extremely little sense, this
          * looks like a workaround for either mishandling the start glyph on a line,
          * or as a really hacky pseudo-track-kerning (in which case it works better than
          * one would expect! especially since most fonts don't set track kerning).
          */
-        FT_BBox cbox;
-        FT_Outline_Get_CBox(&fontFace->glyph->outline, &cbox);
-
-        // Apply Kerning, if any:
-        FT_Vector kernVector;
-        if(kerning && FT_Get_Kerning(fontFace, prevGid, gid, FT_KERNING_DEFAULT, &kernVector) == 0) {
-            dx += kernVector.x;
-        }
-
-        FT_Pos bx = dx - cbox.xMin;
-        // Yes, this is what FreeType calls left-side bearing.
-        // Then interchangeably uses that with "left-side bearing". Sigh.
-        bx += fontFace->glyph->metrics.horiBearingX;
+        FT_Pos bx = dx - glyph->xMin;
+        bx += glyph->bearingX;
 
         OutlineData data = {};
         data.origin  = origin;
         data.u       = u;
         data.v       = v;
-        data.beziers = sbl;
         data.factor  = (float)(1.0 / capHeight);
         data.bx      = bx;
-        if(int fterr = FT_Outline_Decompose(&fontFace->glyph->outline, &outlineFuncs, &data)) {
-            dbp("freetype: bezier decomposition failed for GID 0x%4x in file '%s': %s",
-                gid, fontFile.raw.c_str(), ft_error_string(fterr));
-        }
+        PlotGlyph(&data, glyph, sbl);
 
         // And we're done, so advance our position by the requested advance
         // width, plus the user-requested extra advance.
-        dx += fontFace->glyph->advance.x;
+        dx += glyph->advance;
         prevGid = gid;
     }
 }
@@ -425,11 +470,8 @@ double TtfFont::AspectRatio(const std::string &str, bool kerning) {
                 chr, fontFile.raw.c_str(), ft_error_string(gid));
         }
 
-        if(int fterr = FT_Load_Glyph(fontFace, gid, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING)) {
-            dbp("freetype: cannot load glyph for GID 0x%04x in file '%s': %s",
-                gid, fontFile.raw.c_str(), ft_error_string(fterr));
-            break;
-        }
+        const Glyph *glyph = LoadGlyph(gid);
+        if(glyph == NULL) break;
 
         // Apply Kerning, if any:
         FT_Vector kernVector;
@@ -437,7 +479,7 @@ double TtfFont::AspectRatio(const std::string &str, bool kerning) {
             dx += (double)kernVector.x / capHeight;
         }
 
-        dx += (double)fontFace->glyph->advance.x / capHeight;
+        dx += (double)glyph->advance / capHeight;
         prevGid = gid;
     }
 
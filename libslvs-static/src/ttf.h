@@ -16,6 +16,19 @@ public:
     FT_FaceRec_    *fontFace;
     double          capHeight;
 
+    // A glyph's outline as FreeType decomposes it, in font units, and the
+    // metrics that place it; each is loaded once and then replayed, since
+    // text plots the same few glyphs over and over.
+    struct Glyph {
+        enum { MOVE_TO = 0, LINE_TO = 1, CONIC_TO = 2, CUBIC_TO = 3 };
+        long                xMin;       // of the control box
+        long                bearingX;
+        long                advance;
+        // Each step, then its one, two or three points as x, y pairs
+        std::vector<long>   outline;
+    };
+    std::unordered_map<uint32_t, Glyph> glyphs;
+
     void SetResourceID(const std::string &resource);
     bool IsResource() const;
 
@@ -26,6 +39,7 @@ public:
     void PlotString(const std::string &str,
                     SBezierList *sbl, bool kerning, Vector origin, Vector u, Vector v);
     double AspectRatio(const std::string &str, bool kerning);
+    const Glyph *LoadGlyph(uint32_t gid);
 
     bool ExtractTTFData(bool keepOpen);
 };
@@ -324,6 +324,7 @@ public:
         FIND_CONSTRAINT_TIMEOUT = 119,
         EXPLODE_DISTANCE      = 120,
         ANIMATION_SPEED       = 121,
+        EXPORT_MAX_TRIANGLES  = 122,
         // For TTF text
         TTF_TEXT              = 300,
         // For the step dimension screen
@@ -495,6 +496,7 @@ public:
     static void ScreenChangeMaxSegments(int link, uint32_t v);
     static void ScreenChangeExportChordTolerance(int link, uint32_t v);
     static void ScreenChangeExportMaxSegments(int link, uint32_t v);
+    static void ScreenChangeExportMaxTriangles(int link, uint32_t v);
     static void ScreenChangeCameraTangent(int link, uint32_t v);
     static void ScreenChangeGridSpacing(int link, uint32_t v);
     static void ScreenChangeExplodeDistance(int link, uint32_t v);
@@ -35,7 +35,95 @@ void SolveSpaceUI::UndoEnableMenus() {
     SS.GW.redoMenuItem->SetEnabled(redo.cnt > 0);
 }
 
+// A copy of a group for the undo stack, without any of the stuff that gets
+// regenerated.
+static Group UndoCopyOf(const Group &src) {
+    // Shallow copy
+    Group dest(src);
+    // And then clean up all the stuff that needs to be a deep copy,
+    // and zero out all the dynamic stuff that will get regenerated.
+    dest.clean = false;
+    dest.solved = {};
+    dest.polyLoops = {};
+    dest.bezierLoops = {};
+    dest.bezierOpens = {};
+    dest.polyError = {};
+    dest.thisMesh = {};
+    dest.runningMesh = {};
+    dest.thisShell = {};
+    dest.runningShell = {};
+    dest.thisKey = {};
+    dest.runningKey = {};
+    dest.displayMesh = {};
+    dest.displayOutlines = {};
+
+    dest.remap = src.remap;
+
+    dest.impMesh = {};
+    dest.impShell = {};
+    dest.impEntity = {};
+    return dest;
+}
+
+template<class T>
+static T UndoCopyOf(const T &src) {
+    return src;
+}
+
+// Cuts the whole list `was` down to what it takes to get back to it from
+// `now`: the elements that `now` changed or doesn't have, plus, in `added`,
+// the handles of those `now` has and `was` doesn't.
+template<class T, class H>
+static void KeepWhatDiffers(IdList<T, H> *was, IdList<T, H> *now, std::vector<H> *added,
+                            char type) {
+    IdList<T, H> kept = {};
+    for(T &t : *was) {
+        T *n = now->FindByIdNoOops(t.h);
+        if(n == NULL || !SolveSpaceUI::SavesTheSame(type, &t, n)) {
+            kept.Add(&t);
+        }
+    }
+    for(T &t : *now) {
+        if(was->FindByIdNoOops(t.h) == NULL) added->push_back(t.h);
+    }
+    was->Clear();
+    kept.MoveSelfInto(was);
+}
+
+// And the reverse, making `was` whole again from `now`.
+template<class T, class H>
+static void RestoreWhole(IdList<T, H> *was, IdList<T, H> *now, std::vector<H> *added) {
+    std::sort(added->begin(), added->end(), [](H a, H b) { return a.v < b.v; });
+    IdList<T, H> whole = {};
+    whole.ReserveMore(now->n);
+    for(T &t : *now) {
+        if(was->FindByIdNoOops(t.h) != NULL) continue;
+        if(std::binary_search(added->begin(), added->end(), t.h,
+                              [](H a, H b) { return a.v < b.v; })) continue;
+        T copy = UndoCopyOf(t);
+        whole.AddUnordered(&copy);
+    }
+    for(T &t : *was) {
+        whole.AddUnordered(&t);
+    }
+    whole.SortById();
+    was->Clear();
+    whole.MoveSelfInto(was);
+    added->clear();
+}
+
 void SolveSpaceUI::PushFromCurrentOnto(UndoStack *uk) {
+    // The state that was on top now only has to keep what differs from the
+    // one going on above it.
+    if(uk->cnt > 0) {
+        UndoState *top = &(uk->d[WRAP(uk->write - 1, MAX_UNDO)]);
+        KeepWhatDiffers(&top->group,      &SK.group,      &top->addedGroup,      'g');
+        KeepWhatDiffers(&top->request,    &SK.request,    &top->addedRequest,    'r');
+        KeepWhatDiffers(&top->constraint, &SK.constraint, &top->addedConstraint, 'c');
+        KeepWhatDiffers(&top->param,      &SK.param,      &top->addedParam,      'p');
+        KeepWhatDiffers(&top->style,      &SK.style,      &top->addedStyle,      's');
+    }
+
     if(uk->cnt == MAX_UNDO) {
         UndoClearState(&(uk->d[uk->write]));
         // And then write in to this one again
@@ -47,28 +135,7 @@ void SolveSpaceUI::PushFromCurrentOnto(UndoStack *uk) {
     *ut = {};
     ut->group.ReserveMore(SK.group.n);
     for(Group &src : SK.group) {
-        // Shallow copy
-        Group dest(src);
-        // And then clean up all the stuff that needs to be a deep copy,
-        // and zero out all the dynamic stuff that will get regenerated.
-        dest.clean = false;
-        dest.solved = {};
-        dest.polyLoops = {};
-        dest.bezierLoops = {};
-        dest.bezierOpens = {};
-        dest.polyError = {};
-        dest.thisMesh = {};
-        dest.runningMesh = {};
-        dest.thisShell = {};
-        dest.runningShell = {};
-        dest.displayMesh = {};
-        dest.displayOutlines = {};
-
-        dest.remap = src.remap;
-
-        dest.impMesh = {};
-        dest.impShell = {};
-        dest.impEntity = {};
+        Group dest = UndoCopyOf(src);
         ut->group.Add(&dest);
     }
     for(auto &src : SK.groupOrder) { ut->groupOrder.Add(&src); }
@@ -120,6 +187,17 @@ void SolveSpaceUI::PopOntoCurrentFrom(UndoStack *uk) {
     // No need to free it, since a shallow copy was made above
     *ut = {};
 
+    // The state now on top was kept as just what differs from this one;
+    // make it whole again while the sketch is still exactly this one.
+    if(uk->cnt > 0) {
+        UndoState *top = &(uk->d[WRAP(uk->write - 1, MAX_UNDO)]);
+        RestoreWhole(&top->group,      &SK.group,      &top->addedGroup);
+        RestoreWhole(&top->request,    &SK.request,    &top->addedRequest);
+        RestoreWhole(&top->constraint, &SK.constraint, &top->addedConstraint);
+        RestoreWhole(&top->param,      &SK.param,      &top->addedParam);
+        RestoreWhole(&top->style,      &SK.style,      &top->addedStyle);
+    }
+
     // And reset the state everywhere else in the program, since the
     // sketch just changed a lot.
     SS.GW.ClearSuper();
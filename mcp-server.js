@@ -13,11 +13,12 @@ import {
   CallToolRequestSchema, 
   ListToolsRequestSchema 
 } from '@modelcontextprotocol/sdk/types.js';
-import { execSync, spawn } from 'child_process';
+import { execSync } from 'child_process';
 import * as fs from 'fs';
 import * as path from 'path';
 import * as os from 'os';
 import { fileURLToPath } from 'url';
+import { SolverPool } from './solver-pool.js';
 
 // Get directory of this script
 const __filename = fileURLToPath(import.meta.url);
@@ -64,6 +65,19 @@ function findSlvsxBinary() {
 
 const SLVSX_BINARY = findSlvsxBinary();
 
+// Solves and validations go to a pool of `slvsx serve` workers
+function envInt(name, fallback) {
+  const value = parseInt(process.env[name], 10);
+  return Number.isFinite(value) && value > 0 ? value : fallback;
+}
+
+const POOL_OPTIONS = {
+  size: envInt('SLVSX_POOL_SIZE', os.cpus().length),
+  maxQueue: envInt('SLVSX_POOL_QUEUE', 64),
+  timeoutMs: envInt('SLVSX_TIMEOUT_MS', 30000),
+  format: process.env.SLVSX_POOL_FORMAT === 'msgpack' ? 'msgpack' : 'json',
+};
+
 // Load documentation embeddings if available
 let docsIndex = null;
 let embedder = null;
@@ -161,9 +175,17 @@ class SlvsxServer {
       }
     );
 
+    this.pool = null;
     this.setupHandlers();
   }
 
+  getPool() {
+    if (!this.pool) {
+      this.pool = new SolverPool({ binary: SLVSX_BINARY, ...POOL_OPTIONS });
+    }
+    return this.pool;
+  }
+
   setupHandlers() {
     // List available tools
     this.server.setRequestHandler(ListToolsRequestSchema, async () => ({
@@ -273,6 +295,14 @@ class SlvsxServer {
             properties: {},
           },
         },
+        {
+          name: 'get_solver_stats',
+          description: 'Get statistics for the pool of solver processes: workers, queue depth, request counts, timeouts, restarts and latency',
+          inputSchema: {
+            type: 'object',
+            properties: {},
+          },
+        },
         {
           name: 'list_entities',
           description: 'Get a complete reference of all entity types (point, line, circle, arc, etc.) with their field names and descriptions.',
@@ -313,6 +343,9 @@ class SlvsxServer {
           
           case 'list_entities':
             return this.listEntities();
+
+          case 'get_solver_stats':
+            return this.getSolverStats();
           
           default:
             throw new Error(`Unknown tool: ${name}`);
@@ -331,77 +364,40 @@ class SlvsxServer {
   }
 
   async solveConstraints(constraints) {
-    // Write constraints to temp file
-    const tmpFile = path.join(os.tmpdir(), `slvsx-${Date.now()}.json`);
-    fs.writeFileSync(tmpFile, JSON.stringify(constraints, null, 2));
-
-    try {
-      // Run slvsx solve
-      const result = execSync(`${SLVSX_BINARY} solve ${tmpFile}`, {
-        encoding: 'utf-8',
-        maxBuffer: 10 * 1024 * 1024 // 10MB
-      });
-
-      // Parse the result
-      const lines = result.split('\n');
-      let jsonResult = '';
-      let inJson = false;
-      
-      for (const line of lines) {
-        if (line.startsWith('{')) inJson = true;
-        if (inJson) jsonResult += line + '\n';
-        if (line.startsWith('}')) inJson = false;
-      }
-
-      const solved = jsonResult ? JSON.parse(jsonResult) : { error: 'No solution found' };
-
-      return {
-        content: [
-          {
-            type: 'text',
-            text: JSON.stringify(solved, null, 2),
-          },
-        ],
-      };
-    } finally {
-      // Clean up temp file
-      if (fs.existsSync(tmpFile)) {
-        fs.unlinkSync(tmpFile);
-      }
+    const response = await this.getPool().request('solve', constraints);
+    if (!response.ok) {
+      throw new Error(response.error.message);
     }
+
+    return {
+      content: [
+        {
+          type: 'text',
+          text: JSON.stringify(response.result, null, 2),
+        },
+      ],
+    };
   }
 
   async validateConstraints(constraints) {
-    const tmpFile = path.join(os.tmpdir(), `slvsx-validate-${Date.now()}.json`);
-    fs.writeFileSync(tmpFile, JSON.stringify(constraints, null, 2));
-
+    let text;
     try {
-      const result = execSync(`${SLVSX_BINARY} validate ${tmpFile}`, {
-        encoding: 'utf-8'
-      });
-
-      return {
-        content: [
-          {
-            type: 'text',
-            text: result.includes('✓') ? 'Valid constraint document' : result,
-          },
-        ],
-      };
+      const response = await this.getPool().request('validate', constraints);
+      text = response.ok
+        ? 'Valid constraint document'
+        : `Validation failed: ${response.error.message}`;
     } catch (error) {
-      return {
-        content: [
-          {
-            type: 'text',
-            text: `Validation failed: ${error.message}`,
-          },
-        ],
-      };
-    } finally {
-      if (fs.existsSync(tmpFile)) {
-        fs.unlinkSync(tmpFile);
-      }
+      text = `Validation failed: ${error.message}`;
     }
+
+    return {
+      content: [
+        {
+          type: 'text',
+          text,
+        },
+      ],
+    };
   }
 
   async exportToSvg(constraints, width = 800, height = 600) {
@@ -725,12 +721,26 @@ For horizontal/vertical constraints, use 2D entities:
     };
   }
 
+  getSolverStats() {
+    const stats = this.pool ? this.pool.stats() : { workers: 0, ...POOL_OPTIONS };
+    return {
+      content: [
+        {
+          type: 'text',
+          text: JSON.stringify(stats, null, 2),
+        },
+      ],
+    };
+  }
+
   async run() {
     // Load documentation index for search
     await loadDocsIndex();
     
     const transport = new StdioServerTransport();
     await this.server.connect(transport);
+    // The workers' pipes would keep us running once the client has gone.
+    process.stdin.on('end', () => this.pool?.close());
     console.error('SLVSX MCP Server running on stdio');
   }
 }
@@ -55,8 +55,10 @@ for example in "$PROJECT_ROOT/examples"/*.json; do
         # Solve first (needed for export)
         "$BINARY" solve "$example" > /dev/null 2>&1 || true
         
-        # Export to SVG
-        "$BINARY" export -f svg "$example" -o "$OUTPUT_DIR/${name}.svg" 2>&1 || true
+        # Export to SVG, and a PNG thumbnail from the same solve
+        "$BINARY" export "$example" \
+            -f svg -o "$OUTPUT_DIR/${name}.svg" \
+            -f png -o "$OUTPUT_DIR/${name}.png" 2>&1 || true
     fi
 done
 
@@ -65,30 +67,33 @@ echo "Generating 3D views..."
 
 # Tetrahedron - all views including isometric
 if [ -f "$PROJECT_ROOT/examples/04_3d_tetrahedron.json" ]; then
-    "$BINARY" solve "$PROJECT_ROOT/examples/04_3d_tetrahedron.json" > /dev/null 2>&1
-    "$BINARY" export -f svg -v xy "$PROJECT_ROOT/examples/04_3d_tetrahedron.json" -o "$OUTPUT_DIR/tetrahedron_xy.svg" 2>&1
-    "$BINARY" export -f svg -v xz "$PROJECT_ROOT/examples/04_3d_tetrahedron.json" -o "$OUTPUT_DIR/tetrahedron_xz.svg" 2>&1
-    "$BINARY" export -f svg -v yz "$PROJECT_ROOT/examples/04_3d_tetrahedron.json" -o "$OUTPUT_DIR/tetrahedron_yz.svg" 2>&1
-    "$BINARY" export -f svg -v isometric "$PROJECT_ROOT/examples/04_3d_tetrahedron.json" -o "$OUTPUT_DIR/tetrahedron_isometric.svg" 2>&1
+    # One solve, every view
+    "$BINARY" export -f svg "$PROJECT_ROOT/examples/04_3d_tetrahedron.json" \
+        -v xy -o "$OUTPUT_DIR/tetrahedron_xy.svg" \
+        -v xz -o "$OUTPUT_DIR/tetrahedron_xz.svg" \
+        -v yz -o "$OUTPUT_DIR/tetrahedron_yz.svg" \
+        -v isometric -o "$OUTPUT_DIR/tetrahedron_isometric.svg" 2>&1
     echo "  Generated tetrahedron views (XY, XZ, YZ, Isometric)"
 fi
 
 # 3D basics - multiple views including isometric
 if [ -f "$PROJECT_ROOT/examples/12_3d_basics.json" ]; then
-    "$BINARY" solve "$PROJECT_ROOT/examples/12_3d_basics.json" > /dev/null 2>&1
-    "$BINARY" export -f svg -v xy "$PROJECT_ROOT/examples/12_3d_basics.json" -o "$OUTPUT_DIR/3d_basics_xy.svg" 2>&1
-    "$BINARY" export -f svg -v xz "$PROJECT_ROOT/examples/12_3d_basics.json" -o "$OUTPUT_DIR/3d_basics_xz.svg" 2>&1
-    "$BINARY" export -f svg -v isometric "$PROJECT_ROOT/examples/12_3d_basics.json" -o "$OUTPUT_DIR/3d_basics_isometric.svg" 2>&1
+    # One solve, every view
+    "$BINARY" export -f svg "$PROJECT_ROOT/examples/12_3d_basics.json" \
+        -v xy -o "$OUTPUT_DIR/3d_basics_xy.svg" \
+        -v xz -o "$OUTPUT_DIR/3d_basics_xz.svg" \
+        -v isometric -o "$OUTPUT_DIR/3d_basics_isometric.svg" 2>&1
     echo "  Generated 3D basics views (XY, XZ, Isometric)"
 fi
 
 # Birdhouse - all views including isometric  
 if [ -f "$PROJECT_ROOT/examples/21_birdhouse.json" ]; then
-    "$BINARY" solve "$PROJECT_ROOT/examples/21_birdhouse.json" > /dev/null 2>&1
-    "$BINARY" export -f svg -v xy "$PROJECT_ROOT/examples/21_birdhouse.json" -o "$OUTPUT_DIR/birdhouse_xy.svg" 2>&1
-    "$BINARY" export -f svg -v xz "$PROJECT_ROOT/examples/21_birdhouse.json" -o "$OUTPUT_DIR/birdhouse_xz.svg" 2>&1
-    "$BINARY" export -f svg -v yz "$PROJECT_ROOT/examples/21_birdhouse.json" -o "$OUTPUT_DIR/birdhouse_yz.svg" 2>&1
-    "$BINARY" export -f svg -v isometric "$PROJECT_ROOT/examples/21_birdhouse.json" -o "$OUTPUT_DIR/birdhouse_isometric.svg" 2>&1
+    # One solve, every view
+    "$BINARY" export -f svg "$PROJECT_ROOT/examples/21_birdhouse.json" \
+        -v xy -o "$OUTPUT_DIR/birdhouse_xy.svg" \
+        -v xz -o "$OUTPUT_DIR/birdhouse_xz.svg" \
+        -v yz -o "$OUTPUT_DIR/birdhouse_yz.svg" \
+        -v isometric -o "$OUTPUT_DIR/birdhouse_isometric.svg" 2>&1
     echo "  Generated birdhouse views (XY, XZ, YZ, Isometric)"
 fi
 
@@ -26,13 +26,14 @@ fi
 
 echo "✓ Solve successful"
 
-# Generate renders for all views
+# Generate renders for all views, from one solve
+ARGS=""
 for view in xy xz yz isometric; do
     OUTPUT="$OUTPUT_DIR/${BASENAME}_${view}.svg"
-    echo "  Generating ${view} view..."
-    nix-shell -p cargo rustc cmake pkg-config --run "./target/release/slvsx export $INPUT_FILE --format svg --view $view --output $OUTPUT" > /dev/null 2>&1
-    echo "    → $OUTPUT"
+    ARGS="$ARGS --view $view --output $OUTPUT"
+    echo "  Generating ${view} view → $OUTPUT"
 done
+nix-shell -p cargo rustc cmake pkg-config --run "./target/release/slvsx export $INPUT_FILE --format svg$ARGS" > /dev/null 2>&1
 
 echo "✓ All renders generated in $OUTPUT_DIR"
 
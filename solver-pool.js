@@ -0,0 +1,297 @@
+/**
+ * A pool of long-lived `slvsx serve` processes.
+ *
+ * Starting slvsx for every tool call costs a process spawn, a temp file and
+ * the validator's setup each time. The pool keeps a few `slvsx serve`
+ * workers running instead and sends them one JSON request per line (see
+ * crates/cli/src/serve.rs for the protocol), matching responses back to
+ * requests by id.
+ *
+ * - Each worker runs one request at a time; requests beyond that wait in a
+ *   bounded queue, and once the queue is full new requests are refused
+ *   straight away rather than piling up.
+ * - Every request has a deadline. A request that is still queued when it
+ *   passes is dropped; one that is running is failed and its worker is
+ *   killed, since there's no other way to stop a native solve from here.
+ * - A worker that exits, for whatever reason, fails the request it was
+ *   running and is replaced.
+ * - Each worker keeps its own cache of solve results: a document that
+ *   reaches a worker which solved it before, even reordered or renamed, is
+ *   answered without solving it again.
+ * - With `format: 'msgpack'`, requests and responses are MessagePack
+ *   frames rather than lines of JSON (see wire.js). A solve asked for with
+ *   `positions: true` then comes back with its points and circles as one
+ *   Float64Array, `response.positions`, four floats for each entity of
+ *   the document in order, read from the frame without parsing a number.
+ */
+
+import { spawn } from 'child_process';
+import * as os from 'os';
+import * as readline from 'readline';
+import * as wire from './wire.js';
+
+/** Call onFrame with each length-prefixed frame read from a stream */
+function readFrames(stream, onFrame) {
+  let pending = Buffer.alloc(0);
+  stream.on('data', (chunk) => {
+    pending = pending.length ? Buffer.concat([pending, chunk]) : chunk;
+    while (pending.length >= 4) {
+      const end = 4 + pending.readUInt32BE(0);
+      if (pending.length < end) break;
+      onFrame(pending.subarray(4, end));
+      pending = pending.subarray(end);
+    }
+  });
+}
+
+export class SolverPoolError extends Error {
+  constructor(message, code) {
+    super(message);
+    this.name = 'SolverPoolError';
+    this.code = code;
+  }
+}
+
+// Restarts closer together than this count as a crash loop, and the next
+// one waits for RESTART_BACKOFF_MS first.
+const RESTART_WINDOW_MS = 1000;
+const RESTART_BACKOFF_MS = 500;
+
+export class SolverPool {
+  /**
+   * @param {object} options
+   * @param {string} options.binary  The slvsx executable
+   * @param {string[]} [options.args]  Arguments that start it serving
+   * @param {number} [options.size]  How many workers to run
+   * @param {number} [options.maxQueue]  How many requests may wait for a worker
+   * @param {number} [options.timeoutMs]  The default deadline for a request
+   * @param {'json'|'msgpack'} [options.format]  How requests are encoded
+   */
+  constructor({
+    binary,
+    args = ['serve', '--workers', '1'],
+    size = os.cpus().length,
+    maxQueue = 64,
+    timeoutMs = 30000,
+    format = 'json',
+  }) {
+    if (format !== 'json' && format !== 'msgpack') {
+      throw new SolverPoolError(`Unknown wire format '${format}'`, 'format');
+    }
+    this.binary = binary;
+    this.format = format;
+    this.args = format === 'msgpack' ? [...args, '--format', 'msgpack'] : args;
+    this.size = Math.max(1, size);
+    this.maxQueue = maxQueue;
+    this.timeoutMs = timeoutMs;
+
+    this.nextId = 1;
+    this.workers = [];
+    this.queue = [];
+    this.closed = false;
+    this.counters = {
+      requests: 0,
+      completed: 0,
+      failed: 0,
+      rejected: 0,
+      timeouts: 0,
+      restarts: 0,
+    };
+    this.latency = { count: 0, totalMs: 0, maxMs: 0 };
+
+    for (let i = 0; i < this.size; i++) {
+      this.workers.push(this.startWorker());
+    }
+  }
+
+  startWorker() {
+    const child = spawn(this.binary, this.args, {
+      stdio: ['pipe', 'pipe', 'inherit'],
+    });
+    const worker = { child, job: null, alive: true, stopping: false, startedAt: Date.now() };
+
+    if (this.format === 'msgpack') {
+      readFrames(child.stdout, (frame) => this.onResponse(worker, frame));
+    } else {
+      readline.createInterface({ input: child.stdout }).on('line', (line) => {
+        this.onResponse(worker, line);
+      });
+    }
+    // A write to a worker that has just died surfaces here; 'exit' cleans up.
+    child.stdin.on('error', () => {});
+    child.on('error', (err) => {
+      console.error(`slvsx worker failed: ${err.message}`);
+      this.onExit(worker);
+    });
+    child.on('exit', () => this.onExit(worker));
+    return worker;
+  }
+
+  /**
+   * Send one request and resolve with its response, which has either a
+   * `result` (`ok: true`) or an `error: {code, message}` (`ok: false`).
+   * Rejects with a SolverPoolError if the request couldn't be answered.
+   * With `positions`, a solve's entities come back packed instead, as
+   * `response.positions`, a Float64Array; see crates/cli/src/serve.rs.
+   */
+  request(command, document, { timeoutMs = this.timeoutMs, positions = false } = {}) {
+    if (this.closed) {
+      return Promise.reject(new SolverPoolError('The solver pool is closed', 'closed'));
+    }
+    this.counters.requests++;
+    if (this.queue.length >= this.maxQueue) {
+      this.counters.rejected++;
+      return Promise.reject(
+        new SolverPoolError(`The solver is busy (${this.queue.length} requests waiting)`, 'busy')
+      );
+    }
+
+    const id = this.nextId++;
+    return new Promise((resolve, reject) => {
+      const request = positions ? { id, command, document, positions } : { id, command, document };
+      const job = {
+        id,
+        message: this.encode(request),
+        startedAt: Date.now(),
+        resolve,
+        reject,
+        worker: null,
+      };
+      job.timer = setTimeout(() => this.onTimeout(job, timeoutMs), timeoutMs);
+      this.queue.push(job);
+      this.dispatch();
+    });
+  }
+
+  idleWorker() {
+    return this.workers.find((w) => w.alive && !w.stopping && !w.job);
+  }
+
+  dispatch() {
+    let worker;
+    while (this.queue.length > 0 && (worker = this.idleWorker())) {
+      const job = this.queue.shift();
+      job.worker = worker;
+      worker.job = job;
+      worker.child.stdin.write(job.message);
+    }
+  }
+
+  /** A request as a line of JSON, or a length-prefixed MessagePack frame */
+  encode(request) {
+    if (this.format === 'json') {
+      return JSON.stringify(request) + '\n';
+    }
+    const body = wire.encode(request);
+    const frame = Buffer.allocUnsafe(4 + body.length);
+    frame.writeUInt32BE(body.length, 0);
+    body.copy(frame, 4);
+    return frame;
+  }
+
+  onResponse(worker, message) {
+    let response;
+    try {
+      response = this.format === 'json' ? JSON.parse(message) : wire.decode(message);
+    } catch (e) {
+      console.error(`slvsx worker sent a response that can't be read: ${e.message}`);
+      return;
+    }
+    if (response.positions instanceof Uint8Array) {
+      response.positions = wire.float64s(response.positions);
+    } else if (Array.isArray(response.positions)) {
+      response.positions = Float64Array.from(response.positions, (v) => v ?? NaN);
+    }
+    const job = worker.job;
+    if (!job || response.id !== job.id) {
+      // The answer to a request that has already timed out.
+      return;
+    }
+    worker.job = null;
+    this.finish(job);
+    this.counters.completed++;
+    job.resolve(response);
+    this.dispatch();
+  }
+
+  onTimeout(job, timeoutMs) {
+    this.counters.timeouts++;
+    const queued = this.queue.indexOf(job);
+    if (queued >= 0) {
+      this.queue.splice(queued, 1);
+    } else if (job.worker) {
+      // The worker is stuck in this solve; replace it rather than wait.
+      job.worker.job = null;
+      job.worker.stopping = true;
+      job.worker.child.kill('SIGKILL');
+    }
+    this.finish(job);
+    this.counters.failed++;
+    job.reject(new SolverPoolError(`The solve took longer than ${timeoutMs} ms`, 'timeout'));
+  }
+
+  onExit(worker) {
+    if (!worker.alive) return;
+    worker.alive = false;
+    const job = worker.job;
+    worker.job = null;
+    if (job) {
+      this.finish(job);
+      this.counters.failed++;
+      job.reject(new SolverPoolError('The slvsx worker exited during the solve', 'crashed'));
+    }
+
+    const index = this.workers.indexOf(worker);
+    if (index >= 0) this.workers.splice(index, 1);
+    if (this.closed) return;
+
+    this.counters.restarts++;
+    const restart = () => {
+      if (this.closed) return;
+      this.workers.push(this.startWorker());
+      this.dispatch();
+    };
+    if (Date.now() - worker.startedAt < RESTART_WINDOW_MS) {
+      setTimeout(restart, RESTART_BACKOFF_MS).unref();
+    } else {
+      restart();
+    }
+  }
+
+  finish(job) {
+    clearTimeout(job.timer);
+    const ms = Date.now() - job.startedAt;
+    this.latency.count++;
+    this.latency.totalMs += ms;
+    this.latency.maxMs = Math.max(this.latency.maxMs, ms);
+  }
+
+  /** Counters and gauges for the pool, for reporting */
+  stats() {
+    const alive = this.workers.filter((w) => w.alive);
+    return {
+      workers: alive.length,
+      busy: alive.filter((w) => w.job).length,
+      queued: this.queue.length,
+      maxQueue: this.maxQueue,
+      ...this.counters,
+      latencyMs: {
+        mean: this.latency.count ? this.latency.totalMs / this.latency.count : 0,
+        max: this.latency.maxMs,
+      },
+    };
+  }
+
+  /** Fail whatever is waiting and stop every worker */
+  close() {
+    this.closed = true;
+    for (const job of this.queue.splice(0)) {
+      clearTimeout(job.timer);
+      job.reject(new SolverPoolError('The solver pool is closed', 'closed'));
+    }
+    for (const worker of this.workers) {
+      worker.child.stdin.end();
+      worker.child.kill();
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env node
+/**
+ * Stands in for `slvsx serve` in the solver pool tests. Documents steer it:
+ * `{"sleep": ms}` answers after a delay, `{"crash": true}` exits without
+ * answering, and anything else is echoed back as the result. With
+ * `--format msgpack` it speaks MessagePack frames, and answers a request
+ * for `positions` with the numbers in `document.positions`, packed.
+ */
+
+import * as readline from 'readline';
+import * as wire from '../wire.js';
+
+const msgpack = process.argv.includes('msgpack');
+
+function answer({ id, command, document, positions }) {
+  if (document.crash) {
+    process.exit(1);
+  }
+  const reply = () => {
+    const response = document.fail
+      ? { id, ok: false, error: { code: 2, message: document.fail } }
+      : { id, ok: true, result: { command, document } };
+    if (!msgpack) {
+      process.stdout.write(JSON.stringify(response) + '\n');
+      return;
+    }
+    let body = wire.encode(response);
+    if (positions) {
+      // As the server does: one more entry, a bin of little-endian floats
+      const packed = Buffer.from(Float64Array.from(document.positions).buffer);
+      const key = wire.encode('positions');
+      const header = Buffer.from([0xc6, 0, 0, 0, 0]);
+      header.writeUInt32BE(packed.length, 1);
+      body = Buffer.concat([Buffer.from([body[0] + 1]), body.subarray(1), key, header, packed]);
+    }
+    const length = Buffer.alloc(4);
+    length.writeUInt32BE(body.length);
+    process.stdout.write(Buffer.concat([length, body]));
+  };
+  if (document.sleep) {
+    setTimeout(reply, document.sleep);
+  } else {
+    reply();
+  }
+}
+
+if (msgpack) {
+  let pending = Buffer.alloc(0);
+  process.stdin.on('data', (chunk) => {
+    pending = Buffer.concat([pending, chunk]);
+    while (pending.length >= 4 && pending.length >= 4 + pending.readUInt32BE(0)) {
+      const end = 4 + pending.readUInt32BE(0);
+      answer(wire.decode(pending.subarray(4, end)));
+      pending = pending.subarray(end);
+    }
+  });
+} else {
+  readline.createInterface({ input: process.stdin }).on('line', (line) => answer(JSON.parse(line)));
+}
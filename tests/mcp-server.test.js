@@ -9,6 +9,8 @@ import assert from 'assert';
 import * as fs from 'fs';
 import * as path from 'path';
 import { fileURLToPath } from 'url';
+import { SolverPool } from '../solver-pool.js';
+import * as wire from '../wire.js';
 
 const __filename = fileURLToPath(import.meta.url);
 const __dirname = path.dirname(__filename);
@@ -269,6 +271,146 @@ test('package.json includes docs.json in files', () => {
   assert(pkg.files.includes('dist/docs.json'), 'Should include dist/docs.json in published files');
 });
 
+// ============================================
+// Test: Solver Pool
+// ============================================
+
+const fakeServe = path.join(__dirname, 'fake-slvsx-serve.js');
+
+function fakePool(options = {}) {
+  return new SolverPool({ binary: process.execPath, args: [fakeServe], ...options });
+}
+
+await asyncTest('SolverPool answers requests by id', async () => {
+  const pool = fakePool({ size: 2 });
+  try {
+    const responses = await Promise.all(
+      [30, 0, 10, 0].map((sleep, i) => pool.request('solve', { n: i, sleep }))
+    );
+    responses.forEach((r, i) => {
+      assert(r.ok, 'Response should be ok');
+      assert.strictEqual(r.result.document.n, i);
+    });
+    const stats = pool.stats();
+    assert.strictEqual(stats.completed, 4);
+    assert.strictEqual(stats.queued, 0);
+  } finally {
+    pool.close();
+  }
+});
+
+await asyncTest('SolverPool passes solver errors through', async () => {
+  const pool = fakePool({ size: 1 });
+  try {
+    const r = await pool.request('validate', { fail: 'bad document' });
+    assert.strictEqual(r.ok, false);
+    assert.strictEqual(r.error.message, 'bad document');
+  } finally {
+    pool.close();
+  }
+});
+
+await asyncTest('SolverPool refuses requests once the queue is full', async () => {
+  const pool = fakePool({ size: 1, maxQueue: 1 });
+  try {
+    const running = pool.request('solve', { sleep: 50 });
+    const waiting = pool.request('solve', {});
+    await assert.rejects(pool.request('solve', {}), { code: 'busy' });
+    await Promise.all([running, waiting]);
+    assert.strictEqual(pool.stats().rejected, 1);
+  } finally {
+    pool.close();
+  }
+});
+
+await asyncTest('SolverPool times out a stuck solve and replaces the worker', async () => {
+  const pool = fakePool({ size: 1 });
+  try {
+    await assert.rejects(pool.request('solve', { sleep: 5000 }, { timeoutMs: 50 }), {
+      code: 'timeout',
+    });
+    const r = await pool.request('solve', { n: 1 });
+    assert(r.ok, 'The replacement worker should answer');
+    const stats = pool.stats();
+    assert.strictEqual(stats.timeouts, 1);
+    assert.strictEqual(stats.restarts, 1);
+  } finally {
+    pool.close();
+  }
+});
+
+await asyncTest('SolverPool restarts a worker that crashes', async () => {
+  const pool = fakePool({ size: 1 });
+  try {
+    await assert.rejects(pool.request('solve', { crash: true }), { code: 'crashed' });
+    const r = await pool.request('solve', { n: 2 });
+    assert.strictEqual(r.result.document.n, 2);
+    assert.strictEqual(pool.stats().restarts, 1);
+  } finally {
+    pool.close();
+  }
+});
+
+test('wire round-trips JSON values through MessagePack', () => {
+  const value = {
+    schema: 'slvs-json/1',
+    small: [0, 127, 128, 65536, 4294967296, -1, -33, -40000, -3000000000],
+    floats: [0.5, -2.25, 1e300],
+    text: ['', 'x'.repeat(40), 'y'.repeat(300), 'héllo'],
+    nested: { a: null, b: true, c: false, d: [[], {}] },
+    long: Array.from({ length: 70000 }, (_, i) => i),
+  };
+  assert.deepStrictEqual(wire.decode(wire.encode(value)), value);
+  // As the server encodes it
+  assert.deepStrictEqual(
+    [...wire.encode({ a: [1, -1, 0.5] })],
+    [0x81, 0xa1, 0x61, 0x93, 0x01, 0xff, 0xcb, 0x3f, 0xe0, 0, 0, 0, 0, 0, 0]
+  );
+  assert.throws(() => wire.decode(Buffer.from([0x92, 0x01])));
+  assert.throws(() => wire.decode(Buffer.from([0x01, 0x02])));
+});
+
+test('wire reads packed floats however they are aligned', () => {
+  const floats = [1.5, -2, NaN, 1e-300];
+  const bytes = Buffer.alloc(1 + 8 * floats.length);
+  floats.forEach((f, i) => bytes.writeDoubleLE(f, 1 + 8 * i));
+  assert.deepStrictEqual([...wire.float64s(bytes.subarray(1))], floats);
+  const aligned = Buffer.from(bytes.subarray(1));
+  assert.deepStrictEqual([...wire.float64s(aligned)], floats);
+});
+
+await asyncTest('SolverPool speaks MessagePack and reads positions as floats', async () => {
+  const pool = fakePool({ size: 2, format: 'msgpack' });
+  try {
+    const r = await pool.request('solve', { n: 1, sleep: 5 });
+    assert.strictEqual(r.result.document.n, 1);
+    const err = await pool.request('validate', { fail: 'bad document' });
+    assert.strictEqual(err.error.message, 'bad document');
+
+    // A frame large enough to arrive in several chunks
+    const positions = Array.from({ length: 100000 }, (_, i) => i / 4);
+    const packed = await pool.request('solve', { positions }, { positions: true });
+    assert(packed.positions instanceof Float64Array, 'Positions should be a Float64Array');
+    assert.strictEqual(packed.positions.length, positions.length);
+    assert.strictEqual(packed.positions[99999], 99999 / 4);
+  } finally {
+    pool.close();
+  }
+});
+
+test('MCP server routes solves through the solver pool', () => {
+  const content = fs.readFileSync(path.join(projectRoot, 'mcp-server.js'), 'utf-8');
+  assert(content.includes("request('solve'"), 'Should solve through the pool');
+  assert(content.includes("request('validate'"), 'Should validate through the pool');
+  assert(content.includes("name: 'get_solver_stats'"), 'Should define get_solver_stats tool');
+});
+
+test('package.json includes solver-pool.js in files', () => {
+  const pkg = JSON.parse(fs.readFileSync(path.join(projectRoot, 'package.json'), 'utf-8'));
+  assert(pkg.files.includes('solver-pool.js'), 'Should publish solver-pool.js');
+  assert(pkg.files.includes('wire.js'), 'Should publish wire.js');
+});
+
 // ============================================
 // Summary
 // ============================================
@@ -0,0 +1,78 @@
+// SLVSX Visualizer - solver worker
+//
+// Keeps the gear train's document compiled in the solver's WebAssembly
+// build (`npm run build-wasm`) and answers each change of its parameters
+// with only the entities that moved, so that the page redraws just those
+// gears rather than the whole train. Messages in:
+//
+//   { type: 'load', seq, document, progress }  compile a document and solve it
+//   { type: 'parameters', seq, parameters }    set parameters and solve again
+//
+// and out, for each of those:
+//
+//   { type: 'progress', seq, iterations, residual }  after each Newton step,
+//                                                    if `progress` was asked for
+//   { type: 'delta', seq, changed }  id -> [x, y, z, 0] for a point that moved,
+//                                    [cx, cy, cz, radius] for a circle
+//   { type: 'error', seq, message }
+
+import init, { WasmSystem } from './pkg/slvsx_core.js';
+
+const ready = init();
+
+// How far a coordinate has to move to be sent again
+const TOLERANCE = 1e-9;
+
+let system = null;
+let ids = [];
+let last = null;
+let seq = 0;
+
+function moved(a, b) {
+    for (let i = 0; i < a.length; i++) {
+        if (!(Math.abs(a[i] - b[i]) <= TOLERANCE)) return true;
+    }
+    return false;
+}
+
+function solve() {
+    // The view is good until the next call into the module; keep a copy
+    const positions = system.solve().slice();
+    const changed = {};
+    for (let i = 0; i < ids.length; i++) {
+        const at = positions.subarray(4 * i, 4 * i + 4);
+        // Lines, arcs and the like are made of the points, and come as NaNs
+        if (Number.isNaN(at[0])) continue;
+        if (last && !moved(at, last.subarray(4 * i, 4 * i + 4))) continue;
+        changed[ids[i]] = Array.from(at);
+    }
+    last = positions;
+    postMessage({ type: 'delta', seq, changed });
+}
+
+self.onmessage = async (event) => {
+    await ready;
+    const message = event.data;
+    seq = message.seq;
+    try {
+        if (message.type === 'load') {
+            if (system) system.free();
+            system = new WasmSystem(JSON.stringify(message.document));
+            ids = system.entityIds();
+            last = null;
+            if (message.progress) {
+                system.onProgress((iterations, residual) => {
+                    postMessage({ type: 'progress', seq, iterations, residual });
+                });
+            }
+        } else if (message.type === 'parameters') {
+            if (!system) throw new Error('No document is loaded');
+            for (const [name, value] of Object.entries(message.parameters)) {
+                system.setParameter(name, value);
+            }
+        }
+        solve();
+    } catch (e) {
+        postMessage({ type: 'error', seq, message: String(e) });
+    }
+};
@@ -6,30 +6,83 @@ class GearSystem {
         this.ctx = this.canvas.getContext('2d');
         this.constraints = null;
         this.solution = null;
+        // Each gear as last solved: id -> { center, radius, teeth, module, internal }
+        this.gears = new Map();
+        // Gear outlines, built once for each shape rather than on every redraw
+        this.paths = new Map();
+        // The system type and planets the loaded document was built for;
+        // other inputs only change its parameters
+        this.layout = null;
+        this.seq = 0;
+        this.loadSeq = 0;
+        // Parameters waiting for the solve in flight to finish
+        this.solving = false;
+        this.pending = null;
+        this.worker = this.startWorker();
+
+        for (const id of ['sunTeeth', 'planetTeeth', 'ringTeeth', 'module']) {
+            document.getElementById(id).addEventListener('input', () => this.tweak());
+        }
     }
 
-    generateConstraints() {
-        const systemType = document.getElementById('systemType').value;
-        const sunTeeth = parseInt(document.getElementById('sunTeeth').value);
-        const planetTeeth = parseInt(document.getElementById('planetTeeth').value);
-        const ringTeeth = parseInt(document.getElementById('ringTeeth').value);
-        const numPlanets = parseInt(document.getElementById('numPlanets').value);
-        const module = parseFloat(document.getElementById('module').value);
+    // The solver, compiled to WebAssembly, in a worker of its own; without
+    // that build, solutions are simulated instead
+    startWorker() {
+        try {
+            const worker = new Worker('solver-worker.js', { type: 'module' });
+            worker.onmessage = (event) => this.onSolverMessage(event.data);
+            worker.onerror = () => {
+                this.worker = null;
+                this.solving = false;
+                if (this.constraints) this.applySimulated(this.constraints);
+            };
+            return worker;
+        } catch (e) {
+            return null;
+        }
+    }
 
-        // Validate assembly constraint
+    readInputs() {
+        return {
+            systemType: document.getElementById('systemType').value,
+            sunTeeth: parseInt(document.getElementById('sunTeeth').value),
+            planetTeeth: parseInt(document.getElementById('planetTeeth').value),
+            ringTeeth: parseInt(document.getElementById('ringTeeth').value),
+            numPlanets: parseInt(document.getElementById('numPlanets').value),
+            module: parseFloat(document.getElementById('module').value)
+        };
+    }
+
+    // Why these inputs can't be assembled, if they can't
+    assemblyError(inputs) {
+        const { systemType, sunTeeth, planetTeeth, ringTeeth, numPlanets } = inputs;
         if (systemType === 'planetary' || systemType === 'double') {
+            if (ringTeeth !== sunTeeth + 2 * planetTeeth) {
+                return `Planets only fit between sun and ring if ring teeth = sun teeth + 2 x planet teeth (${sunTeeth + 2 * planetTeeth})`;
+            }
             if ((sunTeeth + ringTeeth) % numPlanets !== 0) {
-                this.showError(`Assembly constraint failed: (${sunTeeth} + ${ringTeeth}) / ${numPlanets} must be integer`);
-                return null;
+                return `Assembly constraint failed: (${sunTeeth} + ${ringTeeth}) / ${numPlanets} must be integer`;
             }
         }
+        return null;
+    }
+
+    generateConstraints() {
+        const inputs = this.readInputs();
+        const { systemType, sunTeeth, planetTeeth, ringTeeth, numPlanets, module } = inputs;
+
+        // Validate assembly constraint
+        const error = this.assemblyError(inputs);
+        if (error) {
+            this.showError(error);
+            return null;
+        }
 
         let constraints = {
             schema: "slvs-json/1",
             units: "mm",
             parameters: {
                 module: module,
-                pressure_angle: 20.0,
                 sun_teeth: sunTeeth,
                 planet_teeth: planetTeeth,
                 ring_teeth: ringTeeth
@@ -38,65 +91,63 @@ class GearSystem {
             constraints: []
         };
 
-        // Add sun gear
-        constraints.entities.push({
-            type: "gear",
-            id: "sun",
-            center: [0, 0, 0],
-            teeth: "$sun_teeth",
-            module: "$module",
-            pressure_angle: "$pressure_angle",
-            phase: 0.0,
-            internal: false
-        });
-
-        if (systemType === 'planetary' || systemType === 'double') {
-            // Add ring gear
+        // Gears are their pitch circles, module x teeth across
+        const gear = (id, center, teeth) => {
             constraints.entities.push({
-                type: "gear",
-                id: "ring",
-                center: [0, 0, 0],
-                teeth: "$ring_teeth",
+                type: "circle",
+                id: id,
+                center: center,
+                diameter: `$module * $${teeth}`
+            });
+        };
+        const mesh = (a, b, teethA, teethB, internal) => {
+            constraints.constraints.push({
+                type: "gear_mesh",
+                a: a,
+                b: b,
                 module: "$module",
-                pressure_angle: "$pressure_angle",
-                phase: 0.0,
-                internal: true
+                teeth_a: `$${teethA}`,
+                teeth_b: `$${teethB}`,
+                internal: internal
             });
+        };
 
-            // Add planets
-            const orbitRadius = (sunTeeth + planetTeeth) * module / 2;
+        // Add sun gear, fixed at the origin
+        constraints.entities.push({ type: "point", id: "sun_center", at: [0, 0, 0] });
+        constraints.constraints.push({ type: "fixed", entity: "sun_center" });
+        gear("sun", "sun_center", "sun_teeth");
+
+        // The gears that mesh with the sun, spread around it
+        const orbitRadius = (sunTeeth + planetTeeth) * module / 2;
+        let planets = [];
+        if (systemType === 'planetary' || systemType === 'double') {
+            // Add ring gear, around the sun; a planet that meshes with the
+            // sun meshes with it too, so it needs no constraint of its own
+            gear("ring", "sun_center", "ring_teeth");
             for (let i = 0; i < numPlanets; i++) {
-                const angle = (i * 360 / numPlanets) * Math.PI / 180;
-                const x = orbitRadius * Math.cos(angle);
-                const y = orbitRadius * Math.sin(angle);
-
-                constraints.entities.push({
-                    type: "gear",
-                    id: `planet${i + 1}`,
-                    center: [x, y, 0],
-                    teeth: "$planet_teeth",
-                    module: "$module",
-                    pressure_angle: "$pressure_angle",
-                    phase: 0.0,
-                    internal: false
-                });
-
-                // Add mesh constraints
-                constraints.constraints.push({
-                    type: "mesh",
-                    gear1: "sun",
-                    gear2: `planet${i + 1}`
-                });
-
-                constraints.constraints.push({
-                    type: "mesh",
-                    gear1: "ring",
-                    gear2: `planet${i + 1}`
-                });
+                planets.push(i * 2 * Math.PI / numPlanets);
             }
+        } else {
+            planets.push(0);
         }
 
+        // Add planets
+        planets.forEach((angle, i) => {
+            const id = `planet${i + 1}`;
+            constraints.entities.push({
+                type: "point",
+                id: `${id}_center`,
+                at: [orbitRadius * Math.cos(angle), orbitRadius * Math.sin(angle), 0]
+            });
+            gear(id, `${id}_center`, "planet_teeth");
+
+            // Add mesh constraints
+            mesh("sun", id, "sun_teeth", "planet_teeth", false);
+        });
+
         this.constraints = constraints;
+        this.layout = `${systemType}/${numPlanets}`;
+        this.gears.clear();
         this.showSuccess('Constraints generated successfully!');
         
         // Display JSON
@@ -105,39 +156,154 @@ class GearSystem {
         return constraints;
     }
 
-    async callSolver(constraints) {
-        // In a real implementation, this would call the SLVSX CLI
-        // For demo purposes, we'll simulate a solution
-        return this.simulateSolution(constraints);
+    // What each gear's teeth and module are, which the solver doesn't say
+    gearInfo(id, parameters) {
+        if (id === 'sun') return { teeth: parameters.sun_teeth, module: parameters.module, internal: false };
+        if (id === 'ring') return { teeth: parameters.ring_teeth, module: parameters.module, internal: true };
+        return { teeth: parameters.planet_teeth, module: parameters.module, internal: false };
+    }
+
+    // Solve the document from scratch, with the solver's steps shown as it goes
+    load(constraints) {
+        this.seq += 1;
+        this.loadSeq = this.seq;
+        if (!this.worker) {
+            this.applySimulated(constraints);
+            return;
+        }
+        this.solving = true;
+        this.pending = null;
+        this.worker.postMessage({ type: 'load', seq: this.seq, document: constraints, progress: true });
+    }
+
+    // An input other than the layout changed: send just the parameters, and
+    // redraw just the gears they move
+    tweak() {
+        const inputs = this.readInputs();
+        if (!this.constraints || this.layout !== `${inputs.systemType}/${inputs.numPlanets}`) return;
+        const error = this.assemblyError(inputs);
+        if (error) {
+            this.showError(error);
+            return;
+        }
+        const parameters = {
+            module: inputs.module,
+            sun_teeth: inputs.sunTeeth,
+            planet_teeth: inputs.planetTeeth,
+            ring_teeth: inputs.ringTeeth
+        };
+        Object.assign(this.constraints.parameters, parameters);
+        if (!this.worker) {
+            this.applySimulated(this.constraints);
+            return;
+        }
+        // While a solve is running, only the latest change is worth solving
+        if (this.solving) {
+            this.pending = parameters;
+            return;
+        }
+        this.solving = true;
+        this.seq += 1;
+        this.worker.postMessage({ type: 'parameters', seq: this.seq, parameters });
+    }
+
+    onSolverMessage(message) {
+        if (message.seq < this.loadSeq) return;
+        if (message.type === 'progress') {
+            this.showStatus(`Solving: step ${message.iterations}, residual ${message.residual.toExponential(2)}`);
+            return;
+        }
+        this.solving = false;
+        if (message.type === 'error') {
+            this.showError(message.message);
+        } else {
+            this.applyDelta(message.changed);
+        }
+        if (this.pending) {
+            const parameters = this.pending;
+            this.pending = null;
+            this.solving = true;
+            this.seq += 1;
+            this.worker.postMessage({ type: 'parameters', seq: this.seq, parameters });
+        }
     }
 
     simulateSolution(constraints) {
-        // Simulate solver output
+        // Simulate solver output: every circle where the document starts it
         let solution = {
             status: "success",
             entities: {}
         };
 
-        // Copy entity positions from constraints
+        const points = {};
         for (let entity of constraints.entities) {
-            solution.entities[entity.id] = {
-                center: entity.center,
-                teeth: this.resolveParameter(entity.teeth, constraints.parameters),
-                module: this.resolveParameter(entity.module, constraints.parameters),
-                phase: entity.phase || 0,
-                internal: entity.internal || false
-            };
+            if (entity.type === 'point') points[entity.id] = entity.at;
+        }
+        for (let entity of constraints.entities) {
+            if (entity.type !== 'circle') continue;
+            const center = points[entity.center];
+            const info = this.gearInfo(entity.id, constraints.parameters);
+            solution.entities[entity.id] = [center[0], center[1], center[2], info.teeth * info.module / 2];
         }
 
         return solution;
     }
 
-    resolveParameter(value, parameters) {
-        if (typeof value === 'string' && value.startsWith('$')) {
-            const paramName = value.substring(1);
-            return parameters[paramName];
+    applySimulated(constraints) {
+        const solution = this.simulateSolution(constraints);
+        const changed = {};
+        for (let [id, at] of Object.entries(solution.entities)) {
+            const gear = this.gears.get(id);
+            if (!gear || gear.center[0] !== at[0] || gear.center[1] !== at[1] || gear.radius !== at[3]) {
+                changed[id] = at;
+            }
+        }
+        this.applyDelta(changed);
+    }
+
+    // Take on the gears that moved, and redraw just the parts of the canvas
+    // they were and are in
+    applyDelta(changed) {
+        const parameters = this.constraints.parameters;
+        const dirty = [];
+        let redrawn = 0;
+        for (let [id, gear] of this.gears) {
+            // A change of teeth alone moves nothing, but still shows
+            const info = this.gearInfo(id, parameters);
+            if (!(id in changed) && (gear.teeth !== info.teeth || gear.module !== info.module)) {
+                changed[id] = [gear.center[0], gear.center[1], gear.center[2], gear.radius];
+            }
         }
-        return value;
+        const full = this.gears.size === 0;
+        for (let [id, at] of Object.entries(changed)) {
+            // Points are the gears' centres, and come with their circles
+            if (!at.length || at[3] === 0) continue;
+            const before = this.gears.get(id);
+            if (before) dirty.push(this.screenBox(before));
+            const gear = { center: at.slice(0, 3), radius: at[3], ...this.gearInfo(id, parameters) };
+            this.gears.set(id, gear);
+            dirty.push(this.screenBox(gear));
+            redrawn += 1;
+        }
+
+        if (full) {
+            this.drawGearSystem();
+        } else if (dirty.length) {
+            this.redraw(dirty);
+        }
+        this.showStatus(`Solved: ${redrawn} of ${this.gears.size} gears redrawn`);
+    }
+
+    // The part of the canvas a gear covers, teeth, label and all
+    screenBox(gear) {
+        const reach = gear.radius + 2 * gear.module + 1;
+        const margin = 2;
+        return {
+            x: this.canvas.width / 2 + 2 * (gear.center[0] - reach) - margin,
+            y: this.canvas.height / 2 - 2 * (gear.center[1] + reach) - margin,
+            w: 4 * reach + 2 * margin,
+            h: 4 * reach + 2 * margin
+        };
     }
 
     visualize() {
@@ -146,69 +312,90 @@ class GearSystem {
             if (!this.constraints) return;
         }
 
-        const solution = this.simulateSolution(this.constraints);
-        this.drawGearSystem(solution);
+        this.load(this.constraints);
     }
 
-    drawGearSystem(solution) {
+    drawGearSystem() {
         const ctx = this.ctx;
-        const width = this.canvas.width;
-        const height = this.canvas.height;
         
         // Clear canvas
-        ctx.clearRect(0, 0, width, height);
+        ctx.clearRect(0, 0, this.canvas.width, this.canvas.height);
+        this.drawGears(null);
         
+        this.showSuccess('Visualization complete!');
+    }
+
+    // Clear the boxes and draw again every gear that overlaps them, clipped
+    // to them, leaving the rest of the canvas as it was
+    redraw(boxes) {
+        const ctx = this.ctx;
+        ctx.save();
+        ctx.beginPath();
+        for (const box of boxes) {
+            ctx.rect(box.x, box.y, box.w, box.h);
+        }
+        ctx.clip();
+        ctx.clearRect(0, 0, this.canvas.width, this.canvas.height);
+        this.drawGears(boxes);
+        ctx.restore();
+    }
+
+    // Draw the gears that overlap boxes, or all of them
+    drawGears(boxes) {
+        const ctx = this.ctx;
+        const overlaps = (a, b) => a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+
         // Set up transformation to center coordinate system
         ctx.save();
-        ctx.translate(width / 2, height / 2);
+        ctx.translate(this.canvas.width / 2, this.canvas.height / 2);
         ctx.scale(2, -2); // Scale up and flip Y axis
         
         // Draw each gear
-        for (let [id, gear] of Object.entries(solution.entities)) {
+        for (let [id, gear] of this.gears) {
+            if (boxes && !boxes.some((box) => overlaps(box, this.screenBox(gear)))) continue;
             this.drawGear(gear, id);
         }
         
         ctx.restore();
-        
-        this.showSuccess('Visualization complete!');
     }
 
-    drawGear(gear, id) {
-        const ctx = this.ctx;
-        const x = gear.center[0];
-        const y = gear.center[1];
-        const pitchRadius = (gear.teeth * gear.module) / 2;
+    // A gear's outline about its centre, made once for each shape
+    gearPath(gear) {
+        const key = `${gear.teeth}/${gear.radius}/${gear.module}/${gear.internal}`;
+        let path = this.paths.get(key);
+        if (path) return path;
+
         const toothHeight = gear.module;
-        
-        ctx.save();
-        ctx.translate(x, y);
-        ctx.rotate(gear.phase * Math.PI / 180);
-        
+        path = new Path2D();
         if (gear.internal) {
-            // Draw ring gear (internal)
-            ctx.strokeStyle = '#764ba2';
-            ctx.lineWidth = 0.5;
-            
             // Outer circle
-            ctx.beginPath();
-            ctx.arc(0, 0, pitchRadius + toothHeight * 2, 0, 2 * Math.PI);
-            ctx.stroke();
+            path.arc(0, 0, gear.radius + toothHeight * 2, 0, 2 * Math.PI);
+            path.closePath();
             
             // Draw internal teeth
-            this.drawInternalTeeth(ctx, gear.teeth, pitchRadius, toothHeight);
+            this.drawInternalTeeth(path, gear.teeth, gear.radius, toothHeight);
         } else {
-            // Draw external gear
-            ctx.strokeStyle = '#667eea';
-            ctx.lineWidth = 0.5;
-            
             // Draw teeth
-            this.drawExternalTeeth(ctx, gear.teeth, pitchRadius, toothHeight);
+            this.drawExternalTeeth(path, gear.teeth, gear.radius, toothHeight);
             
             // Center hole
-            ctx.beginPath();
-            ctx.arc(0, 0, pitchRadius * 0.2, 0, 2 * Math.PI);
-            ctx.stroke();
+            path.moveTo(gear.radius * 0.2, 0);
+            path.arc(0, 0, gear.radius * 0.2, 0, 2 * Math.PI);
         }
+        this.paths.set(key, path);
+        return path;
+    }
+
+    drawGear(gear, id) {
+        const ctx = this.ctx;
+        const x = gear.center[0];
+        const y = gear.center[1];
+        
+        ctx.save();
+        ctx.translate(x, y);
+        ctx.strokeStyle = gear.internal ? '#764ba2' : '#667eea';
+        ctx.lineWidth = 0.5;
+        ctx.stroke(this.gearPath(gear));
         
         // Label
         ctx.restore();
@@ -222,66 +409,63 @@ class GearSystem {
         ctx.restore();
     }
 
-    drawExternalTeeth(ctx, numTeeth, pitchRadius, toothHeight) {
+    drawExternalTeeth(path, numTeeth, pitchRadius, toothHeight) {
         const toothAngle = (2 * Math.PI) / numTeeth;
         const outerRadius = pitchRadius + toothHeight;
         const innerRadius = pitchRadius - toothHeight * 0.5;
         
-        ctx.beginPath();
         for (let i = 0; i < numTeeth; i++) {
             const angle = i * toothAngle;
             const nextAngle = (i + 1) * toothAngle;
             const midAngle = angle + toothAngle / 2;
             
             // Tooth tip
-            ctx.lineTo(
+            path.lineTo(
                 outerRadius * Math.cos(angle + toothAngle * 0.2),
                 outerRadius * Math.sin(angle + toothAngle * 0.2)
             );
-            ctx.lineTo(
+            path.lineTo(
                 outerRadius * Math.cos(angle + toothAngle * 0.3),
                 outerRadius * Math.sin(angle + toothAngle * 0.3)
             );
             
             // Tooth valley
-            ctx.lineTo(
+            path.lineTo(
                 innerRadius * Math.cos(midAngle),
                 innerRadius * Math.sin(midAngle)
             );
         }
-        ctx.closePath();
-        ctx.stroke();
+        path.closePath();
     }
 
-    drawInternalTeeth(ctx, numTeeth, pitchRadius, toothHeight) {
+    drawInternalTeeth(path, numTeeth, pitchRadius, toothHeight) {
         const toothAngle = (2 * Math.PI) / numTeeth;
         const outerRadius = pitchRadius - toothHeight;
         const innerRadius = pitchRadius;
         
-        ctx.beginPath();
+        path.moveTo(innerRadius, 0);
         for (let i = 0; i < numTeeth; i++) {
             const angle = i * toothAngle;
             const midAngle = angle + toothAngle / 2;
             
             // Valley
-            ctx.lineTo(
+            path.lineTo(
                 innerRadius * Math.cos(angle),
                 innerRadius * Math.sin(angle)
             );
             
             // Tooth (pointing inward)
-            ctx.lineTo(
+            path.lineTo(
                 outerRadius * Math.cos(midAngle),
                 outerRadius * Math.sin(midAngle)
             );
             
-            ctx.lineTo(
+            path.lineTo(
                 innerRadius * Math.cos(angle + toothAngle),
                 innerRadius * Math.sin(angle + toothAngle)
             );
         }
-        ctx.closePath();
-        ctx.stroke();
+        path.closePath();
     }
 
     exportSVG() {
@@ -290,11 +474,13 @@ class GearSystem {
             return;
         }
 
+        // The gears as last solved, or as the document starts them
+        if (this.gears.size === 0) this.applySimulated(this.constraints);
+
         // Generate SVG string
-        const solution = this.simulateSolution(this.constraints);
         let svg = `<svg xmlns="http://www.w3.org/2000/svg" viewBox="-200 -200 400 400" width="800" height="800">\n`;
         
-        for (let [id, gear] of Object.entries(solution.entities)) {
+        for (let [id, gear] of this.gears) {
             svg += this.gearToSVG(gear, id);
         }
         
@@ -315,7 +501,7 @@ class GearSystem {
     gearToSVG(gear, id) {
         const x = gear.center[0];
         const y = gear.center[1];
-        const pitchRadius = (gear.teeth * gear.module) / 2;
+        const pitchRadius = gear.radius;
         
         return `  <g id="${id}" transform="translate(${x}, ${y})">
     <circle cx="0" cy="0" r="${pitchRadius}" fill="none" stroke="black" stroke-width="0.5"/>
@@ -332,6 +518,10 @@ class GearSystem {
         const output = document.getElementById('output');
         output.innerHTML = `<div class="success">${message}</div>`;
     }
+
+    showStatus(message) {
+        document.getElementById('status').textContent = message;
+    }
 }
 
 // Initialize
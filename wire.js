@@ -0,0 +1,221 @@
+/**
+ * MessagePack for talking to `slvsx serve --format msgpack` (see
+ * crates/core/src/wire.rs): just the part of it that JSON values need, plus
+ * bin, which the server uses for packed floats.
+ *
+ * - Numbers that aren't integers are written as float 64, and integers as
+ *   small as they fit, as the server does.
+ * - A bin is read as a Uint8Array over the input, not copied;
+ *   `float64s` turns one into a Float64Array.
+ */
+
+import * as os from 'os';
+
+const LITTLE_ENDIAN = os.endianness() === 'LE';
+
+class Writer {
+  constructor() {
+    this.buffer = Buffer.allocUnsafe(256);
+    this.at = 0;
+  }
+
+  room(n) {
+    if (this.at + n <= this.buffer.length) return;
+    const grown = Buffer.allocUnsafe(Math.max(this.buffer.length * 2, this.at + n));
+    this.buffer.copy(grown, 0, 0, this.at);
+    this.buffer = grown;
+  }
+
+  byte(b) {
+    this.room(1);
+    this.buffer[this.at++] = b;
+  }
+
+  // A length in the fix form below fixMax, or after the 8, 16 or 32 bit
+  // marker (0 for none)
+  len(n, fix, fixMax, [m8, m16, m32]) {
+    this.room(5);
+    if (n < fixMax) {
+      this.buffer[this.at++] = fix | n;
+    } else if (m8 && n <= 0xff) {
+      this.buffer[this.at++] = m8;
+      this.buffer[this.at++] = n;
+    } else if (n <= 0xffff) {
+      this.buffer[this.at++] = m16;
+      this.at = this.buffer.writeUInt16BE(n, this.at);
+    } else {
+      this.buffer[this.at++] = m32;
+      this.at = this.buffer.writeUInt32BE(n, this.at);
+    }
+  }
+
+  string(s) {
+    const n = Buffer.byteLength(s);
+    this.len(n, 0xa0, 32, [0xd9, 0xda, 0xdb]);
+    this.room(n);
+    this.at += this.buffer.write(s, this.at);
+  }
+
+  number(x) {
+    this.room(9);
+    if (!Number.isSafeInteger(x)) {
+      this.buffer[this.at++] = 0xcb;
+      this.at = this.buffer.writeDoubleBE(x, this.at);
+    } else if (x >= 0 && x < 0x80) {
+      this.buffer[this.at++] = x;
+    } else if (x < 0 && x >= -32) {
+      this.buffer[this.at++] = x & 0xff;
+    } else if (x >= 0 && x <= 0xffffffff) {
+      this.buffer[this.at++] = 0xce;
+      this.at = this.buffer.writeUInt32BE(x, this.at);
+    } else if (x < 0 && x >= -0x80000000) {
+      this.buffer[this.at++] = 0xd2;
+      this.at = this.buffer.writeInt32BE(x, this.at);
+    } else {
+      this.buffer[this.at++] = x < 0 ? 0xd3 : 0xcf;
+      this.at = x < 0
+        ? this.buffer.writeBigInt64BE(BigInt(x), this.at)
+        : this.buffer.writeBigUInt64BE(BigInt(x), this.at);
+    }
+  }
+
+  value(v) {
+    if (v === null || v === undefined) {
+      this.byte(0xc0);
+    } else if (typeof v === 'boolean') {
+      this.byte(v ? 0xc3 : 0xc2);
+    } else if (typeof v === 'number') {
+      this.number(v);
+    } else if (typeof v === 'string') {
+      this.string(v);
+    } else if (Array.isArray(v)) {
+      this.len(v.length, 0x90, 16, [0, 0xdc, 0xdd]);
+      for (const item of v) this.value(item === undefined ? null : item);
+    } else if (typeof v.toJSON === 'function') {
+      this.value(v.toJSON());
+    } else {
+      // As JSON.stringify would, leave out what's undefined
+      const entries = Object.entries(v).filter(([, item]) => item !== undefined);
+      this.len(entries.length, 0x80, 16, [0, 0xde, 0xdf]);
+      for (const [key, item] of entries) {
+        this.string(key);
+        this.value(item);
+      }
+    }
+  }
+}
+
+/** Encode a JSON value as MessagePack */
+export function encode(value) {
+  const writer = new Writer();
+  writer.value(value);
+  return writer.buffer.subarray(0, writer.at);
+}
+
+class Reader {
+  constructor(bytes) {
+    this.bytes = bytes;
+    this.view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    this.at = 0;
+  }
+
+  take(n) {
+    if (this.at + n > this.bytes.length) {
+      throw new Error('MessagePack ends in the middle of a value');
+    }
+    const at = this.at;
+    this.at += n;
+    return at;
+  }
+
+  u8() { return this.view.getUint8(this.take(1)); }
+  u16() { return this.view.getUint16(this.take(2)); }
+  u32() { return this.view.getUint32(this.take(4)); }
+
+  string(n) {
+    const at = this.take(n);
+    return this.bytes.toString('utf8', at, at + n);
+  }
+
+  array(n) {
+    const items = new Array(n);
+    for (let i = 0; i < n; i++) items[i] = this.value();
+    return items;
+  }
+
+  map(n) {
+    const map = {};
+    for (let i = 0; i < n; i++) {
+      const key = this.value();
+      if (typeof key !== 'string') throw new Error(`MessagePack map key ${key} isn't a string`);
+      map[key] = this.value();
+    }
+    return map;
+  }
+
+  bin(n) {
+    const at = this.take(n);
+    return this.bytes.subarray(at, at + n);
+  }
+
+  value() {
+    const m = this.u8();
+    if (m <= 0x7f) return m;
+    if (m >= 0xe0) return m - 0x100;
+    if ((m & 0xe0) === 0xa0) return this.string(m & 0x1f);
+    if ((m & 0xf0) === 0x90) return this.array(m & 0x0f);
+    if ((m & 0xf0) === 0x80) return this.map(m & 0x0f);
+    switch (m) {
+      case 0xc0: return null;
+      case 0xc2: return false;
+      case 0xc3: return true;
+      case 0xc4: return this.bin(this.u8());
+      case 0xc5: return this.bin(this.u16());
+      case 0xc6: return this.bin(this.u32());
+      case 0xca: return this.view.getFloat32(this.take(4));
+      case 0xcb: return this.view.getFloat64(this.take(8));
+      case 0xcc: return this.u8();
+      case 0xcd: return this.u16();
+      case 0xce: return this.u32();
+      case 0xcf: return Number(this.view.getBigUint64(this.take(8)));
+      case 0xd0: return this.view.getInt8(this.take(1));
+      case 0xd1: return this.view.getInt16(this.take(2));
+      case 0xd2: return this.view.getInt32(this.take(4));
+      case 0xd3: return Number(this.view.getBigInt64(this.take(8)));
+      case 0xd9: return this.string(this.u8());
+      case 0xda: return this.string(this.u16());
+      case 0xdb: return this.string(this.u32());
+      case 0xdc: return this.array(this.u16());
+      case 0xdd: return this.array(this.u32());
+      case 0xde: return this.map(this.u16());
+      case 0xdf: return this.map(this.u32());
+      default:
+        throw new Error(`MessagePack type 0x${m.toString(16)} isn't supported`);
+    }
+  }
+}
+
+/** Decode one MessagePack value, which must be all of bytes (a Buffer) */
+export function decode(bytes) {
+  const reader = new Reader(bytes);
+  const value = reader.value();
+  if (reader.at !== bytes.length) {
+    throw new Error(`MessagePack has ${bytes.length - reader.at} bytes left over after its value`);
+  }
+  return value;
+}
+
+/**
+ * Little-endian float 64s as a Float64Array: over the same memory when it's
+ * aligned for one, or else copied
+ */
+export function float64s(bytes) {
+  const n = Math.floor(bytes.length / 8);
+  if (LITTLE_ENDIAN && bytes.byteOffset % 8 === 0) {
+    return new Float64Array(bytes.buffer, bytes.byteOffset, n);
+  }
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  const out = new Float64Array(n);
+  for (let i = 0; i < n; i++) out[i] = view.getFloat64(i * 8, true);
+  return out;
+}